@@ -4,6 +4,7 @@
 
 #include "m_pd.h"
 #include <math.h>
+#include <string.h>
 #define DIM 4
 #define FLOAT double
 
@@ -13,15 +14,24 @@ doubles the computation time, so it's only compiled in for testing. */
 
 /* #define CALCERROR */
 
+/* Voices are integrated up to LANES at a time: the state and inputs of a
+group of voices are stored lane by lane so that each step of the solver is a
+short loop over the lanes, which the compiler can turn into vector
+instructions.  A multichannel input gets one voice per channel. */
+
+#define LANES 4
+
 typedef struct _params
 {
-    FLOAT p_input;
-    FLOAT p_cutoff;
-    FLOAT p_resonance;
+    FLOAT p_input[LANES];
+    FLOAT p_k[LANES];           /* 2 pi times cutoff frequency */
+    FLOAT p_resonance[LANES];
     FLOAT p_saturation;
-    FLOAT p_derivativeswere[DIM];
+    FLOAT p_saturationinverse;
 } t_params;
 
+typedef FLOAT t_lanes[DIM][LANES];
+
     /* imitate the (tanh) clipping function of a transistor pair.  We
     hope/assume the C compiler is smart enough to inline this so use
     a function instead of a #define. */
@@ -44,86 +54,100 @@ static FLOAT clip(FLOAT value, FLOAT saturation, FLOAT saturationinverse)
 }
 #endif
 
-static void calc_derivatives(FLOAT *dstate, FLOAT *state, t_params *params)
+static void calc_derivatives(t_lanes dstate, t_lanes state,
+    t_params *params, int nlanes)
 {
-    FLOAT k = ((float)(2*3.14159)) * params->p_cutoff;
-    FLOAT sat = params->p_saturation, satinv = 1./sat;
-    FLOAT satstate0 = clip(state[0], sat, satinv);
-    FLOAT satstate1 = clip(state[1], sat, satinv);
-    FLOAT satstate2 = clip(state[2], sat, satinv);
-    dstate[0] = k *
-        (clip(params->p_input - params->p_resonance * state[3], sat, satinv)
-            - satstate0);
-    dstate[1] = k * (satstate0 - satstate1);
-    dstate[2] = k * (satstate1 - satstate2);
-    dstate[3] = k * (satstate2 - clip(state[3], sat, satinv));
+    FLOAT sat = params->p_saturation, satinv = params->p_saturationinverse;
+    int l;
+    for (l = 0; l < nlanes; l++)
+    {
+        FLOAT k = params->p_k[l];
+        FLOAT satstate0 = clip(state[0][l], sat, satinv);
+        FLOAT satstate1 = clip(state[1][l], sat, satinv);
+        FLOAT satstate2 = clip(state[2][l], sat, satinv);
+        dstate[0][l] = k * (clip(params->p_input[l] -
+            params->p_resonance[l] * state[3][l], sat, satinv) - satstate0);
+        dstate[1][l] = k * (satstate0 - satstate1);
+        dstate[2][l] = k * (satstate1 - satstate2);
+        dstate[3][l] = k * (satstate2 - clip(state[3][l], sat, satinv));
+    }
 }
 
-static void solver_euler(FLOAT *state, FLOAT *errorestimate, 
-    FLOAT stepsize, t_params *params)
+    /* tempstate = state + stepsize * deriv */
+static void calc_step(t_lanes tempstate, t_lanes state, t_lanes deriv,
+    FLOAT stepsize, int nlanes)
 {
-    FLOAT cumerror = 0;
-    int i;
-    FLOAT derivatives[DIM];
-    calc_derivatives(derivatives, state, params);
-    *errorestimate = 0;
+    int i, l;
     for (i = 0; i < DIM; i++)
-    {
-        state[i] += stepsize * derivatives[i];
-        *errorestimate += (derivatives[i] > params->p_derivativeswere[i] ?
-            derivatives[i] - params->p_derivativeswere[i] :
-            params->p_derivativeswere[i] - derivatives[i]);
-    }
-    for (i = 0; i < DIM; i++)
-        params->p_derivativeswere[i] = derivatives[i];
+        for (l = 0; l < nlanes; l++)
+            tempstate[i][l] = state[i][l] + stepsize * deriv[i][l];
 }
 
-static void solver_rungekutte(FLOAT *state, FLOAT *errorestimate, 
-    FLOAT stepsize, t_params *params)
+    /* a cheaper fixed-step solver: the midpoint method evaluates the
+    derivatives twice per step instead of four times, but its error per step
+    is third order in the step size as against fifth for Runge-Kutte, so it
+    wants more oversampling for the same accuracy; see the help file for
+    some measurements. */
+static void solver_midpoint(t_lanes state, FLOAT *errorestimate,
+    FLOAT stepsize, t_params *params, int nlanes)
 {
-    FLOAT cumerror = 0;
-    int i;
-    FLOAT deriv1[DIM], deriv2[DIM], deriv3[DIM], deriv4[DIM], tempstate[DIM];
-    FLOAT oldstate[DIM], backstate[DIM];
-#if CALCERROR
+    t_lanes deriv1, deriv2, tempstate;
+    calc_derivatives(deriv1, state, params, nlanes);
+    calc_step(tempstate, state, deriv1, 0.5 * stepsize, nlanes);
+    calc_derivatives(deriv2, tempstate, params, nlanes);
+    calc_step(state, state, deriv2, stepsize, nlanes);
+    *errorestimate = 0;
+}
+
+static void solver_rungekutte(t_lanes state, FLOAT *errorestimate,
+    FLOAT stepsize, t_params *params, int nlanes)
+{
+    int i, l;
+    t_lanes deriv1, deriv2, deriv3, deriv4, tempstate;
+#ifdef CALCERROR
+    t_lanes oldstate;
     for (i = 0; i < DIM; i++)
-        oldstate[i] = state[i];
+        for (l = 0; l < nlanes; l++)
+            oldstate[i][l] = state[i][l];
 #endif
     *errorestimate = 0;
-    calc_derivatives(deriv1, state, params);
-    for (i = 0; i < DIM; i++)
-        tempstate[i] = state[i] + 0.5 * stepsize * deriv1[i];
-    calc_derivatives(deriv2, tempstate, params);
-    for (i = 0; i < DIM; i++)
-        tempstate[i] = state[i] + 0.5 * stepsize * deriv2[i];
-    calc_derivatives(deriv3, tempstate, params);
-    for (i = 0; i < DIM; i++)
-        tempstate[i] = state[i] + stepsize * deriv3[i];
-    calc_derivatives(deriv4, tempstate, params);
-    for (i = 0; i < DIM; i++)
-        state[i] += (1./6.) * stepsize * 
-            (deriv1[i] + 2 * deriv2[i] + 2 * deriv3[i] + deriv4[i]);
-#if CALCERROR
-    calc_derivatives(deriv1, state, params);
-    for (i = 0; i < DIM; i++)
-        tempstate[i] = state[i] - 0.5 * stepsize * deriv1[i];
-    calc_derivatives(deriv2, tempstate, params);
-    for (i = 0; i < DIM; i++)
-        tempstate[i] = state[i] - 0.5 * stepsize * deriv2[i];
-    calc_derivatives(deriv3, tempstate, params);
+    calc_derivatives(deriv1, state, params, nlanes);
+    calc_step(tempstate, state, deriv1, 0.5 * stepsize, nlanes);
+    calc_derivatives(deriv2, tempstate, params, nlanes);
+    calc_step(tempstate, state, deriv2, 0.5 * stepsize, nlanes);
+    calc_derivatives(deriv3, tempstate, params, nlanes);
+    calc_step(tempstate, state, deriv3, stepsize, nlanes);
+    calc_derivatives(deriv4, tempstate, params, nlanes);
     for (i = 0; i < DIM; i++)
-        tempstate[i] = state[i] - stepsize * deriv3[i];
-    calc_derivatives(deriv4, tempstate, params);
+        for (l = 0; l < nlanes; l++)
+            state[i][l] += (1./6.) * stepsize *
+                (deriv1[i][l] + 2 * deriv2[i][l] + 2 * deriv3[i][l] +
+                    deriv4[i][l]);
+#ifdef CALCERROR
+        /* step back from the new state and see how far we land from
+        the old one, summed over the lanes */
+    calc_derivatives(deriv1, state, params, nlanes);
+    calc_step(tempstate, state, deriv1, -0.5 * stepsize, nlanes);
+    calc_derivatives(deriv2, tempstate, params, nlanes);
+    calc_step(tempstate, state, deriv2, -0.5 * stepsize, nlanes);
+    calc_derivatives(deriv3, tempstate, params, nlanes);
+    calc_step(tempstate, state, deriv3, -stepsize, nlanes);
+    calc_derivatives(deriv4, tempstate, params, nlanes);
     for (i = 0; i < DIM; i++)
+        for (l = 0; l < nlanes; l++)
     {
-        backstate[i] = state[i ]- (1./6.) * stepsize * 
-            (deriv1[i] + 2 * deriv2[i] + 2 * deriv3[i] + deriv4[i]);
-        *errorestimate += (backstate[i] > oldstate[i] ?
-            backstate[i] - oldstate[i] : oldstate[i] - backstate[i]);
+        FLOAT backstate = state[i][l] - (1./6.) * stepsize *
+            (deriv1[i][l] + 2 * deriv2[i][l] + 2 * deriv3[i][l] +
+                deriv4[i][l]);
+        *errorestimate += (backstate > oldstate[i][l] ?
+            backstate - oldstate[i][l] : oldstate[i][l] - backstate);
     }
 #endif
 }
 
+typedef void (*t_solver)(t_lanes state, FLOAT *errorestimate,
+    FLOAT stepsize, t_params *params, int nlanes);
+
 typedef struct _bob
 {
     t_object x_obj;
@@ -134,7 +158,12 @@ typedef struct _bob
     FLOAT x_cumerror;
 #endif
     t_params x_params;
-    FLOAT x_state[DIM];
+    t_lanes *x_state;    /* one per group of LANES voices */
+    t_lanes x_state1;    /* x_state points here while there's one group */
+    int x_nvoices;
+    int x_ngroups;
+    int x_nchans[3];     /* channels in each of the three signal inputs */
+    t_solver x_solver;
     FLOAT x_sr;
     int x_oversample;
     int x_errorcount;
@@ -147,6 +176,7 @@ static void bob_saturation(t_bob *x, t_float saturation)
     if (saturation <= 1e-3)
         saturation = 1e-3;
     x->x_params.p_saturation = saturation;
+    x->x_params.p_saturationinverse = 1./saturation;
 }
 
 static void bob_oversample(t_bob *x, t_float oversample)
@@ -156,11 +186,56 @@ static void bob_oversample(t_bob *x, t_float oversample)
     x->x_oversample = oversample;
 }
 
+static void bob_solver(t_bob *x, t_symbol *s)
+{
+    if (!strcmp(s->s_name, "rk4"))
+        x->x_solver = solver_rungekutte;
+    else if (!strcmp(s->s_name, "midpoint"))
+        x->x_solver = solver_midpoint;
+    else pd_error(x, "bob~: solver '%s' unknown (rk4 or midpoint)",
+        s->s_name);
+}
+
 static void bob_clear(t_bob *x)
 {
-    int i;
-    for (i = 0; i < DIM; i++)
-        x->x_state[i] = x->x_params.p_derivativeswere[i] = 0;
+    memset(x->x_state, 0, x->x_ngroups * sizeof(t_lanes));
+}
+
+    /* resize the state to hold "n" voices.  Voices we already had keep
+    their state and new ones start at zero. */
+static void bob_setnvoices(t_bob *x, int n)
+{
+    int ngroups = (n + LANES - 1) / LANES, i, l;
+    if (ngroups < 1)
+        ngroups = 1;
+    if (ngroups != x->x_ngroups)
+    {
+        if (ngroups == 1)
+        {
+            memcpy(x->x_state1, x->x_state[0], sizeof(t_lanes));
+            freebytes(x->x_state, x->x_ngroups * sizeof(t_lanes));
+            x->x_state = &x->x_state1;
+        }
+        else
+        {
+            if (x->x_state == &x->x_state1)
+            {
+                x->x_state = (t_lanes *)getbytes(ngroups * sizeof(t_lanes));
+                memcpy(x->x_state[0], x->x_state1, sizeof(t_lanes));
+            }
+            else x->x_state = (t_lanes *)resizebytes(x->x_state,
+                x->x_ngroups * sizeof(t_lanes), ngroups * sizeof(t_lanes));
+            if (ngroups > x->x_ngroups)
+                memset(x->x_state + x->x_ngroups, 0,
+                    (ngroups - x->x_ngroups) * sizeof(t_lanes));
+        }
+        x->x_ngroups = ngroups;
+    }
+        /* silence lanes past the last voice */
+    for (l = n - (ngroups - 1) * LANES; l < LANES; l++)
+        for (i = 0; i < DIM; i++)
+            x->x_state[ngroups - 1][i][l] = 0;
+    x->x_nvoices = n;
 }
 
 static void bob_error(t_bob *x)
@@ -177,11 +252,19 @@ static void bob_error(t_bob *x)
 
 static void bob_print(t_bob *x)
 {
-    int i;
-    for (i = 0; i < DIM; i++)
-        post("state %d: %f", i, x->x_state[i]);
+    int i, v;
+    for (v = 0; v < x->x_nvoices; v++)
+        for (i = 0; i < DIM; i++)
+    {
+        if (x->x_nvoices > 1)
+            post("voice %d state %d: %f", v, i,
+                x->x_state[v / LANES][i][v % LANES]);
+        else post("state %d: %f", i, x->x_state[0][i][0]);
+    }
     post("saturation %f", x->x_params.p_saturation);
     post("oversample %d", x->x_oversample);
+    post("solver %s",
+        (x->x_solver == solver_rungekutte ? "rk4" : "midpoint"));
 }
 
 static void *bob_new( void)
@@ -191,8 +274,12 @@ static void *bob_new( void)
     inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
     inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
     x->x_f = 0;
+    x->x_state = &x->x_state1;
+    x->x_ngroups = 1;
+    x->x_nvoices = 1;
+    x->x_solver = solver_rungekutte;
     bob_clear(x);
-    bob_saturation(x, 3); 
+    bob_saturation(x, 3);
     bob_oversample(x, 2);
 #ifdef CALCERROR
     x->x_cumerror = 0;
@@ -202,57 +289,93 @@ static void *bob_new( void)
     return (x);
 }
 
+static void bob_free(t_bob *x)
+{
+    if (x->x_state != &x->x_state1)
+        freebytes(x->x_state, x->x_ngroups * sizeof(t_lanes));
+}
+
+    /* each voice takes the corresponding channel of each input; inputs with
+    fewer channels are reused in turn, so that a single-channel cutoff, for
+    instance, controls all the voices. */
 static t_int *bob_perform(t_int *w)
 {
     t_bob *x = (t_bob *)(w[1]);
-    t_float *in1 = (t_float *)(w[2]);
-    t_float *cutoffin = (t_float *)(w[3]);
-    t_float *resonancein = (t_float *)(w[4]);
-    t_float *out = (t_float *)(w[5]);
+    t_sample *in1 = (t_sample *)(w[2]);
+    t_sample *cutoffin = (t_sample *)(w[3]);
+    t_sample *resonancein = (t_sample *)(w[4]);
+    t_sample *out = (t_sample *)(w[5]);
+    int n = (int)(w[6]), i, j, g, l;
         /* bug fix: output is last state varable, not first */
-    double *outstate =
-        (pd_compatibilitylevel > 51? &x->x_state[3] : &x->x_state[0]);
-    int n = (int)(w[6]), i, j;
+    int outindex = (pd_compatibilitylevel > 51 ? 3 : 0);
     FLOAT stepsize = 1./(x->x_oversample * x->x_sr);
     FLOAT errorestimate;
-    for (i = 0; i < n; i++)
+    t_params *params = &x->x_params;
+    for (g = 0; g < x->x_ngroups; g++)
     {
-        x->x_params.p_input = *in1++;
-        x->x_params.p_cutoff = *cutoffin++;
-        if ((x->x_params.p_resonance = *resonancein++) < 0)
-            x->x_params.p_resonance = 0;
-        for (j = 0; j < x->x_oversample; j++)
-            solver_rungekutte(x->x_state, &errorestimate,
-                stepsize, &x->x_params);
-        *out++ = *outstate;
-#if CALCERROR
-        x->x_cumerror += errorestimate;
-        x->x_errorcount++;
+        t_sample *inp[LANES], *cutoffp[LANES], *resonancep[LANES],
+            *outp[LANES];
+        t_lanes *state = &x->x_state[g];
+        int nlanes = x->x_nvoices - g * LANES;
+        if (nlanes > LANES)
+            nlanes = LANES;
+        for (l = 0; l < nlanes; l++)
+        {
+            int v = g * LANES + l;
+            inp[l] = in1 + (v % x->x_nchans[0]) * n;
+            cutoffp[l] = cutoffin + (v % x->x_nchans[1]) * n;
+            resonancep[l] = resonancein + (v % x->x_nchans[2]) * n;
+            outp[l] = out + v * n;
+        }
+        for (i = 0; i < n; i++)
+        {
+            for (l = 0; l < nlanes; l++)
+            {
+                params->p_input[l] = inp[l][i];
+                params->p_k[l] = ((float)(2*3.14159)) * (FLOAT)cutoffp[l][i];
+                if ((params->p_resonance[l] = resonancep[l][i]) < 0)
+                    params->p_resonance[l] = 0;
+            }
+            for (j = 0; j < x->x_oversample; j++)
+                (*x->x_solver)(*state, &errorestimate, stepsize, params,
+                    nlanes);
+            for (l = 0; l < nlanes; l++)
+                outp[l][i] = (*state)[outindex][l];
+#ifdef CALCERROR
+            x->x_cumerror += errorestimate;
+            x->x_errorcount++;
 #endif
+        }
     }
     return (w+7);
 }
 
 static void bob_dsp(t_bob *x, t_signal **sp)
 {
+    int i;
     x->x_sr = sp[0]->s_sr;
+    for (i = 0; i < 3; i++)
+        x->x_nchans[i] = sp[i]->s_nchans;
+    bob_setnvoices(x, sp[3]->s_nchans);
     dsp_add(bob_perform, 6, x, sp[0]->s_vec, sp[1]->s_vec,
         sp[2]->s_vec, sp[3]->s_vec, (t_int)sp[0]->s_n);
 }
 
 void bob_tilde_setup(void)
 {
-    int i;
     bob_class = class_new(gensym("bob~"),
-        (t_newmethod)bob_new, 0, sizeof(t_bob), 0, 0);
+        (t_newmethod)bob_new, (t_method)bob_free, sizeof(t_bob), 0, 0);
     class_addmethod(bob_class, (t_method)bob_saturation, gensym("saturation"),
         A_FLOAT, 0);
     class_addmethod(bob_class, (t_method)bob_oversample, gensym("oversample"),
         A_FLOAT, 0);
+    class_addmethod(bob_class, (t_method)bob_solver, gensym("solver"),
+        A_SYMBOL, 0);
     class_addmethod(bob_class, (t_method)bob_clear, gensym("clear"), 0);
     class_addmethod(bob_class, (t_method)bob_print, gensym("print"), 0);
     class_addmethod(bob_class, (t_method)bob_error, gensym("error"), 0);
 
     class_addmethod(bob_class, (t_method)bob_dsp, gensym("dsp"), A_CANT, 0);
     CLASS_MAINSIGNALIN(bob_class, t_bob, x_f);
+    class_setmultichannel(bob_class);
 }
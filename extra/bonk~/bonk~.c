@@ -80,6 +80,7 @@ void *bonk_class;
 
 #ifdef PD
 #include "m_pd.h"
+#include "d_simd.h"
 static t_class *bonk_class;
 #endif
 
@@ -94,7 +95,7 @@ static t_class *bonk_class;
 /* ------------------------ bonk~ ----------------------------- */
 
 #define DEFNPOINTS 256
-#define MAXCHANNELS 8
+#define MAXCHANNELS 32
 #define MINPOINTS 64
 #define DEFPERIOD 128
 #define DEFNFILTERS 11
@@ -110,6 +111,7 @@ static t_class *bonk_class;
 #define DEFMINVEL 7
 #define DEFATTACKBINS 1
 #define MAXATTACKWAIT 4
+#define BONKCHUNK 4     /* inputs filtered together */
 
 typedef struct _filterkernel
 {
@@ -119,7 +121,7 @@ typedef struct _filterkernel
     int k_nhops;
     t_float k_centerfreq;        /* center frequency, bins */
     t_float k_bandwidth;         /* bandwidth, bins */
-    t_float *k_stuff;
+    t_float *k_stuff;           /* cosine then sine parts of kernel */
 } t_filterkernel;
 
 typedef struct _filterbank
@@ -194,6 +196,20 @@ typedef struct _insig
     t_sample *g_invec;           /* new input samples */
 } t_insig;
 
+    /* inputs are analyzed together in a group: normally all of them make one
+    group, but with "-separate" each is a group of its own.  The templates are
+    shared in any case. */
+typedef struct _bonkgroup
+{
+    int gr_willattack;
+    int gr_attacked;
+    int gr_pending;             /* BONK_POLL or BONK_HIT if output is due */
+    t_float gr_debouncevel;
+} t_bonkgroup;
+
+#define BONK_POLL 1
+#define BONK_HIT 2
+
 typedef struct _bonk
 {
 #ifdef PD
@@ -223,7 +239,6 @@ typedef struct _bonk
     int x_masktime;
     int x_useloudness;      /* use loudness spectra instead of power */
     t_float x_debouncedecay;
-    t_float x_debouncevel;
     double x_learndebounce; /* debounce time (in "learn" mode only) */
     int x_attackbins;       /* number of bins to wait for attack */
 
@@ -232,18 +247,18 @@ typedef struct _bonk
     t_template *x_template;
     t_insig *x_insig;                   
     int x_ninsig;
+    t_bonkgroup *x_group;
+    int x_ngroup;
+    int x_groupsize;            /* inputs per group; ninsig unless separate */
     int x_ntemplate;
     int x_infill;
     int x_countdown;
-    int x_willattack;
-    int x_attacked;
     int x_debug;
     int x_learn;
     int x_learncount;           /* countup for "learn" mode */
     int x_spew;                 /* if true, always generate output! */
     int x_maskphase;            /* phase, 0 to MASKHIST-1, for mask history */
     t_float x_sr;               /* current sample rate in Hz. */
-    int x_hit;                  /* next "tick" called because of a hit, not a poll */
 } t_bonk;
 
 #ifdef MSP
@@ -361,19 +376,18 @@ static t_filterbank *bonk_newfilterbank(int npoints, int nfilters,
         b->b_vec[i].k_centerfreq = cf;
         b->b_vec[i].k_bandwidth = bw;
         
-        for (fp = b->b_vec[i].k_stuff, j = 0; j < filterpoints; j++, fp+= 2)
+        for (fp = b->b_vec[i].k_stuff, j = 0; j < filterpoints; j++, fp++)
         {
             t_float phase = j * cf * (2*3.141592653589793 / npoints);
             t_float wphase = j * (2*3.141592653589793 / filterpoints);
             t_float window = sin(0.5*wphase);
             fp[0] = window * cos(phase);
-            fp[1] = window * sin(phase);
+            fp[filterpoints] = window * sin(phase);
             normalizer += window;
         }
         normalizer = 1/(normalizer * sqrt(nhops));
-        for (fp = b->b_vec[i].k_stuff, j = 0;
-             j < filterpoints; j++, fp+= 2)
-            fp[0] *= normalizer, fp[1] *= normalizer;
+        for (fp = b->b_vec[i].k_stuff, j = 2 * filterpoints; j--; fp++)
+            *fp *= normalizer;
 #if 0
         post("i %d  cf %.2f  bw %.2f  nhops %d, hop %d, skip %d, npoints %d",
              i, cf, bw, nhops, hoppoints, skippoints, filterpoints);
@@ -408,14 +422,14 @@ static void bonk_freefilterbank(t_filterbank *b)
     for (i = 0; i < b->b_nfilters; i++)
         if (b->b_vec[i].k_stuff)
             freebytes(b->b_vec[i].k_stuff,
-                b->b_vec[i].k_filterpoints * sizeof(t_float));
+                2 * b->b_vec[i].k_filterpoints * sizeof(t_float));
     freebytes(b->b_vec, b->b_nfilters * sizeof(*b->b_vec));
     freebytes(b, sizeof(*b));
 }
 
 static void bonk_donew(t_bonk *x, int npoints, int period, int nsig, 
     int nfilters, t_float halftones, t_float overlap, t_float firstbin,
-    t_float minbandwidth, t_float samplerate)
+    t_float minbandwidth, t_float samplerate, int separate)
 {
     int i, j;
     t_hist *h;
@@ -438,14 +452,21 @@ static void bonk_donew(t_bonk *x, int npoints, int period, int nsig,
     x->x_npoints = npoints;
     x->x_period = period;
     x->x_ninsig = nsig;
+    x->x_groupsize = (separate ? 1 : nsig);
+    x->x_ngroup = nsig / x->x_groupsize;
+    x->x_group = (t_bonkgroup *)getbytes(x->x_ngroup * sizeof(*x->x_group));
+    for (j = 0; j < x->x_ngroup; j++)
+    {
+        x->x_group[j].gr_willattack = x->x_group[j].gr_attacked =
+            x->x_group[j].gr_pending = 0;
+        x->x_group[j].gr_debouncevel = 0;
+    }
     x->x_nfilters = nfilters;
     x->x_halftones = halftones;
     x->x_template = (t_template *)getbytes(0);
     x->x_ntemplate = 0;
     x->x_infill = 0;
     x->x_countdown = 0;
-    x->x_willattack = 0;
-    x->x_attacked = 0;
     x->x_maskphase = 0;
     x->x_debug = 0;
     x->x_hithresh = DEFHITHRESH;
@@ -458,11 +479,9 @@ static void bonk_donew(t_bonk *x, int npoints, int period, int nsig,
     x->x_debouncedecay = DEFDEBOUNCEDECAY;
     x->x_minvel = DEFMINVEL;
     x->x_useloudness = 0;
-    x->x_debouncevel = 0;
     x->x_attackbins = DEFATTACKBINS;
     x->x_sr = samplerate;
     x->x_filterbank = 0;
-    x->x_hit = 0;
     for (fb = bonk_filterbanklist; fb; fb = fb->b_next)
         if (fb->b_nfilters == x->x_nfilters &&
             fb->b_halftones == x->x_halftones &&
@@ -481,55 +500,193 @@ static void bonk_donew(t_bonk *x, int npoints, int period, int nsig,
                 x->x_filterbank->b_refcount++;
 }
 
+    /* correlate "nch" input buffers (up to BONKCHUNK of them) with the real
+    and imaginary parts of a kernel.  The kernel is read only once for all of
+    them; inner loops go four points at a time when we have SIMD. */
+static void bonk_correlate(const t_float *re, const t_float *im, int npoints,
+    t_float **in, int offset, int nch, t_float *rsum, t_float *isum)
+{
+    int c, j = 0;
+    for (c = 0; c < nch; c++)
+        rsum[c] = isum[c] = 0;
+#ifdef PD_SIMD
+    if (npoints >= 4)
+    {
+        t_v4 r[BONKCHUNK], s[BONKCHUNK];
+        t_float tmp[4];
+        for (c = 0; c < nch; c++)
+            r[c] = s[c] = V4_ZERO();
+        for (; j + 4 <= npoints; j += 4)
+        {
+            t_v4 kr = V4_LOAD(re + j), ki = V4_LOAD(im + j);
+            for (c = 0; c < nch; c++)
+            {
+                t_v4 g = V4_LOAD(in[c] + offset + j);
+                r[c] = V4_ADD(r[c], V4_MUL(g, kr));
+                s[c] = V4_ADD(s[c], V4_MUL(g, ki));
+            }
+        }
+        for (c = 0; c < nch; c++)
+        {
+            V4_STORE(tmp, r[c]);
+            rsum[c] = tmp[0] + tmp[1] + tmp[2] + tmp[3];
+            V4_STORE(tmp, s[c]);
+            isum[c] = tmp[0] + tmp[1] + tmp[2] + tmp[3];
+        }
+    }
+#endif
+    for (c = 0; c < nch; c++)
+    {
+        const t_float *fp = in[c] + offset;
+        t_float rs = 0, is = 0;
+        int k;
+        for (k = j; k < npoints; k++)
+            rs += fp[k] * re[k], is += fp[k] * im[k];
+        rsum[c] += rs;
+        isum[c] += is;
+    }
+}
+
+    /* compute the power in each filter for each input, into "power" (input
+    by input, nfilters each).  Inputs are taken BONKCHUNK at a time so that
+    the kernels are read once for all of them. */
+static void bonk_filterpowers(t_bonk *x, t_float *power)
+{
+    int i, ch, c, n, ninsig = x->x_ninsig, nfilters = x->x_nfilters;
+    t_filterkernel *k;
+    for (i = 0, k = x->x_filterbank->b_vec; i < nfilters; i++, k++)
+    {
+        int filterpoints = k->k_filterpoints;
+            /* if the user asked for more filters that fit under the
+             Nyquist frequency, some filters won't actually be filled in
+             so we skip running them. */
+        if (!filterpoints)
+        {
+            for (ch = 0; ch < ninsig; ch++)
+                power[ch * nfilters + i] = 0;
+            continue;
+        }
+        for (ch = 0; ch < ninsig; ch += BONKCHUNK)
+        {
+            int nch = (ninsig - ch < BONKCHUNK ? ninsig - ch : BONKCHUNK);
+            t_float *in[BONKCHUNK], rsum[BONKCHUNK], isum[BONKCHUNK],
+                pow[BONKCHUNK];
+            for (c = 0; c < nch; c++)
+                in[c] = x->x_insig[ch + c].g_inbuf, pow[c] = 0;
+                /* run the filter repeatedly, sliding it forward by
+                hoppoints, for nhop times */
+            for (n = 0; n < k->k_nhops; n++)
+            {
+                bonk_correlate(k->k_stuff, k->k_stuff + filterpoints,
+                    filterpoints, in, k->k_skippoints + n * k->k_hoppoints,
+                        nch, rsum, isum);
+                for (c = 0; c < nch; c++)
+                    pow[c] += rsum[c] * rsum[c] + isum[c] * isum[c];
+            }
+            for (c = 0; c < nch; c++)
+                power[(ch + c) * nfilters + i] = pow[c];
+        }
+    }
+}
+
+    /* dot product of a template with the powers for one input */
+static t_float bonk_dot(const t_float *a, const t_float *b, int n)
+{
+    t_float sum = 0;
+    int j = 0;
+#ifdef PD_SIMD
+    if (n >= 4)
+    {
+        t_v4 acc = V4_ZERO();
+        t_float tmp[4];
+        for (; j + 4 <= n; j += 4)
+            acc = V4_ADD(acc, V4_MUL(V4_LOAD(a + j), V4_LOAD(b + j)));
+        V4_STORE(tmp, acc);
+        sum = tmp[0] + tmp[1] + tmp[2] + tmp[3];
+    }
+#endif
+    for (; j < n; j++)
+        sum += a[j] * b[j];
+    return (sum);
+}
+
+    /* output the analysis for each group of inputs that has output pending.
+    Hits are matched against the templates in one pass for all groups, so
+    that simultaneous hits on several inputs share reading the templates. */
 static void bonk_tick(t_bonk *x)
 {
-    t_atom at[MAXNFILTERS], *ap, at2[3];
-    int i, j, k, n;
+    t_atom at[MAXNFILTERS], *ap, at2[4];
+    int i, j, n, g;
     t_hist *h;
-    t_float *pp, vel = 0., temperature = 0.;
-    t_float *fp;
+    t_float *pp, *fp;
     t_template *tp;
-    int nfit, ninsig = x->x_ninsig, ntemplate = x->x_ntemplate, nfilters = x->x_nfilters;
+    int ninsig = x->x_ninsig, ntemplate, nfilters = x->x_nfilters,
+        groupsize = x->x_groupsize, ngroup = x->x_ngroup;
     t_insig *gp;
+    t_bonkgroup *gr;
 #ifdef _MSC_VER
-    t_float powerout[MAXNFILTERS*MAXCHANNELS];
+    t_float powerout[MAXNFILTERS*MAXCHANNELS], vel[MAXCHANNELS],
+        temperature[MAXCHANNELS], bestfit[MAXCHANNELS];
+    int nfit[MAXCHANNELS], what[MAXCHANNELS];
 #else
-    t_float *powerout = alloca(x->x_nfilters * x->x_ninsig * sizeof(*powerout));
+    t_float *powerout = alloca(nfilters * ninsig * sizeof(*powerout)),
+        *vel = alloca(ngroup * sizeof(*vel)),
+        *temperature = alloca(ngroup * sizeof(*temperature)),
+        *bestfit = alloca(ngroup * sizeof(*bestfit));
+    int *nfit = alloca(ngroup * sizeof(*nfit)),
+        *what = alloca(ngroup * sizeof(*what));
 #endif
-    
-    for (i = ninsig, pp = powerout, gp = x->x_insig; i--; gp++)
+
+        /* take what's pending now; outputs below might ask for more */
+    for (g = 0, gr = x->x_group; g < ngroup; g++, gr++)
+        what[g] = gr->gr_pending, gr->gr_pending = 0;
+    for (g = 0, gr = x->x_group; g < ngroup; g++, gr++)
     {
-        for (j = 0, h = gp->g_hist; j < nfilters; j++, h++, pp++)
+        int first = g * groupsize;
+        t_float v = 0, temp = 0;
+        if (!what[g])
+            continue;
+        for (n = 0, gp = x->x_insig + first, pp = powerout + first * nfilters;
+            n < groupsize; n++, gp++)
         {
-            t_float power = h->h_outpower;
-            t_float intensity = *pp = (power > 0. ? 100. * qrsqrt(qrsqrt(power)) : 0.);
-            vel += intensity;
-            temperature += intensity * (t_float)j;
+            for (j = 0, h = gp->g_hist; j < nfilters; j++, h++, pp++)
+            {
+                t_float power = h->h_outpower;
+                t_float intensity = *pp =
+                    (power > 0. ? 100. * qrsqrt(qrsqrt(power)) : 0.);
+                v += intensity;
+                temp += intensity * (t_float)j;
+            }
         }
-    }
-    if (vel > 0) temperature /= vel;
-    else temperature = 0;
-    vel *= 0.5 / ninsig;        /* fudge factor */
-    if (x->x_hit)
-    {
-        /* if hit nonzero it's a clock callback.  if in "learn" mode update the
-         template list; in any event match the hit to known templates. */
-        
-        if (vel < x->x_debouncevel)
+        if (v > 0) temp /= v;
+        else temp = 0;
+        v *= 0.5 / groupsize;       /* fudge factor */
+        vel[g] = v;
+        temperature[g] = temp;
+        nfit[g] = -1;   /* a poll ("bang" or spew) rather than a hit */
+        if (what[g] != BONK_HIT)
+            continue;
+
+        /* if in "learn" mode update the template list; in any event match
+        the hit to known templates. */
+        if (v < gr->gr_debouncevel)
         {
             if (x->x_debug)
                 post("bounce cancelled: vel %f debounce %f",
-                     vel, x->x_debouncevel);
-            return;
+                     v, gr->gr_debouncevel);
+            what[g] = 0;
+            continue;
         }
-        if (vel < x->x_minvel)
+        if (v < x->x_minvel)
         {
             if (x->x_debug)
                 post("low velocity cancelled: vel %f, minvel %f",
-                     vel, x->x_minvel);
-            return;
+                     v, x->x_minvel);
+            what[g] = 0;
+            continue;
         }
-        x->x_debouncevel = vel;
+        gr->gr_debouncevel = v;
+        ntemplate = x->x_ntemplate;
         if (x->x_learn)
         {
             double lasttime = x->x_learndebounce;
@@ -539,108 +696,127 @@ static void bonk_tick(t_bonk *x)
                 int countup = x->x_learncount;
                 /* normalize to 100  */
                 t_float norm;
-                for (i = nfilters * ninsig, norm = 0, pp = powerout; i--; pp++)
-                    norm += *pp * *pp;
+                for (i = nfilters * groupsize, norm = 0,
+                    pp = powerout + first * nfilters; i--; pp++)
+                        norm += *pp * *pp;
                 if (norm < 1.0e-15) norm = 1.0e-15;
                 norm = 100. * qrsqrt(norm);
                 /* check if this is the first strike for a new template */
                 if (!countup)
                 {
                     int oldn = ntemplate;
-                    x->x_ntemplate = ntemplate = oldn + ninsig;
+                    x->x_ntemplate = ntemplate = oldn + groupsize;
                     x->x_template = (t_template *)t_resizebytes(x->x_template,
                         oldn * sizeof(x->x_template[0]),
                             ntemplate * sizeof(x->x_template[0]));
-                    for (i = ninsig, pp = powerout; i--; oldn++)
-                        for (j = nfilters, fp = x->x_template[oldn].t_amp; j--;
-                             pp++, fp++)
-                                *fp = *pp * norm;
+                    for (i = groupsize, pp = powerout + first * nfilters;
+                        i--; oldn++)
+                            for (j = nfilters, fp = x->x_template[oldn].t_amp;
+                                j--; pp++, fp++)
+                                    *fp = *pp * norm;
                 }
                 else
                 {
-                    int oldn = ntemplate - ninsig;
+                    int oldn = ntemplate - groupsize;
                     if (oldn < 0) post("bonk_tick bug");
-                    for (i = ninsig, pp = powerout; i--; oldn++)
+                    for (i = groupsize, pp = powerout + first * nfilters;
+                        i--; oldn++)
                     {
-                        for (j = nfilters, fp = x->x_template[oldn].t_amp; j--;
-                             pp++, fp++)
-                            *fp = (countup * *fp + *pp * norm)
-                            /(countup + 1.0);
+                        for (j = nfilters, fp = x->x_template[oldn].t_amp;
+                            j--; pp++, fp++)
+                                *fp = (countup * *fp + *pp * norm)
+                                    /(countup + 1.0);
                     }
                 }
                 countup++;
                 if (countup == x->x_learn) countup = 0;
                 x->x_learncount = countup;
             }
-            else return;
+            else
+            {
+                what[g] = 0;
+                continue;
+            }
         }
         x->x_learndebounce = clock_getsystime();
-        if (ntemplate)
+        nfit[g] = 0;
+        bestfit[g] = -1e30;
+    }
+
+        /* match all the hits against the templates, reading each template
+        once for all of them */
+    ntemplate = x->x_ntemplate;
+    for (i = 0, tp = x->x_template; i * groupsize < ntemplate;
+        i++, tp += groupsize)
+    {
+        for (g = 0; g < ngroup; g++)
         {
-            t_float bestfit = -1e30;
-            int templatecount;
-            nfit = -1;
-            for (i = 0, templatecount = 0, tp = x->x_template; 
-                 templatecount < ntemplate; i++)
+            t_float dotprod = 0;
+            if (what[g] != BONK_HIT)
+                continue;
+            for (n = 0, pp = powerout + g * groupsize * nfilters;
+                n < groupsize && i * groupsize + n < ntemplate;
+                    n++, pp += nfilters)
+                        dotprod += bonk_dot(tp[n].t_amp, pp, nfilters);
+            if (dotprod > bestfit[g])
             {
-                t_float dotprod = 0;
-                for (k = 0, pp = powerout;
-                     k < ninsig && templatecount < ntemplate;
-                     k++, tp++, templatecount++)
-                {
-                    for (j = nfilters, fp = tp->t_amp;
-                         j--; fp++, pp++)
-                    {
-                        if (*fp < 0 || *pp < 0) post("bonk_tick bug 2");
-                        dotprod += *fp * *pp;
-                    }
-                }
-                if (dotprod > bestfit)
-                {
-                    bestfit = dotprod;
-                    nfit = i;
-                }
+                bestfit[g] = dotprod;
+                nfit[g] = i;
             }
-            if (nfit < 0) post("bonk_tick bug");
         }
-        else nfit = 0;
     }
-    else nfit = -1;     /* hit is zero; this is the "bang" method. */
-    
-    x->x_attacked = 1;
-    if (x->x_debug)
-        post("bonk out: number %d, vel %f, temperature %f",
-            nfit, vel, temperature);
-    
-    SETFLOAT(at2, nfit);
-    SETFLOAT(at2+1, vel);
-    SETFLOAT(at2+2, temperature);
-    outlet_list(x->x_cookedout, 0, 3, at2);
-    
-    for (n = 0, gp = x->x_insig + (ninsig-1),
-        pp = powerout + nfilters * (ninsig-1); n < ninsig;
-            n++, gp--, pp -= nfilters)
+
+    for (g = 0, gr = x->x_group; g < ngroup; g++, gr++)
     {
-        t_float *pp2;
-        for (i = 0, ap = at, pp2 = pp; i < nfilters;
-            i++, ap++, pp2++)
+        int first = g * groupsize;
+        if (!what[g])
+            continue;
+        gr->gr_attacked = 1;
+        if (x->x_debug)
+            post("bonk out: number %d, vel %f, temperature %f",
+                nfit[g], vel[g], temperature[g]);
+            /* with separate inputs the input number comes first */
+        ap = at2;
+        if (x->x_ngroup > 1)
+            SETFLOAT(ap, g), ap++;
+        SETFLOAT(ap, nfit[g]);
+        SETFLOAT(ap+1, vel[g]);
+        SETFLOAT(ap+2, temperature[g]);
+        outlet_list(x->x_cookedout, 0, (int)(ap - at2) + 3, at2);
+
+        for (n = 0, gp = x->x_insig + (first + groupsize - 1),
+            pp = powerout + nfilters * (first + groupsize - 1); n < groupsize;
+                n++, gp--, pp -= nfilters)
         {
-            ap->a_type = A_FLOAT;
-            ap->a_w.w_float = *pp2;
+            t_float *pp2;
+            for (i = 0, ap = at, pp2 = pp; i < nfilters;
+                i++, ap++, pp2++)
+            {
+                ap->a_type = A_FLOAT;
+                ap->a_w.w_float = *pp2;
+            }
+            outlet_list(gp->g_outlet, 0, nfilters, at);
         }
-        outlet_list(gp->g_outlet, 0, nfilters, at);
     }
 }
 
 static void bonk_doit(t_bonk *x)
 {
-    int i, j, ch, n;
+    int i, ch, g;
     t_filterkernel *k;
     t_hist *h;
-    t_float growth = 0, *fp1, *fp3, *fp4, hithresh, lothresh;
+    t_float *pp, hithresh, lothresh;
     int ninsig = x->x_ninsig, nfilters = x->x_nfilters,
+        groupsize = x->x_groupsize, ngroup = x->x_ngroup,
         maskphase = x->x_maskphase, nextphase, oldmaskphase;
     t_insig *gp;
+    t_bonkgroup *gr;
+#ifdef _MSC_VER
+    t_float powers[MAXNFILTERS*MAXCHANNELS], growths[MAXCHANNELS];
+#else
+    t_float *powers = alloca(nfilters * ninsig * sizeof(*powers)),
+        *growths = alloca(ngroup * sizeof(*growths));
+#endif
     nextphase = maskphase + 1;
     if (nextphase >= MASKHIST)
         nextphase = 0;
@@ -652,50 +828,37 @@ static void bonk_doit(t_bonk *x)
         hithresh = qrsqrt(qrsqrt(x->x_hithresh)),
         lothresh = qrsqrt(qrsqrt(x->x_lothresh));
     else hithresh = x->x_hithresh, lothresh = x->x_lothresh;
-    for (ch = 0, gp = x->x_insig; ch < ninsig; ch++, gp++)
+    bonk_filterpowers(x, powers);
+    for (g = 0; g < ngroup; g++)
+        growths[g] = 0;
+    for (ch = 0, gp = x->x_insig, pp = powers; ch < ninsig; ch++, gp++)
     {
+        t_float *growth = &growths[ch / groupsize];
+        gr = &x->x_group[ch / groupsize];
         for (i = 0, k = x->x_filterbank->b_vec, h = gp->g_hist;
-             i < nfilters; i++, k++, h++)
+             i < nfilters; i++, k++, h++, pp++)
         {
-            t_float power = 0, maskpow = h->h_mask[maskphase];
-            t_float *inbuf= gp->g_inbuf + k->k_skippoints;
+            t_float power = *pp, maskpow = h->h_mask[maskphase];
             int countup = h->h_countup;
-            int filterpoints = k->k_filterpoints;
-            /* if the user asked for more filters that fit under the
-             Nyquist frequency, some filters won't actually be filled in
-             so we skip running them. */
-            if  (!filterpoints)
+            if  (!k->k_filterpoints)
             {
                 h->h_countup = 0;
                 h->h_mask[nextphase] = 0;
                 h->h_power = 0;
                 continue;
             }
-            /* run the filter repeatedly, sliding it forward by hoppoints,
-             for nhop times */
-            for (fp1 = inbuf, n = 0;
-                 n < k->k_nhops; fp1 += k->k_hoppoints, n++)
-            {
-                t_float rsum = 0, isum = 0;
-                for (fp3 = fp1, fp4 = k->k_stuff, j = filterpoints; j--;)
-                {
-                    t_float g = *fp3++;
-                    rsum += g * *fp4++;
-                    isum += g * *fp4++;
-                }
-                power += rsum * rsum + isum * isum;
-            }
-            if (!x->x_willattack) 
+            if (!gr->gr_willattack)
                 h->h_before = maskpow;
             
             if (power > h->h_mask[oldmaskphase])
             {
                 if (x->x_useloudness)
-                    growth += qrsqrt(qrsqrt(
+                    *growth += qrsqrt(qrsqrt(
                         power/(h->h_mask[oldmaskphase] + 1.0e-15))) - 1.;
-                else growth += power/(h->h_mask[oldmaskphase] + 1.0e-15) - 1.;
+                else *growth +=
+                    power/(h->h_mask[oldmaskphase] + 1.0e-15) - 1.;
             }
-            if (!x->x_willattack && countup >= x->x_masktime)
+            if (!gr->gr_willattack && countup >= x->x_masktime)
                 maskpow *= x->x_maskdecay;
             
             if (power > maskpow)
@@ -709,44 +872,50 @@ static void bonk_doit(t_bonk *x)
             h->h_power = power;
         }
     }
-    if (x->x_willattack)
+    for (g = 0, gr = x->x_group; g < ngroup; g++, gr++)
     {
-        if (x->x_willattack > MAXATTACKWAIT || growth < x->x_lothresh)
+        int first = g * groupsize;
+        t_float growth = growths[g];
+        if (gr->gr_willattack)
         {
-            /* if haven't yet, and if not in spew mode, report a hit */
-            if (!x->x_spew && !x->x_attacked)
+            if (gr->gr_willattack > MAXATTACKWAIT || growth < x->x_lothresh)
             {
-                for (ch = 0, gp = x->x_insig; ch < ninsig; ch++, gp++)
-                    for (i = nfilters, h = gp->g_hist; i--; h++)
-                        h->h_outpower = h->h_mask[nextphase];
-                x->x_hit = 1;
-                clock_delay(x->x_clock, 0);
+                /* if haven't yet, and if not in spew mode, report a hit */
+                if (!x->x_spew && !gr->gr_attacked)
+                {
+                    for (ch = 0, gp = x->x_insig + first; ch < groupsize;
+                        ch++, gp++)
+                            for (i = nfilters, h = gp->g_hist; i--; h++)
+                                h->h_outpower = h->h_mask[nextphase];
+                    gr->gr_pending = BONK_HIT;
+                    clock_delay(x->x_clock, 0);
+                }
             }
+            if (growth < x->x_lothresh)
+                gr->gr_willattack = 0;
+            else gr->gr_willattack++;
         }
-        if (growth < x->x_lothresh)
-            x->x_willattack = 0;
-        else x->x_willattack++;
-    }
-    else if (growth > x->x_hithresh)
-    {
-        if (x->x_debug) post("attack: growth = %f", growth);
-        x->x_willattack = 1;
-        x->x_attacked = 0;
-        for (ch = 0, gp = x->x_insig; ch < ninsig; ch++, gp++)
-            for (i = nfilters, h = gp->g_hist; i--; h++)
-                h->h_mask[nextphase] = h->h_power, h->h_countup = 0;
-    }
-    
-    /* if in "spew" mode just always output */
-    if (x->x_spew)
-    {
-        for (ch = 0, gp = x->x_insig; ch < ninsig; ch++, gp++)
-            for (i = nfilters, h = gp->g_hist; i--; h++)
-                h->h_outpower = h->h_power;
-        x->x_hit = 0;
-        clock_delay(x->x_clock, 0);
+        else if (growth > x->x_hithresh)
+        {
+            if (x->x_debug) post("attack: growth = %f", growth);
+            gr->gr_willattack = 1;
+            gr->gr_attacked = 0;
+            for (ch = 0, gp = x->x_insig + first; ch < groupsize; ch++, gp++)
+                for (i = nfilters, h = gp->g_hist; i--; h++)
+                    h->h_mask[nextphase] = h->h_power, h->h_countup = 0;
+        }
+        
+        /* if in "spew" mode just always output */
+        if (x->x_spew)
+        {
+            for (ch = 0, gp = x->x_insig + first; ch < groupsize; ch++, gp++)
+                for (i = nfilters, h = gp->g_hist; i--; h++)
+                    h->h_outpower = h->h_power;
+            gr->gr_pending = BONK_POLL;
+            clock_delay(x->x_clock, 0);
+        }
+        gr->gr_debouncevel *= x->x_debouncedecay;
     }
-    x->x_debouncevel *= x->x_debouncedecay;
 }
 
 static void bonk_perform_generic(t_bonk *x, int n) {
@@ -960,7 +1129,7 @@ static void bonk_print(t_bonk *x, t_floatarg f)
 
 static void bonk_forget(t_bonk *x)
 {
-    int ntemplate = x->x_ntemplate, newn = ntemplate - x->x_ninsig;
+    int ntemplate = x->x_ntemplate, newn = ntemplate - x->x_groupsize;
     if (newn < 0) newn = 0;
     x->x_template = (t_template *)t_resizebytes(x->x_template,
         x->x_ntemplate * sizeof(x->x_template[0]),
@@ -973,7 +1142,8 @@ static void bonk_bang(t_bonk *x)
 {
     int i, ch;
     t_insig *gp;
-    x->x_hit = 0;
+    for (i = 0; i < x->x_ngroup; i++)
+        x->x_group[i].gr_pending = BONK_POLL;
     for (ch = 0, gp = x->x_insig; ch < x->x_ninsig; ch++, gp++)
     {
         t_hist *h;
@@ -1018,7 +1188,7 @@ static void bonk_read(t_bonk *x, t_symbol *s)
         ntemplate++;
     }
 nomore:
-    if ((remaining = (ntemplate % x->x_ninsig)))
+    if ((remaining = (ntemplate % x->x_groupsize)))
     {
         post("bonk_read: %d templates not a multiple of %d; dropping extras");
         x->x_template = (t_template *)t_resizebytes(x->x_template,
@@ -1124,7 +1294,7 @@ static void bonk_openfile(t_bonk *x, char *filename, short path) {
         ntemplate++;
     }
 nomore:
-    if ((remaining = (ntemplate % x->x_ninsig)))
+    if ((remaining = (ntemplate % x->x_groupsize)))
     {
         post("bonk_read: %d templates not a multiple of %d; dropping extras");
         x->x_template = (t_template *)t_resizebytes(x->x_template,
@@ -1236,6 +1406,7 @@ static void bonk_free(t_bonk *x)
     for (i = 0, gp = x->x_insig; i < ninsig; i++, gp++)
         freebytes(gp->g_inbuf, x->x_npoints * sizeof(t_float));
     freebytes(x->x_insig, ninsig * sizeof(*x->x_insig));
+    freebytes(x->x_group, x->x_ngroup * sizeof(*x->x_group));
     clock_free(x->x_clock);
     if (!--(x->x_filterbank->b_refcount))
         bonk_freefilterbank(x->x_filterbank);
@@ -1249,7 +1420,7 @@ static void *bonk_new(t_symbol *s, int argc, t_atom *argv)
 {
     t_bonk *x = (t_bonk *)pd_new(bonk_class);
     int nsig = 1, period = DEFPERIOD, npts = DEFNPOINTS,
-        nfilters = DEFNFILTERS, j;
+        nfilters = DEFNFILTERS, separate = 0, j;
     t_float halftones = DEFHALFTONES, overlap = DEFOVERLAP,
         firstbin = DEFFIRSTBIN, minbandwidth = DEFMINBANDWIDTH;
     t_insig *g;
@@ -1304,6 +1475,11 @@ static void *bonk_new(t_symbol *s, int argc, t_atom *argv)
             minbandwidth = atom_getfloatarg(1, argc, argv);
             argc -= 2; argv += 2;
         }
+        else if (!strcmp(firstarg->s_name, "-separate"))
+        {
+            separate = 1;
+            argc--; argv++;
+        }
         else if (!strcmp(firstarg->s_name, "-spew") && argc > 1)
         {
             x->x_spew = (atom_getfloatarg(1, argc, argv) != 0);
@@ -1314,7 +1490,7 @@ static void *bonk_new(t_symbol *s, int argc, t_atom *argv)
             pd_error(x,
 "usage is: bonk [-npts #] [-hop #] [-nsigs #] [-nfilters #] [-halftones #]"); 
             post(
-"... [-overlap #] [-firstbin #] [-spew #]");
+"... [-overlap #] [-firstbin #] [-minbandwidth #] [-spew #] [-separate]");
             argc = 0;
         }
     }
@@ -1345,7 +1521,7 @@ static void *bonk_new(t_symbol *s, int argc, t_atom *argv)
     }
     x->x_cookedout = outlet_new(&x->x_obj, gensym("list"));
     bonk_donew(x, npts, period, nsig, nfilters, halftones, overlap,
-        firstbin, minbandwidth, sys_getsr());
+        firstbin, minbandwidth, sys_getsr(), separate);
     return (x);
 }
 
@@ -1508,15 +1684,12 @@ static void *bonk_new(t_symbol *s, long ac, t_atom *av)
         x->x_ntemplate = 0;
         x->x_infill = 0;
         x->x_countdown = 0;
-        x->x_willattack = 0;
-        x->x_attacked = 0;
         x->x_maskphase = 0;
         x->x_debug = 0;
         x->x_learn = 0;
         x->x_learndebounce = clock_getsystime();
         x->x_learncount = 0;
         x->x_useloudness = 0;
-        x->x_debouncevel = 0;
         x->x_sr = sys_getsr();
         
         if (ac) {
@@ -1548,7 +1721,7 @@ static void *bonk_new(t_symbol *s, long ac, t_atom *av)
 
         bonk_donew(x, x->x_npoints, x->x_period, x->x_ninsig, x->x_nfilters,
             x->x_halftones, x->x_overlap, x->x_firstbin, x->x_minbandwidth,
-                sys_getsr());
+                sys_getsr(), 0);
     }
     return (x);
 }
@@ -99,6 +99,12 @@ static fts_symbol_t *dsp_symbol = 0;
 
 #ifdef PD
 #include "m_pd.h"
+    /* "async" mode analyzes in a worker thread, if we have pthreads */
+#ifndef _MSC_VER
+#define FIDDLE_ASYNC
+#include <pthread.h>
+#include <string.h>
+#endif
 #endif /* PD */
 
 #ifdef MSP
@@ -297,8 +303,27 @@ typedef struct sigfiddle                    /* instance struct */
     void *x_attackout;
     void *x_noteout;
     void *x_peakout;
+#ifdef FIDDLE_ASYNC
+    int x_async;                    /* nonzero to analyze in a worker */
+    int x_busy;                     /* worker has a frame to analyze */
+    int x_quit;                     /* worker should exit */
+    int x_pending;                  /* results not yet output */
+    t_float *x_frame;               /* copy of x_inbuf for the worker */
+    int x_nframe;                   /* size of x_frame */
+    t_clock *x_asyncclock;          /* hands frames to the worker */
+    pthread_t x_thread;
+    pthread_mutex_t x_mutex;
+    pthread_cond_t x_requestcond;   /* worker waits on this for a frame */
+    pthread_cond_t x_answercond;    /* ... and signals this when done */
+#endif
 } t_sigfiddle;
 
+#ifdef FIDDLE_ASYNC
+static void sigfiddle_wait(t_sigfiddle *x);
+#else
+#define sigfiddle_wait(x)
+#endif
+
 #if CHECKER
 t_float fiddle_checker[1024];
 #endif
@@ -358,7 +383,10 @@ t_float fiddle_ftom(t_float f)
 #define ftom fiddle_ftom
 #define mtof fiddle_mtof
 
-void sigfiddle_doit(t_sigfiddle *x)
+    /* analyze the "hop" points in "inbuf", updating the pitch history and
+    the other results that sigfiddle_bang() outputs.  In Pd's "async" mode
+    this is called from a worker thread, in which case x_nprint is zero. */
+static void sigfiddle_analyze(t_sigfiddle *x, t_float *inbuf)
 {
 #ifdef MSP
         /* prevents interrupt-level stack overflow crash with Netscape. */
@@ -393,7 +421,7 @@ void sigfiddle_doit(t_sigfiddle *x)
          * multiply the H points by a 1/4-wave complex exponential,
          * and take FFT of the result.
          */
-    for (i = 0, fp1 = x->x_inbuf, fp2 = x->x_spiral, fp3 = spect1;
+    for (i = 0, fp1 = inbuf, fp2 = x->x_spiral, fp3 = spect1;
         i < hop; i++, fp1++, fp2 += 2, fp3 += 2)
             fp3[0] = fp1[0] * fp2[0], fp3[1] = fp1[0] * fp2[1];
 
@@ -536,7 +564,7 @@ void sigfiddle_doit(t_sigfiddle *x)
     {
         checker3[2*i] = fiddle_checker[i];
         checker3[2*i + 1] = 0;
-        checker3[n + 2*i] = fiddle_checker[i] = x->x_inbuf[i];
+        checker3[n + 2*i] = fiddle_checker[i] = inbuf[i];
         checker3[n + 2*i + 1] = 0;
     }
     for (i = 2*n; i < 4*n; i++) checker3[i] = 0;
@@ -997,8 +1025,14 @@ nopow:
     x->x_dbage = 0;
 }
 
+void sigfiddle_doit(t_sigfiddle *x)
+{
+    sigfiddle_analyze(x, x->x_inbuf);
+}
+
 void sigfiddle_debug(t_sigfiddle *x)
 {
+    sigfiddle_wait(x);
     x->x_nprint = 1;
 }
 
@@ -1014,6 +1048,7 @@ void sigfiddle_print(t_sigfiddle *x)
 
 void sigfiddle_amprange(t_sigfiddle *x, t_floatarg amplo, t_floatarg amphi)
 {
+    sigfiddle_wait(x);
     if (amplo < 0) amplo = 0;
     if (amphi < amplo) amphi = amplo + 1;
     x->x_amplo = amplo;
@@ -1023,6 +1058,7 @@ void sigfiddle_amprange(t_sigfiddle *x, t_floatarg amplo, t_floatarg amphi)
 void sigfiddle_reattack(t_sigfiddle *x,
     t_floatarg attacktime, t_floatarg attackthresh)
 {
+    sigfiddle_wait(x);
     if (attacktime < 0) attacktime = 0;
     if (attackthresh <= 0) attackthresh = 1000;
     x->x_attacktime = attacktime;
@@ -1033,6 +1069,7 @@ void sigfiddle_reattack(t_sigfiddle *x,
 
 void sigfiddle_vibrato(t_sigfiddle *x, t_floatarg vibtime, t_floatarg vibdepth)
 {
+    sigfiddle_wait(x);
     if (vibtime < 0) vibtime = 0;
     if (vibdepth <= 0) vibdepth = 1000;
     x->x_vibtime = vibtime;
@@ -1044,6 +1081,7 @@ void sigfiddle_vibrato(t_sigfiddle *x, t_floatarg vibtime, t_floatarg vibdepth)
 
 void sigfiddle_npartial(t_sigfiddle *x, t_floatarg npartial)
 {
+    sigfiddle_wait(x);
     if (npartial < 0.1) npartial = 0.1;
     x->x_npartial = npartial;
 }
@@ -1077,6 +1115,7 @@ static void sigfiddle_freebird(t_sigfiddle *x)
 int sigfiddle_setnpoints(t_sigfiddle *x, t_floatarg fnpoints)
 {
     int i, npoints = fnpoints;
+    sigfiddle_wait(x);
     sigfiddle_freebird(x);
     if (npoints < MINPOINTS || npoints > MAXPOINTS)
     {
@@ -1402,8 +1441,15 @@ static t_int *fiddle_perform(t_int *w)
         *fp++ = *in++;
     if (fp == x->x_inbuf + x->x_hop)
     {
-        sigfiddle_doit(x);
         x->x_phase = 0;
+#ifdef FIDDLE_ASYNC
+        if (x->x_async)
+        {
+            clock_delay(x->x_asyncclock, 0L);
+            goto nono;
+        }
+#endif
+        sigfiddle_doit(x);
         if (x->x_auto) clock_delay(x->x_clock, 0L);
         if (x->x_nprint) x->x_nprint--;
     }
@@ -1412,8 +1458,135 @@ nono:
     return (w+4);
 }
 
+#ifdef FIDDLE_ASYNC
+/* In "async" mode the perform routine doesn't analyze the input itself but
+sets a clock, which hands a copy of it to a worker thread and outputs the
+results of the previous frame (if "auto" is on).  The output reflects the
+input one hop later than usual but is otherwise the same, since if the
+worker hasn't finished by the next frame we wait for it.  Debugging
+printout is done without the worker as post() isn't thread-safe. */
+
+void sigfiddle_bang(t_sigfiddle *x);
+
+static void *sigfiddle_worker(void *z)
+{
+    t_sigfiddle *x = (t_sigfiddle *)z;
+    pthread_mutex_lock(&x->x_mutex);
+    while (1)
+    {
+        while (!x->x_busy && !x->x_quit)
+            pthread_cond_wait(&x->x_requestcond, &x->x_mutex);
+        if (x->x_quit)
+            break;
+        pthread_mutex_unlock(&x->x_mutex);
+        sigfiddle_analyze(x, x->x_frame);
+        pthread_mutex_lock(&x->x_mutex);
+        x->x_busy = 0;
+        x->x_pending = 1;
+        pthread_cond_signal(&x->x_answercond);
+    }
+    pthread_mutex_unlock(&x->x_mutex);
+    return (0);
+}
+
+static void sigfiddle_wait(t_sigfiddle *x)
+{
+    if (!x->x_async)
+        return;
+    pthread_mutex_lock(&x->x_mutex);
+    while (x->x_busy)
+        pthread_cond_wait(&x->x_answercond, &x->x_mutex);
+    pthread_mutex_unlock(&x->x_mutex);
+}
+
+    /* output results from the worker if "auto" is on */
+static void sigfiddle_flush(t_sigfiddle *x)
+{
+    sigfiddle_wait(x);
+    if (x->x_pending)
+    {
+        x->x_pending = 0;
+        if (x->x_auto)
+            sigfiddle_bang(x);
+    }
+}
+
+static void sigfiddle_asynctick(t_sigfiddle *x)
+{
+    sigfiddle_flush(x);
+    if (!x->x_hop)
+        return;
+    if (!x->x_async || x->x_nprint)
+    {
+        sigfiddle_doit(x);
+        if (x->x_auto) sigfiddle_bang(x);
+        if (x->x_nprint) x->x_nprint--;
+        return;
+    }
+    if (x->x_nframe != x->x_hop)
+    {
+        x->x_frame = (t_float *)resizebytes(x->x_frame,
+            x->x_nframe * sizeof(t_float), x->x_hop * sizeof(t_float));
+        x->x_nframe = x->x_hop;
+    }
+    memcpy(x->x_frame, x->x_inbuf, x->x_hop * sizeof(t_float));
+    pthread_mutex_lock(&x->x_mutex);
+    x->x_busy = 1;
+    pthread_cond_signal(&x->x_requestcond);
+    pthread_mutex_unlock(&x->x_mutex);
+}
+
+void sigfiddle_async(t_sigfiddle *x, t_floatarg f)
+{
+    int onoff = (f != 0);
+    if (onoff == x->x_async)
+        return;
+    if (onoff)
+    {
+        pthread_attr_t attr;
+        int err;
+        x->x_busy = x->x_quit = x->x_pending = 0;
+        pthread_mutex_init(&x->x_mutex, 0);
+        pthread_cond_init(&x->x_requestcond, 0);
+        pthread_cond_init(&x->x_answercond, 0);
+            /* sigfiddle_doit() has big arrays on the stack */
+        pthread_attr_init(&attr);
+        pthread_attr_setstacksize(&attr, 4 * 1024 * 1024);
+        err = pthread_create(&x->x_thread, &attr, sigfiddle_worker, x);
+        pthread_attr_destroy(&attr);
+        if (err)
+        {
+            pd_error(x, "fiddle~: couldn't start worker thread");
+            pthread_cond_destroy(&x->x_answercond);
+            pthread_cond_destroy(&x->x_requestcond);
+            pthread_mutex_destroy(&x->x_mutex);
+            return;
+        }
+        x->x_async = 1;
+    }
+    else
+    {
+        sigfiddle_flush(x);
+        pthread_mutex_lock(&x->x_mutex);
+        x->x_quit = 1;
+        pthread_cond_signal(&x->x_requestcond);
+        pthread_mutex_unlock(&x->x_mutex);
+        pthread_join(x->x_thread, 0);
+        pthread_cond_destroy(&x->x_answercond);
+        pthread_cond_destroy(&x->x_requestcond);
+        pthread_mutex_destroy(&x->x_mutex);
+        if (x->x_frame)
+            freebytes(x->x_frame, x->x_nframe * sizeof(t_float));
+        x->x_frame = 0;
+        x->x_nframe = 0;
+        x->x_async = 0;
+    }
+}
+#endif /* FIDDLE_ASYNC */
+
 void sigfiddle_dsp(t_sigfiddle *x, t_signal **sp)
 {
+    sigfiddle_wait(x);
     x->x_sr = sp[0]->s_sr;
     sigfiddle_reattack(x, x->x_attacktime, x->x_attackthresh);
     sigfiddle_vibrato(x, x->x_vibtime, x->x_vibdepth);
@@ -1428,6 +1601,7 @@ void sigfiddle_bang(t_sigfiddle *x)
 {
     int i;
     t_pitchhist *ph;
+    sigfiddle_wait(x);
     if (x->x_npeakout)
     {
         int npeakout = x->x_npeakout;
@@ -1458,6 +1632,11 @@ void sigfiddle_ff(t_sigfiddle *x)               /* cleanup on free */
 {
     if (x->x_inbuf)
     {
+#ifdef FIDDLE_ASYNC
+        x->x_auto = 0;      /* don't output anything while being freed */
+        sigfiddle_async(x, 0);
+        clock_free(x->x_asyncclock);
+#endif
         freebytes(x->x_inbuf, sizeof(t_float) * x->x_hop);
         freebytes(x->x_lastanalysis, sizeof(t_float) * (2*x->x_hop + 4 * FILTSIZE));
         freebytes(x->x_spiral, sizeof(t_float) * 2*x->x_hop);
@@ -1492,6 +1671,10 @@ void *sigfiddle_new(t_floatarg npoints, t_floatarg npitch,
         x->x_peakout = outlet_new(&x->x_ob, gensym("list"));
     else x->x_peakout = 0;
     x->x_clock = clock_new(&x->x_ob.ob_pd, (t_method)sigfiddle_bang);
+#ifdef FIDDLE_ASYNC
+    x->x_async = 0;
+    x->x_asyncclock = clock_new(&x->x_ob.ob_pd, (t_method)sigfiddle_asynctick);
+#endif
     return (x);
 }
 
@@ -1518,6 +1701,10 @@ void fiddle_tilde_setup(void)
         gensym("auto"), A_FLOAT, 0);
     class_addmethod(sigfiddle_class, (t_method)sigfiddle_print,
         gensym("print"), 0);
+#ifdef FIDDLE_ASYNC
+    class_addmethod(sigfiddle_class, (t_method)sigfiddle_async,
+        gensym("async"), A_FLOAT, 0);
+#endif
     class_addmethod(sigfiddle_class, nullfn, gensym("signal"), 0);
     class_addbang(sigfiddle_class, sigfiddle_bang);
     class_addcreator((t_newmethod)sigfiddle_new, gensym("fiddle"),
@@ -14,12 +14,19 @@ outputs audio and messages. */
 #include "s_stuff.h"
 #include "m_imp.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #ifdef _WIN32
 #include <io.h>
 #include <fcntl.h>
 #endif
 
 #include "binarymsg.c"
+#include "shmemory.c"
+#ifdef PDTILDE_SHM
+#include <errno.h>
+#include <poll.h>
+#endif
 
 #if defined(__linux__) || defined(__FreeBSD__) || defined(__FreeBSD_kernel__)\
      || defined(__GNU__)
@@ -81,6 +88,160 @@ static int readbinmessage(t_binbuf *b)
     }
 }
 
+    /* a message from pd~ for some object in here */
+static void pd_extern_message(int n, t_atom *ap)
+{
+    t_pd *whom = ap[0].a_w.w_symbol->s_thing;
+    if (!whom)
+        pd_error(0, "%s: no such object", ap[0].a_w.w_symbol->s_name);
+    else if (ap[1].a_type == A_SYMBOL)
+        typedmess(whom, ap[1].a_w.w_symbol, n-2, ap+2);
+    else pd_list(whom, 0, n-1, ap+1);
+}
+
+#ifdef PDTILDE_SHM
+static t_class *pd_shmout_class;
+static t_shmheader *shm_header;
+
+    /* messages to the stdout object go here instead of to stdout */
+static void pd_shmout_anything(t_pd *dummy, t_symbol *s,
+    int argc, t_atom *argv)
+{
+    char buf[SHM_MAXMSG];
+    int n = shm_encode(buf, s, argc, argv);
+    if (n < 0)
+        fprintf(stderr, "pd-extern: message too long\n");
+    else if (!shm_ringwrite(shm_header, &shm_header->h_toparent, buf, n,
+        shm_header->h_nslots + 1))
+            fprintf(stderr, "pd-extern: output buffer overflow\n");
+}
+
+    /* wait for the parent to hand us a block; return 0 if it's gone */
+static int shm_waitgo(void)
+{
+#ifdef PDTILDE_SEM
+    struct timespec ts;
+    while (1)
+    {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec++;
+        if (!sem_timedwait(&shm_header->h_go, &ts))
+            break;
+        else if (errno == EINTR)
+            continue;
+        else if (errno != ETIMEDOUT)
+            return (0);
+        else
+        {
+                /* nothing comes in on stdin, so if it's readable the parent
+                has closed it */
+            struct pollfd pfd;
+            char c;
+            pfd.fd = 0;
+            pfd.events = POLLIN;
+            if (poll(&pfd, 1, 0) > 0 && read(0, &c, 1) <= 0)
+                return (0);
+        }
+    }
+#else
+    if (getchar() == EOF)
+        return (0);
+#endif
+    return (!shm_header->h_quit);
+}
+
+static void shm_postdone(void)
+{
+    fflush(stdout);
+#ifdef PDTILDE_SEM
+    sem_post(&shm_header->h_done);
+#else
+    putchar(A_SEMI);
+    fflush(stdout);
+#endif
+}
+
+static int pd_extern_shmsched(int fd, int chin, int chout)
+{
+    t_shmheader *h;
+    t_binbuf *b;
+    t_atom at;
+    unsigned int size;
+    int i, j, slot = 0;
+    char semi = A_SEMI;
+    if ((h = (t_shmheader *)mmap(0, sizeof(*h), PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        perror("pd-extern: mmap");
+        return (1);
+    }
+    if (h->h_magic != SHM_MAGIC)
+    {
+        fprintf(stderr, "pd-extern: bad shared memory\n");
+        return (1);
+    }
+    size = h->h_size;
+    munmap(h, sizeof(*h));
+    if ((h = (t_shmheader *)mmap(0, size, PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        perror("pd-extern: mmap");
+        return (1);
+    }
+    close(fd);
+    shm_header = h;
+    pd_shmout_class = class_new(gensym("pd~"), 0, 0, sizeof(t_pd),
+        CLASS_PD, 0);
+    class_addanything(pd_shmout_class, pd_shmout_anything);
+    pd_bind(&pd_shmout_class, gensym("#pd_shm_stdio"));
+    b = binbuf_new();
+    shm_postdone();     /* tell the parent we're up */
+    while (shm_waitgo())
+    {
+        t_sample *sp;
+        float *fp;
+            /* take messages up to the marker for this block */
+        binbuf_clear(b);
+        while (shm_getatom(h, &h->h_tochild, &at))
+        {
+            if (at.a_type != A_SEMI)
+                binbuf_add(b, 1, &at);
+            else if (!binbuf_getnatom(b))
+                break;
+            else
+            {
+                if (binbuf_getnatom(b) > 1 &&
+                    binbuf_getvec(b)->a_type == A_SYMBOL)
+                        pd_extern_message(binbuf_getnatom(b),
+                            binbuf_getvec(b));
+                binbuf_clear(b);
+            }
+        }
+        for (i = 0, sp = STUFF->st_soundin, fp = shm_slotin(h, slot);
+            i < chin; i++)
+                for (j = 0; j < DEFDACBLKSIZE; j++)
+                    *sp++ = (i < h->h_ninsig ? *fp++ : 0);
+        sched_tick();
+        sys_pollgui();
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__FreeBSD_kernel__)\
+     || defined(__GNU__)
+        pollwatchdog();
+#endif
+        for (i = 0, sp = STUFF->st_soundout, fp = shm_slotout(h, slot);
+            i < h->h_noutsig; i++)
+                for (j = 0; j < DEFDACBLKSIZE; j++)
+                    *fp++ = (i < chout ? *sp++ : 0);
+        for (i = chout*DEFDACBLKSIZE, sp = STUFF->st_soundout; i--; sp++)
+            *sp = 0;
+        shm_ringwrite(h, &h->h_toparent, &semi, 1, 0);
+        slot = (slot + 1) % h->h_nslots;
+        shm_postdone();
+    }
+    binbuf_free(b);
+    return (0);
+}
+#endif /* PDTILDE_SHM */
+
 int pd_extern_sched(char *flags)
 {
     int i, j, chin, chout, fill = 0, c, useascii = 0;
@@ -115,6 +276,13 @@ int pd_extern_sched(char *flags)
     /* fprintf(stderr, "Pd plug-in scheduler called, chans %d %d, sr %d\n",
         chin, chout, (int)rate); */
     sys_setchsr(chin, chout, as.a_srate);
+#ifdef PDTILDE_SHM
+    if (flags && flags[0] == 's')
+    {
+        binbuf_free(b);
+        return (pd_extern_shmsched(atoi(flags+1), chin, chout));
+    }
+#endif
     while (useascii ? readasciimessage(b) : readbinmessage(b) )
     {
         t_atom *ap = binbuf_getvec(b);
@@ -153,14 +321,7 @@ int pd_extern_sched(char *flags)
             fflush(stdout);
         }
         else if (n > 1 && ap[0].a_type == A_SYMBOL)
-        {
-            t_pd *whom = ap[0].a_w.w_symbol->s_thing;
-            if (!whom)
-                pd_error(0, "%s: no such object", ap[0].a_w.w_symbol->s_name);
-            else if (ap[1].a_type == A_SYMBOL)
-                typedmess(whom, ap[1].a_w.w_symbol, n-2, ap+2);
-            else pd_list(whom, 0, n-1, ap+1);
-        }
+            pd_extern_message(n, ap);
     }
     binbuf_free(b);
     return (0);
@@ -125,6 +125,9 @@ static const char *pd_tilde_dllextent[] = {
     0};
 
 #include "binarymsg.c"
+#ifdef PD
+#include "shmemory.c"
+#endif
 
 /* ------------------------ pd_tilde~ ----------------------------- */
 
@@ -159,6 +162,15 @@ typedef struct _pd_tilde
     t_pdsample **x_insig;
     t_pdsample **x_outsig;
     int x_blksize;
+#ifdef PD
+    int x_pool;                 /* take sub-processes from the pool */
+#endif
+#ifdef PDTILDE_SHM
+    int x_shm;                  /* use shared memory instead of pipes */
+    t_shmheader *x_shmheader;   /* the shared memory while running */
+    int x_sendslot;             /* slot for next block to child */
+    int x_receiveslot;          /* slot for next block back from it */
+#endif
 } t_pd_tilde;
 
 #ifdef MSP
@@ -430,12 +442,113 @@ int barf_getc(FILE *fd)
 
 #endif /* MAX */
 
+#ifdef PDTILDE_SHM
+    /* make an anonymous shared memory segment for the subprocess to inherit;
+    returns the file descriptor or -1 on failure */
+static int pd_tilde_shmcreate(t_pd_tilde *x, int ninsig, int noutsig,
+    int nslots)
+{
+    static int count;
+    char name[80];
+    unsigned int size = shm_getsize(ninsig, noutsig, nslots);
+    t_shmheader *h;
+    int fd;
+    snprintf(name, 80, "/pdtilde-%d-%d", (int)getpid(), ++count);
+    if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0)
+    {
+        PDERROR "pd~: shm_open: %s", strerror(errno));
+        return (-1);
+    }
+    shm_unlink(name);
+    if (ftruncate(fd, size) < 0 || (h = (t_shmheader *)mmap(0, size,
+        PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        PDERROR "pd~: can't map shared memory: %s", strerror(errno));
+        close(fd);
+        return (-1);
+    }
+    shm_init(h, ninsig, noutsig, nslots);
+#ifdef PDTILDE_SEM
+    if (sem_init(&h->h_go, 1, 0) < 0 || sem_init(&h->h_done, 1, 0) < 0)
+    {
+        PDERROR "pd~: sem_init: %s", strerror(errno));
+        munmap(h, size);
+        close(fd);
+        return (-1);
+    }
+#endif
+    x->x_shmheader = h;
+    x->x_sendslot = x->x_receiveslot = 0;
+    return (fd);
+}
+
+static void pd_tilde_shmfree(t_pd_tilde *x)
+{
+    t_shmheader *h = x->x_shmheader;
+    if (!h)
+        return;
+    x->x_shmheader = 0;
+#ifdef PDTILDE_SEM
+    sem_destroy(&h->h_go);
+    sem_destroy(&h->h_done);
+#endif
+    munmap(h, h->h_size);
+}
+
+    /* tell the subprocess another block is ready */
+static void pd_tilde_shmgo(t_pd_tilde *x)
+{
+#ifdef PDTILDE_SEM
+    sem_post(&x->x_shmheader->h_go);
+#else
+    putc(A_SEMI, x->x_outfd);
+    fflush(x->x_outfd);
+#endif
+}
+
+    /* wait for the subprocess to finish a block.  Return 0 if it exited. */
+static int pd_tilde_shmwait(t_pd_tilde *x)
+{
+#ifdef PDTILDE_SEM
+    struct timespec ts;
+    while (1)
+    {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        if ((ts.tv_nsec += 100000000) >= 1000000000)
+            ts.tv_sec++, ts.tv_nsec -= 1000000000;
+        if (!sem_timedwait(&x->x_shmheader->h_done, &ts))
+            return (1);
+        else if (errno == EINTR)
+            continue;
+        else if (errno != ETIMEDOUT)
+            return (0);
+            /* check every so often that it's still there */
+        else if (waitpid(x->x_childpid, 0, WNOHANG) == x->x_childpid)
+        {
+            x->x_childpid = -1;
+            errno = 0;
+            return (0);
+        }
+    }
+#else
+    return (getc(x->x_infd) != EOF);
+#endif
+}
+#endif /* PDTILDE_SHM */
+
 static void pd_tilde_close(t_pd_tilde *x)
 {
 #ifdef _WIN32
     int termstat;
 #endif
     FILE *infd = x->x_infd, *outfd = x->x_outfd;
+#ifdef PDTILDE_SHM
+    if (x->x_shmheader && outfd)
+    {
+        x->x_shmheader->h_quit = 1;
+        pd_tilde_shmgo(x);
+    }
+#endif
     x->x_infd = x->x_outfd = 0;
     if (outfd)
         fclose(outfd);
@@ -446,6 +559,9 @@ static void pd_tilde_close(t_pd_tilde *x)
         _cwait(&termstat, x->x_childpid, WAIT_CHILD);
 #else
         waitpid(x->x_childpid, 0, 0);
+#endif
+#ifdef PDTILDE_SHM
+    pd_tilde_shmfree(x);
 #endif
     binbuf_clear(x->x_binbuf);
     x->x_infd = x->x_outfd = 0;
@@ -522,10 +638,37 @@ static int pd_tilde_readmessages(t_pd_tilde *x, FILE *infd)
 #define EXTENT ""
 #endif
 
-    /* only call this if we're not already running (x->x_infd = 0, etc.) */
+    /* wait for the subprocess to come up, if we didn't when starting it */
+static void pd_tilde_finishstart(t_pd_tilde *x)
+{
+    binbuf_clear(x->x_binbuf);
+#ifdef PDTILDE_SHM
+    if (x->x_shmheader)
+    {
+            /* the subprocess says it's ready once it has opened its patch */
+        if (!pd_tilde_shmwait(x))
+        {
+            PDERROR "pd~: subprocess exited");
+            pd_tilde_close(x);
+            post("pd~ startup failed");
+        }
+        return;
+    }
+#endif
+    if (!pd_tilde_readmessages(x, x->x_infd))
+    {
+        PDERROR "pd~: subprocess exited");
+        pd_tilde_close(x);
+        post("pd~ startup failed");
+    }
+}
+
+    /* only call this if we're not already running (x->x_infd = 0, etc.)
+    If "wait" is zero, return without waiting for the subprocess to start;
+    then call pd_tilde_finishstart() before using it. */
 static void pd_tilde_dostart(t_pd_tilde *x, const char *pddir,
     const char *schedlibdir, const char *patchdir_c, int argc, t_atom *argv,
-    int ninsig, int noutsig, int fifo, t_float samplerate)
+    int ninsig, int noutsig, int fifo, t_float samplerate, int wait)
 {
     int i, pid, pipe1[2], pipe2[2];
     FILE *infd, *outfd;
@@ -535,6 +678,10 @@ static void pd_tilde_dostart(t_pd_tilde *x, const char *pddir,
         sampleratestr[40];
     const char**dllextent;
     struct stat statbuf;
+#ifdef PDTILDE_SHM
+    char shmflagstr[20];
+    int shmfd = -1;
+#endif
     x->x_childpid = -1;
     if (argc > MAXARG)
     {
@@ -615,6 +762,17 @@ gotone:
     execargv[10] = noutsigstr;
     execargv[11] = "-r";
     execargv[12] = sampleratestr;
+#ifdef PDTILDE_SHM
+        /* with shared memory, the subprocess finds it as an inherited
+        file descriptor whose number we pass in the flags */
+    if (x->x_shm)
+    {
+        if ((shmfd = pd_tilde_shmcreate(x, ninsig, noutsig, fifo + 1)) < 0)
+            goto fail1;
+        sprintf(shmflagstr, "s%d", shmfd);
+        execargv[4] = shmflagstr;
+    }
+#endif
 
         /* convert atom arguments to strings (temporarily allocating space) */
     for (i = 0; i < argc; i++)
@@ -720,6 +878,10 @@ gotone:
             close(pipe1[1]);
         if (pipe2[0] >= 2)
             close(pipe2[0]);
+#ifdef PDTILDE_SHM
+        if (shmfd >= 0)
+            fcntl(shmfd, F_SETFD, 0);
+#endif
         execv(cmdbuf, execargv);
         _exit(1);
     }
@@ -737,6 +899,27 @@ gotone:
     outfd = fdopen(pipe1[1], "w");
     infd = fdopen(pipe2[0], "r");
     x->x_childpid = pid;
+#ifdef PDTILDE_SHM
+    if (shmfd >= 0)
+    {
+        char semi = A_SEMI;
+        close(shmfd);
+        x->x_outfd = outfd;
+        x->x_infd = infd;
+            /* send "fifo" blocks of zeros to get ahead by; the subprocess
+            takes them once it has opened its patch */
+        for (i = 0; i < fifo; i++)
+        {
+            shm_ringwrite(x->x_shmheader, &x->x_shmheader->h_tochild,
+                &semi, 1, 0);
+            x->x_sendslot = (x->x_sendslot + 1) % x->x_shmheader->h_nslots;
+            pd_tilde_shmgo(x);
+        }
+        if (wait)
+            pd_tilde_finishstart(x);
+        return;
+    }
+#endif
     for (i = 0; i < fifo; i++)
         if (x->x_binary)
     {
@@ -747,8 +930,11 @@ gotone:
     else fprintf(outfd, "%s", ";\n0;\n");
 
     fflush(outfd);
-    binbuf_clear(x->x_binbuf);
-    pd_tilde_readmessages(x, infd);
+    if (wait)
+    {
+        binbuf_clear(x->x_binbuf);
+        pd_tilde_readmessages(x, infd);
+    }
     x->x_outfd = outfd;
     x->x_infd = infd;
     return;
@@ -763,6 +949,11 @@ fail2:
     close(pipe1[0]);
     close(pipe1[1]);
 fail1:
+#ifdef PDTILDE_SHM
+    if (shmfd >= 0)
+        close(shmfd);
+    pd_tilde_shmfree(x);
+#endif
     x->x_infd = x->x_outfd = 0;
     x->x_childpid = -1;
     post("pd~ startup failed");
@@ -789,6 +980,52 @@ void pd_empty(int infd)
 
 static int nperfed = 0;
 
+#ifdef PDTILDE_SHM
+static int pd_tilde_shmperf(t_pd_tilde *x, int n)
+{
+    t_shmheader *h = x->x_shmheader;
+    int i, j, nonempty = 0;
+    char semi = A_SEMI;
+    float *fp;
+    t_atom at;
+    for (i = 0, fp = shm_slotin(h, x->x_sendslot); i < x->x_ninsig; i++)
+    {
+        t_pdsample *sp = x->x_insig[i];
+        for (j = 0; j < n; j++)
+            *fp++ = *sp++;
+        for (; j < DEFDACBLKSIZE; j++)
+            *fp++ = 0;
+    }
+        /* mark the end of the messages the subprocess should take before
+        computing this block; there's always room for this */
+    shm_ringwrite(h, &h->h_tochild, &semi, 1, 0);
+    x->x_sendslot = (x->x_sendslot + 1) % h->h_nslots;
+    pd_tilde_shmgo(x);
+    if (!pd_tilde_shmwait(x))
+        return (0);
+    for (i = 0, fp = shm_slotout(h, x->x_receiveslot); i < x->x_noutsig;
+        i++, fp += DEFDACBLKSIZE)
+    {
+        for (j = 0; j < n; j++)
+            x->x_outsig[i][j] = fp[j];
+        for (; j < x->x_blksize; j++)
+            x->x_outsig[i][j] = 0;
+    }
+    x->x_receiveslot = (x->x_receiveslot + 1) % h->h_nslots;
+        /* and collect the messages it sent during that block */
+    while (shm_getatom(h, &h->h_toparent, &at))
+    {
+        if (!nonempty && at.a_type == A_SEMI)
+            break;
+        nonempty = (at.a_type != A_SEMI);
+        binbuf_add(x->x_binbuf, 1, &at);
+    }
+    if (binbuf_getnatom(x->x_binbuf))
+        clock_delay(x->x_clock, 0);
+    return (1);
+}
+#endif /* PDTILDE_SHM */
+
 static void pd_tilde_doperf(t_pd_tilde *x)
 {
     int n = x->x_blksize, i, j, nsigs, numbuffill = 0, c;
@@ -800,6 +1037,20 @@ static void pd_tilde_doperf(t_pd_tilde *x)
 #endif
     if (!x->x_infd)
         goto zeroit;
+#ifdef PDTILDE_SHM
+    if (x->x_shmheader)
+    {
+        if (!pd_tilde_shmperf(x, n))
+        {
+            if (errno)
+                PDERROR "pd~: %s", strerror(errno));
+            else PDERROR "pd~: subprocess exited");
+            pd_tilde_close(x);
+            goto zeroit;
+        }
+        return;
+    }
+#endif
     if (x->x_binary)
     {
         pd_tilde_putsemi(x->x_outfd);
@@ -932,6 +1183,115 @@ zeroit:
     }
 }
 
+#ifdef PD
+/* a pool of sub-processes, started ahead of time so that "pd~ start" in a
+pd~ object with the "-pool" flag doesn't have to wait for one to come up.
+Each start takes a waiting sub-process started with exactly the same
+settings and arguments, if there is one, and starts another to replace it
+for next time.  Sub-processes are never returned to the pool after use. */
+
+typedef struct _pdtildespare
+{
+    struct _pdtildespare *s_next;
+    t_symbol *s_key;            /* everything that went into starting it */
+    FILE *s_infd;
+    FILE *s_outfd;
+    int s_childpid;
+#ifdef PDTILDE_SHM
+    t_shmheader *s_shmheader;
+    int s_sendslot;
+#endif
+} t_pdtildespare;
+
+static t_pdtildespare *pd_tilde_pool;
+
+    /* move a newly started sub-process from the object to a pool entry */
+static t_pdtildespare *pd_tilde_stash(t_pd_tilde *x, t_symbol *key)
+{
+    t_pdtildespare *sp;
+    if (!x->x_infd)
+        return (0);
+    sp = (t_pdtildespare *)getbytes(sizeof(*sp));
+    sp->s_next = 0;
+    sp->s_key = key;
+    sp->s_infd = x->x_infd;
+    sp->s_outfd = x->x_outfd;
+    sp->s_childpid = x->x_childpid;
+    x->x_infd = x->x_outfd = 0;
+    x->x_childpid = -1;
+#ifdef PDTILDE_SHM
+    sp->s_shmheader = x->x_shmheader;
+    sp->s_sendslot = x->x_sendslot;
+    x->x_shmheader = 0;
+#endif
+    return (sp);
+}
+
+static void pd_tilde_unstash(t_pd_tilde *x, t_pdtildespare *sp)
+{
+    x->x_infd = sp->s_infd;
+    x->x_outfd = sp->s_outfd;
+    x->x_childpid = sp->s_childpid;
+#ifdef PDTILDE_SHM
+    x->x_shmheader = sp->s_shmheader;
+    x->x_sendslot = sp->s_sendslot;
+    x->x_receiveslot = 0;
+#endif
+    freebytes(sp, sizeof(*sp));
+}
+
+static void pd_tilde_poolstart(t_pd_tilde *x, const char *pddir,
+    const char *schedlibdir, const char *patchdir, int argc, t_atom *argv)
+{
+    char keybuf[MAXPDSTRING], *kp = keybuf, *ep = keybuf + MAXPDSTRING;
+    t_pdtildespare *sp, **spp;
+    t_symbol *key;
+    int i;
+    snprintf(keybuf, MAXPDSTRING, "%s %s %s %d %d %d %g %d %d", pddir,
+        schedlibdir, patchdir, x->x_ninsig, x->x_noutsig, x->x_fifo,
+        x->x_sr, x->x_binary,
+#ifdef PDTILDE_SHM
+        x->x_shm
+#else
+        0
+#endif
+        );
+    for (i = 0; i < argc; i++)
+    {
+        kp += strlen(kp);
+        if (kp < ep - 1)
+            *kp++ = ' ', *kp = 0;
+        atom_string(argv+i, kp, (unsigned int)(ep - kp));
+    }
+    key = gensym(keybuf);
+    for (spp = &pd_tilde_pool; (sp = *spp); spp = &sp->s_next)
+        if (sp->s_key == key)
+    {
+        *spp = sp->s_next;
+        break;
+    }
+    if (!sp)
+    {
+        pd_tilde_dostart(x, pddir, schedlibdir, patchdir, argc, argv,
+            x->x_ninsig, x->x_noutsig, x->x_fifo, x->x_sr, 0);
+        if (!(sp = pd_tilde_stash(x, key)))
+            return;
+    }
+        /* start the replacement.  This one doesn't get waited for; it can
+        come up in its own time */
+    pd_tilde_dostart(x, pddir, schedlibdir, patchdir, argc, argv,
+        x->x_ninsig, x->x_noutsig, x->x_fifo, x->x_sr, 0);
+    if (x->x_infd)
+    {
+        t_pdtildespare *sp2 = pd_tilde_stash(x, key);
+        sp2->s_next = pd_tilde_pool;
+        pd_tilde_pool = sp2;
+    }
+    pd_tilde_unstash(x, sp);
+    pd_tilde_finishstart(x);
+}
+#endif /* PD */
+
 static void pd_tilde_pdtilde(t_pd_tilde *x, t_symbol *s,
     int argc, t_atom *argv)
 {
@@ -969,9 +1329,15 @@ static void pd_tilde_pdtilde(t_pd_tilde *x, t_symbol *s,
             else snprintf(scheddirstring, MAXPDSTRING, "%s/extra/pd~", pds);
             schedlibdir = gensym(scheddirstring);
         }
+#ifdef PD
+        if (x->x_pool)
+            pd_tilde_poolstart(x, x->x_pddir->s_name, schedlibdir->s_name,
+                patchdir, argc, argv);
+        else
+#endif
         pd_tilde_dostart(x, x->x_pddir->s_name, schedlibdir->s_name,
             patchdir, argc, argv, x->x_ninsig, x->x_noutsig, x->x_fifo,
-                x->x_sr);
+                x->x_sr, 1);
     }
     else if (sel == gensym("stop"))
     {
@@ -1068,6 +1434,20 @@ static void pd_tilde_anything(t_pd_tilde *x, t_symbol *s,
     char msgbuf[MAXPDSTRING];
     if (!x->x_outfd)
         return;
+#ifdef PDTILDE_SHM
+    if (x->x_shmheader)
+    {
+        t_shmheader *h = x->x_shmheader;
+        char buf[SHM_MAXMSG];
+        int n = shm_encode(buf, s, argc, argv);
+        if (n < 0)
+            pd_error(x, "pd~: message too long");
+            /* leave room for the block markers */
+        else if (!shm_ringwrite(h, &h->h_tochild, buf, n, h->h_nslots + 1))
+            pd_error(x, "pd~: message buffer full; message dropped");
+        return;
+    }
+#endif
     if (x->x_binary)
     {
         pd_tilde_putsymbol(s, x->x_outfd);
@@ -1095,7 +1475,7 @@ static void pd_tilde_anything(t_pd_tilde *x, t_symbol *s,
 static void *pd_tilde_new(t_symbol *s, int argc, t_atom *argv)
 {
     t_pd_tilde *x = (t_pd_tilde *)pd_new(pd_tilde_class);
-    int ninsig = 2, noutsig = 2, j, fifo = 5, binary = 1;
+    int ninsig = 2, noutsig = 2, j, fifo = -1, binary = 1, shm = 0, pool = 0;
     t_float sr = sys_getsr();
     t_pdsample **g;
     t_symbol *pddir = sys_libdir,
@@ -1138,15 +1518,36 @@ static void *pd_tilde_new(t_symbol *s, int argc, t_atom *argv)
             binary = 0;
             argc--; argv++;
         }
+        else if (!strcmp(firstarg->s_name, "-shm"))
+        {
+            shm = 1;
+            argc--; argv++;
+        }
+        else if (!strcmp(firstarg->s_name, "-pool"))
+        {
+            pool = 1;
+            argc--; argv++;
+        }
         else break;
     }
+#ifndef PDTILDE_SHM
+    if (shm)
+    {
+        post("pd~: no shared memory on this platform; using pipes");
+        shm = 0;
+    }
+#endif
+        /* with shared memory the default is no added latency; through
+        pipes it's 5 blocks */
+    if (fifo < 0)
+        fifo = (shm ? 0 : 5);
 
     if (argc)
     {
         pd_error(x,
 "usage: pd~ [-sr #] [-ninsig #] [-noutsig #] [-fifo #] [-pddir <>]");
         post(
-"... [-scheddir <>]");
+"... [-scheddir <>] [-ascii] [-shm] [-pool]");
     }
 
     x->x_clock = clock_new(x, (t_method)pd_tilde_tick);
@@ -1165,6 +1566,11 @@ static void *pd_tilde_new(t_symbol *s, int argc, t_atom *argv)
     x->x_canvas = canvas_getcurrent();
     x->x_binbuf = binbuf_new();
     x->x_binary = binary;
+    x->x_pool = pool;
+#ifdef PDTILDE_SHM
+    x->x_shm = shm;
+    x->x_shmheader = 0;
+#endif
     for (j = 1, g = x->x_insig; j < ninsig; j++, g++)
         inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
     x->x_outlet1 = outlet_new(&x->x_obj, 0);
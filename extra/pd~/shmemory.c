@@ -0,0 +1,211 @@
+/* Copyright 2021 Miller Puckette.  Berkeley license; see the
+file LICENSE.txt in this distribution. */
+
+/* shared-memory transport between pd~ and its subprocess, included by both
+pd~.c and pdsched.c.  Audio goes in a ring of block-sized "slots", one per
+block that can be pending at once, and messages in two single-reader,
+single-writer byte FIFOs using the same binary atoms as binarymsg.c.  An
+empty message (a lone semicolon) marks the end of each block's messages so
+that they stay in order with the audio.
+
+The parent tells the child a block is ready, and the child tells the
+parent it's done, through a pair of process-shared semaphores in the
+shared memory.  macOS doesn't have those, so there we send a single byte
+through the stdio pipes instead (which is still much less work than
+sending all the samples through them). */
+
+#ifndef _WIN32
+#define PDTILDE_SHM
+#endif
+
+#ifdef PDTILDE_SHM
+#include <sys/mman.h>
+#include <unistd.h>
+#ifndef __APPLE__
+#define PDTILDE_SEM
+#include <semaphore.h>
+#include <time.h>
+#endif
+
+#define SHM_MAGIC 0x73707e64    /* "d~ps" */
+#define SHM_RINGSIZE 262144     /* bytes of messages in each direction */
+#define SHM_MAXMSG 16384        /* longest message, in its binary form */
+
+typedef struct _shmring
+{
+    volatile unsigned int r_head;   /* bytes written so far, by producer */
+    volatile unsigned int r_tail;   /* ...and read so far, by consumer */
+    unsigned int r_onset;           /* data onset from start of mapping */
+} t_shmring;
+
+typedef struct _shmheader
+{
+    unsigned int h_magic;
+    unsigned int h_size;            /* size of the whole mapping */
+    int h_ninsig;
+    int h_noutsig;
+    int h_nslots;                   /* blocks that can be in flight */
+    unsigned int h_slotonset;
+    volatile int h_quit;            /* parent asks child to exit */
+#ifdef PDTILDE_SEM
+    sem_t h_go;                     /* parent to child: a block is ready */
+    sem_t h_done;                   /* child to parent: block computed */
+#endif
+    t_shmring h_tochild;
+    t_shmring h_toparent;
+} t_shmheader;
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SHM_BARRIER() __sync_synchronize()
+#else
+#define SHM_BARRIER()
+#endif
+
+static unsigned int shm_getsize(int ninsig, int noutsig, int nslots)
+{
+    return ((sizeof(t_shmheader) + 15) / 16 * 16 + 2 * SHM_RINGSIZE +
+        nslots * (ninsig + noutsig) * DEFDACBLKSIZE * sizeof(float));
+}
+
+    /* fill in the header of a freshly zeroed mapping */
+static void shm_init(t_shmheader *h, int ninsig, int noutsig, int nslots)
+{
+    unsigned int onset = (sizeof(t_shmheader) + 15) / 16 * 16;
+    h->h_magic = SHM_MAGIC;
+    h->h_size = shm_getsize(ninsig, noutsig, nslots);
+    h->h_ninsig = ninsig;
+    h->h_noutsig = noutsig;
+    h->h_nslots = nslots;
+    h->h_tochild.r_onset = onset;
+    h->h_toparent.r_onset = onset + SHM_RINGSIZE;
+    h->h_slotonset = onset + 2 * SHM_RINGSIZE;
+    h->h_quit = 0;
+}
+
+    /* input and output samples for block number k */
+static float *shm_slotin(t_shmheader *h, unsigned int k)
+{
+    return ((float *)((char *)h + h->h_slotonset) +
+        (k % h->h_nslots) * (h->h_ninsig + h->h_noutsig) * DEFDACBLKSIZE);
+}
+
+static float *shm_slotout(t_shmheader *h, unsigned int k)
+{
+    return (shm_slotin(h, k) + h->h_ninsig * DEFDACBLKSIZE);
+}
+
+    /* write a whole message or nothing, leaving room for "reserve" block
+    markers so that those can never fail */
+static int shm_ringwrite(t_shmheader *h, t_shmring *r, const char *buf,
+    int n, int reserve)
+{
+    unsigned int head = r->r_head, i;
+    char *data = (char *)h + r->r_onset;
+    SHM_BARRIER();
+    if (head - r->r_tail + n + reserve > SHM_RINGSIZE)
+        return (0);
+    for (i = 0; i < (unsigned int)n; i++)
+        data[(head + i) % SHM_RINGSIZE] = buf[i];
+    SHM_BARRIER();
+    r->r_head = head + n;
+    return (1);
+}
+
+static int shm_ringgetc(t_shmheader *h, t_shmring *r)
+{
+    unsigned int tail = r->r_tail;
+    unsigned char c;
+    SHM_BARRIER();
+    if (tail == r->r_head)
+        return (-1);
+    c = ((unsigned char *)h + r->r_onset)[tail % SHM_RINGSIZE];
+    SHM_BARRIER();
+    r->r_tail = tail + 1;
+    return (c);
+}
+
+    /* binary form of a message as in binarymsg.c; returns its length or
+    -1 if it won't fit */
+static int shm_encode(char *buf, t_symbol *s, int argc, t_atom *argv)
+{
+    int n = 0, len;
+    float f;
+    if (s)
+    {
+        if ((len = (int)strlen(s->s_name) + 1) + 1 > SHM_MAXMSG)
+            return (-1);
+        buf[n++] = A_SYMBOL;
+        memcpy(buf + n, s->s_name, len);
+        n += len;
+    }
+    for (; argc--; argv++)
+    {
+        if (argv->a_type == A_FLOAT)
+        {
+            if (n + 1 + (int)sizeof(f) + 1 > SHM_MAXMSG)
+                return (-1);
+            f = argv->a_w.w_float;
+            buf[n++] = A_FLOAT;
+            memcpy(buf + n, &f, sizeof(f));
+            n += sizeof(f);
+        }
+        else if (argv->a_type == A_SYMBOL)
+        {
+            len = (int)strlen(argv->a_w.w_symbol->s_name) + 1;
+            if (n + 1 + len + 1 > SHM_MAXMSG)
+                return (-1);
+            buf[n++] = A_SYMBOL;
+            memcpy(buf + n, argv->a_w.w_symbol->s_name, len);
+            n += len;
+        }
+    }
+    buf[n++] = A_SEMI;
+    return (n);
+}
+
+    /* read one atom back; only complete messages are ever in the ring so
+    running out in the middle means something went wrong */
+static int shm_getatom(t_shmheader *h, t_shmring *r, t_atom *ap)
+{
+    char buf[MAXPDSTRING];
+    int c, fill;
+    float f;
+    unsigned char *fp = (unsigned char *)&f;
+    switch (shm_ringgetc(h, r))
+    {
+    case A_SEMI:
+        SETSEMI(ap);
+        return (1);
+    case A_FLOAT:
+        for (fill = 0; fill < (int)sizeof(f); fill++)
+        {
+            if ((c = shm_ringgetc(h, r)) < 0)
+                return (0);
+            fp[fill] = c;
+        }
+        SETFLOAT(ap, f);
+        return (1);
+    case A_SYMBOL:
+        for (fill = 0; fill < MAXPDSTRING; fill++)
+        {
+            if ((c = shm_ringgetc(h, r)) < 0)
+                return (0);
+            buf[fill] = c;
+            if (!c)
+            {
+                SETSYMBOL(ap, gensym(buf));
+                return (1);
+            }
+        }
+            /* too long; skip the rest */
+        while ((c = shm_ringgetc(h, r)) > 0)
+            ;
+        buf[MAXPDSTRING-1] = 0;
+        SETSYMBOL(ap, gensym(buf));
+        return (1);
+    default:
+        return (0);
+    }
+}
+
+#endif /* PDTILDE_SHM */
@@ -0,0 +1,202 @@
+/* Copyright (c) 1997- Miller Puckette and others.
+* For information on usage and redistribution, and for a DISCLAIMER OF ALL
+* WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+/* rev2~ - simple, cheap reverberator with one signal inlet and four signal
+outlets.  This computes what the rev2~ abstraction did: six stages of early
+reflections, then a feedback delay network of four low-pass filtered
+("damped") delay lines mixed by a Hadamard matrix.  The early reflections
+are added into the first two lines' outputs, and all four are output. */
+
+#include "m_pd.h"
+#include "../revcommon.h"
+
+#define NEARLY 6
+#define NDELAY 4
+
+static t_float rev2_earlytimes[NEARLY] =
+    {43.5337, 25.796, 19.392, 16.364, 7.645, 4.2546};
+static t_float rev2_delaytimes[NDELAY] = {58.6435, 69.4325, 74.5234, 86.1244};
+
+static t_class *rev2_tilde_class;
+
+typedef struct _rev2_tilde
+{
+    t_object x_obj;
+    t_float x_f;
+    t_float x_sr;
+    int x_vecsize;
+    t_revdelay x_lines[NEARLY + NDELAY];   /* early reflections first */
+    t_sample *x_buf;            /* all the delay lines */
+    int x_bufsize;
+    t_revramp x_gain;
+    t_revramp x_feedback;
+    t_revramp x_damp;
+    t_float x_crossover;
+    t_sample x_lop[NDELAY];     /* lop~ states */
+    t_sample *x_scratch;        /* NDELAY + 6 blocks */
+} t_rev2_tilde;
+
+static t_int *rev2_tilde_perform(t_int *w)
+{
+    t_rev2_tilde *x = (t_rev2_tilde *)(w[1]);
+    t_sample *in = (t_sample *)(w[2]);
+    int n = (int)(w[7]), i, j;
+    t_revdelay *early = x->x_lines, *delay = x->x_lines + NEARLY;
+    t_sample *v[NDELAY], *left, *right, *tmp, *gain, *fb, *damp,
+        coef = rev_lopcoef(x->x_crossover, x->x_sr);
+    for (i = 0; i < NDELAY; i++)
+        v[i] = x->x_scratch + i * n;
+    left = v[NDELAY-1] + n;
+    right = left + n;
+    tmp = right + n;
+    gain = tmp + n;
+    fb = gain + n;
+    damp = fb + n;
+    revramp_run(&x->x_gain, gain, n, x->x_sr);
+    revramp_run(&x->x_feedback, fb, n, x->x_sr);
+    revramp_run(&x->x_damp, damp, n, x->x_sr);
+
+        /* early reflections: each stage adds and subtracts a delayed copy
+        of the difference from the last stage */
+    memcpy(left, in, n * sizeof(t_sample));
+    memcpy(right, in, n * sizeof(t_sample));
+    for (i = 0; i < NEARLY; i++)
+    {
+        rev_read(&early[i], tmp, n);
+        rev_write(&early[i], right, n);
+        if (i == NEARLY-1)
+            break;
+        for (j = 0; j < n; j++)
+        {
+            t_sample f = left[j], g = tmp[j];
+            left[j] = f + g;
+            right[j] = f - g;
+        }
+    }
+
+        /* the delay network */
+    for (i = 0; i < NDELAY; i++)
+        rev_read(&delay[i], v[i], n);
+    rev_damp4(v, x->x_lop, coef, damp, n);
+    for (j = 0; j < n; j++)
+    {
+        v[0][j] = left[j] + v[0][j] * fb[j];
+        v[1][j] = tmp[j] + v[1][j] * fb[j];
+    }
+    for (i = 2; i < NDELAY; i++)
+        rev_mul(v[i], v[i], fb, n);
+    for (i = 0; i < 4; i++)
+        rev_mul((t_sample *)(w[3 + i]), v[i], gain, n);
+    rev_hadamard(v, NDELAY, n);
+    for (i = 0; i < NDELAY; i++)
+        rev_write(&delay[i], v[i], n);
+    return (w+8);
+}
+
+static void rev2_tilde_dsp(t_rev2_tilde *x, t_signal **sp)
+{
+    int n = sp[0]->s_n;
+    if (n != x->x_vecsize || sp[0]->s_sr != x->x_sr)
+    {
+        x->x_sr = sp[0]->s_sr;
+        rev_setdelays(x->x_lines, NEARLY + NDELAY, &x->x_buf,
+            &x->x_bufsize, x->x_sr, n);
+        if (x->x_scratch)
+            freebytes(x->x_scratch, (NDELAY + 6) * x->x_vecsize *
+                sizeof(t_sample));
+        x->x_scratch = (t_sample *)getbytes((NDELAY + 6) * n *
+            sizeof(t_sample));
+        x->x_vecsize = n;
+    }
+    dsp_add(rev2_tilde_perform, 7, x, sp[0]->s_vec, sp[1]->s_vec,
+        sp[2]->s_vec, sp[3]->s_vec, sp[4]->s_vec, (t_int)n);
+}
+
+static void rev2_tilde_level(t_rev2_tilde *x, t_floatarg f)
+{
+    revramp_set(&x->x_gain, dbtorms(f) * (t_float)0.125, 30);
+}
+
+static void rev2_tilde_liveness(t_rev2_tilde *x, t_floatarg f)
+{
+    revramp_set(&x->x_feedback,
+        (f < 0 ? 0 : (f > 100 ? 100 : f)) / 200, 50);
+}
+
+static void rev2_tilde_crossover(t_rev2_tilde *x, t_floatarg f)
+{
+    x->x_crossover = (f < 1 ? 3000 : f);
+}
+
+static void rev2_tilde_damping(t_rev2_tilde *x, t_floatarg f)
+{
+    revramp_set(&x->x_damp,
+        (f < 0 ? 0 : (f > 100 ? 100 : f)) * (t_float)0.01, 50);
+}
+
+static void *rev2_tilde_new(t_floatarg level, t_floatarg liveness,
+    t_floatarg crossover, t_floatarg damping)
+{
+    t_rev2_tilde *x = (t_rev2_tilde *)pd_new(rev2_tilde_class);
+    int i;
+    for (i = 0; i < NEARLY; i++)
+    {
+        x->x_lines[i].d_msec = rev2_earlytimes[i];
+        x->x_lines[i].d_readfirst = 1;
+    }
+    for (i = 0; i < NDELAY; i++)
+    {
+        x->x_lines[NEARLY + i].d_msec = rev2_delaytimes[i];
+        x->x_lines[NEARLY + i].d_readfirst = 1;
+        x->x_lop[i] = 0;
+    }
+    x->x_buf = x->x_scratch = 0;
+    x->x_bufsize = x->x_vecsize = 0;
+    x->x_sr = 44100;
+    x->x_gain.r_value = x->x_feedback.r_value = x->x_damp.r_value = 0;
+    x->x_gain.r_nleft = x->x_feedback.r_nleft = x->x_damp.r_nleft = 0;
+    rev2_tilde_level(x, level);
+    rev2_tilde_liveness(x, liveness);
+    rev2_tilde_crossover(x, crossover);
+    rev2_tilde_damping(x, damping);
+    inlet_new(&x->x_obj, &x->x_obj.ob_pd, gensym("float"), gensym("level"));
+    inlet_new(&x->x_obj, &x->x_obj.ob_pd, gensym("float"),
+        gensym("liveness"));
+    inlet_new(&x->x_obj, &x->x_obj.ob_pd, gensym("float"),
+        gensym("crossover"));
+    inlet_new(&x->x_obj, &x->x_obj.ob_pd, gensym("float"),
+        gensym("damping"));
+    for (i = 0; i < 4; i++)
+        outlet_new(&x->x_obj, &s_signal);
+    x->x_f = 0;
+    return (x);
+}
+
+static void rev2_tilde_free(t_rev2_tilde *x)
+{
+    if (x->x_buf)
+        freebytes(x->x_buf, x->x_bufsize * sizeof(t_sample));
+    if (x->x_scratch)
+        freebytes(x->x_scratch, (NDELAY + 6) * x->x_vecsize *
+            sizeof(t_sample));
+}
+
+void rev2_tilde_setup(void)
+{
+    rev2_tilde_class = class_new(gensym("rev2~"),
+        (t_newmethod)rev2_tilde_new, (t_method)rev2_tilde_free,
+        sizeof(t_rev2_tilde), 0, A_DEFFLOAT, A_DEFFLOAT, A_DEFFLOAT,
+        A_DEFFLOAT, 0);
+    CLASS_MAINSIGNALIN(rev2_tilde_class, t_rev2_tilde, x_f);
+    class_addmethod(rev2_tilde_class, (t_method)rev2_tilde_dsp,
+        gensym("dsp"), A_CANT, 0);
+    class_addmethod(rev2_tilde_class, (t_method)rev2_tilde_level,
+        gensym("level"), A_FLOAT, 0);
+    class_addmethod(rev2_tilde_class, (t_method)rev2_tilde_liveness,
+        gensym("liveness"), A_FLOAT, 0);
+    class_addmethod(rev2_tilde_class, (t_method)rev2_tilde_crossover,
+        gensym("crossover"), A_FLOAT, 0);
+    class_addmethod(rev2_tilde_class, (t_method)rev2_tilde_damping,
+        gensym("damping"), A_FLOAT, 0);
+}
@@ -0,0 +1,219 @@
+/* Copyright (c) 1997- Miller Puckette and others.
+* For information on usage and redistribution, and for a DISCLAIMER OF ALL
+* WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+/* helpers shared by the rev2~ and rev3~ reverberators.  These compute
+the same networks as the old abstractions did with delwrite~, delread~,
+lop~ and line~ objects, but all the delay lines live in one buffer and
+each block is computed in one perform routine.  Signals are handled a
+block at a time, so that inner loops run over samples and vectorize. */
+
+#include <string.h>
+#include "d_simd.h"
+
+    /* a delay line.  Its delay in samples is rounded and clipped as
+    delread~ does it; "readfirst" means the delread~ was sorted before its
+    delwrite~ so that the delay can't be less than a block. */
+typedef struct _revdelay
+{
+    t_float d_msec;
+    int d_readfirst;
+    int d_delay;            /* delay in samples */
+    int d_length;           /* delay plus one block */
+    int d_phase;            /* where the next block is written */
+    t_sample *d_vec;        /* part of the shared buffer */
+} t_revdelay;
+
+    /* allocate (or reallocate) all the delay lines in one buffer for a
+    given sample rate and block size.  Contents are cleared. */
+static void rev_setdelays(t_revdelay *d, int ndelay, t_sample **bufp,
+    int *sizep, t_float sr, int n)
+{
+    int i, size = 0;
+    t_float msectosamps = sr * 0.001;
+    for (i = 0; i < ndelay; i++)
+    {
+        int offset = (d[i].d_readfirst ? 0 : n),
+            delsamps = (int)(0.5 + msectosamps * d[i].d_msec) + offset,
+                /* delwrite~'s buffer size for the same delay time */
+            maxsamps = d[i].d_msec * sr * (t_float)(0.001f);
+        if (maxsamps < 1)
+            maxsamps = 1;
+        maxsamps += ((- maxsamps) & 3) + 64;
+            /* as in delread~, except that for blocks bigger than
+            delwrite~'s buffer the delay is just a block */
+        if (delsamps > maxsamps)
+            delsamps = maxsamps;
+        if (delsamps < n)
+            delsamps = n;
+        d[i].d_delay = delsamps - offset;
+        d[i].d_length = d[i].d_delay + n;
+        d[i].d_phase = 0;
+        size += d[i].d_length;
+    }
+    if (*bufp)
+        freebytes(*bufp, *sizep * sizeof(t_sample));
+    *bufp = (t_sample *)getbytes(size * sizeof(t_sample));
+    *sizep = size;
+    for (i = 0, size = 0; i < ndelay; i++)
+    {
+        d[i].d_vec = *bufp + size;
+        size += d[i].d_length;
+    }
+}
+
+    /* write a block into a delay line */
+static void rev_write(t_revdelay *d, t_sample *in, int n)
+{
+    int first = d->d_length - d->d_phase;
+    if (first > n)
+    {
+        memcpy(d->d_vec + d->d_phase, in, n * sizeof(t_sample));
+        d->d_phase += n;
+    }
+    else
+    {
+        memcpy(d->d_vec + d->d_phase, in, first * sizeof(t_sample));
+        memcpy(d->d_vec, in + first, (n - first) * sizeof(t_sample));
+        d->d_phase = n - first;
+    }
+}
+
+    /* read a block delayed by the line's delay.  The line holds exactly
+    the delay plus one block, so the block is read from just after the one
+    that will be written next.  A "readfirst" line has to be read before
+    the block is written to it and any other after. */
+static void rev_read(t_revdelay *d, t_sample *out, int n)
+{
+    int start = d->d_phase + (d->d_readfirst ? n : 0), first;
+    if (start >= d->d_length)
+        start -= d->d_length;
+    first = d->d_length - start;
+    if (first >= n)
+        memcpy(out, d->d_vec + start, n * sizeof(t_sample));
+    else
+    {
+        memcpy(out, d->d_vec + start, first * sizeof(t_sample));
+        memcpy(out + first, d->d_vec, (n - first) * sizeof(t_sample));
+    }
+}
+
+    /* linear ramp to a new value, as from a line~ object */
+typedef struct _revramp
+{
+    t_sample r_value;
+    t_sample r_target;
+    t_sample r_inc;
+    t_float r_msec;         /* ramp time not yet converted to samples */
+    int r_nleft;            /* samples left in the ramp */
+} t_revramp;
+
+static void revramp_set(t_revramp *r, t_float target, t_float msec)
+{
+    r->r_target = target;
+    r->r_msec = msec;
+}
+
+    /* fill a block with the ramp's values, starting a new ramp if there
+    is one */
+static void revramp_run(t_revramp *r, t_sample *out, int n, t_float sr)
+{
+    int i;
+    if (r->r_msec >= 0)
+    {
+        r->r_nleft = (int)(0.5 + r->r_msec * sr * 0.001);
+        if (r->r_nleft < 1)
+            r->r_nleft = 1;
+        r->r_inc = (r->r_target - r->r_value) / r->r_nleft;
+        r->r_msec = -1;
+    }
+    for (i = 0; i < n && r->r_nleft; i++, r->r_nleft--)
+        out[i] = (r->r_value += r->r_inc);
+    if (i < n && r->r_value != r->r_target)
+        r->r_value = r->r_target;
+    for (; i < n; i++)
+        out[i] = r->r_value;
+}
+
+    /* coefficient for a lop~ filter at frequency "hz" */
+static t_sample rev_lopcoef(t_float hz, t_float sr)
+{
+    t_sample coef = (hz < 0 ? 0 : hz) * (2 * 3.14159) / sr;
+    return (coef > 1 ? 1 : coef);
+}
+
+    /* run a lop~ on each of four blocks and cross-fade between its input and
+    output ("damp" = 1 is all filtered), in place.  The four filters are run
+    together so that their recursions can overlap. */
+static void rev_damp4(t_sample **v, t_sample *last, t_sample coef,
+    t_sample *damp, int n)
+{
+    int i;
+    t_sample *v0 = v[0], *v1 = v[1], *v2 = v[2], *v3 = v[3],
+        l0 = last[0], l1 = last[1], l2 = last[2], l3 = last[3],
+        feedback = 1 - coef;
+    for (i = 0; i < n; i++)
+    {
+        t_sample f0 = v0[i], f1 = v1[i], f2 = v2[i], f3 = v3[i], d = damp[i];
+        l0 = coef * f0 + feedback * l0;
+        l1 = coef * f1 + feedback * l1;
+        l2 = coef * f2 + feedback * l2;
+        l3 = coef * f3 + feedback * l3;
+        v0[i] = f0 + (l0 - f0) * d;
+        v1[i] = f1 + (l1 - f1) * d;
+        v2[i] = f2 + (l2 - f2) * d;
+        v3[i] = f3 + (l3 - f3) * d;
+    }
+    last[0] = (PD_BIGORSMALL(l0) ? 0 : l0);
+    last[1] = (PD_BIGORSMALL(l1) ? 0 : l1);
+    last[2] = (PD_BIGORSMALL(l2) ? 0 : l2);
+    last[3] = (PD_BIGORSMALL(l3) ? 0 : l3);
+}
+
+    /* multiply a block by a signal: out = in * g */
+static void rev_mul(t_sample *out, t_sample *in, t_sample *g, int n)
+{
+    int i = 0;
+#ifdef PD_SIMD
+    if (!(n & 3))
+    {
+        for (; i < n; i += 4)
+            V4_STORE(out + i, V4_MUL(V4_LOAD(in + i), V4_LOAD(g + i)));
+        return;
+    }
+#endif
+    for (; i < n; i++)
+        out[i] = in[i] * g[i];
+}
+
+    /* unnormalized Walsh-Hadamard transform of "npoints" blocks, in
+    place, one block at a time so that the inner loop vectorizes */
+static void rev_hadamard(t_sample **v, int npoints, int n)
+{
+    int stride, i, j, k;
+    for (stride = 1; stride < npoints; stride *= 2)
+        for (i = 0; i < npoints; i += 2 * stride)
+            for (j = i; j < i + stride; j++)
+    {
+        t_sample *a = v[j], *b = v[j + stride];
+        k = 0;
+#ifdef PD_SIMD
+        if (!(n & 3))
+        {
+            for (; k < n; k += 4)
+            {
+                t_v4 f = V4_LOAD(a + k), g = V4_LOAD(b + k);
+                V4_STORE(a + k, V4_ADD(f, g));
+                V4_STORE(b + k, V4_SUB(f, g));
+            }
+            continue;
+        }
+#endif
+        for (; k < n; k++)
+        {
+            t_sample f = a[k], g = b[k];
+            a[k] = f + g;
+            b[k] = f - g;
+        }
+    }
+}
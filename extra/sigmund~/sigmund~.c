@@ -11,6 +11,14 @@
 
 #ifdef PD
 #include "m_pd.h"
+    /* in Pd, "async" mode analyzes in a worker thread (not with MSVC, which
+    doesn't have pthreads) */
+#ifndef _MSC_VER
+#define SIGMUND_ASYNC
+#include <pthread.h>
+#include <unistd.h>
+#include "m_imp.h"      /* for realfft_new() and friends */
+#endif
 #endif
 #ifdef MSP
 #include "ext.h"
@@ -62,6 +70,17 @@ for example, defines this in the file d_fft_mayer.c or d_fft_fftsg.c. */
 #else
 #define BUF_ALLOCA(n) (getbytes(n))
 #define BUF_FREEA(x, n) (freebytes((x), (n)))
+#endif
+
+    /* the threaded "analyze" method gives each worker thread its own FFT
+    (from realfft_new()) since mayer_realfft() uses one buffer for all; the
+    output is the same.  Elsewhere "fft" is null and the Mayer one is used. */
+#ifdef SIGMUND_ASYNC
+#define SIGMUND_REALFFT(n, buf, fft) \
+    ((fft) ? realfft_forward((fft), (buf)) : mayer_realfft((n), (buf)))
+#else
+typedef struct _realfft t_realfft;
+#define SIGMUND_REALFFT(n, buf, fft) mayer_realfft((n), (buf))
 #endif
 
 typedef struct peak
@@ -262,7 +281,7 @@ static void sigmund_remask(int maxbin, int bestindex, t_float powmask,
 
 static void sigmund_getrawpeaks(int npts, t_float *insamps,
     int npeak, t_peak *peakv, int *nfound, t_float *power, t_float srate,
-    int loud, t_float hifreq)
+    int loud, t_float hifreq, t_realfft *fft)
 {
     t_float oneovern = 1.0/ (t_float)npts;
     t_float fperbin = 0.5 * srate * oneovern, totalpower = 0;
@@ -287,7 +306,7 @@ static void sigmund_getrawpeaks(int npts, t_float *insamps,
         bigbuf[i] = insamps[i];
     for (i = npts; i < 2*npts; i++)
         bigbuf[i] = 0;
-    mayer_realfft(npts2, bigbuf);
+    SIGMUND_REALFFT(npts2, bigbuf, fft);
     for (i = 0; i < npts; i++)
         rawreal[i] = bigbuf[i];
     for (i = 1; i < npts-1; i++)
@@ -879,8 +898,37 @@ typedef struct _sigmund
     unsigned int x_dopitch:1;   /* which things to calculate */
     unsigned int x_donote:1;
     unsigned int x_dotracks:1;
+#ifdef SIGMUND_ASYNC
+    int x_async;                /* nonzero if analyzing in a worker thread */
+    int x_busy;                 /* worker has a frame to analyze */
+    int x_quit;                 /* worker should exit */
+    int x_pending;              /* worker's results not yet output */
+    t_sample *x_frame;          /* copy of input for the worker */
+    int x_nframe;               /* points in frame */
+    t_float x_framesr;          /* sample rate it was taken at */
+    t_peak *x_peakv;            /* peaks found by the worker */
+    int x_npeakv;               /* space allocated in x_peakv */
+    int x_nfound;               /* number of peaks it found */
+    t_float x_freq;             /* ... and the other results */
+    t_float x_power;
+    t_float x_note;
+    pthread_t x_thread;
+    pthread_mutex_t x_mutex;
+    pthread_cond_t x_requestcond;   /* worker waits on this for a frame */
+    pthread_cond_t x_answercond;    /* ... and signals this when done */
+    struct _sigmundjob *x_job;  /* threaded "analyze" of an array, if any */
+    t_clock *x_jobclock;        /* polls for it to finish */
+#endif
 } t_sigmund;
 
+#ifdef SIGMUND_ASYNC
+static void sigmund_wait(t_sigmund *x);
+static void sigmund_async(t_sigmund *x, t_floatarg f);
+static void sigmund_jobfree(t_sigmund *x);
+#else
+#define sigmund_wait(x)
+#endif
+
 static void sigmund_preinit(t_sigmund *x)
 {
     x->x_npts = NPOINTS_DEF;
@@ -906,11 +954,17 @@ static void sigmund_preinit(t_sigmund *x)
 #ifdef MSP
     x->x_inbuf2 = 0;
 #endif
+#ifdef SIGMUND_ASYNC
+    x->x_async = 0;
+    x->x_job = 0;
+    x->x_jobclock = 0;
+#endif
 }
 
 static void sigmund_npts(t_sigmund *x, t_floatarg f)
 {
     int nwas = x->x_npts, npts = f;
+    sigmund_wait(x);
         /* check parameter ranges */
     if (npts < NPOINTS_MIN)
         post("sigmund~: minimum points %d", NPOINTS_MIN),
@@ -952,6 +1006,7 @@ static void sigmund_npts(t_sigmund *x, t_floatarg f)
 static void sigmund_hop(t_sigmund *x, t_floatarg f)
 {
     int hop = f;
+    sigmund_wait(x);
     if (hop < 0)
     {
         pd_error(0, "sigmund~: ignoring negative hopsize %d", hop);
@@ -967,6 +1022,7 @@ static void sigmund_hop(t_sigmund *x, t_floatarg f)
 
 static void sigmund_npeak(t_sigmund *x, t_floatarg f)
 {
+    sigmund_wait(x);
     if (f < 1)
         f = 1;
     x->x_npeak = f;
@@ -974,11 +1030,13 @@ static void sigmund_npeak(t_sigmund *x, t_floatarg f)
 
 static void sigmund_maxfreq(t_sigmund *x, t_floatarg f)
 {
+    sigmund_wait(x);
     x->x_maxfreq = f;
 }
 
 static void sigmund_vibrato(t_sigmund *x, t_floatarg f)
 {
+    sigmund_wait(x);
     if (f < 0)
         f = 0;
     x->x_vibrato = f;
@@ -986,6 +1044,7 @@ static void sigmund_vibrato(t_sigmund *x, t_floatarg f)
 
 static void sigmund_stabletime(t_sigmund *x, t_floatarg f)
 {
+    sigmund_wait(x);
     if (f < 0)
         f = 0;
     x->x_stabletime = f;
@@ -993,6 +1052,7 @@ static void sigmund_stabletime(t_sigmund *x, t_floatarg f)
 
 static void sigmund_growth(t_sigmund *x, t_floatarg f)
 {
+    sigmund_wait(x);
     if (f < 0)
         f = 0;
     x->x_growth = f;
@@ -1000,19 +1060,22 @@ static void sigmund_growth(t_sigmund *x, t_floatarg f)
 
 static void sigmund_minpower(t_sigmund *x, t_floatarg f)
 {
+    sigmund_wait(x);
     if (f < 0)
         f = 0;
     x->x_minpower = f;
 }
 
-static void sigmund_doit(t_sigmund *x, int npts, t_float *arraypoints,
-    int loud, t_float srate)
+    /* analyze a window of input; this doesn't touch Pd so that it can be done
+    in a worker thread in "async" mode */
+static void sigmund_analyze(t_sigmund *x, int npts, t_float *arraypoints,
+    int loud, t_float srate, t_peak *peakv, int *nfoundp, t_float *freqp,
+    t_float *powerp, t_float *notep)
 {
-    t_peak *peakv = (t_peak *)alloca(sizeof(t_peak) * x->x_npeak);
-    int nfound, i, cnt;
+    int nfound;
     t_float freq = 0, power, note = 0;
     sigmund_getrawpeaks(npts, arraypoints, x->x_npeak, peakv,
-        &nfound, &power, srate, loud, x->x_maxfreq);
+        &nfound, &power, srate, loud, x->x_maxfreq, 0);
     if (x->x_dopitch)
         sigmund_getpitch(nfound, peakv, &freq, npts, srate, 
         x->x_param1, x->x_param2, loud);
@@ -1023,6 +1086,16 @@ static void sigmund_doit(t_sigmund *x, int npts, t_float *arraypoints,
     if (x->x_dotracks)
         sigmund_peaktrack(nfound, peakv, x->x_ntrack, x->x_trackv, 
             2* srate / npts, loud);
+    *nfoundp = nfound;
+    *freqp = freq;
+    *powerp = power;
+    *notep = note;
+}
+
+static void sigmund_output(t_sigmund *x, t_peak *peakv, int nfound,
+    t_float freq, t_float power, t_float note)
+{
+    int i, cnt;
     for (cnt = x->x_nvarout; cnt--;)
     {
         t_varout *v = &x->x_varoutv[cnt];
@@ -1065,9 +1138,21 @@ static void sigmund_doit(t_sigmund *x, int npts, t_float *arraypoints,
     }
 }
 
+static void sigmund_doit(t_sigmund *x, int npts, t_float *arraypoints,
+    int loud, t_float srate)
+{
+    t_peak *peakv = (t_peak *)alloca(sizeof(t_peak) * x->x_npeak);
+    int nfound;
+    t_float freq, power, note;
+    sigmund_analyze(x, npts, arraypoints, loud, srate, peakv, &nfound,
+        &freq, &power, &note);
+    sigmund_output(x, peakv, nfound, freq, power, note);
+}
+
 static t_int *sigmund_perform(t_int *w);
 static void sigmund_dsp(t_sigmund *x, t_signal **sp)
 {
+    sigmund_wait(x);
     if (x->x_mode == MODE_STREAM)
     {
         if (x->x_hop % sp[0]->s_n)
@@ -1089,6 +1174,7 @@ static void sigmund_dsp(t_sigmund *x, t_signal **sp)
 
 static void sigmund_print(t_sigmund *x)
 {
+    sigmund_wait(x);
     post("sigmund~ settings:");
     post("npts %d", (int)x->x_npts);
     post("hop %d", (int)x->x_hop);
@@ -1103,6 +1189,12 @@ static void sigmund_print(t_sigmund *x)
 
 static void sigmund_free(t_sigmund *x)
 {
+#ifdef SIGMUND_ASYNC
+    sigmund_async(x, 0);
+    sigmund_jobfree(x);
+    if (x->x_jobclock)
+        clock_free(x->x_jobclock);
+#endif
     if (x->x_inbuf)
     {
         freebytes(x->x_inbuf, x->x_npts * sizeof(*x->x_inbuf));
@@ -1133,10 +1225,379 @@ static void sigmund_stabletime(t_sigmund *x, t_floatarg f);
 static void sigmund_growth(t_sigmund *x, t_floatarg f);
 static void sigmund_minpower(t_sigmund *x, t_floatarg f);
 
+#ifdef SIGMUND_ASYNC
+/* In "async" mode the clock hands each window to a worker thread, and
+outputs the results the next time it goes off, one hop later, so that the
+analysis isn't done in the same thread as the DSP.  If the worker isn't done
+by then we wait for it, so the output is the same as without "async" except
+for the delay.  Debugging printout ("printnext") is done the usual way
+since Pd's post() can only be called from Pd's own thread. */
+
+static void *sigmund_worker(void *z)
+{
+    t_sigmund *x = (t_sigmund *)z;
+    pthread_mutex_lock(&x->x_mutex);
+    while (1)
+    {
+        while (!x->x_busy && !x->x_quit)
+            pthread_cond_wait(&x->x_requestcond, &x->x_mutex);
+        if (x->x_quit)
+            break;
+        pthread_mutex_unlock(&x->x_mutex);
+        sigmund_analyze(x, x->x_nframe, x->x_frame, 0, x->x_framesr,
+            x->x_peakv, &x->x_nfound, &x->x_freq, &x->x_power, &x->x_note);
+        pthread_mutex_lock(&x->x_mutex);
+        x->x_busy = 0;
+        x->x_pending = 1;
+        pthread_cond_signal(&x->x_answercond);
+    }
+    pthread_mutex_unlock(&x->x_mutex);
+    return (0);
+}
+
+    /* wait for the worker to finish with the current window if any.  This
+    is called before changing anything the analysis depends on. */
+static void sigmund_wait(t_sigmund *x)
+{
+    if (!x->x_async)
+        return;
+    pthread_mutex_lock(&x->x_mutex);
+    while (x->x_busy)
+        pthread_cond_wait(&x->x_answercond, &x->x_mutex);
+    pthread_mutex_unlock(&x->x_mutex);
+}
+
+    /* output the results of the last window the worker analyzed */
+static void sigmund_flush(t_sigmund *x)
+{
+    sigmund_wait(x);
+    if (x->x_pending)
+    {
+        x->x_pending = 0;
+        sigmund_output(x, x->x_peakv, x->x_nfound, x->x_freq, x->x_power,
+            x->x_note);
+    }
+}
+
+static void sigmund_handoff(t_sigmund *x)
+{
+    if (x->x_nframe != x->x_npts)
+    {
+        x->x_frame = (t_sample *)t_resizebytes(x->x_frame,
+            x->x_nframe * sizeof(*x->x_frame), x->x_npts * sizeof(*x->x_frame));
+        x->x_nframe = x->x_npts;
+    }
+    if (x->x_npeakv < x->x_npeak)
+    {
+        x->x_peakv = (t_peak *)t_resizebytes(x->x_peakv,
+            x->x_npeakv * sizeof(*x->x_peakv), x->x_npeak * sizeof(*x->x_peakv));
+        x->x_npeakv = x->x_npeak;
+    }
+    memcpy(x->x_frame, x->x_inbuf, x->x_npts * sizeof(*x->x_frame));
+    x->x_framesr = x->x_sr;
+    pthread_mutex_lock(&x->x_mutex);
+    x->x_busy = 1;
+    pthread_cond_signal(&x->x_requestcond);
+    pthread_mutex_unlock(&x->x_mutex);
+}
+
+static void sigmund_async(t_sigmund *x, t_floatarg f)
+{
+    int onoff = (f != 0);
+    if (onoff == x->x_async)
+        return;
+    if (onoff)
+    {
+        pthread_attr_t attr;
+        int err;
+        x->x_busy = x->x_quit = x->x_pending = 0;
+        pthread_mutex_init(&x->x_mutex, 0);
+        pthread_cond_init(&x->x_requestcond, 0);
+        pthread_cond_init(&x->x_answercond, 0);
+            /* the analysis uses alloca() for big buffers */
+        pthread_attr_init(&attr);
+        pthread_attr_setstacksize(&attr, 4 * 1024 * 1024);
+        err = pthread_create(&x->x_thread, &attr, sigmund_worker, x);
+        pthread_attr_destroy(&attr);
+        if (err)
+        {
+            pd_error(x, "sigmund~: couldn't start worker thread");
+            pthread_cond_destroy(&x->x_answercond);
+            pthread_cond_destroy(&x->x_requestcond);
+            pthread_mutex_destroy(&x->x_mutex);
+            return;
+        }
+        x->x_async = 1;
+    }
+    else
+    {
+        sigmund_flush(x);
+        pthread_mutex_lock(&x->x_mutex);
+        x->x_quit = 1;
+        pthread_cond_signal(&x->x_requestcond);
+        pthread_mutex_unlock(&x->x_mutex);
+        pthread_join(x->x_thread, 0);
+        pthread_cond_destroy(&x->x_answercond);
+        pthread_cond_destroy(&x->x_requestcond);
+        pthread_mutex_destroy(&x->x_mutex);
+        if (x->x_frame)
+            freebytes(x->x_frame, x->x_nframe * sizeof(*x->x_frame));
+        if (x->x_peakv)
+            freebytes(x->x_peakv, x->x_npeakv * sizeof(*x->x_peakv));
+        x->x_frame = 0;
+        x->x_peakv = 0;
+        x->x_nframe = x->x_npeakv = 0;
+        x->x_async = 0;
+    }
+}
+
+/* The "analyze" message analyzes a stretch of an array as a series of
+windows "hop" points apart, as though it had been played into sigmund~.  The
+windows are divided into ranges, one for each of a pool of worker threads
+which find the peaks and pitch of each window.  A clock checks for the
+threads to finish and then outputs the results window by window in order,
+finding notes and tracks on the way since these depend on the windows
+before.  The array is copied first so it may change meanwhile. */
+
+#define SIGMUND_MAXTHREADS 16
+#define SIGMUND_JOBPOLL 5   /* msec between checks for the threads */
+
+typedef struct _sigmundrange
+{
+    struct _sigmundjob *r_job;
+    int r_first;            /* first window for this thread */
+    int r_n;                /* number of windows */
+} t_sigmundrange;
+
+typedef struct _sigmundjob
+{
+    int j_npts;             /* points per window */
+    int j_hop;              /* points between windows */
+    int j_nwindow;          /* number of windows */
+    int j_npeak;            /* analysis parameters at the time of the job */
+    t_float j_sr;
+    t_float j_maxfreq;
+    t_float j_param1;
+    t_float j_param2;
+    int j_dopitch;
+    t_float *j_samps;       /* copy of the array */
+    int j_nsamps;
+    t_peak *j_peakv;        /* j_npeak peaks for each window */
+    int *j_nfound;          /* number found in each window */
+    t_float *j_freq;        /* pitch of each window */
+    t_float *j_power;       /* power of each window */
+    int j_nthread;
+    int j_ndone;            /* threads finished, protected by j_mutex */
+    volatile int j_cancel;  /* nonzero to stop the threads early */
+    pthread_mutex_t j_mutex;
+    pthread_t j_threadv[SIGMUND_MAXTHREADS];
+    t_sigmundrange j_rangev[SIGMUND_MAXTHREADS];
+} t_sigmundjob;
+
+static void *sigmund_jobworker(void *z)
+{
+    t_sigmundrange *r = (t_sigmundrange *)z;
+    t_sigmundjob *j = r->r_job;
+    t_realfft *fft = realfft_new(2 * j->j_npts);
+    int i;
+    for (i = r->r_first; i < r->r_first + r->r_n && !j->j_cancel; i++)
+    {
+        t_peak *peakv = j->j_peakv + i * j->j_npeak;
+        sigmund_getrawpeaks(j->j_npts, j->j_samps + i * j->j_hop,
+            j->j_npeak, peakv, &j->j_nfound[i], &j->j_power[i], j->j_sr, 0,
+                j->j_maxfreq, fft);
+        j->j_freq[i] = 0;
+        if (j->j_dopitch)
+            sigmund_getpitch(j->j_nfound[i], peakv, &j->j_freq[i],
+                j->j_npts, j->j_sr, j->j_param1, j->j_param2, 0);
+    }
+    realfft_free(fft);
+    pthread_mutex_lock(&j->j_mutex);
+    j->j_ndone++;
+    pthread_mutex_unlock(&j->j_mutex);
+    return (0);
+}
+
+    /* wait for a job's threads (stopping them first if "cancel" is set) and
+    free it */
+static void sigmund_jobjoin(t_sigmundjob *j, int cancel)
+{
+    int i;
+    if (cancel)
+        j->j_cancel = 1;
+    for (i = 0; i < j->j_nthread; i++)
+        pthread_join(j->j_threadv[i], 0);
+    pthread_mutex_destroy(&j->j_mutex);
+    freebytes(j->j_samps, j->j_nsamps * sizeof(*j->j_samps));
+    freebytes(j->j_peakv, j->j_nwindow * j->j_npeak * sizeof(*j->j_peakv));
+    freebytes(j->j_nfound, j->j_nwindow * sizeof(*j->j_nfound));
+    freebytes(j->j_freq, j->j_nwindow * sizeof(*j->j_freq));
+    freebytes(j->j_power, j->j_nwindow * sizeof(*j->j_power));
+    freebytes(j, sizeof(*j));
+}
+
+    /* abandon the job in progress if any */
+static void sigmund_jobfree(t_sigmund *x)
+{
+    if (x->x_job)
+    {
+        sigmund_jobjoin(x->x_job, 1);
+        x->x_job = 0;
+        clock_unset(x->x_jobclock);
+    }
+}
+
+static void sigmund_jobtick(t_sigmund *x)
+{
+    t_sigmundjob *j = x->x_job;
+    int i, done;
+    if (!j)
+        return;
+    pthread_mutex_lock(&j->j_mutex);
+    done = (j->j_ndone == j->j_nthread);
+    pthread_mutex_unlock(&j->j_mutex);
+    if (!done)
+    {
+        clock_delay(x->x_jobclock, SIGMUND_JOBPOLL);
+        return;
+    }
+        /* the job is detached first so that a new one can be started from
+        the outlets */
+    x->x_job = 0;
+    for (i = 0; i < j->j_nwindow; i++)
+    {
+        t_peak *peakv = j->j_peakv + i * j->j_npeak;
+        t_float note = 0;
+        if (x->x_donote)
+            notefinder_doit(&x->x_notefinder, j->j_freq[i], j->j_power[i],
+                &note, x->x_vibrato,
+                    1 + x->x_stabletime * 0.001 * j->j_sr / (t_float)j->j_hop,
+                        exp(LOG10*0.1*(x->x_minpower - 100)), x->x_growth, 0);
+        if (x->x_dotracks)
+            sigmund_peaktrack(j->j_nfound[i], peakv, x->x_ntrack,
+                x->x_trackv, 2 * j->j_sr / j->j_npts, 0);
+        sigmund_output(x, peakv, j->j_nfound[i], j->j_freq[i],
+            j->j_power[i], note);
+    }
+    sigmund_jobjoin(j, 0);
+}
+
+static void sigmund_analyzearray(t_sigmund *x, t_symbol *s,
+    int argc, t_atom *argv)
+{
+    t_symbol *arrayname = atom_getsymbolarg(0, argc, argv);
+    int npts = atom_getfloatarg(1, argc, argv);
+    int hop = atom_getfloatarg(2, argc, argv);
+    t_float srate = atom_getfloatarg(3, argc, argv);
+    int onset = atom_getfloatarg(4, argc, argv);
+    int nwindow = atom_getfloatarg(5, argc, argv);
+    int arraysize, maxwindow, nthread, i;
+    t_word *wordarray;
+    t_garray *a;
+    t_sigmundjob *j;
+    if (argc < 4)
+    {
+        pd_error(x,
+    "sigmund~: analyze: array-name, npts, hop, samplerate [onset] [nwindows]");
+        return;
+    }
+    if (x->x_job)
+    {
+        pd_error(x, "sigmund~: analyze: still busy with previous array");
+        return;
+    }
+    if (npts < NPOINTS_MIN || npts > NPOINTS_MAX ||
+        npts != (1 << sigmund_ilog2(npts)))
+    {
+        pd_error(x, "sigmund~: analyze: bad npoints");
+        return;
+    }
+    if (hop < 1 || onset < 0 || srate <= 0)
+    {
+        pd_error(x, "sigmund~: analyze: bad hop, onset, or samplerate");
+        return;
+    }
+    if (!(a = (t_garray *)pd_findbyclass(arrayname, garray_class)) ||
+        !garray_getfloatwords(a, &arraysize, &wordarray) ||
+            arraysize < onset + npts)
+    {
+        pd_error(x, "%s: array missing or too small", arrayname->s_name);
+        return;
+    }
+    maxwindow = 1 + (arraysize - onset - npts) / hop;
+    if (nwindow < 1 || nwindow > maxwindow)
+        nwindow = maxwindow;
+    nthread = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthread > SIGMUND_MAXTHREADS)
+        nthread = SIGMUND_MAXTHREADS;
+    if (nthread > nwindow)
+        nthread = nwindow;
+    if (nthread < 1)
+        nthread = 1;
+
+    j = (t_sigmundjob *)getbytes(sizeof(*j));
+    j->j_npts = npts;
+    j->j_hop = hop;
+    j->j_nwindow = nwindow;
+    j->j_npeak = x->x_npeak;
+    j->j_sr = srate;
+    j->j_maxfreq = x->x_maxfreq;
+    j->j_param1 = x->x_param1;
+    j->j_param2 = x->x_param2;
+    j->j_dopitch = x->x_dopitch;
+    j->j_nsamps = (nwindow - 1) * hop + npts;
+    j->j_samps = (t_float *)getbytes(j->j_nsamps * sizeof(*j->j_samps));
+    for (i = 0; i < j->j_nsamps; i++)
+        j->j_samps[i] = wordarray[onset + i].w_float;
+    j->j_peakv = (t_peak *)getbytes(nwindow * j->j_npeak *
+        sizeof(*j->j_peakv));
+    j->j_nfound = (int *)getbytes(nwindow * sizeof(*j->j_nfound));
+    j->j_freq = (t_float *)getbytes(nwindow * sizeof(*j->j_freq));
+    j->j_power = (t_float *)getbytes(nwindow * sizeof(*j->j_power));
+    pthread_mutex_init(&j->j_mutex, 0);
+    for (i = 0; i < nthread; i++)
+    {
+        pthread_attr_t attr;
+        int err;
+        j->j_rangev[i].r_job = j;
+        j->j_rangev[i].r_first = (int)((long)nwindow * i / nthread);
+        j->j_rangev[i].r_n = (int)((long)nwindow * (i+1) / nthread) -
+            j->j_rangev[i].r_first;
+            /* the analysis uses alloca() for big buffers */
+        pthread_attr_init(&attr);
+        pthread_attr_setstacksize(&attr, 4 * 1024 * 1024);
+        err = pthread_create(&j->j_threadv[i], &attr, sigmund_jobworker,
+            &j->j_rangev[i]);
+        pthread_attr_destroy(&attr);
+        if (err)
+        {
+            pd_error(x, "sigmund~: analyze: couldn't start worker thread");
+            j->j_nthread = i;
+            sigmund_jobjoin(j, 1);
+            return;
+        }
+        j->j_nthread = i + 1;
+    }
+    x->x_job = j;
+    if (!x->x_jobclock)
+        x->x_jobclock = clock_new(x, (t_method)sigmund_jobtick);
+    clock_delay(x->x_jobclock, SIGMUND_JOBPOLL);
+}
+#endif /* SIGMUND_ASYNC */
+
 static void sigmund_tick(t_sigmund *x)
 {
+#ifdef SIGMUND_ASYNC
+    if (x->x_async)
+        sigmund_flush(x);
+#endif
     if (x->x_infill == x->x_npts)
     {
+#ifdef SIGMUND_ASYNC
+        if (x->x_async && !x->x_loud)
+            sigmund_handoff(x);
+        else
+#endif
         sigmund_doit(x, x->x_npts, x->x_inbuf, x->x_loud, x->x_sr);
         if (x->x_hop >= x->x_npts)
         {
@@ -1180,6 +1641,7 @@ static t_int *sigmund_perform(t_int *w)
 static void *sigmund_new(t_symbol *s, int argc, t_atom *argv)
 {
     t_sigmund *x = (t_sigmund *)pd_new(sigmund_class);
+    int async = 0;
     sigmund_preinit(x);
 
     while (argc > 0)
@@ -1201,6 +1663,13 @@ static void *sigmund_new(t_symbol *s, int argc, t_atom *argv)
             x->x_mode = MODE_BLOCK;
             argc--, argv++;
         }
+#endif
+#ifdef SIGMUND_ASYNC
+        else if (!strcmp(firstarg->s_name, "-async"))
+        {
+            async = 1;
+            argc--, argv++;
+        }
 #endif
         else if (!strcmp(firstarg->s_name, "-npts") && argc > 1)
         {
@@ -1331,6 +1800,10 @@ static void *sigmund_new(t_symbol *s, int argc, t_atom *argv)
     sigmund_npts(x, x->x_npts);
     notefinder_init(&x->x_notefinder);
     sigmund_clear(x);
+#ifdef SIGMUND_ASYNC
+    if (async)
+        sigmund_async(x, 1);
+#endif
     return (x);
 }
 
@@ -1382,6 +1855,7 @@ static void sigmund_list(t_sigmund *x, t_symbol *s, int argc, t_atom *argv)
     }
     for (i = 0; i < npts; i++)
         arraypoints[i] = wordarray[i+onset].w_float;
+    sigmund_wait(x);
     sigmund_doit(x, npts, arraypoints, loud, srate);
 cleanup:
     freebytes(arraypoints, bufsize);
@@ -1389,6 +1863,7 @@ cleanup:
 
 static void sigmund_clear(t_sigmund *x)
 {
+    sigmund_wait(x);
     if (x->x_trackv)
         memset(x->x_trackv, 0, x->x_ntrack * sizeof(*x->x_trackv));
     x->x_infill = x->x_countdown = 0;
@@ -1397,21 +1872,25 @@ static void sigmund_clear(t_sigmund *x)
     /* these are for testing; their meanings vary... */
 static void sigmund_param1(t_sigmund *x, t_floatarg f)
 {
+    sigmund_wait(x);
     x->x_param1 = f;
 }
 
 static void sigmund_param2(t_sigmund *x, t_floatarg f)
 {
+    sigmund_wait(x);
     x->x_param2 = f;
 }
 
 static void sigmund_param3(t_sigmund *x, t_floatarg f)
 {
+    sigmund_wait(x);
     x->x_param3 = f;
 }
 
 static void sigmund_printnext(t_sigmund *x, t_float f)
 {
+    sigmund_wait(x);
     x->x_loud = f;
 }
 
@@ -1449,6 +1928,12 @@ void sigmund_tilde_setup(void)
         gensym("print"), 0);
     class_addmethod(sigmund_class, (t_method)sigmund_printnext,
         gensym("printnext"), A_FLOAT, 0);
+#ifdef SIGMUND_ASYNC
+    class_addmethod(sigmund_class, (t_method)sigmund_async,
+        gensym("async"), A_FLOAT, 0);
+    class_addmethod(sigmund_class, (t_method)sigmund_analyzearray,
+        gensym("analyze"), A_GIMME, 0);
+#endif
     post("sigmund~ version 0.07");
 }
 
@@ -114,6 +114,13 @@ static void stdout_anything(t_stdout *x, t_symbol *s, int argc, t_atom *argv)
     }
     else if (x->x_mode == MODE_PDTILDE)
     {
+            /* if pd~ is using shared memory, the scheduler takes it */
+        t_pd *shm = gensym("#pd_shm_stdio")->s_thing;
+        if (shm)
+        {
+            typedmess(shm, s, argc, argv);
+            return;
+        }
         pd_tilde_putsymbol(s, stdout);
         for (; argc--; argv++)
         {
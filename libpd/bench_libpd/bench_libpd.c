@@ -0,0 +1,410 @@
+/*
+    bench_libpd: time some of Pd's inner loops through libpd, with no audio
+    device or GUI, and print the results as JSON so that runs from different
+    commits can be compared.  Every result is a time (lower is better) and
+    is the best of a few runs.  Progress and a readable summary go to stderr.
+
+        $ ./bench_libpd [-quick] > results.json
+
+    The patches are generated here, except for a one-object abstraction that
+    "clone" needs, which is written to the current directory and removed
+    again afterward.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include "z_libpd.h"
+#include "m_imp.h"
+
+#define SRATE 44100
+#define NREPEAT 3           /* take the best of this many runs */
+#define NPERFORM 16         /* copies of each object in a perform test */
+#define CHUNKTICKS 16       /* ticks per libpd_process_float() call */
+
+static int bench_quick;
+static int bench_nresults;
+static float bench_inbuf[CHUNKTICKS * 64], bench_outbuf[CHUNKTICKS * 64 * 2];
+
+static void pdprint(const char *s)
+{
+    fprintf(stderr, "%s", s);
+}
+
+static void result(const char *name, double value, const char *unit)
+{
+    printf("%s\n    {\"name\": \"%s\", \"value\": %.6g, \"unit\": \"%s\"}",
+        (bench_nresults++ ? "," : ""), name, value, unit);
+    fprintf(stderr, "%-44s %12.4g %s\n", name, value, unit);
+}
+
+/* -------- building patch text ---------- */
+
+typedef struct _strbuf
+{
+    char *s_buf;
+    size_t s_len;
+    size_t s_size;
+} t_strbuf;
+
+static void sb_init(t_strbuf *b)
+{
+    b->s_size = 4096;
+    b->s_buf = (char *)malloc(b->s_size);
+    b->s_len = 0;
+    b->s_buf[0] = 0;
+}
+
+static void sb_printf(t_strbuf *b, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+    while (1)
+    {
+        va_start(ap, fmt);
+        n = vsnprintf(b->s_buf + b->s_len, b->s_size - b->s_len, fmt, ap);
+        va_end(ap);
+        if (n >= 0 && (size_t)n < b->s_size - b->s_len)
+            break;
+        b->s_size *= 2;
+        b->s_buf = (char *)realloc(b->s_buf, b->s_size);
+    }
+    b->s_len += n;
+}
+
+static void sb_free(t_strbuf *b)
+{
+    free(b->s_buf);
+}
+
+    /* evaluate patch text as if it were a file "name" in the current
+    directory; returns the new canvas */
+static void *loadpatch(const char *text, const char *name)
+{
+    t_binbuf *b = binbuf_new();
+    void *x;
+    binbuf_text(b, text, strlen(text));
+    sys_lock();
+    pd_globallock();
+    x = glob_evalpatch(b, gensym(name), gensym("."));
+    pd_globalunlock();
+    sys_unlock();
+    binbuf_free(b);
+    return (x);
+}
+
+static void setdsp(int onoff)
+{
+    libpd_start_message(1);
+    libpd_add_float(onoff);
+    libpd_finish_message("pd", "dsp");
+}
+
+/* -------- perform routines ---------- */
+
+    /* each object is fed from one noise~ on as many signal inlets as
+    "p_nsigin" says; the rest stay scalars */
+static const struct _perftest
+{
+    const char *p_name;
+    const char *p_args;
+    int p_nsigin;
+} perftests[] =
+{
+    {"osc~", "440", 0},
+    {"phasor~", "440", 0},
+    {"noise~", "", 0},
+    {"cos~", "", 1},
+    {"*~", "0.5", 1},
+    {"*~", "", 2},
+    {"+~", "", 2},
+    {"clip~", "-0.5 0.5", 1},
+    {"wrap~", "", 1},
+    {"sqrt~", "", 1},
+    {"mtof~", "", 1},
+    {"lop~", "1000", 1},
+    {"hip~", "5", 1},
+    {"bp~", "1000 10", 1},
+    {"vcf~", "10", 2},
+    {"biquad~", "1.4 -0.6 0.2 0.4 0.2", 1},
+    {"rpole~", "0.9", 1},
+    {"tabread4~", "bench-table", 1},
+    {"vd~", "bench-delay", 1},
+    {"env~", "", 1},
+};
+#define NPERFTESTS (sizeof(perftests)/sizeof(*perftests))
+
+static const int blocksizes[] = {64, 256, 1024};
+#define NBLOCKSIZES (sizeof(blocksizes)/sizeof(*blocksizes))
+
+    /* seconds to compute "nsamples" through a patch with "ncopies" of the
+    object (none for the baseline) in a subpatch reblocked to "blocksize" */
+static double perform_time(const struct _perftest *p, int ncopies,
+    int blocksize, int nsamples)
+{
+    t_strbuf b;
+    void *x;
+    int i, j, ticks = nsamples / 64;
+    double best = 1e9;
+    sb_init(&b);
+    sb_printf(&b, "#N canvas 0 0 400 300 10;\n");
+    sb_printf(&b, "#X array bench-table 1024 float 0;\n");
+    sb_printf(&b, "#X obj 0 0 delwrite~ bench-delay 100;\n");
+    sb_printf(&b, "#N canvas 0 0 400 300 bench 0;\n");
+    sb_printf(&b, "#X obj 0 0 block~ %d;\n", blocksize);
+    sb_printf(&b, "#X obj 0 0 noise~;\n");
+    for (i = 0; i < ncopies; i++)
+        sb_printf(&b, "#X obj 0 0 %s %s;\n", p->p_name, p->p_args);
+    for (i = 0; i < ncopies; i++)
+        for (j = 0; j < p->p_nsigin; j++)
+            sb_printf(&b, "#X connect 1 0 %d %d;\n", i + 2, j);
+    sb_printf(&b, "#X restore 0 0 pd bench;\n");
+    x = loadpatch(b.s_buf, "bench-perform.pd");
+    sb_free(&b);
+    setdsp(1);
+    for (i = 0; i < NREPEAT; i++)
+    {
+        double start = sys_getrealtime(), elapsed;
+        for (j = 0; j < ticks; j += CHUNKTICKS)
+            libpd_process_float(CHUNKTICKS, bench_inbuf, bench_outbuf);
+        if ((elapsed = sys_getrealtime() - start) < best)
+            best = elapsed;
+    }
+    setdsp(0);
+    libpd_closefile(x);
+    return (best);
+}
+
+static void bench_perform(void)
+{
+    unsigned int i, j;
+    int nsamples = (bench_quick ? 1 << 16 : 1 << 18);
+    char name[MAXPDSTRING];
+    for (j = 0; j < NBLOCKSIZES; j++)
+    {
+        double base = perform_time(&perftests[0], 0, blocksizes[j], nsamples);
+        for (i = 0; i < NPERFTESTS; i++)
+        {
+            double t = perform_time(&perftests[i], NPERFORM, blocksizes[j],
+                nsamples) - base;
+            snprintf(name, MAXPDSTRING, "perform/%s%s%s/%d",
+                perftests[i].p_name, (*perftests[i].p_args ? " " : ""),
+                    perftests[i].p_args, blocksizes[j]);
+            result(name, (t > 0 ? t : 0) * 1e9 / ((double)NPERFORM * nsamples),
+                "ns/sample");
+        }
+    }
+}
+
+/* -------- message dispatch ---------- */
+
+#define NCHAIN 64
+
+static void bench_dispatch(void)
+{
+    t_strbuf b;
+    void *x;
+    int i, j, n = (bench_quick ? 200000 : 2000000);
+    double best[4] = {1e9, 1e9, 1e9, 1e9}, start, elapsed;
+    t_pd *ftarget, *anytarget, *chaintarget;
+    t_atom at[2];
+    sb_init(&b);
+    sb_printf(&b, "#N canvas 0 0 400 300 10;\n");
+    sb_printf(&b, "#X obj 0 0 r bench-f;\n#X obj 0 0 f;\n");
+    sb_printf(&b, "#X obj 0 0 r bench-any;\n#X obj 0 0 route foo bar;\n");
+    sb_printf(&b, "#X obj 0 0 r bench-chain;\n");
+    for (i = 0; i < NCHAIN; i++)
+        sb_printf(&b, "#X obj 0 0 + 1;\n");
+    sb_printf(&b, "#X connect 0 0 1 0;\n#X connect 2 0 3 0;\n");
+    for (i = 0; i < NCHAIN; i++)
+        sb_printf(&b, "#X connect %d 0 %d 0;\n", i + 4, i + 5);
+    x = loadpatch(b.s_buf, "bench-dispatch.pd");
+    sb_free(&b);
+    ftarget = gensym("bench-f")->s_thing;
+    anytarget = gensym("bench-any")->s_thing;
+    chaintarget = gensym("bench-chain")->s_thing;
+    SETFLOAT(&at[0], 1);
+    SETFLOAT(&at[1], 2);
+    for (i = 0; i < NREPEAT; i++)
+    {
+        start = sys_getrealtime();
+        for (j = 0; j < n; j++)
+            pd_typedmess(ftarget, gensym("float"), 1, at);
+        if ((elapsed = sys_getrealtime() - start) < best[0])
+            best[0] = elapsed;
+
+        start = sys_getrealtime();
+        for (j = 0; j < n; j++)
+            pd_typedmess(anytarget, gensym("foo"), 2, at);
+        if ((elapsed = sys_getrealtime() - start) < best[1])
+            best[1] = elapsed;
+
+        start = sys_getrealtime();
+        for (j = 0; j < n / NCHAIN; j++)
+            pd_float(chaintarget, j);
+        if ((elapsed = sys_getrealtime() - start) < best[2])
+            best[2] = elapsed;
+
+        start = sys_getrealtime();
+        for (j = 0; j < n; j++)
+            libpd_float("bench-f", j);
+        if ((elapsed = sys_getrealtime() - start) < best[3])
+            best[3] = elapsed;
+    }
+    libpd_closefile(x);
+    result("dispatch/pd_typedmess float", best[0] * 1e9 / n, "ns/message");
+    result("dispatch/pd_typedmess anything", best[1] * 1e9 / n, "ns/message");
+    result("dispatch/outlet_float chain",
+        best[2] * 1e9 / ((n / NCHAIN) * NCHAIN), "ns/message");
+    result("dispatch/libpd_float", best[3] * 1e9 / n, "ns/message");
+}
+
+/* -------- binbufs ---------- */
+
+static void bench_binbuf(void)
+{
+    t_strbuf text, evaltext;
+    t_binbuf *b = binbuf_new();
+    void *x;
+    int i, j, nmess = 1000, n = (bench_quick ? 20 : 200);
+    double best[2] = {1e9, 1e9}, start, elapsed;
+    sb_init(&text);
+    sb_init(&evaltext);
+    sb_printf(&evaltext, ";\n");
+    for (i = 0; i < nmess; i++)
+    {
+        sb_printf(&text, "foo %d 2.5 bar baz-%d \\$1;\n", i, i % 10);
+        sb_printf(&evaltext, "bench-f %d;\n", i);
+    }
+    x = loadpatch("#N canvas 0 0 400 300 10;\n"
+        "#X obj 0 0 r bench-f;\n#X obj 0 0 f;\n#X connect 0 0 1 0;\n",
+            "bench-binbuf.pd");
+    for (i = 0; i < NREPEAT; i++)
+    {
+        start = sys_getrealtime();
+        for (j = 0; j < n; j++)
+            binbuf_text(b, text.s_buf, text.s_len);
+        if ((elapsed = sys_getrealtime() - start) < best[0])
+            best[0] = elapsed;
+    }
+    binbuf_text(b, evaltext.s_buf, evaltext.s_len);
+    for (i = 0; i < NREPEAT; i++)
+    {
+        start = sys_getrealtime();
+        for (j = 0; j < n; j++)
+            binbuf_eval(b, 0, 0, 0);
+        if ((elapsed = sys_getrealtime() - start) < best[1])
+            best[1] = elapsed;
+    }
+    libpd_closefile(x);
+    binbuf_free(b);
+    sb_free(&text);
+    sb_free(&evaltext);
+    result("binbuf/text", best[0] * 1e9 / ((double)n * nmess), "ns/message");
+    result("binbuf/eval", best[1] * 1e9 / ((double)n * nmess), "ns/message");
+}
+
+/* -------- loading patches ---------- */
+
+static void bench_load(void)
+{
+    static const int sizes[] = {100, 1000, 10000};
+    unsigned int k;
+    char name[MAXPDSTRING];
+    for (k = 0; k < sizeof(sizes)/sizeof(*sizes); k++)
+    {
+        int i, nobj = sizes[k], n = (bench_quick ? 1 : NREPEAT);
+        double bestload = 1e9, bestfree = 1e9;
+        t_strbuf b;
+        sb_init(&b);
+        sb_printf(&b, "#N canvas 0 0 400 300 10;\n");
+        for (i = 0; i < nobj; i++)
+            sb_printf(&b, (i & 1 ? "#X obj %d %d + 1;\n" : "#X obj %d %d f;\n"),
+                (i % 20) * 40, (i / 20) * 20);
+        for (i = 1; i < nobj; i++)
+            sb_printf(&b, "#X connect %d 0 %d %d;\n", i - 1, i, i & 1);
+        for (i = 0; i < n; i++)
+        {
+            double start = sys_getrealtime(), elapsed;
+            void *x = loadpatch(b.s_buf, "bench-load.pd");
+            if ((elapsed = sys_getrealtime() - start) < bestload)
+                bestload = elapsed;
+            start = sys_getrealtime();
+            libpd_closefile(x);
+            if ((elapsed = sys_getrealtime() - start) < bestfree)
+                bestfree = elapsed;
+        }
+        sb_free(&b);
+        snprintf(name, MAXPDSTRING, "load/%d objects", nobj);
+        result(name, bestload * 1e3, "ms");
+        snprintf(name, MAXPDSTRING, "close/%d objects", nobj);
+        result(name, bestfree * 1e3, "ms");
+    }
+}
+
+static void bench_clone(void)
+{
+    static const int sizes[] = {16, 256};
+    static const char *abstraction = "#N canvas 0 0 400 300 10;\n"
+        "#X obj 0 0 inlet;\n#X obj 0 0 osc~;\n#X obj 0 0 outlet~;\n"
+        "#X connect 0 0 1 0;\n#X connect 1 0 2 0;\n";
+    unsigned int k;
+    char name[MAXPDSTRING], text[MAXPDSTRING];
+    FILE *fd = fopen("bench-voice.pd", "w");
+    if (!fd || fputs(abstraction, fd) < 0)
+    {
+        perror("bench-voice.pd");
+        if (fd)
+            fclose(fd);
+        return;
+    }
+    fclose(fd);
+    for (k = 0; k < sizeof(sizes)/sizeof(*sizes); k++)
+    {
+        int i;
+        double best = 1e9;
+        snprintf(text, MAXPDSTRING,
+            "#N canvas 0 0 400 300 10;\n#X obj 0 0 clone bench-voice %d;\n",
+                sizes[k]);
+        for (i = 0; i < NREPEAT; i++)
+        {
+            double start = sys_getrealtime(), elapsed;
+            void *x = loadpatch(text, "bench-clone.pd");
+            if ((elapsed = sys_getrealtime() - start) < best)
+                best = elapsed;
+            libpd_closefile(x);
+        }
+        snprintf(name, MAXPDSTRING, "clone/%d copies", sizes[k]);
+        result(name, best * 1e3, "ms");
+    }
+    remove("bench-voice.pd");
+}
+
+int main(int argc, char **argv)
+{
+    int major, minor, bugfix;
+    if (argc > 1 && !strcmp(argv[1], "-quick"))
+        bench_quick = 1;
+    else if (argc > 1)
+    {
+        fprintf(stderr, "usage: %s [-quick] > results.json\n", argv[0]);
+        return (1);
+    }
+    libpd_set_printhook(pdprint);
+    libpd_init();
+    libpd_init_audio(1, 2, SRATE);
+    sys_getversion(&major, &minor, &bugfix);
+    printf("{\n  \"pd_version\": \"%d.%d.%d\",\n", major, minor, bugfix);
+    printf("  \"float_bits\": %d,\n", (int)(8 * sizeof(t_float)));
+    printf("  \"samplerate\": %d,\n", SRATE);
+    printf("  \"quick\": %s,\n", (bench_quick ? "true" : "false"));
+    printf("  \"results\": [");
+    bench_perform();
+    bench_dispatch();
+    bench_binbuf();
+    bench_load();
+    bench_clone();
+    printf("\n  ]\n}\n");
+    return (0);
+}
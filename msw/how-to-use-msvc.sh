@@ -28,7 +28,7 @@ if make -f makefile.msvc \
     SRCASIO= ASIOLIB=/NODEFAULTLIB:ole32 PAAPI=-DPA_USE_WMME PAASIO=
  then echo -n ; else exit 1; fi
 cd ../extra
-for i in  bonk~ choice fiddle~ loop~ lrshift~ pique sigmund~ stdout pd~;
+for i in  bonk~ choice fiddle~ loop~ lrshift~ pique rev2~ rev3~ sigmund~ stdout pd~;
 do
   echo extern ----------------- $i -----------------
   cd $i
@@ -6,9 +6,119 @@
 If no creation argument is given, there are two signal inlets for vector/vector
 operation; otherwise it's vector/scalar and the second inlet takes a float
 to reset the value.
+All of these take multichannel signals; see binop_add() below.
 */
 
 #include "m_pd.h"
+#include "m_imp.h"
+#include "d_simd.h"
+
+t_int *plus_perf8(t_int *w);
+
+    /* "+~" and "*~" with a block-rate input "b" (see signal_setblockrate()
+    in d_ugen.c): a constant, or a ramp computed the way line~ would have
+    written it out.  If the block was written out after all it's in "in2". */
+static t_int *blockplus_perform(t_int *w)
+{
+    t_sample *in1 = (t_sample *)(w[1]);
+    t_blockrate *b = (t_blockrate *)(w[2]);
+    t_sample *in2 = (t_sample *)(w[3]);
+    t_sample *out = (t_sample *)(w[4]);
+    int n = (int)(w[5]), i = 0;
+    t_sample start = b->b_value, inc = b->b_inc;
+    if (b->b_vec)
+    {
+        for (; i < n; i++)
+            out[i] = in1[i] + in2[i];
+        return (w+6);
+    }
+#ifdef PD_SIMD
+    {
+        static const t_sample zero123[4] = {0, 1, 2, 3};
+        t_v4 vstart = V4_SET1(start), vinc = V4_SET1(inc),
+            four = V4_SET1(4), k = V4_LOAD(zero123);
+        for (; i < (n & ~3); i += 4, k = V4_ADD(k, four))
+            V4_STORE(out + i, V4_ADD(V4_LOAD(in1 + i),
+                V4_ADD(vstart, V4_MUL(k, vinc))));
+    }
+#endif
+    for (; i < n; i++)
+        out[i] = in1[i] + (start + i * inc);
+    return (w+6);
+}
+
+static t_int *blocktimes_perform(t_int *w)
+{
+    t_sample *in1 = (t_sample *)(w[1]);
+    t_blockrate *b = (t_blockrate *)(w[2]);
+    t_sample *in2 = (t_sample *)(w[3]);
+    t_sample *out = (t_sample *)(w[4]);
+    int n = (int)(w[5]), i = 0;
+    t_sample start = b->b_value, inc = b->b_inc;
+    if (b->b_vec)
+    {
+        for (; i < n; i++)
+            out[i] = in1[i] * in2[i];
+        return (w+6);
+    }
+#ifdef PD_SIMD
+    {
+        static const t_sample zero123[4] = {0, 1, 2, 3};
+        t_v4 vstart = V4_SET1(start), vinc = V4_SET1(inc),
+            four = V4_SET1(4), k = V4_LOAD(zero123);
+        for (; i < (n & ~3); i += 4, k = V4_ADD(k, four))
+            V4_STORE(out + i, V4_MUL(V4_LOAD(in1 + i),
+                V4_ADD(vstart, V4_MUL(k, vinc))));
+    }
+#endif
+    for (; i < n; i++)
+        out[i] = in1[i] * (start + i * inc);
+    return (w+6);
+}
+
+    /* add one call to the chain, either fusable through dsp_addpointwise()
+    ("op" >= 0) or not.  "f8" is used if n is a multiple of 8. */
+static void binop_addone(t_perfroutine f, t_perfroutine f8, int op,
+    t_sample *in1, t_int in2, t_sample *out, int n)
+{
+    if (op >= 0)
+        dsp_addpointwise((n&7 ? f : f8), op, in1, in2, 0, out, n);
+    else dsp_add((n&7 ? f : f8), 4, in1, in2, out, (t_int)n);
+}
+
+    /* add a binop whose inputs and output may have several channels.  The
+    output is as wide as the wider input (see ugen_doit()); if the channel
+    counts all agree, which is the usual case, all the channels are done in
+    one call since they're contiguous.  Otherwise the narrower input's
+    channels are reused in turn, so that a single-channel input applies to
+    every channel.  If "in2" is a scalar it's passed as "scalar2". */
+static void binop_add(t_perfroutine f, t_perfroutine f8, int op,
+    t_signal *in1, t_signal *in2, t_float *scalar2, t_signal *out)
+{
+    int n = out->s_n, nchans = out->s_nchans, n1 = in1->s_nchans,
+        n2 = (scalar2 ? nchans : in2->s_nchans), i;
+    if (n1 == nchans && n2 == nchans)
+        binop_addone(f, f8, op, in1->s_vec,
+            (scalar2 ? (t_int)scalar2 : (t_int)in2->s_vec), out->s_vec,
+                n * nchans);
+    else for (i = 0; i < nchans; i++)
+        binop_addone(f, f8, op, in1->s_vec + n * (i % n1),
+            (scalar2 ? (t_int)scalar2 : (t_int)(in2->s_vec + n * (i % n2))),
+                out->s_vec + n * i, n);
+}
+
+    /* add a binop whose second input is a block-rate signal; it has one
+    channel, which goes with each of the first input's.  If the first input
+    is block-rate too, it's filled in. */
+static void binop_addblockrate(t_perfroutine f, t_signal *in1,
+    t_signal *in2, t_signal *out)
+{
+    int n = out->s_n, nchans = out->s_nchans, n1 = in1->s_nchans, i;
+    dsp_add_blockratefill(in1);
+    for (i = 0; i < nchans; i++)
+        dsp_add(f, 5, in1->s_vec + n * (i % n1), in2->s_blockrate,
+            in2->s_vec, out->s_vec + n * i, (t_int)n);
+}
 
 /* ----------------------------- plus ----------------------------- */
 static t_class *plus_class, *scalarplus_class;
@@ -64,6 +174,15 @@ t_int *scalarplus_perf8(t_int *w)
     t_float g = *(t_float *)(w[2]);
     t_sample *out = (t_sample *)(w[3]);
     int n = (int)(w[4]);
+#ifdef PD_SIMD
+    t_v4 g4 = V4_SET1(g);
+    for (; n; n -= 8, in += 8, out += 8)
+    {
+        t_v4 f0 = V4_LOAD(in), f1 = V4_LOAD(in+4);
+        V4_STORE(out, V4_ADD(f0, g4));
+        V4_STORE(out+4, V4_ADD(f1, g4));
+    }
+#else
     for (; n; n -= 8, in += 8, out += 8)
     {
         t_sample f0 = in[0], f1 = in[1], f2 = in[2], f3 = in[3];
@@ -72,22 +191,23 @@ t_int *scalarplus_perf8(t_int *w)
         out[0] = f0 + g; out[1] = f1 + g; out[2] = f2 + g; out[3] = f3 + g;
         out[4] = f4 + g; out[5] = f5 + g; out[6] = f6 + g; out[7] = f7 + g;
     }
+#endif
     return (w+5);
 }
 
 static void plus_dsp(t_plus *x, t_signal **sp)
 {
-    dsp_add_plus(sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[0]->s_n);
+    if (sp[1]->s_blockrate)
+        binop_addblockrate(blockplus_perform, sp[0], sp[1], sp[2]);
+    else if (sp[0]->s_blockrate)
+        binop_addblockrate(blockplus_perform, sp[1], sp[0], sp[2]);
+    else binop_add(plus_perform, plus_perf8, PW_ADD, sp[0], sp[1], 0, sp[2]);
 }
 
 static void scalarplus_dsp(t_scalarplus *x, t_signal **sp)
 {
-    if (sp[0]->s_n&7)
-        dsp_add(scalarplus_perform, 4, sp[0]->s_vec, &x->x_g,
-            sp[1]->s_vec, (t_int)sp[0]->s_n);
-    else
-        dsp_add(scalarplus_perf8, 4, sp[0]->s_vec, &x->x_g,
-            sp[1]->s_vec, (t_int)sp[0]->s_n);
+    binop_add(scalarplus_perform, scalarplus_perf8, PW_SCALARADD,
+        sp[0], 0, &x->x_g, sp[1]);
 }
 
 static void plus_setup(void)
@@ -96,12 +216,15 @@ static void plus_setup(void)
         sizeof(t_plus), 0, A_GIMME, 0);
     class_addmethod(plus_class, (t_method)plus_dsp, gensym("dsp"), A_CANT, 0);
     CLASS_MAINSIGNALIN(plus_class, t_plus, x_f);
+    class_setmultichannel(plus_class);
+    class_setblockratein(plus_class);
     class_sethelpsymbol(plus_class, gensym("sigbinops"));
     scalarplus_class = class_new(gensym("+~"), 0, 0,
         sizeof(t_scalarplus), 0, 0);
     CLASS_MAINSIGNALIN(scalarplus_class, t_scalarplus, x_f);
     class_addmethod(scalarplus_class, (t_method)scalarplus_dsp,
         gensym("dsp"), A_CANT, 0);
+    class_setmultichannel(scalarplus_class);
     class_sethelpsymbol(scalarplus_class, gensym("sigbinops"));
 }
 
@@ -159,6 +282,15 @@ t_int *minus_perf8(t_int *w)
     t_sample *in2 = (t_sample *)(w[2]);
     t_sample *out = (t_sample *)(w[3]);
     int n = (int)(w[4]);
+#ifdef PD_SIMD
+    for (; n; n -= 8, in1 += 8, in2 += 8, out += 8)
+    {
+        t_v4 f0 = V4_LOAD(in1), f1 = V4_LOAD(in1+4);
+        t_v4 g0 = V4_LOAD(in2), g1 = V4_LOAD(in2+4);
+        V4_STORE(out, V4_SUB(f0, g0));
+        V4_STORE(out+4, V4_SUB(f1, g1));
+    }
+#else
     for (; n; n -= 8, in1 += 8, in2 += 8, out += 8)
     {
         t_sample f0 = in1[0], f1 = in1[1], f2 = in1[2], f3 = in1[3];
@@ -170,6 +302,7 @@ t_int *minus_perf8(t_int *w)
         out[0] = f0 - g0; out[1] = f1 - g1; out[2] = f2 - g2; out[3] = f3 - g3;
         out[4] = f4 - g4; out[5] = f5 - g5; out[6] = f6 - g6; out[7] = f7 - g7;
     }
+#endif
     return (w+5);
 }
 
@@ -189,6 +322,15 @@ t_int *scalarminus_perf8(t_int *w)
     t_float g = *(t_float *)(w[2]);
     t_sample *out = (t_sample *)(w[3]);
     int n = (int)(w[4]);
+#ifdef PD_SIMD
+    t_v4 g4 = V4_SET1(g);
+    for (; n; n -= 8, in += 8, out += 8)
+    {
+        t_v4 f0 = V4_LOAD(in), f1 = V4_LOAD(in+4);
+        V4_STORE(out, V4_SUB(f0, g4));
+        V4_STORE(out+4, V4_SUB(f1, g4));
+    }
+#else
     for (; n; n -= 8, in += 8, out += 8)
     {
         t_sample f0 = in[0], f1 = in[1], f2 = in[2], f3 = in[3];
@@ -197,27 +339,19 @@ t_int *scalarminus_perf8(t_int *w)
         out[0] = f0 - g; out[1] = f1 - g; out[2] = f2 - g; out[3] = f3 - g;
         out[4] = f4 - g; out[5] = f5 - g; out[6] = f6 - g; out[7] = f7 - g;
     }
+#endif
     return (w+5);
 }
 
 static void minus_dsp(t_minus *x, t_signal **sp)
 {
-    if (sp[0]->s_n&7)
-        dsp_add(minus_perform, 4,
-            sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, (t_int)sp[0]->s_n);
-    else
-        dsp_add(minus_perf8, 4,
-            sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, (t_int)sp[0]->s_n);
+    binop_add(minus_perform, minus_perf8, PW_SUB, sp[0], sp[1], 0, sp[2]);
 }
 
 static void scalarminus_dsp(t_scalarminus *x, t_signal **sp)
 {
-    if (sp[0]->s_n&7)
-        dsp_add(scalarminus_perform, 4, sp[0]->s_vec, &x->x_g,
-            sp[1]->s_vec, (t_int)sp[0]->s_n);
-    else
-        dsp_add(scalarminus_perf8, 4, sp[0]->s_vec, &x->x_g,
-            sp[1]->s_vec, (t_int)sp[0]->s_n);
+    binop_add(scalarminus_perform, scalarminus_perf8, PW_SCALARSUB,
+        sp[0], 0, &x->x_g, sp[1]);
 }
 
 static void minus_setup(void)
@@ -226,12 +360,14 @@ static void minus_setup(void)
         sizeof(t_minus), 0, A_GIMME, 0);
     CLASS_MAINSIGNALIN(minus_class, t_minus, x_f);
     class_addmethod(minus_class, (t_method)minus_dsp, gensym("dsp"), A_CANT, 0);
+    class_setmultichannel(minus_class);
     class_sethelpsymbol(minus_class, gensym("sigbinops"));
     scalarminus_class = class_new(gensym("-~"), 0, 0,
         sizeof(t_scalarminus), 0, 0);
     CLASS_MAINSIGNALIN(scalarminus_class, t_scalarminus, x_f);
     class_addmethod(scalarminus_class, (t_method)scalarminus_dsp,
         gensym("dsp"), A_CANT, 0);
+    class_setmultichannel(scalarminus_class);
     class_sethelpsymbol(scalarminus_class, gensym("sigbinops"));
 }
 
@@ -290,6 +426,15 @@ t_int *times_perf8(t_int *w)
     t_sample *in2 = (t_sample *)(w[2]);
     t_sample *out = (t_sample *)(w[3]);
     int n = (int)(w[4]);
+#ifdef PD_SIMD
+    for (; n; n -= 8, in1 += 8, in2 += 8, out += 8)
+    {
+        t_v4 f0 = V4_LOAD(in1), f1 = V4_LOAD(in1+4);
+        t_v4 g0 = V4_LOAD(in2), g1 = V4_LOAD(in2+4);
+        V4_STORE(out, V4_MUL(f0, g0));
+        V4_STORE(out+4, V4_MUL(f1, g1));
+    }
+#else
     for (; n; n -= 8, in1 += 8, in2 += 8, out += 8)
     {
         t_sample f0 = in1[0], f1 = in1[1], f2 = in1[2], f3 = in1[3];
@@ -301,6 +446,7 @@ t_int *times_perf8(t_int *w)
         out[0] = f0 * g0; out[1] = f1 * g1; out[2] = f2 * g2; out[3] = f3 * g3;
         out[4] = f4 * g4; out[5] = f5 * g5; out[6] = f6 * g6; out[7] = f7 * g7;
     }
+#endif
     return (w+5);
 }
 
@@ -320,6 +466,15 @@ t_int *scalartimes_perf8(t_int *w)
     t_float g = *(t_float *)(w[2]);
     t_sample *out = (t_sample *)(w[3]);
     int n = (int)(w[4]);
+#ifdef PD_SIMD
+    t_v4 g4 = V4_SET1(g);
+    for (; n; n -= 8, in += 8, out += 8)
+    {
+        t_v4 f0 = V4_LOAD(in), f1 = V4_LOAD(in+4);
+        V4_STORE(out, V4_MUL(f0, g4));
+        V4_STORE(out+4, V4_MUL(f1, g4));
+    }
+#else
     for (; n; n -= 8, in += 8, out += 8)
     {
         t_sample f0 = in[0], f1 = in[1], f2 = in[2], f3 = in[3];
@@ -328,27 +483,40 @@ t_int *scalartimes_perf8(t_int *w)
         out[0] = f0 * g; out[1] = f1 * g; out[2] = f2 * g; out[3] = f3 * g;
         out[4] = f4 * g; out[5] = f5 * g; out[6] = f6 * g; out[7] = f7 * g;
     }
+#endif
     return (w+5);
 }
 
+    /* if either inlet is unconnected, treat its float as a scalar; and
+    take block-rate signals as they come */
 static void times_dsp(t_times *x, t_signal **sp)
 {
-    if (sp[0]->s_n&7)
-        dsp_add(times_perform, 4,
-            sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, (t_int)sp[0]->s_n);
-    else
-        dsp_add(times_perf8, 4,
-            sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, (t_int)sp[0]->s_n);
+    if (sp[1]->s_scalar)
+    {
+        if (sp[0]->s_scalar)
+            dsp_add_scalarcopy(sp[0]->s_scalar, sp[0]->s_vec, sp[0]->s_n);
+        else dsp_add_blockratefill(sp[0]);
+        binop_add(scalartimes_perform, scalartimes_perf8, PW_SCALARMUL,
+            sp[0], 0, sp[1]->s_scalar, sp[2]);
+    }
+    else if (sp[0]->s_scalar)
+    {
+        dsp_add_blockratefill(sp[1]);
+        binop_add(scalartimes_perform, scalartimes_perf8, PW_SCALARMUL,
+            sp[1], 0, sp[0]->s_scalar, sp[2]);
+    }
+    else if (sp[1]->s_blockrate)
+        binop_addblockrate(blocktimes_perform, sp[0], sp[1], sp[2]);
+    else if (sp[0]->s_blockrate)
+        binop_addblockrate(blocktimes_perform, sp[1], sp[0], sp[2]);
+    else binop_add(times_perform, times_perf8, PW_MUL,
+        sp[0], sp[1], 0, sp[2]);
 }
 
 static void scalartimes_dsp(t_scalartimes *x, t_signal **sp)
 {
-    if (sp[0]->s_n&7)
-        dsp_add(scalartimes_perform, 4, sp[0]->s_vec, &x->x_g,
-            sp[1]->s_vec, (t_int)sp[0]->s_n);
-    else
-        dsp_add(scalartimes_perf8, 4, sp[0]->s_vec, &x->x_g,
-            sp[1]->s_vec, (t_int)sp[0]->s_n);
+    binop_add(scalartimes_perform, scalartimes_perf8, PW_SCALARMUL,
+        sp[0], 0, &x->x_g, sp[1]);
 }
 
 static void times_setup(void)
@@ -356,13 +524,17 @@ static void times_setup(void)
     times_class = class_new(gensym("*~"), (t_newmethod)times_new, 0,
         sizeof(t_times), 0, A_GIMME, 0);
     CLASS_MAINSIGNALIN(times_class, t_times, x_f);
+    class_setscalarsignalin(times_class);
+    class_setblockratein(times_class);
     class_addmethod(times_class, (t_method)times_dsp, gensym("dsp"), A_CANT, 0);
+    class_setmultichannel(times_class);
     class_sethelpsymbol(times_class, gensym("sigbinops"));
     scalartimes_class = class_new(gensym("*~"), 0, 0,
         sizeof(t_scalartimes), 0, 0);
     CLASS_MAINSIGNALIN(scalartimes_class, t_scalartimes, x_f);
     class_addmethod(scalartimes_class, (t_method)scalartimes_dsp,
         gensym("dsp"), A_CANT, 0);
+    class_setmultichannel(scalartimes_class);
     class_sethelpsymbol(scalartimes_class, gensym("sigbinops"));
 }
 
@@ -475,22 +647,13 @@ t_int *scalarover_perf8(t_int *w)
 
 static void over_dsp(t_over *x, t_signal **sp)
 {
-    if (sp[0]->s_n&7)
-        dsp_add(over_perform, 4,
-            sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, (t_int)sp[0]->s_n);
-    else
-        dsp_add(over_perf8, 4,
-            sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, (t_int)sp[0]->s_n);
+    binop_add(over_perform, over_perf8, -1, sp[0], sp[1], 0, sp[2]);
 }
 
 static void scalarover_dsp(t_scalarover *x, t_signal **sp)
 {
-    if (sp[0]->s_n&7)
-        dsp_add(scalarover_perform, 4, sp[0]->s_vec, &x->x_g,
-            sp[1]->s_vec, (t_int)sp[0]->s_n);
-    else
-        dsp_add(scalarover_perf8, 4, sp[0]->s_vec, &x->x_g,
-            sp[1]->s_vec, (t_int)sp[0]->s_n);
+    binop_add(scalarover_perform, scalarover_perf8, -1,
+        sp[0], 0, &x->x_g, sp[1]);
 }
 
 static void over_setup(void)
@@ -499,12 +662,14 @@ static void over_setup(void)
         sizeof(t_over), 0, A_GIMME, 0);
     CLASS_MAINSIGNALIN(over_class, t_over, x_f);
     class_addmethod(over_class, (t_method)over_dsp, gensym("dsp"), A_CANT, 0);
+    class_setmultichannel(over_class);
     class_sethelpsymbol(over_class, gensym("sigbinops"));
     scalarover_class = class_new(gensym("/~"), 0, 0,
         sizeof(t_scalarover), 0, 0);
     CLASS_MAINSIGNALIN(scalarover_class, t_scalarover, x_f);
     class_addmethod(scalarover_class, (t_method)scalarover_dsp,
         gensym("dsp"), A_CANT, 0);
+    class_setmultichannel(scalarover_class);
     class_sethelpsymbol(scalarover_class, gensym("sigbinops"));
 }
 
@@ -617,22 +782,13 @@ t_int *scalarmax_perf8(t_int *w)
 
 static void max_dsp(t_max *x, t_signal **sp)
 {
-    if (sp[0]->s_n&7)
-        dsp_add(max_perform, 4,
-            sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, (t_int)sp[0]->s_n);
-    else
-        dsp_add(max_perf8, 4,
-            sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, (t_int)sp[0]->s_n);
+    binop_add(max_perform, max_perf8, -1, sp[0], sp[1], 0, sp[2]);
 }
 
 static void scalarmax_dsp(t_scalarmax *x, t_signal **sp)
 {
-    if (sp[0]->s_n&7)
-        dsp_add(scalarmax_perform, 4, sp[0]->s_vec, &x->x_g,
-            sp[1]->s_vec, (t_int)sp[0]->s_n);
-    else
-        dsp_add(scalarmax_perf8, 4, sp[0]->s_vec, &x->x_g,
-            sp[1]->s_vec, (t_int)sp[0]->s_n);
+    binop_add(scalarmax_perform, scalarmax_perf8, -1,
+        sp[0], 0, &x->x_g, sp[1]);
 }
 
 static void max_setup(void)
@@ -641,12 +797,14 @@ static void max_setup(void)
         sizeof(t_max), 0, A_GIMME, 0);
     CLASS_MAINSIGNALIN(max_class, t_max, x_f);
     class_addmethod(max_class, (t_method)max_dsp, gensym("dsp"), A_CANT, 0);
+    class_setmultichannel(max_class);
     class_sethelpsymbol(max_class, gensym("sigbinops"));
     scalarmax_class = class_new(gensym("max~"), 0, 0,
         sizeof(t_scalarmax), 0, 0);
     CLASS_MAINSIGNALIN(scalarmax_class, t_scalarmax, x_f);
     class_addmethod(scalarmax_class, (t_method)scalarmax_dsp,
         gensym("dsp"), A_CANT, 0);
+    class_setmultichannel(scalarmax_class);
     class_sethelpsymbol(scalarmax_class, gensym("sigbinops"));
 }
 
@@ -759,22 +917,13 @@ t_int *scalarmin_perf8(t_int *w)
 
 static void min_dsp(t_min *x, t_signal **sp)
 {
-    if (sp[0]->s_n&7)
-        dsp_add(min_perform, 4,
-            sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, (t_int)sp[0]->s_n);
-    else
-        dsp_add(min_perf8, 4,
-            sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, (t_int)sp[0]->s_n);
+    binop_add(min_perform, min_perf8, -1, sp[0], sp[1], 0, sp[2]);
 }
 
 static void scalarmin_dsp(t_scalarmin *x, t_signal **sp)
 {
-    if (sp[0]->s_n&7)
-        dsp_add(scalarmin_perform, 4, sp[0]->s_vec, &x->x_g,
-            sp[1]->s_vec, (t_int)sp[0]->s_n);
-    else
-        dsp_add(scalarmin_perf8, 4, sp[0]->s_vec, &x->x_g,
-            sp[1]->s_vec, (t_int)sp[0]->s_n);
+    binop_add(scalarmin_perform, scalarmin_perf8, -1,
+        sp[0], 0, &x->x_g, sp[1]);
 }
 
 static void min_setup(void)
@@ -783,12 +932,14 @@ static void min_setup(void)
         sizeof(t_min), 0, A_GIMME, 0);
     CLASS_MAINSIGNALIN(min_class, t_min, x_f);
     class_addmethod(min_class, (t_method)min_dsp, gensym("dsp"), A_CANT, 0);
+    class_setmultichannel(min_class);
     class_sethelpsymbol(min_class, gensym("sigbinops"));
     scalarmin_class = class_new(gensym("min~"), 0, 0,
         sizeof(t_scalarmin), 0, 0);
     CLASS_MAINSIGNALIN(scalarmin_class, t_scalarmin, x_f);
     class_addmethod(scalarmin_class, (t_method)scalarmin_dsp,
         gensym("dsp"), A_CANT, 0);
+    class_setmultichannel(scalarmin_class);
     class_sethelpsymbol(scalarmin_class, gensym("sigbinops"));
 }
 
@@ -7,6 +7,88 @@
 /* LATER make tabread4 and tabread~ */
 
 #include "m_pd.h"
+#include "m_imp.h"
+#include "g_canvas.h"
+#include "d_simd.h"
+
+    /* The DSP objects here don't restart DSP when their array is resized
+    (see garray_usedindsp_resizable() in g_array.c).  Instead each keeps the
+    resize serial number current when it last looked its array up, and the
+    perform routine looks it up again when that number changes.  Since this
+    can happen on a DSP thread, no errors are reported; they were when the
+    array was first looked up.  Objects that only read the array ask for
+    its points "readonly" so that they may be shared with other arrays.
+    Those that can read points packed into 16 or 24 bits (see garray_pack())
+    pass "packedp" and get them there instead if they are. */
+static int tab_getpoints(t_garray *a, int *npoints, t_word **vec,
+    t_packedpoints **packedp)
+{
+    if (packedp && (*packedp = garray_getpacked(a)))
+    {
+        *npoints = (*packedp)->p_n;
+        *vec = 0;
+        return (1);
+    }
+    return (garray_getfloatwords_readonly(a, npoints, vec));
+}
+
+static t_word *tab_refetch(t_symbol *s, int *npoints, int *serial,
+    int readonly, t_packedpoints **packedp)
+{
+    t_garray *a;
+    t_word *vec;
+    *serial = garray_resizeserial();
+    if (packedp)
+        *packedp = 0;
+    if (!(a = (t_garray *)pd_findbyclass(s, garray_class)) ||
+        !(readonly ? tab_getpoints(a, npoints, &vec, packedp) :
+            garray_getfloatwords(a, npoints, &vec)))
+                return (0);
+    return (vec);
+}
+
+    /* read packed points: one ... */
+static inline t_sample tab_packedpoint(const t_packedpoints *p, int i)
+{
+    if (p->p_bytes == 2)
+        return (((const int16_t *)p->p_vec)[i] * p->p_scale);
+    else
+    {
+        const unsigned char *b = p->p_vec + 3 * i;
+        return ((((int32_t)((uint32_t)b[0] << 8 | (uint32_t)b[1] << 16 |
+            (uint32_t)b[2] << 24)) >> 8) * p->p_scale);
+    }
+}
+
+    /* ... or n in a row, in loops the compiler can vectorize */
+static void tab_unpack(const t_packedpoints *p, int onset, int n,
+    t_sample *out)
+{
+    t_sample scale = p->p_scale;
+    int i;
+    if (p->p_bytes == 2)
+    {
+        const int16_t *ip = (const int16_t *)p->p_vec + onset;
+        for (i = 0; i < n; i++)
+            out[i] = ip[i] * scale;
+    }
+    else
+    {
+        const unsigned char *b = p->p_vec + 3 * onset;
+        for (i = 0; i < n; i++, b += 3)
+            out[i] = (((int32_t)((uint32_t)b[0] << 8 | (uint32_t)b[1] << 16 |
+                (uint32_t)b[2] << 24)) >> 8) * scale;
+    }
+}
+
+    /* objects that write to an array keep the array itself too, to mark
+    what they've written for its summary if it keeps one (see g_array.c),
+    since they only redraw from time to time */
+static t_array *tab_getarray(t_symbol *s)
+{
+    t_garray *a = (t_garray *)pd_findbyclass(s, garray_class);
+    return (a ? garray_getarray(a) : 0);
+}
 
 
 /* ------------------------- tabwrite~ -------------------------- */
@@ -17,10 +99,13 @@ typedef struct _tabwrite_tilde
 {
     t_object x_obj;
     int x_phase;
+    int x_startphase;       /* where recording started, for redrawing */
     int x_nsampsintab;
     t_word *x_vec;
+    t_array *x_array;
     t_symbol *x_arrayname;
     t_float x_f;
+    int x_serial;           /* resize serial when array was looked up */
 } t_tabwrite_tilde;
 
 static void tabwrite_tilde_tick(t_tabwrite_tilde *x);
@@ -29,24 +114,35 @@ static void *tabwrite_tilde_new(t_symbol *s)
 {
     t_tabwrite_tilde *x = (t_tabwrite_tilde *)pd_new(tabwrite_tilde_class);
     x->x_phase = 0x7fffffff;
+    x->x_startphase = 0;
+    x->x_vec = 0;
+    x->x_array = 0;
     x->x_arrayname = s;
     x->x_f = 0;
     return (x);
 }
 
-static void tabwrite_tilde_redraw(t_tabwrite_tilde *x)
+    /* redraw the part we've recorded into, up to "endphase" */
+static void tabwrite_tilde_redraw(t_tabwrite_tilde *x, int endphase)
 {
     t_garray *a = (t_garray *)pd_findbyclass(x->x_arrayname, garray_class);
     if (!a)
         bug("tabwrite_tilde_redraw");
-    else garray_redraw(a);
+    else garray_redrawrange(a, x->x_startphase, endphase - x->x_startphase);
 }
 
 static t_int *tabwrite_tilde_perform(t_int *w)
 {
     t_tabwrite_tilde *x = (t_tabwrite_tilde *)(w[1]);
     t_sample *in = (t_sample *)(w[2]);
-    int n = (int)(w[3]), phase = x->x_phase, endphase = x->x_nsampsintab;
+    int n = (int)(w[3]), phase, endphase;
+    if (x->x_serial != garray_resizeserial())
+    {
+        x->x_vec = tab_refetch(x->x_arrayname, &x->x_nsampsintab,
+            &x->x_serial, 0, 0);
+        x->x_array = tab_getarray(x->x_arrayname);
+    }
+    phase = x->x_phase, endphase = x->x_nsampsintab;
     if (!x->x_vec) goto bad;
 
     if (endphase > phase)
@@ -54,6 +150,8 @@ static t_int *tabwrite_tilde_perform(t_int *w)
         int nxfer = endphase - phase;
         t_word *wp = x->x_vec + phase;
         if (nxfer > n) nxfer = n;
+        if (x->x_array)
+            array_touch(x->x_array, phase, nxfer);
         phase += nxfer;
         while (nxfer--)
         {
@@ -64,7 +162,7 @@ static t_int *tabwrite_tilde_perform(t_int *w)
         }
         if (phase >= endphase)
         {
-            tabwrite_tilde_redraw(x);
+            tabwrite_tilde_redraw(x, phase);
             phase = 0x7fffffff;
         }
         x->x_phase = phase;
@@ -79,6 +177,7 @@ static void tabwrite_tilde_set(t_tabwrite_tilde *x, t_symbol *s)
     t_garray *a;
 
     x->x_arrayname = s;
+    x->x_serial = garray_resizeserial();
     if (!(a = (t_garray *)pd_findbyclass(x->x_arrayname, garray_class)))
     {
         if (*s->s_name) pd_error(x, "tabwrite~: %s: no such array",
@@ -90,7 +189,8 @@ static void tabwrite_tilde_set(t_tabwrite_tilde *x, t_symbol *s)
         pd_error(x, "%s: bad template for tabwrite~", x->x_arrayname->s_name);
         x->x_vec = 0;
     }
-    else garray_usedindsp(a);
+    else garray_usedindsp_resizable(a);
+    x->x_array = (x->x_vec ? garray_getarray(a) : 0);
 }
 
 static void tabwrite_tilde_dsp(t_tabwrite_tilde *x, t_signal **sp)
@@ -101,19 +201,19 @@ static void tabwrite_tilde_dsp(t_tabwrite_tilde *x, t_signal **sp)
 
 static void tabwrite_tilde_bang(t_tabwrite_tilde *x)
 {
-    x->x_phase = 0;
+    x->x_phase = x->x_startphase = 0;
 }
 
 static void tabwrite_tilde_start(t_tabwrite_tilde *x, t_floatarg f)
 {
-    x->x_phase = (f > 0 ? f : 0);
+    x->x_phase = x->x_startphase = (f > 0 ? f : 0);
 }
 
 static void tabwrite_tilde_stop(t_tabwrite_tilde *x)
 {
     if (x->x_phase != 0x7fffffff)
     {
-        tabwrite_tilde_redraw(x);
+        tabwrite_tilde_redraw(x, x->x_phase);
         x->x_phase = 0x7fffffff;
     }
 }
@@ -147,8 +247,15 @@ typedef struct _tabplay_tilde
     int x_nsampsintab;
     int x_limit;
     t_word *x_vec;
+    t_packedpoints *x_packed;   /* packed points instead of x_vec */
     t_symbol *x_arrayname;
     t_clock *x_clock;
+    int x_serial;           /* resize serial when array was looked up */
+    int x_nextphase;        /* playback waiting for its sample to come */
+    int x_nextlimit;
+    double x_when;
+    int x_pending;
+    t_ctltime x_time;
 } t_tabplay_tilde;
 
 static void tabplay_tilde_tick(t_tabplay_tilde *x);
@@ -159,31 +266,42 @@ static void *tabplay_tilde_new(t_symbol *s)
     x->x_clock = clock_new(x, (t_method)tabplay_tilde_tick);
     x->x_phase = 0x7fffffff;
     x->x_limit = 0;
+    x->x_pending = 0;
+    x->x_vec = 0;
+    x->x_packed = 0;
     x->x_arrayname = s;
     outlet_new(&x->x_obj, &s_signal);
     x->x_bangout = outlet_new(&x->x_obj, &s_bang);
     return (x);
 }
 
-static t_int *tabplay_tilde_perform(t_int *w)
+static void tabplay_tilde_doperform(t_tabplay_tilde *x, t_sample *out,
+    int n)
 {
-    t_tabplay_tilde *x = (t_tabplay_tilde *)(w[1]);
-    t_sample *out = (t_sample *)(w[2]);
     t_word *wp;
-    int n = (int)(w[3]), phase = x->x_phase,
-        endphase = (x->x_nsampsintab < x->x_limit ?
-            x->x_nsampsintab : x->x_limit), nxfer, n3;
-    if (!x->x_vec || phase >= endphase)
+    int phase = x->x_phase, endphase, nxfer, n3;
+    endphase = (x->x_nsampsintab < x->x_limit ?
+        x->x_nsampsintab : x->x_limit);
+    if ((!x->x_vec && !x->x_packed) || phase >= endphase)
         goto zero;
 
     nxfer = endphase - phase;
-    wp = x->x_vec + phase;
     if (nxfer > n)
         nxfer = n;
     n3 = n - nxfer;
-    phase += nxfer;
-    while (nxfer--)
-        *out++ = (wp++)->w_float;
+    if (x->x_packed)
+    {
+        tab_unpack(x->x_packed, phase, nxfer, out);
+        out += nxfer;
+        phase += nxfer;
+    }
+    else
+    {
+        wp = x->x_vec + phase;
+        phase += nxfer;
+        while (nxfer--)
+            *out++ = (wp++)->w_float;
+    }
     if (phase >= endphase)
     {
         clock_delay(x->x_clock, 0);
@@ -192,10 +310,33 @@ static t_int *tabplay_tilde_perform(t_int *w)
             *out++ = 0;
     }
     else x->x_phase = phase;
-
-    return (w+4);
+    return;
 zero:
     while (n--) *out++ = 0;
+}
+
+    /* start playing at the sample we were asked to */
+static t_int *tabplay_tilde_perform(t_int *w)
+{
+    t_tabplay_tilde *x = (t_tabplay_tilde *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    int n = (int)(w[3]), onset = 0;
+    if (x->x_serial != garray_resizeserial())
+        x->x_vec = tab_refetch(x->x_arrayname, &x->x_nsampsintab,
+            &x->x_serial, 1, &x->x_packed);
+    ctltime_block(&x->x_time, n);
+    if (x->x_pending)
+    {
+        onset = ctltime_offset(&x->x_time, x->x_when, n);
+        tabplay_tilde_doperform(x, out, onset);
+        if (onset < n)
+        {
+            x->x_phase = x->x_nextphase;
+            x->x_limit = x->x_nextlimit;
+            x->x_pending = 0;
+        }
+    }
+    tabplay_tilde_doperform(x, out + onset, n - onset);
     return (w+4);
 }
 
@@ -204,23 +345,26 @@ static void tabplay_tilde_set(t_tabplay_tilde *x, t_symbol *s)
     t_garray *a;
 
     x->x_arrayname = s;
+    x->x_serial = garray_resizeserial();
     if (!(a = (t_garray *)pd_findbyclass(x->x_arrayname, garray_class)))
     {
         if (*s->s_name) pd_error(x, "tabplay~: %s: no such array",
             x->x_arrayname->s_name);
         x->x_vec = 0;
+        x->x_packed = 0;
     }
-    else if (!garray_getfloatwords(a, &x->x_nsampsintab, &x->x_vec))
+    else if (!tab_getpoints(a, &x->x_nsampsintab, &x->x_vec, &x->x_packed))
     {
         pd_error(x, "%s: bad template for tabplay~", x->x_arrayname->s_name);
         x->x_vec = 0;
     }
-    else garray_usedindsp(a);
+    else garray_usedindsp_resizable(a);
 }
 
 static void tabplay_tilde_dsp(t_tabplay_tilde *x, t_signal **sp)
 {
     tabplay_tilde_set(x, x->x_arrayname);
+    ctltime_dsp(&x->x_time, sp[0]->s_sr);
     dsp_add(tabplay_tilde_perform, 3, x, sp[0]->s_vec, (t_int)sp[0]->s_n);
 }
 
@@ -230,16 +374,21 @@ static void tabplay_tilde_list(t_tabplay_tilde *x, t_symbol *s,
     long start = atom_getfloatarg(0, argc, argv);
     long length = atom_getfloatarg(1, argc, argv);
     if (start < 0) start = 0;
+    if (x->x_pending)
+        x->x_phase = x->x_nextphase, x->x_limit = x->x_nextlimit;
     if (length <= 0)
-        x->x_limit = 0x7fffffff;
+        x->x_nextlimit = 0x7fffffff;
     else
-        x->x_limit = (int)(start + length);
-    x->x_phase = (int)start;
+        x->x_nextlimit = (int)(start + length);
+    x->x_nextphase = (int)start;
+    x->x_when = ctltime_stamp();
+    x->x_pending = 1;
 }
 
 static void tabplay_tilde_stop(t_tabplay_tilde *x)
 {
     x->x_phase = 0x7fffffff;
+    x->x_pending = 0;
 }
 
 static void tabplay_tilde_tick(t_tabplay_tilde *x)
@@ -275,8 +424,10 @@ typedef struct _tabread_tilde
     t_object x_obj;
     int x_npoints;
     t_word *x_vec;
+    t_packedpoints *x_packed;   /* packed points instead of x_vec */
     t_symbol *x_arrayname;
     t_float x_f;
+    int x_serial;           /* resize serial when array was looked up */
 } t_tabread_tilde;
 
 static void *tabread_tilde_new(t_symbol *s)
@@ -284,6 +435,7 @@ static void *tabread_tilde_new(t_symbol *s)
     t_tabread_tilde *x = (t_tabread_tilde *)pd_new(tabread_tilde_class);
     x->x_arrayname = s;
     x->x_vec = 0;
+    x->x_packed = 0;
     outlet_new(&x->x_obj, gensym("signal"));
     x->x_f = 0;
     return (x);
@@ -296,11 +448,28 @@ static t_int *tabread_tilde_perform(t_int *w)
     t_sample *out = (t_sample *)(w[3]);
     int n = (int)(w[4]);
     int maxindex;
-    t_word *buf = x->x_vec;
+    t_word *buf;
     int i;
 
+    if (x->x_serial != garray_resizeserial())
+        x->x_vec = tab_refetch(x->x_arrayname, &x->x_npoints, &x->x_serial,
+            1, &x->x_packed);
+    buf = x->x_vec;
     maxindex = x->x_npoints - 1;
     if(maxindex<0) goto zero;
+    if (x->x_packed)
+    {
+        for (i = 0; i < n; i++)
+        {
+            int index = *in++;
+            if (index < 0)
+                index = 0;
+            else if (index > maxindex)
+                index = maxindex;
+            *out++ = tab_packedpoint(x->x_packed, index);
+        }
+        return (w+5);
+    }
     if (!buf) goto zero;
 
     for (i = 0; i < n; i++)
@@ -324,18 +493,20 @@ static void tabread_tilde_set(t_tabread_tilde *x, t_symbol *s)
     t_garray *a;
 
     x->x_arrayname = s;
+    x->x_serial = garray_resizeserial();
     if (!(a = (t_garray *)pd_findbyclass(x->x_arrayname, garray_class)))
     {
         if (*s->s_name)
             pd_error(x, "tabread~: %s: no such array", x->x_arrayname->s_name);
         x->x_vec = 0;
+        x->x_packed = 0;
     }
-    else if (!garray_getfloatwords(a, &x->x_npoints, &x->x_vec))
+    else if (!tab_getpoints(a, &x->x_npoints, &x->x_vec, &x->x_packed))
     {
         pd_error(x, "%s: bad template for tabread~", x->x_arrayname->s_name);
         x->x_vec = 0;
     }
-    else garray_usedindsp(a);
+    else garray_usedindsp_resizable(a);
 }
 
 static void tabread_tilde_dsp(t_tabread_tilde *x, t_signal **sp)
@@ -365,6 +536,59 @@ static void tabread_tilde_setup(void)
 
 /******************** tabread4~ ***********************/
 
+#ifdef PD_SIMD
+    /* Vector versions of the 4-point interpolation in tabread4~ and tabosc4~.
+    tab4_load() reads the four points starting at wp, which are packed floats
+    if a t_word is no bigger than a float, and otherwise every other float
+    (t_words are pointer-sized and the float sits at the start of each).  The
+    scalar loops find four table positions, then four such loads are turned
+    around by V4_TRANSPOSE so that tab4_interp() can compute four outputs. */
+static inline t_v4 tab4_load(t_word *wp)
+{
+    if (sizeof(t_word) == sizeof(t_float))
+        return (V4_LOAD(&wp->w_float));
+    else return (V4_LOAD_STRIDE2(&wp->w_float));
+}
+
+static inline void tab4_interpv(t_v4 a, t_v4 b, t_v4 c, t_v4 d,
+    t_sample *frac, t_sample *out)
+{
+    t_v4 f = V4_LOAD(frac), cminusb, three = V4_SET1(3.0f);
+    V4_TRANSPOSE(a, b, c, d);
+    cminusb = V4_SUB(c, b);
+    V4_STORE(out, V4_ADD(b, V4_MUL(f, V4_SUB(cminusb,
+        V4_MUL(V4_MUL(V4_SET1(0.1666667f), V4_SUB(V4_SET1(1.0f), f)),
+            V4_ADD(V4_MUL(V4_SUB(V4_SUB(d, a), V4_MUL(three, cminusb)), f),
+                V4_SUB(V4_ADD(d, V4_ADD(a, a)), V4_MUL(three, b))))))));
+}
+
+static inline void tab4_interp(t_word **wp, t_sample *frac, t_sample *out)
+{
+    tab4_interpv(tab4_load(wp[0]), tab4_load(wp[1]), tab4_load(wp[2]),
+        tab4_load(wp[3]), frac, out);
+}
+
+    /* the same from four runs of four points, unpacked into pts[] */
+static inline void tab4_interppacked(t_sample *pts, t_sample *frac,
+    t_sample *out)
+{
+    tab4_interpv(V4_LOAD(pts), V4_LOAD(pts + 4), V4_LOAD(pts + 8),
+        V4_LOAD(pts + 12), frac, out);
+}
+#endif /* PD_SIMD */
+
+    /* 4-point interpolation of a, b, c, d at "frac" between b and c */
+static inline t_sample tab4_interp1(t_sample a, t_sample b, t_sample c,
+    t_sample d, t_sample frac)
+{
+    t_sample cminusb = c-b;
+    return (b + frac * (
+        cminusb - 0.1666667f * (1.-frac) * (
+            (d - a - 3.0f * cminusb) * frac + (d + 2.0f*a - 3.0f*b)
+        )
+    ));
+}
+
 static t_class *tabread4_tilde_class;
 
 typedef struct _tabread4_tilde
@@ -372,9 +596,11 @@ typedef struct _tabread4_tilde
     t_object x_obj;
     int x_npoints;
     t_word *x_vec;
+    t_packedpoints *x_packed;   /* packed points instead of x_vec */
     t_symbol *x_arrayname;
     t_float x_f;
     t_float x_onset;
+    int x_serial;           /* resize serial when array was looked up */
 } t_tabread4_tilde;
 
 static void *tabread4_tilde_new(t_symbol *s)
@@ -382,6 +608,7 @@ static void *tabread4_tilde_new(t_symbol *s)
     t_tabread4_tilde *x = (t_tabread4_tilde *)pd_new(tabread4_tilde_class);
     x->x_arrayname = s;
     x->x_vec = 0;
+    x->x_packed = 0;
     outlet_new(&x->x_obj, gensym("signal"));
     floatinlet_new(&x->x_obj, &x->x_onset);
     x->x_f = 0;
@@ -389,6 +616,44 @@ static void *tabread4_tilde_new(t_symbol *s)
     return (x);
 }
 
+    /* tabread4~ from packed points, unpacking the four around each index */
+static void tabread4_tilde_packed(const t_packedpoints *p, t_sample *in,
+    t_sample *out, int n, double onset)
+{
+    int i, maxindex = p->p_n - 3;
+#ifdef PD_SIMD
+    for (; n >= 4; n -= 4, out += 4)
+    {
+        t_sample pts[16], fracs[4];
+        for (i = 0; i < 4; i++)
+        {
+            double findex = *in++ + onset;
+            int index = findex;
+            if (index < 1)
+                index = 1, fracs[i] = 0;
+            else if (index > maxindex)
+                index = maxindex, fracs[i] = 1;
+            else fracs[i] = findex - index;
+            tab_unpack(p, index - 1, 4, pts + 4 * i);
+        }
+        tab4_interppacked(pts, fracs, out);
+    }
+#endif
+    for (i = 0; i < n; i++)
+    {
+        double findex = *in++ + onset;
+        int index = findex;
+        t_sample frac, pts[4];
+        if (index < 1)
+            index = 1, frac = 0;
+        else if (index > maxindex)
+            index = maxindex, frac = 1;
+        else frac = findex - index;
+        tab_unpack(p, index - 1, 4, pts);
+        *out++ = tab4_interp1(pts[0], pts[1], pts[2], pts[3], frac);
+    }
+}
+
 static t_int *tabread4_tilde_perform(t_int *w)
 {
     t_tabread4_tilde *x = (t_tabread4_tilde *)(w[1]);
@@ -396,12 +661,21 @@ static t_int *tabread4_tilde_perform(t_int *w)
     t_sample *out = (t_sample *)(w[3]);
     int n = (int)(w[4]);
     int maxindex;
-    t_word *buf = x->x_vec, *wp;
+    t_word *buf, *wp;
     double onset = x->x_onset;
     int i;
 
+    if (x->x_serial != garray_resizeserial())
+        x->x_vec = tab_refetch(x->x_arrayname, &x->x_npoints, &x->x_serial,
+            1, &x->x_packed);
+    buf = x->x_vec;
     maxindex = x->x_npoints - 3;
     if(maxindex<0) goto zero;
+    if (x->x_packed)
+    {
+        tabread4_tilde_packed(x->x_packed, in, out, n, onset);
+        return (w+5);
+    }
 
     if (!buf) goto zero;
 
@@ -421,6 +695,25 @@ static t_int *tabread4_tilde_perform(t_int *w)
     }
 #endif
 
+#ifdef PD_SIMD
+    for (; n >= 4; n -= 4, out += 4)
+    {
+        t_word *wps[4];
+        t_sample fracs[4];
+        for (i = 0; i < 4; i++)
+        {
+            double findex = *in++ + onset;
+            int index = findex;
+            if (index < 1)
+                index = 1, fracs[i] = 0;
+            else if (index > maxindex)
+                index = maxindex, fracs[i] = 1;
+            else fracs[i] = findex - index;
+            wps[i] = buf + (index - 1);
+        }
+        tab4_interp(wps, fracs, out);
+    }
+#endif
     for (i = 0; i < n; i++)
     {
         double findex = *in++ + onset;
@@ -455,26 +748,29 @@ static void tabread4_tilde_set(t_tabread4_tilde *x, t_symbol *s)
     t_garray *a;
 
     x->x_arrayname = s;
+    x->x_serial = garray_resizeserial();
     if (!(a = (t_garray *)pd_findbyclass(x->x_arrayname, garray_class)))
     {
         if (*s->s_name)
             pd_error(x, "tabread4~: %s: no such array", x->x_arrayname->s_name);
         x->x_vec = 0;
+        x->x_packed = 0;
     }
-    else if (!garray_getfloatwords(a, &x->x_npoints, &x->x_vec))
+    else if (!tab_getpoints(a, &x->x_npoints, &x->x_vec, &x->x_packed))
     {
         pd_error(x, "%s: bad template for tabread4~", x->x_arrayname->s_name);
         x->x_vec = 0;
     }
-    else garray_usedindsp(a);
+    else garray_usedindsp_resizable(a);
 }
 
 static void tabread4_tilde_dsp(t_tabread4_tilde *x, t_signal **sp)
 {
     tabread4_tilde_set(x, x->x_arrayname);
 
-    dsp_add(tabread4_tilde_perform, 4, x,
-        sp[0]->s_vec, sp[1]->s_vec, (t_int)sp[0]->s_n);
+        /* a multichannel index gives as many channels of output */
+    dsp_add(tabread4_tilde_perform, 4, x, sp[0]->s_vec, sp[1]->s_vec,
+        (t_int)(sp[0]->s_n * sp[0]->s_nchans));
 
 }
 
@@ -488,6 +784,7 @@ static void tabread4_tilde_setup(void)
         (t_newmethod)tabread4_tilde_new, (t_method)tabread4_tilde_free,
         sizeof(t_tabread4_tilde), 0, A_DEFSYM, 0);
     CLASS_MAINSIGNALIN(tabread4_tilde_class, t_tabread4_tilde, x_f);
+    class_setmultichannel(tabread4_tilde_class);
     class_addmethod(tabread4_tilde_class, (t_method)tabread4_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
     class_addmethod(tabread4_tilde_class, (t_method)tabread4_tilde_set,
@@ -545,10 +842,12 @@ typedef struct _tabosc4_tilde
     t_float x_fnpoints;
     t_float x_finvnpoints;
     t_word *x_vec;
+    t_packedpoints *x_packed;   /* packed points instead of x_vec */
     t_symbol *x_arrayname;
     t_float x_f;
     double x_phase;
     t_float x_conv;
+    int x_serial;           /* resize serial when array was looked up */
 } t_tabosc4_tilde;
 
 static void *tabosc4_tilde_new(t_symbol *s)
@@ -556,6 +855,7 @@ static void *tabosc4_tilde_new(t_symbol *s)
     t_tabosc4_tilde *x = (t_tabosc4_tilde *)pd_new(tabosc4_tilde_class);
     x->x_arrayname = s;
     x->x_vec = 0;
+    x->x_packed = 0;
     x->x_fnpoints = 512.;
     x->x_finvnpoints = (1./512.);
     outlet_new(&x->x_obj, gensym("signal"));
@@ -564,24 +864,105 @@ static void *tabosc4_tilde_new(t_symbol *s)
     return (x);
 }
 
+    /* after a resize; like tabosc4_tilde_set() but silent */
+static void tabosc4_tilde_refetch(t_tabosc4_tilde *x)
+{
+    int npoints, pointsinarray;
+    if (!(x->x_vec = tab_refetch(x->x_arrayname, &pointsinarray,
+        &x->x_serial, 1, &x->x_packed)) && !x->x_packed)
+            return;
+    if ((npoints = pointsinarray - 3) != (1 << ilog2(pointsinarray - 3)))
+        x->x_vec = 0, x->x_packed = 0;
+    else
+    {
+        x->x_fnpoints = npoints;
+        x->x_finvnpoints = 1./npoints;
+    }
+}
+
+    /* tabosc4~ from packed points; returns the new phase */
+static double tabosc4_tilde_packed(const t_packedpoints *p, t_sample *in,
+    t_sample *out, int n, double dphase, t_float conv, int mask)
+{
+    union tabfudge tf;
+    int normhipart;
+    tf.tf_d = UNITBIT32;
+    normhipart = tf.tf_i[HIOFFSET];
+#ifdef PD_SIMD
+    for (; n >= 4; n -= 4, out += 4)
+    {
+        t_sample pts[16], fracs[4];
+        int i;
+        for (i = 0; i < 4; i++)
+        {
+            tf.tf_d = dphase;
+            dphase += *in++ * conv;
+            tab_unpack(p, tf.tf_i[HIOFFSET] & mask, 4, pts + 4 * i);
+            tf.tf_i[HIOFFSET] = normhipart;
+            fracs[i] = tf.tf_d - UNITBIT32;
+        }
+        tab4_interppacked(pts, fracs, out);
+    }
+#endif
+    while (n--)
+    {
+        t_sample frac, pts[4];
+        tf.tf_d = dphase;
+        dphase += *in++ * conv;
+        tab_unpack(p, tf.tf_i[HIOFFSET] & mask, 4, pts);
+        tf.tf_i[HIOFFSET] = normhipart;
+        frac = tf.tf_d - UNITBIT32;
+        *out++ = tab4_interp1(pts[0], pts[1], pts[2], pts[3], frac);
+    }
+    return (dphase);
+}
+
 static t_int *tabosc4_tilde_perform(t_int *w)
 {
     t_tabosc4_tilde *x = (t_tabosc4_tilde *)(w[1]);
     t_sample *in = (t_sample *)(w[2]);
     t_sample *out = (t_sample *)(w[3]);
     int n = (int)(w[4]);
-    int normhipart;
+    int normhipart, mask;
     union tabfudge tf;
-    t_float fnpoints = x->x_fnpoints;
-    int mask = fnpoints - 1;
-    t_float conv = fnpoints * x->x_conv;
-    t_word *tab = x->x_vec, *addr;
-    double dphase = fnpoints * x->x_phase + UNITBIT32;
-
-    if (!tab) goto zero;
+    t_float fnpoints, conv;
+    t_word *tab, *addr;
+    double dphase;
+
+    if (x->x_serial != garray_resizeserial())
+        tabosc4_tilde_refetch(x);
+    fnpoints = x->x_fnpoints;
+    mask = fnpoints - 1;
+    conv = fnpoints * x->x_conv;
+    tab = x->x_vec;
+    dphase = fnpoints * x->x_phase + UNITBIT32;
+    if (x->x_packed)
+    {
+        dphase = tabosc4_tilde_packed(x->x_packed, in, out, n, dphase,
+            conv, mask);
+        n = 0;
+    }
+    else if (!tab) goto zero;
     tf.tf_d = UNITBIT32;
     normhipart = tf.tf_i[HIOFFSET];
 
+#ifdef PD_SIMD
+    for (; n >= 4; n -= 4, out += 4)
+    {
+        t_word *wps[4];
+        t_sample fracs[4];
+        int i;
+        for (i = 0; i < 4; i++)
+        {
+            tf.tf_d = dphase;
+            dphase += *in++ * conv;
+            wps[i] = tab + (tf.tf_i[HIOFFSET] & mask);
+            tf.tf_i[HIOFFSET] = normhipart;
+            fracs[i] = tf.tf_d - UNITBIT32;
+        }
+        tab4_interp(wps, fracs, out);
+    }
+#endif
 #if 1
     while (n--)
     {
@@ -622,13 +1003,15 @@ static void tabosc4_tilde_set(t_tabosc4_tilde *x, t_symbol *s)
     int npoints, pointsinarray;
 
     x->x_arrayname = s;
+    x->x_serial = garray_resizeserial();
     if (!(a = (t_garray *)pd_findbyclass(x->x_arrayname, garray_class)))
     {
         if (*s->s_name)
             pd_error(x, "tabosc4~: %s: no such array", x->x_arrayname->s_name);
         x->x_vec = 0;
+        x->x_packed = 0;
     }
-    else if (!garray_getfloatwords(a, &pointsinarray, &x->x_vec))
+    else if (!tab_getpoints(a, &pointsinarray, &x->x_vec, &x->x_packed))
     {
         pd_error(x, "%s: bad template for tabosc4~", x->x_arrayname->s_name);
         x->x_vec = 0;
@@ -638,13 +1021,14 @@ static void tabosc4_tilde_set(t_tabosc4_tilde *x, t_symbol *s)
         pd_error(x, "%s: number of points (%d) not a power of 2 plus three",
             x->x_arrayname->s_name, pointsinarray);
         x->x_vec = 0;
-        garray_usedindsp(a);
+        x->x_packed = 0;
+        garray_usedindsp_resizable(a);
     }
     else
     {
         x->x_fnpoints = npoints;
         x->x_finvnpoints = 1./npoints;
-        garray_usedindsp(a);
+        garray_usedindsp_resizable(a);
     }
 }
 
@@ -686,9 +1070,11 @@ typedef struct _tabsend
     t_word *x_vec;
     int x_graphperiod;
     int x_graphcount;
+    t_array *x_array;
     t_symbol *x_arrayname;
     t_float x_f;
     int x_npoints;
+    int x_serial;           /* resize serial when array was looked up */
 } t_tabsend;
 
 static void tabsend_tick(t_tabsend *x);
@@ -697,6 +1083,8 @@ static void *tabsend_new(t_symbol *s)
 {
     t_tabsend *x = (t_tabsend *)pd_new(tabsend_class);
     x->x_graphcount = 0;
+    x->x_vec = 0;
+    x->x_array = 0;
     x->x_arrayname = s;
     x->x_f = 0;
     return (x);
@@ -707,11 +1095,20 @@ static t_int *tabsend_perform(t_int *w)
     t_tabsend *x = (t_tabsend *)(w[1]);
     t_sample *in = (t_sample *)(w[2]);
     int n = (int)w[3];
-    t_word *dest = x->x_vec;
-    int i = x->x_graphcount;
-    if (!x->x_vec) goto bad;
+    t_word *dest;
+    int i = x->x_graphcount, nwrite;
+    if (x->x_serial != garray_resizeserial())
+    {
+        x->x_vec = tab_refetch(x->x_arrayname, &x->x_npoints,
+            &x->x_serial, 0, 0);
+        x->x_array = tab_getarray(x->x_arrayname);
+    }
+    if (!(dest = x->x_vec)) goto bad;
     if (n > x->x_npoints)
         n = x->x_npoints;
+    nwrite = n;
+    if (x->x_array)
+        array_touch(x->x_array, 0, nwrite);
     while (n--)
     {
         t_sample f = *in++;
@@ -724,7 +1121,7 @@ static t_int *tabsend_perform(t_int *w)
         t_garray *a = (t_garray *)pd_findbyclass(x->x_arrayname, garray_class);
         if (!a)
             bug("tabsend_dsp");
-        else garray_redraw(a);
+        else garray_redrawrange(a, 0, nwrite);
         i = x->x_graphperiod;
     }
     x->x_graphcount = i;
@@ -737,6 +1134,7 @@ static void tabsend_set(t_tabsend *x, t_symbol *s)
     t_garray *a;
 
     x->x_arrayname = s;
+    x->x_serial = garray_resizeserial();
     if (!(a = (t_garray *)pd_findbyclass(x->x_arrayname, garray_class)))
     {
         if (*s->s_name)
@@ -748,7 +1146,8 @@ static void tabsend_set(t_tabsend *x, t_symbol *s)
         pd_error(x, "%s: bad template for tabsend~", x->x_arrayname->s_name);
         x->x_vec = 0;
     }
-    else garray_usedindsp(a);
+    else garray_usedindsp_resizable(a);
+    x->x_array = (x->x_vec ? garray_getarray(a) : 0);
 }
 
 static void tabsend_dsp(t_tabsend *x, t_signal **sp)
@@ -784,6 +1183,7 @@ typedef struct _tabreceive
     t_word *x_vec;
     t_symbol *x_arrayname;
     int x_npoints;
+    int x_serial;           /* resize serial when array was looked up */
 } t_tabreceive;
 
 static t_int *tabreceive_perform(t_int *w)
@@ -791,8 +1191,11 @@ static t_int *tabreceive_perform(t_int *w)
     t_tabreceive *x = (t_tabreceive *)(w[1]);
     t_sample *out = (t_sample *)(w[2]);
     int n = (int)w[3];
-    t_word *from = x->x_vec;
-    if (from)
+    t_word *from;
+    if (x->x_serial != garray_resizeserial())
+        x->x_vec = tab_refetch(x->x_arrayname, &x->x_npoints,
+            &x->x_serial, 1, 0);
+    if ((from = x->x_vec))
     {
         t_int vecsize = x->x_npoints;
         if (vecsize > n)
@@ -813,6 +1216,7 @@ static void tabreceive_set(t_tabreceive *x, t_symbol *s)
     t_garray *a;
 
     x->x_arrayname = s;
+    x->x_serial = garray_resizeserial();
     if (!(a = (t_garray *)pd_findbyclass(x->x_arrayname, garray_class)))
     {
         if (*s->s_name)
@@ -820,13 +1224,13 @@ static void tabreceive_set(t_tabreceive *x, t_symbol *s)
                 x->x_arrayname->s_name);
         x->x_vec = 0;
     }
-    else if (!garray_getfloatwords(a, &x->x_npoints, &x->x_vec))
+    else if (!garray_getfloatwords_readonly(a, &x->x_npoints, &x->x_vec))
     {
         pd_error(x, "%s: bad template for tabreceive~",
             x->x_arrayname->s_name);
         x->x_vec = 0;
     }
-    else garray_usedindsp(a);
+    else garray_usedindsp_resizable(a);
 }
 
 static void tabreceive_dsp(t_tabreceive *x, t_signal **sp)
@@ -873,7 +1277,7 @@ static void tabread_float(t_tabread *x, t_float f)
 
     if (!(a = (t_garray *)pd_findbyclass(x->x_arrayname, garray_class)))
         pd_error(x, "%s: no such array", x->x_arrayname->s_name);
-    else if (!garray_getfloatwords(a, &npoints, &vec))
+    else if (!garray_getfloatwords_readonly(a, &npoints, &vec))
         pd_error(x, "%s: bad template for tabread", x->x_arrayname->s_name);
     else
     {
@@ -924,7 +1328,7 @@ static void tabread4_float(t_tabread4 *x, t_float f)
 
     if (!(a = (t_garray *)pd_findbyclass(x->x_arrayname, garray_class)))
         pd_error(x, "%s: no such array", x->x_arrayname->s_name);
-    else if (!garray_getfloatwords(a, &npoints, &vec))
+    else if (!garray_getfloatwords_readonly(a, &npoints, &vec))
         pd_error(x, "%s: bad template for tabread4", x->x_arrayname->s_name);
     else if (npoints < 4)
         outlet_float(x->x_obj.ob_outlet, 0);
@@ -1003,7 +1407,7 @@ static void tabwrite_float(t_tabwrite *x, t_float f)
         else if (n >= vecsize)
             n = vecsize-1;
         vec[n].w_float = f;
-        garray_redraw(a);
+        garray_redrawrange(a, n, 1);
     }
 }
 
@@ -0,0 +1,534 @@
+/* Copyright (c) 1997- Miller Puckette and others.
+* For information on usage and redistribution, and for a DISCLAIMER OF ALL
+* WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+/*  conv~: convolution with an impulse response kept in an array.
+
+The convolution is computed by partitioned FFT convolution ("overlap-save"):
+the impulse response is cut into partitions of P samples whose spectra (of
+size 2P) are computed once; each new block of P input samples is
+transformed and kept in a "frequency-domain delay line", and the output
+block is the inverse transform of the sum of the products of each past
+input spectrum and the matching partition's spectrum.
+
+To avoid both the latency of large partitions and the cost of many small
+ones, there are two stages.  The "head" stage's partitions are the size of
+a DSP block, so that there's no latency beyond Pd's own, and cover the
+first 2L samples of the response.  The rest is done by the "tail" stage,
+with partitions of L samples, which is computed once every L samples.
+Since its output isn't needed until L samples after its input is complete,
+the tail may be computed by a worker thread while DSP goes on ("-thread");
+in that case the next tail computation waits for the last one to finish,
+so that the result is the same either way.  L is chosen near the square
+root of half the block size times the length of the response, which
+roughly balances the two stages' costs.  Short responses only use the
+head stage.
+
+Tail jobs that come due in the same DSP tick are collected and handed over
+together at the first conv~ to run in the next tick, which costs one lock
+for all of them and still leaves each job nearly L samples to finish in.
+An external can register an "offload" backend, such as one computing on a
+GPU, with conv_setoffload(); each batch is offered to it first, and the
+worker threads take it if it declines.  The backend calls conv_jobdone()
+for each job once its output is written, from any thread it likes. */
+
+#include "m_pd.h"
+#include "m_imp.h"
+#include "s_stuff.h"
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+    /* in d_fft_fftsg.c or d_fft_fftw.c */
+void mayer_init(void);
+void mayer_term(void);
+
+#define CONV_MAXTHREADS 4   /* most worker threads shared by all conv~s */
+#define CONV_MINTAIL 4096   /* shorter responses only use the head stage */
+#define CONV_MAXPART 16384  /* largest tail partition */
+
+typedef struct _convstage
+{
+    int s_size;             /* partition size; FFTs are twice this */
+    int s_npart;            /* number of partitions */
+    t_sample *s_ir;         /* spectra of partitions, real parts then imag */
+    t_sample *s_fdl;        /* spectra of past input, newest at s_head */
+    int s_head;
+    t_sample *s_buf;        /* FFT buffer */
+    t_sample *s_acc;        /* sum of products */
+    t_realfft *s_fft;
+    int s_serial;           /* changes when the partitions are refilled */
+} t_convstage;
+
+static t_class *conv_tilde_class;
+
+typedef struct _conv_tilde
+{
+    t_object x_obj;
+    t_float x_f;
+    t_symbol *x_arrayname;
+    int x_vecsize;          /* DSP block size we're set up for */
+    int x_threaded;         /* compute the tail in a worker thread */
+    t_convstage x_headstage;
+    t_sample *x_headin;     /* last two blocks of input */
+    t_convstage x_tailstage;
+    t_sample *x_tailin;     /* last 2L samples of input, filling in */
+    int x_tailfill;         /* samples of input since last tail job */
+    t_sample *x_jobin;      /* input for the tail job */
+    t_sample *x_tailout[2]; /* output of the last two tail jobs */
+    int x_play;             /* which of them we're playing */
+    int x_busy;             /* tail job queued or being computed */
+    struct _conv_tilde *x_next; /* next in work queue */
+    t_convjob x_job;        /* the tail job, while waiting to be handed over */
+} t_conv_tilde;
+
+static pthread_mutex_t conv_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t conv_wakeup = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t conv_done = PTHREAD_COND_INITIALIZER;
+static pthread_t conv_thread[CONV_MAXTHREADS];
+static int conv_nthreads;
+static int conv_nthreaded;          /* number of conv~s with "-thread" */
+static t_conv_tilde *conv_queue, *conv_queuetail;
+static t_convoffloadfn conv_offloadfn;
+static void *conv_offloaddata;
+static int conv_serial;
+    /* tail jobs that came due this tick, from perform routines that may
+    run on several DSP threads at once, so they have a lock of their own */
+static pthread_mutex_t conv_pendingmutex = PTHREAD_MUTEX_INITIALIZER;
+static t_convjob *conv_pending, *conv_pendingtail;
+static double conv_pendingtime;             /* tick they came due in */
+
+/* ------------------------- one stage ---------------------------- */
+
+    /* unpack a spectrum from mayer_realfft()'s layout into real and
+    imaginary parts of n/2+1 bins each */
+static void conv_unpack(t_sample *fz, int n, t_sample *re, t_sample *im,
+    t_sample scale)
+{
+    int i, nover2 = n/2;
+    re[0] = fz[0] * scale;
+    im[0] = 0;
+    re[nover2] = fz[nover2] * scale;
+    im[nover2] = 0;
+    for (i = 1; i < nover2; i++)
+        re[i] = fz[i] * scale, im[i] = fz[n-i] * scale;
+}
+
+static void conv_pack(t_sample *re, t_sample *im, int n, t_sample *fz)
+{
+    int i, nover2 = n/2;
+    fz[0] = re[0];
+    fz[nover2] = re[nover2];
+    for (i = 1; i < nover2; i++)
+        fz[i] = re[i], fz[n-i] = im[i];
+}
+
+static void convstage_free(t_convstage *s)
+{
+    int nbin = s->s_size + 1;
+    if (!s->s_npart)
+        return;
+    freebytes(s->s_ir, s->s_npart * 2 * nbin * sizeof(t_sample));
+    freebytes(s->s_fdl, s->s_npart * 2 * nbin * sizeof(t_sample));
+    freebytes(s->s_buf, 2 * s->s_size * sizeof(t_sample));
+    freebytes(s->s_acc, 2 * nbin * sizeof(t_sample));
+    realfft_free(s->s_fft);
+    s->s_npart = 0;
+}
+
+    /* set up a stage for "length" samples of the response starting at
+    "onset", in partitions of "size" samples.  The 1/N of the inverse FFT
+    is folded into the partitions' spectra. */
+static int convstage_init(t_convstage *s, int size, t_word *vec, int onset,
+    int length)
+{
+    int i, j, nbin = size + 1;
+    s->s_npart = 0;
+    if (length <= 0 || !(s->s_fft = realfft_new(2 * size)))
+        return (0);
+    s->s_size = size;
+    s->s_npart = (length + size - 1) / size;
+    s->s_ir = (t_sample *)getbytes(s->s_npart * 2 * nbin * sizeof(t_sample));
+    s->s_fdl = (t_sample *)getbytes(s->s_npart * 2 * nbin * sizeof(t_sample));
+    s->s_buf = (t_sample *)getbytes(2 * size * sizeof(t_sample));
+    s->s_acc = (t_sample *)getbytes(2 * nbin * sizeof(t_sample));
+    s->s_head = 0;
+    s->s_serial = ++conv_serial;
+    for (i = 0; i < s->s_npart; i++)
+    {
+        t_sample *re = s->s_ir + i * 2 * nbin;
+        for (j = 0; j < size; j++)
+            s->s_buf[j] = (i * size + j < length ?
+                vec[onset + i * size + j].w_float : 0);
+        for (; j < 2 * size; j++)
+            s->s_buf[j] = 0;
+        realfft_forward(s->s_fft, s->s_buf);
+        conv_unpack(s->s_buf, 2 * size, re, re + nbin, 1./(2 * size));
+    }
+    return (1);
+}
+
+    /* take the last 2P samples of input and output the next P */
+static void convstage_run(t_convstage *s, t_sample *in, t_sample *out)
+{
+    int i, j, nbin = s->s_size + 1, npart = s->s_npart;
+    t_sample *accre = s->s_acc, *accim = s->s_acc + nbin, *xre;
+    memcpy(s->s_buf, in, 2 * s->s_size * sizeof(t_sample));
+    realfft_forward(s->s_fft, s->s_buf);
+    if (--s->s_head < 0)
+        s->s_head = npart - 1;
+    xre = s->s_fdl + s->s_head * 2 * nbin;
+    conv_unpack(s->s_buf, 2 * s->s_size, xre, xre + nbin, 1);
+    memset(s->s_acc, 0, 2 * nbin * sizeof(t_sample));
+    for (i = 0, j = s->s_head; i < npart; i++)
+    {
+        t_sample *xr = s->s_fdl + j * 2 * nbin, *xi = xr + nbin,
+            *hr = s->s_ir + i * 2 * nbin, *hi = hr + nbin;
+        int k;
+        for (k = 0; k < nbin; k++)
+        {
+            accre[k] += xr[k] * hr[k] - xi[k] * hi[k];
+            accim[k] += xr[k] * hi[k] + xi[k] * hr[k];
+        }
+        if (++j == npart)
+            j = 0;
+    }
+    conv_pack(accre, accim, 2 * s->s_size, s->s_buf);
+    realfft_inverse(s->s_fft, s->s_buf);
+    memcpy(out, s->s_buf + s->s_size, s->s_size * sizeof(t_sample));
+}
+
+/* --------------------- the tail's worker threads ----------------------- */
+
+static void conv_tailjob(t_conv_tilde *x)
+{
+    convstage_run(&x->x_tailstage, x->x_jobin, x->x_tailout[!x->x_play]);
+}
+
+static void *conv_work(void *dummy)
+{
+    if (sys_flushdenormals)
+        sched_flushdenormals();
+    pthread_mutex_lock(&conv_mutex);
+    while (1)
+    {
+        t_conv_tilde *x = conv_queue;
+        if (!x)
+        {
+            pthread_cond_wait(&conv_wakeup, &conv_mutex);
+            continue;
+        }
+        if (!(conv_queue = x->x_next))
+            conv_queuetail = 0;
+        pthread_mutex_unlock(&conv_mutex);
+        conv_tailjob(x);
+        pthread_mutex_lock(&conv_mutex);
+        x->x_busy = 0;
+        pthread_cond_broadcast(&conv_done);
+    }
+    return (0);
+}
+
+    /* hand the jobs that came due in the last tick to the offload backend
+    if there is one and it takes them, or else to the worker threads.  If
+    "due" is set, only if they came due before the current tick. */
+static void conv_flush(int due)
+{
+    t_convjob *j, *batch, *next;
+    pthread_mutex_lock(&conv_pendingmutex);
+    if (due && conv_pendingtime == pd_this->pd_systime)
+        batch = 0;
+    else
+    {
+        batch = conv_pending;
+        conv_pending = conv_pendingtail = 0;
+    }
+    pthread_mutex_unlock(&conv_pendingmutex);
+    if (!batch)
+        return;
+    if (conv_offloadfn)
+    {
+        for (j = batch; j; j = j->j_next)
+        {
+            t_conv_tilde *x = (t_conv_tilde *)j->j_owner;
+            t_convstage *s = &x->x_tailstage;
+            j->j_size = s->s_size;
+            j->j_npart = s->s_npart;
+            j->j_head = (s->s_head ? s->s_head : s->s_npart) - 1;
+            j->j_serial = s->s_serial;
+            j->j_ir = s->s_ir;
+            j->j_fdl = s->s_fdl;
+            j->j_in = x->x_jobin;
+            j->j_out = x->x_tailout[!x->x_play];
+        }
+            /* the backend may finish a job before it returns, but each
+            stage's head is only used again after its job is done */
+        if ((*conv_offloadfn)(conv_offloaddata, batch))
+        {
+            for (j = batch; j; j = next)
+            {
+                next = j->j_next;
+                ((t_conv_tilde *)j->j_owner)->x_tailstage.s_head = j->j_head;
+            }
+            return;
+        }
+    }
+    if (!conv_nthreads)
+    {
+        for (j = batch; j; j = next)
+        {
+            t_conv_tilde *x = (t_conv_tilde *)j->j_owner;
+            next = j->j_next;
+            conv_tailjob(x);
+            x->x_busy = 0;
+        }
+        return;
+    }
+    pthread_mutex_lock(&conv_mutex);
+    for (j = batch; j; j = j->j_next)
+    {
+        t_conv_tilde *x = (t_conv_tilde *)j->j_owner;
+        x->x_next = 0;
+        if (conv_queuetail)
+            conv_queuetail->x_next = x;
+        else conv_queue = x;
+        conv_queuetail = x;
+    }
+    pthread_cond_broadcast(&conv_wakeup);
+    pthread_mutex_unlock(&conv_mutex);
+}
+
+    /* wait until the last tail job is done */
+static void conv_wait(t_conv_tilde *x)
+{
+    if (!x->x_threaded)
+        return;
+    if (x->x_busy)
+        conv_flush(0);
+    pthread_mutex_lock(&conv_mutex);
+    while (x->x_busy)
+        pthread_cond_wait(&conv_done, &conv_mutex);
+    pthread_mutex_unlock(&conv_mutex);
+}
+
+    /* note the tail job, to be handed over with the rest of this tick's */
+static void conv_startjob(t_conv_tilde *x)
+{
+    if (!x->x_threaded || (!conv_nthreads && !conv_offloadfn))
+    {
+        conv_tailjob(x);
+        return;
+    }
+    x->x_busy = 1;
+    x->x_job.j_next = 0;
+    pthread_mutex_lock(&conv_pendingmutex);
+    if (conv_pendingtail)
+        conv_pendingtail->j_next = &x->x_job;
+    else conv_pending = &x->x_job;
+    conv_pendingtail = &x->x_job;
+    conv_pendingtime = pd_this->pd_systime;
+    pthread_mutex_unlock(&conv_pendingmutex);
+}
+
+    /* called by an offload backend when a job's output is written */
+void conv_jobdone(t_convjob *job)
+{
+    t_conv_tilde *x = (t_conv_tilde *)job->j_owner;
+    pthread_mutex_lock(&conv_mutex);
+    x->x_busy = 0;
+    pthread_cond_broadcast(&conv_done);
+    pthread_mutex_unlock(&conv_mutex);
+}
+
+    /* register a backend to offer tail jobs to, or none if "fn" is zero.
+    It returns 1 if it takes the whole batch (a list linked by j_next) and
+    0 if the worker threads should compute it.  Only conv~ objects with
+    "-thread" use it.  Call this from an external's setup routine, before
+    DSP is started. */
+void conv_setoffload(t_convoffloadfn fn, void *data)
+{
+    conv_offloadfn = fn;
+    conv_offloaddata = data;
+}
+
+/* --------------------------- conv~ ------------------------------ */
+
+static void conv_tilde_clear(t_conv_tilde *x)
+{
+    int size = x->x_tailstage.s_size;
+    conv_wait(x);
+    if (x->x_headstage.s_npart)
+        freebytes(x->x_headin, 2 * x->x_vecsize * sizeof(t_sample));
+    if (x->x_tailstage.s_npart)
+    {
+        freebytes(x->x_tailin, 2 * size * sizeof(t_sample));
+        freebytes(x->x_jobin, 2 * size * sizeof(t_sample));
+        freebytes(x->x_tailout[0], size * sizeof(t_sample));
+        freebytes(x->x_tailout[1], size * sizeof(t_sample));
+    }
+    convstage_free(&x->x_headstage);
+    convstage_free(&x->x_tailstage);
+}
+
+    /* read the impulse response and set up both stages for our block size */
+static void conv_tilde_load(t_conv_tilde *x)
+{
+    t_garray *a;
+    t_word *vec;
+    int n = x->x_vecsize, npoints, headlength, tailsize = 0;
+    conv_tilde_clear(x);
+    if (!n)
+        return;
+    if (!(a = (t_garray *)pd_findbyclass(x->x_arrayname, garray_class)))
+    {
+        if (*x->x_arrayname->s_name)
+            pd_error(x, "conv~: %s: no such array", x->x_arrayname->s_name);
+        return;
+    }
+    if (!garray_getfloatwords_readonly(a, &npoints, &vec))
+    {
+        pd_error(x, "%s: bad template for conv~", x->x_arrayname->s_name);
+        return;
+    }
+    if (n < 2 || n != (1 << ilog2(n)))
+    {
+        pd_error(x, "conv~: block size %d: must be a power of two", n);
+        return;
+    }
+    if (npoints > CONV_MINTAIL)
+    {
+        tailsize = 1 << ilog2((int)sqrt(0.5 * n * npoints));
+        if (tailsize < 4 * n)
+            tailsize = 4 * n;
+        if (tailsize > CONV_MAXPART)
+            tailsize = CONV_MAXPART;
+        if (2 * tailsize >= npoints)
+            tailsize = 0;
+    }
+    headlength = (tailsize ? 2 * tailsize : npoints);
+    if (!convstage_init(&x->x_headstage, n, vec, 0, headlength))
+        return;
+    x->x_headin = (t_sample *)getbytes(2 * n * sizeof(t_sample));
+    if (tailsize && convstage_init(&x->x_tailstage, tailsize, vec,
+        headlength, npoints - headlength))
+    {
+        x->x_tailin = (t_sample *)getbytes(2 * tailsize * sizeof(t_sample));
+        x->x_jobin = (t_sample *)getbytes(2 * tailsize * sizeof(t_sample));
+        x->x_tailout[0] = (t_sample *)getbytes(tailsize * sizeof(t_sample));
+        x->x_tailout[1] = (t_sample *)getbytes(tailsize * sizeof(t_sample));
+        x->x_tailfill = x->x_play = 0;
+    }
+}
+
+static t_int *conv_tilde_perform(t_int *w)
+{
+    t_conv_tilde *x = (t_conv_tilde *)(w[1]);
+    t_sample *in = (t_sample *)(w[2]);
+    t_sample *out = (t_sample *)(w[3]);
+    int n = (int)(w[4]), i, tailsize = x->x_tailstage.s_size;
+    conv_flush(1);
+    if (!x->x_headstage.s_npart)
+    {
+        memset(out, 0, n * sizeof(t_sample));
+        return (w+5);
+    }
+        /* take the input before writing output, which may be the same */
+    memmove(x->x_headin, x->x_headin + n, n * sizeof(t_sample));
+    memcpy(x->x_headin + n, in, n * sizeof(t_sample));
+    if (x->x_tailstage.s_npart)
+        memcpy(x->x_tailin + tailsize + x->x_tailfill, in,
+            n * sizeof(t_sample));
+    convstage_run(&x->x_headstage, x->x_headin, out);
+    if (x->x_tailstage.s_npart)
+    {
+        t_sample *tail = x->x_tailout[x->x_play] + x->x_tailfill;
+        for (i = 0; i < n; i++)
+            out[i] += tail[i];
+        if ((x->x_tailfill += n) == tailsize)
+        {
+                /* the tail job we started L samples ago computed the
+                output for the next L; start the next one. */
+            conv_wait(x);
+            x->x_play = !x->x_play;
+            memcpy(x->x_jobin, x->x_tailin, 2 * tailsize * sizeof(t_sample));
+            memcpy(x->x_tailin, x->x_tailin + tailsize,
+                tailsize * sizeof(t_sample));
+            x->x_tailfill = 0;
+            conv_startjob(x);
+        }
+    }
+    return (w+5);
+}
+
+static void conv_tilde_dsp(t_conv_tilde *x, t_signal **sp)
+{
+    if (sp[0]->s_n != x->x_vecsize || !x->x_headstage.s_npart)
+    {
+        x->x_vecsize = sp[0]->s_n;
+        conv_tilde_load(x);
+    }
+    dsp_add(conv_tilde_perform, 4, x, sp[0]->s_vec, sp[1]->s_vec,
+        (t_int)sp[0]->s_n);
+}
+
+    /* set the array, or read the same one again after it's changed */
+static void conv_tilde_set(t_conv_tilde *x, t_symbol *s)
+{
+    if (*s->s_name)
+        x->x_arrayname = s;
+    conv_tilde_load(x);
+}
+
+static void *conv_tilde_new(t_symbol *s, int argc, t_atom *argv)
+{
+    t_conv_tilde *x = (t_conv_tilde *)pd_new(conv_tilde_class);
+    x->x_threaded = 0;
+    while (argc && argv->a_type == A_SYMBOL &&
+        *argv->a_w.w_symbol->s_name == '-')
+    {
+        if (!strcmp(argv->a_w.w_symbol->s_name, "-thread"))
+            x->x_threaded = 1;
+        else pd_error(x, "conv~: %s: unknown flag",
+            argv->a_w.w_symbol->s_name);
+        argc--, argv++;
+    }
+    x->x_arrayname = atom_getsymbolarg(0, argc, argv);
+    x->x_vecsize = 0;
+    x->x_headstage.s_npart = x->x_tailstage.s_npart = 0;
+    x->x_headstage.s_size = x->x_tailstage.s_size = 0;
+    x->x_busy = 0;
+    x->x_job.j_owner = x;
+    x->x_f = 0;
+    if (x->x_threaded && ++conv_nthreaded > conv_nthreads &&
+        conv_nthreads < CONV_MAXTHREADS)
+    {
+        if (!pthread_create(&conv_thread[conv_nthreads], 0, conv_work, 0))
+            conv_nthreads++;
+        else pd_error(x, "conv~: couldn't start worker thread");
+    }
+    mayer_init();
+    outlet_new(&x->x_obj, &s_signal);
+    return (x);
+}
+
+static void conv_tilde_free(t_conv_tilde *x)
+{
+    conv_tilde_clear(x);
+    if (x->x_threaded)
+        conv_nthreaded--;
+    mayer_term();
+}
+
+void d_conv_setup(void)
+{
+    conv_tilde_class = class_new(gensym("conv~"),
+        (t_newmethod)conv_tilde_new, (t_method)conv_tilde_free,
+        sizeof(t_conv_tilde), 0, A_GIMME, 0);
+    CLASS_MAINSIGNALIN(conv_tilde_class, t_conv_tilde, x_f);
+    class_addmethod(conv_tilde_class, (t_method)conv_tilde_dsp,
+        gensym("dsp"), A_CANT, 0);
+    class_addmethod(conv_tilde_class, (t_method)conv_tilde_clear,
+        gensym("dsp-release"), A_CANT, 0);
+    class_addmethod(conv_tilde_class, (t_method)conv_tilde_set,
+        gensym("set"), A_DEFSYM, 0);
+}
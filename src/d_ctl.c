@@ -4,10 +4,69 @@
 
 /*  sig~ and line~ control-to-signal converters;
     snapshot~ signal-to-control converter.
+    sig~ and line~ put out block-rate signals (see signal_setblockrate() in
+    d_ugen.c), which are filled in here for objects that need the vector.
 */
 
 #include "m_pd.h"
+#include "m_imp.h"
 #include "math.h"
+#include "d_simd.h"
+
+    /* write n samples of a ramp starting at "start" and rising by "inc" per
+    sample.  Each sample is computed from the start rather than by adding
+    up increments, so that there's no dependency from one sample to the
+    next and the ramp can be written four samples at a time. */
+static void ctl_ramp(t_sample *out, int n, t_sample start, t_sample inc)
+{
+    int i = 0;
+#ifdef PD_SIMD
+    static const t_sample zero123[4] = {0, 1, 2, 3};
+    t_v4 vstart = V4_SET1(start), vinc = V4_SET1(inc), four = V4_SET1(4),
+        k = V4_LOAD(zero123);
+    for (; i < (n & ~3); i += 4, k = V4_ADD(k, four))
+        V4_STORE(out + i, V4_ADD(vstart, V4_MUL(k, vinc)));
+#endif
+    for (; i < n; i++)
+        out[i] = start + i * inc;
+}
+
+static void ctl_fill(t_sample *out, int n, t_sample f)
+{
+    int i = 0;
+#ifdef PD_SIMD
+    t_v4 v = V4_SET1(f);
+    for (; i < (n & ~3); i += 4)
+        V4_STORE(out + i, v);
+#endif
+    for (; i < n; i++)
+        out[i] = f;
+}
+
+    /* write out a block of a block-rate signal unless its producer did */
+void blockrate_fill(const t_blockrate *b, t_sample *vec, int n)
+{
+    if (b->b_vec)
+        return;
+    if (b->b_inc != 0)
+        ctl_ramp(vec, n, b->b_value, b->b_inc);
+    else ctl_fill(vec, n, b->b_value);
+}
+
+static t_int *blockrate_fill_perform(t_int *w)
+{
+    blockrate_fill((t_blockrate *)(w[1]), (t_sample *)(w[2]), (int)(w[3]));
+    return (w+4);
+}
+
+    /* have a block-rate signal's vector filled in each block; does nothing
+    for other signals */
+void dsp_add_blockratefill(t_signal *sig)
+{
+    if (sig->s_blockrate)
+        dsp_add(blockrate_fill_perform, 3, sig->s_blockrate, sig->s_vec,
+            (t_int)sig->s_n);
+}
 
 /* -------------------------- sig~ ------------------------------ */
 static t_class *sig_tilde_class;
@@ -16,52 +75,64 @@ typedef struct _sig
 {
     t_object x_obj;
     t_float x_f;
+    t_float x_next;     /* value waiting for its sample to come */
+    double x_when;      /* when it was sent */
+    int x_pending;      /* true if there's such a value */
+    t_ctltime x_time;
+    t_blockrate x_block;    /* our output, unless written out */
 } t_sig;
 
+    /* change the value at the sample the float was sent.  Only then is the
+    output written out; otherwise it's just the value. */
 static t_int *sig_tilde_perform(t_int *w)
 {
-    t_float f = *(t_float *)(w[1]);
-    t_sample *out = (t_sample *)(w[2]);
-    int n = (int)(w[3]);
-    while (n--)
-        *out++ = f;
-    return (w+4);
-}
-
-static t_int *sig_tilde_perf8(t_int *w)
-{
-    t_float f = *(t_float *)(w[1]);
+    t_sig *x = (t_sig *)(w[1]);
     t_sample *out = (t_sample *)(w[2]);
-    int n = (int)(w[3]);
-
-    for (; n; n -= 8, out += 8)
+    int n = (int)(w[3]), onset;
+    ctltime_block(&x->x_time, n);
+    x->x_block.b_vec = 0;
+    if (x->x_pending)
     {
-        out[0] = f;
-        out[1] = f;
-        out[2] = f;
-        out[3] = f;
-        out[4] = f;
-        out[5] = f;
-        out[6] = f;
-        out[7] = f;
+        onset = ctltime_offset(&x->x_time, x->x_when, n);
+        if (onset > 0 && onset < n)
+        {
+            ctl_fill(out, onset, x->x_f);
+            ctl_fill(out + onset, n - onset, x->x_next);
+            x->x_block.b_vec = 1;
+        }
+        if (onset < n)
+            x->x_f = x->x_next, x->x_pending = 0;
     }
+    x->x_block.b_value = x->x_f;
     return (w+4);
 }
 
 static void sig_tilde_float(t_sig *x, t_float f)
 {
-    x->x_f = f;
+        /* if a value is still waiting, it's superseded at the start of the
+        block rather than at its own sample. */
+    if (x->x_pending)
+        x->x_f = x->x_next;
+    x->x_next = f;
+    x->x_when = ctltime_stamp();
+    x->x_pending = 1;
 }
 
 static void sig_tilde_dsp(t_sig *x, t_signal **sp)
 {
-    dsp_add(sig_tilde_perform, 3, &x->x_f, sp[0]->s_vec, (t_int)sp[0]->s_n);
+    ctltime_dsp(&x->x_time, sp[0]->s_sr);
+    signal_setblockrate(sp[0], &x->x_block);
+    dsp_add(sig_tilde_perform, 3, x, sp[0]->s_vec, (t_int)sp[0]->s_n);
 }
 
 static void *sig_tilde_new(t_floatarg f)
 {
     t_sig *x = (t_sig *)pd_new(sig_tilde_class);
-    x->x_f = f;
+    x->x_f = x->x_next = f;
+    x->x_pending = 0;
+    x->x_block.b_value = f;
+    x->x_block.b_inc = 0;
+    x->x_block.b_vec = 0;
     outlet_new(&x->x_obj, gensym("signal"));
     return (x);
 }
@@ -91,13 +162,21 @@ typedef struct _line
     t_float x_inletwas;
     int x_ticksleft;
     int x_retarget;
+        /* sample-accurate ramps, unless in 0.52 compatibility mode: */
+    int x_timed;            /* true for these, decided when created */
+    int x_sampsleft;        /* samples left in ramp */
+    t_float x_samppermsec;
+    t_float x_nexttarget;   /* ramp waiting for its sample to come */
+    t_float x_nexttime;
+    double x_when;          /* when it was asked for */
+    int x_pending;          /* true if there's such a ramp */
+    t_ctltime x_time;
+    t_blockrate x_block;    /* our output, unless written out */
 } t_line;
 
 static t_int *line_tilde_perform(t_int *w)
 {
     t_line *x = (t_line *)(w[1]);
-    t_sample *out = (t_sample *)(w[2]);
-    int n = (int)(w[3]);
     t_sample f = x->x_value;
 
     if (PD_BIGORSMALL(f))
@@ -111,63 +190,105 @@ static t_int *line_tilde_perform(t_int *w)
         x->x_inc = x->x_1overn * x->x_biginc;
         x->x_retarget = 0;
     }
+        /* ramps go block by block here, so each block is a straight line */
     if (x->x_ticksleft)
     {
-        t_sample f = x->x_value;
-        while (n--) *out++ = f, f += x->x_inc;
+        x->x_block.b_value = x->x_value;
+        x->x_block.b_inc = x->x_inc;
         x->x_value += x->x_biginc;
         x->x_ticksleft--;
     }
     else
     {
-        t_sample g = x->x_value = x->x_target;
-        while (n--)
-            *out++ = g;
+        x->x_block.b_value = x->x_value = x->x_target;
+        x->x_block.b_inc = 0;
     }
     return (w+4);
 }
 
-/* TB: vectorized version */
-static t_int *line_tilde_perf8(t_int *w)
+    /* output n samples of the current ramp, then hold the target */
+static void line_tilde_ramp(t_line *x, t_sample *out, int n)
 {
-    t_line *x = (t_line *)(w[1]);
-    t_sample *out = (t_sample *)(w[2]);
-    int n = (int)(w[3]);
-    t_sample f = x->x_value;
-
-    if (PD_BIGORSMALL(f))
-        x->x_value = f = 0;
-    if (x->x_retarget)
+    int m = (x->x_sampsleft < n ? x->x_sampsleft : n);
+    if (m)
     {
-        int nticks = x->x_inletwas * x->x_dspticktomsec;
-        if (!nticks) nticks = 1;
-        x->x_ticksleft = nticks;
-        x->x_biginc = (x->x_target - x->x_value)/(t_sample)nticks;
-        x->x_inc = x->x_1overn * x->x_biginc;
-        x->x_retarget = 0;
+        ctl_ramp(out, m, x->x_value, x->x_inc);
+        x->x_value += m * x->x_inc;
+        if (!(x->x_sampsleft -= m))
+            x->x_value = x->x_target;
     }
-    if (x->x_ticksleft)
+    ctl_fill(out + m, n - m, x->x_value);
+}
+
+static void line_tilde_start(t_line *x)
+{
+    int nsamps = x->x_nexttime * x->x_samppermsec;
+    x->x_target = x->x_nexttarget;
+    if (nsamps < 1)
     {
-        t_sample f = x->x_value;
-        while (n--) *out++ = f, f += x->x_inc;
-        x->x_value += x->x_biginc;
-        x->x_ticksleft--;
+        x->x_value = x->x_target;
+        x->x_sampsleft = 0;
     }
     else
     {
-        t_sample f = x->x_value = x->x_target;
-        for (; n; n -= 8, out += 8)
+        x->x_sampsleft = nsamps;
+        x->x_inc = (x->x_target - x->x_value) / nsamps;
+    }
+    x->x_pending = 0;
+}
+
+    /* start new ramps at the sample they were asked for.  If the block
+    is a straight line, as it is unless a ramp starts or ends in the middle
+    of it, it's only described in x_block, not written out. */
+static t_int *line_tilde_perform_timed(t_int *w)
+{
+    t_line *x = (t_line *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    int n = (int)(w[3]), onset = 0;
+    ctltime_block(&x->x_time, n);
+    if (PD_BIGORSMALL(x->x_value))
+        x->x_value = 0;
+    if (x->x_pending)
+    {
+        onset = ctltime_offset(&x->x_time, x->x_when, n);
+        line_tilde_ramp(x, out, onset);
+        if (onset < n)
+            line_tilde_start(x);
+    }
+    if (!onset && (!x->x_sampsleft || x->x_sampsleft >= n))
+    {
+        x->x_block.b_vec = 0;
+        x->x_block.b_value = x->x_value;
+        x->x_block.b_inc = (x->x_sampsleft ? x->x_inc : 0);
+        if (x->x_sampsleft)
         {
-            out[0] = f; out[1] = f; out[2] = f; out[3] = f;
-            out[4] = f; out[5] = f; out[6] = f; out[7] = f;
+            x->x_value += n * x->x_inc;
+            if (!(x->x_sampsleft -= n))
+                x->x_value = x->x_target;
         }
     }
+    else
+    {
+        line_tilde_ramp(x, out + onset, n - onset);
+        x->x_block.b_vec = 1;
+    }
     return (w+4);
 }
 
 static void line_tilde_float(t_line *x, t_float f)
 {
-    if (x->x_inletvalue <= 0)
+    if (x->x_timed)
+    {
+            /* a ramp still waiting starts at the beginning of the block */
+        if (x->x_pending)
+            line_tilde_start(x);
+        x->x_nexttarget = f;
+        x->x_nexttime = (x->x_inletvalue > 0 ? x->x_inletvalue : 0);
+        x->x_inletvalue = 0;
+        x->x_when = ctltime_stamp();
+        x->x_pending = 1;
+    }
+    else if (x->x_inletvalue <= 0)
     {
         x->x_target = x->x_value = f;
         x->x_ticksleft = x->x_retarget = 0;
@@ -184,17 +305,21 @@ static void line_tilde_float(t_line *x, t_float f)
 static void line_tilde_stop(t_line *x)
 {
     x->x_target = x->x_value;
-    x->x_ticksleft = x->x_retarget = 0;
+    x->x_ticksleft = x->x_retarget = x->x_sampsleft = x->x_pending = 0;
 }
 
 static void line_tilde_dsp(t_line *x, t_signal **sp)
 {
-    if(sp[0]->s_n&7)
-        dsp_add(line_tilde_perform, 3, x, sp[0]->s_vec, (t_int)sp[0]->s_n);
-    else
-        dsp_add(line_tilde_perf8, 3, x, sp[0]->s_vec, (t_int)sp[0]->s_n);
+    signal_setblockrate(sp[0], &x->x_block);
+    x->x_block.b_vec = 0;
+    if (x->x_timed)
+        dsp_add(line_tilde_perform_timed, 3, x, sp[0]->s_vec,
+            (t_int)sp[0]->s_n);
+    else dsp_add(line_tilde_perform, 3, x, sp[0]->s_vec, (t_int)sp[0]->s_n);
     x->x_1overn = 1./sp[0]->s_n;
     x->x_dspticktomsec = sp[0]->s_sr / (1000 * sp[0]->s_n);
+    x->x_samppermsec = sp[0]->s_sr / 1000;
+    ctltime_dsp(&x->x_time, sp[0]->s_sr);
 }
 
 static void *line_tilde_new(void)
@@ -202,8 +327,12 @@ static void *line_tilde_new(void)
     t_line *x = (t_line *)pd_new(line_tilde_class);
     outlet_new(&x->x_obj, gensym("signal"));
     floatinlet_new(&x->x_obj, &x->x_inletvalue);
-    x->x_ticksleft = x->x_retarget = 0;
+    x->x_ticksleft = x->x_retarget = x->x_sampsleft = x->x_pending = 0;
     x->x_value = x->x_target = x->x_inletvalue = x->x_inletwas = 0;
+    x->x_timed = (pd_compatibilitylevel >= 53);
+    x->x_samppermsec = 0;
+    x->x_block.b_value = x->x_block.b_inc = 0;
+    x->x_block.b_vec = 0;
     return (x);
 }
 
@@ -221,12 +350,21 @@ static void line_tilde_setup(void)
 /* -------------------------- vline~ ------------------------------ */
 static t_class *vline_tilde_class;
 #include "s_stuff.h"    /* for DEFDACBLKSIZE; this should be in m_pd.h */
+
+    /* Segments are kept in order of starting time, in a doubly linked list
+    so that new ones, which always end up last, can be placed by searching
+    back from the end.  Used ones go on a free list, so that once a vline~
+    has had as many segments queued as it will ever get, neither the
+    perform routine nor the float method allocates or frees memory. */
+#define VLINE_NPREALLOC 8   /* segments to start out with */
+
 typedef struct _vseg
 {
     double s_targettime;
     double s_starttime;
     t_sample s_target;
     struct _vseg *s_next;
+    struct _vseg *s_prev;
 } t_vseg;
 
 typedef struct _vline
@@ -243,9 +381,35 @@ typedef struct _vline
     t_sample x_target;
     t_float x_inlet1;
     t_float x_inlet2;
-    t_vseg *x_list;
+    t_vseg *x_list;     /* queued segments */
+    t_vseg *x_last;     /* last one in the queue */
+    t_vseg *x_free;     /* free list */
 } t_vline;
 
+static t_vseg *vline_tilde_getseg(t_vline *x)
+{
+    t_vseg *s;
+    if ((s = x->x_free))
+        x->x_free = s->s_next;
+    else s = (t_vseg *)t_getbytes(sizeof(*s));
+    return (s);
+}
+
+    /* put a segment and all that follow it on the free list */
+static void vline_tilde_freesegs(t_vline *x, t_vseg *s)
+{
+    t_vseg *s1;
+    if (!s)
+        return;
+    if (s->s_prev)
+        s->s_prev->s_next = 0, x->x_last = s->s_prev;
+    else x->x_list = x->x_last = 0;
+    for (s1 = s; s1->s_next; s1 = s1->s_next)
+        ;
+    s1->s_next = x->x_free;
+    x->x_free = s;
+}
+
 static t_int *vline_tilde_perform(t_int *w)
 {
     t_vline *x = (t_vline *)(w[1]);
@@ -264,9 +428,10 @@ static t_int *vline_tilde_perform(t_int *w)
     }
     timenow = x->x_nextblocktime;
     x->x_nextblocktime = timenow + n * msecpersamp;
-    for (i = 0; i < n; i++)
+    for (i = 0; i < n; )
     {
-        double timenext = timenow + msecpersamp;
+        double timenext = timenow + msecpersamp, timeend;
+        int run;
     checknext:
         if (s)
         {
@@ -291,17 +456,37 @@ static t_int *vline_tilde_perform(t_int *w)
                 x->x_inc = inc;
                 x->x_target = s->s_target;
                 x->x_targettime = s->s_targettime;
-                x->x_list = s->s_next;
-                t_freebytes(s, sizeof(*s));
+                if ((x->x_list = s->s_next))
+                    x->x_list->s_prev = 0;
+                else x->x_last = 0;
+                s->s_next = x->x_free;
+                x->x_free = s;
                 s = x->x_list;
                 goto checknext;
             }
         }
         if (x->x_targettime <= timenext)
             f = x->x_target, inc = x->x_inc = 0, x->x_targettime = 1e20;
-        *out++ = f;
-        f = f + inc;
+            /* count the samples, starting with this one, that go by before
+            the next segment starts or the current one ends, and write them
+            all at once.  Usually that's the rest of the block, which we can
+            tell without stepping through the sample times one by one. */
+        timeend = timenow + (n - i + 1) * msecpersamp;
+        if ((!s || s->s_starttime >= timeend) && x->x_targettime > timeend)
+            run = n - i;
+        else for (run = 1; i + run < n; run++)
+        {
+            double timeafter = timenext + msecpersamp;
+            if ((s && s->s_starttime < timeafter) ||
+                x->x_targettime <= timeafter)
+                    break;
+            timenext = timeafter;
+        }
+        ctl_ramp(out, run, f, inc);
+        out += run;
+        f = f + run * inc;
         timenow = timenext;
+        i += run;
     }
     x->x_value = f;
     return (w+4);
@@ -309,10 +494,7 @@ static t_int *vline_tilde_perform(t_int *w)
 
 static void vline_tilde_stop(t_vline *x)
 {
-    t_vseg *s1, *s2;
-    for (s1 = x->x_list; s1; s1 = s2)
-        s2 = s1->s_next, t_freebytes(s1, sizeof(*s1));
-    x->x_list = 0;
+    vline_tilde_freesegs(x, x->x_list);
     x->x_inc = 0;
     x->x_inlet1 = x->x_inlet2 = 0;
     x->x_target = x->x_value;
@@ -325,7 +507,7 @@ static void vline_tilde_float(t_vline *x, t_float f)
     t_float inlet1 = (x->x_inlet1 < 0 ? 0 : x->x_inlet1);
     t_float inlet2 = x->x_inlet2;
     double starttime = timenow + inlet2;
-    t_vseg *s1, *s2, *deletefrom = 0, *snew;
+    t_vseg *s1, *deletefrom = 0, *snew;
     if (PD_BIGORSMALL(f))
         f = 0;
 
@@ -336,42 +518,24 @@ static void vline_tilde_float(t_vline *x, t_float f)
         vline_tilde_stop(x);
         return;
     }
-    snew = (t_vseg *)t_getbytes(sizeof(*snew));
-        /* check if we supplant the first item in the list.  We supplant
-        an item by having an earlier starttime, or an equal starttime unless
-        the equal one was instantaneous and the new one isn't (in which case
-        we'll do a jump-and-slide starting at that time.) */
-    if (!x->x_list || x->x_list->s_starttime > starttime ||
-        (x->x_list->s_starttime == starttime &&
-            (x->x_list->s_targettime > x->x_list->s_starttime || inlet1 <= 0)))
-    {
-        deletefrom = x->x_list;
-        x->x_list = snew;
-    }
-    else
-    {
-        for (s1 = x->x_list; (s2 = s1->s_next); s1 = s2)
-        {
-            if (s2->s_starttime > starttime ||
-                (s2->s_starttime == starttime &&
-                    (s2->s_targettime > s2->s_starttime || inlet1 <= 0)))
-            {
-                deletefrom = s2;
-                s1->s_next = snew;
-                goto didit;
-            }
-        }
-        s1->s_next = snew;
-        deletefrom = 0;
-    didit: ;
-    }
-    while (deletefrom)
-    {
-        s1 = deletefrom->s_next;
-        t_freebytes(deletefrom, sizeof(*deletefrom));
+    if (!(snew = vline_tilde_getseg(x)))
+        return;
+        /* the new segment supplants any segment with a later starttime, or
+        an equal starttime unless the equal one was instantaneous and the new
+        one isn't (in which case we'll do a jump-and-slide starting at that
+        time.)  Supplanted segments and all that follow them are deleted.
+        Search back from the end; usually nothing gets supplanted. */
+    for (s1 = x->x_last; s1 && s1->s_starttime > starttime; s1 = s1->s_prev)
         deletefrom = s1;
-    }
+    for (; s1 && s1->s_starttime == starttime; s1 = s1->s_prev)
+        if (s1->s_targettime > s1->s_starttime || inlet1 <= 0)
+            deletefrom = s1;
+    vline_tilde_freesegs(x, deletefrom);
     snew->s_next = 0;
+    if ((snew->s_prev = x->x_last))
+        x->x_last->s_next = snew;
+    else x->x_list = snew;
+    x->x_last = snew;
     snew->s_target = f;
     snew->s_starttime = starttime;
     snew->s_targettime = starttime + inlet1;
@@ -387,6 +551,7 @@ static void vline_tilde_dsp(t_vline *x, t_signal **sp)
 
 static void *vline_tilde_new(void)
 {
+    int i;
     t_vline *x = (t_vline *)pd_new(vline_tilde_class);
     outlet_new(&x->x_obj, gensym("signal"));
     floatinlet_new(&x->x_obj, &x->x_inlet1);
@@ -395,16 +560,30 @@ static void *vline_tilde_new(void)
     x->x_value = x->x_inc = 0;
     x->x_referencetime = x->x_lastlogicaltime = x->x_nextblocktime =
         clock_getlogicaltime();
-    x->x_list = 0;
+    x->x_list = x->x_last = x->x_free = 0;
+    for (i = 0; i < VLINE_NPREALLOC; i++)
+    {
+        t_vseg *s = (t_vseg *)t_getbytes(sizeof(*s));
+        s->s_next = x->x_free;
+        x->x_free = s;
+    }
     x->x_samppermsec = 0;
     x->x_targettime = 1e20;
     return (x);
 }
 
+static void vline_tilde_free(t_vline *x)
+{
+    t_vseg *s1, *s2;
+    vline_tilde_freesegs(x, x->x_list);
+    for (s1 = x->x_free; s1; s1 = s2)
+        s2 = s1->s_next, t_freebytes(s1, sizeof(*s1));
+}
+
 static void vline_tilde_setup(void)
 {
     vline_tilde_class = class_new(gensym("vline~"), vline_tilde_new,
-        (t_method)vline_tilde_stop, sizeof(t_vline), 0, 0);
+        (t_method)vline_tilde_free, sizeof(t_vline), 0, 0);
     class_addfloat(vline_tilde_class, (t_method)vline_tilde_float);
     class_addmethod(vline_tilde_class, (t_method)vline_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
@@ -556,23 +735,35 @@ static void vsnapshot_tilde_setup(void)
 
 /* ---------------- env~ - simple envelope follower. ----------------- */
 
-#define MAXOVERLAP 32
-#define INITVSTAKEN 64
+/* The Hanning-windowed sum of squares is kept up to date sample by sample
+rather than recomputed for each output: since the window is (1 - cos)/N, it
+is the difference between a running sum of the squares in the window and
+the real part of a sliding DFT of them at the first bin.  Each new sample
+then costs the same however long the window and however often we output.
+The sums are kept in double precision so that what is added in as a sample
+enters the window comes off exactly when it leaves; to be sure rounding
+errors can't pile up, they're recomputed from scratch every ENVRESYNC times
+around the window. */
+
+#define ENVRESYNC 16
 
 typedef struct sigenv
 {
     t_object x_obj;                 /* header */
     void *x_outlet;                 /* a "float" outlet */
     void *x_clock;                  /* a "clock" object */
-    t_sample *x_buf;                   /* a Hanning window */
-    int x_phase;                    /* number of points since last output */
+    t_sample *x_buf;                /* cos and sin tables, then history */
+    int x_phase;                    /* number of points until next output */
     int x_period;                   /* requested period of output */
     int x_realperiod;               /* period rounded up to vecsize multiple */
     int x_npoints;                  /* analysis window size in samples */
+    int x_histphase;                /* where the next squared sample goes */
+    int x_nwrap;                    /* times around since sums recomputed */
+    double x_sum;                   /* sum of squares in the window */
+    double x_cossum;                /* same, weighted by cos of phase */
+    double x_sinsum;                /* same, weighted by sin of phase */
     t_float x_result;                 /* result to output */
-    t_sample x_sumbuf[MAXOVERLAP];     /* summing buffer */
     t_float x_f;
-    int x_allocforvs;               /* extra buffer for DSP vector size */
 } t_sigenv;
 
 t_class *env_tilde_class;
@@ -588,9 +779,8 @@ static void *env_tilde_new(t_floatarg fnpoints, t_floatarg fperiod)
 
     if (npoints < 1) npoints = 1024;
     if (period < 1) period = npoints/2;
-    if (period < npoints / MAXOVERLAP + 1)
-        period = npoints / MAXOVERLAP + 1;
-    if (!(buf = getbytes(sizeof(t_sample) * (npoints + INITVSTAKEN))))
+    if (period < 1) period = 1;
+    if (!(buf = getbytes(3 * sizeof(t_sample) * npoints)))
     {
         pd_error(0, "env: couldn't allocate buffer");
         return (0);
@@ -599,51 +789,86 @@ static void *env_tilde_new(t_floatarg fnpoints, t_floatarg fperiod)
     x->x_buf = buf;
     x->x_npoints = npoints;
     x->x_phase = 0;
-    x->x_period = period;
-    for (i = 0; i < MAXOVERLAP; i++) x->x_sumbuf[i] = 0;
+    x->x_period = x->x_realperiod = period;
+    x->x_histphase = x->x_nwrap = 0;
+    x->x_sum = x->x_cossum = x->x_sinsum = 0;
+    x->x_result = 0;
     for (i = 0; i < npoints; i++)
-        buf[i] = (1. - cos((2 * 3.14159 * i) / npoints))/npoints;
-    for (; i < npoints+INITVSTAKEN; i++) buf[i] = 0;
+    {
+        buf[i] = cos((2 * 3.14159265358979 * i) / npoints);
+        buf[npoints + i] = sin((2 * 3.14159265358979 * i) / npoints);
+        buf[2 * npoints + i] = 0;
+    }
     x->x_clock = clock_new(x, (t_method)env_tilde_tick);
     x->x_outlet = outlet_new(&x->x_obj, gensym("float"));
     x->x_f = 0;
-    x->x_allocforvs = INITVSTAKEN;
     return (x);
 }
 
+    /* recompute the sums from the history */
+static void env_tilde_resync(t_sigenv *x)
+{
+    int i, npoints = x->x_npoints;
+    t_sample *costab = x->x_buf, *sintab = costab + npoints,
+        *hist = sintab + npoints;
+    double sum = 0, cossum = 0, sinsum = 0;
+    for (i = 0; i < npoints; i++)
+    {
+        sum += hist[i];
+        cossum += (double)hist[i] * costab[i];
+        sinsum += (double)hist[i] * sintab[i];
+    }
+    x->x_sum = sum;
+    x->x_cossum = cossum;
+    x->x_sinsum = sinsum;
+    x->x_nwrap = 0;
+}
+
 static t_int *env_tilde_perform(t_int *w)
 {
     t_sigenv *x = (t_sigenv *)(w[1]);
     t_sample *in = (t_sample *)(w[2]);
     int n = (int)(w[3]);
-    int count;
-    t_sample *sump;
-    in += n;
-    for (count = x->x_phase, sump = x->x_sumbuf;
-        count < x->x_npoints; count += x->x_realperiod, sump++)
+    int npoints = x->x_npoints, phase = x->x_histphase, i;
+    t_sample *costab = x->x_buf, *sintab = costab + npoints,
+        *hist = sintab + npoints;
+    while (n)
     {
-        t_sample *hp = x->x_buf + count;
-        t_sample *fp = in;
-        t_sample sum = *sump;
-        int i;
-
-        for (i = 0; i < n; i++)
+            /* go up to the end of the history at most */
+        int chunk = (n < npoints - phase ? n : npoints - phase);
+        double sum = x->x_sum, cossum = x->x_cossum, sinsum = x->x_sinsum;
+        for (i = 0; i < chunk; i++)
+        {
+            t_sample f = in[i] * in[i];
+            double diff = (double)f - hist[phase + i];
+            hist[phase + i] = f;
+            sum += diff;
+            cossum += diff * costab[phase + i];
+            sinsum += diff * sintab[phase + i];
+        }
+        x->x_sum = sum;
+        x->x_cossum = cossum;
+        x->x_sinsum = sinsum;
+        in += chunk;
+        n -= chunk;
+        if ((phase += chunk) == npoints)
         {
-            fp--;
-            sum += *hp++ * (*fp * *fp);
+            phase = 0;
+            if (++x->x_nwrap >= ENVRESYNC)
+                env_tilde_resync(x);
         }
-        *sump = sum;
     }
-    sump[0] = 0;
-    x->x_phase -= n;
+    x->x_histphase = phase;
+    x->x_phase -= (int)(w[3]);
     if (x->x_phase < 0)
     {
-        x->x_result = x->x_sumbuf[0];
-        for (count = x->x_realperiod, sump = x->x_sumbuf;
-            count < x->x_npoints; count += x->x_realperiod, sump++)
-                sump[0] = sump[1];
-        sump[0] = 0;
-        x->x_phase = x->x_realperiod - n;
+            /* turn the DFT around so that its phase is zero at the newest
+            sample, where the window starts */
+        int newest = (phase ? phase : npoints) - 1;
+        double windowed = x->x_sum - (x->x_cossum * costab[newest] +
+            x->x_sinsum * sintab[newest]);
+        x->x_result = (windowed > 0 ? windowed / npoints : 0);
+        x->x_phase = x->x_realperiod - (int)(w[3]);
         clock_delay(x->x_clock, 0L);
     }
     return (w+4);
@@ -654,19 +879,6 @@ static void env_tilde_dsp(t_sigenv *x, t_signal **sp)
     if (x->x_period % sp[0]->s_n) x->x_realperiod =
         x->x_period + sp[0]->s_n - (x->x_period % sp[0]->s_n);
     else x->x_realperiod = x->x_period;
-    if (sp[0]->s_n > x->x_allocforvs)
-    {
-        void *xx = resizebytes(x->x_buf,
-            (x->x_npoints + x->x_allocforvs) * sizeof(t_sample),
-            (x->x_npoints + sp[0]->s_n) * sizeof(t_sample));
-        if (!xx)
-        {
-            pd_error(0, "env~: out of memory");
-            return;
-        }
-        x->x_buf = (t_sample *)xx;
-        x->x_allocforvs = sp[0]->s_n;
-    }
     dsp_add(env_tilde_perform, 3, x, sp[0]->s_vec, (t_int)sp[0]->s_n);
 }
 
@@ -678,7 +890,7 @@ static void env_tilde_tick(t_sigenv *x) /* callback function for the clock */
 static void env_tilde_ff(t_sigenv *x)           /* cleanup on free */
 {
     clock_free(x->x_clock);
-    freebytes(x->x_buf, (x->x_npoints + x->x_allocforvs) * sizeof(*x->x_buf));
+    freebytes(x->x_buf, 3 * x->x_npoints * sizeof(*x->x_buf));
 }
 
 
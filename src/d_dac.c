@@ -6,6 +6,7 @@
 */
 
 #include "m_pd.h"
+#include "m_imp.h"
 #include "s_stuff.h"
 
 /* ----------------------------- dac~ --------------------------- */
@@ -41,18 +42,52 @@ static void *dac_new(t_symbol *s, int argc, t_atom *argv)
     return (x);
 }
 
+    /* add or copy a signal into output channels.  The first one to write a
+    channel in each DSP tick copies; the rest add.  "written" is null when
+    writing into a parallel section's private buffer, which is always
+    added to. */
+static t_int *dac_perform(t_int *w)
+{
+    t_sample *in = (t_sample *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    unsigned char *written = (unsigned char *)(w[3]);
+    int nchans = (int)(w[4]), ch, i;
+    for (ch = 0; ch < nchans; ch++, in += DEFDACBLKSIZE,
+        out += DEFDACBLKSIZE)
+    {
+        if (written && !written[ch])
+        {
+            written[ch] = 1;
+            for (i = 0; i < DEFDACBLKSIZE; i++)
+                out[i] = in[i];
+        }
+        else for (i = 0; i < DEFDACBLKSIZE; i++)
+            out[i] += in[i];
+    }
+    return (w+5);
+}
+
 static void dac_dsp(t_dac *x, t_signal **sp)
 {
     t_int i, *ip;
     t_signal **sp2;
+    t_sample *soundout = ugen_getsoundout();
+    unsigned char *written = ugen_getoutwritten();
     for (i = x->x_n, ip = x->x_vec, sp2 = sp; i--; ip++, sp2++)
     {
-        int ch = (int)(*ip - 1);
+        int ch = (int)(*ip - 1), nchans = (*sp2)->s_nchans;
         if ((*sp2)->s_n != DEFDACBLKSIZE)
             pd_error(0, "dac~: bad vector size");
         else if (ch >= 0 && ch < sys_get_outchannels())
-            dsp_add(plus_perform, 4, STUFF->st_soundout + DEFDACBLKSIZE*ch,
-                (*sp2)->s_vec, STUFF->st_soundout + DEFDACBLKSIZE*ch, (t_int)DEFDACBLKSIZE);
+        {
+                /* the channels of a multichannel input go to this and the
+                following output channels, all in one call. */
+            if (nchans > sys_get_outchannels() - ch)
+                nchans = sys_get_outchannels() - ch;
+            dsp_add(dac_perform, 4, (*sp2)->s_vec,
+                soundout + DEFDACBLKSIZE*ch, (written ? written + ch : 0),
+                    (t_int)nchans);
+        }
     }
 }
 
@@ -119,9 +154,9 @@ static void adc_dsp(t_adc *x, t_signal **sp)
         int ch = (int)(*ip - 1);
         if ((*sp2)->s_n != DEFDACBLKSIZE)
             pd_error(0, "adc~: bad vector size");
+            /* the output is the input channel itself, not a copy */
         else if (ch >= 0 && ch < sys_get_inchannels())
-            dsp_add_copy(STUFF->st_soundin + DEFDACBLKSIZE*ch,
-                (*sp2)->s_vec, DEFDACBLKSIZE);
+            signal_setexternal(sp2, STUFF->st_soundin + DEFDACBLKSIZE*ch);
         else dsp_add_zero((*sp2)->s_vec, DEFDACBLKSIZE);
     }
 }
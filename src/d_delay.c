@@ -5,6 +5,8 @@
 /*  send~, delread~, throw~, catch~ */
 
 #include "m_pd.h"
+#include "m_imp.h"
+#include "d_simd.h"
 #include <string.h>
 extern int ugen_getsortno(void);
 
@@ -19,6 +21,7 @@ typedef struct delwritectl
     int c_n;
     t_sample *c_vec;
     int c_phase;
+    int c_mask;         /* c_n - 1 if c_n is a power of two ("-pow2") or 0 */
 } t_delwritectl;
 
 typedef struct _sigdelwrite
@@ -31,8 +34,14 @@ typedef struct _sigdelwrite
     int x_rsortno;  /* DSP sort # for first delread or write in chain */
     int x_vecsize;  /* vector size for delread~ to use */
     t_float x_f;
+    int x_pow2;     /* round buffer size up to a power of two */
 } t_sigdelwrite;
 
+/* The buffer holds c_n samples of the delay line after XTRASAMPS "guard"
+samples, which repeat the last ones so that interpolating reads can run off
+the beginning of the buffer.  With the "-pow2" flag c_n is rounded up to a
+power of two, so that vd~ can wrap its read positions by masking them. */
+
 #define XTRASAMPS 4
 #define SAMPBLK 4
 
@@ -42,11 +51,21 @@ static void sigdelwrite_updatesr(t_sigdelwrite *x, t_float sr) /* added by Mathi
     if (nsamps < 1) nsamps = 1;
     nsamps += ((- nsamps) & (SAMPBLK - 1));
     nsamps += DEFDELVS;
+    if (x->x_pow2)
+    {
+        int n = DEFDELVS;
+        while (n < nsamps && n < (1 << 30))
+            n <<= 1;
+        nsamps = n;
+    }
+    x->x_cspace.c_mask = (x->x_pow2 ? nsamps - 1 : 0);
     if (x->x_cspace.c_n != nsamps)
     {
+        int kind = mem_setkind(MEM_DELAY);
         x->x_cspace.c_vec = (t_sample *)resizebytes(x->x_cspace.c_vec,
             (x->x_cspace.c_n + XTRASAMPS) * sizeof(t_sample),
             (nsamps + XTRASAMPS) * sizeof(t_sample));
+        mem_setkind(kind);
         x->x_cspace.c_n = nsamps;
         x->x_cspace.c_phase = XTRASAMPS;
     }
@@ -77,15 +96,31 @@ static void sigdelwrite_checkvecsize(t_sigdelwrite *x, int vecsize)
 #endif
 }
 
-static void *sigdelwrite_new(t_symbol *s, t_floatarg msec)
+static void *sigdelwrite_new(t_symbol *dummy, int argc, t_atom *argv)
 {
     t_sigdelwrite *x = (t_sigdelwrite *)pd_new(sigdelwrite_class);
+    t_symbol *s;
+    int kind;
+    x->x_pow2 = 0;
+    while (argc && argv->a_type == A_SYMBOL &&
+        *argv->a_w.w_symbol->s_name == '-')
+    {
+        if (!strcmp(argv->a_w.w_symbol->s_name, "-pow2"))
+            x->x_pow2 = 1;
+        else pd_error(x, "delwrite~: %s: unknown flag",
+            argv->a_w.w_symbol->s_name);
+        argc--; argv++;
+    }
+    s = atom_getsymbolarg(0, argc, argv);
     if (!*s->s_name) s = gensym("delwrite~");
     pd_bind(&x->x_obj.ob_pd, s);
+    canvas_update_dsp();    /* so that delread~ objects find us */
     x->x_sym = s;
-    x->x_deltime = msec;
-    x->x_cspace.c_n = 0;
+    x->x_deltime = atom_getfloatarg(1, argc, argv);
+    x->x_cspace.c_n = x->x_cspace.c_mask = 0;
+    kind = mem_setkind(MEM_DELAY);
     x->x_cspace.c_vec = getbytes(XTRASAMPS * sizeof(t_sample));
+    mem_setkind(kind);
     x->x_sortno = 0;
     x->x_vecsize = 0;
     x->x_f = 0;
@@ -101,12 +136,21 @@ static t_int *sigdelwrite_perform(t_int *w)
     t_sample *vp = c->c_vec, *bp = vp + phase, *ep = vp + (c->c_n + XTRASAMPS);
     phase += n;
 
-    while (n--)
+        /* write up to the end of the buffer, then wrap, instead of
+        checking for the end at every sample */
+    while (n)
     {
-        t_sample f = *in++;
-        if (PD_BIGORSMALL(f))
-            f = 0;
-        *bp++ = f;
+        int i, chunk = (ep - bp < n ? (int)(ep - bp) : n);
+        for (i = 0; i < chunk; i++)
+        {
+            t_sample f = in[i];
+            if (PD_BIGORSMALL(f))
+                f = 0;
+            bp[i] = f;
+        }
+        in += chunk;
+        bp += chunk;
+        n -= chunk;
         if (bp == ep)
         {
             vp[0] = ep[-4];
@@ -129,6 +173,23 @@ static void sigdelwrite_dsp(t_sigdelwrite *x, t_signal **sp)
     sigdelwrite_updatesr(x, sp[0]->s_sr);
 }
 
+    /* free the delay line while our subpatch is released by its switch~;
+    it's made again when we're next sorted.  If a delread~ or vd~ outside
+    the subpatch has already been sorted, it still refers to it. */
+static void sigdelwrite_dsprelease(t_sigdelwrite *x)
+{
+    int kind;
+    if (x->x_rsortno == ugen_getsortno() || !x->x_cspace.c_n)
+        return;
+    freebytes(x->x_cspace.c_vec,
+        (x->x_cspace.c_n + XTRASAMPS) * sizeof(t_sample));
+    kind = mem_setkind(MEM_DELAY);
+    x->x_cspace.c_vec = getbytes(XTRASAMPS * sizeof(t_sample));
+    mem_setkind(kind);
+    x->x_cspace.c_n = x->x_cspace.c_mask = 0;
+    x->x_cspace.c_phase = XTRASAMPS;
+}
+
 static void sigdelwrite_free(t_sigdelwrite *x)
 {
     pd_unbind(&x->x_obj.ob_pd, x->x_sym);
@@ -140,10 +201,12 @@ static void sigdelwrite_setup(void)
 {
     sigdelwrite_class = class_new(gensym("delwrite~"),
         (t_newmethod)sigdelwrite_new, (t_method)sigdelwrite_free,
-        sizeof(t_sigdelwrite), 0, A_DEFSYM, A_DEFFLOAT, 0);
+        sizeof(t_sigdelwrite), 0, A_GIMME, 0);
     CLASS_MAINSIGNALIN(sigdelwrite_class, t_sigdelwrite, x_f);
     class_addmethod(sigdelwrite_class, (t_method)sigdelwrite_dsp,
         gensym("dsp"), A_CANT, 0);
+    class_addmethod(sigdelwrite_class, (t_method)sigdelwrite_dsprelease,
+        gensym("dsp-release"), A_CANT, 0);
     class_addmethod(sigdelwrite_class, (t_method)sigdelwrite_clear,
                     gensym("clear"), 0);
     class_sethelpsymbol(sigdelwrite_class, gensym("delay-tilde-objects"));
@@ -203,10 +266,15 @@ static t_int *sigdelread_perform(t_int *w)
     if (phase < 0) phase += nsamps;
     bp = vp + phase;
 
-    while (n--)
+        /* copy up to the end of the buffer, then wrap: normally that's
+        one or two pieces */
+    while (n)
     {
-        *out++ = *bp++;
-        if (bp == ep) bp -= nsamps;
+        int chunk = (ep - bp < n ? (int)(ep - bp) : n);
+        memcpy(out, bp, chunk * sizeof(t_sample));
+        out += chunk;
+        n -= chunk;
+        bp = vp + XTRASAMPS;
     }
     return (w+5);
 }
@@ -269,6 +337,15 @@ static void *sigvd_new(t_symbol *s)
     return (x);
 }
 
+    /* find the newest of the four points to interpolate between, "idelsamps"
+    samples back from "phase"; the other three precede it, possibly in the
+    guard samples.  A power-of-two buffer lets us wrap by masking. */
+#define VD_POINT(vp, phase, nsamps, mask, idelsamps) \
+    ((mask) ? (vp) + XTRASAMPS + (((phase) - XTRASAMPS - (idelsamps)) & (mask)) \
+        : ((phase) - (idelsamps) < XTRASAMPS ? \
+            (vp) + (phase) - (idelsamps) + (nsamps) : \
+            (vp) + (phase) - (idelsamps)))
+
 static t_int *sigvd_perform(t_int *w)
 {
     t_sample *in = (t_sample *)(w[1]);
@@ -277,10 +354,10 @@ static t_int *sigvd_perform(t_int *w)
     t_sigvd *x = (t_sigvd *)(w[4]);
     int n = (int)(w[5]);
 
-    int nsamps = ctl->c_n;
+    int nsamps = ctl->c_n, phase = ctl->c_phase, mask = ctl->c_mask;
     t_sample limit = nsamps - n;
     t_sample fn = n-1;
-    t_sample *vp = ctl->c_vec, *bp, *wp = vp + ctl->c_phase;
+    t_sample *vp = ctl->c_vec, *bp;
     t_sample zerodel = x->x_zerodel;
     if (limit < 0) /* blocksize is larger than delread~ buffer size */
     {
@@ -288,6 +365,45 @@ static t_int *sigvd_perform(t_int *w)
             *out++ = 0;
         return (w+6);
     }
+#ifdef PD_SIMD
+        /* four outputs at a time.  Each one's four points are loaded as a
+        vector; transposing those gives vectors of all the "a" points, "b"
+        points, and so on, so that the interpolation is done in parallel. */
+    if (n >= 4)
+    {
+        t_v4 sr = V4_SET1(x->x_sr), zd = V4_SET1(zerodel);
+        t_v4 lo = V4_SET1(1.00001f), hi = V4_SET1(limit), four = V4_SET1(4);
+        t_v4 three = V4_SET1(3.0f), sixth = V4_SET1(0.1666667f);
+        t_v4 one = V4_SET1(1.0f);
+        t_v4 fnv, delsamps, frac, a, b, c, d, cminusb, p, q;
+        t_sample ramp[4], del[4];
+        ramp[0] = fn; ramp[1] = fn - 1; ramp[2] = fn - 2; ramp[3] = fn - 3;
+        fnv = V4_LOAD(ramp);
+        for (; n >= 4; n -= 4, in += 4, out += 4)
+        {
+                /* (V4_MAX replaces NaN by the lower limit) */
+            delsamps = V4_ADD(V4_MIN(V4_MAX(
+                V4_SUB(V4_MUL(sr, V4_LOAD(in)), zd), lo), hi), fnv);
+            fnv = V4_SUB(fnv, four);
+            frac = V4_SUB(delsamps, V4_TRUNC(delsamps));
+            V4_STORE(del, delsamps);
+            d = V4_LOAD(VD_POINT(vp, phase, nsamps, mask, (int)del[0]) - 3);
+            c = V4_LOAD(VD_POINT(vp, phase, nsamps, mask, (int)del[1]) - 3);
+            b = V4_LOAD(VD_POINT(vp, phase, nsamps, mask, (int)del[2]) - 3);
+            a = V4_LOAD(VD_POINT(vp, phase, nsamps, mask, (int)del[3]) - 3);
+            V4_TRANSPOSE(d, c, b, a);
+            cminusb = V4_SUB(c, b);
+                /* p = (d - a - 3 * cminusb) * frac + (d + 2 * a - 3 * b) */
+            p = V4_ADD(V4_MUL(V4_SUB(V4_SUB(d, a), V4_MUL(three, cminusb)),
+                frac), V4_SUB(V4_ADD(d, V4_ADD(a, a)), V4_MUL(three, b)));
+                /* q = cminusb - (1 - frac) * p / 6 */
+            q = V4_SUB(cminusb, V4_MUL(V4_MUL(sixth, V4_SUB(one, frac)), p));
+            V4_STORE(out, V4_ADD(b, V4_MUL(frac, q)));
+        }
+        V4_STORE(ramp, fnv);
+        fn = ramp[0];
+    }
+#endif
     while (n--)
     {
         t_sample delsamps = x->x_sr * *in++ - zerodel, frac;
@@ -301,8 +417,7 @@ static t_int *sigvd_perform(t_int *w)
         fn = fn - 1.0f;
         idelsamps = delsamps;
         frac = delsamps - (t_sample)idelsamps;
-        bp = wp - idelsamps;
-        if (bp < vp + XTRASAMPS) bp += nsamps;
+        bp = VD_POINT(vp, phase, nsamps, mask, idelsamps);
         d = bp[-3];
         c = bp[-2];
         b = bp[-1];
@@ -324,6 +439,7 @@ static void sigvd_dsp(t_sigvd *x, t_signal **sp)
     x->x_sr = sp[0]->s_sr * 0.001;
     if (delwriter)
     {
+        sigdelwrite_updatesr(delwriter, sp[0]->s_sr);
         sigdelwrite_checkvecsize(delwriter, sp[0]->s_n);
         x->x_zerodel = (delwriter->x_sortno == ugen_getsortno() ?
             0 : delwriter->x_vecsize);
@@ -3,6 +3,8 @@
 * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
 
 #include "m_pd.h"
+#include "m_imp.h"
+#include <string.h>
 
 /* This file interfaces to one of the Mayer, Ooura, or fftw FFT packages
 to implement the "fft~", etc, Pd objects.  If using Mayer, also compile
@@ -170,33 +172,44 @@ static void *sigrfft_new(void)
     return (x);
 }
 
+    /* this is added with dsp_addbatch() so that all rfft~ objects of the
+    same size that follow each other in the chain are done in one call. */
 static t_int *sigrfft_perform(t_int *w)
 {
-    t_sample *in = (t_sample *)(w[1]);
-    int n = (int)w[2];
-    mayer_realfft(n, in);
-    return (w+3);
+    int n = (int)w[1], count = (int)w[2], n2 = (n>>1), i;
+    t_int *ip = w + 3;
+    for (; count--; ip += 3)
+    {
+        t_sample *in = (t_sample *)(ip[0]);
+        t_sample *out1 = (t_sample *)(ip[1]);
+        t_sample *out2 = (t_sample *)(ip[2]);
+        if (in != out1)
+            memcpy(out1, in, n * sizeof(t_sample));
+        mayer_realfft(n, out1);
+        for (i = 1; i < n2; i++)
+            out2[i] = -out1[n-i];
+        for (i = n2+1; i < n; i++)
+            out1[i] = 0;
+        for (i = n2; i < n; i++)
+            out2[i] = 0;
+        out2[0] = 0;
+    }
+    return (ip);
 }
 
 static void sigrfft_dsp(t_sigrfft *x, t_signal **sp)
 {
-    int n = sp[0]->s_n, n2 = (n>>1);
-    t_sample *in1 = sp[0]->s_vec;
-    t_sample *out1 = sp[1]->s_vec;
-    t_sample *out2 = sp[2]->s_vec;
+    int n = sp[0]->s_n;
+    t_int vec[3];
     if (n < 4)
     {
         pd_error(0, "fft: minimum 4 points");
         return;
     }
-    if (in1 != out1)
-        dsp_add(copy_perform, 3, in1, out1, (t_int)n);
-    dsp_add(sigrfft_perform, 2, out1, (t_int)n);
-    dsp_add(sigrfft_flip, 3, out1 + (n2+1), out2 + n2, (t_int)(n2-1));
-    dsp_add_zero(out1 + (n2+1), ((n2-1)&(~7)));
-    dsp_add_zero(out1 + (n2+1) + ((n2-1)&(~7)), ((n2-1)&7));
-    dsp_add_zero(out2 + n2, n2);
-    dsp_add_zero(out2, 1);
+    vec[0] = (t_int)sp[0]->s_vec;
+    vec[1] = (t_int)sp[1]->s_vec;
+    vec[2] = (t_int)sp[2]->s_vec;
+    dsp_addbatch(sigrfft_perform, n, 3, vec);
 }
 
 static void sigrfft_setup(void)
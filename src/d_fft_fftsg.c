@@ -156,17 +156,15 @@ EXTERN void mayer_ifft(int n, t_sample *fz1, t_sample *fz2)
     mayer_dofft(fz1, fz2, n, 1);
 }
 
-EXTERN void mayer_realfft(int n, t_sample *fz)
+static void ooura_realfft(int n, t_sample *fz, FFTFLT *buf, int *bitrev,
+    FFTFLT *costab)
 {
-    FFTFLT *buf, *fp3;
+    FFTFLT *fp3;
     int i, nover2 = n/2;
     t_sample *fp1, *fp2;
-    if (!ooura_init(n))
-        return;
-    buf = ooura_buffer;
     for (i = 0, fp1 = fz, fp3 = buf; i < n; i++, fp1++, fp3++)
         buf[i] = fz[i];
-    rdft(n, 1, buf, ooura_bitrev, ooura_costab);
+    rdft(n, 1, buf, bitrev, costab);
     fz[0] = buf[0];
     fz[nover2] = buf[1];
     for (i = 1, fp1 = fz+1, fp2 = fz+(n-1), fp3 = buf+2; i < nover2;
@@ -174,24 +172,137 @@ EXTERN void mayer_realfft(int n, t_sample *fz)
             *fp1 = fp3[0], *fp2 = fp3[1];
 }
 
-EXTERN void mayer_realifft(int n, t_sample *fz)
+static void ooura_realifft(int n, t_sample *fz, FFTFLT *buf, int *bitrev,
+    FFTFLT *costab)
 {
-    FFTFLT *buf, *fp3;
+    FFTFLT *fp3;
     int i, nover2 = n/2;
     t_sample *fp1, *fp2;
-    if (!ooura_init(n))
-        return;
-    buf = ooura_buffer;
     buf[0] = fz[0];
     buf[1] = fz[nover2];
     for (i = 1, fp1 = fz+1, fp2 = fz+(n-1), fp3 = buf+2; i < nover2;
         i++, fp1++, fp2--, fp3 += 2)
             fp3[0] = *fp1, fp3[1] = *fp2;
-    rdft(n, -1, buf, ooura_bitrev, ooura_costab);
+    rdft(n, -1, buf, bitrev, costab);
     for (i = 0, fp1 = fz, fp3 = buf; i < n; i++, fp1++, fp3++)
         fz[i] = 2*buf[i];
 }
 
+EXTERN void mayer_realfft(int n, t_sample *fz)
+{
+    if (ooura_init(n))
+        ooura_realfft(n, fz, ooura_buffer, ooura_bitrev, ooura_costab);
+}
+
+EXTERN void mayer_realifft(int n, t_sample *fz)
+{
+    if (ooura_init(n))
+        ooura_realifft(n, fz, ooura_buffer, ooura_bitrev, ooura_costab);
+}
+
+    /* real FFTs of one size with their own tables and buffer, so that they
+    can be computed in any thread, several at once.  The layout and scaling
+    are the same as for mayer_realfft() and mayer_realifft(). */
+struct _realfft
+{
+    int r_n;
+    int *r_bitrev;
+    int r_bitrevsize;
+    FFTFLT *r_costab;
+    FFTFLT *r_buf;
+};
+
+t_realfft *realfft_new(int n)
+{
+    t_realfft *x;
+    if (n < 4 || n != (1 << ilog2(n)))
+        return (0);
+    x = (t_realfft *)getbytes(sizeof(*x));
+    x->r_n = n;
+    x->r_bitrevsize = sizeof(int) * (2 + (1 << (ilog2(n)/2)));
+    x->r_bitrev = (int *)getbytes(x->r_bitrevsize);
+    x->r_costab = (FFTFLT *)getbytes(n * sizeof(FFTFLT)/2);
+    x->r_buf = (FFTFLT *)getbytes(n * sizeof(FFTFLT));
+        /* Ooura makes the tables the first time; do that here so that
+        afterward they're only read. */
+    rdft(n, 1, x->r_buf, x->r_bitrev, x->r_costab);
+    return (x);
+}
+
+void realfft_free(t_realfft *x)
+{
+    freebytes(x->r_bitrev, x->r_bitrevsize);
+    freebytes(x->r_costab, x->r_n * sizeof(FFTFLT)/2);
+    freebytes(x->r_buf, x->r_n * sizeof(FFTFLT));
+    freebytes(x, sizeof(*x));
+}
+
+void realfft_forward(t_realfft *x, t_sample *fz)
+{
+    ooura_realfft(x->r_n, fz, x->r_buf, x->r_bitrev, x->r_costab);
+}
+
+void realfft_inverse(t_realfft *x, t_sample *fz)
+{
+    ooura_realifft(x->r_n, fz, x->r_buf, x->r_bitrev, x->r_costab);
+}
+
+    /* complex FFTs of one size, thread-safe in the same way as t_realfft.
+    The directions and scaling are those of mayer_fft() and mayer_ifft(). */
+struct _complexfft
+{
+    int c_n;
+    int *c_bitrev;
+    int c_bitrevsize;
+    FFTFLT *c_costab;
+    FFTFLT *c_buf;
+};
+
+t_complexfft *complexfft_new(int n)
+{
+    t_complexfft *x;
+    if (n < 2 || n != (1 << ilog2(n)))
+        return (0);
+    x = (t_complexfft *)getbytes(sizeof(*x));
+    x->c_n = n;
+    x->c_bitrevsize = sizeof(int) * (2 + (1 << (ilog2(2*n)/2)));
+    x->c_bitrev = (int *)getbytes(x->c_bitrevsize);
+    x->c_costab = (FFTFLT *)getbytes(n * sizeof(FFTFLT));
+    x->c_buf = (FFTFLT *)getbytes(2 * n * sizeof(FFTFLT));
+    cdft(2*n, 1, x->c_buf, x->c_bitrev, x->c_costab);
+    return (x);
+}
+
+void complexfft_free(t_complexfft *x)
+{
+    freebytes(x->c_bitrev, x->c_bitrevsize);
+    freebytes(x->c_costab, x->c_n * sizeof(FFTFLT));
+    freebytes(x->c_buf, 2 * x->c_n * sizeof(FFTFLT));
+    freebytes(x, sizeof(*x));
+}
+
+static void complexfft_do(t_complexfft *x, t_sample *re, t_sample *im,
+    int sgn)
+{
+    int i, n = x->c_n;
+    FFTFLT *fp = x->c_buf;
+    for (i = 0; i < n; i++, fp += 2)
+        fp[0] = re[i], fp[1] = im[i];
+    cdft(2*n, sgn, x->c_buf, x->c_bitrev, x->c_costab);
+    for (i = 0, fp = x->c_buf; i < n; i++, fp += 2)
+        re[i] = fp[0], im[i] = fp[1];
+}
+
+void complexfft_forward(t_complexfft *x, t_sample *re, t_sample *im)
+{
+    complexfft_do(x, re, im, -1);
+}
+
+void complexfft_inverse(t_complexfft *x, t_sample *re, t_sample *im)
+{
+    complexfft_do(x, re, im, 1);
+}
+
     /* ancient ISPW-like version, used in fiddle~ and perhaps other externs
     here and there. */
 void pd_fft(t_float *buf, int npoints, int inverse)
@@ -7,13 +7,54 @@
 /* changes and additions for FFTW3 by Thomas Grill                      */
 
 #include "m_pd.h"
+#include "m_imp.h"
 #include <fftw3.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 int ilog2(int n);
 
 #define MINFFT 0
 #define MAXFFT 30
 
+    /* FFTW_MEASURE plans take a while to make since FFTW tries out
+    different ways to do each size.  What it learns (its "wisdom") is saved
+    in a file in the home directory and read back the next time, after
+    which making the same plans again is quick.  These are called with the
+    global lock held. */
+static int fftw_gotwisdom;
+
+static void fftw_wisdomfile(char *buf, int bufsize)
+{
+#ifdef _WIN32
+    const char *home = getenv("USERPROFILE");
+#else
+    const char *home = getenv("HOME");
+#endif
+    if (home)
+        snprintf(buf, bufsize, "%s/.pd-fftw-wisdom", home);
+    else *buf = 0;
+}
+
+static void fftw_readwisdom(void)
+{
+    char file[MAXPDSTRING];
+    if (fftw_gotwisdom)
+        return;
+    fftw_gotwisdom = 1;
+    fftw_wisdomfile(file, MAXPDSTRING);
+    if (*file)
+        fftwf_import_wisdom_from_filename(file);
+}
+
+static void fftw_writewisdom(void)
+{
+    char file[MAXPDSTRING];
+    fftw_wisdomfile(file, MAXPDSTRING);
+    if (*file)
+        fftwf_export_wisdom_to_filename(file);
+}
+
 /* from the FFTW website:
  #include <fftw3.h>
      ...
@@ -59,12 +100,14 @@ static cfftw_info *cfftw_getplan(int n,int fwd)
         pd_globallock();
         if (!info->plan)    /* recheck in case it got set while we waited */
         {
+            fftw_readwisdom();
             info->in =
                 (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * n);
             info->out =
                 (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * n);
             info->plan = fftwf_plan_dft_1d(n, info->in, info->out,
                 fwd?FFTW_FORWARD:FFTW_BACKWARD, FFTW_MEASURE);
+            fftw_writewisdom();
         }
         pd_globalunlock();
     }
@@ -115,9 +158,17 @@ static rfftw_info *rfftw_getplan(int n,int fwd)
     info = (fwd?rfftw_fwd:rfftw_bwd)+(logn-MINFFT);
     if (!info->plan)
     {
-        info->in = (float*) fftwf_malloc(sizeof(float) * n);
-        info->out = (float*) fftwf_malloc(sizeof(float) * n);
-        info->plan = fftwf_plan_r2r_1d(n, info->in, info->out, fwd?FFTW_R2HC:FFTW_HC2R, FFTW_MEASURE);
+        pd_globallock();
+        if (!info->plan)    /* recheck in case it got set while we waited */
+        {
+            fftw_readwisdom();
+            info->in = (float*) fftwf_malloc(sizeof(float) * n);
+            info->out = (float*) fftwf_malloc(sizeof(float) * n);
+            info->plan = fftwf_plan_r2r_1d(n, info->in, info->out,
+                fwd?FFTW_R2HC:FFTW_HC2R, FFTW_MEASURE);
+            fftw_writewisdom();
+        }
+        pd_globalunlock();
     }
     return info;
 }
@@ -237,6 +288,123 @@ EXTERN void mayer_realifft(int n, t_sample *fz)
         fz[i] = p->out[i];
 }
 
+    /* real FFTs of one size with their own buffers, so that they can be
+    computed in any thread, several at once.  The plans are shared; FFTW
+    allows executing a plan on other (equally aligned) arrays at the same
+    time.  The layout and scaling are the same as for mayer_realfft() and
+    mayer_realifft(). */
+struct _realfft
+{
+    int r_n;
+    rfftw_info *r_fwd;
+    rfftw_info *r_bwd;
+    float *r_in;
+    float *r_out;
+};
+
+t_realfft *realfft_new(int n)
+{
+    t_realfft *x;
+    rfftw_info *fwd, *bwd;
+    if (n < 4 || n != (1 << ilog2(n)) || !(fwd = rfftw_getplan(n, 1)) ||
+        !(bwd = rfftw_getplan(n, 0)))
+            return (0);
+    x = (t_realfft *)getbytes(sizeof(*x));
+    x->r_n = n;
+    x->r_fwd = fwd;
+    x->r_bwd = bwd;
+    x->r_in = (float *)fftwf_malloc(sizeof(float) * n);
+    x->r_out = (float *)fftwf_malloc(sizeof(float) * n);
+    return (x);
+}
+
+void realfft_free(t_realfft *x)
+{
+    fftwf_free(x->r_in);
+    fftwf_free(x->r_out);
+    freebytes(x, sizeof(*x));
+}
+
+void realfft_forward(t_realfft *x, t_sample *fz)
+{
+    int i, n = x->r_n;
+    for (i = 0; i < n; i++)
+        x->r_in[i] = fz[i];
+    fftwf_execute_r2r(x->r_fwd->plan, x->r_in, x->r_out);
+    for (i = 0; i < n/2+1; i++)
+        fz[i] = x->r_out[i];
+    for (; i < n; i++)
+        fz[i] = -x->r_out[i];
+}
+
+void realfft_inverse(t_realfft *x, t_sample *fz)
+{
+    int i, n = x->r_n;
+    for (i = 0; i < n/2+1; i++)
+        x->r_in[i] = fz[i];
+    for (; i < n; i++)
+        x->r_in[i] = -fz[i];
+    fftwf_execute_r2r(x->r_bwd->plan, x->r_in, x->r_out);
+    for (i = 0; i < n; i++)
+        fz[i] = x->r_out[i];
+}
+
+    /* complex FFTs of one size, thread-safe in the same way as t_realfft.
+    The directions and scaling are those of mayer_fft() and mayer_ifft(). */
+struct _complexfft
+{
+    int c_n;
+    cfftw_info *c_fwd;
+    cfftw_info *c_bwd;
+    fftwf_complex *c_in;
+    fftwf_complex *c_out;
+};
+
+t_complexfft *complexfft_new(int n)
+{
+    t_complexfft *x;
+    cfftw_info *fwd, *bwd;
+    if (n < 2 || n != (1 << ilog2(n)) || !(fwd = cfftw_getplan(n, 1)) ||
+        !(bwd = cfftw_getplan(n, 0)))
+            return (0);
+    x = (t_complexfft *)getbytes(sizeof(*x));
+    x->c_n = n;
+    x->c_fwd = fwd;
+    x->c_bwd = bwd;
+    x->c_in = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * n);
+    x->c_out = (fftwf_complex *)fftwf_malloc(sizeof(fftwf_complex) * n);
+    return (x);
+}
+
+void complexfft_free(t_complexfft *x)
+{
+    fftwf_free(x->c_in);
+    fftwf_free(x->c_out);
+    freebytes(x, sizeof(*x));
+}
+
+static void complexfft_do(t_complexfft *x, t_sample *re, t_sample *im,
+    cfftw_info *p)
+{
+    int i, n = x->c_n;
+    float *fz;
+    for (i = 0, fz = (float *)x->c_in; i < n; i++, fz += 2)
+        fz[0] = re[i], fz[1] = im[i];
+    fftwf_execute_dft(p->plan, x->c_in, x->c_out);
+    for (i = 0, fz = (float *)x->c_out; i < n; i++, fz += 2)
+        re[i] = fz[0], im[i] = fz[1];
+}
+
+void complexfft_forward(t_complexfft *x, t_sample *re, t_sample *im)
+{
+    complexfft_do(x, re, im, x->c_fwd);
+}
+
+void complexfft_inverse(t_complexfft *x, t_sample *re, t_sample *im)
+{
+    complexfft_do(x, re, im, x->c_bwd);
+}
+
     /* ancient ISPW-like version, used in fiddle~ and perhaps other externs
     here and there. */
 void pd_fft(t_float *buf, int npoints, int inverse)
@@ -5,14 +5,45 @@
 /*  "filters", both linear and nonlinear.
 */
 #include "m_pd.h"
+#include "d_simd.h"
 #include <math.h>
+#include <string.h>
+
+    /* hip~ and lop~ take multichannel signals, and keep a state variable
+    for each channel.  This resizes the array of them (clearing any new
+    ones); while there's only one channel the array is "one". */
+static t_sample *sigfilter_setnchans(t_sample *vec, int oldn, int newn,
+    t_sample *one)
+{
+    int i;
+    if (newn == oldn)
+        return (vec);
+    if (newn == 1)
+    {
+        *one = vec[0];
+        freebytes(vec, oldn * sizeof(*vec));
+        return (one);
+    }
+    if (vec == one)
+    {
+        vec = (t_sample *)getbytes(newn * sizeof(*vec));
+        vec[0] = *one;
+    }
+    else vec = (t_sample *)resizebytes(vec,
+        oldn * sizeof(*vec), newn * sizeof(*vec));
+    for (i = oldn; i < newn; i++)
+        vec[i] = 0;
+    return (vec);
+}
 
 /* ---------------- hip~ - 1-pole 1-zero hipass filter. ----------------- */
 
 typedef struct hipctl
 {
-    t_sample c_x;
+    t_sample *c_x;          /* state, one per channel */
     t_sample c_coef;
+    int c_nchans;
+    t_sample c_x1;          /* c_x points here if only one channel */
 } t_hipctl;
 
 typedef struct sighip
@@ -33,7 +64,9 @@ static void *sighip_new(t_floatarg f)
     inlet_new(&x->x_obj, &x->x_obj.ob_pd, gensym("float"), gensym("ft1"));
     outlet_new(&x->x_obj, &s_signal);
     x->x_sr = 44100;
-    x->x_cspace.c_x = 0;
+    x->x_cspace.c_x1 = 0;
+    x->x_cspace.c_x = &x->x_cspace.c_x1;
+    x->x_cspace.c_nchans = 1;
     sighip_ft1(x, f);
     x->x_f = 0;
     return (x);
@@ -56,27 +89,31 @@ static t_int *sighip_perform(t_int *w)
     t_sample *out = (t_sample *)(w[2]);
     t_hipctl *c = (t_hipctl *)(w[3]);
     int n = (int)w[4];
-    int i;
-    t_sample last = c->c_x;
+    int i, ch;
     t_sample coef = c->c_coef;
-    if (coef < 1)
+        /* the channels follow one another in both "in" and "out" */
+    for (ch = 0; ch < c->c_nchans; ch++)
     {
-        t_sample normal = 0.5*(1+coef);
-        for (i = 0; i < n; i++)
+        t_sample last = c->c_x[ch];
+        if (coef < 1)
         {
-            t_sample new = *in++ + coef * last;
-            *out++ = normal * (new - last);
-            last = new;
+            t_sample normal = 0.5*(1+coef);
+            for (i = 0; i < n; i++)
+            {
+                t_sample new = *in++ + coef * last;
+                *out++ = normal * (new - last);
+                last = new;
+            }
+            if (PD_BIGORSMALL(last))
+                last = 0;
+            c->c_x[ch] = last;
+        }
+        else
+        {
+            for (i = 0; i < n; i++)
+                *out++ = *in++;
+            c->c_x[ch] = 0;
         }
-        if (PD_BIGORSMALL(last))
-            last = 0;
-        c->c_x = last;
-    }
-    else
-    {
-        for (i = 0; i < n; i++)
-            *out++ = *in++;
-        c->c_x = 0;
     }
     return (w+5);
 }
@@ -87,26 +124,30 @@ static t_int *sighip_perform_old(t_int *w)
     t_sample *out = (t_sample *)(w[2]);
     t_hipctl *c = (t_hipctl *)(w[3]);
     int n = (int)w[4];
-    int i;
-    t_sample last = c->c_x;
+    int i, ch;
     t_sample coef = c->c_coef;
-    if (coef < 1)
+        /* the channels follow one another in both "in" and "out" */
+    for (ch = 0; ch < c->c_nchans; ch++)
     {
-        for (i = 0; i < n; i++)
+        t_sample last = c->c_x[ch];
+        if (coef < 1)
         {
-            t_sample new = *in++ + coef * last;
-            *out++ = new - last;
-            last = new;
+            for (i = 0; i < n; i++)
+            {
+                t_sample new = *in++ + coef * last;
+                *out++ = new - last;
+                last = new;
+            }
+            if (PD_BIGORSMALL(last))
+                last = 0;
+            c->c_x[ch] = last;
+        }
+        else
+        {
+            for (i = 0; i < n; i++)
+                *out++ = *in++;
+            c->c_x[ch] = 0;
         }
-        if (PD_BIGORSMALL(last))
-            last = 0;
-        c->c_x = last;
-    }
-    else
-    {
-        for (i = 0; i < n; i++)
-            *out++ = *in++;
-        c->c_x = 0;
     }
     return (w+5);
 }
@@ -115,6 +156,9 @@ static void sighip_dsp(t_sighip *x, t_signal **sp)
 {
     x->x_sr = sp[0]->s_sr;
     sighip_ft1(x,  x->x_hz);
+    x->x_cspace.c_x = sigfilter_setnchans(x->x_cspace.c_x,
+        x->x_cspace.c_nchans, sp[1]->s_nchans, &x->x_cspace.c_x1);
+    x->x_cspace.c_nchans = sp[1]->s_nchans;
     dsp_add((pd_compatibilitylevel > 43 ?
         sighip_perform : sighip_perform_old),
             4, sp[0]->s_vec, sp[1]->s_vec, &x->x_cspace, (t_int)sp[0]->s_n);
@@ -122,14 +166,23 @@ static void sighip_dsp(t_sighip *x, t_signal **sp)
 
 static void sighip_clear(t_sighip *x, t_floatarg q)
 {
-    x->x_cspace.c_x = 0;
+    int i;
+    for (i = 0; i < x->x_cspace.c_nchans; i++)
+        x->x_cspace.c_x[i] = 0;
+}
+
+static void sighip_free(t_sighip *x)
+{
+    sigfilter_setnchans(x->x_cspace.c_x, x->x_cspace.c_nchans, 1,
+        &x->x_cspace.c_x1);
 }
 
 void sighip_setup(void)
 {
-    sighip_class = class_new(gensym("hip~"), (t_newmethod)sighip_new, 0,
-        sizeof(t_sighip), 0, A_DEFFLOAT, 0);
+    sighip_class = class_new(gensym("hip~"), (t_newmethod)sighip_new,
+        (t_method)sighip_free, sizeof(t_sighip), 0, A_DEFFLOAT, 0);
     CLASS_MAINSIGNALIN(sighip_class, t_sighip, x_f);
+    class_setmultichannel(sighip_class);
     class_addmethod(sighip_class, (t_method)sighip_dsp,
         gensym("dsp"), A_CANT, 0);
     class_addmethod(sighip_class, (t_method)sighip_ft1,
@@ -141,8 +194,10 @@ void sighip_setup(void)
 
 typedef struct lopctl
 {
-    t_sample c_x;
+    t_sample *c_x;          /* state, one per channel */
     t_sample c_coef;
+    int c_nchans;
+    t_sample c_x1;          /* c_x points here if only one channel */
 } t_lopctl;
 
 typedef struct siglop
@@ -164,7 +219,9 @@ static void *siglop_new(t_floatarg f)
     inlet_new(&x->x_obj, &x->x_obj.ob_pd, gensym("float"), gensym("ft1"));
     outlet_new(&x->x_obj, &s_signal);
     x->x_sr = 44100;
-    x->x_cspace.c_x = 0;
+    x->x_cspace.c_x1 = 0;
+    x->x_cspace.c_x = &x->x_cspace.c_x1;
+    x->x_cspace.c_nchans = 1;
     siglop_ft1(x, f);
     x->x_f = 0;
     return (x);
@@ -183,7 +240,15 @@ static void siglop_ft1(t_siglop *x, t_floatarg f)
 
 static void siglop_clear(t_siglop *x, t_floatarg q)
 {
-    x->x_cspace.c_x = 0;
+    int i;
+    for (i = 0; i < x->x_cspace.c_nchans; i++)
+        x->x_cspace.c_x[i] = 0;
+}
+
+static void siglop_free(t_siglop *x)
+{
+    sigfilter_setnchans(x->x_cspace.c_x, x->x_cspace.c_nchans, 1,
+        &x->x_cspace.c_x1);
 }
 
 static t_int *siglop_perform(t_int *w)
@@ -192,15 +257,38 @@ static t_int *siglop_perform(t_int *w)
     t_sample *out = (t_sample *)(w[2]);
     t_lopctl *c = (t_lopctl *)(w[3]);
     int n = (int)w[4];
+    int i, ch;
+    t_sample coef = c->c_coef;
+    t_sample feedback = 1 - coef;
+    for (ch = 0; ch < c->c_nchans; ch++)
+    {
+        t_sample last = c->c_x[ch];
+        for (i = 0; i < n; i++)
+            last = *out++ = coef * *in++ + feedback * last;
+        if (PD_BIGORSMALL(last))
+            last = 0;
+        c->c_x[ch] = last;
+    }
+    return (w+5);
+}
+
+    /* same for an input that's only set by floats */
+static t_int *siglop_perform_scalar(t_int *w)
+{
+    t_sample in = *(t_float *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    t_lopctl *c = (t_lopctl *)(w[3]);
+    int n = (int)w[4];
     int i;
-    t_sample last = c->c_x;
+    t_sample last = c->c_x[0];
     t_sample coef = c->c_coef;
     t_sample feedback = 1 - coef;
+    in *= coef;
     for (i = 0; i < n; i++)
-        last = *out++ = coef * *in++ + feedback * last;
+        last = *out++ = in + feedback * last;
     if (PD_BIGORSMALL(last))
         last = 0;
-    c->c_x = last;
+    c->c_x[0] = last;
     return (w+5);
 }
 
@@ -208,16 +296,21 @@ static void siglop_dsp(t_siglop *x, t_signal **sp)
 {
     x->x_sr = sp[0]->s_sr;
     siglop_ft1(x,  x->x_hz);
-    dsp_add(siglop_perform, 4,
-        sp[0]->s_vec, sp[1]->s_vec,
-            &x->x_cspace, (t_int)sp[0]->s_n);
+    x->x_cspace.c_x = sigfilter_setnchans(x->x_cspace.c_x,
+        x->x_cspace.c_nchans, sp[1]->s_nchans, &x->x_cspace.c_x1);
+    x->x_cspace.c_nchans = sp[1]->s_nchans;
+    dsp_add((sp[0]->s_scalar ? siglop_perform_scalar : siglop_perform), 4,
+        (sp[0]->s_scalar ? (t_int)sp[0]->s_scalar : (t_int)sp[0]->s_vec),
+            sp[1]->s_vec, &x->x_cspace, (t_int)sp[0]->s_n);
 }
 
 void siglop_setup(void)
 {
-    siglop_class = class_new(gensym("lop~"), (t_newmethod)siglop_new, 0,
-        sizeof(t_siglop), 0, A_DEFFLOAT, 0);
+    siglop_class = class_new(gensym("lop~"), (t_newmethod)siglop_new,
+        (t_method)siglop_free, sizeof(t_siglop), 0, A_DEFFLOAT, 0);
     CLASS_MAINSIGNALIN(siglop_class, t_siglop, x_f);
+    class_setscalarsignalin(siglop_class);
+    class_setmultichannel(siglop_class);
     class_addmethod(siglop_class, (t_method)siglop_dsp,
         gensym("dsp"), A_CANT, 0);
     class_addmethod(siglop_class, (t_method)siglop_ft1,
@@ -421,33 +514,37 @@ static t_int *sigbiquad_perform(t_int *w)
     return (w+5);
 }
 
-static void sigbiquad_list(t_sigbiquad *x, t_symbol *s, int argc, t_atom *argv)
+    /* check that the poles are inside the unit circle */
+static int sigbiquad_stable(t_float fb1, t_float fb2)
 {
-    t_float fb1 = atom_getfloatarg(0, argc, argv);
-    t_float fb2 = atom_getfloatarg(1, argc, argv);
-    t_float ff1 = atom_getfloatarg(2, argc, argv);
-    t_float ff2 = atom_getfloatarg(3, argc, argv);
-    t_float ff3 = atom_getfloatarg(4, argc, argv);
     t_float discriminant = fb1 * fb1 + 4 * fb2;
-    t_biquadctl *c = &x->x_cspace;
     if (discriminant < 0) /* imaginary roots -- resonant filter */
     {
             /* they're conjugates so we just check that the product
             is less than one */
-        if (fb2 >= -1.0f) goto stable;
+        return (fb2 >= -1.0f);
     }
     else    /* real roots */
     {
             /* check that the parabola 1 - fb1 x - fb2 x^2 has a
                 vertex between -1 and 1, and that it's nonnegative
                 at both ends, which implies both roots are in [1-,1]. */
-        if (fb1 <= 2.0f && fb1 >= -2.0f &&
-            1.0f - fb1 -fb2 >= 0 && 1.0f + fb1 - fb2 >= 0)
-                goto stable;
+        return (fb1 <= 2.0f && fb1 >= -2.0f &&
+            1.0f - fb1 -fb2 >= 0 && 1.0f + fb1 - fb2 >= 0);
     }
+}
+
+static void sigbiquad_list(t_sigbiquad *x, t_symbol *s, int argc, t_atom *argv)
+{
+    t_float fb1 = atom_getfloatarg(0, argc, argv);
+    t_float fb2 = atom_getfloatarg(1, argc, argv);
+    t_float ff1 = atom_getfloatarg(2, argc, argv);
+    t_float ff2 = atom_getfloatarg(3, argc, argv);
+    t_float ff3 = atom_getfloatarg(4, argc, argv);
+    t_biquadctl *c = &x->x_cspace;
         /* if unstable, just bash to zero */
-    fb1 = fb2 = ff1 = ff2 = ff3 = 0;
-stable:
+    if (!sigbiquad_stable(fb1, fb2))
+        fb1 = fb2 = ff1 = ff2 = ff3 = 0;
     c->c_fb1 = fb1;
     c->c_fb2 = fb2;
     c->c_ff1 = ff1;
@@ -483,6 +580,369 @@ void sigbiquad_setup(void)
         A_GIMME, 0);
 }
 
+/* ---------------- filterbank~ - many biquads at once ----------------- */
+
+/* "filterbank~ n" runs n biquad~ filters ("bands") on a signal, or on the
+channels of a multichannel one, and outputs an n-channel signal, or with
+"-sum", the sum of the bands.  A band's recursion can't be vectorized over
+time, so instead four bands are computed at once, one per vector lane. */
+
+typedef struct _filterbankgroup
+{
+    t_sample g_fb1[4];
+    t_sample g_fb2[4];
+    t_sample g_ff1[4];
+    t_sample g_ff2[4];
+    t_sample g_ff3[4];
+    t_sample g_x1[4];
+    t_sample g_x2[4];
+} t_filterbankgroup;
+
+typedef struct _filterbank
+{
+    t_object x_obj;
+    t_float x_f;
+    int x_nbands;
+    int x_sum;                      /* output the sum of the bands */
+    t_filterbankgroup *x_groups;    /* (nbands+3)/4 of them */
+    t_symbol *x_arrayname;          /* array to get coefficients from */
+    t_sample *x_scratch;            /* one block, for the sum or unused lanes */
+    int x_scratchsize;
+    t_sample *x_copy;               /* copy of an input we can't work in */
+    int x_copysize;
+} t_filterbank;
+
+static t_class *filterbank_class;
+
+    /* set one band's coefficients, in the order biquad~ takes them */
+static void filterbank_setband(t_filterbank *x, int band, t_float fb1,
+    t_float fb2, t_float ff1, t_float ff2, t_float ff3)
+{
+    t_filterbankgroup *g;
+    int lane = band & 3;
+    if (band < 0 || band >= x->x_nbands)
+        return;
+    g = x->x_groups + (band >> 2);
+    if (!sigbiquad_stable(fb1, fb2))
+        fb1 = fb2 = ff1 = ff2 = ff3 = 0;
+    g->g_fb1[lane] = fb1;
+    g->g_fb2[lane] = fb2;
+    g->g_ff1[lane] = ff1;
+    g->g_ff2[lane] = ff2;
+    g->g_ff3[lane] = ff3;
+}
+
+    /* one step of four biquads: "r" goes in and comes out filtered.  The
+    state and coefficients are in variables ending in "j". */
+#define FILTERBANK_STEP(r, j) { \
+    t_v4 w = V4_ADD(V4_ADD(r, V4_MUL(fb1##j, x1##j)), V4_MUL(fb2##j, x2##j)); \
+    r = V4_ADD(V4_ADD(V4_MUL(ff1##j, w), V4_MUL(ff2##j, x1##j)), \
+        V4_MUL(ff3##j, x2##j)); \
+    x2##j = x1##j; \
+    x1##j = w; }
+
+#define FILTERBANK_LOAD(g, j) \
+    t_v4 fb1##j = V4_LOAD((g)->g_fb1), fb2##j = V4_LOAD((g)->g_fb2), \
+        ff1##j = V4_LOAD((g)->g_ff1), ff2##j = V4_LOAD((g)->g_ff2), \
+        ff3##j = V4_LOAD((g)->g_ff3), x1##j = V4_LOAD((g)->g_x1), \
+        x2##j = V4_LOAD((g)->g_x2)
+
+    /* transpose four samples of four bands so that each vector holds one
+    sample of all four, filter, and transpose back */
+#define FILTERBANK_TILE(row, i, r0, r1, r2, r3, j) { \
+    r0 = V4_LOAD(row[0] + i); \
+    r1 = V4_LOAD(row[1] + i); \
+    r2 = V4_LOAD(row[2] + i); \
+    r3 = V4_LOAD(row[3] + i); \
+    V4_TRANSPOSE(r0, r1, r2, r3); \
+    FILTERBANK_STEP(r0, j); \
+    FILTERBANK_STEP(r1, j); \
+    FILTERBANK_STEP(r2, j); \
+    FILTERBANK_STEP(r3, j); \
+    V4_TRANSPOSE(r0, r1, r2, r3); }
+
+#define FILTERBANK_OUT(row, sum, i, r0, r1, r2, r3) { \
+    if (sum) \
+        V4_STORE(sum + i, V4_ADD(V4_LOAD(sum + i), \
+            V4_ADD(V4_ADD(r0, r1), V4_ADD(r2, r3)))); \
+    else \
+    { \
+        V4_STORE(row[0] + i, r0); \
+        V4_STORE(row[1] + i, r1); \
+        V4_STORE(row[2] + i, r2); \
+        V4_STORE(row[3] + i, r3); \
+    } }
+
+static void filterbank_flush(t_filterbankgroup *g)
+{
+    int k;
+    for (k = 0; k < 4; k++)
+    {
+        if (PD_BIGORSMALL(g->g_x1[k]))
+            g->g_x1[k] = 0;
+        if (PD_BIGORSMALL(g->g_x2[k]))
+            g->g_x2[k] = 0;
+    }
+}
+
+#ifdef PD_SIMD
+    /* two groups at once (eight rows), so that their recursions overlap */
+static void filterbank_rungroup2(t_filterbankgroup *g, t_sample **inrow,
+    t_sample **outrow, t_sample *sum, int n)
+{
+    int i;
+    FILTERBANK_LOAD(g, a);
+    FILTERBANK_LOAD(g + 1, b);
+    for (i = 0; i < n; i += 4)
+    {
+        t_v4 r0, r1, r2, r3, s0, s1, s2, s3;
+        FILTERBANK_TILE(inrow, i, r0, r1, r2, r3, a);
+        FILTERBANK_TILE((inrow + 4), i, s0, s1, s2, s3, b);
+        FILTERBANK_OUT(outrow, sum, i, r0, r1, r2, r3);
+        FILTERBANK_OUT((outrow + 4), sum, i, s0, s1, s2, s3);
+    }
+    V4_STORE(g->g_x1, x1a);
+    V4_STORE(g->g_x2, x2a);
+    V4_STORE(g[1].g_x1, x1b);
+    V4_STORE(g[1].g_x2, x2b);
+    filterbank_flush(g);
+    filterbank_flush(g + 1);
+}
+#endif
+
+    /* run one group of four bands over a block.  Lane k reads inrow[k] and
+    writes outrow[k], or if "sum" isn't zero all lanes are added into that. */
+static void filterbank_rungroup(t_filterbankgroup *g, t_sample **inrow,
+    t_sample **outrow, t_sample *sum, int nlanes, int n)
+{
+    int i, k;
+#ifdef PD_SIMD
+    if (!(n & 3))
+    {
+            /* unused lanes have zero coefficients and so output zeros */
+        FILTERBANK_LOAD(g, a);
+        for (i = 0; i < n; i += 4)
+        {
+            t_v4 r0, r1, r2, r3;
+            FILTERBANK_TILE(inrow, i, r0, r1, r2, r3, a);
+            FILTERBANK_OUT(outrow, sum, i, r0, r1, r2, r3);
+        }
+        V4_STORE(g->g_x1, x1a);
+        V4_STORE(g->g_x2, x2a);
+    }
+    else
+#endif
+    for (k = 0; k < nlanes; k++)
+    {
+        t_sample *in = inrow[k], *out = outrow[k];
+        t_sample last = g->g_x1[k], prev = g->g_x2[k];
+        t_sample fb1 = g->g_fb1[k], fb2 = g->g_fb2[k], ff1 = g->g_ff1[k],
+            ff2 = g->g_ff2[k], ff3 = g->g_ff3[k];
+        for (i = 0; i < n; i++)
+        {
+            t_sample output = in[i] + fb1 * last + fb2 * prev;
+            t_sample f = ff1 * output + ff2 * last + ff3 * prev;
+            if (sum)
+                sum[i] += f;
+            else out[i] = f;
+            prev = last;
+            last = output;
+        }
+        g->g_x1[k] = last;
+        g->g_x2[k] = prev;
+    }
+    filterbank_flush(g);
+}
+
+static t_int *filterbank_perform(t_int *w)
+{
+    t_filterbank *x = (t_filterbank *)(w[1]);
+    t_sample *in = (t_sample *)(w[2]);
+    t_sample *out = (t_sample *)(w[3]);
+    int nin = (int)(w[4]), n = (int)(w[5]), band, k,
+        nbands = x->x_nbands;
+    t_sample *inrow[8], *outrow[8], *sum = (x->x_sum ? x->x_scratch : 0);
+    if (sum)
+        memset(sum, 0, n * sizeof(t_sample));
+    for (band = 0; band < nbands; )
+    {
+            /* channels of the input are repeated if there are fewer than
+            bands; lanes past the last band get dummy rows */
+        for (k = 0; k < 8; k++)
+        {
+            if (band + k < nbands)
+            {
+                inrow[k] = in + ((band + k) % nin) * n;
+                outrow[k] = out + (band + k) * n;
+            }
+            else inrow[k] = in, outrow[k] = x->x_scratch;
+        }
+#ifdef PD_SIMD
+        if (nbands - band > 4 && !(n & 3))
+        {
+            filterbank_rungroup2(x->x_groups + (band >> 2), inrow, outrow,
+                sum, n);
+            band += 8;
+            continue;
+        }
+#endif
+        filterbank_rungroup(x->x_groups + (band >> 2), inrow, outrow, sum,
+            (nbands - band < 4 ? nbands - band : 4), n);
+        band += 4;
+    }
+    if (sum)
+        memcpy(out, sum, n * sizeof(t_sample));
+    return (w+6);
+}
+
+static void filterbank_readarray(t_filterbank *x)
+{
+    t_garray *a;
+    int npoints, band;
+    t_word *vec;
+    if (!(a = (t_garray *)pd_findbyclass(x->x_arrayname, garray_class)))
+        pd_error(x, "filterbank~: %s: no such array", x->x_arrayname->s_name);
+    else if (!garray_getfloatwords_readonly(a, &npoints, &vec))
+        pd_error(x, "%s: bad template for filterbank~",
+            x->x_arrayname->s_name);
+    else for (band = 0; band < x->x_nbands && 5 * band + 4 < npoints; band++)
+        filterbank_setband(x, band, vec[5*band].w_float,
+            vec[5*band+1].w_float, vec[5*band+2].w_float,
+                vec[5*band+3].w_float, vec[5*band+4].w_float);
+}
+
+static void filterbank_dsp(t_filterbank *x, t_signal **sp)
+{
+    int n = sp[0]->s_n, nin = sp[0]->s_nchans;
+    t_sample *in = sp[0]->s_vec, *out;
+    signal_setmultiout(&sp[1], (x->x_sum ? 1 : x->x_nbands));
+    out = sp[1]->s_vec;
+    if (n > x->x_scratchsize)
+    {
+        x->x_scratch = (t_sample *)resizebytes(x->x_scratch,
+            x->x_scratchsize * sizeof(t_sample), n * sizeof(t_sample));
+        x->x_scratchsize = n;
+    }
+        /* bands are written one group at a time, so unless each reads the
+        channel it writes, the output can't overwrite the input */
+    if (!x->x_sum && nin != x->x_nbands && in < out + x->x_nbands * n &&
+        out < in + nin * n)
+    {
+        if (nin * n > x->x_copysize)
+        {
+            x->x_copy = (t_sample *)resizebytes(x->x_copy,
+                x->x_copysize * sizeof(t_sample), nin * n * sizeof(t_sample));
+            x->x_copysize = nin * n;
+        }
+        dsp_add_copy(in, x->x_copy, nin * n);
+        in = x->x_copy;
+    }
+    if (*x->x_arrayname->s_name)
+        filterbank_readarray(x);
+    dsp_add(filterbank_perform, 5, x, in, out, (t_int)nin, (t_int)n);
+}
+
+    /* a list of coefficients for the first bands, five per band */
+static void filterbank_list(t_filterbank *x, t_symbol *s, int argc,
+    t_atom *argv)
+{
+    int band;
+    for (band = 0; band < x->x_nbands && 5 * band < argc; band++)
+        filterbank_setband(x, band, atom_getfloatarg(5*band, argc, argv),
+            atom_getfloatarg(5*band+1, argc, argv),
+            atom_getfloatarg(5*band+2, argc, argv),
+            atom_getfloatarg(5*band+3, argc, argv),
+            atom_getfloatarg(5*band+4, argc, argv));
+}
+
+    /* "band n fb1 fb2 ff1 ff2 ff3" sets one band */
+static void filterbank_band(t_filterbank *x, t_symbol *s, int argc,
+    t_atom *argv)
+{
+    int band = atom_getfloatarg(0, argc, argv);
+    if (band < 0 || band >= x->x_nbands)
+    {
+        pd_error(x, "filterbank~: band %d out of range", band);
+        return;
+    }
+    filterbank_setband(x, band, atom_getfloatarg(1, argc, argv),
+        atom_getfloatarg(2, argc, argv), atom_getfloatarg(3, argc, argv),
+        atom_getfloatarg(4, argc, argv), atom_getfloatarg(5, argc, argv));
+}
+
+    /* get coefficients from an array, now and whenever DSP starts */
+static void filterbank_array(t_filterbank *x, t_symbol *s)
+{
+    x->x_arrayname = s;
+    if (*s->s_name)
+        filterbank_readarray(x);
+}
+
+static void filterbank_clear(t_filterbank *x)
+{
+    int i, k;
+    for (i = 0; i < (x->x_nbands + 3) >> 2; i++)
+        for (k = 0; k < 4; k++)
+            x->x_groups[i].g_x1[k] = x->x_groups[i].g_x2[k] = 0;
+}
+
+static void *filterbank_new(t_symbol *s, int argc, t_atom *argv)
+{
+    t_filterbank *x = (t_filterbank *)pd_new(filterbank_class);
+    int nbands, ngroups;
+    x->x_sum = 0;
+    while (argc && argv->a_type == A_SYMBOL &&
+        *argv->a_w.w_symbol->s_name == '-')
+    {
+        if (!strcmp(argv->a_w.w_symbol->s_name, "-sum"))
+            x->x_sum = 1;
+        else pd_error(x, "filterbank~: %s: unknown flag",
+            argv->a_w.w_symbol->s_name);
+        argc--; argv++;
+    }
+    nbands = atom_getfloatarg(0, argc, argv);
+    if (nbands < 1)
+        nbands = 1;
+    x->x_nbands = nbands;
+    ngroups = (nbands + 3) >> 2;
+    x->x_groups = (t_filterbankgroup *)getbytes(
+        ngroups * sizeof(t_filterbankgroup));
+    x->x_arrayname = atom_getsymbolarg(1, argc, argv);
+    x->x_scratch = x->x_copy = 0;
+    x->x_scratchsize = x->x_copysize = 0;
+    outlet_new(&x->x_obj, &s_signal);
+    x->x_f = 0;
+    return (x);
+}
+
+static void filterbank_free(t_filterbank *x)
+{
+    freebytes(x->x_groups,
+        ((x->x_nbands + 3) >> 2) * sizeof(t_filterbankgroup));
+    if (x->x_scratch)
+        freebytes(x->x_scratch, x->x_scratchsize * sizeof(t_sample));
+    if (x->x_copy)
+        freebytes(x->x_copy, x->x_copysize * sizeof(t_sample));
+}
+
+void filterbank_setup(void)
+{
+    filterbank_class = class_new(gensym("filterbank~"),
+        (t_newmethod)filterbank_new, (t_method)filterbank_free,
+            sizeof(t_filterbank), 0, A_GIMME, 0);
+    CLASS_MAINSIGNALIN(filterbank_class, t_filterbank, x_f);
+    class_setmultichannel(filterbank_class);
+    class_addmethod(filterbank_class, (t_method)filterbank_dsp,
+        gensym("dsp"), A_CANT, 0);
+    class_addlist(filterbank_class, filterbank_list);
+    class_addmethod(filterbank_class, (t_method)filterbank_band,
+        gensym("band"), A_GIMME, 0);
+    class_addmethod(filterbank_class, (t_method)filterbank_array,
+        gensym("array"), A_DEFSYM, 0);
+    class_addmethod(filterbank_class, (t_method)filterbank_clear,
+        gensym("clear"), 0);
+}
+
 /* ---------------- samphold~ - sample and hold  ----------------- */
 
 typedef struct sigsamphold
@@ -1169,6 +1629,7 @@ void d_filter_setup(void)
     siglop_setup();
     sigbp_setup();
     sigbiquad_setup();
+    filterbank_setup();
     sigsamphold_setup();
     sigrpole_setup();
     sigrzero_setup();
@@ -2,10 +2,14 @@
 * For information on usage and redistribution, and for a DISCLAIMER OF ALL
 * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
 
-/*  send~, receive~, throw~, catch~ */
+/*  send~, receive~, throw~, catch~, and xsend~, xreceive~, xsend and
+xreceive between Pd instances */
 
 #include "m_pd.h"
+#include "m_imp.h"
+#include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 #define DEFSENDVS 64    /* LATER get send to get this from canvas */
 
@@ -25,6 +29,7 @@ static void *sigsend_new(t_symbol *s)
 {
     t_sigsend *x = (t_sigsend *)pd_new(sigsend_class);
     pd_bind(&x->x_obj.ob_pd, s);
+    canvas_update_dsp();    /* so that receive~ objects find us */
     x->x_sym = s;
     x->x_n = DEFSENDVS;
     x->x_vec = (t_sample *)getbytes(DEFSENDVS * sizeof(t_sample));
@@ -202,6 +207,7 @@ static void *sigcatch_new(t_symbol *s)
 {
     t_sigcatch *x = (t_sigcatch *)pd_new(sigcatch_class);
     pd_bind(&x->x_obj.ob_pd, s);
+    canvas_update_dsp();    /* so that throw~ objects find us */
     x->x_sym = s;
     x->x_n = DEFSENDVS;
     x->x_vec = (t_sample *)getbytes(DEFSENDVS * sizeof(t_sample));
@@ -272,6 +278,7 @@ typedef struct _sigthrow
     t_symbol *x_sym;
     t_sample *x_whereto;
     int x_n;
+    int x_insection;    /* adding into a partial sum in a parallel section */
     t_float x_f;
 } t_sigthrow;
 
@@ -281,6 +288,7 @@ static void *sigthrow_new(t_symbol *s)
     x->x_sym = s;
     x->x_whereto  = 0;
     x->x_n = DEFSENDVS;
+    x->x_insection = 0;
     x->x_f = 0;
     return (x);
 }
@@ -303,21 +311,31 @@ static t_int *sigthrow_perform(t_int *w)
     return (w+4);
 }
 
-static void sigthrow_set(t_sigthrow *x, t_symbol *s)
+static t_sample *sigthrow_find(t_sigthrow *x)
 {
-    t_sigcatch *catcher = (t_sigcatch *)pd_findbyclass((x->x_sym = s),
+    t_sigcatch *catcher = (t_sigcatch *)pd_findbyclass(x->x_sym,
         sigcatch_class);
     if (catcher)
     {
         if (catcher->x_n == x->x_n)
-            x->x_whereto = catcher->x_vec;
-        else
-        {
-            pd_error(x, "throw~ %s: vector size mismatch", x->x_sym->s_name);
-            x->x_whereto = 0;
-        }
+            return (catcher->x_vec);
+        else pd_error(x, "throw~ %s: vector size mismatch", x->x_sym->s_name);
+    }
+    return (0);     /* no match: now no longer considered an error */
+}
+
+static void sigthrow_set(t_sigthrow *x, t_symbol *s)
+{
+    x->x_sym = s;
+        /* in a parallel section we add into a partial sum that belongs to
+        the DSP chain, so let the chain be rebuilt (before the next DSP tick)
+        rather than write to the catch~ from another thread. */
+    if (x->x_insection)
+    {
+        x->x_whereto = 0;
+        canvas_update_dsp();
     }
-    else x->x_whereto = 0;  /* no match: now no longer considered an error */
+    else x->x_whereto = sigthrow_find(x);
 }
 
 static void sigthrow_dsp(t_sigthrow *x, t_signal **sp)
@@ -328,7 +346,10 @@ static void sigthrow_dsp(t_sigthrow *x, t_signal **sp)
     }
     else
     {
-        sigthrow_set(x, x->x_sym);
+        t_sample *vec = sigthrow_find(x);
+        x->x_whereto = (vec ? ugen_getsumbuffer(vec, x->x_n) : 0);
+            /* if there's no catch~ we can't tell, so play safe */
+        x->x_insection = (!vec || x->x_whereto != vec);
         dsp_add(sigthrow_perform, 3,
             x, sp[0]->s_vec, (t_int)sp[0]->s_n);
     }
@@ -345,6 +366,523 @@ static void sigthrow_setup(void)
         gensym("dsp"), A_CANT, 0);
 }
 
+/* -------------------- buses between Pd instances ------------------------ */
+
+/* xsend~ and xreceive~, and xsend and xreceive, connect Pd instances in the
+same process (such as those made with libpd_new_instance()) even when they
+run in different threads, so that a host needn't copy audio out of one
+instance and into another or relay messages itself.  Buses are named by
+strings since each instance has its own symbols, and are shared by the whole
+process.
+
+Audio: one xsend~ per name writes each block into a ring of XBUS_NSLOT
+blocks and then publishes the count of blocks written.  Any number of
+xreceive~ objects read it without locking.  A receiver starts one block
+behind the newest block and then takes one block per DSP tick, so the
+latency stays where it started (one block, if the sender's instance
+computes its tick first); if the sender falls behind, the receiver puts out
+zeros and starts over one block behind; if the receiver falls more than
+XBUS_NSLOT - 2 blocks behind, it skips ahead.
+
+Messages: each xreceive has a queue that it empties once per DSP tick of
+its own instance, without locking.  xsend writes messages into the queues
+of all receivers of its name; senders hold the bus's lock while doing so,
+which only other senders (and objects coming and going) ever wait for.  A
+message that doesn't fit is dropped.  Floats and symbols are passed;
+pointers become zero. */
+
+#if defined(__GNUC__) || defined(__clang__)
+#define XBUS_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define XBUS_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#elif defined(_MSC_VER)
+#include <windows.h>
+static unsigned long xbus_loadacquire(unsigned long *p)
+{
+    unsigned long v = *(volatile unsigned long *)p;
+    MemoryBarrier();
+    return (v);
+}
+#define XBUS_LOAD(p) xbus_loadacquire(p)
+#define XBUS_STORE(p, v) (MemoryBarrier(), *(volatile unsigned long *)(p) = (v))
+#else
+#define XBUS_LOAD(p) (*(volatile unsigned long *)(p))
+#define XBUS_STORE(p, v) (*(volatile unsigned long *)(p) = (v))
+#endif
+
+#define XBUS_NSLOT 8            /* blocks of audio in the ring */
+#define XBUS_MAXVEC 8192        /* largest block size */
+#define XBUS_QUEUESIZE 65536    /* bytes in a message queue, power of 2 */
+#define XBUS_CACHELINE 64
+
+typedef struct _xqueue
+{
+    struct _xqueue *q_next;
+    unsigned long q_write;      /* bytes written, by senders */
+    char q_pad1[XBUS_CACHELINE - sizeof(unsigned long)];
+    unsigned long q_read;       /* bytes read, by the receiver */
+    char q_pad2[XBUS_CACHELINE - sizeof(unsigned long)];
+    char q_buf[XBUS_QUEUESIZE];
+} t_xqueue;
+
+typedef struct _xbus
+{
+    struct _xbus *b_next;
+    char *b_name;
+    int b_refcount;
+    pthread_mutex_t b_lock;     /* for sending messages and b_queues */
+    t_xqueue *b_queues;         /* queues of message receivers */
+    void *b_writer;             /* the xsend~, if any */
+    t_sample *b_slots;          /* audio ring, or 0 if not used yet */
+    int b_slotn[XBUS_NSLOT];    /* number of points in each block */
+    unsigned long b_written;    /* number of blocks written */
+} t_xbus;
+
+    /* the buses are shared by all instances so they are allocated with
+    malloc() rather than charged to one instance's memory */
+static pthread_mutex_t xbus_listlock = PTHREAD_MUTEX_INITIALIZER;
+static t_xbus *xbus_list;
+
+static t_xbus *xbus_get(const char *name, int audio)
+{
+    t_xbus *b;
+    pthread_mutex_lock(&xbus_listlock);
+    for (b = xbus_list; b; b = b->b_next)
+        if (!strcmp(b->b_name, name))
+            break;
+    if (!b && (b = (t_xbus *)calloc(1, sizeof(*b))))
+    {
+        if (!(b->b_name = strdup(name)))
+        {
+            free(b);
+            b = 0;
+        }
+        else
+        {
+            pthread_mutex_init(&b->b_lock, 0);
+            b->b_next = xbus_list;
+            xbus_list = b;
+        }
+    }
+        /* the audio ring is made once and kept till the bus goes away */
+    if (b && audio && !b->b_slots && !(b->b_slots = (t_sample *)calloc(
+        XBUS_NSLOT * XBUS_MAXVEC, sizeof(t_sample))))
+            b = 0;
+    if (b)
+        b->b_refcount++;
+    pthread_mutex_unlock(&xbus_listlock);
+    return (b);
+}
+
+static void xbus_release(t_xbus *b)
+{
+    t_xbus **bp;
+    pthread_mutex_lock(&xbus_listlock);
+    if (!--b->b_refcount)
+    {
+        for (bp = &xbus_list; *bp; bp = &(*bp)->b_next)
+            if (*bp == b)
+        {
+            *bp = b->b_next;
+            break;
+        }
+        pthread_mutex_destroy(&b->b_lock);
+        if (b->b_slots)
+            free(b->b_slots);
+        free(b->b_name);
+        free(b);
+    }
+    pthread_mutex_unlock(&xbus_listlock);
+}
+
+/* ----------------------------- xsend~ ----------------------------- */
+static t_class *xsigsend_class;
+
+typedef struct _xsigsend
+{
+    t_object x_obj;
+    t_symbol *x_sym;
+    t_xbus *x_bus;
+    int x_writing;      /* true if we're the bus's writer */
+    t_float x_f;
+} t_xsigsend;
+
+static void *xsigsend_new(t_symbol *s)
+{
+    t_xsigsend *x;
+    t_xbus *bus;
+    if (!(bus = xbus_get(s->s_name, 1)))
+    {
+        pd_error(0, "xsend~ %s: out of memory", s->s_name);
+        return (0);
+    }
+    x = (t_xsigsend *)pd_new(xsigsend_class);
+    x->x_sym = s;
+    x->x_bus = bus;
+    x->x_f = 0;
+    pthread_mutex_lock(&xbus_listlock);
+    if ((x->x_writing = !bus->b_writer))
+        bus->b_writer = x;
+    pthread_mutex_unlock(&xbus_listlock);
+    if (!x->x_writing)
+        pd_error(x, "xsend~ %s: bus already has a sender", s->s_name);
+    return (x);
+}
+
+static t_int *xsigsend_perform(t_int *w)
+{
+    t_xbus *b = (t_xbus *)(w[1]);
+    t_sample *in = (t_sample *)(w[2]);
+    int n = (int)(w[3]);
+    unsigned long written = b->b_written;
+    int slot = written % XBUS_NSLOT;
+    memcpy(b->b_slots + slot * XBUS_MAXVEC, in, n * sizeof(t_sample));
+    b->b_slotn[slot] = n;
+    XBUS_STORE(&b->b_written, written + 1);
+    return (w+4);
+}
+
+static void xsigsend_dsp(t_xsigsend *x, t_signal **sp)
+{
+    if (!x->x_writing)
+        return;
+    if (sp[0]->s_n > XBUS_MAXVEC)
+        pd_error(x, "xsend~ %s: block size %d too big", x->x_sym->s_name,
+            sp[0]->s_n);
+    else dsp_add(xsigsend_perform, 3, x->x_bus, sp[0]->s_vec,
+        (t_int)sp[0]->s_n);
+}
+
+static void xsigsend_free(t_xsigsend *x)
+{
+    if (x->x_writing)
+    {
+        pthread_mutex_lock(&xbus_listlock);
+        x->x_bus->b_writer = 0;
+        pthread_mutex_unlock(&xbus_listlock);
+    }
+    xbus_release(x->x_bus);
+}
+
+static void xsigsend_setup(void)
+{
+    xsigsend_class = class_new(gensym("xsend~"), (t_newmethod)xsigsend_new,
+        (t_method)xsigsend_free, sizeof(t_xsigsend), 0, A_DEFSYM, 0);
+    CLASS_MAINSIGNALIN(xsigsend_class, t_xsigsend, x_f);
+    class_addmethod(xsigsend_class, (t_method)xsigsend_dsp,
+        gensym("dsp"), A_CANT, 0);
+}
+
+/* ----------------------------- xreceive~ ----------------------------- */
+static t_class *xsigreceive_class;
+
+typedef struct _xsigreceive
+{
+    t_object x_obj;
+    t_symbol *x_sym;
+    t_xbus *x_bus;
+    unsigned long x_next;       /* next block to read */
+    int x_sync;                 /* true if x_next is valid */
+} t_xsigreceive;
+
+static void *xsigreceive_new(t_symbol *s)
+{
+    t_xsigreceive *x;
+    t_xbus *bus;
+    if (!(bus = xbus_get(s->s_name, 1)))
+    {
+        pd_error(0, "xreceive~ %s: out of memory", s->s_name);
+        return (0);
+    }
+    x = (t_xsigreceive *)pd_new(xsigreceive_class);
+    x->x_sym = s;
+    x->x_bus = bus;
+    x->x_next = 0;
+    x->x_sync = 0;
+    outlet_new(&x->x_obj, &s_signal);
+    return (x);
+}
+
+static t_int *xsigreceive_perform(t_int *w)
+{
+    t_xsigreceive *x = (t_xsigreceive *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    int n = (int)(w[3]), slot, got;
+    t_xbus *b = x->x_bus;
+    unsigned long written = XBUS_LOAD(&b->b_written);
+    if (!x->x_sync)
+    {
+        if (written < 2)
+            goto zero;
+        x->x_next = written - 2;
+        x->x_sync = 1;
+    }
+        /* the sender hasn't caught up: start over later */
+    if (written - x->x_next - 1 >= XBUS_NSLOT - 1)
+    {
+        if (x->x_next == written)
+            x->x_sync = 0;
+        else x->x_next = written - 2;   /* we fell behind: skip ahead */
+        if (!x->x_sync)
+            goto zero;
+    }
+    slot = x->x_next % XBUS_NSLOT;
+    got = b->b_slotn[slot];
+    if (got > n)
+        got = n;
+    memcpy(out, b->b_slots + slot * XBUS_MAXVEC, got * sizeof(t_sample));
+    if (got < n)
+        memset(out + got, 0, (n - got) * sizeof(t_sample));
+        /* if the sender lapped us while we copied, the block was torn */
+    if (XBUS_LOAD(&b->b_written) - x->x_next > XBUS_NSLOT - 1)
+        x->x_sync = 0;
+    else x->x_next++;
+    return (w+4);
+zero:
+    memset(out, 0, n * sizeof(t_sample));
+    return (w+4);
+}
+
+static void xsigreceive_dsp(t_xsigreceive *x, t_signal **sp)
+{
+    x->x_sync = 0;
+    dsp_add(xsigreceive_perform, 3, x, sp[0]->s_vec, (t_int)sp[0]->s_n);
+}
+
+static void xsigreceive_free(t_xsigreceive *x)
+{
+    xbus_release(x->x_bus);
+}
+
+static void xsigreceive_setup(void)
+{
+    xsigreceive_class = class_new(gensym("xreceive~"),
+        (t_newmethod)xsigreceive_new, (t_method)xsigreceive_free,
+        sizeof(t_xsigreceive), 0, A_DEFSYM, 0);
+    class_addmethod(xsigreceive_class, (t_method)xsigreceive_dsp,
+        gensym("dsp"), A_CANT, 0);
+    class_sethelpsymbol(xsigreceive_class, gensym("xsend~"));
+}
+
+/* ----------------------------- xsend ----------------------------- */
+static t_class *xsend_class;
+
+typedef struct _xsend
+{
+    t_object x_obj;
+    t_symbol *x_sym;
+    t_xbus *x_bus;
+} t_xsend;
+
+static void *xsend_new(t_symbol *s)
+{
+    t_xsend *x;
+    t_xbus *bus;
+    if (!(bus = xbus_get(s->s_name, 0)))
+    {
+        pd_error(0, "xsend %s: out of memory", s->s_name);
+        return (0);
+    }
+    x = (t_xsend *)pd_new(xsend_class);
+    x->x_sym = s;
+    x->x_bus = bus;
+    return (x);
+}
+
+    /* copy bytes into a queue at "where", wrapping around */
+static void xqueue_put(t_xqueue *q, unsigned long where, const void *data,
+    int n)
+{
+    int onset = where & (XBUS_QUEUESIZE - 1),
+        n1 = (onset + n > XBUS_QUEUESIZE ? XBUS_QUEUESIZE - onset : n);
+    memcpy(q->q_buf + onset, data, n1);
+    if (n1 < n)
+        memcpy(q->q_buf, (const char *)data + n1, n - n1);
+}
+
+static void xqueue_get(t_xqueue *q, unsigned long where, void *data, int n)
+{
+    int onset = where & (XBUS_QUEUESIZE - 1),
+        n1 = (onset + n > XBUS_QUEUESIZE ? XBUS_QUEUESIZE - onset : n);
+    memcpy(data, q->q_buf + onset, n1);
+    if (n1 < n)
+        memcpy((char *)data + n1, q->q_buf, n - n1);
+}
+
+    /* a message goes in a queue as its size in bytes, then the selector
+    and each symbol as a null-terminated string preceded by 's' and each
+    float as a t_float preceded by 'f' */
+static void xsend_anything(t_xsend *x, t_symbol *s, int argc, t_atom *argv)
+{
+    int i, size = strlen(s->s_name) + 1, ndropped = 0;
+    char *buf, *bp;
+    t_xqueue *q;
+    for (i = 0; i < argc; i++)
+        size += 1 + (argv[i].a_type == A_SYMBOL ?
+            strlen(argv[i].a_w.w_symbol->s_name) + 1 : sizeof(t_float));
+    if (size + sizeof(int) > XBUS_QUEUESIZE)
+    {
+        pd_error(x, "xsend %s: message too long", x->x_sym->s_name);
+        return;
+    }
+    bp = buf = (char *)getbytes(size);
+    strcpy(bp, s->s_name);
+    bp += strlen(s->s_name) + 1;
+    for (i = 0; i < argc; i++)
+    {
+        if (argv[i].a_type == A_SYMBOL)
+        {
+            *bp++ = 's';
+            strcpy(bp, argv[i].a_w.w_symbol->s_name);
+            bp += strlen(argv[i].a_w.w_symbol->s_name) + 1;
+        }
+        else
+        {
+            t_float f = (argv[i].a_type == A_FLOAT ? argv[i].a_w.w_float : 0);
+            *bp++ = 'f';
+            memcpy(bp, &f, sizeof(f));
+            bp += sizeof(f);
+        }
+    }
+    pthread_mutex_lock(&x->x_bus->b_lock);
+    for (q = x->x_bus->b_queues; q; q = q->q_next)
+    {
+        if (XBUS_QUEUESIZE - (q->q_write - XBUS_LOAD(&q->q_read)) <
+            size + sizeof(int))
+        {
+            ndropped++;
+            continue;
+        }
+        xqueue_put(q, q->q_write, &size, sizeof(int));
+        xqueue_put(q, q->q_write + sizeof(int), buf, size);
+        XBUS_STORE(&q->q_write, q->q_write + sizeof(int) + size);
+    }
+    pthread_mutex_unlock(&x->x_bus->b_lock);
+    freebytes(buf, size);
+    if (ndropped)
+        pd_error(x, "xsend %s: queue full; message dropped",
+            x->x_sym->s_name);
+}
+
+static void xsend_free(t_xsend *x)
+{
+    xbus_release(x->x_bus);
+}
+
+static void xsend_setup(void)
+{
+    xsend_class = class_new(gensym("xsend"), (t_newmethod)xsend_new,
+        (t_method)xsend_free, sizeof(t_xsend), 0, A_DEFSYM, 0);
+    class_addanything(xsend_class, xsend_anything);
+    class_sethelpsymbol(xsend_class, gensym("xsend~"));
+}
+
+/* ----------------------------- xreceive ----------------------------- */
+static t_class *xreceive_class;
+
+typedef struct _xreceive
+{
+    t_object x_obj;
+    t_symbol *x_sym;
+    t_xbus *x_bus;
+    t_xqueue *x_queue;
+    t_clock *x_clock;
+} t_xreceive;
+
+static void xreceive_tick(t_xreceive *x);
+
+static void *xreceive_new(t_symbol *s)
+{
+    t_xreceive *x;
+    t_xbus *bus;
+    t_xqueue *q;
+    if (!(q = (t_xqueue *)calloc(1, sizeof(*q))))
+        bus = 0;
+    else if (!(bus = xbus_get(s->s_name, 0)))
+        free(q);
+    if (!bus)
+    {
+        pd_error(0, "xreceive %s: out of memory", s->s_name);
+        return (0);
+    }
+    x = (t_xreceive *)pd_new(xreceive_class);
+    x->x_sym = s;
+    x->x_bus = bus;
+    x->x_queue = q;
+    pthread_mutex_lock(&bus->b_lock);
+    q->q_next = bus->b_queues;
+    bus->b_queues = q;
+    pthread_mutex_unlock(&bus->b_lock);
+    outlet_new(&x->x_obj, 0);
+        /* check the queue once per DSP tick */
+    x->x_clock = clock_new(x, (t_method)xreceive_tick);
+    clock_setunit(x->x_clock, 1, 1);
+    clock_delay(x->x_clock, sys_getblksize());
+    return (x);
+}
+
+static void xreceive_tick(t_xreceive *x)
+{
+    t_xqueue *q = x->x_queue;
+    unsigned long written = XBUS_LOAD(&q->q_write);
+    clock_delay(x->x_clock, sys_getblksize());
+    while (q->q_read != written)
+    {
+        int size, argc = 0, i;
+        char *buf, *bp, *sel;
+        t_atom *argv;
+        xqueue_get(q, q->q_read, &size, sizeof(int));
+        buf = (char *)getbytes(size);
+        xqueue_get(q, q->q_read + sizeof(int), buf, size);
+        XBUS_STORE(&q->q_read, q->q_read + sizeof(int) + size);
+        sel = buf;
+        for (bp = buf + strlen(buf) + 1; bp < buf + size; argc++)
+            bp += (*bp == 's' ? strlen(bp + 1) + 2 : 1 + sizeof(t_float));
+        argv = (t_atom *)getbytes(argc * sizeof(t_atom));
+        for (bp = buf + strlen(buf) + 1, i = 0; i < argc; i++)
+        {
+            if (*bp == 's')
+            {
+                SETSYMBOL(&argv[i], gensym(bp + 1));
+                bp += strlen(bp + 1) + 2;
+            }
+            else
+            {
+                t_float f;
+                memcpy(&f, bp + 1, sizeof(f));
+                SETFLOAT(&argv[i], f);
+                bp += 1 + sizeof(t_float);
+            }
+        }
+        outlet_anything(x->x_obj.ob_outlet, gensym(sel), argc, argv);
+        freebytes(argv, argc * sizeof(t_atom));
+        freebytes(buf, size);
+    }
+}
+
+static void xreceive_free(t_xreceive *x)
+{
+    t_xqueue **qp;
+    clock_free(x->x_clock);
+    pthread_mutex_lock(&x->x_bus->b_lock);
+    for (qp = &x->x_bus->b_queues; *qp; qp = &(*qp)->q_next)
+        if (*qp == x->x_queue)
+    {
+        *qp = x->x_queue->q_next;
+        break;
+    }
+    pthread_mutex_unlock(&x->x_bus->b_lock);
+    free(x->x_queue);
+    xbus_release(x->x_bus);
+}
+
+static void xreceive_setup(void)
+{
+    xreceive_class = class_new(gensym("xreceive"), (t_newmethod)xreceive_new,
+        (t_method)xreceive_free, sizeof(t_xreceive), CLASS_NOINLET,
+            A_DEFSYM, 0);
+    class_sethelpsymbol(xreceive_class, gensym("xsend~"));
+}
+
 /* ----------------------- global setup routine ---------------- */
 
 void d_global_setup(void)
@@ -353,5 +891,9 @@ void d_global_setup(void)
     sigreceive_setup();
     sigcatch_setup();
     sigthrow_setup();
+    xsigsend_setup();
+    xsigreceive_setup();
+    xsend_setup();
+    xreceive_setup();
 }
 
@@ -7,6 +7,9 @@
 */
 
 #include "m_pd.h"
+#include "m_imp.h"
+#include "s_stuff.h"
+#include "d_simd.h"
 #include <math.h>
 #include <limits.h>
 #define LOGTEN 2.302585092994046
@@ -36,23 +39,25 @@ static void *clip_new(t_floatarg lo, t_floatarg hi)
 
 static t_int *clip_perform(t_int *w)
 {
-    t_clip *x = (t_clip *)(w[1]);
-    t_sample *in = (t_sample *)(w[2]);
-    t_sample *out = (t_sample *)(w[3]);
-    int n = (int)(w[4]);
+    t_sample *in = (t_sample *)(w[1]);
+    t_float lo = *(t_float *)(w[2]);
+    t_float hi = *(t_float *)(w[3]);
+    t_sample *out = (t_sample *)(w[4]);
+    int n = (int)(w[5]);
     while (n--)
     {
         t_sample f = *in++;
-        if (f < x->x_lo) f = x->x_lo;
-        if (f > x->x_hi) f = x->x_hi;
+        if (f < lo) f = lo;
+        if (f > hi) f = hi;
         *out++ = f;
     }
-    return (w+5);
+    return (w+6);
 }
 
 static void clip_dsp(t_clip *x, t_signal **sp)
 {
-    dsp_add(clip_perform, 4, x, sp[0]->s_vec, sp[1]->s_vec, (t_int)sp[0]->s_n);
+    dsp_addpointwise(clip_perform, PW_CLIP, sp[0]->s_vec, (t_int)&x->x_lo,
+        (t_int)&x->x_hi, sp[1]->s_vec, sp[0]->s_n);
 }
 
 static void clip_setup(void)
@@ -308,12 +313,46 @@ void sigwrap_setup(void)
         gensym("dsp"), A_CANT, 0);
 }
 
+/* The objects from mtof~ to log~ have a "fast" mode (set by the "fast"
+message, or for all new objects by the "-fastmath" flag) in which they use the
+polynomial approximations from d_simd.h instead of calling libm in double
+precision.  The approximations themselves are good to about 1e-7; what
+remains is the single-precision rounding of the scaled argument, e.g., under
+5e-7 relative error for mtof~ over the MIDI range.  Their structures all begin
+like this one. */
+
+typedef struct _sigmath
+{
+    t_object x_obj;
+    t_float x_f;
+    int x_fast;
+} t_sigmath;
+
+static void sigmath_fast(t_sigmath *x, t_floatarg f)
+{
+    x->x_fast = (f != 0);
+    canvas_update_dsp();
+}
+
+static void sigmath_setup(t_class *c)
+{
+    class_addmethod(c, (t_method)sigmath_fast, gensym("fast"), A_FLOAT, 0);
+}
+
+    /* the conversions in x_acoustics.c, rewritten in base 2 */
+#define MTOF_SCALE (1.f/12.f)
+#define MTOF_OFFSET 3.0313597135246599f     /* log2(440) - 69/12 */
+#define FTOM_OFFSET -36.376316562295918f    /* -12 * MTOF_OFFSET */
+#define DB_LOG2 0.33219280948873623f        /* log2(10) / 10 */
+#define LOG2_DB 3.0102999566398120f         /* 10 / log2(10) */
+
 /* ------------------------------ mtof_tilde~ -------------------------- */
 
 typedef struct mtof_tilde
 {
     t_object x_obj;
     t_float x_f;
+    int x_fast;
 } t_mtof_tilde;
 
 t_class *mtof_tilde_class;
@@ -323,6 +362,7 @@ static void *mtof_tilde_new(void)
     t_mtof_tilde *x = (t_mtof_tilde *)pd_new(mtof_tilde_class);
     outlet_new(&x->x_obj, gensym("signal"));
     x->x_f = 0;
+    x->x_fast = sys_fastmath;
     return (x);
 }
 
@@ -343,9 +383,31 @@ static t_int *mtof_tilde_perform(t_int *w)
     return (w + 4);
 }
 
+static t_int *mtof_tilde_perf_fast(t_int *w)
+{
+    t_sample *in = (t_sample *)w[1], *out = (t_sample *)w[2];
+    int n = (int)w[3];
+#ifdef PD_SIMD
+    for (; n >= 4; n -= 4, in += 4, out += 4)
+    {
+        t_v4 f = V4_LOAD(in);
+        V4_STORE(out, V4_AND(V4_CMPGT(f, V4_SET1(-1500.f)),
+            v4_exp2(V4_ADD(V4_MUL(f, V4_SET1(MTOF_SCALE)),
+                V4_SET1(MTOF_OFFSET)))));
+    }
+#endif
+    for (; n--; in++, out++)
+    {
+        t_sample f = *in;
+        *out = (f <= -1500 ? 0 : fast_exp2(f * MTOF_SCALE + MTOF_OFFSET));
+    }
+    return (w + 4);
+}
+
 static void mtof_tilde_dsp(t_mtof_tilde *x, t_signal **sp)
 {
-    dsp_add(mtof_tilde_perform, 3, sp[0]->s_vec, sp[1]->s_vec, (t_int)sp[0]->s_n);
+    dsp_add((x->x_fast ? mtof_tilde_perf_fast : mtof_tilde_perform), 3,
+        sp[0]->s_vec, sp[1]->s_vec, (t_int)sp[0]->s_n);
 }
 
 void mtof_tilde_setup(void)
@@ -355,6 +417,7 @@ void mtof_tilde_setup(void)
     CLASS_MAINSIGNALIN(mtof_tilde_class, t_mtof_tilde, x_f);
     class_addmethod(mtof_tilde_class, (t_method)mtof_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
+    sigmath_setup(mtof_tilde_class);
 }
 
 /* ------------------------------ ftom_tilde~ -------------------------- */
@@ -363,6 +426,7 @@ typedef struct ftom_tilde
 {
     t_object x_obj;
     t_float x_f;
+    int x_fast;
 } t_ftom_tilde;
 
 t_class *ftom_tilde_class;
@@ -372,6 +436,7 @@ static void *ftom_tilde_new(void)
     t_ftom_tilde *x = (t_ftom_tilde *)pd_new(ftom_tilde_class);
     outlet_new(&x->x_obj, gensym("signal"));
     x->x_f = 0;
+    x->x_fast = sys_fastmath;
     return (x);
 }
 
@@ -387,9 +452,31 @@ static t_int *ftom_tilde_perform(t_int *w)
     return (w + 4);
 }
 
+static t_int *ftom_tilde_perf_fast(t_int *w)
+{
+    t_sample *in = (t_sample *)w[1], *out = (t_sample *)w[2];
+    int n = (int)w[3];
+#ifdef PD_SIMD
+    for (; n >= 4; n -= 4, in += 4, out += 4)
+    {
+        t_v4 f = V4_LOAD(in);
+        V4_STORE(out, V4_SELECT(V4_CMPGT(f, V4_ZERO()),
+            V4_ADD(V4_MUL(v4_log2(f), V4_SET1(12.f)), V4_SET1(FTOM_OFFSET)),
+                V4_SET1(-1500.f)));
+    }
+#endif
+    for (; n--; in++, out++)
+    {
+        t_sample f = *in;
+        *out = (f > 0 ? 12.f * fast_log2(f) + FTOM_OFFSET : -1500);
+    }
+    return (w + 4);
+}
+
 static void ftom_tilde_dsp(t_ftom_tilde *x, t_signal **sp)
 {
-    dsp_add(ftom_tilde_perform, 3, sp[0]->s_vec, sp[1]->s_vec, (t_int)sp[0]->s_n);
+    dsp_add((x->x_fast ? ftom_tilde_perf_fast : ftom_tilde_perform), 3,
+        sp[0]->s_vec, sp[1]->s_vec, (t_int)sp[0]->s_n);
 }
 
 void ftom_tilde_setup(void)
@@ -399,6 +486,7 @@ void ftom_tilde_setup(void)
     CLASS_MAINSIGNALIN(ftom_tilde_class, t_ftom_tilde, x_f);
     class_addmethod(ftom_tilde_class, (t_method)ftom_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
+    sigmath_setup(ftom_tilde_class);
 }
 
 /* ------------------------------ dbtorms~ -------------------------- */
@@ -407,6 +495,7 @@ typedef struct dbtorms_tilde
 {
     t_object x_obj;
     t_float x_f;
+    int x_fast;
 } t_dbtorms_tilde;
 
 t_class *dbtorms_tilde_class;
@@ -416,6 +505,7 @@ static void *dbtorms_tilde_new(void)
     t_dbtorms_tilde *x = (t_dbtorms_tilde *)pd_new(dbtorms_tilde_class);
     outlet_new(&x->x_obj, gensym("signal"));
     x->x_f = 0;
+    x->x_fast = sys_fastmath;
     return (x);
 }
 
@@ -437,9 +527,32 @@ static t_int *dbtorms_tilde_perform(t_int *w)
     return (w + 4);
 }
 
+static t_int *dbtorms_tilde_perf_fast(t_int *w)
+{
+    t_sample *in = (t_sample *)w[1], *out = (t_sample *)w[2];
+    int n = (int)w[3];
+#ifdef PD_SIMD
+    for (; n >= 4; n -= 4, in += 4, out += 4)
+    {
+        t_v4 f = V4_LOAD(in);
+        V4_STORE(out, V4_AND(V4_CMPGT(f, V4_ZERO()),
+            v4_exp2(V4_MUL(V4_SUB(V4_MIN(f, V4_SET1(485.f)),
+                V4_SET1(100.f)), V4_SET1(0.5f * DB_LOG2)))));
+    }
+#endif
+    for (; n--; in++, out++)
+    {
+        t_sample f = *in;
+        *out = (f <= 0 ? 0 :
+            fast_exp2((0.5f * DB_LOG2) * ((f > 485 ? 485 : f) - 100)));
+    }
+    return (w + 4);
+}
+
 static void dbtorms_tilde_dsp(t_dbtorms_tilde *x, t_signal **sp)
 {
-    dsp_add(dbtorms_tilde_perform, 3, sp[0]->s_vec, sp[1]->s_vec, (t_int)sp[0]->s_n);
+    dsp_add((x->x_fast ? dbtorms_tilde_perf_fast : dbtorms_tilde_perform), 3,
+        sp[0]->s_vec, sp[1]->s_vec, (t_int)sp[0]->s_n);
 }
 
 void dbtorms_tilde_setup(void)
@@ -449,6 +562,7 @@ void dbtorms_tilde_setup(void)
     CLASS_MAINSIGNALIN(dbtorms_tilde_class, t_dbtorms_tilde, x_f);
     class_addmethod(dbtorms_tilde_class, (t_method)dbtorms_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
+    sigmath_setup(dbtorms_tilde_class);
 }
 
 /* ------------------------------ rmstodb~ -------------------------- */
@@ -457,6 +571,7 @@ typedef struct rmstodb_tilde
 {
     t_object x_obj;
     t_float x_f;
+    int x_fast;
 } t_rmstodb_tilde;
 
 t_class *rmstodb_tilde_class;
@@ -466,6 +581,7 @@ static void *rmstodb_tilde_new(void)
     t_rmstodb_tilde *x = (t_rmstodb_tilde *)pd_new(rmstodb_tilde_class);
     outlet_new(&x->x_obj, gensym("signal"));
     x->x_f = 0;
+    x->x_fast = sys_fastmath;
     return (x);
 }
 
@@ -486,9 +602,32 @@ static t_int *rmstodb_tilde_perform(t_int *w)
     return (w + 4);
 }
 
+static t_int *rmstodb_tilde_perf_fast(t_int *w)
+{
+    t_sample *in = (t_sample *)w[1], *out = (t_sample *)w[2];
+    int n = (int)w[3];
+#ifdef PD_SIMD
+    for (; n >= 4; n -= 4, in += 4, out += 4)
+    {
+        t_v4 f = V4_LOAD(in);
+            /* nonpositive inputs come out of v4_log2() as -126 */
+        V4_STORE(out, V4_MAX(V4_ADD(V4_MUL(v4_log2(f),
+            V4_SET1(2.f * LOG2_DB)), V4_SET1(100.f)), V4_ZERO()));
+    }
+#endif
+    for (; n--; in++, out++)
+    {
+        t_sample f = *in;
+        t_sample g = 100 + (2.f * LOG2_DB) * fast_log2(f);
+        *out = (g < 0 ? 0 : g);
+    }
+    return (w + 4);
+}
+
 static void rmstodb_tilde_dsp(t_rmstodb_tilde *x, t_signal **sp)
 {
-    dsp_add(rmstodb_tilde_perform, 3, sp[0]->s_vec, sp[1]->s_vec, (t_int)sp[0]->s_n);
+    dsp_add((x->x_fast ? rmstodb_tilde_perf_fast : rmstodb_tilde_perform), 3,
+        sp[0]->s_vec, sp[1]->s_vec, (t_int)sp[0]->s_n);
 }
 
 void rmstodb_tilde_setup(void)
@@ -498,6 +637,7 @@ void rmstodb_tilde_setup(void)
     CLASS_MAINSIGNALIN(rmstodb_tilde_class, t_rmstodb_tilde, x_f);
     class_addmethod(rmstodb_tilde_class, (t_method)rmstodb_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
+    sigmath_setup(rmstodb_tilde_class);
 }
 
 /* ------------------------------ dbtopow~ -------------------------- */
@@ -506,6 +646,7 @@ typedef struct dbtopow_tilde
 {
     t_object x_obj;
     t_float x_f;
+    int x_fast;
 } t_dbtopow_tilde;
 
 t_class *dbtopow_tilde_class;
@@ -515,6 +656,7 @@ static void *dbtopow_tilde_new(void)
     t_dbtopow_tilde *x = (t_dbtopow_tilde *)pd_new(dbtopow_tilde_class);
     outlet_new(&x->x_obj, gensym("signal"));
     x->x_f = 0;
+    x->x_fast = sys_fastmath;
     return (x);
 }
 
@@ -536,9 +678,32 @@ static t_int *dbtopow_tilde_perform(t_int *w)
     return (w + 4);
 }
 
+static t_int *dbtopow_tilde_perf_fast(t_int *w)
+{
+    t_sample *in = (t_sample *)w[1], *out = (t_sample *)w[2];
+    int n = (int)w[3];
+#ifdef PD_SIMD
+    for (; n >= 4; n -= 4, in += 4, out += 4)
+    {
+        t_v4 f = V4_LOAD(in);
+        V4_STORE(out, V4_AND(V4_CMPGT(f, V4_ZERO()),
+            v4_exp2(V4_MUL(V4_SUB(V4_MIN(f, V4_SET1(870.f)),
+                V4_SET1(100.f)), V4_SET1(DB_LOG2)))));
+    }
+#endif
+    for (; n--; in++, out++)
+    {
+        t_sample f = *in;
+        *out = (f <= 0 ? 0 :
+            fast_exp2(DB_LOG2 * ((f > 870 ? 870 : f) - 100)));
+    }
+    return (w + 4);
+}
+
 static void dbtopow_tilde_dsp(t_dbtopow_tilde *x, t_signal **sp)
 {
-    dsp_add(dbtopow_tilde_perform, 3, sp[0]->s_vec, sp[1]->s_vec, (t_int)sp[0]->s_n);
+    dsp_add((x->x_fast ? dbtopow_tilde_perf_fast : dbtopow_tilde_perform), 3,
+        sp[0]->s_vec, sp[1]->s_vec, (t_int)sp[0]->s_n);
 }
 
 void dbtopow_tilde_setup(void)
@@ -548,6 +713,7 @@ void dbtopow_tilde_setup(void)
     CLASS_MAINSIGNALIN(dbtopow_tilde_class, t_dbtopow_tilde, x_f);
     class_addmethod(dbtopow_tilde_class, (t_method)dbtopow_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
+    sigmath_setup(dbtopow_tilde_class);
 }
 
 /* ------------------------------ powtodb~ -------------------------- */
@@ -556,6 +722,7 @@ typedef struct powtodb_tilde
 {
     t_object x_obj;
     t_float x_f;
+    int x_fast;
 } t_powtodb_tilde;
 
 t_class *powtodb_tilde_class;
@@ -565,6 +732,7 @@ static void *powtodb_tilde_new(void)
     t_powtodb_tilde *x = (t_powtodb_tilde *)pd_new(powtodb_tilde_class);
     outlet_new(&x->x_obj, gensym("signal"));
     x->x_f = 0;
+    x->x_fast = sys_fastmath;
     return (x);
 }
 
@@ -585,9 +753,31 @@ static t_int *powtodb_tilde_perform(t_int *w)
     return (w + 4);
 }
 
+static t_int *powtodb_tilde_perf_fast(t_int *w)
+{
+    t_sample *in = (t_sample *)w[1], *out = (t_sample *)w[2];
+    int n = (int)w[3];
+#ifdef PD_SIMD
+    for (; n >= 4; n -= 4, in += 4, out += 4)
+    {
+        t_v4 f = V4_LOAD(in);
+        V4_STORE(out, V4_MAX(V4_ADD(V4_MUL(v4_log2(f),
+            V4_SET1(LOG2_DB)), V4_SET1(100.f)), V4_ZERO()));
+    }
+#endif
+    for (; n--; in++, out++)
+    {
+        t_sample f = *in;
+        t_sample g = 100 + LOG2_DB * fast_log2(f);
+        *out = (g < 0 ? 0 : g);
+    }
+    return (w + 4);
+}
+
 static void powtodb_tilde_dsp(t_powtodb_tilde *x, t_signal **sp)
 {
-    dsp_add(powtodb_tilde_perform, 3, sp[0]->s_vec, sp[1]->s_vec, (t_int)sp[0]->s_n);
+    dsp_add((x->x_fast ? powtodb_tilde_perf_fast : powtodb_tilde_perform), 3,
+        sp[0]->s_vec, sp[1]->s_vec, (t_int)sp[0]->s_n);
 }
 
 void powtodb_tilde_setup(void)
@@ -597,6 +787,7 @@ void powtodb_tilde_setup(void)
     CLASS_MAINSIGNALIN(powtodb_tilde_class, t_powtodb_tilde, x_f);
     class_addmethod(powtodb_tilde_class, (t_method)powtodb_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
+    sigmath_setup(powtodb_tilde_class);
 }
 
 /* ----------------------------- pow ----------------------------- */
@@ -606,6 +797,7 @@ typedef struct _pow_tilde
 {
     t_object x_obj;
     t_float x_f;
+    int x_fast;
 } t_pow_tilde;
 
 static void *pow_tilde_new(t_floatarg f)
@@ -614,7 +806,7 @@ static void *pow_tilde_new(t_floatarg f)
     signalinlet_new(&x->x_obj, f);
     outlet_new(&x->x_obj, &s_signal);
     x->x_f = 0;
-
+    x->x_fast = sys_fastmath;
     return (x);
 }
 
@@ -634,9 +826,34 @@ t_int *pow_tilde_perform(t_int *w)
     return (w+5);
 }
 
+static t_int *pow_tilde_perf_fast(t_int *w)
+{
+    t_sample *in1 = (t_sample *)(w[1]);
+    t_sample *in2 = (t_sample *)(w[2]);
+    t_sample *out = (t_sample *)(w[3]);
+    int n = (int)(w[4]);
+    while (n--)
+    {
+        t_sample f1 = *in1++, f2 = *in2++;
+        if (f1 > 0)
+            *out = fast_exp2(f2 * fast_log2(f1));
+        else if (f1 == 0)
+            *out = (f2 == 0);
+        else if (f2 - (int)f2 != 0)
+            *out = 0;
+        else
+        {
+            t_sample g = fast_exp2(f2 * fast_log2(-f1));
+            *out = ((int)f2 & 1 ? -g : g);
+        }
+        out++;
+    }
+    return (w+5);
+}
+
 static void pow_tilde_dsp(t_pow_tilde *x, t_signal **sp)
 {
-    dsp_add(pow_tilde_perform, 4,
+    dsp_add((x->x_fast ? pow_tilde_perf_fast : pow_tilde_perform), 4,
         sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, (t_int)sp[0]->s_n);
 }
 
@@ -647,6 +864,7 @@ static void pow_tilde_setup(void)
     CLASS_MAINSIGNALIN(pow_tilde_class, t_pow_tilde, x_f);
     class_addmethod(pow_tilde_class, (t_method)pow_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
+    sigmath_setup(pow_tilde_class);
 }
 
 /* ----------------------------- exp ----------------------------- */
@@ -656,12 +874,14 @@ typedef struct _exp_tilde
 {
     t_object x_obj;
     t_float x_f;
+    int x_fast;
 } t_exp_tilde;
 
 static void *exp_tilde_new(void)
 {
     t_exp_tilde *x = (t_exp_tilde *)pd_new(exp_tilde_class);
     outlet_new(&x->x_obj, &s_signal);
+    x->x_fast = sys_fastmath;
     return (x);
 }
 
@@ -675,9 +895,23 @@ t_int *exp_tilde_perform(t_int *w)
     return (w+4);
 }
 
+static t_int *exp_tilde_perf_fast(t_int *w)
+{
+    t_sample *in1 = (t_sample *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    int n = (int)(w[3]);
+#ifdef PD_SIMD
+    for (; n >= 4; n -= 4, in1 += 4, out += 4)
+        V4_STORE(out, v4_exp2(V4_MUL(V4_LOAD(in1), V4_SET1(1.44269504f))));
+#endif
+    while (n--)
+        *out++ = fast_exp2(1.44269504f * *in1++);
+    return (w+4);
+}
+
 static void exp_tilde_dsp(t_exp_tilde *x, t_signal **sp)
 {
-    dsp_add(exp_tilde_perform, 3,
+    dsp_add((x->x_fast ? exp_tilde_perf_fast : exp_tilde_perform), 3,
         sp[0]->s_vec, sp[1]->s_vec, (t_int)sp[0]->s_n);
 }
 
@@ -688,6 +922,7 @@ static void exp_tilde_setup(void)
     CLASS_MAINSIGNALIN(exp_tilde_class, t_exp_tilde, x_f);
     class_addmethod(exp_tilde_class, (t_method)exp_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
+    sigmath_setup(exp_tilde_class);
 }
 
 /* ----------------------------- log ----------------------------- */
@@ -697,6 +932,7 @@ typedef struct _log_tilde
 {
     t_object x_obj;
     t_float x_f;
+    int x_fast;
 } t_log_tilde;
 
 static void *log_tilde_new(t_floatarg f)
@@ -706,6 +942,7 @@ static void *log_tilde_new(t_floatarg f)
         (t_pd *)inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal), f);
     outlet_new(&x->x_obj, &s_signal);
     x->x_f = 0;
+    x->x_fast = sys_fastmath;
     return (x);
 }
 
@@ -728,9 +965,28 @@ t_int *log_tilde_perform(t_int *w)
     return (w+5);
 }
 
+static t_int *log_tilde_perf_fast(t_int *w)
+{
+    t_sample *in1 = (t_sample *)(w[1]);
+    t_sample *in2 = (t_sample *)(w[2]);
+    t_sample *out = (t_sample *)(w[3]);
+    int n = (int)(w[4]);
+    while (n--)
+    {
+        t_sample f = *in1++, g = *in2++;
+        if (f <= 0)
+            *out = -1000;
+        else if (g <= 0)
+            *out = 0.69314718f * fast_log2(f);
+        else *out = fast_log2(f)/fast_log2(g);
+        out++;
+    }
+    return (w+5);
+}
+
 static void log_tilde_dsp(t_log_tilde *x, t_signal **sp)
 {
-    dsp_add(log_tilde_perform, 4,
+    dsp_add((x->x_fast ? log_tilde_perf_fast : log_tilde_perform), 4,
         sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, (t_int)sp[0]->s_n);
 }
 
@@ -741,6 +997,7 @@ static void log_tilde_setup(void)
     CLASS_MAINSIGNALIN(log_tilde_class, t_log_tilde, x_f);
     class_addmethod(log_tilde_class, (t_method)log_tilde_dsp,
         gensym("dsp"), A_CANT, 0);
+    sigmath_setup(log_tilde_class);
 }
 
 /* ----------------------------- abs ----------------------------- */
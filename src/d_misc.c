@@ -2,7 +2,7 @@
 * For information on usage and redistribution, and for a DISCLAIMER OF ALL
 * WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
 
-/*  miscellaneous: print~; more to come.
+/*  miscellaneous: print~, bang~, snake~.
 */
 
 #include "m_pd.h"
@@ -122,6 +122,86 @@ static void bang_tilde_setup(void)
         gensym("dsp"), 0);
 }
 
+/* ------------------------ snake~ -------------------------- */
+
+/* "snake~ in n" combines n signals into one n-channel signal, and
+"snake~ out n" splits the channels of one back out. */
+
+static t_class *snake_in_class, *snake_out_class;
+
+typedef struct _snake
+{
+    t_object x_obj;
+    t_float x_f;
+    int x_nchans;
+} t_snake;
+
+static void snake_in_dsp(t_snake *x, t_signal **sp)
+{
+    int i, n = sp[0]->s_n;
+    t_signal **out = sp + x->x_nchans;
+    signal_setmultiout(out, x->x_nchans);
+        /* go backward: if the output shares its buffer with a multichannel
+        input, that one's first channel is then read before it's written
+        over by channel 0. */
+    for (i = x->x_nchans; i--; )
+        dsp_add_copy(sp[i]->s_vec, (*out)->s_vec + i * n, n);
+}
+
+static void snake_out_dsp(t_snake *x, t_signal **sp)
+{
+    int i, n = sp[0]->s_n;
+    for (i = 0; i < x->x_nchans; i++)
+    {
+        if (i < sp[0]->s_nchans)
+            dsp_add_copy(sp[0]->s_vec + i * n, sp[i+1]->s_vec, n);
+        else dsp_add_zero(sp[i+1]->s_vec, n);
+    }
+}
+
+static void *snake_new(t_symbol *s, int argc, t_atom *argv)
+{
+    t_snake *x;
+    t_symbol *dir = atom_getsymbolarg(0, argc, argv);
+    int i, nchans = (argc > 1 ? atom_getfloatarg(1, argc, argv) : 2);
+    if (nchans < 1)
+        nchans = 1;
+    if (dir == gensym("out"))
+    {
+        x = (t_snake *)pd_new(snake_out_class);
+        for (i = 0; i < nchans; i++)
+            outlet_new(&x->x_obj, &s_signal);
+    }
+    else
+    {
+        if (*dir->s_name && dir != gensym("in"))
+        {
+            pd_error(0, "snake~ %s: expected 'in' or 'out'", dir->s_name);
+            return (0);
+        }
+        x = (t_snake *)pd_new(snake_in_class);
+        for (i = 1; i < nchans; i++)
+            inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
+        outlet_new(&x->x_obj, &s_signal);
+    }
+    x->x_nchans = nchans;
+    x->x_f = 0;
+    return (x);
+}
+
+static void snake_setup(void)
+{
+    snake_in_class = class_new(gensym("snake~"), (t_newmethod)snake_new, 0,
+        sizeof(t_snake), 0, A_GIMME, 0);
+    CLASS_MAINSIGNALIN(snake_in_class, t_snake, x_f);
+    class_addmethod(snake_in_class, (t_method)snake_in_dsp,
+        gensym("dsp"), A_CANT, 0);
+    snake_out_class = class_new(gensym("snake~"), 0, 0,
+        sizeof(t_snake), 0, 0);
+    CLASS_MAINSIGNALIN(snake_out_class, t_snake, x_f);
+    class_addmethod(snake_out_class, (t_method)snake_out_dsp,
+        gensym("dsp"), A_CANT, 0);
+}
 
 /* ------------------------ global setup routine ------------------------- */
 
@@ -129,6 +209,7 @@ void d_misc_setup(void)
 {
     print_setup();
     bang_tilde_setup();
+    snake_setup();
 }
 
 
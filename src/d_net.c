@@ -0,0 +1,668 @@
+/* Copyright (c) 1997-1999 Miller Puckette.
+* For information on usage and redistribution, and for a DISCLAIMER OF ALL
+* WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+/*  netsend~ and netreceive~: audio over UDP between Pd instances.
+
+Each DSP block netsend~ sends one datagram: a 16-byte header and the block's
+samples, interleaved and big-endian:
+
+    'P' 'd' '~' version
+    channels(8) bytes per sample(8) frames(16)
+    sequence number(32)
+    sender's sample rate(32)
+
+Samples are 16 or 24 bit integers or 32-bit floats.  netreceive~ keeps the
+datagrams in a ring of slots indexed by sequence number and starts playing
+once it has buffered enough to ride out the jitter it has measured in their
+arrival times (as in RTP.)  It reads the ring through a linear interpolator
+whose speed is the ratio of the sample rates, nudged up or down to keep the
+buffer at its target, which takes care of the two machines' clocks
+drifting apart.  A datagram that hasn't arrived by the time it's needed is
+replaced by the one before it at half the amplitude, so that a lost packet
+makes a dip instead of a click, and a run of them fades out. */
+
+#include "m_pd.h"
+#include "s_stuff.h"
+#include "s_net.h"
+#include <string.h>
+#include <math.h>
+
+#define NETAUDIO_VERSION 1
+#define NETAUDIO_HEADER 16
+#define NETAUDIO_NSLOTS 256         /* datagrams in netreceive~'s ring */
+#define NETAUDIO_TIMEOUT 2          /* seconds of silence that end a stream */
+#define NETAUDIO_MAXDRIFT 0.005     /* most we'll speed up or slow down */
+
+static void netaudio_put32(unsigned char *p, uint32_t n)
+{
+    p[0] = n >> 24;
+    p[1] = n >> 16;
+    p[2] = n >> 8;
+    p[3] = n;
+}
+
+static uint32_t netaudio_get32(const unsigned char *p)
+{
+    return (((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+        ((uint32_t)p[2] << 8) | p[3]);
+}
+
+/* ----------------------------- netsend~ --------------------------- */
+
+static t_class *netsend_tilde_class;
+
+typedef struct _netsend_tilde
+{
+    t_object x_obj;
+    t_float x_f;
+    int x_nchans;
+    int x_bytes;                /* bytes per sample: 2, 3 or 4 (float) */
+    t_sample **x_invec;
+    int x_n;                    /* block size */
+    t_float x_sr;
+    int x_fd;
+    struct sockaddr_storage x_addr;
+    socklen_t x_addrlen;
+    uint32_t x_seq;
+    unsigned char *x_buf;
+    int x_bufsize;
+    int x_senderror;            /* already complained about sendto() */
+} t_netsend_tilde;
+
+static void netsend_tilde_disconnect(t_netsend_tilde *x)
+{
+    if (x->x_fd >= 0)
+    {
+        sys_closesocket(x->x_fd);
+        x->x_fd = -1;
+        outlet_float(x->x_obj.ob_outlet, 0);
+    }
+}
+
+static void netsend_tilde_connect(t_netsend_tilde *x, t_symbol *host,
+    t_floatarg fport)
+{
+    struct addrinfo *ailist = NULL, *ai;
+    int fd = -1, status, port = fport;
+    netsend_tilde_disconnect(x);
+    if (port <= 0)
+    {
+        pd_error(x, "netsend~: bad port number %d", port);
+        return;
+    }
+    if ((status = addrinfo_get_list(&ailist, host->s_name, port, SOCK_DGRAM)))
+    {
+        pd_error(x, "netsend~: bad host or port? %s (%d)",
+            gai_strerror(status), status);
+        return;
+    }
+    addrinfo_sort_list(&ailist, addrinfo_ipv4_first);
+    for (ai = ailist; ai; ai = ai->ai_next)
+    {
+        if ((fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0)
+            continue;
+        if (ai->ai_family == AF_INET)
+            socket_set_boolopt(fd, SOL_SOCKET, SO_BROADCAST, 1);
+        socket_set_nonblocking(fd, 1);
+        memcpy(&x->x_addr, ai->ai_addr, ai->ai_addrlen);
+        x->x_addrlen = (socklen_t)ai->ai_addrlen;
+        break;
+    }
+    freeaddrinfo(ailist);
+    if (fd < 0)
+    {
+        sys_sockerror("netsend~: socket");
+        return;
+    }
+    x->x_fd = fd;
+    x->x_senderror = 0;
+    outlet_float(x->x_obj.ob_outlet, 1);
+}
+
+static void netsend_tilde_format(t_netsend_tilde *x, t_floatarg f)
+{
+    int bits = f;
+    if (bits != 16 && bits != 24 && bits != 32)
+    {
+        pd_error(x, "netsend~: format %d: use 16, 24 or 32 (float)", bits);
+        return;
+    }
+    x->x_bytes = bits / 8;
+}
+
+static t_int *netsend_tilde_perform(t_int *w)
+{
+    t_netsend_tilde *x = (t_netsend_tilde *)(w[1]);
+    int n = (int)(w[2]), nchans = x->x_nchans, bytes = x->x_bytes, i, j;
+    unsigned char *bp = x->x_buf;
+    if (x->x_fd < 0)
+        return (w+3);
+    bp[0] = 'P'; bp[1] = 'd'; bp[2] = '~'; bp[3] = NETAUDIO_VERSION;
+    bp[4] = nchans;
+    bp[5] = bytes;
+    bp[6] = n >> 8;
+    bp[7] = n;
+    netaudio_put32(bp + 8, x->x_seq++);
+    netaudio_put32(bp + 12, (uint32_t)x->x_sr);
+    bp += NETAUDIO_HEADER;
+    for (i = 0; i < n; i++)
+        for (j = 0; j < nchans; j++, bp += bytes)
+    {
+        t_sample f = x->x_invec[j][i];
+        int32_t k;
+        if (bytes == 4)
+        {
+            union
+            {
+                float z_f;
+                uint32_t z_i;
+            } z;
+            z.z_f = f;
+            netaudio_put32(bp, z.z_i);
+            continue;
+        }
+        if (f > 1)
+            f = 1;
+        else if (f < -1)
+            f = -1;
+        if (bytes == 2)
+        {
+            k = (int32_t)(f * 32767.f + (f >= 0 ? 0.5f : -0.5f));
+            bp[0] = k >> 8;
+            bp[1] = k;
+        }
+        else
+        {
+            k = (int32_t)(f * 8388607.f + (f >= 0 ? 0.5f : -0.5f));
+            bp[0] = k >> 16;
+            bp[1] = k >> 8;
+            bp[2] = k;
+        }
+    }
+    if (sendto(x->x_fd, (char *)x->x_buf, (int)(bp - x->x_buf), 0,
+        (struct sockaddr *)&x->x_addr, x->x_addrlen) < 0)
+    {
+        if (!x->x_senderror)
+            sys_sockerror("netsend~: send");
+        x->x_senderror = 1;
+    }
+    else x->x_senderror = 0;
+    return (w+3);
+}
+
+static void netsend_tilde_dsp(t_netsend_tilde *x, t_signal **sp)
+{
+    int i, n = sp[0]->s_n, size = NETAUDIO_HEADER + n * x->x_nchans * 4;
+    if (size > NET_MAXPACKETSIZE - 1 || n > 65535)
+    {
+        pd_error(x, "netsend~: %d channels of %d samples won't fit in a "
+            "datagram", x->x_nchans, n);
+        return;
+    }
+    if (size > x->x_bufsize)
+    {
+        x->x_buf = (unsigned char *)resizebytes(x->x_buf, x->x_bufsize, size);
+        x->x_bufsize = size;
+    }
+    for (i = 0; i < x->x_nchans; i++)
+        x->x_invec[i] = sp[i]->s_vec;
+    x->x_n = n;
+    x->x_sr = sp[0]->s_sr;
+    dsp_add(netsend_tilde_perform, 2, x, (t_int)n);
+}
+
+static void *netsend_tilde_new(t_symbol *s, int argc, t_atom *argv)
+{
+    t_netsend_tilde *x = (t_netsend_tilde *)pd_new(netsend_tilde_class);
+    int i;
+    x->x_bytes = 2;
+    while (argc && argv->a_type == A_SYMBOL &&
+        *argv->a_w.w_symbol->s_name == '-')
+    {
+        if (!strcmp(argv->a_w.w_symbol->s_name, "-b") && argc > 1)
+        {
+            netsend_tilde_format(x, atom_getfloat(argv + 1));
+            argc--, argv++;
+        }
+        else
+        {
+            pd_error(x, "netsend~: unknown flag ...");
+            postatom(argc, argv); endpost();
+        }
+        argc--, argv++;
+    }
+    x->x_nchans = (argc ? atom_getfloat(argv) : 1);
+    if (x->x_nchans < 1)
+        x->x_nchans = 1;
+    else if (x->x_nchans > 255)
+        x->x_nchans = 255;
+    x->x_invec = (t_sample **)getbytes(x->x_nchans * sizeof(t_sample *));
+    for (i = 1; i < x->x_nchans; i++)
+        inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_signal, &s_signal);
+    outlet_new(&x->x_obj, &s_float);
+    x->x_fd = -1;
+    return (x);
+}
+
+static void netsend_tilde_free(t_netsend_tilde *x)
+{
+    if (x->x_fd >= 0)
+        sys_closesocket(x->x_fd);
+    freebytes(x->x_invec, x->x_nchans * sizeof(t_sample *));
+    if (x->x_buf)
+        freebytes(x->x_buf, x->x_bufsize);
+}
+
+static void netsend_tilde_setup(void)
+{
+    netsend_tilde_class = class_new(gensym("netsend~"),
+        (t_newmethod)netsend_tilde_new, (t_method)netsend_tilde_free,
+        sizeof(t_netsend_tilde), 0, A_GIMME, 0);
+    CLASS_MAINSIGNALIN(netsend_tilde_class, t_netsend_tilde, x_f);
+    class_addmethod(netsend_tilde_class, (t_method)netsend_tilde_dsp,
+        gensym("dsp"), A_CANT, 0);
+    class_addmethod(netsend_tilde_class, (t_method)netsend_tilde_connect,
+        gensym("connect"), A_SYMBOL, A_FLOAT, 0);
+    class_addmethod(netsend_tilde_class, (t_method)netsend_tilde_disconnect,
+        gensym("disconnect"), 0);
+    class_addmethod(netsend_tilde_class, (t_method)netsend_tilde_format,
+        gensym("format"), A_FLOAT, 0);
+}
+
+/* ----------------------------- netreceive~ --------------------------- */
+
+static t_class *netreceive_tilde_class;
+
+typedef struct _netreceive_tilde
+{
+    t_object x_obj;
+    t_outlet *x_statout;
+    t_clock *x_clock;           /* to report starting and stopping */
+    int x_nchans;
+    t_sample **x_outvec;
+    t_float x_sr;
+    int x_fd;
+    t_float x_minbuf;           /* least buffering in msec, 0 for auto */
+        /* the incoming stream */
+    int x_frames;               /* frames per datagram */
+    int x_streamchans;
+    int x_bytes;
+    t_float x_streamsr;
+    t_sample *x_data;           /* NETAUDIO_NSLOTS datagrams of x_nchans */
+    int *x_slotblock;           /* which block each slot holds, or -1 */
+    uint32_t x_baseseq;         /* sequence number of block 0 */
+    int x_active;               /* receiving a stream */
+    int x_playing;              /* ...and buffered enough to play it */
+    int x_reported;             /* x_playing as last output */
+    int x_maxblock;             /* newest block received */
+    double x_readpos;           /* in frames from the start of block 0 */
+    double x_fill;              /* average frames buffered ahead of it */
+    double x_extra;             /* more buffering after underruns */
+    double x_speed;             /* current drift correction */
+    double x_jitter;            /* in seconds, as in RFC 3550 */
+    double x_lastarrival;
+    int x_lastblock;
+    int x_idle;                 /* frames output since the last datagram */
+        /* counts for "status" */
+    int x_nlost;
+    int x_nlate;
+    int x_nunderrun;
+} t_netreceive_tilde;
+
+static void netreceive_tilde_reset(t_netreceive_tilde *x)
+{
+    int i;
+    x->x_active = x->x_playing = 0;
+    x->x_readpos = x->x_fill = x->x_extra = x->x_jitter = 0;
+    x->x_speed = 0;
+    x->x_idle = 0;
+    if (x->x_slotblock)
+        for (i = 0; i < NETAUDIO_NSLOTS; i++)
+            x->x_slotblock[i] = -1;
+}
+
+static void netreceive_tilde_tick(t_netreceive_tilde *x)
+{
+    if (x->x_playing != x->x_reported)
+        outlet_float(x->x_statout, (x->x_reported = x->x_playing));
+}
+
+    /* frames to keep buffered ahead of the read point */
+static double netreceive_tilde_target(t_netreceive_tilde *x)
+{
+    double target = x->x_frames + 4 * x->x_jitter * x->x_sr + x->x_extra +
+        DEFDACBLKSIZE, most = (NETAUDIO_NSLOTS / 2) * x->x_frames;
+    if (target < x->x_minbuf * 0.001 * x->x_sr)
+        target = x->x_minbuf * 0.001 * x->x_sr;
+    return (target < most ? target : most);
+}
+
+    /* (re)allocate the ring for a stream of a new shape */
+static void netreceive_tilde_shape(t_netreceive_tilde *x, int frames,
+    int streamchans, int bytes, t_float sr)
+{
+    if (x->x_data)
+    {
+        freebytes(x->x_data,
+            NETAUDIO_NSLOTS * x->x_frames * x->x_nchans * sizeof(t_sample));
+        freebytes(x->x_slotblock, NETAUDIO_NSLOTS * sizeof(int));
+    }
+    x->x_frames = frames;
+    x->x_streamchans = streamchans;
+    x->x_bytes = bytes;
+    x->x_streamsr = sr;
+    x->x_data = (t_sample *)getbytes(
+        NETAUDIO_NSLOTS * frames * x->x_nchans * sizeof(t_sample));
+    x->x_slotblock = (int *)getbytes(NETAUDIO_NSLOTS * sizeof(int));
+    netreceive_tilde_reset(x);
+}
+
+static void netreceive_tilde_datagram(t_netreceive_tilde *x,
+    const unsigned char *bp, int len, double now)
+{
+    int streamchans = bp[4], bytes = bp[5], frames = (bp[6] << 8) | bp[7];
+    uint32_t seq = netaudio_get32(bp + 8);
+    t_float sr = netaudio_get32(bp + 12);
+    int block, i, j, nchans = x->x_nchans;
+    t_sample *fp;
+    if (len < NETAUDIO_HEADER || bp[0] != 'P' || bp[1] != 'd' ||
+        bp[2] != '~' || bp[3] != NETAUDIO_VERSION ||
+        (bytes != 2 && bytes != 3 && bytes != 4) || !frames || !streamchans ||
+        sr <= 0 || len != NETAUDIO_HEADER + frames * streamchans * bytes)
+            return;
+    if (frames != x->x_frames || streamchans != x->x_streamchans ||
+        bytes != x->x_bytes || sr != x->x_streamsr)
+            netreceive_tilde_shape(x, frames, streamchans, bytes, sr);
+    if (!x->x_active)
+    {
+        x->x_active = 1;
+        x->x_baseseq = seq;
+        x->x_maxblock = x->x_lastblock = 0;
+        x->x_lastarrival = now;
+    }
+    block = (int32_t)(seq - x->x_baseseq);
+    if (block < (int)(x->x_readpos / frames) || (block < 0))
+    {
+        x->x_nlate++;
+        return;
+    }
+    if (block >= (int)(x->x_readpos / frames) + NETAUDIO_NSLOTS)
+    {
+            /* too far ahead (the sender restarted, say): start over */
+        netreceive_tilde_reset(x);
+        netreceive_tilde_datagram(x, bp, len, now);
+        return;
+    }
+    x->x_idle = 0;
+        /* interarrival jitter, counting from the previous datagram */
+    x->x_jitter += (fabs((now - x->x_lastarrival) -
+        (block - x->x_lastblock) * frames / sr) - x->x_jitter) * (1./16.);
+    x->x_lastarrival = now;
+    x->x_lastblock = block;
+    if (block > x->x_maxblock)
+        x->x_maxblock = block;
+    x->x_slotblock[block & (NETAUDIO_NSLOTS-1)] = block;
+    fp = x->x_data + (block & (NETAUDIO_NSLOTS-1)) * frames * nchans;
+    for (i = 0, bp += NETAUDIO_HEADER; i < frames; i++)
+        for (j = 0; j < streamchans; j++, bp += bytes)
+    {
+        t_sample f;
+        if (bytes == 4)
+        {
+            union
+            {
+                float z_f;
+                uint32_t z_i;
+            } z;
+            z.z_i = netaudio_get32(bp);
+            f = (PD_BIGORSMALL(z.z_f) ? 0 : z.z_f);
+        }
+        else if (bytes == 2)
+            f = (int16_t)((bp[0] << 8) | bp[1]) * (1.f / 32768.f);
+        else f = ((int32_t)(((uint32_t)bp[0] << 24) | (bp[1] << 16) |
+            (bp[2] << 8)) >> 8) * (1.f / 8388608.f);
+        if (j < nchans)
+            fp[i * nchans + j] = f;
+    }
+    for (i = 0; i < frames; i++)
+        for (j = streamchans; j < nchans; j++)
+            fp[i * nchans + j] = 0;
+    if (!x->x_playing &&
+        (x->x_maxblock + 1) * frames >= netreceive_tilde_target(x))
+    {
+        x->x_playing = 1;
+        x->x_readpos = (x->x_maxblock + 1) * frames -
+            netreceive_tilde_target(x);
+        x->x_fill = netreceive_tilde_target(x);
+        clock_delay(x->x_clock, 0);
+    }
+}
+
+static void netreceive_tilde_read(t_netreceive_tilde *x, int fd)
+{
+    t_datagram *d = 0;
+    int n, i, more;
+    double now = sys_getrealtime();
+    do
+    {
+        if ((n = sys_recvbatch(fd, &d, &more)) < 0)
+        {
+            if (socket_errno_udp())
+                sys_sockerror("netreceive~: recv");
+            return;
+        }
+        for (i = 0; i < n; i++)
+            netreceive_tilde_datagram(x, d[i].d_buf, d[i].d_len, now);
+        sys_recvbatchdone(d);
+    } while (more);
+}
+
+    /* get a frame of the stream, filling in a datagram that never came
+    from the one before it, at half the amplitude */
+static t_sample *netreceive_tilde_frame(t_netreceive_tilde *x, int index)
+{
+    int frames = x->x_frames, block = index / frames,
+        slot = block & (NETAUDIO_NSLOTS-1), size = frames * x->x_nchans, i;
+    t_sample *fp = x->x_data + slot * size;
+    if (x->x_slotblock[slot] != block)
+    {
+        int prevslot = (block - 1) & (NETAUDIO_NSLOTS-1);
+        t_sample *prev = x->x_data + prevslot * size;
+        if (block > x->x_maxblock)
+        {
+                /* ran out: buffer more from now on */
+            x->x_nunderrun++;
+            x->x_extra += frames;
+        }
+        else x->x_nlost++;
+        if (x->x_slotblock[prevslot] == block - 1)
+            for (i = 0; i < size; i++)
+                fp[i] = 0.5f * prev[i];
+        else memset(fp, 0, size * sizeof(t_sample));
+        x->x_slotblock[slot] = block;
+    }
+    return (fp + (index - block * frames) * x->x_nchans);
+}
+
+static t_int *netreceive_tilde_perform(t_int *w)
+{
+    t_netreceive_tilde *x = (t_netreceive_tilde *)(w[1]);
+    int n = (int)(w[2]), nchans = x->x_nchans, i, j;
+    double pos = x->x_readpos, speed, target, error;
+    if (!x->x_playing)
+    {
+        for (j = 0; j < nchans; j++)
+            memset(x->x_outvec[j], 0, n * sizeof(t_sample));
+        return (w+3);
+    }
+    if ((x->x_idle += n) > NETAUDIO_TIMEOUT * x->x_sr)
+    {
+        netreceive_tilde_reset(x);
+        clock_delay(x->x_clock, 0);
+        return (w+3);
+    }
+    speed = (x->x_streamsr / x->x_sr) * (1 + x->x_speed);
+    for (i = 0; i < n; i++, pos += speed)
+    {
+        int index = (int)pos;
+        t_sample frac = pos - index, *a = netreceive_tilde_frame(x, index),
+            *b = netreceive_tilde_frame(x, index + 1);
+        for (j = 0; j < nchans; j++)
+            x->x_outvec[j][i] = a[j] + frac * (b[j] - a[j]);
+    }
+    x->x_readpos = pos;
+        /* steer the buffer toward its target by reading a bit faster or
+        slower; the clocks' drift ends up absorbed in x_speed */
+    target = netreceive_tilde_target(x);
+    x->x_fill += 0.01 * ((x->x_maxblock + 1) * x->x_frames - pos - x->x_fill);
+    error = (x->x_fill - target) / target;
+    x->x_speed = (error > 1 ? 1 : (error < -1 ? -1 : error)) *
+        NETAUDIO_MAXDRIFT;
+    x->x_extra *= 0.9999;
+    if (pos < 0 || (x->x_maxblock + 1) * x->x_frames - pos >
+        (NETAUDIO_NSLOTS - 2) * x->x_frames)
+    {
+            /* hopelessly far behind or ahead: jump */
+        x->x_readpos = (x->x_maxblock + 1) * x->x_frames - target;
+        x->x_fill = target;
+    }
+    return (w+3);
+}
+
+static void netreceive_tilde_dsp(t_netreceive_tilde *x, t_signal **sp)
+{
+    int i;
+    for (i = 0; i < x->x_nchans; i++)
+        x->x_outvec[i] = sp[i]->s_vec;
+    x->x_sr = sp[0]->s_sr;
+    dsp_add(netreceive_tilde_perform, 2, x, (t_int)sp[0]->s_n);
+}
+
+static void netreceive_tilde_close(t_netreceive_tilde *x)
+{
+    if (x->x_fd >= 0)
+    {
+        sys_rmpollfn(x->x_fd);
+        sys_closesocket(x->x_fd);
+        x->x_fd = -1;
+    }
+    netreceive_tilde_reset(x);
+    netreceive_tilde_tick(x);
+}
+
+static void netreceive_tilde_listen(t_netreceive_tilde *x, t_floatarg fport)
+{
+    struct addrinfo *ailist = NULL, *ai;
+    int fd = -1, status, port = fport;
+    netreceive_tilde_close(x);
+    if (port <= 0)
+        return;
+    if ((status = addrinfo_get_list(&ailist, NULL, port, SOCK_DGRAM)))
+    {
+        pd_error(x, "netreceive~: bad port? %s (%d)",
+            gai_strerror(status), status);
+        return;
+    }
+        /* prefer a dual-stack IPv6 socket, as netreceive does */
+    addrinfo_sort_list(&ailist, addrinfo_ipv6_first);
+    for (ai = ailist; ai; ai = ai->ai_next)
+    {
+        if ((fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0)
+            continue;
+        socket_set_boolopt(fd, SOL_SOCKET, SO_REUSEADDR, 1);
+        if ((ai->ai_family == AF_INET6 &&
+            socket_set_boolopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, 0) < 0) ||
+                bind(fd, ai->ai_addr, ai->ai_addrlen) < 0)
+        {
+            sys_closesocket(fd);
+            fd = -1;
+            continue;
+        }
+        break;
+    }
+    freeaddrinfo(ailist);
+    if (fd < 0)
+    {
+        sys_sockerror("netreceive~: listen");
+        return;
+    }
+    x->x_fd = fd;
+    sys_addpollfn(fd, (t_fdpollfn)netreceive_tilde_read, x);
+}
+
+    /* least buffering in msec; 0 to go by measured jitter alone */
+static void netreceive_tilde_buffer(t_netreceive_tilde *x, t_floatarg f)
+{
+    x->x_minbuf = (f > 0 ? f : 0);
+}
+
+static void netreceive_tilde_status(t_netreceive_tilde *x)
+{
+    t_atom at[6];
+    t_float ms = (x->x_sr > 0 ? 1000. / x->x_sr : 0);
+    SETFLOAT(at, x->x_playing ?
+        ((x->x_maxblock + 1) * x->x_frames - x->x_readpos) * ms : 0);
+    SETFLOAT(at+1, x->x_active ? netreceive_tilde_target(x) * ms : 0);
+    SETFLOAT(at+2, x->x_jitter * 1000.);
+    SETFLOAT(at+3, x->x_nlost);
+    SETFLOAT(at+4, x->x_nlate);
+    SETFLOAT(at+5, x->x_nunderrun);
+    outlet_anything(x->x_statout, gensym("status"), 6, at);
+}
+
+static void *netreceive_tilde_new(t_floatarg fport, t_floatarg fnchans)
+{
+    t_netreceive_tilde *x = (t_netreceive_tilde *)pd_new(netreceive_tilde_class);
+    int i;
+    x->x_nchans = (fnchans >= 1 ? (fnchans <= 255 ? fnchans : 255) : 1);
+    x->x_outvec = (t_sample **)getbytes(x->x_nchans * sizeof(t_sample *));
+    for (i = 0; i < x->x_nchans; i++)
+        outlet_new(&x->x_obj, &s_signal);
+    x->x_statout = outlet_new(&x->x_obj, &s_anything);
+    x->x_clock = clock_new(x, (t_method)netreceive_tilde_tick);
+    x->x_fd = -1;
+    x->x_sr = sys_getsr();
+    netreceive_tilde_reset(x);
+    netreceive_tilde_listen(x, fport);
+    return (x);
+}
+
+static void netreceive_tilde_free(t_netreceive_tilde *x)
+{
+    if (x->x_fd >= 0)
+    {
+        sys_rmpollfn(x->x_fd);
+        sys_closesocket(x->x_fd);
+    }
+    clock_free(x->x_clock);
+    freebytes(x->x_outvec, x->x_nchans * sizeof(t_sample *));
+    if (x->x_data)
+    {
+        freebytes(x->x_data,
+            NETAUDIO_NSLOTS * x->x_frames * x->x_nchans * sizeof(t_sample));
+        freebytes(x->x_slotblock, NETAUDIO_NSLOTS * sizeof(int));
+    }
+}
+
+static void netreceive_tilde_setup(void)
+{
+    netreceive_tilde_class = class_new(gensym("netreceive~"),
+        (t_newmethod)netreceive_tilde_new, (t_method)netreceive_tilde_free,
+        sizeof(t_netreceive_tilde), 0, A_DEFFLOAT, A_DEFFLOAT, 0);
+    class_addmethod(netreceive_tilde_class, (t_method)netreceive_tilde_dsp,
+        gensym("dsp"), A_CANT, 0);
+    class_addmethod(netreceive_tilde_class, (t_method)netreceive_tilde_listen,
+        gensym("listen"), A_FLOAT, 0);
+    class_addmethod(netreceive_tilde_class, (t_method)netreceive_tilde_buffer,
+        gensym("buffer"), A_FLOAT, 0);
+    class_addmethod(netreceive_tilde_class, (t_method)netreceive_tilde_status,
+        gensym("status"), 0);
+    class_sethelpsymbol(netreceive_tilde_class, gensym("netsend~"));
+}
+
+void d_net_setup(void)
+{
+    netsend_tilde_setup();
+    netreceive_tilde_setup();
+}
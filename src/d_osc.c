@@ -6,7 +6,10 @@
 */
 
 #include "m_pd.h"
+#include "m_imp.h"
 #include "math.h"
+#include <string.h>
+#include "d_simd.h"
 
 #define BIGFLOAT 1.0e+19
 #define UNITBIT32 1572864.  /* 3*2^19; bit 32 has place value 1 */
@@ -61,6 +64,10 @@ typedef struct _phasor
     double x_phase;
     t_float x_conv;
     t_float x_f;						// scalar frequency
+    double x_nextphase;     /* phase to jump to at the sample it was sent */
+    double x_when;
+    int x_pending;
+    t_ctltime x_time;
 } t_phasor;
 
 static void *phasor_new(t_floatarg f)
@@ -69,17 +76,14 @@ static void *phasor_new(t_floatarg f)
     x->x_f = f;
     inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_float, gensym("ft1"));
     x->x_phase = 0;
+    x->x_pending = 0;
     x->x_conv = 0;
     outlet_new(&x->x_obj, gensym("signal"));
     return (x);
 }
 
-static t_int *phasor_perform(t_int *w)
+static void phasor_doperform(t_phasor *x, t_sample *in, t_sample *out, int n)
 {
-    t_phasor *x = (t_phasor *)(w[1]);
-    t_sample *in = (t_float *)(w[2]);
-    t_sample *out = (t_float *)(w[3]);
-    int n = (int)(w[4]);
     double dphase = x->x_phase + (double)UNITBIT32;
     union tabfudge tf;
     int normhipart;
@@ -98,18 +102,41 @@ static t_int *phasor_perform(t_int *w)
     }
     tf.tf_i[HIOFFSET] = normhipart;
     x->x_phase = tf.tf_d - UNITBIT32;
+}
+
+    /* a new phase takes effect at the sample it was sent */
+static t_int *phasor_perform(t_int *w)
+{
+    t_phasor *x = (t_phasor *)(w[1]);
+    t_sample *in = (t_float *)(w[2]);
+    t_sample *out = (t_float *)(w[3]);
+    int n = (int)(w[4]), onset = 0;
+    ctltime_block(&x->x_time, n);
+    if (x->x_pending)
+    {
+        onset = ctltime_offset(&x->x_time, x->x_when, n);
+        phasor_doperform(x, in, out, onset);
+        if (onset < n)
+            x->x_phase = x->x_nextphase, x->x_pending = 0;
+    }
+    phasor_doperform(x, in + onset, out + onset, n - onset);
     return (w+5);
 }
 
 static void phasor_dsp(t_phasor *x, t_signal **sp)
 {
     x->x_conv = 1./sp[0]->s_sr;
+    ctltime_dsp(&x->x_time, sp[0]->s_sr);
     dsp_add(phasor_perform, 4, x, sp[0]->s_vec, sp[1]->s_vec, (t_int)sp[0]->s_n);
 }
 
 static void phasor_ft1(t_phasor *x, t_float f)
 {
-    x->x_phase = (double)f;
+    if (x->x_pending)
+        x->x_phase = x->x_nextphase;
+    x->x_nextphase = (double)f;
+    x->x_when = ctltime_stamp();
+    x->x_pending = 1;
 }
 
 static void phasor_setup(void)
@@ -127,7 +154,7 @@ static void phasor_setup(void)
 
 /* ------------------------ cos~ ----------------------------- */
 
-float *cos_table;
+t_float *cos_table;
 
 static t_class *cos_class;
 
@@ -150,7 +177,7 @@ static t_int *cos_perform(t_int *w)
     t_sample *in = (t_sample *)(w[1]);
     t_sample *out = (t_sample *)(w[2]);
     int n = (int)(w[3]);
-    float *tab = cos_table, *addr;
+    t_float *tab = cos_table, *addr;
     t_float f1, f2, frac;
     double dphase;
     int normhipart;
@@ -204,14 +231,24 @@ static void cos_dsp(t_cos *x, t_signal **sp)
 static void cos_maketable(void)
 {
     int i;
-    float *fp, phase, phsinc = (2. * 3.14159) / COSTABSIZE;
+    t_float *fp;
     union tabfudge tf;
 
     if (cos_table) return;
-    cos_table = (float *)getbytes(sizeof(float) * (COSTABSIZE+1));
-    for (i = COSTABSIZE + 1, fp = cos_table, phase = 0; i--;
-        fp++, phase += phsinc)
-            *fp = cos(phase);
+    cos_table = (t_float *)getbytes(sizeof(t_float) * (COSTABSIZE+1));
+#if PD_FLOATSIZE == 32
+    {
+        float phase, phsinc = (2. * 3.14159) / COSTABSIZE;
+        for (i = COSTABSIZE + 1, fp = cos_table, phase = 0; i--;
+            fp++, phase += phsinc)
+                *fp = cos(phase);
+    }
+#else
+        /* in double precision use a bigger table computed exactly, so
+        that the interpolation error stays well below that of float */
+    for (i = 0, fp = cos_table; i <= COSTABSIZE; i++)
+        *fp++ = cos(i * (2. * 3.14159265358979323846 / COSTABSIZE));
+#endif
 
         /* here we check at startup whether the byte alignment
             is as we declared it.  If not, the code has to be
@@ -223,7 +260,7 @@ static void cos_maketable(void)
 
 static void cos_cleanup(t_class *c)
 {
-    freebytes(cos_table, sizeof(float) * (COSTABSIZE+1));
+    freebytes(cos_table, sizeof(t_float) * (COSTABSIZE+1));
     cos_table = 0;
 }
 
@@ -247,6 +284,10 @@ typedef struct _osc
     double x_phase;
     t_float x_conv;
     t_float x_f;						// scalar frequency
+    double x_nextphase;     /* phase to jump to at the sample it was sent */
+    double x_when;
+    int x_pending;
+    t_ctltime x_time;
 } t_osc;
 
 static void *osc_new(t_floatarg f)
@@ -257,16 +298,14 @@ static void *osc_new(t_floatarg f)
     inlet_new(&x->x_obj, &x->x_obj.ob_pd, &s_float, gensym("ft1"));
     x->x_phase = 0;
     x->x_conv = 0;
+    x->x_pending = 0;
     return (x);
 }
 
-static t_int *osc_perform(t_int *w)
+    /* compute n > 0 samples */
+static void osc_doperform(t_osc *x, t_sample *in, t_sample *out, int n)
 {
-    t_osc *x = (t_osc *)(w[1]);
-    t_sample *in = (t_sample *)(w[2]);
-    t_sample *out = (t_sample *)(w[3]);
-    int n = (int)(w[4]);
-    float *tab = cos_table, *addr;
+    t_float *tab = cos_table, *addr;
     t_float f1, f2, frac;
     double dphase = x->x_phase + UNITBIT32;
     int normhipart;
@@ -315,18 +354,136 @@ static t_int *osc_perform(t_int *w)
     tf.tf_d = dphase + (UNITBIT32 * COSTABSIZE - UNITBIT32);
     tf.tf_i[HIOFFSET] = normhipart;
     x->x_phase = tf.tf_d - UNITBIT32 * COSTABSIZE;
+}
+
+    /* same for a frequency that's only set by floats */
+static void osc_doperform_scalar(t_osc *x, t_sample incr, t_sample *out,
+    int n)
+{
+    t_float *tab = cos_table, *addr;
+    t_float f1, f2, frac;
+    double dphase = x->x_phase + UNITBIT32;
+    int normhipart;
+    union tabfudge tf;
+
+    incr *= x->x_conv;
+    tf.tf_d = UNITBIT32;
+    normhipart = tf.tf_i[HIOFFSET];
+    while (n--)
+    {
+        tf.tf_d = dphase;
+        dphase += incr;
+        addr = tab + (tf.tf_i[HIOFFSET] & (COSTABSIZE-1));
+        tf.tf_i[HIOFFSET] = normhipart;
+        frac = tf.tf_d - UNITBIT32;
+        f1 = addr[0];
+        f2 = addr[1];
+        *out++ = f1 + frac * (f2 - f1);
+    }
+    tf.tf_d = UNITBIT32 * COSTABSIZE;
+    normhipart = tf.tf_i[HIOFFSET];
+    tf.tf_d = dphase + (UNITBIT32 * COSTABSIZE - UNITBIT32);
+    tf.tf_i[HIOFFSET] = normhipart;
+    x->x_phase = tf.tf_d - UNITBIT32 * COSTABSIZE;
+}
+
+    /* find where in the block a new phase takes effect, if any */
+static int osc_onset(t_osc *x, int n)
+{
+    ctltime_block(&x->x_time, n);
+    return (x->x_pending ? ctltime_offset(&x->x_time, x->x_when, n) : -1);
+}
+
+static void osc_newphase(t_osc *x)
+{
+    x->x_phase = x->x_nextphase;
+    x->x_pending = 0;
+}
+
+static void osc_doblock(t_osc *x, t_sample *in, t_sample *out, int n)
+{
+    int onset = osc_onset(x, n);
+    if (onset >= 0)
+    {
+        if (onset)
+            osc_doperform(x, in, out, onset);
+        if (onset == n)
+            return;
+        osc_newphase(x);
+        in += onset, out += onset, n -= onset;
+    }
+    osc_doperform(x, in, out, n);
+}
+
+static void osc_doblock_scalar(t_osc *x, t_sample incr, t_sample *out, int n)
+{
+    int onset = osc_onset(x, n);
+    if (onset >= 0)
+    {
+        if (onset)
+            osc_doperform_scalar(x, incr, out, onset);
+        if (onset == n)
+            return;
+        osc_newphase(x);
+        out += onset, n -= onset;
+    }
+    osc_doperform_scalar(x, incr, out, n);
+}
+
+static t_int *osc_perform(t_int *w)
+{
+    osc_doblock((t_osc *)(w[1]), (t_sample *)(w[2]), (t_sample *)(w[3]),
+        (int)(w[4]));
     return (w+5);
 }
 
+static t_int *osc_perform_scalar(t_int *w)
+{
+    osc_doblock_scalar((t_osc *)(w[1]), *(t_float *)(w[2]),
+        (t_sample *)(w[3]), (int)(w[4]));
+    return (w+5);
+}
+
+    /* for a block-rate frequency (see signal_setblockrate() in d_ugen.c):
+    a constant goes as if set by floats; otherwise we fill in the vector,
+    which may not have been written, and go as usual. */
+static t_int *osc_perform_blockrate(t_int *w)
+{
+    t_osc *x = (t_osc *)(w[1]);
+    t_blockrate *b = (t_blockrate *)(w[2]);
+    t_sample *in = (t_sample *)(w[3]);
+    t_sample *out = (t_sample *)(w[4]);
+    int n = (int)(w[5]);
+    if (b->b_vec || b->b_inc != 0)
+    {
+        blockrate_fill(b, in, n);
+        osc_doblock(x, in, out, n);
+    }
+    else osc_doblock_scalar(x, b->b_value, out, n);
+    return (w+6);
+}
+
 static void osc_dsp(t_osc *x, t_signal **sp)
 {
     x->x_conv = COSTABSIZE/sp[0]->s_sr;
-    dsp_add(osc_perform, 4, x, sp[0]->s_vec, sp[1]->s_vec, (t_int)sp[0]->s_n);
+    ctltime_dsp(&x->x_time, sp[0]->s_sr);
+    if (sp[0]->s_scalar)
+        dsp_add(osc_perform_scalar, 4, x, sp[0]->s_scalar, sp[1]->s_vec,
+            (t_int)sp[0]->s_n);
+    else if (sp[0]->s_blockrate)
+        dsp_add(osc_perform_blockrate, 5, x, sp[0]->s_blockrate,
+            sp[0]->s_vec, sp[1]->s_vec, (t_int)sp[0]->s_n);
+    else dsp_add(osc_perform, 4, x, sp[0]->s_vec, sp[1]->s_vec,
+        (t_int)sp[0]->s_n);
 }
 
 static void osc_ft1(t_osc *x, t_float f)
 {
-    x->x_phase = COSTABSIZE * f;
+    if (x->x_pending)
+        osc_newphase(x);
+    x->x_nextphase = COSTABSIZE * f;
+    x->x_when = ctltime_stamp();
+    x->x_pending = 1;
 }
 
 static void osc_setup(void)
@@ -334,12 +491,365 @@ static void osc_setup(void)
     osc_class = class_new(gensym("osc~"), (t_newmethod)osc_new, 0,
         sizeof(t_osc), 0, A_DEFFLOAT, 0);
     CLASS_MAINSIGNALIN(osc_class, t_osc, x_f);
+    class_setscalarsignalin(osc_class);
+    class_setblockratein(osc_class);
     class_addmethod(osc_class, (t_method)osc_dsp, gensym("dsp"), A_CANT, 0);
     class_addmethod(osc_class, (t_method)osc_ft1, gensym("ft1"), A_FLOAT, 0);
 
     cos_maketable();
 }
 
+/* ------------------------ oscbank~ ----------------------------- */
+
+/* A bank of sinusoids summed into one output, for additive synthesis
+without one osc~ per partial.  Frequencies and amplitudes come from lists
+("freqs", "amps") or from a pair of arrays ("set"), and are read once per
+block; amplitude changes are ramped over the block.  Each partial's phase is
+kept in double precision and, at the start of each block, turned into a
+cosine and sine by looking up the cos~ table; within the block each one is
+stepped by complex multiplication, four partials at a time if we have
+vector instructions.  In "bandlimit" mode partials at or above the Nyquist
+frequency are silenced. */
+
+static t_class *oscbank_class;
+
+    /* per group of four partials we keep four each of: cosine and sine of
+    the current phase, cosine and sine of the phase increment, amplitude
+    and its increment per sample. */
+#define OB_COS 0
+#define OB_SIN 4
+#define OB_WCOS 8
+#define OB_WSIN 12
+#define OB_AMP 16
+#define OB_DAMP 20
+#define OB_GROUPSIZE 24
+
+typedef struct _oscbank
+{
+    t_object x_obj;
+    int x_n;                /* number of partials */
+    int x_ngroups;          /* number of groups of 4 partials */
+    t_sample *x_state;      /* OB_GROUPSIZE points per group, as above */
+    double *x_phase;        /* phase in cycles at start of next block */
+    t_float *x_freq;        /* frequency increments were computed for */
+    t_float *x_amp;         /* amplitude at start of next block */
+    t_float *x_flist;       /* frequencies and amplitudes from messages */
+    t_float *x_alist;
+    t_float x_mult;         /* multiplier for all frequencies */
+    t_float x_sr;
+    int x_bandlimit;
+    t_symbol *x_farrayname; /* arrays to read from instead, if any */
+    t_symbol *x_aarrayname;
+    t_word *x_fvec;
+    t_word *x_avec;
+    int x_fsize;
+    int x_asize;
+    t_sample *x_acc;        /* 4 sums per sample, one per lane */
+    int x_accsize;
+} t_oscbank;
+
+static void oscbank_resize(t_oscbank *x, int n)
+{
+    int i, oldn = x->x_n, ngroups = (n + 3) >> 2;
+    if (n == oldn)
+        return;
+    x->x_state = (t_sample *)resizebytes(x->x_state,
+        x->x_ngroups * OB_GROUPSIZE * sizeof(t_sample),
+            ngroups * OB_GROUPSIZE * sizeof(t_sample));
+    x->x_phase = (double *)resizebytes(x->x_phase,
+        oldn * sizeof(double), n * sizeof(double));
+    x->x_freq = (t_float *)resizebytes(x->x_freq,
+        oldn * sizeof(t_float), n * sizeof(t_float));
+    x->x_amp = (t_float *)resizebytes(x->x_amp,
+        oldn * sizeof(t_float), n * sizeof(t_float));
+    x->x_flist = (t_float *)resizebytes(x->x_flist,
+        oldn * sizeof(t_float), n * sizeof(t_float));
+    x->x_alist = (t_float *)resizebytes(x->x_alist,
+        oldn * sizeof(t_float), n * sizeof(t_float));
+    for (i = oldn; i < n; i++)
+    {
+        x->x_phase[i] = 0;
+        x->x_freq[i] = BIGFLOAT;    /* force increments to be computed */
+        x->x_amp[i] = x->x_flist[i] = x->x_alist[i] = 0;
+    }
+        /* clear the state of any lanes no longer used so they add nothing */
+    for (i = n; i < (ngroups << 2); i++)
+    {
+        t_sample *st = x->x_state + (i >> 2) * OB_GROUPSIZE + (i & 3);
+        st[OB_COS] = st[OB_SIN] = st[OB_WCOS] = st[OB_WSIN] =
+            st[OB_AMP] = st[OB_DAMP] = 0;
+    }
+    x->x_n = n;
+    x->x_ngroups = ngroups;
+}
+
+    /* interpolated lookup in the cos~ table; phase is in cycles, 0 to 1 */
+static t_sample oscbank_cos(double phase)
+{
+    double findex = phase * COSTABSIZE;
+    int index = (int)findex;
+    t_sample frac = findex - index, f1, f2;
+    index &= (COSTABSIZE-1);
+    f1 = cos_table[index];
+    f2 = cos_table[index+1];
+    return (f1 + frac * (f2 - f1));
+}
+
+    /* set up each partial for the next "n" samples */
+static void oscbank_update(t_oscbank *x, int n)
+{
+    int i;
+    t_float nyquist = 0.5 * x->x_sr;
+    double conv = 1. / x->x_sr;
+    for (i = 0; i < x->x_n; i++)
+    {
+        t_sample *st = x->x_state + (i >> 2) * OB_GROUPSIZE + (i & 3);
+        t_float f = (x->x_fvec ? x->x_fvec[i].w_float : x->x_flist[i]) *
+            x->x_mult;
+        t_float a = (x->x_avec ? x->x_avec[i].w_float : x->x_alist[i]);
+        double phase = x->x_phase[i];
+        if (x->x_bandlimit && (f >= nyquist || f <= -nyquist))
+            a = 0;
+        if (f != x->x_freq[i])
+        {
+            double w = 2 * 3.14159265358979 * f * conv;
+            st[OB_WCOS] = cos(w);
+            st[OB_WSIN] = sin(w);
+            x->x_freq[i] = f;
+        }
+        st[OB_COS] = oscbank_cos(phase);
+        st[OB_SIN] = oscbank_cos(phase + 0.75);
+        phase += f * conv * n;
+        x->x_phase[i] = phase - floor(phase);
+        st[OB_AMP] = x->x_amp[i];
+        st[OB_DAMP] = (a - x->x_amp[i]) / n;
+        x->x_amp[i] = a;
+    }
+}
+
+static t_int *oscbank_perform(t_int *w)
+{
+    t_oscbank *x = (t_oscbank *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    int n = (int)(w[3]), i, g;
+    if (x->x_farrayname && !x->x_fvec)
+        goto zero;
+    oscbank_update(x, n);
+#ifdef PD_SIMD
+    if (!x->x_ngroups)
+        goto zero;
+    for (g = 0; g < x->x_ngroups; g++)
+    {
+        t_sample *st = x->x_state + g * OB_GROUPSIZE, *acc = x->x_acc;
+        t_v4 c = V4_LOAD(st + OB_COS), s = V4_LOAD(st + OB_SIN),
+            wc = V4_LOAD(st + OB_WCOS), ws = V4_LOAD(st + OB_WSIN),
+            a = V4_LOAD(st + OB_AMP), da = V4_LOAD(st + OB_DAMP);
+        for (i = 0; i < n; i++, acc += 4)
+        {
+            t_v4 c2 = V4_SUB(V4_MUL(c, wc), V4_MUL(s, ws)), y = V4_MUL(a, c);
+            s = V4_ADD(V4_MUL(s, wc), V4_MUL(c, ws));
+            V4_STORE(acc, (g ? V4_ADD(V4_LOAD(acc), y) : y));
+            c = c2;
+            a = V4_ADD(a, da);
+        }
+    }
+        /* add up the four lanes, four samples at a time */
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        t_sample *acc = x->x_acc + 4*i;
+        t_v4 r0 = V4_LOAD(acc), r1 = V4_LOAD(acc + 4),
+            r2 = V4_LOAD(acc + 8), r3 = V4_LOAD(acc + 12);
+        V4_TRANSPOSE(r0, r1, r2, r3);
+        V4_STORE(out + i, V4_ADD(V4_ADD(r0, r1), V4_ADD(r2, r3)));
+    }
+    for (; i < n; i++)
+    {
+        t_sample *acc = x->x_acc + 4*i;
+        out[i] = acc[0] + acc[1] + acc[2] + acc[3];
+    }
+#else
+    for (i = 0; i < n; i++)
+        out[i] = 0;
+    for (g = 0; g < x->x_n; g++)
+    {
+        t_sample *st = x->x_state + (g >> 2) * OB_GROUPSIZE + (g & 3);
+        t_sample c = st[OB_COS], s = st[OB_SIN], wc = st[OB_WCOS],
+            ws = st[OB_WSIN], a = st[OB_AMP], da = st[OB_DAMP];
+        for (i = 0; i < n; i++)
+        {
+            t_sample c2 = c * wc - s * ws;
+            s = s * wc + c * ws;
+            out[i] += a * c;
+            c = c2;
+            a += da;
+        }
+    }
+#endif
+    return (w+4);
+zero:
+    for (i = 0; i < n; i++)
+        out[i] = 0;
+    return (w+4);
+}
+
+static int oscbank_getarray(t_oscbank *x, t_symbol *s, int *size,
+    t_word **vec)
+{
+    t_garray *a;
+    if (!(a = (t_garray *)pd_findbyclass(s, garray_class)))
+    {
+        pd_error(x, "oscbank~: %s: no such array", s->s_name);
+        return (0);
+    }
+    else if (!garray_getfloatwords(a, size, vec))
+    {
+        pd_error(x, "%s: bad template for oscbank~", s->s_name);
+        return (0);
+    }
+    garray_usedindsp(a);
+    return (1);
+}
+
+    /* look the arrays up again and fit the number of partials to them */
+static void oscbank_setarrays(t_oscbank *x)
+{
+    int n;
+    x->x_fvec = x->x_avec = 0;
+    if (!x->x_farrayname)
+        return;
+    if (!oscbank_getarray(x, x->x_farrayname, &x->x_fsize, &x->x_fvec))
+        return;
+    if (x->x_aarrayname && !oscbank_getarray(x, x->x_aarrayname,
+        &x->x_asize, &x->x_avec))
+    {
+        x->x_fvec = 0;
+        return;
+    }
+    n = x->x_fsize;
+    if (x->x_avec && x->x_asize < n)
+        n = x->x_asize;
+    oscbank_resize(x, n);
+}
+
+static void oscbank_set(t_oscbank *x, t_symbol *s, int argc, t_atom *argv)
+{
+    x->x_farrayname = (argc ? atom_getsymbolarg(0, argc, argv) : 0);
+    x->x_aarrayname = (argc > 1 ? atom_getsymbolarg(1, argc, argv) : 0);
+    if (x->x_farrayname && !*x->x_farrayname->s_name)
+        x->x_farrayname = 0;
+    oscbank_setarrays(x);
+}
+
+    /* set the frequencies; new partials get amplitude 1 */
+static void oscbank_freqs(t_oscbank *x, t_symbol *s, int argc, t_atom *argv)
+{
+    int i, oldn = x->x_n;
+    if (x->x_farrayname)
+        x->x_farrayname = x->x_aarrayname = 0, x->x_fvec = x->x_avec = 0;
+    oscbank_resize(x, argc);
+    for (i = 0; i < argc; i++)
+        x->x_flist[i] = atom_getfloatarg(i, argc, argv);
+    for (i = oldn; i < argc; i++)
+        x->x_alist[i] = 1;
+}
+
+static void oscbank_amps(t_oscbank *x, t_symbol *s, int argc, t_atom *argv)
+{
+    int i;
+    for (i = 0; i < argc && i < x->x_n; i++)
+        x->x_alist[i] = atom_getfloatarg(i, argc, argv);
+}
+
+static void oscbank_float(t_oscbank *x, t_floatarg f)
+{
+    x->x_mult = f;
+}
+
+static void oscbank_bandlimit(t_oscbank *x, t_floatarg f)
+{
+    x->x_bandlimit = (f != 0);
+}
+
+static void oscbank_phase(t_oscbank *x)
+{
+    int i;
+    for (i = 0; i < x->x_n; i++)
+        x->x_phase[i] = 0;
+}
+
+static void oscbank_dsp(t_oscbank *x, t_signal **sp)
+{
+    int i, n = sp[0]->s_n;
+    x->x_sr = sp[0]->s_sr;
+        /* the sample rate may have changed */
+    for (i = 0; i < x->x_n; i++)
+        x->x_freq[i] = BIGFLOAT;
+    oscbank_setarrays(x);
+    if (x->x_accsize != 4 * n)
+    {
+        x->x_acc = (t_sample *)resizebytes(x->x_acc,
+            x->x_accsize * sizeof(t_sample), 4 * n * sizeof(t_sample));
+        x->x_accsize = 4 * n;
+    }
+    dsp_add(oscbank_perform, 3, x, sp[0]->s_vec, (t_int)n);
+}
+
+static void *oscbank_new(t_symbol *s, int argc, t_atom *argv)
+{
+    t_oscbank *x = (t_oscbank *)pd_new(oscbank_class);
+    x->x_n = x->x_ngroups = 0;
+    x->x_state = 0;
+    x->x_phase = 0;
+    x->x_freq = x->x_amp = x->x_flist = x->x_alist = 0;
+    x->x_mult = 1;
+    x->x_sr = 44100;
+    x->x_bandlimit = 0;
+    x->x_farrayname = x->x_aarrayname = 0;
+    x->x_fvec = x->x_avec = 0;
+    x->x_fsize = x->x_asize = 0;
+    x->x_acc = 0;
+    x->x_accsize = 0;
+    while (argc && argv->a_type == A_SYMBOL &&
+        *argv->a_w.w_symbol->s_name == '-')
+    {
+        if (!strcmp(argv->a_w.w_symbol->s_name, "-bandlimit"))
+            x->x_bandlimit = 1;
+        else pd_error(x, "oscbank~: %s: unknown flag",
+            argv->a_w.w_symbol->s_name);
+        argc--; argv++;
+    }
+    oscbank_freqs(x, 0, argc, argv);
+    outlet_new(&x->x_obj, &s_signal);
+    return (x);
+}
+
+static void oscbank_free(t_oscbank *x)
+{
+    oscbank_resize(x, 0);
+    if (x->x_acc)
+        freebytes(x->x_acc, x->x_accsize * sizeof(t_sample));
+}
+
+static void oscbank_setup(void)
+{
+    oscbank_class = class_new(gensym("oscbank~"), (t_newmethod)oscbank_new,
+        (t_method)oscbank_free, sizeof(t_oscbank), 0, A_GIMME, 0);
+    class_addmethod(oscbank_class, (t_method)oscbank_dsp,
+        gensym("dsp"), A_CANT, 0);
+    class_addfloat(oscbank_class, oscbank_float);
+    class_addmethod(oscbank_class, (t_method)oscbank_freqs,
+        gensym("freqs"), A_GIMME, 0);
+    class_addmethod(oscbank_class, (t_method)oscbank_amps,
+        gensym("amps"), A_GIMME, 0);
+    class_addmethod(oscbank_class, (t_method)oscbank_set,
+        gensym("set"), A_GIMME, 0);
+    class_addmethod(oscbank_class, (t_method)oscbank_bandlimit,
+        gensym("bandlimit"), A_FLOAT, 0);
+    class_addmethod(oscbank_class, (t_method)oscbank_phase,
+        gensym("phase"), 0);
+    cos_maketable();
+}
+
 /* ---- vcf~ - resonant filter with audio-rate center frequency input ----- */
 
 typedef struct vcfctl
@@ -397,7 +907,7 @@ static t_int *sigvcf_perform(t_int *w)
     t_float qinv = (q > 0? 1.0f/q : 0);
     t_float ampcorrect = 2. - 2. / (q + 2.);
     t_float coefr, coefi;
-    float *tab = cos_table, *addr, f1, f2, frac;
+    t_float *tab = cos_table, *addr, f1, f2, frac;
     double dphase;
     int normhipart, tabindex;
     union tabfudge tf;
@@ -444,10 +954,80 @@ static t_int *sigvcf_perform(t_int *w)
     return (w+7);
 }
 
+    /* if the center frequency is only set by floats, the coefficients
+    are the same for the whole block */
+static t_int *sigvcf_perform_scalar(t_int *w)
+{
+    t_sample *in1 = (t_sample *)(w[1]);
+    t_sample in2 = *(t_float *)(w[2]);
+    t_sample *out1 = (t_sample *)(w[3]);
+    t_sample *out2 = (t_sample *)(w[4]);
+    t_vcfctl *c = (t_vcfctl *)(w[5]);
+    int n = (int)w[6];
+    int i;
+    t_float re = c->c_re, re2;
+    t_float im = c->c_im;
+    t_float q = c->c_q;
+    t_float isr = c->c_isr;
+    t_float qinv = (q > 0? 1.0f/q : 0);
+    t_float ampcorrect = 2. - 2. / (q + 2.);
+    t_float coefr, coefi, gain;
+    t_float *tab = cos_table, *addr, f1, f2, frac;
+    float cf, cfindx, r, oneminusr;
+    double dphase;
+    int normhipart, tabindex;
+    union tabfudge tf;
+
+    tf.tf_d = UNITBIT32;
+    normhipart = tf.tf_i[HIOFFSET];
+
+    cf = in2 * isr;
+    if (cf < 0) cf = 0;
+    cfindx = cf * (float)(COSTABSIZE/6.28318f);
+    r = (qinv > 0 ? 1 - cf * qinv : 0);
+    if (r < 0) r = 0;
+    oneminusr = 1.0f - r;
+    dphase = ((double)(cfindx)) + UNITBIT32;
+    tf.tf_d = dphase;
+    tabindex = tf.tf_i[HIOFFSET] & (COSTABSIZE-1);
+    addr = tab + tabindex;
+    tf.tf_i[HIOFFSET] = normhipart;
+    frac = tf.tf_d - UNITBIT32;
+    f1 = addr[0];
+    f2 = addr[1];
+    coefr = r * (f1 + frac * (f2 - f1));
+
+    addr = tab + ((tabindex - (COSTABSIZE/4)) & (COSTABSIZE-1));
+    f1 = addr[0];
+    f2 = addr[1];
+    coefi = r * (f1 + frac * (f2 - f1));
+    gain = ampcorrect * oneminusr;
+
+    for (i = 0; i < n; i++)
+    {
+        re2 = re;
+        *out1++ = re = gain * *in1++ + coefr * re2 - coefi * im;
+        *out2++ = im = coefi * re2 + coefr * im;
+    }
+    if (PD_BIGORSMALL(re))
+        re = 0;
+    if (PD_BIGORSMALL(im))
+        im = 0;
+    c->c_re = re;
+    c->c_im = im;
+    return (w+7);
+}
+
 static void sigvcf_dsp(t_sigvcf *x, t_signal **sp)
 {
     x->x_cspace.c_isr = 6.28318f/sp[0]->s_sr;
-    dsp_add(sigvcf_perform, 6,
+    if (sp[0]->s_scalar)
+        dsp_add_scalarcopy(sp[0]->s_scalar, sp[0]->s_vec, sp[0]->s_n);
+    if (sp[1]->s_scalar)
+        dsp_add(sigvcf_perform_scalar, 6,
+            sp[0]->s_vec, sp[1]->s_scalar, sp[2]->s_vec, sp[3]->s_vec,
+                &x->x_cspace, (t_int)sp[0]->s_n);
+    else dsp_add(sigvcf_perform, 6,
         sp[0]->s_vec, sp[1]->s_vec, sp[2]->s_vec, sp[3]->s_vec,
             &x->x_cspace, (t_int)sp[0]->s_n);
 }
@@ -458,6 +1038,7 @@ void sigvcf_setup(void)
     sigvcf_class = class_new(gensym("vcf~"), (t_newmethod)sigvcf_new, 0,
         sizeof(t_sigvcf), 0, A_DEFFLOAT, 0);
     CLASS_MAINSIGNALIN(sigvcf_class, t_sigvcf, x_f);
+    class_setscalarsignalin(sigvcf_class);
     class_addmethod(sigvcf_class, (t_method)sigvcf_dsp,
         gensym("dsp"), A_CANT, 0);
     class_addmethod(sigvcf_class, (t_method)sigvcf_ft1,
@@ -484,17 +1065,43 @@ static void *noise_new(void)
     return (x);
 }
 
+    /* noise~ is the linear congruential generator below.  Rather than stepping
+    it once per sample, which serializes the whole loop on the multiply, we
+    keep four consecutive values and jump each one four steps ahead at once
+    (NOISE_A4 and NOISE_C4 are the recurrence composed with itself four
+    times), which the compiler can vectorize.  The output is the same sequence
+    as stepping one at a time, so seeds give the same noise as ever. */
+#define NOISE_A 435898247u
+#define NOISE_C 382842987u
+#define NOISE_A2 (NOISE_A * NOISE_A)
+#define NOISE_A4 (NOISE_A2 * NOISE_A2)
+#define NOISE_C4 (NOISE_C * (1u + NOISE_A) * (1u + NOISE_A2))
+
 static t_int *noise_perform(t_int *w)
 {
     t_sample *out = (t_sample *)(w[1]);
     int *vp = (int *)(w[2]);
-    int n = (int)(w[3]);
-    int val = *vp;
+    int n = (int)(w[3]), i;
+    unsigned int val = *vp, lanes[4];
+    if (n >= 4)
+    {
+        lanes[0] = val;
+        for (i = 1; i < 4; i++)
+            lanes[i] = lanes[i-1] * NOISE_A + NOISE_C;
+        for (; n >= 4; n -= 4, out += 4)
+            for (i = 0; i < 4; i++)
+        {
+            out[i] = ((t_sample)((int)(lanes[i] & 0x7fffffff) - 0x40000000))
+                * (t_sample)(1.0 / 0x40000000);
+            lanes[i] = lanes[i] * NOISE_A4 + NOISE_C4;
+        }
+        val = lanes[0];
+    }
     while (n--)
     {
-        *out++ = ((t_sample)((val & 0x7fffffff) - 0x40000000)) *
+        *out++ = ((t_sample)((int)(val & 0x7fffffff) - 0x40000000)) *
             (t_sample)(1.0 / 0x40000000);
-        val = val * 435898247 + 382842987;
+        val = val * NOISE_A + NOISE_C;
     }
     *vp = val;
     return (w+4);
@@ -527,6 +1134,7 @@ void d_osc_setup(void)
     phasor_setup();
     cos_setup();
     osc_setup();
+    oscbank_setup();
     sigvcf_setup();
     noise_setup();
 }
@@ -4,6 +4,9 @@
 
 
 #include "m_pd.h"
+#include "d_simd.h"
+#include <math.h>
+#include <string.h>
 
 /* --------------------- up/down-sampling --------------------- */
 t_int *downsampling_perform_0(t_int *w)
@@ -97,6 +100,182 @@ t_int *upsampling_perform_linear(t_int *w)
   return (w+6);
 }
 
+/* polyphase FIR ("fir" method): a Kaiser-windowed sinc lowpass of
+RESAMPLE_FIRTAPS taps per phase, with its cutoff just below the Nyquist
+frequency of the lower rate and about 80 dB of stopband rejection.  Only
+the nonzero input samples are convolved when upsampling, and only the kept
+output samples are computed when downsampling.  The filter is linear-phase,
+so it delays the signal by (RESAMPLE_FIRTAPS * factor - 1)/2 samples at the
+higher rate.  The buffer holds the tail of the previous block followed by
+the current one. */
+
+#define RESAMPLE_FIRTAPS 32
+#define RESAMPLE_KAISERBETA 8.
+
+static double resample_bessel0(double x)
+{
+  double sum = 1, term = 1;
+  int k;
+  for (k = 1; k < 50 && term > 1e-12 * sum; k++)
+  {
+    term *= (x * x) / (4. * k * k);
+    sum += term;
+  }
+  return (sum);
+}
+
+  /* design the lowpass for "factor", of length RESAMPLE_FIRTAPS * factor,
+  normalized to unit gain at DC. */
+static void resample_makefir(double *h, int factor)
+{
+  int length = RESAMPLE_FIRTAPS * factor, i;
+  double center = 0.5 * (length - 1), cutoff = 0.42 / factor, sum = 0;
+  double norm = 1. / resample_bessel0(RESAMPLE_KAISERBETA);
+  for (i = 0; i < length; i++)
+  {
+    double t = i - center, r = t / center,
+      arg = 2 * 3.14159265358979 * cutoff * t;
+    h[i] = (t == 0 ? 1 : sin(arg) / arg) *
+      resample_bessel0(RESAMPLE_KAISERBETA * sqrt(1 - r * r)) * norm;
+    sum += h[i];
+  }
+  for (i = 0; i < length; i++)
+    h[i] /= sum;
+}
+
+  /* four dot products at once, each of ntaps (a multiple of 4) points */
+static void resample_dot4(t_sample *out, t_sample **coef, t_sample **in,
+  int ntaps)
+{
+#ifdef PD_SIMD
+  t_v4 acc0 = V4_ZERO(), acc1 = V4_ZERO(), acc2 = V4_ZERO(),
+    acc3 = V4_ZERO();
+  int i;
+  for (i = 0; i < ntaps; i += 4)
+  {
+    acc0 = V4_ADD(acc0, V4_MUL(V4_LOAD(coef[0] + i), V4_LOAD(in[0] + i)));
+    acc1 = V4_ADD(acc1, V4_MUL(V4_LOAD(coef[1] + i), V4_LOAD(in[1] + i)));
+    acc2 = V4_ADD(acc2, V4_MUL(V4_LOAD(coef[2] + i), V4_LOAD(in[2] + i)));
+    acc3 = V4_ADD(acc3, V4_MUL(V4_LOAD(coef[3] + i), V4_LOAD(in[3] + i)));
+  }
+  V4_TRANSPOSE(acc0, acc1, acc2, acc3);
+  V4_STORE(out, V4_ADD(V4_ADD(acc0, acc1), V4_ADD(acc2, acc3)));
+#else
+  int i, j;
+  for (j = 0; j < 4; j++)
+  {
+    t_sample sum = 0;
+    for (i = 0; i < ntaps; i++)
+      sum += coef[j][i] * in[j][i];
+    out[j] = sum;
+  }
+#endif
+}
+
+static t_sample resample_dot(t_sample *coef, t_sample *in, int ntaps)
+{
+  t_sample sum = 0;
+  while (ntaps--)
+    sum += *coef++ * *in++;
+  return (sum);
+}
+
+t_int *upsampling_perform_fir(t_int *w)
+{
+  t_resample *x= (t_resample *)(w[1]);
+  t_sample *in  = (t_sample *)(w[2]); /* original signal     */
+  t_sample *out = (t_sample *)(w[3]); /* upsampled signal    */
+  int up       = (int)(w[4]);       /* upsampling factor   */
+  int parent   = (int)(w[5]);       /* original vectorsize */
+  int ntaps = RESAMPLE_FIRTAPS, hist = ntaps - 1, length = parent * up, n;
+  t_sample *coef[4], *fp[4];
+
+    /* output sample n is phase n%up of the filter applied to the ntaps
+    input samples ending at n/up */
+  memcpy(x->buffer + hist, in, parent * sizeof(t_sample));
+  for (n = 0; n + 4 <= length; n += 4)
+  {
+    int i;
+    for (i = 0; i < 4; i++)
+    {
+      coef[i] = x->coeffs + ((n + i) % up) * ntaps;
+      fp[i] = x->buffer + (n + i) / up;
+    }
+    resample_dot4(out + n, coef, fp, ntaps);
+  }
+  for (; n < length; n++)
+    out[n] = resample_dot(x->coeffs + (n % up) * ntaps,
+      x->buffer + n / up, ntaps);
+  memmove(x->buffer, x->buffer + parent, hist * sizeof(t_sample));
+  return (w+6);
+}
+
+t_int *downsampling_perform_fir(t_int *w)
+{
+  t_resample *x= (t_resample *)(w[1]);
+  t_sample *in  = (t_sample *)(w[2]); /* original signal     */
+  t_sample *out = (t_sample *)(w[3]); /* downsampled signal  */
+  int down     = (int)(w[4]);       /* downsampling factor */
+  int parent   = (int)(w[5]);       /* original vectorsize */
+  int ntaps = RESAMPLE_FIRTAPS * down, hist = ntaps - 1,
+    length = parent / down, n;
+  t_sample *coef[4], *fp[4];
+
+    /* output sample n is the filter applied to the ntaps input samples
+    ending at the last of the "down" samples it replaces */
+  memcpy(x->buffer + hist, in, parent * sizeof(t_sample));
+  coef[0] = coef[1] = coef[2] = coef[3] = x->coeffs;
+  for (n = 0; n + 4 <= length; n += 4)
+  {
+    int i;
+    for (i = 0; i < 4; i++)
+      fp[i] = x->buffer + (n + i) * down + down - 1;
+    resample_dot4(out + n, coef, fp, ntaps);
+  }
+  for (; n < length; n++)
+    out[n] = resample_dot(x->coeffs, x->buffer + n * down + down - 1, ntaps);
+  memmove(x->buffer, x->buffer + parent, hist * sizeof(t_sample));
+  return (w+6);
+}
+
+  /* (re)allocate the coefficients and the history buffer for the FIR
+  method.  Upsampling keeps one row of RESAMPLE_FIRTAPS coefficients per
+  phase, in reverse order so that each output is a plain dot product with
+  the buffer; downsampling uses the whole (symmetric) filter. */
+static void resample_firsetup(t_resample *x, int factor, int upsampling,
+  int parent)
+{
+  int length = RESAMPLE_FIRTAPS * factor, i, j,
+    bufsize = (upsampling ? RESAMPLE_FIRTAPS : length) - 1 + parent;
+  double *h = (double *)getbytes(length * sizeof(double));
+  resample_makefir(h, factor);
+  if (x->coefsize != length)
+  {
+    if (x->coefsize)
+      t_freebytes(x->coeffs, x->coefsize*sizeof(*x->coeffs));
+    x->coefsize = length;
+    x->coeffs = (t_sample *)t_getbytes(x->coefsize*sizeof(*x->coeffs));
+  }
+  if (upsampling)
+  {
+    for (i = 0; i < factor; i++)
+      for (j = 0; j < RESAMPLE_FIRTAPS; j++)
+        x->coeffs[i * RESAMPLE_FIRTAPS + j] =
+          factor * h[(RESAMPLE_FIRTAPS - 1 - j) * factor + i];
+  }
+  else for (i = 0; i < length; i++)
+    x->coeffs[i] = h[length - 1 - i];
+  freebytes(h, length * sizeof(double));
+  if (x->bufsize != bufsize)
+  {
+    if (x->bufsize)
+      t_freebytes(x->buffer, x->bufsize*sizeof(*x->buffer));
+    x->bufsize = bufsize;
+    x->buffer = (t_sample *)t_getbytes(x->bufsize*sizeof(*x->buffer));
+  }
+  memset(x->buffer, 0, x->bufsize*sizeof(*x->buffer));
+}
+
 /* ----------------------- public -------------------------------- */
 
 /* utils */
@@ -140,6 +319,10 @@ void resample_dsp(t_resample *x,
       return;
     }
     switch (method) {
+    case 4:
+      resample_firsetup(x, insize/outsize, 0, insize);
+      dsp_add(downsampling_perform_fir, 5, x, in, out, (t_int)(insize/outsize), (t_int)insize);
+      break;
     default:
       dsp_add(downsampling_perform_0, 4, in, out, (t_int)(insize/outsize), (t_int)insize);
     }
@@ -162,6 +345,10 @@ void resample_dsp(t_resample *x,
       }
       dsp_add(upsampling_perform_linear, 5, x, in, out, (t_int)(outsize/insize), (t_int)insize);
       break;
+    case 4:
+      resample_firsetup(x, outsize/insize, 1, insize);
+      dsp_add(upsampling_perform_fir, 5, x, in, out, (t_int)(outsize/insize), (t_int)insize);
+      break;
     default:
       dsp_add(upsampling_perform_0, 4, in, out, (t_int)(outsize/insize), (t_int)insize);
     }
@@ -0,0 +1,365 @@
+/* Copyright (c) 1997-2021 Miller Puckette and others.
+* For information on usage and redistribution, and for a DISCLAIMER OF ALL
+* WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+/* macros for writing "perf8" loops with 4-wide vector instructions.  These
+are only defined if the compiler targets SSE2 (all 64-bit Intel and AMD
+processors) or NEON (all 64-bit ARM processors and most 32-bit ones), so that
+no run-time check is needed; otherwise PD_SIMD is left undefined and the plain
+C loops are used.  In double precision (PD_FLOATSIZE 64) a t_v4 is one AVX
+register if the compiler targets AVX, and otherwise a pair of SSE2 or 64-bit
+NEON registers, so that the same kernels serve both builds.  Loads and stores
+are unaligned since signal vectors may be borrowed from anywhere. */
+
+#ifndef __d_simd_h_
+#define __d_simd_h_
+
+#if PD_FLOATSIZE == 32
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PD_SIMD
+typedef __m128 t_v4;
+#define V4_LOAD(p) _mm_loadu_ps(p)
+    /* every other float from p[0] to p[6], e.g., from an array of t_words */
+#define V4_LOAD_STRIDE2(p) _mm_shuffle_ps(_mm_loadu_ps(p), \
+    _mm_loadu_ps((p) + 4), _MM_SHUFFLE(2, 0, 2, 0))
+#define V4_STORE(p, v) _mm_storeu_ps((p), (v))
+#define V4_SET1(f) _mm_set1_ps(f)
+#define V4_ZERO() _mm_setzero_ps()
+#define V4_ADD(a, b) _mm_add_ps((a), (b))
+#define V4_SUB(a, b) _mm_sub_ps((a), (b))
+#define V4_MUL(a, b) _mm_mul_ps((a), (b))
+#define V4_MAX(a, b) _mm_max_ps((a), (b))   /* b if a is NaN */
+#define V4_MIN(a, b) _mm_min_ps((a), (b))
+#define V4_TRUNC(a) _mm_cvtepi32_ps(_mm_cvttps_epi32(a))
+    /* make columns of four vectors into rows */
+#define V4_TRANSPOSE(r0, r1, r2, r3) _MM_TRANSPOSE4_PS(r0, r1, r2, r3)
+    /* comparisons give all-ones or all-zeros masks for V4_AND/V4_SELECT */
+#define V4_CMPGT(a, b) _mm_cmpgt_ps((a), (b))
+#define V4_AND(m, a) _mm_and_ps((m), (a))
+#define V4_SELECT(m, a, b) _mm_or_ps(_mm_and_ps((m), (a)), \
+    _mm_andnot_ps((m), (b)))
+    /* 2^n for integer-valued n in [-126, 127] */
+#define V4_EXP2INT(n) _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32( \
+    _mm_cvttps_epi32(n), _mm_set1_epi32(127)), 23))
+    /* exponent and mantissa in [1, 2) of positive normal numbers */
+#define V4_EXPONENT(a) _mm_cvtepi32_ps(_mm_sub_epi32( \
+    _mm_srli_epi32(_mm_castps_si128(a), 23), _mm_set1_epi32(127)))
+#define V4_MANTISSA(a) _mm_or_ps(_mm_and_ps((a), \
+    _mm_castsi128_ps(_mm_set1_epi32(0x007fffff))), _mm_set1_ps(1.f))
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PD_SIMD
+typedef float32x4_t t_v4;
+#define V4_LOAD(p) vld1q_f32(p)
+#define V4_LOAD_STRIDE2(p) (vld2q_f32(p).val[0])
+#define V4_STORE(p, v) vst1q_f32((p), (v))
+#define V4_SET1(f) vdupq_n_f32(f)
+#define V4_ZERO() vdupq_n_f32(0)
+#define V4_ADD(a, b) vaddq_f32((a), (b))
+#define V4_SUB(a, b) vsubq_f32((a), (b))
+#define V4_MUL(a, b) vmulq_f32((a), (b))
+#define V4_MAX(a, b) vbslq_f32(vcgtq_f32((a), (b)), (a), (b))
+#define V4_MIN(a, b) vbslq_f32(vcltq_f32((a), (b)), (a), (b))
+#define V4_TRUNC(a) vcvtq_f32_s32(vcvtq_s32_f32(a))
+#define V4_TRANSPOSE(r0, r1, r2, r3) do { \
+    float32x4x2_t t01 = vtrnq_f32(r0, r1), t23 = vtrnq_f32(r2, r3); \
+    r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0])); \
+    r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1])); \
+    r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0])); \
+    r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1])); \
+} while (0)
+#define V4_CMPGT(a, b) vreinterpretq_f32_u32(vcgtq_f32((a), (b)))
+#define V4_AND(m, a) vreinterpretq_f32_u32(vandq_u32( \
+    vreinterpretq_u32_f32(m), vreinterpretq_u32_f32(a)))
+#define V4_SELECT(m, a, b) vbslq_f32(vreinterpretq_u32_f32(m), (a), (b))
+#define V4_EXP2INT(n) vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32( \
+    vcvtq_s32_f32(n), vdupq_n_s32(127)), 23))
+#define V4_EXPONENT(a) vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32( \
+    vshrq_n_u32(vreinterpretq_u32_f32(a), 23)), vdupq_n_s32(127)))
+#define V4_MANTISSA(a) vreinterpretq_f32_u32(vorrq_u32(vandq_u32( \
+    vreinterpretq_u32_f32(a), vdupq_n_u32(0x007fffff)), \
+    vdupq_n_u32(0x3f800000)))
+#endif
+
+/* fast approximations of 2^x and log2(x), after Cephes' exp2f and logf, for
+the "fast" modes of the objects in d_math.c and x_acoustics.c.  Over the whole
+float range the relative error of fast_exp2() stays below 1.1e-7 and that of
+fast_log2() below 1e-7 (absolute error below 1e-7 for results in [-1, 1]),
+i.e., a couple of units in the last place.  fast_exp2() saturates at 2^-126
+and 2^127.49; fast_log2() expects x > 0 and treats denormals as 2^-126. */
+
+static inline float fast_exp2(float x)
+{
+    union { float f; int i; } u;
+    float n, p;
+    if (x < -126.f) x = -126.f;
+    else if (x > 127.49f) x = 127.49f;
+        /* round to nearest; the offset keeps the truncation positive */
+    n = (float)((int)(x + 126.5f) - 126);
+    x -= n;
+    p = 1.535336188319500e-4f;
+    p = p * x + 1.339887440266574e-3f;
+    p = p * x + 9.618437357674640e-3f;
+    p = p * x + 5.550332471162809e-2f;
+    p = p * x + 2.402264791363012e-1f;
+    p = p * x + 6.931472028550421e-1f;
+    p = p * x + 1.f;
+    u.i = ((int)n + 127) << 23;
+    return (p * u.f);
+}
+
+static inline float fast_log2(float x)
+{
+    union { float f; int i; } u;
+    float e, z, p;
+    u.f = (x < 1.17549435e-38f ? 1.17549435e-38f : x);
+    e = (float)(((u.i >> 23) & 0xff) - 127);
+    u.i = (u.i & 0x007fffff) | 0x3f800000;
+    if (u.f > 1.41421356f)
+        u.f *= 0.5f, e += 1.f;
+    x = u.f - 1.f;
+    z = x * x;
+    p = 7.0376836292e-2f;
+    p = p * x - 1.1514610310e-1f;
+    p = p * x + 1.1676998740e-1f;
+    p = p * x - 1.2420140846e-1f;
+    p = p * x + 1.4249322787e-1f;
+    p = p * x - 1.6668057665e-1f;
+    p = p * x + 2.0000714765e-1f;
+    p = p * x - 2.4999993993e-1f;
+    p = p * x + 3.3333331174e-1f;
+    return ((x + (x * z * p - 0.5f * z)) * 1.44269504f + e);
+}
+
+#ifdef PD_SIMD
+static inline t_v4 v4_exp2(t_v4 x)
+{
+    t_v4 n, p;
+    x = V4_MIN(V4_MAX(x, V4_SET1(-126.f)), V4_SET1(127.49f));
+    n = V4_SUB(V4_TRUNC(V4_ADD(x, V4_SET1(126.5f))), V4_SET1(126.f));
+    x = V4_SUB(x, n);
+    p = V4_ADD(V4_MUL(V4_SET1(1.535336188319500e-4f), x),
+        V4_SET1(1.339887440266574e-3f));
+    p = V4_ADD(V4_MUL(p, x), V4_SET1(9.618437357674640e-3f));
+    p = V4_ADD(V4_MUL(p, x), V4_SET1(5.550332471162809e-2f));
+    p = V4_ADD(V4_MUL(p, x), V4_SET1(2.402264791363012e-1f));
+    p = V4_ADD(V4_MUL(p, x), V4_SET1(6.931472028550421e-1f));
+    p = V4_ADD(V4_MUL(p, x), V4_SET1(1.f));
+    return (V4_MUL(p, V4_EXP2INT(n)));
+}
+
+static inline t_v4 v4_log2(t_v4 x)
+{
+    t_v4 e, m, big, z, p;
+    x = V4_MAX(x, V4_SET1(1.17549435e-38f));
+    e = V4_EXPONENT(x);
+    m = V4_MANTISSA(x);
+    big = V4_CMPGT(m, V4_SET1(1.41421356f));
+    m = V4_SELECT(big, V4_MUL(m, V4_SET1(0.5f)), m);
+    e = V4_ADD(e, V4_AND(big, V4_SET1(1.f)));
+    x = V4_SUB(m, V4_SET1(1.f));
+    z = V4_MUL(x, x);
+    p = V4_ADD(V4_MUL(V4_SET1(7.0376836292e-2f), x),
+        V4_SET1(-1.1514610310e-1f));
+    p = V4_ADD(V4_MUL(p, x), V4_SET1(1.1676998740e-1f));
+    p = V4_ADD(V4_MUL(p, x), V4_SET1(-1.2420140846e-1f));
+    p = V4_ADD(V4_MUL(p, x), V4_SET1(1.4249322787e-1f));
+    p = V4_ADD(V4_MUL(p, x), V4_SET1(-1.6668057665e-1f));
+    p = V4_ADD(V4_MUL(p, x), V4_SET1(2.0000714765e-1f));
+    p = V4_ADD(V4_MUL(p, x), V4_SET1(-2.4999993993e-1f));
+    p = V4_ADD(V4_MUL(p, x), V4_SET1(3.3333331174e-1f));
+    p = V4_SUB(V4_MUL(V4_MUL(x, z), p), V4_MUL(V4_SET1(0.5f), z));
+    return (V4_ADD(V4_MUL(V4_ADD(x, p), V4_SET1(1.44269504f)), e));
+}
+#endif /* PD_SIMD */
+
+#elif PD_FLOATSIZE == 64
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define PD_SIMD
+typedef __m256d t_v4;
+#define V4_LOAD(p) _mm256_loadu_pd(p)
+#define V4_STORE(p, v) _mm256_storeu_pd((p), (v))
+#define V4_SET1(f) _mm256_set1_pd(f)
+#define V4_ZERO() _mm256_setzero_pd()
+#define V4_ADD(a, b) _mm256_add_pd((a), (b))
+#define V4_SUB(a, b) _mm256_sub_pd((a), (b))
+#define V4_MUL(a, b) _mm256_mul_pd((a), (b))
+#define V4_MAX(a, b) _mm256_max_pd((a), (b))   /* b if a is NaN */
+#define V4_MIN(a, b) _mm256_min_pd((a), (b))
+#define V4_TRUNC(a) _mm256_round_pd((a), _MM_FROUND_TO_ZERO | \
+    _MM_FROUND_NO_EXC)
+#define V4_TRANSPOSE(r0, r1, r2, r3) do { \
+    __m256d t0 = _mm256_unpacklo_pd(r0, r1), t1 = _mm256_unpackhi_pd(r0, r1), \
+        t2 = _mm256_unpacklo_pd(r2, r3), t3 = _mm256_unpackhi_pd(r2, r3); \
+    r0 = _mm256_permute2f128_pd(t0, t2, 0x20); \
+    r1 = _mm256_permute2f128_pd(t1, t3, 0x20); \
+    r2 = _mm256_permute2f128_pd(t0, t2, 0x31); \
+    r3 = _mm256_permute2f128_pd(t1, t3, 0x31); \
+} while (0)
+#define V4_CMPGT(a, b) _mm256_cmp_pd((a), (b), _CMP_GT_OQ)
+#define V4_AND(m, a) _mm256_and_pd((m), (a))
+#define V4_SELECT(m, a, b) _mm256_blendv_pd((b), (a), (m))
+#define V4_LOAD_STRIDE2(p) _mm256_set_pd((p)[6], (p)[4], (p)[2], (p)[0])
+
+#elif defined(__SSE2__) || defined(_M_X64) || \
+    (defined(__aarch64__) && defined(__ARM_NEON))
+#define PD_SIMD
+    /* two 2-wide registers, "lo" holding lanes 0 and 1 and "hi" 2 and 3 */
+#ifdef __aarch64__
+#include <arm_neon.h>
+typedef float64x2_t t_v2;
+#define V2_LOAD(p) vld1q_f64(p)
+#define V2_STORE(p, v) vst1q_f64((p), (v))
+#define V2_SET1(f) vdupq_n_f64(f)
+#define V2_ADD(a, b) vaddq_f64((a), (b))
+#define V2_SUB(a, b) vsubq_f64((a), (b))
+#define V2_MUL(a, b) vmulq_f64((a), (b))
+#define V2_MAX(a, b) vbslq_f64(vcgtq_f64((a), (b)), (a), (b))
+#define V2_MIN(a, b) vbslq_f64(vcltq_f64((a), (b)), (a), (b))
+#define V2_TRUNC(a) vrndq_f64(a)
+#define V2_CMPGT(a, b) vreinterpretq_f64_u64(vcgtq_f64((a), (b)))
+#define V2_AND(m, a) vreinterpretq_f64_u64(vandq_u64( \
+    vreinterpretq_u64_f64(m), vreinterpretq_u64_f64(a)))
+#define V2_SELECT(m, a, b) vbslq_f64(vreinterpretq_u64_f64(m), (a), (b))
+#define V2_UNPACKLO(a, b) vzip1q_f64((a), (b))
+#define V2_UNPACKHI(a, b) vzip2q_f64((a), (b))
+#else
+#include <emmintrin.h>
+typedef __m128d t_v2;
+#define V2_LOAD(p) _mm_loadu_pd(p)
+#define V2_STORE(p, v) _mm_storeu_pd((p), (v))
+#define V2_SET1(f) _mm_set1_pd(f)
+#define V2_ADD(a, b) _mm_add_pd((a), (b))
+#define V2_SUB(a, b) _mm_sub_pd((a), (b))
+#define V2_MUL(a, b) _mm_mul_pd((a), (b))
+#define V2_MAX(a, b) _mm_max_pd((a), (b))
+#define V2_MIN(a, b) _mm_min_pd((a), (b))
+#define V2_TRUNC(a) _mm_cvtepi32_pd(_mm_cvttpd_epi32(a))
+#define V2_CMPGT(a, b) _mm_cmpgt_pd((a), (b))
+#define V2_AND(m, a) _mm_and_pd((m), (a))
+#define V2_SELECT(m, a, b) _mm_or_pd(_mm_and_pd((m), (a)), \
+    _mm_andnot_pd((m), (b)))
+#define V2_UNPACKLO(a, b) _mm_unpacklo_pd((a), (b))
+#define V2_UNPACKHI(a, b) _mm_unpackhi_pd((a), (b))
+#endif
+typedef struct _v4
+{
+    t_v2 lo;
+    t_v2 hi;
+} t_v4;
+
+#define V4_UNOP(name, op) static inline t_v4 name(t_v4 a) \
+    { t_v4 r; r.lo = op(a.lo); r.hi = op(a.hi); return (r); }
+#define V4_BINOP(name, op) static inline t_v4 name(t_v4 a, t_v4 b) \
+    { t_v4 r; r.lo = op(a.lo, b.lo); r.hi = op(a.hi, b.hi); return (r); }
+V4_BINOP(v4_add, V2_ADD)
+V4_BINOP(v4_sub, V2_SUB)
+V4_BINOP(v4_mul, V2_MUL)
+V4_BINOP(v4_max, V2_MAX)
+V4_BINOP(v4_min, V2_MIN)
+V4_BINOP(v4_cmpgt, V2_CMPGT)
+V4_BINOP(v4_and, V2_AND)
+V4_UNOP(v4_trunc, V2_TRUNC)
+
+static inline t_v4 v4_load(const double *p)
+{
+    t_v4 r; r.lo = V2_LOAD(p); r.hi = V2_LOAD(p + 2); return (r);
+}
+
+static inline void v4_store(double *p, t_v4 v)
+{
+    V2_STORE(p, v.lo); V2_STORE(p + 2, v.hi);
+}
+
+static inline t_v4 v4_set1(double f)
+{
+    t_v4 r; r.lo = r.hi = V2_SET1(f); return (r);
+}
+
+static inline t_v4 v4_select(t_v4 m, t_v4 a, t_v4 b)
+{
+    t_v4 r;
+    r.lo = V2_SELECT(m.lo, a.lo, b.lo);
+    r.hi = V2_SELECT(m.hi, a.hi, b.hi);
+    return (r);
+}
+
+static inline void v4_transpose(t_v4 *r0, t_v4 *r1, t_v4 *r2, t_v4 *r3)
+{
+    t_v4 t0, t1, t2, t3;
+    t0.lo = V2_UNPACKLO(r0->lo, r1->lo); t0.hi = V2_UNPACKLO(r2->lo, r3->lo);
+    t1.lo = V2_UNPACKHI(r0->lo, r1->lo); t1.hi = V2_UNPACKHI(r2->lo, r3->lo);
+    t2.lo = V2_UNPACKLO(r0->hi, r1->hi); t2.hi = V2_UNPACKLO(r2->hi, r3->hi);
+    t3.lo = V2_UNPACKHI(r0->hi, r1->hi); t3.hi = V2_UNPACKHI(r2->hi, r3->hi);
+    *r0 = t0; *r1 = t1; *r2 = t2; *r3 = t3;
+}
+
+static inline t_v4 v4_loadstride2(const double *p)
+{
+    double f[4];
+    f[0] = p[0]; f[1] = p[2]; f[2] = p[4]; f[3] = p[6];
+    return (v4_load(f));
+}
+
+#define V4_LOAD(p) v4_load(p)
+#define V4_STORE(p, v) v4_store((p), (v))
+#define V4_SET1(f) v4_set1(f)
+#define V4_ZERO() v4_set1(0)
+#define V4_ADD(a, b) v4_add((a), (b))
+#define V4_SUB(a, b) v4_sub((a), (b))
+#define V4_MUL(a, b) v4_mul((a), (b))
+#define V4_MAX(a, b) v4_max((a), (b))   /* b if a is NaN */
+#define V4_MIN(a, b) v4_min((a), (b))
+#define V4_TRUNC(a) v4_trunc(a)
+#define V4_TRANSPOSE(r0, r1, r2, r3) v4_transpose(&(r0), &(r1), &(r2), &(r3))
+#define V4_CMPGT(a, b) v4_cmpgt((a), (b))
+#define V4_AND(m, a) v4_and((m), (a))
+#define V4_SELECT(m, a, b) v4_select((m), (a), (b))
+#define V4_LOAD_STRIDE2(p) v4_loadstride2(p)
+#endif
+
+    /* in double precision the "fast" modes just use libm, except that like
+    the single-precision versions fast_log2() gives -126 for x <= 0. */
+#include <math.h>
+
+static inline double fast_exp2(double x)
+{
+    return (exp(x * 0.69314718055994531));
+}
+
+static inline double fast_log2(double x)
+{
+    return (x > 0 ? log(x) * 1.4426950408889634 : -126);
+}
+
+#ifdef PD_SIMD
+static inline t_v4 v4_exp2(t_v4 x)
+{
+    double f[4];
+    int i;
+    V4_STORE(f, x);
+    for (i = 0; i < 4; i++)
+        f[i] = fast_exp2(f[i]);
+    return (V4_LOAD(f));
+}
+
+static inline t_v4 v4_log2(t_v4 x)
+{
+    double f[4];
+    int i;
+    V4_STORE(f, x);
+    for (i = 0; i < 4; i++)
+        f[i] = fast_log2(f[i]);
+    return (V4_LOAD(f));
+}
+#endif /* PD_SIMD */
+
+#endif /* PD_FLOATSIZE */
+
+#endif /* __d_simd_h_ */
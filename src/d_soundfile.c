@@ -11,10 +11,19 @@ readsf~ and writesf~ are defined which confine disk operations to a separate
 thread so that they can be used in real time.  The readsf~ and writesf~
 objects use Posix-like threads. */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE     /* for fallocate() and sync_file_range() */
+#endif
 #include "d_soundfile.h"
+#include "m_imp.h"
+#include "s_stuff.h"
 #ifdef _WIN32
 #include <io.h>
+#else
+#include <sys/mman.h>
+#define SOUNDFILE_MMAP
 #endif
+#include <sys/stat.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <pthread.h>
@@ -108,7 +117,7 @@ static void object_sferror(const void *x, const char *header,
 
 /* ----- soundfile type ----- */
 
-#define SFMAXTYPES 4
+#define SFMAXTYPES 8
 
 /* should these globals be PERTHREAD? */
 
@@ -130,6 +139,7 @@ void soundfile_wave_setup( void);
 void soundfile_aiff_setup( void);
 void soundfile_caf_setup( void);
 void soundfile_next_setup( void);
+void soundfile_flac_setup( void);
 
     /** set up built-in types */
 void soundfile_type_setup( void)
@@ -138,6 +148,7 @@ void soundfile_type_setup( void)
     soundfile_aiff_setup();
     soundfile_caf_setup();
     soundfile_next_setup();
+    soundfile_flac_setup();
 }
 
 int soundfile_addtype(const t_soundfile_type *type)
@@ -230,6 +241,20 @@ ssize_t fd_write(int fd, off_t offset, const void *src, size_t size)
     return write(fd, src, size);
 }
 
+ssize_t soundfile_read(t_soundfile *sf, void *buf, size_t size)
+{
+    if (sf->sf_data)
+        return sf->sf_type->t_readsamplesfn(sf, buf, size);
+    return read(sf->sf_fd, buf, size);
+}
+
+void soundfile_freedata(t_soundfile *sf)
+{
+    if (sf->sf_data && sf->sf_type && sf->sf_type->t_freedatafn)
+        sf->sf_type->t_freedatafn(sf);
+    sf->sf_data = NULL;
+}
+
 /* ----- byte swappers ----- */
 
 int sys_isbigendian(void)
@@ -378,9 +403,17 @@ int open_soundfile_via_fd(int fd, t_soundfile *sf, size_t skipframes)
     }
 
         /* seek past header and any sample frames to skip */
-    offset = sf->sf_headersize + (skipframes * sf->sf_bytesperframe);
-    if (lseek(sf->sf_fd, offset, 0) < offset)
-        goto badheader;
+    if (sf->sf_data)
+    {
+        if (!sf->sf_type->t_seekfn(sf, skipframes))
+            goto badheader;
+    }
+    else
+    {
+        offset = sf->sf_headersize + (skipframes * sf->sf_bytesperframe);
+        if (lseek(sf->sf_fd, offset, 0) < offset)
+            goto badheader;
+    }
     sf->sf_bytelimit -= skipframes * sf->sf_bytesperframe;
     if (sf->sf_bytelimit < 0)
         sf->sf_bytelimit = 0;
@@ -393,6 +426,7 @@ badheader:
         print out the error... */
     if (!errno)
         errno = SOUNDFILE_ERRMALFORMED;
+    soundfile_freedata(sf);
     sf->sf_fd = -1;
     if (fd >= 0)
         sys_close(fd);
@@ -431,150 +465,204 @@ int open_soundfile_via_canvas(t_canvas *canvas, const char *filename,
     return sf_fd;
 }
 
-static void soundfile_xferin_sample(const t_soundfile *sf, int nvecs,
-    t_sample **vecs, size_t framesread, unsigned char *buf, size_t nframes)
+    /* convert one channel of nframes interleaved samples to floats.  When
+    the file's byte order is the machine's, 16-bit and float samples are
+    loaded whole, which the compiler can turn into vector code; otherwise
+    they're assembled byte by byte. */
+static void soundfile_xferin_column(const t_soundfile *sf, int native,
+    const unsigned char *sp, t_sample *fp, size_t nframes)
 {
-    int nchannels = (sf->sf_nchannels < nvecs ? sf->sf_nchannels : nvecs), i;
-    size_t j;
-    unsigned char *sp, *sp2;
-    t_sample *fp;
-    for (i = 0, sp = buf; i < nchannels; i++, sp += sf->sf_bytespersample)
+    size_t j, stride = sf->sf_bytesperframe;
+    if (sf->sf_bytespersample == 2)
     {
-        if (sf->sf_bytespersample == 2)
+        if (native)
         {
-            if (sf->sf_bigendian)
-            {
-                for (j = 0, sp2 = sp, fp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, fp++)
-                        *fp = SCALE * ((sp2[0] << 24) | (sp2[1] << 16));
-            }
-            else
+            short s;
+            for (j = 0; j < nframes; j++, sp += stride)
             {
-                for (j = 0, sp2 = sp, fp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, fp++)
-                        *fp = SCALE * ((sp2[1] << 24) | (sp2[0] << 16));
+                memcpy(&s, sp, 2);
+                fp[j] = s * (t_sample)(1. / 32768.);
             }
         }
-        else if (sf->sf_bytespersample == 3)
+        else if (sf->sf_bigendian)
         {
-            if (sf->sf_bigendian)
-            {
-                for (j = 0, sp2 = sp, fp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, fp++)
-                        *fp = SCALE * ((sp2[0] << 24) | (sp2[1] << 16) |
-                                       (sp2[2] << 8));
-            }
-            else
+            for (j = 0; j < nframes; j++, sp += stride)
+                fp[j] = SCALE *
+                    (int32_t)(((uint32_t)sp[0] << 24) | (sp[1] << 16));
+        }
+        else
+        {
+            for (j = 0; j < nframes; j++, sp += stride)
+                fp[j] = SCALE *
+                    (int32_t)(((uint32_t)sp[1] << 24) | (sp[0] << 16));
+        }
+    }
+    else if (sf->sf_bytespersample == 3)
+    {
+        if (sf->sf_bigendian)
+        {
+            for (j = 0; j < nframes; j++, sp += stride)
+                fp[j] = SCALE * (int32_t)(((uint32_t)sp[0] << 24) |
+                    (sp[1] << 16) | (sp[2] << 8));
+        }
+        else
+        {
+            for (j = 0; j < nframes; j++, sp += stride)
+                fp[j] = SCALE * (int32_t)(((uint32_t)sp[2] << 24) |
+                    (sp[1] << 16) | (sp[0] << 8));
+        }
+    }
+    else if (sf->sf_bytespersample == 4)
+    {
+        t_floatuint alias;
+        if (native)
+        {
+            for (j = 0; j < nframes; j++, sp += stride)
             {
-                for (j = 0, sp2 = sp, fp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, fp++)
-                        *fp = SCALE * ((sp2[2] << 24) | (sp2[1] << 16) |
-                                       (sp2[0] << 8));
+                memcpy(&alias.ui, sp, 4);
+                fp[j] = (t_sample)alias.f;
             }
         }
-        else if (sf->sf_bytespersample == 4)
+        else if (sf->sf_bigendian)
         {
-            t_floatuint alias;
-            if (sf->sf_bigendian)
+            for (j = 0; j < nframes; j++, sp += stride)
             {
-                for (j = 0, sp2 = sp, fp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, fp++)
-                {
-                    alias.ui = ((sp2[0] << 24) | (sp2[1] << 16) |
-                                (sp2[2] << 8)  |  sp2[3]);
-                    *fp = (t_sample)alias.f;
-                }
+                alias.ui = (((uint32_t)sp[0] << 24) | (sp[1] << 16) |
+                            (sp[2] << 8)  |  sp[3]);
+                fp[j] = (t_sample)alias.f;
             }
-            else
+        }
+        else
+        {
+            for (j = 0; j < nframes; j++, sp += stride)
             {
-                for (j = 0, sp2 = sp, fp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, fp++)
-                {
-                    alias.ui = ((sp2[3] << 24) | (sp2[2] << 16) |
-                                (sp2[1] << 8)  |  sp2[0]);
-                    *fp = (t_sample)alias.f;
-                }
+                alias.ui = (((uint32_t)sp[3] << 24) | (sp[2] << 16) |
+                            (sp[1] << 8)  |  sp[0]);
+                fp[j] = (t_sample)alias.f;
             }
         }
     }
+}
+
+    /* frames converted at a time, so that all channels are taken from the
+    buffer while it's still in the cache */
+#define XFERBLOCK 256
+
+static void soundfile_xferin_sample(const t_soundfile *sf, int nvecs,
+    t_sample **vecs, size_t framesread, unsigned char *buf, size_t nframes)
+{
+    int nchannels = (sf->sf_nchannels < nvecs ? sf->sf_nchannels : nvecs), i,
+        native = (sf->sf_bigendian == sys_isbigendian());
+    size_t j, n;
+    t_sample *fp;
+    for (j = 0; j < nframes; j += n)
+    {
+        n = (nframes - j > XFERBLOCK ? XFERBLOCK : nframes - j);
+        for (i = 0; i < nchannels; i++)
+            soundfile_xferin_column(sf, native,
+                buf + j * sf->sf_bytesperframe + i * sf->sf_bytespersample,
+                    vecs[i] + framesread + j, n);
+    }
         /* zero out other outputs */
     for (i = sf->sf_nchannels; i < nvecs; i++)
-        for (j = nframes, fp = vecs[i]; j--;)
+        for (j = nframes, fp = vecs[i] + framesread; j--;)
             *fp++ = 0;
 }
 
 static void soundfile_xferin_words(const t_soundfile *sf, int nvecs,
     t_word **vecs, size_t framesread, unsigned char *buf, size_t nframes)
 {
-    unsigned char *sp, *sp2;
+    int nchannels = (sf->sf_nchannels < nvecs ? sf->sf_nchannels : nvecs), i,
+        native = (sf->sf_bigendian == sys_isbigendian());
+    size_t j, k, n;
     t_word *wp;
-    int nchannels = (sf->sf_nchannels < nvecs ? sf->sf_nchannels : nvecs), i;
-    size_t j;
-    for (i = 0, sp = buf; i < nchannels; i++, sp += sf->sf_bytespersample)
+    t_sample tmp[XFERBLOCK];
+    for (j = 0; j < nframes; j += n)
     {
-        if (sf->sf_bytespersample == 2)
-        {
-            if (sf->sf_bigendian)
-            {
-                for (j = 0, sp2 = sp, wp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, wp++)
-                        wp->w_float = SCALE * ((sp2[0] << 24) | (sp2[1] << 16));
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, wp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, wp++)
-                        wp->w_float = SCALE * ((sp2[1] << 24) | (sp2[0] << 16));
-            }
-        }
-        else if (sf->sf_bytespersample == 3)
-        {
-            if (sf->sf_bigendian)
-            {
-                for (j = 0, sp2 = sp, wp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, wp++)
-                        wp->w_float = SCALE * ((sp2[0] << 24) | (sp2[1] << 16) |
-                                               (sp2[2] << 8));
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, wp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, wp++)
-                        wp->w_float = SCALE * ((sp2[2] << 24) | (sp2[1] << 16) |
-                                               (sp2[0] << 8));
-            }
-        }
-        else if (sf->sf_bytespersample == 4)
+        n = (nframes - j > XFERBLOCK ? XFERBLOCK : nframes - j);
+        for (i = 0; i < nchannels; i++)
         {
-            t_floatuint alias;
-            if (sf->sf_bigendian)
-            {
-                for (j = 0, sp2 = sp, wp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, wp++)
-                {
-                    alias.ui = ((sp2[0] << 24) | (sp2[1] << 16) |
-                                (sp2[2] << 8)  |  sp2[3]);
-                    wp->w_float = (t_float)alias.f;
-                }
-            }
-            else
-            {
-                for (j = 0, sp2 = sp, wp = vecs[i] + framesread;
-                    j < nframes; j++, sp2 += sf->sf_bytesperframe, wp++)
-                {
-                    alias.ui = ((sp2[3] << 24) | (sp2[2] << 16) |
-                                (sp2[1] << 8)  |  sp2[0]);
-                    wp->w_float = (t_float)alias.f;
-                }
-            }
+            soundfile_xferin_column(sf, native,
+                buf + j * sf->sf_bytesperframe + i * sf->sf_bytespersample,
+                    tmp, n);
+            for (k = 0, wp = vecs[i] + framesread + j; k < n; k++)
+                wp[k].w_float = tmp[k];
         }
     }
         /* zero out other outputs */
     for (i = sf->sf_nchannels; i < nvecs; i++)
-        for (j = nframes, wp = vecs[i]; j--;)
+        for (j = nframes, wp = vecs[i] + framesread; j--;)
             (wp++)->w_float = 0;
 }
 
+    /* big conversions are split into ranges of frames, each converted in
+    a thread of its own */
+#define XFERPARALLEL (1 << 20)  /* samples per thread worth starting one */
+#define XFERMAXTHREADS 8
+
+typedef struct _xferjob
+{
+    const t_soundfile *j_sf;
+    int j_nvecs;
+    t_word **j_vecs;
+    size_t j_onset;
+    unsigned char *j_buf;
+    size_t j_nframes;
+} t_xferjob;
+
+static void *soundfile_xferjob(void *z)
+{
+    t_xferjob *j = (t_xferjob *)z;
+    int affinityserial = -1;
+    sys_bindthread(AFFINITY_DISK, &affinityserial);
+    soundfile_xferin_words(j->j_sf, j->j_nvecs, j->j_vecs, j->j_onset,
+        j->j_buf, j->j_nframes);
+    return (0);
+}
+
+static void soundfile_xferin_parallel(const t_soundfile *sf, int nvecs,
+    t_word **vecs, unsigned char *buf, size_t nframes)
+{
+    t_xferjob job[XFERMAXTHREADS];
+    pthread_t thread[XFERMAXTHREADS];
+    int started[XFERMAXTHREADS], nthreads = 1, i;
+    size_t onset, per;
+#ifdef _SC_NPROCESSORS_ONLN
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t nsamples = nframes * (nvecs > sf->sf_nchannels ?
+        nvecs : sf->sf_nchannels);
+    nthreads = (ncpu > XFERMAXTHREADS ? XFERMAXTHREADS : (int)ncpu);
+    if (nsamples / XFERPARALLEL < (size_t)nthreads)
+        nthreads = (int)(nsamples / XFERPARALLEL);
+#endif
+    if (nthreads < 2)
+    {
+        soundfile_xferin_words(sf, nvecs, vecs, 0, buf, nframes);
+        return;
+    }
+        /* ranges are whole numbers of blocks */
+    per = (nframes / nthreads + XFERBLOCK - 1) / XFERBLOCK * XFERBLOCK;
+    for (i = 0, onset = 0; i < nthreads; i++, onset += per)
+    {
+        job[i].j_sf = sf;
+        job[i].j_nvecs = nvecs;
+        job[i].j_vecs = vecs;
+        job[i].j_onset = (onset < nframes ? onset : nframes);
+        job[i].j_buf = buf + job[i].j_onset * sf->sf_bytesperframe;
+        job[i].j_nframes = (i == nthreads - 1 ? nframes - job[i].j_onset :
+            (onset + per < nframes ? onset + per : nframes) - job[i].j_onset);
+            /* the calling thread takes the first range */
+        started[i] = (i > 0 &&
+            !pthread_create(&thread[i], 0, soundfile_xferjob, &job[i]));
+    }
+    for (i = 0; i < nthreads; i++)
+        if (!started[i])
+            soundfile_xferjob(&job[i]);
+    for (i = 1; i < nthreads; i++)
+        if (started[i])
+            pthread_join(thread[i], 0);
+}
+
     /* soundfiler_write ...
 
        usage: write [flags] filename table ...
@@ -605,6 +693,7 @@ typedef struct _soundfiler_writeargs
     size_t wa_onsetframes;            /* sample frame onset when writing */
     int wa_normalize;                 /* normalize samples? */
     int wa_ascii;                     /* write ascii? */
+    int wa_async;                     /* write in another thread? */
 } t_soundfiler_writeargs;
 
 
@@ -621,7 +710,7 @@ static int soundfiler_parsewriteargs(void *obj, int *p_argc, t_atom **p_argv,
     t_atom *argv = *p_argv;
     int samplerate = -1, bytespersample = 2, bigendian = 0, endianness = -1;
     size_t nframes = SFMAXFRAMES, onsetframes = 0;
-    int normalize = 0, ascii = 0;
+    int normalize = 0, ascii = 0, async = 0;
     t_symbol *filesym;
     t_soundfile_type *type = NULL;
 
@@ -680,6 +769,11 @@ static int soundfiler_parsewriteargs(void *obj, int *p_argc, t_atom **p_argv,
             ascii = 1;
             argc -= 1; argv += 1;
         }
+        else if (!strcmp(flag, "async"))
+        {
+            async = 1;
+            argc -= 1; argv += 1;
+        }
         else if (!strcmp(flag, "nextstep"))
         {
                 /* handle old "-nextstep" alias */
@@ -739,6 +833,7 @@ static int soundfiler_parsewriteargs(void *obj, int *p_argc, t_atom **p_argv,
     wa->wa_onsetframes = onsetframes;
     wa->wa_normalize = normalize;
     wa->wa_ascii = ascii;
+    wa->wa_async = async;
     return 0;
 }
 
@@ -756,7 +851,9 @@ static int create_soundfile(t_canvas *canvas, const char *filename,
         if (!sf->sf_type->t_addextensionfn(filenamebuf, MAXPDSTRING-10))
             return -1;
     filenamebuf[MAXPDSTRING-10] = 0; /* FIXME: what is the 10 for? */
-    canvas_makefilename(canvas, filenamebuf, pathbuf, MAXPDSTRING);
+    if (canvas)
+        canvas_makefilename(canvas, filenamebuf, pathbuf, MAXPDSTRING);
+    else strcpy(pathbuf, filenamebuf);
     if ((fd = sys_open(pathbuf, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
         return -1;
     sf->sf_fd = fd;
@@ -1003,28 +1100,203 @@ static void soundfile_xferout_words(const t_soundfile *sf, t_word **vecs,
     }
 }
 
+/* ----- memory-mapped reading ----- */
+
+    /* map the sample data of an open soundfile, from the current file
+    position up to the byte limit or maxframes, so that it can be converted in place
+    rather than copied through read() calls.  Returns 0 if the file can't
+    be mapped (not a regular file or no mmap() on this platform), in which
+    case the caller just reads it as usual. */
+
+typedef struct _sfmap
+{
+    char *m_base;           /* start of the mapping (page aligned) */
+    size_t m_length;        /* its length */
+    unsigned char *m_data;  /* first byte of sample data */
+    size_t m_size;          /* bytes of whole frames from there on */
+} t_sfmap;
+
+static int sfmap_open(t_sfmap *m, const t_soundfile *sf, size_t maxframes)
+{
+#ifdef SOUNDFILE_MMAP
+    struct stat statbuf;
+    off_t pos, start;
+    size_t size;
+    char *base;
+    long pagesize = sysconf(_SC_PAGESIZE);
+    m->m_base = 0;
+    m->m_data = 0;
+    if (sf->sf_data)    /* compressed, must be decoded */
+        return (0);
+    if (pagesize <= 0 || fstat(sf->sf_fd, &statbuf) < 0 ||
+        !S_ISREG(statbuf.st_mode) ||
+            (pos = lseek(sf->sf_fd, 0, SEEK_CUR)) < 0 ||
+                pos >= statbuf.st_size)
+                    return (0);
+    size = statbuf.st_size - pos;
+    if (sf->sf_bytelimit >= 0 && size > (size_t)sf->sf_bytelimit)
+        size = sf->sf_bytelimit;
+    size -= size % sf->sf_bytesperframe;
+    if (size / sf->sf_bytesperframe > maxframes)
+        size = maxframes * sf->sf_bytesperframe;
+    if (!size)
+        return (0);
+    start = pos - (pos % pagesize);
+    base = mmap(0, size + (pos - start), PROT_READ, MAP_SHARED,
+        sf->sf_fd, start);
+    if (base == MAP_FAILED)
+        return (0);
+    m->m_base = base;
+    m->m_length = size + (pos - start);
+    m->m_data = (unsigned char *)base + (pos - start);
+    m->m_size = size;
+    madvise(base, m->m_length, MADV_SEQUENTIAL);
+    return (1);
+#else
+    m->m_base = 0;
+    m->m_data = 0;
+    return (0);
+#endif
+}
+
+    /* get the pages holding the given byte range into memory.  This may
+    block, so call it from the I/O side, not the audio thread. */
+static void sfmap_fetch(const t_sfmap *m, size_t onset, size_t n)
+{
+#ifdef SOUNDFILE_MMAP
+    long pagesize = sysconf(_SC_PAGESIZE);
+    size_t from = (m->m_data - (unsigned char *)m->m_base) + onset,
+        aligned, i;
+    volatile char c;
+    if (pagesize <= 0 || !n)
+        return;
+    aligned = from - (from % pagesize);
+    madvise(m->m_base + aligned, n + (from - aligned), MADV_WILLNEED);
+        /* touch each page so that it's faulted in here */
+    for (i = 0; i < n; i += pagesize)
+        c = m->m_data[onset + i];
+    c = m->m_data[onset + n - 1];
+    (void)c;
+#endif
+}
+
+static void sfmap_close(t_sfmap *m)
+{
+#ifdef SOUNDFILE_MMAP
+    if (m->m_base)
+        munmap(m->m_base, m->m_length);
+#endif
+    m->m_base = 0;
+    m->m_data = 0;
+}
+
 /* ----- soundfiler - reads and writes soundfiles to/from "garrays" ----- */
 
 #define SAMPBUFSIZE 1024
 
 static t_class *soundfiler_class;
 
+struct _sfasync;
+
 typedef struct _soundfiler
 {
     t_object x_obj;
     t_outlet *x_out2;
     t_canvas *x_canvas;
+    struct _sfasync *x_async;   /* "-async" transfers in progress */
+    t_clock *x_clock;           /* to poll them */
 } t_soundfiler;
 
+static void soundfiler_poll(t_soundfiler *x);
+
 static t_soundfiler *soundfiler_new(void)
 {
     t_soundfiler *x = (t_soundfiler *)pd_new(soundfiler_class);
     x->x_canvas = canvas_getcurrent();
     outlet_new(&x->x_obj, &s_float);
     x->x_out2 = outlet_new(&x->x_obj, &s_float);
+    x->x_async = 0;
+    x->x_clock = clock_new(x, (t_method)soundfiler_poll);
     return x;
 }
 
+    /* read up to nframes frames from an open soundfile into vecs, directly
+    from a mapping of the file if possible */
+static size_t soundfiler_readsamples(t_soundfile *sf, int nvecs, t_word **vecs,
+    size_t nframes)
+{
+    char sampbuf[SAMPBUFSIZE];
+    size_t framesread, bufframes, wantframes;
+    ssize_t thisread;
+    t_sfmap map;
+    if (sfmap_open(&map, sf, nframes))
+    {
+        framesread = map.m_size / sf->sf_bytesperframe;
+        soundfile_xferin_parallel(sf, nvecs, vecs, map.m_data, framesread);
+        sfmap_close(&map);
+        return (framesread);
+    }
+    bufframes = SAMPBUFSIZE / sf->sf_bytesperframe;
+    for (framesread = 0; framesread < nframes;)
+    {
+            /* nframes may be SFMAXFRAMES, so don't go through ssize_t */
+        wantframes = nframes - framesread;
+        if (wantframes > bufframes)
+            wantframes = bufframes;
+        thisread = soundfile_read(sf, sampbuf,
+            wantframes * sf->sf_bytesperframe) / sf->sf_bytesperframe;
+        if (thisread <= 0) break;
+        soundfile_xferin_words(sf, nvecs, vecs, framesread,
+            (unsigned char *)sampbuf, thisread);
+        framesread += thisread;
+    }
+    return (framesread);
+}
+
+static int soundfiler_readasync(t_soundfiler *x, t_soundfile *sf,
+    const char *filename, int argc, t_atom *argv, size_t size,
+    size_t nframes, int resize, int pack);
+
+int garray_share(t_garray *x, const char *key, int publish);
+int garray_pack(t_garray *x, int bits);
+
+    /* With "-share", tables read from the same frames of the same file,
+    in the same format, share one copy of the points (see garray_share()
+    in g_array.c), even across Pd instances.  The file is known by its
+    device and inode number, or on Windows its name, along with its size
+    and modification time, so that a changed file is read again.  Tables
+    in excess of the file's channels share zeros.  Without "publish" this
+    returns true if all the tables could be made to share existing points
+    so that there's nothing to read. */
+static int soundfiler_share(t_soundfiler *x, const char *filename,
+    const t_soundfile *sf, size_t skipframes, size_t nframes,
+    int ntables, t_garray **garrays, int publish)
+{
+    char key[MAXPDSTRING + 200], *cp;
+    struct stat statbuf;
+    int i, nshared = 0;
+    if (fstat(sf->sf_fd, &statbuf) < 0)
+        return (0);
+#ifdef _WIN32
+    snprintf(key, MAXPDSTRING, "%s/%s", canvas_getdir(x->x_canvas)->s_name,
+        filename);
+#else
+    snprintf(key, MAXPDSTRING, "%lu:%lu", (unsigned long)statbuf.st_dev,
+        (unsigned long)statbuf.st_ino);
+#endif
+    cp = key + strlen(key);
+    for (i = 0; i < ntables; i++)
+    {
+        snprintf(cp, 200, "|%lld|%lld|%ld|%ld|%ld|%d|%d|%d|%d",
+            (long long)statbuf.st_size, (long long)statbuf.st_mtime,
+            (long)skipframes, (long)nframes, (long)sf->sf_headersize,
+            sf->sf_nchannels, sf->sf_bytespersample, sf->sf_bigendian,
+            (i < sf->sf_nchannels ? i : -1));
+        nshared += garray_share(garrays[i], key, publish);
+    }
+    return (nshared == ntables);
+}
+
 static int soundfiler_readascii(t_soundfiler *x, const char *filename,
     t_asciiargs *a)
 {
@@ -1106,6 +1378,7 @@ done:
            -skip <frames> ... frames to skip in file
            -raw <headersize channels bytespersample endian>
            -resize
+           -share ... share points with other tables read from the same file
            -maxsize <maxsize>
            -wave
            -aiff
@@ -1118,15 +1391,14 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
     int argc, t_atom *argv)
 {
     t_soundfile sf = {0};
-    int fd = -1, resize = 0, ascii = 0, i;
+    int fd = -1, resize = 0, ascii = 0, async = 0, share = 0, pack = 0, i;
     size_t skipframes = 0, finalsize = 0, maxsize = SFMAXFRAMES,
-           framesread = 0, bufframes, j;
-    ssize_t nframes, framesinfile;
+           framesread = 0, j;
+    ssize_t framesinfile;
     char endianness;
     const char *filename;
     t_garray *garrays[MAXSFCHANS];
     t_word *vecs[MAXSFCHANS];
-    char sampbuf[SAMPBUFSIZE];
 
     soundfile_clear(&sf);
     sf.sf_headersize = -1;
@@ -1183,6 +1455,24 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
             resize = 1;
             argc -= 1; argv += 1;
         }
+        else if (!strcmp(flag, "async"))
+        {
+            async = 1;
+            argc -= 1; argv += 1;
+        }
+        else if (!strcmp(flag, "pack"))
+        {
+            if (argc < 2 || argv[1].a_type != A_FLOAT ||
+                ((pack = argv[1].a_w.w_float) != 16 && pack != 24))
+                    goto usage;
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(flag, "share"))
+        {
+            share = 1;
+            resize = 1;     /* tables take the file's size */
+            argc -= 1; argv += 1;
+        }
         else if (!strcmp(flag, "maxsize"))
         {
             ssize_t tmp;
@@ -1233,7 +1523,7 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
                 argv[i].a_w.w_symbol->s_name);
             goto done;
         }
-        else if (!garray_getfloatwords(garrays[i], &vecsize,
+        else if (!garray_getfloatwords_readonly(garrays[i], &vecsize,
                 &vecs[i]))
             pd_error(x, "soundfiler read: %s: bad template for tabwrite",
                 argv[i].a_w.w_symbol->s_name);
@@ -1273,6 +1563,25 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
     }
     framesinfile = sf.sf_bytelimit / sf.sf_bytesperframe;
 
+        /* with "-async", hand the file over to another thread that reads
+        into new vectors, to be swapped into the tables when it's done */
+    if (async && argc && !share)
+    {
+        size_t size = finalsize,
+            avail = (framesinfile > 0 ? (size_t)framesinfile : 0);
+        if (resize)
+        {
+            size = (avail > maxsize ? maxsize : avail);
+            if (size < avail)
+                pd_error(x, "soundfiler read: truncated to %ld elements",
+                    (long)maxsize);
+        }
+        if (size > 0 && size < INT_MAX && soundfiler_readasync(x, &sf,
+            filename, argc, argv, size, (size < avail ? size : avail),
+                resize, pack))
+                    return;
+    }
+
     if (resize)
     {
             /* figure out what to resize to using header info */
@@ -1283,6 +1592,14 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
             framesinfile = maxsize;
         }
         finalsize = framesinfile;
+        if (share && argc && soundfiler_share(x, filename, &sf, skipframes,
+            finalsize, argc, garrays, 0))
+        {
+            framesread = finalsize;
+            for (i = 0; i < argc; i++)
+                garray_setsaveit(garrays[i], 0);
+            goto done;
+        }
         for (i = 0; i < argc; i++)
         {
             int vecsize;
@@ -1313,18 +1630,7 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
     }
 
         /* read */
-    bufframes = SAMPBUFSIZE / sf.sf_bytesperframe;
-    for (framesread = 0; framesread < finalsize;)
-    {
-        size_t thisread = finalsize - framesread;
-        thisread = (thisread > bufframes ? bufframes : thisread);
-        nframes = read(sf.sf_fd, sampbuf,
-            thisread * sf.sf_bytesperframe) / sf.sf_bytesperframe;
-        if (nframes <= 0) break;
-        soundfile_xferin_words(&sf, argc, vecs, framesread,
-            (unsigned char *)sampbuf, nframes);
-        framesread += nframes;
-    }
+    framesread = soundfiler_readsamples(&sf, argc, vecs, finalsize);
 
         /* zero out remaining elements of vectors */
     for (i = 0; i < argc; i++)
@@ -1343,16 +1649,24 @@ static void soundfiler_read(t_soundfiler *x, t_symbol *s,
             for (j = 0; j < (size_t)vecsize; j++)
                 foo[j].w_float = 0;
     }
+    if (share)
+        soundfiler_share(x, filename, &sf, skipframes, finalsize,
+            argc, garrays, 1);
+    else if (pack)
+        for (i = 0; i < argc; i++)
+            garray_pack(garrays[i], pack);
         /* do all graphics updates */
     for (i = 0; i < argc; i++)
         garray_redraw(garrays[i]);
     goto done;
 usage:
     pd_error(x, "usage: read [flags] filename [tablename]...");
-    post("flags: -skip <n> -resize -maxsize <n> %s -ascii ...", sf_typeargs);
+    post("flags: -skip <n> -resize -maxsize <n> -async -share -pack <16|24>"
+        " %s -ascii ...", sf_typeargs);
     post("-raw <headerbytes> <channels> <bytespersample> "
          "<endian (b, l, or n)>");
 done:
+    soundfile_freedata(&sf);
     sf.sf_fd = -1;
     if (fd >= 0)
         sys_close(fd);
@@ -1390,15 +1704,57 @@ int soundfiler_writeascii(t_soundfiler *x, const char *filename, t_asciiargs *a)
 
     /** this is broken out from soundfiler_write below so garray_write can
         call it too... not done yet though. */
-size_t soundfiler_dowrite(void *obj, t_canvas *canvas,
-    int argc, t_atom *argv, t_soundfile *sf)
+    /* write nframes frames from vectors, starting at onset, to an open
+    soundfile, then fix up its header and close it.  If a write fails, the
+    error is returned in *errp. */
+static size_t soundfiler_writesamples(void *obj, const char *filename,
+    t_soundfile *sf, t_word **vectors, size_t onsetframes, size_t nframes,
+    t_sample normfactor, int *errp)
+{
+    char sampbuf[SAMPBUFSIZE];
+    size_t bufframes = SAMPBUFSIZE / sf->sf_bytesperframe, frameswritten;
+    *errp = 0;
+    for (frameswritten = 0; frameswritten < nframes;)
+    {
+        size_t thiswrite = nframes - frameswritten,
+               datasize;
+        ssize_t byteswritten;
+        thiswrite = (thiswrite > bufframes ? bufframes : thiswrite);
+        datasize = sf->sf_bytesperframe * thiswrite;
+        soundfile_xferout_words(sf, vectors, (unsigned char *)sampbuf,
+            thiswrite, onsetframes, normfactor);
+        byteswritten = write(sf->sf_fd, sampbuf, datasize);
+        if (byteswritten < (ssize_t)datasize)
+        {
+            *errp = errno;
+            if (byteswritten > 0)
+                frameswritten += byteswritten / sf->sf_bytesperframe;
+            break;
+        }
+        frameswritten += thiswrite;
+        onsetframes += thiswrite;
+    }
+        /* update header frame size */
+    soundfile_finishwrite(obj, filename, sf, nframes, frameswritten);
+    sys_close(sf->sf_fd);
+    return (frameswritten);
+}
+
+static int soundfiler_writeasync(t_soundfiler *x, t_soundfile *sf,
+    const char *filename, t_word **vectors, size_t onsetframes,
+    size_t nframes, t_sample normfactor);
+
+    /* the work of soundfiler_dowrite().  If "async" is set and the write
+    is handed over to another thread, this returns 0 with sf->sf_fd still
+    set. */
+static size_t soundfiler_writefile(void *obj, t_canvas *canvas,
+    int argc, t_atom *argv, t_soundfile *sf, t_soundfiler *async)
 {
     t_soundfiler_writeargs wa = {0};
-    int fd = -1, i;
-    size_t bufframes, frameswritten = 0, j;
+    int fd = -1, i, err;
+    size_t frameswritten = 0, j;
     t_garray *garrays[MAXSFCHANS];
     t_word *vectors[MAXSFCHANS];
-    char sampbuf[SAMPBUFSIZE];
     t_sample normfactor = 1, biggest = 0;
 
     soundfile_clear(sf);
@@ -1426,9 +1782,11 @@ size_t soundfiler_dowrite(void *obj, t_canvas *canvas,
                 argv[i].a_w.w_symbol->s_name);
             goto fail;
         }
-        else if (!garray_getfloatwords(garrays[i], &vecsize, &vectors[i]))
-            pd_error(obj, "soundfiler write: %s: bad template for tabwrite",
-                argv[i].a_w.w_symbol->s_name);
+        else if (!garray_getfloatwords_readonly(garrays[i], &vecsize,
+            &vectors[i]))
+                pd_error(obj,
+                    "soundfiler write: %s: bad template for tabwrite",
+                        argv[i].a_w.w_symbol->s_name);
         if (wa.wa_nframes > vecsize - wa.wa_onsetframes)
             wa.wa_nframes = vecsize - wa.wa_onsetframes;
     }
@@ -1499,42 +1857,25 @@ size_t soundfiler_dowrite(void *obj, t_canvas *canvas,
     if (wa.wa_normalize)
         normfactor = (biggest > 0 ? 32767./(32768. * biggest) : 1);
 
+        /* with "-async" the rest is done in another thread, from a copy
+        of the tables */
+    if (wa.wa_async && async && soundfiler_writeasync(async, sf,
+        wa.wa_filesym->s_name, vectors, wa.wa_onsetframes, wa.wa_nframes,
+            normfactor))
+                return (0);
+
         /* write samples */
-    bufframes = SAMPBUFSIZE / sf->sf_bytesperframe;
-    for (frameswritten = 0; frameswritten < wa.wa_nframes;)
-    {
-        size_t thiswrite = wa.wa_nframes - frameswritten,
-               datasize;
-        ssize_t byteswritten;
-        thiswrite = (thiswrite > bufframes ? bufframes : thiswrite);
-        datasize = sf->sf_bytesperframe * thiswrite;
-        soundfile_xferout_words(sf, vectors, (unsigned char *)sampbuf,
-            thiswrite, wa.wa_onsetframes, normfactor);
-        byteswritten = write(sf->sf_fd, sampbuf, datasize);
-        if (byteswritten < (ssize_t)datasize)
-        {
-            object_sferror(obj, "soundfiler write",
-                wa.wa_filesym->s_name, errno, sf);
-            if (byteswritten > 0)
-                frameswritten += byteswritten / sf->sf_bytesperframe;
-            break;
-        }
-        frameswritten += thiswrite;
-        wa.wa_onsetframes += thiswrite;
-    }
-        /* update header frame size */
-    if (fd >= 0)
-    {
-        soundfile_finishwrite(obj, wa.wa_filesym->s_name, sf,
-                wa.wa_nframes, frameswritten);
-        sys_close(fd);
-    }
+    frameswritten = soundfiler_writesamples(obj, wa.wa_filesym->s_name, sf,
+        vectors, wa.wa_onsetframes, wa.wa_nframes, normfactor, &err);
+    if (err)
+        object_sferror(obj, "soundfiler write", wa.wa_filesym->s_name,
+            err, sf);
     sf->sf_fd = -1;
     return frameswritten;
 usage:
     pd_error(obj, "usage: write [flags] filename tablename...");
     post("flags: -skip <n> -nframes <n> -bytes <n> %s ...", sf_typeargs);
-    post("-ascii -big -little -normalize");
+    post("-ascii -big -little -normalize -async");
     post("(defaults to a 16 bit wave file)");
 fail:
     soundfile_clear(sf); /* clear any bad data */
@@ -1543,28 +1884,379 @@ fail:
     return 0;
 }
 
+size_t soundfiler_dowrite(void *obj, t_canvas *canvas,
+    int argc, t_atom *argv, t_soundfile *sf)
+{
+    return (soundfiler_writefile(obj, canvas, argc, argv, sf, 0));
+}
+
+/* ------------------------ offline rendering ------------------------- */
+
+    /* for "-render" (see m_sched.c) the DSP output is written straight to a
+    file from the scheduler's thread, since nothing is waiting on real time.
+    The arguments are flags and a file name as for "soundfiler write"; a
+    relative name is taken relative to "dir".  Whatever comes after the name
+    is handed back in *p_argc and *p_argv.  The file itself isn't created
+    until the first block is written, so that nothing is left behind if the
+    patch can't be opened. */
+
+typedef struct _sfrender
+{
+    t_soundfile r_sf;
+    t_symbol *r_filesym;
+    size_t r_nframes;           /* length promised in the header */
+    size_t r_frameswritten;
+    int r_error;                /* errno of a failed write */
+    unsigned char *r_buf;       /* one block, in the file's format */
+} t_sfrender;
+
+t_sfrender *soundfile_render_new(const char *dir, int *p_argc,
+    t_atom **p_argv, int nchannels, size_t nframes)
+{
+    t_soundfiler_writeargs wa = {0};
+    t_sfrender *x;
+    char pathbuf[MAXPDSTRING];
+    const char *filename;
+    if (soundfiler_parsewriteargs(0, p_argc, p_argv, &wa) ||
+        wa.wa_ascii || wa.wa_normalize || wa.wa_onsetframes ||
+            wa.wa_nframes != SFMAXFRAMES)
+    {
+        pd_error(0, "render: usage: [flags] filename, with flags");
+        post("-bytes <n> %s -big -little -rate <n>", sf_typeargs);
+        return (0);
+    }
+    if (nchannels < 1 || nchannels > MAXSFCHANS)
+    {
+        pd_error(0, "render: %d channels: out of range", nchannels);
+        return (0);
+    }
+    filename = wa.wa_filesym->s_name;
+    if (*dir && !sys_isabsolutepath(filename))
+    {
+        snprintf(pathbuf, MAXPDSTRING, "%s/%s", dir, filename);
+        filename = pathbuf;
+    }
+    x = (t_sfrender *)getbytes(sizeof(*x));
+    soundfile_clear(&x->r_sf);
+    x->r_sf.sf_type = wa.wa_type;
+    x->r_sf.sf_nchannels = nchannels;
+    x->r_sf.sf_samplerate = (wa.wa_samplerate > 0 ?
+        wa.wa_samplerate : sys_getsr());
+    x->r_sf.sf_bytespersample = wa.wa_bytespersample;
+    x->r_sf.sf_bigendian = wa.wa_bigendian;
+    x->r_sf.sf_bytesperframe = nchannels * wa.wa_bytespersample;
+    x->r_filesym = gensym(filename);
+    x->r_nframes = nframes;
+    x->r_frameswritten = 0;
+    x->r_error = 0;
+    x->r_buf = (unsigned char *)getbytes(DEFDACBLKSIZE *
+        x->r_sf.sf_bytesperframe);
+    return (x);
+}
+
+    /* write up to one block from "nchannels" vectors of DEFDACBLKSIZE
+    samples; returns 0 once writing has failed */
+int soundfile_render_write(t_sfrender *x, t_sample *samples, int nframes)
+{
+    t_sample *vecs[MAXSFCHANS];
+    size_t datasize = nframes * x->r_sf.sf_bytesperframe;
+    ssize_t byteswritten;
+    int i;
+    if (x->r_error)
+        return (0);
+    if (x->r_sf.sf_fd < 0 && create_soundfile(0, x->r_filesym->s_name,
+        &x->r_sf, x->r_nframes) < 0)
+    {
+        x->r_error = errno;
+        object_sferror(0, "render", x->r_filesym->s_name, x->r_error,
+            &x->r_sf);
+        return (0);
+    }
+    for (i = 0; i < x->r_sf.sf_nchannels; i++)
+        vecs[i] = samples + i * DEFDACBLKSIZE;
+    soundfile_xferout_sample(&x->r_sf, vecs, x->r_buf, nframes, 0, 1);
+    if ((byteswritten = write(x->r_sf.sf_fd, x->r_buf, datasize)) <
+        (ssize_t)datasize)
+    {
+        x->r_error = errno;
+        if (byteswritten > 0)
+            x->r_frameswritten += byteswritten / x->r_sf.sf_bytesperframe;
+        object_sferror(0, "render", x->r_filesym->s_name, x->r_error,
+            &x->r_sf);
+        return (0);
+    }
+    x->r_frameswritten += nframes;
+    return (1);
+}
+
+    /* fix the header if we stopped early, and close */
+void soundfile_render_free(t_sfrender *x)
+{
+    if (x->r_sf.sf_fd >= 0)
+    {
+        if (x->r_frameswritten < x->r_nframes &&
+            !x->r_sf.sf_type->t_updateheaderfn(&x->r_sf, x->r_frameswritten))
+                object_sferror(0, "render", x->r_filesym->s_name, errno,
+                    &x->r_sf);
+        sys_close(x->r_sf.sf_fd);
+    }
+    freebytes(x->r_buf, DEFDACBLKSIZE * x->r_sf.sf_bytesperframe);
+    freebytes(x, sizeof(*x));
+}
+
 static void soundfiler_write(t_soundfiler *x, t_symbol *s,
     int argc, t_atom *argv)
 {
     size_t frameswritten;
     t_soundfile sf = {0};
-    frameswritten = soundfiler_dowrite(x, x->x_canvas, argc, argv, &sf);
+    frameswritten = soundfiler_writefile(x, x->x_canvas, argc, argv, &sf, x);
+    if (sf.sf_fd >= 0)
+        return;     /* writing asynchronously */
     outlet_soundfileinfo(x->x_out2, &sf);
     outlet_float(x->x_obj.ob_outlet, (t_float)frameswritten);
 }
 
-static void soundfiler_setup(void)
-{
-    soundfiler_class = class_new(gensym("soundfiler"),
-        (t_newmethod)soundfiler_new, 0,
-        sizeof(t_soundfiler), 0, 0);
-    class_addmethod(soundfiler_class, (t_method)soundfiler_read,
-        gensym("read"), A_GIMME, 0);
-    class_addmethod(soundfiler_class, (t_method)soundfiler_write,
-        gensym("write"), A_GIMME, 0);
-}
+/* ----- asynchronous soundfiler reads and writes ----- */
 
-/* ------------------------- readsf object ------------------------- */
+    /* With "-async", "read" and "write" open the file (and for writing,
+    copy the tables) in the calling thread as usual but leave the transfer
+    to a thread of its own, which touches nothing but the job structure
+    below.  The soundfiler polls for completion with a clock, so results
+    arrive between DSP ticks: a read then swaps the new vectors into the
+    tables and both kinds output to the outlets as the synchronous versions
+    would have.  If the soundfiler is deleted first, the thread cleans up
+    after itself. */
+
+#define SFASYNC_POLL 5      /* msec between checks for completion */
+
+int garray_exchangewords(t_garray *x, t_word **vecp, int *np);
+
+typedef struct _sfasync
+{
+    struct _sfasync *a_next;
+    t_soundfiler *a_owner;      /* 0 once the soundfiler is gone */
+    int a_write;                /* write (1) or read (0) */
+    int a_done;                 /* set by the thread when finished */
+    t_soundfile a_sf;           /* file format and open fd */
+    const char *a_filename;
+    int a_nvecs;
+    t_symbol *a_arrays[MAXSFCHANS]; /* read: where the vectors go */
+    t_word *a_vecs[MAXSFCHANS];     /* new contents, or copy to write */
+    int a_size;                 /* number of points in each vector */
+    size_t a_nframes;           /* frames to read or write */
+    size_t a_frames;            /* frames actually read or written */
+    int a_resize;               /* read: clear save-in-patch flags */
+    int a_pack;                 /* read: bits to pack the points into */
+    t_sample a_normfactor;      /* write: normalization */
+    int a_error;                /* errno if it failed */
+} t_sfasync;
+
+static pthread_mutex_t sfasync_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void sfasync_free(t_sfasync *a)
+{
+    int i;
+    for (i = 0; i < a->a_nvecs; i++)
+        if (a->a_vecs[i])
+            freebytes(a->a_vecs[i], a->a_size * sizeof(t_word));
+    freebytes(a, sizeof(*a));
+}
+
+static void *sfasync_main(void *z)
+{
+    t_sfasync *a = (t_sfasync *)z;
+    int i, orphaned, affinityserial = -1;
+    sys_bindthread(AFFINITY_DISK, &affinityserial);
+    if (a->a_write)
+    {
+        a->a_frames = soundfiler_writesamples(0, a->a_filename, &a->a_sf,
+            a->a_vecs, 0, a->a_nframes, a->a_normfactor, &a->a_error);
+    }
+    else
+    {
+        for (i = 0; i < a->a_nvecs; i++)
+            if (!(a->a_vecs[i] =
+                (t_word *)getbytes(a->a_size * sizeof(t_word))))
+                    a->a_error = ENOMEM;
+        if (!a->a_error)
+            a->a_frames = soundfiler_readsamples(&a->a_sf, a->a_nvecs,
+                a->a_vecs, a->a_nframes);
+        soundfile_freedata(&a->a_sf);
+        sys_close(a->a_sf.sf_fd);
+    }
+    a->a_sf.sf_fd = -1;
+    pthread_mutex_lock(&sfasync_mutex);
+    a->a_done = 1;
+    orphaned = !a->a_owner;
+    pthread_mutex_unlock(&sfasync_mutex);
+    if (orphaned)
+        sfasync_free(a);
+    return (0);
+}
+
+    /* start the thread and add the job to the soundfiler's list */
+static int sfasync_start(t_soundfiler *x, t_sfasync *a)
+{
+    t_sfasync **ap;
+    pthread_attr_t attr;
+    pthread_t thread;
+    int fail;
+    a->a_owner = x;
+    pthread_mutex_lock(&sfasync_mutex);
+    for (ap = &x->x_async; *ap; ap = &(*ap)->a_next)
+        ;
+    *ap = a;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if ((fail = pthread_create(&thread, &attr, sfasync_main, a)))
+        *ap = 0;
+    pthread_attr_destroy(&attr);
+    pthread_mutex_unlock(&sfasync_mutex);
+    if (fail)
+        return (0);
+    clock_delay(x->x_clock, SFASYNC_POLL);
+    return (1);
+}
+
+static int soundfiler_readasync(t_soundfiler *x, t_soundfile *sf,
+    const char *filename, int argc, t_atom *argv, size_t size,
+    size_t nframes, int resize, int pack)
+{
+    t_sfasync *a = (t_sfasync *)getbytes(sizeof(*a));
+    int i;
+    if (!a)
+        return (0);
+    a->a_sf = *sf;
+    a->a_filename = filename;
+    a->a_nvecs = argc;
+    for (i = 0; i < argc; i++)
+        a->a_arrays[i] = argv[i].a_w.w_symbol;
+    a->a_size = (int)size;
+    a->a_nframes = nframes;
+    a->a_resize = resize;
+    a->a_pack = pack;
+    if (!sfasync_start(x, a))
+    {
+        freebytes(a, sizeof(*a));
+        return (0);
+    }
+    return (1);
+}
+
+static int soundfiler_writeasync(t_soundfiler *x, t_soundfile *sf,
+    const char *filename, t_word **vectors, size_t onsetframes,
+    size_t nframes, t_sample normfactor)
+{
+    t_sfasync *a = (t_sfasync *)getbytes(sizeof(*a));
+    int i;
+    if (!a || nframes >= INT_MAX)
+        goto fail;
+    a->a_write = 1;
+    a->a_sf = *sf;
+    a->a_filename = filename;
+    a->a_size = (int)nframes;
+    a->a_nframes = nframes;
+    a->a_normfactor = normfactor;
+    for (i = 0; i < sf->sf_nchannels; i++)
+    {
+        if (!(a->a_vecs[i] = (t_word *)getbytes(nframes * sizeof(t_word))))
+            goto fail;
+        a->a_nvecs = i + 1;
+        memcpy(a->a_vecs[i], vectors[i] + onsetframes,
+            nframes * sizeof(t_word));
+    }
+    if (sfasync_start(x, a))
+        return (1);
+fail:
+    if (a)
+        sfasync_free(a);
+    return (0);
+}
+
+    /* a transfer is done: report it, and for reads, swap in the new data */
+static void sfasync_finish(t_soundfiler *x, t_sfasync *a)
+{
+    int i;
+    const char *what = (a->a_write ? "soundfiler write" : "soundfiler read");
+    if (a->a_error)
+        object_sferror(x, what, a->a_filename, a->a_error, &a->a_sf);
+    if (!a->a_write && !a->a_error)
+    {
+        for (i = 0; i < a->a_nvecs; i++)
+        {
+            t_garray *g = (t_garray *)pd_findbyclass(a->a_arrays[i],
+                garray_class);
+            int n = a->a_size;
+            if (!g)
+                pd_error(x, "%s: %s: no such table", what,
+                    a->a_arrays[i]->s_name);
+            else if (garray_exchangewords(g, &a->a_vecs[i], &n))
+            {
+                    /* now holding the old contents, to be freed */
+                freebytes(a->a_vecs[i], n * sizeof(t_word));
+                a->a_vecs[i] = 0;
+                if (a->a_resize)
+                    garray_setsaveit(g, 0);
+                if (a->a_pack)
+                    garray_pack(g, a->a_pack);
+                garray_redraw(g);
+            }
+        }
+    }
+    else if (a->a_error && !a->a_write)
+        a->a_frames = 0;
+    outlet_soundfileinfo(x->x_out2, &a->a_sf);
+    outlet_float(x->x_obj.ob_outlet, (t_float)a->a_frames);
+}
+
+static void soundfiler_poll(t_soundfiler *x)
+{
+    while (1)
+    {
+        t_sfasync **ap, *a;
+        pthread_mutex_lock(&sfasync_mutex);
+        for (ap = &x->x_async; (a = *ap) && !a->a_done; ap = &a->a_next)
+            ;
+        if (a)
+            *ap = a->a_next;
+        pthread_mutex_unlock(&sfasync_mutex);
+        if (!a)
+            break;
+        sfasync_finish(x, a);
+        sfasync_free(a);
+    }
+    if (x->x_async)
+        clock_delay(x->x_clock, SFASYNC_POLL);
+}
+
+static void soundfiler_free(t_soundfiler *x)
+{
+    t_sfasync *a, *next;
+    pthread_mutex_lock(&sfasync_mutex);
+    for (a = x->x_async; a; a = next)
+    {
+        next = a->a_next;
+        if (a->a_done)
+            sfasync_free(a);
+        else a->a_owner = 0;
+    }
+    x->x_async = 0;
+    pthread_mutex_unlock(&sfasync_mutex);
+    clock_free(x->x_clock);
+}
+
+static void soundfiler_setup(void)
+{
+    soundfiler_class = class_new(gensym("soundfiler"),
+        (t_newmethod)soundfiler_new, (t_method)soundfiler_free,
+        sizeof(t_soundfiler), 0, 0);
+    class_addmethod(soundfiler_class, (t_method)soundfiler_read,
+        gensym("read"), A_GIMME, 0);
+    class_addmethod(soundfiler_class, (t_method)soundfiler_write,
+        gensym("write"), A_GIMME, 0);
+}
+
+/* ------------------------- readsf object ------------------------- */
 
 /* READSF uses the Posix threads package; for the moment we're Linux
 only although this should be portable to the other platforms.
@@ -1583,6 +2275,7 @@ areas.
 
 #define READSIZE 65536
 #define WRITESIZE 65536
+#define WRITEALIGN 4096         /* writesf~ ends writes on file pages */
 #define DEFBUFPERCHAN 262144
 #define MINBUFSIZE (4 * READSIZE)
 #define MAXBUFSIZE 16777216     /* arbitrary; just don't want to hang malloc */
@@ -1630,9 +2323,27 @@ typedef struct _readsf
     int x_fifohead;           /**< index of next byte to get from file */
     int x_fifotail;           /**< index of next byte the ugen will read */
     int x_eof;                /**< true if fifohead has stopped changing */
+    int x_usemap;             /**< readsf~ only; map file if possible */
+    t_sfmap x_map;            /**< readsf~ only; the mapping if any */
+    size_t x_maphead;         /**< bytes of the mapping fetched so far */
+    size_t x_maptail;         /**< bytes of the mapping already played */
     int x_sigcountdown;       /**< counter for signaling child for more data */
     int x_sigperiod;          /**< number of ticks per signal */
+    struct _sfcache *x_cache; /**< readsf~ only; preloaded head if any */
+    size_t x_cachepos;        /**< readsf~ only; bytes of it played */
     size_t x_frameswritten;   /**< writesf~ only; frames written */
+    size_t x_byteswritten;    /**< writesf~ only; bytes written */
+    int x_chunk;              /**< writesf~ only; bytes per write asked for */
+    int x_writesize;          /**< writesf~ only; ... fitted to the fifo */
+    t_float x_preallocsec;    /**< writesf~ only; seconds to reserve ahead */
+    t_float x_updatesec;      /**< writesf~ only; seconds between headers */
+    int x_nocache;            /**< writesf~ only; keep out of page cache */
+    off_t x_prealloc;         /**< writesf~ only; ... those in bytes */
+    size_t x_updateframes;    /**< writesf~ only; ... and frames */
+    off_t x_reserved;         /**< writesf~ I/O side; file space reserved */
+    off_t x_synced;           /**< writesf~ I/O side; writeback started */
+    off_t x_dropped;          /**< writesf~ I/O side; dropped from cache */
+    size_t x_headerframes;    /**< writesf~ I/O side; frames in header */
     t_float x_f;              /**< writesf~ only; scalar for signal inlet */
     pthread_mutex_t x_mutex;
     pthread_cond_t x_requestcondition;
@@ -1641,6 +2352,16 @@ typedef struct _readsf
 #ifdef PDINSTANCE
     t_pdinstance *x_pd_this;  /**< pointer to the owner pd instance */
 #endif
+        /* I/O side state, kept here so that any thread can pick it up */
+    t_soundfile x_childsf;    /**< the I/O side's copy, with the open fd */
+    int x_childstreaming;     /**< true while in the read or write loop */
+    int (*x_service)(struct _readsf *x);    /**< readsf or writesf service */
+        /* shared I/O thread pool; these are protected by sfpool_mutex */
+    int x_pooled;             /**< true if using the pool, not our own thread */
+    int x_heapindex;          /**< place in the pool's queue, or -1 */
+    int x_urgency;            /**< its priority there (smaller is sooner) */
+    int x_busy;               /**< true while a pool thread is serving us */
+    int x_again;              /**< requested again while busy */
 } t_readsf;
 
 /* ----- the child thread which performs file I/O ----- */
@@ -1668,284 +2389,693 @@ static void readsf_fakewait(pthread_mutex_t *b)
 #define sfread_cond_signal(a)
 #endif
 
-static void *readsf_child_main(void *zz)
+    /* Each readsf~ or writesf~ does its disk I/O in a "service" routine
+    which is called with the object's mutex locked, does one step (opening
+    or closing a file or transferring one chunk of up to READSIZE bytes),
+    and returns 1 if there might be more to do right away, 0 if it has to
+    wait for the next request, or -1 once it has quit.  Normally all objects
+    share a pool of SFPOOL_DEFTHREADS threads, which serve the objects with
+    requests in order of urgency, that is, how close their FIFO is to
+    running dry (readsf~) or full (writesf~).  After "pd soundfile-threads
+    0" new objects get a thread of their own instead. */
+
+#define SFPOOL_DEFTHREADS 4
+#define SFPOOL_MAXTHREADS 64
+
+static int readsf_service(t_readsf *x);
+static int writesf_service(t_readsf *x);
+
+static pthread_mutex_t sfpool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sfpool_wakeup = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t sfpool_idle = PTHREAD_COND_INITIALIZER;
+static pthread_t sfpool_thread[SFPOOL_MAXTHREADS];
+static int sfpool_nthreads;             /* threads running */
+static int sfpool_wantthreads = SFPOOL_DEFTHREADS;
+static t_readsf **sfpool_heap;          /* objects waiting, most urgent first */
+static int sfpool_nheap, sfpool_heapsize;
+
+    /* how soon the object needs attention; call with its mutex locked */
+static int sfpool_urgency(t_readsf *x)
+{
+    int fill;
+    if (x->x_requestcode != REQUEST_BUSY || !x->x_fifosize)
+        return (-1);    /* open, close and quit go first */
+    if (x->x_map.m_data)
+        fill = x->x_maphead - x->x_maptail;
+    else if ((fill = x->x_fifohead - x->x_fifotail) < 0)
+        fill += x->x_fifosize;
+        /* readers need the data already in the FIFO to last; writers need
+        the room left in it to */
+    return (x->x_service == readsf_service ? fill : x->x_fifosize - fill);
+}
+
+static void sfpool_swap(int i, int j)
+{
+    t_readsf *z = sfpool_heap[i];
+    (sfpool_heap[i] = sfpool_heap[j])->x_heapindex = i;
+    (sfpool_heap[j] = z)->x_heapindex = j;
+}
+
+static void sfpool_siftup(int i)
+{
+    while (i > 0 && sfpool_heap[(i-1)/2]->x_urgency > sfpool_heap[i]->x_urgency)
+        sfpool_swap(i, (i-1)/2), i = (i-1)/2;
+}
+
+static void sfpool_siftdown(int i)
+{
+    while (1)
+    {
+        int k = i, l = 2*i+1, r = 2*i+2;
+        if (l < sfpool_nheap &&
+            sfpool_heap[l]->x_urgency < sfpool_heap[k]->x_urgency)
+                k = l;
+        if (r < sfpool_nheap &&
+            sfpool_heap[r]->x_urgency < sfpool_heap[k]->x_urgency)
+                k = r;
+        if (k == i)
+            return;
+        sfpool_swap(i, k);
+        i = k;
+    }
+}
+
+    /* the functions from here to sfpool_work() are called with the pool
+    mutex locked */
+static void sfpool_push(t_readsf *x, int urgency)
+{
+    if (sfpool_nheap == sfpool_heapsize)
+    {
+        int newsize = (sfpool_heapsize ? 2 * sfpool_heapsize : 64);
+        sfpool_heap = (t_readsf **)resizebytes(sfpool_heap,
+            sfpool_heapsize * sizeof(*sfpool_heap),
+                newsize * sizeof(*sfpool_heap));
+        sfpool_heapsize = newsize;
+    }
+    x->x_urgency = urgency;
+    sfpool_heap[x->x_heapindex = sfpool_nheap++] = x;
+    sfpool_siftup(x->x_heapindex);
+}
+
+static void sfpool_remove(t_readsf *x)
+{
+    int i = x->x_heapindex;
+    if (i < 0)
+        return;
+    x->x_heapindex = -1;
+    if (i != --sfpool_nheap)
+    {
+        (sfpool_heap[i] = sfpool_heap[sfpool_nheap])->x_heapindex = i;
+        sfpool_siftup(i);
+        sfpool_siftdown(sfpool_heap[i]->x_heapindex);
+    }
+}
+
+    /* one pass of the I/O side, traced if that's on */
+static int sfread_doservice(t_readsf *x)
+{
+    unsigned long long tracestart;
+    int ret;
+    if (!sys_tracing)
+        return ((*x->x_service)(x));
+    tracestart = PROFILE_NOW();
+    ret = (*x->x_service)(x);
+    sys_tracespan("io", (x->x_service == writesf_service ?
+        "writesf~" : "readsf~"), tracestart);
+    return (ret);
+}
+
+static void *sfpool_work(void *dummy)
+{
+    int affinityserial = -1;
+    sys_tracethread("soundfile pool");
+    pthread_mutex_lock(&sfpool_mutex);
+    while (1)
+    {
+        t_readsf *x;
+        int ret, urgency;
+        sys_bindthread(AFFINITY_DISK, &affinityserial);
+        if (!sfpool_nheap)
+        {
+            pthread_cond_wait(&sfpool_wakeup, &sfpool_mutex);
+            continue;
+        }
+        x = sfpool_heap[0];
+        sfpool_remove(x);
+        x->x_busy = 1;
+        x->x_again = 0;
+        pthread_mutex_unlock(&sfpool_mutex);
+
+        pthread_mutex_lock(&x->x_mutex);
+#ifdef PDINSTANCE
+        pd_this = x->x_pd_this;
+#endif
+        ret = sfread_doservice(x);
+        urgency = sfpool_urgency(x);
+        pthread_mutex_unlock(&x->x_mutex);
+
+        pthread_mutex_lock(&sfpool_mutex);
+        x->x_busy = 0;
+        if (ret > 0 || (!ret && x->x_again))
+            sfpool_push(x, urgency);
+        pthread_cond_broadcast(&sfpool_idle);
+    }
+    return (0);
+}
+
+    /* start pool threads if there are fewer than wanted */
+static void sfpool_start(void)
+{
+    while (sfpool_nthreads < sfpool_wantthreads)
+    {
+        if (pthread_create(&sfpool_thread[sfpool_nthreads], 0,
+            sfpool_work, 0))
+        {
+            pd_error(0, "soundfile: couldn't start I/O thread");
+            break;
+        }
+        sfpool_nthreads++;
+    }
+}
+
+    /* ask the I/O side for attention: signal our own thread, or queue
+    ourselves for the pool.  Call with the object's mutex locked. */
+static void sfread_request(t_readsf *x)
+{
+    int urgency;
+    if (!x->x_pooled)
+    {
+        sfread_cond_signal(&x->x_requestcondition);
+        return;
+    }
+    urgency = sfpool_urgency(x);
+    pthread_mutex_lock(&sfpool_mutex);
+    if (x->x_busy)
+        x->x_again = 1;
+    else if (x->x_heapindex < 0)
+        sfpool_push(x, urgency);
+    else if (urgency < x->x_urgency)
+    {
+        x->x_urgency = urgency;
+        sfpool_siftup(x->x_heapindex);
+    }
+    pthread_cond_signal(&sfpool_wakeup);
+    pthread_mutex_unlock(&sfpool_mutex);
+}
+
+    /* thread of our own: just call the service routine until it quits */
+static void *sfread_child_main(void *zz)
 {
     t_readsf *x = zz;
-    t_soundfile sf = {0};
-    soundfile_clear(&sf);
+    int ret, affinityserial = -1;
 #ifdef PDINSTANCE
     pd_this = x->x_pd_this;
 #endif
-#ifdef DEBUG_SOUNDFILE_THREADS
-    fprintf(stderr, "readsf~: 1\n");
-#endif
+    sys_tracethread(x->x_service == writesf_service ? "writesf~" : "readsf~");
     pthread_mutex_lock(&x->x_mutex);
     while (1)
     {
-        int fifohead;
-        char *buf;
-#ifdef DEBUG_SOUNDFILE_THREADS
-        fprintf(stderr, "readsf~: 0\n");
-#endif
-        if (x->x_requestcode == REQUEST_NOTHING)
-        {
-#ifdef DEBUG_SOUNDFILE_THREADS
-            fprintf(stderr, "readsf~: wait 2\n");
-#endif
-            sfread_cond_signal(&x->x_answercondition);
+        sys_bindthread(AFFINITY_DISK, &affinityserial);
+        if ((ret = sfread_doservice(x)) < 0)
+            break;
+        if (!ret)
             sfread_cond_wait(&x->x_requestcondition, &x->x_mutex);
-#ifdef DEBUG_SOUNDFILE_THREADS
-            fprintf(stderr, "readsf~: 3\n");
+    }
+    pthread_mutex_unlock(&x->x_mutex);
+    return (0);
+}
+
+    /* set up the I/O side of a new readsf~ or writesf~ and start it */
+static void sfread_startio(t_readsf *x, int (*service)(t_readsf *x))
+{
+    pthread_mutex_init(&x->x_mutex, 0);
+    pthread_cond_init(&x->x_requestcondition, 0);
+    pthread_cond_init(&x->x_answercondition, 0);
+    soundfile_clear(&x->x_childsf);
+    x->x_childstreaming = 0;
+    x->x_service = service;
+    x->x_heapindex = -1;
+    x->x_busy = x->x_again = 0;
+#ifdef PDINSTANCE
+    x->x_pd_this = pd_this;
 #endif
-        }
-        else if (x->x_requestcode == REQUEST_OPEN)
-        {
-            ssize_t bytesread;
-            size_t wantbytes;
+    pthread_mutex_lock(&sfpool_mutex);
+    sfpool_start();
+    x->x_pooled = (sfpool_wantthreads > 0 && sfpool_nthreads > 0);
+    pthread_mutex_unlock(&sfpool_mutex);
+    if (!x->x_pooled)
+        pthread_create(&x->x_childthread, 0, sfread_child_main, x);
+}
 
-                /* copy file stuff out of the data structure so we can
-                relinquish the mutex while we're in open_soundfile_via_path() */
-            size_t onsetframes = x->x_onsetframes;
-            const char *filename = x->x_filename;
-            const char *dirname = canvas_getdir(x->x_canvas)->s_name;
+    /* request QUIT, wait for acknowledge and for the I/O side to let go */
+static void sfread_stopio(t_readsf *x)
+{
+    void *threadrtn;
+    pthread_mutex_lock(&x->x_mutex);
+    x->x_requestcode = REQUEST_QUIT;
+    sfread_request(x);
+    while (x->x_requestcode != REQUEST_NOTHING)
+    {
+        sfread_request(x);
+        sfread_cond_wait(&x->x_answercondition, &x->x_mutex);
+    }
+    pthread_mutex_unlock(&x->x_mutex);
+    if (x->x_pooled)
+    {
+        pthread_mutex_lock(&sfpool_mutex);
+        while (x->x_busy)
+            pthread_cond_wait(&sfpool_idle, &sfpool_mutex);
+        sfpool_remove(x);
+        pthread_mutex_unlock(&sfpool_mutex);
+    }
+    else if (pthread_join(x->x_childthread, &threadrtn))
+        pd_error(x, "soundfile: join failed");
+    pthread_cond_destroy(&x->x_requestcondition);
+    pthread_cond_destroy(&x->x_answercondition);
+    pthread_mutex_destroy(&x->x_mutex);
+}
 
-#ifdef DEBUG_SOUNDFILE_THREADS
-            fprintf(stderr, "readsf~: 4\n");
-#endif
-                /* alter the request code so that an ensuing "open" will get
-                noticed. */
-            x->x_requestcode = REQUEST_BUSY;
-            x->x_fileerror = 0;
+    /* "pd soundfile-threads <n>": number of shared I/O threads for readsf~
+    and writesf~, or 0 to give each new one its own thread.  Threads already
+    started aren't stopped. */
+void glob_soundfilethreads(void *dummy, t_floatarg f)
+{
+    int n = f;
+    if (n < 0)
+        n = 0;
+    else if (n > SFPOOL_MAXTHREADS)
+        n = SFPOOL_MAXTHREADS;
+    pthread_mutex_lock(&sfpool_mutex);
+    sfpool_wantthreads = n;
+    pthread_mutex_unlock(&sfpool_mutex);
+}
 
-                /* if there's already a file open, close it */
-            if (sf.sf_fd >= 0)
-            {
-                pthread_mutex_unlock(&x->x_mutex);
-                sys_close(sf.sf_fd);
-                sf.sf_fd = -1;
-                pthread_mutex_lock(&x->x_mutex);
-                x->x_sf.sf_fd = -1;
-                if (x->x_requestcode != REQUEST_BUSY)
-                    goto lost;
-            }
-                /* cache sf *after* closing as x->sf's type
-                    may have changed in readsf_open() */
-            soundfile_copy(&sf, &x->x_sf);
+int soundfile_getthreads(void)
+{
+    return (sfpool_nthreads);
+}
 
-                /* open the soundfile with the mutex unlocked */
-            pthread_mutex_unlock(&x->x_mutex);
-            open_soundfile_via_path(dirname, filename, &sf, onsetframes);
-            pthread_mutex_lock(&x->x_mutex);
+    /* close the reader's file, and free any decoder state, with the mutex
+    released */
+static void readsf_closefile(t_readsf *x)
+{
+    t_soundfile sf;
+    soundfile_copy(&sf, &x->x_childsf);
+    x->x_childsf.sf_fd = -1;
+    x->x_childsf.sf_data = NULL;
+    x->x_sf.sf_data = NULL;
+    pthread_mutex_unlock(&x->x_mutex);
+    soundfile_freedata(&sf);
+    sys_close(sf.sf_fd);
+    pthread_mutex_lock(&x->x_mutex);
+}
 
-#ifdef DEBUG_SOUNDFILE_THREADS
-            fprintf(stderr, "readsf~: 5\n");
-#endif
-            if (sf.sf_fd < 0)
+    /* the reader fell out of its loop: close file if necessary, set EOF
+    and signal once more */
+static void readsf_lost(t_readsf *x)
+{
+    t_soundfile *sf = &x->x_childsf;
+    x->x_childstreaming = 0;
+    if (x->x_requestcode == REQUEST_BUSY)
+        x->x_requestcode = REQUEST_NOTHING;
+    if (sf->sf_fd >= 0)
+    {
+        readsf_closefile(x);
+        x->x_eof = 1;
+        x->x_sf.sf_fd = -1;
+    }
+    sfread_cond_signal(&x->x_answercondition);
+}
+
+    /* drop the mapping of the previous file, if any */
+static void readsf_unmap(t_readsf *x)
+{
+    t_sfmap map = x->x_map;
+    if (!map.m_base)
+        return;
+    x->x_map.m_base = 0;
+    x->x_map.m_data = 0;
+    pthread_mutex_unlock(&x->x_mutex);
+    sfmap_close(&map);
+    pthread_mutex_lock(&x->x_mutex);
+}
+
+    /* one step of the reader: wait for the fifo to get hungry and feed it */
+static int readsf_service(t_readsf *x)
+{
+    t_soundfile *sf = &x->x_childsf;
+    if (x->x_childstreaming)
+    {
+        ssize_t bytesread;
+        size_t wantbytes;
+        int fifosize = x->x_fifosize, fifohead;
+        char *buf;
+        if (x->x_requestcode != REQUEST_BUSY || x->x_eof)
+        {
+            readsf_lost(x);
+            return (1);
+        }
+        if (x->x_map.m_data)
+        {
+                /* mapped: there's no copying to do, just keep the pages
+                up to a fifo's worth ahead of the player in memory */
+            t_sfmap map = x->x_map;
+            size_t maphead = x->x_maphead;
+            if (maphead >= map.m_size)
             {
-                x->x_fileerror = errno;
                 x->x_eof = 1;
-#ifdef DEBUG_SOUNDFILE_THREADS
-                fprintf(stderr, "readsf~: open failed %s %s\n",
-                    filename, dirname);
-#endif
-                goto lost;
+                readsf_lost(x);
+                return (1);
             }
-                /* copy back into the instance structure. */
-            soundfile_copy(&x->x_sf, &sf);
-                /* check if another request has been made; if so, field it */
-            if (x->x_requestcode != REQUEST_BUSY)
-                goto lost;
-#ifdef DEBUG_SOUNDFILE_THREADS
-            fprintf(stderr, "readsf~: 6\n");
-#endif
-            x->x_fifohead = 0;
-                    /* set fifosize from bufsize.  fifosize must be a
-                    multiple of the number of bytes eaten for each DSP
-                    tick.  We pessimistically assume MAXVECSIZE samples
-                    per tick since that could change.  There could be a
-                    problem here if the vector size increases while a
-                    soundfile is being played...  */
-            x->x_fifosize = x->x_bufsize - (x->x_bufsize %
-                (sf.sf_bytesperframe * MAXVECSIZE));
-                    /* arrange for the "request" condition to be signaled 16
-                    times per buffer */
-#ifdef DEBUG_SOUNDFILE_THREADS
-            fprintf(stderr, "readsf~: fifosize %d\n", x->x_fifosize);
-#endif
-            x->x_sigcountdown = x->x_sigperiod = (x->x_fifosize /
-                (16 * sf.sf_bytesperframe * x->x_vecsize));
-                /* in a loop, wait for the fifo to get hungry and feed it */
-
-            while (x->x_requestcode == REQUEST_BUSY)
+            if (maphead - x->x_maptail + READSIZE > (size_t)fifosize)
             {
-                int fifosize = x->x_fifosize;
-#ifdef DEBUG_SOUNDFILE_THREADS
-                fprintf(stderr, "readsf~: 77\n");
-#endif
-                if (x->x_eof)
-                    break;
-                if (x->x_fifohead >= x->x_fifotail)
-                {
-                        /* if the head is >= the tail, we can immediately read
-                        to the end of the fifo.  Unless, that is, we would
-                        read all the way to the end of the buffer and the
-                        "tail" is zero; this would fill the buffer completely
-                        which isn't allowed because you can't tell a completely
-                        full buffer from an empty one. */
-                    if (x->x_fifotail || (fifosize - x->x_fifohead > READSIZE))
-                    {
-                        wantbytes = fifosize - x->x_fifohead;
-                        if (wantbytes > READSIZE)
-                            wantbytes = READSIZE;
-                        if ((ssize_t)wantbytes > sf.sf_bytelimit)
-                            wantbytes = sf.sf_bytelimit;
-#ifdef DEBUG_SOUNDFILE_THREADS
-                        fprintf(stderr, "readsf~: head %d, tail %d, size %ld\n",
-                            x->x_fifohead, x->x_fifotail, wantbytes);
-#endif
-                    }
-                    else
-                    {
-#ifdef DEBUG_SOUNDFILE_THREADS
-                        fprintf(stderr, "readsf~: wait 7a...\n");
-#endif
-                        sfread_cond_signal(&x->x_answercondition);
-#ifdef DEBUG_SOUNDFILE_THREADS
-                        fprintf(stderr, "readsf~: signaled...\n");
-#endif
-                        sfread_cond_wait(&x->x_requestcondition, &x->x_mutex);
-#ifdef DEBUG_SOUNDFILE_THREADS
-                        fprintf(stderr, "readsf~: 7a ... done\n");
-#endif
-                        continue;
-                    }
-                }
-                else
-                {
-                        /* otherwise check if there are at least READSIZE
-                        bytes to read.  If not, wait and loop back. */
-                    wantbytes =  x->x_fifotail - x->x_fifohead - 1;
-                    if (wantbytes < READSIZE)
-                    {
-#ifdef DEBUG_SOUNDFILE_THREADS
-                        fprintf(stderr, "readsf~: wait 7...\n");
-#endif
-                        sfread_cond_signal(&x->x_answercondition);
-                        sfread_cond_wait(&x->x_requestcondition, &x->x_mutex);
-#ifdef DEBUG_SOUNDFILE_THREADS
-                        fprintf(stderr, "readsf~: 7 ... done\n");
-#endif
-                        continue;
-                    }
-                    else wantbytes = READSIZE;
-                    if ((ssize_t)wantbytes > sf.sf_bytelimit)
-                        wantbytes = sf.sf_bytelimit;
-                }
-#ifdef DEBUG_SOUNDFILE_THREADS
-                fprintf(stderr, "readsf~: 8\n");
-#endif
-                buf = x->x_buf;
-                fifohead = x->x_fifohead;
-                pthread_mutex_unlock(&x->x_mutex);
-                bytesread = read(sf.sf_fd, buf + fifohead, wantbytes);
-                pthread_mutex_lock(&x->x_mutex);
-                if (x->x_requestcode != REQUEST_BUSY)
-                    break;
-                if (bytesread < 0)
-                {
-#ifdef DEBUG_SOUNDFILE_THREADS
-                    fprintf(stderr, "readsf~: fileerror %d\n", errno);
-#endif
-                    x->x_fileerror = errno;
-                    break;
-                }
-                else if (bytesread == 0)
-                {
-                    x->x_eof = 1;
-                    break;
-                }
-                else
-                {
-                    x->x_fifohead += bytesread;
-                    sf.sf_bytelimit -= bytesread;
-                    if (x->x_fifohead == fifosize)
-                        x->x_fifohead = 0;
-                    if (sf.sf_bytelimit <= 0)
-                    {
-                        x->x_eof = 1;
-                        break;
-                    }
-                }
-#ifdef DEBUG_SOUNDFILE_THREADS
-                fprintf(stderr, "readsf~: after, head %d tail %d\n",
-                    x->x_fifohead, x->x_fifotail);
-#endif
-                    /* signal parent in case it's waiting for data */
                 sfread_cond_signal(&x->x_answercondition);
+                return (0);
             }
-
-        lost:
-            if (x->x_requestcode == REQUEST_BUSY)
-                x->x_requestcode = REQUEST_NOTHING;
-#ifdef DEBUG_SOUNDFILE_THREADS
-                fprintf(stderr, "readsf~: lost\n");
-#endif
-                /* fell out of read loop: close file if necessary,
-                set EOF and signal once more */
-            if (sf.sf_fd >= 0)
+            wantbytes = map.m_size - maphead;
+            if (wantbytes > READSIZE)
+                wantbytes = READSIZE;
+            pthread_mutex_unlock(&x->x_mutex);
+            sfmap_fetch(&map, maphead, wantbytes);
+            pthread_mutex_lock(&x->x_mutex);
+            if (x->x_requestcode != REQUEST_BUSY)
             {
-                    /* use cached sf */
-                pthread_mutex_unlock(&x->x_mutex);
-                sys_close(sf.sf_fd);
-                sf.sf_fd = -1;
-                pthread_mutex_lock(&x->x_mutex);
-                x->x_eof = 1;
-                x->x_sf.sf_fd = -1;
+                readsf_lost(x);
+                return (1);
             }
+            x->x_maphead = maphead + wantbytes;
             sfread_cond_signal(&x->x_answercondition);
+            return (1);
         }
-        else if (x->x_requestcode == REQUEST_CLOSE)
+        if (x->x_fifohead >= x->x_fifotail)
         {
-            if (sf.sf_fd >= 0)
+                /* if the head is >= the tail, we can immediately read
+                to the end of the fifo.  Unless, that is, we would
+                read all the way to the end of the buffer and the
+                "tail" is zero; this would fill the buffer completely
+                which isn't allowed because you can't tell a completely
+                full buffer from an empty one. */
+            if (x->x_fifotail || (fifosize - x->x_fifohead > READSIZE))
             {
-                    /* use cached sf */
-                pthread_mutex_unlock(&x->x_mutex);
-                sys_close(sf.sf_fd);
-                sf.sf_fd = -1;
-                pthread_mutex_lock(&x->x_mutex);
-                x->x_sf.sf_fd = -1;
+                wantbytes = fifosize - x->x_fifohead;
+                if (wantbytes > READSIZE)
+                    wantbytes = READSIZE;
+                if ((ssize_t)wantbytes > sf->sf_bytelimit)
+                    wantbytes = sf->sf_bytelimit;
+            }
+            else
+            {
+                sfread_cond_signal(&x->x_answercondition);
+                return (0);
+            }
+        }
+        else
+        {
+                /* otherwise check if there are at least READSIZE
+                bytes to read.  If not, wait and loop back. */
+            wantbytes =  x->x_fifotail - x->x_fifohead - 1;
+            if (wantbytes < READSIZE)
+            {
+                sfread_cond_signal(&x->x_answercondition);
+                return (0);
+            }
+            else wantbytes = READSIZE;
+            if ((ssize_t)wantbytes > sf->sf_bytelimit)
+                wantbytes = sf->sf_bytelimit;
+        }
+#ifdef DEBUG_SOUNDFILE_THREADS
+        fprintf(stderr, "readsf~: head %d, tail %d, size %ld\n",
+            x->x_fifohead, x->x_fifotail, wantbytes);
+#endif
+        buf = x->x_buf;
+        fifohead = x->x_fifohead;
+        pthread_mutex_unlock(&x->x_mutex);
+        bytesread = soundfile_read(sf, buf + fifohead, wantbytes);
+        pthread_mutex_lock(&x->x_mutex);
+        if (x->x_requestcode != REQUEST_BUSY)
+        {
+            readsf_lost(x);
+            return (1);
+        }
+        if (bytesread < 0)
+        {
+#ifdef DEBUG_SOUNDFILE_THREADS
+            fprintf(stderr, "readsf~: fileerror %d\n", errno);
+#endif
+            x->x_fileerror = errno;
+            readsf_lost(x);
+            return (1);
+        }
+        else if (bytesread == 0)
+        {
+            x->x_eof = 1;
+            readsf_lost(x);
+            return (1);
+        }
+        x->x_fifohead += bytesread;
+        sf->sf_bytelimit -= bytesread;
+        if (x->x_fifohead == fifosize)
+            x->x_fifohead = 0;
+        if (sf->sf_bytelimit <= 0)
+        {
+            x->x_eof = 1;
+            readsf_lost(x);
+            return (1);
+        }
+            /* signal parent in case it's waiting for data */
+        sfread_cond_signal(&x->x_answercondition);
+        return (1);
+    }
+    else if (x->x_requestcode == REQUEST_NOTHING)
+    {
+        sfread_cond_signal(&x->x_answercondition);
+        return (0);
+    }
+    else if (x->x_requestcode == REQUEST_OPEN)
+    {
+            /* copy file stuff out of the data structure so we can
+            relinquish the mutex while we're in open_soundfile_via_path() */
+        size_t onsetframes = x->x_onsetframes;
+        const char *filename = x->x_filename;
+        const char *dirname = canvas_getdir(x->x_canvas)->s_name;
+        int usemap = x->x_usemap, mapped = 0;
+        t_sfmap map;
+
+            /* alter the request code so that an ensuing "open" will get
+            noticed. */
+        x->x_requestcode = REQUEST_BUSY;
+        x->x_fileerror = 0;
+        readsf_unmap(x);
+
+            /* if there's already a file open, close it */
+        if (sf->sf_fd >= 0)
+        {
+            readsf_closefile(x);
+            x->x_sf.sf_fd = -1;
+            if (x->x_requestcode != REQUEST_BUSY)
+            {
+                readsf_lost(x);
+                return (1);
             }
-            if (x->x_requestcode == REQUEST_CLOSE)
-                x->x_requestcode = REQUEST_NOTHING;
-            sfread_cond_signal(&x->x_answercondition);
         }
-        else if (x->x_requestcode == REQUEST_QUIT)
+            /* cache sf *after* closing as x->sf's type
+                may have changed in readsf_open() */
+        soundfile_copy(sf, &x->x_sf);
+        sf->sf_data = NULL;
+
+            /* open the soundfile with the mutex unlocked */
+        pthread_mutex_unlock(&x->x_mutex);
+        open_soundfile_via_path(dirname, filename, sf, onsetframes);
+        if (usemap && sf->sf_fd >= 0)
+            mapped = sfmap_open(&map, sf, SFMAXFRAMES);
+        pthread_mutex_lock(&x->x_mutex);
+        if (mapped)
         {
-            if (sf.sf_fd >= 0)
-            {
-                    /* use cached sf */
-                pthread_mutex_unlock(&x->x_mutex);
-                sys_close(sf.sf_fd);
-                sf.sf_fd = -1;
-                pthread_mutex_lock(&x->x_mutex);
-                x->x_sf.sf_fd = -1;
-            }
-            x->x_requestcode = REQUEST_NOTHING;
-            sfread_cond_signal(&x->x_answercondition);
-            break;
+            x->x_map = map;
+            x->x_maphead = x->x_maptail = 0;
         }
-        else
+
+        if (sf->sf_fd < 0)
         {
+            x->x_fileerror = errno;
+            x->x_eof = 1;
 #ifdef DEBUG_SOUNDFILE_THREADS
-            fprintf(stderr, "readsf~: 13\n");
+            fprintf(stderr, "readsf~: open failed %s %s\n",
+                filename, dirname);
 #endif
+            readsf_lost(x);
+            return (1);
+        }
+            /* copy back into the instance structure. */
+        soundfile_copy(&x->x_sf, sf);
+            /* check if another request has been made; if so, field it */
+        if (x->x_requestcode != REQUEST_BUSY)
+        {
+            readsf_lost(x);
+            return (1);
         }
+        x->x_fifohead = 0;
+                /* set fifosize from bufsize.  fifosize must be a
+                multiple of the number of bytes eaten for each DSP
+                tick.  We pessimistically assume MAXVECSIZE samples
+                per tick since that could change.  There could be a
+                problem here if the vector size increases while a
+                soundfile is being played...  */
+        x->x_fifosize = x->x_bufsize - (x->x_bufsize %
+            (sf->sf_bytesperframe * MAXVECSIZE));
+                /* arrange for the "request" condition to be signaled 16
+                times per buffer */
+        x->x_sigcountdown = x->x_sigperiod = (x->x_fifosize /
+            (16 * sf->sf_bytesperframe * x->x_vecsize));
+        x->x_childstreaming = 1;
+        return (1);
     }
-#ifdef DEBUG_SOUNDFILE_THREADS
-    fprintf(stderr, "readsf~: thread exit\n");
-#endif
-    pthread_mutex_unlock(&x->x_mutex);
-    return 0;
+    else if (x->x_requestcode == REQUEST_CLOSE ||
+        x->x_requestcode == REQUEST_QUIT)
+    {
+        int quit = (x->x_requestcode == REQUEST_QUIT);
+        readsf_unmap(x);
+        if (sf->sf_fd >= 0)
+        {
+            readsf_closefile(x);
+            x->x_sf.sf_fd = -1;
+        }
+        if (quit || x->x_requestcode == REQUEST_CLOSE)
+            x->x_requestcode = REQUEST_NOTHING;
+        sfread_cond_signal(&x->x_answercondition);
+        return (quit ? -1 : 1);
+    }
+    else return (0);
+}
+
+/* ----- preloaded heads of soundfiles ----- */
+
+/* readsf~'s "preload" message keeps the first frames of a soundfile in
+memory.  A readsf~ that opens the file plays from there as soon as it's
+started, while its I/O side opens the file and fills the FIFO from the frame
+where the preloaded part ends.  Files are known by their names as given to
+"open", relative to the patch's directory.  Entries are shared by all readsf~
+objects and count their users (plus one while the file is preloaded); an
+entry is freed when the count goes to zero. */
+
+#define SFCACHE_DEFFRAMES 65536
+
+typedef struct _sfcache
+{
+    t_symbol *c_key;            /* directory and name of the file */
+    t_soundfile c_sf;           /* its format, with no file open */
+    unsigned char *c_head;      /* first frames, in the file's format */
+    size_t c_nbytes;            /* allocated size of c_head */
+    size_t c_nframes;           /* frames in c_head */
+    int c_complete;             /* true if that's the whole file */
+    int c_refcount;
+    struct _sfcache *c_next;
+} t_sfcache;
+
+static t_sfcache *sfcache_list;
+static pthread_mutex_t sfcache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static t_symbol *sfcache_key(t_canvas *canvas, const char *filename)
+{
+    char buf[MAXPDSTRING];
+    if (sys_isabsolutepath(filename) || !canvas)
+        return (gensym(filename));
+    snprintf(buf, MAXPDSTRING, "%s/%s", canvas_getdir(canvas)->s_name,
+        filename);
+    return (gensym(buf));
+}
+
+    /* find a file's entry and hold on to it */
+static t_sfcache *sfcache_get(t_symbol *key)
+{
+    t_sfcache *c;
+    pthread_mutex_lock(&sfcache_mutex);
+    for (c = sfcache_list; c; c = c->c_next)
+        if (c->c_key == key)
+    {
+        c->c_refcount++;
+        break;
+    }
+    pthread_mutex_unlock(&sfcache_mutex);
+    return (c);
+}
+
+static void sfcache_release(t_sfcache *c)
+{
+    int refcount;
+    pthread_mutex_lock(&sfcache_mutex);
+    refcount = --c->c_refcount;
+    pthread_mutex_unlock(&sfcache_mutex);
+    if (!refcount)
+    {
+        freebytes(c->c_head, c->c_nbytes);
+        freebytes(c, sizeof(*c));
+    }
+}
+
+    /* take an entry off the list, dropping the list's reference */
+static void sfcache_remove(t_symbol *key)
+{
+    t_sfcache *c, **cp;
+    pthread_mutex_lock(&sfcache_mutex);
+    for (cp = &sfcache_list; (c = *cp); cp = &c->c_next)
+        if (c->c_key == key)
+    {
+        *cp = c->c_next;
+        break;
+    }
+    pthread_mutex_unlock(&sfcache_mutex);
+    if (c)
+        sfcache_release(c);
+}
+
+    /* read the first "nframes" frames of a file into a new entry, replacing
+    any old one.  This reads the file in the calling thread.  Returns 0 on
+    success or else an error number, with the format so far in "sf". */
+static int sfcache_load(t_canvas *canvas, const char *filename,
+    size_t nframes, t_soundfile *sf)
+{
+    t_sfcache *c;
+    size_t want, got = 0;
+    ssize_t bytesread = 1;
+    unsigned char *head;
+    soundfile_clear(sf);
+    sf->sf_headersize = -1;
+    if (open_soundfile_via_canvas(canvas, filename, sf, 0) < 0)
+        return (errno ? errno : SOUNDFILE_ERRUNKNOWN);
+    want = nframes * sf->sf_bytesperframe;
+    if (want > (size_t)sf->sf_bytelimit)
+        want = sf->sf_bytelimit - sf->sf_bytelimit % sf->sf_bytesperframe;
+    head = (unsigned char *)getbytes(want ? want : 1);
+    while (got < want &&
+        (bytesread = soundfile_read(sf, head + got, want - got)) > 0)
+            got += bytesread;
+    soundfile_freedata(sf);
+    sys_close(sf->sf_fd);
+    sf->sf_fd = -1;
+    if (bytesread < 0)
+    {
+        int err = (errno ? errno : SOUNDFILE_ERRMALFORMED);
+        freebytes(head, want ? want : 1);
+        return (err);
+    }
+    got -= got % sf->sf_bytesperframe;
+    c = (t_sfcache *)getbytes(sizeof(*c));
+    c->c_key = sfcache_key(canvas, filename);
+    soundfile_copy(&c->c_sf, sf);
+    c->c_sf.sf_data = NULL;
+    c->c_head = head;
+    c->c_nbytes = (want ? want : 1);
+    c->c_nframes = got / sf->sf_bytesperframe;
+    c->c_complete = (got < nframes * sf->sf_bytesperframe);
+    c->c_refcount = 1;
+    sfcache_remove(c->c_key);
+    pthread_mutex_lock(&sfcache_mutex);
+    c->c_next = sfcache_list;
+    sfcache_list = c;
+    pthread_mutex_unlock(&sfcache_mutex);
+    mem_addsymbolroot(&sfcache_list, sizeof(sfcache_list));
+    return (0);
 }
 
 /* ----- the object proper runs in the calling (parent) thread ----- */
@@ -1976,9 +3106,6 @@ static void *readsf_new(t_floatarg fnchannels, t_floatarg fbufsize)
         outlet_new(&x->x_obj, gensym("signal"));
     x->x_noutlets = nchannels;
     x->x_bangout = outlet_new(&x->x_obj, &s_bang);
-    pthread_mutex_init(&x->x_mutex, 0);
-    pthread_cond_init(&x->x_requestcondition, 0);
-    pthread_cond_init(&x->x_answercondition, 0);
     x->x_vecsize = MAXVECSIZE;
     x->x_state = STATE_IDLE;
     x->x_clock = clock_new(x, (t_method)readsf_tick);
@@ -1990,10 +3117,9 @@ static void *readsf_new(t_floatarg fnchannels, t_floatarg fbufsize)
     x->x_buf = buf;
     x->x_bufsize = bufsize;
     x->x_fifosize = x->x_fifohead = x->x_fifotail = x->x_requestcode = 0;
-#ifdef PDINSTANCE
-    x->x_pd_this = pd_this;
-#endif
-    pthread_create(&x->x_childthread, 0, readsf_child_main, x);
+    x->x_cache = NULL;
+    x->x_cachepos = 0;
+    sfread_startio(x, readsf_service);
     return x;
 }
 
@@ -2002,6 +3128,16 @@ static void readsf_tick(t_readsf *x)
     outlet_bang(x->x_bangout);
 }
 
+    /* true if there are fewer than wantbytes bytes ready; when the fifo
+    is used, one byte fewer is enough */
+static int readsf_short(t_readsf *x, int wantbytes)
+{
+    if (x->x_map.m_data)
+        return (x->x_maphead - x->x_maptail < (size_t)wantbytes);
+    else return (x->x_fifohead >= x->x_fifotail &&
+        x->x_fifohead < x->x_fifotail + wantbytes-1);
+}
+
 static t_int *readsf_perform(t_int *w)
 {
     t_readsf *x = (t_readsf *)(w[1]);
@@ -2012,27 +3148,43 @@ static t_int *readsf_perform(t_int *w)
     soundfile_copy(&sf, &x->x_sf);
     if (x->x_state == STATE_STREAM)
     {
-        int wantbytes;
+        int wantbytes, done = 0;
+            /* first play whatever's left of a preloaded head */
+        if (x->x_cache)
+        {
+            t_sfcache *c = x->x_cache;
+            size_t bytesperframe = c->c_sf.sf_bytesperframe,
+                left = c->c_nframes - x->x_cachepos / bytesperframe;
+            if (left)
+            {
+                done = (left < (size_t)vecsize ? (int)left : vecsize);
+                soundfile_xferin_sample(&c->c_sf, noutlets, x->x_outvec, 0,
+                    c->c_head + x->x_cachepos, done);
+                x->x_cachepos += done * bytesperframe;
+                if (done == vecsize)
+                    return (w + 2);
+            }
+        }
+            /* then stream the rest of the block from the file */
         pthread_mutex_lock(&x->x_mutex);
+        vecsize -= done;
         wantbytes = vecsize * sf.sf_bytesperframe;
-        while (!x->x_eof && x->x_fifohead >= x->x_fifotail &&
-                x->x_fifohead < x->x_fifotail + wantbytes-1)
+        while (!x->x_eof && readsf_short(x, wantbytes))
         {
 #ifdef DEBUG_SOUNDFILE_THREADS
             fprintf(stderr, "readsf~: wait...\n");
 #endif
-            sfread_cond_signal(&x->x_requestcondition);
+            sfread_request(x);
             sfread_cond_wait(&x->x_answercondition, &x->x_mutex);
                 /* resync local variables -- bug fix thanks to Shahrokh */
-            vecsize = x->x_vecsize;
+            vecsize = x->x_vecsize - done;
             soundfile_copy(&sf, &x->x_sf);
             wantbytes = vecsize * sf.sf_bytesperframe;
 #ifdef DEBUG_SOUNDFILE_THREADS
             fprintf(stderr, "readsf~: ... done\n");
 #endif
         }
-        if (x->x_eof && x->x_fifohead >= x->x_fifotail &&
-            x->x_fifohead < x->x_fifotail + wantbytes-1)
+        if (x->x_eof && readsf_short(x, wantbytes))
         {
             int xfersize;
             if (x->x_fileerror)
@@ -2042,33 +3194,46 @@ static t_int *readsf_perform(t_int *w)
             x->x_state = STATE_IDLE;
 
                 /* if there's a partial buffer left, copy it out */
-            xfersize = (x->x_fifohead - x->x_fifotail + 1) /
+            if (x->x_map.m_data)
+                xfersize = (x->x_maphead - x->x_maptail) /
+                    sf.sf_bytesperframe;
+            else xfersize = (x->x_fifohead - x->x_fifotail + 1) /
                        sf.sf_bytesperframe;
             if (xfersize)
             {
-                soundfile_xferin_sample(&sf, noutlets, x->x_outvec, 0,
-                    (unsigned char *)(x->x_buf + x->x_fifotail), xfersize);
+                soundfile_xferin_sample(&sf, noutlets, x->x_outvec, done,
+                    (x->x_map.m_data ? x->x_map.m_data + x->x_maptail :
+                    (unsigned char *)(x->x_buf + x->x_fifotail)), xfersize);
                 vecsize -= xfersize;
             }
                 /* then zero out the (rest of the) output */
             for (i = 0; i < noutlets; i++)
-                for (j = vecsize, fp = x->x_outvec[i] + xfersize; j--;)
+                for (j = vecsize, fp = x->x_outvec[i] + done + xfersize;
+                    j--;)
                     *fp++ = 0;
 
-            sfread_cond_signal(&x->x_requestcondition);
+            sfread_request(x);
             pthread_mutex_unlock(&x->x_mutex);
             return w + 2;
         }
 
-        soundfile_xferin_sample(&sf, noutlets, x->x_outvec, 0,
-            (unsigned char *)(x->x_buf + x->x_fifotail), vecsize);
-
-        x->x_fifotail += wantbytes;
-        if (x->x_fifotail >= x->x_fifosize)
-            x->x_fifotail = 0;
+        if (x->x_map.m_data)
+        {
+            soundfile_xferin_sample(&sf, noutlets, x->x_outvec, done,
+                x->x_map.m_data + x->x_maptail, vecsize);
+            x->x_maptail += wantbytes;
+        }
+        else
+        {
+            soundfile_xferin_sample(&sf, noutlets, x->x_outvec, done,
+                (unsigned char *)(x->x_buf + x->x_fifotail), vecsize);
+            x->x_fifotail += wantbytes;
+            if (x->x_fifotail >= x->x_fifosize)
+                x->x_fifotail = 0;
+        }
         if ((--x->x_sigcountdown) <= 0)
         {
-            sfread_cond_signal(&x->x_requestcondition);
+            sfread_request(x);
             x->x_sigcountdown = x->x_sigperiod;
         }
         pthread_mutex_unlock(&x->x_mutex);
@@ -2097,7 +3262,7 @@ static void readsf_stop(t_readsf *x)
     pthread_mutex_lock(&x->x_mutex);
     x->x_state = STATE_IDLE;
     x->x_requestcode = REQUEST_CLOSE;
-    sfread_cond_signal(&x->x_requestcondition);
+    sfread_request(x);
     pthread_mutex_unlock(&x->x_mutex);
 }
 
@@ -2118,13 +3283,17 @@ static void readsf_open(t_readsf *x, t_symbol *s, int argc, t_atom *argv)
     t_symbol *filesym, *endian;
     t_float onsetframes, headersize, nchannels, bytespersample;
     t_soundfile_type *type = NULL;
+    t_sfcache *cache = NULL;
+    int usemap = 0;
 
     while (argc > 0 && argv->a_type == A_SYMBOL &&
         *argv->a_w.w_symbol->s_name == '-')
     {
-            /* check for type by name */
         const char *flag = argv->a_w.w_symbol->s_name + 1;
-        if (!(type = soundfile_findtype(flag)))
+        if (!strcmp(flag, "mmap"))
+            usemap = 1;
+            /* check for type by name */
+        else if (!(type = soundfile_findtype(flag)))
             goto usage; /* unknown flag */
         argc -= 1; argv += 1;
     }
@@ -2136,6 +3305,17 @@ static void readsf_open(t_readsf *x, t_symbol *s, int argc, t_atom *argv)
     endian = atom_getsymbolarg(5, argc, argv);
     if (!*filesym->s_name)
         return; /* no filename */
+        /* a preloaded head is used unless the format is given */
+    if (!usemap && !type && headersize == 0 &&
+        (cache = sfcache_get(sfcache_key(x->x_canvas, filesym->s_name))) &&
+            cache->c_nframes <= (onsetframes > 0 ? onsetframes : 0))
+    {
+        sfcache_release(cache);
+        cache = NULL;
+    }
+    if (x->x_cache)
+        sfcache_release(x->x_cache);
+    x->x_cache = cache;
 
     pthread_mutex_lock(&x->x_mutex);
     soundfile_clear(&x->x_sf);
@@ -2143,6 +3323,8 @@ static void readsf_open(t_readsf *x, t_symbol *s, int argc, t_atom *argv)
     x->x_filename = filesym->s_name;
     x->x_fifotail = 0;
     x->x_fifohead = 0;
+    x->x_maptail = x->x_maphead = 0;
+    x->x_usemap = usemap;
     if (*endian->s_name == 'b')
          x->x_sf.sf_bigendian = 1;
     else if (*endian->s_name == 'l')
@@ -2165,14 +3347,29 @@ static void readsf_open(t_readsf *x, t_symbol *s, int argc, t_atom *argv)
         x->x_sf.sf_type = type;
     x->x_eof = 0;
     x->x_fileerror = 0;
+    if (cache)
+    {
+            /* play from memory up to the end of the preloaded part, and
+            have the file opened from there on unless that's all of it */
+        x->x_cachepos = x->x_onsetframes * cache->c_sf.sf_bytesperframe;
+        x->x_onsetframes = cache->c_nframes;
+        soundfile_copy(&x->x_sf, &cache->c_sf);
+        x->x_sf.sf_headersize = -1;
+        x->x_sf.sf_bytelimit = SFMAXBYTES;
+        if (cache->c_complete)
+        {
+            x->x_requestcode = REQUEST_CLOSE;
+            x->x_eof = 1;
+        }
+    }
     x->x_state = STATE_STARTUP;
-    sfread_cond_signal(&x->x_requestcondition);
+    sfread_request(x);
     pthread_mutex_unlock(&x->x_mutex);
     return;
 usage:
     pd_error(x, "usage: open [flags] filename [onset] [headersize]...");
     pd_error(0, "[nchannels] [bytespersample] [endian (b or l)]");
-    post("flags: %s", sf_typeargs);
+    post("flags: -mmap %s", sf_typeargs);
 }
 
 static void readsf_dsp(t_readsf *x, t_signal **sp)
@@ -2189,33 +3386,51 @@ static void readsf_dsp(t_readsf *x, t_signal **sp)
 
 static void readsf_print(t_readsf *x)
 {
+    t_sfcache *c;
     post("state %d", x->x_state);
     post("fifo head %d", x->x_fifohead);
     post("fifo tail %d", x->x_fifotail);
     post("fifo size %d", x->x_fifosize);
     post("fd %d", x->x_sf.sf_fd);
     post("eof %d", x->x_eof);
+    if (x->x_cache)
+        post("preloaded %ld of %ld bytes played", (long)x->x_cachepos,
+            (long)(x->x_cache->c_nframes * x->x_cache->c_sf.sf_bytesperframe));
+    pthread_mutex_lock(&sfcache_mutex);
+    for (c = sfcache_list; c; c = c->c_next)
+        post("preloaded: %s (%ld frames%s)", c->c_key->s_name,
+            (long)c->c_nframes, (c->c_complete ? ", complete" : ""));
+    pthread_mutex_unlock(&sfcache_mutex);
+}
+
+    /** preload method: "preload filename [frames]" keeps the first frames
+        of a file (by default SFCACHE_DEFFRAMES) in memory for any readsf~
+        that opens it later */
+static void readsf_preload(t_readsf *x, t_symbol *filesym, t_floatarg f)
+{
+    t_soundfile sf;
+    int err;
+    if (!*filesym->s_name)
+        return;
+    if ((err = sfcache_load(x->x_canvas, filesym->s_name,
+        (f >= 1 ? (size_t)f : SFCACHE_DEFFRAMES), &sf)))
+            object_sferror(x, "readsf~ preload", filesym->s_name, err, &sf);
+}
+
+    /** unload method: forget a preloaded file.  Objects that are
+        playing from it keep it until they're done. */
+static void readsf_unload(t_readsf *x, t_symbol *filesym)
+{
+    if (*filesym->s_name)
+        sfcache_remove(sfcache_key(x->x_canvas, filesym->s_name));
 }
 
     /** request QUIT and wait for acknowledge */
 static void readsf_free(t_readsf *x)
 {
-    void *threadrtn;
-    pthread_mutex_lock(&x->x_mutex);
-    x->x_requestcode = REQUEST_QUIT;
-    sfread_cond_signal(&x->x_requestcondition);
-    while (x->x_requestcode != REQUEST_NOTHING)
-    {
-        sfread_cond_signal(&x->x_requestcondition);
-        sfread_cond_wait(&x->x_answercondition, &x->x_mutex);
-    }
-    pthread_mutex_unlock(&x->x_mutex);
-    if (pthread_join(x->x_childthread, &threadrtn))
-        pd_error(x, "readsf_free: join failed");
-
-    pthread_cond_destroy(&x->x_requestcondition);
-    pthread_cond_destroy(&x->x_answercondition);
-    pthread_mutex_destroy(&x->x_mutex);
+    if (x->x_cache)
+        sfcache_release(x->x_cache);
+    sfread_stopio(x);
     freebytes(x->x_buf, x->x_bufsize);
     clock_free(x->x_clock);
 }
@@ -2233,6 +3448,10 @@ static void readsf_setup(void)
     class_addmethod(readsf_class, (t_method)readsf_open,
         gensym("open"), A_GIMME, 0);
     class_addmethod(readsf_class, (t_method)readsf_print, gensym("print"), 0);
+    class_addmethod(readsf_class, (t_method)readsf_preload,
+        gensym("preload"), A_SYMBOL, A_DEFFLOAT, 0);
+    class_addmethod(readsf_class, (t_method)readsf_unload,
+        gensym("unload"), A_SYMBOL, 0);
 }
 
 /* ------------------------- writesf ------------------------- */
@@ -2243,232 +3462,259 @@ typedef t_readsf t_writesf; /* just re-use the structure */
 
 /* ----- the child thread which performs file I/O ----- */
 
-static void *writesf_child_main(void *zz)
+    /* writer hit an error; close file if necessary, set EOF and signal
+    once more */
+static void writesf_bail(t_writesf *x)
 {
-    t_writesf *x = zz;
-    t_soundfile sf = {0};
-    soundfile_clear(&sf);
-#ifdef PDINSTANCE
-    pd_this = x->x_pd_this;
-#endif
-#ifdef DEBUG_SOUNDFILE_THREADS
-    fprintf(stderr, "writesf~: 1\n");
-#endif
-    pthread_mutex_lock(&x->x_mutex);
-    while (1)
+    t_soundfile *sf = &x->x_childsf;
+    if (x->x_requestcode == REQUEST_BUSY)
+        x->x_requestcode = REQUEST_NOTHING;
+    if (sf->sf_fd >= 0)
     {
-#ifdef DEBUG_SOUNDFILE_THREADS
-        fprintf(stderr, "writesf~: 0\n");
+        int fd = sf->sf_fd;
+        sf->sf_fd = -1;
+        pthread_mutex_unlock(&x->x_mutex);
+        sys_close(fd);
+        pthread_mutex_lock(&x->x_mutex);
+        x->x_eof = 1;
+        x->x_sf.sf_fd = -1;
+    }
+    sfread_cond_signal(&x->x_answercondition);
+}
+
+    /* after each write, as asked for with the "prealloc", "update", and
+    "nocache" messages: reserve disk space some way ahead of the data so
+    that long recordings don't fragment the file system; rewrite the header
+    from time to time so that the file is readable after a crash; and push
+    the data out to disk as it's written and drop it from the page cache,
+    so that the system isn't later stalled writing it all back at once.
+    This runs on the I/O side with the mutex unlocked.  Reserving space
+    and cache control are only done on Linux. */
+static void writesf_diskhints(t_writesf *x, t_soundfile *sf)
+{
+    off_t end = sf->sf_headersize + x->x_byteswritten;
+#ifdef __linux__
+    if (x->x_prealloc && end + x->x_writesize > x->x_reserved)
+    {
+        if (!fallocate(sf->sf_fd, FALLOC_FL_KEEP_SIZE, x->x_reserved,
+            x->x_prealloc))
+                x->x_reserved += x->x_prealloc;
+        else x->x_prealloc = 0;     /* not supported here; stop trying */
+    }
 #endif
-        if (x->x_requestcode == REQUEST_NOTHING)
+        /* a header update can write a pad byte at the end of the data
+        so wait until the data ends on a frame */
+    if (x->x_updateframes && x->x_frameswritten >=
+        x->x_headerframes + x->x_updateframes &&
+            !(x->x_byteswritten % sf->sf_bytesperframe))
+    {
+        off_t pos = lseek(sf->sf_fd, 0, SEEK_CUR);
+        if (sf->sf_type->t_updateheaderfn(sf, x->x_frameswritten))
+            x->x_headerframes = x->x_frameswritten;
+        lseek(sf->sf_fd, pos, SEEK_SET);
+    }
+#ifdef __linux__
+    if (x->x_nocache)
+    {
+            /* start writing the new data back; then wait for the last
+            lot to be written, which should have happened by now, and
+            drop it from the cache */
+        sync_file_range(sf->sf_fd, x->x_synced, end - x->x_synced,
+            SYNC_FILE_RANGE_WRITE);
+        if (x->x_synced > x->x_dropped)
         {
-#ifdef DEBUG_SOUNDFILE_THREADS
-            fprintf(stderr, "writesf~: wait 2\n");
-#endif
-            sfread_cond_signal(&x->x_answercondition);
-            sfread_cond_wait(&x->x_requestcondition, &x->x_mutex);
-#ifdef DEBUG_SOUNDFILE_THREADS
-            fprintf(stderr, "writesf~: 3\n");
-#endif
+            sync_file_range(sf->sf_fd, x->x_dropped,
+                x->x_synced - x->x_dropped, SYNC_FILE_RANGE_WAIT_BEFORE |
+                    SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+            posix_fadvise(sf->sf_fd, x->x_dropped,
+                x->x_synced - x->x_dropped, POSIX_FADV_DONTNEED);
+            x->x_dropped = x->x_synced;
         }
-        else if (x->x_requestcode == REQUEST_OPEN)
-        {
-            ssize_t byteswritten;
-            size_t writebytes;
-
-                /* copy file stuff out of the data structure so we can
-                relinquish the mutex while we're in open_soundfile_via_path() */
-            const char *filename = x->x_filename;
-            t_canvas *canvas = x->x_canvas;
-            soundfile_copy(&sf, &x->x_sf);
+        x->x_synced = end;
+    }
+#endif
+}
 
-                /* alter the request code so that an ensuing "open" will get
-                noticed. */
-#ifdef DEBUG_SOUNDFILE_THREADS
-            fprintf(stderr, "writesf~: 4\n");
+    /* give back space reserved beyond the end of the file */
+static void writesf_unreserve(t_writesf *x, int fd)
+{
+#ifdef __linux__
+    off_t size;
+    if (x->x_reserved > x->x_sf.sf_headersize &&
+        (size = lseek(fd, 0, SEEK_END)) >= 0 && ftruncate(fd, size) < 0)
+            post("writesf~: %s", strerror(errno));
 #endif
-            x->x_requestcode = REQUEST_BUSY;
-            x->x_fileerror = 0;
+}
 
-                /* if there's already a file open, close it.  This
-                should never happen since writesf_open() calls stop if
-                needed and then waits until we're idle. */
-            if (sf.sf_fd >= 0)
-            {
-                size_t frameswritten = x->x_frameswritten;
-
-                pthread_mutex_unlock(&x->x_mutex);
-                soundfile_finishwrite(x, filename, &sf,
-                    SFMAXFRAMES, frameswritten);
-                sys_close(sf.sf_fd);
-                sf.sf_fd = -1;
-                pthread_mutex_lock(&x->x_mutex);
-                x->x_sf.sf_fd = -1;
+    /* one step of the writer: wait for the fifo to have data and write it
+    to disk */
+static int writesf_service(t_writesf *x)
+{
+    t_soundfile *sf = &x->x_childsf;
+    if (x->x_childstreaming && !(x->x_requestcode == REQUEST_BUSY ||
+        (x->x_requestcode == REQUEST_CLOSE &&
+            x->x_fifohead != x->x_fifotail)))
+                x->x_childstreaming = 0;
+    if (x->x_childstreaming)
+    {
+        ssize_t byteswritten;
+        size_t writebytes;
+        int fifosize = x->x_fifosize, fifotail;
+        char *buf = x->x_buf;
+            /* if the head is < the tail, we can immediately write
+            from tail to end of fifo to disk; otherwise we hold off
+            writing until there are at least WRITESIZE bytes in the
+            buffer */
+        if (x->x_fifohead < x->x_fifotail ||
+            x->x_fifohead >= x->x_fifotail + x->x_writesize
+            || (x->x_requestcode == REQUEST_CLOSE &&
+                x->x_fifohead != x->x_fifotail))
+        {
+            writebytes = (x->x_fifohead < x->x_fifotail ?
+                fifosize : x->x_fifohead) - x->x_fifotail;
+            if (writebytes > (size_t)x->x_writesize)
+                writebytes = x->x_writesize;
+                /* end big writes on a page boundary in the file */
+            if (writebytes > WRITEALIGN)
+                writebytes -= (x->x_sf.sf_headersize + x->x_byteswritten +
+                    writebytes) % WRITEALIGN;
+        }
+        else
+        {
+            sfread_cond_signal(&x->x_answercondition);
+            return (0);
+        }
+        fifotail = x->x_fifotail;
+        soundfile_copy(sf, &x->x_sf);
+        pthread_mutex_unlock(&x->x_mutex);
+        byteswritten = write(sf->sf_fd, buf + fifotail, writebytes);
+        pthread_mutex_lock(&x->x_mutex);
+        if (x->x_requestcode != REQUEST_BUSY &&
+            x->x_requestcode != REQUEST_CLOSE)
+        {
+            x->x_childstreaming = 0;
+            return (1);
+        }
+        if (byteswritten < (ssize_t)writebytes)
+        {
 #ifdef DEBUG_SOUNDFILE_THREADS
-                fprintf(stderr, "writesf~: bug? ditched %ld\n", frameswritten);
+            fprintf(stderr, "writesf~: fileerror %d\n", errno);
 #endif
-                if (x->x_requestcode != REQUEST_BUSY)
-                    continue;
-            }
-                /* cache sf *after* closing as x->sf's type
-                    may have changed in readsf_open() */
-            soundfile_copy(&sf, &x->x_sf);
-
-                /* open the soundfile with the mutex unlocked */
+            x->x_fileerror = errno;
+            writesf_bail(x);
+            return (1);
+        }
+        x->x_fifotail += byteswritten;
+        if (x->x_fifotail == fifosize)
+            x->x_fifotail = 0;
+        x->x_byteswritten += byteswritten;
+        x->x_frameswritten = x->x_byteswritten / sf->sf_bytesperframe;
+        if (x->x_prealloc || x->x_updateframes || x->x_nocache)
+        {
             pthread_mutex_unlock(&x->x_mutex);
-            create_soundfile(canvas, filename, &sf, 0);
+            writesf_diskhints(x, sf);
             pthread_mutex_lock(&x->x_mutex);
+        }
+            /* signal parent in case it's waiting for data */
+        sfread_cond_signal(&x->x_answercondition);
+        return (1);
+    }
+    else if (x->x_requestcode == REQUEST_NOTHING)
+    {
+        sfread_cond_signal(&x->x_answercondition);
+        return (0);
+    }
+    else if (x->x_requestcode == REQUEST_OPEN)
+    {
+            /* copy file stuff out of the data structure so we can
+            relinquish the mutex while we're in open_soundfile_via_path() */
+        const char *filename = x->x_filename;
+        t_canvas *canvas = x->x_canvas;
+        soundfile_copy(sf, &x->x_sf);
+
+            /* alter the request code so that an ensuing "open" will get
+            noticed. */
+        x->x_requestcode = REQUEST_BUSY;
+        x->x_fileerror = 0;
+
+            /* if there's already a file open, close it.  This
+            should never happen since writesf_open() calls stop if
+            needed and then waits until we're idle. */
+        if (sf->sf_fd >= 0)
+        {
+            size_t frameswritten = x->x_frameswritten;
+            int fd = sf->sf_fd;
 
+            pthread_mutex_unlock(&x->x_mutex);
+            soundfile_finishwrite(x, filename, sf,
+                SFMAXFRAMES, frameswritten);
+            writesf_unreserve(x, fd);
+            sys_close(fd);
+            pthread_mutex_lock(&x->x_mutex);
+            sf->sf_fd = -1;
+            x->x_sf.sf_fd = -1;
 #ifdef DEBUG_SOUNDFILE_THREADS
-            fprintf(stderr, "writesf~: 5\n");
-#endif
-
-            if (sf.sf_fd < 0)
-            {
-                x->x_sf.sf_fd = -1;
-                x->x_eof = 1;
-                x->x_fileerror = errno;
-#ifdef DEBUG_SOUNDFILE_THREADS
-                fprintf(stderr, "writesf~: open failed %s\n", filename);
+            fprintf(stderr, "writesf~: bug? ditched %ld\n", frameswritten);
 #endif
-                goto bail;
-            }
-                /* check if another request has been made; if so, field it */
             if (x->x_requestcode != REQUEST_BUSY)
-                continue;
-#ifdef DEBUG_SOUNDFILE_THREADS
-            fprintf(stderr, "writesf~: 6\n");
-#endif
-                /* copy back into the instance structure. */
-            soundfile_copy(&x->x_sf, &sf);
-            x->x_fifotail = 0;
-            x->x_frameswritten = 0;
-                /* in a loop, wait for the fifo to have data and write it
-                    to disk */
-            while (x->x_requestcode == REQUEST_BUSY ||
-                (x->x_requestcode == REQUEST_CLOSE &&
-                    x->x_fifohead != x->x_fifotail))
-            {
-                int fifosize = x->x_fifosize, fifotail;
-                char *buf = x->x_buf;
-#ifdef DEBUG_SOUNDFILE_THREADS
-                fprintf(stderr, "writesf~: 77\n");
-#endif
-                    /* if the head is < the tail, we can immediately write
-                    from tail to end of fifo to disk; otherwise we hold off
-                    writing until there are at least WRITESIZE bytes in the
-                    buffer */
-                if (x->x_fifohead < x->x_fifotail ||
-                    x->x_fifohead >= x->x_fifotail + WRITESIZE
-                    || (x->x_requestcode == REQUEST_CLOSE &&
-                        x->x_fifohead != x->x_fifotail))
-                {
-                    writebytes = (x->x_fifohead < x->x_fifotail ?
-                        fifosize : x->x_fifohead) - x->x_fifotail;
-                    if (writebytes > READSIZE)
-                        writebytes = READSIZE;
-                }
-                else
-                {
-#ifdef DEBUG_SOUNDFILE_THREADS
-                    fprintf(stderr, "writesf~: wait 7a...\n");
-#endif
-                    sfread_cond_signal(&x->x_answercondition);
-#ifdef DEBUG_SOUNDFILE_THREADS
-                    fprintf(stderr, "writesf~: signaled...\n");
-#endif
-                    sfread_cond_wait(&x->x_requestcondition,
-                        &x->x_mutex);
-#ifdef DEBUG_SOUNDFILE_THREADS
-                    fprintf(stderr, "writesf~: 7a ... done\n");
-#endif
-                    continue;
-                }
-#ifdef DEBUG_SOUNDFILE_THREADS
-                fprintf(stderr, "writesf~: 8\n");
-#endif
-                fifotail = x->x_fifotail;
-                soundfile_copy(&sf, &x->x_sf);
-                pthread_mutex_unlock(&x->x_mutex);
-                byteswritten = write(sf.sf_fd, buf + fifotail, writebytes);
-                pthread_mutex_lock(&x->x_mutex);
-                if (x->x_requestcode != REQUEST_BUSY &&
-                    x->x_requestcode != REQUEST_CLOSE)
-                        break;
-                if (byteswritten < (ssize_t)writebytes)
-                {
-#ifdef DEBUG_SOUNDFILE_THREADS
-                    fprintf(stderr, "writesf~: fileerror %d\n", errno);
-#endif
-                    x->x_fileerror = errno;
-                    goto bail;
-                }
-                else
-                {
-                    x->x_fifotail += byteswritten;
-                    if (x->x_fifotail == fifosize)
-                        x->x_fifotail = 0;
-                }
-                x->x_frameswritten += byteswritten / sf.sf_bytesperframe;
-#ifdef DEBUG_SOUNDFILE_THREADS
-                fprintf(stderr, "writesf~: after head %d tail %d written %ld\n",
-                    x->x_fifohead, x->x_fifotail, x->x_frameswritten);
-#endif
-                    /* signal parent in case it's waiting for data */
-                sfread_cond_signal(&x->x_answercondition);
-                continue;
-
-             bail:
-                 if (x->x_requestcode == REQUEST_BUSY)
-                     x->x_requestcode = REQUEST_NOTHING;
-                     /* hit an error; close file if necessary,
-                     set EOF and signal once more */
-                 if (sf.sf_fd >= 0)
-                 {
-                     pthread_mutex_unlock(&x->x_mutex);
-                     sys_close(sf.sf_fd);
-                     sf.sf_fd = -1;
-                     pthread_mutex_lock(&x->x_mutex);
-                     x->x_eof = 1;
-                     x->x_sf.sf_fd = -1;
-                 }
-                 sfread_cond_signal(&x->x_answercondition);
-            }
-        }
-        else if (x->x_requestcode == REQUEST_CLOSE ||
-            x->x_requestcode == REQUEST_QUIT)
-        {
-            int quit = (x->x_requestcode == REQUEST_QUIT);
-            if (sf.sf_fd >= 0)
-            {
-                const char *filename = x->x_filename;
-                size_t frameswritten = x->x_frameswritten;
-                soundfile_copy(&sf, &x->x_sf);
-                pthread_mutex_unlock(&x->x_mutex);
-                soundfile_finishwrite(x, filename, &sf,
-                    SFMAXFRAMES, frameswritten);
-                sys_close(sf.sf_fd);
-                sf.sf_fd = -1;
-                pthread_mutex_lock(&x->x_mutex);
-                x->x_sf.sf_fd = -1;
-            }
-            x->x_requestcode = REQUEST_NOTHING;
-            sfread_cond_signal(&x->x_answercondition);
-            if (quit)
-                break;
+                return (1);
         }
-        else
+            /* cache sf *after* closing as x->sf's type
+                may have changed in readsf_open() */
+        soundfile_copy(sf, &x->x_sf);
+
+            /* open the soundfile with the mutex unlocked */
+        pthread_mutex_unlock(&x->x_mutex);
+        create_soundfile(canvas, filename, sf, 0);
+        pthread_mutex_lock(&x->x_mutex);
+
+        if (sf->sf_fd < 0)
         {
+            x->x_sf.sf_fd = -1;
+            x->x_eof = 1;
+            x->x_fileerror = errno;
 #ifdef DEBUG_SOUNDFILE_THREADS
-            fprintf(stderr, "writesf~: 13\n");
+            fprintf(stderr, "writesf~: open failed %s\n", filename);
 #endif
+            writesf_bail(x);
+            return (1);
         }
+            /* check if another request has been made; if so, field it */
+        if (x->x_requestcode != REQUEST_BUSY)
+            return (1);
+            /* copy back into the instance structure. */
+        soundfile_copy(&x->x_sf, sf);
+        x->x_fifotail = 0;
+        x->x_frameswritten = x->x_byteswritten = x->x_headerframes = 0;
+        x->x_reserved = x->x_synced = x->x_dropped = sf->sf_headersize;
+        x->x_childstreaming = 1;
+        return (1);
     }
-#ifdef DEBUG_SOUNDFILE_THREADS
-    fprintf(stderr, "writesf~: thread exit\n");
-#endif
-    pthread_mutex_unlock(&x->x_mutex);
-    return 0;
+    else if (x->x_requestcode == REQUEST_CLOSE ||
+        x->x_requestcode == REQUEST_QUIT)
+    {
+        int quit = (x->x_requestcode == REQUEST_QUIT);
+        if (sf->sf_fd >= 0)
+        {
+            const char *filename = x->x_filename;
+            size_t frameswritten = x->x_frameswritten;
+            int fd;
+            soundfile_copy(sf, &x->x_sf);
+            fd = sf->sf_fd;
+            pthread_mutex_unlock(&x->x_mutex);
+            soundfile_finishwrite(x, filename, sf,
+                SFMAXFRAMES, frameswritten);
+            writesf_unreserve(x, fd);
+            sys_close(fd);
+            pthread_mutex_lock(&x->x_mutex);
+            sf->sf_fd = -1;
+            x->x_sf.sf_fd = -1;
+        }
+        x->x_requestcode = REQUEST_NOTHING;
+        sfread_cond_signal(&x->x_answercondition);
+        return (quit ? -1 : 1);
+    }
+    else return (0);
 }
 
 /* ----- the object proper runs in the calling (parent) thread ----- */
@@ -2499,9 +3745,6 @@ static void *writesf_new(t_floatarg fnchannels, t_floatarg fbufsize)
         inlet_new(&x->x_obj,  &x->x_obj.ob_pd, &s_signal, &s_signal);
 
     x->x_f = 0;
-    pthread_mutex_init(&x->x_mutex, 0);
-    pthread_cond_init(&x->x_requestcondition, 0);
-    pthread_cond_init(&x->x_answercondition, 0);
     x->x_vecsize = MAXVECSIZE;
     x->x_insamplerate = 0;
     x->x_state = STATE_IDLE;
@@ -2514,10 +3757,10 @@ static void *writesf_new(t_floatarg fnchannels, t_floatarg fbufsize)
     x->x_buf = buf;
     x->x_bufsize = bufsize;
     x->x_fifosize = x->x_fifohead = x->x_fifotail = x->x_requestcode = 0;
-#ifdef PDINSTANCE
-    x->x_pd_this = pd_this;
-#endif
-    pthread_create(&x->x_childthread, 0, writesf_child_main, x);
+    x->x_chunk = x->x_writesize = WRITESIZE;
+    x->x_preallocsec = x->x_updatesec = 0;
+    x->x_nocache = 0;
+    sfread_startio(x, writesf_service);
     return x;
 }
 
@@ -2542,7 +3785,7 @@ static t_int *writesf_perform(t_int *w)
             fprintf(stderr, "(head %d, tail %d, room %d, want %ld)\n",
                 (int)x->x_fifohead, (int)x->x_fifotail,
                 (int)roominfifo, (long)wantbytes);
-            sfread_cond_signal(&x->x_requestcondition);
+            sfread_request(x);
             sfread_cond_wait(&x->x_answercondition, &x->x_mutex);
             fprintf(stderr, "... done waiting.\n");
             roominfifo = x->x_fifotail - x->x_fifohead;
@@ -2555,7 +3798,7 @@ static t_int *writesf_perform(t_int *w)
                 object_sferror(x, "writesf~", x->x_filename,
                     x->x_fileerror, &x->x_sf);
             x->x_state = STATE_IDLE;
-            sfread_cond_signal(&x->x_requestcondition);
+            sfread_request(x);
             pthread_mutex_unlock(&x->x_mutex);
             return w + 2;
         }
@@ -2571,7 +3814,7 @@ static t_int *writesf_perform(t_int *w)
 #ifdef DEBUG_SOUNDFILE_THREADS
             fprintf(stderr, "writesf~: signal 1\n");
 #endif
-            sfread_cond_signal(&x->x_requestcondition);
+            sfread_request(x);
             x->x_sigcountdown = x->x_sigperiod;
         }
         pthread_mutex_unlock(&x->x_mutex);
@@ -2598,7 +3841,7 @@ static void writesf_stop(t_writesf *x)
 #ifdef DEBUG_SOUNDFILE_THREADS
     fprintf(stderr, "writesf~: signal 2\n");
 #endif
-    sfread_cond_signal(&x->x_requestcondition);
+    sfread_request(x);
     pthread_mutex_unlock(&x->x_mutex);
 }
 
@@ -2622,7 +3865,7 @@ static void writesf_open(t_writesf *x, t_symbol *s, int argc, t_atom *argv)
     pthread_mutex_lock(&x->x_mutex);
     while (x->x_requestcode != REQUEST_NOTHING)
     {
-        sfread_cond_signal(&x->x_requestcondition);
+        sfread_request(x);
         sfread_cond_wait(&x->x_answercondition, &x->x_mutex);
     }
     x->x_filename = wa.wa_filesym->s_name;
@@ -2636,7 +3879,12 @@ static void writesf_open(t_writesf *x, t_symbol *s, int argc, t_atom *argv)
         (wa.wa_bytespersample > 2 ? wa.wa_bytespersample : 2);
     x->x_sf.sf_bigendian = wa.wa_bigendian;
     x->x_sf.sf_bytesperframe = x->x_sf.sf_nchannels * x->x_sf.sf_bytespersample;
-    x->x_frameswritten = 0;
+    x->x_frameswritten = x->x_byteswritten = 0;
+    x->x_prealloc = (off_t)(x->x_preallocsec * x->x_sf.sf_samplerate) *
+        x->x_sf.sf_bytesperframe;
+    if (x->x_prealloc)
+        x->x_prealloc += (- x->x_prealloc) & (WRITEALIGN - 1);
+    x->x_updateframes = x->x_updatesec * x->x_sf.sf_samplerate;
     x->x_requestcode = REQUEST_OPEN;
     x->x_fifotail = 0;
     x->x_fifohead = 0;
@@ -2652,10 +3900,41 @@ static void writesf_open(t_writesf *x, t_symbol *s, int argc, t_atom *argv)
             times per buffer */
     x->x_sigcountdown = x->x_sigperiod = (x->x_fifosize /
             (16 * (x->x_sf.sf_bytesperframe * x->x_vecsize)));
-    sfread_cond_signal(&x->x_requestcondition);
+        /* the writer waits for a chunk, so the fifo must hold several */
+    x->x_writesize = (x->x_chunk < x->x_fifosize / 4 ?
+        x->x_chunk : (x->x_fifosize / 4) & ~(WRITEALIGN - 1));
+    sfread_request(x);
     pthread_mutex_unlock(&x->x_mutex);
 }
 
+    /** "chunk" message: write to disk in chunks of up to this many
+        kilobytes, rounded to a file page, from the next "open" */
+static void writesf_chunk(t_writesf *x, t_floatarg f)
+{
+    int chunk = (f > 0 ? f : WRITESIZE / 1024);
+    if (chunk > MAXBUFSIZE / 4096)
+        chunk = MAXBUFSIZE / 4096;
+    x->x_chunk = (chunk * 1024 + WRITEALIGN - 1) & ~(WRITEALIGN - 1);
+}
+
+    /** "prealloc" message: reserve disk space this many seconds ahead */
+static void writesf_prealloc(t_writesf *x, t_floatarg f)
+{
+    x->x_preallocsec = (f > 0 ? f : 0);
+}
+
+    /** "update" message: rewrite the header every so many seconds */
+static void writesf_update(t_writesf *x, t_floatarg f)
+{
+    x->x_updatesec = (f > 0 ? f : 0);
+}
+
+    /** "nocache" message: write through the page cache */
+static void writesf_nocache(t_writesf *x, t_floatarg f)
+{
+    x->x_nocache = (f != 0);
+}
+
 static void writesf_dsp(t_writesf *x, t_signal **sp)
 {
     int i, ninlets = x->x_sf.sf_nchannels;
@@ -2678,36 +3957,14 @@ static void writesf_print(t_writesf *x)
     post("fifo size %d", x->x_fifosize);
     post("fd %d", x->x_sf.sf_fd);
     post("eof %d", x->x_eof);
+    post("chunk %d bytes, prealloc %g sec, update %g sec, nocache %d",
+        x->x_chunk, x->x_preallocsec, x->x_updatesec, x->x_nocache);
 }
 
     /** request QUIT and wait for acknowledge */
 static void writesf_free(t_writesf *x)
 {
-    void *threadrtn;
-    pthread_mutex_lock(&x->x_mutex);
-    x->x_requestcode = REQUEST_QUIT;
-#ifdef DEBUG_SOUNDFILE_THREADS
-    fprintf(stderr, "writesf~: stopping thread...\n");
-#endif
-    sfread_cond_signal(&x->x_requestcondition);
-    while (x->x_requestcode != REQUEST_NOTHING)
-    {
-#ifdef DEBUG_SOUNDFILE_THREADS
-        fprintf(stderr, "writesf~: signaling...\n");
-#endif
-        sfread_cond_signal(&x->x_requestcondition);
-        sfread_cond_wait(&x->x_answercondition, &x->x_mutex);
-    }
-    pthread_mutex_unlock(&x->x_mutex);
-    if (pthread_join(x->x_childthread, &threadrtn))
-        pd_error(x, "writesf_free: join failed");
-#ifdef DEBUG_SOUNDFILE_THREADS
-    fprintf(stderr, "writesf~: ... done\n");
-#endif
-
-    pthread_cond_destroy(&x->x_requestcondition);
-    pthread_cond_destroy(&x->x_answercondition);
-    pthread_mutex_destroy(&x->x_mutex);
+    sfread_stopio(x);
     freebytes(x->x_buf, x->x_bufsize);
 }
 
@@ -2723,14 +3980,23 @@ static void writesf_setup(void)
     class_addmethod(writesf_class, (t_method)writesf_open,
         gensym("open"), A_GIMME, 0);
     class_addmethod(writesf_class, (t_method)writesf_print, gensym("print"), 0);
+    class_addmethod(writesf_class, (t_method)writesf_chunk,
+        gensym("chunk"), A_FLOAT, 0);
+    class_addmethod(writesf_class, (t_method)writesf_prealloc,
+        gensym("prealloc"), A_FLOAT, 0);
+    class_addmethod(writesf_class, (t_method)writesf_update,
+        gensym("update"), A_FLOAT, 0);
+    class_addmethod(writesf_class, (t_method)writesf_nocache,
+        gensym("nocache"), A_FLOAT, 0);
     CLASS_MAINSIGNALIN(writesf_class, t_writesf, x_f);
 }
 
 /* ------------------------- global setup routine ------------------------ */
 
+    /* the file types are set up separately, from conf_init(), as externs
+    may add more whether or not these classes are ever set up */
 void d_soundfile_setup(void)
 {
-    soundfile_type_setup();
     soundfiler_setup();
     readsf_setup();
     writesf_setup();
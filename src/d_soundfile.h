@@ -62,6 +62,7 @@ typedef struct _soundfile
     int sf_bigendian;      /**< sample endianness, 1 : big or 0 : little  */
     int sf_bytesperframe;  /**< number of bytes per sample frame          */
     ssize_t sf_bytelimit;  /**< number of sound data bytes to read/write  */
+    void *sf_data;         /**< decoder state of compressed types or NULL */
 } t_soundfile;
 
     /** clear soundfile struct to defaults, does not close or free */
@@ -121,7 +122,28 @@ typedef int (*t_soundfile_addextensionfn)(char *filename, size_t size);
         returns 1 for big endian, 0 for little endian */
 typedef int (*t_soundfile_endiannessfn)(int endianness);
 
-    /* type implementation for a single file format */
+    /** read up to size bytes of decoded sample data into buf, as
+        described by the sf format info, from the current position, returns
+        bytes read, 0 at the end of the data, or -1 on error
+        note: only called for whole sample frames when sf_data is set
+        this may be called in a background thread */
+typedef ssize_t (*t_soundfile_readsamplesfn)(t_soundfile *sf,
+    void *buf, size_t size);
+
+    /** seek to the given sample frame, returns 1 on success or 0 on error
+        this may be called in a background thread */
+typedef int (*t_soundfile_seekfn)(t_soundfile *sf, size_t frame);
+
+    /** free the decoder state in sf_data
+        this may be called in a background thread */
+typedef void (*t_soundfile_freedatafn)(t_soundfile *sf);
+
+    /* type implementation for a single file format
+
+       types whose sample data isn't raw linear PCM allocate their decoder
+       state in sf_data when reading the header, and then must provide the
+       last three functions; samples are then read and seeked through them
+       instead of directly from the file */
 typedef struct _soundfile_type
 {
     char *t_name;           /**< type name, unique & w/o white spaces       */
@@ -133,6 +155,9 @@ typedef struct _soundfile_type
     t_soundfile_hasextensionfn t_hasextensionfn; /**< must be non-NULL      */
     t_soundfile_addextensionfn t_addextensionfn; /**< must be non-NULL      */
     t_soundfile_endiannessfn t_endiannessfn;     /**< must be non-NULL      */
+    t_soundfile_readsamplesfn t_readsamplesfn;   /**< may be NULL           */
+    t_soundfile_seekfn t_seekfn;                 /**< may be NULL           */
+    t_soundfile_freedatafn t_freedatafn;         /**< may be NULL           */
 } t_soundfile_type;
 
     /** add a new type implementation
@@ -141,6 +166,14 @@ int soundfile_addtype(const t_soundfile_type *t);
 
 /* ----- read/write helpers ----- */
 
+    /** read up to size bytes of sample data from an open soundfile, through
+        its type if it keeps decoder state, otherwise with read(),
+        returns bytes read, 0 at the end, or -1 on error */
+ssize_t soundfile_read(t_soundfile *sf, void *buf, size_t size);
+
+    /** free any decoder state of an open soundfile; doesn't close sf_fd */
+void soundfile_freedata(t_soundfile *sf);
+
     /** seek to offset in file fd and read size bytes into dst,
         returns bytes written on success or -1 on failure */
 ssize_t fd_read(int fd, off_t offset, void *dst, size_t size);
@@ -611,7 +611,10 @@ static const t_soundfile_type aiff = {
     aiff_updateheader,
     aiff_hasextension,
     aiff_addextension,
-    aiff_endianness
+    aiff_endianness,
+    NULL,
+    NULL,
+    NULL
 };
 
 void soundfile_aiff_setup( void)
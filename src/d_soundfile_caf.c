@@ -420,7 +420,10 @@ static const t_soundfile_type caf = {
     caf_updateheader,
     caf_hasextension,
     caf_addextension,
-    caf_endianness
+    caf_endianness,
+    NULL,
+    NULL,
+    NULL
 };
 
 void soundfile_caf_setup( void)
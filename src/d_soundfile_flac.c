@@ -0,0 +1,626 @@
+/* Copyright (c) 1997-2021 Miller Puckette and others.
+* For information on usage and redistribution, and for a DISCLAIMER OF ALL
+* WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+/* refs: https://xiph.org/flac/format.html
+         https://datatracker.ietf.org/doc/draft-ietf-cellar-flac */
+
+#include "d_soundfile.h"
+
+/* FLAC
+
+  * "fLaC" id followed by metadata blocks, the first being STREAMINFO,
+    then the audio frames
+  * each frame holds one block of samples for all channels, losslessly
+    compressed through a predictor (constant, verbatim, fixed polynomial
+    or LPC) and Rice coded residuals, optionally with the two channels of
+    a stereo stream stored as left/side, side/right or mid/side
+  * a frame header starts with a 14 bit sync code, and may repeat the
+    stream's sample rate and sample size
+  * an optional SEEKTABLE metadata block gives the byte offsets of some
+    frames relative to the first one
+
+  this implementation:
+
+    * reads only; writing is refused with an "unsupported sample format"
+      error
+    * decodes on demand in the calling thread, one frame at a time, into
+      16 or 24 bit little endian lpcm, so that readsf~ and soundfiler see
+      ordinary sample data; sf_headersize is then the offset of the first
+      frame and sf_bytelimit the size of the decoded data
+    * seeks by way of the SEEKTABLE if present and otherwise decodes from
+      the first frame up to the requested sample frame
+    * sample format: 4 to 24 bits, up to 8 channels
+    * does not check the frame header and footer CRCs or the MD5 signature
+    * does not skip ID3 tags before the "fLaC" id
+
+*/
+
+#define FLACHEADSIZE 42      /**< id + block header + STREAMINFO */
+#define FLACBUFSIZE 16384    /**< file bytes read at a time */
+#define FLACMAXBITS 24       /**< max sample size */
+
+#define FLAC_STREAMINFO 0
+#define FLAC_SEEKTABLE 3
+
+typedef struct _flacseek
+{
+    uint64_t fs_frame;      /**< first sample frame of the target frame */
+    uint64_t fs_offset;     /**< its byte offset from the first frame   */
+} t_flacseek;
+
+    /** decoder state kept in sf_data */
+typedef struct _flac
+{
+    int f_fd;               /**< the soundfile's file descriptor   */
+    int f_nchannels;        /**< number of channels                */
+    int f_bitspersample;    /**< sample size in the stream         */
+    int f_shift;            /**< left shift to the output size     */
+    int f_maxblock;         /**< max frames per block              */
+    int f_nseek;            /**< number of seek points             */
+    t_flacseek *f_seek;     /**< seek points or NULL               */
+    int32_t *f_samples;     /**< decoded block, channel after channel */
+    int f_blocksize;        /**< frames in the decoded block       */
+    int f_blockpos;         /**< next frame to hand out            */
+    int f_eof;              /**< ran out of file bytes             */
+    int f_error;            /**< hit a malformed frame             */
+    off_t f_filepos;        /**< file offset of f_buf[0]           */
+    int f_bufsize;          /**< bytes in f_buf                    */
+    int f_bufpos;           /**< next byte in f_buf                */
+    uint64_t f_cache;       /**< bits read but not yet used        */
+    int f_nbits;            /**< number of them, always < 8        */
+    unsigned char f_buf[FLACBUFSIZE];
+} t_flac;
+
+/* ----- bit reader ----- */
+
+    /** get the next file byte into the bit cache, returns 0 at the end */
+static int flac_fillbyte(t_flac *f)
+{
+    if (f->f_bufpos >= f->f_bufsize)
+    {
+        ssize_t n = read(f->f_fd, f->f_buf, FLACBUFSIZE);
+        f->f_filepos += f->f_bufsize;
+        f->f_bufsize = f->f_bufpos = 0;
+        if (n <= 0)
+        {
+            f->f_eof = 1;
+            return 0;
+        }
+        f->f_bufsize = (int)n;
+    }
+    f->f_cache = (f->f_cache << 8) | f->f_buf[f->f_bufpos++];
+    f->f_nbits += 8;
+    return 1;
+}
+
+    /** read an unsigned value of n <= 32 bits, 0 at the end of the file */
+static uint32_t flac_bits(t_flac *f, int n)
+{
+    while (f->f_nbits < n)
+        if (!flac_fillbyte(f))
+            return 0;
+    f->f_nbits -= n;
+    return (uint32_t)((f->f_cache >> f->f_nbits) & ((1ULL << n) - 1));
+}
+
+    /** read a two's complement value of n <= 32 bits */
+static int32_t flac_sbits(t_flac *f, int n)
+{
+    uint32_t v, sign;
+    if (n <= 0)
+        return 0;
+    v = flac_bits(f, n);
+    sign = (uint32_t)1 << (n - 1);
+    return (int32_t)((v ^ sign) - sign);
+}
+
+    /** count zero bits up to the next 1 */
+static uint32_t flac_unary(t_flac *f)
+{
+    uint32_t q = 0;
+    while (1)
+    {
+        if (!f->f_nbits && !flac_fillbyte(f))
+            return 0;
+        if (f->f_cache & ((1U << f->f_nbits) - 1))
+        {
+            while (!((f->f_cache >> (f->f_nbits - 1)) & 1))
+                q++, f->f_nbits--;
+            f->f_nbits--;
+            return q;
+        }
+        q += f->f_nbits;
+        f->f_nbits = 0;
+    }
+}
+
+    /** drop bits up to the next byte boundary */
+static void flac_align(t_flac *f)
+{
+    f->f_nbits = 0;
+}
+
+    /** byte offset in the file of the next whole byte */
+static off_t flac_tell(const t_flac *f)
+{
+    return f->f_filepos + f->f_bufpos;
+}
+
+    /** continue reading at the given file offset */
+static int flac_goto(t_flac *f, off_t offset)
+{
+    f->f_nbits = 0;
+    f->f_eof = 0;
+    if (offset >= f->f_filepos && offset <= f->f_filepos + f->f_bufsize)
+    {
+        f->f_bufpos = (int)(offset - f->f_filepos);
+        return 1;
+    }
+    if (lseek(f->f_fd, offset, SEEK_SET) != offset)
+        return 0;
+    f->f_filepos = offset;
+    f->f_bufsize = f->f_bufpos = 0;
+    return 1;
+}
+
+/* ----- frame decoding ----- */
+
+    /** read the residual of a subframe after its "order" warm-up samples */
+static int flac_residual(t_flac *f, int32_t *out, int n, int order)
+{
+    int method = flac_bits(f, 2), parambits, escape, porder, nparts,
+        psize, p, i = order;
+    if (method > 1)
+        return 0;
+    parambits = (method ? 5 : 4);
+    escape = (1 << parambits) - 1;
+    porder = flac_bits(f, 4);
+    nparts = 1 << porder;
+    psize = n >> porder;
+    if ((n & (nparts - 1)) || psize < order)
+        return 0;
+    for (p = 0; p < nparts; p++)
+    {
+        int k = flac_bits(f, parambits), end = (p + 1) * psize;
+        if (k == escape)
+        {
+            int width = flac_bits(f, 5);
+            for (; i < end; i++)
+                out[i] = flac_sbits(f, width);
+        }
+        else for (; i < end; i++)
+        {
+            uint32_t u = (flac_unary(f) << k) | flac_bits(f, k);
+            out[i] = (int32_t)((u >> 1) ^ (~(u & 1) + 1));
+        }
+        if (f->f_eof)
+            return 0;
+    }
+    return 1;
+}
+
+    /** decode one channel of n samples that are bps bits wide */
+static int flac_subframe(t_flac *f, int32_t *out, int n, int bps)
+{
+    int type, wasted = 0, order, i, j;
+    if (flac_bits(f, 1))
+        return 0;
+    type = flac_bits(f, 6);
+    if (flac_bits(f, 1))
+    {
+        wasted = flac_unary(f) + 1;
+        if ((bps -= wasted) <= 0)
+            return 0;
+    }
+    if (type == 0)  /* constant */
+    {
+        int32_t v = flac_sbits(f, bps);
+        for (i = 0; i < n; i++)
+            out[i] = v;
+    }
+    else if (type == 1)     /* verbatim */
+    {
+        for (i = 0; i < n; i++)
+            out[i] = flac_sbits(f, bps);
+    }
+    else if (type >= 8 && type <= 12)   /* fixed polynomial predictor */
+    {
+        if ((order = type - 8) > n)
+            return 0;
+        for (i = 0; i < order; i++)
+            out[i] = flac_sbits(f, bps);
+        if (!flac_residual(f, out, n, order))
+            return 0;
+        switch (order)
+        {
+        case 1:
+            for (i = 1; i < n; i++)
+                out[i] += out[i-1];
+            break;
+        case 2:
+            for (i = 2; i < n; i++)
+                out[i] += 2 * out[i-1] - out[i-2];
+            break;
+        case 3:
+            for (i = 3; i < n; i++)
+                out[i] += 3 * (out[i-1] - out[i-2]) + out[i-3];
+            break;
+        case 4:
+            for (i = 4; i < n; i++)
+                out[i] += 4 * (out[i-1] + out[i-3]) - 6 * out[i-2] - out[i-4];
+            break;
+        }
+    }
+    else if (type >= 32)    /* linear predictor */
+    {
+        int32_t coefs[32];
+        int precision, shift;
+        if ((order = (type & 31) + 1) > n)
+            return 0;
+        for (i = 0; i < order; i++)
+            out[i] = flac_sbits(f, bps);
+        if ((precision = flac_bits(f, 4) + 1) == 16 ||
+            (shift = flac_sbits(f, 5)) < 0)
+                return 0;
+        for (i = 0; i < order; i++)
+            coefs[i] = flac_sbits(f, precision);
+        if (!flac_residual(f, out, n, order))
+            return 0;
+        for (i = order; i < n; i++)
+        {
+            int64_t sum = 0;
+            for (j = 0; j < order; j++)
+                sum += (int64_t)coefs[j] * out[i - 1 - j];
+            out[i] += (int32_t)(sum >> shift);
+        }
+    }
+    else return 0;
+    if (wasted)
+        for (i = 0; i < n; i++)
+            out[i] = (int32_t)((uint32_t)out[i] << wasted);
+    return !f->f_eof;
+}
+
+    /** decode the next frame into f_samples, returns 0 at the end of the
+        stream or on error */
+static int flac_decodeblock(t_flac *f)
+{
+    static const int sizes[8] = {0, 8, 12, 0, 16, 20, 24, 32};
+    int code, blocksize, assignment, bps, nchannels, i, c;
+    uint32_t b;
+    int32_t *s0, *s1;
+
+    f->f_blocksize = f->f_blockpos = 0;
+    flac_align(f);
+    if (flac_bits(f, 14) != 0x3ffe)
+    {
+            /* anything else than a frame, like an ID3v1 tag, just ends
+            the stream */
+        return 0;
+    }
+    flac_bits(f, 2);    /* reserved and blocking strategy */
+    code = flac_bits(f, 4);
+    i = flac_bits(f, 4);   /* sample rate code */
+    assignment = flac_bits(f, 4);
+    bps = sizes[flac_bits(f, 3)];
+    flac_bits(f, 1);
+        /* frame or sample number, UTF-8 coded */
+    b = flac_bits(f, 8);
+    if (b & 0x80)
+    {
+        int extra = 0;
+        while (b & (0x40 >> extra))
+            extra++;
+        if (!extra || extra > 6)
+            goto bad;
+        while (extra--)
+            if ((flac_bits(f, 8) & 0xc0) != 0x80)
+                goto bad;
+    }
+    if (code == 0)
+        goto bad;
+    else if (code == 1)
+        blocksize = 192;
+    else if (code <= 5)
+        blocksize = 576 << (code - 2);
+    else if (code == 6)
+        blocksize = flac_bits(f, 8) + 1;
+    else if (code == 7)
+        blocksize = flac_bits(f, 16) + 1;
+    else blocksize = 256 << (code - 8);
+    if (i == 12)
+        flac_bits(f, 8);
+    else if (i == 13 || i == 14)
+        flac_bits(f, 16);
+    else if (i == 15)
+        goto bad;
+    flac_bits(f, 8);    /* CRC-8 */
+    if (!bps)
+        bps = f->f_bitspersample;
+    nchannels = (assignment < 8 ? assignment + 1 : 2);
+    if (f->f_eof || assignment > 10 || bps != f->f_bitspersample ||
+        nchannels != f->f_nchannels || blocksize > f->f_maxblock)
+            goto bad;
+
+    for (c = 0; c < nchannels; c++)
+    {
+            /* the side channel takes an extra bit */
+        int side = ((assignment == 8 || assignment == 10) && c == 1) ||
+            (assignment == 9 && c == 0);
+        if (!flac_subframe(f, f->f_samples + c * f->f_maxblock,
+            blocksize, bps + side))
+                goto bad;
+    }
+    flac_align(f);
+    flac_bits(f, 16);   /* CRC-16 */
+
+    s0 = f->f_samples;
+    s1 = f->f_samples + f->f_maxblock;
+    if (assignment == 8)        /* left/side */
+    {
+        for (i = 0; i < blocksize; i++)
+            s1[i] = s0[i] - s1[i];
+    }
+    else if (assignment == 9)   /* side/right */
+    {
+        for (i = 0; i < blocksize; i++)
+            s0[i] += s1[i];
+    }
+    else if (assignment == 10)  /* mid/side */
+    {
+        for (i = 0; i < blocksize; i++)
+        {
+            int32_t side = s1[i], mid = (int32_t)((uint32_t)s0[i] << 1) |
+                (side & 1);
+            s0[i] = (mid + side) >> 1;
+            s1[i] = (mid - side) >> 1;
+        }
+    }
+    f->f_blocksize = blocksize;
+    return 1;
+bad:
+    f->f_error = 1;
+    return 0;
+}
+
+/* ------------------------- FLAC ------------------------- */
+
+static int flac_isheader(const char *buf, size_t size)
+{
+    return (size >= 4 && !strncmp(buf, "fLaC", 4));
+}
+
+static void flac_freedata(t_soundfile *sf)
+{
+    t_flac *f = (t_flac *)sf->sf_data;
+    if (!f)
+        return;
+    if (f->f_seek)
+        freebytes(f->f_seek, f->f_nseek * sizeof(t_flacseek));
+    if (f->f_samples)
+        freebytes(f->f_samples,
+            f->f_nchannels * f->f_maxblock * sizeof(int32_t));
+    freebytes(f, sizeof(t_flac));
+    sf->sf_data = NULL;
+}
+
+static int flac_readheader(t_soundfile *sf)
+{
+    t_flac *f = (t_flac *)getbytes(sizeof(t_flac));
+    int last = 0, gotinfo = 0, samplerate = 0, bytespersample;
+    uint64_t nframes = 0;
+    if (!f)
+        return 0;
+    sf->sf_data = f;
+    f->f_fd = sf->sf_fd;
+    if (flac_bits(f, 32) != 0x664c6143) /* "fLaC" */
+        goto bad;
+    while (!last)
+    {
+        int type;
+        uint32_t length, skip;
+        last = flac_bits(f, 1);
+        type = flac_bits(f, 7);
+        length = flac_bits(f, 24);
+        if (f->f_eof || (!gotinfo && type != FLAC_STREAMINFO))
+            goto bad;
+        skip = length;
+        if (type == FLAC_STREAMINFO && !gotinfo)
+        {
+            if (length < 34)
+                goto bad;
+            flac_bits(f, 16);   /* min block size */
+            f->f_maxblock = flac_bits(f, 16);
+            flac_bits(f, 24);   /* min and max frame sizes */
+            flac_bits(f, 24);
+            samplerate = flac_bits(f, 20);
+            f->f_nchannels = flac_bits(f, 3) + 1;
+            f->f_bitspersample = flac_bits(f, 5) + 1;
+            nframes = (uint64_t)flac_bits(f, 4) << 32;
+            nframes |= flac_bits(f, 32);
+            skip = length - 18;   /* MD5 and anything after */
+            gotinfo = 1;
+        }
+        else if (type == FLAC_SEEKTABLE && !f->f_seek && length >= 18)
+        {
+            int n = length / 18, i;
+            if (!(f->f_seek = (t_flacseek *)getbytes(n * sizeof(t_flacseek))))
+                goto bad;
+            f->f_nseek = n;
+            for (i = 0; i < n; i++)
+            {
+                t_flacseek *p = &f->f_seek[i];
+                p->fs_frame = (uint64_t)flac_bits(f, 32) << 32;
+                p->fs_frame |= flac_bits(f, 32);
+                p->fs_offset = (uint64_t)flac_bits(f, 32) << 32;
+                p->fs_offset |= flac_bits(f, 32);
+                flac_bits(f, 16);   /* frames in target frame */
+            }
+            skip = length - n * 18;
+        }
+        while (skip > 0 && !f->f_eof)
+        {
+            uint32_t n = f->f_bufsize - f->f_bufpos;
+            if (n > skip)
+                n = skip;
+            if (n)
+                f->f_bufpos += n, skip -= n;
+            else flac_fillbyte(f), f->f_nbits = 0, skip--;
+        }
+        if (f->f_eof)
+            goto bad;
+    }
+    if (!samplerate)
+        goto bad;
+    if (f->f_bitspersample < 4 || f->f_bitspersample > FLACMAXBITS)
+    {
+        errno = SOUNDFILE_ERRSAMPLEFMT;
+        goto bad;
+    }
+    if (f->f_maxblock < 16)
+        f->f_maxblock = 65535;
+    if (!(f->f_samples = (int32_t *)getbytes(
+        f->f_nchannels * f->f_maxblock * sizeof(int32_t))))
+            goto bad;
+    bytespersample = (f->f_bitspersample > 16 ? 3 : 2);
+    f->f_shift = bytespersample * 8 - f->f_bitspersample;
+
+    sf->sf_samplerate = samplerate;
+    sf->sf_nchannels = f->f_nchannels;
+    sf->sf_bytespersample = bytespersample;
+    sf->sf_headersize = flac_tell(f);
+    sf->sf_bigendian = 0;
+    sf->sf_bytesperframe = f->f_nchannels * bytespersample;
+    if (nframes && nframes < (uint64_t)SFMAXBYTES / sf->sf_bytesperframe)
+        sf->sf_bytelimit = nframes * sf->sf_bytesperframe;
+    else sf->sf_bytelimit = SFMAXBYTES;
+    return 1;
+bad:
+    flac_freedata(sf);
+    return 0;
+}
+
+static int flac_seek(t_soundfile *sf, size_t frame)
+{
+    t_flac *f = (t_flac *)sf->sf_data;
+    uint64_t at = 0, offset = 0;
+    int i;
+        /* points are sorted, placeholders (all ones) come last */
+    for (i = 0; i < f->f_nseek && f->f_seek[i].fs_frame <= frame; i++)
+    {
+        at = f->f_seek[i].fs_frame;
+        offset = f->f_seek[i].fs_offset;
+    }
+    f->f_blocksize = f->f_blockpos = f->f_error = 0;
+    if (!flac_goto(f, sf->sf_headersize + offset))
+        return 0;
+    while (at < frame)
+    {
+        if (!flac_decodeblock(f))
+            break;  /* past the end; nothing left to read */
+        if (at + f->f_blocksize > frame)
+        {
+            f->f_blockpos = (int)(frame - at);
+            break;
+        }
+        at += f->f_blocksize;
+        f->f_blockpos = f->f_blocksize;
+    }
+    return !f->f_error;
+}
+
+static ssize_t flac_readsamples(t_soundfile *sf, void *buf, size_t size)
+{
+    t_flac *f = (t_flac *)sf->sf_data;
+    unsigned char *sp = (unsigned char *)buf;
+    int nchannels = f->f_nchannels, shift = f->f_shift,
+        bytespersample = sf->sf_bytespersample;
+    size_t nframes = size / sf->sf_bytesperframe, done = 0;
+    while (done < nframes)
+    {
+        int n, i, c;
+        if (f->f_blockpos >= f->f_blocksize && !flac_decodeblock(f))
+            break;
+        n = f->f_blocksize - f->f_blockpos;
+        if ((size_t)n > nframes - done)
+            n = (int)(nframes - done);
+        for (i = f->f_blockpos; i < f->f_blockpos + n; i++)
+            for (c = 0; c < nchannels; c++)
+            {
+                uint32_t v =
+                    (uint32_t)f->f_samples[c * f->f_maxblock + i] << shift;
+                sp[0] = v;
+                sp[1] = v >> 8;
+                if (bytespersample == 3)
+                    sp[2] = v >> 16;
+                sp += bytespersample;
+            }
+        f->f_blockpos += n;
+        done += n;
+    }
+    if (!done && f->f_error)
+    {
+        errno = SOUNDFILE_ERRMALFORMED;
+        return -1;
+    }
+    return done * sf->sf_bytesperframe;
+}
+
+static int flac_writeheader(t_soundfile *sf, size_t nframes)
+{
+    errno = SOUNDFILE_ERRSAMPLEFMT;
+    return -1;
+}
+
+static int flac_updateheader(t_soundfile *sf, size_t nframes)
+{
+    return 0;
+}
+
+static int flac_hasextension(const char *filename, size_t size)
+{
+    size_t len = strnlen(filename, size);
+    if (len >= 6 &&
+        (!strncmp(filename + (len - 5), ".flac", 5) ||
+         !strncmp(filename + (len - 5), ".FLAC", 5)))
+        return 1;
+    return 0;
+}
+
+static int flac_addextension(char *filename, size_t size)
+{
+    size_t len = strnlen(filename, size);
+    if (len + 5 >= size)
+        return 0;
+    strcpy(filename + len, ".flac");
+    return 1;
+}
+
+    /* always little endian once decoded */
+static int flac_endianness(int endianness)
+{
+    return 0;
+}
+
+/* ------------------------- setup routine ------------------------ */
+
+t_soundfile_type flac = {
+    "flac",
+    FLACHEADSIZE,
+    flac_isheader,
+    flac_readheader,
+    flac_writeheader,
+    flac_updateheader,
+    flac_hasextension,
+    flac_addextension,
+    flac_endianness,
+    flac_readsamples,
+    flac_seek,
+    flac_freedata
+};
+
+void soundfile_flac_setup( void)
+{
+    soundfile_addtype(&flac);
+}
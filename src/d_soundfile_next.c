@@ -288,7 +288,10 @@ t_soundfile_type next = {
     next_updateheader,
     next_hasextension,
     next_addextension,
-    next_endianness
+    next_endianness,
+    NULL,
+    NULL,
+    NULL
 };
 
 void soundfile_next_setup( void)
@@ -514,7 +514,10 @@ t_soundfile_type wave = {
     wave_updateheader,
     wave_hasextension,
     wave_addextension,
-    wave_endianness
+    wave_endianness,
+    NULL,
+    NULL,
+    NULL
 };
 
 void soundfile_wave_setup( void)
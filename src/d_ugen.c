@@ -13,8 +13,15 @@
 
 #include "m_pd.h"
 #include "m_imp.h"
+#include "g_canvas.h"
+#include "s_stuff.h"
+#include "d_simd.h"
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
 
 extern t_class *vinlet_class, *voutlet_class, *canvas_class, *text_class;
 
@@ -30,6 +37,22 @@ void voutlet_dspprolog(struct _voutlet *x, t_signal **parentsigs,
 void voutlet_dspepilog(struct _voutlet *x, t_signal **parentsigs,
     int myvecsize, int calcsize, int phase, int period, int frequency,
     int downsample, int upsample, int reblock, int switched);
+void canvas_flush_dsp(void);
+void ugen_stop(void);
+static void pointwise_free(void);
+static void batch_free(void);
+static void profile_free(void);
+static void rtcheck_begin(void);
+static void rtcheck_end(void);
+static void rtcheck_flush(void);
+    /* record of the object whose DSP code this thread is running */
+static PD_THREADLOCAL struct _profrec *rtcheck_current;
+static void dspcompiled_free(void);
+static void dsptemplate_freeall(void);
+static t_perfroutine dspcompiled_match(void);
+static void graph_setroot(t_object *x);
+
+#define PROFILEPERIOD 8     /* measure one tick in 8 when profiling */
 
 struct _instanceugen
 {
@@ -44,6 +67,42 @@ struct _instanceugen
     int u_phase;
     int u_loud;
     struct _dspcontext *u_context;
+    struct _dspsection *u_sections;     /* parallel sections in DSP chain */
+    struct _dspsection *u_cursection;   /* section being scheduled, if any */
+    int u_deferreuse;           /* nonzero to hold off reusing signals */
+    t_signal *u_pendingreuse;   /* signals waiting to be made reusable */
+        /* signals left over from the last DSP chain, when resorting */
+    t_signal *u_sparelist[MAXLOGSIG+1];
+    t_signal *u_spareborrowed;
+    struct _sigarena *u_arena;  /* memory the signal buffers come from */
+    struct _pointwise *u_pointwise;     /* pointwise run being fused */
+    struct _batch *u_batch;             /* batch of calls being merged */
+    struct _profrec **u_profile;    /* hash table of profile records */
+    struct _profrec *u_profparent;  /* record of object being scheduled */
+    unsigned long long u_profnticks;    /* number of ticks measured */
+    unsigned long long u_profstart;     /* counter when profiling began */
+    double u_profstarttime;             /* ... and real time in seconds */
+    int u_rtcheck;                      /* nonzero if checking RT safety */
+    int u_rtprofile;                    /* nonzero if that turned profiling on */
+    int u_rtunknown[RT_NKIND];          /* counts not charged to anyone */
+    int *u_entries;             /* onset of each call in the DSP chain */
+    int u_nentries;
+    int u_entriessize;
+    struct _dspcompiled *u_compiled;    /* chain compiled by compile-dsp */
+    struct _appended *u_appended;       /* chains added after sorting */
+    t_int *u_pausedchain;       /* DSP chain set aside by ugen_pause() */
+    t_signal u_external;        /* what signal_setexternal() ones borrow */
+    unsigned char *u_outwritten;    /* output channels written this tick */
+    int u_noutwritten;
+    struct _dspgraph *u_graph;  /* recording for "dsp-graph" if any */
+    struct _dsptemplate *u_templates;   /* layouts of canvases sorted */
+    struct _block *u_shedlist;  /* switch~ objects with a priority or quota */
+    t_symbol *u_shedsym;        /* where to report load shedding */
+    double u_shedmax;           /* load above which to shed, or 0 */
+    double u_shedload;          /* smoothed share of real time DSP takes */
+    t_float u_shedfade;         /* fade time in msec */
+    int u_shedhold;             /* ticks to wait before the next decision */
+    int u_shedquiet;            /* ticks the load has been low */
 };
 
 #define THIS (pd_this->pd_ugen)
@@ -51,13 +110,41 @@ struct _instanceugen
 void d_ugen_newpdinstance(void)
 {
     THIS = getbytes(sizeof(*THIS));
+    mem_addsymbolroot(THIS, sizeof(*THIS));
     THIS->u_dspchain = 0;
     THIS->u_dspchainsize = 0;
     THIS->u_signals = 0;
+    THIS->u_sections = 0;
+    THIS->u_cursection = 0;
+    THIS->u_deferreuse = 0;
+    THIS->u_pendingreuse = 0;
+    THIS->u_arena = 0;
+    THIS->u_appended = 0;
+    THIS->u_pausedchain = 0;
+    THIS->u_outwritten = 0;
+    THIS->u_noutwritten = 0;
+    THIS->u_graph = 0;
+    THIS->u_templates = 0;
+    THIS->u_shedlist = 0;
+    THIS->u_shedsym = 0;
+    THIS->u_shedmax = THIS->u_shedload = 0;
+    THIS->u_shedfade = 10;
+    THIS->u_shedhold = THIS->u_shedquiet = 0;
 }
 
 void d_ugen_freepdinstance(void)
 {
+    ugen_stop();
+    pointwise_free();
+    batch_free();
+    profile_free();
+    dspcompiled_free();
+    dsptemplate_freeall();
+    if (THIS->u_entriessize)
+        freebytes(THIS->u_entries, THIS->u_entriessize * sizeof(int));
+    if (THIS->u_outwritten)
+        freebytes(THIS->u_outwritten, THIS->u_noutwritten);
+    mem_removesymbolroot(THIS);
     freebytes(THIS, sizeof(*THIS));
 }
 
@@ -74,6 +161,14 @@ t_int *zero_perf8(t_int *w)
     t_sample *out = (t_sample *)(w[1]);
     int n = (int)(w[2]);
 
+#ifdef PD_SIMD
+    t_v4 z = V4_ZERO();
+    for (; n; n -= 8, out += 8)
+    {
+        V4_STORE(out, z);
+        V4_STORE(out+4, z);
+    }
+#else
     for (; n; n -= 8, out += 8)
     {
         out[0] = 0;
@@ -85,6 +180,7 @@ t_int *zero_perf8(t_int *w)
         out[6] = 0;
         out[7] = 0;
     }
+#endif
     return (w+3);
 }
 
@@ -118,12 +214,35 @@ is thus,
     outlet epilogue code (2)
 
 where (1) means, "if reblocked" and  (2) means, "if reblocked or switched".
+A switch~ also adds a call to block_watch() after all that (see "auto"
+below).
 
 If we're reblocked, the inlet prolog and outlet epilog code takes care of
-overlapping and buffering to deal with vector size changes.  If we're switched
+overlapping and buffering to deal with vector size changes.  When the block
+runs several times per block of the containing canvas (as "block~ 1" does for
+single-sample feedback), the block prologue repeats the objects itself.  The
+first time, it notes where each perform routine is in the chain; after that
+it calls them from that table and doesn't follow the chain at all.  This is
+done unless the subcanvas holds something that jumps around in the chain,
+such as another reblocked subcanvas.  If we're switched
 but not reblocked, the inlet prolog is not needed, and the output epilog is
 ONLY run when the block is switched off; in this case the epilog code simply
 copies zeros to all signal outlets.
+
+A switch~ in "auto" mode also switches itself off when the subcanvas's
+signal inlets and outlets have all been silent for a while (the time
+is given in the "auto" message, to allow for filter and reverb tails.)  It
+comes back on as soon as an inlet gets a signal again, or when it's sent a
+nonzero number -- the way to wake it up for a note started by a message.
+(With no signal inlets or outlets it simply runs for that long after each
+nonzero number.)
+Inlets are checked in the prolog, but the outlets are checked by
+block_watch() at the very end since their buffers may be reused by the
+containing canvas once it's read them.
+
+A switch~ can also be given a priority (and optionally a CPU quota) so that
+it's switched off automatically when DSP gets too slow; see "load shedding"
+below.
 */
 
 static t_class *block_class;
@@ -144,13 +263,45 @@ typedef struct _block
     char x_switched;    /* true if we're acting as a a switch */
     char x_switchon;    /* true if we're switched on */
     char x_reblock;     /* true if inlets and outlets are reblocking */
+    char x_looping;     /* true while block_prolog() repeats the block */
+    int x_ncall;        /* number of routines in x_calls, -1 if not known */
+    int x_callsize;     /* allocated size of x_calls */
+    t_int **x_calls;    /* where in the chain each routine in block is */
     int x_upsample;     /* upsampling-factor */
     int x_downsample;   /* downsampling-factor */
     int x_return;       /* stop right after this block (for one-shots) */
+    t_float x_automs;   /* "auto" mode: msec of silence before bypassing */
+    t_float x_parentsr; /* sample rate of containing canvas */
+    int x_autohold;     /* "auto" hold time in samples of parent, or 0 */
+    int x_quiet;        /* samples of silence so far */
+    int x_nwatchin;     /* number of signal inlets to watch for silence */
+    int x_nwatchout;    /* ... and signal outlets */
+    int x_watchn;       /* their vector size */
+    int x_watchsize;    /* number of vectors allocated in x_watch */
+    t_sample **x_watch; /* the inlets' vectors, then the outlets' */
+    t_canvas *x_canvas;         /* canvas we're in, for reporting */
+    t_float x_priority;         /* shedding priority, or 0 if never shed */
+    t_float x_quota;            /* max share of a DSP tick, or 0 if none */
+    int x_shed;                 /* SHED_LOAD or SHED_QUOTA if we were shed */
+    t_float x_gain;             /* gain applied to outlets while fading */
+    t_float x_fade;             /* change in gain per sample, or 0 */
+    double x_starttime;         /* when the prolog ran this tick */
+    double x_ticktime;          /* time spent in the block this tick */
+    double x_load;              /* smoothed share of a DSP tick */
+    struct _block *x_shednext;  /* next in list of blocks with a priority */
+    int x_release;              /* "release" mode: free contents when off */
+    struct _standin *x_standin; /* ... and what stands in for them */
 } t_block;
 
+#define QUIETLEVEL 1e-6     /* the absolute value we consider silent */
+
 static void block_set(t_block *x, t_floatarg fvecsize, t_floatarg foverlap,
     t_floatarg fupsample);
+static void shed_remove(t_block *x);
+static void standin_switch(t_block *x);
+static int standin_released(t_block *x);
+static void standin_free(t_block *x);
+static void block_dsprelease(t_block *x);
 
 static void *block_new(t_floatarg fvecsize, t_floatarg foverlap,
                        t_floatarg fupsample)
@@ -161,6 +312,25 @@ static void *block_new(t_floatarg fvecsize, t_floatarg foverlap,
     x->x_frequency = 1;
     x->x_switched = 0;
     x->x_switchon = 1;
+    x->x_looping = 0;
+    x->x_ncall = -1;
+    x->x_callsize = 0;
+    x->x_calls = 0;
+    x->x_automs = 0;
+    x->x_parentsr = 0;
+    x->x_autohold = 0;
+    x->x_quiet = 0;
+    x->x_nwatchin = x->x_nwatchout = x->x_watchn = x->x_watchsize = 0;
+    x->x_watch = 0;
+    x->x_canvas = canvas_getcurrent();
+    x->x_priority = x->x_quota = 0;
+    x->x_shed = 0;
+    x->x_gain = 1;
+    x->x_fade = 0;
+    x->x_starttime = x->x_ticktime = x->x_load = 0;
+    x->x_shednext = 0;
+    x->x_release = 0;
+    x->x_standin = 0;
     block_set(x, fvecsize, foverlap, fupsample);
     return (x);
 }
@@ -238,12 +408,88 @@ static void *switch_new(t_floatarg fvecsize, t_floatarg foverlap,
 static void block_float(t_block *x, t_floatarg f)
 {
     if (x->x_switched)
+    {
+        int was = x->x_switchon;
         x->x_switchon = (f != 0);
+            /* the patch overrides any shedding */
+        x->x_shed = 0;
+        x->x_gain = 1;
+        x->x_fade = 0;
+        if (x->x_release && x->x_switchon != was)
+            standin_switch(x);
+    }
+    x->x_quiet = 0;
+}
+
+static void block_setautohold(t_block *x)
+{
+    if (x->x_automs > 0 && x->x_parentsr > 0)
+    {
+        x->x_autohold = x->x_automs * 0.001 * x->x_parentsr;
+        if (x->x_autohold < 1)
+            x->x_autohold = 1;
+    }
+    else x->x_autohold = 0;
+}
+
+static void block_auto(t_block *x, t_floatarg f)
+{
+    if (!x->x_switched)
+    {
+        pd_error(x, "block~: 'auto' only works for switch~");
+        return;
+    }
+    x->x_automs = (f > 0 ? f : 0);
+    x->x_quiet = 0;
+    block_setautohold(x);
+}
+
+    /* "release 1" makes a switch~ release its subpatch's DSP memory while
+    it's off (see "released subpatches" below) */
+static void block_release(t_block *x, t_floatarg f)
+{
+    if (!x->x_switched)
+    {
+        pd_error(x, "block~: 'release' only works for switch~");
+        return;
+    }
+    if (x->x_release == (f != 0))
+        return;
+    x->x_release = (f != 0);
+    if (!x->x_switchon)
+        canvas_update_dsp();
+}
+
+static void block_free(t_block *x)
+{
+    shed_remove(x);
+    standin_free(x);
+    if (x->x_watch)
+        freebytes(x->x_watch, x->x_watchsize * sizeof(*x->x_watch));
+    if (x->x_calls)
+        freebytes(x->x_calls, x->x_callsize * sizeof(*x->x_calls));
+}
+
+    /* check if all of a set of signals are silent */
+static int block_quiet(t_sample **vecs, int nvec, int n)
+{
+    int i, j;
+    for (i = 0; i < nvec; i++)
+    {
+        t_sample *fp = vecs[i];
+        for (j = 0; j < n; j++)
+            if (fp[j] > QUIETLEVEL || fp[j] < -QUIETLEVEL)
+                return (0);
+    }
+    return (1);
 }
 
 static void block_bang(t_block *x)
 {
-    if (x->x_switched && !x->x_switchon && THIS->u_dspchain)
+    canvas_flush_dsp();     /* make sure x_chainonset is up to date */
+    if (standin_released(x))
+        pd_error(x, "switch~: can't bang a released subpatch");
+    else if (x->x_switched && !x->x_switchon && THIS->u_dspchain)
     {
         t_int *ip;
         x->x_return = 1;
@@ -258,13 +504,59 @@ static void block_bang(t_block *x)
 #define PROLOGCALL 2
 #define EPILOGCALL 2
 
+static t_int *block_prolog(t_int *w);
+static t_int *block_epilog(t_int *w);
+static void block_dofade(t_block *x);
+static t_int *section_fork(t_int *w);
+static t_int *section_task(t_int *w);
+static t_int *section_join(t_int *w);
+
+    /* run the objects in a block once, noting where each perform routine
+    is, so that block_prolog() can then call them without following the
+    chain.  If any of them may jump elsewhere in the chain, leave the table
+    empty. */
+static void block_makecalls(t_block *x, t_int *body)
+{
+    t_int *ip, *last = 0;
+    int ok = 1;
+    x->x_ncall = 0;
+    for (ip = body; ip; )
+    {
+        t_perfroutine fn = (t_perfroutine)(*ip);
+        if (fn == block_prolog || fn == section_fork ||
+            fn == section_task || fn == section_join)
+                ok = 0;
+        if (x->x_ncall == x->x_callsize)
+        {
+            int newsize = 2 * x->x_callsize + 16;
+            x->x_calls = (t_int **)(x->x_calls ?
+                resizebytes(x->x_calls, x->x_callsize * sizeof(*x->x_calls),
+                    newsize * sizeof(*x->x_calls)) :
+                getbytes(newsize * sizeof(*x->x_calls)));
+            x->x_callsize = newsize;
+        }
+        x->x_calls[x->x_ncall++] = last = ip;
+        ip = (*fn)(ip);
+    }
+        /* the epilog returned zero and isn't kept in the table */
+    if (!ok || !last || (t_perfroutine)(*last) != block_epilog)
+        x->x_ncall = 0;
+    else x->x_ncall--;
+}
+
 static t_int *block_prolog(t_int *w)
 {
     t_block *x = (t_block *)w[1];
     int phase = x->x_phase;
+    if (x->x_quota > 0)
+        x->x_starttime = sys_getrealtime();
         /* if we're switched off, jump past the epilog code */
     if (!x->x_switchon)
         return (w + x->x_blocklength);
+        /* in "auto" mode, note any input */
+    if (x->x_autohold &&
+        !block_quiet(x->x_watch, x->x_nwatchin, x->x_watchn))
+            x->x_quiet = 0;
     if (phase)
     {
         phase++;
@@ -274,8 +566,33 @@ static t_int *block_prolog(t_int *w)
     }
     else
     {
-        x->x_count = x->x_frequency;
         x->x_phase = (x->x_period > 1 ? 1 : 0);
+            /* skip the block if everything has been quiet long enough */
+        if (x->x_autohold && x->x_quiet >= x->x_autohold)
+            return (w + x->x_blocklength);
+        x->x_count = x->x_frequency;
+        if (x->x_reblock && x->x_frequency > 1 && !x->x_return)
+        {
+            int count = x->x_frequency, i;
+            x->x_looping = 1;
+            if (x->x_ncall < 0)
+                block_makecalls(x, w + PROLOGCALL), count--;
+            if (x->x_ncall)
+                while (count--)
+                    for (i = 0; i < x->x_ncall; i++)
+            {
+                t_int *ip = x->x_calls[i];
+                (*(t_perfroutine)(*ip))(ip);
+            }
+            else while (count--)
+            {
+                t_int *ip;
+                for (ip = w + PROLOGCALL; ip; )
+                    ip = (*(t_perfroutine)(*ip))(ip);
+            }
+            x->x_looping = 0;
+            return (w + x->x_blocklength);
+        }
         return (w + PROLOGCALL);        /* beginning of block is next ugen */
     }
 }
@@ -284,7 +601,7 @@ static t_int *block_epilog(t_int *w)
 {
     t_block *x = (t_block *)w[1];
     int count = x->x_count - 1;
-    if (x->x_return)
+    if (x->x_return || x->x_looping)
         return (0);
     if (!x->x_reblock)
         return (w + x->x_epiloglength + EPILOGCALL);
@@ -297,20 +614,282 @@ static t_int *block_epilog(t_int *w)
     else return (w + EPILOGCALL);
 }
 
+    /* fade the outlets in or out after being restored or shed.  At the end
+    of a fade out we switch ourselves off. */
+static void block_dofade(t_block *x)
+{
+    int i, j, n = x->x_watchn;
+    t_float gain = x->x_gain, fade = x->x_fade;
+    for (i = 0; i < x->x_nwatchout; i++)
+    {
+        t_sample *fp = x->x_watch[x->x_nwatchin + i];
+        t_float g = gain;
+        for (j = 0; j < n; j++, g += fade)
+            fp[j] *= (g < 0 ? 0 : (g > 1 ? 1 : g));
+    }
+    gain += n * fade;
+    if (gain >= 1)
+        x->x_gain = 1, x->x_fade = 0;
+    else if (gain <= 0)
+        x->x_gain = 1, x->x_fade = 0, x->x_switchon = 0;
+    else x->x_gain = gain;
+}
+
+    /* for switch~, called after the outlet epilogs to see if the outlets
+    have been quiet */
+static t_int *block_watch(t_int *w)
+{
+    t_block *x = (t_block *)w[1];
+    if (x->x_autohold && x->x_quiet < x->x_autohold)
+    {
+        if (block_quiet(x->x_watch + x->x_nwatchin, x->x_nwatchout,
+            x->x_watchn))
+                x->x_quiet += x->x_watchn;
+        else x->x_quiet = 0;
+    }
+    if (x->x_fade != 0)
+        block_dofade(x);
+    if (x->x_quota > 0)
+        x->x_ticktime += sys_getrealtime() - x->x_starttime;
+    return (w+2);
+}
+
+    /* note the vectors of the containing canvas's signals connected to our
+    inlets and outlets, to watch in "auto" mode */
+static void block_setwatch(t_block *x, t_signal **iosigs, int nin, int nout,
+    int n, t_float parentsr)
+{
+    int i;
+    if (!iosigs)
+        nin = nout = 0;
+    if (nin + nout > x->x_watchsize)
+    {
+        x->x_watch = (t_sample **)resizebytes(x->x_watch,
+            x->x_watchsize * sizeof(*x->x_watch),
+                (nin + nout) * sizeof(*x->x_watch));
+        x->x_watchsize = nin + nout;
+    }
+    for (i = 0; i < nin + nout; i++)
+        x->x_watch[i] = iosigs[i]->s_vec;
+    x->x_nwatchin = nin;
+    x->x_nwatchout = nout;
+    x->x_watchn = n;
+    x->x_parentsr = parentsr;
+    x->x_quiet = 0;
+    block_setautohold(x);
+}
+
 static void block_dsp(t_block *x, t_signal **sp)
 {
     /* do nothing here */
 }
 
+/* ------------------------- load shedding ----------------------------- */
+
+/* "pd load-shed <percent> [<receiver>] [<fade msec>]" asks that when the
+DSP chain takes more than <percent> of the real time it has (averaged over
+a few ticks), switch~ objects that have been given a priority be switched
+off, lowest priority first, one at a time until the load is below the limit
+again.  Those switched off this way are switched back on, highest priority
+first, once the load has stayed below SHEDRESTORE times the limit for a
+second.  Outlets are faded out and in over <fade msec> (10 by default) so
+nothing clicks; subpatches that write to a dac~ or throw~ instead are just
+switched.  A switch~'s priority is set with "priority <n> [<quota>]", where
+a positive n makes it eligible, and <quota>, if given, is a percentage of a
+DSP tick that the subpatch may use; it's switched off whenever it goes over
+that, whether load shedding is on or not, and stays off until the patch
+switches it on again.  Each event is sent to <receiver> as "shed", "quota",
+or "restore", followed by the name of the subpatch, its priority, and the
+load in percent (that of the subpatch, for "quota"); without a receiver it
+is posted.  "pd load-shed 0" turns shedding off (quotas still apply.)
+Priorities and quotas are enforced in dsp_tick() after each tick.  A
+subpatch inside a clone gets a switch~ of its own in each voice, so voices
+can be shed individually. */
+
+#define SHED_LOAD 1
+#define SHED_QUOTA 2
+#define SHEDSMOOTH 0.1      /* coefficient for smoothing the load */
+#define SHEDRESTORE 0.7     /* restore below this fraction of the limit */
+#define SHEDHOLDMS 50       /* wait this long between decisions */
+#define SHEDQUIETMS 1000    /* and this long under the limit to restore */
+
+static void shed_add(t_block *x)
+{
+    t_block *y;
+    for (y = THIS->u_shedlist; y; y = y->x_shednext)
+        if (y == x)
+            return;
+    x->x_shednext = THIS->u_shedlist;
+    THIS->u_shedlist = x;
+}
+
+static void shed_remove(t_block *x)
+{
+    t_block **yp;
+    for (yp = &THIS->u_shedlist; *yp; yp = &(*yp)->x_shednext)
+        if (*yp == x)
+    {
+        *yp = x->x_shednext;
+        break;
+    }
+    x->x_shednext = 0;
+}
+
+static void block_priority(t_block *x, t_floatarg priority, t_floatarg quota)
+{
+    if (!x->x_switched)
+    {
+        pd_error(x, "block~: 'priority' only works for switch~");
+        return;
+    }
+    x->x_priority = (priority > 0 ? priority : 0);
+    x->x_quota = (quota > 0 ? 0.01 * quota : 0);
+    x->x_ticktime = x->x_load = 0;
+    if (x->x_priority > 0 || x->x_quota > 0)
+        shed_add(x);
+    else shed_remove(x);
+}
+
+static void shed_report(const char *what, t_block *x, double load)
+{
+    const char *name = (x->x_canvas ? x->x_canvas->gl_name->s_name : "?");
+    if (THIS->u_shedsym && THIS->u_shedsym->s_thing)
+    {
+        t_atom at[3];
+        SETSYMBOL(&at[0], gensym(name));
+        SETFLOAT(&at[1], x->x_priority);
+        SETFLOAT(&at[2], 100. * load);
+        pd_typedmess(THIS->u_shedsym->s_thing, gensym(what), 3, at);
+    }
+    else post("load-shed: %s %s (priority %g, load %.1f%%)", what, name,
+        x->x_priority, 100. * load);
+}
+
+static void shed_fade(t_block *x, int out)
+{
+    t_float sr = (x->x_parentsr > 0 ? x->x_parentsr : sys_getsr());
+    t_float nsamps = 0.001 * THIS->u_shedfade * sr;
+    if (nsamps < 1)
+        nsamps = 1;
+    if (out)
+        x->x_fade = -x->x_gain / nsamps;
+    else
+    {
+        x->x_switchon = 1;
+        x->x_gain = 0;
+        x->x_fade = 1. / nsamps;
+    }
+}
+
+    /* called after each DSP tick that took "elapsed" seconds */
+static void shed_tick(double elapsed)
+{
+    double tickperiod = DEFDACBLKSIZE / sys_getsr(), load;
+    int ticksper = 0.001 * sys_getsr() / DEFDACBLKSIZE + 1;
+    t_block *x, *pick;
+        /* subpatches over their quotas */
+    for (x = THIS->u_shedlist; x; x = x->x_shednext)
+        if (x->x_quota > 0)
+    {
+        x->x_load += SHEDSMOOTH * (x->x_ticktime / tickperiod - x->x_load);
+        x->x_ticktime = 0;
+        if (x->x_switchon && x->x_fade >= 0 && x->x_load > x->x_quota)
+        {
+            shed_fade(x, 1);
+            x->x_shed = SHED_QUOTA;
+            shed_report("quota", x, x->x_load);
+            x->x_load = 0;
+        }
+    }
+    if (THIS->u_shedmax <= 0)
+        return;
+    load = (THIS->u_shedload += SHEDSMOOTH *
+        (elapsed / tickperiod - THIS->u_shedload));
+    if (THIS->u_shedhold > 0)
+    {
+        THIS->u_shedhold--;
+        return;
+    }
+    if (load > THIS->u_shedmax)
+    {
+        THIS->u_shedquiet = 0;
+        for (x = THIS->u_shedlist, pick = 0; x; x = x->x_shednext)
+            if (x->x_priority > 0 && x->x_switchon && x->x_fade >= 0 &&
+                (!pick || x->x_priority < pick->x_priority))
+                    pick = x;
+        if (pick)
+        {
+            shed_fade(pick, 1);
+            pick->x_shed = SHED_LOAD;
+            THIS->u_shedhold = SHEDHOLDMS * ticksper;
+            shed_report("shed", pick, load);
+        }
+    }
+    else if (load < SHEDRESTORE * THIS->u_shedmax &&
+        ++THIS->u_shedquiet >= SHEDQUIETMS * ticksper)
+    {
+        THIS->u_shedquiet = 0;
+        for (x = THIS->u_shedlist, pick = 0; x; x = x->x_shednext)
+            if (x->x_shed == SHED_LOAD && !x->x_switchon &&
+                (!pick || x->x_priority > pick->x_priority))
+                    pick = x;
+        if (pick)
+        {
+            shed_fade(pick, 0);
+            pick->x_shed = 0;
+            THIS->u_shedhold = SHEDHOLDMS * ticksper;
+            shed_report("restore", pick, load);
+        }
+    }
+    else if (load >= SHEDRESTORE * THIS->u_shedmax)
+        THIS->u_shedquiet = 0;
+}
+
+void glob_loadshed(void *dummy, t_symbol *s, int argc, t_atom *argv)
+{
+    t_block *x;
+    if (!argc)
+    {
+        if (THIS->u_shedmax > 0)
+            post("load-shed: limit %g%%, load %.1f%%",
+                100. * THIS->u_shedmax, 100. * THIS->u_shedload);
+        else post("load-shed: off");
+        for (x = THIS->u_shedlist; x; x = x->x_shednext)
+            post("%s: priority %g, quota %g%%%s",
+                (x->x_canvas ? x->x_canvas->gl_name->s_name : "?"),
+                    x->x_priority, 100. * x->x_quota,
+                    (x->x_shed == SHED_LOAD ? " (shed)" :
+                        (x->x_shed == SHED_QUOTA ? " (over quota)" : "")));
+        return;
+    }
+    THIS->u_shedmax = 0.01 * atom_getfloatarg(0, argc, argv);
+    THIS->u_shedsym = (argc > 1 && argv[1].a_type == A_SYMBOL ?
+        argv[1].a_w.w_symbol : 0);
+    THIS->u_shedfade = (argc > 2 ? atom_getfloatarg(2, argc, argv) : 10);
+    if (THIS->u_shedfade < 0)
+        THIS->u_shedfade = 0;
+    THIS->u_shedload = 0;
+    THIS->u_shedhold = THIS->u_shedquiet = 0;
+}
+
 void block_tilde_setup(void)
 {
-    block_class = class_new(gensym("block~"), (t_newmethod)block_new, 0,
-            sizeof(t_block), 0, A_DEFFLOAT, A_DEFFLOAT, A_DEFFLOAT, 0);
+    block_class = class_new(gensym("block~"), (t_newmethod)block_new,
+        (t_method)block_free, sizeof(t_block), 0,
+            A_DEFFLOAT, A_DEFFLOAT, A_DEFFLOAT, 0);
     class_addcreator((t_newmethod)switch_new, gensym("switch~"),
         A_DEFFLOAT, A_DEFFLOAT, A_DEFFLOAT, 0);
     class_addmethod(block_class, (t_method)block_set, gensym("set"),
         A_DEFFLOAT, A_DEFFLOAT, A_DEFFLOAT, 0);
     class_addmethod(block_class, (t_method)block_dsp, gensym("dsp"), A_CANT, 0);
+    class_addmethod(block_class, (t_method)block_auto, gensym("auto"),
+        A_FLOAT, 0);
+    class_addmethod(block_class, (t_method)block_priority,
+        gensym("priority"), A_FLOAT, A_DEFFLOAT, 0);
+    class_addmethod(block_class, (t_method)block_release, gensym("release"),
+        A_FLOAT, 0);
+    class_addmethod(block_class, (t_method)block_dsprelease,
+        gensym("dsp-release"), A_CANT, 0);
     class_addfloat(block_class, block_float);
     class_addbang(block_class, block_bang);
 }
@@ -322,6 +901,23 @@ static t_int dsp_done(t_int *w)
     return (0);
 }
 
+    /* note where each call in the chain begins, so that compile-dsp can
+    walk it.  If the chain was backed up to merge calls, forget the ones
+    that were taken back. */
+static void dsp_noteentry(int onset)
+{
+    while (THIS->u_nentries && THIS->u_entries[THIS->u_nentries-1] >= onset)
+        THIS->u_nentries--;
+    if (THIS->u_nentries == THIS->u_entriessize)
+    {
+        int newsize = 2 * THIS->u_entriessize + 64;
+        THIS->u_entries = (int *)resizebytes(THIS->u_entries,
+            THIS->u_entriessize * sizeof(int), newsize * sizeof(int));
+        THIS->u_entriessize = newsize;
+    }
+    THIS->u_entries[THIS->u_nentries++] = onset;
+}
+
 void dsp_add(t_perfroutine f, int n, ...)
 {
     int newsize = THIS->u_dspchainsize + n+1, i;
@@ -330,6 +926,7 @@ void dsp_add(t_perfroutine f, int n, ...)
     THIS->u_dspchain = t_resizebytes(THIS->u_dspchain,
         THIS->u_dspchainsize * sizeof (t_int), newsize * sizeof (t_int));
     THIS->u_dspchain[THIS->u_dspchainsize-1] = (t_int)f;
+    dsp_noteentry(THIS->u_dspchainsize-1);
     if (THIS->u_loud)
         post("add to chain: %lx",
             THIS->u_dspchain[THIS->u_dspchainsize-1]);
@@ -354,6 +951,7 @@ void dsp_addv(t_perfroutine f, int n, t_int *vec)
     THIS->u_dspchain = t_resizebytes(THIS->u_dspchain,
         THIS->u_dspchainsize * sizeof (t_int), newsize * sizeof (t_int));
     THIS->u_dspchain[THIS->u_dspchainsize-1] = (t_int)f;
+    dsp_noteentry(THIS->u_dspchainsize-1);
     for (i = 0; i < n; i++)
         THIS->u_dspchain[THIS->u_dspchainsize + i] = vec[i];
     THIS->u_dspchain[newsize-1] = (t_int)dsp_done;
@@ -362,278 +960,3228 @@ void dsp_addv(t_perfroutine f, int n, t_int *vec)
 
 void dsp_tick(void)
 {
+    canvas_flush_dsp();
     if (THIS->u_dspchain)
     {
         t_int *ip;
-        for (ip = THIS->u_dspchain; ip; ) ip = (*(t_perfroutine)(*ip))(ip);
+        t_perfroutine compiled;
+        double shedstart = 0;
+        if (THIS->u_shedlist)
+            shedstart = sys_getrealtime();
+        if (THIS->u_rtcheck)
+            rtcheck_begin();
+        if (THIS->u_outwritten)
+            memset(THIS->u_outwritten, 0, THIS->u_noutwritten);
+        if (THIS->u_compiled && (compiled = dspcompiled_match()))
+            (*compiled)(THIS->u_dspchain);
+        else for (ip = THIS->u_dspchain; ip; )
+            ip = (*(t_perfroutine)(*ip))(ip);
+        if (THIS->u_rtcheck)
+            rtcheck_end();
+        if (THIS->u_shedlist)
+            shed_tick(sys_getrealtime() - shedstart);
+        if (THIS->u_profile && !(THIS->u_phase & (PROFILEPERIOD-1)))
+            THIS->u_profnticks++;
         THIS->u_phase++;
     }
 }
 
-/* ---------------- signals ---------------------------- */
+/* ------------------ fusing pointwise operations ----------------------- */
 
-int ilog2(int n)
+/* Simple pointwise operations such as "*~ 0.5" or "clip~" are added to the
+chain through dsp_addpointwise().  If one of these takes its input from the
+output of the one that was added just before it, and writes back into the
+same signal (as usually happens since signals are freed before new ones are
+allocated), the two are replaced by a single call to pointwise_perf8(),
+which applies all the operations to each group of 8 points in turn, without
+storing and reloading the intermediate results. */
+
+#define MAXFUSE 16
+
+typedef struct _pointwise
 {
-    int r = -1;
-    if (n <= 0) return(0);
-    while (n)
+    int p_onset;        /* where in the chain the run begins */
+    int p_end;          /* chain size right after the run */
+    int p_nop;          /* number of operations */
+    t_sample *p_in;     /* input to first operation */
+    t_sample *p_out;    /* signal all operations write to */
+    int p_n;            /* vector size */
+    t_int p_ops[3*MAXFUSE];     /* opcode and two arguments for each */
+} t_pointwise;
+
+    /* the perform routines that single pointwise operations were added
+    with, and their opcodes, so that compile-dsp can recognize them */
+#define MAXPWROUTINE 32
+static struct _pwroutine
+{
+    t_perfroutine r_fn;
+    int r_op;
+} pointwise_routines[MAXPWROUTINE];
+static int pointwise_nroutines;
+
+static void pointwise_noteroutine(t_perfroutine f, int op)
+{
+    int i;
+    for (i = 0; i < pointwise_nroutines; i++)
+        if (pointwise_routines[i].r_fn == f)
+            return;
+    if (pointwise_nroutines < MAXPWROUTINE)
     {
-        r++;
-        n >>= 1;
+        pointwise_routines[pointwise_nroutines].r_fn = f;
+        pointwise_routines[pointwise_nroutines++].r_op = op;
     }
-    return (r);
 }
 
-
-    /* call this when DSP is stopped to free all the signals */
-static void signal_cleanup(void)
+    /* opcode of a routine passed to dsp_addpointwise(), or -1 */
+static int pointwise_getop(t_perfroutine f)
 {
-    t_signal *sig;
     int i;
-    while ((sig = THIS->u_signals))
-    {
-        THIS->u_signals = sig->s_nextused;
-        if (!sig->s_isborrowed)
-            t_freebytes(sig->s_vec, sig->s_vecsize * sizeof (*sig->s_vec));
-        t_freebytes(sig, sizeof *sig);
-    }
-    for (i = 0; i <= MAXLOGSIG; i++)
-        THIS->u_freelist[i] = 0;
-    THIS->u_freeborrowed = 0;
+    for (i = 0; i < pointwise_nroutines; i++)
+        if (pointwise_routines[i].r_fn == f)
+            return (pointwise_routines[i].r_op);
+    return (-1);
 }
 
-    /* mark the signal "reusable." */
-void signal_makereusable(t_signal *sig)
+static void pointwise_free(void)
 {
-    int logn = ilog2(sig->s_vecsize);
-#if 1
-    t_signal *s5;
-    for (s5 = THIS->u_freeborrowed; s5; s5 = s5->s_nextfree)
+    if (THIS->u_pointwise)
+        freebytes(THIS->u_pointwise, sizeof(*THIS->u_pointwise));
+}
+
+static t_int *pointwise_perf8(t_int *w)
+{
+    t_sample *in = (t_sample *)(w[1]);
+    t_sample *out = (t_sample *)(w[2]);
+    int n = (int)(w[3]), nop = (int)(w[4]), i, j, k;
+    t_int *op;
+    for (i = 0; i < n; i += 8)
     {
-        if (s5 == sig)
+        t_sample f[8];
+        for (j = 0; j < 8; j++)
+            f[j] = in[i+j];
+        for (k = nop, op = w+5; k--; op += 3)
         {
-            bug("signal_free 3");
-            return;
+            t_sample *v = (t_sample *)(op[1]) + i, g, g2;
+            switch (op[0])
+            {
+            case PW_ADD:
+                for (j = 0; j < 8; j++) f[j] += v[j];
+                break;
+            case PW_SUB:
+                for (j = 0; j < 8; j++) f[j] -= v[j];
+                break;
+            case PW_MUL:
+                for (j = 0; j < 8; j++) f[j] *= v[j];
+                break;
+            case PW_SCALARADD:
+                g = *(t_float *)(op[1]);
+                for (j = 0; j < 8; j++) f[j] += g;
+                break;
+            case PW_SCALARSUB:
+                g = *(t_float *)(op[1]);
+                for (j = 0; j < 8; j++) f[j] -= g;
+                break;
+            case PW_SCALARMUL:
+                g = *(t_float *)(op[1]);
+                for (j = 0; j < 8; j++) f[j] *= g;
+                break;
+            case PW_CLIP:
+                g = *(t_float *)(op[1]);
+                g2 = *(t_float *)(op[2]);
+                for (j = 0; j < 8; j++)
+                {
+                    if (f[j] < g) f[j] = g;
+                    if (f[j] > g2) f[j] = g2;
+                }
+                break;
+            }
         }
+        for (j = 0; j < 8; j++)
+            out[i+j] = f[j];
     }
-    for (s5 = THIS->u_freelist[logn]; s5; s5 = s5->s_nextfree)
+    return (w + 5 + 3*nop);
+}
+
+    /* add a pointwise operation to the chain.  For the vector operations
+    (PW_ADD, etc.) "arg1" is the second input signal; for the scalar ones
+    it points to the t_float operand, and for PW_CLIP "arg1" and "arg2"
+    point to the lower and upper limits.  The perform routine "f" is used if
+    the operation can't be fused with the previous one; it's called with
+    arguments (in, arg1, out, n), or (in, arg1, arg2, out, n) for PW_CLIP. */
+void dsp_addpointwise(t_perfroutine f, int op, t_sample *in, t_int arg1,
+    t_int arg2, t_sample *out, int n)
+{
+    t_pointwise *x = THIS->u_pointwise;
+    if (!x)
+        x = THIS->u_pointwise = (t_pointwise *)getbytes(sizeof(*x));
+        /* addition and multiplication can take the run's output as either
+        input. */
+    if ((op == PW_ADD || op == PW_MUL) && (t_sample *)arg1 == out &&
+        in != out)
     {
-        if (s5 == sig)
-        {
-            bug("signal_free 4");
-            return;
-        }
+        t_sample *swap = (t_sample *)arg1;
+        arg1 = (t_int)in;
+        in = swap;
     }
-#endif
-    if (THIS->u_loud) post("free %lx: %d", sig, sig->s_isborrowed);
-    if (sig->s_isborrowed)
+    if (x->p_nop && x->p_end == THIS->u_dspchainsize && x->p_nop < MAXFUSE &&
+        !(n & 7) && n == x->p_n && in == x->p_out && out == x->p_out &&
+            (op >= PW_SCALARADD || (t_sample *)arg1 != out))
     {
-            /* if the signal is borrowed, decrement the borrowed-from signal's
-                reference count, possibly marking it reusable too */
-        t_signal *s2 = sig->s_borrowedfrom;
-        if ((s2 == sig) || !s2)
-            bug("signal_free");
-        s2->s_refcount--;
-        if (!s2->s_refcount)
-            signal_makereusable(s2);
-        sig->s_nextfree = THIS->u_freeborrowed;
-        THIS->u_freeborrowed = sig;
+        t_int vec[4 + 3*MAXFUSE];
+        int i;
+        x->p_ops[3*x->p_nop] = op;
+        x->p_ops[3*x->p_nop+1] = arg1;
+        x->p_ops[3*x->p_nop+2] = arg2;
+        x->p_nop++;
+        vec[0] = (t_int)x->p_in;
+        vec[1] = (t_int)x->p_out;
+        vec[2] = n;
+        vec[3] = x->p_nop;
+        for (i = 0; i < 3*x->p_nop; i++)
+            vec[4+i] = x->p_ops[i];
+            /* back up the chain to the beginning of the run */
+        THIS->u_dspchainsize = x->p_onset + 1;
+        THIS->u_dspchain[x->p_onset] = (t_int)dsp_done;
+        dsp_addv(pointwise_perf8, 4 + 3*x->p_nop, vec);
     }
     else
     {
-            /* if it's a real signal (not borrowed), put it on the free list
-                so we can reuse it. */
-        if (THIS->u_freelist[logn] == sig) bug("signal_free 2");
-        sig->s_nextfree = THIS->u_freelist[logn];
-        THIS->u_freelist[logn] = sig;
+        x->p_onset = THIS->u_dspchainsize - 1;
+        x->p_nop = 1;
+        x->p_in = in;
+        x->p_out = out;
+        x->p_n = n;
+        x->p_ops[0] = op;
+        x->p_ops[1] = arg1;
+        x->p_ops[2] = arg2;
+        pointwise_noteroutine(f, op);
+        if (op == PW_CLIP)
+            dsp_add(f, 5, in, arg1, arg2, out, (t_int)n);
+        else dsp_add(f, 4, in, arg1, out, (t_int)n);
     }
+    x->p_end = THIS->u_dspchainsize;
 }
 
-    /* reclaim or make an audio signal.  If n is zero, return a "borrowed"
-    signal whose buffer and size will be obtained later via
-    signal_setborrowed(). */
+/* ------------------ batching calls from several objects ----------------- */
+
+/* Objects like rfft~ that do all their work in one perform routine can add
+it through dsp_addbatch() instead of dsp_add().  When several such calls with
+the same routine and vector size are added to the chain one right after the
+other, as happens when a patch has one copy of the object per channel, they
+are merged into a single call which is passed (n, count, args...), "nargs"
+arguments for each of the "count" objects in the order they were added.
+The routine does them one after the other, exactly as the separate calls
+would have, and returns a pointer past all of them. */
 
-static t_signal *signal_new(int n, t_float sr)
+#define MAXBATCH 64
+
+typedef struct _batch
 {
-    int logn, vecsize = 0;
-    t_signal *ret, **whichlist;
-    logn = ilog2(n);
-    if (n)
+    int b_onset;        /* where in the chain the batch begins */
+    int b_end;          /* chain size right after the batch */
+    t_perfroutine b_fn; /* perform routine */
+    int b_n;            /* vector size */
+    int b_nargs;        /* number of arguments for each object */
+    int b_count;        /* number of objects so far */
+    int b_size;         /* number of t_ints allocated in b_vec */
+    t_int *b_vec;       /* n, count, and arguments, as passed to b_fn */
+} t_batch;
+
+static void batch_free(void)
+{
+    if (THIS->u_batch)
     {
-        if ((vecsize = (1<<logn)) != n)
-            vecsize *= 2;
-        if (logn > MAXLOGSIG)
-            bug("signal buffer too large");
-        whichlist = THIS->u_freelist + logn;
+        if (THIS->u_batch->b_vec)
+            freebytes(THIS->u_batch->b_vec,
+                THIS->u_batch->b_size * sizeof(t_int));
+        freebytes(THIS->u_batch, sizeof(*THIS->u_batch));
     }
-    else
-        whichlist = &THIS->u_freeborrowed;
+}
 
-        /* first try to reclaim one from the free list */
-    if ((ret = *whichlist))
-        *whichlist = ret->s_nextfree;
-    else
+void dsp_addbatch(t_perfroutine f, int n, int nargs, t_int *args)
+{
+    t_batch *x = THIS->u_batch;
+    int i, size;
+    if (!x)
+        x = THIS->u_batch = (t_batch *)getbytes(sizeof(*x));
+    if (!x->b_count || x->b_end != THIS->u_dspchainsize || x->b_fn != f ||
+        x->b_n != n || x->b_nargs != nargs || x->b_count >= MAXBATCH)
     {
-            /* LATER figure out what to do for out-of-space here! */
-        ret = (t_signal *)t_getbytes(sizeof *ret);
-        if (n)
-        {
-            ret->s_vec = (t_sample *)getbytes(vecsize * sizeof (*ret->s_vec));
-            ret->s_isborrowed = 0;
-        }
+        x->b_onset = THIS->u_dspchainsize - 1;
+        x->b_fn = f;
+        x->b_n = n;
+        x->b_nargs = nargs;
+        x->b_count = 0;
+    }
+    if ((size = 2 + (x->b_count + 1) * nargs) > x->b_size)
+    {
+        x->b_vec = (t_int *)resizebytes(x->b_vec, x->b_size * sizeof(t_int),
+            size * sizeof(t_int));
+        x->b_size = size;
+    }
+    for (i = 0; i < nargs; i++)
+        x->b_vec[2 + x->b_count * nargs + i] = args[i];
+    x->b_count++;
+    x->b_vec[0] = n;
+    x->b_vec[1] = x->b_count;
+        /* back up the chain to the beginning of the batch and add it again */
+    THIS->u_dspchainsize = x->b_onset + 1;
+    THIS->u_dspchain[x->b_onset] = (t_int)dsp_done;
+    dsp_addv(f, 2 + x->b_count * nargs, x->b_vec);
+    x->b_end = THIS->u_dspchainsize;
+}
+
+/* ------------------ compiling the DSP chain to C ----------------------- */
+
+/* "pd compile-dsp <file.c>" writes the current DSP chain out as a single C
+function.  The simple calls whose arithmetic Pd knows -- pointwise runs and
+single pointwise operations (see above), copies, zeroing, and scalar-to-signal
+copies -- become straight-line loops with the vector size and opcodes
+written in as constants.  Every other call, including those of externals,
+is made directly through its perform routine.  Signal buffers and scalar
+operands are still found through the chain's arguments, since they're
+allocated anew in every run.
+
+The result, built as a shared library, is loaded by "pd dsp-compiled <lib>"
+(or the "-compiled" flag) and then replaces the loop in dsp_tick().  Along
+with the function, the library carries a description of the chain it was
+made from -- where each call begins and the constants of the ones that were
+written out -- and it's only used while the current chain matches that
+description; otherwise DSP runs as usual.  The chain only changes when the
+patch is edited, so this is checked once after each resorting. */
+
+#define DC_OTHER 0          /* call through the perform routine */
+#define DC_POINTWISE 1      /* fused pointwise run: n, nop, opcodes */
+#define DC_PWSINGLE 2       /* one pointwise operation: opcode, n */
+#define DC_COPY 3           /* copy a signal: n */
+#define DC_ZERO 4           /* zero a signal: n */
+#define DC_SCALARCOPY 5     /* copy a scalar to a signal: n */
+
+#define DC_VERSION 1
+#define DC_MAXDESC (4 + MAXFUSE)
+
+t_int *copy_perform(t_int *w);
+static t_int *copy_perf8(t_int *w);
+t_int *zero_perform(t_int *w);
+t_int *zero_perf8(t_int *w);
+static t_int *sig_tilde_perform(t_int *w);
+static t_int *sig_tilde_perf8(t_int *w);
+
+typedef struct _dspcompiled
+{
+    void *c_lib;                /* shared library handle */
+    t_symbol *c_name;           /* its filename */
+    t_perfroutine c_fn;         /* the compiled chain */
+    const int *c_desc;          /* description of the chain it's for */
+    int c_ndesc;
+    int c_sortno;               /* sorting we last checked against */
+    int c_match;                /* true if that matched */
+    int c_warned;               /* true once we've said it doesn't match */
+} t_dspcompiled;
+
+    /* describe the call at "onset" in the chain as a few ints: the onset,
+    its kind, and constants that the generated code depends on.  Returns
+    the number of ints (at most DC_MAXDESC) written into "buf". */
+static int dspcompile_describe(int onset, int *buf)
+{
+    t_int *w = THIS->u_dspchain + onset;
+    t_perfroutine f = (t_perfroutine)w[0];
+    int op, i;
+    buf[0] = onset;
+    if (f == pointwise_perf8)
+    {
+        int nop = (int)w[4];
+        buf[1] = DC_POINTWISE;
+        buf[2] = (int)w[3];
+        buf[3] = nop;
+        for (i = 0; i < nop; i++)
+            buf[4+i] = (int)w[5 + 3*i];
+        return (4 + nop);
+    }
+    else if ((op = pointwise_getop(f)) >= 0)
+    {
+        buf[1] = DC_PWSINGLE;
+        buf[2] = op;
+        buf[3] = (int)w[op == PW_CLIP ? 5 : 4];
+        return (4);
+    }
+    buf[1] = DC_OTHER;
+    if (f == copy_perform || f == copy_perf8)
+        buf[1] = DC_COPY, buf[2] = (int)w[3];
+    else if (f == zero_perform || f == zero_perf8)
+        buf[1] = DC_ZERO, buf[2] = (int)w[2];
+    else if (f == sig_tilde_perform || f == sig_tilde_perf8)
+        buf[1] = DC_SCALARCOPY, buf[2] = (int)w[3];
+    else return (2);
+    return (3);
+}
+
+    /* write out a loop for "nop" pointwise operations whose input and
+    output signals are at w[in] and w[out] in the chain; operation i has
+    opcode ops[i] and arguments at w[arg1[i]] and w[arg2[i]]. */
+static void dspcompile_pointwise(FILE *fd, int in, int out, int n, int nop,
+    const int *ops, const int *arg1, const int *arg2)
+{
+    static const char *opname[] = {"+", "-", "*", "+", "-", "*"};
+    int i;
+    fprintf(fd, "    {\n");
+    fprintf(fd, "        t_sample *in = (t_sample *)w[%d];\n", in);
+    fprintf(fd, "        t_sample *out = (t_sample *)w[%d];\n", out);
+    for (i = 0; i < nop; i++)
+    {
+        if (ops[i] <= PW_MUL)
+            fprintf(fd, "        t_sample *v%d = (t_sample *)w[%d];\n",
+                i, arg1[i]);
+        else fprintf(fd, "        t_sample g%d = *(t_float *)w[%d];\n",
+            i, arg1[i]);
+        if (ops[i] == PW_CLIP)
+            fprintf(fd, "        t_sample h%d = *(t_float *)w[%d];\n",
+                i, arg2[i]);
+    }
+    fprintf(fd, "        int i;\n");
+    fprintf(fd, "        for (i = 0; i < %d; i++)\n", n);
+    fprintf(fd, "        {\n");
+    fprintf(fd, "            t_sample f = in[i];\n");
+    for (i = 0; i < nop; i++)
+    {
+        if (ops[i] <= PW_MUL)
+            fprintf(fd, "            f = f %s v%d[i];\n", opname[ops[i]], i);
+        else if (ops[i] < PW_CLIP)
+            fprintf(fd, "            f = f %s g%d;\n", opname[ops[i]], i);
         else
         {
-            ret->s_vec = 0;
-            ret->s_isborrowed = 1;
+            fprintf(fd, "            if (f < g%d) f = g%d;\n", i, i);
+            fprintf(fd, "            if (f > h%d) f = h%d;\n", i, i);
         }
-        ret->s_nextused = THIS->u_signals;
-        THIS->u_signals = ret;
     }
-    ret->s_n = n;
-    ret->s_vecsize = vecsize;
-    ret->s_sr = sr;
-    ret->s_refcount = 0;
-    ret->s_borrowedfrom = 0;
-    if (THIS->u_loud) post("new %lx: %lx", ret, ret->s_vec);
-    return (ret);
+    fprintf(fd, "            out[i] = f;\n");
+    fprintf(fd, "        }\n");
+    fprintf(fd, "    }\n");
 }
 
-static t_signal *signal_newlike(const t_signal *sig)
+    /* write the code for the call at "onset"; "next" is where the next one
+    begins */
+static void dspcompile_entry(FILE *fd, int onset, int next, const int *desc)
 {
-    return (signal_new(sig->s_n, sig->s_sr));
+    t_int *w = THIS->u_dspchain + onset;
+    int k = onset, ops[MAXFUSE], arg1[MAXFUSE], arg2[MAXFUSE], i;
+    fprintf(fd, "    case %d:\n", k);
+    switch (desc[1])
+    {
+    case DC_POINTWISE:
+        for (i = 0; i < desc[3]; i++)
+        {
+            ops[i] = desc[4+i];
+            arg1[i] = k + 6 + 3*i;
+            arg2[i] = k + 7 + 3*i;
+        }
+        dspcompile_pointwise(fd, k+1, k+2, desc[2], desc[3],
+            ops, arg1, arg2);
+        break;
+    case DC_PWSINGLE:
+        ops[0] = desc[2];
+        arg1[0] = k+2;
+        arg2[0] = k+3;
+        dspcompile_pointwise(fd, k+1, (desc[2] == PW_CLIP ? k+4 : k+3),
+            desc[3], 1, ops, arg1, arg2);
+        break;
+    case DC_COPY:
+        fprintf(fd, "    {\n");
+        fprintf(fd, "        t_sample *in = (t_sample *)w[%d];\n", k+1);
+        fprintf(fd, "        t_sample *out = (t_sample *)w[%d];\n", k+2);
+        fprintf(fd, "        int i;\n");
+        fprintf(fd, "        for (i = 0; i < %d; i++)\n", desc[2]);
+        fprintf(fd, "            out[i] = in[i];\n");
+        fprintf(fd, "    }\n");
+        break;
+    case DC_ZERO:
+        fprintf(fd, "    {\n");
+        fprintf(fd, "        t_sample *out = (t_sample *)w[%d];\n", k+1);
+        fprintf(fd, "        int i;\n");
+        fprintf(fd, "        for (i = 0; i < %d; i++)\n", desc[2]);
+        fprintf(fd, "            out[i] = 0;\n");
+        fprintf(fd, "    }\n");
+        break;
+    case DC_SCALARCOPY:
+        fprintf(fd, "    {\n");
+        fprintf(fd, "        t_sample f = *(t_float *)w[%d];\n", k+1);
+        fprintf(fd, "        t_sample *out = (t_sample *)w[%d];\n", k+2);
+        fprintf(fd, "        int i;\n");
+        fprintf(fd, "        for (i = 0; i < %d; i++)\n", desc[2]);
+        fprintf(fd, "            out[i] = f;\n");
+        fprintf(fd, "    }\n");
+        break;
+    default:
+            /* perform routines may jump (block~, switch~, and parallel
+            sections do) so check where this one went */
+        fprintf(fd, "        ip = (*(t_perfroutine)w[%d])(w + %d);\n", k, k);
+        fprintf(fd, "        if (ip != w + %d)\n", next);
+        fprintf(fd, "            break;\n");
+        break;
+    }
 }
 
-void signal_setborrowed(t_signal *sig, t_signal *sig2)
+void glob_compiledsp(void *dummy, t_symbol *filename)
 {
-    if (!sig->s_isborrowed || sig->s_borrowedfrom)
-        bug("signal_setborrowed");
-    if (sig == sig2)
-        bug("signal_setborrowed 2");
+    FILE *fd;
+    int i, j, ndesc, desc[DC_MAXDESC], ninline = 0;
+    canvas_flush_dsp();
+    if (!THIS->u_dspchain)
+    {
+        pd_error(0, "compile-dsp: DSP is off");
+        return;
+    }
+    if (!(fd = sys_fopen(filename->s_name, "w")))
+    {
+        pd_error(0, "%s: %s", filename->s_name, strerror(errno));
+        return;
+    }
+    fprintf(fd, "/* DSP chain compiled by Pd %d.%d-%d.  Build it as a shared "
+        "library, e.g.,\n", PD_MAJOR_VERSION, PD_MINOR_VERSION,
+            PD_BUGFIX_VERSION);
+    fprintf(fd, "    cc -O3 -ffast-math -fPIC -shared -I<pd>/src "
+        "-o chain.so chain.c\n");
+    fprintf(fd, "and load it with \"pd -compiled chain.so\".  "
+        "It's only used while the patch's\n");
+    fprintf(fd, "DSP chain comes out the same as when this was written."
+        " */\n\n");
+    fprintf(fd, "#include \"m_pd.h\"\n\n");
+    fprintf(fd, "#ifdef _WIN32\n#define DC_EXPORT __declspec(dllexport)\n"
+        "#else\n#define DC_EXPORT\n#endif\n\n");
+
+        /* the description of the chain */
+    fprintf(fd, "DC_EXPORT const int pd_dspcompiled_version = %d;\n",
+        DC_VERSION);
+    fprintf(fd, "DC_EXPORT const int pd_dspcompiled_sampsize = "
+        "sizeof(t_sample);\n");
+    fprintf(fd, "DC_EXPORT const int pd_dspcompiled_desc[] = {\n");
+    for (i = 0, ndesc = 0; i < THIS->u_nentries; i++)
+    {
+        int n = dspcompile_describe(THIS->u_entries[i], desc);
+        fprintf(fd, "   ");
+        for (j = 0; j < n; j++)
+            fprintf(fd, " %d,", desc[j]);
+        fprintf(fd, "\n");
+        ndesc += n;
+        if (desc[1] != DC_OTHER)
+            ninline++;
+    }
+    fprintf(fd, "    %d\n};\n", THIS->u_dspchainsize);
+    fprintf(fd, "DC_EXPORT const int pd_dspcompiled_ndesc = %d;\n\n",
+        ndesc + 1);
+
+        /* the code.  It runs straight through as long as each call returns
+        the next one; if not, it goes back to the switch to find where it
+        landed, or else finishes the chain the usual way. */
+    fprintf(fd, "DC_EXPORT t_int *pd_dspcompiled(t_int *w)\n{\n");
+    fprintf(fd, "    t_int *ip = w;\n");
+    fprintf(fd, "    while (ip) switch (ip - w)\n    {\n");
+    for (i = 0; i < THIS->u_nentries; i++)
+    {
+        dspcompile_describe(THIS->u_entries[i], desc);
+        dspcompile_entry(fd, THIS->u_entries[i],
+            (i < THIS->u_nentries - 1 ? THIS->u_entries[i+1] :
+                THIS->u_dspchainsize - 1), desc);
+    }
+    fprintf(fd, "    case %d:\n        return (0);\n", THIS->u_dspchainsize - 1);
+    fprintf(fd, "    default:\n");
+    fprintf(fd, "        while (ip)\n");
+    fprintf(fd, "            ip = (*(t_perfroutine)(*ip))(ip);\n");
+    fprintf(fd, "        return (0);\n");
+    fprintf(fd, "    }\n    return (0);\n}\n");
+    if (ferror(fd))
+        pd_error(0, "%s: write failed", filename->s_name);
+    else post("compile-dsp: wrote %s (%d calls, %d written out)",
+        filename->s_name, THIS->u_nentries, ninline);
+    sys_fclose(fd);
+}
+
+    /* if a compiled chain is loaded and matches the current chain, return
+    it.  This is only worked out again after the chain is resorted. */
+static t_perfroutine dspcompiled_match(void)
+{
+    t_dspcompiled *x = THIS->u_compiled;
+    int i, j, n, desc[DC_MAXDESC];
+    if (x->c_sortno == THIS->u_sortno)
+        return (x->c_match ? x->c_fn : 0);
+    x->c_sortno = THIS->u_sortno;
+    x->c_match = 0;
+    for (i = j = 0; i < THIS->u_nentries; i++, j += n)
+    {
+        n = dspcompile_describe(THIS->u_entries[i], desc);
+        if (j + n >= x->c_ndesc || memcmp(x->c_desc + j, desc, n * sizeof(int)))
+            goto nomatch;
+    }
+    if (j != x->c_ndesc - 1 || x->c_desc[j] != THIS->u_dspchainsize)
+        goto nomatch;
+    x->c_match = 1;
+    logpost(0, PD_VERBOSE, "using compiled DSP chain %s", x->c_name->s_name);
+    return (x->c_fn);
+nomatch:
+    if (!x->c_warned)
+        post("%s: DSP chain has changed; not using compiled chain",
+            x->c_name->s_name);
+    x->c_warned = 1;
+    return (0);
+}
+
+static void dspcompiled_free(void)
+{
+    t_dspcompiled *x = THIS->u_compiled;
+    if (x)
+    {
+        sys_dlclose(x->c_lib);
+        freebytes(x, sizeof(*x));
+        THIS->u_compiled = 0;
+    }
+}
+
+    /* "dsp-compiled <lib>" loads a chain written by compile-dsp; with no
+    argument, goes back to running the chain as usual */
+void glob_dspcompiled(void *dummy, t_symbol *s, int argc, t_atom *argv)
+{
+    t_symbol *filename = atom_getsymbolarg(0, argc, argv);
+    void *lib;
+    const int *version, *sampsize, *ndesc;
+    t_dspcompiled *x;
+    dspcompiled_free();
+    if (!*filename->s_name)
+        return;
+    if (!(lib = sys_dlopen(filename->s_name)))
+        return;
+    version = (const int *)sys_dlsym(lib, "pd_dspcompiled_version");
+    sampsize = (const int *)sys_dlsym(lib, "pd_dspcompiled_sampsize");
+    ndesc = (const int *)sys_dlsym(lib, "pd_dspcompiled_ndesc");
+    if (!version || !sampsize || !ndesc ||
+        !sys_dlsym(lib, "pd_dspcompiled_desc") ||
+            !sys_dlsym(lib, "pd_dspcompiled"))
+    {
+        pd_error(0, "%s: not a compiled DSP chain", filename->s_name);
+        sys_dlclose(lib);
+        return;
+    }
+    if (*version != DC_VERSION || *sampsize != sizeof(t_sample))
+    {
+        pd_error(0, "%s: compiled for a different version of Pd",
+            filename->s_name);
+        sys_dlclose(lib);
+        return;
+    }
+    x = THIS->u_compiled = (t_dspcompiled *)getbytes(sizeof(*x));
+    x->c_lib = lib;
+    x->c_name = filename;
+    x->c_fn = (t_perfroutine)sys_dlsym(lib, "pd_dspcompiled");
+    x->c_desc = (const int *)sys_dlsym(lib, "pd_dspcompiled_desc");
+    x->c_ndesc = *ndesc;
+    x->c_sortno = THIS->u_sortno - 1;
+}
+
+/* ------------------ parallel DSP sections ----------------------- */
+
+/* A "section" is a stretch of the DSP chain made up of "tasks" which don't
+depend on each other, so that they may be computed by different threads.
+In the chain a section looks like this:
+
+    section_fork (section)
+    section_task (section)      -- first task
+    ... ugens ...
+    section_task (section)      -- second task
+    ... ugens ...
+    section_join (section)
+
+If there are no DSP threads the markers are simply stepped over and the
+tasks are computed one after the other as usual.  Otherwise section_fork()
+hands the tasks out to the worker threads (computing some of them itself),
+waits for all of them to finish, and jumps past the join.  A task is run
+from just after its marker until the next marker, which then returns zero.
+
+While a section is being scheduled, signals that become free aren't put
+back on the free lists until the section is closed, so that no two tasks
+ever share a signal buffer.  Each task that contains a dac~ also gets its
+own copy of the output buffer; these are summed, in task order, into the
+enclosing one at the join, so that the result doesn't depend on which
+thread finished first.  Summing buses such as throw~/catch~ work the same way
+through ugen_getsumbuffer(): a task adds into its own partial sum, and the
+partial sums are added into the bus at the join, again in task order. */
+
+#define MAXDSPTHREADS 64
+
+typedef struct _dspsection
+{
+    struct _dspsection *d_next;         /* next in list for this instance */
+    struct _dspsection *d_parent;       /* enclosing section while building */
+    struct _dspsection *d_nextactive;   /* next in pool's work queue */
+    t_pdinstance *d_instance;   /* Pd instance we belong to */
+    int d_ntask;                /* number of tasks */
+    int d_ntaskalloc;           /* allocated size of the following two */
+    int *d_taskonset;           /* onset of each task from fork in chain */
+    t_sample **d_soundout;      /* private output buffer per task, or 0 */
+    int d_forkonset;            /* location of fork in chain (while building) */
+    int d_joinonset;            /* onset of join from fork */
+    int d_soundoutsize;         /* size of private output buffers */
+    t_sample *d_parentout;      /* output buffer to sum private ones into */
+    t_int *d_fork;              /* fork's address in chain while running */
+    int d_parallel;             /* true while tasks are run by threads */
+    int d_nextclaim;            /* next task to hand out */
+    int d_nfinished;            /* number of tasks computed so far */
+    struct _sectionsum *d_sums; /* partial sums for summing buses */
+    struct _profrec *d_rtcurrent;   /* rt-check record at the fork */
+} t_dspsection;
+
+    /* a task's private partial sum for a bus such as catch~ */
+typedef struct _sectionsum
+{
+    struct _sectionsum *s_next;
+    int s_task;                 /* task it belongs to */
+    t_sample *s_target;         /* bus the task asked to add into */
+    t_sample *s_dest;           /* where to add the partial sum at the join */
+    t_sample *s_vec;            /* the partial sum itself */
+    int s_n;                    /* its size */
+} t_sectionsum;
+
+static pthread_mutex_t dsppool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dsppool_wakeup = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t dsppool_done = PTHREAD_COND_INITIALIZER;
+static pthread_t dsppool_thread[MAXDSPTHREADS];
+static t_dspsection *dsppool_queue;     /* sections with tasks to give out */
+static int dsppool_nthreads;            /* number of worker threads */
+static int dsppool_quit;                /* tell workers to exit */
+
+    /* number of sections currently being computed in parallel; while this
+    is nonzero, perform routines may be called from several threads at
+    once, in which case m_sched.c protects the clock list.  */
+int ugen_nparallel;
+static pthread_mutex_t ugen_clockmutex = PTHREAD_MUTEX_INITIALIZER;
+
+void ugen_lockclocks(void)
+{
+    pthread_mutex_lock(&ugen_clockmutex);
+}
+
+void ugen_unlockclocks(void)
+{
+    pthread_mutex_unlock(&ugen_clockmutex);
+}
+
+    /* compute one task.  Called from a worker or from section_fork(). */
+static void section_runtask(t_dspsection *x, int k)
+{
+    t_int *ip = x->d_fork + x->d_taskonset[k] + 2;
+#ifdef PDINSTANCE
+    pd_this = x->d_instance;
+#endif
+    if (THIS->u_rtcheck)
+        rtcheck_begin();
+    while (ip)
+        ip = (*(t_perfroutine)(*ip))(ip);
+    if (THIS->u_rtcheck)
+        rtcheck_end();
+}
+
+    /* take the next task from a section; call with the pool locked.  When
+    the last one is taken, the section leaves the work queue. */
+static int section_claim(t_dspsection *x)
+{
+    int k = x->d_nextclaim++;
+    if (x->d_nextclaim >= x->d_ntask)
+    {
+        t_dspsection **sp;
+        for (sp = &dsppool_queue; *sp; sp = &(*sp)->d_nextactive)
+            if (*sp == x)
+        {
+            *sp = x->d_nextactive;
+            break;
+        }
+    }
+    return (k);
+}
+
+static void *dsppool_work(void *dummy)
+{
+    int affinityserial = -1;
+    if (sys_flushdenormals)
+        sched_flushdenormals();
+    pthread_mutex_lock(&dsppool_mutex);
+    while (!dsppool_quit)
+    {
+        t_dspsection *x = dsppool_queue;
+        sys_bindthread(AFFINITY_DSP, &affinityserial);
+        if (x)
+        {
+            int k = section_claim(x);
+            pthread_mutex_unlock(&dsppool_mutex);
+            section_runtask(x, k);
+            pthread_mutex_lock(&dsppool_mutex);
+            if (THIS->u_rtcheck)
+                rtcheck_flush();
+            if (++x->d_nfinished == x->d_ntask)
+                pthread_cond_broadcast(&dsppool_done);
+        }
+        else pthread_cond_wait(&dsppool_wakeup, &dsppool_mutex);
+    }
+    pthread_mutex_unlock(&dsppool_mutex);
+    return (0);
+}
+
+    /* add a partial sum into its destination and clear it */
+static void section_addsum(t_sample *in, t_sample *out, int n)
+{
+    if (n & 7)
+        while (n--)
+            *out++ += *in, *in++ = 0;
+    else for (; n; n -= 8, in += 8, out += 8)
+    {
+        out[0] += in[0]; out[1] += in[1]; out[2] += in[2]; out[3] += in[3];
+        out[4] += in[4]; out[5] += in[5]; out[6] += in[6]; out[7] += in[7];
+
+        in[0] = 0; in[1] = 0; in[2] = 0; in[3] = 0;
+        in[4] = 0; in[5] = 0; in[6] = 0; in[7] = 0;
+    }
+}
+
+    /* sum private output buffers and partial sums into the enclosing ones.
+    The partial sums are kept in the order they were asked for, which is
+    task order. */
+static void section_mix(t_dspsection *x)
+{
+    t_sectionsum *sum;
+    int k;
+    if (x->d_soundout)
+        for (k = 0; k < x->d_ntask; k++)
+            if (x->d_soundout[k])
+    {
+        section_addsum(x->d_soundout[k], x->d_parentout,
+            x->d_soundoutsize);
+            /* later dac~s have to add to all channels */
+        if (x->d_parentout == STUFF->st_soundout && THIS->u_outwritten)
+            memset(THIS->u_outwritten, 1, THIS->u_noutwritten);
+    }
+    for (sum = x->d_sums; sum; sum = sum->s_next)
+        section_addsum(sum->s_vec, sum->s_dest, sum->s_n);
+}
+
+static t_int *section_fork(t_int *w)
+{
+    t_dspsection *x = (t_dspsection *)(w[1]);
+    if (!dsppool_nthreads || x->d_ntask < 2)
+        return (w+2);
+    x->d_fork = w;
+    x->d_nextclaim = x->d_nfinished = 0;
+    x->d_parallel = 1;
+    x->d_rtcurrent = rtcheck_current;
+    pthread_mutex_lock(&dsppool_mutex);
+    ugen_nparallel++;
+    x->d_nextactive = dsppool_queue;
+    dsppool_queue = x;
+    pthread_cond_broadcast(&dsppool_wakeup);
+        /* rather than just wait, help compute the tasks */
+    while (x->d_nextclaim < x->d_ntask)
+    {
+        int k = section_claim(x);
+        pthread_mutex_unlock(&dsppool_mutex);
+        section_runtask(x, k);
+        pthread_mutex_lock(&dsppool_mutex);
+        if (THIS->u_rtcheck)
+            rtcheck_flush();
+        x->d_nfinished++;
+    }
+    while (x->d_nfinished < x->d_ntask)
+        pthread_cond_wait(&dsppool_done, &dsppool_mutex);
+    ugen_nparallel--;
+    pthread_mutex_unlock(&dsppool_mutex);
+#ifdef PDINSTANCE
+    pd_this = x->d_instance;
+#endif
+    x->d_parallel = 0;
+    section_mix(x);
+    return (w + x->d_joinonset + 2);
+}
+
+static t_int *section_task(t_int *w)
+{
+    t_dspsection *x = (t_dspsection *)(w[1]);
+    return (x->d_parallel ? 0 : w+2);
+}
+
+static t_int *section_join(t_int *w)
+{
+    t_dspsection *x = (t_dspsection *)(w[1]);
+    if (x->d_parallel)
+        return (0);
+    section_mix(x);
+    return (w+2);
+}
+
+static void signal_makereusable_now(t_signal *sig);
+
+    /* open a parallel section in the DSP chain being built.  Returns 0 if
+    there are no DSP threads, in which case the caller should just schedule
+    its tasks as usual. */
+void *ugen_beginsection(void)
+{
+    t_dspsection *x;
+    if (!dsppool_nthreads)
+        return (0);
+    x = (t_dspsection *)getbytes(sizeof(*x));
+    x->d_instance = pd_this;
+    x->d_parentout = ugen_getsoundout();
+    x->d_soundoutsize = sys_get_outchannels() * DEFDACBLKSIZE;
+    x->d_next = THIS->u_sections;
+    THIS->u_sections = x;
+    x->d_parent = THIS->u_cursection;
+    THIS->u_cursection = x;
+    THIS->u_deferreuse++;
+    x->d_forkonset = THIS->u_dspchainsize - 1;
+    dsp_add(section_fork, 1, x);
+    return (x);
+}
+
+    /* start the next task in a section */
+void ugen_nexttask(void *z)
+{
+    t_dspsection *x = (t_dspsection *)z;
+    if (x->d_ntask == x->d_ntaskalloc)
+    {
+        int newalloc = 2 * x->d_ntaskalloc + 4;
+        if (!x->d_ntaskalloc)
+        {
+            x->d_taskonset = (int *)getbytes(newalloc * sizeof(int));
+            x->d_soundout = (t_sample **)getbytes(newalloc *
+                sizeof(t_sample *));
+        }
+        else
+        {
+            x->d_taskonset = (int *)resizebytes(x->d_taskonset,
+                x->d_ntaskalloc * sizeof(int), newalloc * sizeof(int));
+            x->d_soundout = (t_sample **)resizebytes(x->d_soundout,
+                x->d_ntaskalloc * sizeof(t_sample *),
+                    newalloc * sizeof(t_sample *));
+        }
+        x->d_ntaskalloc = newalloc;
+    }
+    x->d_taskonset[x->d_ntask++] = THIS->u_dspchainsize - 1 - x->d_forkonset;
+    dsp_add(section_task, 1, x);
+}
+
+void ugen_endsection(void *z)
+{
+    t_dspsection *x = (t_dspsection *)z;
+    int i;
+    x->d_joinonset = THIS->u_dspchainsize - 1 - x->d_forkonset;
+    dsp_add(section_join, 1, x);
+        /* only keep the private output buffers that someone asked for */
+    for (i = 0; i < x->d_ntask; i++)
+        if (x->d_soundout[i])
+            break;
+    if (i == x->d_ntask && x->d_ntaskalloc)
+    {
+        freebytes(x->d_soundout, x->d_ntaskalloc * sizeof(t_sample *));
+        x->d_soundout = 0;
+    }
+    THIS->u_cursection = x->d_parent;
+    if (!--THIS->u_deferreuse)
+    {
+        t_signal *sig;
+        while ((sig = THIS->u_pendingreuse))
+        {
+            THIS->u_pendingreuse = sig->s_nextfree;
+            signal_makereusable_now(sig);
+        }
+    }
+}
+
+    /* get the output buffer dac~ should add into.  Inside a parallel
+    section this is a private buffer of the task being scheduled. */
+t_sample *ugen_getsoundout(void)
+{
+    t_dspsection *x = THIS->u_cursection;
+    int k;
+    if (!x || !x->d_ntask || !x->d_soundoutsize)
+        return (STUFF->st_soundout);
+    k = x->d_ntask - 1;
+    if (!x->d_soundout[k])
+        x->d_soundout[k] = (t_sample *)getbytes(x->d_soundoutsize *
+            sizeof(t_sample));
+    return (x->d_soundout[k]);
+}
+
+    /* flags, one per channel of the buffer ugen_getsoundout() gives, that
+    are cleared at the start of each DSP tick; dac~ sets them to show it has
+    written a channel, so that the first one to write each channel can copy
+    into it instead of adding to the zeros the audio API left there.  Null
+    for the private buffers, which dac~ always adds to. */
+unsigned char *ugen_getoutwritten(void)
+{
+    t_dspsection *x = THIS->u_cursection;
+    if (!x || !x->d_ntask || !x->d_soundoutsize)
+        return (THIS->u_outwritten);
+    return (0);
+}
+
+static t_sample *section_getsum(t_dspsection *x, t_sample *target, int n)
+{
+    t_sectionsum *sum, **sp;
+    if (!x)
+        return (target);
+    if (!x->d_ntask)
+        return (section_getsum(x->d_parent, target, n));
+    for (sp = &x->d_sums; (sum = *sp); sp = &sum->s_next)
+        if (sum->s_task == x->d_ntask - 1 && sum->s_target == target)
+            return (sum->s_vec);
+    sum = (t_sectionsum *)getbytes(sizeof(*sum));
+    sum->s_task = x->d_ntask - 1;
+    sum->s_target = target;
+    sum->s_dest = section_getsum(x->d_parent, target, n);
+    sum->s_vec = (t_sample *)getbytes(n * sizeof(t_sample));
+    sum->s_n = n;
+    *sp = sum;
+    return (sum->s_vec);
+}
+
+    /* get the buffer a ugen should add into in place of "target", a
+    summing bus of n samples such as catch~'s.  Inside a parallel section
+    this is a partial sum private to the task being scheduled; otherwise
+    it's the bus itself.  Asking again from the same task gives the same
+    partial sum. */
+t_sample *ugen_getsumbuffer(t_sample *target, int n)
+{
+    return (section_getsum(THIS->u_cursection, target, n));
+}
+
+static void ugen_freesections(void)
+{
+    t_dspsection *x;
+    t_sectionsum *sum;
+    int i;
+    while ((x = THIS->u_sections))
+    {
+        THIS->u_sections = x->d_next;
+        while ((sum = x->d_sums))
+        {
+            x->d_sums = sum->s_next;
+            freebytes(sum->s_vec, sum->s_n * sizeof(t_sample));
+            freebytes(sum, sizeof(*sum));
+        }
+        if (x->d_soundout)
+        {
+            for (i = 0; i < x->d_ntask; i++)
+                if (x->d_soundout[i])
+                    freebytes(x->d_soundout[i],
+                        x->d_soundoutsize * sizeof(t_sample));
+            freebytes(x->d_soundout, x->d_ntaskalloc * sizeof(t_sample *));
+        }
+        if (x->d_taskonset)
+            freebytes(x->d_taskonset, x->d_ntaskalloc * sizeof(int));
+        freebytes(x, sizeof(*x));
+    }
+    THIS->u_cursection = 0;
+}
+
+    /* change the number of DSP worker threads.  This is shared by all Pd
+    instances; the DSP chain is rebuilt so that sections appear or
+    disappear accordingly.  Zero (the default) means compute everything in
+    the scheduler thread. */
+void ugen_setthreads(int n)
+{
+    int i;
+    if (n < 0)
+        n = 0;
+    if (n > MAXDSPTHREADS)
+        n = MAXDSPTHREADS;
+    if (n == dsppool_nthreads)
+        return;
+    pthread_mutex_lock(&dsppool_mutex);
+    dsppool_quit = 1;
+    pthread_cond_broadcast(&dsppool_wakeup);
+    pthread_mutex_unlock(&dsppool_mutex);
+    for (i = 0; i < dsppool_nthreads; i++)
+        pthread_join(dsppool_thread[i], 0);
+    dsppool_quit = 0;
+    for (i = 0; i < n; i++)
+        if (pthread_create(&dsppool_thread[i], 0, dsppool_work, 0))
+    {
+        pd_error(0, "pd: couldn't start DSP thread %d", i+1);
+        break;
+    }
+    dsppool_nthreads = i;
+    canvas_update_dsp();
+}
+
+int ugen_getthreads(void)
+{
+    return (dsppool_nthreads);
+}
+
+void glob_dspthreads(void *dummy, t_floatarg f)
+{
+    ugen_setthreads(f);
+    logpost(NULL, PD_VERBOSE, "DSP threads: %d", dsppool_nthreads);
+}
+
+/* ------------------------- DSP profiling ------------------------------ */
+
+/* When profiling is on ("pd dsp-profile 1") the DSP chain for each object
+is bracketed by calls to profile_begin() and profile_end(), which read the
+processor's cycle counter and add the difference to the object's record.
+Subpatches and clones get records too, which then include the time spent
+in everything inside them; so do root canvases.  To keep the overhead low
+only one tick in PROFILEPERIOD is actually measured.  Records are kept
+across resorting, by object, until profiling is turned off. */
+
+#define PROFILEHASH 1024
+#define PROFILEHASHOF(obj) ((int)(((size_t)(obj) >> 4) & (PROFILEHASH-1)))
+
+typedef struct _profrec
+{
+    struct _profrec *r_next;    /* next in hash bucket */
+    t_object *r_obj;            /* object, subpatch, or root canvas */
+    struct _profrec *r_parent;  /* record of what contains it, if any */
+    int r_sortno;               /* last DSP sorting we were in */
+    unsigned long long r_start; /* counter at beginning of this tick */
+    unsigned long long r_total; /* total counts measured */
+    int r_rt[RT_NKIND];         /* real-time safety violations */
+} t_profrec;
+
+static t_int *profile_begin(t_int *w)
+{
+    t_profrec *x = (t_profrec *)(w[1]);
+    if (!(THIS->u_phase & (PROFILEPERIOD-1)))
+        x->r_start = PROFILE_NOW();
+    rtcheck_current = x;
+    return (w+2);
+}
+
+static t_int *profile_end(t_int *w)
+{
+    t_profrec *x = (t_profrec *)(w[1]);
+    if (!(THIS->u_phase & (PROFILEPERIOD-1)))
+        x->r_total += PROFILE_NOW() - x->r_start;
+    rtcheck_current = x->r_parent;
+    return (w+2);
+}
+
+    /* find or make the record for an object and put the first marker in
+    the chain.  Returns 0 if we aren't profiling. */
+static t_profrec *profile_enter(t_object *obj)
+{
+    t_profrec *x;
+    int hash;
+    if (!THIS->u_profile)
+        return (0);
+    hash = PROFILEHASHOF(obj);
+    for (x = THIS->u_profile[hash]; x; x = x->r_next)
+        if (x->r_obj == obj)
+            break;
+    if (!x)
+    {
+        x = (t_profrec *)getbytes(sizeof(*x));
+        x->r_obj = obj;
+        x->r_next = THIS->u_profile[hash];
+        THIS->u_profile[hash] = x;
+    }
+        /* if the object wasn't in the last DSP chain, it's either new or
+        another one at the same address; start counting over. */
+    else if (x->r_sortno < THIS->u_sortno - 1)
+    {
+        x->r_total = 0;
+        memset(x->r_rt, 0, sizeof(x->r_rt));
+    }
+    x->r_sortno = THIS->u_sortno;
+    x->r_parent = THIS->u_profparent;
+    THIS->u_profparent = x;
+    dsp_add(profile_begin, 1, x);
+    return (x);
+}
+
+static void profile_exit(t_profrec *x)
+{
+    if (x)
+    {
+        dsp_add(profile_end, 1, x);
+        THIS->u_profparent = x->r_parent;
+    }
+}
+
+    /* for g_canvas.c to bracket root canvases with (which also tells
+    "dsp-graph" which one is being scheduled) */
+void *ugen_profilebegin(t_object *x)
+{
+    graph_setroot(x);
+    return (profile_enter(x));
+}
+
+void ugen_profileend(void *z)
+{
+    profile_exit((t_profrec *)z);
+}
+
+static void profile_free(void)
+{
+    int i;
+    t_profrec *x;
+    if (!THIS->u_profile)
+        return;
+    for (i = 0; i < PROFILEHASH; i++)
+        while ((x = THIS->u_profile[i]))
+    {
+        THIS->u_profile[i] = x->r_next;
+        freebytes(x, sizeof(*x));
+    }
+    freebytes(THIS->u_profile, PROFILEHASH * sizeof(*THIS->u_profile));
+    THIS->u_profile = 0;
+}
+
+    /* turn profiling on or off.  Turning it on also resets the counts. */
+void ugen_setprofile(int onoff)
+{
+    profile_free();
+    THIS->u_rtcheck = THIS->u_rtprofile = 0;
+    if (onoff)
+    {
+        THIS->u_profile = (t_profrec **)getbytes(PROFILEHASH *
+            sizeof(*THIS->u_profile));
+        THIS->u_profnticks = 0;
+        THIS->u_profstart = PROFILE_NOW();
+        THIS->u_profstarttime = sys_getrealtime();
+    }
+    THIS->u_profparent = 0;
+    canvas_update_dsp();
+}
+
+    /* find an object's record if it was in the current DSP chain */
+static t_profrec *profile_find(t_object *obj)
+{
+    t_profrec *x;
+    if (!THIS->u_profile)
+        return (0);
+    for (x = THIS->u_profile[PROFILEHASHOF(obj)]; x; x = x->r_next)
+        if (x->r_obj == obj)
+            return (x->r_sortno == THIS->u_sortno ? x : 0);
+    return (0);
+}
+
+    /* factor to convert a record's total count to microseconds per DSP
+    tick, or 0 if nothing has been measured yet */
+static double profile_usecpercount(void)
+{
+    double elapsed;
+    if (!THIS->u_profile || !THIS->u_profnticks ||
+        (elapsed = sys_getrealtime() - THIS->u_profstarttime) <= 0)
+            return (0);
+    return (1e6 * elapsed / ((double)(PROFILE_NOW() - THIS->u_profstart) *
+        THIS->u_profnticks));
+}
+
+static int profile_compare(const void *a, const void *b)
+{
+    const t_profrec *x = *(t_profrec **)a, *y = *(t_profrec **)b;
+    return (x->r_total < y->r_total ? 1 : (x->r_total > y->r_total ? -1 : 0));
+}
+
+static const char *profile_name(t_object *x)
+{
+    if (pd_class(&x->ob_pd) == canvas_class)
+        return (((t_glist *)x)->gl_name->s_name);
+    else return (class_getname(pd_class(&x->ob_pd)));
+}
+
+    /* report the profile, most expensive first, by calling "fn" for each
+    object in the current DSP chain with its name, the name of the object
+    containing it (or an empty string if none), its share of the CPU time,
+    and the average time it took per DSP tick, in microseconds.  Returns the
+    number of records reported, or -1 if we aren't profiling. */
+int ugen_getprofile(t_profilefn fn, void *data)
+{
+    t_profrec *x, **vec;
+    int i, n = 0;
+    double usecpercount, tickusec;
+    if (!THIS->u_profile)
+        return (-1);
+    for (i = 0; i < PROFILEHASH; i++)
+        for (x = THIS->u_profile[i]; x; x = x->r_next)
+            if (x->r_sortno == THIS->u_sortno)
+                n++;
+    if (!n || (usecpercount = profile_usecpercount()) <= 0)
+        return (0);
+    tickusec = 1e6 * DEFDACBLKSIZE / sys_getsr();
+    vec = (t_profrec **)getbytes(n * sizeof(*vec));
+    for (i = n = 0; i < PROFILEHASH; i++)
+        for (x = THIS->u_profile[i]; x; x = x->r_next)
+            if (x->r_sortno == THIS->u_sortno)
+                vec[n++] = x;
+    qsort(vec, n, sizeof(*vec), profile_compare);
+    for (i = 0; i < n; i++)
+    {
+        double usec = usecpercount * (double)vec[i]->r_total;
+        (*fn)(data, profile_name(vec[i]->r_obj),
+            (vec[i]->r_parent ? profile_name(vec[i]->r_parent->r_obj) : ""),
+                usec / tickusec, usec);
+    }
+    freebytes(vec, n * sizeof(*vec));
+    return (n);
+}
+
+typedef struct _profileprint
+{
+    int p_count;
+    int p_max;
+} t_profileprint;
+
+static void profile_print(void *z, const char *name, const char *owner,
+    double load, double usec)
+{
+    t_profileprint *x = (t_profileprint *)z;
+    if (x->p_count++ < x->p_max)
+        post("%6.2f%% %9.2f usec  %s%s%s", 100. * load, usec, name,
+            (*owner ? " in " : ""), owner);
+}
+
+    /* "pd dsp-profile 1" or "0" turns profiling on or off; "pd dsp-profile
+    print [n]" prints the n (default 20) most expensive objects. */
+void glob_dspprofile(void *dummy, t_symbol *s, int argc, t_atom *argv)
+{
+    if (argc && argv->a_type == A_SYMBOL &&
+        !strcmp(argv->a_w.w_symbol->s_name, "print"))
+    {
+        t_profileprint p;
+        p.p_count = 0;
+        p.p_max = (argc > 1 ? atom_getfloatarg(1, argc, argv) : 20);
+        if (ugen_getprofile(profile_print, &p) < 0)
+            post("dsp-profile: profiling is off");
+        else if (p.p_count > p.p_max)
+            post("... (%d more)", p.p_count - p.p_max);
+    }
+    else if (argc)
+        ugen_setprofile(atom_getfloatarg(0, argc, argv) != 0);
+    else post("dsp-profile: profiling is %s",
+        (THIS->u_profile ? "on" : "off"));
+}
+
+/* ------------------- real-time safety checking ------------------------ */
+
+/* "pd rt-check 1" counts calls that might block the audio thread --
+allocating memory with getbytes() or resizebytes(), sys_lock(), and opening
+files with sys_open() or sys_fopen() -- made while the DSP chain is running,
+and charges each one to the object whose DSP code made it, using the markers
+that profiling puts in the chain (so it turns profiling on, and off again
+with "pd rt-check 0" unless it was already on.)  Calls from
+other threads, or that bypass Pd's API, aren't seen.  "pd rt-check print"
+reports the results by class.
+
+Each thread running the chain -- the scheduler and any DSP threads -- has
+its own region flag and current record, and counts into its own log, which
+is added into the records with the pool locked at the end of each task and
+of the tick. */
+
+    /* nonzero while this thread runs the checked chain */
+PD_THREADLOCAL int ugen_rtregion;
+
+#define RTLOGSIZE 16    /* objects per log; more count as unknown */
+
+typedef struct _rtlog
+{
+    int l_n;
+    t_profrec *l_rec[RTLOGSIZE];
+    int l_rt[RTLOGSIZE][RT_NKIND];
+    int l_unknown[RT_NKIND];    /* not charged to anyone */
+} t_rtlog;
+
+static PD_THREADLOCAL t_rtlog rtcheck_log;
+
+static void rtcheck_begin(void)
+{
+    ugen_rtregion = 1;
+    rtcheck_current = 0;
+}
+
+    /* at the end of the tick; DSP threads have flushed their logs already */
+static void rtcheck_end(void)
+{
+    ugen_rtregion = 0;
+    pthread_mutex_lock(&dsppool_mutex);
+    rtcheck_flush();
+    pthread_mutex_unlock(&dsppool_mutex);
+}
+
+    /* called from the hooks in m_memory.c, s_inter.c and s_path.c, only
+    on a thread that is running the chain */
+void ugen_rtviolation(int kind)
+{
+    t_rtlog *l = &rtcheck_log;
+    int i;
+    if (rtcheck_current)
+    {
+        for (i = 0; i < l->l_n; i++)
+            if (l->l_rec[i] == rtcheck_current)
+        {
+            l->l_rt[i][kind]++;
+            return;
+        }
+        if (l->l_n < RTLOGSIZE)
+        {
+            l->l_rec[i] = rtcheck_current;
+            memset(l->l_rt[i], 0, sizeof(l->l_rt[i]));
+            l->l_rt[i][kind] = 1;
+            l->l_n++;
+            return;
+        }
+    }
+    l->l_unknown[kind]++;
+}
+
+    /* add this thread's log into the records; call with the pool locked */
+static void rtcheck_flush(void)
+{
+    t_rtlog *l = &rtcheck_log;
+    int i, k;
+    for (i = 0; i < l->l_n; i++)
+        for (k = 0; k < RT_NKIND; k++)
+            l->l_rec[i]->r_rt[k] += l->l_rt[i][k];
+    for (k = 0; k < RT_NKIND; k++)
+        THIS->u_rtunknown[k] += l->l_unknown[k], l->l_unknown[k] = 0;
+    l->l_n = 0;
+}
+
+typedef struct _rtclass
+{
+    const char *c_name;
+    int c_nobj;
+    int c_rt[RT_NKIND];
+    int c_total;
+} t_rtclass;
+
+static int rtclass_compare(const void *a, const void *b)
+{
+    const t_rtclass *x = (const t_rtclass *)a, *y = (const t_rtclass *)b;
+    return (x->c_total < y->c_total ? 1 : (x->c_total > y->c_total ? -1 :
+        strcmp(x->c_name, y->c_name)));
+}
+
+static void rtcheck_print(void)
+{
+    t_profrec *x;
+    t_rtclass *vec;
+    int i, j, k, n = 0, nclass = 0;
+    if (!THIS->u_rtcheck)
+    {
+        post("rt-check: checking is off");
+        return;
+    }
+    for (i = 0; i < PROFILEHASH; i++)
+        for (x = THIS->u_profile[i]; x; x = x->r_next)
+            n++;
+    vec = (t_rtclass *)getbytes((n + 1) * sizeof(*vec));
+    for (i = 0; i < PROFILEHASH; i++)
+        for (x = THIS->u_profile[i]; x; x = x->r_next)
+    {
+        const char *name = profile_name(x->r_obj);
+        int total = 0;
+        for (k = 0; k < RT_NKIND; k++)
+            total += x->r_rt[k];
+        if (!total)
+            continue;
+        for (j = 0; j < nclass; j++)
+            if (!strcmp(vec[j].c_name, name))
+                break;
+        if (j == nclass)
+            vec[nclass++].c_name = name;
+        vec[j].c_nobj++;
+        for (k = 0; k < RT_NKIND; k++)
+            vec[j].c_rt[k] += x->r_rt[k];
+        vec[j].c_total += total;
+    }
+    for (k = 0; k < RT_NKIND; k++)
+        vec[nclass].c_total += vec[nclass].c_rt[k] = THIS->u_rtunknown[k];
+    if (vec[nclass].c_total)
+    {
+        vec[nclass].c_name = "(unknown)";
+        nclass++;
+    }
+    if (!nclass)
+        post("rt-check: no blocking calls seen");
+    qsort(vec, nclass, sizeof(*vec), rtclass_compare);
+    for (j = 0; j < nclass; j++)
+        post("rt-check: %s (%d object%s): %d allocation(s), %d lock(s), "
+            "%d file open(s)", vec[j].c_name, vec[j].c_nobj,
+                (vec[j].c_nobj == 1 ? "" : "s"), vec[j].c_rt[RT_ALLOC],
+                    vec[j].c_rt[RT_LOCK], vec[j].c_rt[RT_OPEN]);
+    freebytes(vec, (n + 1) * sizeof(*vec));
+}
+
+    /* "pd rt-check 1" or "0" turns checking on or off, resetting the counts;
+    "pd rt-check print" reports them. */
+void glob_rtcheck(void *dummy, t_symbol *s, int argc, t_atom *argv)
+{
+    if (argc && argv->a_type == A_SYMBOL &&
+        !strcmp(argv->a_w.w_symbol->s_name, "print"))
+            rtcheck_print();
+    else if (argc)
+    {
+        int onoff = (atom_getfloatarg(0, argc, argv) != 0);
+        if (onoff)
+        {
+            int ours = (!THIS->u_profile || THIS->u_rtprofile);
+            ugen_setprofile(1);
+            memset(THIS->u_rtunknown, 0, sizeof(THIS->u_rtunknown));
+            THIS->u_rtprofile = ours;
+        }
+            /* stop profiling too unless it was on before checking began */
+        else if (THIS->u_rtcheck && THIS->u_rtprofile)
+            ugen_setprofile(0);
+        THIS->u_rtcheck = onoff;
+    }
+    else post("rt-check: checking is %s", (THIS->u_rtcheck ? "on" : "off"));
+}
+
+/* ---------------- signals ---------------------------- */
+
+int ilog2(int n)
+{
+    int r = -1;
+    if (n <= 0) return(0);
+    while (n)
+    {
+        r++;
+        n >>= 1;
+    }
+    return (r);
+}
+
+
+/* Signal buffers aren't allocated one by one but are cut out of large
+"arena" blocks, in the order the DSP graph first asks for them, so that the
+DSP chain walks through memory more or less in sequence.  Each buffer is
+aligned to SIGARENAALIGN bytes (the size of a cache line, and also enough
+for any vector instruction set.)  Buffers are never given back to the arena;
+they go on the free lists as before, and the arena is freed all at once
+when DSP stops. */
+
+#define SIGARENASIZE 65536      /* default size of an arena block in bytes */
+#define SIGARENAALIGN 64
+
+typedef struct _sigarena
+{
+    struct _sigarena *a_next;
+    size_t a_size;          /* allocated size of block */
+    char *a_fill;           /* next free (aligned) byte */
+    char *a_end;            /* end of usable space */
+} t_sigarena;
+
+static t_sample *sigarena_get(int vecsize)
+{
+    size_t nbytes = (vecsize * sizeof(t_sample) + (SIGARENAALIGN-1)) &
+        ~(size_t)(SIGARENAALIGN-1);
+    t_sigarena *a = THIS->u_arena;
+    t_sample *ret;
+    if (!a || a->a_end - a->a_fill < (ptrdiff_t)nbytes)
+    {
+            /* with huge pages, make the blocks just big enough to get them */
+        size_t overhead = sizeof(t_sigarena) + SIGARENAALIGN,
+            blocksize = (mem_gethugepages() > SIGARENASIZE + overhead ?
+                mem_gethugepages() - overhead : SIGARENASIZE),
+            size = overhead + (nbytes > blocksize ? nbytes : blocksize);
+            /* the arena is shared; signal_new() charges its buffers to
+            their owners for "pd memory-report" */
+        int kind = mem_setkind(MEM_UNTRACKED);
+        a = (t_sigarena *)getbytes(size);
+        mem_setkind(kind);
+        a->a_size = size;
+        a->a_fill = (char *)(((size_t)(a + 1) + (SIGARENAALIGN-1)) &
+            ~(size_t)(SIGARENAALIGN-1));
+        a->a_end = (char *)a + size;
+        a->a_next = THIS->u_arena;
+        THIS->u_arena = a;
+    }
+    ret = (t_sample *)a->a_fill;
+    a->a_fill += nbytes;
+    return (ret);
+}
+
+static void sigarena_free(void)
+{
+    t_sigarena *a;
+    while ((a = THIS->u_arena))
+    {
+        THIS->u_arena = a->a_next;
+        freebytes(a, a->a_size);
+    }
+}
+
+    /* a signal's buffer holds "nchans" vectors of "vecsize" points one
+    after the other, rounded up to a power of two; this is the log of that,
+    which is also the free list it goes on. */
+static int signal_logsize(int vecsize, int nchans)
+{
+    int total = vecsize * nchans, logn = ilog2(total);
+    if ((1<<logn) != total)
+        logn++;
+    return (logn);
+}
+
+    /* call this when DSP is stopped to free all the signals */
+static void signal_cleanup(void)
+{
+    t_signal *sig;
+    int i;
+    while ((sig = THIS->u_signals))
+    {
+        THIS->u_signals = sig->s_nextused;
+        t_freebytes(sig, sizeof *sig);
+    }
+    sigarena_free();
+    if (mem_accounting)
+        mem_unchargeall(MEM_SIGNAL);
+    for (i = 0; i <= MAXLOGSIG; i++)
+        THIS->u_freelist[i] = THIS->u_sparelist[i] = 0;
+    THIS->u_freeborrowed = THIS->u_spareborrowed = 0;
+    THIS->u_pendingreuse = 0;
+    THIS->u_deferreuse = 0;
+}
+
+    /* when the DSP chain is only being resorted, keep all the signals
+    around as "spares" instead of freeing them, so the new chain doesn't
+    have to allocate (and zero) its buffers all over again.  These are
+    kept apart from the free lists, which are searched each time a signal
+    is made reusable. */
+static void signal_recycle(void)
+{
+    t_signal *sig;
+    int i;
+    for (i = 0; i <= MAXLOGSIG; i++)
+        THIS->u_freelist[i] = THIS->u_sparelist[i] = 0;
+    THIS->u_freeborrowed = THIS->u_spareborrowed = 0;
+        /* the new chain charges signals again as it takes them */
+    if (mem_accounting)
+        mem_unchargeall(MEM_SIGNAL);
+    for (sig = THIS->u_signals; sig; sig = sig->s_nextused)
+    {
+        if (sig->s_isborrowed)
+        {
+            sig->s_nextfree = THIS->u_spareborrowed;
+            THIS->u_spareborrowed = sig;
+        }
+        else
+        {
+            int logn = signal_logsize(sig->s_vecsize, sig->s_nchans);
+            sig->s_nextfree = THIS->u_sparelist[logn];
+            THIS->u_sparelist[logn] = sig;
+        }
+    }
+    THIS->u_pendingreuse = 0;
+    THIS->u_deferreuse = 0;
+}
+
+    /* mark the signal "reusable."  Inside a parallel section we hold
+    off until the section is closed (see ugen_endsection()). */
+void signal_makereusable(t_signal *sig)
+{
+    if (THIS->u_deferreuse)
+    {
+        sig->s_nextfree = THIS->u_pendingreuse;
+        THIS->u_pendingreuse = sig;
+    }
+    else signal_makereusable_now(sig);
+}
+
+static void signal_makereusable_now(t_signal *sig)
+{
+    int logn = signal_logsize(sig->s_vecsize, sig->s_nchans);
+#if 1
+    t_signal *s5;
+    for (s5 = THIS->u_freeborrowed; s5; s5 = s5->s_nextfree)
+    {
+        if (s5 == sig)
+        {
+            bug("signal_free 3");
+            return;
+        }
+    }
+    for (s5 = THIS->u_freelist[logn]; s5; s5 = s5->s_nextfree)
+    {
+        if (s5 == sig)
+        {
+            bug("signal_free 4");
+            return;
+        }
+    }
+#endif
+    if (THIS->u_loud) post("free %lx: %d", sig, sig->s_isborrowed);
+    if (sig->s_isborrowed)
+    {
+            /* if the signal is borrowed, decrement the borrowed-from signal's
+                reference count, possibly marking it reusable too */
+        t_signal *s2 = sig->s_borrowedfrom;
+        if ((s2 == sig) || !s2)
+            bug("signal_free");
+        s2->s_refcount--;
+        if (!s2->s_refcount)
+            signal_makereusable_now(s2);
+        sig->s_nextfree = THIS->u_freeborrowed;
+        THIS->u_freeborrowed = sig;
+    }
+    else
+    {
+            /* if it's a real signal (not borrowed), put it on the free list
+                so we can reuse it. */
+        if (THIS->u_freelist[logn] == sig) bug("signal_free 2");
+        sig->s_nextfree = THIS->u_freelist[logn];
+        THIS->u_freelist[logn] = sig;
+    }
+}
+
+    /* reclaim or make an audio signal of "nchans" channels.  If n is zero,
+    return a "borrowed" signal whose buffer and size will be obtained later
+    via signal_setborrowed(). */
+
+static t_signal *signal_new(int n, int nchans, t_float sr)
+{
+    int logn, vecsize = 0;
+    t_signal *ret, **whichlist, **sparelist;
+    logn = ilog2(n);
+    if (n)
+    {
+        if ((vecsize = (1<<logn)) != n)
+            vecsize *= 2;
+        logn = signal_logsize(vecsize, nchans);
+        if (logn > MAXLOGSIG)
+            bug("signal buffer too large");
+        whichlist = THIS->u_freelist + logn;
+        sparelist = THIS->u_sparelist + logn;
+    }
+    else
+    {
+        whichlist = &THIS->u_freeborrowed;
+        sparelist = &THIS->u_spareborrowed;
+    }
+
+        /* first try to reclaim one from the free list, then from the
+        old chain's leftovers */
+    if ((ret = *whichlist))
+        *whichlist = ret->s_nextfree;
+    else if ((ret = *sparelist))
+    {
+        *sparelist = ret->s_nextfree;
+        if (mem_accounting)
+            mem_charge(MEM_SIGNAL, sizeof(*ret) +
+                (n ? (1<<logn) * sizeof(t_sample) : 0));
+    }
+    else
+    {
+            /* LATER figure out what to do for out-of-space here! */
+        int kind = mem_setkind(MEM_UNTRACKED);
+        ret = (t_signal *)t_getbytes(sizeof *ret);
+        mem_setkind(kind);
+        if (mem_accounting)
+            mem_charge(MEM_SIGNAL, sizeof(*ret) +
+                (n ? (1<<logn) * sizeof(t_sample) : 0));
+        if (n)
+        {
+            ret->s_vec = sigarena_get(1<<logn);
+            ret->s_isborrowed = 0;
+        }
+        else
+        {
+            ret->s_vec = 0;
+            ret->s_isborrowed = 1;
+        }
+        ret->s_nextused = THIS->u_signals;
+        THIS->u_signals = ret;
+    }
+    ret->s_n = n;
+    ret->s_vecsize = vecsize;
+    ret->s_nchans = nchans;
+    ret->s_sr = sr;
+    ret->s_refcount = 0;
+    ret->s_borrowedfrom = 0;
+    ret->s_scalar = 0;
+    ret->s_blockrate = 0;
+    if (THIS->u_loud) post("new %lx: %lx", ret, ret->s_vec);
+    return (ret);
+}
+
+static t_signal *signal_newlike(const t_signal *sig)
+{
+    return (signal_new(sig->s_n, sig->s_nchans, sig->s_sr));
+}
+
+    /* called from an object's "dsp" method to have an output signal borrow
+    a buffer that lives outside the signal system, such as adc~'s audio
+    input, instead of copying it into one.  The buffer must hold the
+    signal's channels and stay put until the DSP chain is sorted again.
+    Since the new signal is "borrowed," nobody writes into it in place. */
+void signal_setexternal(t_signal **sig, t_sample *vec)
+{
+    t_signal *s1 = *sig, *s2;
+    if (s1->s_isborrowed)
+    {
+        bug("signal_setexternal");
+        return;
+    }
+    s2 = signal_new(0, s1->s_nchans, s1->s_sr);
+    s2->s_borrowedfrom = &THIS->u_external;
+    THIS->u_external.s_refcount++;
+    s2->s_vec = vec;
+    s2->s_n = s1->s_n;
+    s2->s_vecsize = s1->s_vecsize;
+    s2->s_refcount = s1->s_refcount;
+    s1->s_refcount = 0;
+    signal_makereusable(s1);
+    *sig = s2;
+    if (THIS->u_loud) post("set external %lx: %lx", s2, vec);
+}
+
+    /* called from an object's "dsp" method to give an output signal a
+    different number of channels than the one it was made with.  Nobody can have looked at the output yet, so we just trade it in
+    for a new one. */
+void signal_setmultiout(t_signal **sig, int nchans)
+{
+    t_signal *s1 = *sig, *s2;
+    if (nchans < 1)
+        nchans = 1;
+    if (s1->s_nchans == nchans)
+        return;
+    if (s1->s_isborrowed)
+    {
+        bug("signal_setmultiout");
+        return;
+    }
+    s2 = signal_new(s1->s_n, nchans, s1->s_sr);
+    s2->s_refcount = s1->s_refcount;
+    s1->s_refcount = 0;
+    signal_makereusable(s1);
+    *sig = s2;
+}
+
+    /* called from an object's "dsp" method to make an output a block-rate
+signal: one whose value, each block, is a constant or a straight line, as
+for sig~ or line~ with slow ramps.  Its perform routine then fills in "b"
+rather than the signal's vector; only in blocks where that can't describe
+the output (a value changing in mid-block, say) does it write the vector
+out and set b_vec.  Objects whose class was given class_setblockratein()
+read "b" directly, saving a pass over memory on both sides.  If any other
+object (or a sum of several connections) takes the signal, ugen_doit()
+adds a call to fill in the vector each block as before. */
+void signal_setblockrate(t_signal *sig, t_blockrate *b)
+{
+    if (sig->s_isborrowed || sig->s_nchans != 1)
+    {
+        bug("signal_setblockrate");
+        return;
+    }
+    sig->s_blockrate = b;
+}
+
+void signal_setborrowed(t_signal *sig, t_signal *sig2)
+{
+    if (!sig->s_isborrowed || sig->s_borrowedfrom)
+        bug("signal_setborrowed");
+    if (sig == sig2)
+        bug("signal_setborrowed 2");
     sig->s_borrowedfrom = sig2;
     sig->s_vec = sig2->s_vec;
     sig->s_n = sig2->s_n;
     sig->s_vecsize = sig2->s_vecsize;
+    sig->s_nchans = sig2->s_nchans;
     if (THIS->u_loud) post("set borrowed %lx: %lx", sig, sig->s_vec);
 }
 
-static int signal_compatible(t_signal *s1, t_signal *s2)
+static int signal_compatible(t_signal *s1, t_signal *s2)
+{
+    return (s1->s_n == s2->s_n && s1->s_sr == s2->s_sr);
+}
+
+/* ------------------ ugen ("unit generator") sorting ----------------- */
+
+typedef struct _ugenbox
+{
+    struct _siginlet *u_in;
+    int u_nin;
+    struct _sigoutlet *u_out;
+    int u_nout;
+    int u_phase;
+    struct _ugenbox *u_next;
+    t_object *u_obj;
+    int u_done;
+    int u_nprod;                /* number of connections into us */
+    struct _ugenbox **u_prod;   /* their sources, for ugen_pull() */
+    int u_graphid;              /* index for "dsp-graph" or -1 */
+    int u_index;                /* order added, for templates */
+} t_ugenbox;
+
+    /* most signals summed into an inlet at once; see ugen_sumfanin() */
+#define MAXFANIN 16
+
+typedef struct _siginlet
+{
+    int i_nconnect;
+    int i_ngot;
+    t_signal *i_signal;
+    int i_nfanin;                       /* signals waiting to be added */
+    t_signal *i_fanin[MAXFANIN - 1];    /* ... to i_signal */
+} t_siginlet;
+
+typedef struct _sigoutconnect
+{
+    t_ugenbox *oc_who;
+    int oc_inno;
+    struct _sigoutconnect *oc_next;
+} t_sigoutconnect;
+
+typedef struct _sigoutlet
+{
+    int o_nconnect;
+    int o_nsent;
+    t_signal *o_signal;
+    t_sigoutconnect *o_connections;
+} t_sigoutlet;
+
+
+struct _dspcontext
+{
+    struct _ugenbox *dc_ugenlist;
+    struct _dspcontext *dc_parentcontext;
+    int dc_ninlets;
+    int dc_noutlets;
+    t_signal **dc_iosigs;
+    t_float dc_srate;
+    int dc_vecsize;         /* vector size, power of two */
+    int dc_calcsize;        /* number of elements to calculate */
+    char dc_toplevel;       /* true if "iosigs" is invalid. */
+    char dc_reblock;        /* true if we have to reblock inlets/outlets */
+    char dc_switched;       /* true if we're switched */
+    char dc_presorted;      /* true if ugen_doit() shouldn't recurse */
+    char dc_fromtemplate;   /* true if made from a template (see below) */
+    int dc_graphid;         /* index for "dsp-graph" or -1 */
+    int dc_nugen;           /* number of ugens added */
+    t_glist *dc_maketemplate;   /* canvas to make a template of, if any */
+    struct _dspconn *dc_conn;   /* its connections, as they're made */
+    int dc_nconn;
+    int dc_connsize;
+    int *dc_order;          /* order ugens are scheduled in */
+    int dc_norder;
+    void *dc_block;         /* ugens made in one piece from a template */
+    size_t dc_blocksize;
+};
+
+#define t_dspcontext struct _dspcontext
+
+    /* get a new signal for the current context - used by clone~ object */
+t_signal *signal_newfromcontext(int borrowed)
+{
+    return (signal_new((borrowed? 0 : THIS->u_context->dc_calcsize), 1,
+        THIS->u_context->dc_srate));
+}
+
+    /* get the current context's sample rate and vector sizes, so that
+    clone can later schedule copies just as they would have been here */
+void signal_getcontext(t_float *srate, int *vecsize, int *calcsize)
+{
+    *srate = THIS->u_context->dc_srate;
+    *vecsize = THIS->u_context->dc_vecsize;
+    *calcsize = THIS->u_context->dc_calcsize;
+}
+
+/* ------------- chains built apart from the DSP chain ---------------- */
+
+/* While DSP is running, a subpatch can be scheduled on a chain of its own
+without resorting everything; clone does this for copies it adds, and runs
+the chain from its own place in the DSP chain.  The subpatch is scheduled
+as if its parent had the given sample rate and vector sizes.  Signal inputs
+to it are made with ugen_subchaininput() from buffers that the caller knows
+to be valid when the chain is run.
+
+Whatever is free in the DSP chain's signal lists might be in use where
+the new chain will be run, so these are set aside and the new chain gets
+fresh signals.  Those are left off the free lists afterward and are only
+reused the next time the DSP chain is sorted, at which point the caller
+must stop running the separate chain.
+
+If "vecsize" is zero there's no parent; the chain is for a root canvas,
+which can then be run at the end of the DSP chain with
+ugen_appendsubchain(). */
+
+typedef struct _subchain
+{
+    t_int *s_dspchain;          /* the DSP chain, set aside */
+    int s_dspchainsize;
+    int *s_entries;
+    int s_nentries;
+    int s_entriessize;
+    t_signal *s_freelist[MAXLOGSIG+1];
+    t_signal *s_sparelist[MAXLOGSIG+1];
+    t_signal *s_freeborrowed;
+    t_signal *s_spareborrowed;
+    t_signal *s_inputs;         /* signals made by ugen_subchaininput() */
+} t_subchain;
+
+void *ugen_beginsubchain(t_float srate, int vecsize, int calcsize)
+{
+    t_subchain *x = (t_subchain *)getbytes(sizeof(*x));
+    int i;
+    x->s_dspchain = THIS->u_dspchain;
+    x->s_dspchainsize = THIS->u_dspchainsize;
+    x->s_entries = THIS->u_entries;
+    x->s_nentries = THIS->u_nentries;
+    x->s_entriessize = THIS->u_entriessize;
+    for (i = 0; i <= MAXLOGSIG; i++)
+    {
+        x->s_freelist[i] = THIS->u_freelist[i];
+        x->s_sparelist[i] = THIS->u_sparelist[i];
+        THIS->u_freelist[i] = THIS->u_sparelist[i] = 0;
+    }
+    x->s_freeborrowed = THIS->u_freeborrowed;
+    x->s_spareborrowed = THIS->u_spareborrowed;
+    THIS->u_freeborrowed = THIS->u_spareborrowed = 0;
+    x->s_inputs = 0;
+    THIS->u_entries = 0;
+    THIS->u_nentries = THIS->u_entriessize = 0;
+    THIS->u_dspchain = (t_int *)getbytes(sizeof(*THIS->u_dspchain));
+    THIS->u_dspchain[0] = (t_int)dsp_done;
+    THIS->u_dspchainsize = 1;
+        /* don't fuse or merge with calls on the DSP chain */
+    if (THIS->u_pointwise)
+        THIS->u_pointwise->p_nop = 0;
+    if (THIS->u_batch)
+        THIS->u_batch->b_count = 0;
+    THIS->u_profparent = 0;
+    if (THIS->u_context) bug("ugen_beginsubchain");
+    if (vecsize)
+    {
+            /* stand-in for the parent's context */
+        t_dspcontext *dc = (t_dspcontext *)getbytes(sizeof(*dc));
+        dc->dc_srate = srate;
+        dc->dc_vecsize = vecsize;
+        dc->dc_calcsize = calcsize;
+        dc->dc_toplevel = 1;
+        THIS->u_context = dc;
+    }
+    return (x);
+}
+
+    /* make a signal input for the subpatch from a buffer that will hold
+    it when the chain is run.  It is never reused. */
+t_signal *ugen_subchaininput(void *z, t_sample *vec, int n, int nchans)
+{
+    t_subchain *x = (t_subchain *)z;
+    t_signal *sig = (t_signal *)getbytes(sizeof(*sig));
+    sig->s_vec = vec;
+    sig->s_n = n;
+    if ((sig->s_vecsize = (1 << ilog2(n))) < n)
+        sig->s_vecsize *= 2;
+    sig->s_nchans = nchans;
+    sig->s_sr = THIS->u_context->dc_srate;
+    sig->s_refcount = 0x40000000;
+    sig->s_isborrowed = 0;
+    sig->s_nextused = x->s_inputs;
+    x->s_inputs = sig;
+    return (sig);
+}
+
+    /* finish the chain and return it; the caller owns it and should free
+    it with ugen_freesubchain().  The DSP chain is put back as it was. */
+t_int *ugen_endsubchain(void *z, int *sizep)
+{
+    t_subchain *x = (t_subchain *)z;
+    t_int *chain = THIS->u_dspchain;
+    t_signal *sig;
+    int i;
+    *sizep = THIS->u_dspchainsize;
+    if (THIS->u_context)
+        freebytes(THIS->u_context, sizeof(*THIS->u_context));
+    THIS->u_context = 0;
+    if (THIS->u_entriessize)
+        freebytes(THIS->u_entries, THIS->u_entriessize * sizeof(int));
+    THIS->u_dspchain = x->s_dspchain;
+    THIS->u_dspchainsize = x->s_dspchainsize;
+    THIS->u_entries = x->s_entries;
+    THIS->u_nentries = x->s_nentries;
+    THIS->u_entriessize = x->s_entriessize;
+    for (i = 0; i <= MAXLOGSIG; i++)
+    {
+        THIS->u_freelist[i] = x->s_freelist[i];
+        THIS->u_sparelist[i] = x->s_sparelist[i];
+    }
+    THIS->u_freeborrowed = x->s_freeborrowed;
+    THIS->u_spareborrowed = x->s_spareborrowed;
+    if (THIS->u_pointwise)
+        THIS->u_pointwise->p_nop = 0;
+    if (THIS->u_batch)
+        THIS->u_batch->b_count = 0;
+    while ((sig = x->s_inputs))
+    {
+        x->s_inputs = sig->s_nextused;
+        freebytes(sig, sizeof(*sig));
+    }
+    freebytes(x, sizeof(*x));
+    return (chain);
+}
+
+void ugen_freesubchain(t_int *chain, int size)
+{
+    freebytes(chain, size * sizeof(*chain));
+}
+
+    /* chains of root canvases made since the DSP chain was sorted.  These
+    are run at its end until it is sorted again. */
+typedef struct _appended
+{
+    t_int *a_chain;
+    int a_size;
+    struct _appended *a_next;
+} t_appended;
+
+static t_int *appended_perform(t_int *w)
+{
+    t_int *ip;
+    for (ip = (t_int *)(w[1]); ip; )
+        ip = (*(t_perfroutine)(*ip))(ip);
+    return (w+2);
+}
+
+    /* add a chain from ugen_endsubchain() to the end of the DSP chain,
+    which then owns it. */
+void ugen_appendsubchain(t_int *chain, int size)
+{
+    t_appended *x = (t_appended *)getbytes(sizeof(*x));
+    x->a_chain = chain;
+    x->a_size = size;
+    x->a_next = THIS->u_appended;
+    THIS->u_appended = x;
+    dsp_add(appended_perform, 1, chain);
+}
+
+static void ugen_freeappended(void)
+{
+    t_appended *x;
+    while ((x = THIS->u_appended))
+    {
+        THIS->u_appended = x->a_next;
+        ugen_freesubchain(x->a_chain, x->a_size);
+        freebytes(x, sizeof(*x));
+    }
+}
+
+/* ----------------------- released subpatches ------------------------ */
+
+/* A switch~ given "release 1" doesn't just skip its subpatch while it's
+off, but releases what the contents hold for DSP.  When the DSP chain is
+sorted, such a subpatch puts a stand-in on the chain instead of its
+contents, which thus get no signals, and every object in it with a
+"dsp-release" method is asked to free its DSP memory (delay lines,
+convolution stages, reblocking buffers...)  Switching off resorts the DSP
+chain so that the contents' signals go back to the free lists; switching
+on again doesn't, but schedules the contents on a chain of their own (see
+ugen_beginsubchain() above) for the stand-in to run, with the subpatch's
+inputs and outputs just where they'd have been, until the next sort. */
+
+typedef struct _standinio
+{
+    t_sample *i_vec;
+    int i_n;
+    int i_nchans;
+} t_standinio;
+
+typedef struct _standin
+{
+    int s_sortno;           /* DSP sort we're standing in on, or -1 */
+    int s_building;         /* sorting the contents for s_chain */
+    t_int *s_chain;         /* the contents' own chain once switched on */
+    int s_chainsize;
+    int s_nin;              /* number of signal inlets */
+    int s_nout;             /* ... and outlets */
+    int s_iosize;           /* number allocated in s_io */
+    t_standinio *s_io;      /* the parent's signals, inlets then outlets */
+    t_float s_sr;           /* the parent's sample rate and vector sizes */
+    int s_vecsize;
+    int s_calcsize;
+} t_standin;
+
+static void standin_unchain(t_standin *s)
+{
+    if (s->s_chain)
+        ugen_freesubchain(s->s_chain, s->s_chainsize);
+    s->s_chain = 0;
+}
+
+static void standin_free(t_block *x)
+{
+    t_standin *s = x->x_standin;
+    if (!s)
+        return;
+    standin_unchain(s);
+    if (s->s_io)
+        freebytes(s->s_io, s->s_iosize * sizeof(*s->s_io));
+    freebytes(s, sizeof(*s));
+    x->x_standin = 0;
+}
+
+    /* true if the DSP chain has the stand-in rather than the contents */
+static int standin_released(t_block *x)
+{
+    return (x->x_standin && x->x_standin->s_sortno == THIS->u_sortno);
+}
+
+static t_int *standin_perform(t_int *w)
+{
+    t_standin *s = (t_standin *)(w[1]);
+    t_int *ip;
+    int i;
+    if (s->s_chain)
+        for (ip = s->s_chain; ip; )
+            ip = (*(t_perfroutine)(*ip))(ip);
+    else for (i = s->s_nin; i < s->s_nin + s->s_nout; i++)
+        memset(s->s_io[i].i_vec, 0,
+            s->s_io[i].i_n * s->s_io[i].i_nchans * sizeof(t_sample));
+    return (w+2);
+}
+
+    /* ask everything in a canvas that's no longer sorted to free its
+    DSP memory */
+static void standin_release(t_canvas *gl)
+{
+    t_symbol *s = gensym("dsp-release");
+    t_gobj *y;
+    t_gotfn fn;
+    for (y = gl->gl_list; y; y = y->g_next)
+    {
+        if (pd_class(&y->g_pd) == canvas_class)
+            standin_release((t_canvas *)y);
+        else if ((fn = zgetfn(&y->g_pd, s)))
+            (*(void (*)(t_pd *))fn)(&y->g_pd);
+    }
+}
+
+    /* a switch~ within a released subpatch drops what it had too */
+static void block_dsprelease(t_block *x)
+{
+    if (x->x_standin)
+    {
+        standin_unchain(x->x_standin);
+        x->x_standin->s_sortno = -1;
+    }
+    if (x->x_calls)
+        freebytes(x->x_calls, x->x_callsize * sizeof(*x->x_calls));
+    x->x_calls = 0;
+    x->x_callsize = 0;
+    x->x_ncall = -1;
+    if (x->x_watch)
+        freebytes(x->x_watch, x->x_watchsize * sizeof(*x->x_watch));
+    x->x_watch = 0;
+    x->x_watchsize = x->x_nwatchin = x->x_nwatchout = 0;
+}
+
+void canvas_dodsp(t_canvas *x, int toplevel, t_signal **sp);
+
+    /* schedule the contents on a chain of their own, as clone_schedule()
+    does for a copy added while DSP is running */
+static void standin_makechain(t_block *x)
+{
+    t_standin *s = x->x_standin;
+    int i, nin = s->s_nin, nout = s->s_nout;
+    t_signal **tempio = (t_signal **)getbytes((nin + nout + 1) *
+        sizeof(*tempio));
+    void *z = ugen_beginsubchain(s->s_sr, s->s_vecsize, s->s_calcsize);
+    for (i = 0; i < nin; i++)
+        tempio[i] = ugen_subchaininput(z, s->s_io[i].i_vec, s->s_io[i].i_n,
+            s->s_io[i].i_nchans);
+    for (i = 0; i < nout; i++)
+        tempio[nin + i] = signal_newfromcontext(1);
+    s->s_building = 1;
+    canvas_dodsp(x->x_canvas, 0, tempio);
+    s->s_building = 0;
+    for (i = 0; i < nout; i++)
+    {
+        t_signal *sig = tempio[nin + i];
+        t_standinio *io = &s->s_io[nin + i];
+        dsp_add_copy(sig->s_vec, io->i_vec,
+            (sig->s_n < io->i_n ? sig->s_n : io->i_n));
+        signal_makereusable(sig);
+    }
+    s->s_chain = ugen_endsubchain(z, &s->s_chainsize);
+    freebytes(tempio, (nin + nout + 1) * sizeof(*tempio));
+}
+
+    /* a switch~ in "release" mode was switched on or off */
+static void standin_switch(t_block *x)
+{
+    if (!x->x_switchon)
+        canvas_update_dsp();    /* resorting releases the contents */
+    else if (standin_released(x) && !x->x_standin->s_chain)
+    {
+            /* if DSP isn't running, the chain is sorted when it starts */
+        if (THIS->u_dspchain)
+            standin_makechain(x);
+        else canvas_update_dsp();
+    }
+}
+
+    /* called from canvas_dodsp() for a subpatch.  If its switch~ is off
+    and in "release" mode, release its contents, put the stand-in on the
+    DSP chain in their place, and return 1.  Otherwise return 0 and let the
+    subpatch be sorted as usual. */
+int canvas_standindsp(t_canvas *gl, t_signal **sp)
+{
+    t_gobj *y;
+    t_block *x = 0;
+    t_standin *s;
+    int i, nin, nout;
+    for (y = gl->gl_list; y; y = y->g_next)
+        if (pd_class(&y->g_pd) == block_class)
+    {
+        x = (t_block *)y;
+        break;
+    }
+    if (!x || !THIS->u_context)
+        return (0);
+    if ((s = x->x_standin))
+    {
+        if (s->s_building)
+            return (0);
+        standin_unchain(s);
+        s->s_sortno = -1;
+    }
+    if (!x->x_release || x->x_switchon)
+        return (0);
+    if (!s)
+    {
+        s = x->x_standin = (t_standin *)getbytes(sizeof(*s));
+        s->s_sortno = -1;
+    }
+    nin = obj_nsiginlets(&gl->gl_obj);
+    nout = obj_nsigoutlets(&gl->gl_obj);
+    if (nin + nout > s->s_iosize)
+    {
+        s->s_io = (t_standinio *)resizebytes(s->s_io,
+            s->s_iosize * sizeof(*s->s_io), (nin + nout) * sizeof(*s->s_io));
+        s->s_iosize = nin + nout;
+    }
+    standin_release(gl);
+        /* fill in the outputs as ugen_done_graph() would for a switched
+        subpatch.  The inputs are kept as for a switched one that doesn't
+        reblock, so that they're still valid when the stand-in runs. */
+    for (i = 0; i < nin + nout; i++)
+    {
+        if (i >= nin && sp[i]->s_isborrowed && !sp[i]->s_borrowedfrom)
+        {
+            signal_setborrowed(sp[i], signal_new(
+                THIS->u_context->dc_vecsize, 1, THIS->u_context->dc_srate));
+            sp[i]->s_refcount++;
+        }
+        s->s_io[i].i_vec = sp[i]->s_vec;
+        s->s_io[i].i_n = sp[i]->s_n;
+        s->s_io[i].i_nchans = sp[i]->s_nchans;
+    }
+    s->s_nin = nin;
+    s->s_nout = nout;
+    s->s_sr = THIS->u_context->dc_srate;
+    s->s_vecsize = THIS->u_context->dc_vecsize;
+    s->s_calcsize = THIS->u_context->dc_calcsize;
+    s->s_sortno = THIS->u_sortno;
+    dsp_add(standin_perform, 1, s);
+    return (1);
+}
+
+    /* set the DSP chain aside, keeping its signals, so that it isn't run
+    until ugen_resume() is called.  "pd dsp 0" does this so that "pd dsp 1"
+    needn't sort it all again if nothing has changed.  Starting over with
+    ugen_start() or ugen_restart() frees it as usual. */
+void ugen_pause(void)
+{
+    if (!THIS->u_pausedchain)
+    {
+        THIS->u_pausedchain = THIS->u_dspchain;
+        THIS->u_dspchain = 0;
+    }
+}
+
+void ugen_resume(void)
+{
+    if (THIS->u_pausedchain)
+    {
+        THIS->u_dspchain = THIS->u_pausedchain;
+        THIS->u_pausedchain = 0;
+    }
+}
+
+static void ugen_freechain(void)
+{
+    ugen_resume();      /* so that a paused chain is freed too */
+    if (THIS->u_dspchain)
+    {
+        freebytes(THIS->u_dspchain,
+            THIS->u_dspchainsize * sizeof (t_int));
+        THIS->u_dspchain = 0;
+    }
+}
+
+void ugen_stop(void)
+{
+    ugen_freechain();
+    ugen_freesections();
+    ugen_freeappended();
+    signal_cleanup();
+
+}
+
+static void ugen_newchain(void)
+{
+    THIS->u_sortno++;
+    if (THIS->u_pointwise)
+        THIS->u_pointwise->p_nop = 0;
+    if (THIS->u_batch)
+        THIS->u_batch->b_count = 0;
+    THIS->u_profparent = 0;
+    THIS->u_dspchain = (t_int *)getbytes(sizeof(*THIS->u_dspchain));
+    THIS->u_dspchain[0] = (t_int)dsp_done;
+    THIS->u_dspchainsize = 1;
+    THIS->u_nentries = 0;
+    if (THIS->u_context) bug("ugen_start");
+    if (THIS->u_noutwritten != STUFF->st_outchannels)
+    {
+        THIS->u_outwritten = (unsigned char *)resizebytes(THIS->u_outwritten,
+            THIS->u_noutwritten, STUFF->st_outchannels);
+        THIS->u_noutwritten = STUFF->st_outchannels;
+    }
+        /* signals that borrow from outside buffers each hold this once, and
+        it holds itself, so it never becomes reusable */
+    THIS->u_external.s_refcount = 1;
+}
+
+void ugen_start(void)
+{
+    ugen_stop();
+    ugen_newchain();
+}
+
+    /* start over with a new DSP chain, keeping the old one's signals */
+void ugen_restart(void)
+{
+    ugen_freechain();
+    ugen_freesections();
+    ugen_freeappended();
+    signal_recycle();
+    ugen_newchain();
+}
+
+int ugen_getsortno(void)
+{
+    return (THIS->u_sortno);
+}
+
+#if 0
+void glob_ugen_printstate(void *dummy, t_symbol *s, int argc, t_atom *argv)
+{
+    int i, count;
+    t_signal *sig;
+    for (count = 0, sig = THIS->u_signals; sig;
+        count++, sig = sig->s_nextused)
+            ;
+    post("used signals %d", count);
+    for (i = 0; i < MAXLOGSIG; i++)
+    {
+        for (count = 0, sig = THIS->u_freelist[i]; sig;
+            count++, sig = sig->s_nextfree)
+                ;
+        if (count)
+            post("size %d: free %d", (1 << i), count);
+    }
+    for (count = 0, sig = THIS->u_freeborrowed; sig;
+        count++, sig = sig->s_nextfree)
+            ;
+    post("free borrowed %d", count);
+
+    THIS->u_loud = argc;
+}
+#endif
+
+/* ------------------ exporting the DSP graph ----------------------- */
+
+/* "pd dsp-graph <file>" resorts the DSP chain while recording what the sort
+did, and writes it out, as JSON if the file name ends in ".json" and
+otherwise in Graphviz's DOT format.  For each ugen we give its place in the
+sort, its class, the block~ context it was sorted in, the parallel section
+and task it went into (only when there are DSP threads), and for each
+signal inlet and outlet the buffer it got, its size and channel count, and
+how many signals were summed into it.  Each context gives its block size,
+overlap, up/downsampling and sample rate, and the ugen (a subpatch or
+clone) that it belongs to.  If the profiler is on ("pd dsp-profile 1") each
+ugen also gets its measured time per DSP tick. */
+
+typedef struct _graphport
+{
+    int p_buf;                  /* index of buffer, or -1 if none */
+    int p_n;                    /* points per channel */
+    int p_nchans;
+    int p_nsum;                 /* signals summed into an inlet */
+    char p_borrowed;            /* buffer belongs to another signal */
+    char p_scalar;              /* unconnected inlet taking a float */
+} t_graphport;
+
+typedef struct _graphnode
+{
+    t_object *n_obj;
+    int n_context;
+    int n_section;              /* parallel section, or -1 if none */
+    int n_task;                 /* task within it */
+    int n_nin;
+    int n_nout;
+    t_graphport *n_port;        /* inlets followed by outlets */
+} t_graphnode;
+
+typedef struct _graphcontext
+{
+    int c_parent;               /* enclosing context or -1 */
+    int c_owner;                /* ugen whose "dsp" method made it or -1 */
+    t_object *c_root;           /* otherwise the root canvas, if known */
+    int c_vecsize;
+    int c_calcsize;
+    int c_overlap;
+    int c_period;
+    int c_frequency;
+    int c_upsample;
+    int c_downsample;
+    t_float c_srate;
+    char c_reblock;
+    char c_switched;
+} t_graphcontext;
+
+typedef struct _graphbuf
+{
+    t_sample *b_vec;
+    int b_bytes;
+} t_graphbuf;
+
+typedef struct _graphconnect
+{
+    int c_from;
+    int c_outno;
+    int c_to;
+    int c_inno;
+} t_graphconnect;
+
+typedef struct _dspgraph
+{
+    t_graphnode *g_node;
+    int g_nnode, g_nodealloc;
+    t_graphcontext *g_context;
+    int g_ncontext, g_contextalloc;
+    t_graphbuf *g_buf;
+    int g_nbuf, g_bufalloc;
+    t_graphconnect *g_connect;
+    int g_nconnect, g_connectalloc;
+    struct _dspsection **g_section;
+    int g_nsection, g_sectionalloc;
+    int g_curnode;              /* ugen being scheduled, or -1 */
+    t_object *g_root;           /* root canvas being scheduled */
+} t_dspgraph;
+
+    /* make room for one more element in one of the above vectors */
+static void *graph_grow(void *vec, int n, int *allocp, size_t size)
+{
+    if (n == *allocp)
+    {
+        int newalloc = 2 * *allocp + 16;
+        vec = resizebytes(vec, *allocp * size, newalloc * size);
+        *allocp = newalloc;
+    }
+    return (vec);
+}
+
+static void graph_free(t_dspgraph *x)
+{
+    int i;
+    for (i = 0; i < x->g_nnode; i++)
+        freebytes(x->g_node[i].n_port, (x->g_node[i].n_nin +
+            x->g_node[i].n_nout) * sizeof(t_graphport));
+    freebytes(x->g_node, x->g_nodealloc * sizeof(*x->g_node));
+    freebytes(x->g_context, x->g_contextalloc * sizeof(*x->g_context));
+    freebytes(x->g_buf, x->g_bufalloc * sizeof(*x->g_buf));
+    freebytes(x->g_connect, x->g_connectalloc * sizeof(*x->g_connect));
+    freebytes(x->g_section, x->g_sectionalloc * sizeof(*x->g_section));
+    freebytes(x, sizeof(*x));
+}
+
+    /* called from ugen_start_graph() */
+static int graph_addcontext(t_dspcontext *dc)
+{
+    t_dspgraph *x = THIS->u_graph;
+    t_graphcontext *c;
+    if (!x)
+        return (-1);
+    x->g_context = (t_graphcontext *)graph_grow(x->g_context, x->g_ncontext,
+        &x->g_contextalloc, sizeof(*x->g_context));
+    c = &x->g_context[x->g_ncontext];
+    memset(c, 0, sizeof(*c));
+    c->c_parent = (dc->dc_parentcontext ?
+        dc->dc_parentcontext->dc_graphid : -1);
+    c->c_owner = x->g_curnode;
+    if (!dc->dc_parentcontext && c->c_owner < 0)
+        c->c_root = x->g_root;
+    return (x->g_ncontext++);
+}
+
+static void graph_setroot(t_object *x)
+{
+    if (THIS->u_graph)
+        THIS->u_graph->g_root = x;
+}
+
+    /* called from ugen_done_graph() once the block size is known */
+static void graph_setcontext(t_dspcontext *dc, int overlap, int period,
+    int frequency, int upsample, int downsample)
+{
+    t_graphcontext *c;
+    if (!THIS->u_graph || dc->dc_graphid < 0)
+        return;
+    c = &THIS->u_graph->g_context[dc->dc_graphid];
+    c->c_vecsize = dc->dc_vecsize;
+    c->c_calcsize = dc->dc_calcsize;
+    c->c_overlap = overlap;
+    c->c_period = period;
+    c->c_frequency = frequency;
+    c->c_upsample = upsample;
+    c->c_downsample = downsample;
+    c->c_srate = dc->dc_srate;
+    c->c_reblock = dc->dc_reblock;
+    c->c_switched = dc->dc_switched;
+}
+
+static int graph_getbuf(t_dspgraph *x, t_signal *sig)
+{
+    int i, bytes = sig->s_n * sig->s_nchans * sizeof(t_sample);
+    if (!sig->s_vec)
+        return (-1);
+    for (i = 0; i < x->g_nbuf; i++)
+        if (x->g_buf[i].b_vec == sig->s_vec)
+    {
+        if (bytes > x->g_buf[i].b_bytes)
+            x->g_buf[i].b_bytes = bytes;
+        return (i);
+    }
+    x->g_buf = (t_graphbuf *)graph_grow(x->g_buf, x->g_nbuf,
+        &x->g_bufalloc, sizeof(*x->g_buf));
+    x->g_buf[x->g_nbuf].b_vec = sig->s_vec;
+    x->g_buf[x->g_nbuf].b_bytes = bytes;
+    return (x->g_nbuf++);
+}
+
+    /* called from ugen_doit() just before the "dsp" method.  Returns the
+    previous value of g_curnode for graph_endnode() to restore. */
+static void graph_setport(t_dspgraph *x, t_graphport *p, t_signal *sig)
+{
+    p->p_buf = graph_getbuf(x, sig);
+    p->p_n = sig->s_n;
+    p->p_nchans = sig->s_nchans;
+    p->p_borrowed = (sig->s_isborrowed != 0);
+    p->p_scalar = (sig->s_scalar != 0);
+}
+
+static int graph_beginnode(t_dspcontext *dc, t_ugenbox *u, t_signal **insig)
+{
+    t_dspgraph *x = THIS->u_graph;
+    t_graphnode *n;
+    int i, was;
+    if (!x)
+        return (-1);
+    x->g_node = (t_graphnode *)graph_grow(x->g_node, x->g_nnode,
+        &x->g_nodealloc, sizeof(*x->g_node));
+    n = &x->g_node[x->g_nnode];
+    n->n_obj = u->u_obj;
+    n->n_context = dc->dc_graphid;
+    n->n_section = n->n_task = -1;
+    if (THIS->u_cursection)
+    {
+        for (i = 0; i < x->g_nsection; i++)
+            if (x->g_section[i] == THIS->u_cursection)
+                break;
+        if (i == x->g_nsection)
+        {
+            x->g_section = (struct _dspsection **)graph_grow(x->g_section,
+                x->g_nsection, &x->g_sectionalloc, sizeof(*x->g_section));
+            x->g_section[x->g_nsection++] = THIS->u_cursection;
+        }
+        n->n_section = i;
+        n->n_task = THIS->u_cursection->d_ntask - 1;
+    }
+    n->n_nin = u->u_nin;
+    n->n_nout = u->u_nout;
+    n->n_port = (t_graphport *)getbytes((u->u_nin + u->u_nout) *
+        sizeof(t_graphport));
+    for (i = 0; i < u->u_nin; i++)
+    {
+        graph_setport(x, &n->n_port[i], insig[i]);
+        n->n_port[i].p_nsum = u->u_in[i].i_nconnect;
+    }
+    u->u_graphid = x->g_nnode++;
+    was = x->g_curnode;
+    x->g_curnode = u->u_graphid;
+    return (was);
+}
+
+    /* and just after it, when the outputs have been filled in */
+static void graph_endnode(t_ugenbox *u, t_signal **outsig, int was)
+{
+    t_dspgraph *x = THIS->u_graph;
+    int i;
+    if (!x || u->u_graphid < 0)
+        return;
+    for (i = 0; i < u->u_nout; i++)
+        graph_setport(x, &x->g_node[u->u_graphid].n_port[u->u_nin + i],
+            outsig[i]);
+    x->g_curnode = was;
+}
+
+    /* called from ugen_done_graph() before the ugenboxes are deleted */
+static void graph_addconnections(t_dspcontext *dc)
+{
+    t_dspgraph *x = THIS->u_graph;
+    t_ugenbox *u;
+    t_sigoutlet *uout;
+    t_sigoutconnect *oc;
+    int i;
+    if (!x)
+        return;
+    for (u = dc->dc_ugenlist; u; u = u->u_next)
+        if (u->u_graphid >= 0)
+            for (uout = u->u_out, i = 0; i < u->u_nout; uout++, i++)
+                for (oc = uout->o_connections; oc; oc = oc->oc_next)
+                    if (oc->oc_who->u_graphid >= 0)
+    {
+        t_graphconnect *c;
+        x->g_connect = (t_graphconnect *)graph_grow(x->g_connect,
+            x->g_nconnect, &x->g_connectalloc, sizeof(*x->g_connect));
+        c = &x->g_connect[x->g_nconnect++];
+        c->c_from = u->u_graphid;
+        c->c_outno = i;
+        c->c_to = oc->oc_who->u_graphid;
+        c->c_inno = oc->oc_inno;
+    }
+}
+
+    /* a name for a ugen, with the name of a subpatch or abstraction */
+static void graph_name(t_object *obj, char *buf, int size)
+{
+    if (pd_class(&obj->ob_pd) == canvas_class)
+    {
+        t_glist *gl = (t_glist *)obj;
+        if (canvas_isabstraction(gl))
+            snprintf(buf, size, "%s", gl->gl_name->s_name);
+        else snprintf(buf, size, "pd %s", gl->gl_name->s_name);
+    }
+    else snprintf(buf, size, "%s", class_getname(pd_class(&obj->ob_pd)));
+}
+
+    /* name a context after the subpatch or root canvas it belongs to */
+static void graph_contextname(t_dspgraph *x, t_graphcontext *c, char *buf,
+    int size)
+{
+    if (c->c_owner >= 0)
+        graph_name(x->g_node[c->c_owner].n_obj, buf, size);
+    else if (c->c_root)
+        graph_name(c->c_root, buf, size);
+    else snprintf(buf, size, "root");
+}
+
+    /* write a string as a JSON or DOT string, quoting as needed */
+static void graph_writestring(FILE *fd, const char *s)
+{
+    putc('"', fd);
+    for (; *s; s++)
+    {
+        if (*s == '\n')
+            fprintf(fd, "\\n");
+        else if ((unsigned char)*s >= ' ')
+        {
+            if (*s == '"' || *s == '\\')
+                putc('\\', fd);
+            putc(*s, fd);
+        }
+    }
+    putc('"', fd);
+}
+
+static void graph_writejsonports(FILE *fd, t_graphport *p, int n,
+    int inlets)
+{
+    int i;
+    for (i = 0; i < n; i++, p++)
+    {
+        fprintf(fd, "%s{\"buffer\": %d, \"n\": %d, \"nchans\": %d",
+            (i ? ", " : ""), p->p_buf, p->p_n, p->p_nchans);
+        if (inlets)
+            fprintf(fd, ", \"sum\": %d", p->p_nsum);
+        if (p->p_borrowed)
+            fprintf(fd, ", \"borrowed\": true");
+        if (p->p_scalar)
+            fprintf(fd, ", \"scalar\": true");
+        fprintf(fd, "}");
+    }
+}
+
+static void graph_writejson(t_dspgraph *x, FILE *fd, double usecpercount)
+{
+    int i;
+    char buf[MAXPDSTRING];
+    fprintf(fd, "{\n  \"version\": \"%d.%d-%d\",\n", PD_MAJOR_VERSION,
+        PD_MINOR_VERSION, PD_BUGFIX_VERSION);
+    fprintf(fd, "  \"samplerate\": %g,\n  \"blocksize\": %d,\n",
+        sys_getsr(), sys_getblksize());
+    fprintf(fd, "  \"threads\": %d,\n  \"profiled\": %s,\n",
+        dsppool_nthreads, (usecpercount > 0 ? "true" : "false"));
+    fprintf(fd, "  \"contexts\": [");
+    for (i = 0; i < x->g_ncontext; i++)
+    {
+        t_graphcontext *c = &x->g_context[i];
+        graph_contextname(x, c, buf, MAXPDSTRING);
+        fprintf(fd, "%s\n    {\"id\": %d, \"name\": ", (i ? "," : ""), i);
+        graph_writestring(fd, buf);
+        fprintf(fd, ", \"parent\": %d, \"owner\": %d, "
+            "\"vecsize\": %d, \"calcsize\": %d, \"overlap\": %d, "
+            "\"period\": %d, \"frequency\": %d, \"upsample\": %d, "
+            "\"downsample\": %d, \"samplerate\": %g, \"reblock\": %s, "
+            "\"switched\": %s}", c->c_parent, c->c_owner, c->c_vecsize,
+                c->c_calcsize, c->c_overlap, c->c_period, c->c_frequency,
+                c->c_upsample, c->c_downsample, c->c_srate,
+                (c->c_reblock ? "true" : "false"),
+                (c->c_switched ? "true" : "false"));
+    }
+    fprintf(fd, "\n  ],\n  \"buffers\": [");
+    for (i = 0; i < x->g_nbuf; i++)
+        fprintf(fd, "%s\n    {\"id\": %d, \"bytes\": %d}", (i ? "," : ""),
+            i, x->g_buf[i].b_bytes);
+    fprintf(fd, "\n  ],\n  \"ugens\": [");
+    for (i = 0; i < x->g_nnode; i++)
+    {
+        t_graphnode *n = &x->g_node[i];
+        t_profrec *rec;
+        graph_name(n->n_obj, buf, MAXPDSTRING);
+        fprintf(fd, "%s\n    {\"id\": %d, \"name\": ", (i ? "," : ""), i);
+        graph_writestring(fd, buf);
+        fprintf(fd, ", \"class\": ");
+        graph_writestring(fd, class_getname(pd_class(&n->n_obj->ob_pd)));
+        fprintf(fd, ", \"context\": %d, \"section\": %d, \"task\": %d",
+            n->n_context, n->n_section, n->n_task);
+        if (usecpercount > 0 && (rec = profile_find(n->n_obj)))
+            fprintf(fd, ", \"usec\": %.3f",
+                usecpercount * (double)rec->r_total);
+        fprintf(fd, ",\n      \"inlets\": [");
+        graph_writejsonports(fd, n->n_port, n->n_nin, 1);
+        fprintf(fd, "],\n      \"outlets\": [");
+        graph_writejsonports(fd, n->n_port + n->n_nin, n->n_nout, 0);
+        fprintf(fd, "]");
+        fprintf(fd, "}");
+    }
+    fprintf(fd, "\n  ],\n  \"connections\": [");
+    for (i = 0; i < x->g_nconnect; i++)
+        fprintf(fd, "%s\n    {\"from\": %d, \"outlet\": %d, \"to\": %d, "
+            "\"inlet\": %d}", (i ? "," : ""), x->g_connect[i].c_from,
+                x->g_connect[i].c_outno, x->g_connect[i].c_to,
+                    x->g_connect[i].c_inno);
+    fprintf(fd, "\n  ]\n}\n");
+}
+
+    /* check whether a context or any inside it has ugens */
+static int graph_contextused(t_dspgraph *x, int ctx)
+{
+    int i;
+    for (i = 0; i < x->g_nnode; i++)
+        if (x->g_node[i].n_context == ctx)
+            return (1);
+    for (i = 0; i < x->g_ncontext; i++)
+        if (x->g_context[i].c_parent == ctx && graph_contextused(x, i))
+            return (1);
+    return (0);
+}
+
+    /* write a context as a DOT cluster holding its ugens and, nested inside
+    it, the contexts that belong to it */
+static void graph_writedotcontext(t_dspgraph *x, FILE *fd, int ctx,
+    double usecpercount, int indent)
+{
+    t_graphcontext *c = &x->g_context[ctx];
+    char buf[MAXPDSTRING], label[MAXPDSTRING];
+    int i, j;
+    fprintf(fd, "%*ssubgraph cluster_%d {\n", indent, "", ctx);
+    graph_contextname(x, c, buf, MAXPDSTRING);
+    snprintf(label, MAXPDSTRING, "%s\nblock %d", buf, c->c_vecsize);
+    if (c->c_calcsize != c->c_vecsize)
+        snprintf(label + strlen(label), MAXPDSTRING - strlen(label),
+            " (calc %d)", c->c_calcsize);
+    if (c->c_overlap > 1)
+        snprintf(label + strlen(label), MAXPDSTRING - strlen(label),
+            " overlap %d", c->c_overlap);
+    if (c->c_upsample != 1 || c->c_downsample != 1)
+        snprintf(label + strlen(label), MAXPDSTRING - strlen(label),
+            " resample %d/%d", c->c_upsample, c->c_downsample);
+    snprintf(label + strlen(label), MAXPDSTRING - strlen(label),
+        " %g Hz%s", c->c_srate, (c->c_switched ? " switched" : ""));
+    fprintf(fd, "%*s  label=", indent, "");
+    graph_writestring(fd, label);
+    fprintf(fd, ";\n");
+    for (i = 0; i < x->g_nnode; i++)
+    {
+        t_graphnode *n = &x->g_node[i];
+        t_profrec *rec;
+        if (n->n_context != ctx)
+            continue;
+        graph_name(n->n_obj, buf, MAXPDSTRING);
+        snprintf(label, MAXPDSTRING, "%d: %s", i, buf);
+        if (n->n_section >= 0)
+            snprintf(label + strlen(label), MAXPDSTRING - strlen(label),
+                "\nsection %d task %d", n->n_section, n->n_task);
+        for (j = 0; j < n->n_nin + n->n_nout; j++)
+        {
+            t_graphport *p = &n->n_port[j];
+            snprintf(label + strlen(label), MAXPDSTRING - strlen(label),
+                "\n%s %d: buf %d (%d bytes)", (j < n->n_nin ? "in" : "out"),
+                    (j < n->n_nin ? j : j - n->n_nin), p->p_buf,
+                    (p->p_buf >= 0 ? x->g_buf[p->p_buf].b_bytes : 0));
+            if (p->p_nchans > 1)
+                snprintf(label + strlen(label),
+                    MAXPDSTRING - strlen(label), " x%d", p->p_nchans);
+            if (j < n->n_nin && p->p_nsum > 1)
+                snprintf(label + strlen(label),
+                    MAXPDSTRING - strlen(label), " sum of %d", p->p_nsum);
+        }
+        if (usecpercount > 0 && (rec = profile_find(n->n_obj)))
+            snprintf(label + strlen(label), MAXPDSTRING - strlen(label),
+                "\n%.2f usec", usecpercount * (double)rec->r_total);
+        fprintf(fd, "%*s  n%d [label=", indent, "", i);
+        graph_writestring(fd, label);
+        fprintf(fd, "];\n");
+    }
+    for (i = 0; i < x->g_ncontext; i++)
+        if (x->g_context[i].c_parent == ctx && graph_contextused(x, i))
+            graph_writedotcontext(x, fd, i, usecpercount, indent + 2);
+    fprintf(fd, "%*s}\n", indent, "");
+}
+
+static void graph_writedot(t_dspgraph *x, FILE *fd, double usecpercount)
 {
-    return (s1->s_n == s2->s_n && s1->s_sr == s2->s_sr);
+    int i;
+    fprintf(fd, "digraph dsp {\n  node [shape=box];\n");
+    for (i = 0; i < x->g_ncontext; i++)
+        if (x->g_context[i].c_parent < 0 && graph_contextused(x, i))
+            graph_writedotcontext(x, fd, i, usecpercount, 2);
+        /* show what a subpatch contains next to it */
+    for (i = 0; i < x->g_ncontext; i++)
+        if (x->g_context[i].c_owner >= 0)
+    {
+        int k;
+        for (k = 0; k < x->g_nnode; k++)
+            if (x->g_node[k].n_context == i)
+                break;
+        if (k < x->g_nnode)
+            fprintf(fd, "  n%d -> n%d [style=dotted, lhead=cluster_%d];\n",
+                x->g_context[i].c_owner, k, i);
+    }
+    for (i = 0; i < x->g_nconnect; i++)
+    {
+        t_graphconnect *c = &x->g_connect[i];
+        t_graphport *p = &x->g_node[c->c_from].n_port[
+            x->g_node[c->c_from].n_nin + c->c_outno];
+        fprintf(fd, "  n%d -> n%d [label=\"%d:%d buf %d\"];\n", c->c_from,
+            c->c_to, c->c_outno, c->c_inno, p->p_buf);
+    }
+    fprintf(fd, "}\n");
 }
 
-/* ------------------ ugen ("unit generator") sorting ----------------- */
-
-typedef struct _ugenbox
+void glob_dspgraph(void *dummy, t_symbol *filename)
 {
-    struct _siginlet *u_in;
-    int u_nin;
-    struct _sigoutlet *u_out;
-    int u_nout;
-    int u_phase;
-    struct _ugenbox *u_next;
-    t_object *u_obj;
-    int u_done;
-} t_ugenbox;
+    FILE *fd;
+    t_dspgraph *x;
+    double usecpercount;
+    int len = strlen(filename->s_name);
+    canvas_flush_dsp();
+    if (!THIS->u_dspchain)
+    {
+        pd_error(0, "dsp-graph: DSP is off");
+        return;
+    }
+    if (!(fd = sys_fopen(filename->s_name, "w")))
+    {
+        pd_error(0, "%s: %s", filename->s_name, strerror(errno));
+        return;
+    }
+    x = (t_dspgraph *)getbytes(sizeof(*x));
+    x->g_curnode = -1;
+    THIS->u_graph = x;
+    canvas_update_dsp();
+    canvas_flush_dsp();
+    THIS->u_graph = 0;
+    usecpercount = profile_usecpercount();
+    if (len > 5 && !strcmp(filename->s_name + len - 5, ".json"))
+        graph_writejson(x, fd, usecpercount);
+    else graph_writedot(x, fd, usecpercount);
+    if (ferror(fd))
+        pd_error(0, "%s: write failed", filename->s_name);
+    else post("dsp-graph: wrote %s (%d ugens, %d buffers)",
+        filename->s_name, x->g_nnode, x->g_nbuf);
+    sys_fclose(fd);
+    graph_free(x);
+}
 
-typedef struct _siginlet
+/* ------------- DSP templates shared by identical canvases ------------- */
+
+/* Every copy of an abstraction (each voice of a clone, say) has the same DSP
+objects and connections, so when one has been sorted its layout is kept as
+a "template": the class of each object in the canvas, which of them are
+ugens with how many signal inlets and outlets, their connections, and the
+order ugen_doit() took them in.  The next canvas with the same name and
+directory is checked against it object by object and connection by
+connection; if it matches, its ugens are made from the template in one
+piece and scheduled in the same order without sorting.  Otherwise (if a
+copy was edited, say, or its creation arguments made different objects) it
+is sorted as usual and becomes the template in turn.  Signals are still
+allocated and "dsp" methods called for each copy as ever. */
+
+typedef struct _dspconn
 {
-    int i_nconnect;
-    int i_ngot;
-    t_signal *i_signal;
-} t_siginlet;
-
-typedef struct _sigoutconnect
+    int c_from;         /* index of the ugen it comes from */
+    int c_outno;        /* outlet number, and signal outlet number */
+    int c_sigoutno;
+    int c_to;           /* index of the ugen it goes to */
+    int c_inno;         /* inlet number, and signal inlet number */
+    int c_siginno;
+} t_dspconn;
+
+typedef struct _ugenat
 {
-    t_ugenbox *oc_who;
-    int oc_inno;
-    struct _sigoutconnect *oc_next;
-} t_sigoutconnect;
+    int a_where;        /* index in the canvas's list */
+    int a_nin;          /* number of signal inlets */
+    int a_nout;         /* and outlets */
+} t_ugenat;
 
-typedef struct _sigoutlet
+typedef struct _dsptemplate
 {
-    int o_nconnect;
-    int o_nsent;
-    t_signal *o_signal;
-    t_sigoutconnect *o_connections;
-} t_sigoutlet;
-
-
-struct _dspcontext
+    struct _dsptemplate *tm_next;
+    t_symbol *tm_name;      /* name and directory of the canvas */
+    t_symbol *tm_dir;
+    int tm_locality;        /* sys_dsplocality when it was sorted */
+    int tm_nobj;            /* number of objects in the canvas */
+    t_class **tm_class;     /* their classes */
+    int tm_nugen;           /* number of ugens */
+    t_ugenat *tm_ugen;      /* where they are, in order added */
+    int tm_nin;             /* total signal inlets */
+    int tm_nout;            /* ... and outlets */
+    int tm_nconn;           /* number of connections */
+    t_dspconn *tm_conn;     /* the connections, in order made */
+    int *tm_order;          /* order ugens were scheduled in */
+} t_dsptemplate;
+
+static void dsptemplate_free(t_dsptemplate *t)
 {
-    struct _ugenbox *dc_ugenlist;
-    struct _dspcontext *dc_parentcontext;
-    int dc_ninlets;
-    int dc_noutlets;
-    t_signal **dc_iosigs;
-    t_float dc_srate;
-    int dc_vecsize;         /* vector size, power of two */
-    int dc_calcsize;        /* number of elements to calculate */
-    char dc_toplevel;       /* true if "iosigs" is invalid. */
-    char dc_reblock;        /* true if we have to reblock inlets/outlets */
-    char dc_switched;       /* true if we're switched */
-};
-
-#define t_dspcontext struct _dspcontext
+    freebytes(t->tm_class, t->tm_nobj * sizeof(*t->tm_class));
+    freebytes(t->tm_ugen, t->tm_nugen * sizeof(*t->tm_ugen));
+    freebytes(t->tm_conn, t->tm_nconn * sizeof(*t->tm_conn));
+    freebytes(t->tm_order, t->tm_nugen * sizeof(*t->tm_order));
+    freebytes(t, sizeof(*t));
+}
 
-    /* get a new signal for the current context - used by clone~ object */
-t_signal *signal_newfromcontext(int borrowed)
+static void dsptemplate_freeall(void)
 {
-    return (signal_new((borrowed? 0 : THIS->u_context->dc_calcsize),
-        THIS->u_context->dc_srate));
+    t_dsptemplate *t;
+    while ((t = THIS->u_templates))
+    {
+        THIS->u_templates = t->tm_next;
+        dsptemplate_free(t);
+    }
 }
 
-void ugen_stop(void)
+    /* called from ugen_connect() while recording */
+static void dsptemplate_addconnect(t_dspcontext *dc, t_ugenbox *u1, int outno,
+    int sigoutno, t_ugenbox *u2, int inno, int siginno)
 {
-    if (THIS->u_dspchain)
+    t_dspconn *c;
+    if (dc->dc_nconn == dc->dc_connsize)
     {
-        freebytes(THIS->u_dspchain,
-            THIS->u_dspchainsize * sizeof (t_int));
-        THIS->u_dspchain = 0;
+        int newsize = (dc->dc_connsize ? 2 * dc->dc_connsize : 16);
+        dc->dc_conn = (t_dspconn *)resizebytes(dc->dc_conn,
+            dc->dc_connsize * sizeof(*dc->dc_conn),
+                newsize * sizeof(*dc->dc_conn));
+        dc->dc_connsize = newsize;
     }
-    signal_cleanup();
-
+    c = dc->dc_conn + dc->dc_nconn++;
+    c->c_from = u1->u_index;
+    c->c_outno = outno;
+    c->c_sigoutno = sigoutno;
+    c->c_to = u2->u_index;
+    c->c_inno = inno;
+    c->c_siginno = siginno;
 }
 
-void ugen_start(void)
+    /* make the ugens for "x" from template "t" if it matches, returning 1,
+    or return 0 if it doesn't */
+static int dsptemplate_match(t_dsptemplate *t, t_dspcontext *dc, t_glist *x)
 {
-    ugen_stop();
-    THIS->u_sortno++;
-    THIS->u_dspchain = (t_int *)getbytes(sizeof(*THIS->u_dspchain));
-    THIS->u_dspchain[0] = (t_int)dsp_done;
-    THIS->u_dspchainsize = 1;
-    if (THIS->u_context) bug("ugen_start");
+    size_t size = t->tm_nugen * sizeof(t_ugenbox) +
+        t->tm_nin * sizeof(t_siginlet) + t->tm_nout * sizeof(t_sigoutlet) +
+            t->tm_nconn * sizeof(t_sigoutconnect);
+    t_ugenbox *boxes = (t_ugenbox *)getbytes(size), *u;
+    t_siginlet *uin = (t_siginlet *)(boxes + t->tm_nugen);
+    t_sigoutlet *uout = (t_sigoutlet *)(uin + t->tm_nin);
+    t_sigoutconnect *oc = (t_sigoutconnect *)(uout + t->tm_nout);
+    t_dspconn *c = t->tm_conn, *cend = t->tm_conn + t->tm_nconn;
+    t_gobj *y;
+    int i, k;
+        /* the same classes in the same places */
+    for (y = x->gl_list, i = k = 0; y; y = y->g_next, i++)
+    {
+        if (i == t->tm_nobj || pd_class(&y->g_pd) != t->tm_class[i])
+            goto nomatch;
+        if (k < t->tm_nugen && t->tm_ugen[k].a_where == i)
+        {
+            u = boxes + k;
+            u->u_obj = pd_checkobject(&y->g_pd);
+            u->u_nin = t->tm_ugen[k].a_nin;
+            u->u_nout = t->tm_ugen[k].a_nout;
+            if (obj_nsiginlets(u->u_obj) != u->u_nin ||
+                obj_nsigoutlets(u->u_obj) != u->u_nout)
+                    goto nomatch;
+            u->u_in = uin;
+            uin += u->u_nin;
+            u->u_out = uout;
+            uout += u->u_nout;
+            u->u_next = (k ? u - 1 : 0);
+            u->u_graphid = -1;
+            u->u_index = k++;
+        }
+    }
+    if (i != t->tm_nobj)
+        goto nomatch;
+        /* and the same connections in the same order */
+    for (k = 0, u = boxes; k < t->tm_nugen; k++, u++)
+    {
+        int outno, nout = obj_noutlets(u->u_obj), sigoutno = 0;
+        for (outno = 0; outno < nout; outno++)
+        {
+            t_outlet *op;
+            t_outconnect *traverse;
+            if (!obj_issignaloutlet(u->u_obj, outno))
+                continue;
+            traverse = obj_starttraverseoutlet(u->u_obj, &op, outno);
+            while (traverse)
+            {
+                t_object *dest;
+                t_inlet *ip;
+                int inno;
+                traverse = obj_nexttraverseoutlet(traverse, &dest, &ip, &inno);
+                if (c == cend || c->c_from != k || c->c_outno != outno ||
+                    c->c_sigoutno != sigoutno || c->c_inno != inno ||
+                        boxes[c->c_to].u_obj != dest ||
+                            obj_siginletindex(dest, inno) != c->c_siginno)
+                                goto nomatch;
+                    /* add it as ugen_connect() would */
+                oc->oc_who = boxes + c->c_to;
+                oc->oc_inno = c->c_siginno;
+                oc->oc_next = u->u_out[sigoutno].o_connections;
+                u->u_out[sigoutno].o_connections = oc++;
+                u->u_out[sigoutno].o_nconnect++;
+                boxes[c->c_to].u_in[c->c_siginno].i_nconnect++;
+                c++;
+            }
+            sigoutno++;
+        }
+    }
+    if (c != cend)
+        goto nomatch;
+    dc->dc_ugenlist = (t->tm_nugen ? boxes + t->tm_nugen - 1 : 0);
+    dc->dc_nugen = t->tm_nugen;
+    dc->dc_block = boxes;
+    dc->dc_blocksize = size;
+    dc->dc_order = (int *)copybytes(t->tm_order,
+        t->tm_nugen * sizeof(*t->tm_order));
+    dc->dc_norder = t->tm_nugen;
+    dc->dc_fromtemplate = 1;
+    return (1);
+nomatch:
+    freebytes(boxes, size);
+    return (0);
 }
 
-int ugen_getsortno(void)
+    /* called from canvas_dodsp() in place of ugen_add() and ugen_connect()
+    for a canvas within another.  If there's a template for it, make the
+    ugens from that and return 1; otherwise return 0 and have
+    ugen_done_graph() make a template of it. */
+int ugen_addtemplate(t_dspcontext *dc, t_glist *x)
 {
-    return (THIS->u_sortno);
+    t_symbol *dir = canvas_getdir(x);
+    t_dsptemplate *t, **tp;
+    for (tp = &THIS->u_templates; (t = *tp); tp = &t->tm_next)
+        if (t->tm_name == x->gl_name && t->tm_dir == dir &&
+            t->tm_locality == sys_dsplocality)
+    {
+            /* the one used last goes first; copies come one after another */
+        *tp = t->tm_next;
+        t->tm_next = THIS->u_templates;
+        THIS->u_templates = t;
+        if (dsptemplate_match(t, dc, x))
+            return (1);
+        break;
+    }
+    dc->dc_maketemplate = x;
+    return (0);
 }
 
-#if 0
-void glob_ugen_printstate(void *dummy, t_symbol *s, int argc, t_atom *argv)
+    /* after sorting, make a template of the canvas, replacing any old one */
+static void dsptemplate_make(t_dspcontext *dc)
 {
-    int i, count;
-    t_signal *sig;
-    for (count = 0, sig = THIS->u_signals; sig;
-        count++, sig = sig->s_nextused)
-            ;
-    post("used signals %d", count);
-    for (i = 0; i < MAXLOGSIG; i++)
+    t_glist *x = dc->dc_maketemplate;
+    t_symbol *dir = canvas_getdir(x);
+    t_dsptemplate *t, **tp;
+    t_ugenbox *u, **ugens;
+    t_gobj *y;
+    int i, k, kind = mem_setkind(MEM_UNTRACKED);
+    for (tp = &THIS->u_templates; (t = *tp); tp = &t->tm_next)
+        if (t->tm_name == x->gl_name && t->tm_dir == dir &&
+            t->tm_locality == sys_dsplocality)
     {
-        for (count = 0, sig = THIS->u_freelist[i]; sig;
-            count++, sig = sig->s_nextfree)
-                ;
-        if (count)
-            post("size %d: free %d", (1 << i), count);
+        *tp = t->tm_next;
+        dsptemplate_free(t);
+        break;
     }
-    for (count = 0, sig = THIS->u_freeborrowed; sig;
-        count++, sig = sig->s_nextfree)
-            ;
-    post("free borrowed %d", count);
-
-    THIS->u_loud = argc;
+    t = (t_dsptemplate *)getbytes(sizeof(*t));
+    t->tm_name = x->gl_name;
+    t->tm_dir = dir;
+    t->tm_locality = sys_dsplocality;
+    for (y = x->gl_list, t->tm_nobj = 0; y; y = y->g_next)
+        t->tm_nobj++;
+    t->tm_class = (t_class **)getbytes(t->tm_nobj * sizeof(*t->tm_class));
+    t->tm_nugen = dc->dc_nugen;
+    t->tm_ugen = (t_ugenat *)getbytes(t->tm_nugen * sizeof(*t->tm_ugen));
+    t->tm_nin = t->tm_nout = 0;
+    ugens = (t_ugenbox **)getbytes(t->tm_nugen * sizeof(*ugens));
+    for (u = dc->dc_ugenlist; u; u = u->u_next)
+    {
+        ugens[u->u_index] = u;
+        t->tm_ugen[u->u_index].a_nin = u->u_nin;
+        t->tm_ugen[u->u_index].a_nout = u->u_nout;
+        t->tm_nin += u->u_nin;
+        t->tm_nout += u->u_nout;
+    }
+        /* ugens were added in the order they're in the canvas */
+    for (y = x->gl_list, i = k = 0; y; y = y->g_next, i++)
+    {
+        t->tm_class[i] = pd_class(&y->g_pd);
+        if (k < t->tm_nugen && &ugens[k]->u_obj->ob_g == y)
+            t->tm_ugen[k++].a_where = i;
+    }
+    t->tm_nconn = dc->dc_nconn;
+    t->tm_conn = (t_dspconn *)copybytes(dc->dc_conn,
+        t->tm_nconn * sizeof(*t->tm_conn));
+    t->tm_order = (int *)copybytes(dc->dc_order,
+        t->tm_nugen * sizeof(*t->tm_order));
+    freebytes(ugens, t->tm_nugen * sizeof(*ugens));
+    mem_setkind(kind);
+    if (k < t->tm_nugen)
+    {
+        bug("dsptemplate_make");
+        dsptemplate_free(t);
+        return;
+    }
+    t->tm_next = THIS->u_templates;
+    THIS->u_templates = t;
 }
-#endif
 
     /* start building the graph for a canvas */
 t_dspcontext *ugen_start_graph(int toplevel, t_signal **sp,
@@ -649,11 +4197,22 @@ t_dspcontext *ugen_start_graph(int toplevel, t_signal **sp,
         ninlets = noutlets = 0;
 
     dc->dc_ugenlist = 0;
+    dc->dc_presorted = 0;
+    dc->dc_fromtemplate = 0;
+    dc->dc_nugen = 0;
+    dc->dc_maketemplate = 0;
+    dc->dc_conn = 0;
+    dc->dc_nconn = dc->dc_connsize = 0;
+    dc->dc_order = 0;
+    dc->dc_norder = 0;
+    dc->dc_block = 0;
+    dc->dc_blocksize = 0;
     dc->dc_toplevel = toplevel;
     dc->dc_iosigs = sp;
     dc->dc_ninlets = ninlets;
     dc->dc_noutlets = noutlets;
     dc->dc_parentcontext = THIS->u_context;
+    dc->dc_graphid = graph_addcontext(dc);
     THIS->u_context = dc;
     return (dc);
 }
@@ -669,6 +4228,8 @@ void ugen_add(t_dspcontext *dc, t_object *obj)
     x->u_next = dc->dc_ugenlist;
     dc->dc_ugenlist = x;
     x->u_obj = obj;
+    x->u_graphid = -1;
+    x->u_index = dc->dc_nugen++;
     x->u_nin = obj_nsiginlets(obj);
     x->u_in = getbytes(x->u_nin * sizeof (*x->u_in));
     for (uin = x->u_in, i = x->u_nin; i--; uin++)
@@ -704,6 +4265,7 @@ void ugen_connect(t_dspcontext *dc, t_object *x1, int outno, t_object *x2,
         else if (!(x2 && (pd_class(&x2->ob_pd) == text_class)))
             pd_error(u1->u_obj,
                 "audio signal outlet connected to nonsignal inlet (ignored)");
+        dc->dc_maketemplate = 0;
         return;
     }
     if (sigoutno < 0 || sigoutno >= u1->u_nout || siginno >= u2->u_nin)
@@ -725,6 +4287,8 @@ void ugen_connect(t_dspcontext *dc, t_object *x1, int outno, t_object *x2,
         /* update inlet and outlet counts  */
     uout->o_nconnect++;
     uin->i_nconnect++;
+    if (dc->dc_maketemplate)
+        dsptemplate_addconnect(dc, u1, outno, sigoutno, u2, inno, siginno);
 }
 
     /* get the index of a ugenbox or -1 if it's not on the list */
@@ -738,6 +4302,95 @@ static int ugen_index(t_dspcontext *dc, t_ugenbox *x)
 }
 extern t_class *clone_class;
 
+    /* inputs that aren't freed until after the "dsp" call so that no output
+    can share their buffers: unfilled ones for classes that take their
+    floats directly, block-rate ones for classes that read the descriptor
+    (which reusing the signal for an output would clear), and, for
+    multichannel classes, any whose channel count differs from that of the
+    outputs (which may repeat their channels.) */
+static int ugen_holdinput(t_class *class, t_signal *sig, int nchans)
+{
+    return ((sig->s_scalar && class->c_scalarsignalin) ||
+        (sig->s_blockrate && class->c_blockratein) ||
+        (class->c_multichannel && sig->s_nchans != nchans));
+}
+
+static void dsp_add_sum(t_sample **in, int nin, t_sample *out, int n);
+
+    /* whether anyone an output goes to needs a block-rate signal's vector:
+    any class that doesn't take block-rate signals, or an inlet where it'll
+    be summed with others */
+static int ugen_needsvector(t_sigoutlet *uout)
+{
+    t_sigoutconnect *oc;
+    for (oc = uout->o_connections; oc; oc = oc->oc_next)
+    {
+        t_ugenbox *u2 = oc->oc_who;
+        if (!pd_class(&u2->u_obj->ob_pd)->c_blockratein ||
+            u2->u_in[oc->oc_inno].i_nconnect > 1)
+                return (1);
+    }
+    return (0);
+}
+
+    /* When several signals are connected to one inlet, rather than adding
+    each one in as it arrives (one pass over the sum for each connection),
+    ugen_doit() keeps up to MAXFANIN-1 of them waiting at the inlet and then
+    adds them all in one pass, either when there are that many or when the
+    last one has arrived.  They're added in the order they came, so the sum
+    is exactly as before.  Only signals with as many channels as the first
+    one wait; others are added right away the old way. */
+static void ugen_sumfanin(t_siginlet *uin)
+{
+    t_signal *s2 = uin->i_signal, *s3 = 0;
+    t_sample *vecs[MAXFANIN];
+    int i, j, nfanin = uin->i_nfanin;
+    if (!nfanin)
+        return;
+    s2->s_refcount--;
+    for (i = 0; i < nfanin; i++)
+        uin->i_fanin[i]->s_refcount--;
+        /* as for two, add into one that nobody else needs if possible */
+    if (!s2->s_refcount && !s2->s_isborrowed)
+        s3 = s2;
+    else for (i = 0; i < nfanin; i++)
+        if (!uin->i_fanin[i]->s_refcount && !uin->i_fanin[i]->s_isborrowed)
+    {
+        s3 = uin->i_fanin[i];
+        break;
+    }
+    if (!s3)
+        s3 = signal_newlike(s2);
+    if (nfanin == 1)
+        dsp_add_plus(uin->i_fanin[0]->s_vec, s2->s_vec, s3->s_vec,
+            s2->s_n * s2->s_nchans);
+    else
+    {
+        vecs[0] = s2->s_vec;
+        for (i = 0; i < nfanin; i++)
+            vecs[i+1] = uin->i_fanin[i]->s_vec;
+        dsp_add_sum(vecs, nfanin + 1, s3->s_vec, s2->s_n * s2->s_nchans);
+    }
+    uin->i_signal = s3;
+    s3->s_refcount = 1;
+    s3->s_blockrate = 0;
+    if (s2 != s3 && !s2->s_refcount)
+        signal_makereusable(s2);
+    for (i = 0; i < nfanin; i++)
+    {
+        t_signal *s1 = uin->i_fanin[i];
+        if (s1 == s3 || s1 == s2 || s1->s_refcount)
+            continue;
+            /* the same signal may be waiting twice */
+        for (j = 0; j < i; j++)
+            if (uin->i_fanin[j] == s1)
+                break;
+        if (j == i)
+            signal_makereusable(s1);
+    }
+    uin->i_nfanin = 0;
+}
+
     /* put a ugenbox on the chain, recursively putting any others on that
     this one might uncover. */
 static void ugen_doit(t_dspcontext *dc, t_ugenbox *u)
@@ -762,25 +4415,45 @@ static void ugen_doit(t_dspcontext *dc, t_ugenbox *u)
         ((class == voutlet_class) &&  !(dc->dc_reblock || dc->dc_switched)));
     t_signal **insig, **outsig, **sig, *s1, *s2, *s3;
     t_ugenbox *u2;
+    t_profrec *rec;
+    t_memowner owner;
+    int nchans = 1, graphwas;
 
     if (THIS->u_loud) post("doit %s %d %d", class_getname(class), nofreesigs,
         nonewsigs);
+    if (dc->dc_maketemplate)
+        dc->dc_order[dc->dc_norder++] = u->u_index;
+        /* the object's class owns its signals and what its "dsp" method
+        allocates */
+    mem_pushowner(&owner, 0, class);
     for (i = 0, uin = u->u_in; i < u->u_nin; i++, uin++)
     {
         if (!uin->i_nconnect)
         {
             t_float *scalar;
-            s3 = signal_new(dc->dc_calcsize, dc->dc_srate);
+            s3 = signal_new(dc->dc_calcsize, 1, dc->dc_srate);
             /* post("%s: unconnected signal inlet set to zero",
                 class_getname(u->u_obj->ob_pd)); */
+                /* unless the class can use the float directly, copy it
+                into the signal every block */
             if ((scalar = obj_findsignalscalar(u->u_obj, i)))
-                dsp_add_scalarcopy(scalar, s3->s_vec, s3->s_n);
+            {
+                s3->s_scalar = scalar;
+                if (!class->c_scalarsignalin)
+                    dsp_add_scalarcopy(scalar, s3->s_vec, s3->s_n);
+            }
             else
                 dsp_add_zero(s3->s_vec, s3->s_n);
             uin->i_signal = s3;
             s3->s_refcount = 1;
         }
     }
+        /* a multichannel class's outputs start out as wide as its
+        widest input */
+    if (class->c_multichannel)
+        for (i = 0, uin = u->u_in; i < u->u_nin; i++, uin++)
+            if (uin->i_signal->s_nchans > nchans)
+                nchans = uin->i_signal->s_nchans;
     insig = (t_signal **)getbytes((u->u_nin + u->u_nout) * sizeof(t_signal *));
     outsig = insig + u->u_nin;
     for (sig = insig, uin = u->u_in, i = u->u_nin; i--; sig++, uin++)
@@ -792,10 +4465,11 @@ static void ugen_doit(t_dspcontext *dc, t_ugenbox *u)
             unless it's a subcanvas or outlet; these might keep the
             signal around to send to objects connected to them.  In this
             case we increment the reference count; the corresponding decrement
-            is in sig_makereusable(). */
+            is in sig_makereusable().  Some inputs are kept till after the
+            "dsp" call (see ugen_holdinput() above.) */
         if (nofreesigs)
             (*sig)->s_refcount++;
-        else if (!newrefcount)
+        else if (!newrefcount && !ugen_holdinput(class, *sig, nchans))
             signal_makereusable(*sig);
     }
     for (sig = outsig, uout = u->u_out, i = u->u_nout; i--; sig++, uout++)
@@ -810,16 +4484,43 @@ static void ugen_doit(t_dspcontext *dc, t_ugenbox *u)
         if (nonewsigs)
         {
             *sig = uout->o_signal =
-                signal_new(0, dc->dc_srate);
+                signal_new(0, 1, dc->dc_srate);
         }
-        else
-            *sig = uout->o_signal = signal_new(dc->dc_calcsize, dc->dc_srate);
+        else *sig = uout->o_signal =
+            signal_new(dc->dc_calcsize, nchans, dc->dc_srate);
         (*sig)->s_refcount = uout->o_nconnect;
     }
         /* now call the DSP scheduling routine for the ugen.  This
         routine must fill in "borrowed" signal outputs in case it's either
         a subcanvas or a signal inlet. */
+    graphwas = graph_beginnode(dc, u, insig);
+    rec = profile_enter(u->u_obj);
     mess1(&u->u_obj->ob_pd, gensym("dsp"), insig);
+    profile_exit(rec);
+    mem_popowner(&owner);
+    graph_endnode(u, outsig, graphwas);
+
+    if (!nofreesigs)
+        for (sig = insig, i = 0; i < u->u_nin; i++, sig++)
+    {
+        if (!(*sig)->s_refcount && ugen_holdinput(class, *sig, nchans))
+        {
+                /* the same signal may come in on two inlets */
+            for (n = 0; n < i; n++)
+                if (insig[n] == *sig)
+                    break;
+            if (n == i)
+                signal_makereusable(*sig);
+        }
+    }
+        /* multichannel classes may have replaced their outputs; and
+        block-rate ones get their vectors filled in if anyone needs them */
+    for (sig = outsig, uout = u->u_out, i = u->u_nout; i--; sig++, uout++)
+    {
+        uout->o_signal = *sig;
+        if ((*sig)->s_blockrate && ugen_needsvector(uout))
+            dsp_add_blockratefill(*sig);
+    }
 
         /* if any output signals aren't connected to anyone, free them
         now; otherwise they'll either get freed when the reference count
@@ -852,9 +4553,19 @@ static void ugen_doit(t_dspcontext *dc, t_ugenbox *u)
         {
             u2 = oc->oc_who;
             uin = &u2->u_in[oc->oc_inno];
-                /* if there's already someone here, sum the two */
-            if ((s2 = uin->i_signal))
+                /* if there's already someone here, sum them, either later
+                with any others (see ugen_sumfanin()) or right now */
+            if ((s2 = uin->i_signal) && s2->s_nchans == s1->s_nchans &&
+                signal_compatible(s1, s2))
             {
+                uin->i_fanin[uin->i_nfanin++] = s1;
+                if (uin->i_nfanin == MAXFANIN - 1)
+                    ugen_sumfanin(uin);
+            }
+            else if (s2)
+            {
+                ugen_sumfanin(uin);
+                s2 = uin->i_signal;
                 s1->s_refcount--;
                 s2->s_refcount--;
                 if (!signal_compatible(s1, s2))
@@ -863,26 +4574,46 @@ static void ugen_doit(t_dspcontext *dc, t_ugenbox *u)
                         class_getname(u->u_obj->ob_pd));
                     return;
                 }
-                s3 = signal_newlike(s1);
-                dsp_add_plus(s1->s_vec, s2->s_vec, s3->s_vec, s1->s_n);
+                    /* if nobody else needs one of the two (and it owns its
+                    buffer) add the other one into it in place.  If they
+                    have different numbers of channels the sum has as many
+                    as the wider one, which is then "s1" below. */
+                if (s2->s_nchans > s1->s_nchans)
+                    s3 = s1, s1 = s2, s2 = s3;
+                if (!s2->s_refcount && !s2->s_isborrowed &&
+                    s2->s_nchans == s1->s_nchans)
+                        s3 = s2;
+                else if (!s1->s_refcount && !s1->s_isborrowed)
+                    s3 = s1;
+                else s3 = signal_newlike(s1);
+                dsp_add_plus(s1->s_vec, s2->s_vec, s3->s_vec,
+                    s2->s_n * s2->s_nchans);
+                if (s3 != s1 && s1->s_nchans > s2->s_nchans)
+                    dsp_add_copy(s1->s_vec + s2->s_n * s2->s_nchans,
+                        s3->s_vec + s2->s_n * s2->s_nchans,
+                            s1->s_n * (s1->s_nchans - s2->s_nchans));
                 uin->i_signal = s3;
                 s3->s_refcount = 1;
-                if (!s1->s_refcount) signal_makereusable(s1);
-                if (!s2->s_refcount) signal_makereusable(s2);
+                s3->s_blockrate = 0;
+                if (s1 != s3 && !s1->s_refcount) signal_makereusable(s1);
+                if (s2 != s3 && !s2->s_refcount) signal_makereusable(s2);
             }
             else uin->i_signal = s1;
             uin->i_ngot++;
                 /* if we didn't fill this inlet don't bother yet */
             if (uin->i_ngot < uin->i_nconnect)
                 goto notyet;
+            ugen_sumfanin(uin);
                 /* if there's more than one, check them all */
             if (u2->u_nin > 1)
             {
                 for (uin = u2->u_in, n = u2->u_nin; n--; uin++)
                     if (uin->i_ngot < uin->i_nconnect) goto notyet;
             }
-                /* so now we can schedule the ugen.  */
-            ugen_doit(dc, u2);
+                /* so now we can schedule the ugen, unless the order has
+                already been worked out (see ugen_pull() below.) */
+            if (!dc->dc_presorted)
+                ugen_doit(dc, u2);
         notyet: ;
         }
     }
@@ -890,6 +4621,87 @@ static void ugen_doit(t_dspcontext *dc, t_ugenbox *u)
     u->u_done = 1;
 }
 
+    /* With the "-dsplocality" flag, rather than starting from each ugen
+    without inputs and scheduling whatever that makes ready, we work back
+    from the ugens whose outputs go nowhere, putting each ugen after
+    everything that feeds it.  Each ugen is then computed as late as
+    possible, just before the first one that uses its output, so that
+    fewer signals are live at once and the ones a ugen reads were usually
+    written just before.  This can change the order of ugens that aren't
+    connected to each other (such as delwrite~ and delread~.)  Ugens in a
+    DSP loop aren't reached, and are reported as usual. */
+static void ugen_pull(t_ugenbox *u, t_ugenbox ***orderp)
+{
+    int i;
+    if (u->u_done)
+        return;
+    u->u_done = 1;
+    for (i = 0; i < u->u_nprod; i++)
+        ugen_pull(u->u_prod[i], orderp);
+    *(*orderp)++ = u;
+}
+
+static void ugen_sortforlocality(t_dspcontext *dc)
+{
+    t_ugenbox *u, **order, **op, **op2;
+    t_sigoutlet *uout;
+    t_siginlet *uin;
+    t_sigoutconnect *oc;
+    int i, nugen = 0;
+        /* make lists of the sources of each ugen's inputs */
+    for (u = dc->dc_ugenlist; u; u = u->u_next, nugen++)
+        u->u_nprod = 0;
+    for (u = dc->dc_ugenlist; u; u = u->u_next)
+        for (uout = u->u_out, i = u->u_nout; i--; uout++)
+            for (oc = uout->o_connections; oc; oc = oc->oc_next)
+                oc->oc_who->u_nprod++;
+    for (u = dc->dc_ugenlist; u; u = u->u_next)
+    {
+        u->u_prod = (t_ugenbox **)getbytes(
+            u->u_nprod * sizeof(*u->u_prod));
+        u->u_nprod = 0;
+    }
+    for (u = dc->dc_ugenlist; u; u = u->u_next)
+        for (uout = u->u_out, i = u->u_nout; i--; uout++)
+            for (oc = uout->o_connections; oc; oc = oc->oc_next)
+    {
+        t_ugenbox *u2 = oc->oc_who;
+        u2->u_prod[u2->u_nprod++] = u;
+    }
+    order = op = (t_ugenbox **)getbytes(nugen * sizeof(*order));
+        /* start from the ugens with no connected outputs */
+    for (u = dc->dc_ugenlist; u; u = u->u_next)
+    {
+        for (uout = u->u_out, i = u->u_nout; i--; uout++)
+            if (uout->o_nconnect)
+                goto next;
+        ugen_pull(u, &op);
+    next: ;
+    }
+        /* then anything left, which can only be upstream of a DSP loop */
+    for (u = dc->dc_ugenlist; u; u = u->u_next)
+        ugen_pull(u, &op);
+    for (u = dc->dc_ugenlist; u; u = u->u_next)
+    {
+        u->u_done = 0;
+        for (uin = u->u_in, i = u->u_nin; i--; uin++)
+            uin->i_ngot = 0;
+    }
+    dc->dc_presorted = 1;
+    for (op2 = order; op2 < op; op2++)
+    {
+        u = *op2;
+        for (uin = u->u_in, i = u->u_nin; i--; uin++)
+            if (uin->i_ngot < uin->i_nconnect)
+                goto notready;
+        ugen_doit(dc, u);
+    notready: ;
+    }
+    freebytes(order, nugen * sizeof(*order));
+    for (u = dc->dc_ugenlist; u; u = u->u_next)
+        freebytes(u->u_prod, u->u_nprod * sizeof(*u->u_prod));
+}
+
     /* once the DSP graph is built, we call this routine to sort it.
     This routine also deletes the graph; later we might want to leave the
     graph around, in case the user is editing the DSP network, to save having
@@ -912,7 +4724,7 @@ void ugen_done_graph(t_dspcontext *dc)
     int chainblockend;      /* and after block epilog code */
     int chainafterall;      /* and after signal outlet epilog */
     int reblock = 0, switched;
-    int downsample = 1, upsample = 1;
+    int downsample = 1, upsample = 1, overlap = 1;
     /* debugging printout */
 
     if (THIS->u_loud)
@@ -965,6 +4777,7 @@ void ugen_done_graph(t_dspcontext *dc)
             calcsize = vecsize;
         realoverlap = blk->x_overlap;
         if (realoverlap > vecsize) realoverlap = vecsize;
+        overlap = realoverlap;
         downsample = blk->x_downsample;
         upsample   = blk->x_upsample;
         if (downsample > parent_vecsize)
@@ -1002,6 +4815,7 @@ void ugen_done_graph(t_dspcontext *dc)
     dc->dc_srate = srate;
     dc->dc_vecsize = vecsize;
     dc->dc_calcsize = calcsize;
+    graph_setcontext(dc, overlap, period, frequency, upsample, downsample);
 
         /* if we're reblocking or switched, we now have to create output
         signals to fill in for the "borrowed" ones we have now.  This
@@ -1018,7 +4832,7 @@ void ugen_done_graph(t_dspcontext *dc)
             if ((*sigp)->s_isborrowed && !(*sigp)->s_borrowedfrom)
             {
                 signal_setborrowed(*sigp,
-                    signal_new(parent_vecsize, parent_srate));
+                    signal_new(parent_vecsize, 1, parent_srate));
                 (*sigp)->s_refcount++;
 
                 if (THIS->u_loud) post("set %lx->%lx", *sigp,
@@ -1055,11 +4869,17 @@ void ugen_done_graph(t_dspcontext *dc)
     }
     chainblockbegin = THIS->u_dspchainsize;
 
+    if (blk && switched)
+        block_setwatch(blk, dc->dc_iosigs, dc->dc_ninlets, dc->dc_noutlets,
+            parent_vecsize, parent_srate);
     if (blk && (reblock || switched))   /* add the block DSP prolog */
     {
         dsp_add(block_prolog, 1, blk);
         blk->x_chainonset = THIS->u_dspchainsize - 1;
     }
+    if (dc->dc_maketemplate)
+        dc->dc_order = (int *)getbytes(dc->dc_nugen * sizeof(*dc->dc_order));
+
         /* Initialize for sorting */
     for (u = dc->dc_ugenlist; u; u = u->u_next)
     {
@@ -1070,9 +4890,18 @@ void ugen_done_graph(t_dspcontext *dc)
             uin->i_ngot = 0, uin->i_signal = 0;
    }
 
-        /* Do the sort */
+        /* Do the sort, unless it's already been done for the template we
+        were made from; in that case each ugen is ready in its turn. */
 
-    for (u = dc->dc_ugenlist; u; u = u->u_next)
+    if (dc->dc_fromtemplate)
+    {
+        dc->dc_presorted = 1;
+        for (i = 0; i < dc->dc_norder; i++)
+            ugen_doit(dc, (t_ugenbox *)dc->dc_block + dc->dc_order[i]);
+    }
+    else if (sys_dsplocality)
+        ugen_sortforlocality(dc);
+    else for (u = dc->dc_ugenlist; u; u = u->u_next)
     {
             /* check that we have no connected signal inlets */
         if (u->u_done) continue;
@@ -1099,7 +4928,7 @@ void ugen_done_graph(t_dspcontext *dc)
         {
             if ((*sigp)->s_isborrowed && !(*sigp)->s_borrowedfrom)
             {
-                t_signal *s3 = signal_new(parent_vecsize, parent_srate);
+                t_signal *s3 = signal_new(parent_vecsize, 1, parent_srate);
                 signal_setborrowed(*sigp, s3);
                 (*sigp)->s_refcount++;
                 dsp_add_zero(s3->s_vec, s3->s_n);
@@ -1111,6 +4940,10 @@ void ugen_done_graph(t_dspcontext *dc)
         break;   /* don't need to keep looking. */
     }
 
+        /* if they were all scheduled, others like us can be made alike */
+    if (dc->dc_maketemplate && dc->dc_norder == dc->dc_nugen)
+        dsptemplate_make(dc);
+
     if (blk && (reblock || switched))    /* add block DSP epilog */
         dsp_add(block_epilog, 1, blk);
     chainblockend = THIS->u_dspchainsize;
@@ -1136,7 +4969,10 @@ void ugen_done_graph(t_dspcontext *dc)
         blk->x_blocklength = chainblockend - chainblockbegin;
         blk->x_epiloglength = chainafterall - chainblockend;
         blk->x_reblock = reblock;
+        blk->x_ncall = -1;
     }
+    if (blk && switched)
+        dsp_add(block_watch, 1, blk);
 
     if (THIS->u_loud)
     {
@@ -1147,7 +4983,17 @@ void ugen_done_graph(t_dspcontext *dc)
                     post("chain %lx", *ip);
         post("... ugen_done_graph done.");
     }
+    graph_addconnections(dc);
         /* now delete everything. */
+    if (dc->dc_order)
+        freebytes(dc->dc_order, dc->dc_nugen * sizeof(*dc->dc_order));
+    if (dc->dc_conn)
+        freebytes(dc->dc_conn, dc->dc_connsize * sizeof(*dc->dc_conn));
+    if (dc->dc_block)
+    {
+        freebytes(dc->dc_block, dc->dc_blocksize);
+        dc->dc_ugenlist = 0;
+    }
     while (dc->dc_ugenlist)
     {
         for (uout = dc->dc_ugenlist->u_out, n = dc->dc_ugenlist->u_nout;
@@ -1202,6 +5048,15 @@ t_int *plus_perf8(t_int *w)
     t_sample *in2 = (t_sample *)(w[2]);
     t_sample *out = (t_sample *)(w[3]);
     int n = (int)(w[4]);
+#ifdef PD_SIMD
+    for (; n; n -= 8, in1 += 8, in2 += 8, out += 8)
+    {
+        t_v4 f0 = V4_LOAD(in1), f1 = V4_LOAD(in1+4);
+        t_v4 g0 = V4_LOAD(in2), g1 = V4_LOAD(in2+4);
+        V4_STORE(out, V4_ADD(f0, g0));
+        V4_STORE(out+4, V4_ADD(f1, g1));
+    }
+#else
     for (; n; n -= 8, in1 += 8, in2 += 8, out += 8)
     {
         t_sample f0 = in1[0], f1 = in1[1], f2 = in1[2], f3 = in1[3];
@@ -1213,15 +5068,77 @@ t_int *plus_perf8(t_int *w)
         out[0] = f0 + g0; out[1] = f1 + g1; out[2] = f2 + g2; out[3] = f3 + g3;
         out[4] = f4 + g4; out[5] = f5 + g5; out[6] = f6 + g6; out[7] = f7 + g7;
     }
+#endif
     return (w+5);
 }
 
 void dsp_add_plus(t_sample *in1, t_sample *in2, t_sample *out, int n)
 {
-    if (n&7)
-        dsp_add(plus_perform, 4, in1, in2, out, (t_int)n);
-    else
-        dsp_add(plus_perf8, 4, in1, in2, out, (t_int)n);
+    dsp_addpointwise((n&7 ? plus_perform : plus_perf8), PW_ADD,
+        in1, (t_int)in2, 0, out, n);
+}
+
+    /* sum of several signals: w[1] is the output, w[2] the vector size, and
+    w[3] the number of inputs, which follow.  The output may be one of the
+    inputs. */
+static t_int *sum_perform(t_int *w)
+{
+    t_sample *out = (t_sample *)(w[1]);
+    int n = (int)(w[2]), nin = (int)(w[3]), i, k;
+    for (i = 0; i < n; i++)
+    {
+        t_sample f = ((t_sample *)(w[4]))[i];
+        for (k = 1; k < nin; k++)
+            f += ((t_sample *)(w[4+k]))[i];
+        out[i] = f;
+    }
+    return (w + 4 + nin);
+}
+
+    /* the same, 8 points at a time so that each input is read once */
+static t_int *sum_perf8(t_int *w)
+{
+    t_sample *out = (t_sample *)(w[1]);
+    int n = (int)(w[2]), nin = (int)(w[3]), i, k;
+    for (i = 0; i < n; i += 8)
+    {
+        t_sample *in = (t_sample *)(w[4]) + i;
+#ifdef PD_SIMD
+        t_v4 f0 = V4_LOAD(in), f1 = V4_LOAD(in+4);
+        for (k = 1; k < nin; k++)
+        {
+            in = (t_sample *)(w[4+k]) + i;
+            f0 = V4_ADD(f0, V4_LOAD(in));
+            f1 = V4_ADD(f1, V4_LOAD(in+4));
+        }
+        V4_STORE(out+i, f0);
+        V4_STORE(out+i+4, f1);
+#else
+        t_sample f0 = in[0], f1 = in[1], f2 = in[2], f3 = in[3];
+        t_sample f4 = in[4], f5 = in[5], f6 = in[6], f7 = in[7];
+        for (k = 1; k < nin; k++)
+        {
+            in = (t_sample *)(w[4+k]) + i;
+            f0 += in[0]; f1 += in[1]; f2 += in[2]; f3 += in[3];
+            f4 += in[4]; f5 += in[5]; f6 += in[6]; f7 += in[7];
+        }
+        out[i] = f0; out[i+1] = f1; out[i+2] = f2; out[i+3] = f3;
+        out[i+4] = f4; out[i+5] = f5; out[i+6] = f6; out[i+7] = f7;
+#endif
+    }
+    return (w + 4 + nin);
+}
+
+static void dsp_add_sum(t_sample **in, int nin, t_sample *out, int n)
+{
+    t_int vec[3 + MAXFANIN];
+    int i;
+    vec[0] = (t_int)out;
+    vec[1] = n;
+    vec[2] = nin;
+    for (i = 0; i < nin; i++)
+        vec[3+i] = (t_int)in[i];
+    dsp_addv((n&7 ? sum_perform : sum_perf8), 3 + nin, vec);
 }
 
 t_int *copy_perform(t_int *w)
@@ -1239,6 +5156,14 @@ static t_int *copy_perf8(t_int *w)
     t_sample *out = (t_sample *)(w[2]);
     int n = (int)(w[3]);
 
+#ifdef PD_SIMD
+    for (; n; n -= 8, in1 += 8, out += 8)
+    {
+        t_v4 f0 = V4_LOAD(in1), f1 = V4_LOAD(in1+4);
+        V4_STORE(out, f0);
+        V4_STORE(out+4, f1);
+    }
+#else
     for (; n; n -= 8, in1 += 8, out += 8)
     {
         t_sample f0 = in1[0];
@@ -1259,6 +5184,7 @@ static t_int *copy_perf8(t_int *w)
         out[6] = f6;
         out[7] = f7;
     }
+#endif
     return (w+4);
 }
 
@@ -1308,6 +5234,54 @@ void dsp_add_scalarcopy(t_float *in, t_sample *out, int n)
         dsp_add(sig_tilde_perf8, 3, in, out, (t_int)n);
 }
 
+/* ---------------- sample-accurate control messages -------------------- */
+
+/* Messages sent from clocks arrive at logical times between DSP ticks.
+Normally a signal object acts on them at the start of the next block it
+computes.  Instead, it can stamp each message with ctltime_stamp().  In its
+perform routine it calls ctltime_block() and then ctltime_offset(), which
+gives the sample of this block at which the message was sent.  That sample
+is n if the message belongs to a later block (when reblocked below the
+tick size).  Logical time is followed the same way vline~ does it: the tick
+the scheduler is about to compute ends at the current logical time.
+Asking for pd 0.52 compatibility or earlier puts every message at the
+start of the block, as before. */
+
+double ctltime_stamp(void)
+{
+    return (pd_compatibilitylevel < 53 ? -1e30 : clock_gettimesince(0));
+}
+
+void ctltime_dsp(t_ctltime *x, t_float sr)
+{
+    x->c_msecpersamp = 1000. / sr;
+    x->c_lastlogical = -1e30;
+    x->c_blocktime = x->c_nexttime = 0;
+}
+
+void ctltime_block(t_ctltime *x, int n)
+{
+    double now = clock_gettimesince(0);
+    if (now != x->c_lastlogical)
+    {
+        x->c_lastlogical = now;
+        x->c_nexttime = now -
+            (n > DEFDACBLKSIZE ? n : DEFDACBLKSIZE) * x->c_msecpersamp;
+    }
+    x->c_blocktime = x->c_nexttime;
+    x->c_nexttime += n * x->c_msecpersamp;
+}
+
+int ctltime_offset(t_ctltime *x, double stamp, int n)
+{
+    double offset = (stamp - x->c_blocktime) / x->c_msecpersamp;
+    if (offset <= 0)
+        return (0);
+    else if (offset >= n)
+        return (n);
+    else return ((int)offset);
+}
+
 /* ------------------------ samplerate~~ -------------------------- */
 
 static t_class *samplerate_tilde_class;
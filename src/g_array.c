@@ -6,8 +6,19 @@
 #include <string.h>
 #include <stdio.h>      /* for read/write to files */
 #include "m_pd.h"
+#include "m_imp.h"
 #include "g_canvas.h"
 #include <math.h>
+#include <errno.h>
+#include <pthread.h>
+#include "d_simd.h"
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define GARRAY_MMAP
+#endif
 
 /* jsarlo { */
 #define ARRAYPAGESIZE 1000  /* this should match the page size in u_main.tk */
@@ -15,6 +26,24 @@
 
 /* --------- "pure" arrays with scalars for elements. --------------- */
 
+    /* get or resize the points of an array, which "pd memory-report"
+    counts as array memory */
+static void *array_getbytes(size_t nbytes)
+{
+    int kind = mem_setkind(MEM_ARRAY);
+    void *ret = getbytes(nbytes);
+    mem_setkind(kind);
+    return (ret);
+}
+
+static void *array_resizebytes(void *old, size_t oldsize, size_t newsize)
+{
+    int kind = mem_setkind(MEM_ARRAY);
+    void *ret = resizebytes(old, oldsize, newsize);
+    mem_setkind(kind);
+    return (ret);
+}
+
 /* Pure arrays have no a priori graphical capabilities.
 They are instantiated by "garrays" below or can be elements of other
 scalars (g_scalar.c); their graphical behavior is defined accordingly. */
@@ -27,7 +56,7 @@ t_array *array_new(t_symbol *templatesym, t_gpointer *parent)
     x->a_templatesym = templatesym;
     x->a_n = 1;
     x->a_elemsize = sizeof(t_word) * template->t_n;
-    x->a_vec = (char *)getbytes(x->a_elemsize);
+    x->a_vec = (char *)array_getbytes(x->a_elemsize);
         /* note here we blithely copy a gpointer instead of "setting" a
         new one; this gpointer isn't accounted for and needn't be since
         we'll be deleted before the thing pointed to gets deleted anyway;
@@ -35,6 +64,9 @@ t_array *array_new(t_symbol *templatesym, t_gpointer *parent)
     x->a_gp = *parent;
     x->a_stub = gstub_new(0, x);
     word_init((t_word *)(x->a_vec), template, parent);
+        /* with one element the two layouts are the same */
+    x->a_columns = template->t_columns;
+    x->a_summary = 0;
     return (x);
 }
 
@@ -52,7 +84,30 @@ void array_resize(t_array *x, int n)
     oldn = x->a_n;
     elemsize = sizeof(t_word) * template->t_n;
 
-    tmp = (char *)resizebytes(x->a_vec, oldn * elemsize, n * elemsize);
+    if (x->a_columns)
+    {
+            /* move each field's vector to its new place.  The elements are
+            all floats, so there's nothing to free and zero is initial. */
+        int i, nfield = template->t_n;
+        t_word *vec;
+        if (n < oldn)
+            for (i = 1, vec = (t_word *)x->a_vec; i < nfield; i++)
+                memmove(vec + i * n, vec + i * oldn, n * sizeof(t_word));
+        if (!(tmp = (char *)array_resizebytes(x->a_vec, oldn * elemsize,
+            n * elemsize)))
+                return;
+        x->a_vec = tmp;
+        x->a_n = n;
+        if (n > oldn)
+            for (i = nfield, vec = (t_word *)x->a_vec; i--; )
+        {
+            memmove(vec + i * n, vec + i * oldn, oldn * sizeof(t_word));
+            memset(vec + i * n + oldn, 0, (n - oldn) * sizeof(t_word));
+        }
+        x->a_valid = ++glist_valid;
+        return;
+    }
+    tmp = (char *)array_resizebytes(x->a_vec, oldn * elemsize, n * elemsize);
     if (!tmp)
         return;
     x->a_vec = tmp;
@@ -90,7 +145,9 @@ void array_free(t_array *x)
     int i;
     t_template *scalartemplate = template_findbyname(x->a_templatesym);
     gstub_cutoff(x->a_stub);
-    for (i = 0; i < x->a_n; i++)
+    array_setsummary(x, 0);
+    if (!x->a_columns)  /* (stored by field means there's nothing to free) */
+        for (i = 0; i < x->a_n; i++)
     {
         t_word *wp = (t_word *)(x->a_vec + x->a_elemsize * i);
         word_free(wp, scalartemplate);
@@ -99,6 +156,405 @@ void array_free(t_array *x)
     freebytes(x, sizeof *x);
 }
 
+    /* switch an array between storing by element and by field.  Only arrays
+    of float-only elements may be stored by field; see g_canvas.h. */
+void array_setcolumns(t_array *x, int columns)
+{
+    int i, j, nfield = x->a_elemsize / sizeof(t_word), n = x->a_n;
+    t_word *from = (t_word *)x->a_vec, *to;
+    columns = (columns != 0);
+    if (columns == x->a_columns)
+        return;
+    if (n > 1 && nfield > 1)
+    {
+        to = (t_word *)array_getbytes(x->a_elemsize * n);
+        for (i = 0; i < n; i++)
+            for (j = 0; j < nfield; j++)
+        {
+            if (columns)
+                to[j * n + i] = from[i * nfield + j];
+            else to[i * nfield + j] = from[j * n + i];
+        }
+        x->a_vec = (char *)to;
+        freebytes(from, x->a_elemsize * n);
+    }
+    x->a_columns = columns;
+        /* invalidate all gpointers into the array */
+    x->a_valid = ++glist_valid;
+}
+
+    /* copy element "indx" of an array into a record "rec" laid out as usual,
+    or (if "toarray") back again.  This lets the template_...() routines get
+    at elements of arrays stored by field. */
+void array_copyelement(t_array *x, int indx, t_word *rec, int toarray)
+{
+    int j, nfield = x->a_elemsize / sizeof(t_word), stride;
+    t_word *w;
+    if (x->a_columns)
+        w = (t_word *)x->a_vec + indx, stride = x->a_n;
+    else w = (t_word *)x->a_vec + indx * nfield, stride = 1;
+    for (j = 0; j < nfield; j++, w += stride)
+    {
+        if (toarray)
+            *w = rec[j];
+        else rec[j] = *w;
+    }
+}
+
+/* ------------------- summaries of float arrays --------------------- */
+
+/* An array of single floats (such as a garray's) may keep a summary of its
+points, so that "array sum", "array max" and so on, and the drawing of
+huge arrays, take time proportional to the log of the size of the range
+instead of the size.  The points are taken SUMMARYLEAF at a time as leaves
+of a binary tree, each node of which holds the t_arraystats of the leaves
+below it, so that a range's statistics add up from O(log n) nodes and the
+two partial leaves at its ends.  Writing doesn't update the tree directly:
+writers mark the leaves they changed as stale, through garray_redraw(),
+garray_redrawrange(), array_redraw() or (for those that don't redraw, like
+tabwrite~) array_touch(), and stale leaves are recomputed at the next
+query.  A resized or replaced array is summarized over again. */
+
+#define SUMMARYLEAF 256
+
+typedef struct _arraysummary
+{
+    char *s_vec;            /* the array's points and size when summarized */
+    int s_n;
+    int s_nleaf;
+    int s_size;             /* power of two, at least s_nleaf */
+    t_arraystats *s_tree;   /* 2 * s_size nodes; the root is number 1 */
+    int s_stalelo;          /* leaves in [lo, hi) need recomputing */
+    int s_stalehi;
+} t_arraysummary;
+
+void array_initstats(t_arraystats *s)
+{
+    s->as_min = 1e30;
+    s->as_max = -1e30;
+    s->as_imin = s->as_imax = -1;
+    s->as_sum = s->as_possum = 0;
+}
+
+    /* add the stats of a range to those of the range just before it */
+static void array_addstats(t_arraystats *to, const t_arraystats *from)
+{
+    if (from->as_min < to->as_min)
+        to->as_min = from->as_min, to->as_imin = from->as_imin;
+    if (from->as_max > to->as_max)
+        to->as_max = from->as_max, to->as_imax = from->as_imax;
+    to->as_sum += from->as_sum;
+    to->as_possum += from->as_possum;
+}
+
+    /* smallest and largest of n points, ignoring NaNs */
+static void array_minmax(t_word *w, int n, t_float *lop, t_float *hip)
+{
+    t_float lo = 1e30, hi = -1e30;
+    int i = 0;
+#ifdef PD_SIMD
+    if (n >= 4)
+    {
+        t_v4 vlo = V4_SET1(lo), vhi = V4_SET1(hi), v;
+        t_float l[4], h[4];
+        int j;
+        for (; i + 4 <= n; i += 4)
+        {
+            if (sizeof(t_word) == sizeof(t_float))
+                v = V4_LOAD(&w[i].w_float);
+            else v = V4_LOAD_STRIDE2(&w[i].w_float);
+                /* the old value stays if the new one is a NaN */
+            vlo = V4_MIN(v, vlo);
+            vhi = V4_MAX(v, vhi);
+        }
+        V4_STORE(l, vlo);
+        V4_STORE(h, vhi);
+        for (j = 0; j < 4; j++)
+        {
+            if (l[j] < lo)
+                lo = l[j];
+            if (h[j] > hi)
+                hi = h[j];
+        }
+    }
+#endif
+    for (; i < n; i++)
+    {
+        t_float f = w[i].w_float;
+        if (f < lo)
+            lo = f;
+        if (f > hi)
+            hi = f;
+    }
+    *lop = lo;
+    *hip = hi;
+}
+
+    /* add the stats of points "onset" to "onset + n" of a vector to "s" */
+void array_scanwords(t_word *vec, int onset, int n, t_arraystats *s)
+{
+    int i = onset, end = onset + n;
+    while (i < end)
+    {
+        int m = (end - i < SUMMARYLEAF ? end - i : SUMMARYLEAF), j;
+        t_word *w = vec + i;
+        t_float lo, hi;
+        double sum0 = 0, sum1 = 0, pos0 = 0, pos1 = 0;
+        array_minmax(w, m, &lo, &hi);
+        if (lo < s->as_min)
+        {
+            for (j = 0; w[j].w_float != lo; j++)
+                ;
+            s->as_min = lo, s->as_imin = i + j;
+        }
+        if (hi > s->as_max)
+        {
+            for (j = 0; w[j].w_float != hi; j++)
+                ;
+            s->as_max = hi, s->as_imax = i + j;
+        }
+            /* two chains of additions so that they can overlap */
+        for (j = 0; j + 2 <= m; j += 2)
+        {
+            t_float f0 = w[j].w_float, f1 = w[j+1].w_float;
+            sum0 += f0;
+            sum1 += f1;
+            pos0 += (f0 > 0 ? f0 : 0);
+            pos1 += (f1 > 0 ? f1 : 0);
+        }
+        if (j < m)
+        {
+            t_float f0 = w[j].w_float;
+            sum0 += f0;
+            pos0 += (f0 > 0 ? f0 : 0);
+        }
+        s->as_sum += sum0 + sum1;
+        s->as_possum += pos0 + pos1;
+        i += m;
+    }
+}
+
+    /* start or stop keeping a summary.  Only arrays of single floats can
+    have one. */
+void array_setsummary(t_array *x, int on)
+{
+    t_arraysummary *s = x->a_summary;
+    if (on && !s)
+    {
+        t_template *template = template_findbyname(x->a_templatesym);
+        if (!template || template->t_n != 1 ||
+            template->t_vec[0].ds_type != DT_FLOAT)
+                return;
+        s = (t_arraysummary *)getbytes(sizeof(*s));
+        s->s_vec = 0;
+        s->s_n = s->s_nleaf = s->s_size = 0;
+        s->s_tree = 0;
+        s->s_stalelo = s->s_stalehi = 0;
+        x->a_summary = s;
+    }
+    else if (!on && s)
+    {
+        if (s->s_tree)
+            freebytes(s->s_tree, 2 * s->s_size * sizeof(*s->s_tree));
+        freebytes(s, sizeof(*s));
+        x->a_summary = 0;
+    }
+}
+
+    /* note that points "onset" to "onset + n" were written (all of them if
+    n < 0) */
+void array_touch(t_array *x, int onset, int n)
+{
+    t_arraysummary *s = x->a_summary;
+    int lo, hi;
+    if (!s || !n)
+        return;
+    if (n < 0)
+        lo = 0, hi = s->s_nleaf;
+    else
+    {
+        lo = onset / SUMMARYLEAF;
+        hi = (onset + n - 1) / SUMMARYLEAF + 1;
+        if (lo < 0)
+            lo = 0;
+        if (hi > s->s_nleaf)
+            hi = s->s_nleaf;
+    }
+    if (lo < s->s_stalelo)
+        s->s_stalelo = lo;
+    if (hi > s->s_stalehi)
+        s->s_stalehi = hi;
+}
+
+    /* bring the tree up to date with the array */
+static void summary_refresh(t_array *x)
+{
+    t_arraysummary *s = x->a_summary;
+    int lo, hi, i;
+    if (s->s_vec != x->a_vec || s->s_n != x->a_n)
+    {
+        int nleaf = (x->a_n + SUMMARYLEAF - 1) / SUMMARYLEAF, size = 1;
+        while (size < nleaf)
+            size *= 2;
+        if (size != s->s_size)
+        {
+            if (s->s_tree)
+                freebytes(s->s_tree, 2 * s->s_size * sizeof(*s->s_tree));
+            s->s_tree = (t_arraystats *)getbytes(2 * size *
+                sizeof(*s->s_tree));
+            s->s_size = size;
+        }
+        for (i = 0; i < 2 * size; i++)
+            array_initstats(&s->s_tree[i]);
+        s->s_vec = x->a_vec;
+        s->s_n = x->a_n;
+        s->s_nleaf = nleaf;
+        s->s_stalelo = 0;
+        s->s_stalehi = nleaf;
+    }
+    if ((lo = s->s_stalelo) >= (hi = s->s_stalehi))
+        return;
+    for (i = lo; i < hi; i++)
+    {
+        t_arraystats *leaf = &s->s_tree[s->s_size + i];
+        int onset = i * SUMMARYLEAF;
+        array_initstats(leaf);
+        array_scanwords((t_word *)x->a_vec, onset,
+            (x->a_n - onset < SUMMARYLEAF ? x->a_n - onset : SUMMARYLEAF),
+                leaf);
+    }
+    for (lo = (s->s_size + lo) / 2, hi = (s->s_size + hi - 1) / 2; lo >= 1;
+        lo /= 2, hi /= 2)
+            for (i = lo; i <= hi; i++)
+    {
+        s->s_tree[i] = s->s_tree[2*i];
+        array_addstats(&s->s_tree[i], &s->s_tree[2*i+1]);
+    }
+    s->s_stalelo = s->s_nleaf;
+    s->s_stalehi = 0;
+}
+
+    /* add the stats of points "onset" to "onset + n" to "st", from the
+    summary if there is one (indices count from the start of the array) */
+void array_getstats(t_array *x, int onset, int n, t_arraystats *st)
+{
+    t_arraysummary *s = x->a_summary;
+    t_word *vec = (t_word *)x->a_vec;
+    int end = onset + n, first, last, l, r;
+    t_arraystats right;
+    if (!s)
+    {
+        array_scanwords(vec, onset, n, st);
+        return;
+    }
+    summary_refresh(x);
+        /* the whole leaves in the range */
+    first = (onset + SUMMARYLEAF - 1) / SUMMARYLEAF;
+    last = (end == x->a_n ? s->s_nleaf : end / SUMMARYLEAF);
+    if (first >= last)
+    {
+        array_scanwords(vec, onset, n, st);
+        return;
+    }
+    array_scanwords(vec, onset, first * SUMMARYLEAF - onset, st);
+    array_initstats(&right);
+    for (l = first + s->s_size, r = last + s->s_size; l < r; l /= 2, r /= 2)
+    {
+        if (l & 1)
+            array_addstats(st, &s->s_tree[l++]);
+        if (r & 1)
+        {
+            t_arraystats tmp = s->s_tree[--r];
+            array_addstats(&tmp, &right);
+            right = tmp;
+        }
+    }
+    array_addstats(st, &right);
+    if (last * SUMMARYLEAF < end)
+        array_scanwords(vec, last * SUMMARYLEAF, end - last * SUMMARYLEAF,
+            st);
+}
+
+    /* subtract positive points from "remaining" starting at "from" and
+    return the index at which it goes below zero, or -1 if it doesn't
+    before "to" */
+static int quantile_scan(t_word *vec, int from, int to, double *remaining)
+{
+    int i;
+    for (i = from; i < to; i++)
+    {
+        t_float f = vec[i].w_float;
+        *remaining -= (f > 0 ? f : 0);
+        if (*remaining < 0)
+            return (i);
+    }
+    return (-1);
+}
+
+    /* the same for whole leaves "from" to "to" using the tree: return the
+    leaf in which "remaining" would go below zero, having subtracted the
+    ones before it */
+static int quantile_findleaf(t_arraysummary *s, int node, int lo, int hi,
+    int from, int to, double *remaining)
+{
+    int leaf;
+    if (hi <= from || lo >= to)
+        return (-1);
+    if (from <= lo && hi <= to &&
+        *remaining - s->s_tree[node].as_possum >= 0)
+    {
+        *remaining -= s->s_tree[node].as_possum;
+        return (-1);
+    }
+    if (hi - lo == 1)
+        return (lo);
+    if ((leaf = quantile_findleaf(s, 2*node, lo, (lo + hi)/2, from, to,
+        remaining)) >= 0)
+            return (leaf);
+    return (quantile_findleaf(s, 2*node+1, (lo + hi)/2, hi, from, to,
+        remaining));
+}
+
+    /* find where the sum of positive points from "onset" first exceeds
+    "target", counting from "onset", looking at the first n-1 points; if
+    it doesn't, return n-1.  This is what "array quantile" outputs. */
+int array_quantile(t_array *x, int onset, int n, double target)
+{
+    t_arraysummary *s = x->a_summary;
+    t_word *vec = (t_word *)x->a_vec;
+    int end = onset + n - 1, i = onset, first, last, leaf, found;
+    double remaining = target;
+    if (n < 1)
+        return (0);
+    if (s)
+        summary_refresh(x);
+    while (1)
+    {
+        first = (i + SUMMARYLEAF - 1) / SUMMARYLEAF;
+        last = end / SUMMARYLEAF;
+        if (!s || first >= last)
+        {
+            found = quantile_scan(vec, i, end, &remaining);
+            break;
+        }
+        if ((found = quantile_scan(vec, i, first * SUMMARYLEAF,
+            &remaining)) >= 0)
+                break;
+        if ((leaf = quantile_findleaf(s, 1, 0, s->s_size, first, last,
+            &remaining)) < 0)
+        {
+            found = quantile_scan(vec, last * SUMMARYLEAF, end, &remaining);
+            break;
+        }
+            /* rounding might put the crossing in a later leaf */
+        if ((found = quantile_scan(vec, leaf * SUMMARYLEAF,
+            (leaf + 1) * SUMMARYLEAF, &remaining)) >= 0)
+                break;
+        i = (leaf + 1) * SUMMARYLEAF;
+    }
+    return (found >= 0 ? found - onset : n - 1);
+}
+
 /* --------------------- graphical arrays (garrays) ------------------- */
 
 t_class *garray_class;
@@ -111,11 +567,20 @@ struct _garray
     t_symbol *x_name;       /* unexpanded name (possibly with leading '$') */
     t_symbol *x_realname;   /* expanded name (symbol we're bound to) */
     unsigned int  x_usedindsp:1;    /* 1 if some DSP routine is using this */
+    unsigned int  x_usedresizable:1; /* ... one that survives resizing */
+    t_symbol *x_mapname;            /* file we're mapped from, if any */
+    int x_mapfd;                    /* and its file descriptor */
+    struct _sharedwords *x_shared;  /* points shared with other arrays */
+    t_packedpoints *x_packed;       /* points packed into 16 or 24 bits */
     unsigned int  x_saveit:1;       /* we should save this with parent */
     unsigned int  x_savesize:1;     /* save size too */
+    unsigned int  x_savebinary:1;   /* save contents to a file beside patch */
     unsigned int  x_listviewing:1;  /* list view window is open */
     unsigned int  x_hidename:1;     /* don't print name above graph */
     unsigned int  x_edit:1;         /* we can edit the array */
+    unsigned int  x_redrawall:1;    /* whole array needs redrawing */
+    int x_redrawonset;              /* else, part that needs it if n > 0 */
+    int x_redrawn;
 };
 
 static t_pd *garray_arraytemplatecanvas;  /* written at setup w/ global lock */
@@ -169,19 +634,26 @@ static t_garray *graph_scalar(t_glist *gl, t_symbol *s, t_symbol *templatesym,
     x->x_name = s;
     x->x_realname = canvas_realizedollar(gl, s);
     pd_bind(&x->x_gobj.g_pd, x->x_realname);
-    x->x_usedindsp = 0;
+    x->x_usedindsp = x->x_usedresizable = 0;
+    x->x_mapname = 0;
+    x->x_shared = 0;
+    x->x_packed = 0;
         /* when invoked this way, saving implies saving size too */
     x->x_saveit = saveit;
     x->x_savesize = savesize;
+    x->x_savebinary = 0;
     x->x_listviewing = 0;
     x->x_edit = 1;
+    x->x_redrawall = 0;
+    x->x_redrawonset = x->x_redrawn = 0;
     glist_add(gl, &x->x_gobj);
     x->x_glist = gl;
     return (x);
 }
 
-    /* get a garray's "array" structure. */
-t_array *garray_getarray(t_garray *x)
+    /* get a garray's "array" structure as it is, even if its points are
+    packed (see garray_pack() below) */
+static t_array *garray_doarray(t_garray *x)
 {
     int zonset, ztype;
     t_symbol *zarraytype;
@@ -208,8 +680,16 @@ t_array *garray_getarray(t_garray *x)
     return (sc->sc_vec[zonset].w_array);
 }
 
+    /* get a garray's "array" structure. */
+t_array *garray_getarray(t_garray *x)
+{
+    if (x->x_packed)
+        garray_unpack(x);
+    return (garray_doarray(x));
+}
+
     /* get the "array" structure and furthermore check it's float */
-static t_array *garray_getarray_floatonly(t_garray *x,
+static t_array *garray_getarray_floatfield(t_garray *x,
     int *yonsetp, int *elemsizep)
 {
     t_array *a = garray_getarray(x);
@@ -224,6 +704,14 @@ static t_array *garray_getarray_floatonly(t_garray *x,
     return (a);
 }
 
+    /* the same for callers that may write to it */
+static t_array *garray_getarray_floatonly(t_garray *x,
+    int *yonsetp, int *elemsizep)
+{
+    garray_unshare(x);
+    return (garray_getarray_floatfield(x, yonsetp, elemsizep));
+}
+
     /* get the array's name.  Return nonzero if it should be hidden */
 int garray_getname(t_garray *x, t_symbol **namep)
 {
@@ -231,6 +719,12 @@ int garray_getname(t_garray *x, t_symbol **namep)
     return (x->x_hidename);
 }
 
+    /* get the symbol a garray is bound to */
+t_symbol *garray_getrealname(t_garray *x)
+{
+    return (x->x_realname);
+}
+
     /* get a garray's containing glist */
 t_glist *garray_getglist(t_garray *x)
 {
@@ -320,6 +814,7 @@ t_garray *graph_array(t_glist *gl, t_symbol *s, t_symbol *templateargsym,
     savesize = ((flags & GRAPH_ARRAY_SAVESIZE) != 0);
     x = graph_scalar(gl, s, templatesym, saveit, savesize);
     x->x_hidename = ((flags & 8) >> 3);
+    x->x_savebinary = ((flags & GRAPH_ARRAY_SAVEBINARY) != 0);
 
     if (n <= 0)
         n = 100;
@@ -363,7 +858,7 @@ void canvas_menuarray(t_glist *canvas)
 void garray_properties(t_garray *x)
 {
     char cmdbuf[200];
-    t_array *a = garray_getarray(x);
+    t_array *a = garray_doarray(x);
     t_scalar *sc = x->x_scalar;
     int style = template_getfloat(template_findbyname(sc->sc_template),
         gensym("style"), x->x_scalar->sc_vec, 1);
@@ -377,7 +872,7 @@ void garray_properties(t_garray *x)
         properly; right now we just detect a leading '$' and escape
         it.  There should be a systematic way of doing this. */
     sprintf(cmdbuf, "pdtk_array_dialog %%s {%s} %d %d 0\n",
-            x->x_name->s_name, a->a_n, x->x_saveit +
+            x->x_name->s_name, garray_npoints(x), x->x_saveit +
             2 * filestyle);
     gfxstub_new(&x->x_gobj.g_pd, x, cmdbuf);
 }
@@ -413,7 +908,7 @@ void garray_arraydialog(t_garray *x, t_symbol *name, t_floatarg fsize,
             gensym("style"), x->x_scalar->sc_vec, 1);
     if (deleteit != 0)
     {
-        int wasused = x->x_usedindsp;
+        int wasused = (x->x_usedindsp || x->x_usedresizable);
         glist_delete(x->x_glist, &x->x_gobj);
         if (wasused)
             canvas_update_dsp();
@@ -421,7 +916,7 @@ void garray_arraydialog(t_garray *x, t_symbol *name, t_floatarg fsize,
     else
     {
         long size;
-        t_array *a = garray_getarray(x);
+        t_array *a = garray_doarray(x);
         t_template *scalartemplate;
         if (!a)
         {
@@ -459,7 +954,7 @@ void garray_arraydialog(t_garray *x, t_symbol *name, t_floatarg fsize,
         size = fsize;
         if (size < 1)
             size = 1;
-        if (size != a->a_n)
+        if (size != garray_npoints(x))
             garray_resize_long(x, size);
         else if (style != stylewas)
             garray_fittograph(x, (int)size, style);
@@ -560,6 +1055,11 @@ void garray_arrayviewlist_close(t_garray *x)
 }
 /* } jsarlo */
 
+static void garray_unmapfile(t_garray *x, int keep);
+static void garray_dropshared(t_garray *x);
+static void garray_droppacked(t_garray *x);
+static t_float packedpoints_get(const t_packedpoints *p, int i);
+
 static void garray_free(t_garray *x)
 {
     t_pd *x2;
@@ -571,6 +1071,10 @@ static void garray_free(t_garray *x)
     }
     /* } jsarlo */
     gfxstub_deleteforkey(x);
+    garray_droppacked(x);
+    garray_unmapfile(x, 0);
+    garray_dropshared(x);
+    glist_valid++;      /* tell anyone with a pointer to our values */
     pd_unbind(&x->x_gobj.g_pd, x->x_realname);
         /* just in case we're still bound to #A from loading... */
     while ((x2 = pd_findbyclass(gensym("#A"), garray_class)))
@@ -582,6 +1086,7 @@ static void garray_free(t_garray *x)
 
 void array_redraw(t_array *a, t_glist *glist)
 {
+    array_touch(a, 0, -1);
     while (a->a_gp.gp_stub->gs_which == GP_ARRAY)
         a = a->a_gp.gp_stub->gs_un.gs_array;
     scalar_redraw(a->a_gp.gp_un.gp_scalar, glist);
@@ -701,6 +1206,8 @@ static int garray_click(t_gobj *z, t_glist *glist,
     int xpix, int ypix, int shift, int alt, int dbl, int doit)
 {
     t_garray *x = (t_garray *)z;
+    if (x->x_edit && doit)
+        garray_unshare(x);
     if (x->x_edit)
         return (gobj_click(&x->x_scalar->sc_gobj, glist,
             xpix, ypix, shift, alt, dbl, doit));
@@ -710,14 +1217,144 @@ static int garray_click(t_gobj *z, t_glist *glist,
 
 #define ARRAYWRITECHUNKSIZE 1000
 
-void garray_savecontentsto(t_garray *x, t_binbuf *b)
+    /* With the "savebinary" flag, an array saved with a patch file has its
+    contents written to a file beside the patch, named after the patch and
+    the array, and the patch gets a "readbinary" message instead of the
+    points.  The file starts with a 16-byte header: "PDAR", then three
+    32-bit words in the writer's byte order: 1 (so a reader can tell the
+    byte order), the bytes per point (4 or 8), and the number of points.
+    The points follow as raw floats of that size. */
+
+static int garray_writebinary(t_garray *x, t_binbuf *b)
 {
+    t_symbol *dir, *filename;
     t_array *array = garray_getarray(x);
+    char name[MAXPDSTRING], path[MAXPDSTRING], *cp;
+    int i, n = array->a_n, ok;
+    uint32_t head[4];
+    t_float *vec;
+    FILE *fd;
+    if (!canvas_getsavefile(&dir, &filename))
+        return (0);     /* copying, or saving state: use text */
+    snprintf(name, MAXPDSTRING, "%s", filename->s_name);
+    if ((cp = strrchr(name, '.')) && cp != name)
+        *cp = 0;
+    snprintf(name + strlen(name), MAXPDSTRING - strlen(name), "-%s.pdarray",
+        x->x_name->s_name);
+        /* keep '$' and path separators out of the file name */
+    for (cp = name; *cp; cp++)
+        if (*cp == '$' || *cp == '/' || *cp == '\\' || *cp == ':')
+            *cp = '_';
+    snprintf(path, MAXPDSTRING, "%s/%s", dir->s_name, name);
+    if (!(fd = sys_fopen(path, "wb")))
+    {
+        pd_error(x, "%s: %s", path, strerror(errno));
+        return (0);
+    }
+    memcpy(&head[0], "PDAR", 4);
+    head[1] = 1;
+    head[2] = sizeof(t_float);
+    head[3] = n;
+    vec = (t_float *)getbytes(n * sizeof(t_float));
+    for (i = 0; i < n; i++)
+        vec[i] = ((t_word *)(array->a_vec))[i].w_float;
+    ok = (fwrite(head, sizeof(head), 1, fd) == 1 &&
+        fwrite(vec, sizeof(t_float), n, fd) == (size_t)n);
+    freebytes(vec, n * sizeof(t_float));
+    if (fclose(fd) != 0)
+        ok = 0;
+    if (!ok)
+    {
+        pd_error(x, "%s: write failed", path);
+        return (0);
+    }
+    binbuf_addv(b, "sss;", gensym("#A"), gensym("readbinary"), gensym(name));
+    return (1);
+}
+
+static void garray_swapbytes(char *p, int size)
+{
+    int i;
+    for (i = 0; i < size/2; i++)
+    {
+        char c = p[i];
+        p[i] = p[size - 1 - i];
+        p[size - 1 - i] = c;
+    }
+}
+
+static void garray_readbinary(t_garray *x, t_symbol *filename)
+{
+    char buf[MAXPDSTRING], *bufptr, *data;
+    int filedesc, yonset, elemsize, swap, size, n, i;
+    uint32_t head[4];
+    FILE *fd;
+    t_array *array = garray_getarray_floatonly(x, &yonset, &elemsize);
+    if (!array)
+    {
+        pd_error(0, "%s: needs floating-point 'y' field", x->x_realname->s_name);
+        return;
+    }
+    if ((filedesc = canvas_open(glist_getcanvas(x->x_glist),
+            filename->s_name, "", buf, &bufptr, MAXPDSTRING, 1)) < 0
+                || !(fd = fdopen(filedesc, "rb")))
+    {
+        pd_error(x, "%s: can't open", filename->s_name);
+        return;
+    }
+    if (fread(head, sizeof(head), 1, fd) != 1 || memcmp(&head[0], "PDAR", 4))
+        goto bad;
+    if ((swap = (head[1] != 1)))
+    {
+        for (i = 1; i < 4; i++)
+            garray_swapbytes((char *)&head[i], 4);
+        if (head[1] != 1)
+            goto bad;
+    }
+    if ((size = head[2]) != 4 && size != 8)
+        goto bad;
+    n = (head[3] < (uint32_t)array->a_n ? (int)head[3] : array->a_n);
+    data = (char *)getbytes(n * size);
+        /* all the points at once */
+    if (fread(data, size, n, fd) != (size_t)n)
+    {
+        freebytes(data, n * size);
+        goto bad;
+    }
+    for (i = 0; i < n; i++)
+    {
+        char *p = data + i * size;
+        if (swap)
+            garray_swapbytes(p, size);
+        *((t_float *)(array->a_vec + elemsize * i) + yonset) =
+            (size == 4 ? *(float *)p : *(double *)p);
+    }
+    for (; i < array->a_n; i++)
+        *((t_float *)(array->a_vec + elemsize * i) + yonset) = 0;
+    freebytes(data, n * size);
+    fclose(fd);
+    garray_redraw(x);
+    return;
+bad:
+    pd_error(x, "%s: bad or truncated array file", filename->s_name);
+    fclose(fd);
+}
+
+void garray_savecontentsto(t_garray *x, t_binbuf *b)
+{
+    t_packedpoints *p = (x->x_savebinary ? 0 : x->x_packed);
+    t_array *array = (p ? garray_doarray(x) : garray_getarray(x));
+    if (x->x_mapname)
+    {
+        binbuf_addv(b, "sss;", gensym("#A"), gensym("map"), x->x_mapname);
+        return;
+    }
     if (x->x_savesize)
-        binbuf_addv(b, "ssi;", gensym("#A"), gensym("resize"), array->a_n);
-    if (x->x_saveit)
+        binbuf_addv(b, "ssi;", gensym("#A"), gensym("resize"),
+            garray_npoints(x));
+    if (x->x_saveit && !(x->x_savebinary && garray_writebinary(x, b)))
     {
-        int n = array->a_n, n2 = 0;
+        int n = garray_npoints(x), n2 = 0;
         if (n > 200000)
             post("warning: I'm saving an array with %d points!\n", n);
         while (n2 < n)
@@ -727,7 +1364,8 @@ void garray_savecontentsto(t_garray *x, t_binbuf *b)
                 chunk = ARRAYWRITECHUNKSIZE;
             binbuf_addv(b, "si", gensym("#A"), n2);
             for (i = 0; i < chunk; i++)
-                binbuf_addv(b, "f", ((t_word *)(array->a_vec))[n2+i].w_float);
+                binbuf_addv(b, "f", (p ? packedpoints_get(p, n2+i) :
+                    ((t_word *)(array->a_vec))[n2+i].w_float));
             binbuf_addv(b, ";");
             n2 += chunk;
         }
@@ -738,7 +1376,6 @@ static void garray_save(t_gobj *z, t_binbuf *b)
 {
     int style, filestyle;
     t_garray *x = (t_garray *)z;
-    t_array *array = garray_getarray(x);
     t_template *scalartemplate;
     if (x->x_scalar->sc_template != gensym("pd-float-array"))
     {
@@ -758,8 +1395,9 @@ static void garray_save(t_gobj *z, t_binbuf *b)
     filestyle = (style == PLOTSTYLE_POINTS ? 1 :
         (style == PLOTSTYLE_POLY ? 0 : style));
     binbuf_addv(b, "sssisi;", gensym("#X"), gensym("array"),
-        x->x_name, array->a_n, &s_float,
-            x->x_saveit + 2 * filestyle + 8*x->x_hidename);
+        x->x_name, garray_npoints(x), &s_float,
+            x->x_saveit + 2 * filestyle + 8*x->x_hidename +
+                16*x->x_savebinary);
     garray_savecontentsto(x, b);
 }
 
@@ -781,20 +1419,44 @@ void garray_usedindsp(t_garray *x)
     x->x_usedindsp = 1;
 }
 
+    /* DSP objects that call this instead of garray_usedindsp() promise to
+    check garray_resizeserial() at the start of each perform routine and to
+    look the array up again if it has changed.  Resizing such an array
+    then doesn't restart DSP; the new vector and size are in place by the
+    next DSP tick since resizing happens between ticks. */
+static int garray_serial;
+
+void garray_usedindsp_resizable(t_garray *x)
+{
+    x->x_usedresizable = 1;
+}
+
+int garray_resizeserial(void)
+{
+    return (garray_serial);
+}
+
 static void garray_doredraw(t_gobj *client, t_glist *glist)
 {
     t_garray *x = (t_garray *)client;
-    if (glist_isvisible(x->x_glist) && gobj_shouldvis(client, glist))
+    if (glist_isvisible(x->x_glist) && gobj_shouldvis(client, glist) &&
+        (x->x_redrawall || !plot_redrawrange(x->x_scalar, x->x_glist,
+            garray_doarray(x), x->x_redrawonset, x->x_redrawn)))
     {
         garray_vis(&x->x_gobj, x->x_glist, 0);
         garray_vis(&x->x_gobj, x->x_glist, 1);
     }
+    x->x_redrawall = 0;
+    x->x_redrawonset = x->x_redrawn = 0;
 }
 
-void garray_redraw(t_garray *x)
+static void garray_redrawall(t_garray *x)
 {
     if (glist_isvisible(x->x_glist))
+    {
+        x->x_redrawall = 1;
         sys_queuegui(&x->x_gobj, x->x_glist, garray_doredraw);
+    }
     /* jsarlo { */
     /* this happens in garray_vis() when array is visible for
        performance reasons */
@@ -807,12 +1469,53 @@ void garray_redraw(t_garray *x)
     /* } jsarlo */
 }
 
+    /* note that points were written, for the array's summary if it has one;
+    garray_redraw() and garray_redrawrange() do this too. */
+void garray_touch(t_garray *x, int onset, int n)
+{
+    t_array *a = (x->x_packed ? 0 : garray_getarray(x));
+    if (a)
+        array_touch(a, onset, n);
+}
+
+    /* redraw only "n" points starting at "onset".  Requests pile up until the
+    GUI queue gets to us, so the redrawn part covers all of them. */
+void garray_redrawrange(t_garray *x, int onset, int n)
+{
+    if (n <= 0)
+        return;
+    garray_touch(x, onset, n);
+    if (!glist_isvisible(x->x_glist))
+    {
+        garray_redrawall(x);
+        return;
+    }
+    if (x->x_redrawn > 0)
+    {
+        int end = onset + n, oldend = x->x_redrawonset + x->x_redrawn;
+        if (onset > x->x_redrawonset)
+            onset = x->x_redrawonset;
+        if (end < oldend)
+            end = oldend;
+        n = end - onset;
+    }
+    x->x_redrawonset = onset;
+    x->x_redrawn = n;
+    sys_queuegui(&x->x_gobj, x->x_glist, garray_doredraw);
+}
+
+void garray_redraw(t_garray *x)
+{
+    garray_touch(x, 0, -1);
+    garray_redrawall(x);
+}
+
    /* This functiopn gets the template of an array; if we can't figure
    out what template an array's elements belong to we're in grave trouble
    when it's time to free or resize it.  */
 t_template *garray_template(t_garray *x)
 {
-    t_array *array = garray_getarray(x);
+    t_array *array = garray_doarray(x);
     t_template *template =
         (array ? template_findbyname(array->a_templatesym) : 0);
     if (!template)
@@ -822,13 +1525,18 @@ t_template *garray_template(t_garray *x)
 
 int garray_npoints(t_garray *x) /* get the length */
 {
-    t_array *array = garray_getarray(x);
+    t_array *array;
+    if (x->x_packed)
+        return (x->x_packed->p_n);
+    array = garray_getarray(x);
     return (array->a_n);
 }
 
 char *garray_vec(t_garray *x) /* get the contents */
 {
-    t_array *array = garray_getarray(x);
+    t_array *array;
+    garray_unshare(x);
+    array = garray_getarray(x);
     return ((char *)(array->a_vec));
 }
 
@@ -853,6 +1561,19 @@ int garray_getfloatwords(t_garray *x, int *size, t_word **vec)
     *vec =  (t_word *)garray_vec(x);
     return (1);
 }
+    /* the same for callers that only read the points, which might then
+    be shared with other arrays (see garray_share() below) */
+int garray_getfloatwords_readonly(t_garray *x, int *size, t_word **vec)
+{
+    t_array *array;
+    if (!x->x_shared)
+        return (garray_getfloatwords(x, size, vec));
+    array = garray_getarray(x);
+    *size = array->a_n;
+    *vec = (t_word *)array->a_vec;
+    return (1);
+}
+
     /* older, non-64-bit safe version, supplied for older externs */
 
 int garray_getfloatarray(t_garray *x, int *size, t_float **vec)
@@ -1009,6 +1730,20 @@ static void garray_normalize(t_garray *x, t_float f)
     garray_redraw(x);
 }
 
+    /* keep a summary for quick range queries (or stop keeping one) */
+static void garray_summary(t_garray *x, t_floatarg f)
+{
+    int yonset, elemsize;
+    t_array *array = garray_getarray_floatonly(x, &yonset, &elemsize);
+    if (!array || elemsize != sizeof(t_word))
+    {
+        pd_error(x, "%s: only arrays of single floats have summaries",
+            x->x_realname->s_name);
+        return;
+    }
+    array_setsummary(array, (f != 0));
+}
+
     /* list -- the first value is an index; subsequent values are put in
     the "y" slot of the array.  This generalizes Max's "table", sort of. */
 static void garray_list(t_garray *x, t_symbol *s, int argc, t_atom *argv)
@@ -1043,8 +1778,8 @@ static void garray_list(t_garray *x, t_symbol *s, int argc, t_atom *argv)
         for (i = 0; i < argc; i++)
             *((t_float *)(array->a_vec + elemsize * (i + firstindex)) + yonset)
                 = atom_getfloat(argv + i);
+        garray_redrawrange(x, firstindex, argc);
     }
-    garray_redraw(x);
 }
 
     /* forward a "bounds" message to the owning graph */
@@ -1252,6 +1987,462 @@ static void garray_write(t_garray *x, t_symbol *filename)
     fclose(fd);
 }
 
+    /* install a new vector of n points, redrawing the array and letting
+    DSP objects know.  The caller disposes of the old one. */
+static void garray_setvec(t_garray *x, char *vec, int n)
+{
+    t_array *array = garray_getarray(x), *a2 = array;
+    int vis = glist_isvisible(x->x_glist);
+    garray_fittograph(x, n, template_getfloat(
+        template_findbyname(x->x_scalar->sc_template),
+            gensym("style"), x->x_scalar->sc_vec, 1));
+    while (a2->a_gp.gp_stub->gs_which == GP_ARRAY)
+        a2 = a2->a_gp.gp_stub->gs_un.gs_array;
+    if (vis)
+        gobj_vis(&a2->a_gp.gp_un.gp_scalar->sc_gobj, x->x_glist, 0);
+    array->a_vec = vec;
+    array->a_n = n;
+    array->a_valid = ++glist_valid;
+    if (vis)
+        gobj_vis(&a2->a_gp.gp_un.gp_scalar->sc_gobj, x->x_glist, 1);
+    garray_serial++;
+    if (x->x_usedindsp)
+        canvas_update_dsp();
+}
+
+/* ------------------ arrays mapped from files ----------------------- */
+
+    /* "map" makes the array's points live in a file, mapped into memory
+    and shared with any other process (or Pd instance) mapping it, so that
+    huge sample sets load immediately and take no memory beyond the
+    operating system's page cache.  The file holds the points as they are
+    stored in memory: one t_word each, that is, raw native-endian floats
+    if a t_word is the size of a t_float, and otherwise floats padded to
+    the size of a pointer.  Writing to the array writes to the file. */
+
+static int garray_domap(t_garray *x, int fd, long n)
+{
+#ifdef GARRAY_MMAP
+    char *vec;
+    if (ftruncate(fd, (off_t)n * sizeof(t_word)) < 0 ||
+        (vec = (char *)mmap(0, n * sizeof(t_word), PROT_READ|PROT_WRITE,
+            MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        pd_error(x, "%s: %s", x->x_realname->s_name, strerror(errno));
+        return (0);
+    }
+    garray_setvec(x, vec, (int)n);
+    return (1);
+#else
+    return (0);
+#endif
+}
+
+    /* unmap the file; unless "keep", replace the points by a single zero */
+static void garray_unmapfile(t_garray *x, int keep)
+{
+#ifdef GARRAY_MMAP
+    t_array *array = garray_getarray(x);
+    char *oldvec = array->a_vec, *vec;
+    int n = array->a_n;
+    if (!x->x_mapname)
+        return;
+    if (keep)
+    {
+        vec = (char *)array_getbytes(n * sizeof(t_word));
+        memcpy(vec, oldvec, n * sizeof(t_word));
+        garray_setvec(x, vec, n);
+    }
+    else
+    {
+        array->a_vec = (char *)array_getbytes(sizeof(t_word));
+        array->a_n = 1;
+        array->a_valid = ++glist_valid;
+    }
+    munmap(oldvec, n * sizeof(t_word));
+    close(x->x_mapfd);
+    x->x_mapname = 0;
+#endif
+}
+
+static void garray_map(t_garray *x, t_symbol *filename, t_floatarg fsize)
+{
+#ifdef GARRAY_MMAP
+    char buf[MAXPDSTRING], *oldvec;
+    int yonset, elemsize, fd, oldn;
+    struct stat statbuf;
+    long n;
+    t_array *array = garray_getarray_floatonly(x, &yonset, &elemsize);
+    if (!array || elemsize != sizeof(t_word))
+    {
+        pd_error(x, "%s: can only map arrays of plain floats",
+            x->x_realname->s_name);
+        return;
+    }
+    canvas_makefilename(glist_getcanvas(x->x_glist), filename->s_name,
+        buf, MAXPDSTRING);
+    if ((fd = sys_open(buf, O_RDWR | O_CREAT, 0666)) < 0 ||
+        fstat(fd, &statbuf) < 0)
+    {
+        pd_error(x, "%s: %s", buf, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+        /* a size grows or shrinks the file; otherwise take its size */
+    n = (fsize >= 1 ? (long)fsize : (long)(statbuf.st_size / sizeof(t_word)));
+    if (n < 1 || n > 0x7fffffff / (long)sizeof(t_word))
+    {
+        pd_error(x, "%s: %s: file is %s", x->x_realname->s_name, buf,
+            (n < 1 ? "empty (give a size to create it)" : "too large"));
+        close(fd);
+        return;
+    }
+    oldvec = array->a_vec;
+    oldn = array->a_n;
+    if (x->x_mapname)
+    {
+        munmap(oldvec, oldn * sizeof(t_word));
+        close(x->x_mapfd);
+        x->x_mapname = 0;
+        array->a_vec = (char *)array_getbytes(sizeof(t_word));
+        array->a_n = 1;
+        oldvec = array->a_vec;
+        oldn = 1;
+    }
+    if (!garray_domap(x, fd, n))
+    {
+        close(fd);
+        return;
+    }
+    freebytes(oldvec, oldn * sizeof(t_word));
+    x->x_mapname = filename;
+    x->x_mapfd = fd;
+        /* the file, not the patch, holds the contents now */
+    x->x_saveit = 0;
+#else
+    pd_error(x, "%s: can't map files on this platform",
+        x->x_realname->s_name);
+#endif
+}
+
+static void garray_unmap(t_garray *x)
+{
+    garray_unmapfile(x, 1);
+}
+
+/* ------------- arrays sharing their points with others ------------- */
+
+    /* "soundfiler read -share" leaves all the arrays read from the same
+    part of the same file using one copy of the points.  The copies are
+    kept in a list shared by all Pd instances, each counting the arrays
+    that use it, and are freed when the last one lets go.  Anything that
+    may write to an array unshares it first, getting its own copy of the
+    points, or just taking them over if no other array uses them; this
+    happens in garray_getfloatwords(), garray_vec(), and the array's own
+    methods.  Readers that don't write call garray_getfloatwords_readonly()
+    instead.  Unsharing doesn't restart DSP: readers that took the old
+    points with garray_usedindsp() took them writably, so they can't have
+    been shared, and the others look the array up again after
+    garray_resizeserial() changes. */
+
+typedef struct _sharedwords
+{
+    char *w_key;
+    t_word *w_vec;
+    int w_n;
+    int w_refcount;
+    struct _sharedwords *w_next;
+} t_sharedwords;
+
+static t_sharedwords *garray_sharedlist;
+static pthread_mutex_t garray_sharedmutex = PTHREAD_MUTEX_INITIALIZER;
+
+    /* take an entry off the list; call with the mutex locked */
+static void sharedwords_unlink(t_sharedwords *w)
+{
+    t_sharedwords **wp;
+    for (wp = &garray_sharedlist; *wp; wp = &(*wp)->w_next)
+        if (*wp == w)
+    {
+        *wp = w->w_next;
+        break;
+    }
+}
+
+static void sharedwords_free(t_sharedwords *w, int freevec)
+{
+    if (freevec)
+        freebytes(w->w_vec, w->w_n * sizeof(t_word));
+    freebytes(w->w_key, strlen(w->w_key) + 1);
+    freebytes(w, sizeof(*w));
+}
+
+static void sharedwords_release(t_sharedwords *w)
+{
+    int last;
+    pthread_mutex_lock(&garray_sharedmutex);
+    if ((last = !--w->w_refcount))
+        sharedwords_unlink(w);
+    pthread_mutex_unlock(&garray_sharedmutex);
+    if (last)
+        sharedwords_free(w, 1);
+}
+
+    /* give the array its own points before it's written to */
+void garray_unshare(t_garray *x)
+{
+    t_sharedwords *w = x->x_shared;
+    t_array *array;
+    char *vec;
+    int last;
+    if (!w)
+        return;
+    array = garray_getarray(x);
+    pthread_mutex_lock(&garray_sharedmutex);
+    if ((last = (w->w_refcount == 1)))
+        sharedwords_unlink(w);
+    else
+    {
+            /* copy with the lock held in case another thread is about to
+            take the points over */
+        vec = (char *)array_getbytes(w->w_n * sizeof(t_word));
+        memcpy(vec, w->w_vec, w->w_n * sizeof(t_word));
+        w->w_refcount--;
+    }
+    pthread_mutex_unlock(&garray_sharedmutex);
+    x->x_shared = 0;
+    if (last)
+        sharedwords_free(w, 0);
+    else
+    {
+        array->a_vec = vec;
+        array->a_valid = ++glist_valid;
+        garray_serial++;
+    }
+}
+
+    /* let go of shared points, leaving the array a single zero */
+static void garray_dropshared(t_garray *x)
+{
+    t_array *array;
+    if (!x->x_shared)
+        return;
+    array = garray_getarray(x);
+    array->a_vec = (char *)array_getbytes(sizeof(t_word));
+    array->a_n = 1;
+    array->a_valid = ++glist_valid;
+    garray_serial++;
+    sharedwords_release(x->x_shared);
+    x->x_shared = 0;
+}
+
+    /* if points are shared under "key", make the array use them and return
+    1.  Otherwise, if "publish" is set, share the array's own points under
+    that key from now on and return 1, or else return 0.  Only arrays of
+    plain floats that aren't mapped from files can be shared. */
+int garray_share(t_garray *x, const char *key, int publish)
+{
+    t_array *array = garray_getarray(x);
+    t_sharedwords *w, *old = x->x_shared;
+    int yonset, elemsize, oldn = array->a_n;
+    char *oldvec = array->a_vec;
+    if (!garray_getarray_floatfield(x, &yonset, &elemsize) ||
+        elemsize != sizeof(t_word) || x->x_mapname)
+            return (0);
+    pthread_mutex_lock(&garray_sharedmutex);
+    for (w = garray_sharedlist; w; w = w->w_next)
+        if (!strcmp(w->w_key, key))
+            break;
+    if (w)
+    {
+        if (w == old)
+        {
+            pthread_mutex_unlock(&garray_sharedmutex);
+            return (1);
+        }
+        w->w_refcount++;
+        pthread_mutex_unlock(&garray_sharedmutex);
+        x->x_shared = w;
+        garray_setvec(x, (char *)w->w_vec, w->w_n);
+        if (old)
+            sharedwords_release(old);
+        else freebytes(oldvec, oldn * sizeof(t_word));
+        return (1);
+    }
+    else if (publish && !old)
+    {
+        w = (t_sharedwords *)getbytes(sizeof(*w));
+        w->w_key = (char *)getbytes(strlen(key) + 1);
+        strcpy(w->w_key, key);
+        w->w_vec = (t_word *)array->a_vec;
+        w->w_n = array->a_n;
+        w->w_refcount = 1;
+        w->w_next = garray_sharedlist;
+        garray_sharedlist = w;
+        x->x_shared = w;
+        pthread_mutex_unlock(&garray_sharedmutex);
+        return (1);
+    }
+    pthread_mutex_unlock(&garray_sharedmutex);
+    return (0);
+}
+
+/* ------------ arrays with points packed into 16 or 24 bits ------------ */
+
+    /* "pack 16" or "pack 24" (or "soundfiler read -pack ...") keeps the
+    points as integers times a scale factor, in a half or less of the
+    memory, for big sample sets that are only played back.  The scale is
+    chosen so that 16- or 24-bit samples read from a file come back
+    exactly, unless they go over 1, in which case the peak does.  tabread~,
+    tabread4~, tabplay~ and tabosc4~ read the packed points directly (see
+    garray_getpacked()).  Anything else gets them unpacked first, in
+    garray_getarray(), so that packing shows only in memory use and
+    resolution.  While the points are packed the array itself holds a
+    single zero, which is what gets drawn.  As with unsharing, readers that
+    took the points with garray_usedindsp_resizable() find the new ones
+    after garray_resizeserial() changes; the others get DSP restarted. */
+
+static t_float packedpoints_get(const t_packedpoints *p, int i)
+{
+    if (p->p_bytes == 2)
+        return (((const int16_t *)p->p_vec)[i] * p->p_scale);
+    else
+    {
+        const unsigned char *b = p->p_vec + 3 * i;
+        return ((((int32_t)((uint32_t)b[0] << 8 | (uint32_t)b[1] << 16 |
+            (uint32_t)b[2] << 24)) >> 8) * p->p_scale);
+    }
+}
+
+static void packedpoints_free(t_packedpoints *p)
+{
+    freebytes(p->p_vec, (size_t)p->p_n * p->p_bytes);
+    freebytes(p, sizeof(*p));
+}
+
+    /* put a new vector of n points in place of the old, which is freed */
+static void garray_replacevec(t_garray *x, char *vec, int n)
+{
+    t_array *array = garray_doarray(x);
+    freebytes(array->a_vec, array->a_n * array->a_elemsize);
+    array->a_vec = vec;
+    array->a_n = n;
+    array->a_valid = ++glist_valid;
+    garray_serial++;
+    if (x->x_usedindsp)
+        canvas_update_dsp();
+}
+
+int garray_pack(t_garray *x, int bits)
+{
+    int n, i, bytes = bits / 8;
+    double range = (bits == 24 ? 8388608. : 32768.), scale;
+    t_float peak = 0;
+    t_word *vec;
+    t_packedpoints *p;
+    char *zero;
+    if (bits != 16 && bits != 24)
+    {
+        pd_error(x, "%s: can only pack into 16 or 24 bits",
+            x->x_realname->s_name);
+        return (0);
+    }
+    if (x->x_mapname)
+    {
+        pd_error(x, "%s: can't pack a mapped array", x->x_realname->s_name);
+        return (0);
+    }
+        /* this unpacks and unshares the points if need be */
+    if (!garray_getfloatwords(x, &n, &vec))
+        return (0);
+    for (i = 0; i < n; i++)
+        if (fabs(vec[i].w_float) > peak)
+            peak = fabs(vec[i].w_float);
+    scale = (peak <= 1 ? 1. / range : peak / (range - 1));
+    p = (t_packedpoints *)getbytes(sizeof(*p));
+    if (!(p->p_vec = (unsigned char *)array_getbytes((size_t)n * bytes)) ||
+        !(zero = (char *)array_getbytes(sizeof(t_word))))
+    {
+        if (p->p_vec)
+            freebytes(p->p_vec, (size_t)n * bytes);
+        freebytes(p, sizeof(*p));
+        pd_error(x, "%s: out of memory", x->x_realname->s_name);
+        return (0);
+    }
+    p->p_n = n;
+    p->p_bytes = bytes;
+    p->p_scale = scale;
+    for (i = 0; i < n; i++)
+    {
+        double d = vec[i].w_float / scale;
+        int32_t k;
+        if (!(d >= -range))     /* also NaN */
+            d = -range;
+        else if (d > range - 1)
+            d = range - 1;
+        k = (int32_t)(d < 0 ? d - 0.5 : d + 0.5);
+        if (bytes == 2)
+            ((int16_t *)p->p_vec)[i] = k;
+        else
+        {
+            unsigned char *b = p->p_vec + 3 * i;
+            b[0] = k;
+            b[1] = k >> 8;
+            b[2] = k >> 16;
+        }
+    }
+    garray_replacevec(x, zero, 1);
+    x->x_packed = p;
+    return (1);
+}
+
+void garray_unpack(t_garray *x)
+{
+    t_packedpoints *p = x->x_packed;
+    t_word *vec;
+    int i;
+    if (!p)
+        return;
+    if (!(vec = (t_word *)array_getbytes((size_t)p->p_n * sizeof(t_word))))
+    {
+        pd_error(x, "%s: out of memory unpacking", x->x_realname->s_name);
+        return;
+    }
+    for (i = 0; i < p->p_n; i++)
+        vec[i].w_float = packedpoints_get(p, i);
+    x->x_packed = 0;
+    garray_replacevec(x, (char *)vec, p->p_n);
+    packedpoints_free(p);
+}
+
+    /* let go of packed points that are to be replaced anyway */
+static void garray_droppacked(t_garray *x)
+{
+    if (!x->x_packed)
+        return;
+    packedpoints_free(x->x_packed);
+    x->x_packed = 0;
+    garray_serial++;
+}
+
+t_packedpoints *garray_getpacked(t_garray *x)
+{
+    return (x->x_packed);
+}
+
+static void garray_pack_msg(t_garray *x, t_floatarg f)
+{
+    if (garray_pack(x, (f == 0 ? 16 : (int)f)))
+        garray_redraw(x);
+}
+
+static void garray_unpack_msg(t_garray *x)
+{
+    garray_unpack(x);
+    garray_redraw(x);
+}
+
 void garray_resize_long(t_garray *x, long n)
 {
     t_array *array = garray_getarray(x);
@@ -1259,14 +2450,60 @@ void garray_resize_long(t_garray *x, long n)
         n = 1;
     if (n == array->a_n)
         return;
+    garray_unshare(x);
+#ifdef GARRAY_MMAP
+    if (x->x_mapname)
+    {
+            /* grow or shrink the file and map it again */
+        char *oldvec = array->a_vec;
+        int oldn = array->a_n;
+        if (n > 0x7fffffff / (long)sizeof(t_word))
+            pd_error(x, "%s: too large to map", x->x_realname->s_name);
+        else if (garray_domap(x, x->x_mapfd, n))
+            munmap(oldvec, oldn * sizeof(t_word));
+        return;
+    }
+#endif
     garray_fittograph(x, (int)n, template_getfloat(
         template_findbyname(x->x_scalar->sc_template),
             gensym("style"), x->x_scalar->sc_vec, 1));
     array_resize_and_redraw(array, x->x_glist, (int)n);
+    garray_serial++;
     if (x->x_usedindsp)
         canvas_update_dsp();
 }
 
+    /* replace the contents of a one-field float array by the n points
+    at *vecp (allocated with getbytes()) in one step, as when a resize
+    would otherwise be followed by filling it in.  The old points are
+    returned in *vecp and *np for the caller to free.  A mapped array
+    is resized and the points copied into the file instead, and the caller
+    gets its own vector back. */
+int garray_exchangewords(t_garray *x, t_word **vecp, int *np)
+{
+    t_array *array = garray_getarray(x);
+    int size, n = *np;
+    t_word *vec;
+    char *oldvec;
+    garray_droppacked(x);
+    if (n < 1 || !garray_getfloatwords(x, &size, &vec))
+        return (0);
+    if (x->x_mapname)
+    {
+        garray_resize_long(x, n);
+        if (array->a_n != n)
+            return (0);
+        memcpy(array->a_vec, *vecp, n * sizeof(t_word));
+        array->a_valid = ++glist_valid;
+        return (1);
+    }
+    oldvec = array->a_vec;
+    garray_setvec(x, (char *)*vecp, n);
+    *vecp = (t_word *)oldvec;
+    *np = size;
+    return (1);
+}
+
     /* float version to use as Pd method */
 void garray_resize(t_garray *x, t_floatarg f)
 {
@@ -1283,11 +2520,22 @@ static void garray_edit(t_garray *x, t_floatarg f)
     x->x_edit = (int)f;
 }
 
+static void garray_savebinary(t_garray *x, t_floatarg f)
+{
+    x->x_savebinary = (f != 0);
+    canvas_dirty(x->x_glist, 1);
+}
+
 static void garray_print(t_garray *x)
 {
-    t_array *array = garray_getarray(x);
-    post("garray %s: template %s, length %d",
-        x->x_realname->s_name, array->a_templatesym->s_name, array->a_n);
+    t_array *array = garray_doarray(x);
+    char packed[40];
+    if (x->x_packed)
+        sprintf(packed, " (packed in %d bits)", 8 * x->x_packed->p_bytes);
+    post("garray %s: template %s, length %d%s",
+        x->x_realname->s_name, array->a_templatesym->s_name,
+            garray_npoints(x), (x->x_shared ? " (shared)" :
+                (x->x_packed ? packed : "")));
 }
 
 void g_array_setup(void)
@@ -1322,12 +2570,24 @@ void g_array_setup(void)
         A_SYMBOL, A_NULL);
     class_addmethod(garray_class, (t_method)garray_write, gensym("write"),
         A_SYMBOL, A_NULL);
+    class_addmethod(garray_class, (t_method)garray_map, gensym("map"),
+        A_SYMBOL, A_DEFFLOAT, A_NULL);
+    class_addmethod(garray_class, (t_method)garray_unmap, gensym("unmap"),
+        A_NULL);
+    class_addmethod(garray_class, (t_method)garray_pack_msg, gensym("pack"),
+        A_DEFFLOAT, A_NULL);
+    class_addmethod(garray_class, (t_method)garray_unpack_msg,
+        gensym("unpack"), A_NULL);
     class_addmethod(garray_class, (t_method)garray_resize, gensym("resize"),
         A_FLOAT, A_NULL);
     class_addmethod(garray_class, (t_method)garray_zoom, gensym("zoom"),
         A_FLOAT, 0);
     class_addmethod(garray_class, (t_method)garray_edit, gensym("edit"),
         A_FLOAT, 0);
+    class_addmethod(garray_class, (t_method)garray_readbinary,
+        gensym("readbinary"), A_SYMBOL, A_NULL);
+    class_addmethod(garray_class, (t_method)garray_savebinary,
+        gensym("savebinary"), A_FLOAT, A_NULL);
     class_addmethod(garray_class, (t_method)garray_print, gensym("print"),
         A_NULL);
     class_addmethod(garray_class, (t_method)garray_sinesum, gensym("sinesum"),
@@ -1336,6 +2596,8 @@ void g_array_setup(void)
         gensym("cosinesum"), A_GIMME, 0);
     class_addmethod(garray_class, (t_method)garray_normalize,
         gensym("normalize"), A_DEFFLOAT, 0);
+    class_addmethod(garray_class, (t_method)garray_summary,
+        gensym("summary"), A_FLOAT, 0);
     class_addmethod(garray_class, (t_method)garray_arraydialog,
         gensym("arraydialog"), A_SYMBOL, A_FLOAT, A_FLOAT, A_FLOAT, A_NULL);
 /* jsarlo { */
@@ -72,6 +72,7 @@ void gobj_displace(t_gobj *x, t_glist *glist, int dx, int dy)
 {
     if (x->g_pd->c_wb && x->g_pd->c_wb->w_displacefn)
         (*x->g_pd->c_wb->w_displacefn)(x, glist, dx, dy);
+    glist_nohitgrid(glist);
 }
 
     /* here we add an extra check whether we're mapped, because some
@@ -145,10 +146,49 @@ int gobj_shouldvis(t_gobj *x, struct _glist *glist)
     else return (1);
 }
 
+    /* in windows with more than this many objects, those out of view
+    (by more than the margin, in pixels) aren't drawn until they come into
+    view, so that opening huge patches doesn't flood the GUI */
+#define GLIST_CULLOBJECTS 1000
+#define GLIST_CULLMARGIN 256
+
+static int glist_inview(t_glist *gl, t_gobj *y)
+{
+    t_editor *e = gl->gl_editor;
+    int x1, y1, x2, y2, margin = GLIST_CULLMARGIN * gl->gl_zoom;
+    gobj_getrect(y, gl, &x1, &y1, &x2, &y2);
+    return (x2 >= e->e_viewx1 - margin && x1 <= e->e_viewx2 + margin &&
+        y2 >= e->e_viewy1 - margin && y1 <= e->e_viewy2 + margin);
+}
+
+    /* objects are redrawn whenever their shape changes, so this is also
+    where we learn that the editor's hit-testing grid is out of date */
 void gobj_vis(t_gobj *x, struct _glist *glist, int flag)
 {
+    t_object *ob;
+    glist_nohitgrid(glist);
     if (x->g_pd->c_wb && x->g_pd->c_wb->w_visfn && gobj_shouldvis(x, glist))
+    {
+        if (glist->gl_editor && glist->gl_editor->e_cull &&
+            (ob = pd_checkobject(&x->g_pd)))
+        {
+                /* erasing something never drawn, or drawing it again */
+            if (ob->te_notdrawn)
+            {
+                ob->te_notdrawn = 0;
+                glist->gl_editor->e_ndeferred--;
+                if (!flag)
+                    return;
+            }
+            if (flag && !glist_inview(glist, x))
+            {
+                ob->te_notdrawn = 1;
+                glist->gl_editor->e_ndeferred++;
+                return;
+            }
+        }
         (*x->g_pd->c_wb->w_visfn)(x, glist, flag);
+    }
 }
 
 int gobj_click(t_gobj *x, struct _glist *glist,
@@ -177,6 +217,7 @@ static void canvas_addtolist(t_canvas *x)
 
 static void canvas_takeofflist(t_canvas *x)
 {
+    canvas_update_dsp();    /* the list changed (see canvas_doevalfile()) */
         /* take it off the window list */
     if (x == pd_this->pd_canvaslist) pd_this->pd_canvaslist = x->gl_next;
     else
@@ -344,11 +385,7 @@ void canvas_rename(t_canvas *x, t_symbol *s, t_symbol *dir)
 
 int canvas_getindex(t_canvas *x, t_gobj *y)
 {
-    t_gobj *y2;
-    int indexno;
-    for (indexno = 0, y2 = x->gl_list; y2 && y2 != y; y2 = y2->g_next)
-        indexno++;
-    return (indexno);
+    return (glist_getindex(x, y));
 }
 
 void linetraverser_start(t_linetraverser *t, t_canvas *x)
@@ -794,6 +831,18 @@ void canvas_map(t_canvas *x, t_floatarg f)
                 bug("canvas_map");
                 canvas_vis(x, 1);
             }
+            t_editor *e = x->gl_editor;
+            int nobj = 0;
+            for (y = x->gl_list; y; y = y->g_next)
+                nobj++;
+                /* until the GUI says otherwise, guess that we're looking at
+                the top left of the canvas */
+            if ((e->e_cull = (nobj > GLIST_CULLOBJECTS)) && !e->e_haveview)
+            {
+                e->e_viewx1 = e->e_viewy1 = 0;
+                e->e_viewx2 = x->gl_screenx2 - x->gl_screenx1;
+                e->e_viewy2 = x->gl_screeny2 - x->gl_screeny1;
+            }
             for (y = x->gl_list; y; y = y->g_next)
                 gobj_vis(y, x, 1);
             x->gl_mapped = 1;
@@ -802,7 +851,23 @@ void canvas_map(t_canvas *x, t_floatarg f)
             canvas_drawlines(x);
             if (x->gl_isgraph && x->gl_goprect)
                 canvas_drawredrect(x, 1);
-            sys_vgui("pdtk_canvas_getscroll .x%lx.c\n", x);
+                /* if we left anything out, the scroll region still has to
+                cover it */
+            if (e->e_ndeferred)
+            {
+                int x1, y1, x2, y2, bx1 = 0, by1 = 0, bx2 = 0, by2 = 0;
+                for (y = x->gl_list; y; y = y->g_next)
+                {
+                    gobj_getrect(y, x, &x1, &y1, &x2, &y2);
+                    if (x1 < bx1) bx1 = x1;
+                    if (y1 < by1) by1 = y1;
+                    if (x2 > bx2) bx2 = x2;
+                    if (y2 > by2) by2 = y2;
+                }
+                sys_vgui("pdtk_canvas_setextent .x%lx.c %d %d %d %d\n", x,
+                    bx1, by1, bx2, by2);
+            }
+            else sys_vgui("pdtk_canvas_setextent .x%lx.c\n", x);
         }
     }
     else
@@ -816,6 +881,7 @@ void canvas_map(t_canvas *x, t_floatarg f)
             }
                 /* just clear out the whole canvas */
             sys_vgui(".x%lx.c delete all\n", x);
+            glist_undefer(x);
             x->gl_mapped = 0;
         }
     }
@@ -899,6 +965,7 @@ void canvas_free(t_canvas *x)
     t_gobj *y;
     t_canvas_private*private = x->gl_privatedata;
     int dspstate = canvas_suspend_dsp();
+    canvas_unfreeze(x);
     canvas_noundo(x);
     if (canvas_whichfind == x)
         canvas_whichfind = 0;
@@ -917,6 +984,7 @@ void canvas_free(t_canvas *x)
         freebytes(x->gl_env, sizeof(*x->gl_env));
     }
     canvas_undo_free(x);
+    glist_freeindex(x);
     freebytes(private, sizeof(*private));
     canvas_resume_dsp(dspstate);
     freebytes(x->gl_xlabel, x->gl_nxlabels * sizeof(*(x->gl_xlabel)));
@@ -925,31 +993,104 @@ void canvas_free(t_canvas *x)
     gfxstub_deleteforkey(x);        /* probably unnecessary */
     if (!x->gl_owner && !x->gl_isclone)
         canvas_takeofflist(x);
+    mem_canvasfreed(x);
 }
 
 /* ----------------- lines ---------- */
 
+static void canvas_drawline(t_canvas *x, t_linetraverser *t,
+    t_outconnect *oc)
+{
+    sys_vgui(
+        ".x%lx.c create line %d %d %d %d -width %d -tags [list l%lx cord]\n",
+        glist_getcanvas(x),
+        t->tr_lx1, t->tr_ly1, t->tr_lx2, t->tr_ly2,
+        (outlet_getsymbol(t->tr_outlet) == &s_signal ? 2:1) * x->gl_zoom,
+        oc);
+}
+
+    /* a connection is drawn as soon as either end of it is */
 static void canvas_drawlines(t_canvas *x)
 {
     t_linetraverser t;
     t_outconnect *oc;
+    linetraverser_start(&t, x);
+    while ((oc = linetraverser_next(&t)))
+        if (!t.tr_ob->te_notdrawn || !t.tr_ob2->te_notdrawn)
+            canvas_drawline(x, &t, oc);
+}
+
+    /* draw whatever was put off and has now come into view, and the
+    connections that had neither end drawn before */
+void glist_drawdeferred(t_glist *x)
+{
+    t_editor *e = x->gl_editor;
+    t_linetraverser t;
+    t_outconnect *oc;
+    t_gobj *y;
+    t_object *ob;
+    if (!e || !e->e_ndeferred)
+        return;
+    for (y = x->gl_list; y; y = y->g_next)
+        if ((ob = pd_checkobject(&y->g_pd)) && ob->te_notdrawn &&
+            glist_inview(x, y))
     {
-        linetraverser_start(&t, x);
-        while ((oc = linetraverser_next(&t)))
-            sys_vgui(
-        ".x%lx.c create line %d %d %d %d -width %d -tags [list l%lx cord]\n",
-                glist_getcanvas(x),
-                t.tr_lx1, t.tr_ly1, t.tr_lx2, t.tr_ly2,
-                (outlet_getsymbol(t.tr_outlet) == &s_signal ? 2:1) * x->gl_zoom,
-                oc);
+        (*y->g_pd->c_wb->w_visfn)(y, x, 1);
+        if (glist_isselected(x, y))
+            gobj_select(y, x, 1);
     }
+    linetraverser_start(&t, x);
+    while ((oc = linetraverser_next(&t)))
+        if (t.tr_ob->te_notdrawn && t.tr_ob2->te_notdrawn &&
+            (glist_inview(x, &t.tr_ob->te_g) ||
+                glist_inview(x, &t.tr_ob2->te_g)))
+                    canvas_drawline(x, &t, oc);
+    for (y = x->gl_list; y; y = y->g_next)
+        if ((ob = pd_checkobject(&y->g_pd)) && ob->te_notdrawn &&
+            glist_inview(x, y))
+    {
+        ob->te_notdrawn = 0;
+        e->e_ndeferred--;
+    }
+    if (!e->e_ndeferred)
+        sys_vgui("pdtk_canvas_setextent .x%lx.c\n", x);
+}
+
+    /* forget what was put off, once the window's contents are gone */
+void glist_undefer(t_glist *x)
+{
+    t_gobj *y;
+    t_object *ob;
+    if (!x->gl_editor || !x->gl_editor->e_ndeferred)
+        return;
+    for (y = x->gl_list; y; y = y->g_next)
+        if ((ob = pd_checkobject(&y->g_pd)))
+            ob->te_notdrawn = 0;
+    x->gl_editor->e_ndeferred = 0;
+}
+
+    /* the GUI tells us which part of the canvas is in the window */
+static void canvas_viewport(t_canvas *x, t_floatarg x1, t_floatarg y1,
+    t_floatarg x2, t_floatarg y2)
+{
+    t_editor *e = x->gl_editor;
+    if (!e)
+        return;
+    e->e_viewx1 = x1;
+    e->e_viewy1 = y1;
+    e->e_viewx2 = x2;
+    e->e_viewy2 = y2;
+    e->e_haveview = 1;
+    if (glist_isvisible(x))
+        glist_drawdeferred(x);
 }
 
 void canvas_fixlinesfor(t_canvas *x, t_text *text)
 {
     t_linetraverser t;
     t_outconnect *oc;
-    
+
+    glist_nohitgrid(x);
     linetraverser_start(&t, x);
     while ((oc = linetraverser_next(&t)))
     {
@@ -962,46 +1103,65 @@ void canvas_fixlinesfor(t_canvas *x, t_text *text)
     }
 }
 
-    /* kill all lines for the object */
-void canvas_deletelinesfor(t_canvas *x, t_text *text)
+    /* kill lines from one object's outlets that either go to "to" (or
+    anywhere if "to" is zero) or come from outlet "outp" (any if "all" is
+    set), or that go to inlet "inp" of "to" (any if "all"). */
+static void canvas_deletelinesfrom(t_canvas *x, t_object *from,
+    t_object *to, t_inlet *inp, t_outlet *outp, int all)
 {
-    t_linetraverser t;
-    t_outconnect *oc;
-    linetraverser_start(&t, x);
-    while ((oc = linetraverser_next(&t)))
+    int outno, nout = obj_noutlets(from);
+    for (outno = 0; outno < nout; outno++)
     {
-        if (t.tr_ob == text || t.tr_ob2 == text)
+        t_outlet *out;
+        t_outconnect *oc = obj_starttraverseoutlet(from, &out, outno), *oc2;
+        while (oc)
         {
-            if (glist_isvisible(x))
+            t_object *dest;
+            t_inlet *in;
+            int inno;
+            oc2 = obj_nexttraverseoutlet(oc, &dest, &in, &inno);
+            if (to ? (dest == to && (all || in == inp)) :
+                (all || out == outp))
             {
-                sys_vgui(".x%lx.c delete l%lx\n",
-                    glist_getcanvas(x), oc);
+                if (glist_isvisible(x))
+                {
+                    sys_vgui(".x%lx.c delete l%lx\n",
+                        glist_getcanvas(x), oc);
+                }
+                obj_disconnect(from, outno, dest, inno);
+                glist_forgetline(x, from, dest);
             }
-            obj_disconnect(t.tr_ob, t.tr_outno, t.tr_ob2, t.tr_inno);
+            oc = oc2;
         }
     }
 }
 
+    /* kill lines into and out of an object.  The glist's index tells us
+    which objects have lines into it, so that we don't have to look at
+    every object's outlets; otherwise deleting a whole patch would take
+    time proportional to the square of its size. */
+static void canvas_dodeletelines(t_canvas *x, t_text *text,
+    t_inlet *inp, t_outlet *outp, int all)
+{
+    int n, i;
+    t_object **sources = glist_linesources(x, text, &n);
+    canvas_deletelinesfrom(x, text, 0, inp, outp, all);
+    for (i = 0; i < n; i++)
+        if (!i || sources[i] != sources[i-1])
+            canvas_deletelinesfrom(x, sources[i], text, inp, outp, all);
+}
+
+    /* kill all lines for the object */
+void canvas_deletelinesfor(t_canvas *x, t_text *text)
+{
+    canvas_dodeletelines(x, text, 0, 0, 1);
+}
+
     /* kill all lines for one inlet or outlet */
 void canvas_deletelinesforio(t_canvas *x, t_text *text,
     t_inlet *inp, t_outlet *outp)
 {
-    t_linetraverser t;
-    t_outconnect *oc;
-    linetraverser_start(&t, x);
-    while ((oc = linetraverser_next(&t)))
-    {
-        if ((t.tr_ob == text && t.tr_outlet == outp) ||
-            (t.tr_ob2 == text && t.tr_inlet == inp))
-        {
-            if (glist_isvisible(x))
-            {
-                sys_vgui(".x%lx.c delete l%lx\n",
-                    glist_getcanvas(x), oc);
-            }
-            obj_disconnect(t.tr_ob, t.tr_outno, t.tr_ob2, t.tr_inno);
-        }
-    }
+    canvas_dodeletelines(x, text, inp, outp, 0);
 }
 
 typedef void (*t_zoomfn)(void *x, t_floatarg arg1);
@@ -1316,6 +1476,7 @@ EXTERN_STRUCT _dspcontext;
 
 void ugen_start(void);
 void ugen_stop(void);
+void ugen_restart(void);
 
 t_dspcontext *ugen_start_graph(int toplevel, t_signal **sp,
     int ninlets, int noutlets);
@@ -1323,6 +1484,9 @@ void ugen_add(t_dspcontext *dc, t_object *x);
 void ugen_connect(t_dspcontext *dc, t_object *x1, int outno,
     t_object *x2, int inno);
 void ugen_done_graph(t_dspcontext *dc);
+int ugen_addtemplate(t_dspcontext *dc, t_glist *x);
+int canvas_freezedsp(t_canvas *gl, t_dspcontext *dc);
+int canvas_standindsp(t_canvas *gl, t_signal **sp);
 
     /* schedule one canvas for DSP.  This is called below for all "root"
     canvases, but is also called from the "dsp" method for sub-
@@ -1336,6 +1500,17 @@ void canvas_dodsp(t_canvas *x, int toplevel, t_signal **sp)
     t_object *ob;
     t_symbol *dspsym = gensym("dsp");
     t_dspcontext *dc;
+    t_memowner owner;
+
+        /* memory allocated while sorting belongs to this canvas */
+    mem_pushowner(&owner, x, 0);
+
+        /* a subpatch released by its switch~ is left out altogether */
+    if (!toplevel && !x->gl_freeze && canvas_standindsp(x, sp))
+    {
+        mem_popowner(&owner);
+        return;
+    }
 
         /* create a new "DSP graph" object to use in sorting this canvas.
         If we aren't toplevel, there are already other dspcontexts around. */
@@ -1344,20 +1519,31 @@ void canvas_dodsp(t_canvas *x, int toplevel, t_signal **sp)
         obj_nsiginlets(&x->gl_obj),
         obj_nsigoutlets(&x->gl_obj));
 
-        /* find all the "dsp" boxes and add them to the graph */
+        /* a frozen subpatch only plays back what it rendered */
+    if (x->gl_freeze && canvas_freezedsp(x, dc))
+        ;
+        /* a canvas laid out like one sorted before (another copy of the
+        same abstraction, usually) is made from that one's template */
+    else if (!toplevel && ugen_addtemplate(dc, x))
+        ;
+    else
+    {
+            /* find all the "dsp" boxes and add them to the graph */
 
-    for (y = x->gl_list; y; y = y->g_next)
-        if ((ob = pd_checkobject(&y->g_pd)) && zgetfn(&y->g_pd, dspsym))
-            ugen_add(dc, ob);
+        for (y = x->gl_list; y; y = y->g_next)
+            if ((ob = pd_checkobject(&y->g_pd)) && zgetfn(&y->g_pd, dspsym))
+                ugen_add(dc, ob);
 
-        /* ... and all dsp interconnections */
-    linetraverser_start(&t, x);
-    while ((oc = linetraverser_next(&t)))
-        if (obj_issignaloutlet(t.tr_ob, t.tr_outno))
-            ugen_connect(dc, t.tr_ob, t.tr_outno, t.tr_ob2, t.tr_inno);
+            /* ... and all dsp interconnections */
+        linetraverser_start(&t, x);
+        while ((oc = linetraverser_next(&t)))
+            if (obj_issignaloutlet(t.tr_ob, t.tr_outno))
+                ugen_connect(dc, t.tr_ob, t.tr_outno, t.tr_ob2, t.tr_inno);
+    }
 
         /* finally, sort them and add them to the DSP chain */
     ugen_done_graph(dc);
+    mem_popowner(&owner);
 }
 
 static void canvas_dsp(t_canvas *x, t_signal **sp)
@@ -1367,24 +1553,63 @@ static void canvas_dsp(t_canvas *x, t_signal **sp)
 
 int canvas_dspstate;    /* for back compatibility with externs - don't use */
 
-    /* this routine starts DSP for all root canvases. */
-static void canvas_start_dsp(void)
+    /* schedule a root canvas, marking it for the profiler and for tracing
+    if they're on */
+static void canvas_dorootdsp(t_canvas *x)
 {
-    t_canvas *x;
-    if (THISGUI->i_dspstate) ugen_stop();
-    else sys_gui("pdtk_pd_dsp ON\n");
-    ugen_start();
+    void *rec = ugen_profilebegin(&x->gl_obj);
+    sys_tracedspbegin(x);
+    canvas_dodsp(x, 1, 0);
+    sys_tracedspend(x);
+    ugen_profileend(rec);
+}
 
-    for (x = pd_getcanvaslist(); x; x = x->gl_next)
-        canvas_dodsp(x, 1, 0);
+    /* this routine starts DSP for all root canvases.  If "resort" is set,
+    and DSP is already running (or its chain was kept by "pd dsp 0"), we're
+    only resorting, so the signals of the old DSP chain may be kept and
+    reused by the new one. */
+static void canvas_dostart_dsp(int resort)
+{
+    t_canvas *x;
+    void *section;
+    THISGUI->i_dspupdate = 0;
+    if (!THISGUI->i_dspstate)
+        sys_gui("pdtk_pd_dsp ON\n");
+    if ((THISGUI->i_dspstate || THISGUI->i_dspkept) && resort)
+        ugen_restart();
+    else ugen_start();
+    THISGUI->i_dspkept = 0;
+    pd_findcache(1);
+
+        /* if there are DSP threads, root canvases are computed in
+        parallel; their dac~ outputs are summed after all are done. */
+    if ((section = (pd_getcanvaslist() && pd_getcanvaslist()->gl_next ?
+        ugen_beginsection() : 0)))
+    {
+        for (x = pd_getcanvaslist(); x; x = x->gl_next)
+        {
+            ugen_nexttask(section);
+            canvas_dorootdsp(x);
+        }
+        ugen_endsection(section);
+    }
+    else for (x = pd_getcanvaslist(); x; x = x->gl_next)
+        canvas_dorootdsp(x);
+    pd_findcache(0);
 
     canvas_dspstate = THISGUI->i_dspstate = 1;
     if (gensym("pd-dsp-started")->s_thing)
         pd_bang(gensym("pd-dsp-started")->s_thing);
 }
 
+static void canvas_start_dsp(void)
+{
+    canvas_dostart_dsp(0);
+}
+
 static void canvas_stop_dsp(void)
 {
+    THISGUI->i_dspupdate = 0;
     if (THISGUI->i_dspstate)
     {
         ugen_stop();
@@ -1395,6 +1620,37 @@ static void canvas_stop_dsp(void)
     }
 }
 
+    /* "pd dsp 0" only sets the DSP chain aside.  Anything that would have
+    resorted it in the meantime marks it out of date (see canvas_update_dsp()
+    and canvas_suspend_dsp()); if nothing did, "pd dsp 1" takes it up again
+    as it was, and otherwise resorts it, reusing its signals. */
+static void canvas_pause_dsp(void)
+{
+    if (THISGUI->i_dspstate)
+    {
+        ugen_pause();
+        THISGUI->i_dspkept = 1;
+        sys_gui("pdtk_pd_dsp OFF\n");
+        canvas_dspstate = THISGUI->i_dspstate = 0;
+        if (gensym("pd-dsp-stopped")->s_thing)
+            pd_bang(gensym("pd-dsp-stopped")->s_thing);
+    }
+}
+
+static void canvas_continue_dsp(void)
+{
+    if (THISGUI->i_dspkept && !THISGUI->i_dspupdate)
+    {
+        ugen_resume();
+        THISGUI->i_dspkept = 0;
+        sys_gui("pdtk_pd_dsp ON\n");
+        canvas_dspstate = THISGUI->i_dspstate = 1;
+        if (gensym("pd-dsp-started")->s_thing)
+            pd_bang(gensym("pd-dsp-started")->s_thing);
+    }
+    else canvas_dostart_dsp(1);
+}
+
     /* DSP can be suspended before, and resumed after, operations which
     might affect the DSP chain.  For example, we suspend before loading and
     resume afterward, so that DSP doesn't get resorted for every DSP object
@@ -1404,6 +1660,7 @@ int canvas_suspend_dsp(void)
 {
     int rval = THISGUI->i_dspstate;
     if (rval) canvas_stop_dsp();
+    else if (THISGUI->i_dspkept) THISGUI->i_dspupdate = 1;
     return (rval);
 }
 
@@ -1412,10 +1669,74 @@ void canvas_resume_dsp(int oldstate)
     if (oldstate) canvas_start_dsp();
 }
 
-    /* this is equivalent to suspending and resuming in one step. */
+    /* this is equivalent to suspending and resuming in one step, except
+    that the actual resorting is put off until the next DSP tick (see
+    canvas_flush_dsp() below.)  That way, a patch that makes many
+    connections or deletions in a row, as in dynamic patching, only gets
+    resorted once. */
 void canvas_update_dsp(void)
 {
-    if (THISGUI->i_dspstate) canvas_start_dsp();
+    if (THISGUI->i_dspstate || THISGUI->i_dspheld || THISGUI->i_dspkept)
+        THISGUI->i_dspupdate = 1;
+}
+
+    /* same, for a new signal connection, unless it's in a patch being
+    opened, which isn't on the DSP chain yet */
+void canvas_update_dspconnect(void)
+{
+    if (!THISGUI->i_dspopening)
+        canvas_update_dsp();
+}
+
+    /* hold off stopping or resorting DSP while making objects that the
+    running DSP chain doesn't refer to, such as new copies that clone
+    schedules on a chain of their own, or a newly opened patch.  Calls to
+    canvas_suspend_dsp() in the meantime do nothing, but if anything asks
+    for the chain to be resorted it still will be.  Pass the return value
+    to canvas_releasedsp(), which returns 1 if DSP is running and the chain
+    can be kept as it is, so that the new objects can be scheduled by
+    themselves. */
+int canvas_holddsp(void)
+{
+    int held = THISGUI->i_dspstate + 2 * THISGUI->i_dspupdate;
+    THISGUI->i_dspstate = THISGUI->i_dspupdate = 0;
+    THISGUI->i_dspheld++;
+    return (held);
+}
+
+int canvas_releasedsp(int held)
+{
+    THISGUI->i_dspheld--;
+        /* if DSP was started meanwhile (by a loadbang for instance) the
+        chain is new and already has everything */
+    if (THISGUI->i_dspstate)
+        return (0);
+    THISGUI->i_dspstate = (held & 1);
+    if (!THISGUI->i_dspstate && !THISGUI->i_dspheld && !THISGUI->i_dspkept)
+        THISGUI->i_dspupdate = 0;
+    else if (held & 2)
+        THISGUI->i_dspupdate = 1;
+    return (THISGUI->i_dspstate && !THISGUI->i_dspupdate);
+}
+
+    /* schedule a root canvas made while DSP was held on a chain of its
+    own, and run that at the end of the DSP chain until it's next sorted */
+static void canvas_adddsp(t_canvas *x)
+{
+    void *z = ugen_beginsubchain(0, 0, 0);
+    t_int *chain;
+    int size;
+    canvas_dorootdsp(x);
+    chain = ugen_endsubchain(z, &size);
+    ugen_appendsubchain(chain, size);
+}
+
+    /* resort the DSP chain if canvas_update_dsp() was called since the
+    last time.  This must happen before anyone runs the DSP chain, which
+    might still refer to objects that have since been deleted. */
+void canvas_flush_dsp(void)
+{
+    if (THISGUI->i_dspupdate && THISGUI->i_dspstate) canvas_dostart_dsp(1);
 }
 
 /* the "dsp" message to pd starts and stops DSP somputation, and, if
@@ -1436,11 +1757,11 @@ void glob_dsp(void *dummy, t_symbol *s, int argc, t_atom *argv)
         if (newstate && !THISGUI->i_dspstate)
         {
             sys_set_audio_state(1);
-            canvas_start_dsp();
+            canvas_continue_dsp();
         }
         else if (!newstate && THISGUI->i_dspstate)
         {
-            canvas_stop_dsp();
+            canvas_pause_dsp();
             if (!audio_shouldkeepopen())
                 sys_set_audio_state(0);
         }
@@ -2004,6 +2325,7 @@ extern void glist_scalar(t_glist *canvas, t_symbol *s, int argc, t_atom *argv);
 void g_graph_setup(void);
 void g_editor_setup(void);
 void g_readwrite_setup(void);
+void g_freeze_setup(void);
 extern void canvas_properties(t_gobj *z, t_glist *canvas);
 
 void g_canvas_setup(void)
@@ -2084,6 +2406,8 @@ void g_canvas_setup(void)
         gensym("menu-open"), A_NULL);
     class_addmethod(canvas_class, (t_method)canvas_map,
         gensym("map"), A_FLOAT, A_NULL);
+    class_addmethod(canvas_class, (t_method)canvas_viewport,
+        gensym("viewport"), A_FLOAT, A_FLOAT, A_FLOAT, A_FLOAT, A_NULL);
     class_addmethod(canvas_class, (t_method)canvas_dirty,
         gensym("dirty"), A_FLOAT, A_NULL);
     class_setpropertiesfn(canvas_class, canvas_properties);
@@ -2116,6 +2440,7 @@ void g_canvas_setup(void)
     g_graph_setup();
     g_editor_setup();
     g_readwrite_setup();
+    g_freeze_setup();
 }
 
     /* functions to add basic gui (e.g., clicking but not editing) to things
@@ -2144,11 +2469,13 @@ void canvas_add_for_class(t_class *c)
 void g_canvas_newpdinstance(void)
 {
     THISGUI = getbytes(sizeof(*THISGUI));
+    mem_addsymbolroot(THISGUI, sizeof(*THISGUI));
     THISGUI->i_newfilename = THISGUI->i_newdirectory = &s_;
     THISGUI->i_newargc = 0;
     THISGUI->i_newargv = 0;
     THISGUI->i_reloadingabstraction = 0;
-    THISGUI->i_dspstate = 0;
+    THISGUI->i_dspstate = THISGUI->i_dspupdate = 0;
+    THISGUI->i_dspheld = THISGUI->i_dspopening = THISGUI->i_dspkept = 0;
     THISGUI->i_dollarzero = 1000;
     g_editor_newpdinstance();
     g_template_newpdinstance();
@@ -2158,6 +2485,7 @@ void g_canvas_freepdinstance(void)
 {
     g_editor_freepdinstance();
     g_template_freepdinstance();
+    mem_removesymbolroot(THISGUI);
     freebytes(THISGUI, sizeof(*THISGUI));
 }
 
@@ -2170,20 +2498,24 @@ void pd_doloadbang(void);
 
     /* evaluate a file, which is expected to create a patch, and perform
     post-evaluation cleanup and loadbang */
-t_pd *glob_evalfile(t_pd *ignore, t_symbol *name, t_symbol *dir)
+static t_pd *canvas_doevalfile(t_binbuf *b, t_symbol *name, t_symbol *dir)
 {
     t_pd *x = 0, *boundx;
-    int dspstate;
+    t_canvas *was = pd_getcanvaslist(), *gl;
+    int held;
 
-        /* even though binbuf_evalfile appears to take care of dspstate,
-        we have to do it again here, because canvas_startdsp() assumes
-        that all toplevel canvases are visible.  LATER check if this
-        is still necessary -- probably not. */
-    dspstate = canvas_suspend_dsp();
+        /* rather than stopping DSP and starting it again for all patches,
+        hold it, and if nothing in the new patch needs the old ones to be
+        resorted, add the new root canvases to the running chain. */
+    held = canvas_holddsp();
     boundx = s__X.s_thing;
         s__X.s_thing = 0;       /* don't save #X; we'll need to leave it bound
                                 for the caller to grab it. */
-    binbuf_evalfile(name, dir);
+    THISGUI->i_dspopening++;
+    if (b)
+        binbuf_evalpatch(b, name, dir);
+    else binbuf_evalfile(name, dir);
+    THISGUI->i_dspopening--;
     while ((x != s__X.s_thing) && s__X.s_thing)
     {
         x = s__X.s_thing;
@@ -2191,11 +2523,31 @@ t_pd *glob_evalfile(t_pd *ignore, t_symbol *name, t_symbol *dir)
     }
     if (!sys_noloadbang)
         pd_doloadbang();
-    canvas_resume_dsp(dspstate);
+    if (canvas_releasedsp(held))
+    {
+            /* new root canvases are at the head of the list */
+        for (gl = pd_getcanvaslist(); gl && gl != was; gl = gl->gl_next)
+            canvas_adddsp(gl);
+    }
+        /* a chain kept by "pd dsp 0" doesn't have them */
+    else if (THISGUI->i_dspkept && pd_getcanvaslist() != was)
+        canvas_update_dsp();
     s__X.s_thing = boundx;
     return x;
 }
 
+t_pd *glob_evalfile(t_pd *ignore, t_symbol *name, t_symbol *dir)
+{
+    return (canvas_doevalfile(0, name, dir));
+}
+
+    /* same for a patch that's already in a binbuf, as if it had been read
+    from "name" in "dir" */
+t_pd *glob_evalpatch(t_binbuf *b, t_symbol *name, t_symbol *dir)
+{
+    return (canvas_doevalfile(b, name, dir));
+}
+
     /* open a file as if from an open dialog from the GUI.  If the optional
     argument "f" is nonzero, first check if the file is already open and if
     so, just "vis" it.  This would be useful if you want merely to make sure a
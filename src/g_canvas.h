@@ -125,6 +125,17 @@ typedef struct _editor
     t_clock *e_clock;               /* clock to filter GUI move messages */
     int e_xnew;                     /* xpos for next move event */
     int e_ynew;                     /* ypos, similarly */
+    struct _hitgrid *e_hitgrid;     /* where objects are, for hit testing */
+    unsigned int e_cull: 1;         /* one to put off drawing out of view */
+    unsigned int e_haveview: 1;     /* one if the GUI told us what's in view */
+    int e_ndeferred;                /* objects not drawn yet */
+    int e_viewx1;                   /* visible part of the canvas */
+    int e_viewy1;
+    int e_viewx2;
+    int e_viewy2;
+    t_rtext **e_rtexthash;          /* rtexts by owner, for glist_findrtext */
+    int e_rtexthashsize;            /* number of buckets, a power of two */
+    int e_nrtext;                   /* number of rtexts */
 } t_editor;
 
 #define MA_NONE    0    /* e_onmotion: do nothing on mouse motion */
@@ -205,6 +216,8 @@ struct _glist
     unsigned int gl_isclone:1;      /* exists as part of a clone object */
     int gl_zoom;                    /* zoom factor (integer zoom-in only) */
     void *gl_privatedata;           /* private data */
+    struct _glistindex *gl_index;   /* for finding objects by number */
+    struct _freeze *gl_freeze;      /* rendered to arrays; see g_freeze.c */
 };
 
 #define gl_gobj gl_obj.te_g
@@ -232,6 +245,7 @@ typedef struct _template
     int t_n;                    /* number of dataslots (fields) */
     t_dataslot *t_vec;          /* array of dataslots */
     struct _template *t_next;
+    int t_columns;              /* store arrays of these by field */
 } t_template;
 
 struct _array
@@ -243,8 +257,24 @@ struct _array
     int a_valid;        /* protection against stale pointers into array */
     t_gpointer a_gp;    /* pointer to scalar or array element we're in */
     t_gstub *a_stub;    /* stub for pointing into this array */
+    int a_columns;      /* stored by field (see below) */
+    struct _arraysummary *a_summary;    /* optional, see array_setsummary() */
 };
 
+/* Arrays whose element template was declared with "struct -columns" (which
+is only allowed if all its fields are floats) are stored by field: each field
+is a contiguous vector of a_n words, so that reading one field across the
+array is a streaming read.  Element i of field j is then word (j * a_n + i)
+of a_vec instead of word (j + i * a_elemsize/sizeof(t_word)).  For a field
+at byte "onset" in the template, elements are ARRAY_STRIDE() bytes apart,
+starting at ARRAY_FIELD(); a gpointer to element i points to word i. */
+
+#define ARRAY_STRIDE(a) \
+    ((a)->a_columns ? (int)sizeof(t_word) : (a)->a_elemsize)
+#define ARRAY_ONSET(a, onset) \
+    ((a)->a_columns ? (onset) * (a)->a_n : (onset))
+#define ARRAY_FIELD(a, onset) ((a)->a_vec + ARRAY_ONSET(a, onset))
+
     /* structure for traversing all the connections in a glist */
 typedef struct _linetraverser
 {
@@ -274,6 +304,10 @@ struct _instancecanvas
     t_atom *i_newargv;
     t_glist *i_reloadingabstraction;
     int i_dspstate;
+    int i_dspupdate;        /* DSP chain needs resorting before next tick */
+    int i_dspheld;          /* canvas_holddsp() calls not yet released */
+    int i_dspopening;       /* making a patch that isn't on the chain yet */
+    int i_dspkept;          /* DSP chain kept after "pd dsp 0" */
     int i_dollarzero;
     t_float i_graph_lastxpix, i_graph_lastypix;
 };
@@ -410,6 +444,16 @@ EXTERN void glist_deselect(t_glist *x, t_gobj *y);
 EXTERN void glist_noselect(t_glist *x);
 EXTERN void glist_selectall(t_glist *x);
 EXTERN void glist_delete(t_glist *x, t_gobj *y);
+EXTERN t_gobj *glist_nth(t_glist *x, int n);
+EXTERN int glist_getindex(t_glist *x, t_gobj *y);
+EXTERN t_scalar **glist_getscalars(t_glist *x, int *np);
+EXTERN void glist_noindex(t_glist *x);
+EXTERN t_object **glist_linesources(t_glist *x, t_object *ob, int *np);
+EXTERN void glist_forgetline(t_glist *x, t_object *from, t_object *to);
+EXTERN void glist_nohitgrid(t_glist *x);
+EXTERN void glist_drawdeferred(t_glist *x);
+EXTERN void glist_undefer(t_glist *x);
+EXTERN void glist_freeindex(t_glist *x);
 EXTERN void glist_retext(t_glist *x, t_text *y);
 EXTERN void glist_grab(t_glist *x, t_gobj *y, t_glistmotionfn motionfn,
     t_glistkeyfn keyfn, int xpos, int ypos);
@@ -523,6 +567,8 @@ EXTERN void canvas_loadbang(t_canvas *x);
 EXTERN int canvas_hitbox(t_canvas *x, t_gobj *y, int xpos, int ypos,
     int *x1p, int *y1p, int *x2p, int *y2p);
 EXTERN int canvas_setdeleting(t_canvas *x, int flag);
+EXTERN int canvas_holddsp(void);
+EXTERN int canvas_releasedsp(int held);
 
 #define LB_LOAD 0       /* "loadbang" actions - 0 for original meaning */
 #define LB_INIT 1       /* loaded but not yet connected to parent patch */
@@ -533,6 +579,7 @@ typedef int (*t_undofn)(t_canvas *canvas, void *buf,
 #define UNDO_FREE 0                     /* free current undo/redo buffer */
 #define UNDO_UNDO 1                     /* undo */
 #define UNDO_REDO 2                     /* redo */
+#define UNDO_SIZE 3                     /* return bytes held by the buffer */
 EXTERN void canvas_setundo(t_canvas *x, t_undofn undofn, void *buf,
     const char *name);
 EXTERN void canvas_noundo(t_canvas *x);
@@ -563,20 +610,63 @@ EXTERN void linetraverser_skipobject(t_linetraverser *t);
 /* --------- functions on garrays (graphical arrays) -------------------- */
 
 EXTERN t_template *garray_template(t_garray *x);
+EXTERN int garray_exchangewords(t_garray *x, t_word **vecp, int *np);
+EXTERN int garray_share(t_garray *x, const char *key, int publish);
+EXTERN void garray_unshare(t_garray *x);
+EXTERN t_symbol *garray_getrealname(t_garray *x);
+
+    /* points of an array packed into 16- or 24-bit integers, each standing
+    for that many times p_scale.  16-bit points are int16_t; 24-bit ones are
+    three bytes each, least significant first.  See garray_pack(). */
+typedef struct _packedpoints
+{
+    int p_n;                /* number of points */
+    int p_bytes;            /* bytes per point, 2 or 3 */
+    t_float p_scale;        /* value of one step */
+    unsigned char *p_vec;
+} t_packedpoints;
+
+EXTERN int garray_pack(t_garray *x, int bits);
+EXTERN void garray_unpack(t_garray *x);
+EXTERN t_packedpoints *garray_getpacked(t_garray *x);
 
 /* -------------------- arrays --------------------- */
 #define GRAPH_ARRAY_SAVE 1      /* flags for graph_array() below */
 #define GRAPH_ARRAY_PLOTSTYLE 6 /* 2-bit field, PLOTSTYLE_POINTS, etc */
 #define GRAPH_ARRAY_SAVESIZE 8  /* save size as well as contents */
+#define GRAPH_ARRAY_SAVEBINARY 16   /* save contents to a binary file */
 
 EXTERN t_garray *graph_array(t_glist *gl, t_symbol *s, t_symbol *tmpl,
     t_floatarg f, t_floatarg flags);
 EXTERN t_array *array_new(t_symbol *templatesym, t_gpointer *parent);
 EXTERN void array_resize(t_array *x, int n);
 EXTERN void array_free(t_array *x);
+EXTERN void array_setcolumns(t_array *x, int columns);
+EXTERN void array_copyelement(t_array *x, int indx, t_word *rec,
+    int toarray);
 EXTERN void array_redraw(t_array *a, t_glist *glist);
 EXTERN void array_resize_and_redraw(t_array *array, t_glist *glist, int n);
 
+    /* smallest and largest values and sums over a range of floats.  Values
+    not inside (-1e30, 1e30) are never the smallest or largest; indices are
+    of the first of each, or -1 if there's none. */
+typedef struct _arraystats
+{
+    t_float as_min;
+    t_float as_max;
+    int as_imin;
+    int as_imax;
+    double as_sum;          /* sum of all the points */
+    double as_possum;       /* sum of the positive ones */
+} t_arraystats;
+
+EXTERN void array_initstats(t_arraystats *s);
+EXTERN void array_scanwords(t_word *vec, int onset, int n, t_arraystats *s);
+EXTERN void array_setsummary(t_array *x, int on);
+EXTERN void array_touch(t_array *x, int onset, int n);
+EXTERN void array_getstats(t_array *x, int onset, int n, t_arraystats *s);
+EXTERN int array_quantile(t_array *x, int onset, int n, double target);
+
 /* --------------------- gpointers and stubs ---------------- */
 EXTERN t_gstub *gstub_new(t_glist *gl, t_array *a);
 EXTERN void gstub_cutoff(t_gstub *gs);
@@ -592,6 +682,7 @@ EXTERN t_scalar *scalar_new(t_glist *owner,
 EXTERN void word_free(t_word *wp, t_template *tmpl);
 EXTERN void scalar_getbasexy(t_scalar *x, t_float *basex, t_float *basey);
 EXTERN void scalar_redraw(t_scalar *x, t_glist *glist);
+EXTERN int canvas_getsavefile(t_symbol **dirp, t_symbol **filenamep);
 EXTERN void canvas_writescalar(t_symbol *templatesym, t_word *w, t_binbuf *b,
     int amarrayelement);
 EXTERN int canvas_readscalar(t_glist *x, int natoms, t_atom *vec,
@@ -609,6 +700,8 @@ EXTERN int array_getfields(t_symbol *elemtemplatesym,
     t_template **elemtemplatep, int *elemsizep,
     t_fielddesc *xfielddesc, t_fielddesc *yfielddesc, t_fielddesc *wfielddesc,
     int *xonsetp, int *yonsetp, int *wonsetp);
+EXTERN int plot_redrawrange(t_scalar *sc, t_glist *glist, t_array *array,
+    int onset, int n);
 
 /* --------------------- templates ------------------------- */
 EXTERN t_template *template_new(t_symbol *sym, int argc, t_atom *argv);
@@ -627,6 +720,7 @@ EXTERN void template_setsymbol(t_template *x, t_symbol *fieldname,
 
 EXTERN t_template *gtemplate_get(t_gtemplate *x);
 EXTERN t_template *template_findbyname(t_symbol *s);
+EXTERN int template_getserial(void);
 EXTERN t_canvas *template_findcanvas(t_template *tmpl);
 EXTERN void template_notify(t_template *tmpl,
     t_symbol *s, int argc, t_atom *argv);
@@ -651,6 +745,10 @@ EXTERN t_symbol *iemgui_put_in_braces(t_symbol *s);
 /*-------------  g_clone.c ------------- */
 extern t_class *clone_class;
 
+/*-------------  g_freeze.c ------------- */
+EXTERN void canvas_freezechanged(t_glist *gl);
+EXTERN void canvas_unfreeze(t_canvas *gl);
+
 #if defined(_LANGUAGE_C_PLUS_PLUS) || defined(__cplusplus)
 }
 #endif
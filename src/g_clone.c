@@ -1,6 +1,7 @@
 #include "m_pd.h"
 #include "g_canvas.h"
 #include "m_imp.h"
+#include "s_stuff.h"
 #include <string.h>
 
 /* ---------- clone - maintain copies of a patch ----------------- */
@@ -19,6 +20,9 @@
 #define ATOMS_FREEA(x, n) ( \
     ((n) < LIST_NGETBYTE || (freebytes((x), (n) * sizeof(t_atom)), 0)))
 
+int ugen_getsortno(void);
+void signal_getcontext(t_float *srate, int *vecsize, int *calcsize);
+
 t_class *clone_class;
 static t_class *clone_in_class, *clone_out_class;
 
@@ -26,8 +30,17 @@ typedef struct _copy
 {
     t_glist *c_gl;
     int c_on;           /* DSP running */
+    t_int *c_chain;     /* DSP chain of its own if added while DSP ran */
+    int c_chainsize;
 } t_copy;
 
+typedef struct _clonesig    /* signal noted for copies added while DSP runs */
+{
+    t_sample *s_vec;
+    int s_n;
+    int s_nchans;
+} t_clonesig;
+
 typedef struct _in
 {
     t_class *i_pd;
@@ -47,6 +60,7 @@ typedef struct _out
 typedef struct _clone
 {
     t_object x_obj;
+    t_canvas *x_canvas; /* canvas we're in */
     int x_n;            /* number of copies */
     t_copy *x_vec;      /* the copies */
     int x_nin;
@@ -59,6 +73,15 @@ typedef struct _clone
     int x_phase;
     int x_startvoice;   /* number of first voice, 0 by default */
     int x_suppressvoice; /* suppress voice number as $1 arg */
+    int x_nthreads;     /* number of DSP threads we may use, 0 if none */
+    int x_sortno;       /* DSP sorting we were last scheduled in, 0 if none */
+    t_float x_sr;       /* context we were scheduled in */
+    int x_vecsize;
+    int x_calcsize;
+    int x_nsigin;       /* signal inputs and sums of outputs there */
+    int x_nsigout;
+    t_clonesig *x_sigvec;
+    int x_nchain;       /* number of copies with chains of their own */
 } t_clone;
 
 int clone_match(t_pd *z, t_symbol *name, t_symbol *dir)
@@ -180,8 +203,13 @@ static void clone_free(t_clone *x)
             pd_free(&x->x_vec[i].c_gl->gl_pd);
             t_freebytes(x->x_outvec[i],
                 x->x_nout * sizeof(*x->x_outvec[i]));
+            if (x->x_vec[i].c_chain)
+                ugen_freesubchain(x->x_vec[i].c_chain,
+                    x->x_vec[i].c_chainsize);
         }
         t_freebytes(x->x_vec, x->x_n * sizeof(*x->x_vec));
+        t_freebytes(x->x_sigvec,
+            (x->x_nsigin + x->x_nsigout) * sizeof(*x->x_sigvec));
         t_freebytes(x->x_argv, x->x_argc * sizeof(*x->x_argv));
         t_freebytes(x->x_invec, x->x_nin * sizeof(*x->x_invec));
         t_freebytes(x->x_outvec, x->x_n * sizeof(*x->x_outvec));
@@ -189,11 +217,17 @@ static void clone_free(t_clone *x)
     }
 }
 
-static t_canvas *clone_makeone(t_symbol *s, int argc, t_atom *argv)
+    /* make a copy of abstraction "s".  If "b" is nonzero it holds the
+    contents of the file "name" in "dir" that it was found in before, so we
+    needn't look for it again. */
+static t_canvas *clone_makeone(t_symbol *s, t_binbuf *b, t_symbol *name,
+    t_symbol *dir, int argc, t_atom *argv)
 {
     t_canvas *retval;
     pd_this->pd_newest = 0;
-    typedmess(&pd_objectmaker, s, argc, argv);
+    if (b)
+        sys_makeabstraction(s, b, name, dir, argc, argv);
+    else typedmess(&pd_objectmaker, s, argc, argv);
     if (pd_this->pd_newest == 0)
     {
         pd_error(0, "clone: can't create subpatch '%s'",
@@ -214,40 +248,97 @@ static t_canvas *clone_makeone(t_symbol *s, int argc, t_atom *argv)
     return (retval);
 }
 
+void canvas_dodsp(t_canvas *x, int toplevel, t_signal **sp);
+t_signal *signal_newfromcontext(int borrowed);
+void signal_makereusable(t_signal *sig);
+
+    /* schedule a copy added while DSP is running on a chain of its own,
+    with the inputs and output sums clone_dsp() noted, as if it had been
+    there when the DSP chain was sorted.  clone_perform() runs it. */
+static void clone_schedule(t_clone *x, t_copy *c)
+{
+    int i, nin = x->x_nsigin, nout = x->x_nsigout;
+    t_signal **tempio = (t_signal **)alloca((nin + nout + 1) *
+        sizeof(*tempio));
+    t_clonesig *sig = x->x_sigvec;
+    void *z = ugen_beginsubchain(x->x_sr, x->x_vecsize, x->x_calcsize);
+    for (i = 0; i < nin; i++)
+        tempio[i] = ugen_subchaininput(z, sig[i].s_vec, sig[i].s_n,
+            sig[i].s_nchans);
+    for (i = 0; i < nout; i++)
+        tempio[nin + i] = signal_newfromcontext(1);
+    canvas_dodsp(c->c_gl, 0, tempio);
+    for (i = 0; i < nout; i++)
+    {
+        dsp_add_plus(tempio[nin + i]->s_vec, sig[nin + i].s_vec,
+            sig[nin + i].s_vec, sig[nin + i].s_n);
+        signal_makereusable(tempio[nin + i]);
+    }
+    c->c_chain = ugen_endsubchain(z, &c->c_chainsize);
+    x->x_nchain++;
+}
+
+    /* change the number of copies, creating or freeing only the ones
+    that come or go.  If DSP is running and we're on the DSP chain, new
+    copies are scheduled by themselves and the chain isn't resorted.
+    Removing copies resorts it, once, before the next DSP tick, since other
+    objects might refer to what is going away. */
 void clone_setn(t_clone *x, t_floatarg f)
 {
-    int dspstate = canvas_suspend_dsp();
-    int nwas = x->x_n, wantn = f, i, j;
+    int nwas = x->x_n, wantn = f, i, j, held = canvas_holddsp();
+        /* DSP is on (and no resort is pending) and we're on the chain */
+    int incremental = (held == 1 && x->x_sortno == ugen_getsortno());
+    t_binbuf *b = 0;
+    t_symbol *absname = 0, *absdir = 0;
     if (wantn < 1)
     {
         pd_error(x, "can't resize to zero or negative number; setting to 1");
         wantn = 1;
     }
+        /* new copies are made in our canvas, as when we were created */
+    canvas_setcurrent(x->x_canvas);
     if (wantn > nwas)
-        for (i = nwas; i < wantn; i++)
+    {
+            /* the first copy told us where the abstraction is; read it once
+            and evaluate that for every new copy, rather than searching for
+            it and checking the file cache each time */
+        if (nwas && canvas_isabstraction(x->x_vec[0].c_gl))
+        {
+            absname = x->x_vec[0].c_gl->gl_name;
+            absdir = canvas_getdir(x->x_vec[0].c_gl);
+            b = binbuf_readabstraction(absname, absdir);
+        }
+        x->x_vec = (t_copy *)t_resizebytes(x->x_vec, nwas * sizeof(t_copy),
+            wantn * sizeof(t_copy));
+        x->x_outvec = (t_out **)t_resizebytes(x->x_outvec,
+            nwas * sizeof(*x->x_outvec), wantn * sizeof(*x->x_outvec));
+    }
+    for (i = nwas; i < wantn; i++)
     {
         t_canvas *c;
         t_out *outvec;
         SETFLOAT(x->x_argv, x->x_startvoice + i);
-        if (!(c = clone_makeone(x->x_s, x->x_argc - x->x_suppressvoice,
-            x->x_argv + x->x_suppressvoice)))
+        if (!(c = clone_makeone(x->x_s, b, absname, absdir,
+            x->x_argc - x->x_suppressvoice, x->x_argv + x->x_suppressvoice)))
         {
             pd_error(x, "clone: couldn't create '%s'", x->x_s->s_name);
+            x->x_vec = (t_copy *)t_resizebytes(x->x_vec,
+                wantn * sizeof(t_copy), i * sizeof(t_copy));
+            x->x_outvec = (t_out **)t_resizebytes(x->x_outvec,
+                wantn * sizeof(*x->x_outvec), i * sizeof(*x->x_outvec));
             goto done;
         }
-        x->x_vec = (t_copy *)t_resizebytes(x->x_vec, i * sizeof(t_copy),
-            (i+1) * sizeof(t_copy));
         x->x_vec[i].c_gl = c;
         x->x_vec[i].c_on = 0;
-        x->x_outvec = (t_out **)t_resizebytes(x->x_outvec,
-            i * sizeof(*x->x_outvec), (i+1) * sizeof(*x->x_outvec));
+        x->x_vec[i].c_chain = 0;
+        x->x_vec[i].c_chainsize = 0;
         x->x_outvec[i] = outvec =
             (t_out *)getbytes(x->x_nout * sizeof(*outvec));
         for (j = 0; j < x->x_nout; j++)
         {
             outvec[j].o_pd = clone_out_class;
             outvec[j].o_signal =
-                obj_issignaloutlet(&x->x_vec[0].c_gl->gl_obj, i);
+                obj_issignaloutlet(&x->x_vec[0].c_gl->gl_obj, j);
             outvec[j].o_n = x->x_startvoice + i;
             outvec[j].o_outlet =
                 x->x_outvec[0][j].o_outlet;
@@ -262,13 +353,50 @@ void clone_setn(t_clone *x, t_floatarg f)
         {
             canvas_closebang(x->x_vec[i].c_gl);
             pd_free(&x->x_vec[i].c_gl->gl_pd);
+            t_freebytes(x->x_outvec[i],
+                x->x_nout * sizeof(*x->x_outvec[i]));
+            if (x->x_vec[i].c_chain)
+            {
+                ugen_freesubchain(x->x_vec[i].c_chain,
+                    x->x_vec[i].c_chainsize);
+                x->x_nchain--;
+            }
         }
         x->x_vec = (t_copy *)t_resizebytes(x->x_vec, nwas * sizeof(t_copy),
             wantn * sizeof(*x->x_vec));
+        x->x_outvec = (t_out **)t_resizebytes(x->x_outvec,
+            nwas * sizeof(*x->x_outvec), wantn * sizeof(*x->x_outvec));
         x->x_n = wantn;
     }
 done:
-    canvas_resume_dsp(dspstate);
+    if (b)
+        binbuf_free(b);
+    canvas_unsetcurrent(x->x_canvas);
+    if (!canvas_releasedsp(held))
+        incremental = 0;
+        /* if we've never been scheduled (as when made in a patch that's
+        being opened) the copies will be when we are */
+    if (!x->x_sortno)
+        ;
+    else if (x->x_n < nwas)
+        canvas_update_dsp();
+    else if (x->x_n > nwas)
+    {
+        if (incremental)
+            for (i = nwas; i < x->x_n; i++)
+                clone_schedule(x, &x->x_vec[i]);
+        else canvas_update_dsp();
+    }
+}
+
+    /* "resize" message: as above, then loadbang the new copies */
+static void clone_in_resize(t_in *x, t_floatarg f)
+{
+    t_clone *owner = x->i_owner;
+    int i, nwas = owner->x_n;
+    clone_setn(owner, f);
+    for (i = nwas; i < owner->x_n; i++)
+        canvas_loadbang(owner->x_vec[i].c_gl);
 }
 
 static void clone_click(t_clone *x, t_floatarg xpos, t_floatarg ypos,
@@ -290,14 +418,110 @@ static void clone_loadbang(t_clone *x, t_floatarg f)
             canvas_closebang(x->x_vec[i].c_gl);
 }
 
-void canvas_dodsp(t_canvas *x, int toplevel, t_signal **sp);
-t_signal *signal_newfromcontext(int borrowed);
-void signal_makereusable(t_signal *sig);
+static t_int *clone_perform(t_int *w)
+{
+    t_clone *x = (t_clone *)(w[1]);
+    int j;
+    t_int *ip;
+    if (x->x_nchain)
+        for (j = 0; j < x->x_n; j++)
+            if (x->x_vec[j].c_chain)
+                for (ip = x->x_vec[j].c_chain; ip; )
+                    ip = (*(t_perfroutine)(*ip))(ip);
+    return (w+2);
+}
+
+    /* after the copies are on the DSP chain and their outputs summed into
+    "tempsigs", note where the inputs and sums are, so that copies added
+    later can be scheduled with clone_schedule(), and leave room for them
+    to be run.  Then copy the sums out.  clone_dsp() holds one extra
+    reference to each input signal so that its buffer stays valid until
+    here, and we let go of it now. */
+static void clone_dspfinish(t_clone *x, t_signal **sp, int nin, int nout,
+    t_signal **tempsigs)
+{
+    int i;
+    t_clonesig *sig;
+    for (i = 0; i < x->x_n; i++)
+        if (x->x_vec[i].c_chain)
+    {
+        ugen_freesubchain(x->x_vec[i].c_chain, x->x_vec[i].c_chainsize);
+        x->x_vec[i].c_chain = 0;
+    }
+    x->x_nchain = 0;
+    x->x_sigvec = (t_clonesig *)resizebytes(x->x_sigvec,
+        (x->x_nsigin + x->x_nsigout) * sizeof(*x->x_sigvec),
+            (nin + nout) * sizeof(*x->x_sigvec));
+    x->x_nsigin = nin;
+    x->x_nsigout = nout;
+    for (i = 0, sig = x->x_sigvec; i < nin + nout; i++, sig++)
+    {
+        t_signal *from = (i < nin ? sp[i] : tempsigs[i - nin]);
+        sig->s_vec = from->s_vec;
+        sig->s_n = from->s_n;
+        sig->s_nchans = from->s_nchans;
+    }
+    signal_getcontext(&x->x_sr, &x->x_vecsize, &x->x_calcsize);
+    x->x_sortno = ugen_getsortno();
+    dsp_add(clone_perform, 1, x);
+    for (i = 0; i < nout; i++)
+    {
+        dsp_add_copy(tempsigs[i]->s_vec, sp[nin+i]->s_vec, tempsigs[i]->s_n);
+        signal_makereusable(tempsigs[i]);
+    }
+    for (i = 0; i < nin; i++)
+        if (!--sp[i]->s_refcount)
+            signal_makereusable(sp[i]);
+}
+
+    /* compute copies in parallel, a few at a time in as many tasks as
+    there are threads, times four so that unevenly loaded threads can
+    make up for each other.  The copies' outputs are kept around until all
+    tasks are done and are then summed in order. */
+static void clone_dsp_parallel(t_clone *x, t_signal **sp, int nin, int nout,
+    t_signal **tempsigs, t_signal **tempio, void *section)
+{
+    int i, j, ntask = 4 * x->x_nthreads, nper;
+    t_signal **outsigs = (t_signal **)getbytes(x->x_n * nout *
+        sizeof(*outsigs));
+    if (ntask > x->x_n)
+        ntask = x->x_n;
+    nper = (x->x_n + ntask - 1) / ntask;
+    for (i = 0; i < nin; i++)
+    {
+        sp[i]->s_refcount += x->x_n;
+        tempio[i] = sp[i];
+    }
+    for (i = 0; i < nout; i++)
+        tempsigs[i] = signal_newfromcontext(0);
+    for (j = 0; j < x->x_n; j++)
+    {
+        if (!(j % nper))
+            ugen_nexttask(section);
+        for (i = 0; i < nout; i++)
+            outsigs[j * nout + i] = tempio[nin + i] = signal_newfromcontext(1);
+        canvas_dodsp(x->x_vec[j].c_gl, 0, tempio);
+    }
+    ugen_endsection(section);
+    for (j = 0; j < x->x_n; j++)
+        for (i = 0; i < nout; i++)
+    {
+        t_signal *s = outsigs[j * nout + i];
+        if (j == 0)
+            dsp_add_copy(s->s_vec, tempsigs[i]->s_vec, tempsigs[i]->s_n);
+        else dsp_add_plus(s->s_vec, tempsigs[i]->s_vec,
+            tempsigs[i]->s_vec, tempsigs[i]->s_n);
+        signal_makereusable(s);
+    }
+    clone_dspfinish(x, sp, nin, nout, tempsigs);
+    freebytes(outsigs, x->x_n * nout * sizeof(*outsigs));
+}
 
 static void clone_dsp(t_clone *x, t_signal **sp)
 {
     int i, j, nin, nout;
     t_signal **tempsigs, **tempio;
+    void *section;
     if (!x->x_n)
         return;
     for (i = nin = 0; i < x->x_nin; i++)
@@ -314,6 +538,7 @@ static void clone_dsp(t_clone *x, t_signal **sp)
                     obj_nsigoutlets(&x->x_vec[j].c_gl->gl_obj) != nout)
         {
             pd_error(x, "clone: can't do DSP until edited copy is saved");
+            x->x_sortno = -1;
             for (i = 0; i < nout; i++)
                 dsp_add_zero(sp[nin+i]->s_vec, sp[nin+i]->s_n);
             return;
@@ -321,12 +546,18 @@ static void clone_dsp(t_clone *x, t_signal **sp)
     }
     tempsigs = (t_signal **)alloca((nin + 2 * nout) * sizeof(*tempsigs));
     tempio = tempsigs + nout;
+    if (x->x_nthreads > 1 && x->x_n > 1 && (section = ugen_beginsection()))
+    {
+        clone_dsp_parallel(x, sp, nin, nout, tempsigs, tempio, section);
+        return;
+    }
         /* load input signals into signal vector to send subpatches */
     for (i = 0; i < nin; i++)
     {
             /* we already have one reference "counted" for our presumed
-            use of this input signal but add one for each additional copy. */
-        sp[i]->s_refcount += x->x_n-1;
+            use of this input signal but add one for each additional copy,
+            and one to hold it until clone_dspfinish(). */
+        sp[i]->s_refcount += x->x_n;
         tempio[i] = sp[i];
     }
         /* for first copy, write output to first nout temp sigs */
@@ -348,12 +579,8 @@ static void clone_dsp(t_clone *x, t_signal **sp)
             signal_makereusable(tempio[nin + i]);
         }
     }
-        /* copy to output signsls */
-    for (i = 0; i < nout; i++)
-    {
-        dsp_add_copy(tempsigs[i]->s_vec, sp[nin+i]->s_vec, tempsigs[i]->s_n);
-        signal_makereusable(tempsigs[i]);
-    }
+        /* copy to output signals */
+    clone_dspfinish(x, sp, nin, nout, tempsigs);
 }
 
 static void *clone_new(t_symbol *s, int argc, t_atom *argv)
@@ -366,6 +593,11 @@ static void *clone_new(t_symbol *s, int argc, t_atom *argv)
     x->x_outvec = 0;
     x->x_startvoice = 0;
     x->x_suppressvoice = 0;
+    x->x_nthreads = 0;
+    x->x_canvas = canvas_getcurrent();
+    x->x_sortno = 0;
+    x->x_nsigin = x->x_nsigout = x->x_nchain = 0;
+    x->x_sigvec = 0;
     clone_voicetovis = -1;
     if (argc == 0)
     {
@@ -385,6 +617,12 @@ static void *clone_new(t_symbol *s, int argc, t_atom *argv)
         }
         else if (!strcmp(argv[0].a_w.w_symbol->s_name, "-x"))
             x->x_suppressvoice = 1, argc--, argv++;
+        else if (!strcmp(argv[0].a_w.w_symbol->s_name, "-threads") &&
+            argc > 1 && argv[1].a_type == A_FLOAT)
+        {
+            x->x_nthreads = argv[1].a_w.w_float;
+            argc -= 2; argv += 2;
+        }
         else goto usage;
     }
     if (argc >= 2 && (wantn = atom_getfloatarg(0, argc, argv)) >= 0
@@ -400,11 +638,14 @@ static void *clone_new(t_symbol *s, int argc, t_atom *argv)
     x->x_argv = getbytes(x->x_argc * sizeof(*x->x_argv));
     memcpy(x->x_argv, argv+1, x->x_argc * sizeof(*x->x_argv));
     SETFLOAT(x->x_argv, x->x_startvoice);
-    if (!(c = clone_makeone(x->x_s, x->x_argc - x->x_suppressvoice,
+    if (!(c = clone_makeone(x->x_s, 0, 0, 0, x->x_argc - x->x_suppressvoice,
         x->x_argv + x->x_suppressvoice)))
             goto fail;
     x->x_vec = (t_copy *)getbytes(sizeof(*x->x_vec));
     x->x_vec[0].c_gl = c;
+    x->x_vec[0].c_on = 0;
+    x->x_vec[0].c_chain = 0;
+    x->x_vec[0].c_chainsize = 0;
     x->x_n = 1;
     x->x_nin = obj_ninlets(&x->x_vec[0].c_gl->gl_obj);
     x->x_invec = (t_in *)getbytes(x->x_nin * sizeof(*x->x_invec));
@@ -437,12 +678,16 @@ static void *clone_new(t_symbol *s, int argc, t_atom *argv)
     }
     clone_setn(x, (t_floatarg)(wantn));
     x->x_phase = wantn-1;
+        /* the scheduler thread is one of the threads; start others as
+        needed.  DSP is suspended so this doesn't resort the DSP chain. */
+    if (x->x_nthreads > 1 && ugen_getthreads() < x->x_nthreads - 1)
+        ugen_setthreads(x->x_nthreads - 1);
     canvas_resume_dsp(dspstate);
     if (voicetovis >= 0 && voicetovis < x->x_n)
         canvas_vis(x->x_vec[voicetovis].c_gl, 1);
     return (x);
 usage:
-    pd_error(0, "usage: clone [-s starting-number] <number> <name> [arguments]");
+    pd_error(0, "usage: clone [-s starting-number] [-x] [-threads n] <number> <name> [arguments]");
 fail:
     freebytes(x, sizeof(t_clone));
     canvas_resume_dsp(dspstate);
@@ -474,6 +719,8 @@ void clone_setup(void)
         A_FLOAT, A_FLOAT, 0);
     class_addmethod(clone_in_class, (t_method)clone_in_fwd, gensym("fwd"),
         A_GIMME, 0);
+    class_addmethod(clone_in_class, (t_method)clone_in_resize,
+        gensym("resize"), A_FLOAT, 0);
     class_addlist(clone_in_class, (t_method)clone_in_list);
 
     clone_out_class = class_new(gensym("clone-outlet"), 0, 0,
@@ -228,18 +228,6 @@ void glist_selectall(t_glist *x)
     }
 }
 
-    /* get the index of a gobj in a glist.  If y is zero, return the
-       total number of objects. */
-int glist_getindex(t_glist *x, t_gobj *y)
-{
-    t_gobj *y2;
-    int indx;
-
-    for (y2 = x->gl_list, indx = 0; y2 && y2 != y; y2 = y2->g_next)
-        indx++;
-    return (indx);
-}
-
     /* get the index of the object, among selected items, if "selected"
        is set; otherwise, among unselected ones.  If y is zero, just
        counts the selected or unselected objects. */
@@ -254,16 +242,6 @@ int glist_selectionindex(t_glist *x, t_gobj *y, int selected)
     return (indx);
 }
 
-static t_gobj *glist_nth(t_glist *x, int n)
-{
-    t_gobj *y;
-    int indx;
-    for (y = x->gl_list, indx = 0; y; y = y->g_next, indx++)
-        if (indx == n)
-            return (y);
-    return (0);
-}
-
 /* ------------------- support for undo/redo  -------------------------- */
 
 static void canvas_applybinbuf(t_canvas *x, t_binbuf *b)
@@ -633,6 +611,7 @@ int canvas_undo_cut(t_canvas *x, void *z, int action)
                         }
                         else if (y_prev && !y_next)
                             y_prev->g_next = NULL;
+                        glist_noindex(x);
                             /* now put the moved object at the beginning of the cue */
                         y->g_next = glist_nth(x, 0);
                         x->gl_list = y;
@@ -648,6 +627,7 @@ int canvas_undo_cut(t_canvas *x, void *z, int action)
                         {
                             y_prev->g_next = NULL;
                         }
+                        glist_noindex(x);
                             /* now put the moved object in its right place */
                         y_prev = glist_nth(x, buf->p_a[i]-1);
                         y_next = glist_nth(x, buf->p_a[i]);
@@ -656,6 +636,7 @@ int canvas_undo_cut(t_canvas *x, void *z, int action)
                         y->g_next = y_next;
                             /* LATER when objects are properly tagged lower y here */
                     }
+                    glist_noindex(x);
                 }
             }
                 /* LATER disable redrawing here */
@@ -695,6 +676,7 @@ int canvas_undo_cut(t_canvas *x, void *z, int action)
         }
     }
     else if (action == UNDO_FREE)
+    {
         if (buf)
         {
             if (buf->u_objectbuf)
@@ -706,6 +688,12 @@ int canvas_undo_cut(t_canvas *x, void *z, int action)
             t_freebytes(buf, sizeof(*buf) +
                 sizeof(buf->p_a[0]) * (buf->n_obj-1));
         }
+    }
+    else if (action == UNDO_SIZE)
+        return (buf ? (int)(sizeof(*buf) + sizeof(buf->p_a[0]) * (buf->n_obj-1))
+            + canvas_undo_binbufsize(buf->u_objectbuf)
+            + canvas_undo_binbufsize(buf->u_reconnectbuf)
+            + canvas_undo_binbufsize(buf->u_redotextbuf) : 0);
     return 1;
 }
 
@@ -807,6 +795,14 @@ int canvas_undo_move(t_canvas *x, void *z, int action)
 
 /* --------- 5. paste (also duplicate) ----------- */
 
+    /* pasting the same clipboard again and again shouldn't keep a new copy of
+    it each time, so consecutive pastes share one reference-counted copy */
+typedef struct _undo_snapshot
+{
+    t_binbuf *s_binbuf;
+    int s_refcount;
+} t_undo_snapshot;
+
 typedef struct _undo_paste
 {
     int u_index;            /* index of first object pasted */
@@ -814,9 +810,56 @@ typedef struct _undo_paste
                                object was pasted (for autopatching) */
     int u_offset;           /* xy-offset for duplicated items (since it differs
                                when duplicated into same or different canvas */
-    t_binbuf *u_objectbuf;  /* here we store actual copied data */
+    int u_owner;            /* whether we made the snapshot (and count it) */
+    t_undo_snapshot *u_snapshot;  /* here we store actual copied data */
 } t_undo_paste;
 
+static int binbuf_isequal(const t_binbuf *b1, const t_binbuf *b2)
+{
+    int i, n = binbuf_getnatom(b1);
+    const t_atom *v1 = binbuf_getvec(b1), *v2 = binbuf_getvec(b2);
+    if (b1 == b2)
+        return (1);
+    if (n != binbuf_getnatom(b2))
+        return (0);
+    for (i = 0; i < n; i++, v1++, v2++)
+    {
+        if (v1->a_type != v2->a_type)
+            return (0);
+        if (v1->a_type == A_FLOAT)
+        {
+            if (v1->a_w.w_float != v2->a_w.w_float)
+                return (0);
+        }
+        else if (v1->a_type == A_DOLLAR)
+        {
+            if (v1->a_w.w_index != v2->a_w.w_index)
+                return (0);
+        }
+        else if (v1->a_type != A_SEMI && v1->a_type != A_COMMA &&
+            v1->a_w.w_symbol != v2->a_w.w_symbol)
+                return (0);
+    }
+    return (1);
+}
+
+    /* find the snapshot of the latest paste into this canvas, if it still
+    matches what we're about to paste */
+static t_undo_snapshot *canvas_undo_findsnapshot(t_canvas *x, t_binbuf *b)
+{
+    t_undo *udo = canvas_undo_get(x);
+    t_undo_action *a;
+    for (a = (udo ? udo->u_last : 0); a && a->type != UNDO_INIT; a = a->prev)
+    {
+        if (a->type == UNDO_PASTE)
+        {
+            t_undo_snapshot *snap = ((t_undo_paste *)a->data)->u_snapshot;
+            return (binbuf_isequal(snap->s_binbuf, b) ? snap : 0);
+        }
+    }
+    return (0);
+}
+
 void *canvas_undo_set_paste(t_canvas *x, int numpasted, int duplicate,
     int d_offset)
 {
@@ -834,7 +877,19 @@ void *canvas_undo_set_paste(t_canvas *x, int numpasted, int duplicate,
         buf->u_sel_index = -1;
     }
     buf->u_offset = d_offset;
-    buf->u_objectbuf = binbuf_duplicate(EDITOR->copy_binbuf);
+    if ((buf->u_snapshot =
+        canvas_undo_findsnapshot(x, EDITOR->copy_binbuf)))
+    {
+        buf->u_snapshot->s_refcount++;
+        buf->u_owner = 0;
+    }
+    else
+    {
+        buf->u_snapshot = (t_undo_snapshot *)getbytes(sizeof(*buf->u_snapshot));
+        buf->u_snapshot->s_binbuf = binbuf_duplicate(EDITOR->copy_binbuf);
+        buf->u_snapshot->s_refcount = 1;
+        buf->u_owner = 1;
+    }
     return (buf);
 }
 void *canvas_undo_set_pastebinbuf(t_canvas *x, t_binbuf *b,
@@ -876,7 +931,7 @@ int canvas_undo_paste(t_canvas *x, void *z, int action)
         {
             glist_select(x, glist_nth(x, buf->u_sel_index));
         }
-        canvas_dopaste(x, buf->u_objectbuf);
+        canvas_dopaste(x, buf->u_snapshot->s_binbuf);
 
             /* if it was "duplicate" have to re-enact the displacement. */
         if (buf->u_offset)
@@ -889,10 +944,16 @@ int canvas_undo_paste(t_canvas *x, void *z, int action)
     }
     else if (action == UNDO_FREE)
     {
-        if (buf->u_objectbuf)
-            binbuf_free(buf->u_objectbuf);
+        if (!--buf->u_snapshot->s_refcount)
+        {
+            binbuf_free(buf->u_snapshot->s_binbuf);
+            t_freebytes(buf->u_snapshot, sizeof(*buf->u_snapshot));
+        }
         t_freebytes(buf, sizeof(*buf));
     }
+    else if (action == UNDO_SIZE)
+        return ((int)sizeof(*buf) + (buf->u_owner ? (int)sizeof(*buf->u_snapshot)
+            + canvas_undo_binbufsize(buf->u_snapshot->s_binbuf) : 0));
     return 1;
 }
 
@@ -980,6 +1041,7 @@ int canvas_undo_apply(t_canvas *x, void *z, int action)
         canvas_dopaste(x, buf->u_objectbuf);
 
             /* change previous instance with current one */
+        binbuf_free(buf->u_objectbuf);
         buf->u_objectbuf = tmp;
 
             /* connections should stay the same */
@@ -996,6 +1058,9 @@ int canvas_undo_apply(t_canvas *x, void *z, int action)
             binbuf_free(buf->u_reconnectbuf);
         t_freebytes(buf, sizeof(*buf));
     }
+    else if (action == UNDO_SIZE)
+        return ((int)sizeof(*buf) + canvas_undo_binbufsize(buf->u_objectbuf)
+            + canvas_undo_binbufsize(buf->u_reconnectbuf));
     return 1;
 }
 
@@ -1010,6 +1075,7 @@ int canvas_apply_restore_original_position(t_canvas *x, int orig_pos)
         y_prev = glist_nth(x, glist_getindex(x, 0) - 2);
         if (y_prev)
             y_prev->g_next = NULL;
+        glist_noindex(x);
             /* if the object is supposed to be first in the gl_list */
         if (orig_pos == 0)
         {
@@ -1023,6 +1089,7 @@ int canvas_apply_restore_original_position(t_canvas *x, int orig_pos)
             y_prev->g_next = y;
             y->g_next = y_next;
         }
+        glist_noindex(x);
         return(1);
     }
     return(0);
@@ -1112,6 +1179,7 @@ static void canvas_doarrange(t_canvas *x, t_float which, t_gobj *oldy,
         bug("canvas_arrange");
         return;
     }
+    glist_noindex(x);
     canvas_dirty(x, 1);
 }
 
@@ -1142,6 +1210,7 @@ int canvas_undo_arrange(t_canvas *x, void *z, int action)
                 /* first previous object should point to nothing */
             prev = glist_nth(x, buf->u_newindex - 1);
             prev->g_next = NULL;
+            glist_noindex(x);
 
                 /* now we reuse vars for the following:
                    old index should be right before the object previndex
@@ -1184,6 +1253,7 @@ int canvas_undo_arrange(t_canvas *x, void *z, int action)
             prev->g_next = y;
             y->g_next = next;
         }
+        glist_noindex(x);
             /* and finally redraw canvas */
         if (x->gl_havewindow)
             canvas_redraw(x);
@@ -1442,6 +1512,9 @@ int canvas_undo_create(t_canvas *x, void *z, int action)
         binbuf_free(buf->u_reconnectbuf);
         t_freebytes(buf, sizeof(*buf));
     }
+    else if (action == UNDO_SIZE)
+        return ((int)sizeof(*buf) + canvas_undo_binbufsize(buf->u_objectbuf)
+            + canvas_undo_binbufsize(buf->u_reconnectbuf));
     return 1;
 }
 
@@ -1554,6 +1627,9 @@ int canvas_undo_recreate(t_canvas *x, void *z, int action)
         binbuf_free(buf->u_reconnectbuf);
         t_freebytes(buf, sizeof(*buf));
     }
+    else if (action == UNDO_SIZE)
+        return ((int)sizeof(*buf) + canvas_undo_binbufsize(buf->u_objectbuf)
+            + canvas_undo_binbufsize(buf->u_reconnectbuf));
     return 1;
 }
 
@@ -1748,15 +1824,354 @@ int canvas_hitbox(t_canvas *x, t_gobj *y, int xpos, int ypos,
     else return (0);
 }
 
+/* ------------- finding objects under the mouse ------------ */
+
+    /* So that mouse motion doesn't have to ask every object in a big patch
+    for its rectangle, the editor keeps a grid of square cells, each listing
+    the objects that overlap it.  The grid is rebuilt lazily once anything
+    has called glist_nohitgrid() -- which happens when objects are added,
+    deleted, moved, reordered or redrawn.  It only narrows down the search:
+    candidates are still tested against their current rectangles.  Objects
+    that aren't boxes (scalars, which can move by themselves) and very large
+    ones are kept in a "loose" list that's searched for every point.
+    Connections are kept in a flat list along with their end points, which
+    is also forgotten whenever any connection anywhere is made or broken. */
+
+#define HITGRIDCELL 64      /* minimum cell size in pixels */
+#define HITGRIDMAXSPAN 64   /* objects covering more cells than this are loose */
+
+typedef struct _hitgrid
+{
+    int g_valid;            /* false if objects may have changed */
+    int g_n;                /* number of objects */
+    int g_size;             /* allocated size of the per-object vectors */
+    t_gobj **g_vec;         /* objects in the order of gl_list */
+    t_gobj **g_hits;        /* scratch space for query results */
+    int *g_found;           /* scratch object numbers */
+    int *g_stamp;           /* per-object mark to avoid duplicates */
+    int g_stampnow;
+    int g_x0, g_y0;         /* top left corner of the grid */
+    int g_cellsize;
+    int g_ncols, g_nrows;
+    int *g_cellonset;       /* ncols*nrows+1 onsets into g_cellobj */
+    int g_nonset;           /* allocated size of g_cellonset */
+    int *g_cellobj;         /* object numbers, ascending within each cell */
+    int g_ncellobj;         /* allocated size of g_cellobj */
+    int *g_loose;           /* objects to try everywhere, ascending */
+    int g_nloose;
+    struct _hitline *g_lines;   /* connections, in traversal order */
+    int g_nlines;
+    int g_linesize;         /* allocated size of g_lines */
+    int g_lineserial;       /* obj_connectserial() when lines were listed */
+    int g_linesvalid;
+} t_hitgrid;
+
+typedef struct _hitline
+{
+    t_outconnect *l_oc;
+    t_object *l_ob;
+    int l_outno;
+    t_object *l_ob2;
+    int l_inno;
+    int l_x1, l_y1, l_x2, l_y2;
+} t_hitline;
+
+void glist_nohitgrid(t_glist *x)
+{
+    if (x->gl_editor && x->gl_editor->e_hitgrid)
+        x->gl_editor->e_hitgrid->g_valid = 0;
+}
+
+static void hitgrid_free(t_hitgrid *g)
+{
+    if (g->g_size)
+    {
+        freebytes(g->g_vec, g->g_size * sizeof(*g->g_vec));
+        freebytes(g->g_hits, g->g_size * sizeof(*g->g_hits));
+        freebytes(g->g_found, g->g_size * sizeof(*g->g_found));
+        freebytes(g->g_stamp, g->g_size * sizeof(*g->g_stamp));
+        freebytes(g->g_loose, g->g_size * sizeof(*g->g_loose));
+    }
+    if (g->g_nonset)
+        freebytes(g->g_cellonset, g->g_nonset * sizeof(*g->g_cellonset));
+    if (g->g_ncellobj)
+        freebytes(g->g_cellobj, g->g_ncellobj * sizeof(*g->g_cellobj));
+    if (g->g_linesize)
+        freebytes(g->g_lines, g->g_linesize * sizeof(*g->g_lines));
+    freebytes(g, sizeof(*g));
+}
+
+    /* the same cheap check against unnoticed list changes as the glist's
+    own index: the ends of the vector have to match the ends of the list. */
+static int hitgrid_ok(t_hitgrid *g, t_glist *x)
+{
+    return (g->g_valid && (g->g_n ?
+        (g->g_vec[0] == x->gl_list && !g->g_vec[g->g_n-1]->g_next) :
+            !x->gl_list));
+}
+
+static void hitgrid_build(t_hitgrid *g, t_glist *x)
+{
+    t_gobj *y;
+    int n, i, ncells, nentries, (*rects)[4] = 0,
+        xmin = 0x7fffffff, ymin = 0x7fffffff, xmax = -0x7fffffff,
+        ymax = -0x7fffffff;
+    for (y = x->gl_list, n = 0; y; y = y->g_next)
+        n++;
+    if (n > g->g_size)
+    {
+        int newsize = (g->g_size ? 2 * g->g_size : 64);
+        while (newsize < n)
+            newsize *= 2;
+        if (g->g_size)
+        {
+            freebytes(g->g_vec, g->g_size * sizeof(*g->g_vec));
+            freebytes(g->g_hits, g->g_size * sizeof(*g->g_hits));
+            freebytes(g->g_found, g->g_size * sizeof(*g->g_found));
+            freebytes(g->g_stamp, g->g_size * sizeof(*g->g_stamp));
+            freebytes(g->g_loose, g->g_size * sizeof(*g->g_loose));
+        }
+        g->g_vec = (t_gobj **)getbytes(newsize * sizeof(*g->g_vec));
+        g->g_hits = (t_gobj **)getbytes(newsize * sizeof(*g->g_hits));
+        g->g_found = (int *)getbytes(newsize * sizeof(*g->g_found));
+        g->g_stamp = (int *)getbytes(newsize * sizeof(*g->g_stamp));
+        g->g_loose = (int *)getbytes(newsize * sizeof(*g->g_loose));
+        g->g_size = newsize;
+        g->g_stampnow = 0;
+    }
+    g->g_n = n;
+    g->g_nloose = 0;
+    if (n)
+        rects = (int (*)[4])getbytes(n * sizeof(*rects));
+    for (y = x->gl_list, i = 0; y; y = y->g_next, i++)
+    {
+        int *r = rects[i], m;
+        g->g_vec[i] = y;
+        if (!pd_checkobject(&y->g_pd))
+        {
+            r[0] = 1, r[2] = 0;     /* empty: goes in the loose list */
+            continue;
+        }
+        gobj_getrect(y, x, &r[0], &r[1], &r[2], &r[3]);
+        if (r[0] > r[2])
+            m = r[0], r[0] = r[2], r[2] = m;
+        if (r[1] > r[3])
+            m = r[1], r[1] = r[3], r[3] = m;
+        if (r[0] < xmin) xmin = r[0];
+        if (r[1] < ymin) ymin = r[1];
+        if (r[2] > xmax) xmax = r[2];
+        if (r[3] > ymax) ymax = r[3];
+    }
+    if (xmin > xmax)
+        xmin = xmax = ymin = ymax = 0;
+        /* make the cells bigger if the patch is sparse, so the grid
+        doesn't get much bigger than the number of objects */
+    g->g_x0 = xmin;
+    g->g_y0 = ymin;
+    g->g_cellsize = HITGRIDCELL;
+    while (1)
+    {
+        g->g_ncols = (int)(((double)xmax - xmin) / g->g_cellsize) + 1;
+        g->g_nrows = (int)(((double)ymax - ymin) / g->g_cellsize) + 1;
+        if ((double)g->g_ncols * g->g_nrows <= 4 * n + 64)
+            break;
+        g->g_cellsize *= 2;
+    }
+    ncells = g->g_ncols * g->g_nrows;
+    if (ncells + 1 > g->g_nonset)
+    {
+        if (g->g_nonset)
+            freebytes(g->g_cellonset, g->g_nonset * sizeof(*g->g_cellonset));
+        g->g_cellonset = (int *)getbytes((ncells + 1) *
+            sizeof(*g->g_cellonset));
+        g->g_nonset = ncells + 1;
+    }
+    else memset(g->g_cellonset, 0, (ncells + 1) * sizeof(*g->g_cellonset));
+        /* count objects per cell, moving big and non-box ones to the loose
+        list (marked by an empty rectangle) */
+    for (i = 0, nentries = 0; i < n; i++)
+    {
+        int *r = rects[i], cx1, cy1, cx2, cy2, cx, cy;
+        if (r[0] > r[2])
+        {
+            g->g_loose[g->g_nloose++] = i;
+            continue;
+        }
+        cx1 = (r[0] - g->g_x0) / g->g_cellsize;
+        cy1 = (r[1] - g->g_y0) / g->g_cellsize;
+        cx2 = (r[2] - g->g_x0) / g->g_cellsize;
+        cy2 = (r[3] - g->g_y0) / g->g_cellsize;
+        if ((cx2 - cx1 + 1) * (cy2 - cy1 + 1) > HITGRIDMAXSPAN)
+        {
+            g->g_loose[g->g_nloose++] = i;
+            r[0] = 1, r[2] = 0;
+            continue;
+        }
+        for (cy = cy1; cy <= cy2; cy++)
+            for (cx = cx1; cx <= cx2; cx++)
+                g->g_cellonset[cy * g->g_ncols + cx]++, nentries++;
+    }
+    for (i = 1; i <= ncells; i++)
+        g->g_cellonset[i] += g->g_cellonset[i-1];
+    if (nentries > g->g_ncellobj)
+    {
+        if (g->g_ncellobj)
+            freebytes(g->g_cellobj, g->g_ncellobj * sizeof(*g->g_cellobj));
+        g->g_cellobj = (int *)getbytes(nentries * sizeof(*g->g_cellobj));
+        g->g_ncellobj = nentries;
+    }
+        /* fill backward so each cell comes out in ascending order and its
+        count turns into its onset */
+    for (i = n - 1; i >= 0; i--)
+    {
+        int *r = rects[i], cx1, cy1, cx2, cy2, cx, cy;
+        if (r[0] > r[2])
+            continue;
+        cx1 = (r[0] - g->g_x0) / g->g_cellsize;
+        cy1 = (r[1] - g->g_y0) / g->g_cellsize;
+        cx2 = (r[2] - g->g_x0) / g->g_cellsize;
+        cy2 = (r[3] - g->g_y0) / g->g_cellsize;
+        for (cy = cy1; cy <= cy2; cy++)
+            for (cx = cx1; cx <= cx2; cx++)
+                g->g_cellobj[--g->g_cellonset[cy * g->g_ncols + cx]] = i;
+    }
+    if (n)
+        freebytes(rects, n * sizeof(*rects));
+    g->g_valid = 1;
+    g->g_linesvalid = 0;
+}
+
+static t_hitgrid *canvas_gethitgrid(t_canvas *x)
+{
+    t_hitgrid *g = x->gl_editor->e_hitgrid;
+    if (!g)
+        g = x->gl_editor->e_hitgrid = (t_hitgrid *)getbytes(sizeof(*g));
+    if (!hitgrid_ok(g, x))
+        hitgrid_build(g, x);
+    return (g);
+}
+
+    /* get all connections with their current end points */
+static t_hitline *canvas_gethitlines(t_canvas *x, int *np)
+{
+    t_hitgrid *g = canvas_gethitgrid(x);
+    if (!g->g_linesvalid || g->g_lineserial != obj_connectserial())
+    {
+        t_linetraverser t;
+        t_outconnect *oc;
+        g->g_nlines = 0;
+        linetraverser_start(&t, x);
+        while ((oc = linetraverser_next(&t)))
+        {
+            t_hitline *l;
+            if (g->g_nlines == g->g_linesize)
+            {
+                int newsize = (g->g_linesize ? 2 * g->g_linesize : 64);
+                g->g_lines = (t_hitline *)(g->g_linesize ?
+                    resizebytes(g->g_lines, g->g_linesize * sizeof(t_hitline),
+                        newsize * sizeof(t_hitline)) :
+                    getbytes(newsize * sizeof(t_hitline)));
+                g->g_linesize = newsize;
+            }
+            l = &g->g_lines[g->g_nlines++];
+            l->l_oc = oc;
+            l->l_ob = t.tr_ob;
+            l->l_outno = t.tr_outno;
+            l->l_ob2 = t.tr_ob2;
+            l->l_inno = t.tr_inno;
+            l->l_x1 = t.tr_lx1;
+            l->l_y1 = t.tr_ly1;
+            l->l_x2 = t.tr_lx2;
+            l->l_y2 = t.tr_ly2;
+        }
+        g->g_lineserial = obj_connectserial();
+        g->g_linesvalid = 1;
+    }
+    *np = g->g_nlines;
+    return (g->g_lines);
+}
+
+    /* get the objects that might contain a point, in the order of the
+    glist.  The vector stays valid until the next query. */
+static int canvas_hitcandidates(t_canvas *x, int xpos, int ypos,
+    t_gobj ***vecp)
+{
+    t_hitgrid *g = canvas_gethitgrid(x);
+    int cx = (xpos - g->g_x0), cy = (ypos - g->g_y0), n = 0,
+        i = 0, ni = 0, j = 0, nj = g->g_nloose, *cell = 0;
+    if (cx >= 0 && cy >= 0 && (cx /= g->g_cellsize) < g->g_ncols &&
+        (cy /= g->g_cellsize) < g->g_nrows)
+    {
+        int c = cy * g->g_ncols + cx;
+        cell = g->g_cellobj + g->g_cellonset[c];
+        ni = g->g_cellonset[c+1] - g->g_cellonset[c];
+    }
+    while (i < ni || j < nj)
+    {
+        if (j >= nj || (i < ni && cell[i] < g->g_loose[j]))
+            g->g_hits[n++] = g->g_vec[cell[i++]];
+        else g->g_hits[n++] = g->g_vec[g->g_loose[j++]];
+    }
+    *vecp = g->g_hits;
+    return (n);
+}
+
+static int hitgrid_intcmp(const void *a, const void *b)
+{
+    return (*(const int *)a - *(const int *)b);
+}
+
+    /* same for objects that might overlap a rectangle */
+static int canvas_hitcandidatesinrect(t_canvas *x, int lox, int loy,
+    int hix, int hiy, t_gobj ***vecp)
+{
+    t_hitgrid *g = canvas_gethitgrid(x);
+    int cx1, cy1, cx2, cy2, cx, cy, i, n = 0;
+    if (++g->g_stampnow == 0x7fffffff)
+    {
+        memset(g->g_stamp, 0, g->g_size * sizeof(*g->g_stamp));
+        g->g_stampnow = 1;
+    }
+    cx1 = (lox - g->g_x0) / g->g_cellsize;
+    cy1 = (loy - g->g_y0) / g->g_cellsize;
+    cx2 = (hix - g->g_x0) / g->g_cellsize;
+    cy2 = (hiy - g->g_y0) / g->g_cellsize;
+    if (lox < g->g_x0) cx1 = 0;
+    if (loy < g->g_y0) cy1 = 0;
+    if (hix < g->g_x0) cx2 = -1;
+    if (hiy < g->g_y0) cy2 = -1;
+    if (cx2 >= g->g_ncols) cx2 = g->g_ncols - 1;
+    if (cy2 >= g->g_nrows) cy2 = g->g_nrows - 1;
+    for (cy = cy1; cy <= cy2; cy++)
+        for (cx = cx1; cx <= cx2; cx++)
+    {
+        int c = cy * g->g_ncols + cx;
+        for (i = g->g_cellonset[c]; i < g->g_cellonset[c+1]; i++)
+        {
+            int k = g->g_cellobj[i];
+            if (g->g_stamp[k] != g->g_stampnow)
+                g->g_stamp[k] = g->g_stampnow, g->g_found[n++] = k;
+        }
+    }
+    for (i = 0; i < g->g_nloose; i++)
+        g->g_found[n++] = g->g_loose[i];
+    qsort(g->g_found, n, sizeof(*g->g_found), hitgrid_intcmp);
+    for (i = 0; i < n; i++)
+        g->g_hits[i] = g->g_vec[g->g_found[i]];
+    *vecp = g->g_hits;
+    return (n);
+}
+
     /* find the last gobj, if any, containing the point. */
 static t_gobj *canvas_findhitbox(t_canvas *x, int xpos, int ypos,
     int *x1p, int *y1p, int *x2p, int *y2p)
 {
-    t_gobj *y, *rval = 0;
-    int x1, y1, x2, y2;
+    t_gobj *y, *rval = 0, **vec;
+    int x1, y1, x2, y2, i, n = canvas_hitcandidates(x, xpos, ypos, &vec);
     *x1p = -0x7fffffff;
-    for (y = x->gl_list; y; y = y->g_next)
+    for (i = 0; i < n; i++)
     {
+        y = vec[i];
         if (canvas_hitbox(x, y, xpos, ypos, &x1, &y1, &x2, &y2)
             && (x1 > *x1p))
                 *x1p = x1, *y1p = y1, *x2p = x2, *y2p = y2, rval = y;
@@ -1764,7 +2179,7 @@ static t_gobj *canvas_findhitbox(t_canvas *x, int xpos, int ypos,
         /* if there are at least two selected objects, we'd prefer
            to find a selected one (never mind which) to the one we got. */
     if (x->gl_editor && x->gl_editor->e_selection &&
-        x->gl_editor->e_selection->sel_next && !glist_isselected(x, y))
+        x->gl_editor->e_selection->sel_next)
     {
         t_selection *sel;
         for (sel = x->gl_editor->e_selection; sel; sel = sel->sel_next)
@@ -1808,6 +2223,10 @@ static void editor_free(t_editor *x, t_glist *y)
     binbuf_free(x->e_deleted);
     if (x->e_clock)
         clock_free(x->e_clock);
+    if (x->e_hitgrid)
+        hitgrid_free(x->e_hitgrid);
+    if (x->e_rtexthash)
+        freebytes(x->e_rtexthash, x->e_rtexthashsize * sizeof(t_rtext *));
     freebytes((void *)x, sizeof(*x));
 }
 
@@ -1837,6 +2256,7 @@ void canvas_destroy_editor(t_glist *x)
             rtext_activate(x->gl_editor->e_textedfor, 0);
         while ((rtext = x->gl_editor->e_rtext))
             rtext_free(rtext);
+        glist_undefer(x);
         editor_free(x->gl_editor, x);
         x->gl_editor = 0;
     }
@@ -2256,14 +2676,19 @@ static void canvas_doclick(t_canvas *x, int xpos, int ypos, int which,
             }
             return;
         }
-        for (hitbox = x->gl_list; hitbox; hitbox = hitbox->g_next)
+        t_gobj **vec;
+        int i, n = canvas_hitcandidates(x, xpos, ypos, &vec);
+        for (i = 0, hitbox = 0; i < n; i++)
         {
                 /* check if the object wants to be clicked */
-            if (canvas_hitbox(x, hitbox, xpos, ypos, &x1, &y1, &x2, &y2)
-                && (clickreturned = gobj_click(hitbox, x, xpos, ypos,
+            if (canvas_hitbox(x, vec[i], xpos, ypos, &x1, &y1, &x2, &y2)
+                && (clickreturned = gobj_click(vec[i], x, xpos, ypos,
                     shiftmod, ((mod & CTRLMOD) && (!x->gl_edit)) || altmod,
                         doublemod, doit)))
-                            break;
+            {
+                hitbox = vec[i];
+                break;
+            }
         }
         if (!doit)
         {
@@ -2415,24 +2840,32 @@ static void canvas_doclick(t_canvas *x, int xpos, int ypos, int which,
         /* having failed to find a box, we try lines now. */
     if (!runmode && !altmod)
     {
-        t_linetraverser t;
+        t_hitline *l;
         t_outconnect *oc;
         t_float fx = xpos, fy = ypos;
         t_glist *glist2 = glist_getcanvas(x);
-        linetraverser_start(&t, glist2);
-        while ((oc = linetraverser_next(&t)))
+        int i, nlines;
+        l = canvas_gethitlines(glist2, &nlines);
+        for (i = 0; i < nlines; i++, l++)
         {
-            int outindex, inindex;
-            t_float lx1 = t.tr_lx1, ly1 = t.tr_ly1,
-                lx2 = t.tr_lx2, ly2 = t.tr_ly2;
-            t_float area = (lx2 - lx1) * (fy - ly1) -
-                (ly2 - ly1) * (fx - lx1);
-            t_float dsquare = (lx2-lx1) * (lx2-lx1) + (ly2-ly1) * (ly2-ly1);
+            int outindex, inindex, outno, inno;
+            t_float lx1 = l->l_x1, ly1 = l->l_y1,
+                lx2 = l->l_x2, ly2 = l->l_y2, area, dsquare;
+                /* quick rejection: we only accept points within sqrt(50)
+                of the line below */
+            if ((fx < lx1 - 8 && fx < lx2 - 8) || (fx > lx1 + 8 && fx > lx2 + 8)
+                || (fy < ly1 - 8 && fy < ly2 - 8) || (fy > ly1 + 8 && fy > ly2 + 8))
+                    continue;
+            area = (lx2 - lx1) * (fy - ly1) - (ly2 - ly1) * (fx - lx1);
+            dsquare = (lx2-lx1) * (lx2-lx1) + (ly2-ly1) * (ly2-ly1);
             if (area * area >= 50 * dsquare) continue;
             if ((lx2-lx1) * (fx-lx1) + (ly2-ly1) * (fy-ly1) < 0) continue;
             if ((lx2-lx1) * (lx2-fx) + (ly2-ly1) * (ly2-fy) < 0) continue;
-            outindex = canvas_getindex(glist2, &t.tr_ob->ob_g);
-            inindex = canvas_getindex(glist2, &t.tr_ob2->ob_g);
+            oc = l->l_oc;
+            outno = l->l_outno;
+            inno = l->l_inno;
+            outindex = canvas_getindex(glist2, &l->l_ob->ob_g);
+            inindex = canvas_getindex(glist2, &l->l_ob2->ob_g);
             if (shiftmod)
             {
                 int soutindex, sinindex, soutno, sinno;
@@ -2442,8 +2875,8 @@ static void canvas_doclick(t_canvas *x, int xpos, int ypos, int which,
                     if (doit)
                     {
                         glist_selectline(glist2, oc,
-                            outindex, t.tr_outno,
-                            inindex, t.tr_inno);
+                            outindex, outno,
+                            inindex, inno);
                     }
                     canvas_setcursor(x, CURSOR_EDITMODE_DISCONNECT);
                     return;
@@ -2454,7 +2887,7 @@ static void canvas_doclick(t_canvas *x, int xpos, int ypos, int which,
                 sinno = x->gl_editor->e_selectline_inno;
                         /* if the hovered line is already selected, deselect it */
                 if ((outindex == soutindex) && (inindex == sinindex)
-                    && (soutno == t.tr_outno) && (sinno == t.tr_inno))
+                    && (soutno == outno) && (sinno == inno))
                 {
                     if(doit)
                         glist_deselectline(x);
@@ -2470,15 +2903,15 @@ static void canvas_doclick(t_canvas *x, int xpos, int ypos, int which,
                     {
                         canvas_undo_add(x, UNDO_SEQUENCE_START, "reconnect", 0);
                         canvas_disconnect_with_undo(x, soutindex, soutno, sinindex, sinno);
-                        canvas_disconnect_with_undo(x, outindex, t.tr_outno, inindex, t.tr_inno);
-                        canvas_connect_with_undo(x, outindex, t.tr_outno, sinindex, sinno);
-                        canvas_connect_with_undo(x, soutindex, soutno, inindex, t.tr_inno);
+                        canvas_disconnect_with_undo(x, outindex, outno, inindex, inno);
+                        canvas_connect_with_undo(x, outindex, outno, sinindex, sinno);
+                        canvas_connect_with_undo(x, soutindex, soutno, inindex, inno);
                         canvas_undo_add(x, UNDO_SEQUENCE_END, "reconnect", 0);
 
                         x->gl_editor->e_selectline_index1 = soutindex;
                         x->gl_editor->e_selectline_outno = soutno;
                         x->gl_editor->e_selectline_index2 = inindex;
-                        x->gl_editor->e_selectline_inno = t.tr_inno;
+                        x->gl_editor->e_selectline_inno = inno;
 
                         canvas_dirty(x, 1);
                     }
@@ -2493,8 +2926,8 @@ static void canvas_doclick(t_canvas *x, int xpos, int ypos, int which,
                 {
                     glist_noselect(x);
                     glist_selectline(glist2, oc,
-                        outindex, t.tr_outno,
-                        inindex, t.tr_inno);
+                        outindex, outno,
+                        inindex, inno);
                 }
                 canvas_setcursor(x, CURSOR_EDITMODE_DISCONNECT);
                 return;
@@ -2519,16 +2952,22 @@ void canvas_mouse(t_canvas *x, t_floatarg xpos, t_floatarg ypos,
     canvas_doclick(x, xpos, ypos, which, mod, 1);
 }
 
+    /* look only at the connections from outlet n1 of ob1, not all the
+    canvas's connections, so that loading a patch stays linear */
 int canvas_isconnected (t_canvas *x, t_text *ob1, int n1,
     t_text *ob2, int n2)
 {
-    t_linetraverser t;
-    t_outconnect *oc;
-    linetraverser_start(&t, x);
-    while ((oc = linetraverser_next(&t)))
-        if (t.tr_ob == ob1 && t.tr_outno == n1 &&
-            t.tr_ob2 == ob2 && t.tr_inno == n2)
-                return (1);
+    t_outlet *op;
+    t_inlet *ip;
+    t_object *dest;
+    int which;
+    t_outconnect *oc = obj_starttraverseoutlet(ob1, &op, n1);
+    while (oc)
+    {
+        oc = obj_nexttraverseoutlet(oc, &dest, &ip, &which);
+        if (dest == ob2 && which == n2)
+            return (1);
+    }
     return (0);
 }
 
@@ -2799,10 +3238,15 @@ static void canvas_doconnect(t_canvas *x, int xpos, int ypos, int mod, int doit)
 
 void canvas_selectinrect(t_canvas *x, int lox, int loy, int hix, int hiy)
 {
-    t_gobj *y;
-    for (y = x->gl_list; y; y = y->g_next)
+    t_gobj *y, **vec;
+    int i, n;
+    if (!x->gl_editor)
+        return;
+    n = canvas_hitcandidatesinrect(x, lox, loy, hix, hiy, &vec);
+    for (i = 0; i < n; i++)
     {
         int x1, y1, x2, y2;
+        y = vec[i];
         gobj_getrect(y, x, &x1, &y1, &x2, &y2);
         if (hix >= x1 && lox <= x2 && hiy >= y1 && loy <= y2
             && !glist_isselected(x, y))
@@ -2912,6 +3356,8 @@ static void canvas_displaceselection(t_canvas *x, int dx, int dy)
     }
     if (resortin) canvas_resortinlets(x);
     if (resortout) canvas_resortoutlets(x);
+        /* anything not drawn yet may have been moved into view */
+    glist_drawdeferred(x);
     sys_vgui("pdtk_canvas_getscroll .x%lx.c\n", x);
     if (x->gl_editor->e_selection)
         canvas_dirty(x, 1);
@@ -3566,6 +4012,7 @@ void canvas_stowconnections(t_canvas *x)
         /* move the selected part to the end */
     if (!nonhead) x->gl_list = selhead;
     else x->gl_list = nonhead, nontail->g_next = selhead;
+    glist_noindex(x);
 
         /* add connections to binbuf */
     binbuf_clear(x->gl_editor->e_connectbuf);
@@ -3648,6 +4095,48 @@ static void canvas_clearline(t_canvas *x)
     }
 }
 
+typedef struct _clearitem
+{
+    int c_index;
+    t_gobj *c_gobj;
+    t_selection *c_sel;
+} t_clearitem;
+
+static int canvas_clearitemcmp(const void *p1, const void *p2)
+{
+    return (((t_clearitem *)p1)->c_index - ((t_clearitem *)p2)->c_index);
+}
+
+    /* delete the selected objects in the order of the glist.  The selection
+    is put in the same order first, so that the one being deleted is always
+    at its head and deselecting it doesn't have to search. */
+static void canvas_clearselection(t_canvas *x)
+{
+    t_selection *sel;
+    t_clearitem *vec;
+    int n, i, nobj = glist_getindex(x, 0);
+    for (sel = x->gl_editor->e_selection, n = 0; sel; sel = sel->sel_next)
+        n++;
+    if (!n)
+        return;
+    vec = (t_clearitem *)getbytes(n * sizeof(*vec));
+    for (sel = x->gl_editor->e_selection, i = 0; sel; sel = sel->sel_next, i++)
+    {
+        vec[i].c_index = glist_getindex(x, sel->sel_what);
+        vec[i].c_gobj = sel->sel_what;
+        vec[i].c_sel = sel;
+    }
+    qsort(vec, n, sizeof(*vec), canvas_clearitemcmp);
+    x->gl_editor->e_selection = vec[0].c_sel;
+    for (i = 0; i < n; i++)
+        vec[i].c_sel->sel_next = (i < n-1 ? vec[i+1].c_sel : 0);
+        /* anything not found in the glist is left selected, as before */
+    for (i = 0; i < n && vec[i].c_index < nobj; i++)
+        if (glist_isselected(x, vec[i].c_gobj))
+            glist_delete(x, vec[i].c_gobj);
+    freebytes(vec, n * sizeof(*vec));
+}
+
 static void canvas_doclear(t_canvas *x)
 {
     t_gobj *y, *y2;
@@ -3677,6 +4166,8 @@ static void canvas_doclear(t_canvas *x)
                 if (&y->g_pd == pd_this->pd_newest) glist_select(x, y);
         }
     }
+    canvas_clearselection(x);
+        /* in case deleting something selected something else */
     while (1)   /* this is pretty weird...  should rewrite it */
     {
         for (y = x->gl_list; y; y = y2)
@@ -4295,18 +4786,16 @@ void canvas_connect(t_canvas *x, t_floatarg fwhoout, t_floatarg foutno,
     int nin = whoin, nout = whoout;
     if (EDITOR->paste_canvas == x) whoout += EDITOR->paste_onset,
         whoin += EDITOR->paste_onset;
-    for (src = x->gl_list; whoout; src = src->g_next, whoout--)
-        if (!src->g_next) {
-            src = NULL;
-            logpost(sink, 3, "cannot connect non-existing object");
-            goto bad; /* bug fix thanks to Hannes */
-        }
-    for (sink = x->gl_list; whoin; sink = sink->g_next, whoin--)
-        if (!sink->g_next) {
-            sink = NULL;
-            logpost(src, 3, "cannot connect to non-existing object");
-            goto bad;
-        }
+    if (!(src = glist_nth(x, whoout)))
+    {
+        logpost(sink, 3, "cannot connect non-existing object");
+        goto bad; /* bug fix thanks to Hannes */
+    }
+    if (!(sink = glist_nth(x, whoin)))
+    {
+        logpost(src, 3, "cannot connect to non-existing object");
+        goto bad;
+    }
 
         /* check they're both patchable objects */
     if (!(objsrc = pd_checkobject(&src->g_pd)) ||
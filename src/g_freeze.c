@@ -0,0 +1,366 @@
+/* Copyright (c) 1997-2021 Miller Puckette and others.
+* For information on usage and redistribution, and for a DISCLAIMER OF ALL
+* WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+/* "freeze" for subpatches.  A subpatch whose output doesn't depend on
+anything coming into it -- a drone, a wavetable, an impulse response -- can
+be rendered once into arrays (one per signal outlet) by sending it
+"freeze <msec> <array>...".  While frozen, the DSP chain leaves out its
+contents and plays the arrays back in a loop instead, until it gets
+"unfreeze".
+
+Rendering is done in the background, a little at a time from a clock so
+that it doesn't hold up the scheduler.  It runs the subpatch on a DSP chain
+of its own (see ugen_beginsubchain() in d_ugen.c) with silent inputs; until
+it's done, the frozen subpatch outputs zeros.  The chain is made again if
+the main DSP chain is resorted (which recycles its signals) or if anything
+in the subpatch is deleted. */
+
+#include "m_pd.h"
+#include "m_imp.h"
+#include "g_canvas.h"
+#include <string.h>
+
+#define FREEZE_BUDGET 0.0005    /* seconds of rendering per clock */
+#define FREEZE_INTERVAL 1       /* msec between bouts of rendering */
+#define FREEZE_VECSIZE 64
+
+EXTERN_STRUCT _dspcontext;
+#define t_dspcontext struct _dspcontext
+void ugen_add(t_dspcontext *dc, t_object *x);
+void ugen_connect(t_dspcontext *dc, t_object *x1, int outno,
+    t_object *x2, int inno);
+void canvas_dodsp(t_canvas *x, int toplevel, t_signal **sp);
+t_signal *signal_newfromcontext(int borrowed);
+void signal_makereusable(t_signal *sig);
+int ugen_getsortno(void);
+t_outlet *voutlet_getit(t_pd *x);
+
+static t_class *freeze_player_class;
+
+typedef struct _freezeplayer    /* stands in for the subpatch's contents */
+{
+    t_object p_obj;
+    struct _freeze *p_freeze;
+} t_freezeplayer;
+
+typedef struct _freeze
+{
+    t_canvas *f_canvas;
+    t_freezeplayer *f_player;
+    int f_nout;             /* number of arrays, one per signal outlet */
+    t_symbol **f_arrays;
+    t_word **f_vecs;        /* array contents when playing */
+    int *f_npoints;
+    unsigned long f_phase;  /* playback position in samples */
+    int f_rendering;        /* nonzero until the arrays are filled */
+    int f_building;         /* sorting the subpatch for rendering */
+    int f_stale;            /* something was deleted; remake the chain */
+    long f_nsamps;          /* length to render */
+    long f_done;            /* ... and how much is done so far */
+    t_float f_sr;
+    t_clock *f_clock;
+    t_int *f_chain;         /* the subpatch's own DSP chain */
+    int f_chainsize;
+    int f_sortno;           /* DSP sort the chain was made in */
+    t_sample *f_zeros;      /* silent input */
+    t_sample *f_outbuf;     /* outputs copied here by the chain */
+} t_freeze;
+
+static void freeze_unchain(t_freeze *x)
+{
+    if (x->f_chain)
+        ugen_freesubchain(x->f_chain, x->f_chainsize);
+    x->f_chain = 0;
+}
+
+    /* make a DSP chain for the subpatch, as clone_schedule() does for a
+    copy added while DSP is running, copying its outputs to f_outbuf */
+static void freeze_makechain(t_freeze *x)
+{
+    t_canvas *gl = x->f_canvas;
+    int i, nin = obj_nsiginlets(&gl->gl_obj),
+        nout = obj_nsigoutlets(&gl->gl_obj);
+    t_signal **tempio = (t_signal **)getbytes((nin + nout + 1) *
+        sizeof(*tempio));
+    void *z;
+    freeze_unchain(x);
+    memset(x->f_outbuf, 0, x->f_nout * FREEZE_VECSIZE * sizeof(t_sample));
+    z = ugen_beginsubchain(x->f_sr, FREEZE_VECSIZE, FREEZE_VECSIZE);
+    for (i = 0; i < nin; i++)
+        tempio[i] = ugen_subchaininput(z, x->f_zeros, FREEZE_VECSIZE, 1);
+    for (i = 0; i < nout; i++)
+        tempio[nin + i] = signal_newfromcontext(1);
+    x->f_building = 1;
+    canvas_dodsp(gl, 0, tempio);
+    x->f_building = 0;
+    for (i = 0; i < nout; i++)
+    {
+        if (i < x->f_nout)
+            dsp_add_copy(tempio[nin + i]->s_vec,
+                x->f_outbuf + i * FREEZE_VECSIZE, FREEZE_VECSIZE);
+        signal_makereusable(tempio[nin + i]);
+    }
+    x->f_chain = ugen_endsubchain(z, &x->f_chainsize);
+    x->f_sortno = ugen_getsortno();
+    x->f_stale = 0;
+    freebytes(tempio, (nin + nout + 1) * sizeof(*tempio));
+}
+
+    /* find the nth array, which must still be long enough to finish */
+static t_garray *freeze_getarray(t_freeze *x, int n, int *npoints,
+    t_word **vec)
+{
+    t_garray *a = (t_garray *)pd_findbyclass(x->f_arrays[n], garray_class);
+    if (!a || !garray_getfloatwords(a, npoints, vec))
+        return (0);
+    return (a);
+}
+
+static void freeze_resort(void)
+{
+    canvas_resume_dsp(canvas_suspend_dsp());
+}
+
+static void freeze_tick(t_freeze *x)
+{
+    double start = sys_getrealtime();
+    int i;
+    if (x->f_stale || !x->f_chain || x->f_sortno != ugen_getsortno())
+        freeze_makechain(x);
+    while (x->f_done < x->f_nsamps)
+    {
+        t_int *ip;
+        int n = (x->f_nsamps - x->f_done < FREEZE_VECSIZE ?
+            x->f_nsamps - x->f_done : FREEZE_VECSIZE);
+        for (ip = x->f_chain; ip; )
+            ip = (*(t_perfroutine)(*ip))(ip);
+        for (i = 0; i < x->f_nout; i++)
+        {
+            int npoints, j;
+            t_word *vec;
+            t_sample *fp = x->f_outbuf + i * FREEZE_VECSIZE;
+            if (!freeze_getarray(x, i, &npoints, &vec) ||
+                npoints < x->f_nsamps)
+            {
+                pd_error(x->f_canvas, "freeze: %s: no such array or too short",
+                    x->f_arrays[i]->s_name);
+                freeze_unchain(x);
+                x->f_rendering = 0;
+                return;
+            }
+            for (j = 0, vec += x->f_done; j < n; j++)
+                vec[j].w_float = fp[j];
+        }
+        x->f_done += n;
+        if (sys_getrealtime() - start > FREEZE_BUDGET)
+            break;
+    }
+    if (x->f_done < x->f_nsamps)
+    {
+        clock_delay(x->f_clock, FREEZE_INTERVAL);
+        return;
+    }
+    freeze_unchain(x);
+    for (i = 0; i < x->f_nout; i++)
+    {
+        t_garray *a = (t_garray *)pd_findbyclass(x->f_arrays[i],
+            garray_class);
+        if (a)
+            garray_redraw(a);
+    }
+    x->f_rendering = 0;
+    x->f_phase = 0;
+    freeze_resort();
+}
+
+static t_int *freeze_player_perform(t_int *w)
+{
+    t_freeze *x = (t_freeze *)(w[1]);
+    int n = (int)(w[2]), i, j;
+    for (i = 0; i < x->f_nout; i++)
+    {
+        t_sample *out = (t_sample *)(w[3 + i]);
+        t_word *vec = x->f_vecs[i];
+        int npoints = x->f_npoints[i];
+        if (vec && npoints > 0)
+        {
+            int phase = x->f_phase % npoints;
+            for (j = 0; j < n; j++)
+            {
+                out[j] = vec[phase].w_float;
+                if (++phase >= npoints)
+                    phase = 0;
+            }
+        }
+        else for (j = 0; j < n; j++)
+            out[j] = 0;
+    }
+    x->f_phase += n;
+    return (w + 3 + x->f_nout);
+}
+
+static void freeze_player_dsp(t_freezeplayer *p, t_signal **sp)
+{
+    t_freeze *x = p->p_freeze;
+    t_int *vec = (t_int *)getbytes((2 + x->f_nout) * sizeof(*vec));
+    int i;
+    vec[0] = (t_int)x;
+    vec[1] = (t_int)sp[0]->s_n;
+    for (i = 0; i < x->f_nout; i++)
+    {
+        t_garray *a;
+        x->f_vecs[i] = 0;
+        x->f_npoints[i] = 0;
+        if (!x->f_rendering &&
+            (a = freeze_getarray(x, i, &x->f_npoints[i], &x->f_vecs[i])))
+                garray_usedindsp(a);
+        vec[2 + i] = (t_int)sp[i]->s_vec;
+    }
+    dsp_addv(freeze_player_perform, 2 + x->f_nout, vec);
+    freebytes(vec, (2 + x->f_nout) * sizeof(*vec));
+}
+
+    /* called from canvas_dodsp().  If the canvas is frozen, put only its
+    inlets and outlets on the DSP graph, with the player feeding the signal
+    outlets in order, and return 1.  Otherwise return 0 and let the canvas
+    sort its contents as usual. */
+int canvas_freezedsp(t_canvas *gl, t_dspcontext *dc)
+{
+    t_freeze *x = gl->gl_freeze;
+    t_gobj *y;
+    int nout = obj_noutlets(&gl->gl_obj), sigout = 0, i;
+    if (!x || x->f_building)
+        return (0);
+    for (y = gl->gl_list; y; y = y->g_next)
+        if (pd_class(&y->g_pd) == vinlet_class ||
+            pd_class(&y->g_pd) == voutlet_class)
+                ugen_add(dc, pd_checkobject(&y->g_pd));
+    ugen_add(dc, &x->f_player->p_obj);
+    for (i = 0; i < nout && sigout < x->f_nout; i++)
+    {
+        t_outlet *op;
+        if (!obj_issignaloutlet(&gl->gl_obj, i))
+            continue;
+        obj_starttraverseoutlet(&gl->gl_obj, &op, i);
+        for (y = gl->gl_list; y; y = y->g_next)
+            if (pd_class(&y->g_pd) == voutlet_class &&
+                voutlet_getit(&y->g_pd) == op)
+        {
+            ugen_connect(dc, &x->f_player->p_obj, sigout,
+                pd_checkobject(&y->g_pd), 0);
+            break;
+        }
+        sigout++;
+    }
+    return (1);
+}
+
+    /* something in the glist was deleted; if it, or a glist it's in, is
+    being rendered, the chain has to be made again before it's run */
+void canvas_freezechanged(t_glist *gl)
+{
+    for (; gl; gl = gl->gl_owner)
+        if (gl->gl_freeze)
+            gl->gl_freeze->f_stale = 1;
+}
+
+void canvas_unfreeze(t_canvas *gl)
+{
+    t_freeze *x = gl->gl_freeze;
+    if (!x)
+        return;
+    gl->gl_freeze = 0;
+    clock_free(x->f_clock);
+    freeze_unchain(x);
+    pd_free(&x->f_player->p_obj.ob_pd);
+    freebytes(x->f_arrays, x->f_nout * sizeof(*x->f_arrays));
+    freebytes(x->f_vecs, x->f_nout * sizeof(*x->f_vecs));
+    freebytes(x->f_npoints, x->f_nout * sizeof(*x->f_npoints));
+    freebytes(x->f_zeros, FREEZE_VECSIZE * sizeof(t_sample));
+    freebytes(x->f_outbuf, x->f_nout * FREEZE_VECSIZE * sizeof(t_sample));
+    freebytes(x, sizeof(*x));
+    freeze_resort();
+}
+
+    /* "freeze <msec> <array>..." - render the subpatch into the arrays,
+    which are resized to fit, and play them in its place from then on */
+static void canvas_freeze(t_canvas *gl, t_symbol *s, int argc, t_atom *argv)
+{
+    t_freeze *x;
+    t_float msec = atom_getfloatarg(0, argc, argv);
+    int i, nout = obj_nsigoutlets(&gl->gl_obj);
+    long nsamps = (long)(msec * sys_getsr() * 0.001 + 0.5);
+    if (!gl->gl_owner)
+    {
+        pd_error(gl, "freeze: only subpatches can be frozen");
+        return;
+    }
+    if (argc < 2 || nsamps < 1 || argc - 1 > nout)
+    {
+        pd_error(gl,
+            "usage: freeze <msec> <array>... (one per signal outlet, %d here)",
+                nout);
+        return;
+    }
+    for (i = 1; i < argc; i++)
+    {
+        t_garray *a;
+        t_word *vec;
+        int npoints;
+        if (argv[i].a_type != A_SYMBOL || !(a = (t_garray *)
+            pd_findbyclass(argv[i].a_w.w_symbol, garray_class)))
+        {
+            pd_error(gl, "freeze: no array '%s'",
+                atom_getsymbolarg(i, argc, argv)->s_name);
+            return;
+        }
+        if (!garray_getfloatwords(a, &npoints, &vec))
+        {
+            pd_error(gl, "freeze: %s: bad template",
+                argv[i].a_w.w_symbol->s_name);
+            return;
+        }
+    }
+    canvas_unfreeze(gl);
+    nout = argc - 1;
+    x = (t_freeze *)getbytes(sizeof(*x));
+    x->f_canvas = gl;
+    x->f_nout = nout;
+    x->f_arrays = (t_symbol **)getbytes(nout * sizeof(*x->f_arrays));
+    x->f_vecs = (t_word **)getbytes(nout * sizeof(*x->f_vecs));
+    x->f_npoints = (int *)getbytes(nout * sizeof(*x->f_npoints));
+    for (i = 0; i < nout; i++)
+    {
+        x->f_arrays[i] = argv[i + 1].a_w.w_symbol;
+        garray_resize_long((t_garray *)pd_findbyclass(x->f_arrays[i],
+            garray_class), nsamps);
+    }
+    x->f_zeros = (t_sample *)getbytes(FREEZE_VECSIZE * sizeof(t_sample));
+    x->f_outbuf = (t_sample *)getbytes(nout * FREEZE_VECSIZE *
+        sizeof(t_sample));
+    x->f_nsamps = nsamps;
+    x->f_sr = sys_getsr();
+    x->f_rendering = 1;
+    x->f_clock = clock_new(x, (t_method)freeze_tick);
+    x->f_player = (t_freezeplayer *)pd_new(freeze_player_class);
+    x->f_player->p_freeze = x;
+    for (i = 0; i < nout; i++)
+        outlet_new(&x->f_player->p_obj, &s_signal);
+    gl->gl_freeze = x;
+        /* take the contents off the DSP chain while they're rendered */
+    freeze_resort();
+    clock_delay(x->f_clock, 0);
+}
+
+void g_freeze_setup(void)
+{
+    freeze_player_class = class_new(gensym("freeze-player"), 0, 0,
+        sizeof(t_freezeplayer), CLASS_NOINLET, 0);
+    class_addmethod(freeze_player_class, (t_method)freeze_player_dsp,
+        gensym("dsp"), A_CANT, 0);
+    class_addmethod(canvas_class, (t_method)canvas_freeze,
+        gensym("freeze"), A_GIMME, 0);
+    class_addmethod(canvas_class, (t_method)canvas_unfreeze,
+        gensym("unfreeze"), 0);
+}
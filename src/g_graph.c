@@ -8,7 +8,7 @@ to this file... */
 
 #include <stdlib.h>
 #include "m_pd.h"
-
+#include "m_imp.h"
 #include "g_canvas.h"
 #include <stdio.h>
 #include <string.h>
@@ -25,17 +25,427 @@ static void graph_getrect(t_gobj *z, t_glist *glist,
 
 void canvas_drawredrect(t_canvas *x, int doit);
 
+    /* To avoid walking the list every time an object is looked up by
+    number (for each "connect" message when loading a patch, and in undo)
+    we keep a vector of the objects in order, and a hash table from object
+    to number.  A second vector holds just the scalars, so that "pointer"
+    can seek to the nth one.  Appending via glist_add() and deleting any
+    object keep them up to date; anything else that changes the list must
+    call glist_noindex() afterward so that they're rebuilt the next time
+    they're needed.
+
+    A deleted object leaves a hole in the vector, and each slot keeps the
+    numbers of the live slots before and after it, so that glist_delete()
+    finds the object's predecessor in the list without walking it.  The
+    holes are squeezed out (by rebuilding) the next time an object is asked
+    for by number.  Deleting a whole patch or a big selection is then linear
+    in the number of objects. */
+
+typedef struct _glistsource
+{
+    int s_slot;             /* slot of an object connected into this one */
+    int s_next;             /* next entry for the same object, or -1 */
+} t_glistsource;
+
+typedef struct _glistindex
+{
+    t_gobj **gi_vec;        /* objects in the order of gl_list, 0 if gone */
+    int gi_n;               /* number of slots used */
+    int gi_nlive;           /* number of slots still holding objects */
+    int gi_size;            /* allocated size of per-slot vectors */
+    int *gi_prev;           /* previous live slot, or -1 */
+    int *gi_next;           /* next live slot, or -1 */
+    int gi_first;           /* first and last live slots, or -1 */
+    int gi_last;
+    int *gi_hash;           /* 1 + index into gi_vec, or 0 if empty */
+    int gi_hashsize;        /* size of gi_hash, a power of 2 */
+    int gi_valid;           /* false if the list might have changed */
+    t_scalar **gi_svec;     /* the scalars among them, in order */
+    int gi_ns;              /* number of scalars */
+    int gi_ssize;           /* allocated size of gi_svec */
+    int gi_sstale;          /* true if a scalar was deleted from the middle */
+        /* connections into each object, so that deleting an object
+        doesn't have to look at every other object's outlets.  This is
+        rebuilt when anyone makes or breaks a connection, except for what
+        glist_forgetline() is told about. */
+    int *gi_inhead;         /* per slot, first entry in gi_src or -1 */
+    t_glistsource *gi_src;
+    int gi_nsrc;
+    int gi_srcsize;
+    t_object **gi_scratch;  /* result of glist_linesources() */
+    int gi_scratchsize;
+    int gi_lineserial;      /* obj_connectserial() when lines were listed */
+    int gi_linesvalid;
+} t_glistindex;
+
+#define GLISTINDEXMIN 16
+
+#define GLISTHASH(y, mask) \
+    ((unsigned int)((((size_t)(y)) >> 4) * 2654435761u) & (mask))
+
+static void glistindex_hashput(t_glistindex *gi, int n)
+{
+    int mask = gi->gi_hashsize - 1, h = GLISTHASH(gi->gi_vec[n], mask);
+    while (gi->gi_hash[h])
+        h = (h + 1) & mask;
+    gi->gi_hash[h] = n + 1;
+}
+
+    /* find the slot holding an object, or -1 */
+static int glistindex_find(t_glistindex *gi, void *y)
+{
+    int mask = gi->gi_hashsize - 1, h, i;
+    if (!gi->gi_nlive)
+        return (-1);
+    for (h = GLISTHASH(y, mask); (i = gi->gi_hash[h]); h = (h + 1) & mask)
+        if (gi->gi_vec[i-1] == y)
+            return (i-1);
+    return (-1);
+}
+
+static void *glistindex_grow(void *vec, int oldsize, int newsize, int elsize)
+{
+    return (oldsize ? resizebytes(vec, oldsize * elsize, newsize * elsize) :
+        getbytes(newsize * elsize));
+}
+
+    /* make room for "n" slots, rehashing if the table grows */
+static void glistindex_reserve(t_glistindex *gi, int n)
+{
+    int i;
+    if (n > gi->gi_size)
+    {
+        int newsize = (gi->gi_size ? 2 * gi->gi_size : GLISTINDEXMIN);
+        while (newsize < n)
+            newsize *= 2;
+        gi->gi_vec = (t_gobj **)glistindex_grow(gi->gi_vec, gi->gi_size,
+            newsize, sizeof(t_gobj *));
+        gi->gi_prev = (int *)glistindex_grow(gi->gi_prev, gi->gi_size,
+            newsize, sizeof(int));
+        gi->gi_next = (int *)glistindex_grow(gi->gi_next, gi->gi_size,
+            newsize, sizeof(int));
+        gi->gi_inhead = (int *)glistindex_grow(gi->gi_inhead, gi->gi_size,
+            newsize, sizeof(int));
+        gi->gi_size = newsize;
+    }
+        /* keep the hash table at most half full */
+    if (2 * n > gi->gi_hashsize)
+    {
+        int newsize = (gi->gi_hashsize ? gi->gi_hashsize : GLISTINDEXMIN);
+        while (newsize < 2 * n)
+            newsize *= 2;
+        if (gi->gi_hashsize)
+            freebytes(gi->gi_hash, gi->gi_hashsize * sizeof(int));
+        gi->gi_hash = (int *)getbytes(newsize * sizeof(int));
+        gi->gi_hashsize = newsize;
+        for (i = 0; i < gi->gi_n; i++)
+            if (gi->gi_vec[i])
+                glistindex_hashput(gi, i);
+    }
+}
+
+static void glistindex_addscalar(t_glistindex *gi, t_scalar *sc)
+{
+    if (gi->gi_ns == gi->gi_ssize)
+    {
+        int newsize = (gi->gi_ssize ? 2 * gi->gi_ssize : GLISTINDEXMIN);
+        gi->gi_svec = (t_scalar **)glistindex_grow(gi->gi_svec,
+            gi->gi_ssize, newsize, sizeof(t_scalar *));
+        gi->gi_ssize = newsize;
+    }
+    gi->gi_svec[gi->gi_ns++] = sc;
+}
+
+    /* add an object after the last one */
+static void glistindex_append(t_glistindex *gi, t_gobj *y)
+{
+    int n = gi->gi_n;
+    glistindex_reserve(gi, n + 1);
+    gi->gi_vec[n] = y;
+    gi->gi_prev[n] = gi->gi_last;
+    gi->gi_next[n] = -1;
+    gi->gi_inhead[n] = -1;
+    if (gi->gi_last >= 0)
+        gi->gi_next[gi->gi_last] = n;
+    else gi->gi_first = n;
+    gi->gi_last = n;
+    gi->gi_n++;
+    gi->gi_nlive++;
+    glistindex_hashput(gi, n);
+    if (pd_class(&y->g_pd) == scalar_class)
+        glistindex_addscalar(gi, (t_scalar *)y);
+}
+
+    /* mark the index as stale after reordering or removing objects */
+void glist_noindex(t_glist *x)
+{
+    if (x->gl_index)
+        x->gl_index->gi_valid = 0;
+    glist_nohitgrid(x);
+}
+
+void glist_freeindex(t_glist *x)
+{
+    t_glistindex *gi = x->gl_index;
+    if (gi)
+    {
+        if (gi->gi_size)
+        {
+            freebytes(gi->gi_vec, gi->gi_size * sizeof(t_gobj *));
+            freebytes(gi->gi_prev, gi->gi_size * sizeof(int));
+            freebytes(gi->gi_next, gi->gi_size * sizeof(int));
+            freebytes(gi->gi_inhead, gi->gi_size * sizeof(int));
+        }
+        if (gi->gi_hashsize)
+            freebytes(gi->gi_hash, gi->gi_hashsize * sizeof(int));
+        if (gi->gi_ssize)
+            freebytes(gi->gi_svec, gi->gi_ssize * sizeof(t_scalar *));
+        if (gi->gi_srcsize)
+            freebytes(gi->gi_src, gi->gi_srcsize * sizeof(t_glistsource));
+        if (gi->gi_scratchsize)
+            freebytes(gi->gi_scratch,
+                gi->gi_scratchsize * sizeof(t_object *));
+        freebytes(gi, sizeof(*gi));
+        x->gl_index = 0;
+    }
+}
+
+    /* check if the index is usable.  As a cheap check against code that
+    changes the list without telling us, the ends of the vector have to
+    match the ends of the list. */
+static int glist_indexok(t_glist *x)
+{
+    t_glistindex *gi = x->gl_index;
+    return (gi && gi->gi_valid && (gi->gi_nlive ?
+        (gi->gi_vec[gi->gi_first] == x->gl_list &&
+            !gi->gi_vec[gi->gi_last]->g_next) :
+            !x->gl_list));
+}
+
+    /* get the index, rebuilding it if necessary.  It may have holes. */
+static t_glistindex *glist_getlistindex(t_glist *x)
+{
+    t_glistindex *gi = x->gl_index;
+    t_gobj *y;
+    int n;
+    if (glist_indexok(x))
+        return (gi);
+    if (!gi)
+        gi = x->gl_index = (t_glistindex *)getbytes(sizeof(*gi));
+    for (y = x->gl_list, n = 0; y; y = y->g_next)
+        n++;
+    gi->gi_n = gi->gi_nlive = gi->gi_ns = gi->gi_sstale = 0;
+    gi->gi_first = gi->gi_last = -1;
+    gi->gi_linesvalid = 0;
+    glistindex_reserve(gi, n);
+    if (gi->gi_hashsize)
+        memset(gi->gi_hash, 0, gi->gi_hashsize * sizeof(int));
+    for (y = x->gl_list; y; y = y->g_next)
+        glistindex_append(gi, y);
+    gi->gi_valid = 1;
+    return (gi);
+}
+
+    /* get the index with the objects numbered in order, without holes */
+static t_glistindex *glist_getdenseindex(t_glist *x)
+{
+    t_glistindex *gi = glist_getlistindex(x);
+    if (gi->gi_n != gi->gi_nlive || gi->gi_sstale)
+    {
+        gi->gi_valid = 0;
+        gi = glist_getlistindex(x);
+    }
+    return (gi);
+}
+
+    /* get the nth object in a glist, or zero if out of range */
+t_gobj *glist_nth(t_glist *x, int n)
+{
+    t_glistindex *gi = glist_getdenseindex(x);
+    return (n >= 0 && n < gi->gi_n ? gi->gi_vec[n] : 0);
+}
+
+    /* get the index of a gobj in a glist.  If y is zero or not in the
+    glist, return the total number of objects. */
+int glist_getindex(t_glist *x, t_gobj *y)
+{
+    t_glistindex *gi = glist_getdenseindex(x);
+    int i;
+    if (!y || (i = glistindex_find(gi, y)) < 0)
+        return (gi->gi_n);
+    return (i);
+}
+
+    /* get the scalars in a glist as a vector, in order */
+t_scalar **glist_getscalars(t_glist *x, int *np)
+{
+    t_glistindex *gi = glist_getdenseindex(x);
+    *np = gi->gi_ns;
+    return (gi->gi_svec);
+}
+
+    /* find the object before y in the list, or zero if y is first or not
+    there.  If the list was changed behind our backs we fall back on
+    walking it. */
+static t_gobj *glist_prevof(t_glist *x, t_gobj *y)
+{
+    t_glistindex *gi = glist_getlistindex(x);
+    t_gobj *g;
+    int i = glistindex_find(gi, y);
+    if (i >= 0)
+    {
+        g = (gi->gi_prev[i] >= 0 ? gi->gi_vec[gi->gi_prev[i]] : 0);
+        if (g ? (g->g_next == y) : (x->gl_list == y))
+            return (g);
+    }
+    glist_noindex(x);
+    for (g = x->gl_list; g; g = g->g_next)
+        if (g->g_next == y)
+            return (g);
+    return (0);
+}
+
+    /* take an object out of the index after it's been unlinked from the
+    list, leaving a hole */
+static void glist_unindex(t_glist *x, t_gobj *y)
+{
+    t_glistindex *gi = x->gl_index;
+    int mask, h, i, i2, prev, next;
+    if (!gi || !gi->gi_valid || (i = glistindex_find(gi, y)) < 0)
+    {
+        glist_noindex(x);
+        return;
+    }
+    mask = gi->gi_hashsize - 1;
+    for (h = GLISTHASH(y, mask); gi->gi_hash[h] != i + 1; h = (h + 1) & mask)
+        ;
+        /* empty the slot and re-insert the rest of its cluster */
+    gi->gi_hash[h] = 0;
+    for (h = (h + 1) & mask; (i2 = gi->gi_hash[h]); h = (h + 1) & mask)
+    {
+        gi->gi_hash[h] = 0;
+        glistindex_hashput(gi, i2-1);
+    }
+    prev = gi->gi_prev[i];
+    next = gi->gi_next[i];
+    if (prev >= 0)
+        gi->gi_next[prev] = next;
+    else gi->gi_first = next;
+    if (next >= 0)
+        gi->gi_prev[next] = prev;
+    else gi->gi_last = prev;
+    gi->gi_vec[i] = 0;
+    gi->gi_nlive--;
+        /* deleting from the end doesn't leave a hole */
+    gi->gi_n = gi->gi_last + 1;
+    if (pd_class(&y->g_pd) == scalar_class)
+    {
+        if (gi->gi_ns && gi->gi_svec[gi->gi_ns-1] == (t_scalar *)y)
+            gi->gi_ns--;
+        else gi->gi_sstale = 1;
+    }
+    glist_nohitgrid(x);
+}
+
+    /* list the connections into every object */
+static void glistindex_getlines(t_glistindex *gi)
+{
+    int i, outno, nout;
+    if (gi->gi_linesvalid && gi->gi_lineserial == obj_connectserial())
+        return;
+    for (i = 0; i < gi->gi_n; i++)
+        gi->gi_inhead[i] = -1;
+    gi->gi_nsrc = 0;
+    for (i = gi->gi_first; i >= 0; i = gi->gi_next[i])
+    {
+        t_object *ob = pd_checkobject(&gi->gi_vec[i]->g_pd);
+        if (!ob)
+            continue;
+        for (outno = 0, nout = obj_noutlets(ob); outno < nout; outno++)
+        {
+            t_outlet *out;
+            t_outconnect *oc = obj_starttraverseoutlet(ob, &out, outno);
+            while (oc)
+            {
+                t_object *dest;
+                t_inlet *in;
+                int inno, j;
+                oc = obj_nexttraverseoutlet(oc, &dest, &in, &inno);
+                if ((j = glistindex_find(gi, dest)) < 0)
+                    continue;
+                if (gi->gi_nsrc == gi->gi_srcsize)
+                {
+                    int newsize = (gi->gi_srcsize ?
+                        2 * gi->gi_srcsize : GLISTINDEXMIN);
+                    gi->gi_src = (t_glistsource *)glistindex_grow(gi->gi_src,
+                        gi->gi_srcsize, newsize, sizeof(t_glistsource));
+                    gi->gi_srcsize = newsize;
+                }
+                gi->gi_src[gi->gi_nsrc].s_slot = i;
+                gi->gi_src[gi->gi_nsrc].s_next = gi->gi_inhead[j];
+                gi->gi_inhead[j] = gi->gi_nsrc++;
+            }
+        }
+    }
+    gi->gi_lineserial = obj_connectserial();
+    gi->gi_linesvalid = 1;
+}
+
+    /* get the objects that have connections into "ob", once for each
+    connection.  If "ob" isn't in the glist we report none.  The vector
+    is good until the next call. */
+t_object **glist_linesources(t_glist *x, t_object *ob, int *np)
+{
+    t_glistindex *gi = glist_getlistindex(x);
+    int i, e, n = 0;
+    glistindex_getlines(gi);
+    if ((i = glistindex_find(gi, ob)) >= 0)
+        for (e = gi->gi_inhead[i]; e >= 0; e = gi->gi_src[e].s_next)
+    {
+        if (n == gi->gi_scratchsize)
+        {
+            int newsize = (n ? 2 * n : GLISTINDEXMIN);
+            gi->gi_scratch = (t_object **)glistindex_grow(gi->gi_scratch,
+                n, newsize, sizeof(t_object *));
+            gi->gi_scratchsize = newsize;
+        }
+        gi->gi_scratch[n++] = (t_object *)gi->gi_vec[gi->gi_src[e].s_slot];
+    }
+    *np = n;
+    return (gi->gi_scratch);
+}
+
+    /* tell the index about a connection that was just broken with
+    obj_disconnect(), so that it doesn't have to list them all again */
+void glist_forgetline(t_glist *x, t_object *from, t_object *to)
+{
+    t_glistindex *gi = x->gl_index;
+    int i, j, *ep;
+    if (!gi || !gi->gi_linesvalid ||
+        gi->gi_lineserial + 1 != obj_connectserial())
+            return;
+    gi->gi_lineserial = obj_connectserial();
+    if ((i = glistindex_find(gi, from)) < 0 ||
+        (j = glistindex_find(gi, to)) < 0)
+            return;
+    for (ep = &gi->gi_inhead[j]; *ep >= 0; ep = &gi->gi_src[*ep].s_next)
+        if (gi->gi_src[*ep].s_slot == i)
+    {
+        *ep = gi->gi_src[*ep].s_next;
+        break;
+    }
+}
+
 void glist_add(t_glist *x, t_gobj *y)
 {
     t_object *ob;
+        /* the index tells us where the end of the list is; rebuilding it
+        costs no more than walking the list would */
+    t_glistindex *gi = glist_getlistindex(x);
     y->g_next = 0;
     if (!x->gl_list) x->gl_list = y;
-    else
-    {
-        t_gobj *y2;
-        for (y2 = x->gl_list; y2->g_next; y2 = y2->g_next);
-        y2->g_next = y;
-    }
+    else gi->gi_vec[gi->gi_last]->g_next = y;
+    glistindex_append(gi, y);
     if (x->gl_editor && (ob = pd_checkobject(&y->g_pd)))
         rtext_new(x, ob);
     if (x->gl_editor && x->gl_isgraph && !x->gl_goprect
@@ -129,18 +539,19 @@ void glist_delete(t_glist *x, t_gobj *y)
         !(rtext = glist_findrtext(x, ob)))
             rtext = rtext_new(x, ob);
     if (x->gl_list == y) x->gl_list = y->g_next;
-    else for (g = x->gl_list; g; g = g->g_next)
-        if (g->g_next == y)
-    {
+    else if ((g = glist_prevof(x, y)))
         g->g_next = y->g_next;
-        break;
-    }
+    glist_unindex(x, y);
     if (y->g_pd == scalar_class)
         x->gl_valid = ++glist_valid;
     pd_free(&y->g_pd);
     if (rtext)
         rtext_free(rtext);
-    if (chkdsp) canvas_update_dsp();
+    if (chkdsp)
+    {
+        canvas_update_dsp();
+        canvas_freezechanged(x);
+    }
     if (drawcommand)
         canvas_redrawallfortemplate(template_findbyname(canvas_makebindsym(
             glist_getcanvas(x)->gl_name)), 1);
@@ -289,7 +700,10 @@ void glist_sort(t_glist *x)
         nitems++;
     }
     if (foo)
+    {
         x->gl_list = glist_dosort(x, x->gl_list, nitems);
+        glist_noindex(x);
+    }
 }
 
 /* --------------- inlets and outlets  ----------- */
@@ -1031,7 +1445,9 @@ static void graph_motion(void *z, t_floatarg dx, t_floatarg dy)
                 ((t_float)(newx - i))/(t_float)(newx - oldx);
     }
     else vec[newx].w_float = newy;
-    garray_redraw(a);
+    if (oldx < newx)
+        garray_redrawrange(a, oldx, newx - oldx + 1);
+    else garray_redrawrange(a, newx, oldx - newx + 1);
 }
 
 static int graph_click(t_gobj *z, struct _glist *glist,
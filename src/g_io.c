@@ -101,12 +101,27 @@ int vinlet_issignal(t_vinlet *x)
     return (x->x_buf != 0);
 }
 
+    /* The buffer is circular.  If blocks overlap, each one is the last
+    "n" samples the prolog wrote, oldest first, which we copy out in up to
+    two pieces; otherwise we just read through the buffer in order. */
 t_int *vinlet_perform(t_int *w)
 {
     t_vinlet *x = (t_vinlet *)(w[1]);
     t_sample *out = (t_sample *)(w[2]);
     int n = (int)(w[3]);
-    t_sample *in = x->x_read;
+    t_sample *in;
+    if (x->x_hop < x->x_bufsize)
+    {
+        int n1;
+        in = x->x_fill;
+        if (in == x->x_endbuf)
+            in = x->x_buf;
+        n1 = x->x_endbuf - in;
+        memcpy(out, in, n1 * sizeof(*out));
+        memcpy(out + n1, x->x_buf, (n - n1) * sizeof(*out));
+        return (w+4);
+    }
+    in = x->x_read;
     while (n--) *out++ = *in++;
     if (in == x->x_endbuf) in = x->x_buf;
     x->x_read = in;
@@ -141,7 +156,21 @@ static void vinlet_dsp(t_vinlet *x, t_signal **sp)
     }
 }
 
-    /* prolog code: loads buffer from parent patch */
+    /* free the reblocking buffer while our subpatch is released by its
+    switch~; the prolog makes a new one when it's sorted again */
+static void vinlet_dsprelease(t_vinlet *x)
+{
+    if (!x->x_buf)
+        return;
+    t_freebytes(x->x_buf, x->x_bufsize * sizeof(*x->x_buf));
+    x->x_endbuf = x->x_buf = (t_sample *)t_getbytes(0);
+    x->x_bufsize = 0;
+    resample_free(&x->x_updown);
+}
+
+    /* prolog code: loads buffer from parent patch.  The buffer is a
+    multiple of the parent's vector size so we only wrap around between
+    vectors. */
 t_int *vinlet_doprolog(t_int *w)
 {
     t_vinlet *x = (t_vinlet *)(w[1]);
@@ -149,13 +178,7 @@ t_int *vinlet_doprolog(t_int *w)
     int n = (int)(w[3]);
     t_sample *out = x->x_fill;
     if (out == x->x_endbuf)
-    {
-        t_sample *f1 = x->x_buf, *f2 = x->x_buf + x->x_hop;
-        int nshift = x->x_bufsize - x->x_hop;
-        out -= x->x_hop;
-        while (nshift--) *f1++ = *f2++;
-    }
-
+        out = x->x_buf;
     while (n--) *out++ = *in++;
     x->x_fill = out;
     return (w+4);
@@ -238,7 +261,12 @@ void vinlet_dspprolog(struct _vinlet *x, t_signal **parentsigs,
             if (!insig->s_refcount)
                 signal_makereusable(insig);
         }
-        else memset((char *)(x->x_buf), 0, bufsize * sizeof(*x->x_buf));
+        else
+        {
+            memset((char *)(x->x_buf), 0, bufsize * sizeof(*x->x_buf));
+            x->x_hop = bufsize;
+            x->x_fill = x->x_buf;
+        }
         x->x_directsignal = 0;
     }
     else
@@ -267,6 +295,7 @@ static void *vinlet_newsig(t_symbol *s)
      * maybe indices would be better...
      *
      * up till now we provide several upsampling methods and 1 single downsampling method (no filtering !)
+     * except for "fir", which lowpass filters both ways.
      */
     if (s == gensym("hold"))
         x->x_updown.method = 1;       /* up: sample and hold */
@@ -274,6 +303,8 @@ static void *vinlet_newsig(t_symbol *s)
         x->x_updown.method = 2;       /* up: linear interpolation */
     else if (s == gensym("pad"))
         x->x_updown.method = 0;       /* up: zero-padding */
+    else if (s == gensym("fir"))
+        x->x_updown.method = 4;       /* up: polyphase lowpass filter */
     else x->x_updown.method = 3;      /* sample/hold unless version<0.44 */
 
     if (s == gensym("fwd"))         /* turn on forwarding */
@@ -296,6 +327,8 @@ static void vinlet_setup(void)
         A_GIMME, 0);
     class_addmethod(vinlet_class, (t_method)vinlet_dsp,
         gensym("dsp"), A_CANT, 0);
+    class_addmethod(vinlet_class, (t_method)vinlet_dsprelease,
+        gensym("dsp-release"), A_CANT, 0);
     class_sethelpsymbol(vinlet_class, gensym("inlet-outlet"));
 }
 
@@ -391,13 +424,16 @@ t_int *voutlet_perform(t_int *w)
 {
     t_voutlet *x = (t_voutlet *)(w[1]);
     t_sample *in = (t_sample *)(w[2]);
-    int n = (int)(w[3]);
+    int n = (int)(w[3]), n1 = x->x_endbuf - x->x_write;
     t_sample *out = x->x_write, *outwas = out;
-    while (n--)
-    {
+        /* add into the circular buffer in at most two pieces */
+    if (n1 > n)
+        n1 = n;
+    n -= n1;
+    while (n1--)
+        *out++ += *in++;
+    for (out = x->x_buf; n--; )
         *out++ += *in++;
-        if (out == x->x_endbuf) out = x->x_buf;
-    }
     outwas += x->x_hop;
     if (outwas >= x->x_endbuf) outwas = x->x_buf;
     x->x_write = outwas;
@@ -478,6 +514,16 @@ static void voutlet_dsp(t_voutlet *x, t_signal **sp)
         dsp_add(voutlet_perform, 3, x, insig->s_vec, (t_int)insig->s_n);
 }
 
+static void voutlet_dsprelease(t_voutlet *x)
+{
+    if (!x->x_buf)
+        return;
+    t_freebytes(x->x_buf, x->x_bufsize * sizeof(*x->x_buf));
+    x->x_endbuf = x->x_buf = (t_sample *)t_getbytes(0);
+    x->x_bufsize = 0;
+    resample_free(&x->x_updown);
+}
+
         /* set up epilog DSP code.  If we're reblocking, this is the
         time to copy the samples out to the containing object's outlets.
         If we aren't reblocking, there's nothing to do here.  */
@@ -578,11 +624,13 @@ static void *voutlet_newsig(t_symbol *s)
      * maybe indices would be better...
      *
      * up till now we provide several upsampling methods and 1 single downsampling method (no filtering !)
+     * except for "fir", which lowpass filters both ways.
      */
     if (s == gensym("hold"))x->x_updown.method=1;        /* up: sample and hold */
     else if (s == gensym("lin"))x->x_updown.method=2;    /* up: linear interpolation */
     else if (s == gensym("linear"))x->x_updown.method=2; /* up: linear interpolation */
     else if (s == gensym("pad"))x->x_updown.method=0;    /* up: zero pad */
+    else if (s == gensym("fir"))x->x_updown.method=4;    /* up and down: lowpass */
     else x->x_updown.method=3;                           /* up: zero-padding; down: ignore samples between */
 
     return (x);
@@ -602,6 +650,8 @@ static void voutlet_setup(void)
     class_addanything(voutlet_class, voutlet_anything);
     class_addmethod(voutlet_class, (t_method)voutlet_dsp,
         gensym("dsp"), A_CANT, 0);
+    class_addmethod(voutlet_class, (t_method)voutlet_dsprelease,
+        gensym("dsp-release"), A_CANT, 0);
     class_sethelpsymbol(voutlet_class, gensym("inlet-outlet"));
 }
 
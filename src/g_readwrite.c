@@ -14,6 +14,7 @@ file format as in the dialog window for data.
 #include <stdlib.h>
 #include <stdio.h>
 #include "m_pd.h"
+#include "m_imp.h"
 #include "g_canvas.h"
 #include <string.h>
 #include <errno.h>
@@ -151,19 +152,26 @@ static void glist_readatoms(t_glist *x, int natoms, t_atom *vec,
             {
                 pd_error(0, "%s: no such template", arraytemplatesym->s_name);
             }
-            else while (1)
+            else
             {
-                t_word *element;
-                int nline = canvas_scanbinbuf(natoms, vec, &message, p_nextmsg);
-                    /* empty line terminates array */
-                if (!nline)
-                    break;
-                array_resize(a, nitems + 1);
-                element = (t_word *)(((char *)a->a_vec) +
-                    nitems * elemsize);
-                glist_readatoms(x, natoms, vec, p_nextmsg, arraytemplatesym,
-                    element, nline, vec + message);
-                nitems++;
+                    /* read arrays stored by field one element at a time */
+                array_setcolumns(a, 0);
+                while (1)
+                {
+                    t_word *element;
+                    int nline = canvas_scanbinbuf(natoms, vec, &message,
+                        p_nextmsg);
+                        /* empty line terminates array */
+                    if (!nline)
+                        break;
+                    array_resize(a, nitems + 1);
+                    element = (t_word *)(((char *)a->a_vec) +
+                        nitems * elemsize);
+                    glist_readatoms(x, natoms, vec, p_nextmsg,
+                        arraytemplatesym, element, nline, vec + message);
+                    nitems++;
+                }
+                array_setcolumns(a, arraytemplate->t_columns);
             }
         }
         else if (template->t_vec[i].ds_type == DT_TEXT)
@@ -398,6 +406,7 @@ void canvas_dataproperties(t_canvas *x, t_scalar *sc, t_binbuf *b)
         }
     }
     else gobj_vis((newone = x->gl_list), x, 0), x->gl_list = newone->g_next;
+    glist_noindex(x);
     if (!newone)
         pd_error(0, "couldn't update properties (perhaps a format problem?)");
     else if (!oldone)
@@ -441,7 +450,7 @@ void canvas_dataproperties(t_canvas *x, t_scalar *sc, t_binbuf *b)
         else newone->g_next = x->gl_list, x->gl_list = newone;
     }
 didit:
-    ;
+    glist_noindex(x);
 }
 
     /* ----------- routines to write data to a binbuf ----------- */
@@ -507,7 +516,17 @@ void canvas_writescalar(t_symbol *templatesym, t_word *w, t_binbuf *b,
             t_array *a = w[i].w_array;
             int elemsize = a->a_elemsize, nitems = a->a_n;
             t_symbol *arraytemplatesym = template->t_vec[i].ds_arraytemplate;
-            for (j = 0; j < nitems; j++)
+            if (a->a_columns)   /* stored by field: write a copy of each */
+            {
+                t_word *rec = (t_word *)getbytes(elemsize);
+                for (j = 0; j < nitems; j++)
+                {
+                    array_copyelement(a, j, rec, 0);
+                    canvas_writescalar(arraytemplatesym, rec, b, 1);
+                }
+                freebytes(rec, elemsize);
+            }
+            else for (j = 0; j < nitems; j++)
                 canvas_writescalar(arraytemplatesym,
                     (t_word *)(((char *)a->a_vec) + elemsize * j), b, 1);
             binbuf_addsemi(b);
@@ -552,10 +571,12 @@ static void canvas_addtemplatesforscalar(t_symbol *templatesym,
             int elemsize = a->a_elemsize, nitems = a->a_n;
             t_symbol *arraytemplatesym = ds->ds_arraytemplate;
             canvas_doaddtemplate(arraytemplatesym, p_ntemplates, p_templatevec);
-            for (j = 0; j < nitems; j++)
-                canvas_addtemplatesforscalar(arraytemplatesym,
-                    (t_word *)(((char *)a->a_vec) + elemsize * j),
-                        p_ntemplates, p_templatevec);
+                /* (arrays stored by field have no arrays inside) */
+            if (!a->a_columns)
+                for (j = 0; j < nitems; j++)
+                    canvas_addtemplatesforscalar(arraytemplatesym,
+                        (t_word *)(((char *)a->a_vec) + elemsize * j),
+                            p_ntemplates, p_templatevec);
         }
     }
 }
@@ -657,6 +678,20 @@ static void glist_write(t_glist *x, t_symbol *filename, t_symbol *format)
 
 typedef void (*t_zoomfn)(void *x, t_floatarg arg1);
 
+    /* while canvas_savetofile() is writing a patch, the binbuf it's saving
+    into and a writer for the file.  Every so often what has been saved
+    so far is written out and the binbuf emptied, so that a big patch
+    never has to be held in memory as a whole. */
+static t_binbuf *canvas_savebinbuf;
+static t_binbufwriter *canvas_savewriter;
+#define SAVEFLUSHATOMS 4096
+
+static void canvas_saveflush(t_binbuf *b)
+{
+    if (b == canvas_savebinbuf && binbuf_getnatom(b) >= SAVEFLUSHATOMS)
+        binbuf_writer_add(canvas_savewriter, b);
+}
+
     /* save to a binbuf, called recursively; cf. canvas_savetofile() which
     saves the document, and is only called on root canvases. */
 static void canvas_saveto(t_canvas *x, t_binbuf *b)
@@ -694,7 +729,10 @@ static void canvas_saveto(t_canvas *x, t_binbuf *b)
         canvas_savedeclarationsto(x, b);
     }
     for (y = x->gl_list; y; y = y->g_next)
+    {
         gobj_save(y, b);
+        canvas_saveflush(b);
+    }
 
     linetraverser_start(&t, x);
     while ((oc = linetraverser_next(&t)))
@@ -703,6 +741,7 @@ static void canvas_saveto(t_canvas *x, t_binbuf *b)
         int sinkno = canvas_getindex(x, &t.tr_ob2->ob_g);
         binbuf_addv(b, "ssiiii;", gensym("#X"), gensym("connect"),
             srcno, t.tr_outno, sinkno, t.tr_inno);
+        canvas_saveflush(b);
     }
         /* unless everything is the default (as in ordinary subpatches)
         print out a "coords" message to set up the coordinate systems */
@@ -767,6 +806,8 @@ static void canvas_savetemplatesto(t_canvas *x, t_binbuf *b, int wholething)
             /* drop "pd-" prefix from template symbol to print */
         binbuf_addv(b, "sss", &s__N, gensym("struct"),
             gensym(templatevec[i]->s_name + 3));
+        if (template->t_columns)
+            binbuf_addv(b, "s", gensym("-columns"));
         for (j = 0; j < m; j++)
         {
             t_symbol *type;
@@ -790,16 +831,57 @@ static void canvas_savetemplatesto(t_canvas *x, t_binbuf *b, int wholething)
 
 void canvas_reload(t_symbol *name, t_symbol *dir, t_glist *except);
 
+    /* the file being saved by canvas_savetofile(), if any, so that objects
+    can save bulky data in files next to it */
+static t_symbol *canvas_savedir, *canvas_savefilename;
+
+int canvas_getsavefile(t_symbol **dirp, t_symbol **filenamep)
+{
+    if (!canvas_savefilename)
+        return (0);
+    *dirp = canvas_savedir;
+    *filenamep = canvas_savefilename;
+    return (1);
+}
+
     /* save a "root" canvas to a file; cf. canvas_saveto() which saves the
     body (and which is called recursively.) */
 static void canvas_savetofile(t_canvas *x, t_symbol *filename, t_symbol *dir,
     float fdestroy)
 {
     t_binbuf *b = binbuf_new();
+    const char *ext = filename->s_name + strlen(filename->s_name);
+    int fail;
+    errno = 0;
+        /* Max formats are converted as a whole; otherwise stream it */
+    if (ext - filename->s_name >= 4 &&
+        (!strcmp(ext - 4, ".pat") || !strcmp(ext - 4, ".mxt")))
+            canvas_savewriter = 0;
+    else if (!(canvas_savewriter = binbuf_writer_new(filename->s_name,
+        dir->s_name, 0)))
+    {
+        post("%s/%s: %s", dir->s_name, filename->s_name,
+            (errno ? strerror(errno) : "write failed"));
+        binbuf_free(b);
+        return;
+    }
+    canvas_savebinbuf = (canvas_savewriter ? b : 0);
+    canvas_savedir = dir;
+    canvas_savefilename = filename;
+    mem_addsymbolroot(&canvas_savedir, sizeof(canvas_savedir));
+    mem_addsymbolroot(&canvas_savefilename, sizeof(canvas_savefilename));
     canvas_savetemplatesto(x, b, 1);
     canvas_saveto(x, b);
-    errno = 0;
-    if (binbuf_write(b, filename->s_name, dir->s_name, 0))
+    canvas_savedir = canvas_savefilename = 0;
+    canvas_savebinbuf = 0;
+    if (canvas_savewriter)
+    {
+        binbuf_writer_add(canvas_savewriter, b);
+        fail = binbuf_writer_free(canvas_savewriter);
+        canvas_savewriter = 0;
+    }
+    else fail = binbuf_write(b, filename->s_name, dir->s_name, 0);
+    if (fail)
         post("%s/%s: %s", dir->s_name, filename->s_name,
             (errno ? strerror(errno) : "write failed"));
     else
@@ -34,8 +34,38 @@ struct _rtext
     t_glist *x_glist;   /* glist owner belongs to */
     char x_tag[50];     /* tag for gui */
     struct _rtext *x_next;  /* next in editor list */
+    struct _rtext *x_prev;  /* previous one, so that freeing doesn't search */
+    struct _rtext *x_hashnext;  /* next in the editor's hash bucket */
 };
 
+    /* the editor also keeps its rtexts in a hash table by owner, since
+    glist_findrtext() is called for every object and connection drawn */
+#define RTEXT_HASH(e, who) \
+    ((unsigned int)(((size_t)(who) >> 4) * 2654435761u) & \
+        ((e)->e_rtexthashsize - 1))
+
+static void rtext_rehash(t_editor *e, int newsize)
+{
+    t_rtext **newhash = (t_rtext **)getbytes(newsize * sizeof(*newhash));
+    int i, oldsize = e->e_rtexthashsize;
+    t_rtext **oldhash = e->e_rtexthash;
+    e->e_rtexthash = newhash;
+    e->e_rtexthashsize = newsize;
+    for (i = 0; i < oldsize; i++)
+    {
+        t_rtext *x, *next;
+        for (x = oldhash[i]; x; x = next)
+        {
+            t_rtext **bucket = &newhash[RTEXT_HASH(e, x->x_text)];
+            next = x->x_hashnext;
+            x->x_hashnext = *bucket;
+            *bucket = x;
+        }
+    }
+    if (oldhash)
+        freebytes(oldhash, oldsize * sizeof(*oldhash));
+}
+
 t_rtext *rtext_new(t_glist *glist, t_text *who)
 {
     t_rtext *x = (t_rtext *)getbytes(sizeof *x);
@@ -43,6 +73,9 @@ t_rtext *rtext_new(t_glist *glist, t_text *who)
     x->x_text = who;
     x->x_glist = glist;
     x->x_next = glist->gl_editor->e_rtext;
+    x->x_prev = 0;
+    if (x->x_next)
+        x->x_next->x_prev = x;
     x->x_selstart = x->x_selend = x->x_active =
         x->x_drawnwidth = x->x_drawnheight = 0;
     binbuf_gettext(who->te_binbuf, &x->x_buf, &x->x_bufsize);
@@ -50,6 +83,16 @@ t_rtext *rtext_new(t_glist *glist, t_text *who)
     x->x_buf = resizebytes(x->x_buf, x->x_bufsize, x->x_bufsize+1);
     x->x_buf[x->x_bufsize] = 0;
     glist->gl_editor->e_rtext = x;
+    {
+        t_editor *e = glist->gl_editor;
+        t_rtext **bucket;
+        if (e->e_nrtext >= e->e_rtexthashsize)
+            rtext_rehash(e, (e->e_rtexthashsize ? 2 * e->e_rtexthashsize : 16));
+        bucket = &e->e_rtexthash[RTEXT_HASH(e, who)];
+        x->x_hashnext = *bucket;
+        *bucket = x;
+        e->e_nrtext++;
+    }
     sprintf(x->x_tag, ".x%lx.t%lx", (t_int)glist_getcanvas(x->x_glist),
         (t_int)x);
     return (x);
@@ -57,20 +100,23 @@ t_rtext *rtext_new(t_glist *glist, t_text *who)
 
 void rtext_free(t_rtext *x)
 {
-    if (x->x_glist->gl_editor->e_textedfor == x)
-        x->x_glist->gl_editor->e_textedfor = 0;
-    if (x->x_glist->gl_editor->e_rtext == x)
-        x->x_glist->gl_editor->e_rtext = x->x_next;
-    else
+    t_editor *e = x->x_glist->gl_editor;
+    t_rtext **bp;
+    for (bp = &e->e_rtexthash[RTEXT_HASH(e, x->x_text)]; *bp;
+        bp = &(*bp)->x_hashnext)
+            if (*bp == x)
     {
-        t_rtext *e2;
-        for (e2 = x->x_glist->gl_editor->e_rtext; e2; e2 = e2->x_next)
-            if (e2->x_next == x)
-        {
-            e2->x_next = x->x_next;
-            break;
-        }
+        *bp = x->x_hashnext;
+        e->e_nrtext--;
+        break;
     }
+    if (x->x_glist->gl_editor->e_textedfor == x)
+        x->x_glist->gl_editor->e_textedfor = 0;
+    if (x->x_prev)
+        x->x_prev->x_next = x->x_next;
+    else x->x_glist->gl_editor->e_rtext = x->x_next;
+    if (x->x_next)
+        x->x_next->x_prev = x->x_prev;
     freebytes(x->x_buf, x->x_bufsize + 1); /* extra 0 byte */
     freebytes(x, sizeof *x);
 }
@@ -447,8 +493,11 @@ static void rtext_senditup(t_rtext *x, int action, int *widthp, int *heightp,
         sys_vgui("pdtk_text_set .x%lx.c %s {%s }\n",
             canvas, x->x_tag, escbuf);
         if (*widthp != x->x_drawnwidth || *heightp != x->x_drawnheight)
+        {
             text_drawborder(x->x_text, x->x_glist, x->x_tag,
                 *widthp, *heightp, 0);
+            glist_nohitgrid(x->x_glist);
+        }
         if (x->x_active)
         {
             if (selend_b > selstart_b)
@@ -496,8 +545,11 @@ t_rtext *glist_findrtext(t_glist *gl, t_text *who)
     t_rtext *x;
     if (!gl->gl_editor)
         canvas_create_editor(gl);
-    for (x = gl->gl_editor->e_rtext; x && x->x_text != who; x = x->x_next)
-        ;
+    if (!gl->gl_editor->e_rtexthash)
+        return (0);
+    for (x = gl->gl_editor->e_rtexthash[RTEXT_HASH(gl->gl_editor, who)];
+        x && x->x_text != who; x = x->x_hashnext)
+            ;
     return (x);
 }
 
@@ -122,17 +122,37 @@ static void template_takeofflist(t_template *x)
     }
 }
 
+    /* bumped whenever a template comes, goes, or has scalars conformed to
+    it, so that objects that cache a template and its field onsets (get, set,
+    element and getsize in g_traversal.c) know to look them up again. */
+static int template_serial;
+
+int template_getserial(void)
+{
+    return (template_serial);
+}
+
 t_template *template_new(t_symbol *templatesym, int argc, t_atom *argv)
 {
     t_template *x = (t_template *)pd_new(template_class);
+    int i, columns = 0;
     x->t_n = 0;
     x->t_vec = (t_dataslot *)t_getbytes(0);
     x->t_next = 0;
+    x->t_columns = 0;
     template_addtolist(x);
     while (argc > 0)
     {
         int newtype, oldn, newn;
         t_symbol *newname, *newarraytemplate = &s_, *newtypesym;
+            /* "-columns": store arrays of these by field (see g_canvas.h) */
+        if (argv[0].a_type == A_SYMBOL &&
+            !strcmp(argv[0].a_w.w_symbol->s_name, "-columns"))
+        {
+            columns = 1;
+            argc--; argv++;
+            continue;
+        }
         if (argc < 2 || argv[0].a_type != A_SYMBOL ||
             argv[1].a_type != A_SYMBOL)
                 goto bad;
@@ -172,12 +192,24 @@ t_template *template_new(t_symbol *templatesym, int argc, t_atom *argv)
     bad:
         argc -= 2; argv += 2;
     }
+    if (columns)
+    {
+        for (i = 0; i < x->t_n; i++)
+            if (x->t_vec[i].ds_type != DT_FLOAT)
+                break;
+        if (i == x->t_n)
+            x->t_columns = 1;
+        else if (*templatesym->s_name)  /* (drop "pd-" prefix) */
+            pd_error(x, "struct %s: -columns: fields must all be floats",
+                templatesym->s_name + 3);
+    }
     if (*templatesym->s_name)
     {
         x->t_sym = templatesym;
         pd_bind(&x->t_pdobj, x->t_sym);
     }
     else x->t_sym = templatesym;
+    template_serial++;
     return (x);
 }
 
@@ -364,6 +396,7 @@ static t_scalar *template_conformscalar(t_template *tfrom, t_template *tto,
             bug("template_conformscalar");
         nobug: ;
         }
+        glist_noindex(glist);
             /* burn the old one */
         pd_free(&scfrom->sc_gobj.g_pd);
         scalartemplate = tto;
@@ -397,8 +430,12 @@ static void template_conformarray(t_template *tfrom, t_template *tto,
         /* the array elements must all be conformed */
         int oldelemsize = sizeof(t_word) * tfrom->t_n,
             newelemsize = sizeof(t_word) * tto->t_n;
-        char *newarray = getbytes(newelemsize * a->a_n);
-        char *oldarray = a->a_vec;
+        char *newarray, *oldarray;
+            /* (conform element by element, then store by field again if
+            the new template says so) */
+        array_setcolumns(a, 0);
+        newarray = getbytes(newelemsize * a->a_n);
+        oldarray = a->a_vec;
         if (a->a_elemsize != oldelemsize)
             bug("template_conformarray");
         for (i = 0; i < a->a_n; i++)
@@ -411,9 +448,13 @@ static void template_conformarray(t_template *tfrom, t_template *tto,
         }
         scalartemplate = tto;
         a->a_vec = newarray;
+        a->a_elemsize = newelemsize;
         freebytes(oldarray, oldelemsize * a->a_n);
+        array_setcolumns(a, tto->t_columns);
     }
     else scalartemplate = template_findbyname(a->a_templatesym);
+    if (a->a_columns)   /* no arrays inside */
+        return;
         /* convert all arrays and sublist fields in each element of the array */
     for (i = 0; i < a->a_n; i++)
     {
@@ -490,7 +531,7 @@ void template_conform(t_template *tfrom, t_template *tto)
             conformedfrom[j] = 1;
         }
     }
-    if (nto != nfrom)
+    if (nto != nfrom || tfrom->t_columns != tto->t_columns)
         doit = 1;
     else for (i = 0; i < nto; i++)
         if (conformaction[i] != i)
@@ -504,6 +545,7 @@ void template_conform(t_template *tfrom, t_template *tto)
     }
     freebytes(conformaction, sizeof(int) * nto);
     freebytes(conformedfrom, sizeof(int) * nfrom);
+    template_serial++;
 }
 
 t_template *template_findbyname(t_symbol *s)
@@ -598,6 +640,7 @@ void template_free(t_template *x)
         pd_unbind(&x->t_pdobj, x->t_sym);
     t_freebytes(x->t_vec, x->t_n * sizeof(*x->t_vec));
     template_takeofflist(x);
+    template_serial++;
 }
 
 static void template_setup(void)
@@ -654,7 +697,7 @@ static void *gtemplate_donew(t_symbol *sym, int argc, t_atom *argv)
             canvas_redrawallfortemplate(t, 2);
                 /* Unless the new template is different from the old one,
                 there's nothing to do.  */
-            if (!template_match(t, y))
+            if (!template_match(t, y) || t->t_columns != y->t_columns)
             {
                     /* conform everyone to the new template */
                 template_conform(t, y);
@@ -1571,6 +1614,9 @@ static int plot_readownertemplate(t_plot *x,
     *visp = fielddesc_getfloat(&x->x_vis, ownertemplate, data, 1);
     *scalarvisp = fielddesc_getfloat(&x->x_scalarvis, ownertemplate, data, 1);
     *editp = fielddesc_getfloat(&x->x_edit, ownertemplate, data, 1);
+        /* arrays stored by field can't show or edit elements one by one */
+    if (array->a_columns)
+        *scalarvisp = *editp = 0;
     *elemtemplatesymp = elemtemplatesym;
     *arrayp = array;
     *xfield = &x->x_xpoints;
@@ -1637,6 +1683,23 @@ int array_getfields(t_symbol *elemtemplatesym,
     return (0);
 }
 
+    /* adjust what array_getfields() returned so that the usual
+    "a_vec + i * elemsize + onset" arithmetic finds an element's fields in
+    an array stored by field.  No-op for ordinary arrays. */
+static void array_getcolumnfields(t_array *array, int *elemsizep,
+    int *xonsetp, int *yonsetp, int *wonsetp)
+{
+    if (!array->a_columns)
+        return;
+    *elemsizep = ARRAY_STRIDE(array);
+    if (*xonsetp >= 0)
+        *xonsetp = ARRAY_ONSET(array, *xonsetp);
+    if (*yonsetp >= 0)
+        *yonsetp = ARRAY_ONSET(array, *yonsetp);
+    if (*wonsetp >= 0)
+        *wonsetp = ARRAY_ONSET(array, *wonsetp);
+}
+
 static void plot_getrect(t_gobj *z, t_glist *glist,
     t_word *data, t_template *template, t_float basex, t_float basey,
     int *xp1, int *yp1, int *xp2, int *yp2)
@@ -1671,6 +1734,7 @@ static void plot_getrect(t_gobj *z, t_glist *glist,
     {
             /* if it has more than 2000 points, just check 1000 of them. */
         int incr = (array->a_n <= 2000 ? 1 : array->a_n / 1000);
+        array_getcolumnfields(array, &elemsize, &xonset, &yonset, &wonset);
         for (i = 0, xsum = 0; i < array->a_n; i += incr)
         {
             t_float usexloc, useyloc;
@@ -1753,6 +1817,163 @@ static void plot_activate(t_gobj *z, t_glist *glist,
 
 #define CLIP(x) ((x) < 1e20 && (x) > -1e20 ? x : 0)
 
+    /* The traces of arrays without "x" fields, drawn as points or (if there's
+    no "w" field either) as straight lines, are made of up to PLOTNCHUNK
+    canvas items, each for a piece of the array, so that when part of the
+    array changes only that part has to be redrawn (see plot_redrawrange()).
+    Each pixel column gets a rectangle or up to two line vertices spanning
+    the smallest and largest value falling in it, so the amount sent to the
+    GUI depends on the width of the graph, not the size of the array. */
+
+#define PLOTNCHUNK 32           /* most pieces to draw a trace in */
+#define PLOTMINCHUNK 256        /* fewest elements in a piece */
+#define PLOTMAXCOLUMNS 1000     /* most pixel columns to draw per piece */
+
+    /* true if a template's canvas has any drawing instructions */
+static int template_hasdrawing(t_canvas *templatecanvas)
+{
+    t_gobj *y;
+    if (templatecanvas)
+        for (y = templatecanvas->gl_list; y; y = y->g_next)
+            if (pd_getparentwidget(&y->g_pd))
+                return (1);
+    return (0);
+}
+
+static int plot_inpieces(t_float style, int xonset, int wonset)
+{
+    return (xonset < 0 && (style == PLOTSTYLE_POINTS ||
+        (style == PLOTSTYLE_POLY && wonset < 0)));
+}
+
+static int plot_chunksize(int nelem)
+{
+    int chunksize = (nelem + PLOTNCHUNK - 1) / PLOTNCHUNK;
+    return (chunksize < PLOTMINCHUNK ? PLOTMINCHUNK : chunksize);
+}
+
+    /* add one or two line vertices for a pixel column, in the order the
+    values appeared in the array */
+static void plot_addcolumn(t_glist *glist, int ixpix, t_float basey,
+    t_fielddesc *yfielddesc, t_float first, t_float second, int *npointsp)
+{
+    sys_vgui("%d %f \\\n", ixpix,
+        glist_ytopixels(glist, basey + fielddesc_cvttocoord(yfielddesc, first)));
+    (*npointsp)++;
+    if (second != first)
+    {
+        sys_vgui("%d %f \\\n", ixpix, glist_ytopixels(glist,
+            basey + fielddesc_cvttocoord(yfielddesc, second)));
+        (*npointsp)++;
+    }
+}
+
+    /* draw pieces "firstchunk" up to (not including) "lastchunk" */
+static void plot_drawchunks(t_plot *x, t_glist *glist, t_word *data,
+    t_template *template, t_array *array, t_float basex, t_float basey,
+    t_float xloc, t_float xinc, t_float yloc, t_float linewidth,
+    t_float style, int elemsize, int yonset,
+    t_fielddesc *xfielddesc, t_fielddesc *yfielddesc,
+    int firstchunk, int lastchunk)
+{
+    int nelem = array->a_n, chunksize = plot_chunksize(nelem), chunk;
+    char *elem = (char *)array->a_vec, color[20];
+    numbertocolor(fielddesc_getfloat(&x->x_outlinecolor, template, data, 1),
+        color);
+    for (chunk = firstchunk; chunk < lastchunk; chunk++)
+    {
+        int onset = chunk * chunksize, end, i, ixpix, ncolumns = 0;
+        t_float yval, minyval = 0, maxyval = 0;
+        if (onset >= nelem)
+            break;
+            /* lines overlap the next piece by one point to join up */
+        end = onset + chunksize + (style != PLOTSTYLE_POINTS);
+        if (end > nelem)
+            end = nelem;
+        if (onset > 0 && end - onset < 2 && style != PLOTSTYLE_POINTS)
+            break;  /* only the last point, already drawn */
+        if (style == PLOTSTYLE_POINTS)
+        {
+            int inextx = glist_xtopixels(glist, fielddesc_cvttocoord(
+                xfielddesc, basex + xloc + onset * xinc)), gotone = 0;
+            for (i = onset; i < end; i++)
+            {
+                ixpix = inextx;
+                inextx = glist_xtopixels(glist, fielddesc_cvttocoord(
+                    xfielddesc, basex + xloc + (i + 1) * xinc));
+                if (yonset >= 0)
+                    yval = yloc + *(t_float *)((elem + elemsize * i) + yonset);
+                else yval = 0;
+                yval = CLIP(yval);
+                if (!gotone || yval < minyval)
+                    minyval = yval;
+                if (!gotone || yval > maxyval)
+                    maxyval = yval;
+                gotone = 1;
+                if (i == end-1 || inextx != ixpix)
+                {
+                    sys_vgui(".x%lx.c create rectangle %d %d %d %d "
+                        "-fill %s -width 0 -tags [list plot%lx plot%lxc%d array]\n",
+                        glist_getcanvas(glist),
+                        ixpix, (int)glist_ytopixels(glist,
+                            basey + fielddesc_cvttocoord(yfielddesc, minyval)),
+                        inextx, (int)(glist_ytopixels(glist,
+                            basey + fielddesc_cvttocoord(yfielddesc, maxyval))
+                                + linewidth), color, data, data, chunk);
+                    gotone = 0;
+                    if (++ncolumns >= PLOTMAXCOLUMNS)
+                        break;
+                }
+            }
+        }
+        else
+        {
+            int lastpixel = 0, minindex = 0, maxindex = 0, npoints = 0;
+            sys_vgui(".x%lx.c create line \\\n", glist_getcanvas(glist));
+            for (i = onset; i < end; i++)
+            {
+                ixpix = glist_xtopixels(glist, basex +
+                    fielddesc_cvttocoord(xfielddesc, xloc + i * xinc)) + 0.5;
+                if (yonset >= 0)
+                    yval = *(t_float *)((elem + elemsize * i) + yonset);
+                else yval = 0;
+                yval = CLIP(yval);
+                if (i > onset && ixpix == lastpixel)
+                {
+                    if (yval < minyval)
+                        minyval = yval, minindex = i;
+                    if (yval > maxyval)
+                        maxyval = yval, maxindex = i;
+                    continue;
+                }
+                if (i > onset)
+                {
+                    plot_addcolumn(glist, lastpixel, basey + yloc, yfielddesc,
+                        (minindex < maxindex ? minyval : maxyval),
+                        (minindex < maxindex ? maxyval : minyval), &npoints);
+                    if (++ncolumns >= PLOTMAXCOLUMNS)
+                        break;
+                }
+                lastpixel = ixpix;
+                minyval = maxyval = yval;
+                minindex = maxindex = i;
+            }
+            if (i == end)
+                plot_addcolumn(glist, lastpixel, basey + yloc, yfielddesc,
+                    (minindex < maxindex ? minyval : maxyval),
+                    (minindex < maxindex ? maxyval : minyval), &npoints);
+                /* TK will complain if there aren't at least 2 points... */
+            if (npoints < 2)
+                plot_addcolumn(glist, lastpixel, basey + yloc, yfielddesc,
+                    minyval, minyval, &npoints);
+            sys_vgui("-width %f\\\n", linewidth);
+            sys_vgui("-fill %s\\\n", color);
+            sys_vgui("-tags [list plot%lx plot%lxc%d array]\n",
+                data, data, chunk);
+        }
+    }
+}
+
 static void plot_vis(t_gobj *z, t_glist *glist,
     t_word *data, t_template *template, t_float basex, t_float basey,
     int tovis)
@@ -1786,6 +2007,10 @@ static void plot_vis(t_gobj *z, t_glist *glist,
                 &elemtemplate, &elemsize, xfielddesc, yfielddesc, wfielddesc,
                 &xonset, &yonset, &wonset))
                     return;
+    array_getcolumnfields(array, &elemsize, &xonset, &yonset, &wonset);
+        /* don't visit every element if there's nothing to draw for them */
+    if (!template_hasdrawing(elemtemplatecanvas))
+        scalarvis = 0;
     nelem = array->a_n;
     elem = (char *)array->a_vec;
 
@@ -1794,7 +2019,14 @@ static void plot_vis(t_gobj *z, t_glist *glist,
 
     if (tovis)
     {
-        if (style == PLOTSTYLE_POINTS)
+        if (plot_inpieces(style, xonset, wonset))
+        {
+            if (style == PLOTSTYLE_POINTS || linewidth > 0)
+                plot_drawchunks(x, glist, data, template, array, basex, basey,
+                    xloc, xinc, yloc, linewidth, style, elemsize, yonset,
+                    xfielddesc, yfielddesc, 0, PLOTNCHUNK);
+        }
+        else if (style == PLOTSTYLE_POINTS)
         {
             t_float minyval = 1e20, maxyval = -1e20;
             int ndrawn = 0;
@@ -2042,6 +2274,71 @@ static void plot_vis(t_gobj *z, t_glist *glist,
     }
 }
 
+    /* redraw "n" elements starting at "onset" of an array that a scalar
+    plots, if every plot of it is drawn in pieces (see above.)  Returns 0 if
+    not, in which case the caller should redraw the whole scalar. */
+int plot_redrawrange(t_scalar *sc, t_glist *glist, t_array *array,
+    int onset, int n)
+{
+    t_template *template = template_findbyname(sc->sc_template);
+    t_canvas *templatecanvas = (template ? template_findcanvas(template) : 0);
+    t_float basex, basey;
+    t_gobj *y;
+    int found = 0;
+    if (!templatecanvas)
+        return (0);
+    if (onset < 0)
+        n += onset, onset = 0;
+    if (onset + n > array->a_n)
+        n = array->a_n - onset;
+    if (n <= 0)
+        return (1);
+    scalar_getbasexy(sc, &basex, &basey);
+    for (y = templatecanvas->gl_list; y; y = y->g_next)
+    {
+        t_plot *x = (t_plot *)y;
+        int elemsize, yonset, wonset, xonset, chunksize, first, last, i;
+        t_canvas *elemtemplatecanvas;
+        t_template *elemtemplate;
+        t_symbol *elemtemplatesym;
+        t_float linewidth, xloc, xinc, yloc, style, vis, scalarvis, edit;
+        t_array *plotarray;
+        t_fielddesc *xfielddesc, *yfielddesc, *wfielddesc;
+        if (pd_class(&y->g_pd) != plot_class ||
+            plot_readownertemplate(x, sc->sc_vec, template, &elemtemplatesym,
+                &plotarray, &linewidth, &xloc, &xinc, &yloc, &style, &vis,
+                &scalarvis, &edit, &xfielddesc, &yfielddesc, &wfielddesc) ||
+            plotarray != array)
+                continue;
+        if (vis == 0 ||
+            array_getfields(elemtemplatesym, &elemtemplatecanvas,
+                &elemtemplate, &elemsize, xfielddesc, yfielddesc, wfielddesc,
+                &xonset, &yonset, &wonset) ||
+            (scalarvis != 0 && template_hasdrawing(elemtemplatecanvas)) ||
+            !plot_inpieces(style, xonset, wonset))
+                return (0);
+        array_getcolumnfields(array, &elemsize, &xonset, &yonset, &wonset);
+        if (glist->gl_isgraph)
+            linewidth *= glist_getzoom(glist);
+        found = 1;
+        if (style != PLOTSTYLE_POINTS && linewidth <= 0)
+            continue;
+        chunksize = plot_chunksize(array->a_n);
+        first = onset / chunksize;
+        last = (onset + n - 1) / chunksize + 1;
+            /* lines share their first point with the previous piece */
+        if (style != PLOTSTYLE_POINTS && first > 0 && onset % chunksize == 0)
+            first--;
+        for (i = first; i < last; i++)
+            sys_vgui(".x%lx.c delete plot%lxc%d\n",
+                glist_getcanvas(glist), sc->sc_vec, i);
+        plot_drawchunks(x, glist, sc->sc_vec, template, array, basex, basey,
+            xloc, xinc, yloc, linewidth, style, elemsize, yonset,
+            xfielddesc, yfielddesc, first, last);
+    }
+    return (found);
+}
+
     /* LATER protect against the template changing or the scalar disappearing
     probably by attaching a gpointer here ... */
 
@@ -2196,6 +2493,7 @@ static int array_doclick(t_array *array, t_glist *glist, t_scalar *sc,
         t_float best = 100;
             /* if it has more than 2000 points, just check 1000 of them. */
         int incr = (array->a_n <= 2000 ? 1 : array->a_n / 1000);
+        array_getcolumnfields(array, &elemsize, &xonset, &yonset, &wonset);
         TEMPLATE->array_motion_elemsize = elemsize;
         TEMPLATE->array_motion_glist = glist;
         TEMPLATE->array_motion_scalar = sc;
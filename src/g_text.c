@@ -97,7 +97,11 @@ static void canvas_objtext(t_glist *gl, int xpix, int ypix, int width,
     t_text *x;
     int argc;
     t_atom *argv;
+    t_memowner owner;
     pd_this->pd_newest = 0;
+        /* for "pd memory-report", the new object's class (set by pd_new())
+        owns what's allocated until we're done */
+    mem_pushowner(&owner, gl, 0);
     canvas_setcurrent((t_canvas *)gl);
     canvas_getargs(&argc, &argv);
     binbuf_eval(b, &pd_objectmaker, argc, argv);
@@ -138,6 +142,7 @@ static void canvas_objtext(t_glist *gl, int xpix, int ypix, int width,
     if (pd_class(&x->ob_pd) == voutlet_class)
         canvas_resortoutlets(glist_getcanvas(gl));
     canvas_unsetcurrent((t_canvas *)gl);
+    mem_popowner(&owner);
 }
 
 extern int sys_noautopatch;
@@ -349,6 +349,93 @@ static void ptrobj_rewind(t_ptrobj *x)
     ptrobj_bang(x);
 }
 
+    /* get the list the pointer is in; unlike the other methods, seeking
+    works from a stale pointer since it doesn't depend on where we were. */
+static t_glist *ptrobj_getglist(t_ptrobj *x, const char *why)
+{
+    t_gstub *gs = x->x_gp.gp_stub;
+    if (!gs || gs->gs_which == GP_NONE)
+    {
+        pd_error(x, "pointer %s: no current pointer", why);
+        return (0);
+    }
+    if (gs->gs_which != GP_GLIST)
+    {
+        pd_error(x, "pointer %s: lists only, not arrays", why);
+        return (0);
+    }
+    return (gs->gs_un.gs_glist);
+}
+
+    /* point to a scalar and output it.  If there's none, bang, but stay
+    in the list (at its head) so that we can seek again. */
+static void ptrobj_goto(t_ptrobj *x, t_glist *glist, t_scalar *sc)
+{
+    gpointer_setglist(&x->x_gp, glist, sc);
+    if (sc)
+        ptrobj_bang(x);
+    else outlet_bang(x->x_bangout);
+}
+
+    /* go to the nth scalar in the list, counting from zero */
+static void ptrobj_seek(t_ptrobj *x, t_floatarg f)
+{
+    t_glist *glist;
+    t_scalar **vec;
+    int n, i = f;
+    if (!(glist = ptrobj_getglist(x, "seek")))
+        return;
+    vec = glist_getscalars(glist, &n);
+    ptrobj_goto(x, glist, (i >= 0 && i < n ? vec[i] : 0));
+}
+
+    /* go to the first scalar whose field matches a value: for a number,
+    the first one whose field is at least that much (so that in a list sorted
+    by time we find the first event at or after a given time); for a symbol,
+    the first one that's equal.  Scalars without the field are skipped. */
+static void ptrobj_seekfield(t_ptrobj *x, t_symbol *s, int argc, t_atom *argv)
+{
+    t_glist *glist;
+    t_scalar **vec, *found = 0;
+    t_symbol *fieldsym, *templatesym = 0, *arraytype;
+    t_template *template;
+    int n, i, onset = 0, type = -1, wanttype;
+    if (argc < 2 || argv[0].a_type != A_SYMBOL ||
+        (argv[1].a_type != A_FLOAT && argv[1].a_type != A_SYMBOL))
+    {
+        pd_error(x, "pointer seek-field: usage: seek-field <field> <value>");
+        return;
+    }
+    if (!(glist = ptrobj_getglist(x, "seek-field")))
+        return;
+    fieldsym = argv[0].a_w.w_symbol;
+    wanttype = (argv[1].a_type == A_FLOAT ? DT_FLOAT : DT_SYMBOL);
+    vec = glist_getscalars(glist, &n);
+    for (i = 0; i < n; i++)
+    {
+        t_word *w = vec[i]->sc_vec;
+            /* look the field up again only when the template changes */
+        if (vec[i]->sc_template != templatesym)
+        {
+            templatesym = vec[i]->sc_template;
+            if (!(template = template_findbyname(templatesym)) ||
+                !template_find_field(template, fieldsym, &onset, &type,
+                    &arraytype))
+                        type = -1;
+        }
+        if (type != wanttype)
+            continue;
+        if (type == DT_FLOAT ?
+            *(t_float *)(((char *)w) + onset) >= argv[1].a_w.w_float :
+            *(t_symbol **)(((char *)w) + onset) == argv[1].a_w.w_symbol)
+        {
+            found = vec[i];
+            break;
+        }
+    }
+    ptrobj_goto(x, glist, found);
+}
+
 static void ptrobj_free(t_ptrobj *x)
 {
     freebytes(x->x_typedout, x->x_ntypedout * sizeof (*x->x_typedout));
@@ -372,10 +459,59 @@ static void ptrobj_setup(void)
         gensym("send-window"), A_GIMME, 0);
     class_addmethod(ptrobj_class, (t_method)ptrobj_rewind,
         gensym("rewind"), 0);
+    class_addmethod(ptrobj_class, (t_method)ptrobj_seek,
+        gensym("seek"), A_FLOAT, 0);
+    class_addmethod(ptrobj_class, (t_method)ptrobj_seekfield,
+        gensym("seek-field"), A_GIMME, 0);
     class_addpointer(ptrobj_class, ptrobj_pointer);
     class_addbang(ptrobj_class, ptrobj_bang);
 }
 
+/* ------------- template cache for get, set, element, getsize ---------- */
+
+    /* these objects look up the template and the onsets of their fields
+    once and reuse them until either the template name changes or
+    template_getserial() says some template came, went, or was conformed. */
+typedef struct _tcache
+{
+    t_symbol *tc_sym;
+    t_template *tc_template;
+    int tc_serial;
+} t_tcache;
+
+static void tcache_init(t_tcache *tc)
+{
+    tc->tc_sym = 0;
+    tc->tc_template = 0;
+    tc->tc_serial = 0;
+}
+
+    /* return the cached template, or zero if it has to be looked up again */
+static t_template *tcache_get(t_tcache *tc, t_symbol *templatesym)
+{
+    if (tc->tc_sym == templatesym && tc->tc_serial == template_getserial())
+        return (tc->tc_template);
+    else return (0);
+}
+
+static t_template *tcache_lookup(t_tcache *tc, t_symbol *templatesym)
+{
+    tc->tc_sym = templatesym;
+    tc->tc_serial = template_getserial();
+    return (tc->tc_template = template_findbyname(templatesym));
+}
+
+    /* look up a field; on failure the type is set to -1 */
+static void tcache_findfield(t_template *template, t_symbol *name,
+    int *p_onset, int *p_type, t_symbol **p_arraytype)
+{
+    t_symbol *arraytype;
+    if (!template_find_field(template, name, p_onset, p_type, &arraytype))
+        *p_type = -1, arraytype = &s_;
+    if (p_arraytype)
+        *p_arraytype = arraytype;
+}
+
 /* ---------------------- get ----------------------------- */
 
 static t_class *get_class;
@@ -384,6 +520,8 @@ typedef struct _getvariable
 {
     t_symbol *gv_sym;
     t_outlet *gv_outlet;
+    int gv_onset;   /* cached from the template */
+    int gv_type;
 } t_getvariable;
 
 typedef struct _get
@@ -392,6 +530,7 @@ typedef struct _get
     t_symbol *x_templatesym;
     int x_nout;
     t_getvariable *x_variables;
+    t_tcache x_tcache;
 } t_get;
 
 static void *get_new(t_symbol *why, int argc, t_atom *argv)
@@ -402,6 +541,7 @@ static void *get_new(t_symbol *why, int argc, t_atom *argv)
     t_getvariable *sp;
 
     x->x_templatesym = template_getbindsym(atom_getsymbolarg(0, argc, argv));
+    tcache_init(&x->x_tcache);
     if (argc < 2)
     {
         varcount = 1;
@@ -431,6 +571,7 @@ static void get_set(t_get *x, t_symbol *templatesym, t_symbol *field)
     {
         x->x_templatesym = template_getbindsym(templatesym);
         x->x_variables->gv_sym = field;
+        tcache_init(&x->x_tcache);
     }
 }
 
@@ -441,6 +582,7 @@ static void get_pointer(t_get *x, t_gpointer *gp)
     t_template *template;
     t_gstub *gs = gp->gp_stub;
     t_word *vec;
+    t_array *array = 0;
     t_getvariable *vp;
 
     if (!gpointer_check(gp, 0))
@@ -458,19 +600,27 @@ static void get_pointer(t_get *x, t_gpointer *gp)
         }
     }
     else templatesym = gpointer_gettemplatesym(gp);
-    if (!(template = template_findbyname(templatesym)))
+    if (!(template = tcache_get(&x->x_tcache, templatesym)))
     {
-        pd_error(x, "get: couldn't find template %s", templatesym->s_name);
-        return;
+        if (!(template = tcache_lookup(&x->x_tcache, templatesym)))
+        {
+            pd_error(x, "get: couldn't find template %s", templatesym->s_name);
+            return;
+        }
+        for (i = 0, vp = x->x_variables; i < nitems; i++, vp++)
+            tcache_findfield(template, vp->gv_sym,
+                &vp->gv_onset, &vp->gv_type, 0);
     }
-    if (gs->gs_which == GP_ARRAY) vec = gp->gp_un.gp_w;
+    if (gs->gs_which == GP_ARRAY)
+        vec = gp->gp_un.gp_w, array = gs->gs_un.gs_array;
     else vec = gp->gp_un.gp_scalar->sc_vec;
     for (i = nitems - 1, vp = x->x_variables + i; i >= 0; i--, vp--)
     {
-        int onset, type;
-        t_symbol *arraytype;
-        if (template_find_field(template, vp->gv_sym, &onset, &type, &arraytype))
+        int onset = vp->gv_onset, type = vp->gv_type;
+        if (type >= 0)
         {
+            if (array)  /* (in case it's stored by field) */
+                onset = ARRAY_ONSET(array, onset);
             if (type == DT_FLOAT)
                 outlet_float(vp->gv_outlet,
                     *(t_float *)(((char *)vec) + onset));
@@ -507,6 +657,8 @@ typedef struct _setvariable
 {
     t_symbol *gv_sym;
     union word gv_w;
+    int gv_onset;   /* cached from the template */
+    int gv_type;
 } t_setvariable;
 
 typedef struct _set
@@ -517,6 +669,7 @@ typedef struct _set
     int x_nin;
     int x_issymbol;
     t_setvariable *x_variables;
+    t_tcache x_tcache;
 } t_set;
 
 static void *set_new(t_symbol *why, int argc, t_atom *argv)
@@ -534,6 +687,7 @@ static void *set_new(t_symbol *why, int argc, t_atom *argv)
     }
     else x->x_issymbol = 0;
     x->x_templatesym = template_getbindsym(atom_getsymbolarg(0, argc, argv));
+    tcache_init(&x->x_tcache);
     if (argc < 2)
     {
         varcount = 1;
@@ -570,6 +724,7 @@ static void set_set(t_set *x, t_symbol *templatesym, t_symbol *field)
     {
        x->x_templatesym = template_getbindsym(templatesym);
        x->x_variables->gv_sym = field;
+       tcache_init(&x->x_tcache);
        if (x->x_issymbol)
            x->x_variables->gv_w.w_symbol = &s_;
        else
@@ -577,6 +732,8 @@ static void set_set(t_set *x, t_symbol *templatesym, t_symbol *field)
     }
 }
 
+#define SET_NRECBUF 64
+
 static void set_bang(t_set *x)
 {
     int nitems = x->x_nin, i;
@@ -585,7 +742,9 @@ static void set_bang(t_set *x)
     t_setvariable *vp;
     t_gpointer *gp = &x->x_gp;
     t_gstub *gs = gp->gp_stub;
-    t_word *vec;
+    t_word *vec, recbuf[SET_NRECBUF], *rec = 0;
+    t_array *array = 0;
+    int indx = 0;
     if (!gpointer_check(gp, 0))
     {
         pd_error(x, "set: empty pointer");
@@ -601,21 +760,52 @@ static void set_bang(t_set *x)
         }
     }
     else templatesym = gpointer_gettemplatesym(gp);
-    if (!(template = template_findbyname(templatesym)))
+    if (!(template = tcache_get(&x->x_tcache, templatesym)))
     {
-        pd_error(x, "set: couldn't find template %s", templatesym->s_name);
-        return;
+        if (!(template = tcache_lookup(&x->x_tcache, templatesym)))
+        {
+            pd_error(x, "set: couldn't find template %s", templatesym->s_name);
+            return;
+        }
+        for (i = 0, vp = x->x_variables; i < nitems; i++, vp++)
+            tcache_findfield(template, vp->gv_sym,
+                &vp->gv_onset, &vp->gv_type, 0);
     }
     if (!nitems)
         return;
     if (gs->gs_which == GP_ARRAY)
+    {
         vec = gp->gp_un.gp_w;
+        array = gs->gs_un.gs_array;
+            /* if the array is stored by field, set a copy of the element
+            and put it back afterward */
+        if (array->a_columns)
+        {
+            indx = (int)(vec - (t_word *)array->a_vec);
+            rec = (template->t_n > SET_NRECBUF ?
+                (t_word *)getbytes(template->t_n * sizeof(t_word)) : recbuf);
+            array_copyelement(array, indx, rec, 0);
+            vec = rec;
+        }
+    }
     else vec = gp->gp_un.gp_scalar->sc_vec;
-    if (x->x_issymbol)
-        for (i = 0, vp = x->x_variables; i < nitems; i++, vp++)
-            template_setsymbol(template, vp->gv_sym, vec, vp->gv_w.w_symbol, 1);
-    else for (i = 0, vp = x->x_variables; i < nitems; i++, vp++)
-        template_setfloat(template, vp->gv_sym, vec, vp->gv_w.w_float, 1);
+    for (i = 0, vp = x->x_variables; i < nitems; i++, vp++)
+    {
+        if (vp->gv_type == (x->x_issymbol ? DT_SYMBOL : DT_FLOAT))
+            *(t_word *)(((char *)vec) + vp->gv_onset) = vp->gv_w;
+        else if (vp->gv_type >= 0)
+            pd_error(x, "%s.%s: %s", template->t_sym->s_name,
+                vp->gv_sym->s_name,
+                    (x->x_issymbol ? "not a symbol" : "not a number"));
+        else pd_error(x, "%s.%s: no such field",
+            template->t_sym->s_name, vp->gv_sym->s_name);
+    }
+    if (rec)
+    {
+        array_copyelement(array, indx, rec, 1);
+        if (rec != recbuf)
+            freebytes(rec, template->t_n * sizeof(t_word));
+    }
     if (gs->gs_which == GP_GLIST)
         scalar_redraw(gp->gp_un.gp_scalar, gs->gs_un.gs_glist);
     else
@@ -676,6 +866,9 @@ typedef struct _elem
     t_symbol *x_fieldsym;
     t_gpointer x_gp;
     t_gpointer x_gparent;
+    t_tcache x_tcache;
+    int x_onset;    /* cached from the template */
+    int x_type;
 } t_elem;
 
 static void *elem_new(t_symbol *templatesym, t_symbol *fieldsym)
@@ -683,6 +876,7 @@ static void *elem_new(t_symbol *templatesym, t_symbol *fieldsym)
     t_elem *x = (t_elem *)pd_new(elem_class);
     x->x_templatesym = template_getbindsym(templatesym);
     x->x_fieldsym = fieldsym;
+    tcache_init(&x->x_tcache);
     gpointer_init(&x->x_gp);
     gpointer_init(&x->x_gparent);
     pointerinlet_new(&x->x_obj, &x->x_gparent);
@@ -694,18 +888,17 @@ static void elem_set(t_elem *x, t_symbol *templatesym, t_symbol *fieldsym)
 {
     x->x_templatesym = template_getbindsym(templatesym);
     x->x_fieldsym = fieldsym;
+    tcache_init(&x->x_tcache);
 }
 
 static void elem_float(t_elem *x, t_float f)
 {
-    int indx = f, nitems, onset;
+    int indx = f, nitems;
     t_symbol *templatesym, *fieldsym = x->x_fieldsym, *elemtemplatesym;
     t_template *template;
-    t_template *elemtemplate;
     t_gpointer *gparent = &x->x_gparent;
     t_word *w;
     t_array *array;
-    int elemsize, type;
 
     if (!gpointer_check(gparent, 0))
     {
@@ -723,46 +916,46 @@ static void elem_float(t_elem *x, t_float f)
         }
     }
     else templatesym = gpointer_gettemplatesym(gparent);
-    if (!(template = template_findbyname(templatesym)))
+    if (!(template = tcache_get(&x->x_tcache, templatesym)))
     {
-        pd_error(x, "elem: couldn't find template %s", templatesym->s_name);
-        return;
+        if (!(template = tcache_lookup(&x->x_tcache, templatesym)))
+        {
+            pd_error(x, "elem: couldn't find template %s",
+                templatesym->s_name);
+            return;
+        }
+        tcache_findfield(template, fieldsym,
+            &x->x_onset, &x->x_type, &elemtemplatesym);
+            /* don't cache a field whose element template isn't there yet */
+        if (x->x_type == DT_ARRAY && !template_findbyname(elemtemplatesym))
+        {
+            pd_error(x, "element: couldn't find field template %s",
+                elemtemplatesym->s_name);
+            tcache_init(&x->x_tcache);
+            return;
+        }
     }
     if (gparent->gp_stub->gs_which == GP_ARRAY) w = gparent->gp_un.gp_w;
     else w = gparent->gp_un.gp_scalar->sc_vec;
-    if (!template)
-    {
-        pd_error(x, "element: couldn't find template %s", templatesym->s_name);
-        return;
-    }
-    if (!template_find_field(template, fieldsym,
-        &onset, &type, &elemtemplatesym))
+    if (x->x_type < 0)
     {
         pd_error(x, "element: couldn't find array field %s", fieldsym->s_name);
         return;
     }
-    if (type != DT_ARRAY)
+    if (x->x_type != DT_ARRAY)
     {
         pd_error(x, "element: field %s not of type array", fieldsym->s_name);
         return;
     }
-    if (!(elemtemplate = template_findbyname(elemtemplatesym)))
-    {
-        pd_error(x, "element: couldn't find field template %s",
-            elemtemplatesym->s_name);
-        return;
-    }
 
-    elemsize = elemtemplate->t_n * sizeof(t_word);
-
-    array = *(t_array **)(((char *)w) + onset);
+    array = *(t_array **)(((char *)w) + x->x_onset);
 
     nitems = array->a_n;
     if (indx < 0) indx = 0;
     if (indx >= nitems) indx = nitems-1;
 
     gpointer_setarray(&x->x_gp, array,
-        (t_word *)((char *)(array->a_vec) + indx * elemsize));
+        (t_word *)((char *)(array->a_vec) + indx * ARRAY_STRIDE(array)));
     outlet_pointer(x->x_obj.ob_outlet, &x->x_gp);
 }
 
@@ -790,6 +983,9 @@ typedef struct _getsize
     t_object x_obj;
     t_symbol *x_templatesym;
     t_symbol *x_fieldsym;
+    t_tcache x_tcache;
+    int x_onset;    /* cached from the template */
+    int x_type;
 } t_getsize;
 
 static void *getsize_new(t_symbol *templatesym, t_symbol *fieldsym)
@@ -797,6 +993,7 @@ static void *getsize_new(t_symbol *templatesym, t_symbol *fieldsym)
     t_getsize *x = (t_getsize *)pd_new(getsize_class);
     x->x_templatesym = template_getbindsym(templatesym);
     x->x_fieldsym = fieldsym;
+    tcache_init(&x->x_tcache);
     outlet_new(&x->x_obj, &s_float);
     return (x);
 }
@@ -805,16 +1002,15 @@ static void getsize_set(t_getsize *x, t_symbol *templatesym, t_symbol *fieldsym)
 {
     x->x_templatesym = template_getbindsym(templatesym);
     x->x_fieldsym = fieldsym;
+    tcache_init(&x->x_tcache);
 }
 
 static void getsize_pointer(t_getsize *x, t_gpointer *gp)
 {
-    int nitems, onset, type;
-    t_symbol *templatesym, *fieldsym = x->x_fieldsym, *elemtemplatesym;
+    t_symbol *templatesym, *fieldsym = x->x_fieldsym;
     t_template *template;
     t_word *w;
     t_array *array;
-    int elemsize;
     t_gstub *gs = gp->gp_stub;
     if (!gpointer_check(gp, 0))
     {
@@ -832,18 +1028,22 @@ static void getsize_pointer(t_getsize *x, t_gpointer *gp)
         }
     }
     else templatesym = gpointer_gettemplatesym(gp);
-    if (!(template = template_findbyname(templatesym)))
+    if (!(template = tcache_get(&x->x_tcache, templatesym)))
     {
-        pd_error(x, "elem: couldn't find template %s", templatesym->s_name);
-        return;
+        if (!(template = tcache_lookup(&x->x_tcache, templatesym)))
+        {
+            pd_error(x, "elem: couldn't find template %s",
+                templatesym->s_name);
+            return;
+        }
+        tcache_findfield(template, fieldsym, &x->x_onset, &x->x_type, 0);
     }
-    if (!template_find_field(template, fieldsym,
-        &onset, &type, &elemtemplatesym))
+    if (x->x_type < 0)
     {
         pd_error(x, "getsize: couldn't find array field %s", fieldsym->s_name);
         return;
     }
-    if (type != DT_ARRAY)
+    if (x->x_type != DT_ARRAY)
     {
         pd_error(x, "getsize: field %s not of type array", fieldsym->s_name);
         return;
@@ -851,7 +1051,7 @@ static void getsize_pointer(t_getsize *x, t_gpointer *gp)
     if (gs->gs_which == GP_ARRAY) w = gp->gp_un.gp_w;
     else w = gp->gp_un.gp_scalar->sc_vec;
 
-    array = *(t_array **)(((char *)w) + onset);
+    array = *(t_array **)(((char *)w) + x->x_onset);
     outlet_float(x->x_obj.ob_outlet, (t_float)(array->a_n));
 }
 
@@ -980,27 +1180,32 @@ static void setsize_float(t_setsize *x, t_float f)
             gobj_vis((t_gobj *)(owner_array->a_gp.gp_un.gp_scalar),
                 owner_array->a_gp.gp_stub->gs_un.gs_glist, 0);
     }
-        /* if shrinking, free the scalars that will disappear */
-    if (newsize < nitems)
-    {
-        char *elem;
-        int count;
-        for (elem = ((char *)array->a_vec) + newsize * elemsize,
-            count = nitems - newsize; count--; elem += elemsize)
-                word_free((t_word *)elem, elemtemplate);
-    }
-        /* resize the array  */
-    array->a_vec = (char *)resizebytes(array->a_vec,
-        elemsize * nitems, elemsize * newsize);
-    array->a_n = newsize;
-        /* if growing, initialize new scalars */
-    if (newsize > nitems)
+    if (array->a_columns)   /* stored by field: see array_resize() */
+        array_resize(array, newsize);
+    else
     {
-        char *elem;
-        int count;
-        for (elem = ((char *)array->a_vec) + nitems * elemsize,
-            count = newsize - nitems; count--; elem += elemsize)
-                word_init((t_word *)elem, elemtemplate, gp);
+            /* if shrinking, free the scalars that will disappear */
+        if (newsize < nitems)
+        {
+            char *elem;
+            int count;
+            for (elem = ((char *)array->a_vec) + newsize * elemsize,
+                count = nitems - newsize; count--; elem += elemsize)
+                    word_free((t_word *)elem, elemtemplate);
+        }
+            /* resize the array  */
+        array->a_vec = (char *)resizebytes(array->a_vec,
+            elemsize * nitems, elemsize * newsize);
+        array->a_n = newsize;
+            /* if growing, initialize new scalars */
+        if (newsize > nitems)
+        {
+            char *elem;
+            int count;
+            for (elem = ((char *)array->a_vec) + nitems * elemsize,
+                count = newsize - nitems; count--; elem += elemsize)
+                    word_init((t_word *)elem, elemtemplate, gp);
+        }
     }
         /* invalidate all gpointers into the array */
     array->a_valid++;
@@ -1159,6 +1364,7 @@ static void append_float(t_append *x, t_float f)
         sc->sc_gobj.g_next = glist->gl_list;
         glist->gl_list = &sc->sc_gobj;
     }
+    glist_noindex(glist);
 
     gp->gp_un.gp_scalar = sc;
     vec = sc->sc_vec;
@@ -14,17 +14,11 @@
 
 void canvas_undo_set_name(const char*name);
 
+    /* limit on the bytes held by each undo queue; 0 for no limit */
+static size_t undo_maxbytes = 64 * 1024 * 1024;
+
 /* --------- 12. internal object state --------------- */
 int glist_getindex(t_glist *x, t_gobj *y);
-static t_gobj *glist_nth(t_glist *x, int n)
-{
-    t_gobj *y;
-    int indx;
-    for (y = x->gl_list, indx = 0; y; y = y->g_next, indx++)
-        if (indx == n)
-            return (y);
-    return (0);
-}
 typedef struct _undo_object_state {
     int u_obj;
     t_symbol*u_symbol;
@@ -99,6 +93,9 @@ int canvas_undo_objectstate(t_canvas *cnv, void *z, int action) {
         if(x)
             pd_typedmess(x, buf->u_symbol, binbuf_getnatom(bbuf), binbuf_getvec(bbuf));
         break;
+    case UNDO_SIZE:
+        return (sizeof(*buf) + canvas_undo_binbufsize(buf->u_undo)
+            + canvas_undo_binbufsize(buf->u_redo));
     }
     return 1;
 }
@@ -106,6 +103,18 @@ int canvas_undo_objectstate(t_canvas *cnv, void *z, int action) {
 
 /* --------------- */
 
+int canvas_undo_binbufsize(const t_binbuf *b)
+{
+    return (b ? binbuf_getnatom(b) * (int)sizeof(t_atom) : 0);
+}
+
+    /* "pd undo-memory <kbytes>": most memory each undo queue may hold before
+    its oldest actions are forgotten, or 0 for no limit. */
+void glob_undomemory(void *dummy, t_floatarg f)
+{
+    undo_maxbytes = (f > 0 ? (size_t)f * 1024 : 0);
+}
+
 static void canvas_show_undomenu(t_canvas*x, const char* undo_action, const char* redo_action)
 {
     if (glist_isvisible(x) && glist_istoplevel(x))
@@ -159,6 +168,7 @@ t_undo_action *canvas_undo_init(t_canvas *x)
     a->type = 0;
     a->x = x;
     a->next = NULL;
+    a->size = 0;
 
     if (!udo->u_queue)
     {
@@ -194,6 +204,82 @@ t_undo_action *canvas_undo_init(t_canvas *x)
     return(a);
 }
 
+static int canvas_undo_doit(t_canvas *x, t_undo_action *udo, int action,
+    const char*funname);
+
+    /* (re)compute the bytes held by an action; the handlers that copy objects
+    answer UNDO_SIZE, the rest only hold small fixed-size records */
+static void canvas_undo_measure(t_canvas *x, t_undo *udo, t_undo_action *a)
+{
+    int size = sizeof(*a);
+    switch(a->type)
+    {
+    case UNDO_CUT:
+    case UNDO_PASTE:
+    case UNDO_APPLY:
+    case UNDO_CREATE:
+    case UNDO_RECREATE:
+    case UNDO_OBJECT_STATE:
+        if (a->data)
+            size += canvas_undo_doit(x, a, UNDO_SIZE, __FUNCTION__);
+        break;
+    default:
+        break;
+    }
+    udo->u_size = udo->u_size - a->size + size;
+    a->size = size;
+}
+
+static void canvas_undo_dofree(t_canvas *x, t_undo *udo, t_undo_action *a,
+    const char*funname)
+{
+    canvas_undo_doit(x, a, UNDO_FREE, funname);
+    udo->u_size -= a->size;
+    freebytes(a, sizeof(*a));
+}
+
+    /* forget the oldest actions while the queue holds more than undo_maxbytes.
+    A sequence goes as a whole, and the newest action always stays. */
+static void canvas_undo_trim(t_canvas *x, t_undo *udo)
+{
+    t_undo_action *first, *last, *a;
+    if (!undo_maxbytes || udo->u_doing)
+        return;
+    while (udo->u_size > undo_maxbytes &&
+        (first = udo->u_queue->next) && first != udo->u_last)
+    {
+        last = first;
+        if (UNDO_SEQUENCE_START == first->type)
+        {
+            int depth = 1;
+            while (depth && last != udo->u_last)
+            {
+                last = last->next;
+                if (UNDO_SEQUENCE_START == last->type)
+                    depth++;
+                else if (UNDO_SEQUENCE_END == last->type)
+                    depth--;
+            }
+            if (depth)  /* sequence still being recorded */
+                break;
+        }
+        if (last == udo->u_last)
+            break;
+            /* if the saved state can no longer be reached, stay dirty */
+        for (a = udo->u_queue; a != last->next; a = a->next)
+            if (udo->u_cleanstate == a)
+                udo->u_cleanstate = (void*)1;
+        udo->u_queue->next = last->next;
+        last->next->prev = udo->u_queue;
+        while (first != udo->u_queue->next)
+        {
+            a = first->next;
+            canvas_undo_dofree(x, udo, first, __FUNCTION__);
+            first = a;
+        }
+    }
+}
+
 t_undo_action *canvas_undo_add(t_canvas *x, t_undo_type type, const char *name,
     void *data)
 {
@@ -218,13 +304,16 @@ t_undo_action *canvas_undo_add(t_canvas *x, t_undo_type type, const char *name,
     a->type = type;
     a->data = (void *)data;
     a->name = (char *)name;
+    canvas_undo_measure(x, udo, a);
+    canvas_undo_trim(x, udo);
     canvas_undo_set_name(name);
     canvas_show_undomenu(x, a->name, "no");
     DEBUG_UNDO(post("%s: done!", __FUNCTION__));
     return(a);
 }
 
-static int canvas_undo_doit(t_canvas *x, t_undo_action *udo, int action, const char*funname)
+static int canvas_undo_doit(t_canvas *x, t_undo_action *udo, int action,
+    const char*funname)
 {
     DEBUG_UNDO(post("%s: %s(%d) %d %p", __FUNCTION__, funname, action, udo->type, udo->data));
 
@@ -284,6 +373,7 @@ void canvas_undo_undo(t_canvas *x)
                     break;
                 default:
                     canvas_undo_doit(x, udo->u_last, UNDO_UNDO, __FUNCTION__);
+                    canvas_undo_measure(x, udo, udo->u_last);
                 }
                 if (sequence_depth < 1)
                     break;
@@ -297,6 +387,7 @@ void canvas_undo_undo(t_canvas *x)
         if(canvas_undo_doit(x, udo->u_last, UNDO_UNDO, __FUNCTION__))
         {
             char *undo_action, *redo_action;
+            canvas_undo_measure(x, udo, udo->u_last);
             udo->u_last = udo->u_last->prev;
             undo_action = udo->u_last->name;
             redo_action = udo->u_last->next->name;
@@ -343,6 +434,7 @@ void canvas_undo_redo(t_canvas *x)
                     break;
                 default:
                     canvas_undo_doit(x, udo->u_last, UNDO_REDO, __FUNCTION__);
+                    canvas_undo_measure(x, udo, udo->u_last);
                 }
                 if (sequence_depth < 1)
                     break;
@@ -354,6 +446,7 @@ void canvas_undo_redo(t_canvas *x)
         }
 
         canvas_undo_doit(x, udo->u_last, UNDO_REDO, __FUNCTION__);
+        canvas_undo_measure(x, udo, udo->u_last);
         undo_action = udo->u_last->name;
         redo_action = (udo->u_last->next ? udo->u_last->next->name : "no");
         udo->u_doing = 0;
@@ -377,9 +470,8 @@ void canvas_undo_rebranch(t_canvas *x)
         a1 = udo->u_last->next;
         while(a1)
         {
-            canvas_undo_doit(x, a1, UNDO_FREE, __FUNCTION__);
             a2 = a1->next;
-            freebytes(a1, sizeof(*a1));
+            canvas_undo_dofree(x, udo, a1, __FUNCTION__);
             a1 = a2;
         }
         udo->u_last->next = 0;
@@ -412,9 +504,8 @@ void canvas_undo_free(t_canvas *x)
         a1 = udo->u_queue;
         while(a1)
         {
-            canvas_undo_doit(x, a1, UNDO_FREE, __FUNCTION__);
             a2 = a1->next;
-            freebytes(a1, sizeof(*a1));
+            canvas_undo_dofree(x, udo, a1, __FUNCTION__);
             a1 = a2;
         }
     }
@@ -26,6 +26,11 @@ What about abstractions? Once they are recreated  (e.g. after delete, followed
 by an undo) all undo actions (except for its deletion in the parent window should
 be purged since abstraction's state will now default to its original (saved) state.
 
+Each action remembers roughly how much memory it holds (asked for with
+UNDO_SIZE).  When a queue holds more than the limit set with "pd undo-memory",
+the oldest actions are freed until it fits again; undo sequences are only
+dropped as a whole and the newest action is always kept.
+
 Types of undo data:
 0  - init data (start of the queue)
 1  - connect
@@ -75,6 +80,7 @@ struct _undo_action
 	char *name;					/* name of current action */
 	struct _undo_action *prev;	/* previous undo action */
 	struct _undo_action *next;	/* next undo action */
+	int size;					/* approximate bytes held, see UNDO_SIZE */
 };
 
 #ifndef t_undo_action
@@ -87,6 +93,7 @@ struct _undo
     t_undo_action *u_last;
     void *u_cleanstate; /* pointer to non-dirty state */
     int u_doing; /* currently undoing */
+    size_t u_size; /* approximate bytes held by all actions in the queue */
 };
 #define t_undo struct _undo
 
@@ -105,6 +112,9 @@ EXTERN void canvas_undo_check_canvas_pointers(t_canvas *x);
 EXTERN void canvas_undo_purge_abstraction_actions(t_canvas *x);
 EXTERN void canvas_undo_free(t_canvas *x);
 
+    /* bytes held by a binbuf, for answering UNDO_SIZE */
+EXTERN int canvas_undo_binbufsize(const t_binbuf *b);
+
 /* --------- 1. connect ---------- */
 
 EXTERN void *canvas_undo_set_connect(t_canvas *x,
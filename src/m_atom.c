@@ -5,6 +5,92 @@
 #include "m_pd.h"
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
+
+    /* Format a float exactly as sprintf()'s "%g" would, but without going
+    through sprintf() in the common cases: integers below a million, and
+    numbers from 0.0001 to a million whose six significant digits can be
+    rounded safely in double precision (that is, unless the part left over
+    is within a hair of one half).  Everything else, including infinities
+    and NaNs, goes to sprintf().  "buf" needs 30 bytes. */
+static void atom_formatfloat(char *buf, double f)
+{
+    static const double pow10[] =
+        {1, 10, 100, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+    char digits[6], *bp = buf;
+    double a = (f < 0 ? -f : f), s, fl;
+    int e, n, i, last;
+    union
+    {
+        double u_d;
+        uint64_t u_i;
+    } u;
+        /* look at the bits, since we may be compiled with -ffast-math */
+    u.u_d = f;
+    if (((u.u_i >> 52) & 0x7ff) == 0x7ff)   /* infinity or NaN */
+        goto slow;
+    if (!(u.u_i << 1))      /* plus or minus zero */
+    {
+        strcpy(buf, ((u.u_i >> 63) ? "-0" : "0"));
+        return;
+    }
+    if (a < 1e6 && a == (int)a)
+    {
+        char tmp[8], *tp = tmp;
+        if (f < 0)
+            *bp++ = '-';
+        n = (int)a;
+        do *tp++ = '0' + n % 10;
+        while ((n /= 10));
+        while (tp > tmp)
+            *bp++ = *--tp;
+        *bp = 0;
+        return;
+    }
+    if (!(a >= 1e-4 && a < 1e6))
+        goto slow;
+        /* find the power of ten that puts six digits before the point */
+    for (e = 5, s = a; s < 1e5 && e > -4; e--)
+        s = a * pow10[5 - (e - 1)];
+    fl = floor(s);
+    if (s - fl > 0.5 - 1e-7 && s - fl < 0.5 + 1e-7)
+        goto slow;
+    n = (int)fl + (s - fl > 0.5);
+    if (n >= 1000000)
+        n /= 10, e++;
+    if (e > 5 || n < 100000)
+        goto slow;
+    for (i = 6; i--; n /= 10)
+        digits[i] = '0' + n % 10;
+    for (last = 5; last > 0 && digits[last] == '0'; last--)
+        ;
+    if (f < 0)
+        *bp++ = '-';
+    if (e >= 0)
+    {
+        for (i = 0; i <= e; i++)
+            *bp++ = digits[i];
+        if (last > e)
+        {
+            *bp++ = '.';
+            for (; i <= last; i++)
+                *bp++ = digits[i];
+        }
+    }
+    else
+    {
+        *bp++ = '0';
+        *bp++ = '.';
+        for (i = -1; i > e; i--)
+            *bp++ = '0';
+        for (i = 0; i <= last; i++)
+            *bp++ = digits[i];
+    }
+    *bp = 0;
+    return;
+slow:
+    sprintf(buf, "%g", f);
+}
 
     /* convenience routines for checking and getting values of
         atoms.  There's no "pointer" version since there's nothing
@@ -32,7 +118,7 @@ t_symbol *atom_gensym(const t_atom *a)  /* this works  better for graph labels *
     char buf[30];
     if (a->a_type == A_SYMBOL) return (a->a_w.w_symbol);
     else if (a->a_type == A_FLOAT)
-        sprintf(buf, "%g", a->a_w.w_float);
+        atom_formatfloat(buf, a->a_w.w_float);
     else strcpy(buf, "???");
     return (gensym(buf));
 }
@@ -75,7 +161,7 @@ void atom_string(const t_atom *a, char *buf, unsigned int bufsize)
         strcpy(buf, "(pointer)");
         break;
     case A_FLOAT:
-        sprintf(tbuf, "%g", a->a_w.w_float);
+        atom_formatfloat(tbuf, a->a_w.w_float);
         if (strlen(tbuf) < bufsize-1) strcpy(buf, tbuf);
         else if (a->a_w.w_float < 0) strcpy(buf, "-");
         else  strcpy(buf, "+");
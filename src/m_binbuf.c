@@ -5,6 +5,7 @@
 
 #include <stdlib.h>
 #include "m_pd.h"
+#include "m_imp.h"
 #include "s_stuff.h"
 #include "g_canvas.h"
 #include <stdio.h>
@@ -18,47 +19,492 @@
 #include <fcntl.h>
 #include <string.h>
 #include <stdarg.h>
+#include <sys/stat.h>
+#include <pthread.h>
 
 #ifdef _MSC_VER
 #define snprintf _snprintf
 #endif
 
+    /* a small cache of dollar-symbol expansions made by binbuf_eval().
+    Only symbols whose only dollar signs are "$0" are cached, since these
+    expand the same way every time a message box or the like is clicked;
+    entries are keyed on the symbol and the value of $0 so that they
+    can never go stale even if the binbuf's contents are changed. */
+#define DOLLCACHESIZE 8
+
+typedef struct _dollcache
+{
+    t_symbol *dc_sym;
+    t_float dc_dollarzero;
+    t_symbol *dc_result;
+} t_dollcache;
+
+    /* the onsets of the lines (messages separated by semicolons or commas)
+    in a binbuf, so that [text get] and friends can find the nth line
+    without counting separators.  Any change in the binbuf's size
+    invalidates it; the few places that write separators into a binbuf
+    in place call binbuf_invalidatelines(). */
+typedef struct _lineindex
+{
+    int li_valid;
+    int li_n;               /* number of lines */
+    int li_size;            /* allocated size of li_onset */
+    int li_lastend;         /* end of the last line */
+    int *li_onset;
+} t_lineindex;
+
+    /* A large binbuf nobody is looking at (such as a [text define] score
+    that isn't playing) can be packed into a compact form: a 4-byte cell
+    per atom (8 with double precision) holding the float, the "$" number,
+    or an index into a table of the distinct symbols, plus a byte for the
+    type -- about a third of the 16 bytes a t_atom takes.  The line index
+    is kept, and the serial number doesn't change, so indices that other
+    objects keep stay good.  binbuf_touch() expands it again as soon as
+    anyone asks for the atoms. */
+
+typedef union _packcell
+{
+    t_float c_float;
+    int c_index;                /* symbol table index or "$" number */
+} t_packcell;
+
+typedef struct _binpack
+{
+    int p_n;                    /* number of atoms */
+    t_packcell *p_cell;         /* p_n cells, then p_n type bytes */
+    unsigned char *p_type;
+    int p_nsym;                 /* distinct symbols */
+    t_symbol **p_sym;
+} t_binpack;
+
+void binbuf_invalidatelines(t_binbuf *x);
+static void binbuf_unpack(t_binbuf *x);
+static void binbuf_droppack(t_binbuf *x);
+
+    /* call before looking at a binbuf's atoms: expand it if it's packed,
+    and note that it's in use */
+#define binbuf_touch(x) ((x)->b_pack ? binbuf_unpack((t_binbuf *)(x)) : \
+    (void)0, ((t_binbuf *)(x))->b_used = 1)
+
 struct _binbuf
 {
     int b_n;
+    int b_size;                 /* number of atoms there's room for */
     t_atom *b_vec;
+    t_dollcache *b_dollcache;   /* allocated on first use */
+    t_lineindex *b_lines;       /* ditto */
+    int b_serial;               /* changes whenever the contents might */
+    struct _binpack *b_pack;    /* compact form while idle, see below */
+    int b_used;                 /* used since the last binbuf_pack() call */
+    struct _binbuf *b_next;     /* list of all binbufs, with -symgc, or
+                                the instance's pool of free ones */
+    struct _binbuf **b_prevp;   /* ... or zero if not in it */
 };
 
+    /* serial numbers are unique over all binbufs so that an index kept
+    elsewhere (see text_search in x_text.c) can't mistake a new binbuf
+    at the same address for the one it was made from. */
+static int binbuf_serialcount;
+
+    /* note that the contents changed (called automatically if the size
+    changes; call it explicitly after writing into binbuf_getvec()) */
+void binbuf_modified(t_binbuf *x)
+{
+    x->b_serial = ++binbuf_serialcount;
+    x->b_used = 1;
+}
+
+int binbuf_getserial(const t_binbuf *x)
+{
+    return (x->b_serial);
+}
+
+    /* with -symgc all binbufs are listed, so that "pd symbol-collect" can
+    see the symbols in ones only a static variable points to, like the
+    clipboard's.  They might be made and freed in any thread. */
+static t_binbuf *binbuf_list;
+static pthread_mutex_t binbuf_listmutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void binbuf_enlist(t_binbuf *x)
+{
+    if (!sys_symgc)
+    {
+        x->b_prevp = 0;
+        return;
+    }
+    pthread_mutex_lock(&binbuf_listmutex);
+    if ((x->b_next = binbuf_list))
+        binbuf_list->b_prevp = &x->b_next;
+    binbuf_list = x;
+    x->b_prevp = &binbuf_list;
+    pthread_mutex_unlock(&binbuf_listmutex);
+}
+
+static void binbuf_delist(t_binbuf *x)
+{
+    if (!x->b_prevp)
+        return;
+    pthread_mutex_lock(&binbuf_listmutex);
+    if ((*x->b_prevp = x->b_next))
+        x->b_next->b_prevp = x->b_prevp;
+    pthread_mutex_unlock(&binbuf_listmutex);
+}
+
+static void binbuf_markfilecache(void (*fn)(const void *w));
+
+    /* call a function on each symbol in all binbufs, including ones in
+    their caches of "$" symbols, and on the names of cached files */
+void binbuf_marksymbols(void (*fn)(const void *w))
+{
+    t_binbuf *x;
+    int i;
+    pthread_mutex_lock(&binbuf_listmutex);
+    for (x = binbuf_list; x; x = x->b_next)
+    {
+        (*fn)(x);
+        for (i = 0; i < x->b_n; i++)
+            if (x->b_vec[i].a_type == A_SYMBOL ||
+                x->b_vec[i].a_type == A_DOLLSYM)
+                    (*fn)(x->b_vec[i].a_w.w_symbol);
+        if (x->b_pack)
+            for (i = 0; i < x->b_pack->p_nsym; i++)
+                (*fn)(x->b_pack->p_sym[i]);
+        if (x->b_dollcache)
+            for (i = 0; i < DOLLCACHESIZE; i++)
+        {
+            (*fn)(x->b_dollcache[i].dc_sym);
+            (*fn)(x->b_dollcache[i].dc_result);
+        }
+    }
+    pthread_mutex_unlock(&binbuf_listmutex);
+    binbuf_markfilecache(fn);
+}
+
+    /* Binbufs are made and freed all the time for messages passing
+    through, so their room grows geometrically and each instance keeps a
+    pool of up to BINBUF_POOLSIZE free ones, with room for up to
+    BINBUF_KEEP atoms, to hand out again.  With "-lowmem" neither is
+    done. */
+#define BINBUF_POOLSIZE 32
+#define BINBUF_KEEP 256
+
+    /* the current instance's pool, or 0 if it's being made or freed */
+static t_instancestuff *binbuf_pool(void)
+{
+#ifdef PDINSTANCE
+    if (!pd_this)
+        return (0);
+#endif
+    return (STUFF);
+}
+
+    /* binbufs are "message storage" for "pd memory-report"; blocks keep
+    their kind when they're resized */
 t_binbuf *binbuf_new(void)
 {
-    t_binbuf *x = (t_binbuf *)t_getbytes(sizeof(*x));
+    t_instancestuff *pool = binbuf_pool();
+    t_binbuf *x;
+    if (pool && (x = pool->st_binbufpool))
+    {
+        pool->st_binbufpool = x->b_next;
+        pool->st_nbinbufpool--;
+    }
+    else
+    {
+        int kind = mem_setkind(MEM_MESSAGE);
+        x = (t_binbuf *)t_getbytes(sizeof(*x));
+        x->b_size = 0;
+        x->b_vec = t_getbytes(0);
+        mem_setkind(kind);
+    }
     x->b_n = 0;
-    x->b_vec = t_getbytes(0);
+    x->b_dollcache = 0;
+    x->b_lines = 0;
+    x->b_pack = 0;
+    x->b_used = 0;
+    binbuf_modified(x);
+    binbuf_enlist(x);
     return (x);
 }
 
+    /* change the room in a binbuf's vector */
+static int binbuf_realloc(t_binbuf *x, int size)
+{
+    t_atom *vec = t_resizebytes(x->b_vec,
+        x->b_size * sizeof(*x->b_vec), size * sizeof(*x->b_vec));
+    if (!vec)
+        return (0);
+    x->b_vec = vec;
+    x->b_size = size;
+    return (1);
+}
+
 void binbuf_free(t_binbuf *x)
 {
-    t_freebytes(x->b_vec, x->b_n * sizeof(*x->b_vec));
+    t_instancestuff *pool = binbuf_pool();
+    binbuf_delist(x);
+    binbuf_droppack(x);
+    if (x->b_dollcache)
+        t_freebytes(x->b_dollcache, DOLLCACHESIZE * sizeof(*x->b_dollcache));
+    if (x->b_lines)
+    {
+        t_freebytes(x->b_lines->li_onset,
+            x->b_lines->li_size * sizeof(*x->b_lines->li_onset));
+        t_freebytes(x->b_lines, sizeof(*x->b_lines));
+    }
+    if (!sys_lowmem && pool && pool->st_nbinbufpool < BINBUF_POOLSIZE &&
+        (x->b_size <= BINBUF_KEEP || binbuf_realloc(x, 0)))
+    {
+        x->b_next = pool->st_binbufpool;
+        pool->st_binbufpool = x;
+        pool->st_nbinbufpool++;
+        return;
+    }
+    t_freebytes(x->b_vec, x->b_size * sizeof(*x->b_vec));
     t_freebytes(x,  sizeof(*x));
 }
 
+    /* free the instance's pool when the instance goes away */
+void binbuf_freepool(void)
+{
+    t_binbuf *x;
+    while ((x = STUFF->st_binbufpool))
+    {
+        STUFF->st_binbufpool = x->b_next;
+        t_freebytes(x->b_vec, x->b_size * sizeof(*x->b_vec));
+        t_freebytes(x,  sizeof(*x));
+    }
+    STUFF->st_nbinbufpool = 0;
+}
+
 t_binbuf *binbuf_duplicate(const t_binbuf *y)
 {
-    t_binbuf *x = (t_binbuf *)t_getbytes(sizeof(*x));
-    x->b_n = y->b_n;
-    x->b_vec = t_getbytes(x->b_n * sizeof(*x->b_vec));
-    memcpy(x->b_vec, y->b_vec, x->b_n * sizeof(*x->b_vec));
+    t_binbuf *x = binbuf_new();
+    binbuf_touch(y);
+    if (binbuf_resize(x, y->b_n))
+        memcpy(x->b_vec, y->b_vec, y->b_n * sizeof(*x->b_vec));
     return (x);
 }
 
+    /* the room is kept to be filled again, unless there's a lot of it */
 void binbuf_clear(t_binbuf *x)
 {
-    x->b_vec = t_resizebytes(x->b_vec, x->b_n * sizeof(*x->b_vec), 0);
+    binbuf_droppack(x);
+    if (x->b_size > BINBUF_KEEP || sys_lowmem)
+        binbuf_realloc(x, 0);
     x->b_n = 0;
+    binbuf_invalidatelines(x);
+    binbuf_modified(x);
+}
+
+static void binbuf_droppack(t_binbuf *x)
+{
+    t_binpack *p = x->b_pack;
+    if (!p)
+        return;
+    t_freebytes(p->p_cell, p->p_n * (sizeof(*p->p_cell) + 1));
+    t_freebytes(p->p_sym, p->p_nsym * sizeof(*p->p_sym));
+    t_freebytes(p, sizeof(*p));
+    x->b_pack = 0;
+}
+
+static void binbuf_unpack(t_binbuf *x)
+{
+    t_binpack *p = x->b_pack;
+    int i, kind = mem_setkind(MEM_MESSAGE);
+    if (!binbuf_realloc(x, p->p_n))
+    {
+        mem_setkind(kind);
+        pd_error(0, "binbuf: out of memory expanding %d atoms", p->p_n);
+        return;
+    }
+    mem_setkind(kind);
+    for (i = 0; i < p->p_n; i++)
+    {
+        t_atom *ap = &x->b_vec[i];
+        switch (ap->a_type = p->p_type[i])
+        {
+        case A_FLOAT: ap->a_w.w_float = p->p_cell[i].c_float; break;
+        case A_SYMBOL: case A_DOLLSYM:
+            ap->a_w.w_symbol = p->p_sym[p->p_cell[i].c_index]; break;
+        case A_DOLLAR: ap->a_w.w_index = p->p_cell[i].c_index; break;
+        default: ap->a_w.w_index = 0;
+        }
+    }
+    x->b_n = p->p_n;
+    binbuf_droppack(x);
+}
+
+    /* pack a binbuf if it has at least "minatoms" atoms and hasn't been
+    used since the last call, so that calling this periodically packs
+    a binbuf once it has gone unused for a whole period.  Returns 1 if
+    the binbuf is packed. */
+int binbuf_pack(t_binbuf *x, int minatoms)
+{
+    t_binpack *p;
+    int i, n = x->b_n, nsymatom = 0, hashsize, *hash, kind;
+    if (x->b_pack)
+        return (1);
+    if (x->b_used || n < minatoms || !n)
+    {
+        x->b_used = 0;
+        return (0);
+    }
+    for (i = 0; i < n; i++)
+    {
+        int type = x->b_vec[i].a_type;
+        if (type == A_SYMBOL || type == A_DOLLSYM)
+            nsymatom++;
+        else if (type != A_FLOAT && type != A_SEMI && type != A_COMMA &&
+            type != A_DOLLAR)
+                return (0);     /* pointers and such can't be packed */
+    }
+    kind = mem_setkind(MEM_MESSAGE);
+    p = (t_binpack *)t_getbytes(sizeof(*p));
+    p->p_n = n;
+    p->p_cell = (t_packcell *)t_getbytes(n * (sizeof(*p->p_cell) + 1));
+    p->p_type = (unsigned char *)(p->p_cell + n);
+    p->p_sym = (t_symbol **)t_getbytes(nsymatom * sizeof(*p->p_sym));
+    p->p_nsym = 0;
+        /* open hash from symbols to their indices in the table */
+    for (hashsize = 16; hashsize < 2 * nsymatom; hashsize *= 2)
+        ;
+    hash = (int *)getbytes(hashsize * sizeof(*hash));
+    for (i = 0; i < hashsize; i++)
+        hash[i] = -1;
+    for (i = 0; i < n; i++)
+    {
+        t_atom *ap = &x->b_vec[i];
+        p->p_type[i] = ap->a_type;
+        if (ap->a_type == A_FLOAT)
+            p->p_cell[i].c_float = ap->a_w.w_float;
+        else if (ap->a_type == A_DOLLAR)
+            p->p_cell[i].c_index = ap->a_w.w_index;
+        else if (ap->a_type == A_SYMBOL || ap->a_type == A_DOLLSYM)
+        {
+            t_symbol *sym = ap->a_w.w_symbol;
+            unsigned int h = (unsigned int)(((size_t)sym) >> 3) * 2654435761u;
+            int j = h & (hashsize - 1);
+            while (hash[j] >= 0 && p->p_sym[hash[j]] != sym)
+                j = (j + 1) & (hashsize - 1);
+            if (hash[j] < 0)
+                p->p_sym[(hash[j] = p->p_nsym++)] = sym;
+            p->p_cell[i].c_index = hash[j];
+        }
+        else p->p_cell[i].c_index = 0;
+    }
+    freebytes(hash, hashsize * sizeof(*hash));
+    p->p_sym = (t_symbol **)t_resizebytes(p->p_sym,
+        nsymatom * sizeof(*p->p_sym), p->p_nsym * sizeof(*p->p_sym));
+    mem_setkind(kind);
+    binbuf_realloc(x, 0);
+    x->b_n = 0;
+    x->b_pack = p;
+    return (1);
 }
 
     /* convert text to a binbuf */
+    /* character classes for binbuf_text(): characters that end an atom,
+    and ones that need the careful, character-by-character treatment */
+#define BB_END 1
+#define BB_SPECIAL 2
+static unsigned char binbuf_ctype[256];
+
+static void binbuf_ctypeinit(void)
+{
+    binbuf_ctype[' '] = binbuf_ctype['\n'] = binbuf_ctype['\r'] =
+        binbuf_ctype['\t'] = binbuf_ctype[','] = binbuf_ctype[';'] = BB_END;
+    binbuf_ctype['\\'] = binbuf_ctype['$'] = BB_SPECIAL;
+}
+
+    /* check whether the n characters in buf (null-terminated) make a number
+    as binbuf_text() has always understood it: an optional minus sign, then
+    digits with an optional decimal point (or a point and digits), then an
+    optional exponent.  If so, get its value as atof() would.  That is quick
+    when the digits fit in a double's mantissa and the power of ten is at
+    most 22, so that one correctly rounded multiply or divide gives the
+    right answer; otherwise call atof(). */
+static int binbuf_scanfloat(const char *buf, int n, double *fp)
+{
+    static const double pow10[] = {1, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+        1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18,
+        1e19, 1e20, 1e21, 1e22};
+    const char *p = buf, *e = buf + n;
+    uint64_t mant = 0;
+    int neg = 0, ndigits = 0, nfrac = 0, exponent = 0, expneg = 0,
+        inexact = 0, power;
+    double f;
+    if (p < e && *p == '-')
+        neg = 1, p++;
+    for (; p < e && *p >= '0' && *p <= '9'; p++, ndigits++)
+    {
+        if (mant < ((uint64_t)1 << 53) / 10)
+            mant = mant * 10 + (*p - '0');
+        else inexact = 1, nfrac--;  /* (dropped digit: scale up by 10) */
+    }
+    if (p < e && *p == '.')
+        for (p++; p < e && *p >= '0' && *p <= '9'; p++, ndigits++)
+    {
+        if (mant < ((uint64_t)1 << 53) / 10)
+            mant = mant * 10 + (*p - '0'), nfrac++;
+        else inexact = 1;
+    }
+    if (!ndigits)
+        return (0);
+    if (p < e && (*p == 'e' || *p == 'E'))
+    {
+        p++;
+        if (p < e && (*p == '+' || *p == '-'))
+            expneg = (*p++ == '-');
+        if (p == e)
+            return (0);
+        for (; p < e && *p >= '0' && *p <= '9'; p++)
+            if (exponent < 10000)
+                exponent = exponent * 10 + (*p - '0');
+    }
+    if (p != e)
+        return (0);
+    power = (expneg ? -exponent : exponent) - nfrac;
+        /* (and let atof() get the sign of zero right under -ffast-math) */
+    if (inexact || power > 22 || power < -22 || (!mant && neg))
+        *fp = atof(buf);
+    else
+    {
+        f = (double)mant;
+        if (power >= 0)
+            f *= pow10[power];
+        else f /= pow10[-power];
+        *fp = (neg ? -f : f);
+    }
+    return (1);
+}
+
+    /* most atoms have no backslashes or dollar signs, so that their end can
+    be found in one sweep and they can be checked for being numbers
+    afterward.  If the atom at *textpp is one, parse it into *ap using buf
+    (at least MAXPDSTRING+1 bytes), advance *textpp and return 1. */
+static int binbuf_quickatom(const char **textpp, const char *etext,
+    char *buf, t_atom *ap)
+{
+    const char *textp = *textpp, *endp = textp;
+    double f;
+    int n;
+    while (endp != etext && !binbuf_ctype[(unsigned char)*endp])
+        endp++;
+    if ((endp != etext && binbuf_ctype[(unsigned char)*endp] != BB_END) ||
+        endp - textp >= MAXPDSTRING)
+            return (0);
+    n = (int)(endp - textp);
+    memcpy(buf, textp, n);
+    buf[n] = 0;
+    *textpp = endp;
+    if (binbuf_scanfloat(buf, n, &f))
+        SETFLOAT(ap, f);
+    else SETSYMBOL(ap, gensym(buf));
+    return (1);
+}
+
 void binbuf_text(t_binbuf *x, const char *text, size_t size)
 {
     char buf[MAXPDSTRING+1], *bufp, *ebuf = buf+MAXPDSTRING;
@@ -67,6 +513,8 @@ void binbuf_text(t_binbuf *x, const char *text, size_t size)
     int nalloc = 16, natom = 0;
     binbuf_clear(x);
     if (!binbuf_resize(x, nalloc)) return;
+    if (!binbuf_ctype[' '])
+        binbuf_ctypeinit();
     ap = x->b_vec;
     while (1)
     {
@@ -77,7 +525,7 @@ void binbuf_text(t_binbuf *x, const char *text, size_t size)
         if (textp == etext) break;
         if (*textp == ';') SETSEMI(ap), textp++;
         else if (*textp == ',') SETCOMMA(ap), textp++;
-        else
+        else if (!binbuf_quickatom(&textp, etext, buf, ap))
         {
                 /* it's an atom other than a comma or semi */
             char c;
@@ -193,7 +641,7 @@ void binbuf_text(t_binbuf *x, const char *text, size_t size)
         }
         if (textp == etext) break;
     }
-    /* reallocate the vector to exactly the right size */
+    /* give back the extra room if it's more than half */
     binbuf_resize(x, natom);
 }
 
@@ -206,6 +654,7 @@ void binbuf_gettext(const t_binbuf *x, char **bufp, int *lengthp)
     const t_atom *ap;
     int indx;
 
+    binbuf_touch(x);
     for (ap = x->b_vec, indx = x->b_n; indx--; ap++)
     {
         int newlength;
@@ -237,6 +686,7 @@ writing to file doesn't buffer everything together. */
 
 void binbuf_add(t_binbuf *x, int argc, const t_atom *argv)
 {
+    binbuf_touch(x);
     int previoussize = x->b_n;
     int newsize = previoussize + argc, i;
     t_atom *ap;
@@ -297,6 +747,7 @@ void binbuf_addbinbuf(t_binbuf *x, const t_binbuf *y)
     t_binbuf *z = binbuf_new();
     int i, fixit;
     t_atom *ap;
+    binbuf_touch(y);
     binbuf_add(z, y->b_n, y->b_vec);
     for (i = 0, ap = z->b_vec; i < z->b_n; i++, ap++)
     {
@@ -351,6 +802,7 @@ from binbuf_addbinbuf.  The symbol ";" goes to a semicolon, etc. */
 
 void binbuf_restore(t_binbuf *x, int argc, const t_atom *argv)
 {
+    binbuf_touch(x);
     int previoussize = x->b_n;
     int newsize = previoussize + argc, i;
     t_atom *ap;
@@ -432,6 +884,7 @@ void binbuf_restore(t_binbuf *x, int argc, const t_atom *argv)
 void binbuf_print(const t_binbuf *x)
 {
     int i, startedpost = 0, newline = 1;
+    binbuf_touch(x);
     for (i = 0; i < x->b_n; i++)
     {
         if (newline)
@@ -450,21 +903,99 @@ void binbuf_print(const t_binbuf *x)
 
 int binbuf_getnatom(const t_binbuf *x)
 {
+    binbuf_touch(x);
     return (x->b_n);
 }
 
 t_atom *binbuf_getvec(const t_binbuf *x)
 {
+    binbuf_touch(x);
     return (x->b_vec);
 }
 
+    /* growing at least doubles the room, so that adding atoms one or a
+    few at a time doesn't reallocate each time; shrinking gives back the
+    room only once less than half of it is used */
 int binbuf_resize(t_binbuf *x, int newsize)
 {
-    t_atom *new = t_resizebytes(x->b_vec,
-        x->b_n * sizeof(*x->b_vec), newsize * sizeof(*x->b_vec));
-    if (new)
-        x->b_vec = new, x->b_n = newsize;
-    return (new != 0);
+    int size, ok = 1;
+    binbuf_touch(x);
+    size = x->b_size;
+    if (newsize > size)
+        size = (sys_lowmem || newsize > 2 * size ? newsize : 2 * size);
+    else if (newsize < x->b_n && (sys_lowmem || newsize <= size / 2))
+        size = newsize;
+    if (size != x->b_size)
+    {
+        int kind = mem_setkind(MEM_MESSAGE);
+        ok = binbuf_realloc(x, size);
+        mem_setkind(kind);
+    }
+    if (ok)
+        x->b_n = newsize;
+    binbuf_invalidatelines(x);
+    binbuf_modified(x);
+    return (ok);
+}
+
+void binbuf_invalidatelines(t_binbuf *x)
+{
+    if (x->b_lines)
+        x->b_lines->li_valid = 0;
+}
+
+static void binbuf_makelines(t_binbuf *x)
+{
+    t_lineindex *li = x->b_lines;
+    int i, nlines = 0, kind = mem_setkind(MEM_MESSAGE);
+    if (!li)
+        li = x->b_lines = (t_lineindex *)t_getbytes(sizeof(*li));
+    for (i = 0; i < x->b_n; i++)
+        if (x->b_vec[i].a_type == A_SEMI || x->b_vec[i].a_type == A_COMMA)
+            nlines++;
+    nlines++;
+    if (nlines > li->li_size)
+    {
+        li->li_onset = (int *)t_resizebytes(li->li_onset,
+            li->li_size * sizeof(*li->li_onset),
+                nlines * sizeof(*li->li_onset));
+        li->li_size = nlines;
+    }
+    mem_setkind(kind);
+        /* a line starts at the beginning and after every separator
+        except a final one */
+    li->li_n = 0;
+    if (x->b_n)
+        li->li_onset[li->li_n++] = 0;
+    for (i = 0; i < x->b_n - 1; i++)
+        if (x->b_vec[i].a_type == A_SEMI || x->b_vec[i].a_type == A_COMMA)
+            li->li_onset[li->li_n++] = i + 1;
+    if (li->li_n)
+    {
+        for (i = li->li_onset[li->li_n - 1]; i < x->b_n &&
+            x->b_vec[i].a_type != A_SEMI && x->b_vec[i].a_type != A_COMMA;
+                i++)
+                    ;
+        li->li_lastend = i;
+    }
+    li->li_valid = 1;
+}
+
+    /* find the nth line, returning its onset and the index of the separator
+    that ends it (or the number of atoms if there is none).  Returns zero if
+    there are fewer than n+1 lines. */
+int binbuf_nthline(t_binbuf *x, int n, int *startp, int *endp)
+{
+    t_lineindex *li;
+    binbuf_touch(x);
+    li = x->b_lines;
+    if (!li || !li->li_valid)
+        binbuf_makelines(x), li = x->b_lines;
+    if (n < 0 || n >= li->li_n)
+        return (0);
+    *startp = li->li_onset[n];
+    *endp = (n < li->li_n - 1 ? li->li_onset[n+1] - 1 : li->li_lastend);
+    return (1);
 }
 
 int canvas_getdollarzero(void);
@@ -585,6 +1116,50 @@ done:
     return (gensym(buf2));
 }
 
+    /* true if every '$' in the symbol's name is a "$0" */
+static int binbuf_onlydollarzero(t_symbol *s)
+{
+    const char *str = s->s_name;
+    while ((str = strchr(str, '$')))
+    {
+        if (str[1] != '0' || (str[2] >= '0' && str[2] <= '9'))
+            return (0);
+        str += 2;
+    }
+    return (1);
+}
+
+    /* binbuf_realizedollsym() for binbuf_eval(), using the cache */
+static t_symbol *binbuf_evaldollsym(const t_binbuf *x, t_symbol *s,
+    int argc, const t_atom *argv, int tonew)
+{
+    t_dollcache *dc;
+    t_float dollarzero;
+    t_symbol *result;
+    if (!x->b_dollcache)
+    {
+        if (!binbuf_onlydollarzero(s))
+            return (binbuf_realizedollsym(s, argc, argv, tonew));
+            /* the cache isn't part of the binbuf's contents */
+        int kind = mem_setkind(MEM_MESSAGE);
+        ((t_binbuf *)x)->b_dollcache = (t_dollcache *)t_getbytes(
+            DOLLCACHESIZE * sizeof(*x->b_dollcache));
+        mem_setkind(kind);
+    }
+    dc = &x->b_dollcache[((size_t)s >> 3) & (DOLLCACHESIZE-1)];
+    dollarzero = canvas_getdollarzero();
+    if (dc->dc_sym == s && dc->dc_dollarzero == dollarzero)
+        return (dc->dc_result);
+    result = binbuf_realizedollsym(s, argc, argv, tonew);
+    if (result && binbuf_onlydollarzero(s))
+    {
+        dc->dc_sym = s;
+        dc->dc_dollarzero = dollarzero;
+        dc->dc_result = result;
+    }
+    return (result);
+}
+
 #define SMALLMSG 5
 #define HUGEMSG 1000
 
@@ -614,7 +1189,7 @@ done:
 void binbuf_eval(const t_binbuf *x, t_pd *target, int argc, const t_atom *argv)
 {
     t_atom smallstack[SMALLMSG], *mstack, *msp;
-    const t_atom *at = x->b_vec;
+    const t_atom *at = (binbuf_touch(x), x->b_vec);
     int ac = x->b_n;
     int nargs, maxnargs = 0;
     t_pd *initial_target = target;
@@ -688,7 +1263,7 @@ void binbuf_eval(const t_binbuf *x, t_pd *target, int argc, const t_atom *argv)
             }
             else if (at->a_type == A_DOLLSYM)
             {
-                if (!(s = binbuf_realizedollsym(at->a_w.w_symbol,
+                if (!(s = binbuf_evaldollsym(x, at->a_w.w_symbol,
                     argc, argv, 0)))
                 {
                     pd_error(initial_target, "$%s: not enough arguments supplied",
@@ -763,7 +1338,7 @@ void binbuf_eval(const t_binbuf *x, t_pd *target, int argc, const t_atom *argv)
                 }
                 break;
             case A_DOLLSYM:
-                s9 = binbuf_realizedollsym(at->a_w.w_symbol, argc, argv,
+                s9 = binbuf_evaldollsym(x, at->a_w.w_symbol, argc, argv,
                     target == &pd_objectmaker);
                 if (!s9)
                 {
@@ -907,34 +1482,54 @@ int binbuf_read_via_path(t_binbuf *b, const char *filename, const char *dirname,
 #define WBUFSIZE 4096
 static t_binbuf *binbuf_convert(const t_binbuf *oldb, int maxtopd);
 
-    /* write a binbuf to a text file.  If "crflag" is set we suppress
-    semicolons. */
-int binbuf_write(const t_binbuf *x, const char *filename, const char *dir, int crflag)
+static void binbuf_dropfilecache(const char *path);
+
+    /* A binbuf writer writes the text of one or more binbufs in succession
+    to a file, as if they were one, so that a big one (like a patch being
+    saved) can be written a piece at a time without ever being built whole.
+    If "crflag" is set we suppress semicolons. */
+struct _binbufwriter
 {
-    FILE *f = 0;
-    char sbuf[WBUFSIZE], fbuf[MAXPDSTRING], *bp = sbuf, *ep = sbuf + WBUFSIZE;
-    t_atom *ap;
-    t_binbuf *y = 0;
-    const t_binbuf *z = x;
-    int indx;
-    int ncolumn = 0;
+    FILE *w_file;
+    int w_crflag;
+    int w_ncolumn;
+    int w_error;
+    char *w_bp;             /* end of text not yet written */
+    char w_buf[WBUFSIZE];
+};
 
+t_binbufwriter *binbuf_writer_new(const char *filename, const char *dir,
+    int crflag)
+{
+    t_binbufwriter *w;
+    FILE *f;
+    char fbuf[MAXPDSTRING];
     if (*dir)
         snprintf(fbuf, MAXPDSTRING-1, "%s/%s", dir, filename);
     else
         snprintf(fbuf, MAXPDSTRING-1, "%s", filename);
     fbuf[MAXPDSTRING-1] = 0;
-
-    if (!strcmp(filename + strlen(filename) - 4, ".pat") ||
-        !strcmp(filename + strlen(filename) - 4, ".mxt"))
-    {
-        y = binbuf_convert(x, 0);
-        z = y;
-    }
-
+    binbuf_dropfilecache(fbuf);
     if (!(f = sys_fopen(fbuf, "w")))
-        goto fail;
-    for (ap = z->b_vec, indx = z->b_n; indx--; ap++)
+        return (0);
+    w = (t_binbufwriter *)getbytes(sizeof(*w));
+    w->w_file = f;
+    w->w_crflag = crflag;
+    w->w_ncolumn = 0;
+    w->w_error = 0;
+    w->w_bp = w->w_buf;
+    return (w);
+}
+
+static void binbuf_writer_doadd(t_binbufwriter *w, const t_binbuf *x)
+{
+    char *bp = w->w_bp, *ep = w->w_buf + WBUFSIZE;
+    t_atom *ap;
+    int indx;
+    binbuf_touch(x);
+    if (w->w_error)
+        return;
+    for (ap = x->b_vec, indx = x->b_n; indx--; ap++)
     {
         int length;
             /* estimate how many characters will be needed.  Printing out
@@ -944,46 +1539,79 @@ int binbuf_write(const t_binbuf *x, const char *filename, const char *dir, int c
         else length = 40;
         if (ep - bp < length)
         {
-            if (fwrite(sbuf, bp-sbuf, 1, f) < 1)
-                goto fail;
-            bp = sbuf;
+            if (fwrite(w->w_buf, bp - w->w_buf, 1, w->w_file) < 1)
+            {
+                w->w_error = 1;
+                return;
+            }
+            bp = w->w_buf;
         }
         if ((ap->a_type == A_SEMI || ap->a_type == A_COMMA) &&
-            bp > sbuf && bp[-1] == ' ') bp--;
-        if (!crflag || ap->a_type != A_SEMI)
+            bp > w->w_buf && bp[-1] == ' ') bp--;
+        if (!w->w_crflag || ap->a_type != A_SEMI)
         {
             atom_string(ap, bp, (unsigned int)((ep-bp)-2));
             length = (int)strlen(bp);
             bp += length;
-            ncolumn += length;
+            w->w_ncolumn += length;
         }
-        if (ap->a_type == A_SEMI || (!crflag && ncolumn > 65))
+        if (ap->a_type == A_SEMI || (!w->w_crflag && w->w_ncolumn > 65))
         {
             *bp++ = '\n';
-            ncolumn = 0;
+            w->w_ncolumn = 0;
         }
         else
         {
             *bp++ = ' ';
-            ncolumn++;
+            w->w_ncolumn++;
         }
     }
-    if (fwrite(sbuf, bp-sbuf, 1, f) < 1)
-        goto fail;
+    w->w_bp = bp;
+}
 
-    if (fflush(f) != 0)
-        goto fail;
+    /* write out the contents of a binbuf and empty it */
+void binbuf_writer_add(t_binbufwriter *w, t_binbuf *x)
+{
+    binbuf_writer_doadd(w, x);
+    binbuf_clear(x);
+}
 
+    /* finish writing and close the file; returns nonzero on error */
+int binbuf_writer_free(t_binbufwriter *w)
+{
+    int error = w->w_error;
+    if (!error && (fwrite(w->w_buf, w->w_bp - w->w_buf, 1, w->w_file) < 1 ||
+        fflush(w->w_file) != 0))
+            error = 1;
+    fclose(w->w_file);
+    freebytes(w, sizeof(*w));
+    return (error);
+}
+
+    /* write a binbuf to a text file.  If "crflag" is set we suppress
+    semicolons. */
+int binbuf_write(const t_binbuf *x, const char *filename, const char *dir, int crflag)
+{
+    t_binbuf *y = 0;
+    const t_binbuf *z = x;
+    t_binbufwriter *w;
+    int fail;
+
+    if (!strcmp(filename + strlen(filename) - 4, ".pat") ||
+        !strcmp(filename + strlen(filename) - 4, ".mxt"))
+    {
+        y = binbuf_convert(x, 0);
+        z = y;
+    }
+    if ((w = binbuf_writer_new(filename, dir, crflag)))
+    {
+        binbuf_writer_doadd(w, z);
+        fail = binbuf_writer_free(w);
+    }
+    else fail = 1;
     if (y)
         binbuf_free(y);
-    fclose(f);
-    return (0);
-fail:
-    if (y)
-        binbuf_free(y);
-    if (f)
-        fclose(f);
-    return (1);
+    return (fail);
 }
 
 /* The following routine attempts to convert from max to pd or back.  The
@@ -999,7 +1627,7 @@ from Pd to Max hasn't been tested for patches with subpatches yet!  */
 static t_binbuf *binbuf_convert(const t_binbuf *oldb, int maxtopd)
 {
     t_binbuf *newb = binbuf_new();
-    t_atom *vec = oldb->b_vec;
+    t_atom *vec = (binbuf_touch(oldb), oldb->b_vec);
     t_int n = oldb->b_n, nextindex, stackdepth = 0, stack[MAXSTACK] = {0},
         nobj = 0, gotfontsize = 0;
 	int i;
@@ -1468,40 +2096,350 @@ static t_binbuf *binbuf_convert(const t_binbuf *oldb, int maxtopd)
     return (newb);
 }
 
+/* Cache of parsed patch files.  An abstraction is read from disk and
+tokenized each time it is instantiated, which dominates the loading time of
+patches using many copies of the same abstractions.  The first time an
+abstraction, or the second time any other file is evaluated, we keep a copy
+of its contents, and use it as long as the file's modification time and size
+don't change (saving a file from Pd also drops its entry.)  The cache is per
+Pd instance since symbols are. */
+
+typedef struct _filecache
+{
+    t_symbol *fc_path;
+    time_t fc_mtime;
+    long fc_size;
+    int fc_nread;               /* times read since it last changed */
+    t_binbuf *fc_binbuf;        /* zero till file is evaluated twice */
+    struct _filecache *fc_next;
+} t_filecache;
+
+#define FILECACHE (STUFF->st_filecache)
+
+static t_filecache *binbuf_getfilecache(const char *path, struct stat *sb)
+{
+    t_filecache *fc;
+    t_symbol *s = gensym(path);
+    for (fc = FILECACHE; fc; fc = fc->fc_next)
+        if (fc->fc_path == s)
+            break;
+    if (!fc)
+    {
+        fc = (t_filecache *)getbytes(sizeof(*fc));
+        fc->fc_path = s;
+        fc->fc_next = FILECACHE;
+        FILECACHE = fc;
+    }
+    else if (fc->fc_mtime != sb->st_mtime ||
+        fc->fc_size != (long)sb->st_size)
+    {
+        if (fc->fc_binbuf)
+            binbuf_free(fc->fc_binbuf);
+        fc->fc_binbuf = 0;
+        fc->fc_nread = 0;
+    }
+    fc->fc_mtime = sb->st_mtime;
+    fc->fc_size = (long)sb->st_size;
+    return (fc);
+}
+
+static void binbuf_dropfilecache(const char *path)
+{
+    t_filecache *fc;
+    t_symbol *s = gensym(path);
+    for (fc = FILECACHE; fc; fc = fc->fc_next)
+        if (fc->fc_path == s)
+    {
+        if (fc->fc_binbuf)
+            binbuf_free(fc->fc_binbuf);
+        fc->fc_binbuf = 0;
+        fc->fc_nread = 0;
+    }
+}
+
+/* "pd preload <name> <dir>" reads a patch file in a thread of its own, so
+that opening it later with "pd open" (or making an abstraction from it)
+doesn't wait for the disk in the scheduler's thread -- to get the next
+scene of a show ready while the current one plays, for instance.  The
+contents are used, as they were when read, the first time the file is read
+after the thread is done; if that's sooner the file is read as usual. */
+
+typedef struct _preload
+{
+    char p_path[MAXPDSTRING];
+    char *p_buf;            /* file contents, or 0 if they couldn't be read */
+    long p_size;
+    struct stat p_stat;
+    int p_done;             /* set by the thread when finished */
+    pthread_t p_thread;
+    struct _preload *p_next;
+} t_preload;
+
+#define PRELOADS (STUFF->st_preloads)
+
+static pthread_mutex_t preload_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void *preload_thread(void *z)
+{
+    t_preload *x = (t_preload *)z;
+    char *buf = 0;
+    long size = 0;
+    int fd;
+    if ((fd = sys_open(x->p_path, 0)) >= 0)
+    {
+        if (!fstat(fd, &x->p_stat) && (size = (long)x->p_stat.st_size) > 0)
+        {
+            buf = (char *)getbytes(size);
+            if (read(fd, buf, size) < size)
+            {
+                freebytes(buf, size);
+                buf = 0;
+            }
+        }
+        close(fd);
+    }
+    pthread_mutex_lock(&preload_mutex);
+    x->p_buf = buf;
+    x->p_size = size;
+    x->p_done = 1;
+    pthread_mutex_unlock(&preload_mutex);
+    return (0);
+}
+
+static void preload_free(t_preload *x)
+{
+    pthread_join(x->p_thread, 0);
+    if (x->p_buf)
+        freebytes(x->p_buf, x->p_size);
+    freebytes(x, sizeof(*x));
+}
+
+void glob_preload(void *dummy, t_symbol *name, t_symbol *dir)
+{
+    t_preload *x;
+    char path[MAXPDSTRING];
+    if (*dir->s_name)
+        snprintf(path, MAXPDSTRING-1, "%s/%s", dir->s_name, name->s_name);
+    else snprintf(path, MAXPDSTRING-1, "%s", name->s_name);
+    path[MAXPDSTRING-1] = 0;
+    for (x = PRELOADS; x; x = x->p_next)
+        if (!strcmp(x->p_path, path))
+            return;
+    x = (t_preload *)getbytes(sizeof(*x));
+    strcpy(x->p_path, path);
+    if (pthread_create(&x->p_thread, 0, preload_thread, x))
+    {
+        pd_error(0, "preload %s: couldn't start thread", path);
+        freebytes(x, sizeof(*x));
+        return;
+    }
+    x->p_next = PRELOADS;
+    PRELOADS = x;
+}
+
+    /* take a file's preloaded contents off the list if they're ready */
+static t_preload *binbuf_takepreload(const char *path)
+{
+    t_preload *x, **xp;
+    int done;
+    for (xp = &PRELOADS; (x = *xp); xp = &x->p_next)
+        if (!strcmp(x->p_path, path))
+    {
+        pthread_mutex_lock(&preload_mutex);
+        done = x->p_done;
+        pthread_mutex_unlock(&preload_mutex);
+        if (!done)
+            return (0);
+        *xp = x->p_next;
+        return (x);
+    }
+    return (0);
+}
+
+static void binbuf_markfilecache(void (*fn)(const void *w))
+{
+    t_filecache *fc;
+    for (fc = FILECACHE; fc; fc = fc->fc_next)
+        (*fn)(fc->fc_path);
+}
+
+void binbuf_freefilecache(void)
+{
+    t_filecache *fc;
+    t_preload *x;
+    while ((fc = FILECACHE))
+    {
+        FILECACHE = fc->fc_next;
+        if (fc->fc_binbuf)
+            binbuf_free(fc->fc_binbuf);
+        freebytes(fc, sizeof(*fc));
+    }
+    while ((x = PRELOADS))
+    {
+        PRELOADS = x->p_next;
+        preload_free(x);
+    }
+}
+
+    /* replace the symbols in a binbuf with the ones of the same names in the
+    current Pd instance, for a binbuf that came from another instance */
+void binbuf_gensyms(t_binbuf *x)
+{
+    int i;
+    binbuf_touch(x);
+    for (i = 0; i < x->b_n; i++)
+        if (x->b_vec[i].a_type == A_SYMBOL || x->b_vec[i].a_type == A_DOLLSYM)
+            x->b_vec[i].a_w.w_symbol =
+                gensym(x->b_vec[i].a_w.w_symbol->s_name);
+    binbuf_modified(x);
+}
+
+#ifdef PDINSTANCE
+    /* copy the patches another instance has cached into this one's cache,
+    so that a copy of an instance doesn't have to read them again */
+void binbuf_copyfilecache(t_pdinstance *from)
+{
+    t_filecache *fc, *fc2;
+    for (fc = from->pd_stuff->st_filecache; fc; fc = fc->fc_next)
+    {
+        t_symbol *s;
+        if (!fc->fc_binbuf)
+            continue;
+        s = gensym(fc->fc_path->s_name);
+        for (fc2 = FILECACHE; fc2; fc2 = fc2->fc_next)
+            if (fc2->fc_path == s)
+                break;
+        if (fc2)
+            continue;
+        fc2 = (t_filecache *)getbytes(sizeof(*fc2));
+        fc2->fc_path = s;
+        fc2->fc_mtime = fc->fc_mtime;
+        fc2->fc_size = fc->fc_size;
+        fc2->fc_nread = fc->fc_nread;
+        fc2->fc_binbuf = binbuf_duplicate(fc->fc_binbuf);
+        binbuf_gensyms(fc2->fc_binbuf);
+        fc2->fc_next = FILECACHE;
+        FILECACHE = fc2;
+    }
+}
+#endif /* PDINSTANCE */
+
+    /* read a patch file, using the cache if possible.  Abstractions are
+    cached from their first reading on ("cachenow" is set.) */
+static int binbuf_readpatch(t_binbuf *b, const char *filename,
+    const char *dirname, int cachenow)
+{
+    char namebuf[MAXPDSTRING];
+    struct stat sb;
+    t_filecache *fc;
+    t_preload *pl;
+    if (*dirname)
+        snprintf(namebuf, MAXPDSTRING-1, "%s/%s", dirname, filename);
+    else
+        snprintf(namebuf, MAXPDSTRING-1, "%s", filename);
+    namebuf[MAXPDSTRING-1] = 0;
+    if ((pl = binbuf_takepreload(namebuf)) && pl->p_buf)
+    {
+        fc = binbuf_getfilecache(namebuf, &pl->p_stat);
+        binbuf_text(b, pl->p_buf, pl->p_size);
+        preload_free(pl);
+        if (!fc->fc_binbuf && (fc->fc_nread++ || cachenow))
+            fc->fc_binbuf = binbuf_duplicate(b);
+        return (0);
+    }
+    else if (pl)
+        preload_free(pl);
+    if (stat(namebuf, &sb) < 0)
+        return (binbuf_read(b, filename, dirname, 0));
+    fc = binbuf_getfilecache(namebuf, &sb);
+    if (fc->fc_binbuf)
+    {
+        binbuf_clear(b);
+        binbuf_add(b, fc->fc_binbuf->b_n, fc->fc_binbuf->b_vec);
+        return (0);
+    }
+    if (binbuf_read(b, filename, dirname, 0))
+        return (1);
+        /* otherwise, the first time we only take note of the file */
+    if (fc->fc_nread++ || cachenow)
+        fc->fc_binbuf = binbuf_duplicate(b);
+    return (0);
+}
+
 /* LATER make this evaluate the file on-the-fly. */
 /* LATER figure out how to log errors */
-void binbuf_evalfile(t_symbol *name, t_symbol *dir)
+    /* evaluate a patch that's already in a binbuf as if it were being read
+    from file "name" in directory "dir" */
+void binbuf_evalpatch(t_binbuf *b, t_symbol *name, t_symbol *dir)
 {
-    t_binbuf *b = binbuf_new();
-    int import = !strcmp(name->s_name + strlen(name->s_name) - 4, ".pat") ||
-        !strcmp(name->s_name + strlen(name->s_name) - 4, ".mxt");
+        /* save bindings of symbols #N, #A (and restore afterward) */
+    t_pd *bounda = gensym("#A")->s_thing, *boundn = s__N.s_thing;
     int dspstate = canvas_suspend_dsp();
         /* set filename so that new canvases can pick them up */
     glob_setfilename(0, name, dir);
-    if (binbuf_read(b, name->s_name, dir->s_name, 0))
+    gensym("#A")->s_thing = 0;
+    s__N.s_thing = &pd_canvasmaker;
+    binbuf_eval(b, 0, 0, 0);
+        /* avoid crashing if no canvas was created by binbuf eval */
+    if (s__X.s_thing && *s__X.s_thing == canvas_class)
+        canvas_initbang((t_canvas *)(s__X.s_thing)); /* JMZ*/
+    gensym("#A")->s_thing = bounda;
+    s__N.s_thing = boundn;
+    glob_setfilename(0, &s_, &s_);
+    canvas_resume_dsp(dspstate);
+}
+
+    /* read a patch file to evaluate, converting it if it's a Max patch.
+    Returns 0 if it can't be read. */
+static t_binbuf *binbuf_readforeval(t_symbol *name, t_symbol *dir,
+    int abstraction)
+{
+    t_binbuf *b = binbuf_new();
+    int import = !strcmp(name->s_name + strlen(name->s_name) - 4, ".pat") ||
+        !strcmp(name->s_name + strlen(name->s_name) - 4, ".mxt");
+    if (binbuf_readpatch(b, name->s_name, dir->s_name, abstraction))
+    {
+        binbuf_free(b);
+        return (0);
+    }
+    if (import)
+    {
+        t_binbuf *newb = binbuf_convert(b, 1);
+        binbuf_free(b);
+        b = newb;
+    }
+    return (b);
+}
+
+static void binbuf_doevalfile(t_symbol *name, t_symbol *dir, int abstraction)
+{
+    t_binbuf *b = binbuf_readforeval(name, dir, abstraction);
+    if (!b)
         pd_error(0, "%s: read failed; %s", name->s_name, strerror(errno));
     else
     {
-            /* save bindings of symbols #N, #A (and restore afterward) */
-        t_pd *bounda = gensym("#A")->s_thing, *boundn = s__N.s_thing;
-        gensym("#A")->s_thing = 0;
-        s__N.s_thing = &pd_canvasmaker;
-        if (import)
-        {
-            t_binbuf *newb = binbuf_convert(b, 1);
-            binbuf_free(b);
-            b = newb;
-        }
-        binbuf_eval(b, 0, 0, 0);
-            /* avoid crashing if no canvas was created by binbuf eval */
-        if (s__X.s_thing && *s__X.s_thing == canvas_class)
-            canvas_initbang((t_canvas *)(s__X.s_thing)); /* JMZ*/
-        gensym("#A")->s_thing = bounda;
-        s__N.s_thing = boundn;
+        binbuf_evalpatch(b, name, dir);
+        binbuf_free(b);
     }
-    glob_setfilename(0, &s_, &s_);
-    binbuf_free(b);
-    canvas_resume_dsp(dspstate);
+}
+
+void binbuf_evalfile(t_symbol *name, t_symbol *dir)
+{
+    binbuf_doevalfile(name, dir, 0);
+}
+
+    /* same for an abstraction, whose contents are likely to be needed
+    again for other copies (in "clone" for instance.) */
+void binbuf_evalabstraction(t_symbol *name, t_symbol *dir)
+{
+    binbuf_doevalfile(name, dir, 1);
+}
+
+    /* read an abstraction once to make many copies of it with
+    sys_makeabstraction(), as clone does.  Returns 0 on failure. */
+t_binbuf *binbuf_readabstraction(t_symbol *name, t_symbol *dir)
+{
+    return (binbuf_readforeval(name, dir, 1));
 }
 
     /* save a text object to a binbuf for a file or copy buf */
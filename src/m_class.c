@@ -30,9 +30,9 @@ t_pd pd_objectmaker;    /* factory for creating "object" boxes */
 t_pd pd_canvasmaker;    /* factory for creating canvases */
 
 static t_symbol *class_extern_dir;
+static t_class *class_list = 0;     /* all classes, newest first */
 
 #ifdef PDINSTANCE
-static t_class *class_list = 0;
 PERTHREAD t_pdinstance *pd_this = NULL;
 t_pdinstance **pd_instances;
 int pd_ninstances;
@@ -53,6 +53,22 @@ void g_canvas_freepdinstance( void);
 void d_ugen_newpdinstance( void);
 void d_ugen_freepdinstance( void);
 void new_anything(void *dummy, t_symbol *s, int argc, t_atom *argv);
+void binbuf_freefilecache(void);
+void binbuf_freepool(void);
+void sys_freepathcache(void);
+void pd_freefindcache(void);
+
+    /* symbols that might be freed ("-symgc"; see symgc_add() below) */
+typedef struct _symgc
+{
+    t_symbol **g_vec;       /* symbols that might be freed */
+    int g_n;
+    int g_size;
+    t_clock *g_clock;       /* to collect at top level, not from a message */
+} t_symgc;
+
+static void symgc_add(t_instancestuff *stuff, t_symbol *s);
+static void symgc_free(void);
 
 void s_stuff_newpdinstance(void)
 {
@@ -63,23 +79,45 @@ void s_stuff_newpdinstance(void)
     STUFF->st_dacsr = DEFDACSAMPLERATE;
     STUFF->st_printhook = sys_printhook;
     STUFF->st_impdata = NULL;
+    STUFF->st_clockheap = 0;
+    STUFF->st_nclocks = STUFF->st_clockheapsize = 0;
+    STUFF->st_clockserial = 0;
+    STUFF->st_filecache = 0;
+    STUFF->st_preloads = 0;
+    STUFF->st_pathcache = 0;
+    STUFF->st_tickcount = 0;
+    STUFF->st_findcache = 0;
+    STUFF->st_symgc = 0;
+    STUFF->st_binbufpool = 0;
+    STUFF->st_nbinbufpool = 0;
 }
 
 void s_stuff_freepdinstance(void)
 {
+    binbuf_freefilecache();
+    sys_freepathcache();
+    pd_freefindcache();
+    symgc_free();
+    if (STUFF->st_clockheap)
+        freebytes(STUFF->st_clockheap,
+            STUFF->st_clockheapsize * sizeof(*STUFF->st_clockheap));
+    binbuf_freepool();
     freebytes(STUFF, sizeof(*STUFF));
+    STUFF = 0;
 }
 
 static t_pdinstance *pdinstance_init(t_pdinstance *x)
 {
-    int i;
+    int i, symhashsize = (sys_lowmem ? SYMTABLOWMEMSIZE : SYMTABHASHSIZE);
     x->pd_systime = 0;
     x->pd_clock_setlist = 0;
     x->pd_canvaslist = 0;
     x->pd_templatelist = 0;
-    x->pd_symhash = getbytes(SYMTABHASHSIZE * sizeof(*x->pd_symhash));
-    for (i = 0; i < SYMTABHASHSIZE; i++)
+    x->pd_symhash = getbytes(symhashsize * sizeof(*x->pd_symhash));
+    for (i = 0; i < symhashsize; i++)
         x->pd_symhash[i] = 0;
+    x->pd_symhashsize = symhashsize;
+    x->pd_nsym = 0;
 #ifdef PDINSTANCE
     dogensym("pointer",   &x->pd_s_pointer,  x);
     dogensym("float",     &x->pd_s_float,    x);
@@ -115,11 +153,85 @@ static t_pdinstance *pdinstance_init(t_pdinstance *x)
     return (x);
 }
 
-static void class_addmethodtolist(t_class *c, t_methodentry **methodlist,
-    int nmethod, t_gotfn fn, t_symbol *sel, unsigned char *args,
-        t_pdinstance *pdinstance)
+/* Selector lookup.  Method lists are searched linearly, except that once a
+list has METHODHASHMIN methods (as any GUI class and, with all its classes,
+pd_objectmaker do) we also keep an open-addressed hash table, at most half
+full, mapping each selector to its index in the list.  Selectors are unique
+within a list since older methods get renamed (see below.)  The table is
+updated as methods are added so lookup never has to build it. */
+
+#define METHODHASHMIN 8
+#define METHODHASH(s, size) \
+    ((int)((((size_t)(s) >> 3) * 2654435761u) & ((size) - 1)))
+
+static void methodhash_free(t_methodhash *h)
+{
+    if (h->mh_size)
+        freebytes(h->mh_vec, h->mh_size * sizeof(*h->mh_vec));
+    h->mh_size = 0;
+    h->mh_vec = 0;
+}
+
+static void methodhash_insert(t_methodhash *h, t_methodentry *mlist,
+    int index)
+{
+    t_symbol *s = mlist[index].me_name;
+    int slot;
+    if (!s)
+        return;
+    for (slot = METHODHASH(s, h->mh_size); h->mh_vec[slot] >= 0;
+        slot = (slot + 1) & (h->mh_size - 1))
+            ;
+    h->mh_vec[slot] = index;
+}
+
+    /* (re)build the table for a list of nmethod methods */
+static void methodhash_build(t_methodhash *h, t_methodentry *mlist,
+    int nmethod)
+{
+    int i, size = 4 * METHODHASHMIN;
+    while (size < 4 * nmethod)
+        size *= 2;
+    methodhash_free(h);
+    h->mh_vec = (int *)getbytes(size * sizeof(*h->mh_vec));
+    h->mh_size = size;
+    for (i = 0; i < size; i++)
+        h->mh_vec[i] = -1;
+    for (i = 0; i < nmethod; i++)
+        methodhash_insert(h, mlist, i);
+}
+
+static t_methodentry *class_findmethod(const t_class *c, t_symbol *s)
 {
+    t_methodentry *m, *mlist;
+    const t_methodhash *h;
     int i;
+#ifdef PDINSTANCE
+    mlist = c->c_methods[pd_this->pd_instanceno];
+    h = &c->c_methodhash[pd_this->pd_instanceno];
+#else
+    mlist = c->c_methods;
+    h = &c->c_methodhash;
+#endif
+    if (h->mh_size)
+    {
+        for (i = METHODHASH(s, h->mh_size); h->mh_vec[i] >= 0;
+            i = (i + 1) & (h->mh_size - 1))
+                if (mlist[h->mh_vec[i]].me_name == s)
+                    return (&mlist[h->mh_vec[i]]);
+        return (0);
+    }
+    for (i = c->c_nmethod, m = mlist; i--; m++)
+        if (m->me_name == s)
+            return (m);
+    return (0);
+}
+
+static void class_addmethodtolist(t_class *c, t_methodentry **methodlist,
+    t_methodhash *hash, int nmethod, t_gotfn fn, t_symbol *sel,
+        unsigned char *args, t_pdinstance *pdinstance)
+{
+    int i, renamed = 0;
     t_methodentry *m;
     for (i = 0; i < nmethod; i++)
         if (sel && (*methodlist)[i].me_name == sel)
@@ -128,6 +240,7 @@ static void class_addmethodtolist(t_class *c, t_methodentry **methodlist,
         snprintf(nbuf, 80, "%s_aliased", sel->s_name);
         nbuf[79] = 0;
         (*methodlist)[i].me_name = dogensym(nbuf, 0, pdinstance);
+        renamed = 1;
         if (c == pd_objectmaker)
             logpost(NULL, PD_VERBOSE, "warning: class '%s' overwritten; old one renamed '%s'",
                 sel->s_name, nbuf);
@@ -141,6 +254,15 @@ static void class_addmethodtolist(t_class *c, t_methodentry **methodlist,
     m->me_name = sel;
     m->me_fun = (t_gotfn)fn;
     memcpy(m->me_arg, args, MAXPDARG+1);
+    nmethod++;
+        /* with "-lowmem" we do without the hash tables and search */
+    if (sys_lowmem && !hash->mh_size)
+        ;
+    else if (renamed ||
+        (nmethod >= METHODHASHMIN && 2 * nmethod > hash->mh_size))
+            methodhash_build(hash, *methodlist, nmethod);
+    else if (hash->mh_size)
+        methodhash_insert(hash, *methodlist, nmethod - 1);
 }
 
 #ifdef PDINSTANCE
@@ -179,8 +301,14 @@ EXTERN t_pdinstance *pdinstance_new(void)
             pd_ninstances * sizeof(*c->c_methods),
             (pd_ninstances + 1) * sizeof(*c->c_methods));
         c->c_methods[pd_ninstances] = t_getbytes(0);
+        c->c_methodhash = (t_methodhash *)t_resizebytes(c->c_methodhash,
+            pd_ninstances * sizeof(*c->c_methodhash),
+            (pd_ninstances + 1) * sizeof(*c->c_methodhash));
+        c->c_methodhash[pd_ninstances].mh_size = 0;
+        c->c_methodhash[pd_ninstances].mh_vec = 0;
         for (i = 0; i < c->c_nmethod; i++)
-            class_addmethodtolist(c, &c->c_methods[pd_ninstances], i,
+            class_addmethodtolist(c, &c->c_methods[pd_ninstances],
+                &c->c_methodhash[pd_ninstances], i,
                 c->c_methods[0][i].me_fun,
                 dogensym(c->c_methods[0][i].me_name->s_name, 0, x),
                     c->c_methods[0][i].me_arg, x);
@@ -224,8 +352,14 @@ EXTERN void pdinstance_free(t_pdinstance *x)
         c->c_methods = (t_methodentry **)t_resizebytes(c->c_methods,
             pd_ninstances * sizeof(*c->c_methods),
             (pd_ninstances - 1) * sizeof(*c->c_methods));
+        methodhash_free(&c->c_methodhash[instanceno]);
+        for (i = instanceno; i < pd_ninstances-1; i++)
+            c->c_methodhash[i] = c->c_methodhash[i+1];
+        c->c_methodhash = (t_methodhash *)t_resizebytes(c->c_methodhash,
+            pd_ninstances * sizeof(*c->c_methodhash),
+            (pd_ninstances - 1) * sizeof(*c->c_methodhash));
     }
-    for (i =0; i < SYMTABHASHSIZE; i++)
+    for (i =0; i < x->pd_symhashsize; i++)
     {
         while ((s = x->pd_symhash[i]))
         {
@@ -248,7 +382,7 @@ EXTERN void pdinstance_free(t_pdinstance *x)
             }
         }
     }
-    freebytes(x->pd_symhash, SYMTABHASHSIZE * sizeof (*x->pd_symhash));
+    freebytes(x->pd_symhash, x->pd_symhashsize * sizeof (*x->pd_symhash));
     x_midi_freepdinstance();
     g_canvas_freepdinstance();
     d_ugen_freepdinstance();
@@ -477,6 +611,10 @@ t_class *class_new(t_symbol *s, t_newmethod newmethod, t_method freemethod,
                     vec[0], vec[1], vec[2], vec[3], vec[4], vec[5]);
         }
     }
+        /* symbols made so far may be kept in static variables by this and
+        earlier setup routines, so they're never freed */
+    if (sys_symgc && pd_this && STUFF && STUFF->st_symgc)
+        STUFF->st_symgc->g_n = 0;
     c = (t_class *)t_getbytes(sizeof(*c));
     c->c_name = c->c_helpname = s;
     c->c_size = size;
@@ -494,6 +632,9 @@ t_class *class_new(t_symbol *s, t_newmethod newmethod, t_method freemethod,
     c->c_patchable = (typeflag == CLASS_PATCHABLE);
     c->c_gobj = (typeflag >= CLASS_GOBJ);
     c->c_drawcommand = 0;
+    c->c_scalarsignalin = 0;
+    c->c_multichannel = ((flags & CLASS_MULTICHANNEL) != 0);
+    c->c_blockratein = 0;
     c->c_floatsignalin = 0;
     c->c_externdir = class_extern_dir;
     c->c_savefn = (typeflag == CLASS_PATCHABLE ? text_save : class_nosavefn);
@@ -503,11 +644,15 @@ t_class *class_new(t_symbol *s, t_newmethod newmethod, t_method freemethod,
         pd_ninstances * sizeof(*c->c_methods));
     for (i = 0; i < pd_ninstances; i++)
         c->c_methods[i] = t_getbytes(0);
-    c->c_next = class_list;
-    class_list = c;
+    c->c_methodhash = (t_methodhash *)t_getbytes(
+        pd_ninstances * sizeof(*c->c_methodhash));
 #else
     c->c_methods = t_getbytes(0);
+    c->c_methodhash.mh_size = 0;
+    c->c_methodhash.mh_vec = 0;
 #endif
+    c->c_next = class_list;
+    class_list = c;
 #if 0       /* enable this if you want to see a list of all classes */
     post("class: %s", c->c_name->s_name);
 #endif
@@ -517,7 +662,6 @@ t_class *class_new(t_symbol *s, t_newmethod newmethod, t_method freemethod,
 void class_free(t_class *c)
 {
     int i;
-#ifdef PDINSTANCE
     t_class *prev;
     if (class_list == c)
         class_list = c->c_next;
@@ -528,7 +672,6 @@ void class_free(t_class *c)
           prev = prev->c_next;
         prev->c_next = c->c_next;
     }
-#endif
     if (c->c_classfreefn)
         c->c_classfreefn(c);
 #ifdef PDINSTANCE
@@ -537,10 +680,13 @@ void class_free(t_class *c)
         if(c->c_methods[i])
             freebytes(c->c_methods[i], c->c_nmethod * sizeof(*c->c_methods[i]));
         c->c_methods[i] = NULL;
+        methodhash_free(&c->c_methodhash[i]);
     }
     freebytes(c->c_methods, pd_ninstances * sizeof(*c->c_methods));
+    freebytes(c->c_methodhash, pd_ninstances * sizeof(*c->c_methodhash));
 #else
     freebytes(c->c_methods, c->c_nmethod * sizeof(*c->c_methods));
+    methodhash_free(&c->c_methodhash);
 #endif
     freebytes(c, sizeof(*c));
 }
@@ -653,12 +799,14 @@ void class_addmethod(t_class *c, t_method fn, t_symbol *sel,
 #ifdef PDINSTANCE
         for (i = 0; i < pd_ninstances; i++)
         {
-            class_addmethodtolist(c, &c->c_methods[i], c->c_nmethod,
+            class_addmethodtolist(c, &c->c_methods[i], &c->c_methodhash[i],
+                c->c_nmethod,
                 (t_gotfn)fn, sel?dogensym(sel->s_name, 0, pd_instances[i]):0,
                     argvec, pd_instances[i]);
         }
 #else
-        class_addmethodtolist(c, &c->c_methods, c->c_nmethod,
+        class_addmethodtolist(c, &c->c_methods, &c->c_methodhash,
+            c->c_nmethod,
             (t_gotfn)fn, sel, argvec, &pd_maininstance);
 #endif
         c->c_nmethod++;
@@ -762,6 +910,42 @@ void class_setdrawcommand(t_class *c)
     c->c_drawcommand = 1;
 }
 
+    /* declare that the class's "dsp" method looks at the s_scalar field of
+    its input signals.  Those of unconnected inlets then aren't filled in
+    with the inlet's float, and the method has to either use the float
+    directly or call dsp_add_scalarcopy() itself. */
+void class_setscalarsignalin(t_class *c)
+{
+    if(!c)
+        return;
+    c->c_scalarsignalin = 1;
+}
+
+    /* declare that the class's "dsp" method handles multichannel signals,
+    as does the CLASS_MULTICHANNEL flag to class_new().  Its signal outputs
+    are then made with as many channels as its widest input, which the
+    method can change with signal_setmultiout() -- so code written to call
+    that for every output, as Pd 0.54's API expects, works here too.  Other
+    classes get single-channel outputs (unless they call
+    signal_setmultiout()) and usually just use the first channel of their
+    inputs. */
+void class_setmultichannel(t_class *c)
+{
+    if(!c)
+        return;
+    c->c_multichannel = 1;
+}
+
+    /* declare that the class's "dsp" method handles block-rate signals (see
+    signal_setblockrate()) on all its signal inputs, either using their
+    t_blockrate directly or calling dsp_add_blockratefill() for them. */
+void class_setblockratein(t_class *c)
+{
+    if(!c)
+        return;
+    c->c_blockratein = 1;
+}
+
 int class_isdrawcommand(const t_class *c)
 {
     if(!c)
@@ -796,6 +980,7 @@ void class_domainsignalin(t_class *c, int onset)
 void class_set_extern_dir(t_symbol *s)
 {
     class_extern_dir = s;
+    mem_addsymbolroot(&class_extern_dir, sizeof(class_extern_dir));
 }
 
 const char *class_gethelpdir(const t_class *c)
@@ -840,27 +1025,62 @@ t_propertiesfn class_getpropertiesfn(const t_class *c)
 
 /* ---------------- the symbol table ------------------------ */
 
-static t_symbol *dogensym(const char *s, t_symbol *oldsym,
-    t_pdinstance *pdinstance)
+static unsigned int symhash(const char *s, int *lengthp)
 {
-    char *symname = 0;
-    t_symbol **symhashloc, *sym2;
     unsigned int hash = 5381;
     int length = 0;
-    const char *s2 = s;
-    while (*s2) /* djb2 hash algo */
+    while (*s) /* djb2 hash algo */
     {
-        hash = ((hash << 5) + hash) + *s2;
+        hash = ((hash << 5) + hash) + *s;
         length++;
-        s2++;
+        s++;
     }
-    symhashloc = pdinstance->pd_symhash + (hash & (SYMTABHASHSIZE-1));
+    if (lengthp)
+        *lengthp = length;
+    return (hash);
+}
+
+    /* the symbol table is doubled in size whenever it averages more than
+    two symbols per bucket, so that patches making many "$0-" names
+    don't slow down lookup. */
+static void symtab_grow(t_pdinstance *pdinstance)
+{
+    int i, oldsize = pdinstance->pd_symhashsize, newsize = 2 * oldsize;
+    t_symbol **newhash = (t_symbol **)getbytes(newsize * sizeof(*newhash));
+    for (i = 0; i < oldsize; i++)
+    {
+        t_symbol *sym = pdinstance->pd_symhash[i], *next;
+        for (; sym; sym = next)
+        {
+            t_symbol **loc = newhash +
+                (symhash(sym->s_name, 0) & (newsize - 1));
+            next = sym->s_next;
+            sym->s_next = *loc;
+            *loc = sym;
+        }
+    }
+    freebytes(pdinstance->pd_symhash, oldsize * sizeof(*newhash));
+    pdinstance->pd_symhash = newhash;
+    pdinstance->pd_symhashsize = newsize;
+}
+
+static t_symbol *dogensym(const char *s, t_symbol *oldsym,
+    t_pdinstance *pdinstance)
+{
+    char *symname = 0;
+    t_symbol **symhashloc, *sym2;
+    int length, kind = 0;
+    unsigned int hash = symhash(s, &length);
+    symhashloc = pdinstance->pd_symhash +
+        (hash & (pdinstance->pd_symhashsize-1));
     while ((sym2 = *symhashloc))
     {
         if (!strcmp(sym2->s_name, s))
             return(sym2);
         symhashloc = &sym2->s_next;
     }
+    if (sys_symgc)  /* symbols aren't looked through for references */
+        kind = mem_setkind(MEM_UNTRACKED);
     if (oldsym)
         sym2 = oldsym;
     else sym2 = (t_symbol *)t_getbytes(sizeof(*sym2));
@@ -870,6 +1090,14 @@ static t_symbol *dogensym(const char *s, t_symbol *oldsym,
     strcpy(symname, s);
     sym2->s_name = symname;
     *symhashloc = sym2;
+    if (sys_symgc)
+    {
+        if (!oldsym && pdinstance->pd_stuff)
+            symgc_add(pdinstance->pd_stuff, sym2);
+        mem_setkind(kind);
+    }
+    if (++pdinstance->pd_nsym > 2 * pdinstance->pd_symhashsize)
+        symtab_grow(pdinstance);
     return (sym2);
 }
 
@@ -878,6 +1106,213 @@ t_symbol *gensym(const char *s)
     return(dogensym(s, 0, pd_this));
 }
 
+    /* memory taken by this instance's symbol table, for "pd
+    memory-subsystems" */
+size_t mess_symbolbytes(int *nsym)
+{
+    size_t bytes = pd_this->pd_symhashsize * sizeof(*pd_this->pd_symhash);
+    int i;
+    t_symbol *s;
+    for (i = 0; i < pd_this->pd_symhashsize; i++)
+        for (s = pd_this->pd_symhash[i]; s; s = s->s_next)
+            bytes += sizeof(*s) + strlen(s->s_name) + 1;
+    *nsym = pd_this->pd_nsym;
+    return (bytes);
+}
+
+    /* ... and by classes and their methods */
+size_t mess_classbytes(int *nclass)
+{
+    size_t bytes = 0;
+    int n = 0;
+    t_class *c;
+    for (c = class_list; c; c = c->c_next, n++)
+    {
+#ifdef PDINSTANCE
+        t_methodhash *h = &c->c_methodhash[pd_this->pd_instanceno];
+#else
+        t_methodhash *h = &c->c_methodhash;
+#endif
+        bytes += sizeof(*c) + c->c_nmethod * sizeof(t_methodentry) +
+            h->mh_size * sizeof(*h->mh_vec);
+    }
+    *nclass = n;
+    return (bytes);
+}
+
+/* ------------------ freeing symbols ("-symgc" flag) -------------------- */
+
+/* Symbols are never freed, since anything might hold a pointer to one.  With
+"-symgc", those made since the last class was set up are listed, and "pd
+symbol-collect" frees the ones that aren't bound to anything and that
+mem_marksymbols() (m_memory.c) doesn't find in any block of memory it can
+reach from the patches, the binbufs and the classes.  That search is
+conservative: it looks at every word of every block from getbytes(), which
+is why the flag turns memory accounting on.  Memory that doesn't come from
+getbytes() isn't searched unless it's added with mem_addsymbolroot(), as
+static variables holding symbols are when they're set; code keeping
+symbols in other memory calls mess_keepsymbol() to make them permanent
+(as expr does.) */
+
+static void symgc_add(t_instancestuff *stuff, t_symbol *s)
+{
+    t_symgc *g = stuff->st_symgc;
+    if (!g)
+    {
+        g = stuff->st_symgc = (t_symgc *)t_getbytes(sizeof(*g));
+        g->g_n = 0;
+        g->g_size = 256;
+        g->g_vec = (t_symbol **)t_getbytes(g->g_size * sizeof(*g->g_vec));
+        g->g_clock = 0;
+    }
+    if (g->g_n == g->g_size)
+    {
+        g->g_vec = (t_symbol **)t_resizebytes(g->g_vec,
+            g->g_size * sizeof(*g->g_vec), 2 * g->g_size * sizeof(*g->g_vec));
+        g->g_size *= 2;
+    }
+    g->g_vec[g->g_n++] = s;
+}
+
+static void symgc_free(void)
+{
+    t_symgc *g = STUFF->st_symgc;
+    if (g)
+    {
+        if (g->g_clock)
+            clock_free(g->g_clock);
+        t_freebytes(g->g_vec, g->g_size * sizeof(*g->g_vec));
+        t_freebytes(g, sizeof(*g));
+        STUFF->st_symgc = 0;
+    }
+}
+
+    /* never free this symbol.  Recent symbols are likelier, so search
+    backward. */
+void mess_keepsymbol(t_symbol *s)
+{
+    t_symgc *g = (sys_symgc ? STUFF->st_symgc : 0);
+    int i;
+    if (g)
+        for (i = g->g_n; i--; )
+            if (g->g_vec[i] == s)
+    {
+        g->g_vec[i] = g->g_vec[--g->g_n];
+        return;
+    }
+}
+
+    /* call a function on each symbol held by a class */
+void class_marksymbols(void (*fn)(const void *w))
+{
+    t_class *c;
+    int i;
+    for (c = class_list; c; c = c->c_next)
+    {
+#ifdef PDINSTANCE
+        t_methodentry *m = c->c_methods[pd_this->pd_instanceno];
+#else
+        t_methodentry *m = c->c_methods;
+#endif
+        (*fn)(c->c_name);
+        (*fn)(c->c_helpname);
+        (*fn)(c->c_externdir);
+        for (i = 0; i < c->c_nmethod; i++)
+            (*fn)(m[i].me_name);
+    }
+}
+
+    /* free the symbols that might be and that aren't bound or "kept" */
+static int symgc_sweep(t_symgc *g, const char *keep)
+{
+    int i, j, nfreed = 0;
+    for (i = j = 0; i < g->g_n; i++)
+    {
+        t_symbol *s = g->g_vec[i], **sp;
+        if (keep[i] || s->s_thing)
+        {
+            g->g_vec[j++] = s;
+            continue;
+        }
+        for (sp = pd_this->pd_symhash + (symhash(s->s_name, 0) &
+            (pd_this->pd_symhashsize - 1)); *sp != s; sp = &(*sp)->s_next)
+                ;
+        *sp = s->s_next;
+        t_freebytes((char *)s->s_name, strlen(s->s_name) + 1);
+        t_freebytes(s, sizeof(*s));
+        pd_this->pd_nsym--;
+        nfreed++;
+    }
+    g->g_n = j;
+    return (nfreed);
+}
+
+static void symgc_collect(t_symgc *g)
+{
+    char *keep = (char *)getbytes(g->g_n ? g->g_n : 1);
+    int n = g->g_n, nfreed;
+    mem_marksymbols(g->g_vec, n, keep);
+    nfreed = symgc_sweep(g, keep);
+    freebytes(keep, n ? n : 1);
+    post("symbol-collect: freed %d of %d symbols (%d left)", nfreed, n,
+        pd_this->pd_nsym);
+}
+
+    /* "pd symbol-collect": in case it came from a patch, wait until nothing
+    is on the stack */
+void glob_symbolcollect(void *dummy)
+{
+    t_symgc *g = STUFF->st_symgc;
+    if (!sys_symgc)
+    {
+        pd_error(0, "symbol-collect: start Pd with -symgc to use this");
+        return;
+    }
+    if (!g)
+    {
+        post("symbol-collect: no new symbols");
+        return;
+    }
+    if (!g->g_clock)
+        g->g_clock = clock_new(g, (t_method)symgc_collect);
+    clock_delay(g->g_clock, 0);
+}
+
+    /* "pd symbol-stats" */
+void glob_symbolstats(void *dummy)
+{
+    int i, n, nbound = 0, longest = 0, nsym;
+    size_t bytes = mess_symbolbytes(&nsym);
+    t_symbol *s;
+    t_symgc *g = STUFF->st_symgc;
+    for (i = 0; i < pd_this->pd_symhashsize; i++)
+    {
+        for (s = pd_this->pd_symhash[i], n = 0; s; s = s->s_next, n++)
+            if (s->s_thing)
+                nbound++;
+        if (n > longest)
+            longest = n;
+    }
+    post("symbols: %d (%ld bytes), %d bound", nsym, (long)bytes, nbound);
+    post("hash table: %d buckets, longest chain %d",
+        pd_this->pd_symhashsize, longest);
+    if (!sys_symgc)
+        post("(start Pd with -symgc to free unused symbols)");
+    else if (g && g->g_n)
+    {
+        char *keep = (char *)getbytes(g->g_n);
+        int nkeep = 0;
+        n = g->g_n;
+        mem_marksymbols(g->g_vec, n, keep);
+        for (i = 0; i < n; i++)
+            if (keep[i] || g->g_vec[i]->s_thing)
+                nkeep++;
+        freebytes(keep, n);
+        post("collectable: %d new symbols, %d unused", n, n - nkeep);
+    }
+    else post("collectable: no new symbols");
+}
+
 static t_symbol *addfileextent(t_symbol *s)
 {
     char namebuf[MAXPDSTRING];
@@ -896,6 +1331,7 @@ void canvas_popabstraction(t_canvas *x);
 
 t_symbol* pathsearch(t_symbol *s,char* ext);
 int pd_setloadingabstraction(t_symbol *sym);
+int conf_lazysetup(t_symbol *s);
 
     /* this routine is called when a new "object" is requested whose class Pd
     doesn't know.  Pd tries to load it as an extern, then as an abstraction. */
@@ -912,7 +1348,14 @@ void new_anything(void *dummy, t_symbol *s, int argc, t_atom *argv)
       return;
     }
     pd_this->pd_newest = 0;
+        /* maybe it's a built-in whose setup was put off ("-lazyclasses") */
+    if (conf_lazysetup(s))
+    {
+        typedmess(dummy, s, argc, argv);
+        return;
+    }
     class_loadsym = s;
+    mem_addsymbolroot(&class_loadsym, sizeof(class_loadsym));
     pd_globallock();
     if (sys_load_lib(canvas_getcurrent(), s->s_name))
     {
@@ -952,13 +1395,27 @@ typedef t_pd *(*t_fun5)(t_int i1, t_int i2, t_int i3, t_int i4, t_int i5,
 typedef t_pd *(*t_fun6)(t_int i1, t_int i2, t_int i3, t_int i4, t_int i5, t_int i6,
     t_floatarg d1, t_floatarg d2, t_floatarg d3, t_floatarg d4, t_floatarg d5);
 
+static void pd_dotypedmess(t_pd *x, t_symbol *s, int argc, t_atom *argv);
+
+    /* when profiling messages, time those that come from outside (the GUI,
+    the network, and so on); messages from outlets are timed there */
 void pd_typedmess(t_pd *x, t_symbol *s, int argc, t_atom *argv)
+{
+    if (outlet_msgprofiling && !outlet_msgprofiledepth())
+    {
+        outlet_msgprofilebegin(x);
+        pd_dotypedmess(x, s, argc, argv);
+        outlet_msgprofileend();
+    }
+    else pd_dotypedmess(x, s, argc, argv);
+}
+
+static void pd_dotypedmess(t_pd *x, t_symbol *s, int argc, t_atom *argv)
 {
     t_method *f;
     t_class *c = *x;
-    t_methodentry *m, *mlist;
+    t_methodentry *m;
     unsigned char *wp, wanttype;
-    int i;
     t_int ai[MAXPDARG+1], *ap = ai;
     t_floatarg ad[MAXPDARG+1], *dp = ad;
     int narg = 0;
@@ -1001,13 +1458,7 @@ void pd_typedmess(t_pd *x, t_symbol *s, int argc, t_atom *argv)
         else goto badarg;
         return;
     }
-#ifdef PDINSTANCE
-    mlist = c->c_methods[pd_this->pd_instanceno];
-#else
-    mlist = c->c_methods;
-#endif
-    for (i = c->c_nmethod, m = mlist; i--; m++)
-        if (m->me_name == s)
+    if ((m = class_findmethod(c, s)))
     {
         wp = m->me_arg;
         if (*wp == A_GIMME)
@@ -1169,16 +1620,8 @@ void nullfn(void) {}
 t_gotfn getfn(const t_pd *x, t_symbol *s)
 {
     const t_class *c = *x;
-    t_methodentry *m, *mlist;
-    int i;
-
-#ifdef PDINSTANCE
-    mlist = c->c_methods[pd_this->pd_instanceno];
-#else
-    mlist = c->c_methods;
-#endif
-    for (i = c->c_nmethod, m = mlist; i--; m++)
-        if (m->me_name == s) return(m->me_fun);
+    t_methodentry *m = class_findmethod(c, s);
+    if (m) return(m->me_fun);
     pd_error(x, "%s: no method for message '%s'", c->c_name->s_name, s->s_name);
     return((t_gotfn)nullfn);
 }
@@ -1186,17 +1629,8 @@ t_gotfn getfn(const t_pd *x, t_symbol *s)
 t_gotfn zgetfn(const t_pd *x, t_symbol *s)
 {
     const t_class *c = *x;
-    t_methodentry *m, *mlist;
-    int i;
-
-#ifdef PDINSTANCE
-    mlist = c->c_methods[pd_this->pd_instanceno];
-#else
-    mlist = c->c_methods;
-#endif
-    for (i = c->c_nmethod, m = mlist; i--; m++)
-        if (m->me_name == s) return(m->me_fun);
-    return(0);
+    t_methodentry *m = class_findmethod(c, s);
+    return(m ? m->me_fun : 0);
 }
 
 void c_extern(t_externclass *cls, t_newmethod newroutine,
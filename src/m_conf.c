@@ -6,6 +6,9 @@
 /* all changes are labeled with      iemlib      */
 
 #include "m_pd.h"
+#include "m_imp.h"
+#include "s_stuff.h"
+#include <string.h>
 
 void g_array_setup(void);
 void g_canvas_setup(void);
@@ -46,6 +49,7 @@ void expr_setup(void);
 void d_arithmetic_setup(void);
 void d_array_setup(void);
 void d_ctl_setup(void);
+void d_conv_setup(void);
 void d_dac_setup(void);
 void d_delay_setup(void);
 void d_fft_setup(void);
@@ -53,59 +57,175 @@ void d_filter_setup(void);
 void d_global_setup(void);
 void d_math_setup(void);
 void d_misc_setup(void);
+void d_net_setup(void);
 void d_osc_setup(void);
+void soundfile_type_setup(void);
 void d_soundfile_setup(void);
 void d_ugen_setup(void);
 
-void conf_init(void)
+    /* the built-in subsystems, in the order they're set up.  Those with a
+    list of creator names can wait, with "-lazyclasses", until one of those
+    is asked for (see conf_lazysetup() below); the rest are needed by Pd
+    itself or set up state other code expects, so they're always done
+    first thing.  A subsystem that gets new objects must list them here. */
+typedef struct _confsetup
+{
+    const char *c_name;
+    void (*c_fn)(void);
+    const char *c_creators;     /* space-separated, or 0 if not deferrable */
+    double c_time;              /* seconds it took */
+    int c_done;
+} t_confsetup;
+
+static t_confsetup conf_setup[] =
 {
-    g_array_setup();
-    g_canvas_setup();
-    g_guiconnect_setup();
+    {"g_array", g_array_setup, 0, 0, 0},
+    {"g_canvas", g_canvas_setup, 0, 0, 0},
+    {"g_guiconnect", g_guiconnect_setup, 0, 0, 0},
 /* iemlib */
-    g_bang_setup();
-    g_hradio_setup();
-    g_hslider_setup();
-    g_mycanvas_setup();
-    g_numbox_setup();
-    g_toggle_setup();
-    g_vradio_setup();
-    g_vslider_setup();
-    g_vumeter_setup();
+    {"g_bang", g_bang_setup, "bng", 0, 0},
+    {"g_hradio", g_hradio_setup, "hradio hdl rdb radiobut radiobutton", 0, 0},
+    {"g_hslider", g_hslider_setup, "hsl hslider", 0, 0},
+    {"g_mycanvas", g_mycanvas_setup, "cnv my_canvas", 0, 0},
+    {"g_numbox", g_numbox_setup, "nbx my_numbox", 0, 0},
+    {"g_toggle", g_toggle_setup, "tgl toggle", 0, 0},
+    {"g_vradio", g_vradio_setup, "vradio vdl", 0, 0},
+    {"g_vslider", g_vslider_setup, "vsl vslider", 0, 0},
+    {"g_vumeter", g_vumeter_setup, "vu", 0, 0},
 /* iemlib */
-    g_io_setup();
-    g_scalar_setup();
-    g_template_setup();
-    g_text_setup();
-    g_traversal_setup();
-    clone_setup();
-    m_pd_setup();
-    x_acoustics_setup();
-    x_interface_setup();
-    x_connective_setup();
-    x_time_setup();
-    x_arithmetic_setup();
-    x_array_setup();
-    x_midi_setup();
-    x_misc_setup();
-    x_net_setup();
-    x_file_setup();
-    x_qlist_setup();
-    x_gui_setup();
-    x_list_setup();
-    x_scalar_setup();
-    expr_setup();
-    d_arithmetic_setup();
-    d_array_setup();
-    d_ctl_setup();
-    d_dac_setup();
-    d_delay_setup();
-    d_fft_setup();
-    d_filter_setup();
-    d_global_setup();
-    d_math_setup();
-    d_misc_setup();
-    d_osc_setup();
-    d_soundfile_setup();
-    d_ugen_setup();
+    {"g_io", g_io_setup, 0, 0, 0},
+    {"g_scalar", g_scalar_setup, 0, 0, 0},
+    {"g_template", g_template_setup, 0, 0, 0},
+    {"g_text", g_text_setup, 0, 0, 0},
+    {"g_traversal", g_traversal_setup, 0, 0, 0},
+    {"clone", clone_setup, "clone", 0, 0},
+    {"m_pd", m_pd_setup, 0, 0, 0},
+    {"x_acoustics", x_acoustics_setup,
+        "mtof ftom powtodb rmstodb dbtopow dbtorms", 0, 0},
+    {"x_interface", x_interface_setup, 0, 0, 0},
+    {"x_connective", x_connective_setup, 0, 0, 0},
+    {"x_time", x_time_setup, "delay del metro line timer pipe", 0, 0},
+    {"x_arithmetic", x_arithmetic_setup,
+        "+ - * / pow max min log == != > < >= <= & && | || << >> % mod div "
+        "sin cos tan atan atan2 sqrt exp abs wrap clip", 0, 0},
+    {"x_array", x_array_setup, "array table", 0, 0},
+    {"x_midi", x_midi_setup,
+        "midiin sysexin midirealtimein notein ctlin pgmin bendin touchin "
+        "polytouchin midiout noteout ctlout pgmout bendout touchout "
+        "polytouchout makenote stripnote poly bag", 0, 0},
+    {"x_misc", x_misc_setup, 0, 0, 0},
+    {"x_net", x_net_setup, "netsend netreceive", 0, 0},
+    {"x_file", x_file_setup, "file", 0, 0},
+    {"x_qlist", x_qlist_setup, "text qlist textfile", 0, 0},
+    {"x_gui", x_gui_setup, 0, 0, 0},
+    {"x_list", x_list_setup, 0, 0, 0},
+    {"x_scalar", x_scalar_setup, "scalar", 0, 0},
+    {"expr", expr_setup, "expr expr~ fexpr~", 0, 0},
+    {"d_arithmetic", d_arithmetic_setup, "+~ -~ *~ /~ max~ min~", 0, 0},
+    {"d_array", d_array_setup,
+        "tabwrite~ tabplay~ tabread~ tabread4~ tabosc4~ tabsend~ tabreceive~ "
+        "tabread tabread4 tabwrite", 0, 0},
+    {"d_ctl", d_ctl_setup,
+        "sig~ line~ vline~ snapshot~ vsnapshot~ env~ threshold~", 0, 0},
+    {"d_conv", d_conv_setup, "conv~", 0, 0},
+    {"d_dac", d_dac_setup, "dac~ adc~", 0, 0},
+    {"d_delay", d_delay_setup, "delwrite~ delread~ delread4~ vd~", 0, 0},
+    {"d_fft", d_fft_setup, "fft~ ifft~ rfft~ rifft~ framp~", 0, 0},
+    {"d_filter", d_filter_setup,
+        "hip~ lop~ bp~ biquad~ filterbank~ samphold~ rpole~ rzero~ rzero_rev~ "
+        "cpole~ czero~ czero_rev~ slop~", 0, 0},
+    {"d_global", d_global_setup,
+        "send~ s~ receive~ r~ catch~ throw~ xsend~ xreceive~ xsend xreceive", 0, 0},
+    {"d_math", d_math_setup,
+        "clip~ rsqrt~ q8_rsqrt~ sqrt~ q8_sqrt~ wrap~ mtof~ ftom~ dbtorms~ "
+        "rmstodb~ dbtopow~ powtodb~ pow~ exp~ log~ abs~", 0, 0},
+    {"d_misc", d_misc_setup, "print~ bang~", 0, 0},
+    {"d_net", d_net_setup, "netsend~ netreceive~", 0, 0},
+    {"d_osc", d_osc_setup, "phasor~ cos~ osc~ vcf~ noise~", 0, 0},
+    {"soundfile types", soundfile_type_setup, 0, 0, 0},
+    {"d_soundfile", d_soundfile_setup, "soundfiler readsf~ writesf~", 0, 0},
+    {"d_ugen", d_ugen_setup, 0, 0, 0},
+};
+#define NCONFSETUP (sizeof(conf_setup)/sizeof(*conf_setup))
+
+int sys_lazyclasses;            /* defer what we can ("-lazyclasses" flag) */
+int sys_lowmem;                 /* small footprint over speed ("-lowmem") */
+int sys_symgc;                  /* symbols can be freed ("-symgc") */
+
+static void conf_dosetup(t_confsetup *c)
+{
+    double start = sys_getrealtime();
+    c->c_done = 1;
+    (*c->c_fn)();
+    c->c_time = sys_getrealtime() - start;
+}
+
+void conf_init(void)
+{
+    unsigned int i;
+    for (i = 0; i < NCONFSETUP; i++)
+        if (!sys_lazyclasses || !conf_setup[i].c_creators)
+            conf_dosetup(&conf_setup[i]);
+}
+
+    /* called from new_anything() for an unknown object name.  If a deferred
+    subsystem makes that object, set it up now and return 1 so that the
+    caller can try again. */
+int conf_lazysetup(t_symbol *s)
+{
+    unsigned int i;
+    int len = (int)strlen(s->s_name);
+    for (i = 0; i < NCONFSETUP; i++)
+    {
+        const char *cp = conf_setup[i].c_creators;
+        if (conf_setup[i].c_done || !cp)
+            continue;
+        while ((cp = strstr(cp, s->s_name)))
+        {
+            if ((cp == conf_setup[i].c_creators || cp[-1] == ' ') &&
+                (cp[len] == ' ' || !cp[len]))
+            {
+                pd_globallock();
+                conf_dosetup(&conf_setup[i]);
+                pd_globalunlock();
+                logpost(0, PD_DEBUG, "%s: set up for '%s' (%.3f msec)",
+                    conf_setup[i].c_name, s->s_name, 1000 * conf_setup[i].c_time);
+                return (1);
+            }
+            cp += len;
+        }
+    }
+    return (0);
+}
+
+    /* number of subsystems not set up yet */
+int conf_ndeferred(void)
+{
+    unsigned int i;
+    int n = 0;
+    for (i = 0; i < NCONFSETUP; i++)
+        if (!conf_setup[i].c_done)
+            n++;
+    return (n);
+}
+
+    /* post the time taken by each subsystem, for "pd startuptime" */
+void conf_printtimes(void)
+{
+    unsigned int i;
+    double total = 0;
+    int ndeferred = 0;
+    for (i = 0; i < NCONFSETUP; i++)
+    {
+        if (conf_setup[i].c_done)
+        {
+            post("  %-16s %8.3f msec", conf_setup[i].c_name,
+                1000 * conf_setup[i].c_time);
+            total += conf_setup[i].c_time;
+        }
+        else ndeferred++;
+    }
+    post("  %-16s %8.3f msec", "(all classes)", 1000 * total);
+    if (ndeferred)
+        post("  %d subsystem(s) not needed yet", ndeferred);
 }
@@ -34,14 +34,40 @@ void glob_addtopath(t_pd *dummy, t_symbol *path, t_float saveit);
 void glob_start_startup_dialog(t_pd *dummy, t_floatarg flongform);
 void glob_startup_dialog(t_pd *dummy, t_symbol *s, int argc, t_atom *argv);
 void glob_ping(t_pd *dummy);
+void glob_guiframerate(t_pd *dummy, t_floatarg f);
+void glob_printlimit(t_pd *dummy, t_floatarg f);
 void glob_plugindispatch(t_pd *dummy, t_symbol *s, int argc, t_atom *argv);
 void glob_watchdog(t_pd *dummy);
 void glob_loadpreferences(t_pd *dummy, t_symbol *s);
 void glob_savepreferences(t_pd *dummy, t_symbol *s);
 void glob_forgetpreferences(t_pd *dummy);
 void glob_open(t_pd *ignore, t_symbol *name, t_symbol *dir, t_floatarg f);
+void glob_preload(void *dummy, t_symbol *name, t_symbol *dir);
 void glob_fastforward(t_pd *ignore, t_floatarg f);
 void glob_settracing(void *dummy, t_float f);
+void glob_dspthreads(void *dummy, t_floatarg f);
+void glob_clockbudget(void *dummy, t_floatarg f);
+void glob_audioadapt(void *dummy, t_symbol *s, int argc, t_atom *argv);
+void glob_schedtelemetry(void *dummy, t_symbol *s, int argc, t_atom *argv);
+void glob_dspprofile(void *dummy, t_symbol *s, int argc, t_atom *argv);
+void glob_msgprofile(void *dummy, t_symbol *s, int argc, t_atom *argv);
+void glob_trace(void *dummy, t_symbol *s, int argc, t_atom *argv);
+void glob_memorystats(void *dummy);
+void glob_memoryaccounting(void *dummy, t_floatarg f);
+void glob_memoryreport(void *dummy, t_floatarg f);
+void glob_inputlog(void *dummy, t_symbol *s, int argc, t_atom *argv);
+void glob_startuptime(void *dummy);
+void glob_memorysubsystems(void *dummy);
+void glob_symbolstats(void *dummy);
+void glob_symbolcollect(void *dummy);
+void glob_lockstats(void *dummy);
+void glob_lockbudget(void *dummy, t_floatarg f);
+void glob_rtcheck(void *dummy, t_symbol *s, int argc, t_atom *argv);
+void glob_dspgraph(void *dummy, t_symbol *filename);
+void glob_loadshed(void *dummy, t_symbol *s, int argc, t_atom *argv);
+void glob_soundfilethreads(void *dummy, t_floatarg f);
+void glob_undomemory(void *dummy, t_floatarg f);
+void glob_affinity(void *dummy, t_symbol *s, int argc, t_atom *argv);
 
 static void glob_helpintro(t_pd *dummy)
 {
@@ -142,6 +168,8 @@ void glob_init(void)
         A_SYMBOL, A_SYMBOL, 0);
     class_addmethod(glob_pdobject, (t_method)glob_open, gensym("open"),
         A_SYMBOL, A_SYMBOL, A_DEFFLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_preload, gensym("preload"),
+        A_SYMBOL, A_SYMBOL, 0);
     class_addmethod(glob_pdobject, (t_method)glob_exit, gensym("quit"), A_DEFFLOAT, 0);
     class_addmethod(glob_pdobject, (t_method)glob_verifyquit,
         gensym("verifyquit"), A_DEFFLOAT, 0);
@@ -177,6 +205,30 @@ void glob_init(void)
     class_addmethod(glob_pdobject, (t_method)glob_startup_dialog,
         gensym("startup-dialog"), A_GIMME, 0);
     class_addmethod(glob_pdobject, (t_method)glob_ping, gensym("ping"), 0);
+    class_addmethod(glob_pdobject, (t_method)glob_guiframerate,
+        gensym("gui-framerate"), A_FLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_printlimit,
+        gensym("print-limit"), A_FLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_memorystats,
+        gensym("memory-stats"), 0);
+    class_addmethod(glob_pdobject, (t_method)glob_memoryaccounting,
+        gensym("memory-accounting"), A_FLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_memoryreport,
+        gensym("memory-report"), A_DEFFLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_inputlog,
+        gensym("input-log"), A_GIMME, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_startuptime,
+        gensym("startuptime"), 0);
+    class_addmethod(glob_pdobject, (t_method)glob_memorysubsystems,
+        gensym("memory-subsystems"), 0);
+    class_addmethod(glob_pdobject, (t_method)glob_symbolstats,
+        gensym("symbol-stats"), 0);
+    class_addmethod(glob_pdobject, (t_method)glob_symbolcollect,
+        gensym("symbol-collect"), 0);
+    class_addmethod(glob_pdobject, (t_method)glob_lockstats,
+        gensym("lock-stats"), 0);
+    class_addmethod(glob_pdobject, (t_method)glob_lockbudget,
+        gensym("lock-budget"), A_FLOAT, 0);
     class_addmethod(glob_pdobject, (t_method)glob_loadpreferences,
         gensym("load-preferences"), A_DEFSYM, 0);
     class_addmethod(glob_pdobject, (t_method)glob_savepreferences,
@@ -199,6 +251,36 @@ void glob_init(void)
          gensym("fast-forward"), A_FLOAT, 0);
     class_addmethod(glob_pdobject, (t_method)glob_settracing,
          gensym("set-tracing"), A_FLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_dspthreads,
+         gensym("dsp-threads"), A_FLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_clockbudget,
+         gensym("clock-budget"), A_FLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_audioadapt,
+         gensym("audio-adapt"), A_GIMME, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_schedtelemetry,
+         gensym("sched-telemetry"), A_GIMME, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_dspprofile,
+         gensym("dsp-profile"), A_GIMME, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_msgprofile,
+         gensym("msg-profile"), A_GIMME, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_trace,
+         gensym("trace"), A_GIMME, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_rtcheck,
+        gensym("rt-check"), A_GIMME, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_compiledsp,
+        gensym("compile-dsp"), A_SYMBOL, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_dspcompiled,
+        gensym("dsp-compiled"), A_GIMME, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_dspgraph,
+        gensym("dsp-graph"), A_SYMBOL, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_loadshed,
+        gensym("load-shed"), A_GIMME, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_soundfilethreads,
+        gensym("soundfile-threads"), A_FLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_undomemory,
+        gensym("undo-memory"), A_FLOAT, 0);
+    class_addmethod(glob_pdobject, (t_method)glob_affinity,
+        gensym("affinity"), A_GIMME, 0);
 #if defined(__linux__) || defined(__FreeBSD_kernel__)
     class_addmethod(glob_pdobject, (t_method)glob_watchdog,
         gensym("watchdog"), 0);
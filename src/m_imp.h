@@ -19,6 +19,15 @@ typedef struct _methodentry
     unsigned char me_arg[MAXPDARG+1];
 } t_methodentry;
 
+/* open-addressed hash table from selector to method, kept for classes with
+many methods (see m_class.c).  Slots hold indices into the method list or
+-1 if empty; mh_size is a power of two, or zero if there is no table. */
+typedef struct _methodhash
+{
+    int mh_size;
+    int *mh_vec;
+} t_methodhash;
+
 EXTERN_STRUCT _widgetbehavior;
 
 typedef void (*t_bangmethod)(t_pd *x);
@@ -58,14 +67,69 @@ struct _class
     char c_firstin;                 /* if patchable, true if draw first inlet */
     char c_drawcommand;             /* a drawing command for a template */
     t_classfreefn c_classfreefn;    /* function to call before freeing class */
+#ifdef PDINSTANCE
+    t_methodhash *c_methodhash;     /* method lookup table per instance */
+#else
+    t_methodhash c_methodhash;
+#endif
+    char c_scalarsignalin;      /* dsp method handles unconnected inlets */
+    char c_multichannel;        /* dsp method handles multichannel signals */
+    char c_blockratein;         /* dsp method handles block-rate signals */
 };
 
+    /* thread-local storage even where PERTHREAD is empty, which it is
+    unless both PDTHREADS and PDINSTANCE are defined */
+#ifdef _MSC_VER
+#define PD_THREADLOCAL __declspec(thread)
+#else
+#define PD_THREADLOCAL __thread
+#endif
+
 /* m_pd.c */
 EXTERN void pd_init_systems(void);
 EXTERN void pd_term_systems(void);
 
+/* m_memory.c */
+EXTERN void *pool_getbytes(size_t nbytes);
+EXTERN void pool_freebytes(void *x, size_t nbytes);
+
+    /* kinds of memory for "pd memory-report" */
+#define MEM_UNTRACKED -1    /* not counted at all */
+#define MEM_OTHER 0
+#define MEM_SIGNAL 1
+#define MEM_ARRAY 2
+#define MEM_DELAY 3
+#define MEM_MESSAGE 4
+#define MEM_NKIND 5
+
+typedef struct _memowner
+{
+    struct _glist *o_canvas;
+    t_class *o_class;
+} t_memowner;
+
+extern int mem_accounting;
+EXTERN int mem_setkind(int kind);
+EXTERN void mem_setclass(t_class *c);
+EXTERN void mem_pushowner(t_memowner *save, struct _glist *canvas,
+    t_class *c);
+EXTERN void mem_popowner(const t_memowner *save);
+EXTERN void mem_charge(int kind, size_t nbytes);
+EXTERN void mem_unchargeall(int kind);
+EXTERN void mem_canvasfreed(struct _glist *x);
+EXTERN void mem_setaccounting(int on);
+EXTERN void mem_sethugepages(size_t minbytes);
+EXTERN size_t mess_symbolbytes(int *nsym);
+EXTERN size_t mess_classbytes(int *nclass);
+EXTERN size_t mem_gethugepages(void);
+EXTERN void mem_marksymbols(t_symbol **vec, int n, char *keep);
+EXTERN void mem_addsymbolroot(const void *p, size_t size);
+EXTERN void mem_removesymbolroot(const void *p);
+
 /* m_class.c */
 EXTERN void pd_emptylist(t_pd *x);
+EXTERN void mess_keepsymbol(t_symbol *s);
+EXTERN void class_marksymbols(void (*fn)(const void *w));
 
 /* m_obj.c */
 EXTERN int obj_noutlets(const t_object *x);
@@ -78,7 +142,15 @@ EXTERN t_outconnect *obj_connect(t_object *source, int outno,
     t_object *sink, int inno);
 EXTERN void obj_disconnect(t_object *source, int outno, t_object *sink,
     int inno);
+EXTERN int obj_connectserial(void);
+EXTERN int pd_bindserial(void);
+EXTERN void pd_findcache(int on);
 EXTERN void outlet_setstacklim(void);
+extern int outlet_msgprofiling;
+EXTERN void outlet_msgprofilebegin(void *who);
+EXTERN void outlet_msgprofileend(void);
+EXTERN void outlet_msgprofileforget(void *who);
+EXTERN int outlet_msgprofiledepth(void);
 EXTERN int obj_issignalinlet(const t_object *x, int m);
 EXTERN int obj_issignaloutlet(const t_object *x, int m);
 EXTERN int obj_nsiginlets(const t_object *x);
@@ -87,20 +159,149 @@ EXTERN int obj_siginletindex(const t_object *x, int m);
 EXTERN int obj_sigoutletindex(const t_object *x, int m);
 EXTERN t_float *obj_findsignalscalar(const t_object *x, int m);
 
+/* d_ugen.c */
+EXTERN void *ugen_beginsection(void);
+EXTERN void ugen_nexttask(void *section);
+EXTERN void ugen_endsection(void *section);
+EXTERN t_sample *ugen_getsoundout(void);
+EXTERN unsigned char *ugen_getoutwritten(void);
+EXTERN void signal_setexternal(t_signal **sig, t_sample *vec);
+EXTERN t_sample *ugen_getsumbuffer(t_sample *target, int n);
+EXTERN void *ugen_beginsubchain(t_float srate, int vecsize, int calcsize);
+EXTERN t_signal *ugen_subchaininput(void *z, t_sample *vec, int n,
+    int nchans);
+EXTERN t_int *ugen_endsubchain(void *z, int *sizep);
+EXTERN void ugen_freesubchain(t_int *chain, int size);
+EXTERN void ugen_appendsubchain(t_int *chain, int size);
+EXTERN void ugen_pause(void);
+EXTERN void ugen_resume(void);
+EXTERN void ugen_setthreads(int n);
+EXTERN int ugen_getthreads(void);
+
+    /* sample-accurate control messages */
+typedef struct _ctltime
+{
+    double c_blocktime;     /* logical time (msec) of block's first sample */
+    double c_nexttime;      /* ... and of the next block's */
+    double c_lastlogical;   /* logical time when the last block was computed */
+    double c_msecpersamp;
+} t_ctltime;
+EXTERN double ctltime_stamp(void);
+EXTERN void ctltime_dsp(t_ctltime *x, t_float sr);
+EXTERN void ctltime_block(t_ctltime *x, int n);
+EXTERN int ctltime_offset(t_ctltime *x, double stamp, int n);
+extern int ugen_nparallel;
+void ugen_lockclocks(void);
+void ugen_unlockclocks(void);
+
+    /* pointwise operations that dsp_addpointwise() may fuse */
+#define PW_ADD 0        /* add, subtract, or multiply by another signal */
+#define PW_SUB 1
+#define PW_MUL 2
+#define PW_SCALARADD 3  /* ... or by a scalar */
+#define PW_SCALARSUB 4
+#define PW_SCALARMUL 5
+#define PW_CLIP 6       /* clip between two scalars */
+EXTERN void dsp_addpointwise(t_perfroutine f, int op, t_sample *in,
+    t_int arg1, t_int arg2, t_sample *out, int n);
+EXTERN void dsp_addbatch(t_perfroutine f, int n, int nargs, t_int *args);
+
+    /* the processor's cycle counter, for the DSP and message profilers */
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define PROFILE_NOW() __rdtsc()
+#elif defined(__x86_64__) || defined(__i386__)
+#define PROFILE_NOW() __builtin_ia32_rdtsc()
+#elif defined(__aarch64__)
+static inline unsigned long long profile_cntvct(void)
+{
+    unsigned long long v;
+    __asm__ __volatile__ ("mrs %0, cntvct_el0" : "=r" (v));
+    return (v);
+}
+#define PROFILE_NOW() profile_cntvct()
+#else
+#define PROFILE_NOW() ((unsigned long long)(sys_getrealtime() * 1e9))
+#endif
+typedef void (*t_profilefn)(void *data, const char *name, const char *owner,
+    double load, double usec);
+EXTERN void ugen_setprofile(int onoff);
+EXTERN int ugen_getprofile(t_profilefn fn, void *data);
+EXTERN void *ugen_profilebegin(t_object *x);
+EXTERN void ugen_profileend(void *rec);
+#define RT_ALLOC 0          /* kinds of real-time safety violations */
+#define RT_LOCK 1
+#define RT_OPEN 2
+#define RT_NKIND 3
+extern PD_THREADLOCAL int ugen_rtregion;
+EXTERN void ugen_rtviolation(int kind);
+
+/* d_fft_fftsg.c or d_fft_fftw.c */
+typedef struct _realfft t_realfft;
+EXTERN t_realfft *realfft_new(int n);
+EXTERN void realfft_free(t_realfft *x);
+EXTERN void realfft_forward(t_realfft *x, t_sample *fz);
+EXTERN void realfft_inverse(t_realfft *x, t_sample *fz);
+typedef struct _complexfft t_complexfft;
+EXTERN t_complexfft *complexfft_new(int n);
+EXTERN void complexfft_free(t_complexfft *x);
+EXTERN void complexfft_forward(t_complexfft *x, t_sample *re, t_sample *im);
+EXTERN void complexfft_inverse(t_complexfft *x, t_sample *re, t_sample *im);
+
+/* d_conv.c -- a tail job for an offload backend (see conv_setoffload()).
+The stage's spectra are kept as npart partitions of real then imaginary
+parts, L+1 bins each; the response's already carry the inverse FFT's 1/2L.
+The job is to transform the last 2L samples of input into FDL slot "head",
+sum the products of slot head+i (mod npart) with partition i, and write the
+second half of the inverse transform to "out". */
+typedef struct _convjob
+{
+    int j_size;                 /* partition size L; FFTs are 2L points */
+    int j_npart;                /* number of partitions */
+    int j_head;                 /* FDL slot for the new input */
+    int j_serial;               /* changes whenever j_ir is refilled */
+    const t_sample *j_ir;       /* spectra of the response's partitions */
+    t_sample *j_fdl;            /* spectra of past input */
+    const t_sample *j_in;       /* last 2L samples of input */
+    t_sample *j_out;            /* L samples of output */
+    void *j_owner;
+    struct _convjob *j_next;    /* next in this batch */
+} t_convjob;
+typedef int (*t_convoffloadfn)(void *data, t_convjob *jobs);
+EXTERN void conv_setoffload(t_convoffloadfn fn, void *data);
+EXTERN void conv_jobdone(t_convjob *job);
+
+/* m_binbuf.c */
+EXTERN void binbuf_evalpatch(t_binbuf *b, t_symbol *name, t_symbol *dir);
+EXTERN t_binbuf *binbuf_readabstraction(t_symbol *name, t_symbol *dir);
+EXTERN void binbuf_gensyms(t_binbuf *x);
+EXTERN void binbuf_marksymbols(void (*fn)(const void *w));
+EXTERN int binbuf_pack(t_binbuf *x, int minatoms);
+#ifdef PDINSTANCE
+EXTERN void binbuf_copyfilecache(t_pdinstance *from);
+#endif
+
 /* s_inter.c */
 void pd_globallock(void);
 void pd_globalunlock(void);
 
 /* misc */
+    /* initial size of the symbol table, which grows as needed */
 #ifndef SYMTABHASHSIZE  /* set this to, say, 1024 for small memory footprint */
 #define SYMTABHASHSIZE 16384
 #endif /* SYMTABHASHSIZE */
+#define SYMTABLOWMEMSIZE 256    /* initial size with "-lowmem"; it grows */
 
 EXTERN t_pd *glob_evalfile(t_pd *ignore, t_symbol *name, t_symbol *dir);
+EXTERN t_pd *glob_evalpatch(t_binbuf *b, t_symbol *name, t_symbol *dir);
 EXTERN void glob_initfromgui(void *dummy, t_symbol *s, int argc, t_atom *argv);
 EXTERN void glob_quit(void *dummy); /* glob_exit(0); */
 EXTERN void glob_exit(void *dummy, t_float status);
+EXTERN void glob_dsp(void *dummy, t_symbol *s, int argc, t_atom *argv);
+EXTERN void glob_compiledsp(void *dummy, t_symbol *filename);
+EXTERN void glob_dspcompiled(void *dummy, t_symbol *s, int argc, t_atom *argv);
 EXTERN void open_via_helppath(const char *name, const char *dir);
+EXTERN void canvas_update_dspconnect(void);
 
 
 #define __m_imp_h_
@@ -4,8 +4,24 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
+#include <pthread.h>
 #include "m_pd.h"
 #include "m_imp.h"
+#include "g_canvas.h"
+#include "s_stuff.h"
+
+#ifdef _MSC_VER
+#define snprintf _snprintf
+#endif
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#define HUGE_MMAP
+#elif defined(_WIN32)
+#include <windows.h>
+#define HUGE_VIRTUALALLOC
+#endif
 
 /* #define LOUD */
 #ifdef LOUD
@@ -17,11 +33,24 @@
 static int totalmem = 0;
 #endif
 
+static void mem_track(void *p, size_t nbytes);
+struct _memrecord;
+static struct _memrecord *mem_detach(void *p);
+static void mem_reattach(struct _memrecord *r, void *p, size_t newsize);
+static void mem_untrack(void *p);
+int mem_accounting;
+struct _hugeblock;
+static void *huge_getbytes(size_t nbytes);
+static void *huge_resizebytes(void *old, size_t oldsize, size_t newsize);
+static void huge_freebytes(void *p);
+
 void *getbytes(size_t nbytes)
 {
     void *ret;
     if (nbytes < 1) nbytes = 1;
-    ret = (void *)calloc(nbytes, 1);
+    if (ugen_rtregion)
+        ugen_rtviolation(RT_ALLOC);
+    ret = huge_getbytes(nbytes);
 #ifdef LOUD
     fprintf(stderr, "new  %lx %d\n", (int)ret, nbytes);
 #endif /* LOUD */
@@ -30,6 +59,8 @@ void *getbytes(size_t nbytes)
 #endif
     if (!ret)
         post("pd: getbytes() failed -- out of memory");
+    else if (mem_accounting)
+        mem_track(ret, nbytes);
     return (ret);
 }
 
@@ -50,17 +81,20 @@ void *copybytes(const void *src, size_t nbytes)
 void *resizebytes(void *old, size_t oldsize, size_t newsize)
 {
     void *ret;
+    struct _memrecord *rec = (mem_accounting ? mem_detach(old) : 0);
     if (newsize < 1) newsize = 1;
     if (oldsize < 1) oldsize = 1;
-    ret = (void *)realloc((char *)old, newsize);
-    if (newsize > oldsize && ret)
-        memset(((char *)ret) + oldsize, 0, newsize - oldsize);
+    if (ugen_rtregion)
+        ugen_rtviolation(RT_ALLOC);
+    ret = huge_resizebytes(old, oldsize, newsize);
 #ifdef LOUD
     fprintf(stderr, "resize %lx %d --> %lx %d\n", (int)old, oldsize, (int)ret, newsize);
 #endif /* LOUD */
 #ifdef DEBUGMEM
     totalmem += (newsize - oldsize);
 #endif
+    if (mem_accounting)
+        mem_reattach(rec, ret, newsize);
     if (!ret)
         post("pd: resizebytes() failed -- out of memory");
     return (ret);
@@ -76,7 +110,997 @@ void freebytes(void *fatso, size_t nbytes)
 #ifdef DEBUGMEM
     totalmem -= nbytes;
 #endif
-    free(fatso);
+    if (mem_accounting)
+        mem_untrack(fatso);
+    huge_freebytes(fatso);
+}
+
+/* ----------------------------- huge pages ------------------------------ */
+
+/* With "-hugepages <kbytes>", blocks at least that big -- signal buffer
+arenas, delay lines and big arrays, mostly -- are mapped directly from the
+system instead of coming from malloc(), so that they can be backed by huge
+pages and the DSP chain sweeping through them doesn't keep missing the TLB.
+On linux we first ask for pages from the reserved pool (MAP_HUGETLB) and
+if there are none, take an ordinary mapping aligned to HUGEPAGESIZE and
+advise the kernel to use transparent huge pages for it; on Windows we ask
+for large pages, which needs the "lock pages in memory" privilege.  If that
+all fails the block just comes from calloc().  Mappings are rounded up to
+whole huge pages, so the threshold shouldn't be much below their size (2 MB
+on most machines.)  freebytes() and resizebytes() find mapped blocks in a
+list; since they're all page-aligned and malloc()'s blocks aren't, other
+blocks needn't be looked up. */
+
+#define HUGEPAGESIZE ((size_t)2 * 1024 * 1024)
+#define HUGEPAGEMASK ((size_t)4095)     /* mapped blocks have these zero */
+
+typedef struct _hugeblock
+{
+    void *h_ptr;
+    size_t h_size;              /* size of the mapping */
+    int h_explicit;             /* from the reserved pool / large pages */
+    struct _hugeblock *h_next;
+} t_hugeblock;
+
+static pthread_mutex_t huge_mutex = PTHREAD_MUTEX_INITIALIZER;
+static t_hugeblock *huge_list;
+static size_t huge_min;         /* threshold in bytes, or zero if off */
+static int huge_nblocks, huge_nexplicit;
+static size_t huge_nbytes;
+
+    /* put a block on the list */
+static void huge_putback(t_hugeblock *b)
+{
+    pthread_mutex_lock(&huge_mutex);
+    b->h_next = huge_list;
+    huge_list = b;
+    huge_nblocks++;
+    huge_nexplicit += b->h_explicit;
+    huge_nbytes += b->h_size;
+    pthread_mutex_unlock(&huge_mutex);
+}
+
+    /* map a block; return 0 to have it come from calloc() after all */
+static void *huge_alloc(size_t nbytes)
+{
+    t_hugeblock *b;
+    void *p = 0;
+    size_t size = 0;
+    int explicit = 0;
+#if defined(HUGE_MMAP)
+    size = (nbytes + HUGEPAGESIZE - 1) & ~(HUGEPAGESIZE - 1);
+#ifdef MAP_HUGETLB
+    p = mmap(0, size, PROT_READ|PROT_WRITE,
+        MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED)
+        explicit = 1;
+    else
+#endif
+    {
+            /* map one huge page too many and trim it back to alignment */
+        char *raw = (char *)mmap(0, size + HUGEPAGESIZE,
+            PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0), *start;
+        if (raw == (char *)MAP_FAILED)
+            return (0);
+        start = (char *)(((size_t)raw + HUGEPAGESIZE - 1) &
+            ~(HUGEPAGESIZE - 1));
+        if (start > raw)
+            munmap(raw, start - raw);
+        if (raw + HUGEPAGESIZE > start)
+            munmap(start + size, (raw + HUGEPAGESIZE) - start);
+        p = start;
+#ifdef MADV_HUGEPAGE
+        madvise(p, size, MADV_HUGEPAGE);
+#endif
+    }
+#elif defined(HUGE_VIRTUALALLOC)
+    SIZE_T large = GetLargePageMinimum();
+    if (!large)
+        return (0);
+    size = (nbytes + large - 1) & ~(large - 1);
+    if (!(p = VirtualAlloc(0, size, MEM_RESERVE|MEM_COMMIT|MEM_LARGE_PAGES,
+        PAGE_READWRITE)))
+            return (0);
+    explicit = 1;
+#endif
+    if (!p)
+        return (0);
+    if (!(b = (t_hugeblock *)malloc(sizeof(*b))))
+    {
+#if defined(HUGE_MMAP)
+        munmap(p, size);
+#elif defined(HUGE_VIRTUALALLOC)
+        VirtualFree(p, 0, MEM_RELEASE);
+#endif
+        return (0);
+    }
+    b->h_ptr = p;
+    b->h_size = size;
+    b->h_explicit = explicit;
+    huge_putback(b);
+    return (p);
+}
+
+    /* take a block off the list if it's a mapped one */
+static t_hugeblock *huge_take(void *p)
+{
+    t_hugeblock **bp, *b = 0;
+    if (!huge_list || ((size_t)p & HUGEPAGEMASK))
+        return (0);
+    pthread_mutex_lock(&huge_mutex);
+    for (bp = &huge_list; *bp; bp = &(*bp)->h_next)
+        if ((*bp)->h_ptr == p)
+    {
+        b = *bp;
+        *bp = b->h_next;
+        huge_nblocks--;
+        huge_nexplicit -= b->h_explicit;
+        huge_nbytes -= b->h_size;
+        break;
+    }
+    pthread_mutex_unlock(&huge_mutex);
+    return (b);
+}
+
+static void huge_release(t_hugeblock *b)
+{
+#if defined(HUGE_MMAP)
+    munmap(b->h_ptr, b->h_size);
+#elif defined(HUGE_VIRTUALALLOC)
+    VirtualFree(b->h_ptr, 0, MEM_RELEASE);
+#endif
+    free(b);
+}
+
+    /* get zeroed memory, mapped if it's big enough */
+static void *huge_getbytes(size_t nbytes)
+{
+    void *ret;
+    if (huge_min && nbytes >= huge_min && (ret = huge_alloc(nbytes)))
+        return (ret);
+    return (calloc(nbytes, 1));
+}
+
+    /* resize memory from huge_getbytes(), zeroing any new part.  A block
+    moving to or from a mapping is copied over; if there's no room for the
+    new one the old one stays where it was, as with realloc(). */
+static void *huge_resizebytes(void *old, size_t oldsize, size_t newsize)
+{
+    t_hugeblock *b = huge_take(old);
+    void *ret;
+    if (b && newsize >= huge_min && newsize <= b->h_size)
+    {
+            /* still fits in its mapping */
+        huge_putback(b);
+        if (newsize > oldsize)
+            memset(((char *)old) + oldsize, 0, newsize - oldsize);
+        return (old);
+    }
+    if (b || (huge_min && newsize >= huge_min))
+    {
+        if ((ret = huge_getbytes(newsize)))
+        {
+            memcpy(ret, old, (oldsize < newsize ? oldsize : newsize));
+            if (b)
+                huge_release(b);
+            else free(old);
+        }
+        else if (b)
+            huge_putback(b);
+        return (ret);
+    }
+    ret = realloc(old, newsize);
+    if (newsize > oldsize && ret)
+        memset(((char *)ret) + oldsize, 0, newsize - oldsize);
+    return (ret);
+}
+
+    /* free memory from huge_getbytes() */
+static void huge_freebytes(void *p)
+{
+    t_hugeblock *b = huge_take(p);
+    if (b)
+        huge_release(b);
+    else free(p);
+}
+
+    /* set the threshold; zero turns huge pages off for new blocks */
+void mem_sethugepages(size_t minbytes)
+{
+#if defined(HUGE_MMAP) || defined(HUGE_VIRTUALALLOC)
+    huge_min = minbytes;
+#else
+    if (minbytes)
+        post("warning: huge pages aren't supported on this platform");
+#endif
+}
+
+size_t mem_gethugepages(void)
+{
+    return (huge_min);
+}
+
+/* --------------------- small-object pools ------------------------ */
+
+/* Fixed-size things that come and go while a patch is running, such as
+connections, clocks, outlets and "bind" list elements, are taken from
+per-thread free lists in size classes of POOL_GRAIN bytes.  The lists are
+fed from chunks that are never given back, so once a patch has reached its
+working size, creating and deleting these doesn't call the system allocator.
+Memory from pool_getbytes() must be freed with pool_freebytes() with the
+same size.  It can be freed from another thread than it came from, in which
+case it goes on that thread's lists; a thread with more than POOL_KEEP free
+blocks of a size passes half of them to a shared list, under a lock, which
+threads whose own lists are empty take from before carving a new chunk.
+Bigger requests just go to getbytes(). */
+
+#define POOL_GRAIN 16
+#define POOL_NCLASS 16      /* classes up to POOL_GRAIN * POOL_NCLASS bytes */
+#define POOL_CHUNK 16384    /* bytes to get from the system at a time */
+#define POOL_KEEP 64        /* free blocks per class a thread holds on to */
+
+typedef struct _poolblock
+{
+    struct _poolblock *pb_next;
+} t_poolblock;
+
+typedef struct _poolclass
+{
+    t_poolblock *pc_free;   /* free list */
+    int pc_nfree;           /* number of blocks on it */
+    int pc_nused;           /* number handed out and not (yet) freed here */
+} t_poolclass;
+
+static PD_THREADLOCAL t_poolclass pool_class[POOL_NCLASS];
+static PD_THREADLOCAL char *pool_chunk;    /* current chunk being carved up */
+static PD_THREADLOCAL size_t pool_chunkfill;
+static PD_THREADLOCAL int pool_nchunks;
+static PD_THREADLOCAL int pool_nbig;       /* pool_getbytes() calls too big */
+
+    /* the shared lists */
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static t_poolclass pool_shared[POOL_NCLASS];
+
+    /* move up to n blocks from one free list to another */
+static void pool_move(t_poolclass *from, t_poolclass *to, int n)
+{
+    t_poolblock *b;
+    while (n-- && (b = from->pc_free))
+    {
+        from->pc_free = b->pb_next;
+        from->pc_nfree--;
+        b->pb_next = to->pc_free;
+        to->pc_free = b;
+        to->pc_nfree++;
+    }
+}
+
+void *pool_getbytes(size_t nbytes)
+{
+    t_poolclass *pc;
+    t_poolblock *b;
+    size_t which = (nbytes + POOL_GRAIN - 1) / POOL_GRAIN;
+    if (which < 1)
+        which = 1;
+    if (which > POOL_NCLASS)
+    {
+        pool_nbig++;
+        return (getbytes(nbytes));
+    }
+    pc = &pool_class[which - 1];
+    if (!pc->pc_free)
+    {
+        pthread_mutex_lock(&pool_mutex);
+        pool_move(&pool_shared[which - 1], pc, POOL_KEEP/2);
+        pthread_mutex_unlock(&pool_mutex);
+    }
+    if ((b = pc->pc_free))
+    {
+        pc->pc_free = b->pb_next;
+        pc->pc_nfree--;
+    }
+    else
+    {
+        size_t size = which * POOL_GRAIN;
+        if (!pool_chunk || pool_chunkfill + size > POOL_CHUNK)
+        {
+            if (!(pool_chunk = (char *)getbytes(POOL_CHUNK)))
+                return (0);
+            pool_chunkfill = 0;
+            pool_nchunks++;
+        }
+        b = (t_poolblock *)(pool_chunk + pool_chunkfill);
+        pool_chunkfill += size;
+    }
+    pc->pc_nused++;
+    memset(b, 0, which * POOL_GRAIN);
+    return (b);
+}
+
+void pool_freebytes(void *x, size_t nbytes)
+{
+    t_poolclass *pc;
+    size_t which = (nbytes + POOL_GRAIN - 1) / POOL_GRAIN;
+    if (which < 1)
+        which = 1;
+    if (which > POOL_NCLASS)
+    {
+        freebytes(x, nbytes);
+        return;
+    }
+    pc = &pool_class[which - 1];
+    ((t_poolblock *)x)->pb_next = pc->pc_free;
+    pc->pc_free = (t_poolblock *)x;
+    pc->pc_nfree++;
+    pc->pc_nused--;
+    if (pc->pc_nfree > POOL_KEEP)
+    {
+        pthread_mutex_lock(&pool_mutex);
+        pool_move(pc, &pool_shared[which - 1], POOL_KEEP/2);
+        pthread_mutex_unlock(&pool_mutex);
+    }
+}
+
+    /* "pd memory-stats" message: print this thread's pool usage */
+void glob_memorystats(void *dummy)
+{
+    int i, nshared[POOL_NCLASS];
+    post("memory pools: %d chunk(s) of %d bytes, %d oversized request(s)",
+        pool_nchunks, POOL_CHUNK, pool_nbig);
+    pthread_mutex_lock(&pool_mutex);
+    for (i = 0; i < POOL_NCLASS; i++)
+        nshared[i] = pool_shared[i].pc_nfree;
+    pthread_mutex_unlock(&pool_mutex);
+    for (i = 0; i < POOL_NCLASS; i++)
+        if (pool_class[i].pc_nused || pool_class[i].pc_nfree || nshared[i])
+            post("%4d bytes: %d in use, %d free, %d shared",
+                (i + 1) * POOL_GRAIN, pool_class[i].pc_nused,
+                    pool_class[i].pc_nfree, nshared[i]);
+    if (huge_min)
+        post("huge pages: %d block(s) of %ld bytes or more, %ld bytes in all, %d from the reserved pool",
+            huge_nblocks, (long)huge_min, (long)huge_nbytes, huge_nexplicit);
+#ifdef DEBUGMEM
+    post("total mem %d", totalmem);
+#endif
+}
+
+/* ------------------- per-canvas memory accounting ----------------------- */
+
+/* When accounting is on ("pd memory-accounting 1" or the -memaccount flag),
+every block from getbytes() is recorded with the canvas and class that own
+it and with a kind: signal buffers, arrays, delay lines, message storage or
+other.  A canvas owns what's allocated while its objects are being created
+(canvas_objtext()), while it's being loaded, and while its DSP is being
+sorted (canvas_dodsp(), and ugen_doit() for the class); allocations made
+at run time outside of these are charged to no canvas.  Signal buffers come
+from an arena shared by all canvases, so signal_new() charges them one by
+one with mem_charge() instead.  "pd memory-report" prints the totals.
+Blocks allocated before accounting was turned on aren't counted. */
+
+typedef struct _memtag
+{
+    t_glist *tg_canvas;         /* owning canvas, or zero */
+    t_symbol *tg_name;          /* its name, kept after it's deleted */
+    int tg_deleted;
+    t_class *tg_class;
+    size_t tg_bytes[MEM_NKIND];
+    struct _memtag *tg_next;
+} t_memtag;
+
+typedef struct _memrecord
+{
+    void *r_ptr;
+    size_t r_size;
+    int r_kind;
+    t_memtag *r_tag;
+    struct _memrecord *r_next;
+} t_memrecord;
+
+#define MEM_NTAGHASH 1024
+
+static pthread_mutex_t mem_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t mem_mainthread;
+static t_memrecord **mem_hash;
+static size_t mem_nhash, mem_nrecords;
+static t_memtag *mem_taghash[MEM_NTAGHASH];
+static PD_THREADLOCAL t_glist *mem_canvas;     /* these are per thread */
+static PD_THREADLOCAL t_class *mem_class;
+static PD_THREADLOCAL int mem_kind;
+
+static const char *mem_kindnames[MEM_NKIND] =
+    {"other", "signal", "array", "delay", "message"};
+
+static size_t mem_hashof(const void *p, size_t n)
+{
+    return ((((size_t)p >> 4) * 2654435761u) & (n - 1));
+}
+
+    /* set the kind of the next allocations in this thread, returning the
+    old one to restore afterward */
+int mem_setkind(int kind)
+{
+    int was = mem_kind;
+    mem_kind = kind;
+    return (was);
+}
+
+    /* called from pd_new(): the class of the object being made */
+void mem_setclass(t_class *c)
+{
+    mem_class = c;
+}
+
+    /* make a canvas (zero to keep the current one) and class the owners of
+    this thread's allocations until mem_popowner() */
+void mem_pushowner(t_memowner *save, t_glist *canvas, t_class *c)
+{
+    save->o_canvas = mem_canvas;
+    save->o_class = mem_class;
+    if (canvas)
+        mem_canvas = canvas;
+    mem_class = c;
+}
+
+void mem_popowner(const t_memowner *save)
+{
+    mem_canvas = save->o_canvas;
+    mem_class = save->o_class;
+}
+
+    /* find or make the tag for the current owner.  Call with the lock
+    held. */
+static t_memtag *mem_gettag(t_glist *canvas)
+{
+    t_class *c = (canvas ? mem_class : 0);
+    size_t h = mem_hashof(canvas, MEM_NTAGHASH) ^
+        (mem_hashof(c, MEM_NTAGHASH) >> 1);
+    t_memtag *t;
+    for (t = mem_taghash[h]; t; t = t->tg_next)
+        if (t->tg_canvas == canvas && t->tg_class == c && !t->tg_deleted)
+            return (t);
+    if (!(t = (t_memtag *)calloc(1, sizeof(*t))))
+        return (0);
+    t->tg_canvas = canvas;
+    t->tg_class = c;
+    t->tg_next = mem_taghash[h];
+    mem_taghash[h] = t;
+    return (t);
+}
+
+    /* the owning canvas, if any: the one pushed or else, in the main
+    thread, the one being loaded */
+static t_glist *mem_owner(void)
+{
+    if (mem_canvas)
+        return (mem_canvas);
+    else if (pthread_equal(pthread_self(), mem_mainthread))
+        return (canvas_getcurrent());
+    else return (0);
+}
+
+static void mem_addrecord(t_memrecord *r)
+{
+    size_t h;
+    if (mem_nrecords >= mem_nhash)
+    {
+        size_t i, n = (mem_nhash ? 2 * mem_nhash : 4096);
+        t_memrecord **nh = (t_memrecord **)calloc(n, sizeof(*nh)), *r2;
+        if (nh)
+        {
+            for (i = 0; i < mem_nhash; i++)
+                while ((r2 = mem_hash[i]))
+            {
+                mem_hash[i] = r2->r_next;
+                h = mem_hashof(r2->r_ptr, n);
+                r2->r_next = nh[h];
+                nh[h] = r2;
+            }
+            free(mem_hash);
+            mem_hash = nh;
+            mem_nhash = n;
+        }
+    }
+    h = mem_hashof(r->r_ptr, mem_nhash);
+    r->r_next = mem_hash[h];
+    mem_hash[h] = r;
+    mem_nrecords++;
+}
+
+static t_memrecord *mem_takerecord(const void *p)
+{
+    t_memrecord **rp, *r;
+    if (!mem_nhash)
+        return (0);
+    for (rp = &mem_hash[mem_hashof(p, mem_nhash)]; (r = *rp);
+        rp = &r->r_next)
+            if (r->r_ptr == p)
+    {
+        *rp = r->r_next;
+        mem_nrecords--;
+        return (r);
+    }
+    return (0);
+}
+
+static void mem_track(void *p, size_t nbytes)
+{
+    t_glist *canvas;
+    t_memrecord *r;
+    if (mem_kind == MEM_UNTRACKED)
+        return;
+    canvas = mem_owner();
+    if (!(r = (t_memrecord *)malloc(sizeof(*r))))
+        return;
+    pthread_mutex_lock(&mem_mutex);
+    if (!mem_accounting || !(r->r_tag = mem_gettag(canvas)))
+    {
+        pthread_mutex_unlock(&mem_mutex);
+        free(r);
+        return;
+    }
+    r->r_ptr = p;
+    r->r_size = nbytes;
+    r->r_kind = mem_kind;
+    r->r_tag->tg_bytes[mem_kind] += nbytes;
+    mem_addrecord(r);
+    pthread_mutex_unlock(&mem_mutex);
+}
+
+    /* a block being resized is taken out of the table, still counted,
+    and put back under its new address with its owner and kind.  If it
+    wasn't known it's counted from now on as if it were new; if the resize
+    failed it's gone. */
+static t_memrecord *mem_detach(void *p)
+{
+    t_memrecord *r;
+    if (!p)
+        return (0);
+    pthread_mutex_lock(&mem_mutex);
+    r = mem_takerecord(p);
+    pthread_mutex_unlock(&mem_mutex);
+    return (r);
+}
+
+static void mem_reattach(t_memrecord *r, void *p, size_t newsize)
+{
+    if (!r)
+    {
+        if (p)
+            mem_track(p, newsize);
+        return;
+    }
+    pthread_mutex_lock(&mem_mutex);
+    if (p && mem_accounting)
+    {
+        r->r_tag->tg_bytes[r->r_kind] += newsize - r->r_size;
+        r->r_ptr = p;
+        r->r_size = newsize;
+        mem_addrecord(r);
+        r = 0;
+    }
+    else if (mem_accounting)
+        r->r_tag->tg_bytes[r->r_kind] -= r->r_size;
+    pthread_mutex_unlock(&mem_mutex);
+    free(r);
+}
+
+static void mem_untrack(void *p)
+{
+    t_memrecord *r;
+    pthread_mutex_lock(&mem_mutex);
+    if ((r = mem_takerecord(p)))
+        r->r_tag->tg_bytes[r->r_kind] -= r->r_size;
+    pthread_mutex_unlock(&mem_mutex);
+    free(r);
+}
+
+    /* charge memory that isn't a block of its own (signal buffers) to the
+    current owner */
+void mem_charge(int kind, size_t nbytes)
+{
+    t_glist *canvas = mem_owner();
+    t_memtag *t;
+    pthread_mutex_lock(&mem_mutex);
+    if (mem_accounting && (t = mem_gettag(canvas)))
+        t->tg_bytes[kind] += nbytes;
+    pthread_mutex_unlock(&mem_mutex);
+}
+
+    /* forget all charges of a kind, when the memory is given back */
+void mem_unchargeall(int kind)
+{
+    int i;
+    t_memtag *t;
+    pthread_mutex_lock(&mem_mutex);
+    for (i = 0; i < MEM_NTAGHASH; i++)
+        for (t = mem_taghash[i]; t; t = t->tg_next)
+            t->tg_bytes[kind] = 0;
+    pthread_mutex_unlock(&mem_mutex);
+}
+
+static size_t mem_tagtotal(const t_memtag *t)
+{
+    size_t total = 0;
+    int i;
+    for (i = 0; i < MEM_NKIND; i++)
+        total += t->tg_bytes[i];
+    return (total);
+}
+
+    /* called from canvas_free().  Whatever the canvas still owns is kept
+    under its name, so that leaks from deleted abstractions show up. */
+void mem_canvasfreed(t_glist *x)
+{
+    int i;
+    t_memtag **tp, *t;
+    if (!mem_accounting)
+        return;
+    pthread_mutex_lock(&mem_mutex);
+    for (i = 0; i < MEM_NTAGHASH; i++)
+        for (tp = &mem_taghash[i]; (t = *tp); )
+    {
+        if (t->tg_canvas == x && !t->tg_deleted)
+        {
+            if (!mem_tagtotal(t))
+            {
+                *tp = t->tg_next;
+                free(t);
+                continue;
+            }
+            t->tg_name = x->gl_name;
+            t->tg_canvas = 0;
+            t->tg_deleted = 1;
+        }
+        tp = &t->tg_next;
+    }
+    pthread_mutex_unlock(&mem_mutex);
+}
+
+static void mem_clear(void)
+{
+    size_t i;
+    t_memrecord *r;
+    t_memtag *t;
+    for (i = 0; i < mem_nhash; i++)
+        while ((r = mem_hash[i]))
+            mem_hash[i] = r->r_next, free(r);
+    free(mem_hash);
+    mem_hash = 0;
+    mem_nhash = mem_nrecords = 0;
+    for (i = 0; i < MEM_NTAGHASH; i++)
+        while ((t = mem_taghash[i]))
+            mem_taghash[i] = t->tg_next, free(t);
+}
+
+void mem_setaccounting(int on)
+{
+    pthread_mutex_lock(&mem_mutex);
+    if (on && !mem_accounting)
+        mem_mainthread = pthread_self();
+    else if (!on && mem_accounting)
+        mem_clear();
+    mem_accounting = (on != 0);
+    pthread_mutex_unlock(&mem_mutex);
+}
+
+    /* a line of the report: totals for one canvas or class */
+typedef struct _memrow
+{
+    const void *m_key;
+    t_glist *m_canvas;
+    t_symbol *m_name;
+    int m_deleted;
+    t_class *m_class;
+    size_t m_bytes[MEM_NKIND];
+    size_t m_total;
+} t_memrow;
+
+static int mem_rowcompare(const void *a, const void *b)
+{
+    size_t x = ((const t_memrow *)a)->m_total,
+        y = ((const t_memrow *)b)->m_total;
+    return (x < y ? 1 : (x > y ? -1 : 0));
+}
+
+    /* sum the tags into rows by canvas or by class.  Deleted canvases of the
+    same name go together.  Call with the lock held; since posting might
+    allocate memory, the rows are printed after it's released. */
+static int mem_sumrows(t_memrow *rows, int bycanvas)
+{
+    int i, j, nrows = 0, k;
+    t_memtag *t;
+    for (i = 0; i < MEM_NTAGHASH; i++)
+        for (t = mem_taghash[i]; t; t = t->tg_next)
+    {
+        const void *key = (!bycanvas ? (const void *)t->tg_class :
+            (t->tg_deleted ? (const void *)t->tg_name :
+                (const void *)t->tg_canvas));
+        for (j = 0; j < nrows; j++)
+            if (rows[j].m_key == key &&
+                (!bycanvas || rows[j].m_deleted == t->tg_deleted))
+                    break;
+        if (j == nrows)
+        {
+            rows[j].m_key = key;
+            rows[j].m_canvas = t->tg_canvas;
+            rows[j].m_name = (t->tg_deleted ? t->tg_name :
+                (t->tg_canvas ? t->tg_canvas->gl_name : 0));
+            rows[j].m_deleted = t->tg_deleted;
+            rows[j].m_class = t->tg_class;
+            memset(rows[j].m_bytes, 0, sizeof(rows[j].m_bytes));
+            rows[j].m_total = 0;
+            nrows++;
+        }
+        for (k = 0; k < MEM_NKIND; k++)
+            rows[j].m_bytes[k] += t->tg_bytes[k],
+                rows[j].m_total += t->tg_bytes[k];
+    }
+    qsort(rows, nrows, sizeof(*rows), mem_rowcompare);
+    return (nrows);
+}
+
+static void mem_postrow(const t_memrow *row, const char *name)
+{
+    post("%9ld %9ld %9ld %9ld %9ld %9ld  %s", (long)row->m_total,
+        (long)row->m_bytes[MEM_SIGNAL], (long)row->m_bytes[MEM_ARRAY],
+        (long)row->m_bytes[MEM_DELAY], (long)row->m_bytes[MEM_MESSAGE],
+        (long)row->m_bytes[MEM_OTHER], name);
+}
+
+static void mem_postheader(const char *what)
+{
+    post("%9s %9s %9s %9s %9s %9s  %s", "total", "signal", "array", "delay",
+        "message", "other", what);
+}
+
+    /* "pd memory-accounting <0|1>" */
+void glob_memoryaccounting(void *dummy, t_floatarg f)
+{
+    if (f == 0 && sys_symgc)
+    {
+        pd_error(0, "memory-accounting: -symgc needs it on");
+        return;
+    }
+    mem_setaccounting(f != 0);
+    post("memory accounting %s", (f != 0 ? "on" : "off"));
+}
+
+    /* "pd memory-report [n]": totals by kind and the "n" (default 20)
+    biggest classes and canvases */
+void glob_memoryreport(void *dummy, t_floatarg f)
+{
+    int ntags = 0, nclass, ncanvas, i, k, n = (f > 0 ? (int)f : 20);
+    size_t total[MEM_NKIND], sum = 0, nblocks;
+    t_memtag *t;
+    t_memrow *rows;
+    char buf[MAXPDSTRING];
+    if (!mem_accounting)
+    {
+        post("memory-report: accounting is off (send 'pd memory-accounting 1' or start pd with -memaccount)");
+        return;
+    }
+    pthread_mutex_lock(&mem_mutex);
+    for (i = 0; i < MEM_NTAGHASH; i++)
+        for (t = mem_taghash[i]; t; t = t->tg_next)
+            ntags++;
+    if (!(rows = (t_memrow *)malloc((2 * ntags + 1) * sizeof(*rows))))
+    {
+        pthread_mutex_unlock(&mem_mutex);
+        return;
+    }
+    nclass = mem_sumrows(rows, 0);
+    ncanvas = mem_sumrows(rows + nclass, 1);
+    nblocks = mem_nrecords;
+    pthread_mutex_unlock(&mem_mutex);
+
+    for (k = 0; k < MEM_NKIND; k++)
+        total[k] = 0;
+    for (i = 0; i < nclass; i++)
+        for (k = 0; k < MEM_NKIND; k++)
+            total[k] += rows[i].m_bytes[k], sum += rows[i].m_bytes[k];
+    post("memory-report: %ld bytes in %ld block(s)", (long)sum, (long)nblocks);
+    for (k = 0; k < MEM_NKIND; k++)
+        post("  %-8s %ld", mem_kindnames[k], (long)total[k]);
+    post("by class:");
+    mem_postheader("class");
+    for (i = 0; i < nclass && i < n && rows[i].m_total; i++)
+        mem_postrow(&rows[i], (rows[i].m_class ?
+            class_getname(rows[i].m_class) : "(no class)"));
+    post("by canvas:");
+    mem_postheader("canvas");
+    for (i = nclass; i < nclass + ncanvas && i < nclass + n &&
+        rows[i].m_total; i++)
+    {
+        const char *name = (rows[i].m_name ? rows[i].m_name->s_name : "?");
+        if (rows[i].m_deleted)
+            snprintf(buf, MAXPDSTRING, "%s (deleted)", name);
+        else if (rows[i].m_canvas)
+            snprintf(buf, MAXPDSTRING, "%s ($0 = %s)", name,
+                canvas_realizedollar(rows[i].m_canvas,
+                    gensym("$0"))->s_name);
+        else strcpy(buf, "(no canvas)");
+        mem_postrow(&rows[i], buf);
+    }
+    free(rows);
+}
+
+/* ---------------- finding symbols in memory ("-symgc" flag) -------------- */
+
+/* For "pd symbol-collect" (m_class.c): note which of a list of symbols a
+pointer is found to in any block of memory that can be reached from the
+patches, templates, bound objects, classes, binbufs and the "roots" added
+with mem_addsymbolroot() below.  Any word that might be a pointer is taken
+as one, so a float or an integer that happens to equal a block's address
+only keeps some symbol or other from being freed.  Pointers into the middle of blocks aren't followed.  The lock is
+held throughout, so this makes no blocks of its own with getbytes(). */
+
+typedef struct _symmark
+{
+    t_symbol **m_syms;          /* the symbols, */
+    char *m_keep;               /* ... which are found, */
+    int *m_symhash;             /* ... and a hash table of their indices */
+    size_t m_nsymhash;
+    const void **m_seen;        /* blocks already looked at */
+    size_t m_nseen;
+    t_memrecord **m_stack;      /* blocks still to look at */
+    size_t m_nstack;
+} t_symmark;
+
+static t_symmark *symmark_this;
+
+static t_memrecord *mem_findrecord(const void *p)
+{
+    t_memrecord *r;
+    for (r = mem_hash[mem_hashof(p, mem_nhash)]; r; r = r->r_next)
+        if (r->r_ptr == p)
+            return (r);
+    return (0);
+}
+
+static void symmark_word(const void *w)
+{
+    t_symmark *m = symmark_this;
+    size_t h;
+    t_memrecord *r;
+    if (!w)
+        return;
+    for (h = mem_hashof(w, m->m_nsymhash); m->m_symhash[h] >= 0;
+        h = (h + 1) & (m->m_nsymhash - 1))
+            if (m->m_syms[m->m_symhash[h]] == w)
+    {
+        m->m_keep[m->m_symhash[h]] = 1;
+        return;
+    }
+    if (!(r = mem_findrecord(w)))
+        return;
+    for (h = mem_hashof(w, m->m_nseen); m->m_seen[h];
+        h = (h + 1) & (m->m_nseen - 1))
+            if (m->m_seen[h] == w)
+                return;
+    m->m_seen[h] = w;
+    m->m_stack[m->m_nstack++] = r;
+}
+
+    /* memory outside the blocks we track that may hold symbols: static
+    variables, and per-instance state made before accounting was turned
+    on.  The array comes from malloc() so as not to be accounted itself. */
+typedef struct _symroot
+{
+    const void *r_ptr;
+    size_t r_size;
+} t_symroot;
+
+static t_symroot *mem_symroots;
+static int mem_nsymroots, mem_symrootsize;
+
+    /* add "size" bytes at "p" to where mem_marksymbols() looks.  Adding the
+    same memory again does nothing, so that a variable can be added each
+    time it's set. */
+void mem_addsymbolroot(const void *p, size_t size)
+{
+    int i;
+    pthread_mutex_lock(&mem_mutex);
+    for (i = 0; i < mem_nsymroots; i++)
+        if (mem_symroots[i].r_ptr == p)
+            goto done;
+    if (mem_nsymroots == mem_symrootsize)
+    {
+        int newsize = (mem_symrootsize ? 2 * mem_symrootsize : 16);
+        t_symroot *newroots = (t_symroot *)realloc(mem_symroots,
+            newsize * sizeof(*newroots));
+        if (!newroots)
+            goto done;
+        mem_symroots = newroots;
+        mem_symrootsize = newsize;
+    }
+    mem_symroots[mem_nsymroots].r_ptr = p;
+    mem_symroots[mem_nsymroots].r_size = size;
+    mem_nsymroots++;
+done:
+    pthread_mutex_unlock(&mem_mutex);
+}
+
+void mem_removesymbolroot(const void *p)
+{
+    int i;
+    pthread_mutex_lock(&mem_mutex);
+    for (i = 0; i < mem_nsymroots; i++)
+        if (mem_symroots[i].r_ptr == p)
+    {
+        mem_symroots[i] = mem_symroots[--mem_nsymroots];
+        break;
+    }
+    pthread_mutex_unlock(&mem_mutex);
+}
+
+void mem_marksymbols(t_symbol **vec, int n, char *keep)
+{
+    t_symmark m;
+    size_t i;
+    t_symbol *s;
+    t_canvas *gl;
+    memset(keep, 0, n);
+    pthread_mutex_lock(&mem_mutex);
+    for (m.m_nsymhash = 16; m.m_nsymhash < 2 * (size_t)n; m.m_nsymhash *= 2)
+        ;
+    for (m.m_nseen = 16; m.m_nseen < 2 * mem_nrecords; m.m_nseen *= 2)
+        ;
+    m.m_syms = vec;
+    m.m_keep = keep;
+    m.m_symhash = (int *)malloc(m.m_nsymhash * sizeof(*m.m_symhash));
+    m.m_seen = (const void **)calloc(m.m_nseen, sizeof(*m.m_seen));
+    m.m_stack = (t_memrecord **)malloc((mem_nrecords + 1) *
+        sizeof(*m.m_stack));
+    m.m_nstack = 0;
+    if (!m.m_symhash || !m.m_seen || !m.m_stack || !mem_nhash)
+    {
+            /* can't tell; keep them all */
+        memset(keep, 1, n);
+        goto done;
+    }
+    for (i = 0; i < m.m_nsymhash; i++)
+        m.m_symhash[i] = -1;
+    for (i = 0; i < (size_t)n; i++)
+    {
+        size_t h = mem_hashof(vec[i], m.m_nsymhash);
+        while (m.m_symhash[h] >= 0)
+            h = (h + 1) & (m.m_nsymhash - 1);
+        m.m_symhash[h] = (int)i;
+    }
+    symmark_this = &m;
+        /* the roots */
+    for (gl = pd_getcanvaslist(); gl; gl = gl->gl_next)
+        symmark_word(gl);
+    symmark_word(pd_this->pd_templatelist);
+    for (i = 0; i < (size_t)pd_this->pd_symhashsize; i++)
+        for (s = pd_this->pd_symhash[i]; s; s = s->s_next)
+            if (s->s_thing)
+                symmark_word(s), symmark_word(s->s_thing);
+    for (i = 0; i < (size_t)mem_nsymroots; i++)
+    {
+        const void **w = (const void **)mem_symroots[i].r_ptr;
+        size_t j;
+        for (j = 0; j < mem_symroots[i].r_size / sizeof(*w); j++)
+            symmark_word(w[j]);
+    }
+    class_marksymbols(symmark_word);
+    binbuf_marksymbols(symmark_word);
+        /* and everything they lead to.  Samples can't be pointers. */
+    while (m.m_nstack)
+    {
+        t_memrecord *r = m.m_stack[--m.m_nstack];
+        const void **w = (const void **)r->r_ptr;
+        if (r->r_kind == MEM_SIGNAL || r->r_kind == MEM_DELAY)
+            continue;
+        for (i = 0; i < r->r_size / sizeof(*w); i++)
+            symmark_word(w[i]);
+    }
+    symmark_this = 0;
+done:
+    pthread_mutex_unlock(&mem_mutex);
+    free(m.m_symhash);
+    free(m.m_seen);
+    free(m.m_stack);
 }
 
 #ifdef DEBUGMEM
@@ -8,6 +8,8 @@ behavior for "gobjs" appears at the end of this file.  */
 
 #include "m_pd.h"
 #include "m_imp.h"
+#include "g_canvas.h"
+#include <stdlib.h>
 #include <string.h>
 
 #ifdef _WIN32
@@ -311,14 +313,58 @@ struct _outconnect
     t_pd *oc_to;
 };
 
+    /* The connection list above is what the editor and the traversal
+    routines see.  For sending messages we keep a flat copy of it in each
+    outlet (the "fan"), so that the outlet_xxx() functions walk an array
+    instead of chasing list nodes.  The float method of each destination is
+    cached there too.  The fan lives in the outlet itself for up to
+    OUTLET_NFANINLINE connections and otherwise in a heap array that grows
+    by doubling.  It is rebuilt by outlet_refan() whenever the list changes. */
+
+typedef struct _fanout
+{
+    t_pd *f_to;
+    t_floatmethod f_float;
+} t_fanout;
+
+#define OUTLET_NFANINLINE 2
+
 struct _outlet
 {
     t_object *o_owner;
     struct _outlet *o_next;
     t_outconnect *o_connections;
     t_symbol *o_sym;
+    int o_nfan;             /* number of connections in o_fan */
+    int o_fansize;          /* allocated size of o_fan */
+    t_fanout *o_fan;        /* either o_faninline or a heap array */
+    t_fanout o_faninline[OUTLET_NFANINLINE];
 };
 
+static void outlet_refan(t_outlet *x)
+{
+    t_outconnect *oc;
+    int n = 0;
+    for (oc = x->o_connections; oc; oc = oc->oc_next)
+        n++;
+    if (n > x->o_fansize)
+    {
+        int newsize = x->o_fansize;
+        while (newsize < n)
+            newsize *= 2;
+        if (x->o_fan != x->o_faninline)
+            freebytes(x->o_fan, x->o_fansize * sizeof(t_fanout));
+        x->o_fan = (t_fanout *)getbytes(newsize * sizeof(t_fanout));
+        x->o_fansize = newsize;
+    }
+    for (oc = x->o_connections, n = 0; oc; oc = oc->oc_next, n++)
+    {
+        x->o_fan[n].f_to = oc->oc_to;
+        x->o_fan[n].f_float = (*oc->oc_to)->c_floatmethod;
+    }
+    x->o_nfan = n;
+}
+
 /* ------- backtracer - keep track of stack for backtracing  --------- */
 #define NARGS 5
 typedef struct _msgstack
@@ -366,6 +412,331 @@ int sched_geteventno(void)
     return (outlet_eventno);
 }
 
+/* ------------------------ message profiling ---------------------------- */
+
+/* When "pd msg-profile 1" turns this on, each message an outlet sends is
+timed and charged to the object receiving it, as are clock callbacks (from
+sched_tick()) and messages coming in from outside, such as from the GUI or
+the network, that reach pd_typedmess() with nothing else being timed.  Each
+object's record counts the messages it got and their "inclusive" time,
+including everything they set off downstream, and "exclusive" time, which
+leaves out the time charged to other objects while it was running.  Times
+are read from the processor's cycle counter as in the DSP profiler.  "pd
+msg-profile print [n]" reports the n most expensive objects by exclusive
+time, and the canvases by the total exclusive time of what's in them.  The
+records are only kept for the main Pd instance. */
+
+#define MSGPROFHASH 1024
+#define MSGPROFSTACK (STACKITER + 16)
+
+typedef struct _msgprof
+{
+    struct _msgprof *p_next;    /* next in hash bucket */
+    void *p_who;                /* receiving object, or clock owner */
+    unsigned long long p_incl;  /* counts including what it set off */
+    unsigned long long p_excl;  /* counts excluding it */
+    unsigned long p_nmess;      /* number of messages */
+    int p_active;               /* number of times it's on the stack */
+    t_glist *p_owner;           /* canvas it's in, found when reporting */
+    int p_found;                /* true if it's still in a patch */
+} t_msgprof;
+
+typedef struct _msgframe
+{
+    t_msgprof *f_prof;          /* record, or 0 if not counting */
+    unsigned long long f_start; /* counter at start */
+    unsigned long long f_inner; /* counts charged to others meanwhile */
+} t_msgframe;
+
+int outlet_msgprofiling;
+static t_msgprof **msgprof_hash;
+static t_msgframe msgprof_stack[MSGPROFSTACK];
+static int msgprof_depth;
+static unsigned long long msgprof_start;
+static double msgprof_starttime;
+
+static t_msgprof *msgprof_find(void *who, int create)
+{
+    int hash = (int)(((size_t)who >> 4) & (MSGPROFHASH-1));
+    t_msgprof *x;
+    for (x = msgprof_hash[hash]; x; x = x->p_next)
+        if (x->p_who == who)
+            return (x);
+    if (!create)
+        return (0);
+    x = (t_msgprof *)getbytes(sizeof(*x));
+    x->p_who = who;
+    x->p_next = msgprof_hash[hash];
+    msgprof_hash[hash] = x;
+    return (x);
+}
+
+    /* begin timing a message to "who".  This may be an inlet, which we
+    charge its owner for.  Calls must be paired with outlet_msgprofileend()
+    even if profiling is turned off or on in between. */
+void outlet_msgprofilebegin(void *who)
+{
+    t_msgframe *f;
+    if (msgprof_depth++ >= MSGPROFSTACK)
+        return;
+    f = &msgprof_stack[msgprof_depth - 1];
+    if (msgprof_hash && who && pd_this == &pd_maininstance)
+    {
+        t_class *c = *(t_pd *)who;
+        if (c == inlet_class || c == pointerinlet_class ||
+            c == floatinlet_class || c == symbolinlet_class)
+                who = ((t_inlet *)who)->i_owner;
+        f->f_prof = msgprof_find(who, 1);
+        f->f_prof->p_active++;
+        f->f_inner = 0;
+        f->f_start = PROFILE_NOW();
+    }
+    else f->f_prof = 0;
+}
+
+void outlet_msgprofileend(void)
+{
+    t_msgframe *f;
+    unsigned long long elapsed;
+    if (msgprof_depth <= 0 || --msgprof_depth >= MSGPROFSTACK)
+        return;
+    f = &msgprof_stack[msgprof_depth];
+    if (!f->f_prof)
+        return;
+    elapsed = PROFILE_NOW() - f->f_start;
+    f->f_prof->p_nmess++;
+        /* only count inclusive time once if the object was reentered */
+    if (!--f->f_prof->p_active)
+        f->f_prof->p_incl += elapsed;
+    f->f_prof->p_excl += elapsed - f->f_inner;
+    if (msgprof_depth > 0)
+        msgprof_stack[msgprof_depth - 1].f_inner += elapsed;
+}
+
+    /* how many messages are being timed; pd_typedmess() only times those
+    that arrive when none are */
+int outlet_msgprofiledepth(void)
+{
+    return (msgprof_depth);
+}
+
+    /* called from pd_free() so that a new object at the same address won't
+    inherit the old one's record */
+void outlet_msgprofileforget(void *who)
+{
+    int hash = (int)(((size_t)who >> 4) & (MSGPROFHASH-1)), i;
+    t_msgprof *x, **xp;
+    if (!msgprof_hash)
+        return;
+    for (xp = &msgprof_hash[hash]; (x = *xp); xp = &x->p_next)
+        if (x->p_who == who)
+    {
+        *xp = x->p_next;
+        for (i = 0; i < msgprof_depth && i < MSGPROFSTACK; i++)
+            if (msgprof_stack[i].f_prof == x)
+                msgprof_stack[i].f_prof = 0;
+        freebytes(x, sizeof(*x));
+        return;
+    }
+}
+
+static void msgprof_free(void)
+{
+    int i;
+    t_msgprof *x;
+    if (!msgprof_hash)
+        return;
+    for (i = 0; i < msgprof_depth && i < MSGPROFSTACK; i++)
+        msgprof_stack[i].f_prof = 0;
+    for (i = 0; i < MSGPROFHASH; i++)
+        while ((x = msgprof_hash[i]))
+    {
+        msgprof_hash[i] = x->p_next;
+        freebytes(x, sizeof(*x));
+    }
+    freebytes(msgprof_hash, MSGPROFHASH * sizeof(*msgprof_hash));
+    msgprof_hash = 0;
+}
+
+    /* turn profiling on or off.  Turning it on also resets the counts. */
+static void msgprof_set(int onoff)
+{
+    msgprof_free();
+    if (onoff)
+    {
+        msgprof_hash = (t_msgprof **)getbytes(MSGPROFHASH *
+            sizeof(*msgprof_hash));
+        msgprof_start = PROFILE_NOW();
+        msgprof_starttime = sys_getrealtime();
+    }
+    outlet_msgprofiling = onoff;
+}
+
+typedef struct _msgcanvas
+{
+    t_glist *c_glist;
+    unsigned long long c_total;     /* exclusive counts of all inside it */
+} t_msgcanvas;
+
+typedef struct _msgreport
+{
+    t_msgcanvas *r_canvases;
+    int r_ncanvases;
+    int r_size;
+} t_msgreport;
+
+static void msgprof_mark(t_msgprof *x, t_glist *owner)
+{
+    x->p_owner = owner;
+    x->p_found = 1;
+}
+
+    /* find the records of objects that are still in a patch, note which
+    canvas they're in, and total the exclusive counts of each canvas,
+    including its subpatches */
+static unsigned long long msgprof_traverse(t_msgreport *r, t_glist *gl,
+    t_glist *owner)
+{
+    t_gobj *y;
+    t_msgprof *x;
+    unsigned long long total = 0;
+    int n;
+    if ((x = msgprof_find(gl, 0)))
+    {
+        msgprof_mark(x, owner);
+        total += x->p_excl;
+    }
+    for (y = gl->gl_list; y; y = y->g_next)
+    {
+        if (pd_class(&y->g_pd) == canvas_class)
+            total += msgprof_traverse(r, (t_glist *)y, gl);
+        else if ((x = msgprof_find(y, 0)))
+        {
+            msgprof_mark(x, gl);
+            total += x->p_excl;
+        }
+    }
+    if (r->r_ncanvases == r->r_size)
+    {
+        n = 2 * r->r_size + 16;
+        r->r_canvases = (t_msgcanvas *)resizebytes(r->r_canvases,
+            r->r_size * sizeof(t_msgcanvas), n * sizeof(t_msgcanvas));
+        r->r_size = n;
+    }
+    r->r_canvases[r->r_ncanvases].c_glist = gl;
+    r->r_canvases[r->r_ncanvases++].c_total = total;
+    return (total);
+}
+
+static int msgprof_compare(const void *a, const void *b)
+{
+    const t_msgprof *x = *(t_msgprof **)a, *y = *(t_msgprof **)b;
+    return (x->p_excl < y->p_excl ? 1 : (x->p_excl > y->p_excl ? -1 : 0));
+}
+
+static int msgprof_comparecanvas(const void *a, const void *b)
+{
+    const t_msgcanvas *x = (t_msgcanvas *)a, *y = (t_msgcanvas *)b;
+    return (x->c_total < y->c_total ? 1 : (x->c_total > y->c_total ? -1 : 0));
+}
+
+    /* the text of an object's box, or the name of a canvas */
+static void msgprof_name(t_pd *x, char *buf, int size)
+{
+    t_binbuf *b;
+    char *text;
+    int length;
+    if (*x == canvas_class && !((t_glist *)x)->gl_owner)
+        snprintf(buf, size, "%s", ((t_glist *)x)->gl_name->s_name);
+    else if (pd_checkobject(x) && (b = ((t_object *)x)->te_binbuf) &&
+        binbuf_getnatom(b))
+    {
+        binbuf_gettext(b, &text, &length);
+        snprintf(buf, size, "%.*s%s", (length < size - 4 ? length : size - 4),
+            text, (length < size - 4 ? "" : "..."));
+        freebytes(text, length);
+    }
+    else snprintf(buf, size, "%s", class_getname(*x));
+}
+
+static void msgprof_print(int max)
+{
+    t_msgreport r;
+    t_msgprof *x, **vec;
+    t_canvas *gl;
+    int i, n = 0;
+    double elapsed = sys_getrealtime() - msgprof_starttime, usecpercount;
+    char name[MAXPDSTRING], owner[MAXPDSTRING];
+    for (i = 0; i < MSGPROFHASH; i++)
+        for (x = msgprof_hash[i]; x; x = x->p_next)
+            x->p_found = 0;
+    r.r_canvases = 0;
+    r.r_ncanvases = r.r_size = 0;
+    for (gl = pd_getcanvaslist(); gl; gl = gl->gl_next)
+        msgprof_traverse(&r, gl, 0);
+    for (i = 0; i < MSGPROFHASH; i++)
+        for (x = msgprof_hash[i]; x; x = x->p_next)
+            if (x->p_found && x->p_nmess)
+                n++;
+    if (!n || elapsed <= 0)
+    {
+        post("msg-profile: no messages yet");
+        goto done;
+    }
+    usecpercount = 1e6 * elapsed / (double)(PROFILE_NOW() - msgprof_start);
+    vec = (t_msgprof **)getbytes(n * sizeof(*vec));
+    for (i = n = 0; i < MSGPROFHASH; i++)
+        for (x = msgprof_hash[i]; x; x = x->p_next)
+            if (x->p_found && x->p_nmess)
+                vec[n++] = x;
+    qsort(vec, n, sizeof(*vec), msgprof_compare);
+    post("msg-profile: %d objects in %.1f seconds; messages, usec total \
+(exclusive), usec total (inclusive):", n, elapsed);
+    for (i = 0; i < n && i < max; i++)
+    {
+        msgprof_name((t_pd *)vec[i]->p_who, name, 40);
+        if (vec[i]->p_owner)
+            msgprof_name(&vec[i]->p_owner->gl_pd, owner, 40);
+        else *owner = 0;
+        post("%9lu %11.1f %11.1f  %s%s%s", vec[i]->p_nmess,
+            vec[i]->p_excl * usecpercount, vec[i]->p_incl * usecpercount,
+                name, (*owner ? " in " : ""), owner);
+    }
+    if (n > max)
+        post("... (%d more)", n - max);
+    freebytes(vec, n * sizeof(*vec));
+    qsort(r.r_canvases, r.r_ncanvases, sizeof(t_msgcanvas),
+        msgprof_comparecanvas);
+    post("msg-profile: canvases, usec total of all inside:");
+    for (i = 0; i < r.r_ncanvases && i < max &&
+        r.r_canvases[i].c_total; i++)
+    {
+        msgprof_name(&r.r_canvases[i].c_glist->gl_pd, name, 40);
+        post("%11.1f  %s", r.r_canvases[i].c_total * usecpercount, name);
+    }
+done:
+    if (r.r_canvases)
+        freebytes(r.r_canvases, r.r_size * sizeof(t_msgcanvas));
+}
+
+    /* "pd msg-profile 1" or "0" turns profiling on or off; "pd msg-profile
+    print [n]" prints the n (default 20) most expensive objects and
+    canvases. */
+void glob_msgprofile(void *dummy, t_symbol *s, int argc, t_atom *argv)
+{
+    if (argc && argv->a_type == A_SYMBOL &&
+        !strcmp(argv->a_w.w_symbol->s_name, "print"))
+    {
+        if (!msgprof_hash)
+            post("msg-profile: profiling is off");
+        else msgprof_print(argc > 1 ? atom_getfloatarg(1, argc, argv) : 20);
+    }
+    else if (argc)
+        msgprof_set(atom_getfloatarg(0, argc, argv) != 0);
+    else post("msg-profile: profiling is %s",
+        (msgprof_hash ? "on" : "off"));
+}
+
     /* get pointer to connection list for an outlet (for editing/traversing) */
 static t_outconnect **outlet_getconnectionpointer(t_outlet *x)
 {
@@ -398,7 +769,7 @@ static void backtracer_printmsg(t_pd *who, t_symbol *s,
 static void backtracer_anything(t_backtracer *x, t_symbol *s,
     int argc, t_atom *argv)
 {
-    t_msgstack *m = (t_msgstack *)t_getbytes(sizeof(t_msgstack));
+    t_msgstack *m = (t_msgstack *)pool_getbytes(sizeof(t_msgstack));
     t_outconnect *oc;
     int ncopy = (argc > NARGS ? NARGS : argc), i;
     m->m_next = backtracer_stack;
@@ -413,7 +784,7 @@ static void backtracer_anything(t_backtracer *x, t_symbol *s,
     for (oc = x->b_connections; oc; oc = oc->oc_next)
         typedmess(oc->oc_to, s, argc, argv);
     backtracer_stack = m->m_next;
-    t_freebytes(m, sizeof(*m));
+    pool_freebytes(m, sizeof(*m));
 }
 
 t_backtracer *backtracer_new(t_pd *owner)
@@ -490,17 +861,27 @@ void glob_settracing(void *dummy, t_float f)
 #endif
 }
 
+    /* bumped whenever any connection is made or freed, so that code caching
+    t_outconnect pointers (the editor's hit testing) knows to forget them */
+static int obj_connectionserial;
+
+int obj_connectserial(void)
+{
+    return (obj_connectionserial);
+}
+
     /* this is called on every object, via canvas_settracing() call above */
 void obj_dosettracing(t_object *ob, int onoff)
 {
     t_outlet *o;
+    obj_connectionserial++;
     for (o = ob->ob_outlet; o; o = o->o_next)
     {
         if (onoff)
         {
             t_backtracer *b = backtracer_new(&ob->ob_pd);
             b->b_connections = o->o_connections;
-            o->o_connections =  (t_outconnect *)t_getbytes(sizeof(t_outconnect));
+            o->o_connections =  (t_outconnect *)pool_getbytes(sizeof(t_outconnect));
             o->o_connections->oc_next = 0;
             o->o_connections->oc_to = &b->b_pd;
         }
@@ -508,17 +889,18 @@ void obj_dosettracing(t_object *ob, int onoff)
             (*o->o_connections->oc_to == backtracer_class))
         {
             t_backtracer *b = (t_backtracer *)o->o_connections->oc_to;
-            t_freebytes(o->o_connections, sizeof(*o->o_connections));
+            pool_freebytes(o->o_connections, sizeof(*o->o_connections));
             o->o_connections = b->b_connections;
             t_freebytes(b, sizeof(*b));
         }
         else bug("obj_dosettracing");
+        outlet_refan(o);
     }
 }
 
 t_outlet *outlet_new(t_object *owner, t_symbol *s)
 {
-    t_outlet *x = (t_outlet *)getbytes(sizeof(*x)), *y, *y2;
+    t_outlet *x = (t_outlet *)pool_getbytes(sizeof(*x)), *y, *y2;
     x->o_owner = owner;
     x->o_next = 0;
     if ((y = owner->ob_outlet))
@@ -530,12 +912,16 @@ t_outlet *outlet_new(t_object *owner, t_symbol *s)
     if (backtracer_cantrace)
     {
         t_backtracer *b = backtracer_new(&owner->ob_pd);
-        x->o_connections =  (t_outconnect *)t_getbytes(sizeof(t_outconnect));
+        x->o_connections =  (t_outconnect *)pool_getbytes(sizeof(t_outconnect));
         x->o_connections->oc_next = 0;
         x->o_connections->oc_to = &b->b_pd;
     }
     else x->o_connections = 0;
     x->o_sym = s;
+    x->o_nfan = 0;
+    x->o_fansize = OUTLET_NFANINLINE;
+    x->o_fan = x->o_faninline;
+    outlet_refan(x);
     return (x);
 }
 
@@ -546,71 +932,114 @@ static void outlet_stackerror(t_outlet *x)
 
 void outlet_bang(t_outlet *x)
 {
-    t_outconnect *oc;
+    int i;
     if(++stackcount >= STACKITER)
         outlet_stackerror(x);
+    else if (outlet_msgprofiling)
+        for (i = 0; i < x->o_nfan; i++)
+    {
+        outlet_msgprofilebegin(x->o_fan[i].f_to);
+        pd_bang(x->o_fan[i].f_to);
+        outlet_msgprofileend();
+    }
     else
-    for (oc = x->o_connections; oc; oc = oc->oc_next)
-        pd_bang(oc->oc_to);
+    for (i = 0; i < x->o_nfan; i++)
+        pd_bang(x->o_fan[i].f_to);
     --stackcount;
 }
 
 void outlet_pointer(t_outlet *x, t_gpointer *gp)
 {
-    t_outconnect *oc;
+    int i;
     t_gpointer gpointer;
     if(++stackcount >= STACKITER)
         outlet_stackerror(x);
     else
     {
         gpointer = *gp;
-        for (oc = x->o_connections; oc; oc = oc->oc_next)
-            pd_pointer(oc->oc_to, &gpointer);
+        for (i = 0; i < x->o_nfan; i++)
+        {
+            if (outlet_msgprofiling)
+            {
+                outlet_msgprofilebegin(x->o_fan[i].f_to);
+                pd_pointer(x->o_fan[i].f_to, &gpointer);
+                outlet_msgprofileend();
+            }
+            else pd_pointer(x->o_fan[i].f_to, &gpointer);
+        }
     }
     --stackcount;
 }
 
 void outlet_float(t_outlet *x, t_float f)
 {
-    t_outconnect *oc;
+    int i;
     if(++stackcount >= STACKITER)
         outlet_stackerror(x);
+    else if (outlet_msgprofiling)
+        for (i = 0; i < x->o_nfan; i++)
+    {
+        outlet_msgprofilebegin(x->o_fan[i].f_to);
+        (*x->o_fan[i].f_float)(x->o_fan[i].f_to, f);
+        outlet_msgprofileend();
+    }
     else
-    for (oc = x->o_connections; oc; oc = oc->oc_next)
-        pd_float(oc->oc_to, f);
+    for (i = 0; i < x->o_nfan; i++)
+        (*x->o_fan[i].f_float)(x->o_fan[i].f_to, f);
     --stackcount;
 }
 
 void outlet_symbol(t_outlet *x, t_symbol *s)
 {
-    t_outconnect *oc;
+    int i;
     if(++stackcount >= STACKITER)
         outlet_stackerror(x);
+    else if (outlet_msgprofiling)
+        for (i = 0; i < x->o_nfan; i++)
+    {
+        outlet_msgprofilebegin(x->o_fan[i].f_to);
+        pd_symbol(x->o_fan[i].f_to, s);
+        outlet_msgprofileend();
+    }
     else
-    for (oc = x->o_connections; oc; oc = oc->oc_next)
-        pd_symbol(oc->oc_to, s);
+    for (i = 0; i < x->o_nfan; i++)
+        pd_symbol(x->o_fan[i].f_to, s);
     --stackcount;
 }
 
 void outlet_list(t_outlet *x, t_symbol *s, int argc, t_atom *argv)
 {
-    t_outconnect *oc;
+    int i;
     if(++stackcount >= STACKITER)
         outlet_stackerror(x);
+    else if (outlet_msgprofiling)
+        for (i = 0; i < x->o_nfan; i++)
+    {
+        outlet_msgprofilebegin(x->o_fan[i].f_to);
+        pd_list(x->o_fan[i].f_to, s, argc, argv);
+        outlet_msgprofileend();
+    }
     else
-    for (oc = x->o_connections; oc; oc = oc->oc_next)
-        pd_list(oc->oc_to, s, argc, argv);
+    for (i = 0; i < x->o_nfan; i++)
+        pd_list(x->o_fan[i].f_to, s, argc, argv);
     --stackcount;
 }
 
 void outlet_anything(t_outlet *x, t_symbol *s, int argc, t_atom *argv)
 {
-    t_outconnect *oc;
+    int i;
     if(++stackcount >= STACKITER)
         outlet_stackerror(x);
+    else if (outlet_msgprofiling)
+        for (i = 0; i < x->o_nfan; i++)
+    {
+        outlet_msgprofilebegin(x->o_fan[i].f_to);
+        typedmess(x->o_fan[i].f_to, s, argc, argv);
+        outlet_msgprofileend();
+    }
     else
-    for (oc = x->o_connections; oc; oc = oc->oc_next)
-        typedmess(oc->oc_to, s, argc, argv);
+    for (i = 0; i < x->o_nfan; i++)
+        typedmess(x->o_fan[i].f_to, s, argc, argv);
     --stackcount;
 }
 
@@ -631,7 +1060,9 @@ void outlet_free(t_outlet *x)
         x2->o_next = x->o_next;
         break;
     }
-    t_freebytes(x, sizeof(*x));
+    if (x->o_fan != x->o_faninline)
+        freebytes(x->o_fan, x->o_fansize * sizeof(t_fanout));
+    pool_freebytes(x, sizeof(*x));
 }
 
     /* connect an outlet of one object to an inlet of another.  The receiving
@@ -662,7 +1093,7 @@ t_outconnect *obj_connect(t_object *source, int outno,
     to = &i->i_pd;
 doit:
     ochead = outlet_getconnectionpointer(o);
-    oc = (t_outconnect *)t_getbytes(sizeof(*oc));
+    oc = (t_outconnect *)pool_getbytes(sizeof(*oc));
     oc->oc_next = 0;
     oc->oc_to = to;
         /* append it to the end of the list */
@@ -674,7 +1105,9 @@ doit:
         oc2->oc_next = oc;
     }
     else *ochead = oc;
-    if (o->o_sym == &s_signal) canvas_update_dsp();
+    outlet_refan(o);
+    obj_connectionserial++;
+    if (o->o_sym == &s_signal) canvas_update_dspconnect();
 
     return (oc);
 }
@@ -706,7 +1139,7 @@ doit:
     if (oc->oc_to == to)
     {
         *ochead = oc->oc_next;
-        freebytes(oc, sizeof(*oc));
+        pool_freebytes(oc, sizeof(*oc));
         goto done;
     }
     while ((oc2 = oc->oc_next))
@@ -714,12 +1147,14 @@ doit:
         if (oc2->oc_to == to)
         {
             oc->oc_next = oc2->oc_next;
-            freebytes(oc2, sizeof(*oc2));
+            pool_freebytes(oc2, sizeof(*oc2));
             goto done;
         }
         oc = oc2;
     }
 done:
+    outlet_refan(o);
+    obj_connectionserial++;
     if (o->o_sym == &s_signal) canvas_update_dsp();
 }
 
@@ -6,6 +6,7 @@
 #include <string.h>
 #include "m_pd.h"
 #include "m_imp.h"
+#include "s_stuff.h"
 #include "g_canvas.h"   /* just for LB_LOAD */
 
     /* FIXME no out-of-memory testing yet! */
@@ -17,6 +18,8 @@ t_pd *pd_new(t_class *c)
         bug ("pd_new: apparently called before setup routine");
         return NULL;
     }
+    if (mem_accounting)
+        mem_setclass(c);
     x = (t_pd *)t_getbytes(c->c_size);
     *x = c;
     if (c->c_patchable)
@@ -30,6 +33,8 @@ t_pd *pd_new(t_class *c)
 void pd_free(t_pd *x)
 {
     t_class *c = *x;
+    if (outlet_msgprofiling)
+        outlet_msgprofileforget(x);
     if (c->c_freemethod) (*(t_gotfn)(c->c_freemethod))(x);
     if (c->c_patchable)
     {
@@ -52,70 +57,207 @@ void gobj_save(t_gobj *x, t_binbuf *b)
 
 /* deal with several objects bound to the same symbol.  If more than one, we
 actually bind a collection object to the symbol, which forwards messages sent
-to the symbol. */
+to the symbol.  The receivers are kept in an array, oldest first, and
+messages go to them newest first.  Unbinding just clears the receiver's slot
+(found through a hash table if there are many) so that it's safe to do while
+a message is being forwarded; the array is compacted, and the bindlist
+replaced by the receiver itself when only one is left, once no message is
+being forwarded any more. */
 
 static t_class *bindlist_class;
 
-typedef struct _bindelem
-{
-    t_pd *e_who;
-    struct _bindelem *e_next;
-} t_bindelem;
+#define BINDHASHMIN 16  /* make a hash table for more receivers than this */
 
 typedef struct _bindlist
 {
     t_pd b_pd;
-    t_bindelem *b_list;
+    t_symbol *b_sym;    /* symbol we're bound to */
+    t_pd **b_vec;       /* receivers, or 0 for ones that have been unbound */
+    int b_n;            /* number of slots used in b_vec */
+    int b_size;         /* number of slots allocated */
+    int b_nlive;        /* number of receivers still bound */
+    int b_inuse;        /* depth of messages being forwarded */
+    int *b_hash;        /* 1 + slot number for each receiver, or 0 */
+    int b_hashsize;     /* size of b_hash, a power of two, or 0 if none */
 } t_bindlist;
 
+#define BINDHASH(x, who) \
+    ((int)(((size_t)(who) >> 4) * 2654435761u) & ((x)->b_hashsize - 1))
+
+static void bindlist_hashput(t_bindlist *x, int slot)
+{
+    int i = BINDHASH(x, x->b_vec[slot]);
+    while (x->b_hash[i])
+        i = (i + 1) & (x->b_hashsize - 1);
+    x->b_hash[i] = slot + 1;
+}
+
+    /* (re)build the hash table if there are enough receivers for one */
+static void bindlist_rehash(t_bindlist *x)
+{
+    int i;
+    if (x->b_hash)
+        freebytes(x->b_hash, x->b_hashsize * sizeof(*x->b_hash));
+    x->b_hash = 0;
+    x->b_hashsize = 0;
+    if (x->b_nlive <= BINDHASHMIN)
+        return;
+    for (x->b_hashsize = 64; x->b_hashsize < 2 * x->b_size; )
+        x->b_hashsize *= 2;
+    x->b_hash = (int *)getbytes(x->b_hashsize * sizeof(*x->b_hash));
+    for (i = 0; i < x->b_n; i++)
+        if (x->b_vec[i])
+            bindlist_hashput(x, i);
+}
+
+static void bindlist_add(t_bindlist *x, t_pd *who)
+{
+    if (x->b_n == x->b_size)
+    {
+        int newsize = 2 * x->b_size;
+        x->b_vec = (t_pd **)resizebytes(x->b_vec,
+            x->b_size * sizeof(*x->b_vec), newsize * sizeof(*x->b_vec));
+        x->b_size = newsize;
+        if (x->b_hash)
+        {
+            x->b_vec[x->b_n++] = who;
+            x->b_nlive++;
+            bindlist_rehash(x);
+            return;
+        }
+    }
+    x->b_vec[x->b_n++] = who;
+    x->b_nlive++;
+    if (x->b_hash)
+        bindlist_hashput(x, x->b_n - 1);
+    else if (x->b_nlive > BINDHASHMIN)
+        bindlist_rehash(x);
+}
+
+    /* find the slot of the newest binding of "who", or -1 */
+static int bindlist_find(t_bindlist *x, t_pd *who)
+{
+    int i;
+    if (x->b_hash)
+    {
+        int found = -1;
+        for (i = BINDHASH(x, who); x->b_hash[i];
+            i = (i + 1) & (x->b_hashsize - 1))
+                if (x->b_vec[x->b_hash[i] - 1] == who &&
+                    x->b_hash[i] - 1 > found)
+                        found = x->b_hash[i] - 1;
+        return (found);
+    }
+    for (i = x->b_n; i--; )
+        if (x->b_vec[i] == who)
+            return (i);
+    return (-1);
+}
+
+    /* take a slot out of the hash table, moving later entries in its
+    cluster back so that no tombstones are needed */
+static void bindlist_hashremove(t_bindlist *x, int slot)
+{
+    int i, j, k, mask = x->b_hashsize - 1;
+    for (i = BINDHASH(x, x->b_vec[slot]); x->b_hash[i] != slot + 1;
+        i = (i + 1) & mask)
+            ;
+    for (j = i; ; )
+    {
+        x->b_hash[i] = 0;
+        do
+        {
+            j = (j + 1) & mask;
+            if (!x->b_hash[j])
+                return;
+            k = BINDHASH(x, x->b_vec[x->b_hash[j] - 1]);
+        } while (i <= j ? (i < k && k <= j) : (i < k || k <= j));
+        x->b_hash[i] = x->b_hash[j];
+        i = j;
+    }
+}
+
+static void bindlist_free(t_bindlist *x)
+{
+    freebytes(x->b_vec, x->b_size * sizeof(*x->b_vec));
+    if (x->b_hash)
+        freebytes(x->b_hash, x->b_hashsize * sizeof(*x->b_hash));
+}
+
+    /* called when done forwarding a message: if there's only one receiver
+    left, bind it straight to the symbol; otherwise squeeze out the empty
+    slots if there are many. */
+static void bindlist_tidy(t_bindlist *x)
+{
+    if (x->b_nlive <= 1)
+    {
+        int i;
+        t_pd *who = 0;
+        for (i = 0; i < x->b_n; i++)
+            if (x->b_vec[i])
+                who = x->b_vec[i];
+        x->b_sym->s_thing = who;
+        pd_free(&x->b_pd);
+    }
+    else if (x->b_n > 2 * x->b_nlive)
+    {
+        int i, j;
+        for (i = j = 0; i < x->b_n; i++)
+            if (x->b_vec[i])
+                x->b_vec[j++] = x->b_vec[i];
+        x->b_n = j;
+        bindlist_rehash(x);
+    }
+}
+
+#define BINDLIST_FORWARD(x, call) \
+{ \
+    int i; \
+    t_pd *who; \
+    x->b_inuse++; \
+    for (i = x->b_n; i--; ) \
+        if ((who = x->b_vec[i])) \
+            call; \
+    if (!--x->b_inuse && x->b_n > x->b_nlive) \
+        bindlist_tidy(x); \
+}
+
 static void bindlist_bang(t_bindlist *x)
 {
-    t_bindelem *e;
-    for (e = x->b_list; e; e = e->e_next)
-        pd_bang(e->e_who);
+    BINDLIST_FORWARD(x, pd_bang(who));
 }
 
 static void bindlist_float(t_bindlist *x, t_float f)
 {
-    t_bindelem *e;
-    for (e = x->b_list; e; e = e->e_next)
-        pd_float(e->e_who, f);
+    BINDLIST_FORWARD(x, pd_float(who, f));
 }
 
 static void bindlist_symbol(t_bindlist *x, t_symbol *s)
 {
-    t_bindelem *e;
-    for (e = x->b_list; e; e = e->e_next)
-        pd_symbol(e->e_who, s);
+    BINDLIST_FORWARD(x, pd_symbol(who, s));
 }
 
 static void bindlist_pointer(t_bindlist *x, t_gpointer *gp)
 {
-    t_bindelem *e;
-    for (e = x->b_list; e; e = e->e_next)
-        pd_pointer(e->e_who, gp);
+    BINDLIST_FORWARD(x, pd_pointer(who, gp));
 }
 
 static void bindlist_list(t_bindlist *x, t_symbol *s,
     int argc, t_atom *argv)
 {
-    t_bindelem *e;
-    for (e = x->b_list; e; e = e->e_next)
-        pd_list(e->e_who, s, argc, argv);
+    BINDLIST_FORWARD(x, pd_list(who, s, argc, argv));
 }
 
 static void bindlist_anything(t_bindlist *x, t_symbol *s,
     int argc, t_atom *argv)
 {
-    t_bindelem *e;
-    for (e = x->b_list; e; e = e->e_next)
-        pd_typedmess(e->e_who, s, argc, argv);
+    BINDLIST_FORWARD(x, pd_typedmess(who, s, argc, argv));
 }
 
 void m_pd_setup(void)
 {
-    bindlist_class = class_new(gensym("bindlist"), 0, 0,
-        sizeof(t_bindlist), CLASS_PD, 0);
+    bindlist_class = class_new(gensym("bindlist"), 0,
+        (t_method)bindlist_free, sizeof(t_bindlist), CLASS_PD, 0);
     class_addbang(bindlist_class, bindlist_bang);
     class_addfloat(bindlist_class, (t_method)bindlist_float);
     class_addsymbol(bindlist_class, bindlist_symbol);
@@ -124,28 +266,37 @@ void m_pd_setup(void)
     class_addanything(bindlist_class, bindlist_anything);
 }
 
+    /* counts calls to pd_bind() and pd_unbind() anywhere, so that whoever
+    keeps the result of pd_findbyclass() can tell it might have changed */
+static int bindserial;
+
+int pd_bindserial(void)
+{
+    return (bindserial);
+}
+
+static void findcache_forget(void);
+
 void pd_bind(t_pd *x, t_symbol *s)
 {
+    bindserial++;
+    findcache_forget();
     if (s->s_thing)
     {
         if (*s->s_thing == bindlist_class)
-        {
-            t_bindlist *b = (t_bindlist *)s->s_thing;
-            t_bindelem *e = (t_bindelem *)getbytes(sizeof(t_bindelem));
-            e->e_next = b->b_list;
-            e->e_who = x;
-            b->b_list = e;
-        }
+            bindlist_add((t_bindlist *)s->s_thing, x);
         else
         {
             t_bindlist *b = (t_bindlist *)pd_new(bindlist_class);
-            t_bindelem *e1 = (t_bindelem *)getbytes(sizeof(t_bindelem));
-            t_bindelem *e2 = (t_bindelem *)getbytes(sizeof(t_bindelem));
-            b->b_list = e1;
-            e1->e_who = x;
-            e1->e_next = e2;
-            e2->e_who = s->s_thing;
-            e2->e_next = 0;
+            b->b_sym = s;
+            b->b_size = 4;
+            b->b_vec = (t_pd **)getbytes(b->b_size * sizeof(*b->b_vec));
+            b->b_vec[0] = s->s_thing;
+            b->b_vec[1] = x;
+            b->b_n = b->b_nlive = 2;
+            b->b_inuse = 0;
+            b->b_hash = 0;
+            b->b_hashsize = 0;
             s->s_thing = &b->b_pd;
         }
     }
@@ -154,38 +305,146 @@ void pd_bind(t_pd *x, t_symbol *s)
 
 void pd_unbind(t_pd *x, t_symbol *s)
 {
+    int i;
+    bindserial++;
+    findcache_forget();
     if (s->s_thing == x) s->s_thing = 0;
-    else if (s->s_thing && *s->s_thing == bindlist_class)
+    else if (s->s_thing && *s->s_thing == bindlist_class &&
+        (i = bindlist_find((t_bindlist *)s->s_thing, x)) >= 0)
     {
-            /* bindlists always have at least two elements... if the number
-            goes down to one, get rid of the bindlist and bind the symbol
-            straight to the remaining element. */
-
         t_bindlist *b = (t_bindlist *)s->s_thing;
-        t_bindelem *e, *e2;
-        if ((e = b->b_list)->e_who == x)
-        {
-            b->b_list = e->e_next;
-            freebytes(e, sizeof(t_bindelem));
-        }
-        else for (e = b->b_list; (e2 = e->e_next); e = e2)
-            if (e2->e_who == x)
-        {
-            e->e_next = e2->e_next;
-            freebytes(e2, sizeof(t_bindelem));
-            break;
-        }
-        if (!b->b_list->e_next)
-        {
-            s->s_thing = b->b_list->e_who;
-            freebytes(b->b_list, sizeof(t_bindelem));
-            pd_free(&b->b_pd);
-        }
+        if (b->b_hash)
+            bindlist_hashremove(b, i);
+        b->b_vec[i] = 0;
+        b->b_nlive--;
+            /* unless we're in the middle of forwarding a message, drop
+            the bindlist once there's only one receiver left */
+        if (!b->b_inuse && (b->b_nlive <= 1 || b->b_n > 2 * b->b_nlive))
+            bindlist_tidy(b);
     }
     else pd_error(x, "%s: couldn't unbind", s->s_name);
 }
 
+/* -------- remembering what pd_findbyclass() found while DSP is sorted ----- */
+
+    /* Every tabread~, delread~, throw~ and so on looks its name up when
+    the DSP chain is rebuilt, and if many other things are bound to the
+    same name (receives, say) each lookup goes through all of them.  While
+    the chain is being rebuilt the results are kept in a hash table keyed
+    by symbol and class.  Binding or unbinding anything forgets them all
+    by starting a new generation. */
+
+typedef struct _findentry
+{
+    t_symbol *f_sym;
+    const t_class *f_class;
+    t_pd *f_what;
+    unsigned int f_gen;     /* entry is only good in this generation */
+} t_findentry;
+
+typedef struct _findcache
+{
+    t_findentry *c_vec;
+    int c_size;             /* a power of 2 */
+    int c_n;                /* entries in the current generation */
+    unsigned int c_gen;
+    int c_on;
+} t_findcache;
+
+#define FINDCACHEMIN 256
+#define FINDHASH(s, c, mask) ((unsigned int)((((size_t)(s) >> 3) ^ \
+    ((size_t)(c) >> 5)) * 2654435761u) & (mask))
+
+static void findcache_forget(void)
+{
+    t_findcache *fc = STUFF->st_findcache;
+    if (fc && fc->c_n)
+    {
+        fc->c_gen++;
+        fc->c_n = 0;
+    }
+}
+
+    /* turn the cache on before sorting DSP and off after */
+void pd_findcache(int on)
+{
+    t_findcache *fc = STUFF->st_findcache;
+    if (!fc)
+    {
+        if (!on)
+            return;
+        fc = STUFF->st_findcache = (t_findcache *)getbytes(sizeof(*fc));
+        fc->c_size = FINDCACHEMIN;
+        fc->c_vec = (t_findentry *)getbytes(fc->c_size * sizeof(t_findentry));
+        fc->c_gen = 1;
+    }
+    findcache_forget();
+    fc->c_on = on;
+}
+
+void pd_freefindcache(void)
+{
+    t_findcache *fc = STUFF->st_findcache;
+    if (fc)
+    {
+        freebytes(fc->c_vec, fc->c_size * sizeof(t_findentry));
+        freebytes(fc, sizeof(*fc));
+        STUFF->st_findcache = 0;
+    }
+}
+
+static t_findentry *findcache_slot(t_findcache *fc, t_symbol *s,
+    const t_class *c)
+{
+    int mask = fc->c_size - 1, h = FINDHASH(s, c, mask);
+    t_findentry *e;
+    while ((e = &fc->c_vec[h])->f_gen == fc->c_gen &&
+        (e->f_sym != s || e->f_class != c))
+            h = (h + 1) & mask;
+    return (e);
+}
+
+    /* keep the table at most half full, dropping the old generations */
+static void findcache_grow(t_findcache *fc)
+{
+    t_findentry *old = fc->c_vec;
+    int i, oldsize = fc->c_size;
+    unsigned int gen = fc->c_gen;
+    fc->c_size *= 2;
+    fc->c_vec = (t_findentry *)getbytes(fc->c_size * sizeof(t_findentry));
+    for (i = 0; i < oldsize; i++)
+        if (old[i].f_gen == gen)
+            *findcache_slot(fc, old[i].f_sym, old[i].f_class) = old[i];
+    freebytes(old, oldsize * sizeof(t_findentry));
+}
+
+static t_pd *pd_dofindbyclass(t_symbol *s, const t_class *c);
+
 t_pd *pd_findbyclass(t_symbol *s, const t_class *c)
+{
+    t_findcache *fc = STUFF->st_findcache;
+    t_findentry *e;
+        /* not worth caching unless there's a bindlist to look through */
+    if (!fc || !fc->c_on || !s->s_thing || *s->s_thing != bindlist_class)
+        return (pd_dofindbyclass(s, c));
+    e = findcache_slot(fc, s, c);
+    if (e->f_gen != fc->c_gen)
+    {
+        if (2 * (fc->c_n + 1) > fc->c_size)
+        {
+            findcache_grow(fc);
+            e = findcache_slot(fc, s, c);
+        }
+        e->f_sym = s;
+        e->f_class = c;
+        e->f_what = pd_dofindbyclass(s, c);
+        e->f_gen = fc->c_gen;
+        fc->c_n++;
+    }
+    return (e->f_what);
+}
+
+static t_pd *pd_dofindbyclass(t_symbol *s, const t_class *c)
 {
     t_pd *x = 0;
 
@@ -194,17 +453,16 @@ t_pd *pd_findbyclass(t_symbol *s, const t_class *c)
     if (*s->s_thing == bindlist_class)
     {
         t_bindlist *b = (t_bindlist *)s->s_thing;
-        t_bindelem *e, *e2;
-        int warned = 0;
-        for (e = b->b_list; e; e = e->e_next)
-            if (*e->e_who == c)
+        int i, warned = 0;
+        for (i = b->b_n; i--; )
+            if (b->b_vec[i] && *b->b_vec[i] == c)
         {
             if (x && !warned)
             {
                 post("warning: %s: multiply defined", s->s_name);
                 warned = 1;
             }
-            x = e->e_who;
+            x = b->b_vec[i];
         }
     }
     return x;
@@ -231,6 +489,7 @@ int pd_setloadingabstraction(t_symbol *sym)
         if (foo->g_loadingabstraction == sym)
             return (1);
     pd_loadingabstraction = sym;
+    mem_addsymbolroot(&pd_loadingabstraction, sizeof(pd_loadingabstraction));
     return (0);
 }
 
@@ -300,6 +559,7 @@ void obj_init(void);
 void conf_init(void);
 void glob_init(void);
 void garray_init(void);
+void text_template_init(void);
 void ooura_term(void);
 
 void pd_init(void)
@@ -325,6 +585,7 @@ EXTERN void pd_init_systems(void) {
     obj_init();
     conf_init();
     glob_init();
+    text_template_init();
     garray_init();
     sys_unlock();
 }
@@ -9,8 +9,8 @@ extern "C" {
 #endif
 
 #define PD_MAJOR_VERSION 0
-#define PD_MINOR_VERSION 52
-#define PD_BUGFIX_VERSION 1
+#define PD_MINOR_VERSION 53
+#define PD_BUGFIX_VERSION 0
 #define PD_TEST_VERSION ""
 extern int pd_compatibilitylevel;   /* e.g., 43 for pd 0.43 compatibility */
 
@@ -239,6 +239,7 @@ typedef struct _text        /* patchable object - graphical, with text */
     short te_ypix;
     short te_width;             /* requested width in chars, 0 if auto */
     unsigned int te_type:2;     /* from defs below */
+    unsigned int te_notdrawn:1; /* out of view, so drawing was put off */
 } t_text;
 
 #define T_TEXT 0        /* just a textual comment */
@@ -366,6 +367,11 @@ EXTERN int binbuf_read_via_path(t_binbuf *b, const char *filename, const char *d
     int crflag);
 EXTERN int binbuf_write(const t_binbuf *x, const char *filename, const char *dir,
     int crflag);
+typedef struct _binbufwriter t_binbufwriter;
+EXTERN t_binbufwriter *binbuf_writer_new(const char *filename,
+    const char *dir, int crflag);
+EXTERN void binbuf_writer_add(t_binbufwriter *w, t_binbuf *x);
+EXTERN int binbuf_writer_free(t_binbufwriter *w);
 EXTERN void binbuf_evalfile(t_symbol *name, t_symbol *dir);
 EXTERN t_symbol *binbuf_realizedollsym(t_symbol *s, int ac, const t_atom *av,
     int tonew);
@@ -466,6 +472,7 @@ EXTERN const t_parentwidgetbehavior *pd_getparentwidget(t_pd *x);
 #define CLASS_GOBJ 2
 #define CLASS_PATCHABLE 3
 #define CLASS_NOINLET 8
+#define CLASS_MULTICHANNEL 0x10 /* same as class_setmultichannel() */
 
 #define CLASS_TYPEMASK 3
 
@@ -498,6 +505,9 @@ EXTERN const char *class_getname(const t_class *c);
 EXTERN const char *class_gethelpname(const t_class *c);
 EXTERN const char *class_gethelpdir(const t_class *c);
 EXTERN void class_setdrawcommand(t_class *c);
+EXTERN void class_setscalarsignalin(t_class *c);
+EXTERN void class_setmultichannel(t_class *c);
+EXTERN void class_setblockratein(t_class *c);
 EXTERN int class_isdrawcommand(const t_class *c);
 EXTERN void class_domainsignalin(t_class *c, int onset);
 EXTERN void class_set_extern_dir(t_symbol *s);
@@ -594,6 +604,15 @@ typedef union _sampleint_union {
 #define MAXLOGSIG 32
 #define MAXSIGSIZE (1 << MAXLOGSIG)
 
+    /* what a block-rate signal carries each block; see
+    signal_setblockrate() in d_ugen.c */
+typedef struct _blockrate
+{
+    t_sample b_value;   /* value at the start of the block */
+    t_sample b_inc;     /* increment per sample, zero if it's constant */
+    int b_vec;          /* true if the block is written out in s_vec instead */
+} t_blockrate;
+
 typedef struct _signal
 {
     int s_n;            /* number of points in the array */
@@ -605,6 +624,10 @@ typedef struct _signal
     struct _signal *s_nextfree;         /* next in freelist */
     struct _signal *s_nextused;         /* next in used list */
     int s_vecsize;      /* allocated size of array in points */
+    t_float *s_scalar;  /* if an unconnected inlet, the float it takes */
+    int s_nchans;       /* number of channels, each s_n points long and
+                        stored one after the other in s_vec */
+    t_blockrate *s_blockrate;   /* if a block-rate signal, its value */
 } t_signal;
 
 typedef t_int *(*t_perfroutine)(t_int *args);
@@ -617,6 +640,10 @@ EXTERN void dsp_add_plus(t_sample *in1, t_sample *in2, t_sample *out, int n);
 EXTERN void dsp_add_copy(t_sample *in, t_sample *out, int n);
 EXTERN void dsp_add_scalarcopy(t_float *in, t_sample *out, int n);
 EXTERN void dsp_add_zero(t_sample *out, int n);
+EXTERN void signal_setmultiout(t_signal **sig, int nchans);
+EXTERN void signal_setblockrate(t_signal *sig, t_blockrate *b);
+EXTERN void dsp_add_blockratefill(t_signal *sig);
+EXTERN void blockrate_fill(const t_blockrate *b, t_sample *vec, int n);
 
 EXTERN int sys_getblksize(void);
 EXTERN t_float sys_getsr(void);
@@ -634,8 +661,12 @@ EXTERN void mayer_ifft(int n, t_sample *real, t_sample *imag);
 EXTERN void mayer_realfft(int n, t_sample *real);
 EXTERN void mayer_realifft(int n, t_sample *real);
 
-EXTERN float *cos_table;
+EXTERN t_float *cos_table;
+#if PD_FLOATSIZE == 32
 #define LOGCOSTABSIZE 9
+#else
+#define LOGCOSTABSIZE 11
+#endif
 #define COSTABSIZE (1<<LOGCOSTABSIZE)
 
 EXTERN int canvas_suspend_dsp(void);
@@ -692,12 +723,18 @@ EXTERN_STRUCT _garray;
 EXTERN t_class *garray_class;
 EXTERN int garray_getfloatarray(t_garray *x, int *size, t_float **vec);
 EXTERN int garray_getfloatwords(t_garray *x, int *size, t_word **vec);
+EXTERN int garray_getfloatwords_readonly(t_garray *x, int *size,
+    t_word **vec);
 EXTERN void garray_redraw(t_garray *x);
+EXTERN void garray_redrawrange(t_garray *x, int onset, int n);
+EXTERN void garray_touch(t_garray *x, int onset, int n);
 EXTERN int garray_npoints(t_garray *x);
 EXTERN char *garray_vec(t_garray *x);
 EXTERN void garray_resize(t_garray *x, t_floatarg f);  /* avoid; use this: */
 EXTERN void garray_resize_long(t_garray *x, long n);   /* better version */
 EXTERN void garray_usedindsp(t_garray *x);
+EXTERN void garray_usedindsp_resizable(t_garray *x);
+EXTERN int garray_resizeserial(void);
 EXTERN void garray_setsaveit(t_garray *x, int saveit);
 EXTERN t_glist *garray_getglist(t_garray *x);
 EXTERN t_array *garray_getarray(t_garray *x);
@@ -812,6 +849,17 @@ static inline int PD_BIGORSMALL(t_float f)  /* exponent outside (-512,512) */
     || (f) > -1e-150 && (f) < 1e-150 )
 #endif
 #endif /* _MSC_VER */
+
+/* Pd normally has the FPU flush denormals to zero in the threads that run the
+DSP chain (see "-noflushdenormals").  If Pd and the externals are compiled with
+PD_FTZ defined, this is taken to be always the case and PD_BIGORSMALL() just
+returns 0, so that filters don't have to test their state every block.  NOTE
+that the test also resets filters that have blown up to infinity or NAN. */
+#ifdef PD_FTZ
+#undef PD_BIGORSMALL
+#define PD_BIGORSMALL(f) 0
+#endif
+
     /* get version number at run time */
 EXTERN void sys_getversion(int *major, int *minor, int *bugfix);
 
@@ -865,6 +913,8 @@ struct _pdinstance
 #if PDTHREADS
     int pd_islocked;
 #endif
+    int pd_symhashsize;         /* number of buckets in pd_symhash */
+    int pd_nsym;                /* number of symbols in it */
 };
 #define t_pdinstance struct _pdinstance
 EXTERN t_pdinstance pd_maininstance;
@@ -7,8 +7,21 @@
 #include "m_pd.h"
 #include "m_imp.h"
 #include "s_stuff.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
 #ifdef _WIN32
 #include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#endif
+#if defined(__SSE__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SCHED_MXCSR
 #endif
 
     /* LATER consider making this variable.  It's now the LCM of all sample
@@ -26,15 +39,24 @@ static int sys_quit;
 
 int sys_usecsincelastsleep(void);
 int sys_sleepgrain;
+int sys_tickless;       /* "-tickless": sleep through idle ticks */
 
 typedef void (*t_clockmethod)(void *client);
 
+/* Set clocks are kept in a binary heap ordered by c_settime, and for equal
+times by c_serial, which counts clock_set() calls so that clocks set to the
+same time go off in the order they were set.  The heap lives in STUFF;
+pd_this->pd_clock_setlist always points to the earliest clock (or is zero
+if none is set), so that it can be tested as before.  Setting and unsetting
+a clock are O(log n) in the number of set clocks. */
+
 struct _clock
 {
     double c_settime;       /* in TIMEUNITS; <0 if unset */
     void *c_owner;
     t_clockmethod c_fn;
-    struct _clock *c_next;
+    int c_heapindex;        /* our place in the heap if set */
+    double c_serial;        /* order of setting, for ties */
     t_float c_unit;         /* >0 if in TIMEUNITS; <0 if in samples */
 };
 
@@ -44,54 +66,126 @@ struct _clock
 
 t_clock *clock_new(void *owner, t_method fn)
 {
-    t_clock *x = (t_clock *)getbytes(sizeof *x);
+    t_clock *x = (t_clock *)pool_getbytes(sizeof *x);
     x->c_settime = -1;
     x->c_owner = owner;
     x->c_fn = (t_clockmethod)fn;
-    x->c_next = 0;
+    x->c_heapindex = -1;
+    x->c_serial = 0;
     x->c_unit = TIMEUNITPERMSEC;
     return (x);
 }
 
-void clock_unset(t_clock *x)
+#define CLOCK_BEFORE(a, b) ((a)->c_settime < (b)->c_settime || \
+    ((a)->c_settime == (b)->c_settime && (a)->c_serial < (b)->c_serial))
+
+static void clock_heapput(t_clock *x, int i)
+{
+    STUFF->st_clockheap[i] = x;
+    x->c_heapindex = i;
+}
+
+    /* move a clock toward the root until its parent is earlier */
+static void clock_siftup(int i)
+{
+    t_clock **heap = STUFF->st_clockheap, *x = heap[i];
+    while (i > 0)
+    {
+        int parent = (i - 1) >> 1;
+        if (!CLOCK_BEFORE(x, heap[parent]))
+            break;
+        clock_heapput(heap[parent], i);
+        i = parent;
+    }
+    clock_heapput(x, i);
+}
+
+    /* move a clock toward the leaves until its children are later */
+static void clock_siftdown(int i)
+{
+    t_clock **heap = STUFF->st_clockheap, *x = heap[i];
+    int n = STUFF->st_nclocks;
+    while (1)
+    {
+        int child = 2 * i + 1;
+        if (child >= n)
+            break;
+        if (child + 1 < n && CLOCK_BEFORE(heap[child+1], heap[child]))
+            child++;
+        if (!CLOCK_BEFORE(heap[child], x))
+            break;
+        clock_heapput(heap[child], i);
+        i = child;
+    }
+    clock_heapput(x, i);
+}
+
+static void clock_dounset(t_clock *x)
 {
     if (x->c_settime >= 0)
     {
-        if (x == pd_this->pd_clock_setlist)
-            pd_this->pd_clock_setlist = x->c_next;
-        else
+        int i = x->c_heapindex, n = --STUFF->st_nclocks;
+        if (i < n)
         {
-            t_clock *x2 = pd_this->pd_clock_setlist;
-            while (x2->c_next != x) x2 = x2->c_next;
-            x2->c_next = x->c_next;
+            t_clock *last = STUFF->st_clockheap[n];
+            clock_heapput(last, i);
+            if (i > 0 && CLOCK_BEFORE(last,
+                STUFF->st_clockheap[(i - 1) >> 1]))
+                    clock_siftup(i);
+            else clock_siftdown(i);
         }
+        pd_this->pd_clock_setlist = (n ? STUFF->st_clockheap[0] : 0);
         x->c_settime = -1;
+        x->c_heapindex = -1;
+    }
+}
+
+    /* perform routines may set and unset clocks; if the DSP chain is being
+    computed by several threads (see d_ugen.c) we protect the list here. */
+void clock_unset(t_clock *x)
+{
+    if (ugen_nparallel)
+    {
+        ugen_lockclocks();
+        clock_dounset(x);
+        ugen_unlockclocks();
+    }
+    else clock_dounset(x);
+}
+
+static void clock_doset(t_clock *x, double setticks)
+{
+    clock_dounset(x);
+    if (STUFF->st_nclocks == STUFF->st_clockheapsize)
+    {
+        int newsize = (STUFF->st_clockheapsize ?
+            2 * STUFF->st_clockheapsize : 64);
+        if (STUFF->st_clockheap)
+            STUFF->st_clockheap = (t_clock **)resizebytes(STUFF->st_clockheap,
+                STUFF->st_clockheapsize * sizeof(t_clock *),
+                    newsize * sizeof(t_clock *));
+        else STUFF->st_clockheap =
+            (t_clock **)getbytes(newsize * sizeof(t_clock *));
+        STUFF->st_clockheapsize = newsize;
     }
+    x->c_settime = setticks;
+    x->c_serial = STUFF->st_clockserial++;
+    clock_heapput(x, STUFF->st_nclocks++);
+    clock_siftup(x->c_heapindex);
+    pd_this->pd_clock_setlist = STUFF->st_clockheap[0];
 }
 
     /* set the clock to call back at an absolute system time */
 void clock_set(t_clock *x, double setticks)
 {
     if (setticks < pd_this->pd_systime) setticks = pd_this->pd_systime;
-    clock_unset(x);
-    x->c_settime = setticks;
-    if (pd_this->pd_clock_setlist &&
-        pd_this->pd_clock_setlist->c_settime <= setticks)
+    if (ugen_nparallel)
     {
-        t_clock *cbefore, *cafter;
-        for (cbefore = pd_this->pd_clock_setlist,
-            cafter = pd_this->pd_clock_setlist->c_next;
-                cbefore; cbefore = cafter, cafter = cbefore->c_next)
-        {
-            if (!cafter || cafter->c_settime > setticks)
-            {
-                cbefore->c_next = x;
-                x->c_next = cafter;
-                return;
-            }
-        }
+        ugen_lockclocks();
+        clock_doset(x, setticks);
+        ugen_unlockclocks();
     }
-    else x->c_next = pd_this->pd_clock_setlist, pd_this->pd_clock_setlist = x;
+    else clock_doset(x, setticks);
 }
 
     /* set the clock to call back after a delay in msec */
@@ -166,7 +260,7 @@ double clock_getsystimeafter(double delaytime)
 void clock_free(t_clock *x)
 {
     clock_unset(x);
-    freebytes(x, sizeof *x);
+    pool_freebytes(x, sizeof *x);
 }
 
 
@@ -178,20 +272,285 @@ void glob_audiostatus(void)
 static int sched_diored;
 static int sched_dioredtime;
 static int sched_meterson;
-static int sched_counter;
 
-static void sys_addhist(int n) {}   /* maybe revive this later for profiling */
-static void sys_clearhist(void) {}
+/* If "pd clock-budget <msec>" sets a nonzero budget, sched_tick() stops
+running clock callbacks once they have taken that much real time in one
+tick; the remaining ones, still at the head of the clock list, are run
+first in the following tick(s), with logical time held at the time they
+were actually run rather than going backward.  This trades a late audio
+block for some control jitter.  Deferrals are counted and reported at
+most once a second. */
+
+static double sched_clockbudget;    /* in seconds; 0 for no limit */
+static int sched_ndeferred;         /* number of ticks with deferrals */
+static double sched_deferredreporttime;
+
+void glob_clockbudget(void *dummy, t_floatarg f)
+{
+    sched_clockbudget = (f > 0 ? 0.001 * f : 0);
+}
+
+static void sched_reportdeferred(double now)
+{
+    if (now > sched_deferredreporttime + 1)
+    {
+        post("clock budget exceeded: clocks deferred in %d tick%s",
+                sched_ndeferred, (sched_ndeferred == 1 ? "" : "s"));
+        sched_ndeferred = 0;
+        sched_deferredreporttime = now;
+    }
+}
+
+/* ------------------------ scheduler telemetry ------------------------- */
+
+/* If turned on by "pd sched-telemetry <name> <msec>", the scheduler keeps
+histograms of how long each tick spends in clock callbacks and in DSP, how
+far the audio I/O's timing strays from the nominal tick period ("jitter"),
+and how long the idle task takes.  Bin k counts times from 2^k to 2^(k+1)
+microseconds (the first and last bins also take anything below or above.)
+We also count "late" ticks, whose computation took longer than a tick's
+worth of real time.  Every <msec> milliseconds these are sent to the
+receive name <name> as messages "clocks", "dsp", "jitter", and "idle", each
+followed by SCHEDNHIST counts, and "late" followed by the number of late
+ticks and the total number of ticks; then the counts start over.  The
+messages may be forwarded to a dashboard with [netsend], for instance.
+"pd sched-telemetry 0" turns this off. */
+
+#define SCHEDNHIST 16
+#define HIST_CLOCKS 0
+#define HIST_DSP 1
+#define HIST_JITTER 2
+#define HIST_IDLE 3
+#define NHISTS 4
+
+static int sched_telemetry;
+static t_symbol *sched_telemetrysym;
+static t_clock *sched_telemetryclock;
+static double sched_telemetryinterval;
+static int sched_hist[NHISTS][SCHEDNHIST];
+static int sched_nlate, sched_nticks;
+static double sched_lastdacstime;
+
+static void sched_addhist(int which, double seconds)
+{
+    int bin = 0;
+    double usec = 1e6 * seconds;
+    while (usec >= 2 && bin < SCHEDNHIST-1)
+        usec *= 0.5, bin++;
+    sched_hist[which][bin]++;
+}
+
+static void sched_clearhist(void)
+{
+    int i, j;
+    for (i = 0; i < NHISTS; i++)
+        for (j = 0; j < SCHEDNHIST; j++)
+            sched_hist[i][j] = 0;
+    sched_nlate = sched_nticks = 0;
+}
+
+static void sched_telemetry_tick(void *dummy)
+{
+    static const char *names[NHISTS] = {"clocks", "dsp", "jitter", "idle"};
+    t_atom at[SCHEDNHIST];
+    int i, j;
+    if (sched_telemetrysym->s_thing)
+    {
+        for (i = 0; i < NHISTS; i++)
+        {
+            for (j = 0; j < SCHEDNHIST; j++)
+                SETFLOAT(&at[j], sched_hist[i][j]);
+            pd_typedmess(sched_telemetrysym->s_thing, gensym(names[i]),
+                SCHEDNHIST, at);
+        }
+        SETFLOAT(&at[0], sched_nlate);
+        SETFLOAT(&at[1], sched_nticks);
+        pd_typedmess(sched_telemetrysym->s_thing, gensym("late"), 2, at);
+    }
+    sched_clearhist();
+    clock_delay(sched_telemetryclock, sched_telemetryinterval);
+}
+
+void glob_schedtelemetry(void *dummy, t_symbol *s, int argc, t_atom *argv)
+{
+    if (argc && argv->a_type == A_SYMBOL)
+    {
+        sched_telemetrysym = argv->a_w.w_symbol;
+        mem_addsymbolroot(&sched_telemetrysym, sizeof(sched_telemetrysym));
+        sched_telemetryinterval = (argc > 1 ?
+            atom_getfloatarg(1, argc, argv) : 1000);
+        if (sched_telemetryinterval < 1)
+            sched_telemetryinterval = 1;
+        if (!sched_telemetryclock)
+            sched_telemetryclock = clock_new(0, (t_method)sched_telemetry_tick);
+        sched_clearhist();
+        sched_lastdacstime = 0;
+        sched_telemetry = 1;
+        clock_delay(sched_telemetryclock, sched_telemetryinterval);
+    }
+    else
+    {
+        sched_telemetry = 0;
+        if (sched_telemetryclock)
+            clock_unset(sched_telemetryclock);
+    }
+}
+
+static int sched_adaptmisses;           /* misses in this window */
 
 void sys_log_error(int type)
 {
+    if (audio_pipeline_logerror(type))
+        return;
     if (type != ERR_NOTHING && !sched_diored &&
-        (sched_counter >= sched_dioredtime))
+        (STUFF->st_tickcount >= sched_dioredtime))
     {
         sys_vgui("pdtk_pd_dio 1\n");
         sched_diored = 1;
     }
-    sched_dioredtime = sched_counter + APPROXTICKSPERSEC;
+    if (type != ERR_NOTHING)
+        sched_adaptmisses++;
+    sched_dioredtime = STUFF->st_tickcount + APPROXTICKSPERSEC;
+}
+
+/* ---------------- adaptive audio buffer ("-adaptaudiobuf") --------------- */
+
+/* In adaptive mode the scheduler advance ("-audiobuf") follows the load.
+DIO errors reported by the audio APIs through sys_log_error(), and ticks
+whose computation took longer than the whole advance, count as misses.
+Every ADAPTWINDOW seconds we decide: if there were misses the advance grows
+by half (up to the maximum); after ADAPTQUIET seconds without any it
+shrinks by a fifth (down to the minimum).  A shrink that leads to misses
+doubles the quiet time needed before the next one, so that the setting
+settles near the lowest the load allows instead of oscillating.  Changing
+the advance means reopening the audio device, which m_mainloop() does just
+as for a change from the audio dialog; the first window after a reopen is
+ignored since the reopen itself usually causes errors.  Turn on with
+"pd audio-adapt <min msec> <max msec>", off with "pd audio-adapt 0";
+"pd audio-adapt" with no arguments reports the current state. */
+
+#define ADAPTWINDOW 2
+#define ADAPTQUIET 30
+#define ADAPTMAXQUIET 600
+
+static int sched_adapt;
+static int sched_adaptmin, sched_adaptmax;      /* msec */
+static int sched_adapttotal;            /* misses since turned on */
+static int sched_adaptnextcheck;        /* tick count for next decision */
+static int sched_adaptquiet;            /* quiet seconds needed to shrink */
+static int sched_adaptquietsofar;
+static int sched_adaptshrunk;           /* last change was a shrink */
+static int sched_adaptgrace;            /* windows to ignore */
+static int sched_adaptnchange;
+static int sched_adaptrequest;          /* new advance for m_mainloop() */
+
+static void sched_adaptset(int msec, int misses)
+{
+    if (!audio_isopen())
+        return;
+    post("audio-adapt: %s audio buffer to %d msec (%d miss%s)",
+        (msec > sys_schedadvance/1000 ? "growing" : "shrinking"), msec,
+            misses, (misses == 1 ? "" : "es"));
+    sched_adaptrequest = msec;
+    sched_adaptnchange++;
+    sched_adaptgrace = 1;
+    sys_quit = SYS_QUIT_RESTART;
+}
+
+    /* called at the end of each tick with the time it took */
+static void sched_adapttick(double ticktime)
+{
+    int misses, advance = sys_schedadvance/1000;
+    if (ticktime * 1e6 > sys_schedadvance)
+        sched_adaptmisses++;
+    if (STUFF->st_tickcount < sched_adaptnextcheck)
+        return;
+    misses = sched_adaptmisses;
+    sched_adaptmisses = 0;
+    sched_adaptnextcheck = STUFF->st_tickcount +
+        ADAPTWINDOW * APPROXTICKSPERSEC;
+    if (sched_adaptgrace || sched_adaptrequest)
+    {
+        if (!sched_adaptrequest)
+            sched_adaptgrace--;
+        return;
+    }
+    sched_adapttotal += misses;
+    if (misses)
+    {
+        sched_adaptquietsofar = 0;
+        if (sched_adaptshrunk && (sched_adaptquiet *= 2) > ADAPTMAXQUIET)
+            sched_adaptquiet = ADAPTMAXQUIET;
+        sched_adaptshrunk = 0;
+        if (advance < sched_adaptmax)
+            sched_adaptset((advance + advance/2 + 1 > sched_adaptmax ?
+                sched_adaptmax : advance + advance/2 + 1), misses);
+    }
+    else if ((sched_adaptquietsofar += ADAPTWINDOW) >= sched_adaptquiet &&
+        advance > sched_adaptmin)
+    {
+        sched_adaptquietsofar = 0;
+        sched_adaptshrunk = 1;
+        sched_adaptset((advance - advance/5 - 1 < sched_adaptmin ?
+            sched_adaptmin : advance - advance/5 - 1), 0);
+    }
+}
+
+    /* called from m_mainloop() with audio closed, to apply a new advance */
+static void sched_adaptapply(void)
+{
+    t_audiosettings as;
+    sys_get_audio_settings(&as);
+    as.a_advance = sched_adaptrequest;
+    sys_set_audio_settings(&as);
+    sched_adaptrequest = 0;
+}
+
+void sched_setadapt(int min, int max)
+{
+    if (min <= 0)
+    {
+        sched_adapt = 0;
+        return;
+    }
+    sched_adaptmin = min;
+    sched_adaptmax = (max > min ? max : min);
+    sched_adaptmisses = sched_adapttotal = sched_adaptnchange = 0;
+    sched_adaptquiet = ADAPTQUIET;
+    sched_adaptquietsofar = sched_adaptshrunk = sched_adaptgrace = 0;
+    sched_adaptnextcheck = STUFF->st_tickcount +
+        ADAPTWINDOW * APPROXTICKSPERSEC;
+    sched_adapt = 1;
+        /* start within the bounds */
+    if (sys_schedadvance/1000 < sched_adaptmin ||
+        sys_schedadvance/1000 > sched_adaptmax)
+    {
+        int msec = (sys_schedadvance/1000 < sched_adaptmin ?
+            sched_adaptmin : sched_adaptmax);
+        if (audio_isopen())
+            sched_adaptset(msec, 0);
+        else
+        {
+            sched_adaptrequest = msec;
+            sched_adaptapply();
+        }
+    }
+}
+
+void glob_audioadapt(void *dummy, t_symbol *s, int argc, t_atom *argv)
+{
+    if (argc)
+        sched_setadapt(atom_getfloatarg(0, argc, argv),
+            atom_getfloatarg(1, argc, argv));
+    else if (!sched_adapt)
+        post("audio-adapt: off; audio buffer %d msec",
+            sys_schedadvance/1000);
+    else post("audio-adapt: audio buffer %d msec (range %d-%d); "
+        "%d miss%s, %d change%s; %d quiet sec needed to shrink",
+            sys_schedadvance/1000, sched_adaptmin, sched_adaptmax,
+            sched_adapttotal, (sched_adapttotal == 1 ? "" : "es"),
+            sched_adaptnchange, (sched_adaptnchange == 1 ? "" : "s"),
+            sched_adaptquiet);
 }
 
 static int sched_lastinclip, sched_lastoutclip,
@@ -218,6 +577,8 @@ void sched_reopenmeplease(void)   /* request from s_audio for deferred reopen */
 
 void sched_set_using_audio(int flag)
 {
+    if (audio_pipeline_setusing(flag))
+        return;
     sched_useaudio = flag;
     if (flag == SCHED_AUDIO_NONE)
     {
@@ -235,19 +596,68 @@ void sched_set_using_audio(int flag)
     sys_vgui("pdtk_pd_audio %s\n", flag ? "on" : "off");
 }
 
+    /* set the FPU of the calling thread to flush denormals to zero
+    ("FTZ") and, where that's available, to read them as zero ("DAZ").
+    This is called before every tick since the thread that calls
+    sched_tick() can change when audio is reopened, and since checking
+    is cheap. */
+void sched_flushdenormals(void)
+{
+#if defined(SCHED_MXCSR)
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+    unsigned int bits = 0x8040;     /* FTZ and DAZ */
+#else
+    unsigned int bits = 0x8000;     /* some SSE-only CPUs lack DAZ */
+#endif
+    unsigned int csr = _mm_getcsr();
+    if ((csr & bits) != bits)
+        _mm_setcsr(csr | bits);
+#elif defined(__aarch64__) && defined(__GNUC__)
+    unsigned long fpcr;
+    __asm__ __volatile__ ("mrs %0, fpcr" : "=r" (fpcr));
+    if (!(fpcr & (1 << 24)))        /* FZ bit */
+        __asm__ __volatile__ ("msr fpcr, %0" : : "r" (fpcr | (1 << 24)));
+#elif defined(__arm__) && defined(__ARM_FP) && defined(__GNUC__)
+    unsigned int fpscr;
+    __asm__ __volatile__ ("vmrs %0, fpscr" : "=r" (fpscr));
+    if (!(fpscr & (1 << 24)))       /* FZ bit */
+        __asm__ __volatile__ ("vmsr fpscr, %0" : : "r" (fpscr | (1 << 24)));
+#endif
+}
+
+static PERTHREAD int sched_affinityserial = -1;
+
     /* take the scheduler forward one DSP tick, also handling clock timeouts */
 void sched_tick(void)
 {
     double next_sys_time = pd_this->pd_systime + SYSTIMEPERTICK;
     int countdown = 5000;
+    double starttime = (sched_telemetry || sched_clockbudget > 0 ||
+        sched_adapt ? sys_getrealtime() : 0), dsptime;
+    unsigned long long tracestart = (sys_tracing ? PROFILE_NOW() : 0),
+        clockstart, dspstart;
+    if (sys_flushdenormals)
+        sched_flushdenormals();
+    sys_bindthread(AFFINITY_SCHED, &sched_affinityserial);
     while (pd_this->pd_clock_setlist &&
         pd_this->pd_clock_setlist->c_settime < next_sys_time)
     {
         t_clock *c = pd_this->pd_clock_setlist;
-        pd_this->pd_systime = c->c_settime;
-        clock_unset(pd_this->pd_clock_setlist);
+            /* deferred clocks are late; don't move time backward */
+        if (c->c_settime > pd_this->pd_systime)
+            pd_this->pd_systime = c->c_settime;
+        clock_dounset(pd_this->pd_clock_setlist);
         outlet_setstacklim();
-        (*c->c_fn)(c->c_owner);
+        clockstart = (sys_tracing ? PROFILE_NOW() : 0);
+        if (outlet_msgprofiling)
+        {
+            outlet_msgprofilebegin(c->c_owner);
+            (*c->c_fn)(c->c_owner);
+            outlet_msgprofileend();
+        }
+        else (*c->c_fn)(c->c_owner);
+        if (clockstart)
+            sys_tracespan("sched", "clock", clockstart);
         if (!countdown--)
         {
             countdown = 5000;
@@ -255,10 +665,45 @@ void sched_tick(void)
         }
         if (sys_quit)
             return;
+        if (sched_clockbudget > 0 && pd_this->pd_clock_setlist &&
+            pd_this->pd_clock_setlist->c_settime < next_sys_time)
+        {
+            double now = sys_getrealtime();
+            if (now - starttime > sched_clockbudget)
+            {
+                sched_ndeferred++;
+                sched_reportdeferred(now);
+                break;
+            }
+        }
+    }
+    if (pd_this->pd_systime < next_sys_time)
+        pd_this->pd_systime = next_sys_time;
+    if (sys_inputrecording || sys_inputreplaying)
+        sys_inputaudio();
+    dspstart = (sys_tracing ? PROFILE_NOW() : 0);
+    if (sched_telemetry)
+    {
+        double endtime;
+        dsptime = sys_getrealtime();
+        dsp_tick();
+        endtime = sys_getrealtime();
+        sched_addhist(HIST_CLOCKS, dsptime - starttime);
+        sched_addhist(HIST_DSP, endtime - dsptime);
+        if (endtime - starttime >
+            STUFF->st_schedblocksize / STUFF->st_dacsr)
+                sched_nlate++;
+        sched_nticks++;
+    }
+    else dsp_tick();
+    if (dspstart)
+    {
+        sys_tracespan("sched", "dsp", dspstart);
+        sys_tracetick(tracestart);
     }
-    pd_this->pd_systime = next_sys_time;
-    dsp_tick();
-    sched_counter++;
+    if (sched_adapt)
+        sched_adapttick(sys_getrealtime() - starttime);
+    STUFF->st_tickcount++;
 }
 
 int sched_get_sleepgrain( void)
@@ -295,9 +740,16 @@ static int sched_idletask( void)
 {
     static int sched_nextmeterpolltime, sched_nextpingtime;
     int rtn = 0;
+    unsigned long long tracestart;
     sys_lock();
+    tracestart = (sys_tracing ? PROFILE_NOW() : 0);
     if (sys_pollgui())
+    {
         rtn = 1;
+        if (tracestart)
+            sys_tracespan("sched", "pollgui", tracestart);
+    }
+    sys_lockreport();
     sys_unlock();
 
 #if defined(__linux__) || defined(__FreeBSD__) || defined(__FreeBSD_kernel__)\
@@ -306,27 +758,95 @@ static int sched_idletask( void)
         where we arrange to ping the watchdog every 2 seconds.  (If there's
         a GUI, it initiates the ping instead to be sure there's communication
         back and forth.) */
-    if (!sys_havegui() && sys_hipriority && sched_counter > sched_nextpingtime)
+    if (!sys_havegui() && sys_hipriority &&
+        STUFF->st_tickcount > sched_nextpingtime)
     {
         glob_watchdog(0);
             /* ping every 2 seconds */
-        sched_nextpingtime = sched_counter + 2 * APPROXTICKSPERSEC;
+        sched_nextpingtime = STUFF->st_tickcount + 2 * APPROXTICKSPERSEC;
     }
 #endif
 
         /* clear the "DIO error" warning 1 sec after it flashes */
-    if (sched_counter > sched_nextmeterpolltime)
+    if (STUFF->st_tickcount > sched_nextmeterpolltime)
     {
-        if (sched_diored && (sched_counter - sched_dioredtime > 0))
+        if (sched_diored && (STUFF->st_tickcount - sched_dioredtime > 0))
         {
             sys_vgui("pdtk_pd_dio 0\n");
             sched_diored = 0;
         }
-        sched_nextmeterpolltime = sched_counter + APPROXTICKSPERSEC;
+        sched_nextmeterpolltime = STUFF->st_tickcount + APPROXTICKSPERSEC;
     }
     return (rtn || sys_idlehook && sys_idlehook());
 }
 
+    /* call the idle task, timing it if we're gathering telemetry */
+static int sched_doidletask(void)
+{
+    double starttime;
+    int rtn;
+    if (!sched_telemetry)
+        return (sched_idletask());
+    starttime = sys_getrealtime();
+    rtn = sched_idletask();
+    sched_addhist(HIST_IDLE, sys_getrealtime() - starttime);
+    return (rtn);
+}
+
+/* With "-tickless", when there's no audio and DSP is off, an idle scheduler
+doesn't wake up every tick (or sleep grain) but sleeps until the tick that
+will run the next clock, or until a file descriptor is ready, and then skips
+the empty ticks in between by moving logical time forward.  Since another
+thread might set a clock while we sleep (with the lock held), sleeps are
+no longer than TICKLESS_MAXSLEEP.  MIDI input (see -nomidi), idle hooks and
+input logs need the scheduler to look every tick, so they turn this off. */
+
+#define TICKLESS_MAXSLEEP 0.1   /* seconds */
+
+static int sched_ticklesssleep(void)
+{
+    double now, wait = TICKLESS_MAXSLEEP, reallogical, until;
+    t_clock *c;
+    int nticks;
+    sys_lock();
+    if (!sys_tickless || sched_useaudio != SCHED_AUDIO_NONE ||
+        pd_getdspstate() || sys_idlehook || sys_nmidiin ||
+        sys_inputrecording)
+    {
+        sys_unlock();
+        return (0);
+    }
+        /* the next clock goes off in the tick starting at "until" */
+    if ((c = pd_this->pd_clock_setlist))
+    {
+        until = pd_this->pd_systime + SYSTIMEPERTICK *
+            floor((c->c_settime - pd_this->pd_systime) / SYSTIMEPERTICK);
+        wait = sched_referencerealtime - sys_getrealtime() +
+            (until - sched_referencelogicaltime) / TIMEUNITPERSECOND;
+        if (wait > TICKLESS_MAXSLEEP)
+            wait = TICKLESS_MAXSLEEP;
+    }
+    sys_unlock();
+    if (wait > 0)
+        sys_fdwait((int)(wait * 1000000));
+    sys_lock();
+        /* skip the ticks that would have had nothing to do, up to the one
+        to run now (an fd might have set an earlier clock) */
+    now = sys_getrealtime();
+    reallogical = sched_referencelogicaltime +
+        (now - sched_referencerealtime) * TIMEUNITPERSECOND;
+    if ((c = pd_this->pd_clock_setlist) && c->c_settime < reallogical)
+        reallogical = c->c_settime;
+    nticks = (int)floor((reallogical - pd_this->pd_systime) / SYSTIMEPERTICK);
+    if (nticks > 0)
+    {
+        pd_this->pd_systime += nticks * SYSTIMEPERTICK;
+        STUFF->st_tickcount += nticks;
+    }
+    sys_unlock();
+    return (1);
+}
+
 static void m_pollingscheduler(void)
 {
     sys_lock();
@@ -335,9 +855,7 @@ static void m_pollingscheduler(void)
     {
         int timeforward;
 
-        sys_addhist(0);
         sched_tick();
-        sys_addhist(1);
 
             /* fast forward, in which the scheduler advances without waiting
             for real time; for patches that alternate between interactive
@@ -350,7 +868,6 @@ static void m_pollingscheduler(void)
             continue;
         }
         sys_pollmidiqueue();
-        sys_addhist(2);
         while (!sys_quit)   /* inner loop runs until it can transfer audio */
         {
             int sentdacs;   /* YES if audio was transferred, NO if not,
@@ -369,16 +886,31 @@ static void m_pollingscheduler(void)
                 }
                 timeforward = (lateness > 0 ? SENDDACS_YES : SENDDACS_NO);
             }
+            else if (sys_tracing)
+            {
+                unsigned long long tracestart = PROFILE_NOW();
+                timeforward = sys_send_dacs();
+                sys_tracespan("sched", "send_dacs", tracestart);
+            }
             else timeforward = sys_send_dacs();
-            sys_addhist(3);
+            if (sched_telemetry && timeforward != SENDDACS_NO)
+            {
+                double now = sys_getrealtime(), jitter;
+                if (sched_lastdacstime > 0)
+                {
+                    jitter = (now - sched_lastdacstime) -
+                        STUFF->st_schedblocksize / STUFF->st_dacsr;
+                    sched_addhist(HIST_JITTER, jitter < 0 ? -jitter : jitter);
+                }
+                sched_lastdacstime = now;
+            }
                 /* test for idle; if so, do graphics updates. */
-            if (timeforward != SENDDACS_YES && !sched_idletask())
+            if (timeforward != SENDDACS_YES && !sched_doidletask())
             {
                 /* if even that had nothing to do, sleep. */
-                sys_addhist(4);
-                sys_microsleep();
+                if (!sched_ticklesssleep())
+                    sys_microsleep();
             }
-            sys_addhist(5);
             sys_lock();
             if (timeforward != SENDDACS_NO)
                 break;
@@ -387,30 +919,61 @@ static void m_pollingscheduler(void)
     sys_unlock();
 }
 
+    /* in "-callbackqueue" mode, messages from the main thread are taken in
+    before the tick rather than after it */
 void sched_audio_callbackfn(void)
 {
+    if (sys_callbackqueue)
+        (void)sched_doidletask();
     sys_lock();
-    sys_addhist(0);
     sched_tick();
-    sys_addhist(1);
     sys_pollmidiqueue();
-    sys_addhist(2);
     sys_unlock();
-    (void)sched_idletask();
-    sys_addhist(3);
+    if (!sys_callbackqueue)
+        (void)sched_doidletask();
+}
+
+    /* spend a second handing ready fds to the audio callback, or just
+    sleeping if that can't be done here */
+static void sched_waitcallback(void)
+{
+    double endtime = sys_getrealtime() + 1;
+    while (!sys_quit && sys_getrealtime() < endtime)
+        if (sys_fdqueuewait(100000) < 0)
+    {
+#ifdef _WIN32
+        Sleep(100);
+#else
+        usleep(100000);
+#endif
+    }
 }
 
 static void m_callbackscheduler(void)
 {
     sys_initmidiqueue();
+    if (sys_callbackqueue)
+    {
+        sys_lock();
+        sys_setfdqueue(1);
+        sys_unlock();
+    }
     while (!sys_quit)
     {
         double timewas = pd_this->pd_systime;
+        if (sys_callbackqueue)
+            sched_waitcallback();
+        else
+        {
 #ifdef _WIN32
-        Sleep(1000);
+            Sleep(1000);
 #else
-        sleep(1);
+            sleep(1);
 #endif
+        }
+            /* if audio has stalled, tick from here.  The fd queue is then
+            read under the lock, which keeps the callback out if it comes
+            back in the meantime. */
         if (pd_this->pd_systime == timewas)
         {
             sys_lock();
@@ -421,10 +984,17 @@ static void m_callbackscheduler(void)
         if (sys_idlehook)
             sys_idlehook();
     }
+    if (sys_callbackqueue)
+    {
+        sys_lock();
+        sys_setfdqueue(0);
+        sys_unlock();
+    }
 }
 
 int m_mainloop(void)
 {
+    sys_tracethread("scheduler");
     while (sys_quit != SYS_QUIT_QUIT)
     {
         if (sched_useaudio == SCHED_AUDIO_CALLBACK)
@@ -436,6 +1006,8 @@ int m_mainloop(void)
             if (audio_isopen())
             {
                 sys_close_audio();
+                if (sched_adaptrequest)
+                    sched_adaptapply();
                 sys_reopen_audio();
             }
         }
@@ -443,11 +1015,344 @@ int m_mainloop(void)
     return (0);
 }
 
+    /* in batch mode, an input log given with "-replay" is fed back between
+    ticks (s_replay.c), and we quit at its end */
 int m_batchmain(void)
 {
     while (sys_quit != SYS_QUIT_QUIT)
+    {
+        if (sys_inputreplaying && !sys_replaypoll())
+            break;
         sched_tick();
+    }
+    return (0);
+}
+
+/* ------------------ offline rendering ("-render" flag) ------------------ */
+
+/* Each message in the job file renders one patch:
+
+    patch.pd <seconds> [soundfile flags] <soundfile> [args...]
+
+which opens the patch with the args as $1, $2, ..., turns DSP on, and writes
+that many seconds of the dac~ output to the soundfile (with flags as for
+"soundfiler write") as fast as they can be computed.  No audio device is
+opened; the channel count and sample rate come from the usual flags.  A
+patch that sends "pd quit" just ends its own job early.  Relative paths are
+taken from the job file's directory.  With "-renderprocs" the jobs are dealt
+out among that many copies of Pd forked at the start; there's only one Pd
+instance per process here so that's the way to use more cores.
+
+"-bench" runs the same way but writes no soundfiles, so its jobs are just
+
+    patch.pd <seconds> [args...]
+
+For each one it reports the real-time factor, the longest single tick, the
+process's memory high-water mark, and the most expensive objects according
+to the DSP profiler, which stays on while the job runs (its markers cost a
+few percent of the DSP time).  doc/7.stuff/bench has a set of patches for
+comparing machines or versions of Pd. */
+
+int sched_rendering;
+
+typedef struct _sfrender t_sfrender;
+t_sfrender *soundfile_render_new(const char *dir, int *p_argc,
+    t_atom **p_argv, int nchannels, size_t nframes);
+int soundfile_render_write(t_sfrender *x, t_sample *samples, int nframes);
+void soundfile_render_free(t_sfrender *x);
+void glob_dsp(void *dummy, t_symbol *s, int argc, t_atom *argv);
+
+typedef struct _renderstats     /* what each process reports back */
+{
+    double r_seconds;           /* seconds of output written */
+    double r_peaktick;          /* longest tick in seconds ("-bench" only) */
+    long r_maxrss;              /* memory high-water mark in kB (ditto) */
+    int r_njobs;
+    int r_nfailed;
+} t_renderstats;
+
+static int render_bench;        /* "-bench": no soundfiles, more stats */
+#define RENDER_NPROFILE 5       /* how many objects' profiles to print */
+
+static void render_setdsp(int onoff)
+{
+    t_atom at;
+    SETFLOAT(&at, onoff);
+    glob_dsp(0, gensym("dsp"), 1, &at);
+}
+
+    /* memory high-water mark of this process in kB, or 0 if unknown */
+static long render_maxrss(void)
+{
+#ifdef _WIN32
     return (0);
+#else
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) < 0)
+        return (0);
+#ifdef __APPLE__
+    return (ru.ru_maxrss / 1024);   /* bytes, not kB, on macOS */
+#else
+    return (ru.ru_maxrss);
+#endif
+#endif
+}
+
+static void render_profileprint(void *z, const char *name, const char *owner,
+    double load, double usec)
+{
+    int *count = (int *)z;
+    if ((*count)++ < RENDER_NPROFILE)
+        post("    %6.2f%% %9.2f usec  %s%s%s", 100. * load, usec, name,
+            (*owner ? " in " : ""), owner);
+}
+
+    /* report a "-bench" job; called while its DSP chain is still there */
+static void render_benchreport(const char *patchname, double seconds,
+    double elapsed, double peaktick, t_renderstats *stats)
+{
+    double tickmsec = 1000. * DEFDACBLKSIZE / STUFF->st_dacsr;
+    long maxrss = render_maxrss();
+    int count = 0;
+    post("%s: %.2f seconds in %.2f (%.1f times real time)", patchname,
+        seconds, elapsed, (elapsed > 0 ? seconds / elapsed : 0));
+    post("    peak tick %.3f msec (%.0f%% of %.3f), memory high water %ld kB",
+        1000. * peaktick, 100. * 1000. * peaktick / tickmsec, tickmsec,
+            maxrss);
+    ugen_getprofile(render_profileprint, &count);
+    ugen_setprofile(0);
+    if (peaktick > stats->r_peaktick)
+        stats->r_peaktick = peaktick;
+    if (maxrss > stats->r_maxrss)
+        stats->r_maxrss = maxrss;
+}
+
+    /* run one job, adding its result to *stats */
+static void render_job(const char *jobdir, int argc, t_atom *argv,
+    t_renderstats *stats)
+{
+    char pathbuf[MAXPDSTRING], *slash;
+    const char *patchname, *patchdir = ".";
+    double seconds, starttime, elapsed;
+    size_t nframes, nwritten = 0;
+    int ok = 1;
+    t_sfrender *sf;
+    t_pd *x;
+    double peaktick = 0;
+    stats->r_njobs++;
+    if (argc < (render_bench ? 2 : 3) || argv[0].a_type != A_SYMBOL ||
+        argv[1].a_type != A_FLOAT || (seconds = argv[1].a_w.w_float) <= 0)
+    {
+        if (render_bench)
+            pd_error(0, "bench: usage: patch seconds [args]");
+        else pd_error(0,
+            "render: usage: patch seconds [flags] soundfile [args]");
+        stats->r_nfailed++;
+        return;
+    }
+    patchname = argv[0].a_w.w_symbol->s_name;
+    if (sys_isabsolutepath(patchname))
+        strncpy(pathbuf, patchname, MAXPDSTRING);
+    else snprintf(pathbuf, MAXPDSTRING, "%s/%s", jobdir, patchname);
+    pathbuf[MAXPDSTRING-1] = 0;
+    if ((slash = strrchr(pathbuf, '/')))
+    {
+        *slash = 0;
+        patchname = slash + 1;
+        patchdir = (*pathbuf ? pathbuf : "/");
+    }
+    else patchname = pathbuf;
+
+    nframes = seconds * STUFF->st_dacsr + 0.5;
+    argc -= 2; argv += 2;
+    if (render_bench)
+        sf = 0;
+    else if (!(sf = soundfile_render_new(jobdir, &argc, &argv,
+        STUFF->st_outchannels, nframes)))
+    {
+        stats->r_nfailed++;
+        return;
+    }
+    canvas_setargs(argc, argv);
+    x = glob_evalfile(0, gensym(patchname), gensym(patchdir));
+    canvas_setargs(0, 0);
+    if (!x)
+    {
+        pd_error(0, "%s: %s/%s: can't open", (render_bench ?
+            "bench" : "render"), patchdir, patchname);
+        if (sf)
+            soundfile_render_free(sf);
+        stats->r_nfailed++;
+        return;
+    }
+    if (render_bench)
+        ugen_setprofile(1);
+    render_setdsp(1);
+    starttime = sys_getrealtime();
+    while (nwritten < nframes && sys_quit != SYS_QUIT_QUIT)
+    {
+        int n = (nframes - nwritten < DEFDACBLKSIZE ?
+            (int)(nframes - nwritten) : DEFDACBLKSIZE);
+        if (render_bench)
+        {
+            double ticktime = sys_getrealtime();
+            sched_tick();
+            if ((ticktime = sys_getrealtime() - ticktime) > peaktick)
+                peaktick = ticktime;
+        }
+        else sched_tick();
+            /* (st_soundout is reallocated if the patch turns DSP on again) */
+        if (sf && !soundfile_render_write(sf, STUFF->st_soundout, n))
+        {
+            ok = 0;
+            break;
+        }
+        memset(STUFF->st_soundout, 0,
+            STUFF->st_outchannels * DEFDACBLKSIZE * sizeof(t_sample));
+        nwritten += n;
+    }
+    elapsed = sys_getrealtime() - starttime;
+    if (render_bench)
+        render_benchreport(patchname, nwritten / STUFF->st_dacsr, elapsed,
+            peaktick, stats);
+    render_setdsp(0);
+    pd_free(x);
+    if (sf)
+        soundfile_render_free(sf);
+    if (sys_quit == SYS_QUIT_QUIT)
+        sys_quit = 0;
+    seconds = nwritten / STUFF->st_dacsr;
+    stats->r_seconds += seconds;
+    if (!ok)
+        stats->r_nfailed++;
+    else if (!render_bench)
+        post("%s: %.2f seconds in %.2f (%.1f times real time)", patchname,
+            seconds, elapsed, (elapsed > 0 ? seconds / elapsed : 0));
+}
+
+    /* run our share of the jobs; "proc" counts from 0 to nprocs-1 */
+static void render_jobs(t_binbuf *b, const char *jobdir, int proc,
+    int nprocs, t_renderstats *stats)
+{
+    int argc = binbuf_getnatom(b), onset, i, job = 0;
+    t_atom *argv = binbuf_getvec(b);
+    for (i = onset = 0; i <= argc; i++)
+        if (i == argc || argv[i].a_type == A_SEMI)
+    {
+        if (i > onset && (job++ % nprocs) == proc)
+            render_job(jobdir, i - onset, argv + onset, stats);
+        onset = i + 1;
+    }
+}
+
+int m_rendermain(const char *jobfile, int nprocs, int bench)
+{
+    t_binbuf *b = binbuf_new();
+    t_audiosettings as;
+    t_renderstats stats = {0, 0, 0, 0, 0};
+    const char *what = (bench ? "bench" : "render");
+    char dirbuf[MAXPDSTRING], *slash;
+    const char *jobname = jobfile;
+    double starttime = sys_getrealtime(), elapsed;
+    int i, nchannels;
+
+    strncpy(dirbuf, jobfile, MAXPDSTRING);
+    dirbuf[MAXPDSTRING-1] = 0;
+    if ((slash = strrchr(dirbuf, '/')))
+    {
+        jobname = jobfile + (slash - dirbuf) + 1;
+        slash[slash == dirbuf] = 0;
+    }
+    else strcpy(dirbuf, ".");
+    if (binbuf_read(b, jobname, dirbuf, 0))
+    {
+        pd_error(0, "%s: %s: can't read job list", what, jobfile);
+        binbuf_free(b);
+        return (1);
+    }
+        /* no devices, but as many output channels as we were asked for */
+    sys_get_audio_settings(&as);
+    for (i = nchannels = 0; i < as.a_nchoutdev; i++)
+        nchannels += as.a_choutdevvec[i];
+    as.a_api = API_NONE;
+    as.a_nindev = as.a_nchindev = as.a_callback = 0;
+    as.a_noutdev = as.a_nchoutdev = 1;
+    as.a_outdevvec[0] = 0;
+    as.a_choutdevvec[0] = (nchannels > 0 ? nchannels : 2);
+    sys_set_audio_settings(&as);
+    sys_reopen_audio();
+    sched_rendering = 1;
+    render_bench = bench;
+
+#ifndef _WIN32
+    if (nprocs > 1)
+    {
+        int fds[2], proc, nstarted = 0, status;
+        t_renderstats childstats;
+        if (pipe(fds) < 0)
+        {
+            perror("render: pipe");
+            nprocs = 1;
+        }
+        else for (proc = 0; proc < nprocs; proc++)
+        {
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                close(fds[0]);
+                render_jobs(b, dirbuf, proc, nprocs, &stats);
+                if (write(fds[1], &stats, sizeof(stats)) <
+                    (ssize_t)sizeof(stats))
+                        perror("render: write");
+                _exit(stats.r_nfailed != 0);
+            }
+            else if (pid < 0)
+            {
+                perror("render: fork");
+                break;
+            }
+            nstarted++;
+        }
+        if (nprocs > 1)
+        {
+                /* the ones we couldn't start are done here */
+            close(fds[1]);
+            for (proc = nstarted; proc < nprocs; proc++)
+                render_jobs(b, dirbuf, proc, nprocs, &stats);
+                /* once they've all exited their reports are in the pipe;
+                don't wait for end of file in case some other process
+                inherited the pipe from one of them */
+            while (wait(&status) > 0)
+                ;
+            fcntl(fds[0], F_SETFL, O_NONBLOCK);
+            while (read(fds[0], &childstats, sizeof(childstats)) ==
+                sizeof(childstats))
+            {
+                stats.r_seconds += childstats.r_seconds;
+                if (childstats.r_peaktick > stats.r_peaktick)
+                    stats.r_peaktick = childstats.r_peaktick;
+                if (childstats.r_maxrss > stats.r_maxrss)
+                    stats.r_maxrss = childstats.r_maxrss;
+                stats.r_njobs += childstats.r_njobs;
+                stats.r_nfailed += childstats.r_nfailed;
+            }
+            close(fds[0]);
+        }
+    }
+    if (nprocs <= 1)
+#endif
+        render_jobs(b, dirbuf, 0, 1, &stats);
+    binbuf_free(b);
+    elapsed = sys_getrealtime() - starttime;
+    post("%s: %d job(s), %.2f seconds in %.2f (%.1f times real time)",
+        what, stats.r_njobs, stats.r_seconds, elapsed,
+            (elapsed > 0 ? stats.r_seconds / elapsed : 0));
+    if (bench)
+        post("bench: peak tick %.3f msec, memory high water %ld kB",
+            1000. * stats.r_peaktick, stats.r_maxrss);
+    if (stats.r_nfailed)
+        post("%s: %d job(s) failed", what, stats.r_nfailed);
+    return (stats.r_nfailed != 0);
 }
 
 void sys_exit(void)
@@ -10,6 +10,7 @@
 */
 
 #include "m_pd.h"
+#include "m_imp.h"
 #include "s_stuff.h"
 #include <stdio.h>
 #ifdef _WIN32
@@ -22,6 +23,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <math.h>
+#include <pthread.h>
 
 #ifdef _MSC_VER
 #define snprintf _snprintf
@@ -43,6 +46,7 @@ static t_audiosettings audio_nextsettings;
 
 void sched_audio_callbackfn(void);
 void sched_reopenmeplease(void);
+static void audio_pipeline_stop(void);
 
 int audio_isopen(void)
 {
@@ -91,6 +95,17 @@ void sys_setchsr(int chin, int chout, int sr)
     int outbytes = (chout ? chout : 2) *
                 (DEFDACBLKSIZE*sizeof(t_sample));
 
+    audio_pipeline_stop();
+        /* if nothing changed, keep the buffers, which the DSP chain (or one
+        set aside by "pd dsp 0") points to, so it needn't be resorted */
+    if (STUFF->st_soundin && STUFF->st_soundout &&
+        chin == STUFF->st_inchannels && chout == STUFF->st_outchannels &&
+            (audio_isfixedsr(sys_audioapiopened) || sr == STUFF->st_dacsr))
+    {
+        memset(STUFF->st_soundin, 0, inbytes);
+        memset(STUFF->st_soundout, 0, outbytes);
+        return;
+    }
     if (STUFF->st_soundin)
         freebytes(STUFF->st_soundin,
             (STUFF->st_inchannels? STUFF->st_inchannels : 2) *
@@ -109,6 +124,8 @@ void sys_setchsr(int chin, int chout, int sr)
 
     STUFF->st_soundout = (t_sample *)getbytes(outbytes);
     memset(STUFF->st_soundout, 0, outbytes);
+    STUFF->st_iosoundin = STUFF->st_soundin;
+    STUFF->st_iosoundout = STUFF->st_soundout;
 
     logpost(NULL, PD_VERBOSE, "input channels = %d, output channels = %d",
             STUFF->st_inchannels, STUFF->st_outchannels);
@@ -271,6 +288,7 @@ void sys_close_audio(void)
     }
     if (!audio_isopen())
         return;
+    audio_pipeline_stop();
 #ifdef USEAPI_PORTAUDIO
     if (sys_audioapiopened == API_PORTAUDIO)
         pa_close_audio();
@@ -435,7 +453,7 @@ void sys_reopen_audio(void)
     sys_vgui("set pd_whichapi %d\n",  sys_audioapiopened);
 }
 
-int sys_send_dacs(void)
+static int audio_dosend_dacs(void)
 {
 #ifdef USEAPI_PORTAUDIO
     if (sys_audioapiopened == API_PORTAUDIO)
@@ -481,6 +499,593 @@ int sys_send_dacs(void)
     return (0);
 }
 
+/* ----------------- pipelining DSP with device I/O ----------------------- */
+
+/* With "-pipeline", the device transfer (the API's send_dacs routine,
+including sample conversion and waiting for the device to be ready) runs on
+a thread of its own while the scheduler computes the next tick, at the cost
+of one more block (64 samples) of latency.  The API transfers a second pair
+of buffers, st_iosoundin and st_iosoundout, and each time the thread is done
+the scheduler trades the just-computed output for the input the thread got.
+Without it those are just st_soundin and st_soundout.
+
+The thread doesn't hold Pd's lock, so what the APIs report from their
+send_dacs routines -- printout, sys_log_error(), sched_set_using_audio() --
+is recorded and reported by sys_send_dacs() when it takes the block.  If
+the device needs reopening, the thread gives up and the scheduler does the
+transfer itself, so that the API can do that under the lock. */
+
+static pthread_t pipe_thread;
+static pthread_mutex_t pipe_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pipe_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pipe_donecond = PTHREAD_COND_INITIALIZER;
+static int pipe_running;    /* thread exists */
+static int pipe_busy;       /* thread is transferring a block */
+static int pipe_quit;       /* thread should exit */
+static int pipe_result;     /* what the last transfer returned */
+static int pipe_inbytes, pipe_outbytes;
+static PD_THREADLOCAL int pipe_onthread;    /* true on the thread itself */
+
+    /* what the thread left for the scheduler to report; only touched by
+    the thread while it is busy and by the scheduler while it isn't */
+#define PIPE_NERR (ERR_DATALATE + 1)
+#define PIPE_TEXTSIZE 4096
+static int pipe_errors[PIPE_NERR];  /* sys_log_error() calls by type */
+static int pipe_useaudio = -1;      /* sched_set_using_audio() flag or -1 */
+static int pipe_lost;               /* API wants the scheduler to retry */
+static char pipe_text[PIPE_TEXTSIZE];   /* kind byte and string, repeated */
+static int pipe_textsize;
+
+    /* the following return true if called on the pipeline thread, in
+    which case they just record what to report later */
+int audio_pipeline_logerror(int type)
+{
+    if (!pipe_onthread)
+        return (0);
+    if (type >= 0 && type < PIPE_NERR)
+        pipe_errors[type]++;
+    return (1);
+}
+
+int audio_pipeline_setusing(int flag)
+{
+    if (!pipe_onthread)
+        return (0);
+    pipe_useaudio = flag;
+    return (1);
+}
+
+int audio_pipeline_print(int kind, const char *s)
+{
+    int n;
+    if (!pipe_onthread)
+        return (0);
+    n = (int)strlen(s) + 1;
+    if (pipe_textsize + 1 + n <= PIPE_TEXTSIZE)
+    {
+        pipe_text[pipe_textsize] = (char)kind;
+        memcpy(pipe_text + pipe_textsize + 1, s, n);
+        pipe_textsize += 1 + n;
+    }
+    return (1);
+}
+
+    /* for an API that found the device gone and wants to close or reopen
+    it, which has to happen on the scheduler's side */
+int audio_pipeline_lost(void)
+{
+    if (!pipe_onthread)
+        return (0);
+    pipe_lost = 1;
+    return (1);
+}
+
+    /* report what the thread recorded; call with Pd locked and the thread
+    idle */
+static void audio_pipeline_report(void)
+{
+    int i;
+    for (i = 0; i < pipe_textsize; )
+    {
+        sys_printdeferred(pipe_text[i], pipe_text + i + 1);
+        i += 2 + (int)strlen(pipe_text + i + 1);
+    }
+    pipe_textsize = 0;
+    for (i = 0; i < PIPE_NERR; i++)
+        for (; pipe_errors[i]; pipe_errors[i]--)
+            sys_log_error(i);
+    if (pipe_useaudio >= 0)
+    {
+        sched_set_using_audio(pipe_useaudio);
+        pipe_useaudio = -1;
+    }
+}
+
+static void *audio_pipeline_thread(void *dummy)
+{
+    int affinityserial = -1;
+    pipe_onthread = 1;
+    pthread_mutex_lock(&pipe_mutex);
+    while (1)
+    {
+        int result;
+        while (!pipe_busy && !pipe_quit)
+            pthread_cond_wait(&pipe_cond, &pipe_mutex);
+        if (pipe_quit)
+            break;
+        pthread_mutex_unlock(&pipe_mutex);
+        sys_bindthread(AFFINITY_SCHED, &affinityserial);
+            /* wait for the device the way the scheduler would, except that
+            there's nothing else to do meanwhile */
+        while ((result = audio_dosend_dacs()) == SENDDACS_NO &&
+            !pipe_quit && !pipe_lost)
+        {
+#ifdef _WIN32
+            Sleep(1);
+#else
+            usleep(sched_get_sleepgrain());
+#endif
+        }
+        pthread_mutex_lock(&pipe_mutex);
+        pipe_result = result;
+        pipe_busy = 0;
+        pthread_cond_signal(&pipe_donecond);
+    }
+    pthread_mutex_unlock(&pipe_mutex);
+    return (0);
+}
+
+static int audio_pipeline_start(void)
+{
+    int nin = (STUFF->st_inchannels ? STUFF->st_inchannels : 2),
+        nout = (STUFF->st_outchannels ? STUFF->st_outchannels : 2);
+    pipe_inbytes = nin * DEFDACBLKSIZE * sizeof(t_sample);
+    pipe_outbytes = nout * DEFDACBLKSIZE * sizeof(t_sample);
+    STUFF->st_iosoundin = (t_sample *)getbytes(pipe_inbytes);
+    STUFF->st_iosoundout = (t_sample *)getbytes(pipe_outbytes);
+    pipe_busy = pipe_quit = pipe_lost = 0;
+    pipe_result = SENDDACS_YES;
+    if (pthread_create(&pipe_thread, 0, audio_pipeline_thread, 0))
+    {
+        pd_error(0, "-pipeline: couldn't start audio thread");
+        freebytes(STUFF->st_iosoundin, pipe_inbytes);
+        freebytes(STUFF->st_iosoundout, pipe_outbytes);
+        STUFF->st_iosoundin = STUFF->st_soundin;
+        STUFF->st_iosoundout = STUFF->st_soundout;
+        sys_audiopipeline = 0;
+        return (0);
+    }
+    pipe_running = 1;
+    logpost(NULL, PD_VERBOSE, "audio I/O pipelined (one extra block latency)");
+    return (1);
+}
+
+    /* called before the device is closed or the buffers reallocated;
+    the next sys_send_dacs() starts it up again */
+static void audio_pipeline_stop(void)
+{
+    if (!pipe_running)
+        return;
+    pthread_mutex_lock(&pipe_mutex);
+    pipe_quit = 1;
+    pthread_cond_signal(&pipe_cond);
+    pthread_mutex_unlock(&pipe_mutex);
+    pthread_join(pipe_thread, 0);
+    pipe_running = 0;
+    freebytes(STUFF->st_iosoundin, pipe_inbytes);
+    freebytes(STUFF->st_iosoundout, pipe_outbytes);
+    STUFF->st_iosoundin = STUFF->st_soundin;
+    STUFF->st_iosoundout = STUFF->st_soundout;
+}
+
+    /* hand the audio API the block just computed and get the input for the
+    next one, either directly or by trading with the pipeline thread.
+    Returns SENDDACS_NO if the device (or the thread) isn't ready yet. */
+int sys_send_dacs(void)
+{
+    int result;
+    if (!sys_audiopipeline || audio_callback_is_open)
+    {
+        if (pipe_running)
+            audio_pipeline_stop();
+        return (audio_dosend_dacs());
+    }
+    if (!pipe_running && !audio_pipeline_start())
+        return (audio_dosend_dacs());
+    pthread_mutex_lock(&pipe_mutex);
+    if (pipe_busy)
+    {
+            /* the scheduler would sleep a whole "sleepgrain" on SENDDACS_NO,
+            typically longer than a block; so wait up to a block's worth of
+            time here for the thread to finish first. */
+#ifndef _WIN32
+        struct timeval now;
+        struct timespec ts;
+        long nsec = (long)(1e9 * DEFDACBLKSIZE / STUFF->st_dacsr);
+        gettimeofday(&now, 0);
+        nsec += 1000L * now.tv_usec;
+        ts.tv_sec = now.tv_sec + nsec / 1000000000L;
+        ts.tv_nsec = nsec % 1000000000L;
+        while (pipe_busy &&
+            !pthread_cond_timedwait(&pipe_donecond, &pipe_mutex, &ts))
+                ;
+#endif
+        if (pipe_busy)
+        {
+            pthread_mutex_unlock(&pipe_mutex);
+            return (SENDDACS_NO);
+        }
+    }
+    audio_pipeline_report();
+    if (pipe_lost)
+    {
+            /* let the API deal with the device from this thread */
+        pthread_mutex_unlock(&pipe_mutex);
+        audio_pipeline_stop();
+        return (audio_dosend_dacs());
+    }
+    result = pipe_result;
+    memcpy(STUFF->st_iosoundout, STUFF->st_soundout, pipe_outbytes);
+    memset(STUFF->st_soundout, 0, pipe_outbytes);  /* as the API would */
+    memcpy(STUFF->st_soundin, STUFF->st_iosoundin, pipe_inbytes);
+    pipe_busy = 1;
+    pthread_cond_signal(&pipe_cond);
+    pthread_mutex_unlock(&pipe_mutex);
+    return (result);
+}
+
+/* ------------ sample conversion shared by the audio APIs -------------- */
+
+/* Pd's own sample buffers are "planar", one channel after another, but
+most devices want channels interleaved, in one of a few formats.  Rather
+than converting sample by sample as we stride through the device buffer,
+each channel is converted a chunk at a time between floats and integers in
+a small contiguous buffer, which compilers can vectorize, and only the
+copy in or out of place is strided.  Channels the device has but we don't
+are zeroed. */
+
+#define CONVCHUNK 64
+    /* don't assume we can turn all 31 bits when doing float-to-fix;
+    otherwise some audio drivers (e.g. Midiman/ALSA) wrap around. */
+#define CONV32SCALE 2147479552.f    /* 0x7ffff000 */
+
+    /* scale and clip floats to integers for the given format */
+static void conv_tofix(int32_t *to, const t_sample *from, int n, int format)
+{
+    int i;
+    t_sample scale = (format == SAMPFMT_S32 ? CONV32SCALE :
+        (format == SAMPFMT_S24_3LE ? 8388351.f : 32767.f));
+    for (i = 0; i < n; i++)
+    {
+        t_sample f = from[i];
+        f = (f > 1 ? 1 : (f < -1 ? -1 : f));
+        to[i] = (int32_t)(f * scale);
+    }
+}
+
+static void conv_fromfix(t_sample *to, const int32_t *from, int n,
+    int format)
+{
+    int i;
+    t_sample scale = (format == SAMPFMT_S16 ? 3.051850e-05 :
+        (1./ INT32_MAX));  /* 24-bit samples are read into the top bits */
+    for (i = 0; i < n; i++)
+        to[i] = from[i] * scale;
+}
+
+    /* convert "nin" planar channels (each "instride" apart) into a device
+    buffer of "bufchans" interleaved ones */
+void sys_interleave(void *buf, int format, int bufchans,
+    const t_sample *in, int nin, int instride, int nframes)
+{
+    int32_t tmp[CONVCHUNK];
+    int ch, i, j, n, nconv = (nin < bufchans ? nin : bufchans);
+    if (format == SAMPFMT_FLOAT32)
+    {
+        float *fp = (float *)buf;
+        for (ch = 0; ch < bufchans; ch++)
+        {
+            if (ch < nconv)
+                for (i = 0; i < nframes; i++)
+                    fp[i * bufchans + ch] = in[ch * instride + i];
+            else for (i = 0; i < nframes; i++)
+                fp[i * bufchans + ch] = 0;
+        }
+        return;
+    }
+    for (ch = 0; ch < bufchans; ch++)
+        for (j = 0; j < nframes; j += n)
+    {
+        int32_t *ip;
+        int16_t *sp;
+        unsigned char *cp;
+        n = (nframes - j < CONVCHUNK ? nframes - j : CONVCHUNK);
+        if (ch < nconv)
+            conv_tofix(tmp, in + ch * instride + j, n, format);
+        else memset(tmp, 0, n * sizeof(*tmp));
+        switch (format)
+        {
+        case SAMPFMT_S32:
+            for (i = 0, ip = (int32_t *)buf + j * bufchans + ch; i < n;
+                i++, ip += bufchans)
+                    *ip = tmp[i];
+            break;
+        case SAMPFMT_S24_3LE:
+            for (i = 0, cp = (unsigned char *)buf + 3 * (j * bufchans + ch);
+                i < n; i++, cp += 3 * bufchans)
+            {
+                cp[0] = (tmp[i] & 255);
+                cp[1] = ((tmp[i] >> 8) & 255);
+                cp[2] = ((tmp[i] >> 16) & 255);
+            }
+            break;
+        default:
+            for (i = 0, sp = (int16_t *)buf + j * bufchans + ch; i < n;
+                i++, sp += bufchans)
+                    *sp = tmp[i];
+            break;
+        }
+    }
+}
+
+    /* the reverse: take "nout" planar channels out of a device buffer */
+void sys_deinterleave(t_sample *out, int nout, int outstride,
+    const void *buf, int format, int bufchans, int nframes)
+{
+    int32_t tmp[CONVCHUNK];
+    int ch, i, j, n, nconv = (nout < bufchans ? nout : bufchans);
+    for (ch = nconv; ch < nout; ch++)
+        memset(out + ch * outstride, 0, nframes * sizeof(t_sample));
+    if (format == SAMPFMT_FLOAT32)
+    {
+        const float *fp = (const float *)buf;
+        for (ch = 0; ch < nconv; ch++)
+            for (i = 0; i < nframes; i++)
+                out[ch * outstride + i] = fp[i * bufchans + ch];
+        return;
+    }
+    for (ch = 0; ch < nconv; ch++)
+        for (j = 0; j < nframes; j += n)
+    {
+        const int32_t *ip;
+        const int16_t *sp;
+        const unsigned char *cp;
+        n = (nframes - j < CONVCHUNK ? nframes - j : CONVCHUNK);
+        switch (format)
+        {
+        case SAMPFMT_S32:
+            for (i = 0, ip = (const int32_t *)buf + j * bufchans + ch; i < n;
+                i++, ip += bufchans)
+                    tmp[i] = *ip;
+            break;
+        case SAMPFMT_S24_3LE:
+            for (i = 0, cp = (const unsigned char *)buf +
+                3 * (j * bufchans + ch); i < n; i++, cp += 3 * bufchans)
+                    tmp[i] = (int32_t)(((uint32_t)cp[0] << 8) |
+                        ((uint32_t)cp[1] << 16) | ((uint32_t)cp[2] << 24));
+            break;
+        default:
+            for (i = 0, sp = (const int16_t *)buf + j * bufchans + ch; i < n;
+                i++, sp += bufchans)
+                    tmp[i] = *sp;
+            break;
+        }
+        conv_fromfix(out + ch * outstride + j, tmp, n, format);
+    }
+}
+
+/* ------------ clock-drift compensation between audio devices ------------ */
+
+/* Devices opened side by side that don't share a word clock drift slowly
+apart until one of them over- or underruns.  With "-aggregate", an API that
+opens several devices runs each one that isn't on the first device's clock
+through a small adaptive resampler.  A PI controller steers its ratio from
+the device's buffer fill so that the fill stays where it settled after
+opening; the resampler itself only adds the couple of frames its 4-point
+interpolation looks ahead. */
+
+int sys_aggregate;
+
+#define RESYNC_FIFOSIZE (2 * RESYNC_MAXFRAMES)
+#define RESYNC_SETTLE 200       /* blocks to watch the fill before locking */
+#define RESYNC_SMOOTH 0.005     /* coefficient of one-pole filter on fill */
+#define RESYNC_KP 2e-5          /* ratio change per frame of fill error */
+#define RESYNC_KI 1e-8          /* ... and per frame of accumulated error */
+#define RESYNC_MAXDRIFT 0.002   /* never correct by more than 2000 ppm */
+
+struct _resync
+{
+    int r_nchans;
+    int r_output;           /* true if Pd writes to the device */
+    int r_settle;           /* blocks left before we pick a target fill */
+    double r_fill;          /* smoothed buffer fill in frames, or -1 */
+    double r_target;        /* fill we try to hold */
+    double r_integral;      /* accumulated error: the drift estimate */
+    double r_ratio;         /* device frames per Pd frame */
+    double r_phase;         /* read position in the FIFO */
+    int r_nfifo;            /* frames in the FIFO */
+    int r_need;             /* input frames asked for by resync_inneed() */
+    t_sample *r_fifo;       /* r_nchans channels of RESYNC_FIFOSIZE */
+    t_sample *r_buf;        /* device side, r_nchans of RESYNC_MAXFRAMES */
+};
+
+t_resync *resync_new(int nchans, int output)
+{
+    t_resync *x = (t_resync *)getbytes(sizeof(*x));
+    x->r_nchans = nchans;
+    x->r_output = output;
+    x->r_fifo = (t_sample *)getbytes(nchans * RESYNC_FIFOSIZE *
+        sizeof(t_sample));
+    x->r_buf = (t_sample *)getbytes(nchans * RESYNC_MAXFRAMES *
+        sizeof(t_sample));
+    x->r_ratio = 1;
+        /* one (zero) frame of history behind the read position */
+    x->r_nfifo = 1;
+    x->r_phase = 1;
+    resync_reset(x);
+    return (x);
+}
+
+void resync_free(t_resync *x)
+{
+    freebytes(x->r_fifo, x->r_nchans * RESYNC_FIFOSIZE * sizeof(t_sample));
+    freebytes(x->r_buf, x->r_nchans * RESYNC_MAXFRAMES * sizeof(t_sample));
+    freebytes(x, sizeof(*x));
+}
+
+    /* after an xrun the fill means nothing; settle on a new target.  The
+    drift estimate is kept since the clocks haven't changed. */
+void resync_reset(t_resync *x)
+{
+    x->r_settle = RESYNC_SETTLE;
+    x->r_fill = -1;
+}
+
+    /* current correction in parts per million */
+double resync_getdrift(t_resync *x)
+{
+    return ((x->r_ratio - 1) * 1e6);
+}
+
+    /* feed back the device's fill, once per block: frames queued for an
+    output device or frames waiting to be read from an input one */
+static void resync_setfill(t_resync *x, int fill)
+{
+    double err, corr;
+    if (x->r_fill < 0)
+        x->r_fill = fill;
+    else x->r_fill += RESYNC_SMOOTH * (fill - x->r_fill);
+    if (x->r_settle > 0)
+    {
+        if (!--x->r_settle)
+            x->r_target = x->r_fill;
+        err = 0;
+    }
+    else err = x->r_fill - x->r_target;
+    corr = RESYNC_KP * err + RESYNC_KI * (x->r_integral + err);
+    if (corr > RESYNC_MAXDRIFT)
+        corr = RESYNC_MAXDRIFT;
+    else if (corr < -RESYNC_MAXDRIFT)
+        corr = -RESYNC_MAXDRIFT;
+    else x->r_integral += err;  /* don't wind up while we're at the limit */
+        /* too much queued output means the device runs slow against us,
+        so we send it fewer frames; too much waiting input, that it's fast */
+    x->r_ratio = (x->r_output ? 1 - corr : 1 + corr);
+}
+
+    /* append "n" frames of "nin" channels; any others get zeros */
+static void resync_push(t_resync *x, const t_sample *in, int nin,
+    int instride, int n)
+{
+    int ch;
+    if (n > RESYNC_FIFOSIZE - x->r_nfifo)
+        n = RESYNC_FIFOSIZE - x->r_nfifo;
+    for (ch = 0; ch < x->r_nchans; ch++)
+    {
+        t_sample *fp = x->r_fifo + ch * RESYNC_FIFOSIZE + x->r_nfifo;
+        if (ch < nin && in)
+            memcpy(fp, in + ch * instride, n * sizeof(t_sample));
+        else memset(fp, 0, n * sizeof(t_sample));
+    }
+    x->r_nfifo += n;
+}
+
+    /* how many frames, "incr" FIFO frames apart, we can interpolate from
+    what's in the FIFO.  Each needs the frame after its successor. */
+static int resync_navail(t_resync *x, double incr)
+{
+    double room = x->r_nfifo - 2 - x->r_phase;
+    return (room > 0 ? (int)ceil(room / incr) : 0);
+}
+
+    /* interpolate "n" frames into "nout" channels, as tabread4~ does, then
+    drop the FIFO frames we're done with */
+static void resync_pull(t_resync *x, t_sample *out, int nout, int outstride,
+    int n, double incr)
+{
+    int ch, i, drop;
+    for (ch = 0; ch < nout; ch++)
+    {
+        t_sample *fifo = x->r_fifo + ch * RESYNC_FIFOSIZE,
+            *op = out + ch * outstride;
+        double phase = x->r_phase;
+        if (ch >= x->r_nchans)
+        {
+            memset(op, 0, n * sizeof(t_sample));
+            continue;
+        }
+        for (i = 0; i < n; i++, phase += incr)
+        {
+            int index = phase;
+            t_sample frac = phase - index, *wp = fifo + index,
+                a = wp[-1], b = wp[0], c = wp[1], d = wp[2], cminusb = c-b;
+            op[i] = b + frac * (
+                cminusb - 0.1666667f * (1.-frac) * (
+                    (d - a - 3.0f * cminusb) * frac + (d + 2.0f*a - 3.0f*b)
+                )
+            );
+        }
+    }
+    x->r_phase += n * incr;
+    if ((drop = (int)x->r_phase - 1) > 0)
+    {
+        for (ch = 0; ch < x->r_nchans; ch++)
+            memmove(x->r_fifo + ch * RESYNC_FIFOSIZE,
+                x->r_fifo + ch * RESYNC_FIFOSIZE + drop,
+                    (x->r_nfifo - drop) * sizeof(t_sample));
+        x->r_nfifo -= drop;
+        x->r_phase -= drop;
+    }
+}
+
+    /* output: take a block of "nin" of Pd's channels and return how many
+    device frames are now in resync_getbuf() ("fill" frames were queued) */
+int resync_out(t_resync *x, const t_sample *in, int nin, int instride,
+    int fill)
+{
+    double incr;
+    int n;
+    resync_setfill(x, fill);
+    resync_push(x, in, nin, instride, DEFDACBLKSIZE);
+    incr = 1. / x->r_ratio;
+    if ((n = resync_navail(x, incr)) > RESYNC_MAXFRAMES)
+        n = RESYNC_MAXFRAMES;
+    resync_pull(x, x->r_buf, x->r_nchans, RESYNC_MAXFRAMES, n, incr);
+    return (n);
+}
+
+    /* input: how many device frames to read into resync_getbuf() for the
+    next block ("fill" frames are waiting) ... */
+int resync_inneed(t_resync *x, int fill)
+{
+    int need;
+    resync_setfill(x, fill);
+        /* the last frame for Pd needs the FIFO up to 2 past its index */
+    need = (int)(x->r_phase + (DEFDACBLKSIZE - 1) * x->r_ratio) + 3 -
+        x->r_nfifo;
+    return (x->r_need = (need < 0 ? 0 :
+        (need > RESYNC_MAXFRAMES ? RESYNC_MAXFRAMES : need)));
+}
+
+    /* ... and once "nread" of them are there, make a block for "nout" of
+    Pd's channels.  If the device came up short we fill in with zeros. */
+void resync_in(t_resync *x, int nread, t_sample *out, int nout,
+    int outstride)
+{
+    if (nread > x->r_need)
+        nread = x->r_need;
+    resync_push(x, x->r_buf, x->r_nchans, RESYNC_MAXFRAMES,
+        (nread > 0 ? nread : 0));
+    if (nread < x->r_need)
+        resync_push(x, 0, 0, 0, x->r_need - (nread > 0 ? nread : 0));
+    resync_pull(x, out, nout, outstride, DEFDACBLKSIZE, x->r_ratio);
+}
+
+t_sample *resync_getbuf(t_resync *x)
+{
+    return (x->r_buf);
+}
+
 t_float sys_getsr(void)
 {
      return (STUFF->st_dacsr);
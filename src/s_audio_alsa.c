@@ -41,11 +41,6 @@ static void alsa_numbertoname(int iodev, char *devname, int nchar);
 static int alsa_jittermax;
 #define ALSA_DEFJITTERMAX 5
 
-    /* don't assume we can turn all 31 bits when doing float-to-fix;
-    otherwise some audio drivers (e.g. Midiman/ALSA) wrap around. */
-#define FMAX 0x7ffff000
-#define CLIP32(x) (((x)>FMAX)?FMAX:((x) < -FMAX)?-FMAX:(x))
-
 static char *alsa_snd_buf;
 static int alsa_snd_bufsize;
 static int alsa_buf_samps;
@@ -74,6 +69,21 @@ static void check_error(int err, int fn, const char *why)
                 why, snd_strerror(err));
 }
 
+    /* plain transfer of a buffer of frames, for either kind of access */
+static snd_pcm_sframes_t alsa_writebuf(t_alsa_dev *dev, void *buf,
+    snd_pcm_uframes_t nframes)
+{
+    return (dev->a_mmap ? snd_pcm_mmap_writei(dev->a_handle, buf, nframes) :
+        snd_pcm_writei(dev->a_handle, buf, nframes));
+}
+
+static snd_pcm_sframes_t alsa_readbuf(t_alsa_dev *dev, void *buf,
+    snd_pcm_uframes_t nframes)
+{
+    return (dev->a_mmap ? snd_pcm_mmap_readi(dev->a_handle, buf, nframes) :
+        snd_pcm_readi(dev->a_handle, buf, nframes));
+}
+
 /* figure out, when opening ALSA device, whether we should use the code in
 this file or defer to Winfried Ritch's code to do mapped transfers (handled
 in s_audio_alsamm.c). */
@@ -126,9 +136,14 @@ static int alsaio_setup(t_alsa_dev *dev, int out, int *channels, int *rate,
     err = snd_pcm_hw_params_any(dev->a_handle, hw_params);
     check_error(err, out, "snd_pcm_hw_params_any");
 
-        /* try to set interleaved access */
+        /* try to set interleaved access, memory-mapped if possible so that
+        we can convert samples straight into and out of the device's buffer */
     err = snd_pcm_hw_params_set_access(dev->a_handle,
-        hw_params, SND_PCM_ACCESS_RW_INTERLEAVED);
+        hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED);
+    dev->a_mmap = (err >= 0);
+    if (err < 0)
+        err = snd_pcm_hw_params_set_access(dev->a_handle,
+            hw_params, SND_PCM_ACCESS_RW_INTERLEAVED);
     if (err < 0)
         return (-1);
     check_error(err, out, "snd_pcm_hw_params_set_access");
@@ -202,7 +217,7 @@ static int alsaio_setup(t_alsa_dev *dev, int out, int *channels, int *rate,
     if (err < 0)
         return (-1);
         /* set up the buffer */
-    bufsizeforthis = DEFDACBLKSIZE * dev->a_sampwidth * *channels;
+    bufsizeforthis = RESYNC_MAXFRAMES * dev->a_sampwidth * *channels;
     if (alsa_snd_buf)
     {
         if (alsa_snd_bufsize < bufsizeforthis)
@@ -295,6 +310,7 @@ int alsa_open_audio(int naudioindev, int *audioindev, int nchindev,
         if (err < 0)
             continue;
         alsa_indev[alsa_nindev].a_devno = audioindev[iodev];
+        alsa_indev[alsa_nindev].a_resync = 0;
         snd_pcm_nonblock(alsa_indev[alsa_nindev].a_handle, 1);
         logpost(NULL, PD_VERBOSE, "opened input device name %s", devname);
         alsa_nindev++;
@@ -308,6 +324,7 @@ int alsa_open_audio(int naudioindev, int *audioindev, int nchindev,
         if (err < 0)
             continue;
         alsa_outdev[alsa_noutdev].a_devno = audiooutdev[iodev];
+        alsa_outdev[alsa_noutdev].a_resync = 0;
         snd_pcm_nonblock(alsa_outdev[alsa_noutdev].a_handle, 1);
         alsa_noutdev++;
     }
@@ -349,6 +366,22 @@ int alsa_open_audio(int naudioindev, int *audioindev, int nchindev,
     if (!inchans && !outchans)
         goto blewit;
 
+        /* with -aggregate, resample any device that isn't the first one
+        (or the other direction of the same card) to keep it in step */
+    if (sys_aggregate)
+    {
+        int refdevno = (alsa_noutdev ? alsa_outdev[0].a_devno :
+            alsa_indev[0].a_devno);
+        for (iodev = 0; iodev < alsa_nindev; iodev++)
+            if (alsa_indev[iodev].a_devno != refdevno)
+                alsa_indev[iodev].a_resync =
+                    resync_new(alsa_indev[iodev].a_channels, 0);
+        for (iodev = 0; iodev < alsa_noutdev; iodev++)
+            if (alsa_outdev[iodev].a_devno != refdevno)
+                alsa_outdev[iodev].a_resync =
+                    resync_new(alsa_outdev[iodev].a_channels, 1);
+    }
+
     for (iodev = 0; iodev < alsa_nindev; iodev++)
         snd_pcm_prepare(alsa_indev[iodev].a_handle);
     for (iodev = 0; iodev < alsa_noutdev; iodev++)
@@ -382,7 +415,7 @@ int alsa_open_audio(int naudioindev, int *audioindev, int nchindev,
         while (i--)
         {
             for (iodev = 0; iodev < alsa_noutdev; iodev++)
-                snd_pcm_writei(alsa_outdev[iodev].a_handle, alsa_snd_buf,
+                alsa_writebuf(&alsa_outdev[iodev], alsa_snd_buf,
                     DEFDACBLKSIZE);
         }
     }
@@ -416,23 +449,113 @@ void alsa_close_audio(void)
     {
         err = snd_pcm_close(alsa_indev[iodev].a_handle);
         check_error(err, 0, "snd_pcm_close");
+        if (alsa_indev[iodev].a_resync)
+            resync_free(alsa_indev[iodev].a_resync),
+                alsa_indev[iodev].a_resync = 0;
     }
     for (iodev = 0; iodev < alsa_noutdev; iodev++)
     {
         err = snd_pcm_close(alsa_outdev[iodev].a_handle);
         check_error(err, 1, "snd_pcm_close");
+        if (alsa_outdev[iodev].a_resync)
+            resync_free(alsa_outdev[iodev].a_resync),
+                alsa_outdev[iodev].a_resync = 0;
     }
     alsa_nindev = alsa_noutdev = 0;
 }
 
+static int alsa_sampfmt(t_alsa_dev *dev)
+{
+    return (dev->a_sampwidth == 4 ? SAMPFMT_S32 :
+        (dev->a_sampwidth == 3 ? SAMPFMT_S24_3LE : SAMPFMT_S16));
+}
+
+    /* write "nframes" of output from "nin" of Pd's channels, "instride"
+    apart.  If the device is memory-mapped, convert straight into its
+    buffer; otherwise go through alsa_snd_buf.  Returns the number of frames
+    written or a negative error code.  The caller has checked there's room
+    for all of them. */
+static snd_pcm_sframes_t alsa_putblock(t_alsa_dev *dev, const t_sample *in,
+    int nin, int instride, int nframes)
+{
+    int format = alsa_sampfmt(dev);
+    if (dev->a_mmap)
+    {
+        snd_pcm_uframes_t done = 0;
+        while (done < (snd_pcm_uframes_t)nframes)
+        {
+            const snd_pcm_channel_area_t *areas;
+            snd_pcm_uframes_t offset, frames = nframes - done;
+            snd_pcm_sframes_t n;
+            int err = snd_pcm_mmap_begin(dev->a_handle, &areas, &offset,
+                &frames);
+            if (err < 0)
+                return (err);
+            if (!frames)
+                break;
+            sys_interleave((char *)areas[0].addr +
+                (areas[0].first + offset * areas[0].step) / 8, format,
+                    dev->a_channels, in + done, nin, instride, frames);
+            if ((n = snd_pcm_mmap_commit(dev->a_handle, offset, frames)) < 0)
+                return (n);
+            done += n;
+            if ((snd_pcm_uframes_t)n < frames)
+                break;      /* the ring wrapped; go around again */
+        }
+        return (done);
+    }
+    sys_interleave(alsa_snd_buf, format, dev->a_channels, in, nin,
+        instride, nframes);
+    return (snd_pcm_writei(dev->a_handle, alsa_snd_buf, nframes));
+}
+
+    /* the same for input into "nout" channels */
+static snd_pcm_sframes_t alsa_getblock(t_alsa_dev *dev, t_sample *out,
+    int nout, int outstride, int nframes)
+{
+    int format = alsa_sampfmt(dev);
+    snd_pcm_sframes_t result;
+    if (dev->a_mmap)
+    {
+        snd_pcm_uframes_t done = 0;
+        while (done < (snd_pcm_uframes_t)nframes)
+        {
+            const snd_pcm_channel_area_t *areas;
+            snd_pcm_uframes_t offset, frames = nframes - done;
+            snd_pcm_sframes_t n;
+            int err = snd_pcm_mmap_begin(dev->a_handle, &areas, &offset,
+                &frames);
+            if (err < 0)
+                return (err);
+            if (!frames)
+                break;
+            sys_deinterleave(out + done, nout, outstride,
+                (char *)areas[0].addr +
+                    (areas[0].first + offset * areas[0].step) / 8, format,
+                        dev->a_channels, frames);
+            if ((n = snd_pcm_mmap_commit(dev->a_handle, offset, frames)) < 0)
+                return (n);
+            done += n;
+            if ((snd_pcm_uframes_t)n < frames)
+                break;
+        }
+        return (done);
+    }
+    result = snd_pcm_readi(dev->a_handle, alsa_snd_buf, nframes);
+    sys_deinterleave(out, nout, outstride, alsa_snd_buf, format,
+        dev->a_channels, (result > 0 ? result : 0));
+    return (result);
+}
+
 int alsa_send_dacs(void)
 {
     static double timenow;
     double timelast;
-    t_sample *fp, *fp1, *fp2;
-    int i, j, k, err, iodev, result, ch, goterror = 0, busy = 0;
+    t_sample *fp1;
+    int iodev, result, goterror = 0, busy = 0;
     int chansintogo, chansouttogo;
     unsigned int transfersize;
+    snd_pcm_sframes_t infill[ALSA_MAXDEV], outfill[ALSA_MAXDEV];
     if (alsa_usemmap)
         return (alsamm_send_dacs());
 
@@ -463,6 +586,8 @@ int alsa_send_dacs(void)
             fprintf(stderr, "restart alsa input\n");
             if (res2 < 0)
                 fprintf(stderr, "alsa xrun recovery apparently failed\n");
+            if (alsa_indev[iodev].a_resync)
+                resync_reset(alsa_indev[iodev].a_resync);
         }
         snd_pcm_status(alsa_indev[iodev].a_handle, alsa_status);
 #ifdef DEBUG_ALSA_XFER
@@ -471,8 +596,10 @@ int alsa_send_dacs(void)
                 snd_pcm_status_get_avail(alsa_status),
                 snd_pcm_status_get_delay(alsa_status));
 #endif
-        if (snd_pcm_status_get_avail(alsa_status) < transfersize)
-            busy = 1;
+        infill[iodev] = snd_pcm_status_get_avail(alsa_status);
+        if (infill[iodev] < (alsa_indev[iodev].a_resync ?
+            RESYNC_MAXFRAMES : transfersize))
+                busy = 1;
     }
     for (iodev = 0; iodev < alsa_noutdev; iodev++)
     {
@@ -483,6 +610,8 @@ int alsa_send_dacs(void)
             fprintf(stderr, "restart alsa output\n");
             if (res2 < 0)
                 fprintf(stderr, "alsa xrun recovery apparently failed\n");
+            if (alsa_outdev[iodev].a_resync)
+                resync_reset(alsa_outdev[iodev].a_resync);
         }
         snd_pcm_status(alsa_outdev[iodev].a_handle, alsa_status);
 #ifdef DEBUG_ALSA_XFER
@@ -493,8 +622,10 @@ int alsa_send_dacs(void)
                     snd_pcm_status_get_avail(alsa_status) +
                     snd_pcm_status_get_delay(alsa_status));
 #endif
-        if (snd_pcm_status_get_avail(alsa_status) < transfersize)
-            return (SENDDACS_NO);
+        outfill[iodev] = snd_pcm_status_get_delay(alsa_status);
+        if (snd_pcm_status_get_avail(alsa_status) <
+            (alsa_outdev[iodev].a_resync ? RESYNC_MAXFRAMES : transfersize))
+                return (SENDDACS_NO);
     }
     if (busy)
         return (SENDDACS_NO);
@@ -503,72 +634,25 @@ int alsa_send_dacs(void)
         post("xfer %d", transfersize);
 #endif
     /* do output */
-    for (iodev = 0, fp1 = STUFF->st_soundout, ch = 0;
-        iodev < alsa_noutdev; iodev++)
+    for (iodev = 0, fp1 = STUFF->st_iosoundout; iodev < alsa_noutdev; iodev++)
     {
-        int thisdevchans = alsa_outdev[iodev].a_channels;
+        t_alsa_dev *dev = &alsa_outdev[iodev];
+        int thisdevchans = dev->a_channels, want = transfersize;
         int chans = (chansouttogo < thisdevchans ? chansouttogo : thisdevchans);
         chansouttogo -= chans;
 
-        if (alsa_outdev[iodev].a_sampwidth == 4)
+        if (dev->a_resync)
         {
-            for (i = 0; i < chans; i++, ch++, fp1 += DEFDACBLKSIZE)
-                for (j = i, k = DEFDACBLKSIZE, fp2 = fp1; k--;
-                     j += thisdevchans, fp2++)
-            {
-                t_sample s1 = *fp2 * INT32_MAX;
-                ((t_alsa_sample32 *)alsa_snd_buf)[j] = CLIP32(s1);
-            }
-            for (; i < thisdevchans; i++, ch++)
-                for (j = i, k = DEFDACBLKSIZE; k--; j += thisdevchans)
-                    ((t_alsa_sample32 *)alsa_snd_buf)[j] = 0;
+            want = resync_out(dev->a_resync, fp1, chans, DEFDACBLKSIZE,
+                outfill[iodev]);
+            result = alsa_putblock(dev, resync_getbuf(dev->a_resync),
+                thisdevchans, RESYNC_MAXFRAMES, want);
         }
-        else if (alsa_outdev[iodev].a_sampwidth == 3)
-        {
-            for (i = 0; i < chans; i++, ch++, fp1 += DEFDACBLKSIZE)
-                for (j = i, k = DEFDACBLKSIZE, fp2 = fp1; k--;
-                     j += thisdevchans, fp2++)
-            {
-                int s = *fp2 * 8388352.;
-                if (s > 8388351)
-                    s = 8388351;
-                else if (s < -8388351)
-                    s = -8388351;
-#if BYTE_ORDER == LITTLE_ENDIAN
-                ((char *)(alsa_snd_buf))[3*j] = (s & 255);
-                ((char *)(alsa_snd_buf))[3*j+1] = ((s>>8) & 255);
-                ((char *)(alsa_snd_buf))[3*j+2] = ((s>>16) & 255);
-#else
-                fprintf(stderr, "big endian 24-bit not supported");
-#endif
-            }
-            for (; i < thisdevchans; i++, ch++)
-                for (j = i, k = DEFDACBLKSIZE; k--; j += thisdevchans)
-                    ((char *)(alsa_snd_buf))[3*j] =
-                    ((char *)(alsa_snd_buf))[3*j+1] =
-                    ((char *)(alsa_snd_buf))[3*j+2] = 0;
-        }
-        else        /* 16 bit samples */
-        {
-            for (i = 0; i < chans; i++, ch++, fp1 += DEFDACBLKSIZE)
-                for (j = ch, k = DEFDACBLKSIZE, fp2 = fp1; k--;
-                     j += thisdevchans, fp2++)
-            {
-                int s = *fp2 * 32767.;
-                if (s > 32767)
-                    s = 32767;
-                else if (s < -32767)
-                    s = -32767;
-                ((t_alsa_sample16 *)alsa_snd_buf)[j] = s;
-            }
-            for (; i < thisdevchans; i++, ch++)
-                for (j = ch, k = DEFDACBLKSIZE; k--; j += thisdevchans)
-                    ((t_alsa_sample16 *)alsa_snd_buf)[j] = 0;
-        }
-        result = snd_pcm_writei(alsa_outdev[iodev].a_handle, alsa_snd_buf,
-            transfersize);
+        else result = alsa_putblock(dev, fp1, chans, DEFDACBLKSIZE,
+            DEFDACBLKSIZE);
+        fp1 += chans * DEFDACBLKSIZE;
 
-        if (result != (int)transfersize)
+        if (result != want)
         {
     #ifdef DEBUG_ALSA_XFER
             if (result >= 0 || errno == EAGAIN)
@@ -578,9 +662,11 @@ int alsa_send_dacs(void)
                          snd_strerror(errno));
     #endif
             sys_log_error(ERR_DATALATE);
+            if (dev->a_resync)
+                resync_reset(dev->a_resync);
             if (result == -EPIPE)
             {
-                result = snd_pcm_prepare(alsa_outdev[iodev].a_handle);
+                result = snd_pcm_prepare(dev->a_handle);
                 if (result < 0)
                     fprintf(stderr, "read reset error %d\n", result);
             }
@@ -591,10 +677,6 @@ int alsa_send_dacs(void)
                 goterror = 1;
             }
         }
-
-        /* zero out the output buffer */
-        memset(STUFF->st_soundout, 0, DEFDACBLKSIZE * sizeof(*STUFF->st_soundout) *
-               STUFF->st_outchannels);
         if (sys_getrealtime() - timenow > 0.002)
         {
     #ifdef DEBUG_ALSA_XFER
@@ -605,16 +687,28 @@ int alsa_send_dacs(void)
             sys_log_error(ERR_DACSLEPT);
         }
     }
+        /* zero out the output buffer */
+    memset(STUFF->st_iosoundout, 0,
+        DEFDACBLKSIZE * sizeof(*STUFF->st_iosoundout) * STUFF->st_outchannels);
 
             /* do input */
-    for (iodev = 0, fp1 = STUFF->st_soundin, ch = 0; iodev < alsa_nindev; iodev++)
+    for (iodev = 0, fp1 = STUFF->st_iosoundin; iodev < alsa_nindev; iodev++)
     {
-        int thisdevchans = alsa_indev[iodev].a_channels;
+        t_alsa_dev *dev = &alsa_indev[iodev];
+        int thisdevchans = dev->a_channels, want = transfersize;
         int chans = (chansintogo < thisdevchans ? chansintogo : thisdevchans);
-        chansouttogo -= chans;
-        result = snd_pcm_readi(alsa_indev[iodev].a_handle, alsa_snd_buf,
-            transfersize);
-        if (result < (int)transfersize)
+        chansintogo -= chans;
+        if (dev->a_resync)
+        {
+            want = resync_inneed(dev->a_resync, infill[iodev]);
+            result = (want ? alsa_getblock(dev, resync_getbuf(dev->a_resync),
+                thisdevchans, RESYNC_MAXFRAMES, want) : 0);
+            resync_in(dev->a_resync, result, fp1, chans, DEFDACBLKSIZE);
+        }
+        else result = alsa_getblock(dev, fp1, chans, DEFDACBLKSIZE,
+            DEFDACBLKSIZE);
+        fp1 += chans * DEFDACBLKSIZE;
+        if (result < want)
         {
 #ifdef DEBUG_ALSA_XFER
             if (result < 0)
@@ -624,9 +718,11 @@ int alsa_send_dacs(void)
                          callno, xferno, result);
 #endif
             sys_log_error(ERR_DATALATE);
+            if (dev->a_resync)
+                resync_reset(dev->a_resync);
             if (result == -EPIPE)
             {
-                result = snd_pcm_prepare(alsa_indev[iodev].a_handle);
+                result = snd_pcm_prepare(dev->a_handle);
                 if (result < 0)
                     fprintf(stderr, "read reset error %d\n", result);
             }
@@ -637,43 +733,6 @@ int alsa_send_dacs(void)
                 goterror = 1;
             }
         }
-        if (alsa_indev[iodev].a_sampwidth == 4)
-        {
-            for (i = 0; i < chans; i++, ch++, fp1 += DEFDACBLKSIZE)
-            {
-                for (j = ch, k = DEFDACBLKSIZE, fp2 = fp1; k--;
-                     j += thisdevchans, fp2++)
-                    *fp2 = (t_sample) ((t_alsa_sample32 *)alsa_snd_buf)[j]
-                        * (1./ INT32_MAX);
-            }
-        }
-        else if (alsa_indev[iodev].a_sampwidth == 3)
-        {
-#if BYTE_ORDER == LITTLE_ENDIAN
-            for (i = 0; i < chans; i++, ch++, fp1 += DEFDACBLKSIZE)
-            {
-                for (j = ch, k = DEFDACBLKSIZE, fp2 = fp1; k--;
-                     j += thisdevchans, fp2++)
-                    *fp2 = ((t_sample) (
-                        (((unsigned char *)alsa_snd_buf)[3*j] << 8)
-                        | (((unsigned char *)alsa_snd_buf)[3*j+1] << 16)
-                        | (((unsigned char *)alsa_snd_buf)[3*j+2] << 24)))
-                        * (1./ INT32_MAX);
-            }
-#else
-                fprintf(stderr, "big endian 24-bit not supported");
-#endif
-        }
-        else
-        {
-            for (i = 0; i < chans; i++, ch++, fp1 += DEFDACBLKSIZE)
-            {
-                for (j = ch, k = DEFDACBLKSIZE, fp2 = fp1; k--;
-                    j += thisdevchans, fp2++)
-                        *fp2 = (t_sample) ((t_alsa_sample16 *)alsa_snd_buf)[j]
-                            * 3.051850e-05;
-            }
-        }
     }
 #ifdef DEBUG_ALSA_XFER
     xferno++;
@@ -730,6 +789,14 @@ void alsa_printstate(void)
     post("sum delay %d available %d", indelay + outdelay, inavail + outavail);
 
     post("buf samples %d", alsa_buf_samps);
+    for (iodev = 0; iodev < alsa_nindev; iodev++)
+        if (alsa_indev[iodev].a_resync)
+            post("input device %d resampled by %g ppm", iodev,
+                resync_getdrift(alsa_indev[iodev].a_resync));
+    for (iodev = 0; iodev < alsa_noutdev; iodev++)
+        if (alsa_outdev[iodev].a_resync)
+            post("output device %d resampled by %g ppm", iodev,
+                resync_getdrift(alsa_outdev[iodev].a_resync));
     post("");
 }
 
@@ -741,7 +808,7 @@ void alsa_putzeros(int iodev, int n)
             alsa_outdev[iodev].a_channels);
     for (i = 0; i < n; i++)
     {
-        result = snd_pcm_writei(alsa_outdev[iodev].a_handle, alsa_snd_buf,
+        result = alsa_writebuf(&alsa_outdev[iodev], alsa_snd_buf,
             DEFDACBLKSIZE);
 #if 0
         if (result != DEFDACBLKSIZE)
@@ -756,7 +823,7 @@ void alsa_getzeros(int iodev, int n)
     int i, result;
     for (i = 0; i < n; i++)
     {
-        result = snd_pcm_readi(alsa_indev[iodev].a_handle, alsa_snd_buf,
+        result = alsa_readbuf(&alsa_indev[iodev], alsa_snd_buf,
             DEFDACBLKSIZE);
 #if 0
         if (result != DEFDACBLKSIZE)
@@ -784,6 +851,8 @@ static void alsa_checkiosync(void)
         maxphase = -0x7fffffff;
         for (iodev = 0; iodev < alsa_noutdev; iodev++)
         {
+            if (alsa_outdev[iodev].a_resync)
+                continue;   /* the resampler keeps it in step */
             if ((result = snd_pcm_state(alsa_outdev[iodev].a_handle))
                 == SND_PCM_STATE_XRUN)
             {
@@ -823,6 +892,8 @@ static void alsa_checkiosync(void)
         }
         for (iodev = 0; iodev < alsa_nindev; iodev++)
         {
+            if (alsa_indev[iodev].a_resync)
+                continue;
             if ((result = snd_pcm_state(alsa_indev[iodev].a_handle))
                 == SND_PCM_STATE_XRUN)
             {
@@ -861,6 +932,8 @@ static void alsa_checkiosync(void)
 
         for (iodev = 0; iodev < alsa_noutdev; iodev++)
         {
+            if (alsa_outdev[iodev].a_resync)
+                continue;
             result = snd_pcm_delay(alsa_outdev[iodev].a_handle, &outdelay);
             if (result < 0)
                 outdelay = result;
@@ -878,6 +951,8 @@ static void alsa_checkiosync(void)
         }
         for (iodev = 0; iodev < alsa_nindev; iodev++)
         {
+            if (alsa_indev[iodev].a_resync)
+                continue;
             result = snd_pcm_delay(alsa_indev[iodev].a_handle, &thisphase);
             if (result < 0)
                 thisphase = 0;
@@ -28,6 +28,8 @@ typedef struct _alsa_dev
     int a_channels;
     char **a_addr;
     int a_synced;
+    int a_mmap;         /* interleaved, but through the mmap interface */
+    t_resync *a_resync; /* drift compensation if not on the first clock */
 } t_alsa_dev;
 
 extern t_alsa_dev alsa_indev[ALSA_MAXDEV];
@@ -1098,7 +1098,7 @@ int alsamm_send_dacs(void)
 
 
   /* OUTPUT Transfer */
-  fpo = STUFF->st_soundout;
+  fpo = STUFF->st_iosoundout;
   for(devno = 0;devno < alsa_noutdev;devno++){
 
     t_alsa_dev *dev = &alsa_outdev[devno];
@@ -1234,7 +1234,7 @@ int alsamm_send_dacs(void)
   }/* for devno */
 
 
-  fpi = STUFF->st_soundin; /* star first card first channel */
+  fpi = STUFF->st_iosoundin; /* star first card first channel */
 
   for(devno = 0;devno < alsa_nindev;devno++){
 
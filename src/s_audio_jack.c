@@ -40,10 +40,10 @@ static int jack_should_autoconnect = 1;
 static int jack_blocksize = 0; /* should this be PERTHREAD? */
 pthread_mutex_t jack_mutex;
 pthread_cond_t jack_sem;
-static PA_VOLATILE char *jack_outbuf;
-static PA_VOLATILE sys_ringbuf jack_outring;
-static PA_VOLATILE char *jack_inbuf;
-static PA_VOLATILE sys_ringbuf jack_inring;
+static char *jack_outbuf;
+static sys_ringbuf jack_outring;
+static char *jack_inbuf;
+static sys_ringbuf jack_inring;
 
 /* #define TESTCANSLEEP */
 
@@ -56,10 +56,7 @@ static int jack_polling_callback(jack_nframes_t nframes, void *unused)
 {
     unsigned long infiforoom = sys_ringbuf_getwriteavailable(&jack_inring),
         outfiforoom = sys_ringbuf_getreadavailable(&jack_outring);
-    t_sample *muxbuffer =  (t_sample *)alloca(sizeof (t_sample) * nframes *
-        (STUFF->st_inchannels > STUFF->st_outchannels ?
-            STUFF->st_inchannels : STUFF->st_outchannels));
-    int j;
+    int j, k, n, nchans = STUFF->st_inchannels;
     jack_default_audio_sample_t *jp;
 
         /* even though the FIFO is lock-free we have to lock here
@@ -80,33 +77,41 @@ static int jack_polling_callback(jack_nframes_t nframes, void *unused)
     }
     else
     {
-        t_sample *fp, *fp2;
+            /* interleave straight into the FIFO's (one or two) free
+            regions, and back out of the filled ones */
+        void *region[2];
+        long size[2];
+        t_sample *fp;
         int ch;
-        if (STUFF->st_inchannels)
+        if (nchans)
         {
-            for (fp = muxbuffer, ch = 0; ch < STUFF->st_inchannels; ch++, fp++)
+            sys_ringbuf_getwriteregions(&jack_inring,
+                nframes * nchans * sizeof(t_sample),
+                    &region[0], &size[0], &region[1], &size[1], jack_inbuf);
+            for (ch = 0; ch < nchans; ch++)
             {
                 jp = jack_port_get_buffer(input_port[ch], nframes);
-                for (j = 0, fp2 = fp; j < (int)nframes;
-                    j++, fp2 += STUFF->st_inchannels)
-                        *fp2 = jp[j];
+                for (k = 0, j = 0; k < 2; k++)
+                    for (n = size[k] / (nchans * sizeof(t_sample)),
+                        fp = (t_sample *)region[k] + ch; n--; fp += nchans)
+                            *fp = jp[j++];
             }
-            sys_ringbuf_write(&jack_inring, muxbuffer,
-                nframes * STUFF->st_inchannels * sizeof(t_sample),
-                    jack_inbuf);
+            sys_ringbuf_advancewrite(&jack_inring, size[0] + size[1]);
         }
-        if (STUFF->st_outchannels)
+        if ((nchans = STUFF->st_outchannels))
         {
-            sys_ringbuf_read(&jack_outring, muxbuffer,
-                nframes * STUFF->st_outchannels * sizeof(t_sample),
-                    jack_outbuf);
-            for (fp = muxbuffer, ch = 0; ch < STUFF->st_outchannels; ch++, fp++)
+            sys_ringbuf_getreadregions(&jack_outring,
+                nframes * nchans * sizeof(t_sample),
+                    &region[0], &size[0], &region[1], &size[1], jack_outbuf);
+            for (ch = 0; ch < nchans; ch++)
             {
                 jp = jack_port_get_buffer(output_port[ch], nframes);
-                for (j = 0, fp2 = fp; j < (int)nframes;
-                    j++, fp2 += STUFF->st_outchannels)
-                        jp[j] = *fp2;
+                for (k = 0, j = 0; k < 2; k++)
+                    for (n = size[k] / (nchans * sizeof(t_sample)),
+                        fp = (t_sample *)region[k] + ch; n--; fp += nchans)
+                            jp[j++] = *fp;
             }
+            sys_ringbuf_advanceread(&jack_outring, size[0] + size[1]);
         }
     }
     pthread_cond_broadcast(&jack_sem);
@@ -114,44 +119,83 @@ static int jack_polling_callback(jack_nframes_t nframes, void *unused)
     return 0;
 }
 
+static t_sample *jack_cbout;
+static int jack_cboutsize;
+static int jack_cbphase;    /* frames into the current block */
+
+static void jack_copyin(t_sample *to, const jack_default_audio_sample_t *from,
+    int n)
+{
+#if PD_FLOATSIZE == 32
+    memcpy(to, from, n * sizeof(t_sample));
+#else
+    while (n--)
+        *to++ = *from++;
+#endif
+}
+
+static void jack_copyout(jack_default_audio_sample_t *to, const t_sample *from,
+    int n)
+{
+#if PD_FLOATSIZE == 32
+    memcpy(to, from, n * sizeof(t_sample));
+#else
+    while (n--)
+        *to++ = *from++;
+#endif
+}
+
+    /* callback routine for callback client: Pd's DSP tick runs right here,
+    once per DEFDACBLKSIZE frames, copying straight between the port buffers
+    and Pd's.  If JACK's period isn't a multiple of that (e.g. 32 frames),
+    inputs are collected until there's a whole block and outputs are played
+    out of jack_cbout, a block behind. */
 static int callbackprocess(jack_nframes_t nframes, void *arg)
 {
-    int chan, j, k;
-    unsigned int n;
-    jack_default_audio_sample_t *out[MAX_JACK_PORTS], *in[MAX_JACK_PORTS], *jp;
-    if (nframes % DEFDACBLKSIZE)
-    {
-        fprintf(stderr, "jack: nframes %d not a multiple of blocksize %d\n",
-            nframes, DEFDACBLKSIZE);
-        nframes -= (nframes % DEFDACBLKSIZE);
-    }
-    for (chan = 0; chan < STUFF->st_inchannels; chan++)
+    int chan, nin = STUFF->st_inchannels, nout = STUFF->st_outchannels;
+    unsigned int n, m;
+    jack_default_audio_sample_t *out[MAX_JACK_PORTS], *in[MAX_JACK_PORTS];
+    for (chan = 0; chan < nin; chan++)
         in[chan] = jack_port_get_buffer(input_port[chan], nframes);
-    for (chan = 0; chan < STUFF->st_outchannels; chan++)
+    for (chan = 0; chan < nout; chan++)
         out[chan] = jack_port_get_buffer(output_port[chan], nframes);
-    for (n = 0; n < nframes; n += DEFDACBLKSIZE)
+    if (!(nframes % DEFDACBLKSIZE) && !jack_cbphase)
+        for (n = 0; n < nframes; n += DEFDACBLKSIZE)
     {
-        t_sample *fp;
-        for (chan = 0; chan < STUFF->st_inchannels; chan++)
+        for (chan = 0; chan < nin; chan++)
             if (in[chan])
-        {
-            for (fp = STUFF->st_soundin + chan*DEFDACBLKSIZE,
-                jp = in[chan] + n, j=0; j < DEFDACBLKSIZE; j++)
-                    *fp++ = *jp++;
-        }
-        for (chan = 0; chan < STUFF->st_outchannels; chan++)
-        {
-            for (fp = STUFF->st_soundout + chan*DEFDACBLKSIZE,
-                j = 0; j < DEFDACBLKSIZE; j++)
-                    *fp++ = 0;
-        }
+                jack_copyin(STUFF->st_iosoundin + chan*DEFDACBLKSIZE,
+                    in[chan] + n, DEFDACBLKSIZE);
+        memset(STUFF->st_iosoundout, 0,
+            nout * DEFDACBLKSIZE * sizeof(t_sample));
         (*jack_callback)();
-        for (chan = 0; chan < STUFF->st_outchannels; chan++)
+        for (chan = 0; chan < nout; chan++)
+            if (out[chan])
+                jack_copyout(out[chan] + n,
+                    STUFF->st_iosoundout + chan*DEFDACBLKSIZE, DEFDACBLKSIZE);
+    }
+    else for (n = 0; n < nframes; n += m)
+    {
+        m = DEFDACBLKSIZE - jack_cbphase;
+        if (m > nframes - n)
+            m = nframes - n;
+        for (chan = 0; chan < nin; chan++)
+            if (in[chan])
+                jack_copyin(STUFF->st_iosoundin + chan*DEFDACBLKSIZE +
+                    jack_cbphase, in[chan] + n, m);
+        for (chan = 0; chan < nout; chan++)
             if (out[chan])
+                jack_copyout(out[chan] + n,
+                    jack_cbout + chan*DEFDACBLKSIZE + jack_cbphase, m);
+        if ((jack_cbphase += m) == DEFDACBLKSIZE)
         {
-            for (fp = STUFF->st_soundout + chan*DEFDACBLKSIZE, jp = out[chan] + n,
-                j=0; j < DEFDACBLKSIZE; j++)
-                    *jp++ = *fp++;
+            memset(STUFF->st_iosoundout, 0,
+                nout * DEFDACBLKSIZE * sizeof(t_sample));
+            (*jack_callback)();
+            if (jack_cbout)
+                memcpy(jack_cbout, STUFF->st_iosoundout,
+                    nout * DEFDACBLKSIZE * sizeof(t_sample));
+            jack_cbphase = 0;
         }
     }
     return 0;
@@ -444,6 +488,13 @@ int jack_open_audio(int inchans, int outchans, t_audiocallback callback)
         }
     }
 
+        /* in callback mode we need a block of output to play from if
+        JACK's period isn't a multiple of ours */
+    jack_cbphase = 0;
+    if (callback && STUFF->st_outchannels)
+        jack_cbout = (t_sample *)getbytes(jack_cboutsize =
+            STUFF->st_outchannels * DEFDACBLKSIZE * sizeof(t_sample));
+
         /* create ring buffers (if not callback) */
 
     if (!callback && STUFF->st_inchannels)
@@ -493,6 +544,8 @@ void jack_close_audio(void)
         free(jack_inbuf), jack_inbuf = 0;
     if (jack_outbuf)
         free(jack_outbuf), jack_outbuf = 0;
+    if (jack_cbout)
+        freebytes(jack_cbout, jack_cboutsize), jack_cbout = 0;
 
     jack_started = 0;
     jack_blocksize = 0;
@@ -508,10 +561,10 @@ void jack_close_audio(void)
 
 int jack_send_dacs(void)
 {
-    unsigned long infiforoom, outfiforoom;
-    t_sample *muxbuffer;
-    t_sample *fp, *fp2, *jp;
-    int j, ch;
+    void *region[2];
+    long size[2];
+    t_sample *fp, *jp;
+    int j, k, n, ch, nchans;
     double timenow, timeref = sys_getrealtime();
     if (!STUFF->st_inchannels && !STUFF->st_outchannels) return (SENDDACS_NO);
 
@@ -541,36 +594,37 @@ int jack_send_dacs(void)
     }
     jack_started = 1;
 
-    muxbuffer =  (t_sample *)alloca(sizeof (t_sample) * DEFDACBLKSIZE *
-        (STUFF->st_inchannels > STUFF->st_outchannels ?
-            STUFF->st_inchannels : STUFF->st_outchannels));
-    if (STUFF->st_inchannels)
+    if ((nchans = STUFF->st_inchannels))
     {
-        sys_ringbuf_read(&jack_inring, muxbuffer,
-            DEFDACBLKSIZE * STUFF->st_inchannels * sizeof(t_sample),
-                jack_inbuf);
-        for (fp = muxbuffer, ch = 0; ch < STUFF->st_inchannels; ch++, fp++)
+        sys_ringbuf_getreadregions(&jack_inring,
+            DEFDACBLKSIZE * nchans * sizeof(t_sample),
+                &region[0], &size[0], &region[1], &size[1], jack_inbuf);
+        for (ch = 0; ch < nchans; ch++)
         {
-            jp = STUFF->st_soundin + ch * DEFDACBLKSIZE;
-            for (j = 0, fp2 = fp; j < DEFDACBLKSIZE;
-                j++, fp2 += STUFF->st_inchannels)
-                    jp[j] = *fp2;
+            jp = STUFF->st_iosoundin + ch * DEFDACBLKSIZE;
+            for (k = 0, j = 0; k < 2; k++)
+                for (n = size[k] / (nchans * sizeof(t_sample)),
+                    fp = (t_sample *)region[k] + ch; n--; fp += nchans)
+                        jp[j++] = *fp;
         }
+        sys_ringbuf_advanceread(&jack_inring, size[0] + size[1]);
     }
-    if (STUFF->st_outchannels)
+    if ((nchans = STUFF->st_outchannels))
     {
-        for (fp = muxbuffer, ch = 0; ch < STUFF->st_outchannels; ch++, fp++)
+        sys_ringbuf_getwriteregions(&jack_outring,
+            DEFDACBLKSIZE * nchans * sizeof(t_sample),
+                &region[0], &size[0], &region[1], &size[1], jack_outbuf);
+        for (ch = 0; ch < nchans; ch++)
         {
-            jp = STUFF->st_soundout + ch * DEFDACBLKSIZE;
-            for (j = 0, fp2 = fp; j < DEFDACBLKSIZE;
-                j++, fp2 += STUFF->st_outchannels)
-                    *fp2 = jp[j];
+            jp = STUFF->st_iosoundout + ch * DEFDACBLKSIZE;
+            for (k = 0, j = 0; k < 2; k++)
+                for (n = size[k] / (nchans * sizeof(t_sample)),
+                    fp = (t_sample *)region[k] + ch; n--; fp += nchans)
+                        *fp = jp[j++];
         }
-        sys_ringbuf_write(&jack_outring, muxbuffer,
-            DEFDACBLKSIZE * STUFF->st_outchannels * sizeof(t_sample),
-                jack_outbuf);
+        sys_ringbuf_advancewrite(&jack_outring, size[0] + size[1]);
     }
-    memset(STUFF->st_soundout, 0,
+    memset(STUFF->st_iosoundout, 0,
         DEFDACBLKSIZE*sizeof(t_sample) * STUFF->st_outchannels);
             /* fprintf(stderr, "%g ", sys_getrealtime() - timeref); */
     if ((timenow = sys_getrealtime()) - timeref > 0.0002)
@@ -512,7 +512,7 @@ int mmio_send_dacs(void)
         for (i = 0, n = 2 * nt_nwavein * DEFDACBLKSIZE, maxsamp = nt_inmax;
             i < n; i++)
         {
-            t_sample f = STUFF->st_soundin[i];
+            t_sample f = STUFF->st_iosoundin[i];
             if (f > maxsamp) maxsamp = f;
             else if (-f > maxsamp) maxsamp = -f;
         }
@@ -520,7 +520,7 @@ int mmio_send_dacs(void)
         for (i = 0, n = 2 * nt_nwaveout * DEFDACBLKSIZE, maxsamp = nt_outmax;
             i < n; i++)
         {
-            t_sample f = STUFF->st_soundout[i];
+            t_sample f = STUFF->st_iosoundout[i];
             if (f > maxsamp) maxsamp = f;
             else if (-f > maxsamp) maxsamp = -f;
         }
@@ -567,7 +567,7 @@ int mmio_send_dacs(void)
 
         /* Convert audio output to fixed-point and put it in the output
         buffer. */
-    for (nda = 0, fp1 = STUFF->st_soundout; nda < nt_nwaveout; nda++)
+    for (nda = 0, fp1 = STUFF->st_iosoundout; nda < nt_nwaveout; nda++)
     {
         int phase = ntsnd_outphase[nda];
 
@@ -585,12 +585,12 @@ int mmio_send_dacs(void)
             }
         }
     }
-    memset(STUFF->st_soundout, 0,
+    memset(STUFF->st_iosoundout, 0,
         (DEFDACBLKSIZE *sizeof(t_sample)*CHANNELS_PER_DEVICE)*nt_nwaveout);
 
         /* vice versa for the input buffer */
 
-    for (nad = 0, fp1 = STUFF->st_soundin; nad < nt_nwavein; nad++)
+    for (nad = 0, fp1 = STUFF->st_iosoundin; nad < nt_nwavein; nad++)
     {
         int phase = ntsnd_inphase[nad];
 
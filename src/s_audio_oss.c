@@ -610,11 +610,9 @@ static void oss_doresync(void)
 
 int oss_send_dacs(void)
 {
-    t_sample *fp1, *fp2;
     long fill;
-    int i, j, dev, rtnval = SENDDACS_YES;
+    int dev, rtnval = SENDDACS_YES;
     char buf[OSS_MAXSAMPLEWIDTH * DEFDACBLKSIZE * OSS_MAXCHPERDEV];
-    t_oss_int16 *sp;
     t_oss_int32 *lp;
         /* the maximum number of samples we should have in the ADC buffer */
     int idle = 0;
@@ -706,20 +704,9 @@ int oss_send_dacs(void)
         else
         {
             if (linux_dacs[dev].d_bytespersamp == 2)
-            {
-                for (i = DEFDACBLKSIZE,  fp1 = STUFF->st_soundout +
-                    DEFDACBLKSIZE*thischan,
-                    sp = (t_oss_int16 *)buf; i--; fp1++, sp += nchannels)
-                {
-                    for (j=0, fp2 = fp1; j<nchannels; j++, fp2 += DEFDACBLKSIZE)
-                    {
-                        int s = *fp2 * 32767.;
-                        if (s > 32767) s = 32767;
-                        else if (s < -32767) s = -32767;
-                        sp[j] = s;
-                    }
-                }
-            }
+                sys_interleave(buf, SAMPFMT_S16, nchannels,
+                    STUFF->st_iosoundout + DEFDACBLKSIZE*thischan, nchannels,
+                        DEFDACBLKSIZE, DEFDACBLKSIZE);
             linux_dacs_write(linux_dacs[dev].d_fd, buf,
                 OSS_XFERSIZE(nchannels, linux_dacs[dev].d_bytespersamp));
             if ((timenow = sys_getrealtime()) - timeref > 0.002)
@@ -732,7 +719,7 @@ int oss_send_dacs(void)
         }
         thischan += nchannels;
     }
-    memset(STUFF->st_soundout, 0,
+    memset(STUFF->st_iosoundout, 0,
         STUFF->st_outchannels * (sizeof(t_sample) * DEFDACBLKSIZE));
 
         /* do input */
@@ -753,14 +740,9 @@ int oss_send_dacs(void)
         timeref = timenow;
 
         if (linux_adcs[dev].d_bytespersamp == 2)
-        {
-            for (i = DEFDACBLKSIZE,fp1 = STUFF->st_soundin + thischan*DEFDACBLKSIZE,
-                sp = (t_oss_int16 *)buf; i--; fp1++, sp += nchannels)
-            {
-                for (j=0;j<nchannels;j++)
-                    fp1[j*DEFDACBLKSIZE] = (t_sample)sp[j]*(t_sample)3.051850e-05;
-            }
-        }
+            sys_deinterleave(STUFF->st_iosoundin + thischan*DEFDACBLKSIZE,
+                nchannels, DEFDACBLKSIZE, buf, SAMPFMT_S16, nchannels,
+                    DEFDACBLKSIZE);
         thischan += nchannels;
      }
      return (rtnval);
@@ -70,10 +70,10 @@ static int pa_dio_error;
 
 #ifdef FAKEBLOCKING
 #include "s_audio_paring.h"
-static PA_VOLATILE char *pa_outbuf;
-static PA_VOLATILE sys_ringbuf pa_outring;
-static PA_VOLATILE char *pa_inbuf;
-static PA_VOLATILE sys_ringbuf pa_inring;
+static char *pa_outbuf;
+static sys_ringbuf pa_outring;
+static char *pa_inbuf;
+static sys_ringbuf pa_inring;
 #ifdef THREADSIGNAL
 #include <pthread.h>
 #include <errno.h>
@@ -139,10 +139,7 @@ static int pa_lowlevel_callback(const void *inputBuffer,
     const PaStreamCallbackTimeInfo *outTime, PaStreamCallbackFlags myflags,
     void *userData)
 {
-    int i;
-    unsigned int n, j;
-    float *fbuf, *fp2, *fp3;
-    t_sample *soundiop;
+    unsigned int n;
     if (nframes % DEFDACBLKSIZE)
     {
         post("warning: audio nframes %ld not a multiple of blocksize %d",
@@ -152,28 +149,18 @@ static int pa_lowlevel_callback(const void *inputBuffer,
     for (n = 0; n < nframes; n += DEFDACBLKSIZE)
     {
         if (inputBuffer != NULL)
-        {
-            fbuf = ((float *)inputBuffer) + n*pa_inchans;
-            soundiop = pa_soundin;
-            for (i = 0, fp2 = fbuf; i < pa_inchans; i++, fp2++)
-                    for (j = 0, fp3 = fp2; j < DEFDACBLKSIZE;
-                        j++, fp3 += pa_inchans)
-                            *soundiop++ = (t_sample)*fp3;
-        }
+            sys_deinterleave(pa_soundin, pa_inchans, DEFDACBLKSIZE,
+                ((float *)inputBuffer) + n*pa_inchans, SAMPFMT_FLOAT32,
+                    pa_inchans, DEFDACBLKSIZE);
         else memset((void *)pa_soundin, 0,
             DEFDACBLKSIZE * pa_inchans * sizeof(t_sample));
         memset((void *)pa_soundout, 0,
             DEFDACBLKSIZE * pa_outchans * sizeof(t_sample));
         (*pa_callback)();
         if (outputBuffer != NULL)
-        {
-            fbuf = ((float *)outputBuffer) + n*pa_outchans;
-            soundiop = pa_soundout;
-            for (i = 0, fp2 = fbuf; i < pa_outchans; i++, fp2++)
-                for (j = 0, fp3 = fp2; j < DEFDACBLKSIZE;
-                    j++, fp3 += pa_outchans)
-                        *fp3 = (float)*soundiop++;
-        }
+            sys_interleave(((float *)outputBuffer) + n*pa_outchans,
+                SAMPFMT_FLOAT32, pa_outchans, pa_soundout, pa_outchans,
+                    DEFDACBLKSIZE, DEFDACBLKSIZE);
     }
     return 0;
 }
@@ -490,14 +477,16 @@ void pa_close_audio(void)
 
 int pa_send_dacs(void)
 {
-    t_sample *fp;
-    float *fp2, *fp3;
+#ifndef FAKEBLOCKING
     float *conversionbuf;
-    int j, k;
+    int j;
+#endif
     int rtnval =  SENDDACS_YES;
     int locked = 0;
     double timebefore;
 #ifdef FAKEBLOCKING
+    void *region[2];
+    long size[2];
 #ifdef THREADSIGNAL
     struct timespec ts;
     double timeout;
@@ -520,8 +509,6 @@ int pa_send_dacs(void)
 
     if ((!STUFF->st_inchannels && !STUFF->st_outchannels) || !pa_stream)
         return (SENDDACS_NO);
-    conversionbuf = (float *)alloca((STUFF->st_inchannels > STUFF->st_outchannels?
-        STUFF->st_inchannels:STUFF->st_outchannels) * DEFDACBLKSIZE * sizeof(float));
 
 #ifdef FAKEBLOCKING
     if (!STUFF->st_inchannels)    /* if no input channels sync on output */
@@ -558,13 +545,19 @@ int pa_send_dacs(void)
         /* write output */
     if (STUFF->st_outchannels && !locked)
     {
-        for (j = 0, fp = STUFF->st_soundout, fp2 = conversionbuf;
-            j < STUFF->st_outchannels; j++, fp2++)
-                for (k = 0, fp3 = fp2; k < DEFDACBLKSIZE;
-                    k++, fp++, fp3 += STUFF->st_outchannels)
-                        *fp3 = *fp;
-        sys_ringbuf_write(&pa_outring, conversionbuf,
-            STUFF->st_outchannels*(DEFDACBLKSIZE*sizeof(float)), pa_outbuf);
+            /* interleave straight into the FIFO's free region(s) */
+        int framesize = STUFF->st_outchannels * sizeof(float);
+        sys_ringbuf_getwriteregions(&pa_outring, DEFDACBLKSIZE * framesize,
+            &region[0], &size[0], &region[1], &size[1], pa_outbuf);
+        sys_interleave(region[0], SAMPFMT_FLOAT32, STUFF->st_outchannels,
+            STUFF->st_iosoundout, STUFF->st_outchannels, DEFDACBLKSIZE,
+                size[0] / framesize);
+        if (size[1])
+            sys_interleave(region[1], SAMPFMT_FLOAT32,
+                STUFF->st_outchannels,
+                    STUFF->st_iosoundout + size[0] / framesize,
+                    STUFF->st_outchannels, DEFDACBLKSIZE, size[1] / framesize);
+        sys_ringbuf_advancewrite(&pa_outring, size[0] + size[1]);
     }
     if (STUFF->st_inchannels)    /* if there is input sync on it */
     {
@@ -599,16 +592,22 @@ int pa_send_dacs(void)
     }
     if (STUFF->st_inchannels && !locked)
     {
-        sys_ringbuf_read(&pa_inring, conversionbuf,
-            STUFF->st_inchannels*(DEFDACBLKSIZE*sizeof(float)), pa_inbuf);
-        for (j = 0, fp = STUFF->st_soundin, fp2 = conversionbuf;
-            j < STUFF->st_inchannels; j++, fp2++)
-                for (k = 0, fp3 = fp2; k < DEFDACBLKSIZE;
-                    k++, fp++, fp3 += STUFF->st_inchannels)
-                        *fp = *fp3;
+        int framesize = STUFF->st_inchannels * sizeof(float);
+        sys_ringbuf_getreadregions(&pa_inring, DEFDACBLKSIZE * framesize,
+            &region[0], &size[0], &region[1], &size[1], pa_inbuf);
+        sys_deinterleave(STUFF->st_iosoundin, STUFF->st_inchannels,
+            DEFDACBLKSIZE, region[0], SAMPFMT_FLOAT32,
+                STUFF->st_inchannels, size[0] / framesize);
+        if (size[1])
+            sys_deinterleave(STUFF->st_iosoundin + size[0] / framesize,
+                STUFF->st_inchannels, DEFDACBLKSIZE, region[1],
+                    SAMPFMT_FLOAT32, STUFF->st_inchannels, size[1] / framesize);
+        sys_ringbuf_advanceread(&pa_inring, size[0] + size[1]);
     }
 
 #else /* FAKEBLOCKING */
+    conversionbuf = (float *)alloca((STUFF->st_inchannels > STUFF->st_outchannels?
+        STUFF->st_inchannels:STUFF->st_outchannels) * DEFDACBLKSIZE * sizeof(float));
         /* write output */
     if (STUFF->st_outchannels)
     {
@@ -619,11 +618,9 @@ int pa_send_dacs(void)
             for (j = 0; j < pa_nbuffers-1; j++)
                 Pa_WriteStream(pa_stream, conversionbuf, DEFDACBLKSIZE);
         }
-        for (j = 0, fp = STUFF->st_soundout, fp2 = conversionbuf;
-            j < STUFF->st_outchannels; j++, fp2++)
-                for (k = 0, fp3 = fp2; k < DEFDACBLKSIZE;
-                    k++, fp++, fp3 += STUFF->st_outchannels)
-                        *fp3 = *fp;
+        sys_interleave(conversionbuf, SAMPFMT_FLOAT32, STUFF->st_outchannels,
+            STUFF->st_iosoundout, STUFF->st_outchannels, DEFDACBLKSIZE,
+                DEFDACBLKSIZE);
         if (Pa_WriteStream(pa_stream, conversionbuf, DEFDACBLKSIZE) != paNoError)
             if (Pa_IsStreamActive(&pa_stream) < 0)
                 locked = 1;
@@ -634,11 +631,9 @@ int pa_send_dacs(void)
         if (Pa_ReadStream(pa_stream, conversionbuf, DEFDACBLKSIZE) != paNoError)
             if (Pa_IsStreamActive(&pa_stream) < 0)
                 locked = 1;
-        for (j = 0, fp = STUFF->st_soundin, fp2 = conversionbuf;
-            j < STUFF->st_inchannels; j++, fp2++)
-                for (k = 0, fp3 = fp2; k < DEFDACBLKSIZE;
-                    k++, fp++, fp3 += STUFF->st_inchannels)
-                        *fp = *fp3;
+        sys_deinterleave(STUFF->st_iosoundin, STUFF->st_inchannels,
+            DEFDACBLKSIZE, conversionbuf, SAMPFMT_FLOAT32,
+                STUFF->st_inchannels, DEFDACBLKSIZE);
     }
     if (sys_getrealtime() - timebefore > 0.002)
     {
@@ -647,11 +642,15 @@ int pa_send_dacs(void)
 #endif /* FAKEBLOCKING */
     pa_started = 1;
 
-    memset(STUFF->st_soundout, 0,
+    memset(STUFF->st_iosoundout, 0,
         DEFDACBLKSIZE*sizeof(t_sample)*STUFF->st_outchannels);
     if (locked)
     {
-        PaError err = Pa_IsStreamActive(&pa_stream);
+        PaError err;
+            /* on the "-pipeline" thread, leave this to the scheduler */
+        if (audio_pipeline_lost())
+            return (SENDDACS_NO);
+        err = Pa_IsStreamActive(&pa_stream);
         pd_error(0, "error %d: %s", err, Pa_GetErrorText(err));
         sys_close_audio();
         #ifdef __APPLE__
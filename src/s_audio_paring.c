@@ -35,6 +35,8 @@
  *
  * extensively hacked by msp@ucsd.edu for various reasons
  *
+ * indices made atomic (acquire/release) and kept on separate cache lines
+ *
  */
 
 #include <stdio.h>
@@ -43,48 +45,46 @@
 #include "s_audio_paring.h"
 #include <string.h>
 
-/* Clear buffer. Should only be called when buffer is NOT being read. */
-static void sys_ringbuf_Flush(PA_VOLATILE sys_ringbuf *rbuf,
-    PA_VOLATILE void *dataPtr, long nfill);
-
-/* Get address of region(s) to which we can write data.
-** If the region is contiguous, size2 will be zero.
-** If non-contiguous, size2 will be the size of second region.
-** Returns room available to be written or numBytes, whichever is smaller.
-*/
-static long sys_ringbuf_GetWriteRegions(PA_VOLATILE  sys_ringbuf *rbuf,
-    long numBytes, PA_VOLATILE void **dataPtr1, long *sizePtr1,
-    PA_VOLATILE void **dataPtr2, long *sizePtr2, PA_VOLATILE char *buffer);
-static long sys_ringbuf_AdvanceWriteIndex(PA_VOLATILE sys_ringbuf *rbuf,
-    long numBytes);
-
-/* Get address of region(s) from which we can read data.
-** If the region is contiguous, size2 will be zero.
-** If non-contiguous, size2 will be the size of second region.
-** Returns room available to be read or numBytes, whichever is smaller.
-*/
-static long sys_ringbuf_GetReadRegions(PA_VOLATILE sys_ringbuf *rbuf,
-    long numBytes, PA_VOLATILE void **dataPtr1, long *sizePtr1,
-    PA_VOLATILE void **dataPtr2, long *sizePtr2, PA_VOLATILE char *buffer);
-
-static long sys_ringbuf_AdvanceReadIndex(PA_VOLATILE sys_ringbuf *rbuf,
-    long numBytes );
+    /* load the other thread's index before touching the data it covers;
+    store our own index after we're done with the data */
+#if defined(__GNUC__) || defined(__clang__)
+#define RING_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define RING_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#elif defined(_MSC_VER)
+#include <windows.h>
+static long ring_loadacquire(long *p)
+{
+    long v = *(volatile long *)p;
+    MemoryBarrier();
+    return (v);
+}
+#define RING_LOAD(p) ring_loadacquire(p)
+#define RING_STORE(p, v) (MemoryBarrier(), *(volatile long *)(p) = (v))
+#else
+#define RING_LOAD(p) (*(volatile long *)(p))
+#define RING_STORE(p, v) (*(volatile long *)(p) = (v))
+#endif
 
 /***************************************************************************
- * Initialize FIFO.
+ * Initialize FIFO.  Should only be called when the buffer is NOT in use.
  */
-long sys_ringbuf_init(PA_VOLATILE sys_ringbuf *rbuf, long numBytes,
-    PA_VOLATILE char *dataPtr, long nfill)
+long sys_ringbuf_init(sys_ringbuf *rbuf, long numBytes, char *dataPtr,
+    long nfill)
 {
     rbuf->bufferSize = numBytes;
-    sys_ringbuf_Flush(rbuf, dataPtr,  nfill);
+    memset(dataPtr, 0, nfill);
+    RING_STORE(&rbuf->readIndex, 0);
+    RING_STORE(&rbuf->writeIndex, nfill);
     return 0;
 }
+
 /***************************************************************************
-** Return number of bytes available for reading. */
-long sys_ringbuf_getreadavailable(PA_VOLATILE sys_ringbuf *rbuf)
+** Return number of bytes available for reading.  The indices run up to
+** twice the buffer size so that a full buffer can be told from an empty
+** one. */
+long sys_ringbuf_getreadavailable(sys_ringbuf *rbuf)
 {
-    long ret = rbuf->writeIndex - rbuf->readIndex;
+    long ret = RING_LOAD(&rbuf->writeIndex) - RING_LOAD(&rbuf->readIndex);
     if (ret < 0)
         ret += 2 * rbuf->bufferSize;
     if (ret < 0 || ret > rbuf->bufferSize)
@@ -92,47 +92,25 @@ long sys_ringbuf_getreadavailable(PA_VOLATILE sys_ringbuf *rbuf)
             "consistency check failed: sys_ringbuf_getreadavailable\n");
     return ( ret );
 }
+
 /***************************************************************************
 ** Return number of bytes available for writing. */
-long sys_ringbuf_getwriteavailable(PA_VOLATILE sys_ringbuf *rbuf)
+long sys_ringbuf_getwriteavailable(sys_ringbuf *rbuf)
 {
     return ( rbuf->bufferSize - sys_ringbuf_getreadavailable(rbuf));
 }
 
-/***************************************************************************
-** Clear buffer. Should only be called when buffer is NOT being read. */
-static void sys_ringbuf_Flush(PA_VOLATILE sys_ringbuf *rbuf,
-    PA_VOLATILE void *dataPtr, long nfill)
-{
-    PA_VOLATILE char *s;
-    long n;
-    rbuf->readIndex = 0;
-    rbuf->writeIndex = nfill;
-    for (n = nfill, s = dataPtr; n--; s++)
-        *s = 0;
-}
-
-/***************************************************************************
-** Get address of region(s) to which we can write data.
-** If the region is contiguous, size2 will be zero.
-** If non-contiguous, size2 will be the size of second region.
-** Returns room available to be written or numBytes, whichever is smaller.
-*/
-static long sys_ringbuf_GetWriteRegions(PA_VOLATILE  sys_ringbuf *rbuf,
-    long numBytes, PA_VOLATILE void **dataPtr1, long *sizePtr1,
-    PA_VOLATILE void **dataPtr2, long *sizePtr2, PA_VOLATILE char *buffer)
+    /* split "numBytes" starting at "index" into at most two regions */
+static void sys_ringbuf_regions(sys_ringbuf *rbuf, long index,
+    long numBytes, void **dataPtr1, long *sizePtr1, void **dataPtr2,
+    long *sizePtr2, char *buffer)
 {
-    long   index;
-    long   available = sys_ringbuf_getwriteavailable( rbuf );
-    if( numBytes > available ) numBytes = available;
-    /* Check to see if write is not contiguous. */
-    index = rbuf->writeIndex;
-    while (index >= rbuf->bufferSize)
+    if (index >= rbuf->bufferSize)
         index -= rbuf->bufferSize;
-    if( (index + numBytes) > rbuf->bufferSize )
+    if (index + numBytes > rbuf->bufferSize)
     {
-        /* Write data in two blocks that wrap the buffer. */
-        long   firstHalf = rbuf->bufferSize - index;
+        /* data in two blocks that wrap the buffer. */
+        long firstHalf = rbuf->bufferSize - index;
         *dataPtr1 = &buffer[index];
         *sizePtr1 = firstHalf;
         *dataPtr2 = &buffer[0];
@@ -145,111 +123,92 @@ static long sys_ringbuf_GetWriteRegions(PA_VOLATILE  sys_ringbuf *rbuf,
         *dataPtr2 = NULL;
         *sizePtr2 = 0;
     }
-    return numBytes;
 }
 
-
 /***************************************************************************
+** Get address of region(s) to which we can write data.
+** If the region is contiguous, size2 will be zero.
+** If non-contiguous, size2 will be the size of second region.
+** Returns room available to be written or numBytes, whichever is smaller.
 */
-static long sys_ringbuf_AdvanceWriteIndex(PA_VOLATILE sys_ringbuf *rbuf,
-    long numBytes)
+long sys_ringbuf_getwriteregions(sys_ringbuf *rbuf, long numBytes,
+    void **dataPtr1, long *sizePtr1, void **dataPtr2, long *sizePtr2,
+    char *buffer)
+{
+    long available = sys_ringbuf_getwriteavailable(rbuf);
+    if (numBytes > available)
+        numBytes = available;
+    sys_ringbuf_regions(rbuf, rbuf->writeIndex, numBytes,
+        dataPtr1, sizePtr1, dataPtr2, sizePtr2, buffer);
+    return numBytes;
+}
+
+/***************************************************************************
+** Publish written data to the reader. */
+void sys_ringbuf_advancewrite(sys_ringbuf *rbuf, long numBytes)
 {
     long ret = (rbuf->writeIndex + numBytes);
-    if ( ret >= 2 * rbuf->bufferSize)
+    if (ret >= 2 * rbuf->bufferSize)
         ret -= 2 * rbuf->bufferSize;    /* check for end of buffer */
-    return rbuf->writeIndex = ret;
+    RING_STORE(&rbuf->writeIndex, ret);
 }
 
 /***************************************************************************
 ** Get address of region(s) from which we can read data.
 ** If the region is contiguous, size2 will be zero.
 ** If non-contiguous, size2 will be the size of second region.
-** Returns room available to be written or numBytes, whichever is smaller.
+** Returns data available to be read or numBytes, whichever is smaller.
 */
-static long sys_ringbuf_GetReadRegions(PA_VOLATILE sys_ringbuf *rbuf,
-    long numBytes, PA_VOLATILE void **dataPtr1, long *sizePtr1,
-    PA_VOLATILE void **dataPtr2, long *sizePtr2, PA_VOLATILE char *buffer)
+long sys_ringbuf_getreadregions(sys_ringbuf *rbuf, long numBytes,
+    void **dataPtr1, long *sizePtr1, void **dataPtr2, long *sizePtr2,
+    char *buffer)
 {
-    long   index;
-    long   available = sys_ringbuf_getreadavailable( rbuf );
-    if( numBytes > available ) numBytes = available;
-    /* Check to see if read is not contiguous. */
-    index = rbuf->readIndex;
-    while (index >= rbuf->bufferSize)
-        index -= rbuf->bufferSize;
-
-    if( (index + numBytes) > rbuf->bufferSize )
-    {
-        /* Write data in two blocks that wrap the buffer. */
-        long firstHalf = rbuf->bufferSize - index;
-        *dataPtr1 = &buffer[index];
-        *sizePtr1 = firstHalf;
-        *dataPtr2 = &buffer[0];
-        *sizePtr2 = numBytes - firstHalf;
-    }
-    else
-    {
-        *dataPtr1 = &buffer[index];
-        *sizePtr1 = numBytes;
-        *dataPtr2 = NULL;
-        *sizePtr2 = 0;
-    }
+    long available = sys_ringbuf_getreadavailable(rbuf);
+    if (numBytes > available)
+        numBytes = available;
+    sys_ringbuf_regions(rbuf, rbuf->readIndex, numBytes,
+        dataPtr1, sizePtr1, dataPtr2, sizePtr2, buffer);
     return numBytes;
 }
+
 /***************************************************************************
-*/
-static long sys_ringbuf_AdvanceReadIndex(PA_VOLATILE sys_ringbuf *rbuf,
-    long numBytes)
+** Hand read space back to the writer. */
+void sys_ringbuf_advanceread(sys_ringbuf *rbuf, long numBytes)
 {
     long ret = (rbuf->readIndex + numBytes);
-    if( ret >= 2 * rbuf->bufferSize)
+    if (ret >= 2 * rbuf->bufferSize)
         ret -= 2 * rbuf->bufferSize;
-    return rbuf->readIndex = ret;
+    RING_STORE(&rbuf->readIndex, ret);
 }
 
 /***************************************************************************
 ** Return bytes written. */
-long sys_ringbuf_write(PA_VOLATILE sys_ringbuf *rbuf, const void *data,
-    long numBytes, PA_VOLATILE char *buffer)
+long sys_ringbuf_write(sys_ringbuf *rbuf, const void *data,
+    long numBytes, char *buffer)
 {
     long size1, size2, numWritten;
-    PA_VOLATILE void *data1, *data2;
-    numWritten = sys_ringbuf_GetWriteRegions( rbuf, numBytes, &data1, &size1,
+    void *data1, *data2;
+    numWritten = sys_ringbuf_getwriteregions(rbuf, numBytes, &data1, &size1,
         &data2, &size2, buffer);
-    if( size2 > 0 )
-    {
-
-        memcpy((void *)data1, data, size1 );
-        data = ((char *)data) + size1;
-        memcpy((void *)data2, data, size2 );
-    }
-    else
-    {
-        memcpy((void *)data1, data, size1 );
-    }
-    sys_ringbuf_AdvanceWriteIndex( rbuf, numWritten );
+    memcpy(data1, data, size1);
+    if (size2 > 0)
+        memcpy(data2, (const char *)data + size1, size2);
+    sys_ringbuf_advancewrite(rbuf, numWritten);
     return numWritten;
 }
 
 /***************************************************************************
 ** Return bytes read. */
-long sys_ringbuf_read(PA_VOLATILE sys_ringbuf *rbuf, void *data, long numBytes,
-    PA_VOLATILE char *buffer)
+long sys_ringbuf_read(sys_ringbuf *rbuf, void *data, long numBytes,
+    char *buffer)
 {
     long size1, size2, numRead;
-    PA_VOLATILE void *data1, *data2;
-    numRead = sys_ringbuf_GetReadRegions( rbuf, numBytes, &data1, &size1,
+    void *data1, *data2;
+    numRead = sys_ringbuf_getreadregions(rbuf, numBytes, &data1, &size1,
         &data2, &size2, buffer);
-    if( size2 > 0 )
-    {
-        memcpy(data, (void *)data1, size1 );
-        data = ((char *)data) + size1;
-        memcpy(data, (void *)data2, size2 );
-    }
-    else
-    {
-        memcpy( data, (void *)data1, size1 );
-    }
-    sys_ringbuf_AdvanceReadIndex( rbuf, numRead );
+    memcpy(data, data1, size1);
+    if (size2 > 0)
+        memcpy((char *)data + size1, data2, size2);
+    sys_ringbuf_advanceread(rbuf, numRead);
     return numRead;
 }
@@ -40,34 +40,57 @@ extern "C"
  *
  */
 
-/* If it's ever desired to use shared memory so that one process reads and
-another one writes to the same ring buffer, define this as 'volatile' : */
-#define PA_VOLATILE
+/* The FIFO is for one writer thread and one reader thread (the audio
+callback and Pd's scheduler) and needs no lock.  Each side only writes its
+own index and publishes it with a "release" store after touching the data;
+the other side reads it with an "acquire" load before touching the data, so
+that the data are seen complete even on weakly ordered CPUs such as ARM.
+The two indices are kept on separate cache lines so that each side's writes
+don't keep invalidating the line the other side is reading. */
+
+#define RINGBUF_CACHELINE 64
 
 typedef struct
 {
     long   bufferSize;              /* Number of bytes in FIFO.
                                         Set by sys_ringbuf_init */
-    PA_VOLATILE long   writeIndex; /* Index of next writable byte.
-                                        Set by sys_ringbuf_AdvanceWriteIndex */
-    PA_VOLATILE long   readIndex;  /* Index of next readable byte.
-                                        Set by sys_ringbuf_AdvanceReadIndex */
+    char   pad1[RINGBUF_CACHELINE - sizeof(long)];
+    long   writeIndex;              /* Index of next writable byte.
+                                        Set by sys_ringbuf_advancewrite */
+    char   pad2[RINGBUF_CACHELINE - sizeof(long)];
+    long   readIndex;               /* Index of next readable byte.
+                                        Set by sys_ringbuf_advanceread */
+    char   pad3[RINGBUF_CACHELINE - sizeof(long)];
 } sys_ringbuf;
 
-/* Initialize Ring Buffer. */
-long sys_ringbuf_init(PA_VOLATILE sys_ringbuf *rbuf, long numBytes,
-    PA_VOLATILE char *dataPtr, long nfill);
+/* Initialize Ring Buffer.  "nfill" bytes of zeros are made readable. */
+long sys_ringbuf_init(sys_ringbuf *rbuf, long numBytes, char *dataPtr,
+    long nfill);
 
 /* Return number of bytes available for writing. */
-long sys_ringbuf_getwriteavailable(PA_VOLATILE sys_ringbuf *rbuf);
+long sys_ringbuf_getwriteavailable(sys_ringbuf *rbuf);
 /* Return number of bytes available for read. */
-long sys_ringbuf_getreadavailable(PA_VOLATILE sys_ringbuf *rbuf);
+long sys_ringbuf_getreadavailable(sys_ringbuf *rbuf);
 /* Return bytes written. */
-long sys_ringbuf_write(PA_VOLATILE sys_ringbuf *rbuf, const void *data,
-    long numBytes, PA_VOLATILE char *buffer);
+long sys_ringbuf_write(sys_ringbuf *rbuf, const void *data,
+    long numBytes, char *buffer);
 /* Return bytes read. */
-long sys_ringbuf_read(PA_VOLATILE sys_ringbuf *rbuf, void *data, long numBytes,
-    PA_VOLATILE char *buffer);
+long sys_ringbuf_read(sys_ringbuf *rbuf, void *data, long numBytes,
+    char *buffer);
+
+/* For copying (or converting) straight into or out of the FIFO: get the
+one or two contiguous regions in which up to numBytes may be written or
+read, and after filling or emptying them, advance by the number of bytes
+actually used.  If the region is contiguous, size2 is zero.  The return
+value is the total size of the two, which may be less than numBytes. */
+long sys_ringbuf_getwriteregions(sys_ringbuf *rbuf, long numBytes,
+    void **dataPtr1, long *sizePtr1, void **dataPtr2, long *sizePtr2,
+    char *buffer);
+void sys_ringbuf_advancewrite(sys_ringbuf *rbuf, long numBytes);
+long sys_ringbuf_getreadregions(sys_ringbuf *rbuf, long numBytes,
+    void **dataPtr1, long *sizePtr1, void **dataPtr2, long *sizePtr2,
+    char *buffer);
+void sys_ringbuf_advanceread(sys_ringbuf *rbuf, long numBytes);
 
 #ifdef __cplusplus
 }
@@ -5,6 +5,10 @@
 /* Pd side of the Pd/Pd-gui interface.  Also, some system interface routines
 that didn't really belong anywhere. */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE     /* for recvmmsg() */
+#endif
+
 #include "m_pd.h"
 #include "s_stuff.h"
 #include "m_imp.h"
@@ -23,6 +27,34 @@ that didn't really belong anywhere. */
 #ifdef HAVE_BSTRING_H
 #include <bstring.h>
 #endif
+
+    /* where the system has one, poll file descriptors through a kernel
+    event queue to which they're added once, rather than building an fd_set
+    for select() on every pass */
+#if defined(__linux__)
+#include <sys/epoll.h>
+#define POLL_EPOLL
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || \
+    defined(__OpenBSD__) || defined(__DragonFly__)
+#include <sys/event.h>
+#define POLL_KQUEUE
+#endif
+#define POLL_MAXEVENTS 64   /* events fetched per pass */
+
+    /* memory barrier for data shared between threads without a lock */
+#if defined(__GNUC__) || defined(__clang__)
+#define SYS_BARRIER() __sync_synchronize()
+#elif defined(_MSC_VER)
+#define SYS_BARRIER() MemoryBarrier()
+#else
+#define SYS_BARRIER()
+#endif
+
+    /* receive UDP datagrams several at a time */
+#ifdef __linux__
+#define HAVE_RECVMMSG
+#endif
+#define RECVBATCH 16        /* datagrams per recvmmsg() call */
 #ifdef _WIN32
 #include <io.h>
 #include <process.h>
@@ -86,8 +118,12 @@ typedef struct _fdpoll
 struct _socketreceiver
 {
     char *sr_inbuf;
-    int sr_inhead;
-    int sr_intail;
+    int sr_insize;      /* bytes allocated for sr_inbuf */
+    int sr_inhead;      /* end of the data received so far */
+    int sr_intail;      /* start of the message being received */
+    int sr_inscan;      /* how far we've looked for its terminating semi */
+    int sr_escaped;     /* last byte scanned was an unescaped backslash */
+    int sr_skipping;    /* discarding a message that grew too big */
     void *sr_owner;
     int sr_udp;
     struct sockaddr_storage *sr_fromaddr; /* optional */
@@ -102,17 +138,49 @@ typedef struct _guiqueue
     t_glist *gq_glist;
     t_guicallbackfn gq_fn;
     struct _guiqueue *gq_next;
+    struct _guiqueue *gq_prev;
+    struct _guiqueue *gq_hashnext;  /* others in the same hash bucket */
+    unsigned int gq_seq;            /* order queued in, to find frame ends */
 } t_guiqueue;
 
+    /* pending GUI updates are hashed by client so that asking again for
+    one that's already queued is cheap */
+#define GUIQUEUEHASH 256    /* must be a power of two */
+#define GUIQUEUE_HASHFN(client) \
+    ((((size_t)(client)) >> 4) & (GUIQUEUEHASH - 1))
+
+    /* how the instance's lock has been used, for "pd lock-stats".  Times
+    are in PROFILE_NOW() counts. */
+typedef struct _lockstats
+{
+    unsigned long long l_nlocks;        /* times taken */
+    unsigned long long l_ncontended;    /* ... after waiting for it */
+    unsigned long long l_waited;        /* time spent waiting */
+    unsigned long long l_held;          /* time held */
+    unsigned long long l_maxheld;       /* longest hold */
+    unsigned long long l_lockedat;      /* when it was last taken */
+    unsigned long long l_nover;         /* holds longer than the budget */
+    unsigned long long l_overmax;       /* longest since the last warning */
+    int l_overwarn;                     /* ... and how many */
+} t_lockstats;
+
 struct _instanceinter
 {
     int i_havegui;
     int i_nfdpoll;
     t_fdpoll *i_fdpoll;
+    int i_nfdwritepoll;
+    t_fdpoll *i_fdwritepoll;    /* fds waited on for writing */
     int i_maxfd;
     int i_guisock;
     t_socketreceiver *i_socketreceiver;
     t_guiqueue *i_guiqueuehead;
+    t_guiqueue *i_guiqueuetail;
+    t_guiqueue *i_guiqueuehash[GUIQUEUEHASH];
+    int i_guiinframe;           /* in the middle of sending a frame */
+    unsigned int i_guiseq;      /* sequence number for next queued update */
+    unsigned int i_guiframeend; /* first one not in the current frame */
+    double i_guinextframe;      /* realtime we may start the next one */
     t_binbuf *i_inbinbuf;
     char *i_guibuf;
     int i_guihead;
@@ -121,6 +189,7 @@ struct _instanceinter
     int i_waitingforping;
     int i_bytessincelastping;
     int i_fdschanged;   /* flag to break fdpoll loop if fd list changes */
+    int i_pollfd;       /* epoll or kqueue descriptor, -1 to use select() */
 
 #ifdef _WIN32
     LARGE_INTEGER i_inittime;
@@ -128,13 +197,19 @@ struct _instanceinter
 #endif
 #if PDTHREADS
     pthread_mutex_t i_mutex;
+    t_lockstats i_lockstats;
 #endif
 
     unsigned char i_recvbuf[NET_MAXPACKETSIZE];
+    unsigned char *i_batchbuf;  /* RECVBATCH buffers and addresses or NULL */
+    int i_batchbusy;            /* i_batch handed out and not yet done */
+    t_datagram i_batch[RECVBATCH];
+    t_datagram i_onedatagram;   /* one at a time, in i_recvbuf */
+    struct sockaddr_storage i_oneaddr;
 };
 
 extern int sys_guisetportnumber;
-extern int sys_addhist(int phase);
+extern const char *sys_guisetsocketpath;
 void sys_set_searchpath(void);
 void sys_set_temppath(void);
 void sys_set_extrapath(void);
@@ -195,37 +270,327 @@ double sys_getrealtime(void)
 
 extern int sys_nosleep;
 
+    /* call an fd's function, tracing it if that's on */
+static void sys_fdcall(t_fdpoll *fp)
+{
+    unsigned long long tracestart = (sys_tracing ? PROFILE_NOW() : 0);
+    (*fp->fdp_fn)(fp->fdp_ptr, fp->fdp_fd);
+    if (tracestart)
+        sys_tracespan("net", "fd", tracestart);
+}
+
+    /* find fd in a poll list and call its function */
+static int sys_fdpollcall(t_fdpoll *fp, int n, int fd)
+{
+    for (; n--; fp++)
+        if (fp->fdp_fd == fd)
+    {
+        sys_fdcall(fp);
+        return (1);
+    }
+    return (0);
+}
+
+#if defined(POLL_EPOLL) || defined(POLL_KQUEUE)
+
+static int sys_fdpolled(t_fdpoll *fp, int n, int fd)
+{
+    for (; n--; fp++)
+        if (fp->fdp_fd == fd)
+            return (1);
+    return (0);
+}
+
+    /* update the event queue after fd has been added to or removed from the
+    read or write poll list.  If the queue won't take it (epoll refuses
+    regular files, for instance) give the queue up and go back to select(). */
+static void sys_queuefd(int fd, int write, int add)
+{
+    int ret;
+#ifdef POLL_EPOLL
+    struct epoll_event ev;
+    int op;
+    ev.events =
+        (sys_fdpolled(INTER->i_fdpoll, INTER->i_nfdpoll, fd) ? EPOLLIN : 0) |
+        (sys_fdpolled(INTER->i_fdwritepoll, INTER->i_nfdwritepoll, fd) ?
+            EPOLLOUT : 0);
+    ev.data.fd = fd;
+    if (!ev.events)
+        op = EPOLL_CTL_DEL;
+    else if (add && ev.events == (write ? EPOLLOUT : EPOLLIN))
+        op = EPOLL_CTL_ADD;
+    else op = EPOLL_CTL_MOD;
+    ret = epoll_ctl(INTER->i_pollfd, op, fd, &ev);
+#else
+    struct kevent ev;
+        /* unless the same fd was added twice */
+    if (!add && (write ?
+        sys_fdpolled(INTER->i_fdwritepoll, INTER->i_nfdwritepoll, fd) :
+        sys_fdpolled(INTER->i_fdpoll, INTER->i_nfdpoll, fd)))
+            return;
+    EV_SET(&ev, fd, (write ? EVFILT_WRITE : EVFILT_READ),
+        (add ? EV_ADD : EV_DELETE), 0, 0, 0);
+    ret = kevent(INTER->i_pollfd, &ev, 1, 0, 0, 0);
+#endif
+        /* on removal, the fd may already have been closed, which takes it
+        out of the queue anyway */
+    if (ret < 0 && add && errno != EEXIST)
+    {
+        close(INTER->i_pollfd);
+        INTER->i_pollfd = -1;
+    }
+}
+
+    /* wait up to microsec for any fds to be ready, and dispatch them.  The
+    lock is released while waiting. */
+static int sys_dopoll(int microsec)
+{
+    int n, i, didsomething = 0;
+#ifdef POLL_EPOLL
+    struct epoll_event events[POLL_MAXEVENTS];
+    n = epoll_wait(INTER->i_pollfd, events, POLL_MAXEVENTS, 0);
+        /* epoll only waits for whole milliseconds; sleep shorter than that
+        with usleep() as before */
+    if (n == 0 && microsec >= 1000)
+    {
+        int pollfd = INTER->i_pollfd;
+        sys_unlock();
+        n = epoll_wait(pollfd, events, POLL_MAXEVENTS, microsec / 1000);
+        sys_lock();
+        microsec = 0;
+    }
+#else
+    struct kevent events[POLL_MAXEVENTS];
+    struct timespec timeout = {0, 0};
+    n = kevent(INTER->i_pollfd, 0, 0, events, POLL_MAXEVENTS, &timeout);
+    if (n == 0 && microsec)
+    {
+        int pollfd = INTER->i_pollfd;
+        timeout.tv_sec = microsec / 1000000;
+        timeout.tv_nsec = (microsec % 1000000) * 1000;
+        sys_unlock();
+        n = kevent(pollfd, 0, 0, events, POLL_MAXEVENTS, &timeout);
+        sys_lock();
+        microsec = 0;
+    }
+#endif
+    if (n < 0 && errno != EINTR)
+        perror("microsleep poll");
+    INTER->i_fdschanged = 0;
+    for (i = 0; i < n && !INTER->i_fdschanged; i++)
+    {
+            /* the fd may have been removed while we slept */
+#ifdef POLL_EPOLL
+        int fd = events[i].data.fd, flags = events[i].events;
+        if ((flags & (EPOLLIN|EPOLLERR|EPOLLHUP)) &&
+            sys_fdpollcall(INTER->i_fdpoll, INTER->i_nfdpoll, fd))
+                didsomething = 1;
+        if (!INTER->i_fdschanged && (flags & (EPOLLOUT|EPOLLERR|EPOLLHUP)) &&
+            sys_fdpollcall(INTER->i_fdwritepoll, INTER->i_nfdwritepoll, fd))
+                didsomething = 1;
+#else
+        int fd = (int)events[i].ident;
+        if (events[i].filter == EVFILT_WRITE ?
+            sys_fdpollcall(INTER->i_fdwritepoll, INTER->i_nfdwritepoll, fd) :
+            sys_fdpollcall(INTER->i_fdpoll, INTER->i_nfdpoll, fd))
+                didsomething = 1;
+#endif
+    }
+    if (didsomething)
+        return (1);
+    if (microsec)
+    {
+        sys_unlock();
+        usleep(microsec);
+        sys_lock();
+    }
+    return (0);
+}
+
+#endif /* POLL_EPOLL || POLL_KQUEUE */
+
+/* In "-callbackqueue" mode the main thread waits for file descriptors to be
+ready and passes them, through a lock-free ring with one writer and one
+reader, to the audio callback, which reads them and dispatches the resulting
+messages before its next tick.  This way the main thread never takes the
+Pd lock while audio is running, so the callback never waits for it.  Only
+the kernel event queue is shared between the threads; with select() the
+callback polls for itself as in plain callback mode. */
+
+#define FDQ_SIZE 256    /* ready fds in flight; a power of two */
+
+typedef struct _fdqevent
+{
+    int e_fd;
+    int e_write;
+} t_fdqevent;
+
+static t_fdqevent sys_fdq[FDQ_SIZE];
+static volatile unsigned int sys_fdqhead, sys_fdqtail;
+static int sys_fdqueueing;
+
+    /* turn queueing on or off; call with the lock set */
+void sys_setfdqueue(int onoff)
+{
+    sys_fdqtail = sys_fdqhead;
+    sys_fdqueueing = onoff;
+}
+
+#if defined(POLL_EPOLL) || defined(POLL_KQUEUE)
+#include <poll.h>
+
+static void sys_fdqpush(int fd, int write)
+{
+    unsigned int head = sys_fdqhead;
+    if (head - sys_fdqtail >= FDQ_SIZE)
+        return;     /* still ready next time, since the queue is level-
+                    triggered */
+    sys_fdq[head & (FDQ_SIZE-1)].e_fd = fd;
+    sys_fdq[head & (FDQ_SIZE-1)].e_write = write;
+    SYS_BARRIER();
+    sys_fdqhead = head + 1;
+}
+
+    /* main thread, without the lock: wait up to microsec for fds to be
+    ready and queue them.  Returns -1 if there's no kernel queue to wait
+    on, in which case the callback has to poll by itself. */
+int sys_fdqueuewait(int microsec)
+{
+    int n, i, pollfd = INTER->i_pollfd;
+    if (pollfd < 0)
+        return (-1);
+        /* don't look again until the callback has taken what we gave it,
+        or we'd only find the same fds again */
+    SYS_BARRIER();
+    if (sys_fdqtail != sys_fdqhead)
+    {
+        usleep(1000);
+        return (0);
+    }
+#ifdef POLL_EPOLL
+    {
+        struct epoll_event events[POLL_MAXEVENTS];
+        n = epoll_wait(pollfd, events, POLL_MAXEVENTS, microsec / 1000);
+        if (n < 0)
+            return (errno == EINTR ? 0 : -1);
+        for (i = 0; i < n; i++)
+        {
+            if (events[i].events & (EPOLLIN|EPOLLERR|EPOLLHUP))
+                sys_fdqpush(events[i].data.fd, 0);
+            if (events[i].events & (EPOLLOUT|EPOLLERR|EPOLLHUP))
+                sys_fdqpush(events[i].data.fd, 1);
+        }
+    }
+#else
+    {
+        struct kevent events[POLL_MAXEVENTS];
+        struct timespec timeout;
+        timeout.tv_sec = microsec / 1000000;
+        timeout.tv_nsec = (microsec % 1000000) * 1000;
+        n = kevent(pollfd, 0, 0, events, POLL_MAXEVENTS, &timeout);
+        if (n < 0)
+            return (errno == EINTR ? 0 : -1);
+        for (i = 0; i < n; i++)
+            sys_fdqpush((int)events[i].ident,
+                (events[i].filter == EVFILT_WRITE));
+    }
+#endif
+    return (n);
+}
+
+    /* audio callback, with the lock set: dispatch the queued fds.  An fd
+    may have been closed, and its number reused, since it was queued, so
+    check it's really ready before calling a function that might block. */
+static int sys_fdqueuerun(void)
+{
+    unsigned int head = sys_fdqhead, tail = sys_fdqtail;
+    int didsomething = 0;
+    SYS_BARRIER();
+    for (; tail != head; tail++)
+    {
+        t_fdqevent *e = &sys_fdq[tail & (FDQ_SIZE-1)];
+        struct pollfd p;
+        p.fd = e->e_fd;
+        p.events = (e->e_write ? POLLOUT : POLLIN);
+        p.revents = 0;
+        if (poll(&p, 1, 0) > 0 && (e->e_write ?
+            sys_fdpollcall(INTER->i_fdwritepoll, INTER->i_nfdwritepoll,
+                e->e_fd) :
+            sys_fdpollcall(INTER->i_fdpoll, INTER->i_nfdpoll, e->e_fd)))
+                didsomething = 1;
+    }
+    SYS_BARRIER();
+    sys_fdqtail = tail;
+    return (didsomething);
+}
+
+#else /* POLL_EPOLL || POLL_KQUEUE */
+
+int sys_fdqueuewait(int microsec)
+{
+    return (-1);
+}
+
+static int sys_fdqueuerun(void)
+{
+    return (0);
+}
+
+#endif /* POLL_EPOLL || POLL_KQUEUE */
+
 /* sleep (but cancel the sleeping if any file descriptors are
 ready - in that case, dispatch any resulting Pd messages and return.  Called
 with sys_lock() set.  We will temporarily release the lock if we actually
-sleep. */
-static int sys_domicrosleep(int microsec)
+sleep.  Without epoll or kqueue the fds are only checked before sleeping
+unless "wait" is set, in which case the sleep ends when one is ready. */
+static int sys_domicrosleep(int microsec, int wait)
 {
     struct timeval timeout;
     int i, didsomething = 0;
     t_fdpoll *fp;
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 0;
-    if (INTER->i_nfdpoll)
+#if defined(POLL_EPOLL) || defined(POLL_KQUEUE)
+    if (INTER->i_pollfd >= 0)
+        return (sys_dopoll(microsec));
+#endif
+    timeout.tv_sec = (wait ? microsec / 1000000 : 0);
+    timeout.tv_usec = (wait ? microsec % 1000000 : 0);
+    if (INTER->i_nfdpoll || INTER->i_nfdwritepoll)
     {
         fd_set readset, writeset, exceptset;
+        int ret;
         FD_ZERO(&writeset);
         FD_ZERO(&readset);
         FD_ZERO(&exceptset);
         for (fp = INTER->i_fdpoll,
             i = INTER->i_nfdpoll; i--; fp++)
                 FD_SET(fp->fdp_fd, &readset);
-        if(select(INTER->i_maxfd+1,
-                  &readset, &writeset, &exceptset, &timeout) < 0)
+        for (fp = INTER->i_fdwritepoll,
+            i = INTER->i_nfdwritepoll; i--; fp++)
+                FD_SET(fp->fdp_fd, &writeset);
+        if (wait)
+            sys_unlock();
+        ret = select(INTER->i_maxfd+1,
+                  &readset, &writeset, &exceptset, &timeout);
+        if (wait)
+        {
+            sys_lock();
+            microsec = 0;
+        }
+        if (ret < 0)
           perror("microsleep select");
         INTER->i_fdschanged = 0;
         for (i = 0; i < INTER->i_nfdpoll &&
             !INTER->i_fdschanged; i++)
                 if (FD_ISSET(INTER->i_fdpoll[i].fdp_fd, &readset))
         {
-            (*INTER->i_fdpoll[i].fdp_fn)
-                (INTER->i_fdpoll[i].fdp_ptr,
-                    INTER->i_fdpoll[i].fdp_fd);
+            sys_fdcall(&INTER->i_fdpoll[i]);
+            didsomething = 1;
+        }
+        for (i = 0; i < INTER->i_nfdwritepoll &&
+            !INTER->i_fdschanged; i++)
+                if (FD_ISSET(INTER->i_fdwritepoll[i].fdp_fd, &writeset))
+        {
+            sys_fdcall(&INTER->i_fdwritepoll[i]);
             didsomething = 1;
         }
         if (didsomething)
@@ -249,7 +614,16 @@ static int sys_domicrosleep(int microsec)
 void sys_microsleep( void)
 {
     sys_lock();
-    sys_domicrosleep(sched_get_sleepgrain());
+    sys_domicrosleep(sched_get_sleepgrain(), 0);
+    sys_unlock();
+}
+
+    /* sleep up to "microsec" but wake as soon as an fd is ready, for
+    "-tickless" scheduling.  Call with the lock unset, as above. */
+void sys_fdwait(int microsec)
+{
+    sys_lock();
+    sys_domicrosleep(microsec, 1);
     sys_unlock();
 }
 
@@ -391,6 +765,195 @@ void sys_set_priority(int mode)
 
 #endif /* __linux__ */
 
+/* ------------------------- CPU affinity --------------------------------- */
+
+/* Threads can be pinned to sets of CPUs according to their role: the
+scheduler (which also computes DSP unless there are worker threads), the
+DSP workers, and the disk threads of readsf~, writesf~ and soundfiler.  The
+sets come from "-affinity <role> <cpus>" flags or "pd affinity <role>
+<cpus...>" messages; "pd affinity" alone prints the current layout.  Each
+thread applies its set itself, next time it comes around its loop, so a
+change reaches running threads without stopping them.  Under Linux's
+default first-touch policy, signal buffers then end up on the memory node
+of the scheduler thread that first writes to them when DSP is started. */
+
+static const char *sys_affinityname[AFFINITY_NROLES] = {"sched", "dsp", "disk"};
+static int sys_affinityserial;
+
+#if defined(__linux__)
+#include <sched.h>
+#include <pthread.h>
+#define AFFINITY_OK
+static cpu_set_t sys_affinityset[AFFINITY_NROLES];
+static int sys_hasaffinity[AFFINITY_NROLES];
+static cpu_set_t sys_affinitydefault;
+static int sys_affinitygotdefault;
+
+    /* parse a list such as "0-3,8" into a set; "all" or "none" unpins */
+static int sys_parsecpus(const char *s, cpu_set_t *set, int *pinned)
+{
+    CPU_ZERO(set);
+    if (!strcmp(s, "all") || !strcmp(s, "none"))
+    {
+        *pinned = 0;
+        return (1);
+    }
+    while (*s)
+    {
+        char *end;
+        long lo = strtol(s, &end, 10), hi = lo;
+        if (end == s || lo < 0)
+            return (0);
+        s = end;
+        if (*s == '-')
+        {
+            hi = strtol(s + 1, &end, 10);
+            if (end == s + 1 || hi < lo)
+                return (0);
+            s = end;
+        }
+        if (hi >= CPU_SETSIZE)
+            return (0);
+        for (; lo <= hi; lo++)
+            CPU_SET(lo, set);
+        if (*s == ',')
+            s++;
+        else if (*s)
+            return (0);
+    }
+    *pinned = 1;
+    return (CPU_COUNT(set) > 0);
+}
+
+static void sys_printcpus(cpu_set_t *set, char *buf, int bufsize)
+{
+    int i, j, n = 0;
+    buf[0] = 0;
+    for (i = 0; i < CPU_SETSIZE && n < bufsize - 24; i = j)
+    {
+        if (!CPU_ISSET(i, set))
+        {
+            j = i + 1;
+            continue;
+        }
+        for (j = i + 1; j < CPU_SETSIZE && CPU_ISSET(j, set); j++)
+            ;
+        if (j > i + 1)
+            n += sprintf(buf + n, "%s%d-%d", (n ? "," : ""), i, j - 1);
+        else n += sprintf(buf + n, "%s%d", (n ? "," : ""), i);
+    }
+}
+#endif /* __linux__ */
+
+    /* set the CPUs for a role; "cpus" is a list like "0-3,8".  Returns 1
+    on success. */
+int sys_setaffinity(const char *role, const char *cpus)
+{
+    int i;
+    for (i = 0; i < AFFINITY_NROLES; i++)
+        if (!strcmp(role, sys_affinityname[i]))
+            break;
+    if (i == AFFINITY_NROLES)
+    {
+        pd_error(0, "affinity: %s: unknown thread role (use sched, dsp or disk)",
+            role);
+        return (0);
+    }
+#ifdef AFFINITY_OK
+    {
+        cpu_set_t set;
+        int pinned;
+        if (!sys_parsecpus(cpus, &set, &pinned))
+        {
+            pd_error(0, "affinity: %s: bad CPU list", cpus);
+            return (0);
+        }
+            /* remember what we were allowed before pinning anything */
+        if (!sys_affinitygotdefault &&
+            !sched_getaffinity(0, sizeof(sys_affinitydefault),
+                &sys_affinitydefault))
+                    sys_affinitygotdefault = 1;
+        sys_affinityset[i] = set;
+        sys_hasaffinity[i] = pinned;
+        sys_affinityserial++;
+        return (1);
+    }
+#else
+    pd_error(0, "affinity: not supported on this platform");
+    return (0);
+#endif
+}
+
+    /* called by a thread of the given role, from time to time, to apply
+    any change of its CPU set.  "serial" is the thread's own record of
+    the last change it applied and should start out as -1. */
+void sys_bindthread(int role, int *serial)
+{
+    if (*serial == sys_affinityserial)
+        return;
+    *serial = sys_affinityserial;
+#ifdef AFFINITY_OK
+    if (sys_hasaffinity[role])
+    {
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+            &sys_affinityset[role]))
+                pd_error(0, "affinity: couldn't pin %s thread",
+                    sys_affinityname[role]);
+    }
+    else if (sys_affinitygotdefault)
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+            &sys_affinitydefault);
+#endif
+}
+
+int soundfile_getthreads(void);
+
+    /* "pd affinity <role> <cpu> ...": each CPU can be a number or a range
+    like "4-7".  With no arguments, print the thread layout. */
+void glob_affinity(void *dummy, t_symbol *s, int argc, t_atom *argv)
+{
+    char buf[MAXPDSTRING], cpus[MAXPDSTRING];
+    int i, nthreads[AFFINITY_NROLES];
+    if (argc >= 2 && argv->a_type == A_SYMBOL)
+    {
+        cpus[0] = 0;
+        for (i = 1; i < argc; i++)
+        {
+                /* join with commas; ranges are symbols, CPUs singly floats */
+            atom_string(argv + i, buf, MAXPDSTRING);
+            if (strlen(cpus) + strlen(buf) + 2 >= MAXPDSTRING)
+                break;
+            if (i > 1)
+                strcat(cpus, ",");
+            strcat(cpus, buf);
+        }
+        sys_setaffinity(argv->a_w.w_symbol->s_name, cpus);
+        return;
+    }
+    else if (argc)
+    {
+        pd_error(0, "usage: pd affinity [<role> <cpus...>]");
+        return;
+    }
+    nthreads[AFFINITY_SCHED] = 1;
+    nthreads[AFFINITY_DSP] = ugen_getthreads();
+    nthreads[AFFINITY_DISK] = soundfile_getthreads();
+    post("thread layout:");
+    for (i = 0; i < AFFINITY_NROLES; i++)
+    {
+        strcpy(cpus, "any");
+#ifdef AFFINITY_OK
+        if (sys_hasaffinity[i])
+            sys_printcpus(&sys_affinityset[i], cpus, MAXPDSTRING);
+#endif
+        if (i == AFFINITY_DISK)
+            post("  %s: %d pool thread%s, CPUs %s", sys_affinityname[i],
+                nthreads[i], (nthreads[i] == 1 ? "" : "s"), cpus);
+        else post("  %s: %d thread%s, CPUs %s", sys_affinityname[i],
+            nthreads[i], (nthreads[i] == 1 ? "" : "s"), cpus);
+    }
+}
+
 /* ------------------ receiving incoming messages over sockets ------------- */
 
 unsigned char *sys_getrecvbuf(unsigned int *size)
@@ -400,6 +963,73 @@ unsigned char *sys_getrecvbuf(unsigned int *size)
     return INTER->i_recvbuf;
 }
 
+int sys_recvbatch(int fd, t_datagram **dp, int *morep)
+{
+    t_datagram *d;
+    socklen_t fromaddrlen = sizeof(struct sockaddr_storage);
+    int n;
+#ifdef HAVE_RECVMMSG
+        /* the batch may still be in use further up the stack if a message
+        from it caused polling; get just one datagram then */
+    if (!INTER->i_batchbusy && (INTER->i_batchbuf ||
+        (INTER->i_batchbuf = (unsigned char *)getbytes(RECVBATCH *
+            (NET_MAXPACKETSIZE + sizeof(struct sockaddr_storage))))))
+    {
+        struct mmsghdr msgs[RECVBATCH];
+        struct iovec iov[RECVBATCH];
+        struct sockaddr_storage *addr = (struct sockaddr_storage *)
+            (INTER->i_batchbuf + RECVBATCH * NET_MAXPACKETSIZE);
+        int i;
+        memset(msgs, 0, sizeof(msgs));
+        for (i = 0; i < RECVBATCH; i++)
+        {
+            iov[i].iov_base = INTER->i_batchbuf + i * NET_MAXPACKETSIZE;
+            iov[i].iov_len = NET_MAXPACKETSIZE - 1;
+            msgs[i].msg_hdr.msg_name = &addr[i];
+            msgs[i].msg_hdr.msg_namelen = fromaddrlen;
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        *morep = 0;
+        if ((n = recvmmsg(fd, msgs, RECVBATCH, MSG_DONTWAIT, 0)) < 0)
+            return ((errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1);
+        for (i = 0; i < n; i++)
+        {
+            d = &INTER->i_batch[i];
+            d->d_buf = (unsigned char *)iov[i].iov_base;
+            d->d_len = msgs[i].msg_len;
+            d->d_truncated = ((msgs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0);
+            d->d_from = &addr[i];
+            sockaddr_end_unixpath(&addr[i], msgs[i].msg_hdr.msg_namelen);
+        }
+        INTER->i_batchbusy = (n > 0);
+        *dp = INTER->i_batch;
+        *morep = (n == RECVBATCH);
+        return (n);
+    }
+#endif
+    d = &INTER->i_onedatagram;
+    *morep = 0;
+    if ((n = (int)recvfrom(fd, INTER->i_recvbuf, NET_MAXPACKETSIZE-1, 0,
+        (struct sockaddr *)&INTER->i_oneaddr, &fromaddrlen)) < 0)
+            return (-1);
+    sockaddr_end_unixpath(&INTER->i_oneaddr, fromaddrlen);
+    d->d_buf = INTER->i_recvbuf;
+    d->d_len = n;
+    d->d_truncated = 0;
+    d->d_from = &INTER->i_oneaddr;
+    *dp = d;
+        /* check for pending UDP packets */
+    *morep = (socket_bytes_available(fd) > 0);
+    return (1);
+}
+
+void sys_recvbatchdone(t_datagram *d)
+{
+    if (d == INTER->i_batch)
+        INTER->i_batchbusy = 0;
+}
+
 void sys_sockerror(const char *s)
 {
     char buf[MAXPDSTRING];
@@ -408,32 +1038,30 @@ void sys_sockerror(const char *s)
     pd_error(0, "%s: %s (%d)", s, buf, err);
 }
 
-void sys_addpollfn(int fd, t_fdpollfn fn, void *ptr)
+static void sys_addtopoll(t_fdpoll **list, int *np, int fd,
+    t_fdpollfn fn, void *ptr)
 {
-    int nfd, size;
+    int nfd = *np, size = nfd * sizeof(t_fdpoll);
     t_fdpoll *fp;
     sys_init_fdpoll();
-    nfd = INTER->i_nfdpoll;
-    size = nfd * sizeof(t_fdpoll);
-    INTER->i_fdpoll = (t_fdpoll *)t_resizebytes(
-        INTER->i_fdpoll, size, size + sizeof(t_fdpoll));
-    fp = INTER->i_fdpoll + nfd;
+    *list = (t_fdpoll *)t_resizebytes(*list, size, size + sizeof(t_fdpoll));
+    fp = *list + nfd;
     fp->fdp_fd = fd;
     fp->fdp_fn = fn;
     fp->fdp_ptr = ptr;
-    INTER->i_nfdpoll = nfd + 1;
+    *np = nfd + 1;
     if (fd >= INTER->i_maxfd)
         INTER->i_maxfd = fd + 1;
     INTER->i_fdschanged = 1;
 }
 
-void sys_rmpollfn(int fd)
+static int sys_rmfrompoll(t_fdpoll **list, int *np, int fd)
 {
-    int nfd = INTER->i_nfdpoll;
+    int nfd = *np;
     int i, size = nfd * sizeof(t_fdpoll);
     t_fdpoll *fp;
     INTER->i_fdschanged = 1;
-    for (i = nfd, fp = INTER->i_fdpoll; i--; fp++)
+    for (i = nfd, fp = *list; i--; fp++)
     {
         if (fp->fdp_fd == fd)
         {
@@ -442,25 +1070,75 @@ void sys_rmpollfn(int fd)
                 fp[0] = fp[1];
                 fp++;
             }
-            INTER->i_fdpoll = (t_fdpoll *)t_resizebytes(
-                INTER->i_fdpoll, size, size - sizeof(t_fdpoll));
-            INTER->i_nfdpoll = nfd - 1;
-            return;
+            *list = (t_fdpoll *)t_resizebytes(*list,
+                size, size - sizeof(t_fdpoll));
+            *np = nfd - 1;
+            return (1);
         }
     }
-    post("warning: %d removed from poll list but not found", fd);
+    return (0);
+}
+
+void sys_addpollfn(int fd, t_fdpollfn fn, void *ptr)
+{
+    sys_addtopoll(&INTER->i_fdpoll, &INTER->i_nfdpoll, fd, fn, ptr);
+#if defined(POLL_EPOLL) || defined(POLL_KQUEUE)
+    if (INTER->i_pollfd >= 0)
+        sys_queuefd(fd, 0, 1);
+#endif
+}
+
+void sys_rmpollfn(int fd)
+{
+    if (!sys_rmfrompoll(&INTER->i_fdpoll, &INTER->i_nfdpoll, fd))
+    {
+        post("warning: %d removed from poll list but not found", fd);
+        return;
+    }
+#if defined(POLL_EPOLL) || defined(POLL_KQUEUE)
+    if (INTER->i_pollfd >= 0)
+        sys_queuefd(fd, 0, 0);
+#endif
 }
 
-    /* Size of the buffer used for parsing FUDI messages
-    received over TCP. Must be a power of two!
-    LATER make this settable per socketreceiver instance */
+    /* same for waiting until fd can take output without blocking */
+void sys_addwritepollfn(int fd, t_fdpollfn fn, void *ptr)
+{
+    sys_addtopoll(&INTER->i_fdwritepoll, &INTER->i_nfdwritepoll,
+        fd, fn, ptr);
+#if defined(POLL_EPOLL) || defined(POLL_KQUEUE)
+    if (INTER->i_pollfd >= 0)
+        sys_queuefd(fd, 1, 1);
+#endif
+}
+
+void sys_rmwritepollfn(int fd)
+{
+    if (!sys_rmfrompoll(&INTER->i_fdwritepoll, &INTER->i_nfdwritepoll, fd))
+    {
+        post("warning: %d removed from write poll list but not found", fd);
+        return;
+    }
+#if defined(POLL_EPOLL) || defined(POLL_KQUEUE)
+    if (INTER->i_pollfd >= 0)
+        sys_queuefd(fd, 1, 0);
+#endif
+}
+
+    /* Initial size of the buffer used for parsing FUDI messages received
+    over TCP.  It grows as needed to hold the longest message so far, up to
+    INBUFMAX; messages longer than that are dropped. */
 #define INBUFSIZE 4096
+#define INBUFLOWMEMSIZE 512     /* with "-lowmem" */
+#define INBUFMAX (1 << 26)
 
 t_socketreceiver *socketreceiver_new(void *owner, t_socketnotifier notifier,
     t_socketreceivefn socketreceivefn, int udp)
 {
     t_socketreceiver *x = (t_socketreceiver *)getbytes(sizeof(*x));
-    x->sr_inhead = x->sr_intail = 0;
+    x->sr_inhead = x->sr_intail = x->sr_inscan = 0;
+    x->sr_escaped = x->sr_skipping = 0;
+    x->sr_insize = (udp ? 0 : (sys_lowmem ? INBUFLOWMEMSIZE : INBUFSIZE));
     x->sr_owner = owner;
     x->sr_notifier = notifier;
     x->sr_socketreceivefn = socketreceivefn;
@@ -469,7 +1147,7 @@ t_socketreceiver *socketreceiver_new(void *owner, t_socketnotifier notifier,
     x->sr_fromaddrfn = NULL;
     if (!udp)
     {
-        if (!(x->sr_inbuf = malloc(INBUFSIZE)))
+        if (!(x->sr_inbuf = malloc(x->sr_insize)))
             bug("t_socketreceiver");
     }
     else
@@ -485,58 +1163,98 @@ void socketreceiver_free(t_socketreceiver *x)
     freebytes(x, sizeof(*x));
 }
 
-    /* this is in a separately called subroutine so that the buffer isn't
-    sitting on the stack while the messages are getting passed. */
+    /* look for the end of the next message, picking up where the last call
+    left off so that each byte is only scanned once.  If there's a complete
+    message, parse it in place into INTER->i_inbinbuf and return 1. */
 static int socketreceiver_doread(t_socketreceiver *x)
 {
-    char messbuf[INBUFSIZE], *bp = messbuf;
-    int indx, first = 1;
-    int inhead = x->sr_inhead;
-    int intail = x->sr_intail;
     char *inbuf = x->sr_inbuf;
-    for (indx = intail; first || (indx != inhead);
-        first = 0, (indx = (indx+1)&(INBUFSIZE-1)))
-    {
-            /* if we hit a semi that isn't preceded by a \, it's a message
-            boundary. LATER we should deal with the possibility that the
-            preceding \ might itself be escaped! */
-        char c = *bp++ = inbuf[indx];
-        if (c == ';' && (!indx || inbuf[indx-1] != '\\'))
+    int indx, inhead = x->sr_inhead, escaped = x->sr_escaped;
+    for (indx = x->sr_inscan; indx < inhead; indx++)
+    {
+        char c = inbuf[indx];
+            /* a semi that isn't escaped by a backslash (itself unescaped)
+            is a message boundary */
+        if (escaped)
+            escaped = 0;
+        else if (c == '\\')
+            escaped = 1;
+        else if (c == ';')
         {
-            intail = (indx+1)&(INBUFSIZE-1);
-            binbuf_text(INTER->i_inbinbuf, messbuf, bp - messbuf);
+            char *messbuf = inbuf + x->sr_intail;
+            int messlen = indx + 1 - x->sr_intail;
+            x->sr_intail = x->sr_inscan = indx + 1;
+            x->sr_escaped = 0;
+            if (x->sr_skipping)
+            {
+                x->sr_skipping = 0;
+                continue;
+            }
+            binbuf_text(INTER->i_inbinbuf, messbuf, messlen);
             if (sys_debuglevel & DEBUG_MESSDOWN)
             {
-                size_t bufsize = (bp>messbuf)?(bp-messbuf):0;
         #ifdef _WIN32
             #ifdef _MSC_VER
-                fwprintf(stderr, L"<< %.*S\n", (int)bufsize, messbuf);
+                fwprintf(stderr, L"<< %.*S\n", messlen, messbuf);
             #else
-                fwprintf(stderr, L"<< %.*s\n", (int)bufsize, messbuf);
+                fwprintf(stderr, L"<< %.*s\n", messlen, messbuf);
             #endif
                 fflush(stderr);
         #else
-                fprintf(stderr, "<< %.*s\n", (int)bufsize, messbuf);
+                fprintf(stderr, "<< %.*s\n", messlen, messbuf);
         #endif
             }
-            x->sr_inhead = inhead;
-            x->sr_intail = intail;
             return (1);
         }
     }
+    x->sr_inscan = inhead;
+    x->sr_escaped = escaped;
     return (0);
 }
 
+    /* make room to receive more: move any partial message to the start of
+    the buffer, and if it already fills the buffer, grow it. */
+static void socketreceiver_makeroom(t_socketreceiver *x)
+{
+    int intail = x->sr_intail;
+    if (intail > 0 && (intail == x->sr_inhead ||
+        x->sr_insize - x->sr_inhead < x->sr_insize / 4))
+    {
+        memmove(x->sr_inbuf, x->sr_inbuf + intail, x->sr_inhead - intail);
+        x->sr_inhead -= intail;
+        x->sr_inscan -= intail;
+        x->sr_intail = 0;
+    }
+    if (x->sr_inhead == x->sr_insize)
+    {
+        char *newbuf;
+        if (x->sr_insize >= INBUFMAX ||
+            !(newbuf = realloc(x->sr_inbuf, 2 * x->sr_insize)))
+        {
+                /* give up on this message and ignore the rest of it */
+            if (x == INTER->i_socketreceiver)
+                fprintf(stderr, "pd: dropped message from gui\n");
+            else pd_error(0, "dropped incoming message longer than %d bytes",
+                x->sr_insize);
+            x->sr_inhead = x->sr_intail = x->sr_inscan = 0;
+            x->sr_escaped = 0;
+            x->sr_skipping = 1;
+        }
+        else
+        {
+            x->sr_inbuf = newbuf;
+            x->sr_insize *= 2;
+        }
+    }
+}
+
 static void socketreceiver_getudp(t_socketreceiver *x, int fd)
 {
-    char *buf = (char *)sys_getrecvbuf(0);
-    socklen_t fromaddrlen = sizeof(struct sockaddr_storage);
-    int ret, readbytes = 0;
+    t_datagram *d = 0;
+    int n, i, more, readbytes = 0;
     while (1)
     {
-        ret = (int)recvfrom(fd, buf, NET_MAXPACKETSIZE-1, 0,
-            (struct sockaddr *)x->sr_fromaddr, (x->sr_fromaddr ? &fromaddrlen : 0));
-        if (ret < 0)
+        if ((n = sys_recvbatch(fd, &d, &more)) < 0)
         {
                 /* socket_errno_udp() ignores some error codes */
             if (socket_errno_udp())
@@ -552,15 +1270,16 @@ static void socketreceiver_getudp(t_socketreceiver *x, int fd)
             }
             return;
         }
-        else if (ret > 0)
+        for (i = 0; i < n; i++)
         {
+            char *buf = (char *)d[i].d_buf;
+            int ret = d[i].d_len;
+            if (ret <= 0)
+                continue;
                 /* handle too large UDP packets */
-            if (ret > NET_MAXPACKETSIZE-1)
-            {
-                post("warning: incoming UDP packet truncated from %d to %d bytes.",
-                    ret, NET_MAXPACKETSIZE-1);
-                ret = NET_MAXPACKETSIZE-1;
-            }
+            if (d[i].d_truncated)
+                post("warning: incoming UDP packet truncated to %d bytes.",
+                    NET_MAXPACKETSIZE-1);
             buf[ret] = 0;
     #if 0
             post("%s", buf);
@@ -577,22 +1296,28 @@ static void socketreceiver_getudp(t_socketreceiver *x, int fd)
                 if (semi)
                     *semi = 0;
                 if (x->sr_fromaddrfn)
-                    (*x->sr_fromaddrfn)(x->sr_owner, (const void *)x->sr_fromaddr);
+                {
+                    if (x->sr_fromaddr)
+                        memcpy(x->sr_fromaddr, d[i].d_from,
+                            sizeof(struct sockaddr_storage));
+                    (*x->sr_fromaddrfn)(x->sr_owner,
+                        (const void *)x->sr_fromaddr);
+                }
                 binbuf_text(INTER->i_inbinbuf, buf, strlen(buf));
                 outlet_setstacklim();
+                if (sys_inputrecording)
+                    sys_recordmessage(x->sr_owner, INTER->i_inbinbuf);
                 if (x->sr_socketreceivefn)
                     (*x->sr_socketreceivefn)(x->sr_owner,
                         INTER->i_inbinbuf);
                 else bug("socketreceiver_getudp");
             }
             readbytes += ret;
-            /* throttle */
-            if (readbytes >= NET_MAXPACKETSIZE)
-                return;
-            /* check for pending UDP packets */
-            if (socket_bytes_available(fd) <= 0)
-                return;
         }
+        sys_recvbatchdone(d);
+            /* throttle */
+        if (readbytes >= NET_MAXPACKETSIZE || !more)
+            return;
     }
 }
 
@@ -602,72 +1327,67 @@ void socketreceiver_read(t_socketreceiver *x, int fd)
         socketreceiver_getudp(x, fd);
     else  /* TCP ("streaming") socket protocol */
     {
-        char *semi;
-        int readto =
-            (x->sr_inhead >= x->sr_intail ? INBUFSIZE : x->sr_intail-1);
-        int ret;
-
-            /* the input buffer might be full. If so, drop the whole thing */
-        if (readto == x->sr_inhead)
-        {
-            fprintf(stderr, "pd: dropped message from gui\n");
-            x->sr_inhead = x->sr_intail = 0;
-            readto = INBUFSIZE;
-        }
-        else
+        int ret, gotpeer = -1;
+        socketreceiver_makeroom(x);
+        ret = (int)recv(fd, x->sr_inbuf + x->sr_inhead,
+            x->sr_insize - x->sr_inhead, 0);
+        if (ret <= 0)
         {
-            ret = (int)recv(fd, x->sr_inbuf + x->sr_inhead,
-                readto - x->sr_inhead, 0);
-            if (ret <= 0)
+            if (ret < 0)
+                sys_sockerror("recv (tcp)");
+            if (x == INTER->i_socketreceiver)
             {
-                if (ret < 0)
-                    sys_sockerror("recv (tcp)");
-                if (x == INTER->i_socketreceiver)
+                if (pd_this == &pd_maininstance)
                 {
-                    if (pd_this == &pd_maininstance)
-                    {
-                        fprintf(stderr, "read from GUI socket: %s; stopping\n",
-                            strerror(errno));
-                        sys_bail(1);
-                    }
-                    else
-                    {
-                        sys_rmpollfn(fd);
-                        sys_closesocket(fd);
-                        sys_stopgui();
-                    }
+                    fprintf(stderr, "read from GUI socket: %s; stopping\n",
+                        strerror(errno));
+                    sys_bail(1);
                 }
                 else
                 {
-                    if (x->sr_notifier)
-                        (*x->sr_notifier)(x->sr_owner, fd);
                     sys_rmpollfn(fd);
                     sys_closesocket(fd);
+                    sys_stopgui();
                 }
             }
             else
             {
-                x->sr_inhead += ret;
-                if (x->sr_inhead >= INBUFSIZE) x->sr_inhead = 0;
-                while (socketreceiver_doread(x))
+                if (x->sr_notifier)
+                    (*x->sr_notifier)(x->sr_owner, fd);
+                sys_rmpollfn(fd);
+                sys_closesocket(fd);
+            }
+        }
+        else
+        {
+            x->sr_inhead += ret;
+            while (socketreceiver_doread(x))
+            {
+                if (x->sr_fromaddrfn)
                 {
-                    if (x->sr_fromaddrfn)
+                        /* the peer is the same for every message here */
+                    if (gotpeer < 0)
                     {
-                        socklen_t fromaddrlen = sizeof(struct sockaddr_storage);
-                        if(!getpeername(fd,
-                                        (struct sockaddr *)x->sr_fromaddr,
-                                        &fromaddrlen))
-                            (*x->sr_fromaddrfn)(x->sr_owner,
-                                (const void *)x->sr_fromaddr);
+                        socklen_t fromaddrlen =
+                            sizeof(struct sockaddr_storage);
+                        if ((gotpeer = !getpeername(fd,
+                            (struct sockaddr *)x->sr_fromaddr, &fromaddrlen)))
+                                sockaddr_end_unixpath(x->sr_fromaddr,
+                                    fromaddrlen);
                     }
-                    outlet_setstacklim();
-                    if (x->sr_socketreceivefn)
-                        (*x->sr_socketreceivefn)(x->sr_owner,
-                            INTER->i_inbinbuf);
-                    else binbuf_eval(INTER->i_inbinbuf, 0, 0, 0);
-                    if (x->sr_inhead == x->sr_intail)
-                        break;
+                    if (gotpeer)
+                        (*x->sr_fromaddrfn)(x->sr_owner,
+                            (const void *)x->sr_fromaddr);
                 }
+                outlet_setstacklim();
+                if (sys_inputrecording)
+                    sys_recordmessage(x->sr_owner, INTER->i_inbinbuf);
+                if (x->sr_socketreceivefn)
+                    (*x->sr_socketreceivefn)(x->sr_owner,
+                        INTER->i_inbinbuf);
+                else binbuf_eval(INTER->i_inbinbuf, 0, 0, 0);
+                if (x->sr_inhead == x->sr_intail)
+                    break;
             }
         }
     }
@@ -689,8 +1409,231 @@ void socketreceiver_set_fromaddrfn(t_socketreceiver *x,
     }
 }
 
+/* In "-iothread" mode the scheduler never writes to the GUI socket or to
+TCP connections itself.  Whoever holds the Pd lock hands buffers, through a
+lock-free ring with one writer and one reader, to an I/O thread which does
+the send() calls, waiting for the socket whenever it's full.  Sockets with
+output still in the ring are closed by the I/O thread once it's written,
+so that their numbers can't be reused in the meantime.  If a write fails
+the I/O thread shuts the socket down, and the failure shows up as end of
+file for whoever reads it.  The same thread also does other slow output
+for the scheduler, such as writing the log file (see s_print.c). */
+
+#if PDTHREADS
+
+#define IOQ_SIZE 1024   /* buffers in flight; a power of two */
+
+typedef struct _iochunk
+{
+    t_iofn c_fn;        /* function to call instead of writing to c_fd */
+    int c_fd;
+    int c_close;        /* close the fd after writing */
+    char *c_buf;        /* malloc()ed buffer to write and free, or NULL */
+    int c_onset;
+    int c_size;
+} t_iochunk;
+
+static t_iochunk sys_ioq[IOQ_SIZE];
+static volatile unsigned int sys_ioqhead, sys_ioqtail;
+static volatile int sys_iosleeping;     /* I/O thread waits for work */
+static volatile int sys_iowaiting;      /* scheduler waits for room */
+static int sys_iorunning;
+static pthread_t sys_iothreadid;
+static pthread_mutex_t sys_iomutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sys_iocond = PTHREAD_COND_INITIALIZER;
+
+static void sys_iowrite(t_iochunk *c)
+{
+    char *bp = c->c_buf + c->c_onset;
+    int left = c->c_size;
+    while (left > 0)
+    {
+        int res = (int)send(c->c_fd, bp, left, 0), err;
+        if (res >= 0)
+        {
+            bp += res;
+            left -= res;
+            continue;
+        }
+        err = socket_errno();
+#ifdef _WIN32
+        if (err == WSAEWOULDBLOCK)
+#else
+        if (err == EINTR)
+            continue;
+        if (err == EAGAIN || err == EWOULDBLOCK)
+#endif
+        {
+                /* a non-blocking socket that's full: wait for it */
+            fd_set writeset;
+            FD_ZERO(&writeset);
+            FD_SET(c->c_fd, &writeset);
+            select(c->c_fd + 1, 0, &writeset, 0, 0);
+            continue;
+        }
+        shutdown(c->c_fd, 2);
+        break;
+    }
+}
+
+static void *sys_iothread_main(void *dummy)
+{
+    while (1)
+    {
+        unsigned int tail = sys_ioqtail;
+        t_iochunk *c;
+        SYS_BARRIER();
+        if (tail == sys_ioqhead)
+        {
+            pthread_mutex_lock(&sys_iomutex);
+            sys_iosleeping = 1;
+            SYS_BARRIER();
+            while (sys_ioqtail == sys_ioqhead)
+                pthread_cond_wait(&sys_iocond, &sys_iomutex);
+            sys_iosleeping = 0;
+            pthread_mutex_unlock(&sys_iomutex);
+            continue;
+        }
+        c = &sys_ioq[tail & (IOQ_SIZE-1)];
+        if (c->c_buf)
+        {
+            if (c->c_fn)
+                (*c->c_fn)(c->c_buf + c->c_onset, c->c_size);
+            else sys_iowrite(c);
+            free(c->c_buf);
+        }
+        if (c->c_close)
+            socket_close(c->c_fd);
+        SYS_BARRIER();
+        sys_ioqtail = tail + 1;
+        SYS_BARRIER();
+        if (sys_iowaiting)
+        {
+            pthread_mutex_lock(&sys_iomutex);
+            pthread_cond_broadcast(&sys_iocond);
+            pthread_mutex_unlock(&sys_iomutex);
+        }
+    }
+    return (0);
+}
+
+    /* wait until there are no more than "n" buffers in the ring */
+static void sys_iowait(unsigned int n)
+{
+    SYS_BARRIER();
+    if (sys_ioqhead - sys_ioqtail <= n)
+        return;
+    pthread_mutex_lock(&sys_iomutex);
+    sys_iowaiting = 1;
+    SYS_BARRIER();
+    while (sys_ioqhead - sys_ioqtail > n)
+        pthread_cond_wait(&sys_iocond, &sys_iomutex);
+    sys_iowaiting = 0;
+    pthread_mutex_unlock(&sys_iomutex);
+}
+
+    /* hand a buffer to the I/O thread, which will free it.  Returns 0 if
+    the ring is full and "wait" is zero, in which case the buffer still
+    belongs to the caller.  Call with the Pd lock set. */
+static int sys_iopush(t_iofn fn, int fd, char *buf, int onset, int size,
+    int close, int wait)
+{
+    unsigned int head = sys_ioqhead;
+    t_iochunk *c;
+    if (!sys_iorunning)
+    {
+        if (pthread_create(&sys_iothreadid, 0, sys_iothread_main, 0))
+        {
+            fprintf(stderr, "Pd: couldn't start I/O thread\n");
+            sys_iothread = 0;
+            return (0);
+        }
+        sys_iorunning = 1;
+    }
+    SYS_BARRIER();
+    if (head - sys_ioqtail >= IOQ_SIZE)
+    {
+        if (!wait)
+            return (0);
+        sys_iowait(IOQ_SIZE - 1);
+    }
+    c = &sys_ioq[head & (IOQ_SIZE-1)];
+    c->c_fn = fn;
+    c->c_fd = fd;
+    c->c_close = close;
+    c->c_buf = buf;
+    c->c_onset = onset;
+    c->c_size = size;
+    SYS_BARRIER();
+    sys_ioqhead = head + 1;
+    SYS_BARRIER();
+    if (sys_iosleeping)
+    {
+        pthread_mutex_lock(&sys_iomutex);
+        pthread_cond_signal(&sys_iocond);
+        pthread_mutex_unlock(&sys_iomutex);
+    }
+    return (1);
+}
+
+    /* queue a copy of "buf" to be written to a TCP socket.  Returns -1,
+    and does nothing, if we're not in "-iothread" mode. */
+int sys_iosend(int fd, const char *buf, int length)
+{
+    char *copy;
+    if (!sys_iothread)
+        return (-1);
+    if (!(copy = malloc(length)))
+        return (-1);
+    memcpy(copy, buf, length);
+    if (!sys_iopush(0, fd, copy, 0, length, 0, 1))
+    {
+        free(copy);
+        return (-1);
+    }
+    return (0);
+}
+
+    /* have the I/O thread call "fn" on a copy of "buf", whether or not
+    we're in "-iothread" mode.  Returns -1, doing nothing, if the ring is
+    full or there's no thread to be had. */
+int sys_iodefer(t_iofn fn, const char *buf, int length)
+{
+    char *copy;
+    if (!(copy = malloc(length)))
+        return (-1);
+    memcpy(copy, buf, length);
+    if (!sys_iopush(fn, -1, copy, 0, length, 0, 0))
+    {
+        free(copy);
+        return (-1);
+    }
+    return (0);
+}
+
+#else /* PDTHREADS */
+
+int sys_iosend(int fd, const char *buf, int length)
+{
+    return (-1);
+}
+
+int sys_iodefer(t_iofn fn, const char *buf, int length)
+{
+    return (-1);
+}
+
+#endif /* PDTHREADS */
+
 void sys_closesocket(int sockfd)
 {
+#if PDTHREADS
+        /* if there's output still waiting, let the I/O thread close it */
+    SYS_BARRIER();
+    if (sys_iorunning && sys_ioqhead != sys_ioqtail &&
+        sys_iopush(0, sockfd, 0, 0, 0, 1, 1))
+            return;
+#endif
     socket_close(sockfd);
 }
 
@@ -763,6 +1706,12 @@ static void sys_trytogetmoreguibuf(int newsize)
     }
 }
 
+    /* memory taken by the buffer to the GUI, for "pd memory-subsystems" */
+size_t sys_guibytes(void)
+{
+    return (INTER->i_guibuf ? INTER->i_guisize : 0);
+}
+
 int sys_havegui(void)
 {
     return (INTER->i_havegui);
@@ -846,6 +1795,18 @@ static int sys_flushtogui(void)
 {
     int writesize = INTER->i_guihead - INTER->i_guitail,
         nwrote = 0;
+#if PDTHREADS
+        /* give the whole buffer to the I/O thread and start a new one */
+    if (sys_iothread && writesize > 0)
+    {
+        if (!sys_iopush(0, INTER->i_guisock, INTER->i_guibuf,
+            INTER->i_guitail, writesize, 0, 0))
+                return (0);
+        INTER->i_guibuf = 0;
+        INTER->i_guisize = INTER->i_guihead = INTER->i_guitail = 0;
+        return (1);
+    }
+#endif
     if (writesize > 0)
         nwrote = (int)send(
             INTER->i_guisock,
@@ -886,6 +1847,31 @@ void glob_ping(t_pd *dummy)
     INTER->i_waitingforping = 0;
 }
 
+    /* maximum rate at which queued GUI updates are sent out, in frames
+    per second (0 for no limit).  Updates asked for again before their
+    frame comes around are only sent once. */
+static t_float sys_guiframerate = 60;
+
+void glob_guiframerate(t_pd *dummy, t_floatarg f)
+{
+    sys_guiframerate = (f > 0 ? f : 0);
+}
+
+    /* take an update out of the queue and the hash table */
+static void sys_guiqueue_unlink(t_guiqueue *gq)
+{
+    t_guiqueue **hp = &INTER->i_guiqueuehash[GUIQUEUE_HASHFN(gq->gq_client)];
+    while (*hp != gq)
+        hp = &(*hp)->gq_hashnext;
+    *hp = gq->gq_hashnext;
+    if (gq->gq_prev)
+        gq->gq_prev->gq_next = gq->gq_next;
+    else INTER->i_guiqueuehead = gq->gq_next;
+    if (gq->gq_next)
+        gq->gq_next->gq_prev = gq->gq_prev;
+    else INTER->i_guiqueuetail = gq->gq_prev;
+}
+
 static int sys_flushqueue(void)
 {
     int wherestop = INTER->i_bytessincelastping + GUI_UPDATESLICE;
@@ -894,7 +1880,23 @@ static int sys_flushqueue(void)
     if (INTER->i_waitingforping)
         return (0);
     if (!INTER->i_guiqueuehead)
+    {
+        INTER->i_guiinframe = 0;
         return (0);
+    }
+        /* wait for the next frame; once started, keep going in slices
+        until everything that was queued when it started has gone out.
+        Updates asked for since then wait for the frame after. */
+    if (!INTER->i_guiinframe)
+    {
+        double now = sys_getrealtime();
+        if (sys_guiframerate > 0 && now < INTER->i_guinextframe)
+            return (0);
+        INTER->i_guiinframe = 1;
+        INTER->i_guiframeend = INTER->i_guiseq;
+        INTER->i_guinextframe = now +
+            (sys_guiframerate > 0 ? 1. / sys_guiframerate : 0);
+    }
     while (1)
     {
         if (INTER->i_bytessincelastping >= GUI_BYTESPERPING)
@@ -904,16 +1906,21 @@ static int sys_flushqueue(void)
             INTER->i_waitingforping = 1;
             return (1);
         }
-        if (INTER->i_guiqueuehead)
+        if (INTER->i_guiqueuehead && (int)(INTER->i_guiqueuehead->gq_seq -
+            INTER->i_guiframeend) < 0)
         {
             t_guiqueue *headwas = INTER->i_guiqueuehead;
-            INTER->i_guiqueuehead = headwas->gq_next;
+            sys_guiqueue_unlink(headwas);
             (*headwas->gq_fn)(headwas->gq_client, headwas->gq_glist);
             t_freebytes(headwas, sizeof(*headwas));
             if (INTER->i_bytessincelastping >= wherestop)
                 break;
         }
-        else break;
+        else
+        {
+            INTER->i_guiinframe = 0;
+            break;
+        }
     }
     sys_flushtogui();
     return (1);
@@ -944,48 +1951,44 @@ void sys_pretendguibytes(int n)
     INTER->i_bytessincelastping += n;
 }
 
+static t_guiqueue *sys_guiqueue_find(void *client)
+{
+    t_guiqueue *gq;
+    for (gq = INTER->i_guiqueuehash[GUIQUEUE_HASHFN(client)]; gq;
+        gq = gq->gq_hashnext)
+            if (gq->gq_client == client)
+                return (gq);
+    return (0);
+}
+
 void sys_queuegui(void *client, t_glist *glist, t_guicallbackfn f)
 {
-    t_guiqueue **gqnextptr, *gq;
-    if (!INTER->i_guiqueuehead)
-        gqnextptr = &INTER->i_guiqueuehead;
-    else
-    {
-        for (gq = INTER->i_guiqueuehead; gq->gq_next;
-            gq = gq->gq_next)
-                if (gq->gq_client == client)
-                    return;
-        if (gq->gq_client == client)
-            return;
-        gqnextptr = &gq->gq_next;
-    }
+    t_guiqueue *gq, **hp;
+    if (sys_guiqueue_find(client))
+        return;
     gq = t_getbytes(sizeof(*gq));
-    gq->gq_next = 0;
     gq->gq_client = client;
     gq->gq_glist = glist;
     gq->gq_fn = f;
+    gq->gq_seq = INTER->i_guiseq++;
     gq->gq_next = 0;
-    *gqnextptr = gq;
+    if ((gq->gq_prev = INTER->i_guiqueuetail))
+        INTER->i_guiqueuetail->gq_next = gq;
+    else INTER->i_guiqueuehead = gq;
+    INTER->i_guiqueuetail = gq;
+    hp = &INTER->i_guiqueuehash[GUIQUEUE_HASHFN(client)];
+    gq->gq_hashnext = *hp;
+    *hp = gq;
 }
 
 void sys_unqueuegui(void *client)
 {
-    t_guiqueue *gq, *gq2;
-    while (INTER->i_guiqueuehead && INTER->i_guiqueuehead->gq_client == client)
+    t_guiqueue *gq = sys_guiqueue_find(client);
+    if (gq)
     {
-        gq = INTER->i_guiqueuehead;
-        INTER->i_guiqueuehead = INTER->i_guiqueuehead->gq_next;
+        sys_guiqueue_unlink(gq);
         t_freebytes(gq, sizeof(*gq));
     }
-    if (!INTER->i_guiqueuehead)
-        return;
-    for (gq = INTER->i_guiqueuehead; (gq2 = gq->gq_next); gq = gq2)
-        if (gq2->gq_client == client)
-        {
-            gq->gq_next = gq2->gq_next;
-            t_freebytes(gq2, sizeof(*gq2));
-            break;
-        }
 }
 
     /* poll for any incoming packets, or for GUI updates to send.  call with
@@ -994,7 +1997,8 @@ int sys_pollgui(void)
 {
     static double lasttime = 0;
     double now = 0;
-    int didsomething = sys_domicrosleep(0);
+    int didsomething = (sys_fdqueueing && INTER->i_pollfd >= 0 ?
+        sys_fdqueuerun() : sys_domicrosleep(0, 0));
     if (!didsomething || (now = sys_getrealtime()) > lasttime + 0.5)
     {
         didsomething |= sys_poll_togui();
@@ -1012,6 +2016,11 @@ void sys_init_fdpoll(void)
     INTER->i_fdpoll = (t_fdpoll *)t_getbytes(0);
     INTER->i_nfdpoll = 0;
     INTER->i_inbinbuf = binbuf_new();
+#if defined(POLL_EPOLL)
+    INTER->i_pollfd = epoll_create1(EPOLL_CLOEXEC);
+#elif defined(POLL_KQUEUE)
+    INTER->i_pollfd = kqueue();
+#endif
 }
 
 /* --------------------- starting up the GUI connection ------------- */
@@ -1097,7 +2106,8 @@ static int sys_do_startgui(const char *libdir)
 
     sys_init_fdpoll();
 
-    if (sys_guisetportnumber)  /* GUI exists and sent us a port number */
+        /* GUI exists and sent us a port number or socket path */
+    if (sys_guisetportnumber || sys_guisetsocketpath)
     {
         int status;
 #ifdef __APPLE__
@@ -1116,43 +2126,65 @@ static int sys_do_startgui(const char *libdir)
             close(burnfd3);
 #endif
 
-        /* get addrinfo list using hostname & port */
-        status = addrinfo_get_list(&ailist,
-            LOCALHOST, sys_guisetportnumber, SOCK_STREAM);
-        if (status != 0)
+            /* a GUI on the same machine can save the TCP stack and listen
+            on a Unix-domain socket instead */
+        if (sys_guisetsocketpath)
         {
-            fprintf(stderr,
-                "localhost not found (inet protocol not installed?)\n%s (%d)",
-                gai_strerror(status), status);
-            return (1);
+            struct sockaddr_storage ss;
+            int len = sockaddr_set_unixpath(&ss, sys_guisetsocketpath);
+            if (len < 0)
+            {
+                fprintf(stderr, "%s: bad or unsupported GUI socket path\n",
+                    sys_guisetsocketpath);
+                return (1);
+            }
+            if ((sockfd = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0 &&
+                socket_connect(sockfd, (struct sockaddr *)&ss, len, 10.f) < 0)
+            {
+                sys_closesocket(sockfd);
+                sockfd = -1;
+            }
         }
+        else
+        {
+            /* get addrinfo list using hostname & port */
+            status = addrinfo_get_list(&ailist,
+                LOCALHOST, sys_guisetportnumber, SOCK_STREAM);
+            if (status != 0)
+            {
+                fprintf(stderr,
+                    "localhost not found (inet protocol not installed?)\n%s (%d)",
+                    gai_strerror(status), status);
+                return (1);
+            }
 
-        /* Sort to IPv4 for now as the Pd gui uses IPv4. */
-        addrinfo_sort_list(&ailist, addrinfo_ipv4_first);
+            /* Sort to IPv4 for now as the Pd gui uses IPv4. */
+            addrinfo_sort_list(&ailist, addrinfo_ipv4_first);
 
-        /* We don't know in advance whether the GUI uses IPv4 or IPv6,
-           so we try both and pick the one which works. */
-        for (ai = ailist; ai != NULL; ai = ai->ai_next)
-        {
-            /* create a socket */
-            sockfd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
-            if (sockfd < 0)
-                continue;
-        #if 1
-            if (socket_set_boolopt(sockfd, IPPROTO_TCP, TCP_NODELAY, 1) < 0)
-                fprintf(stderr, "setsockopt (TCP_NODELAY) failed");
-        #endif
-            /* try to connect */
-            if (socket_connect(sockfd, ai->ai_addr, ai->ai_addrlen, 10.f) < 0)
+            /* We don't know in advance whether the GUI uses IPv4 or IPv6,
+               so we try both and pick the one which works. */
+            for (ai = ailist; ai != NULL; ai = ai->ai_next)
             {
-                sys_closesocket(sockfd);
-                sockfd = -1;
-                continue;
+                /* create a socket */
+                sockfd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+                if (sockfd < 0)
+                    continue;
+            #if 1
+                if (socket_set_boolopt(sockfd, IPPROTO_TCP, TCP_NODELAY, 1) < 0)
+                    fprintf(stderr, "setsockopt (TCP_NODELAY) failed");
+            #endif
+                /* try to connect */
+                if (socket_connect(sockfd, ai->ai_addr, ai->ai_addrlen, 10.f) < 0)
+                {
+                    sys_closesocket(sockfd);
+                    sockfd = -1;
+                    continue;
+                }
+                /* this addr worked */
+                break;
             }
-            /* this addr worked */
-            break;
+            freeaddrinfo(ailist);
         }
-        freeaddrinfo(ailist);
 
         /* confirm that we could connect */
         if (sockfd < 0)
@@ -1555,6 +2587,9 @@ void glob_exit(void *dummy, t_float status)
 {
         /* sys_exit() sets the sys_quit flag, so all loops end */
     sys_exit();
+        /* ... but when rendering offline that only ends the current job */
+    if (sched_rendering)
+        return;
     sys_close_audio();
     sys_close_midi();
     if (sys_havegui())
@@ -1562,6 +2597,11 @@ void glob_exit(void *dummy, t_float status)
         sys_closesocket(INTER->i_guisock);
         sys_rmpollfn(INTER->i_guisock);
     }
+#if PDTHREADS
+        /* let the I/O thread finish writing whatever it still has */
+    if (sys_iorunning)
+        sys_iowait(0);
+#endif
     exit((int)status);
 }
 void glob_quit(void *dummy)
@@ -1624,11 +2664,36 @@ void sys_stopgui(void)
 
 /* ----------- mutexes for thread safety --------------- */
 
+#if PDTHREADS
+    /* a real-time thread waiting for a mutex should lend its priority to the
+    thread holding it, where the system can do that */
+static void sys_initmutex(pthread_mutex_t *m)
+{
+#if defined(_POSIX_THREAD_PRIO_INHERIT) && _POSIX_THREAD_PRIO_INHERIT > 0
+    pthread_mutexattr_t attr;
+    if (!pthread_mutexattr_init(&attr))
+    {
+        int ok = (!pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT)
+            && !pthread_mutex_init(m, &attr));
+        pthread_mutexattr_destroy(&attr);
+        if (ok)
+            return;
+    }
+#endif
+    pthread_mutex_init(m, NULL);
+}
+
+static void sys_initglobalmutex(void);
+#endif /* PDTHREADS */
+
 void s_inter_newpdinstance(void)
 {
     INTER = getbytes(sizeof(*INTER));
+    INTER->i_pollfd = -1;
 #if PDTHREADS
-    pthread_mutex_init(&INTER->i_mutex, NULL);
+    sys_initglobalmutex();
+    sys_initmutex(&INTER->i_mutex);
+    memset(&INTER->i_lockstats, 0, sizeof(INTER->i_lockstats));
     pd_this->pd_islocked = 0;
 #endif
 #ifdef _WIN32
@@ -1647,6 +2712,20 @@ void s_inter_free(t_instanceinter *inter)
         inter->i_fdpoll = 0;
         inter->i_nfdpoll = 0;
     }
+    if (inter->i_fdwritepoll)
+    {
+        t_freebytes(inter->i_fdwritepoll,
+            inter->i_nfdwritepoll * sizeof(t_fdpoll));
+        inter->i_fdwritepoll = 0;
+        inter->i_nfdwritepoll = 0;
+    }
+    if (inter->i_batchbuf)
+        freebytes(inter->i_batchbuf, RECVBATCH *
+            (NET_MAXPACKETSIZE + sizeof(struct sockaddr_storage)));
+#if defined(POLL_EPOLL) || defined(POLL_KQUEUE)
+    if (inter->i_pollfd >= 0)
+        close(inter->i_pollfd);
+#endif
     freebytes(inter, sizeof(*inter));
 }
 
@@ -1657,10 +2736,28 @@ void s_inter_freepdinstance(void)
 
 #if PDTHREADS
 #ifdef PDINSTANCE
-static pthread_rwlock_t sys_rwlock = PTHREAD_RWLOCK_INITIALIZER;
+#include <sched.h>
+    /* the instance holding the global lock (see below), which others wait
+    for by locking sys_writemutex */
+static t_pdinstance *volatile sys_writer;
+static int sys_writedepth;
+static pthread_mutex_t sys_writemutex = PTHREAD_MUTEX_INITIALIZER;
 #else /* PDINSTANCE */
 static pthread_mutex_t sys_mutex = PTHREAD_MUTEX_INITIALIZER;
 #endif /* PDINSTANCE */
+
+static void sys_initglobalmutex(void)
+{
+    static int initted;
+    if (initted)
+        return;
+    initted = 1;
+#ifdef PDINSTANCE
+    sys_initmutex(&sys_writemutex);
+#else
+    sys_initmutex(&sys_mutex);
+#endif
+}
 #endif /* PDTHREADS */
 
 #if PDTHREADS
@@ -1671,48 +2768,164 @@ methods to them, or creating or freeing Pd instances.  They should probably
 not be called from outside Pd.  They should be called at a point where the
 current instance of Pd is currently locked via sys_lock() below; this gains
 read access to the class and instance lists which must be released for the
-write-lock to be available. */
+write-lock to be available.
+
+With more than one instance this is a "big reader" lock: each instance
+holds read access by setting its own pd_islocked flag, so that instances
+running in parallel never write to memory they share.  The writer sets
+sys_writer, which makes new readers wait, and then waits for the other
+instances' flags to clear.  Calls may be nested, and sys_unlock() releases
+the write lock too if it's still held. */
+
+#ifdef PDINSTANCE
+static void sys_readlock(void)
+{
+    while (1)
+    {
+        pd_this->pd_islocked = 1;
+        SYS_BARRIER();
+        if (!sys_writer)
+            return;
+        pd_this->pd_islocked = 0;
+        SYS_BARRIER();
+        pthread_mutex_lock(&sys_writemutex);
+        pthread_mutex_unlock(&sys_writemutex);
+    }
+}
+
+static void sys_writeunlock(void)
+{
+    sys_writedepth = 0;
+    sys_writer = 0;
+    SYS_BARRIER();
+    pthread_mutex_unlock(&sys_writemutex);
+}
+#endif /* PDINSTANCE */
 
 void pd_globallock(void)
 {
 #ifdef PDINSTANCE
+    int i;
+    if (sys_writer == pd_this)
+    {
+        sys_writedepth++;
+        return;
+    }
     if (!pd_this->pd_islocked)
         bug("pd_globallock");
-    pthread_rwlock_unlock(&sys_rwlock);
-    pthread_rwlock_wrlock(&sys_rwlock);
+    pd_this->pd_islocked = 0;
+    SYS_BARRIER();
+    pthread_mutex_lock(&sys_writemutex);
+    sys_writer = pd_this;
+    SYS_BARRIER();
+    for (i = 0; i < pd_ninstances; i++)
+        while (*(volatile int *)&pd_instances[i]->pd_islocked)
+            sched_yield();
 #endif /* PDINSTANCE */
 }
 
 void pd_globalunlock(void)
 {
 #ifdef PDINSTANCE
-    pthread_rwlock_unlock(&sys_rwlock);
-    pthread_rwlock_rdlock(&sys_rwlock);
+    if (sys_writer != pd_this)
+        bug("pd_globalunlock");
+    else if (sys_writedepth)
+        sys_writedepth--;
+    else
+    {
+        sys_writeunlock();
+        sys_readlock();
+    }
 #endif /* PDINSTANCE */
 }
 
+/* Each instance's lock counts how often it's taken, how often that meant
+waiting, and how long it's held.  With a budget ("-lockbudget <msec>" or
+"pd lock-budget <msec>"), holding it longer gets a warning -- posted later
+from the scheduler, since the thread that held it might not be able to.
+PROFILE_NOW() counts are converted to time once they've been compared
+with the real-time clock for a while. */
+
+static double lock_budget;              /* msec, or zero for none */
+static unsigned long long lock_budgetcounts;
+static unsigned long long lock_calcounts;
+static double lock_caltime, lock_countspersec;
+
+    /* compare the counter with the real-time clock (again) */
+static void lock_calibrate(void)
+{
+    unsigned long long counts = PROFILE_NOW();
+    double now = sys_getrealtime();
+    if (!lock_calcounts)
+        lock_calcounts = counts, lock_caltime = now;
+    else if (now > lock_caltime + 0.5)
+        lock_countspersec = (counts - lock_calcounts) / (now - lock_caltime);
+    lock_budgetcounts = (unsigned long long)
+        (lock_budget * 0.001 * lock_countspersec);
+}
+
+static double lock_msec(unsigned long long counts)
+{
+    return (lock_countspersec > 0 ? 1000. * counts / lock_countspersec : 0);
+}
+
+static void lock_take(pthread_mutex_t *m, t_lockstats *x)
+{
+    if (pthread_mutex_trylock(m))
+    {
+        unsigned long long start = PROFILE_NOW();
+        pthread_mutex_lock(m);
+        x->l_ncontended++;
+        x->l_waited += PROFILE_NOW() - start;
+    }
+    x->l_nlocks++;
+    x->l_lockedat = PROFILE_NOW();
+}
+
+static void lock_release(pthread_mutex_t *m, t_lockstats *x)
+{
+    unsigned long long held = PROFILE_NOW() - x->l_lockedat;
+    x->l_held += held;
+    if (held > x->l_maxheld)
+        x->l_maxheld = held;
+    if (lock_budgetcounts && held > lock_budgetcounts)
+    {
+        x->l_nover++;
+        x->l_overwarn++;
+        if (held > x->l_overmax)
+            x->l_overmax = held;
+    }
+    pthread_mutex_unlock(m);
+}
+
 /* routines to lock/unlock a Pd instance for thread safety.  Call pd_setinsance
 first.  The "pd_this"  variable can be written and read thread-safely as it
 is defined as per-thread storage. */
 void sys_lock(void)
 {
+    if (ugen_rtregion)
+        ugen_rtviolation(RT_LOCK);
 #ifdef PDINSTANCE
-    pthread_mutex_lock(&INTER->i_mutex);
-    pthread_rwlock_rdlock(&sys_rwlock);
-    pd_this->pd_islocked = 1;
+    lock_take(&INTER->i_mutex, &INTER->i_lockstats);
+    sys_readlock();
 #else
-    pthread_mutex_lock(&sys_mutex);
+    lock_take(&sys_mutex, &INTER->i_lockstats);
 #endif
 }
 
 void sys_unlock(void)
 {
 #ifdef PDINSTANCE
-    pd_this->pd_islocked = 0;
-    pthread_rwlock_unlock(&sys_rwlock);
-    pthread_mutex_unlock(&INTER->i_mutex);
+    if (sys_writer == pd_this)
+        sys_writeunlock();
+    else
+    {
+        pd_this->pd_islocked = 0;
+        SYS_BARRIER();
+    }
+    lock_release(&INTER->i_mutex, &INTER->i_lockstats);
 #else
-    pthread_mutex_unlock(&sys_mutex);
+    lock_release(&sys_mutex, &INTER->i_lockstats);
 #endif
 }
 
@@ -1722,17 +2935,93 @@ int sys_trylock(void)
     int ret;
     if (!(ret = pthread_mutex_trylock(&INTER->i_mutex)))
     {
-        if (!(ret = pthread_rwlock_tryrdlock(&sys_rwlock)))
-            return (0);
-        else
+        pd_this->pd_islocked = 1;
+        SYS_BARRIER();
+        if (!sys_writer)
         {
-            pthread_mutex_unlock(&INTER->i_mutex);
-            return (ret);
+            INTER->i_lockstats.l_nlocks++;
+            INTER->i_lockstats.l_lockedat = PROFILE_NOW();
+            return (0);
         }
+        pd_this->pd_islocked = 0;
+        SYS_BARRIER();
+        pthread_mutex_unlock(&INTER->i_mutex);
+        return (EBUSY);
     }
     else return (ret);
 #else
-    return pthread_mutex_trylock(&sys_mutex);
+    int ret = pthread_mutex_trylock(&sys_mutex);
+    if (!ret)
+    {
+        INTER->i_lockstats.l_nlocks++;
+        INTER->i_lockstats.l_lockedat = PROFILE_NOW();
+    }
+    return (ret);
+#endif
+}
+
+    /* warn about holding the lock too long, at most once a second.  Called
+    from the scheduler with the lock held. */
+void sys_lockreport(void)
+{
+    static double lastwarning;
+    t_lockstats *x = &INTER->i_lockstats;
+    double now;
+    if (!lock_budget)
+        return;
+    if (!lock_countspersec || !x->l_overwarn)
+    {
+        lock_calibrate();
+        return;
+    }
+    if ((now = sys_getrealtime()) < lastwarning + 1)
+        return;
+    lastwarning = now;
+    if (x->l_overwarn > 1)
+        post("warning: Pd's lock was held for up to %.2f msec, %d times "
+            "(budget %g msec)", lock_msec(x->l_overmax), x->l_overwarn,
+                lock_budget);
+    else post("warning: Pd's lock was held for %.2f msec (budget %g msec)",
+        lock_msec(x->l_overmax), lock_budget);
+    x->l_overwarn = 0;
+    x->l_overmax = 0;
+    lock_calibrate();
+}
+
+void sys_setlockbudget(double msec)
+{
+    lock_budget = (msec > 0 ? msec : 0);
+    lock_calibrate();
+}
+
+    /* "pd lock-budget <msec>" */
+void glob_lockbudget(void *dummy, t_floatarg f)
+{
+    sys_setlockbudget(f);
+}
+
+    /* "pd lock-stats" */
+void glob_lockstats(void *dummy)
+{
+    t_lockstats *x = &INTER->i_lockstats;
+    lock_calibrate();
+    if (!lock_countspersec)
+    {
+        post("lock-stats: still timing the clock; try again in a second");
+        return;
+    }
+    post("lock: taken %llu times, %llu (%.2f%%) after waiting",
+        x->l_nlocks, x->l_ncontended,
+            (x->l_nlocks ? 100. * x->l_ncontended / x->l_nlocks : 0));
+    post("waited %.3f msec in all; held %.3f msec on average, %.3f at most",
+        lock_msec(x->l_waited),
+            (x->l_nlocks ? lock_msec(x->l_held) / x->l_nlocks : 0),
+                lock_msec(x->l_maxheld));
+    if (lock_budget)
+        post("held longer than the budget (%g msec) %llu times",
+            lock_budget, x->l_nover);
+#if defined(_POSIX_THREAD_PRIO_INHERIT) && _POSIX_THREAD_PRIO_INHERIT > 0
+    post("(priority inheritance is on)");
 #endif
 }
 
@@ -1757,5 +3046,12 @@ void sys_unlock(void) {}
 #endif
 void pd_globallock(void) {}
 void pd_globalunlock(void) {}
+void sys_lockreport(void) {}
+void sys_setlockbudget(double msec) {}
+void glob_lockbudget(void *dummy, t_floatarg f) {}
+void glob_lockstats(void *dummy)
+{
+    post("lock-stats: Pd was compiled without threads");
+}
 
 #endif /* PDTHREADS */
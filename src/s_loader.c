@@ -111,6 +111,48 @@ void sys_putonloadlist(const char *classname)
 
 void class_set_extern_dir(t_symbol *s);
 
+    /* look in "path" for the binary of the library "objectname" whose last
+    component is "classname".  Return an open file or -1. */
+static int sys_do_find_lib(const char *objectname, const char *classname,
+    const char *path, char *dirbuf, char **nameptr)
+{
+    char filename[MAXPDSTRING];
+    const char**dllextent;
+    int fd;
+        /* try looking in the path for (objectname).(sys_dllextent) ... */
+    for(dllextent=sys_dllextent; *dllextent; dllextent++)
+    {
+        if ((fd = sys_trytoopenone(path, objectname, *dllextent,
+            dirbuf, nameptr, MAXPDSTRING, 1)) >= 0)
+                return (fd);
+    }
+        /* next try (objectname)/(classname).(sys_dllextent) ... */
+    strncpy(filename, objectname, MAXPDSTRING);
+    filename[MAXPDSTRING-2] = 0;
+    strcat(filename, "/");
+    strncat(filename, classname, MAXPDSTRING-strlen(filename));
+    filename[MAXPDSTRING-1] = 0;
+    for(dllextent=sys_dllextent; *dllextent; dllextent++)
+    {
+        if ((fd = sys_trytoopenone(path, filename, *dllextent,
+            dirbuf, nameptr, MAXPDSTRING, 1)) >= 0)
+                return (fd);
+    }
+#ifdef ANDROID
+    /* Android libs have a 'lib' prefix, '.so' suffix and don't allow ~ */
+    char libname[MAXPDSTRING] = "lib";
+    strncat(libname, objectname, MAXPDSTRING - 4);
+    int len = strlen(libname);
+    if (libname[len-1] == '~' && len < MAXPDSTRING - 6) {
+        strcpy(libname+len-1, "_tilde");
+    }
+    if ((fd = sys_trytoopenone(path, libname, ".so",
+        dirbuf, nameptr, MAXPDSTRING, 1)) >= 0)
+            return (fd);
+#endif
+    return (-1);
+}
+
 static int sys_do_load_abs(t_canvas *canvas, const char *objectname,
     const char *path);
 static int sys_do_load_lib(t_canvas *canvas, const char *objectname,
@@ -118,7 +160,6 @@ static int sys_do_load_lib(t_canvas *canvas, const char *objectname,
 {
     char symname[MAXPDSTRING], filename[MAXPDSTRING], dirbuf[MAXPDSTRING],
         *nameptr;
-    const char**dllextent;
     const char *classname, *cnameptr;
     void *dlobj;
     t_xxx makeout = NULL;
@@ -167,39 +208,9 @@ static int sys_do_load_lib(t_canvas *canvas, const char *objectname,
 #if 0
     fprintf(stderr, "lib: %s\n", classname);
 #endif
-        /* try looking in the path for (objectname).(sys_dllextent) ... */
-    for(dllextent=sys_dllextent; *dllextent; dllextent++)
-    {
-        if ((fd = sys_trytoopenone(path, objectname, *dllextent,
-            dirbuf, &nameptr, MAXPDSTRING, 1)) >= 0)
-                goto gotone;
-    }
-        /* next try (objectname)/(classname).(sys_dllextent) ... */
-    strncpy(filename, objectname, MAXPDSTRING);
-    filename[MAXPDSTRING-2] = 0;
-    strcat(filename, "/");
-    strncat(filename, classname, MAXPDSTRING-strlen(filename));
-    filename[MAXPDSTRING-1] = 0;
-    for(dllextent=sys_dllextent; *dllextent; dllextent++)
-    {
-        if ((fd = sys_trytoopenone(path, filename, *dllextent,
-            dirbuf, &nameptr, MAXPDSTRING, 1)) >= 0)
-                goto gotone;
-    }
-#ifdef ANDROID
-    /* Android libs have a 'lib' prefix, '.so' suffix and don't allow ~ */
-    char libname[MAXPDSTRING] = "lib";
-    strncat(libname, objectname, MAXPDSTRING - 4);
-    int len = strlen(libname);
-    if (libname[len-1] == '~' && len < MAXPDSTRING - 6) {
-        strcpy(libname+len-1, "_tilde");
-    }
-    if ((fd = sys_trytoopenone(path, libname, ".so",
-        dirbuf, &nameptr, MAXPDSTRING, 1)) >= 0)
-            goto gotone;
-#endif
-    return (0);
-gotone:
+    if ((fd = sys_do_find_lib(objectname, classname, path,
+        dirbuf, &nameptr)) < 0)
+            return (0);
     close(fd);
     class_set_extern_dir(gensym(dirbuf));
 
@@ -372,6 +383,208 @@ int sys_load_lib(t_canvas *canvas, const char *classname)
     return data.ok;
 }
 
+/* ------------- prefetching libraries at startup ---------------- */
+
+/* At startup, the libraries named by "-lib" flags and those declared
+("declare -lib" or "-stdlib") in the patches to be opened are all looked
+for before any of them is loaded.  First all the directories they might be
+in are listed into the path cache in parallel, so that looking for them
+costs no system calls where they aren't; then the files found are read
+through, again in parallel, so that dlopen() finds their pages in memory.
+They are still loaded and set up one at a time, in the same order as
+before, so this only changes how long it all takes. */
+
+typedef struct _prefetchlib
+{
+    char *l_name;               /* name relative to the directories */
+    t_namelist *l_dirs;         /* directories to look in, in order */
+    struct _prefetchlib *l_next;
+} t_prefetchlib;
+
+typedef struct _prefetchlist
+{
+    char **p_vec;
+    int p_n;
+    int p_size;
+} t_prefetchlist;
+
+static void prefetchlist_add(t_prefetchlist *x, const char *s1,
+    const char *s2, const char *s3)
+{
+    char buf[MAXPDSTRING];
+    snprintf(buf, MAXPDSTRING, "%s%s%s", s1, s2, s3);
+    if (x->p_n == x->p_size)
+    {
+        int newsize = (x->p_size ? 2 * x->p_size : 64);
+        x->p_vec = (char **)(x->p_vec ? resizebytes(x->p_vec,
+            x->p_size * sizeof(*x->p_vec), newsize * sizeof(*x->p_vec)) :
+                getbytes(newsize * sizeof(*x->p_vec)));
+        x->p_size = newsize;
+    }
+    x->p_vec[x->p_n] = (char *)getbytes(strlen(buf) + 1);
+    strcpy(x->p_vec[x->p_n++], buf);
+}
+
+static void prefetchlist_free(t_prefetchlist *x)
+{
+    int i;
+    for (i = 0; i < x->p_n; i++)
+        freebytes(x->p_vec[i], strlen(x->p_vec[i]) + 1);
+    if (x->p_vec)
+        freebytes(x->p_vec, x->p_size * sizeof(*x->p_vec));
+}
+
+static int prefetch_adddir(const char *path, t_namelist **dirs)
+{
+    *dirs = namelist_append(*dirs, path, 0);
+    return (1);
+}
+
+    /* add a library to look for, either in "firstdir" or wherever
+    sys_load_lib() would look with no canvas.  "Globaldirs" starts with
+    "." which is where "firstdir" goes instead. */
+static void prefetch_addlib(t_prefetchlib **list, const char *name,
+    const char *firstdir, t_namelist *globaldirs)
+{
+    t_prefetchlib *l, **lp;
+    t_namelist *nl;
+    const char *slash;
+    if (sys_onloadlist(name))
+        return;
+    l = (t_prefetchlib *)getbytes(sizeof(*l));
+    l->l_dirs = 0;
+    if (sys_isabsolutepath(name) && (slash = strrchr(name, '/')))
+    {
+        char dirbuf[MAXPDSTRING];
+        int dirlen = (int)(slash - name);
+        if (dirlen > MAXPDSTRING-1)
+            dirlen = MAXPDSTRING-1;
+        strncpy(dirbuf, name, dirlen);
+        dirbuf[dirlen] = 0;
+        l->l_dirs = namelist_append(0, dirbuf, 0);
+        name = slash + 1;
+    }
+    else
+    {
+        if (firstdir)
+            l->l_dirs = namelist_append(0, firstdir, 0);
+        for (nl = globaldirs; nl; nl = nl->nl_next)
+            if (!firstdir || nl != globaldirs)
+                l->l_dirs = namelist_append(l->l_dirs, nl->nl_string, 0);
+    }
+    l->l_name = (char *)getbytes(strlen(name) + 1);
+    strcpy(l->l_name, name);
+    l->l_next = 0;
+    for (lp = list; *lp; lp = &(*lp)->l_next)
+        ;
+    *lp = l;
+}
+
+    /* find the libraries declared in a patch to be opened */
+static void prefetch_scanpatch(t_prefetchlib **list, const char *cwd,
+    const char *filename, t_namelist *globaldirs)
+{
+    char dirbuf[MAXPDSTRING], *nameptr;
+    t_binbuf *b;
+    t_atom *av;
+    int ac, i, fd = open_via_path(cwd, filename, "", dirbuf, &nameptr,
+        MAXPDSTRING, 0);
+    if (fd < 0)
+        return;
+    close(fd);
+    b = binbuf_new();
+    if (!binbuf_read(b, nameptr, dirbuf, 0))
+    {
+        ac = binbuf_getnatom(b);
+        av = binbuf_getvec(b);
+        for (i = 0; i + 1 < ac; i++)
+            if ((!i || av[i-1].a_type == A_SEMI) &&
+                av[i].a_type == A_SYMBOL && av[i+1].a_type == A_SYMBOL &&
+                !strcmp(av[i].a_w.w_symbol->s_name, "#X") &&
+                !strcmp(av[i+1].a_w.w_symbol->s_name, "declare"))
+        {
+            for (i += 2; i + 1 < ac && av[i].a_type == A_SYMBOL; i++)
+            {
+                const char *flag = av[i].a_w.w_symbol->s_name, *lib;
+                if (av[i+1].a_type != A_SYMBOL)
+                    continue;
+                lib = av[++i].a_w.w_symbol->s_name;
+                if (!strcmp(flag, "-lib"))
+                    prefetch_addlib(list, lib, dirbuf, globaldirs);
+                else if (!strcmp(flag, "-stdlib"))
+                    prefetch_addlib(list, (strncmp(lib, "extra/", 6) ?
+                        lib : lib + 6), 0, globaldirs);
+            }
+        }
+    }
+    binbuf_free(b);
+}
+
+void sys_prefetchlibs(t_namelist *libs, t_namelist *patches,
+    const char *cwd)
+{
+    t_namelist *globaldirs = 0, *nl;
+    t_prefetchlib *list = 0, *l;
+    t_prefetchlist candidates = {0, 0, 0}, files = {0, 0, 0};
+    char dirbuf[MAXPDSTRING], filename[MAXPDSTRING], *nameptr;
+    canvas_path_iterate(0, (t_canvas_path_iterator)prefetch_adddir,
+        &globaldirs);
+    for (nl = libs; nl; nl = nl->nl_next)
+        prefetch_addlib(&list, nl->nl_string, 0, globaldirs);
+    for (nl = patches; nl; nl = nl->nl_next)
+        prefetch_scanpatch(&list, cwd, nl->nl_string, globaldirs);
+    if (!list)
+        goto done;
+
+        /* every directory sys_do_find_lib() will look in */
+    for (l = list; l; l = l->l_next)
+    {
+        const char *classname = strrchr(l->l_name, '/');
+        classname = (classname ? classname + 1 : l->l_name);
+        for (nl = l->l_dirs; nl; nl = nl->nl_next)
+        {
+            const char *sep = (*nl->nl_string &&
+                nl->nl_string[strlen(nl->nl_string)-1] != '/' ? "/" : "");
+            prefetchlist_add(&candidates, nl->nl_string, sep, l->l_name);
+            snprintf(filename, MAXPDSTRING, "%s/%s", l->l_name, classname);
+            prefetchlist_add(&candidates, nl->nl_string, sep, filename);
+        }
+    }
+    sys_pathcache_prefetch(candidates.p_n, candidates.p_vec);
+
+        /* find the libraries, now without searching, and read them */
+    for (l = list; l; l = l->l_next)
+    {
+        const char *classname = strrchr(l->l_name, '/');
+        classname = (classname ? classname + 1 : l->l_name);
+        for (nl = l->l_dirs; nl; nl = nl->nl_next)
+        {
+            int fd = sys_do_find_lib(l->l_name, classname, nl->nl_string,
+                dirbuf, &nameptr);
+            if (fd >= 0)
+            {
+                close(fd);
+                prefetchlist_add(&files, dirbuf, "/", nameptr);
+                break;
+            }
+        }
+    }
+    sys_prefetchfiles(files.p_n, files.p_vec);
+    logpost(NULL, PD_VERBOSE, "prefetched %d of the startup libraries",
+        files.p_n);
+done:
+    while ((l = list))
+    {
+        list = l->l_next;
+        namelist_free(l->l_dirs);
+        freebytes(l->l_name, strlen(l->l_name) + 1);
+        freebytes(l, sizeof(*l));
+    }
+    namelist_free(globaldirs);
+    prefetchlist_free(&candidates);
+    prefetchlist_free(&files);
+}
+
 int sys_run_scheduler(const char *externalschedlibname,
     const char *sys_extraflagsstring)
 {
@@ -431,17 +644,71 @@ int sys_run_scheduler(const char *externalschedlibname,
 }
 
 
+    /* open a shared library that isn't an external (such as a DSP chain
+    written by "pd compile-dsp") and look things up in it */
+void *sys_dlopen(const char *filename)
+{
+    char buf[MAXPDSTRING];
+    void *lib = 0;
+    sys_bashfilename(filename, buf);
+#ifdef _WIN32
+    if (!(lib = (void *)LoadLibrary(buf)))
+        pd_error(0, "%s: couldn't load (%d)", filename, (int)GetLastError());
+#elif defined(HAVE_LIBDL) || defined(__FreeBSD__)
+    if (!(lib = dlopen(buf, RTLD_NOW | RTLD_LOCAL)))
+        pd_error(0, "%s: %s", filename, dlerror());
+#else
+    pd_error(0, "%s: can't load libraries on this platform", filename);
+#endif
+    return (lib);
+}
+
+void *sys_dlsym(void *lib, const char *symname)
+{
+#ifdef _WIN32
+    return ((void *)GetProcAddress((HMODULE)lib, symname));
+#elif defined(HAVE_LIBDL) || defined(__FreeBSD__)
+    return (dlsym(lib, symname));
+#else
+    return (0);
+#endif
+}
+
+void sys_dlclose(void *lib)
+{
+#ifdef _WIN32
+    FreeLibrary((HMODULE)lib);
+#elif defined(HAVE_LIBDL) || defined(__FreeBSD__)
+    dlclose(lib);
+#endif
+}
+
 /* abstraction loading */
 void canvas_popabstraction(t_canvas *x);
 int pd_setloadingabstraction(t_symbol *sym);
+void binbuf_evalabstraction(t_symbol *name, t_symbol *dir);
+void binbuf_evalpatch(t_binbuf *b, t_symbol *name, t_symbol *dir);
+
+    /* evaluate an abstraction found as file "name" in "dir", from "b" if
+    it's already been read */
+static t_pd *do_eval_abstraction(t_binbuf *b, t_symbol *name,
+    t_symbol *dir, int argc, t_atom *argv)
+{
+    t_pd *was = s__X.s_thing;
+    canvas_setargs(argc, argv);
+    if (b)
+        binbuf_evalpatch(b, name, dir);
+    else binbuf_evalabstraction(name, dir);
+    if (s__X.s_thing && was != s__X.s_thing)
+        canvas_popabstraction((t_canvas *)(s__X.s_thing));
+    else s__X.s_thing = was;
+    canvas_setargs(0, 0);
+    return (pd_this->pd_newest);
+}
 
 static t_pd *do_create_abstraction(t_symbol*s, int argc, t_atom *argv)
 {
-    /*
-     * TODO: check if the there is a binbuf cached for <canvas::symbol>
-        and use that instead.  We'll have to invalidate the cache once we
-        are done (either with a clock_delay(0) or something else)
-     */
+    /* the file's contents are cached by binbuf_evalabstraction() */
     if (!pd_setloadingabstraction(s))
     {
         const char *objectname = s->s_name;
@@ -450,7 +717,6 @@ static t_pd *do_create_abstraction(t_symbol*s, int argc, t_atom *argv)
         t_canvas *canvas = (t_canvas*)glist_getcanvas(glist);
         int fd = -1;
 
-        t_pd *was = s__X.s_thing;
         snprintf(classslashclass, MAXPDSTRING, "%s/%s", objectname, objectname);
         if ((fd = canvas_open(canvas, objectname, ".pd",
                   dirbuf, &nameptr, MAXPDSTRING, 0)) >= 0 ||
@@ -460,14 +726,8 @@ static t_pd *do_create_abstraction(t_symbol*s, int argc, t_atom *argv)
                   dirbuf, &nameptr, MAXPDSTRING, 0)) >= 0)
         {
             close(fd);
-            canvas_setargs(argc, argv);
-
-            binbuf_evalfile(gensym(nameptr), gensym(dirbuf));
-            if (s__X.s_thing && was != s__X.s_thing)
-                canvas_popabstraction((t_canvas *)(s__X.s_thing));
-            else s__X.s_thing = was;
-            canvas_setargs(0, 0);
-            return (pd_this->pd_newest);
+            return (do_eval_abstraction(0, gensym(nameptr), gensym(dirbuf),
+                argc, argv));
         }
             /* otherwise we couldn't do it; just return 0 */
     }
@@ -476,6 +736,22 @@ static t_pd *do_create_abstraction(t_symbol*s, int argc, t_atom *argv)
     return (0);
 }
 
+    /* make another copy of abstraction "s", whose file "name" in "dir" has
+    already been found and read into "b" (see binbuf_readabstraction()),
+    without searching for it again.  clone uses this for all copies but
+    the first. */
+t_pd *sys_makeabstraction(t_symbol *s, t_binbuf *b, t_symbol *name,
+    t_symbol *dir, int argc, t_atom *argv)
+{
+    pd_this->pd_newest = 0;
+    if (pd_setloadingabstraction(s))
+    {
+        pd_error(0, "%s: can't load abstraction within itself\n", s->s_name);
+        return (0);
+    }
+    return (do_eval_abstraction(b, name, dir, argc, argv));
+}
+
 /* search for abstraction; register a creator if found */
 static int sys_do_load_abs(t_canvas *canvas, const char *objectname,
     const char *path)
@@ -43,6 +43,7 @@ int sys_startgui(const char *guipath);
 void sys_setrealtime(const char *guipath);
 int m_mainloop(void);
 int m_batchmain(void);
+int m_rendermain(const char *jobfile, int nprocs, int bench);
 void sys_addhelppath(char *p);
 #ifdef USEAPI_ALSA
 void alsa_adddev(const char *name);
@@ -55,7 +56,14 @@ int sys_noloadbang;
 static int sys_dontstartgui;
 int sys_hipriority = -1;    /* -1 = not specified; 0 = no; 1 = yes */
 int sys_guisetportnumber;   /* if started from the GUI, this is the port # */
+const char *sys_guisetsocketpath; /* ... or its Unix-domain socket */
 int sys_nosleep = 0;  /* skip all "sleep" calls and spin instead */
+int sys_audiopipeline = 0;  /* compute DSP while the last block transfers */
+int sys_flushdenormals = 1; /* have the FPU flush denormals in DSP threads */
+int sys_fastmath = 0;   /* approximate exp and log in mtof~, dbtorms~, etc. */
+int sys_dsplocality = 0;    /* order the DSP chain for cache locality */
+int sys_iothread = 0;   /* write GUI and TCP sockets from their own thread */
+int sys_callbackqueue;      /* main thread hands messages to audio callback */
 int sys_defeatrt;       /* flag to cancel real-time */
 t_symbol *sys_flags;    /* more command-line flags */
 
@@ -63,6 +71,8 @@ const char *sys_guicmd;
 t_symbol *sys_libdir;
 static t_namelist *sys_openlist;
 static t_namelist *sys_messagelist;
+static const char *sys_compilefile;     /* write DSP chain as C and quit */
+static const char *sys_compiledlib;     /* run DSP chain compiled earlier */
 static int sys_version;
 int sys_oldtclversion;      /* hack to warn g_rtext.c about old text sel */
 
@@ -84,6 +94,11 @@ static int sys_listplease;
 int sys_externalschedlib;
 char sys_externalschedlibname[MAXPDSTRING];
 static int sys_batch;
+static const char *sys_renderfile;   /* job list for "-render" */
+static int sys_renderprocs = 1;
+static int sys_renderbench;         /* "-bench": same, but no soundfiles */
+static const char *sys_inputlogfile;  /* "-inputlog": record input to this */
+static int sys_adaptmin, sys_adaptmax;  /* "-adaptaudiobuf" bounds in msec */
 int sys_extraflags;
 char sys_extraflagsstring[MAXPDSTRING];
 int sys_run_scheduler(const char *externalschedlibname,
@@ -207,6 +222,76 @@ from; for instance we could be some kind of RT embedded system.  However, to
 really make this make sense we would have to implement
 open(), read(), etc, calls to be served somehow from the GUI too. */
 
+    /* time spent in each stage of startup, for "pd startuptime" */
+#define NSTARTSTAGE 8
+static struct _startstage
+{
+    const char *s_name;
+    double s_time;
+} sys_startstage[NSTARTSTAGE];
+static int sys_nstartstage;
+static double sys_startlasttime;
+
+static void sys_markstartup(const char *name)
+{
+    double now = sys_getrealtime();
+    if (sys_nstartstage < NSTARTSTAGE)
+    {
+        sys_startstage[sys_nstartstage].s_name = name;
+        sys_startstage[sys_nstartstage].s_time = now - sys_startlasttime;
+        sys_nstartstage++;
+    }
+    sys_startlasttime = now;
+}
+
+void conf_printtimes(void);
+int conf_ndeferred(void);
+
+void glob_startuptime(void *dummy)
+{
+    int i;
+    post("startup:");
+    for (i = 0; i < sys_nstartstage; i++)
+        post("  %-16s %8.3f msec", sys_startstage[i].s_name,
+            1000 * sys_startstage[i].s_time);
+    post("class setup%s:", (sys_lazyclasses ? " (-lazyclasses)" : ""));
+    conf_printtimes();
+}
+
+    /* "pd memory-subsystems": what the parts of Pd that aren't patches
+    take, and (on linux) how much of the process is resident.  This is
+    posted at startup with "-lowmem". */
+void glob_memorysubsystems(void *dummy)
+{
+    int nsym, nclass, ndeferred = conf_ndeferred();
+    size_t symbytes = mess_symbolbytes(&nsym),
+        classbytes = mess_classbytes(&nclass);
+#ifdef __linux__
+    FILE *fd;
+    long pages, resident;
+#endif
+    post("memory by subsystem%s:", (sys_lowmem ? " (-lowmem)" : ""));
+    post("  %-16s %8ld bytes (%d symbols in %d buckets)", "symbols",
+        (long)symbytes, nsym, pd_this->pd_symhashsize);
+    post("  %-16s %8ld bytes (%d classes)", "classes",
+        (long)classbytes, nclass);
+    if (ndeferred)
+        post("  %-16s %d subsystem(s) not set up yet", "", ndeferred);
+    post("  %-16s %8ld bytes", "clocks",
+        (long)(STUFF->st_clockheapsize * sizeof(*STUFF->st_clockheap)));
+    post("  %-16s %8ld bytes", "MIDI queues", (long)sys_midibytes());
+    post("  %-16s %8ld bytes", "GUI buffer", (long)sys_guibytes());
+#ifdef __linux__
+    if ((fd = fopen("/proc/self/statm", "r")))
+    {
+        if (fscanf(fd, "%ld %ld", &pages, &resident) == 2)
+            post("  %-16s %8ld bytes", "resident in all",
+                resident * sysconf(_SC_PAGESIZE));
+        fclose(fd);
+    }
+#endif
+}
+
 void glob_initfromgui(void *dummy, t_symbol *s, int argc, t_atom *argv)
 {
     const char *cwd = atom_getsymbolarg(0, argc, argv)->s_name;
@@ -214,6 +299,7 @@ void glob_initfromgui(void *dummy, t_symbol *s, int argc, t_atom *argv)
     unsigned int i;
     int did_fontwarning = 0;
     int j;
+    sys_markstartup("waiting for GUI");
     sys_oldtclversion = atom_getfloatarg(1, argc, argv);
     if (argc != 2 + 3 * NZOOM * NFONT)
         bug("glob_initfromgui");
@@ -246,16 +332,25 @@ void glob_initfromgui(void *dummy, t_symbol *s, int argc, t_atom *argv)
         /* load dynamic libraries specified with "-lib" args */
     if (sys_oktoloadfiles(0))
     {
+        sys_prefetchlibs(STUFF->st_externlist, sys_openlist, cwd);
         for  (nl = STUFF->st_externlist; nl; nl = nl->nl_next)
             if (!sys_load_lib(0, nl->nl_string))
                 post("%s: can't load library", nl->nl_string);
         sys_oktoloadfiles(1);
+    }
+    sys_markstartup("libraries");
+    if (sys_compiledlib)
+    {
+        t_atom at;
+        SETSYMBOL(&at, gensym(sys_compiledlib));
+        glob_dspcompiled(0, gensym("dsp-compiled"), 1, &at);
     }
         /* open patches specifies with "-open" args */
     for  (nl = sys_openlist; nl; nl = nl->nl_next)
         openit(cwd, nl->nl_string);
     namelist_free(sys_openlist);
     sys_openlist = 0;
+    sys_markstartup("patches");
         /* send messages specified with "-send" args */
     for  (nl = sys_messagelist; nl; nl = nl->nl_next)
     {
@@ -266,6 +361,19 @@ void glob_initfromgui(void *dummy, t_symbol *s, int argc, t_atom *argv)
     }
     namelist_free(sys_messagelist);
     sys_messagelist = 0;
+    sys_markstartup("messages");
+    if (sys_lowmem)
+        glob_memorysubsystems(0);
+    if (sys_compilefile)
+    {
+        t_atom at;
+        SETFLOAT(&at, 1);
+        glob_dsp(0, gensym("dsp"), 1, &at);
+        glob_compiledsp(0, gensym(sys_compilefile));
+        glob_quit(0);
+    }
+    if (sys_verbose)
+        glob_startuptime(0);
 }
 
 // font char metric triples: pointsize width(pixels) height(pixels)
@@ -309,6 +417,8 @@ int sys_main(int argc, const char **argv)
     const char *prefsfile = "";
     sys_externalschedlib = 0;
     sys_extraflags = 0;
+    mem_addsymbolroot(&sys_flags, sizeof(sys_flags));
+    mem_addsymbolroot(&sys_libdir, sizeof(sys_libdir));
 #ifdef PD_DEBUG
     fprintf(stderr, "Pd: COMPILED FOR DEBUGGING\n");
 #endif
@@ -338,7 +448,13 @@ int sys_main(int argc, const char **argv)
 #endif  /* _WIN32 */
     if (socket_init())
         sys_sockerror("socket_init()");
+    for (i = 1; i < argc; i++)      /* must know this before pd_init() */
+        if (!strcmp(argv[i], "-lazyclasses"))
+            sys_lazyclasses = 1;
+        else if (!strcmp(argv[i], "-lowmem"))
+            sys_lowmem = sys_lazyclasses = 1;
     pd_init();                                  /* start the message system */
+    sys_startlasttime = sys_getrealtime();
     sys_findprogdir(argv[0]);                   /* set sys_progname, guipath */
     for (i = noprefs = 0; i < argc; i++)    /* prescan ... */
     {
@@ -371,16 +487,23 @@ int sys_main(int argc, const char **argv)
     }
     sys_setsignalhandlers();
     sys_afterargparse();                    /* post-argparse settings */
+    sys_markstartup("flags and prefs");
     if (sys_dontstartgui)
         clock_set((sys_fakefromguiclk =
             clock_new(0, (t_method)sys_fakefromgui)), 0);
     else if (sys_startgui(sys_libdir->s_name)) /* start the gui */
         return (1);
-    if (sys_hipriority)
+    sys_markstartup("starting GUI");
+    if (sys_hipriority && !sys_renderfile)  /* no point when rendering */
         sys_setrealtime(sys_libdir->s_name); /* set desired process priority */
+    if (sys_inputlogfile)
+        sys_inputlog(sys_inputlogfile);
     if (sys_externalschedlib)
         return (sys_run_scheduler(sys_externalschedlibname,
             sys_extraflagsstring));
+    else if (sys_renderfile)
+        return (m_rendermain(sys_renderfile, sys_renderprocs,
+            sys_renderbench));
     else if (sys_batch)
         return (m_batchmain());
     else
@@ -408,6 +531,7 @@ static char *(usagemessage[]) = {
 "-outchannels ... -- number of audio out channels (same)\n",
 "-channels ...    -- specify both input and output channels\n",
 "-audiobuf <n>    -- specify size of audio buffer in msec\n",
+"-adaptaudiobuf <min> <max> -- adapt audio buffer to load within bounds (msec)\n",
 "-blocksize <n>   -- specify audio I/O block size in sample frames\n",
 "-sleepgrain <n>  -- specify number of milliseconds to sleep when idle\n",
 "-nodac           -- suppress audio output\n",
@@ -415,6 +539,8 @@ static char *(usagemessage[]) = {
 "-noaudio         -- suppress audio input and output (-nosound is synonym) \n",
 "-callback        -- use callbacks if possible\n",
 "-nocallback      -- use polling-mode (true by default)\n",
+"-callbackqueue   -- use callbacks, never locking out the audio callback\n",
+"-aggregate       -- resample extra audio devices to follow the first one\n",
 "-listdev         -- list audio and MIDI devices\n",
 
 #ifdef USEAPI_OSS
@@ -467,6 +593,7 @@ static char *(usagemessage[]) = {
 "-nomidiin        -- suppress MIDI input\n",
 "-nomidiout       -- suppress MIDI output\n",
 "-nomidi          -- suppress MIDI input and output\n",
+"-nomiditimestamps -- send MIDI output from Pd, not scheduled by the API\n",
 #ifdef USEAPI_OSS
 "-ossmidi         -- use OSS midi API\n",
 #endif
@@ -491,13 +618,23 @@ static char *(usagemessage[]) = {
 "-d <n>           -- specify debug level for inspecting the GUI communication\n",
 "-loadbang        -- do not suppress all loadbangs (true by default)\n",
 "-noloadbang      -- suppress all loadbangs\n",
+"-lazyclasses     -- set up built-in classes only when first used\n",
+"-lowmem          -- small footprint: -lazyclasses, small tables, report\n",
 "-stderr          -- send printout to standard error instead of GUI\n",
 "-nostderr        -- send printout to GUI (true by default)\n",
+"-printlimit <n>  -- let each print object print at most n lines a second\n",
+"-logfile <file>  -- also append printout to a file\n",
+#ifndef _WIN32
+"-syslog          -- also send printout to the system log\n",
+#endif
 "-gui             -- start GUI (true by default)\n",
 "-nogui           -- suppress starting the GUI\n",
 "-guiport <n>     -- connect to pre-existing GUI over port <n>\n",
+"-guiport <path>  -- ... or over a Unix-domain socket at <path>\n",
 "-guicmd \"cmd...\" -- start alternative GUI program (e.g., remote via ssh)\n",
 "-send \"msg...\"   -- send a message at startup, after patches are loaded\n",
+"-compile <file>  -- write the patches' DSP chain to a C file and quit\n",
+"-compiled <lib>  -- run the DSP chain from a library built from that file\n",
 "-prefs           -- load preferences on startup (true by default)\n",
 "-noprefs         -- suppress loading preferences on startup\n",
 "-prefsfile <file>  -- load preferences from a file\n",
@@ -507,10 +644,27 @@ static char *(usagemessage[]) = {
 #endif
 "-sleep           -- sleep when idle, don't spin (true by default)\n",
 "-nosleep         -- spin, don't sleep (may lower latency on multi-CPUs)\n",
+"-tickless        -- without audio, MIDI input or DSP, sleep until a clock is due\n",
+"-lockbudget <msec> -- warn when Pd's lock is held longer than this\n",
+"-flushdenormals  -- flush denormals to zero in DSP (true by default)\n",
+"-noflushdenormals -- leave denormals to the FPU's default handling\n",
+"-fastmath        -- use fast approximations in mtof, exp~, log~ and such\n",
+"-dsplocality     -- order DSP so signals are used soon after they're computed\n",
+"-iothread        -- write to the GUI and TCP sockets from a separate thread\n",
+"-pipeline        -- overlap DSP with audio I/O at one block more latency\n",
+"-memaccount      -- count memory by canvas and class for 'pd memory-report'\n",
+"-symgc           -- let 'pd symbol-collect' free unused symbols\n",
+"-hugepages <n>   -- back blocks of n kbytes or more with huge pages\n",
+"-affinity <role> <cpus> -- pin sched, dsp or disk threads to CPUs (e.g. 0-3,8)\n",
 "-schedlib <file> -- plug in external scheduler (omit file extensions)\n",
 "-extraflags <s>  -- string argument to send schedlib\n",
 "-batch           -- run off-line as a batch process\n",
+"-inputlog <file> -- record MIDI, socket and audio input for '-replay'\n",
+"-replay <file>   -- run as a batch process fed by an input log\n",
 "-nobatch         -- run interactively (true by default)\n",
+"-render <file>   -- render the jobs listed in a file to soundfiles\n",
+"-renderprocs <n> -- number of processes to render them with\n",
+"-bench <file>    -- run patches listed in a file and report their speed\n",
 "-autopatch       -- enable auto-patching to new objects (true by default)\n",
 "-noautopatch     -- defeat auto-patching\n",
 "-compatibility <f> -- set back-compatibility to version <f>\n",
@@ -698,6 +852,14 @@ int sys_argparse(int argc, const char **argv)
             as.a_advance = atoi(argv[1]);
             argc -= 2; argv += 2;
         }
+        else if (!strcmp(*argv, "-adaptaudiobuf"))
+        {
+            if (argc < 3)
+                goto usage;
+            sys_adaptmin = atoi(argv[1]);
+            sys_adaptmax = atoi(argv[2]);
+            argc -= 3; argv += 3;
+        }
         else if (!strcmp(*argv, "-callback"))
         {
             as.a_callback = 1;
@@ -706,6 +868,18 @@ int sys_argparse(int argc, const char **argv)
         else if (!strcmp(*argv, "-nocallback"))
         {
             as.a_callback = 0;
+            sys_callbackqueue = 0;
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-callbackqueue"))
+        {
+            as.a_callback = 1;
+            sys_callbackqueue = 1;
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-aggregate"))
+        {
+            sys_aggregate = 1;
             argc--; argv++;
         }
         else if (!strcmp(*argv, "-blocksize"))
@@ -1001,6 +1175,11 @@ int sys_argparse(int argc, const char **argv)
             sys_nmidiin = sys_nmidiout = 0;
             argc--; argv++;
         }
+        else if (!strcmp(*argv, "-nomiditimestamps"))
+        {
+            sys_miditimestamps = 0;
+            argc--; argv++;
+        }
         else if (!strcmp(*argv, "-midiindev"))
         {
             if (argc < 2)
@@ -1204,6 +1383,11 @@ int sys_argparse(int argc, const char **argv)
             sys_noloadbang = 1;
             argc--; argv++;
         }
+        else if (!strcmp(*argv, "-lazyclasses") || !strcmp(*argv, "-lowmem"))
+        {
+                /* already seen by sys_main(); too late from preferences */
+            argc--; argv++;
+        }
         else if (!strcmp(*argv, "-gui"))
         {
             sys_dontstartgui = 0;
@@ -1215,8 +1399,11 @@ int sys_argparse(int argc, const char **argv)
             argc--; argv++;
         }
         else if (!strcmp(*argv, "-guiport") && argc > 1 &&
-            sscanf(argv[1], "%d", &sys_guisetportnumber) >= 1)
+            (strchr(argv[1], '/') ||
+                sscanf(argv[1], "%d", &sys_guisetportnumber) >= 1))
         {
+            if (strchr(argv[1], '/'))
+                sys_guisetsocketpath = argv[1];
             argc -= 2;
             argv += 2;
         }
@@ -1230,6 +1417,21 @@ int sys_argparse(int argc, const char **argv)
             sys_printtostderr = 1;
             argc--; argv++;
         }
+        else if (!strcmp(*argv, "-printlimit") && argc > 1)
+        {
+            sys_printlimit = atoi(argv[1]);
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-logfile") && argc > 1)
+        {
+            sys_setlogfile(argv[1]);
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-syslog"))
+        {
+            sys_setsyslog(1);
+            argc--; argv++;
+        }
         else if (!strcmp(*argv, "-guicmd"))
         {
             if (argc < 2)
@@ -1246,6 +1448,16 @@ int sys_argparse(int argc, const char **argv)
             sys_messagelist = namelist_append(sys_messagelist, argv[1], 1);
             argc -= 2; argv += 2;
         }
+        else if (!strcmp(*argv, "-compile") && argc > 1)
+        {
+            sys_compilefile = argv[1];
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-compiled") && argc > 1)
+        {
+            sys_compiledlib = argv[1];
+            argc -= 2; argv += 2;
+        }
         else if (!strcmp(*argv, "-schedlib"))
         {
             if (argc < 2)
@@ -1287,6 +1499,37 @@ int sys_argparse(int argc, const char **argv)
             sys_batch = 0;
             argc--; argv++;
         }
+        else if (!strcmp(*argv, "-inputlog") && argc > 1)
+        {
+            sys_inputlogfile = gensym(argv[1])->s_name;
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-replay") && argc > 1)
+        {
+            if (sys_openreplay(argv[1]))
+                return (1);
+            sys_batch = 1;
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-render") && argc > 1)
+        {
+            sys_renderfile = gensym(argv[1])->s_name;
+            sys_batch = 1;
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-bench") && argc > 1)
+        {
+            sys_renderfile = gensym(argv[1])->s_name;
+            sys_renderbench = sys_batch = 1;
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-renderprocs") && argc > 1 &&
+            sscanf(argv[1], "%d", &sys_renderprocs) >= 1)
+        {
+            if (sys_renderprocs < 1)
+                sys_renderprocs = 1;
+            argc -= 2; argv += 2;
+        }
         else if (!strcmp(*argv, "-autopatch"))
         {
             sys_noautopatch = 0;
@@ -1339,6 +1582,68 @@ int sys_argparse(int argc, const char **argv)
             sys_nosleep = 1;
             argc--; argv++;
         }
+        else if (!strcmp(*argv, "-pipeline"))
+        {
+            sys_audiopipeline = 1;
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-tickless"))
+        {
+            sys_tickless = 1;
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-lockbudget") && argc > 1)
+        {
+            sys_setlockbudget(atof(argv[1]));
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-flushdenormals"))
+        {
+            sys_flushdenormals = 1;
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-noflushdenormals"))
+        {
+            sys_flushdenormals = 0;
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-fastmath"))
+        {
+            sys_fastmath = 1;
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-dsplocality"))
+        {
+            sys_dsplocality = 1;
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-iothread"))
+        {
+            sys_iothread = 1;
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-memaccount"))
+        {
+            mem_setaccounting(1);
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-symgc"))
+        {
+            sys_symgc = 1;
+            mem_setaccounting(1);
+            argc--; argv++;
+        }
+        else if (!strcmp(*argv, "-hugepages") && argc > 1)
+        {
+            int kbytes = atoi(argv[1]);
+            mem_sethugepages(kbytes > 0 ? (size_t)kbytes * 1024 : 0);
+            argc -= 2; argv += 2;
+        }
+        else if (!strcmp(*argv, "-affinity") && argc > 2)
+        {
+            sys_setaffinity(argv[1], argv[2]);
+            argc -= 3; argv += 3;
+        }
         else if (!strcmp(*argv, "-noprefs")) /* did this earlier */
             argc--, argv++;
         else if (!strcmp(*argv, "-prefsfile") && argc > 1) /* this too */
@@ -1365,6 +1670,8 @@ int sys_argparse(int argc, const char **argv)
         sys_openlist = namelist_append_files(sys_openlist, *argv);
 
     sys_set_audio_settings(&as);
+    if (sys_adaptmin > 0)
+        sched_setadapt(sys_adaptmin, sys_adaptmax);
     return (0);
 }
 
@@ -63,13 +63,28 @@ typedef struct _midiqelem
     unsigned char q_byte3;
 } t_midiqelem;
 
-#define MIDIQSIZE 1024
+/* MIDI in and out are queued with their times, in a ring buffer for each
+port, and the rings grow rather than overflow when dense streams arrive
+(MIDI clock, MPE controllers and so on).  All the MIDI APIs are polled from
+the scheduler, so the rings are only ever touched from that thread.  Events
+from several ports are taken in order of time. */
 
-t_midiqelem midi_outqueue[MIDIQSIZE];
-int midi_outhead, midi_outtail;
-t_midiqelem midi_inqueue[MIDIQSIZE];
-int midi_inhead, midi_intail;
+#define MIDIQINITSIZE 256       /* initial size of each ring */
+#define MIDIQLOWMEMSIZE 16      /* ...with "-lowmem" */
+#define MIDIQMAXSIZE 65536      /* ...and the most it will grow to */
+
+typedef struct _midiring
+{
+    t_midiqelem *r_buf;
+    int r_size;                 /* a power of two, or 0 if not yet used */
+    unsigned int r_head;        /* elements put in so far */
+    unsigned int r_tail;        /* ...and taken out */
+} t_midiring;
+
+static t_midiring midi_outring[MAXMIDIOUTDEV];
+static t_midiring midi_inring[MAXMIDIINDEV];
 static double sys_midiinittime;
+static double sys_midiintime;   /* time of MIDI input being dispatched */
 #define API_DEFAULTMIDI 0
 
 #if (defined USEAPI_ALSA) && (defined USEAPI_MIDIDUMMY)
@@ -140,28 +155,82 @@ static double sys_getmidiinrealtime(void)
     return (sys_getrealtime() + sys_adctimeminusrealtime);
 }
 
-static void sys_putnext(void)
+    /* get a slot for a new element, growing the ring if needed.  Returns
+    0 if it's full and can't grow any more. */
+static t_midiqelem *midiring_put(t_midiring *r)
+{
+    if (r->r_head - r->r_tail >= (unsigned int)r->r_size)
+    {
+        int newsize = (r->r_size ? 2 * r->r_size :
+            (sys_lowmem ? MIDIQLOWMEMSIZE : MIDIQINITSIZE)), i;
+        unsigned int n = r->r_head - r->r_tail;
+        t_midiqelem *newbuf;
+        if (newsize > MIDIQMAXSIZE ||
+            !(newbuf = (t_midiqelem *)getbytes(newsize * sizeof(*newbuf))))
+                return (0);
+        for (i = 0; i < (int)n; i++)
+            newbuf[i] = r->r_buf[(r->r_tail + i) & (r->r_size - 1)];
+        if (r->r_buf)
+            freebytes(r->r_buf, r->r_size * sizeof(*r->r_buf));
+        r->r_buf = newbuf;
+        r->r_size = newsize;
+        r->r_tail = 0;
+        r->r_head = n;
+    }
+    return (&r->r_buf[r->r_head++ & (r->r_size - 1)]);
+}
+
+    /* memory taken by the rings, for "pd memory-subsystems" */
+size_t sys_midibytes(void)
+{
+    size_t bytes = 0;
+    int i;
+    for (i = 0; i < MAXMIDIOUTDEV; i++)
+        bytes += midi_outring[i].r_size * sizeof(t_midiqelem);
+    for (i = 0; i < MAXMIDIINDEV; i++)
+        bytes += midi_inring[i].r_size * sizeof(t_midiqelem);
+    return (bytes);
+}
+
+static t_midiqelem *midiring_first(t_midiring *r)
 {
-    int portno = midi_outqueue[midi_outtail].q_portno;
+    return (r->r_head != r->r_tail ?
+        &r->r_buf[r->r_tail & (r->r_size - 1)] : 0);
+}
+
+    /* find the port whose next element is earliest */
+static t_midiring *midiring_earliest(t_midiring *rings, int nrings)
+{
+    t_midiring *best = 0;
+    t_midiqelem *e, *beste = 0;
+    int i;
+    for (i = 0; i < nrings; i++)
+        if ((e = midiring_first(&rings[i])) && (!beste ||
+            e->q_time < beste->q_time))
+                best = &rings[i], beste = e;
+    return (best);
+}
+
+static void sys_putnext(t_midiring *r)
+{
+    t_midiqelem *e = midiring_first(r);
+    int portno = e->q_portno;
 #ifdef USEAPI_ALSA
     if (sys_midiapi == API_ALSA)
       {
-        if (midi_outqueue[midi_outtail].q_onebyte)
-          sys_alsa_putmidibyte(portno, midi_outqueue[midi_outtail].q_byte1);
-        else sys_alsa_putmidimess(portno, midi_outqueue[midi_outtail].q_byte1,
-                             midi_outqueue[midi_outtail].q_byte2,
-                             midi_outqueue[midi_outtail].q_byte3);
+        if (e->q_onebyte)
+          sys_alsa_putmidibyte(portno, e->q_byte1);
+        else sys_alsa_putmidimess(portno, e->q_byte1, e->q_byte2,
+            e->q_byte3);
       }
     else
 #endif /* ALSA */
       {
-        if (midi_outqueue[midi_outtail].q_onebyte)
-          sys_putmidibyte(portno, midi_outqueue[midi_outtail].q_byte1);
-        else sys_putmidimess(portno, midi_outqueue[midi_outtail].q_byte1,
-                             midi_outqueue[midi_outtail].q_byte2,
-                             midi_outqueue[midi_outtail].q_byte3);
+        if (e->q_onebyte)
+          sys_putmidibyte(portno, e->q_byte1);
+        else sys_putmidimess(portno, e->q_byte1, e->q_byte2, e->q_byte3);
       }
-    midi_outtail  = (midi_outtail + 1 == MIDIQSIZE ? 0 : midi_outtail + 1);
+    r->r_tail++;
 }
 
 /*  #define TEST_DEJITTER */
@@ -172,47 +241,84 @@ void sys_pollmidioutqueue(void)
     static int db = 0;
 #endif
     double midirealtime = sys_getmidioutrealtime();
+    t_midiring *r;
 #ifdef TEST_DEJITTER
-    if (midi_outhead == midi_outtail)
+    if (!midiring_earliest(midi_outring, MAXMIDIOUTDEV))
         db = 0;
 #endif
-    while (midi_outhead != midi_outtail)
+    while ((r = midiring_earliest(midi_outring, MAXMIDIOUTDEV)))
     {
 #ifdef TEST_DEJITTER
         if (!db)
         {
             post("out: del %f, midiRT %f logicaltime %f, RT %f dacminusRT %f",
-                (midi_outqueue[midi_outtail].q_time - midirealtime),
+                (midiring_first(r)->q_time - midirealtime),
                     midirealtime, .001 * clock_gettimesince(sys_midiinittime),
                         sys_getrealtime(), sys_dactimeminusrealtime);
             db = 1;
         }
 #endif
-        if (midi_outqueue[midi_outtail].q_time <= midirealtime)
-            sys_putnext();
+        if (midiring_first(r)->q_time <= midirealtime)
+            sys_putnext(r);
         else break;
     }
 }
 
 /* ------------------------- MIDI output queue handling ------------------ */
 
+/* If the MIDI API can schedule output itself (PortMidi and ALSA sequencer)
+messages are handed to it at once, stamped with the real time at which the
+audio for their logical time will be heard, so that their timing doesn't
+depend on when the scheduler happens to wake up.  Otherwise, or with the
+"-nomiditimestamps" flag, they wait in the output ring until that time and
+are sent as sys_pollmidioutqueue() finds them due.  Stamps for each port
+are kept in order since PortMidi requires it. */
+
+int sys_miditimestamps = 1;
+static double midi_laststamp[MAXMIDIOUTDEV];
+
+static int sys_putmidimess_stamped(int portno, int a, int b, int c)
+{
+    double when = .001 * clock_gettimesince(sys_midiinittime) -
+        sys_dactimeminusrealtime;
+    if (when < midi_laststamp[portno])
+        when = midi_laststamp[portno];
+#ifdef USEAPI_ALSA
+    if (sys_midiapi == API_ALSA)
+    {
+        if (!sys_alsa_putmidimess_at(portno, a, b, c, when))
+            return (0);
+    }
+    else
+#endif /* ALSA */
+    if (!sys_putmidimess_at(portno, a, b, c, when))
+        return (0);
+    midi_laststamp[portno] = when;
+    return (1);
+}
+
 static void sys_queuemidimess(int portno, int onebyte, int a, int b, int c)
 {
-    t_midiqelem *midiqelem;
-    int newhead = midi_outhead +1;
-    if (newhead == MIDIQSIZE)
-        newhead = 0;
+    t_midiring *r;
+    t_midiqelem *e;
+    if (portno < 0 || portno >= MAXMIDIOUTDEV)
+        return;     /* no such port to send to anyway */
+    r = &midi_outring[portno];
+    if (sys_miditimestamps && !onebyte && !midiring_first(r) &&
+        sys_putmidimess_stamped(portno, a, b, c))
+            return;
             /* if FIFO is full flush an element to make room */
-    if (newhead == midi_outtail)
-        sys_putnext();
-    midi_outqueue[midi_outhead].q_portno = portno;
-    midi_outqueue[midi_outhead].q_onebyte = onebyte;
-    midi_outqueue[midi_outhead].q_byte1 = a;
-    midi_outqueue[midi_outhead].q_byte2 = b;
-    midi_outqueue[midi_outhead].q_byte3 = c;
-    midi_outqueue[midi_outhead].q_time =
-        .001 * clock_gettimesince(sys_midiinittime);
-    midi_outhead = newhead;
+    if (!(e = midiring_put(r)))
+    {
+        sys_putnext(r);
+        e = midiring_put(r);
+    }
+    e->q_portno = portno;
+    e->q_onebyte = onebyte;
+    e->q_byte1 = a;
+    e->q_byte2 = b;
+    e->q_byte3 = c;
+    e->q_time = .001 * clock_gettimesince(sys_midiinittime);
     sys_pollmidioutqueue();
 }
 
@@ -301,17 +407,20 @@ void inmidi_pitchbend(int portno, int channel, int value);
 void inmidi_aftertouch(int portno, int channel, int value);
 void inmidi_polyaftertouch(int portno, int channel, int pitch, int value);
 
-static void sys_dispatchnextmidiin(void)
+static void sys_dispatchnextmidiin(t_midiring *r)
 {
     static t_midiparser parser[MAXMIDIINDEV], *parserp;
-    int portno = midi_inqueue[midi_intail].q_portno,
-        byte = midi_inqueue[midi_intail].q_byte1;
-    if (!midi_inqueue[midi_intail].q_onebyte)
+    t_midiqelem *e = midiring_first(r);
+    int portno = e->q_portno, byte = e->q_byte1;
+    if (!e->q_onebyte)
         bug("sys_dispatchnextmidiin");
     if (portno < 0 || portno >= MAXMIDIINDEV)
         bug("sys_dispatchnextmidiin 2");
     parserp = parser + portno;
+    sys_midiintime = e->q_time;
     outlet_setstacklim();
+    if (sys_inputrecording)
+        sys_recordmidi(portno, byte, sys_getmidiinoffset());
 
     if (byte >= MIDI_CLOCK)
     {
@@ -421,7 +530,25 @@ static void sys_dispatchnextmidiin(void)
             }
         }
     }
-    midi_intail = (midi_intail + 1 == MIDIQSIZE ? 0 : midi_intail + 1);
+    r->r_tail++;
+}
+
+    /* sample offset, in the DSP tick about to be computed, of the MIDI
+    input now being dispatched, so that it can be rendered at the right
+    sample rather than at the start of the block.  MIDI input is dispatched
+    after each tick once logical time has caught up with it, so an event
+    that arrived during the last tick's worth of time goes out that far
+    into the next one; anything older goes at the start. */
+int sys_getmidiinoffset(void)
+{
+    double ticktime = (double)DEFDACBLKSIZE / STUFF->st_dacsr,
+        late = .001 * clock_gettimesince(sys_midiinittime) - sys_midiintime;
+    int offset = (int)((ticktime - late) / ticktime * DEFDACBLKSIZE);
+    if (offset < 0)
+        return (0);
+    else if (offset >= DEFDACBLKSIZE)
+        return (DEFDACBLKSIZE - 1);
+    else return (offset);
 }
 
 void sys_pollmidiinqueue(void)
@@ -430,33 +557,34 @@ void sys_pollmidiinqueue(void)
     static int db = 0;
 #endif
     double logicaltime = .001 * clock_gettimesince(sys_midiinittime);
+    t_midiring *r;
 #ifdef TEST_DEJITTER
-    if (midi_inhead == midi_intail)
+    if (!midiring_earliest(midi_inring, MAXMIDIINDEV))
         db = 0;
 #endif
-    while (midi_inhead != midi_intail)
+    while ((r = midiring_earliest(midi_inring, MAXMIDIINDEV)))
     {
 #ifdef TEST_DEJITTER
         if (!db)
         {
             post("in del %f, logicaltime %f, RT %f adcminusRT %f",
-                (midi_inqueue[midi_intail].q_time - logicaltime),
+                (midiring_first(r)->q_time - logicaltime),
                     logicaltime, sys_getrealtime(), sys_adctimeminusrealtime);
             db = 1;
         }
 #endif
 #if 0
-        if (midi_inqueue[midi_intail].q_time <= logicaltime - 0.007)
+        if (midiring_first(r)->q_time <= logicaltime - 0.007)
             post("late %f",
-                1000 * (logicaltime - midi_inqueue[midi_intail].q_time));
+                1000 * (logicaltime - midiring_first(r)->q_time));
 #endif
-        if (midi_inqueue[midi_intail].q_time <= logicaltime)
+        if (midiring_first(r)->q_time <= logicaltime)
         {
 #if 0
             post("diff %f",
-                1000* (logicaltime - midi_inqueue[midi_intail].q_time));
+                1000* (logicaltime - midiring_first(r)->q_time));
 #endif
-            sys_dispatchnextmidiin();
+            sys_dispatchnextmidiin(r);
         }
         else break;
     }
@@ -468,28 +596,54 @@ void sys_pollmidiinqueue(void)
 void sys_midibytein(int portno, int byte)
 {
     static int warned = 0;
-    t_midiqelem *midiqelem;
-    int newhead = midi_inhead +1;
-    if (newhead == MIDIQSIZE)
-        newhead = 0;
+    t_midiring *r;
+    t_midiqelem *e;
+    if (portno < 0 || portno >= MAXMIDIINDEV)
+    {
+        bug("sys_midibytein");
+        return;
+    }
+    r = &midi_inring[portno];
             /* if FIFO is full flush an element to make room */
-    if (newhead == midi_intail)
+    if (!(e = midiring_put(r)))
     {
         if (!warned)
         {
             post("warning: MIDI timing FIFO overflowed");
             warned = 1;
         }
-        sys_dispatchnextmidiin();
+        sys_dispatchnextmidiin(r);
+        e = midiring_put(r);
     }
-    midi_inqueue[midi_inhead].q_portno = portno;
-    midi_inqueue[midi_inhead].q_onebyte = 1;
-    midi_inqueue[midi_inhead].q_byte1 = byte;
-    midi_inqueue[midi_inhead].q_time = sys_getmidiinrealtime();
-    midi_inhead = newhead;
+    e->q_portno = portno;
+    e->q_onebyte = 1;
+    e->q_byte1 = byte;
+    e->q_time = sys_getmidiinrealtime();
     sys_pollmidiinqueue();
 }
 
+    /* dispatch a byte from an input log (s_replay.c) right away, dating it
+    so that sys_getmidiinoffset() gives the offset it had when recorded */
+void sys_replaymidibyte(int portno, int byte, int offset)
+{
+    double ticktime = (double)DEFDACBLKSIZE / STUFF->st_dacsr;
+    t_midiring *r;
+    t_midiqelem *e;
+    if (portno < 0 || portno >= MAXMIDIINDEV)
+        return;
+    r = &midi_inring[portno];
+    while (!(e = midiring_put(r)))
+        sys_dispatchnextmidiin(r);
+    e->q_portno = portno;
+    e->q_onebyte = 1;
+    e->q_byte1 = byte;
+    e->q_time = .001 * clock_gettimesince(sys_midiinittime) -
+        ticktime * (1 - (offset + 0.5) / DEFDACBLKSIZE);
+    while (midiring_first(r) != e)
+        sys_dispatchnextmidiin(r);
+    sys_dispatchnextmidiin(r);
+}
+
 void sys_pollmidiqueue(void)
 {
     sys_setmiditimediff(0, 1e-6 * sys_schedadvance);
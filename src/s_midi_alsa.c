@@ -44,6 +44,7 @@ static int alsa_nmidiout;
 static int alsa_midioutfd[MAXMIDIOUTDEV];
 
 static snd_seq_t *midi_handle;
+static int alsa_queue = -1;     /* for timestamped output */
 
 static snd_midi_event_t *midiev;
 
@@ -117,6 +118,12 @@ void sys_alsa_do_open_midi(int nmidiin, int *midiinvec,
     post("opened alsa MIDI client %d in:%d out:%d", client, nmidiin, nmidiout);
     sys_setalarm(0);
     snd_midi_event_new(ALSA_MAX_EVENT_SIZE, &midiev);
+    if (nmidiout > 0 &&
+        (alsa_queue = snd_seq_alloc_queue(midi_handle)) >= 0)
+    {
+        snd_seq_start_queue(midi_handle, alsa_queue, 0);
+        snd_seq_drain_output(midi_handle);
+    }
     alsa_nmidiout = nmidiout;
     alsa_nmidiin = nmidiin;
 
@@ -127,62 +134,70 @@ void sys_alsa_do_open_midi(int nmidiin, int *midiinvec,
     return;
 }
 
+    /* fill in a sequencer event for a MIDI message */
+static int alsa_makemidievent(snd_seq_event_t *ev, int a, int b, int c)
+{
+    int status = a & 0xf0;
+    int channel = a & 0x0f;
+    status = (status >= MIDI_SYSEX) ? status : (status & 0xf0);
+    switch (status)
+    {
+        case MIDI_NOTEON:
+            snd_seq_ev_set_noteon(ev, channel, b, c);
+            break;
+        case MIDI_NOTEOFF:
+            snd_seq_ev_set_noteoff(ev, channel, b, c);
+            break;
+        case MIDI_POLYAFTERTOUCH:
+            snd_seq_ev_set_keypress(ev, channel, b, c);
+            break;
+        case MIDI_CONTROLCHANGE:
+            snd_seq_ev_set_controller(ev, channel, b, c);
+            break;
+        case MIDI_PROGRAMCHANGE:
+            snd_seq_ev_set_pgmchange(ev, channel, b);
+            break;
+        case MIDI_AFTERTOUCH:
+            snd_seq_ev_set_chanpress(ev, channel, b);
+            break;
+        case MIDI_PITCHBEND:
+            /* b and c are already correct but alsa needs to recalculate them */
+            snd_seq_ev_set_pitchbend(ev, channel, (((c<<7)|b)-8192));
+            break;
+        case MIDI_TIMECODE:
+            ev->type = SND_SEQ_EVENT_QFRAME;
+            snd_seq_ev_set_fixed(ev);
+            ev->data.raw8.d[0] = a & 0xff; /* status */
+            ev->data.raw8.d[1] = b & 0x7f; /* data */
+            break;
+        case MIDI_SONGPOS:
+            ev->type = SND_SEQ_EVENT_SONGPOS;
+            snd_seq_ev_set_fixed(ev);
+            ev->data.raw8.d[0] = a & 0xff; /* status */
+            ev->data.raw8.d[1] = b & 0x7f; /* data */
+            ev->data.raw8.d[2] = c & 0x7f; /* data */
+            break;
+        case MIDI_SONGSELECT:
+            ev->type = SND_SEQ_EVENT_SONGSEL;
+            snd_seq_ev_set_fixed(ev);
+            ev->data.raw8.d[0] = a & 0xff; /* status */
+            ev->data.raw8.d[1] = b & 0x7f; /* data */
+            break;
+        default:
+            bug("couldn't put alsa MIDI message");
+            return (0);
+    }
+    return (1);
+}
+
 void sys_alsa_putmidimess(int portno, int a, int b, int c)
 {
     if (portno >= 0 && portno < alsa_nmidiout)
     {
         snd_seq_event_t ev;
-        int status = a & 0xf0;
-        int channel = a & 0x0f;
         snd_seq_ev_clear(&ev);
-        status = (status >= MIDI_SYSEX) ? status : (status & 0xf0);
-        switch (status)
-        {
-            case MIDI_NOTEON:
-                snd_seq_ev_set_noteon(&ev, channel, b, c);
-                break;
-            case MIDI_NOTEOFF:
-                snd_seq_ev_set_noteoff(&ev, channel, b, c);
-                break;
-            case MIDI_POLYAFTERTOUCH:
-                snd_seq_ev_set_keypress(&ev, channel, b, c);
-                break;
-            case MIDI_CONTROLCHANGE:
-                snd_seq_ev_set_controller(&ev, channel, b, c);
-                break;
-            case MIDI_PROGRAMCHANGE:
-                snd_seq_ev_set_pgmchange(&ev, channel, b);
-                break;
-            case MIDI_AFTERTOUCH:
-                snd_seq_ev_set_chanpress(&ev, channel, b);
-                break;
-            case MIDI_PITCHBEND:
-                /* b and c are already correct but alsa needs to recalculate them */
-                snd_seq_ev_set_pitchbend(&ev, channel, (((c<<7)|b)-8192));
-                break;
-            case MIDI_TIMECODE:
-                ev.type = SND_SEQ_EVENT_QFRAME;
-                snd_seq_ev_set_fixed(&ev);
-                ev.data.raw8.d[0] = a & 0xff; /* status */
-                ev.data.raw8.d[1] = b & 0x7f; /* data */
-                break;
-            case MIDI_SONGPOS:
-                ev.type = SND_SEQ_EVENT_SONGPOS;
-                snd_seq_ev_set_fixed(&ev);
-                ev.data.raw8.d[0] = a & 0xff; /* status */
-                ev.data.raw8.d[1] = b & 0x7f; /* data */
-                ev.data.raw8.d[2] = c & 0x7f; /* data */
-                break;
-            case MIDI_SONGSELECT:
-                ev.type = SND_SEQ_EVENT_SONGSEL;
-                snd_seq_ev_set_fixed(&ev);
-                ev.data.raw8.d[0] = a & 0xff; /* status */
-                ev.data.raw8.d[1] = b & 0x7f; /* data */
-                break;
-            default:
-                bug("couldn't put alsa MIDI message");
-                break;
-        }
+        if (!alsa_makemidievent(&ev, a, b, c))
+            return;
         snd_seq_ev_set_direct(&ev);
         snd_seq_ev_set_subs(&ev);
         snd_seq_ev_set_source(&ev, alsa_midioutfd[portno]);
@@ -191,6 +206,31 @@ void sys_alsa_putmidimess(int portno, int a, int b, int c)
     //post("%d %d %d\n", a, b, c);
 }
 
+    /* schedule a message on our queue, relative to now */
+int sys_alsa_putmidimess_at(int portno, int a, int b, int c, double when)
+{
+    if (alsa_queue < 0)
+        return (0);
+    if (portno >= 0 && portno < alsa_nmidiout)
+    {
+        snd_seq_event_t ev;
+        snd_seq_real_time_t rt;
+        double delay = when - sys_getrealtime();
+        if (delay < 0)
+            delay = 0;
+        snd_seq_ev_clear(&ev);
+        if (!alsa_makemidievent(&ev, a, b, c))
+            return (1);
+        rt.tv_sec = (unsigned int)delay;
+        rt.tv_nsec = (unsigned int)((delay - rt.tv_sec) * 1e9);
+        snd_seq_ev_schedule_real(&ev, alsa_queue, 1, &rt);
+        snd_seq_ev_set_subs(&ev);
+        snd_seq_ev_set_source(&ev, alsa_midioutfd[portno]);
+        snd_seq_event_output_direct(midi_handle, &ev);
+    }
+    return (1);
+}
+
 void sys_alsa_putmidibyte(int portno, int byte)
 {
   static snd_midi_event_t *dev = NULL;
@@ -248,6 +288,9 @@ void sys_alsa_close_midi()
     alsa_nmidiin = alsa_nmidiout = 0;
     if (midi_handle)
     {
+        if (alsa_queue >= 0)
+            snd_seq_free_queue(midi_handle, alsa_queue);
+        alsa_queue = -1;
         snd_seq_close(midi_handle);
         midi_handle = NULL;
         if (midiev)
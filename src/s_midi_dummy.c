@@ -24,6 +24,11 @@ void sys_putmidibyte(int portno, int byte)
 {
 }
 
+int sys_putmidimess_at(int portno, int a, int b, int c, double when)
+{
+    return (0);
+}
+
 void sys_poll_midi(void)
 {
 }
@@ -161,6 +161,12 @@ void sys_putmidibyte(int portno, int byte)
         oss_midiout(oss_midioutfd[portno], byte);
 }
 
+    /* raw MIDI devices can't schedule output */
+int sys_putmidimess_at(int portno, int a, int b, int c, double when)
+{
+    return (0);
+}
+
 void sys_poll_midi(void)
 {
     int i, throttle = 100;
@@ -45,6 +45,11 @@ static PmStream *mac_midioutdevlist[MAXMIDIOUTDEV];
 static int mac_nmidiindev;
 static int mac_nmidioutdev;
 
+    /* outputs are opened with this latency (msec) so that PortMidi honors
+    timestamps; messages are then sent at their timestamp plus this.  A
+    timestamp of zero means "now" as before. */
+#define PM_LATENCY 1
+
 void sys_do_open_midi(int nmidiin, int *midiinvec,
     int nmidiout, int *midioutvec)
 {
@@ -95,7 +100,7 @@ void sys_do_open_midi(int nmidiin, int *midiinvec,
                 {
                     err = Pm_OpenOutput(
                         &mac_midioutdevlist[mac_nmidioutdev],
-                            j, NULL, 0, NULL, NULL, 0);
+                            j, NULL, 0, NULL, NULL, PM_LATENCY);
                     if (err)
                         post("could not open MIDI output %d (%s): %s",
                             j, info->name, Pm_GetErrorText(err));
@@ -136,6 +141,20 @@ void sys_putmidimess(int portno, int a, int b, int c)
     }
 }
 
+int sys_putmidimess_at(int portno, int a, int b, int c, double when)
+{
+    PmEvent buffer;
+    if (portno >= 0 && portno < mac_nmidioutdev)
+    {
+        double delay = 1000 * (when - sys_getrealtime());
+        buffer.message = Pm_Message(a, b, c);
+        buffer.timestamp = Pt_Time() - PM_LATENCY +
+            (delay > 0 ? (PmTimestamp)(delay + 0.5) : 0);
+        Pm_Write(mac_midioutdevlist[portno], &buffer, 1);
+    }
+    return (1);
+}
+
 static void writemidi4(PortMidiStream* stream, int a, int b, int c, int d)
 {
     PmEvent buffer;
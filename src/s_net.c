@@ -5,6 +5,8 @@
 #include "s_net.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <errno.h>
 #ifndef _WIN32
@@ -12,6 +14,8 @@
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/time.h>
+#include <net/if.h>
+#include <sys/stat.h>
 #endif
 
     /* Windows XP winsock doesn't provide inet_ntop */
@@ -177,6 +181,14 @@ const char* sockaddr_get_addrstr(const struct sockaddr *sa, char *addrstr,
         struct sockaddr_in *sa4 = (struct sockaddr_in *)sa;
         addr = (const void *)&sa4->sin_addr.s_addr;
     }
+#ifdef NET_UNIXSOCKETS
+    else if (sa->sa_family == AF_UNIX)
+    {
+        struct sockaddr_un *sun = (struct sockaddr_un *)sa;
+        snprintf(addrstr, addrstrlen, "%s", sun->sun_path);
+        return addrstr;
+    }
+#endif
     else return NULL;
     return INET_NTOP(sa->sa_family, addr, addrstr, addrstrlen);
 }
@@ -225,6 +237,95 @@ int sockaddr_is_multicast(const struct sockaddr *sa)
     return 0;
 }
 
+socklen_t sockaddr_get_len(const struct sockaddr *sa)
+{
+    if (sa->sa_family == AF_INET6)
+        return sizeof(struct sockaddr_in6);
+#ifdef NET_UNIXSOCKETS
+    else if (sa->sa_family == AF_UNIX)
+        return sizeof(struct sockaddr_un);
+#endif
+    else return sizeof(struct sockaddr_in);
+}
+
+int sockaddr_is_unixpath(const char *name)
+{
+    return (strchr(name, '/') != 0);
+}
+
+int sockaddr_set_unixpath(struct sockaddr_storage *ss, const char *path)
+{
+#ifdef NET_UNIXSOCKETS
+    struct sockaddr_un *sun = (struct sockaddr_un *)ss;
+    if (strlen(path) >= sizeof(sun->sun_path))
+        return -1;
+    memset(ss, 0, sizeof(*ss));
+    sun->sun_family = AF_UNIX;
+    strcpy(sun->sun_path, path);
+    return sizeof(struct sockaddr_un);
+#else
+    return -1;
+#endif
+}
+
+int socket_bind_unix(const char *path, int protocol)
+{
+#ifdef NET_UNIXSOCKETS
+    struct sockaddr_storage ss;
+    int sockfd, len = sockaddr_set_unixpath(&ss, path);
+    if (len < 0)
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if ((sockfd = socket(AF_UNIX, protocol, 0)) < 0)
+        return -1;
+        /* a socket file outlives the process that made it, so get rid of
+        any old one first; if somebody is still listening there the bind
+        takes it over. */
+    socket_unlink_unix(path);
+    if (bind(sockfd, (struct sockaddr *)&ss, len) < 0)
+    {
+        int err = errno;
+        close(sockfd);
+        errno = err;
+        return -1;
+    }
+    return sockfd;
+#else
+    errno = EAFNOSUPPORT;
+    return -1;
+#endif
+}
+
+void sockaddr_end_unixpath(struct sockaddr_storage *ss, socklen_t len)
+{
+        /* an unbound Unix-domain sender may not even fill in the family */
+    if (len < (socklen_t)sizeof(ss->ss_family))
+        ss->ss_family = AF_UNSPEC;
+#ifdef NET_UNIXSOCKETS
+    struct sockaddr_un *sun = (struct sockaddr_un *)ss;
+    size_t off = offsetof(struct sockaddr_un, sun_path);
+    if (ss->ss_family == AF_UNIX)
+    {
+        if (len <= off)
+            sun->sun_path[0] = 0;
+        else if (len - off < sizeof(sun->sun_path))
+            sun->sun_path[len - off] = 0;
+        else sun->sun_path[sizeof(sun->sun_path) - 1] = 0;
+    }
+#endif
+}
+
+void socket_unlink_unix(const char *path)
+{
+#ifdef NET_UNIXSOCKETS
+    struct stat statbuf;
+    if (!lstat(path, &statbuf) && S_ISSOCK(statbuf.st_mode))
+        unlink(path);
+#endif
+}
+
 int socket_init(void)
 {
 #ifdef _WIN32
@@ -372,7 +473,8 @@ int socket_bytes_available(int socket)
 #endif
 }
 
-int socket_join_multicast_group(int socket, const struct sockaddr *sa)
+int socket_set_multicast_membership(int socket, const struct sockaddr *sa,
+    const char *ifname, int join)
 {
     if (sa->sa_family == AF_INET6)
     {
@@ -380,42 +482,72 @@ int socket_join_multicast_group(int socket, const struct sockaddr *sa)
         struct ipv6_mreq mreq6 = {0};
         memcpy(&mreq6.ipv6mr_multiaddr, &sa6->sin6_addr,
             sizeof(struct in6_addr));
-        return setsockopt(socket, IPPROTO_IPV6, IPV6_JOIN_GROUP,
-            (char *)&mreq6, sizeof(mreq6));
+            /* IPv6 interfaces go by index, or on Unix also by name */
+        if (ifname && *ifname)
+        {
+            if (*ifname >= '0' && *ifname <= '9')
+                mreq6.ipv6mr_interface = atoi(ifname);
+        #ifndef _WIN32
+            else if (!(mreq6.ipv6mr_interface = if_nametoindex(ifname)))
+            {
+                errno = ENODEV;
+                return -1;
+            }
+        #else
+            else
+            {
+                WSASetLastError(WSAEINVAL);
+                return -1;
+            }
+        #endif
+        }
+        return setsockopt(socket, IPPROTO_IPV6,
+            (join ? IPV6_JOIN_GROUP : IPV6_LEAVE_GROUP),
+                (char *)&mreq6, sizeof(mreq6));
     }
     else if (sa->sa_family == AF_INET)
     {
         struct sockaddr_in *sa4 = (struct sockaddr_in *)sa;
         struct ip_mreq mreq = {0};
         mreq.imr_multiaddr.s_addr = sa4->sin_addr.s_addr;
-        mreq.imr_interface.s_addr = INADDR_ANY;
-        return setsockopt(socket, IPPROTO_IP, IP_ADD_MEMBERSHIP,
-            (char *)&mreq, sizeof(mreq));
+            /* IPv4 interfaces go by their address */
+        if (ifname && *ifname)
+        {
+            if ((mreq.imr_interface.s_addr = inet_addr(ifname)) == INADDR_NONE)
+            {
+            #ifdef _WIN32
+                WSASetLastError(WSAEINVAL);
+            #else
+                errno = EINVAL;
+            #endif
+                return -1;
+            }
+        }
+        else mreq.imr_interface.s_addr = INADDR_ANY;
+        return setsockopt(socket, IPPROTO_IP,
+            (join ? IP_ADD_MEMBERSHIP : IP_DROP_MEMBERSHIP),
+                (char *)&mreq, sizeof(mreq));
     }
     return -1;
 }
 
+int socket_join_multicast_group(int socket, const struct sockaddr *sa)
+{
+    return socket_set_multicast_membership(socket, sa, NULL, 1);
+}
+
 int socket_leave_multicast_group(int socket, const struct sockaddr *sa)
 {
-    if (sa->sa_family == AF_INET6)
-    {
-        struct sockaddr_in6 *sa6 = (struct sockaddr_in6 *)sa;
-        struct ipv6_mreq mreq6 = {0};
-        memcpy(&mreq6.ipv6mr_multiaddr, &sa6->sin6_addr,
-            sizeof(struct in6_addr));
-        return setsockopt(socket, IPPROTO_IPV6, IPV6_LEAVE_GROUP,
-            (char *)&mreq6, sizeof(mreq6));
-    }
-    else if (sa->sa_family == AF_INET)
-    {
-        struct sockaddr_in *sa4 = (struct sockaddr_in *)sa;
-        struct ip_mreq mreq = {0};
-        mreq.imr_multiaddr.s_addr = sa4->sin_addr.s_addr;
-        mreq.imr_interface.s_addr = INADDR_ANY;
-        return setsockopt(socket, IPPROTO_IP, IP_DROP_MEMBERSHIP,
-            (char *)&mreq, sizeof(mreq));
-    }
+    return socket_set_multicast_membership(socket, sa, NULL, 0);
+}
+
+int socket_set_reuseport(int socket, int value)
+{
+#ifdef SO_REUSEPORT
+    return socket_set_boolopt(socket, SOL_SOCKET, SO_REUSEPORT, value);
+#else
     return -1;
+#endif
 }
 
 int socket_errno(void)
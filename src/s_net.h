@@ -16,6 +16,8 @@ typedef int socklen_t;
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <netdb.h>
+#include <sys/un.h>
+#define NET_UNIXSOCKETS
 #endif
 
 #ifndef NET_MAXPACKETSIZE
@@ -101,6 +103,34 @@ void sockaddr_set_port(const struct sockaddr *sa, unsigned int port);
     /** returns 1 if address is a IPv4 or IPv6 multicast address, otherwise 0 */
 int sockaddr_is_multicast(const struct sockaddr *sa);
 
+    /** returns the length of an IPv4, IPv6, or Unix-domain sockaddr,
+        as needed for sendto() and bind() */
+socklen_t sockaddr_get_len(const struct sockaddr *sa);
+
+/* ----- Unix-domain sockets ----- */
+
+    /** returns 1 if a host name is really the path of a Unix-domain
+        socket (which we take to mean it contains a '/'), otherwise 0 */
+int sockaddr_is_unixpath(const char *name);
+
+    /** fill in a Unix-domain sockaddr for a path, returns its length
+        or -1 if the path is too long or Unix-domain sockets aren't
+        supported on this platform */
+int sockaddr_set_unixpath(struct sockaddr_storage *ss, const char *path);
+
+    /** create a Unix-domain socket (SOCK_STREAM or SOCK_DGRAM) bound to
+        a path, first removing a stale socket file left there by an earlier
+        process.  returns the socket or -1 on error */
+int socket_bind_unix(const char *path, int protocol);
+
+    /** terminate the path in a Unix-domain sockaddr of the length returned
+        by recvfrom() or getpeername(); an unbound sender has none at all,
+        in which case the family may come back AF_UNSPEC */
+void sockaddr_end_unixpath(struct sockaddr_storage *ss, socklen_t len);
+
+    /** remove a Unix-domain socket file, but only if it is one */
+void socket_unlink_unix(const char *path);
+
 /* ----- socket ----- */
 
     /** cross-platform initialization routine, returns -1 on failure */
@@ -133,6 +163,17 @@ int socket_join_multicast_group(int socket, const struct sockaddr *sa);
     /** leave a multicast group address, returns < 0 on error */
 int socket_leave_multicast_group(int socket, const struct sockaddr *sa);
 
+    /** join (or leave) a multicast group address on a given interface:
+        an IPv4 address, or an IPv6 interface index or (not on Windows)
+        name; NULL for the default.  returns < 0 on error */
+int socket_set_multicast_membership(int socket, const struct sockaddr *sa,
+    const char *ifname, int join);
+
+    /** enable/disable SO_REUSEPORT, which lets several sockets bind the same
+        port and has the kernel spread incoming datagrams (or connections)
+        among them.  returns < 0 on error or where it's not supported */
+int socket_set_reuseport(int socket, int value);
+
     /** cross-platform socket errno() which catches
         WSAESOCKTNOSUPPORT on Windows */
 int socket_errno(void);
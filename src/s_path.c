@@ -39,6 +39,11 @@
 #include <stdio.h>
 #include <fcntl.h>
 #include <ctype.h>
+#ifdef HAVE_UNISTD_H
+#include <dirent.h>
+#include <time.h>
+#include <pthread.h>
+#endif
 
 #ifdef _LARGEFILE64_SOURCE
 # define open  open64
@@ -273,6 +278,369 @@ void sys_setextrapath(const char *p)
     The "bin" flag requests opening for binary (which only makes a difference
     on Windows). */
 
+/* Cache of directory listings, so that looking for an object or file
+along the search path (which tries every directory, and for externs every
+extension) only opens files that are there.  Each directory we look in
+is listed once and its file names kept, lower-cased so that a
+case-insensitive file system can't make us miss a file; a name that isn't
+in the listing is known to be absent without any system call.  If the
+listing is more than PATHCACHE_RECHECK seconds old we check the
+directory's modification time again and relist it if it changed (or might
+have), so new files are found.  Directories we can't list (or that are huge) are
+searched directly as before.  Not used on Windows.
+
+Files Pd creates itself, through sys_open() or sys_fopen(), may be looked
+for right away (as when "soundfiler" reads back a file it just wrote), so
+each creation bumps a counter, and a name missing from a listing made
+before the latest creation is checked against a fresh listing.  Files can
+be created from other threads, which don't have the instance's cache, so
+the counter is global and atomic, and is bumped once the file exists. */
+
+static long pathcache_generation;   /* number of files created so far */
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PATHCACHE_GENERATION() \
+    __atomic_load_n(&pathcache_generation, __ATOMIC_ACQUIRE)
+#define PATHCACHE_CREATED() \
+    __atomic_add_fetch(&pathcache_generation, 1, __ATOMIC_RELEASE)
+#elif defined(_MSC_VER)
+#define PATHCACHE_GENERATION() \
+    InterlockedCompareExchange(&pathcache_generation, 0, 0)
+#define PATHCACHE_CREATED() InterlockedIncrement(&pathcache_generation)
+#else
+#define PATHCACHE_GENERATION() (*(volatile long *)&pathcache_generation)
+#define PATHCACHE_CREATED() ((*(volatile long *)&pathcache_generation)++)
+#endif
+
+#ifdef HAVE_UNISTD_H
+
+#define PATHCACHE_RECHECK 1.
+#define PATHCACHE_MAXFILES 20000
+
+#define DI_UNLISTED -1      /* values of di_nfiles if there's no listing */
+#define DI_MISSING -2
+
+typedef struct _dirindex
+{
+    char *di_dir;
+    time_t di_mtime;        /* directory's modification time */
+    time_t di_listtime;     /* clock time when listed */
+    double di_checktime;    /* real time we last checked directory */
+    long di_generation;     /* pathcache_generation when listed */
+    int di_nfiles;          /* number of names, or DI_UNLISTED/DI_MISSING */
+    char **di_files;        /* lower-case file names, sorted */
+    struct _dirindex *di_next;
+} t_dirindex;
+
+static int dirindex_compare(const void *a, const void *b)
+{
+    return (strcmp(*(const char **)a, *(const char **)b));
+}
+
+static void dirindex_lower(char *s)
+{
+    for (; *s; s++)
+        *s = tolower(*(unsigned char *)s);
+}
+
+static void dirindex_clear(t_dirindex *di)
+{
+    int i;
+    for (i = 0; i < di->di_nfiles; i++)
+        freebytes(di->di_files[i], strlen(di->di_files[i]) + 1);
+    if (di->di_nfiles > 0)
+        freebytes(di->di_files, di->di_nfiles * sizeof(*di->di_files));
+    di->di_files = 0;
+    di->di_nfiles = DI_UNLISTED;
+}
+
+static void dirindex_list(t_dirindex *di)
+{
+    struct stat statbuf;
+    struct dirent *ent;
+    DIR *dp;
+    int n = 0, nalloc = 0;
+    char **files = 0;
+    dirindex_clear(di);
+    di->di_generation = PATHCACHE_GENERATION();
+    if (stat(di->di_dir, &statbuf) < 0)
+    {
+        di->di_nfiles = DI_MISSING;
+        di->di_mtime = 0;
+        return;
+    }
+    di->di_mtime = statbuf.st_mtime;
+    di->di_listtime = time(0);
+    if (!(dp = opendir(di->di_dir)))
+        return;
+    while ((ent = readdir(dp)))
+    {
+        size_t len = strlen(ent->d_name);
+        if (n == PATHCACHE_MAXFILES)
+            break;
+        if (n == nalloc)
+        {
+            int newalloc = (nalloc ? 2 * nalloc : 64);
+            files = (char **)(files ? resizebytes(files,
+                nalloc * sizeof(*files), newalloc * sizeof(*files)) :
+                    getbytes(newalloc * sizeof(*files)));
+            nalloc = newalloc;
+        }
+        files[n] = (char *)getbytes(len + 1);
+        strcpy(files[n], ent->d_name);
+        dirindex_lower(files[n]);
+        n++;
+    }
+    closedir(dp);
+    if (ent)    /* too many files to bother with */
+    {
+        while (n--)
+            freebytes(files[n], strlen(files[n]) + 1);
+        freebytes(files, nalloc * sizeof(*files));
+        return;
+    }
+    if (n)
+    {
+        files = (char **)resizebytes(files, nalloc * sizeof(*files),
+            n * sizeof(*files));
+        qsort(files, n, sizeof(*files), dirindex_compare);
+    }
+    else if (files)
+        freebytes(files, nalloc * sizeof(*files)), files = 0;
+    di->di_files = files;
+    di->di_nfiles = n;
+}
+
+    /* split a path into the directory the cache keys it by and the
+    lower-cased file name.  Return 0 if either is too long. */
+static int pathcache_split(const char *path, char *dir, char *file)
+{
+    const char *slash = strrchr(path, '/');
+    if (slash)
+    {
+        int dirlen = (int)(slash - path);
+        if (dirlen >= MAXPDSTRING)
+            return (0);
+        strncpy(dir, path, dirlen);
+        dir[dirlen] = 0;
+        if (!dirlen)
+            strcpy(dir, "/");
+        slash++;
+    }
+    else strcpy(dir, "."), slash = path;
+    if (strlen(slash) >= MAXPDSTRING)
+        return (0);
+    strcpy(file, slash);
+    dirindex_lower(file);
+    return (1);
+}
+
+static t_dirindex *pathcache_find(const char *dir)
+{
+    t_dirindex *di;
+    for (di = STUFF->st_pathcache; di; di = di->di_next)
+        if (!strcmp(di->di_dir, dir))
+            return (di);
+    return (0);
+}
+
+    /* return 0 if the file named by "path" surely doesn't exist */
+static int pathcache_mightexist(const char *path)
+{
+    char dir[MAXPDSTRING], file[MAXPDSTRING], *key = file;
+    t_dirindex *di;
+    double now = sys_getrealtime();
+    if (!pathcache_split(path, dir, file))
+        return (1);
+    if (!(di = pathcache_find(dir)))
+    {
+        di = (t_dirindex *)getbytes(sizeof(*di));
+        di->di_dir = (char *)getbytes(strlen(dir) + 1);
+        strcpy(di->di_dir, dir);
+        di->di_nfiles = DI_UNLISTED;
+        di->di_next = STUFF->st_pathcache;
+        STUFF->st_pathcache = di;
+        dirindex_list(di);
+        di->di_checktime = now;
+    }
+    else if (now > di->di_checktime + PATHCACHE_RECHECK)
+    {
+        struct stat statbuf;
+            /* modification times are only to the second, so if the
+            directory was changed in the second we listed it, we can't
+            tell whether it changed again afterward; list it again. */
+        if (stat(dir, &statbuf) < 0 ? di->di_nfiles != DI_MISSING :
+            (di->di_nfiles == DI_MISSING || statbuf.st_mtime != di->di_mtime
+                || di->di_mtime >= di->di_listtime - 1))
+                    dirindex_list(di);
+        di->di_checktime = now;
+    }
+    if (di->di_nfiles == DI_UNLISTED)
+        return (1);
+    if (di->di_nfiles != DI_MISSING && bsearch(&key, di->di_files,
+        di->di_nfiles, sizeof(*di->di_files), dirindex_compare))
+            return (1);
+        /* not there; but Pd might have created it since we listed */
+    if (di->di_generation == PATHCACHE_GENERATION())
+        return (0);
+    dirindex_list(di);
+    di->di_checktime = now;
+    if (di->di_nfiles == DI_MISSING)
+        return (0);
+    return (di->di_nfiles == DI_UNLISTED || bsearch(&key, di->di_files,
+        di->di_nfiles, sizeof(*di->di_files), dirindex_compare));
+}
+
+    /* run "fn" on each of "n" items, from up to PREFETCH_MAXTHREADS threads
+    that each take the next item not yet taken.  The items are independent
+    and "fn" may not post or touch Pd's state. */
+#define PREFETCH_MAXTHREADS 8
+
+typedef struct _prefetchjob
+{
+    void (*j_fn)(void *item);
+    void **j_items;
+    int j_n;
+    int j_next;
+    pthread_mutex_t j_mutex;
+} t_prefetchjob;
+
+static void *prefetch_work(void *z)
+{
+    t_prefetchjob *j = (t_prefetchjob *)z;
+    while (1)
+    {
+        int i;
+        pthread_mutex_lock(&j->j_mutex);
+        i = j->j_next++;
+        pthread_mutex_unlock(&j->j_mutex);
+        if (i >= j->j_n)
+            return (0);
+        (*j->j_fn)(j->j_items[i]);
+    }
+}
+
+static void prefetch_parallel(void (*fn)(void *item), void **items, int n)
+{
+    pthread_t thread[PREFETCH_MAXTHREADS];
+    int started[PREFETCH_MAXTHREADS], nthreads, i;
+    t_prefetchjob j;
+    j.j_fn = fn;
+    j.j_items = items;
+    j.j_n = n;
+    j.j_next = 0;
+    pthread_mutex_init(&j.j_mutex, 0);
+    nthreads = (n > PREFETCH_MAXTHREADS ? PREFETCH_MAXTHREADS : n);
+        /* the calling thread works too */
+    for (i = 1; i < nthreads; i++)
+        started[i] = !pthread_create(&thread[i], 0, prefetch_work, &j);
+    prefetch_work(&j);
+    for (i = 1; i < nthreads; i++)
+        if (started[i])
+            pthread_join(thread[i], 0);
+    pthread_mutex_destroy(&j.j_mutex);
+}
+
+static void prefetch_listone(void *z)
+{
+    dirindex_list((t_dirindex *)z);
+}
+
+    /* list the directories of all the given paths into the cache at once,
+    in parallel; those already in the cache are left alone.  The paths are
+    expanded as by sys_trytoopenone().  This is for finding many files at
+    startup when each system call might be slow (as on a network file
+    system). */
+void sys_pathcache_prefetch(int npath, char **paths)
+{
+    char path[MAXPDSTRING], dir[MAXPDSTRING], file[MAXPDSTRING];
+    t_dirindex **list, *di;
+    int nlist = 0, i, j;
+    double now = sys_getrealtime();
+    if (!npath)
+        return;
+    list = (t_dirindex **)getbytes(npath * sizeof(*list));
+    for (i = 0; i < npath; i++)
+    {
+        sys_expandpath(paths[i], path, MAXPDSTRING);
+        if (!pathcache_split(path, dir, file) || pathcache_find(dir))
+            continue;
+        for (j = 0; j < nlist; j++)
+            if (!strcmp(list[j]->di_dir, dir))
+                break;
+        if (j < nlist)
+            continue;
+        di = (t_dirindex *)getbytes(sizeof(*di));
+        di->di_dir = (char *)getbytes(strlen(dir) + 1);
+        strcpy(di->di_dir, dir);
+        di->di_nfiles = DI_UNLISTED;
+        di->di_files = 0;
+        list[nlist++] = di;
+    }
+    prefetch_parallel(prefetch_listone, (void **)list, nlist);
+    for (i = 0; i < nlist; i++)
+    {
+        list[i]->di_checktime = now;
+        list[i]->di_next = STUFF->st_pathcache;
+        STUFF->st_pathcache = list[i];
+    }
+    freebytes(list, npath * sizeof(*list));
+}
+
+static void prefetch_readone(void *z)
+{
+    char buf[65536];
+    int fd = open((const char *)z, O_RDONLY);
+    if (fd < 0)
+        return;
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+    while (read(fd, buf, sizeof(buf)) > 0)
+        ;
+    close(fd);
+}
+
+    /* read the given files through, in parallel, so that their pages are
+    in memory when they're used (such as by dlopen()) */
+void sys_prefetchfiles(int nfile, char **files)
+{
+    prefetch_parallel(prefetch_readone, (void **)files, nfile);
+}
+
+void sys_freepathcache(void)
+{
+    t_dirindex *di;
+    while ((di = STUFF->st_pathcache))
+    {
+        STUFF->st_pathcache = di->di_next;
+        dirindex_clear(di);
+        freebytes(di->di_dir, strlen(di->di_dir) + 1);
+        freebytes(di, sizeof(*di));
+    }
+}
+
+#else /* HAVE_UNISTD_H */
+
+static int pathcache_mightexist(const char *path)
+{
+    return (1);
+}
+
+void sys_pathcache_prefetch(int npath, char **paths)
+{
+}
+
+void sys_prefetchfiles(int nfile, char **files)
+{
+}
+
+void sys_freepathcache(void)
+{
+}
+
+#endif /* HAVE_UNISTD_H */
+
 int sys_trytoopenone(const char *dir, const char *name, const char* ext,
     char *dirresult, char **nameresult, unsigned int size, int bin)
 {
@@ -289,7 +657,8 @@ int sys_trytoopenone(const char *dir, const char *name, const char* ext,
 
     DEBUG(post("looking for %s",dirresult));
         /* see if we can open the file for reading */
-    if ((fd=sys_open(dirresult, O_RDONLY)) >= 0)
+    if (pathcache_mightexist(dirresult) &&
+        (fd=sys_open(dirresult, O_RDONLY)) >= 0)
     {
             /* in unix, further check that it's not a directory */
 #ifdef HAVE_UNISTD_H
@@ -417,12 +786,18 @@ int sys_open(const char *path, int oflag, ...)
     int i, fd;
     char pathbuf[MAXPDSTRING];
     wchar_t ucs2path[MAXPDSTRING];
+    if (ugen_rtregion)
+        ugen_rtviolation(RT_OPEN);
     sys_bashfilename(path, pathbuf);
     u8_utf8toucs2(ucs2path, MAXPDSTRING, pathbuf, MAXPDSTRING-1);
     /* For the create mode, Win32 does not have the same possibilities,
      * so we ignore the argument and just hard-code read/write. */
     if (oflag & O_CREAT)
-        fd = _wopen(ucs2path, oflag | O_BINARY, _S_IREAD | _S_IWRITE);
+    {
+        if ((fd = _wopen(ucs2path, oflag | O_BINARY,
+            _S_IREAD | _S_IWRITE)) >= 0)
+                PATHCACHE_CREATED();
+    }
     else
         fd = _wopen(ucs2path, oflag | O_BINARY);
     return fd;
@@ -433,11 +808,16 @@ FILE *sys_fopen(const char *filename, const char *mode)
     char namebuf[MAXPDSTRING];
     wchar_t ucs2buf[MAXPDSTRING];
     wchar_t ucs2mode[MAXPDSTRING];
+    FILE *fp;
+    if (ugen_rtregion)
+        ugen_rtviolation(RT_OPEN);
     sys_bashfilename(filename, namebuf);
     u8_utf8toucs2(ucs2buf, MAXPDSTRING, namebuf, MAXPDSTRING-1);
     /* mode only uses ASCII, so no need for a full conversion, just copy it */
     mbstowcs(ucs2mode, mode, MAXPDSTRING);
-    return (_wfopen(ucs2buf, ucs2mode));
+    if ((fp = _wfopen(ucs2buf, ucs2mode)) && (*mode == 'w' || *mode == 'a'))
+        PATHCACHE_CREATED();
+    return (fp);
 }
 #else
 #include <stdarg.h>
@@ -445,6 +825,8 @@ int sys_open(const char *path, int oflag, ...)
 {
     int i, fd;
     char pathbuf[MAXPDSTRING];
+    if (ugen_rtregion)
+        ugen_rtviolation(RT_OPEN);
     sys_bashfilename(path, pathbuf);
     if (oflag & O_CREAT)
     {
@@ -463,7 +845,8 @@ int sys_open(const char *path, int oflag, ...)
         imode = va_arg (ap, int);
         mode = (mode_t)imode;
         va_end(ap);
-        fd = open(pathbuf, oflag, mode);
+        if ((fd = open(pathbuf, oflag, mode)) >= 0)
+            PATHCACHE_CREATED();
     }
     else
         fd = open(pathbuf, oflag);
@@ -473,8 +856,13 @@ int sys_open(const char *path, int oflag, ...)
 FILE *sys_fopen(const char *filename, const char *mode)
 {
   char namebuf[MAXPDSTRING];
+  FILE *fp;
+  if (ugen_rtregion)
+      ugen_rtviolation(RT_OPEN);
   sys_bashfilename(filename, namebuf);
-  return fopen(namebuf, mode);
+  if ((fp = fopen(namebuf, mode)) && (*mode == 'w' || *mode == 'a'))
+      PATHCACHE_CREATED();
+  return fp;
 }
 #endif /* _WIN32 */
 
@@ -8,7 +8,11 @@
 #include <stdarg.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 #include "s_stuff.h"
+#ifndef _WIN32
+#include <syslog.h>
+#endif
 
 #ifdef _MSC_VER
 #define snprintf _snprintf
@@ -16,6 +20,214 @@
 
 t_printhook sys_printhook = NULL;
 int sys_printtostderr;
+int sys_printlimit;     /* lines a second from any one source, or 0 */
+
+/* ------------- copying what's printed to a file or the system log ------ */
+
+/* Besides going to the GUI (or stderr, or the print hook), printout can
+be copied to a log file or to the system log.  Whole lines are handed to
+the I/O thread (see sys_iodefer() in s_inter.c), which does the writing,
+so that a slow disk never holds up the scheduler.  If the thread falls
+behind, lines are dropped and the number dropped is logged later. */
+
+static FILE *print_logfile;
+static int print_syslog;
+static char print_line[MAXPDSTRING];    /* line being gathered */
+static int print_linelen;
+static int print_dropped;
+
+    /* write one line; the first byte says whether it's an error.  Called
+    from the I/O thread. */
+static void print_writeline(const char *buf, int length)
+{
+    if (print_logfile)
+    {
+        char stamp[40];
+        time_t now = time(0);
+        struct tm tm;
+#ifdef _WIN32
+        tm = *localtime(&now);
+#else
+        localtime_r(&now, &tm);
+#endif
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+        fprintf(print_logfile, "%s %s%.*s", stamp,
+            (buf[0] == 'e' ? "error: " : ""), length - 1, buf + 1);
+        fflush(print_logfile);
+    }
+#ifndef _WIN32
+    if (print_syslog)
+        syslog((buf[0] == 'e' ? LOG_ERR : LOG_INFO), "%.*s",
+            length - 2, buf + 1);   /* without the newline */
+#endif
+}
+
+static void print_sendline(const char *buf, int length)
+{
+#if PDTHREADS
+    if (print_dropped)
+    {
+        char msg[80];
+        snprintf(msg, sizeof(msg), "p(%d lines dropped from the log)\n",
+            print_dropped);
+        if (sys_iodefer(print_writeline, msg, (int)strlen(msg)) < 0)
+        {
+            print_dropped++;
+            return;
+        }
+        print_dropped = 0;
+    }
+    if (sys_iodefer(print_writeline, buf, length) < 0)
+        print_dropped++;
+#else
+    print_writeline(buf, length);
+#endif
+}
+
+    /* gather printout into lines for the log */
+static void print_tolog(int iserror, const char *s)
+{
+    if (!print_logfile && !print_syslog)
+        return;
+    for (; *s; s++)
+    {
+        if (!print_linelen)
+            print_line[print_linelen++] = (iserror ? 'e' : 'p');
+        if (*s != '\n')
+            print_line[print_linelen++] = *s;
+        if (*s == '\n' || print_linelen >= MAXPDSTRING - 1)
+        {
+            print_line[print_linelen++] = '\n';
+            print_sendline(print_line, print_linelen);
+            print_linelen = 0;
+        }
+    }
+}
+
+int sys_setlogfile(const char *filename)
+{
+    FILE *fd = sys_fopen(filename, "a");
+    if (!fd)
+    {
+        fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+        return (-1);
+    }
+    if (print_logfile)
+        fclose(print_logfile);
+    print_logfile = fd;
+    return (0);
+}
+
+void sys_setsyslog(int onoff)
+{
+#ifndef _WIN32
+    if (onoff && !print_syslog)
+        openlog("pd", LOG_PID, LOG_USER);
+    else if (!onoff && print_syslog)
+        closelog();
+    print_syslog = (onoff != 0);
+#endif
+}
+
+/* ------------------------- rate limiting ------------------------ */
+
+/* With a limit set, each [print] object, and each object reporting
+errors, may print that many lines per second of logical time.  The rest
+are counted and a summary printed once the second is up.  Sources share
+a small table by address, so two that collide take turns, which only
+ever loosens the limit. */
+
+#define PRINTSOURCES 64
+
+typedef struct _printsource
+{
+    const void *ps_source;
+    t_symbol *ps_name;      /* name to report suppressed lines under */
+    double ps_start;        /* logical time this second began */
+    int ps_count;           /* lines asked for this second */
+    int ps_suppressed;      /* ... and not printed */
+    int ps_iserror;
+} t_printsource;
+
+static t_printsource print_source[PRINTSOURCES];
+static t_clock *print_clock;
+static int print_clockset;
+
+static void doerror(const void *object, const char *s);
+static void dopost(const char *s);
+
+static void print_summarize(t_printsource *ps)
+{
+    char buf[MAXPDSTRING];
+    if (!ps->ps_suppressed)
+        return;
+    snprintf(buf, MAXPDSTRING-1, "%s: %d message%s suppressed\n",
+        ps->ps_name->s_name, ps->ps_suppressed,
+        (ps->ps_suppressed == 1 ? "" : "s"));
+    buf[MAXPDSTRING-1] = 0;
+    ps->ps_suppressed = 0;
+    if (ps->ps_iserror)
+        doerror(ps->ps_source, buf);
+    else dopost(buf);
+}
+
+static void print_tick(void *dummy)
+{
+    int i, more = 0;
+    print_clockset = 0;
+    for (i = 0; i < PRINTSOURCES; i++)
+        if (print_source[i].ps_suppressed)
+    {
+        if (clock_gettimesince(print_source[i].ps_start) >= 1000)
+            print_summarize(&print_source[i]);
+        else more = 1;
+    }
+    if (more)
+    {
+        clock_delay(print_clock, 100);
+        print_clockset = 1;
+    }
+}
+
+static int print_allow(const void *source, t_symbol *name, int iserror)
+{
+    t_printsource *ps;
+    if (sys_printlimit <= 0)
+        return (1);
+    ps = &print_source[((size_t)source >> 4) % PRINTSOURCES];
+    if (ps->ps_source != source || !ps->ps_name ||
+        clock_gettimesince(ps->ps_start) >= 1000)
+    {
+        print_summarize(ps);
+        ps->ps_source = source;
+        ps->ps_name = name;
+        ps->ps_iserror = iserror;
+        ps->ps_start = clock_getlogicaltime();
+        ps->ps_count = 0;
+    }
+    if (ps->ps_count++ < sys_printlimit)
+        return (1);
+    ps->ps_suppressed++;
+    if (!print_clockset)
+    {
+        if (!print_clock)
+            print_clock = clock_new(0, (t_method)print_tick);
+        clock_delay(print_clock, 100);
+        print_clockset = 1;
+    }
+    return (0);
+}
+
+    /* called by [print] before printing a line */
+int sys_printallow(const void *source, t_symbol *name)
+{
+    return (print_allow(source, name, 0));
+}
+
+void glob_printlimit(t_pd *dummy, t_floatarg f)
+{
+    sys_printlimit = (f > 0 ? f : 0);
+}
 
 /* escape characters for tcl/tk */
 char* pdgui_strnescape(char *dst, size_t dstlen, const char *src, size_t srclen)
@@ -50,6 +262,9 @@ char* pdgui_strnescape(char *dst, size_t dstlen, const char *src, size_t srclen)
 
 static void dopost(const char *s)
 {
+    if (audio_pipeline_print('p', s))
+        return;
+    print_tolog(0, s);
     if (STUFF->st_printhook)
         (*STUFF->st_printhook)(s);
     else if (sys_printtostderr || !sys_havegui())
@@ -77,6 +292,9 @@ static void doerror(const void *object, const char *s)
     char upbuf[MAXPDSTRING];
     upbuf[MAXPDSTRING-1]=0;
 
+    if (audio_pipeline_print('e', s))
+        return;
+    print_tolog(1, s);
     // what about sys_printhook_error ?
     if (STUFF->st_printhook)
     {
@@ -109,6 +327,9 @@ static void dologpost(const void *object, const int level, const char *s)
             nothing */
     if (level >= PD_VERBOSE && !sys_verbose)
         return;
+    if (audio_pipeline_print('0' + level, s))
+        return;
+    print_tolog(level <= PD_ERROR, s);
     // what about sys_printhook_verbose ?
     if (STUFF->st_printhook)
     {
@@ -133,6 +354,17 @@ static void dologpost(const void *object, const int level, const char *s)
             object, level, pdgui_strnescape(upbuf, MAXPDSTRING, s, 0));
 }
 
+    /* print what the "-pipeline" audio thread recorded (s_audio.c): "kind"
+    is 'p' for post, 'e' for error, or '0' plus the level for logpost */
+void sys_printdeferred(int kind, const char *s)
+{
+    if (kind == 'p')
+        dopost(s);
+    else if (kind == 'e')
+        doerror(0, s);
+    else dologpost(0, kind - '0', s);
+}
+
 void logpost(const void *object, int level, const char *fmt, ...)
 {
     char buf[MAXPDSTRING];
@@ -215,10 +447,13 @@ void postfloat(t_float f)
 
 void endpost(void)
 {
-    if (STUFF->st_printhook)
-        (*STUFF->st_printhook)("\n");
-    else if (sys_printtostderr)
-        fprintf(stderr, "\n");
+    if (STUFF->st_printhook || sys_printtostderr)
+    {
+        print_tolog(0, "\n");
+        if (STUFF->st_printhook)
+            (*STUFF->st_printhook)("\n");
+        else fprintf(stderr, "\n");
+    }
     else post("");
 }
 
@@ -275,6 +510,9 @@ void pd_error(const void *object, const char *fmt, ...)
     int i;
     static int saidit;
 
+    if (object && !print_allow(object,
+        gensym(class_getname(pd_class((t_pd *)object))), 1))
+        return;
     va_start(ap, fmt);
     vsnprintf(buf, MAXPDSTRING-1, fmt, ap);
     va_end(ap);
@@ -0,0 +1,410 @@
+/* Copyright (c) 1997- Miller Puckette and others.
+* For information on usage and redistribution, and for a DISCLAIMER OF ALL
+* WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+/* Recording external input and playing it back, so that a performance
+problem that depends on live input can be reproduced offline.  While "pd
+input-log <file>" (or the "-inputlog <file>" flag) is on, everything that
+comes in from outside is written to a binary log stamped with the number of
+DSP ticks since recording started: MIDI bytes as they're dispatched (with
+their sample offsets into the block), messages from the GUI and from
+netsend/netreceive connections as socketreceiver_read() parses them, and
+the audio input each tick gets in STUFF->st_soundin (a silent block takes
+just a few bytes).
+
+"-replay <file>" runs Pd in batch mode and feeds the log back at the same
+ticks, which makes the run deterministic: each tick's input goes in after
+the same tick as before and its DSP sees the same audio input.  Pd quits at
+the end of the log and prints how long the replay took.  Socket messages are
+sent to the netsend or netreceive object created in the same order as when
+recording (so the same patch has to be loaded) -- there needn't be any
+connection.  GUI messages whose receiver doesn't exist are dropped, which
+is the case for most of them since canvas names depend on where the canvas
+was in memory; "pd" messages and the like go through.  The log is written in
+the machine's byte order. */
+
+#include "m_pd.h"
+#include "m_imp.h"
+#include "s_stuff.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef _MSC_VER
+#define snprintf _snprintf
+#endif
+
+#define REPLAYMAGIC "PDINPUT1"
+#define REPLAYBUFSIZE (1 << 20)     /* stdio buffer for the log */
+#define REPLAYIDSIZE 64
+
+#define REPLAY_MIDI 1       /* port, byte, offset */
+#define REPLAY_MESSAGE 2    /* source id, zero, message text */
+#define REPLAY_AUDIO 3      /* channel count, then the block as floats */
+#define REPLAY_SILENCE 4    /* channel count of a block that was all zero */
+
+typedef struct _replayhead
+{
+    unsigned int h_tick;        /* ticks since the start of the log */
+    unsigned int h_type;
+    unsigned int h_size;        /* bytes that follow */
+} t_replayhead;
+
+    /* an object that receives messages from sockets, under an id that's the
+    same from one run to the next */
+typedef struct _replaysource
+{
+    void *s_owner;
+    t_socketreceivefn s_fn;
+    char s_id[REPLAYIDSIZE];
+    struct _replaysource *s_next;
+} t_replaysource;
+
+    /* how many of each class have been made, to number them */
+typedef struct _replaycount
+{
+    t_symbol *c_name;
+    int c_n;
+    struct _replaycount *c_next;
+} t_replaycount;
+
+int sys_inputrecording;
+int sys_inputreplaying;
+
+static FILE *replay_fd;
+static char *replay_buf;            /* stdio buffer */
+static int replay_starttick;
+static int replay_started;          /* replay: set at the first tick */
+static double replay_starttime;
+static t_replayhead replay_next;    /* replay: next record, not yet used */
+static int replay_havenext;
+static char *replay_payload;        /* replay: space to read records into */
+static size_t replay_payloadsize;
+static int replay_ndropped;
+static t_replaysource *replay_sources;
+static t_replaycount *replay_counts;
+static float *replay_floats;        /* recording, if t_sample isn't float */
+static int replay_nfloats;
+static t_binbuf *replay_binbuf;
+
+    /* netsend and netreceive objects call this when created and freed.  Ids
+    are the class name and how many of the class have been created before,
+    which depends only on the order the patch is loaded in. */
+void sys_inputsource(void *owner, t_socketreceivefn fn, int add)
+{
+    t_replaysource *s, **sp;
+    if (add)
+    {
+        t_symbol *name = (*(t_pd *)owner)->c_name;
+        t_replaycount *c;
+        for (c = replay_counts; c; c = c->c_next)
+            if (c->c_name == name)
+                break;
+        if (!c)
+        {
+            c = (t_replaycount *)getbytes(sizeof(*c));
+            c->c_name = name;
+            c->c_n = 0;
+            c->c_next = replay_counts;
+            replay_counts = c;
+        }
+        s = (t_replaysource *)getbytes(sizeof(*s));
+        s->s_owner = owner;
+        s->s_fn = fn;
+        snprintf(s->s_id, REPLAYIDSIZE, "%s#%d", name->s_name, c->c_n++);
+        s->s_next = replay_sources;
+        replay_sources = s;
+    }
+    else for (sp = &replay_sources; (s = *sp); sp = &s->s_next)
+        if (s->s_owner == owner)
+    {
+        *sp = s->s_next;
+        freebytes(s, sizeof(*s));
+        break;
+    }
+}
+
+/* ------------------------------ recording ------------------------------ */
+
+static void replay_write(int type, const void *data1, size_t size1,
+    const void *data2, size_t size2)
+{
+    t_replayhead h;
+    h.h_tick = STUFF->st_tickcount - replay_starttick;
+    h.h_type = type;
+    h.h_size = (unsigned int)(size1 + size2);
+    if (fwrite(&h, sizeof(h), 1, replay_fd) != 1 ||
+        (size1 && fwrite(data1, size1, 1, replay_fd) != 1) ||
+        (size2 && fwrite(data2, size2, 1, replay_fd) != 1))
+    {
+        pd_error(0, "input-log: write failed; stopping");
+        sys_inputlog(0);
+    }
+}
+
+    /* a MIDI byte being dispatched (s_midi.c) */
+void sys_recordmidi(int portno, int byte, int offset)
+{
+    unsigned char b[4];
+    b[0] = portno;
+    b[1] = byte;
+    b[2] = offset;
+    b[3] = 0;
+    replay_write(REPLAY_MIDI, b, 4, 0, 0);
+}
+
+    /* a message from a socket (s_inter.c); "owner" is zero for the GUI */
+void sys_recordmessage(void *owner, t_binbuf *b)
+{
+    const char *id = 0;
+    char *text;
+    int length;
+    t_replaysource *s;
+    if (!owner)
+        id = "gui";
+    else for (s = replay_sources; s; s = s->s_next)
+        if (s->s_owner == owner)
+            id = s->s_id;
+    if (!id)
+        return;     /* an external's socket; we couldn't replay it */
+    binbuf_gettext(b, &text, &length);
+    replay_write(REPLAY_MESSAGE, id, strlen(id) + 1, text, length);
+    freebytes(text, length);
+}
+
+/* ------------------------------ replaying ------------------------------ */
+
+    /* read the next record's header if we haven't yet */
+static int replay_peek(void)
+{
+    if (!replay_havenext)
+        replay_havenext =
+            (fread(&replay_next, sizeof(replay_next), 1, replay_fd) == 1);
+    return (replay_havenext);
+}
+
+static char *replay_read(void)
+{
+    size_t size = replay_next.h_size;
+    replay_havenext = 0;
+    if (size + 1 > replay_payloadsize)
+    {
+        replay_payload = (char *)resizebytes(replay_payload,
+            replay_payloadsize, size + 1);
+        replay_payloadsize = size + 1;
+    }
+    if (size && fread(replay_payload, size, 1, replay_fd) != 1)
+        return (0);
+    replay_payload[size] = 0;
+    return (replay_payload);
+}
+
+static void replay_message(const char *id, const char *text, int length)
+{
+    t_replaysource *s;
+    binbuf_text(replay_binbuf, text, length);
+    outlet_setstacklim();
+    if (!strcmp(id, "gui"))
+    {
+        t_atom *at = binbuf_getvec(replay_binbuf);
+        if (binbuf_getnatom(replay_binbuf) && at->a_type == A_SYMBOL &&
+            at->a_w.w_symbol->s_thing)
+                binbuf_eval(replay_binbuf, 0, 0, 0);
+        else replay_ndropped++;
+        return;
+    }
+    for (s = replay_sources; s; s = s->s_next)
+        if (!strcmp(s->s_id, id))
+    {
+        if (s->s_fn)
+            (*s->s_fn)(s->s_owner, replay_binbuf);
+        else binbuf_eval(replay_binbuf, 0, 0, 0);
+        return;
+    }
+    replay_ndropped++;
+}
+
+static void replay_finish(void)
+{
+    double elapsed = sys_getrealtime() - replay_starttime;
+    int nticks = STUFF->st_tickcount - replay_starttick;
+    post("replay: %d ticks (%.3f sec of audio) in %.3f sec%s",
+        nticks, nticks * (double)DEFDACBLKSIZE / STUFF->st_dacsr, elapsed,
+            (replay_ndropped ? "; some messages had no receiver" : ""));
+    if (replay_ndropped)
+        post("replay: %d message(s) dropped", replay_ndropped);
+    fclose(replay_fd);
+    replay_fd = 0;
+    sys_inputreplaying = 0;
+}
+
+    /* called between ticks in batch mode: send all input up to this tick.
+    Audio for the coming tick is left for sys_inputaudio().  Returns 0 at
+    the end of the log. */
+int sys_replaypoll(void)
+{
+    int tick;
+    if (!replay_started)
+    {
+        replay_started = 1;
+        replay_starttick = STUFF->st_tickcount;
+        replay_starttime = sys_getrealtime();
+    }
+    tick = STUFF->st_tickcount - replay_starttick;
+    while (replay_peek() && (int)replay_next.h_tick <= tick)
+    {
+        int type = replay_next.h_type, size = replay_next.h_size;
+        char *p;
+        if ((type == REPLAY_AUDIO || type == REPLAY_SILENCE) &&
+            (int)replay_next.h_tick == tick)
+                break;
+        if (!(p = replay_read()))
+            break;
+        if (type == REPLAY_MIDI && size >= 3)
+            sys_replaymidibyte((unsigned char)p[0], (unsigned char)p[1],
+                (unsigned char)p[2]);
+        else if (type == REPLAY_MESSAGE)
+        {
+            int idlength = (int)strlen(p) + 1;
+            if (idlength < size)
+                replay_message(p, p + idlength, size - idlength);
+        }
+    }
+    if (!replay_peek())
+    {
+        replay_finish();
+        return (0);
+    }
+    return (1);
+}
+
+    /* called by sched_tick() before DSP: record the audio input, or
+    replace it with the recorded one */
+void sys_inputaudio(void)
+{
+    int nchans = STUFF->st_inchannels, n = nchans * DEFDACBLKSIZE, i;
+    t_sample *vec = STUFF->st_soundin;
+    if (sys_inputrecording)
+    {
+        unsigned int u = nchans;
+        for (i = 0; i < n; i++)
+            if (vec[i] != 0)
+                break;
+        if (i == n)
+            replay_write(REPLAY_SILENCE, &u, sizeof(u), 0, 0);
+        else if (sizeof(t_sample) == sizeof(float))
+            replay_write(REPLAY_AUDIO, &u, sizeof(u), vec, n * sizeof(float));
+        else
+        {
+            if (n > replay_nfloats)
+            {
+                replay_floats = (float *)resizebytes(replay_floats,
+                    replay_nfloats * sizeof(float), n * sizeof(float));
+                replay_nfloats = n;
+            }
+            for (i = 0; i < n; i++)
+                replay_floats[i] = vec[i];
+            replay_write(REPLAY_AUDIO, &u, sizeof(u), replay_floats,
+                n * sizeof(float));
+        }
+    }
+    else if (sys_inputreplaying && replay_started && replay_peek() &&
+        (int)replay_next.h_tick == STUFF->st_tickcount - replay_starttick &&
+            (replay_next.h_type == REPLAY_AUDIO ||
+                replay_next.h_type == REPLAY_SILENCE))
+    {
+        int type = replay_next.h_type, size = replay_next.h_size, logchans;
+        char *p = replay_read();
+        float *f;
+        if (!p || size < (int)sizeof(unsigned int))
+            return;
+        logchans = *(unsigned int *)p;
+        f = (float *)(p + sizeof(unsigned int));
+            /* if the channel counts differ, copy what we can */
+        for (i = 0; i < nchans; i++)
+        {
+            int j;
+            t_sample *out = vec + i * DEFDACBLKSIZE;
+            if (type == REPLAY_AUDIO && i < logchans &&
+                size >= (int)(sizeof(unsigned int) +
+                    (i + 1) * DEFDACBLKSIZE * sizeof(float)))
+                        for (j = 0; j < DEFDACBLKSIZE; j++)
+                            out[j] = f[i * DEFDACBLKSIZE + j];
+            else memset(out, 0, DEFDACBLKSIZE * sizeof(t_sample));
+        }
+    }
+}
+
+/* ------------------------------ control -------------------------------- */
+
+    /* start recording to a file, or stop if "filename" is zero */
+int sys_inputlog(const char *filename)
+{
+    char buf[MAXPDSTRING];
+    if (replay_fd && sys_inputrecording)
+    {
+        fclose(replay_fd);
+        replay_fd = 0;
+        sys_inputrecording = 0;
+        post("input-log: stopped after %d ticks",
+            STUFF->st_tickcount - replay_starttick);
+    }
+    if (!filename)
+        return (0);
+    if (sys_inputreplaying)
+    {
+        pd_error(0, "input-log: can't record while replaying");
+        return (-1);
+    }
+    sys_bashfilename(filename, buf);
+    if (!(replay_fd = sys_fopen(buf, "wb")))
+    {
+        pd_error(0, "input-log: %s: %s", buf, strerror(errno));
+        return (-1);
+    }
+    if (!replay_buf)
+        replay_buf = (char *)getbytes(REPLAYBUFSIZE);
+    setvbuf(replay_fd, replay_buf, _IOFBF, REPLAYBUFSIZE);
+    fwrite(REPLAYMAGIC, 8, 1, replay_fd);
+    replay_starttick = STUFF->st_tickcount;
+    sys_inputrecording = 1;
+    return (0);
+}
+
+    /* open a log to replay from m_batchmain() */
+int sys_openreplay(const char *filename)
+{
+    char buf[MAXPDSTRING], magic[8];
+    sys_bashfilename(filename, buf);
+    if (!(replay_fd = sys_fopen(buf, "rb")))
+    {
+        fprintf(stderr, "replay: %s: %s\n", buf, strerror(errno));
+        return (-1);
+    }
+    if (fread(magic, 8, 1, replay_fd) != 1 || memcmp(magic, REPLAYMAGIC, 8))
+    {
+        fprintf(stderr, "replay: %s: not an input log\n", buf);
+        fclose(replay_fd);
+        replay_fd = 0;
+        return (-1);
+    }
+    if (!replay_buf)
+        replay_buf = (char *)getbytes(REPLAYBUFSIZE);
+    setvbuf(replay_fd, replay_buf, _IOFBF, REPLAYBUFSIZE);
+    replay_binbuf = binbuf_new();
+    sys_inputreplaying = 1;
+    return (0);
+}
+
+    /* "pd input-log <file>" starts recording and "pd input-log 0" (or no
+    argument) stops */
+void glob_inputlog(void *dummy, t_symbol *s, int argc, t_atom *argv)
+{
+    if (argc && argv->a_type == A_SYMBOL)
+    {
+        if (!sys_inputlog(argv->a_w.w_symbol->s_name))
+            post("input-log: recording to %s", argv->a_w.w_symbol->s_name);
+    }
+    else sys_inputlog(0);
+}
@@ -26,6 +26,8 @@ int sys_open_absolute(const char *name, const char* ext,
     char *dirresult, char **nameresult, unsigned int size, int bin, int *fdp);
 int sys_trytoopenone(const char *dir, const char *name, const char* ext,
     char *dirresult, char **nameresult, unsigned int size, int bin);
+void sys_pathcache_prefetch(int npath, char **paths);
+void sys_prefetchfiles(int nfile, char **files);
 t_symbol *sys_decodedialog(t_symbol *s);
 
 /* s_file.c */
@@ -39,7 +41,11 @@ extern t_symbol *sys_flags;
 extern int sys_debuglevel;
 extern int sys_verbose;
 extern int sys_noloadbang;
+extern int sys_lazyclasses;     /* "-lazyclasses" flag, in m_conf.c */
+extern int sys_lowmem;          /* "-lowmem" flag, also in m_conf.c */
+extern int sys_symgc;           /* "-symgc" flag, also in m_conf.c */
 EXTERN int sys_havegui(void);
+EXTERN size_t sys_guibytes(void);
 extern const char *sys_guicmd;
 
 EXTERN int sys_nearestfontsize(int fontsize);
@@ -51,7 +57,14 @@ EXTERN t_symbol *sys_libdir;    /* library directory for auxiliary files */
 
 typedef int (*loader_t)(t_canvas *canvas, const char *classname, const char*path); /* callback type */
 EXTERN int sys_load_lib(t_canvas *canvas, const char *classname);
+void sys_prefetchlibs(t_namelist *libs, t_namelist *patches,
+    const char *cwd);
+EXTERN void *sys_dlopen(const char *filename);
+EXTERN void *sys_dlsym(void *lib, const char *symname);
+EXTERN void sys_dlclose(void *lib);
 EXTERN void sys_register_loader(loader_t loader);
+EXTERN t_pd *sys_makeabstraction(t_symbol *s, t_binbuf *b, t_symbol *name,
+    t_symbol *dir, int argc, t_atom *argv);
 
                         /* s_audio.c */
 
@@ -148,6 +161,13 @@ extern int sys_schedadvance;
 
 void sys_set_audio_state(int onoff);
 int sys_send_dacs(void);
+extern int sys_audiopipeline;   /* overlap DSP with device I/O */
+    /* called by the APIs and the functions they call; true if on the
+    "-pipeline" thread, which leaves reporting these to the scheduler */
+int audio_pipeline_logerror(int type);
+int audio_pipeline_setusing(int flag);
+int audio_pipeline_print(int kind, const char *s);
+int audio_pipeline_lost(void);
 void sys_reportidle(void);
 void sys_listdevs(void);
 EXTERN void sys_set_audio_settings(t_audiosettings *as);
@@ -157,6 +177,31 @@ EXTERN void sys_close_audio(void);
     /* return true if the interface prefers always being open (ala jack) : */
 EXTERN int audio_shouldkeepopen(void);
 EXTERN int audio_isopen(void);     /* true if audio interface is open */
+
+    /* device sample formats for sys_interleave() and sys_deinterleave() */
+#define SAMPFMT_FLOAT32 0
+#define SAMPFMT_S32 1
+#define SAMPFMT_S24_3LE 2
+#define SAMPFMT_S16 3
+EXTERN void sys_interleave(void *buf, int format, int bufchans,
+    const t_sample *in, int nin, int instride, int nframes);
+EXTERN void sys_deinterleave(t_sample *out, int nout, int outstride,
+    const void *buf, int format, int bufchans, int nframes);
+
+    /* drift compensation for devices not on the first one's clock */
+extern int sys_aggregate;       /* true to use it ("-aggregate" flag) */
+#define RESYNC_MAXFRAMES (DEFDACBLKSIZE + 4)  /* most device frames/block */
+typedef struct _resync t_resync;
+EXTERN t_resync *resync_new(int nchans, int output);
+EXTERN void resync_free(t_resync *x);
+EXTERN void resync_reset(t_resync *x);
+EXTERN double resync_getdrift(t_resync *x);
+EXTERN int resync_out(t_resync *x, const t_sample *in, int nin, int instride,
+    int fill);
+EXTERN int resync_inneed(t_resync *x, int fill);
+EXTERN void resync_in(t_resync *x, int nread, t_sample *out, int nout,
+    int outstride);
+EXTERN t_sample *resync_getbuf(t_resync *x);
 EXTERN int sys_audiodevnametonumber(int output, const char *name);
 EXTERN void sys_audiodevnumbertoname(int output, int devno, char *name,
     int namesize);
@@ -271,8 +316,16 @@ EXTERN void sys_reopen_midi(void);
 EXTERN void sys_close_midi(void);
 EXTERN void sys_putmidimess(int portno, int a, int b, int c);
 EXTERN void sys_putmidibyte(int portno, int a);
+    /* send a message at the given real time (as from sys_getrealtime()),
+    letting the driver schedule it.  Returns 0, without sending anything, if
+    the API can't schedule output. */
+EXTERN int sys_putmidimess_at(int portno, int a, int b, int c, double when);
+EXTERN size_t sys_midibytes(void);
 EXTERN void sys_poll_midi(void);
 EXTERN void sys_midibytein(int portno, int byte);
+extern int sys_miditimestamps;  /* let the API schedule MIDI output */
+EXTERN int sys_getmidiinoffset(void);
+EXTERN void sys_replaymidibyte(int portno, int byte, int offset);
 
 void sys_listmididevs(void);
 EXTERN void sys_set_midi_api(int whichapi);
@@ -285,6 +338,8 @@ void sys_do_open_midi(int nmidiindev, int *midiindev,
 
 #ifdef USEAPI_ALSA
 EXTERN void sys_alsa_putmidimess(int portno, int a, int b, int c);
+EXTERN int sys_alsa_putmidimess_at(int portno, int a, int b, int c,
+    double when);
 EXTERN void sys_alsa_putmidibyte(int portno, int a);
 EXTERN void sys_alsa_poll_midi(void);
 EXTERN void sys_alsa_close_midi(void);
@@ -309,12 +364,18 @@ EXTERN void sys_log_error(int type);
 #define SCHED_AUDIO_POLL 1
 #define SCHED_AUDIO_CALLBACK 2
 void sched_set_using_audio(int flag);
+void sched_setadapt(int min, int max);  /* "-adaptaudiobuf"; 0 for off */
 extern int sys_sleepgrain;      /* override value set in command line */
+extern int sys_tickless;        /* "-tickless" flag */
+extern int sched_rendering;     /* true while running "-render" jobs */
 EXTERN int sched_get_sleepgrain( void);     /* returns actual value */
 
 /* s_inter.c */
 
 EXTERN void sys_microsleep( void);
+EXTERN void sys_fdwait(int microsec);
+EXTERN void sys_lockreport(void);
+EXTERN void sys_setlockbudget(double msec);
 EXTERN void sys_init_fdpoll(void);
 
 EXTERN void sys_bail(int exitcode);
@@ -335,11 +396,34 @@ EXTERN void socketreceiver_set_fromaddrfn(t_socketreceiver *x,
     t_socketfromaddrfn fromaddrfn);
 EXTERN void sys_sockerror(const char *s);
 EXTERN void sys_closesocket(int fd);
+extern int sys_iothread;
+EXTERN int sys_iosend(int fd, const char *buf, int length);
+typedef void (*t_iofn)(const char *buf, int length);
+EXTERN int sys_iodefer(t_iofn fn, const char *buf, int length);
 EXTERN unsigned char *sys_getrecvbuf(unsigned int *size);
 
+    /* one datagram received by sys_recvbatch(); "d_from" points to a struct
+    sockaddr_storage with the sender's address */
+typedef struct _datagram
+{
+    unsigned char *d_buf;   /* data, with room for a terminating null */
+    int d_len;              /* its length */
+    int d_truncated;        /* nonzero if the datagram didn't fit */
+    void *d_from;
+} t_datagram;
+    /* receive any pending datagrams from a UDP socket, several at a time
+    where recvmmsg() exists.  Returns how many (or -1 on error) and sets
+    *morep if more may be waiting.  Pass the datagrams back to
+    sys_recvbatchdone() before asking for more. */
+EXTERN int sys_recvbatch(int fd, t_datagram **dp, int *morep);
+EXTERN void sys_recvbatchdone(t_datagram *d);
+
 typedef void (*t_fdpollfn)(void *ptr, int fd);
 EXTERN void sys_addpollfn(int fd, t_fdpollfn fn, void *ptr);
 EXTERN void sys_rmpollfn(int fd);
+    /* call fn when fd can take output again without blocking */
+EXTERN void sys_addwritepollfn(int fd, t_fdpollfn fn, void *ptr);
+EXTERN void sys_rmwritepollfn(int fd);
 #if defined(USEAPI_OSS) || defined(USEAPI_ALSA)
 void sys_setalarm(int microsec);
 #endif
@@ -347,6 +431,34 @@ void sys_setalarm(int microsec);
 void sys_set_priority(int higher);
 extern int sys_hipriority;      /* real-time flag, true if priority boosted */
 
+    /* thread roles for CPU affinity */
+#define AFFINITY_SCHED 0
+#define AFFINITY_DSP 1
+#define AFFINITY_DISK 2
+#define AFFINITY_NROLES 3
+EXTERN int sys_setaffinity(const char *role, const char *cpus);
+EXTERN void sys_bindthread(int role, int *serial);
+
+/* s_trace.c */
+extern int sys_tracing;
+EXTERN void sys_tracethread(const char *name);
+EXTERN void sys_tracespan(const char *cat, const char *name,
+    unsigned long long start);
+EXTERN void sys_tracetick(unsigned long long start);
+EXTERN void sys_tracedspbegin(t_canvas *x);
+EXTERN void sys_tracedspend(t_canvas *x);
+
+/* s_replay.c */
+extern int sys_inputrecording;
+extern int sys_inputreplaying;
+EXTERN void sys_inputsource(void *owner, t_socketreceivefn fn, int add);
+EXTERN void sys_recordmidi(int portno, int byte, int offset);
+EXTERN void sys_recordmessage(void *owner, t_binbuf *b);
+EXTERN void sys_inputaudio(void);
+EXTERN int sys_replaypoll(void);
+EXTERN int sys_inputlog(const char *filename);
+EXTERN int sys_openreplay(const char *filename);
+
 /* s_print.c */
 
 typedef void (*t_printhook)(const char *s);
@@ -354,6 +466,11 @@ typedef void (*t_printhook)(const char *s);
 /* set this to override printing; used as default for STUFF->st_printhook */
 extern t_printhook sys_printhook;
 extern int sys_printtostderr;
+extern int sys_printlimit;
+EXTERN int sys_printallow(const void *source, t_symbol *name);
+EXTERN int sys_setlogfile(const char *filename);
+EXTERN void sys_setsyslog(int onoff);
+void sys_printdeferred(int kind, const char *s);
 
 /* jsarlo { */
 
@@ -371,6 +488,13 @@ EXTERN int* get_sys_schedadvance(void);
 
 EXTERN void sys_initmidiqueue(void);
 EXTERN void sched_tick(void);
+extern int sys_flushdenormals;
+extern int sys_fastmath;
+extern int sys_dsplocality;
+EXTERN void sched_flushdenormals(void);
+extern int sys_callbackqueue;
+EXTERN void sys_setfdqueue(int onoff);
+EXTERN int sys_fdqueuewait(int microsec);
 EXTERN void sys_pollmidiqueue(void);
 EXTERN void sys_setchsr(int chin, int chout, int sr);
 
@@ -409,6 +533,20 @@ struct _instancestuff
     double st_time_per_dsp_tick;    /* obsolete - included for GEM?? */
     t_printhook st_printhook;   /* set this to override per-instance printing */
     void *st_impdata; /* optional implementation-specific data for libpd, etc */
+    struct _clock **st_clockheap;   /* heap of set clocks (m_sched.c) */
+    int st_nclocks;                 /* number of clocks in heap */
+    int st_clockheapsize;           /* allocated size of heap */
+    double st_clockserial;          /* counts clock_set() calls */
+    struct _filecache *st_filecache;    /* parsed patch files (m_binbuf.c) */
+    struct _preload *st_preloads;       /* files being read ahead (ditto) */
+    struct _dirindex *st_pathcache;     /* directory listings (s_path.c) */
+    int st_tickcount;           /* ticks computed so far (m_sched.c) */
+    struct _findcache *st_findcache;    /* pd_findbyclass() results (m_pd.c) */
+    struct _symgc *st_symgc;    /* symbols that might be freed (m_class.c) */
+    struct _binbuf *st_binbufpool;  /* free binbufs to reuse (m_binbuf.c) */
+    int st_nbinbufpool;             /* number of them */
+    t_sample *st_iosoundout;    /* what the audio API transfers: the same */
+    t_sample *st_iosoundin;     /* as above, or others with -pipeline */
 };
 
 #define STUFF (pd_this->pd_stuff)
@@ -0,0 +1,414 @@
+/* Copyright (c) 1997- Miller Puckette and others.
+* For information on usage and redistribution, and for a DISCLAIMER OF ALL
+* WARRANTIES, see the file, "LICENSE.txt," in this distribution.  */
+
+/* Tracing what the scheduler and the threads around it are doing, for
+chasing down the odd late tick.  While "pd trace 1" is on, each thread keeps
+a ring buffer of the last TRACESIZE "spans" it recorded -- scheduler ticks,
+clock callbacks, DSP as a whole and each root canvas's share of it,
+sys_send_dacs(), GUI polls that did something, file descriptor callbacks
+(sockets and the GUI), and readsf~ and writesf~ I/O -- each with its start and
+end read from the processor's cycle counter.  "pd trace dump <file>" writes
+all that's in the rings to a file in Chrome's "trace event" JSON format, which
+chrome://tracing and the Perfetto UI both read.  "pd trace late <file>" arms a
+one-shot dump, of the last TRACELATESEC seconds, to be made the next time a
+tick takes longer than a tick's worth of real time; the dump is then written
+by the I/O thread so as not to hold up the scheduler any further.
+
+A thread's ring is allocated the first time it records a span, and is kept
+(and reused by a later thread once the thread exits) so that it can still be
+dumped after tracing is turned off. */
+
+#include "m_pd.h"
+#include "m_imp.h"
+#include "s_stuff.h"
+#include "g_canvas.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define TRACESIZE 32768         /* spans per thread; power of two */
+#define TRACEMARGIN 64          /* oldest spans, maybe being overwritten,
+                                that a dump leaves out */
+#define TRACELATESEC 2          /* seconds before a late tick to dump */
+#define TRACEMAXTHREADS 64
+
+typedef struct _traceevent
+{
+    const char *e_cat;          /* category; a string constant */
+    const char *e_name;         /* name; a constant or a symbol's name */
+    unsigned long long e_start;
+    unsigned long long e_end;
+} t_traceevent;
+
+typedef struct _tracering
+{
+    struct _tracering *r_next;
+    int r_tid;                  /* thread number in the dump */
+    const char *r_thread;       /* thread's name if it gave one */
+    int r_inuse;                /* false once the thread is gone */
+    unsigned long long r_dspstart;  /* start of a root canvas's DSP */
+    volatile unsigned long r_head;  /* spans recorded so far */
+    t_traceevent r_vec[TRACESIZE];
+} t_tracering;
+
+    /* a dump, copied out of the rings so that the I/O thread can write it */
+typedef struct _tracedumpevent
+{
+    t_traceevent d_event;
+    int d_tid;
+} t_tracedumpevent;
+
+typedef struct _tracedump
+{
+    char d_filename[MAXPDSTRING];
+    double d_usecpercount;
+    unsigned long long d_base;
+    int d_nthreads;
+    int d_tids[TRACEMAXTHREADS];
+    const char *d_threads[TRACEMAXTHREADS];
+    int d_nevents;
+    t_tracedumpevent d_events[1];   /* actually d_nevents of them */
+} t_tracedump;
+
+int sys_tracing;
+static t_tracering *trace_rings;
+static int trace_nrings;
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static pthread_key_t trace_ringkey, trace_namekey;
+static unsigned long long trace_start;
+static double trace_starttime;
+static double trace_countspersec;
+static unsigned long long trace_tickcounts;
+static char trace_latefile[MAXPDSTRING];
+
+    /* a thread is exiting: let another thread have its ring */
+static void trace_release(void *z)
+{
+    ((t_tracering *)z)->r_inuse = 0;
+}
+
+static void trace_makekeys(void)
+{
+    pthread_key_create(&trace_ringkey, trace_release);
+    pthread_key_create(&trace_namekey, 0);
+}
+
+    /* give the calling thread a name to show in dumps.  This may be called
+    whether tracing is on or not. */
+void sys_tracethread(const char *name)
+{
+    t_tracering *r;
+    pthread_once(&trace_once, trace_makekeys);
+    pthread_setspecific(trace_namekey, name);
+    if ((r = (t_tracering *)pthread_getspecific(trace_ringkey)))
+        r->r_thread = name;
+}
+
+    /* get the calling thread's ring, making or reusing one if needed */
+static t_tracering *trace_getring(void)
+{
+    t_tracering *r;
+    pthread_once(&trace_once, trace_makekeys);
+    if ((r = (t_tracering *)pthread_getspecific(trace_ringkey)))
+        return (r);
+    pthread_mutex_lock(&trace_mutex);
+    for (r = trace_rings; r; r = r->r_next)
+        if (!r->r_inuse)
+            break;
+    if (!r && trace_nrings < TRACEMAXTHREADS &&
+        (r = (t_tracering *)calloc(1, sizeof(*r))))
+    {
+        r->r_tid = ++trace_nrings;
+        r->r_next = trace_rings;
+        trace_rings = r;
+    }
+    if (r)
+    {
+        r->r_inuse = 1;
+        r->r_head = 0;
+        r->r_dspstart = 0;
+        r->r_thread = (const char *)pthread_getspecific(trace_namekey);
+        pthread_setspecific(trace_ringkey, r);
+    }
+    pthread_mutex_unlock(&trace_mutex);
+    return (r);
+}
+
+static void trace_record(t_tracering *r, const char *cat, const char *name,
+    unsigned long long start, unsigned long long end)
+{
+    t_traceevent *e = &r->r_vec[r->r_head & (TRACESIZE-1)];
+    e->e_cat = cat;
+    e->e_name = name;
+    e->e_start = start;
+    e->e_end = end;
+    r->r_head++;
+}
+
+    /* record a span that began at "start" (from PROFILE_NOW()) and ends
+    now.  Callers get "start" only if sys_tracing is set, and pass 0 if it
+    wasn't, so that spans begun before tracing was turned on are dropped. */
+void sys_tracespan(const char *cat, const char *name, unsigned long long start)
+{
+    t_tracering *r;
+    if (start && sys_tracing && (r = trace_getring()))
+        trace_record(r, cat, name, start, PROFILE_NOW());
+}
+
+/* ------------------------------ dumps --------------------------------- */
+
+    /* counts per second of the cycle counter, measured against the real
+    time clock over at least a second; 0 until then */
+static double trace_getcountspersec(void)
+{
+    double elapsed;
+    if (!trace_countspersec &&
+        (elapsed = sys_getrealtime() - trace_starttime) >= 1)
+            trace_countspersec =
+                (double)(PROFILE_NOW() - trace_start) / elapsed;
+    return (trace_countspersec);
+}
+
+    /* copy the spans that ended since "since" out of the rings */
+static t_tracedump *trace_snapshot(const char *filename,
+    unsigned long long since, size_t *sizep)
+{
+    t_tracering *r;
+    t_tracedump *d;
+    int n = 0;
+    size_t size;
+    double countspersec = trace_getcountspersec();
+    pthread_mutex_lock(&trace_mutex);
+    for (r = trace_rings; r; r = r->r_next)
+        n += (r->r_head < TRACESIZE ? r->r_head : TRACESIZE);
+    size = sizeof(t_tracedump) + n * sizeof(t_tracedumpevent);
+    if (!(d = (t_tracedump *)malloc(size)))
+    {
+        pthread_mutex_unlock(&trace_mutex);
+        return (0);
+    }
+    strncpy(d->d_filename, filename, MAXPDSTRING);
+    d->d_filename[MAXPDSTRING-1] = 0;
+        /* fall back on a nominal 1 GHz if we haven't had time to measure */
+    d->d_usecpercount = 1e6 / (countspersec > 0 ? countspersec : 1e9);
+    d->d_base = trace_start;
+    d->d_nthreads = d->d_nevents = 0;
+    for (r = trace_rings; r; r = r->r_next)
+    {
+        unsigned long head = r->r_head, i, first;
+        d->d_tids[d->d_nthreads] = r->r_tid;
+        d->d_threads[d->d_nthreads++] = r->r_thread;
+        first = (head > TRACESIZE ? head - TRACESIZE + TRACEMARGIN : 0);
+        for (i = first; i < head && d->d_nevents < n; i++)
+        {
+            t_traceevent *e = &r->r_vec[i & (TRACESIZE-1)];
+            if (e->e_end < since || e->e_start < trace_start ||
+                e->e_end < e->e_start)
+                    continue;
+            d->d_events[d->d_nevents].d_event = *e;
+            d->d_events[d->d_nevents++].d_tid = r->r_tid;
+        }
+    }
+    pthread_mutex_unlock(&trace_mutex);
+    *sizep = sizeof(t_tracedump) +
+        d->d_nevents * sizeof(t_tracedumpevent);
+    return (d);
+}
+
+static void trace_putstring(FILE *fd, const char *s)
+{
+    putc('"', fd);
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            fprintf(fd, "\\%c", *s);
+        else if ((unsigned char)*s < 32)
+            fprintf(fd, "\\u%04x", *s);
+        else putc(*s, fd);
+    }
+    putc('"', fd);
+}
+
+    /* write a snapshot as Chrome trace events.  This may be called from the
+    I/O thread, so we can't post errors from here but only print them. */
+static int trace_write(const t_tracedump *d)
+{
+    FILE *fd;
+    int i;
+    if (!(fd = fopen(d->d_filename, "w")))
+        return (0);
+    fprintf(fd, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (i = 0; i < d->d_nthreads; i++)
+    {
+        char buf[80];
+        fprintf(fd, "{\"name\": \"thread_name\", \"ph\": \"M\", \
+\"pid\": 1, \"tid\": %d, \"args\": {\"name\": ", d->d_tids[i]);
+        if (!d->d_threads[i])
+            snprintf(buf, sizeof(buf), "thread %d", d->d_tids[i]);
+        trace_putstring(fd, (d->d_threads[i] ? d->d_threads[i] : buf));
+        fprintf(fd, "}},\n");
+    }
+    for (i = 0; i < d->d_nevents; i++)
+    {
+        const t_traceevent *e = &d->d_events[i].d_event;
+        fprintf(fd, "{\"name\": ");
+        trace_putstring(fd, e->e_name);
+        fprintf(fd, ", \"cat\": ");
+        trace_putstring(fd, e->e_cat);
+        fprintf(fd, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \
+\"ts\": %.3f, \"dur\": %.3f},\n", d->d_events[i].d_tid,
+            (e->e_start - d->d_base) * d->d_usecpercount,
+            (e->e_end - e->e_start) * d->d_usecpercount);
+    }
+        /* a last event so that the list needn't end with a comma */
+    fprintf(fd, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \
+\"args\": {\"name\": \"Pd\"}}\n]}\n");
+    return (!fclose(fd));
+}
+
+    /* I/O thread: write a late tick's dump */
+static void trace_iowrite(const char *buf, int length)
+{
+    const t_tracedump *d = (const t_tracedump *)buf;
+    if (!trace_write(d))
+        fprintf(stderr, "trace: %s: couldn't write\n", d->d_filename);
+}
+
+static void trace_dump(const char *filename)
+{
+    t_tracedump *d;
+    size_t size;
+    char pathbuf[MAXPDSTRING];
+    sys_bashfilename(filename, pathbuf);
+    if (!(d = trace_snapshot(pathbuf, 0, &size)))
+        pd_error(0, "trace: out of memory");
+    else
+    {
+        if (trace_write(d))
+            post("trace: wrote %d events to %s", d->d_nevents, filename);
+        else pd_error(0, "trace: %s: couldn't write", filename);
+        free(d);
+    }
+}
+
+    /* called at the end of each tick: record it, and if it was late and a
+    dump is armed, have the last few seconds written out */
+void sys_tracetick(unsigned long long start)
+{
+    t_tracering *r;
+    unsigned long long now;
+    if (!start || !sys_tracing || !(r = trace_getring()))
+        return;
+    trace_record(r, "sched", "tick", start, (now = PROFILE_NOW()));
+    if (!*trace_latefile)
+        return;
+    if (!trace_tickcounts)
+    {
+        double countspersec = trace_getcountspersec();
+        if (countspersec > 0 && STUFF->st_dacsr > 0)
+            trace_tickcounts = countspersec *
+                (STUFF->st_schedblocksize / STUFF->st_dacsr);
+    }
+    if (trace_tickcounts && now - start > trace_tickcounts)
+    {
+        t_tracedump *d;
+        size_t size;
+        unsigned long long window = TRACELATESEC * trace_countspersec,
+            since = (now > window ? now - window : 0);
+        post("trace: tick took %.2f msec; dumping to %s",
+            1000. * (now - start) / trace_countspersec, trace_latefile);
+        if ((d = trace_snapshot(trace_latefile, since, &size)))
+        {
+            if (sys_iodefer(trace_iowrite, (char *)d, (int)size) < 0)
+                trace_iowrite((char *)d, (int)size);
+            free(d);
+        }
+        *trace_latefile = 0;
+    }
+}
+
+/* -------------------- DSP markers for root canvases ------------------- */
+
+static t_int *trace_dspbegin(t_int *w)
+{
+    t_tracering *r;
+    if (sys_tracing && (r = trace_getring()))
+        r->r_dspstart = PROFILE_NOW();
+    return (w+1);
+}
+
+static t_int *trace_dspend(t_int *w)
+{
+    t_canvas *x = (t_canvas *)(w[1]);
+    t_tracering *r;
+    if (sys_tracing && (r = trace_getring()) && r->r_dspstart)
+    {
+        trace_record(r, "dsp", x->gl_name->s_name, r->r_dspstart,
+            PROFILE_NOW());
+        r->r_dspstart = 0;
+    }
+    return (w+2);
+}
+
+    /* for g_canvas.c to bracket root canvases with while sorting */
+void sys_tracedspbegin(t_canvas *x)
+{
+    if (sys_tracing)
+        dsp_add(trace_dspbegin, 0);
+}
+
+void sys_tracedspend(t_canvas *x)
+{
+    if (sys_tracing)
+        dsp_add(trace_dspend, 1, x);
+}
+
+/* ------------------------------ "pd trace" ---------------------------- */
+
+    /* "pd trace 1" or "0" turns tracing on (clearing what was recorded) or
+    off; "pd trace dump <file>" writes what's recorded; "pd trace late
+    <file>" arms a dump on the next late tick, and "pd trace late" with no
+    file disarms it. */
+void glob_trace(void *dummy, t_symbol *s, int argc, t_atom *argv)
+{
+    t_symbol *what = atom_getsymbolarg(0, argc, argv);
+    if (what == gensym("dump"))
+    {
+        if (argc < 2 || argv[1].a_type != A_SYMBOL)
+            pd_error(0, "trace dump: needs a file name");
+        else trace_dump(argv[1].a_w.w_symbol->s_name);
+    }
+    else if (what == gensym("late"))
+    {
+        if (argc > 1 && argv[1].a_type == A_SYMBOL)
+            sys_bashfilename(argv[1].a_w.w_symbol->s_name, trace_latefile);
+        else *trace_latefile = 0;
+    }
+    else if (argc && argv->a_type == A_FLOAT)
+    {
+        int onoff = (argv->a_w.w_float != 0);
+        t_tracering *r;
+        if (onoff && !sys_tracing)
+        {
+            pthread_mutex_lock(&trace_mutex);
+            for (r = trace_rings; r; r = r->r_next)
+            {
+                r->r_head = 0;
+                r->r_dspstart = 0;
+            }
+            pthread_mutex_unlock(&trace_mutex);
+            trace_start = PROFILE_NOW();
+            trace_starttime = sys_getrealtime();
+            trace_countspersec = 0;
+            trace_tickcounts = 0;
+        }
+        sys_tracing = onoff;
+            /* put the root canvases' markers in or take them out */
+        canvas_update_dsp();
+    }
+    else post("trace: tracing is %s%s%s", (sys_tracing ? "on" : "off"),
+        (*trace_latefile ? "; dump on late tick to " : ""), trace_latefile);
+}
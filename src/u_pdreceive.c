@@ -16,6 +16,7 @@ standard output. */
 #include <stdio.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <stdint.h>
 #ifndef _WIN32
 #include <unistd.h>
 #endif
@@ -29,6 +30,12 @@ typedef struct _fdpoll
     int fdp_outlen;   /*length of output message*/
     int fdp_discard;  /*buffer overflow: output message is incomplete, discard it*/
     int fdp_gotsemi;  /*last char from input was a semicolon*/
+    int fdp_typed;    /* typed binary (1), text (0) or not known yet (-1) */
+    unsigned char *fdp_inbuf;   /* typed: incoming bytes */
+    int fdp_insize;
+    int fdp_inhead;
+    char **fdp_syms;  /* typed: symbols the peer has defined */
+    int fdp_nsyms;
 } t_fdpoll;
 
 static int nfdpoll;
@@ -36,11 +43,13 @@ static t_fdpoll *fdpoll;
 static int maxfd;
 static int sockfd;
 static int protocol;
+static int batch;   /* "-b": read all that's waiting, write output at once */
 char recvbuf[NET_MAXPACKETSIZE];
 
 static void sockerror(char *s);
 static void dopoll(void);
 static void sockerror(char *s);
+static void flushoutput(void);
 
 /* print addrinfo lists for debugging */
 /* #define PRINT_ADDRINFO */
@@ -50,8 +59,14 @@ int main(int argc, char **argv)
     int status, portno, multicast = 0;
     char *hostname = NULL;
     struct addrinfo *ailist = NULL, *ai;
-    if (argc < 2 || sscanf(argv[1], "%d", &portno) < 1 || portno <= 0)
-        goto usage;
+    while (argc > 1 && !strcmp(argv[1], "-b"))
+    {
+        batch = 1;
+        argc--; argv++;
+    }
+    if (argc < 2 || (!sockaddr_is_unixpath(argv[1]) &&
+        (sscanf(argv[1], "%d", &portno) < 1 || portno <= 0)))
+            goto usage;
     if (argc > 2)
     {
         if (!strcmp(argv[2], "tcp"))
@@ -68,6 +83,17 @@ int main(int argc, char **argv)
     {
         sockerror("socket_init()");
         exit(EXIT_FAILURE);
+    }
+        /* a path instead of a port number is a Unix-domain socket */
+    if (sockaddr_is_unixpath(argv[1]))
+    {
+        if ((sockfd = socket_bind_unix(argv[1], protocol)) < 0)
+        {
+            sockerror(argv[1]);
+            exit(EXIT_FAILURE);
+        }
+        fprintf(stderr, "listening on %s\n", argv[1]);
+        goto bound;
     }
     status = addrinfo_get_list(&ailist, hostname, portno, protocol);
     if (status != 0)
@@ -196,8 +222,10 @@ int main(int argc, char **argv)
         fprintf(stderr, "listen failed: %s (%d)\n", buf, err);
         exit(EXIT_FAILURE);
     }
-
+bound:
     maxfd = sockfd + 1;
+    if (batch)
+        socket_set_nonblocking(sockfd, 1);
 
     if (protocol == SOCK_STREAM) /* streaming protocol */
     {
@@ -214,8 +242,10 @@ int main(int argc, char **argv)
         dopoll();
 
 usage:
-    fprintf(stderr, "usage: pdreceive <portnumber> [udp|tcp] [host]\n");
+    fprintf(stderr, "usage: pdreceive [-b] <portnumber> [udp|tcp] [host]\n");
+    fprintf(stderr, "   or: pdreceive [-b] <socket path> [udp|tcp]\n");
     fprintf(stderr, "(default is tcp)\n");
+    fprintf(stderr, "-b: read all waiting input before writing it out\n");
     exit(EXIT_FAILURE);
 }
 
@@ -237,6 +267,13 @@ static void addport(int fd)
     nfdpoll++;
     if (fd >= maxfd) maxfd = fd + 1;
     fp->fdp_outlen = fp->fdp_discard = fp->fdp_gotsemi = 0;
+    fp->fdp_typed = -1;
+    fp->fdp_inbuf = 0;
+    fp->fdp_insize = fp->fdp_inhead = 0;
+    fp->fdp_syms = 0;
+    fp->fdp_nsyms = 0;
+    if (batch)
+        socket_set_nonblocking(fd, 1);
     if (!(fp->fdp_outbuf = (char*) malloc(NET_MAXPACKETSIZE)))
     {
         fprintf(stderr, "out of memory");
@@ -256,6 +293,10 @@ static void rmport(t_fdpoll *x)
         {
             socket_close(fp->fdp_fd);
             free(fp->fdp_outbuf);
+            free(fp->fdp_inbuf);
+            while (fp->fdp_nsyms--)
+                free(fp->fdp_syms[fp->fdp_nsyms]);
+            free(fp->fdp_syms);
             while (i--)
             {
                 fp[0] = fp[1];
@@ -279,7 +320,7 @@ static void doconnect(void)
     else addport(fd);
 }
 
-static void makeoutput(char *buf, int len)
+static void writeoutput(char *buf, int len)
 {
 #ifdef _WIN32
     int j;
@@ -294,17 +335,288 @@ static void makeoutput(char *buf, int len)
 #endif
 }
 
-static void udpread(void)
+    /* with "-b" output is collected here and written once per poll */
+#define OUTBUFSIZE 65536
+static char outbuf[OUTBUFSIZE];
+static int outlen;
+
+static void makeoutput(char *buf, int len)
 {
-    int ret = recv(sockfd, recvbuf, NET_MAXPACKETSIZE, 0);
-    if (ret < 0)
+    if (!batch)
+        writeoutput(buf, len);
+    else
     {
-        sockerror("recv (udp)");
-        socket_close(sockfd);
-        exit(EXIT_FAILURE);
+        if (outlen + len > OUTBUFSIZE)
+            flushoutput();
+        if (len > OUTBUFSIZE)
+            writeoutput(buf, len);
+        else
+        {
+            memcpy(outbuf + outlen, buf, len);
+            outlen += len;
+        }
     }
-    else if (ret > 0)
-        makeoutput(recvbuf, ret);
+}
+
+static void flushoutput(void)
+{
+    if (outlen)
+        writeoutput(outbuf, outlen);
+    outlen = 0;
+}
+
+static int wouldblock(void)
+{
+    int err = socket_errno();
+#ifdef _WIN32
+    return (err == WSAEWOULDBLOCK);
+#else
+    return (err == EAGAIN || err == EWOULDBLOCK);
+#endif
+}
+
+/* ------------------- typed binary messages --------------------------- */
+
+/* Messages from "netsend -t" or "pdsend -t" are typed atoms, not text (see
+x_net.c for the format); we print them as FUDI text like the others.  A TCP
+connection is typed if its first byte is TYPED_MAGIC, and then we answer
+with a hello of our own; a datagram is typed if it starts with the hello. */
+
+#define TYPED_MAGIC 0xff
+#define TYPED_VERSION 1
+#define TYPED_MAXMSG (16 * 1024 * 1024)
+
+static unsigned int get16(const unsigned char *p)
+{
+    return ((p[0] << 8) | p[1]);
+}
+
+static uint32_t get32(const unsigned char *p)
+{
+    return (((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+        ((uint32_t)p[2] << 8) | p[3]);
+}
+
+    /* print a symbol, escaped as Pd would */
+static int typed_putsymbol(char *tp, const unsigned char *bp, int len)
+{
+    int i, n = 0;
+    for (i = 0; i < len; i++)
+    {
+        if (bp[i] == ';' || bp[i] == ',' || bp[i] == '\\' ||
+            bp[i] == ' ' || bp[i] == '$')
+                tp[n++] = '\\';
+        tp[n++] = bp[i];
+    }
+    return (n);
+}
+
+    /* make sure there's room for n more characters of text */
+static char *typed_room(char *text, int *size, int len, int n)
+{
+    if (!text || *size - len < n)
+    {
+        *size = 2 * *size + n;
+        if (!(text = (char *)realloc(text, *size)))
+        {
+            fprintf(stderr, "out of memory");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return (text);
+}
+
+    /* print one typed message (x is zero for UDP); returns -1 if garbled */
+static int typed_output(t_fdpoll *x, const unsigned char *bp, int n)
+{
+    const unsigned char *ep = bp + n;
+    int len = 0, size = 0, linestart = 1;
+    char *text = typed_room(0, &size, 0, 2 * n + 64);
+    while (bp < ep)
+    {
+        int tag = *bp++, count = 1, slen, id;
+        float f;
+        if (tag == 'F')
+        {
+            if (ep - bp < 2)
+                goto garbled;
+            count = get16(bp);
+            bp += 2;
+            if (ep - bp < 4 * count)
+                goto garbled;
+        }
+        text = typed_room(text, &size, len, 64 + 16 * count);
+        if (tag != ';' && tag != ',' && !linestart)
+            text[len++] = ' ';
+        linestart = 0;
+        switch (tag)
+        {
+        case 'f': case 'F':
+            if (ep - bp < 4)
+                goto garbled;
+            while (count--)
+            {
+                uint32_t u = get32(bp);
+                memcpy(&f, &u, 4);
+                len += sprintf(text + len, "%g", f);
+                if (count)
+                    text[len++] = ' ';
+                bp += 4;
+            }
+            break;
+        case 'd':
+        {
+            uint64_t u;
+            double d;
+            if (ep - bp < 8)
+                goto garbled;
+            u = ((uint64_t)get32(bp) << 32) | get32(bp + 4);
+            memcpy(&d, &u, 8);
+            len += sprintf(text + len, "%.15g", d);
+            bp += 8;
+            break;
+        }
+        case ';':
+            text[len++] = ';';
+            text[len++] = '\n';
+            linestart = 1;
+            break;
+        case ',':
+            text[len++] = ',';
+            break;
+        case 'S':
+            if (!x || ep - bp < 2 || (id = get16(bp)) >= x->fdp_nsyms ||
+                !x->fdp_syms[id])
+                    goto garbled;
+            slen = (int)strlen(x->fdp_syms[id]);
+            text = typed_room(text, &size, len, 2 * slen + 64);
+            len += typed_putsymbol(text + len,
+                (const unsigned char *)x->fdp_syms[id], slen);
+            bp += 2;
+            break;
+        case 's': case 'n':
+            if (tag == 's')
+            {
+                if (!x || ep - bp < 2)
+                    goto garbled;
+                id = get16(bp);
+                bp += 2;
+            }
+            else id = -1;
+            if (ep - bp < 2 || ep - bp < 2 + (slen = get16(bp)))
+                goto garbled;
+            text = typed_room(text, &size, len, 2 * slen + 64);
+            len += typed_putsymbol(text + len, bp + 2, slen);
+            if (id >= 0)
+            {
+                if (id >= x->fdp_nsyms)
+                {
+                    char **syms = (char **)realloc(x->fdp_syms,
+                        (id + 1) * sizeof(char *));
+                    if (!syms)
+                    {
+                        fprintf(stderr, "out of memory");
+                        exit(EXIT_FAILURE);
+                    }
+                    memset(syms + x->fdp_nsyms, 0,
+                        (id + 1 - x->fdp_nsyms) * sizeof(char *));
+                    x->fdp_syms = syms;
+                    x->fdp_nsyms = id + 1;
+                }
+                free(x->fdp_syms[id]);
+                if ((x->fdp_syms[id] = (char *)malloc(slen + 1)))
+                {
+                    memcpy(x->fdp_syms[id], bp + 2, slen);
+                    x->fdp_syms[id][slen] = 0;
+                }
+            }
+            bp += 2 + slen;
+            break;
+        default:
+            goto garbled;
+        }
+    }
+        /* the end of a typed message ends the Pd message too */
+    if (!linestart)
+    {
+        text[len++] = ';';
+        text[len++] = '\n';
+    }
+    makeoutput(text, len);
+    free(text);
+    return (0);
+garbled:
+    free(text);
+    fprintf(stderr, "pdreceive: dropped garbled typed message\n");
+    return (-1);
+}
+
+    /* take in bytes from a typed TCP connection and print whole messages */
+static int typed_tcpinput(t_fdpoll *x, const char *buf, int len)
+{
+    int onset = 0;
+    if (x->fdp_insize - x->fdp_inhead < len)
+    {
+        int newsize = (x->fdp_insize ? x->fdp_insize : NET_MAXPACKETSIZE);
+        unsigned char *inbuf;
+        while (newsize - x->fdp_inhead < len)
+            newsize *= 2;
+        if (!(inbuf = (unsigned char *)realloc(x->fdp_inbuf, newsize)))
+        {
+            fprintf(stderr, "out of memory");
+            exit(EXIT_FAILURE);
+        }
+        x->fdp_inbuf = inbuf;
+        x->fdp_insize = newsize;
+    }
+    memcpy(x->fdp_inbuf + x->fdp_inhead, buf, len);
+    x->fdp_inhead += len;
+    if (x->fdp_inhead < 2)
+        return (0);
+    if (x->fdp_inbuf[0] != TYPED_MAGIC || x->fdp_inbuf[1] != TYPED_VERSION)
+    {
+        fprintf(stderr, "pdreceive: unknown typed message version\n");
+        return (-1);
+    }
+    onset = 2;
+    while (x->fdp_inhead - onset >= 4)
+    {
+        uint32_t n = get32(x->fdp_inbuf + onset);
+        if (n > TYPED_MAXMSG)
+        {
+            fprintf(stderr, "pdreceive: typed message too long\n");
+            return (-1);
+        }
+        if (x->fdp_inhead - onset < 4 + (int)n)
+            break;
+        typed_output(x, x->fdp_inbuf + onset + 4, n);
+        onset += 4 + n;
+    }
+        /* keep the hello at the front so that we see it again next time */
+    memmove(x->fdp_inbuf + 2, x->fdp_inbuf + onset, x->fdp_inhead - onset);
+    x->fdp_inhead -= onset - 2;
+    return (0);
+}
+
+static void udpread(void)
+{
+    do
+    {
+        int ret = recv(sockfd, recvbuf, NET_MAXPACKETSIZE, 0);
+        if (ret < 0)
+        {
+            if (batch && wouldblock())
+                return;
+            sockerror("recv (udp)");
+            socket_close(sockfd);
+            exit(EXIT_FAILURE);
+        }
+        else if (ret >= 2 && (unsigned char)recvbuf[0] == TYPED_MAGIC &&
+            recvbuf[1] == TYPED_VERSION)
+                typed_output(0, (unsigned char *)recvbuf + 2, ret - 2);
+        else if (ret > 0)
+            makeoutput(recvbuf, ret);
+    } while (batch);
 }
 
 static int tcpmakeoutput(t_fdpoll *x, char *inbuf, int len)
@@ -348,15 +660,36 @@ static void tcpread(t_fdpoll *x)
     int  ret;
     char inbuf[NET_MAXPACKETSIZE];
 
-    ret = recv(x->fdp_fd, inbuf, NET_MAXPACKETSIZE, 0);
-    if (ret < 0)
+    do
     {
-        sockerror("recv (tcp)");
-        rmport(x);
-    }
-    else if (ret == 0)
-        rmport(x);
-    else tcpmakeoutput(x, inbuf, ret);
+        ret = recv(x->fdp_fd, inbuf, NET_MAXPACKETSIZE, 0);
+        if (ret < 0)
+        {
+            if (batch && wouldblock())
+                return;
+            sockerror("recv (tcp)");
+            rmport(x);
+            return;
+        }
+        else if (ret == 0)
+        {
+            rmport(x);
+            return;
+        }
+        if (x->fdp_typed < 0)
+        {
+            static const char hello[2] = {(char)TYPED_MAGIC, TYPED_VERSION};
+            if ((x->fdp_typed = ((unsigned char)inbuf[0] == TYPED_MAGIC)))
+                send(x->fdp_fd, hello, 2, 0);
+        }
+        if (!x->fdp_typed)
+            tcpmakeoutput(x, inbuf, ret);
+        else if (typed_tcpinput(x, inbuf, ret) < 0)
+        {
+            rmport(x);
+            return;
+        }
+    } while (batch);
 }
 
 static void dopoll(void)
@@ -392,6 +725,8 @@ static void dopoll(void)
         if (FD_ISSET(sockfd, &readset))
             udpread();
     }
+    if (batch)
+        flushoutput();
 }
 
 
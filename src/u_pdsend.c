@@ -10,10 +10,23 @@ from its standard input to Pd via the netsend/netreceive ("FUDI") protocol. */
 #include <stdio.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <float.h>
+#include <stdint.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 #include "s_net.h"
 
+#ifdef _WIN32
+#define SHUT_WR SD_SEND
+#endif
+
 static void sockerror(char *s);
+static void sendbuffered(int sockfd, int protocol,
+    const struct sockaddr_storage *server, int batch, int typed);
 
 /* print addrinfo lists for debugging */
 /* #define PRINT_ADDRINFO */
@@ -26,28 +39,72 @@ int main(int argc, char **argv)
     struct sockaddr_storage server;
     struct addrinfo *ailist = NULL, *ai;
     float timeout = 10;
-    char *hostname;
-    if (argc < 2 || sscanf(argv[1], "%d", &portno) < 1 || portno <= 0)
+    char *hostname, *unixpath = 0;
+    int argn;   /* where the protocol argument is */
+    int batch = 0, typed = 0;
+    while (argc > 1 && argv[1][0] == '-')
+    {
+        if (!strcmp(argv[1], "-b"))
+            batch = 1;
+        else if (!strcmp(argv[1], "-t"))
+            typed = 1;
+        else goto usage;
+        argc--; argv++;
+    }
+    if (argc < 2)
         goto usage;
-    if (argc >= 3)
-        hostname = argv[2];
-    else hostname = "localhost";
-    if (argc >= 4)
+        /* a path instead of a port number is a Unix-domain socket, and
+        then there's no host argument */
+    if (sockaddr_is_unixpath(argv[1]))
+        unixpath = hostname = argv[1], portno = 0, argn = 2;
+    else
     {
-        if (!strcmp(argv[3], "tcp"))
+        if (sscanf(argv[1], "%d", &portno) < 1 || portno <= 0)
+            goto usage;
+        if (argc >= 3)
+            hostname = argv[2];
+        else hostname = "localhost";
+        argn = 3;
+    }
+    if (argc > argn)
+    {
+        if (!strcmp(argv[argn], "tcp"))
             protocol = SOCK_STREAM;
-        else if (!strcmp(argv[3], "udp"))
+        else if (!strcmp(argv[argn], "udp"))
             protocol = SOCK_DGRAM;
         else goto usage;
     }
     else protocol = SOCK_STREAM;
-    if (argc >= 5 && sscanf(argv[4], "%f", &timeout) < 1)
+    if (argc > argn + 1 && sscanf(argv[argn + 1], "%f", &timeout) < 1)
         goto usage;
     if (socket_init())
     {
         sockerror("socket_init()");
         exit(EXIT_FAILURE);
     }
+    if (unixpath)
+    {
+        int len = sockaddr_set_unixpath(&server, unixpath);
+        if (len < 0)
+        {
+            fprintf(stderr, "%s: bad or unsupported socket path\n", unixpath);
+            exit(EXIT_FAILURE);
+        }
+        if ((sockfd = socket(AF_UNIX, protocol, 0)) < 0)
+        {
+            sockerror("socket");
+            exit(EXIT_FAILURE);
+        }
+        if (protocol == SOCK_STREAM && socket_connect(sockfd,
+            (struct sockaddr *)&server, len, timeout) < 0)
+        {
+            sockerror("connecting stream socket");
+            socket_close(sockfd);
+            exit(EXIT_FAILURE);
+        }
+        fprintf(stderr, "connected to %s\n", unixpath);
+        goto connected;
+    }
     /* get addrinfo list using hostname & port */
     status = addrinfo_get_list(&ailist, hostname, portno, protocol);
     if (status != 0)
@@ -109,7 +166,13 @@ int main(int argc, char **argv)
             (SOCK_STREAM==protocol)?"tcp":"udp", hostname, portno);
         exit(EXIT_FAILURE);
     }
-
+connected:
+    if (batch || typed)
+    {
+        sendbuffered(sockfd, protocol, &server, batch, typed);
+        socket_close(sockfd);
+        exit(EXIT_SUCCESS);
+    }
     /* now loop reading stdin and sending it to socket */
     while (1)
     {
@@ -123,8 +186,8 @@ int main(int argc, char **argv)
             int res = 0;
             if (protocol == SOCK_DGRAM)
             {
-                socklen_t addrlen = (server.ss_family == AF_INET6 ?
-                    sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+                socklen_t addrlen =
+                    sockaddr_get_len((struct sockaddr *)&server);
                 res = (int)sendto(sockfd, bp, nsend-nsent, 0,
                     (struct sockaddr *)&server, addrlen);
             }
@@ -146,11 +209,502 @@ done:
     socket_close(sockfd);
     exit(EXIT_SUCCESS);
 usage:
-    fprintf(stderr, "usage: pdsend <portnumber> [host] [udp|tcp] [timeout(s)]\n");
+    fprintf(stderr, "usage: pdsend [-b] [-t] <portnumber> [host] [udp|tcp] [timeout(s)]\n");
+    fprintf(stderr, "   or: pdsend [-b] [-t] <socket path> [udp|tcp] [timeout(s)]\n");
     fprintf(stderr, "(default is localhost and tcp with 10s timeout)\n");
+    fprintf(stderr, "-b: pack as many messages as are waiting into each packet\n");
+    fprintf(stderr, "-t: send typed binary messages as \"netsend -t\" does\n");
     exit(EXIT_FAILURE);
 }
 
+/* -------------------- buffered and batched sending --------------------- */
+
+/* With "-b" or "-t", stdin is read in big chunks and the messages go out
+through a queue to a nonblocking socket, so that we go on reading while the
+connection is busy and vice versa.  With "-b", each datagram or typed message
+carries all the messages that were waiting; otherwise each message gets its
+own.  "-t" sends typed binary atoms as "netsend -t" does (see x_net.c): over
+TCP a two-byte hello, then each message as a 4-byte length and the tagged
+atoms; over UDP each datagram is the hello followed by atoms. */
+
+#define TYPED_MAGIC 0xff
+#define TYPED_VERSION 1
+#define TYPED_MAXSYM 65535
+#define TYPED_MAXTOKEN 1000         /* longest symbol, as in Pd's MAXPDSTRING */
+
+#define BUF_READSIZE 65536          /* bytes read from stdin at once */
+#define BUF_MAXQUEUE (1024 * 1024)  /* stop reading stdin when this far behind */
+#define BUF_MAXTYPED 65536          /* TCP: biggest typed message we make */
+#define BUF_MAXUDP 1472             /* UDP: biggest datagram we pack to */
+
+static int sendfd, sendprotocol, sendbatch, sendtyped;
+static const struct sockaddr *sendaddr;
+
+    /* TCP output waiting for the socket */
+static unsigned char *queue;
+static int queuesize, queuehead, queuetail;
+
+    /* the datagram or typed TCP message being filled */
+static unsigned char *packet;
+static int packetsize, packetlen, packetnmsg;
+
+    /* typed: atoms of the message being parsed, with the onset of the last
+    'f' or 'F' if it was the last atom, so that floats can be run together */
+static unsigned char *msg;
+static int msgsize, msglen, msglastf = -1;
+
+    /* typed TCP: symbols we've given numbers to */
+static char **symhash;
+static int *symid;
+static int symhashsize, nsym;
+
+static void growbuf(unsigned char **bufp, int *sizep, int need)
+{
+    if (need > *sizep)
+    {
+        int newsize = (*sizep ? *sizep : 4096);
+        while (newsize < need)
+            newsize *= 2;
+        if (!(*bufp = (unsigned char *)realloc(*bufp, newsize)))
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        *sizep = newsize;
+    }
+}
+
+static void put16(unsigned char *p, unsigned int n)
+{
+    p[0] = n >> 8;
+    p[1] = n;
+}
+
+static void put32(unsigned char *p, uint32_t n)
+{
+    p[0] = n >> 24;
+    p[1] = n >> 16;
+    p[2] = n >> 8;
+    p[3] = n;
+}
+
+static int wouldblock(void)
+{
+    int err = socket_errno();
+#ifdef _WIN32
+    return (err == WSAEWOULDBLOCK);
+#else
+    return (err == EAGAIN || err == EWOULDBLOCK);
+#endif
+}
+
+static void waitwritable(void)
+{
+    fd_set writeset;
+    FD_ZERO(&writeset);
+    FD_SET(sendfd, &writeset);
+    select(sendfd + 1, 0, &writeset, 0, 0);
+}
+
+    /* throw away whatever the other side sends (a typed hello, say), so
+    that closing doesn't reset the connection; returns 0 at end of file */
+static int discardinput(void)
+{
+    char buf[1024];
+    int ret;
+    while ((ret = (int)recv(sendfd, buf, sizeof(buf), 0)) > 0)
+        ;
+    return (ret < 0 && wouldblock());
+}
+
+static void queue_add(const unsigned char *buf, int n)
+{
+    if (queuehead == queuetail)
+        queuehead = queuetail = 0;
+    else if (queuehead > queuesize / 2)
+    {
+        memmove(queue, queue + queuehead, queuetail - queuehead);
+        queuetail -= queuehead;
+        queuehead = 0;
+    }
+    growbuf(&queue, &queuesize, queuetail + n);
+    memcpy(queue + queuetail, buf, n);
+    queuetail += n;
+}
+
+    /* send as much of the queue as the socket will take now */
+static void queue_send(void)
+{
+    while (queuehead < queuetail)
+    {
+        int res = (int)send(sendfd, (char *)queue + queuehead,
+            queuetail - queuehead, 0);
+        if (res < 0)
+        {
+            if (wouldblock())
+                return;
+            sockerror("send");
+            exit(EXIT_FAILURE);
+        }
+        queuehead += res;
+    }
+}
+
+static void packet_start(void)
+{
+    growbuf(&packet, &packetsize, 4);
+    packetnmsg = 0;
+    if (!sendtyped)
+        packetlen = 0;
+    else if (sendprotocol == SOCK_STREAM)
+        packetlen = 4;  /* room for the length */
+    else
+    {
+        packet[0] = TYPED_MAGIC;
+        packet[1] = TYPED_VERSION;
+        packetlen = 2;
+    }
+}
+
+static void packet_flush(void)
+{
+    if (!packetnmsg)
+        return;
+    if (sendprotocol == SOCK_STREAM)
+    {
+        put32(packet, packetlen - 4);
+        queue_add(packet, packetlen);
+    }
+    else while (sendto(sendfd, (char *)packet, packetlen, 0, sendaddr,
+        sockaddr_get_len(sendaddr)) < 0)
+    {
+        if (!wouldblock())
+        {
+            sockerror("sendto");
+            exit(EXIT_FAILURE);
+        }
+        waitwritable();
+    }
+    packet_start();
+}
+
+static void packet_add(const unsigned char *buf, int n)
+{
+    if (packetnmsg && packetlen + n >
+        (sendprotocol == SOCK_STREAM ? BUF_MAXTYPED : BUF_MAXUDP))
+            packet_flush();
+    growbuf(&packet, &packetsize, packetlen + n);
+    memcpy(packet + packetlen, buf, n);
+    packetlen += n;
+    packetnmsg++;
+    if (!sendbatch)
+        packet_flush();
+}
+
+    /* find the number we gave a symbol, or -1 after giving it one, or -2
+    if we've run out */
+static unsigned int sym_hash(const char *name)
+{
+    unsigned int h = 2166136261u;
+    for (; *name; name++)
+        h = (h ^ (unsigned char)*name) * 16777619u;
+    return (h);
+}
+
+static int sym_find(const char *name)
+{
+    unsigned int i, mask;
+    if (nsym >= symhashsize / 2)
+    {
+        char **oldhash = symhash;
+        int *oldid = symid, oldsize = symhashsize, j;
+        if (nsym >= TYPED_MAXSYM)
+            return (-2);
+        symhashsize = (oldsize ? 2 * oldsize : 256);
+        symhash = (char **)calloc(symhashsize, sizeof(char *));
+        symid = (int *)calloc(symhashsize, sizeof(int));
+        if (!symhash || !symid)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        mask = symhashsize - 1;
+        for (j = 0; j < oldsize; j++)
+            if (oldhash[j])
+        {
+            for (i = sym_hash(oldhash[j]) & mask; symhash[i];
+                i = (i + 1) & mask)
+                    ;
+            symhash[i] = oldhash[j];
+            symid[i] = oldid[j];
+        }
+        free(oldhash);
+        free(oldid);
+    }
+    mask = symhashsize - 1;
+    for (i = sym_hash(name) & mask; symhash[i]; i = (i + 1) & mask)
+        if (!strcmp(symhash[i], name))
+            return (symid[i]);
+    if (!(symhash[i] = strdup(name)))
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    symid[i] = nsym++;
+    return (-1);
+}
+
+static void msg_addfloat(double d)
+{
+    float f = (float)d;
+    uint32_t u;
+    unsigned char *bp;
+        /* float32 unless that would change a big integer or overflow */
+    if ((d > FLT_MAX || d < -FLT_MAX) || ((double)f != d &&
+        d > -9e18 && d < 9e18 && d == (double)(long long)d))
+    {
+        uint64_t w;
+        memcpy(&w, &d, 8);
+        growbuf(&msg, &msgsize, msglen + 9);
+        msg[msglen] = 'd';
+        put32(msg + msglen + 1, (uint32_t)(w >> 32));
+        put32(msg + msglen + 5, (uint32_t)w);
+        msglen += 9;
+        msglastf = -1;
+        return;
+    }
+    memcpy(&u, &f, 4);
+    growbuf(&msg, &msgsize, msglen + 7);
+    if (msglastf >= 0 && msg[msglastf] == 'f')
+    {
+            /* two in a row: make the first a run */
+        bp = msg + msglastf;
+        memmove(bp + 3, bp + 1, 4);
+        bp[0] = 'F';
+        put16(bp + 1, 1);
+        msglen += 2;
+    }
+    bp = (msglastf >= 0 ? msg + msglastf : 0);
+    if (bp && ((bp[1] << 8) | bp[2]) < 65535)
+    {
+        put16(bp + 1, ((bp[1] << 8) | bp[2]) + 1);
+        put32(msg + msglen, u);
+        msglen += 4;
+    }
+    else
+    {
+        msglastf = msglen;
+        msg[msglen] = 'f';
+        put32(msg + msglen + 1, u);
+        msglen += 5;
+    }
+}
+
+static void msg_addsymbol(const char *name, int len)
+{
+    int id = (sendprotocol == SOCK_STREAM ? sym_find(name) : -2);
+    growbuf(&msg, &msgsize, msglen + 5 + len);
+    if (id >= 0)
+    {
+        msg[msglen] = 'S';
+        put16(msg + msglen + 1, id);
+        msglen += 3;
+    }
+    else if (id == -1)
+    {
+        msg[msglen] = 's';
+        put16(msg + msglen + 1, nsym - 1);
+        put16(msg + msglen + 3, len);
+        memcpy(msg + msglen + 5, name, len);
+        msglen += 5 + len;
+    }
+    else
+    {
+        msg[msglen] = 'n';
+        put16(msg + msglen + 1, len);
+        memcpy(msg + msglen + 3, name, len);
+        msglen += 3 + len;
+    }
+    msglastf = -1;
+}
+
+    /* does a token read as a number in Pd? */
+static int token_isfloat(const char *s)
+{
+    int ndigit = 0;
+    if (*s == '+' || *s == '-')
+        s++;
+    for (; *s >= '0' && *s <= '9'; s++)
+        ndigit++;
+    if (*s == '.')
+        for (s++; *s >= '0' && *s <= '9'; s++)
+            ndigit++;
+    if (!ndigit)
+        return (0);
+    if (*s == 'e' || *s == 'E')
+    {
+        s++;
+        if (*s == '+' || *s == '-')
+            s++;
+        if (*s < '0' || *s > '9')
+            return (0);
+        while (*s >= '0' && *s <= '9')
+            s++;
+    }
+    return (!*s);
+}
+
+    /* split FUDI text into atoms; each complete message goes to a packet */
+static void typed_parse(const char *bp, int n)
+{
+    char token[TYPED_MAXTOKEN + 1];
+    int i, len = 0, intoken = 0, escaped = 0;
+    for (i = 0; i <= n; i++)
+    {
+        int c = (i < n ? bp[i] : ' ');
+        if (c == '\\' && i + 1 < n)
+        {
+            c = bp[++i];
+            escaped = 1;
+        }
+        else if (c == ' ' || c == '\t' || c == '\n' || c == '\r' ||
+            c == ';' || c == ',')
+        {
+            if (intoken)
+            {
+                token[len] = 0;
+                if (!escaped && token_isfloat(token))
+                    msg_addfloat(strtod(token, 0));
+                else msg_addsymbol(token, len);
+            }
+            len = intoken = escaped = 0;
+            if (c == ';' || c == ',')
+            {
+                growbuf(&msg, &msgsize, msglen + 1);
+                msg[msglen++] = c;
+                msglastf = -1;
+            }
+            if (c == ';')
+            {
+                packet_add(msg, msglen);
+                msglen = 0;
+            }
+            continue;
+        }
+        intoken = 1;
+        if (len < TYPED_MAXTOKEN)
+            token[len++] = c;
+    }
+}
+
+    /* pass n bytes of complete lines of input on */
+static void sendtext(const char *bp, int n)
+{
+    if (sendtyped)
+        typed_parse(bp, n);
+    else if (sendprotocol == SOCK_STREAM)
+        queue_add((const unsigned char *)bp, n);
+    else while (n > 0)
+    {
+        const char *nl = memchr(bp, '\n', n);
+        int len = (nl ? (int)(nl - bp) + 1 : n);
+        packet_add((const unsigned char *)bp, len);
+        bp += len;
+        n -= len;
+    }
+}
+
+static void sendbuffered(int sockfd, int protocol,
+    const struct sockaddr_storage *server, int batch, int typed)
+{
+    static char inbuf[BUF_READSIZE];
+    int inlen = 0, eof = 0;
+    sendfd = sockfd;
+    sendprotocol = protocol;
+    sendbatch = batch;
+    sendtyped = typed;
+    sendaddr = (const struct sockaddr *)server;
+    socket_set_nonblocking(sockfd, 1);
+    packet_start();
+    if (typed && protocol == SOCK_STREAM)
+    {
+        static const unsigned char hello[2] = {TYPED_MAGIC, TYPED_VERSION};
+        queue_add(hello, 2);
+    }
+    while (!eof || queuehead < queuetail)
+    {
+        fd_set readset, writeset;
+        int canread = (!eof && queuetail - queuehead < BUF_MAXQUEUE), end;
+        FD_ZERO(&readset);
+        FD_ZERO(&writeset);
+        if (queuehead < queuetail)
+            FD_SET(sockfd, &writeset);
+        if (protocol == SOCK_STREAM)
+            FD_SET(sockfd, &readset);
+#ifdef _WIN32
+            /* stdin can't be selected on here; wait for the socket only
+            when there's nothing else to do */
+        if (!canread && select(sockfd + 1, &readset, &writeset, 0, 0) < 0)
+#else
+        if (canread)
+            FD_SET(0, &readset);
+        if (select(sockfd + 1, &readset, &writeset, 0, 0) < 0)
+#endif
+        {
+            if (errno == EINTR)
+                continue;
+            perror("select");
+            exit(EXIT_FAILURE);
+        }
+        if (FD_ISSET(sockfd, &readset) && !discardinput())
+            return;     /* the other side closed */
+#ifndef _WIN32
+        canread = FD_ISSET(0, &readset);
+#endif
+        if (canread)
+        {
+            int ret = (int)read(0, inbuf + inlen, BUF_READSIZE - inlen);
+            if (ret < 0 && errno == EINTR)
+                continue;
+            if (ret < 0)
+                perror("stdin");
+            if (ret <= 0)
+                eof = 1;
+            else inlen += ret;
+                /* pass on whole lines, or anything too long for one */
+            for (end = inlen; end > 0 && inbuf[end-1] != '\n'; end--)
+                ;
+            if (eof || (!end && inlen == BUF_READSIZE))
+                end = inlen;
+            sendtext(inbuf, end);
+            memmove(inbuf, inbuf + end, inlen - end);
+            inlen -= end;
+            if (eof && typed && msglen)
+            {
+                packet_add(msg, msglen);
+                msglen = 0;
+            }
+            packet_flush();
+        }
+        queue_send();
+    }
+    if (protocol == SOCK_STREAM)
+    {
+            /* wait a second for the other side to close first */
+        struct timeval timeout;
+        fd_set readset;
+        timeout.tv_sec = 1;
+        timeout.tv_usec = 0;
+        shutdown(sockfd, SHUT_WR);
+        do
+        {
+            FD_ZERO(&readset);
+            FD_SET(sockfd, &readset);
+        } while (select(sockfd + 1, &readset, 0, 0, &timeout) > 0 &&
+            discardinput());
+    }
+}
+
 void sockerror(char *s)
 {
     char buf[256];
@@ -6,18 +6,28 @@
 */
 
 #include "m_pd.h"
+#include "s_stuff.h"
+#include "d_simd.h"
 #include <math.h>
 #define LOGTEN 2.302585092994046
 
+    /* with -fastmath these use the same approximations as mtof~ etc.,
+    rewritten in base 2; see d_math.c */
+#define LOG2TEN 3.3219280948873623
+
 t_float mtof(t_float f)
 {
     if (f <= -1500) return(0);
     else if (f > 1499) return(mtof(1499));
+    else if (sys_fastmath)
+        return (fast_exp2(f * (1./12.) + 3.0313597135246599));
     else return (8.17579891564 * exp(.0577622650 * f));
 }
 
 t_float ftom(t_float f)
 {
+    if (sys_fastmath)
+        return (f > 0 ? 12. * fast_log2(f) - 36.376316562295918 : -1500);
     return (f > 0 ? 17.3123405046 * log(.12231220585 * f) : -1500);
 }
 
@@ -26,7 +36,8 @@ t_float powtodb(t_float f)
     if (f <= 0) return (0);
     else
     {
-        t_float val = 100 + 10./LOGTEN * log(f);
+        t_float val = 100 + (sys_fastmath ?
+            10./LOG2TEN * fast_log2(f) : 10./LOGTEN * log(f));
         return (val < 0 ? 0 : val);
     }
 }
@@ -36,7 +47,8 @@ t_float rmstodb(t_float f)
     if (f <= 0) return (0);
     else
     {
-        t_float val = 100 + 20./LOGTEN * log(f);
+        t_float val = 100 + (sys_fastmath ?
+            20./LOG2TEN * fast_log2(f) : 20./LOGTEN * log(f));
         return (val < 0 ? 0 : val);
     }
 }
@@ -49,6 +61,8 @@ t_float dbtopow(t_float f)
     {
         if (f > 870)
             f = 870;
+        if (sys_fastmath)
+            return (fast_exp2((LOG2TEN * 0.1) * (f-100.)));
         return (exp((LOGTEN * 0.1) * (f-100.)));
     }
 }
@@ -62,6 +76,8 @@ t_float dbtorms(t_float f)
         if (f > 485)
             f = 485;
     }
+    if (sys_fastmath)
+        return (fast_exp2((LOG2TEN * 0.05) * (f-100.)));
     return (exp((LOGTEN * 0.05) * (f-100.)));
 }
 
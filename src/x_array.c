@@ -5,9 +5,13 @@
 /* The "array" object. */
 
 #include "m_pd.h"
+#include "m_imp.h"
+#include "s_stuff.h"
 #include "g_canvas.h"
 #include <string.h>
 #include <stdio.h>
+#include <math.h>
+#include <pthread.h>
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -338,11 +342,17 @@ static t_array *array_client_getbuf(t_array_client *x, t_glist **glist)
     else return (0);    /* shouldn't happen */
 }
 
-static void array_client_senditup(t_array_client *x)
+    /* redraw after changing "n" elements starting at "onset" */
+static void array_client_senditup(t_array_client *x, int onset, int n)
 {
     t_glist *glist = 0;
     t_array *a = array_client_getbuf(x, &glist);
-    if (glist)
+    t_garray *y;
+        /* named arrays only redraw the part that changed */
+    if (x->tc_sym &&
+        (y = (t_garray *)pd_findbyclass(x->tc_sym, garray_class)))
+            garray_redrawrange(y, onset, n);
+    else if (glist)
        array_redraw(a, glist);
 }
 
@@ -541,7 +551,7 @@ static void *array_rangeop_new(t_class *class,
     return (x);
 }
 
-static int array_rangeop_getrange(t_array_rangeop *x,
+static int array_rangeop_getrange(t_array_rangeop *x, t_array **arrayp,
     char **firstitemp, int *nitemp, int *stridep, int *arrayonsetp)
 {
     t_glist *glist;
@@ -559,7 +569,7 @@ static int array_rangeop_getrange(t_array_rangeop *x,
             x->x_elemfield->s_name, a->a_templatesym->s_name);
         return (0);
     }
-    stride = a->a_elemsize;
+    stride = ARRAY_STRIDE(a);
     arrayonset = x->x_onset;
     if (arrayonset < 0)
         arrayonset = 0;
@@ -573,7 +583,50 @@ static int array_rangeop_getrange(t_array_rangeop *x,
         if (nitem + arrayonset > a->a_n)
             nitem = a->a_n - arrayonset;
     }
-    *firstitemp = a->a_vec+(fieldonset+arrayonset*stride);
+    *arrayp = a;
+    *firstitemp = ARRAY_FIELD(a, fieldonset) + arrayonset*stride;
+    *nitemp = nitem;
+    *stridep = stride;
+    *arrayonsetp = arrayonset;
+    return (1);
+}
+
+    /* get smallest, largest, and sums of the range, with indices counting
+    from its start.  Contiguous floats are scanned with vector instructions,
+    and an array's summary (see g_array.c) is used if it has one. */
+static int array_rangeop_getstats(t_array_rangeop *x, t_arraystats *st,
+    t_array **arrayp, char **firstitemp, int *nitemp, int *stridep,
+    int *arrayonsetp)
+{
+    char *itemp, *firstitem;
+    int stride, nitem, arrayonset, i;
+    t_array *a;
+    if (!array_rangeop_getrange(x, &a, &firstitem, &nitem, &stride,
+        &arrayonset))
+            return (0);
+    array_initstats(st);
+    if (a->a_summary && firstitem == a->a_vec + arrayonset * sizeof(t_word))
+    {
+        array_getstats(a, arrayonset, nitem, st);
+        if (st->as_imin >= 0)
+            st->as_imin -= arrayonset;
+        if (st->as_imax >= 0)
+            st->as_imax -= arrayonset;
+    }
+    else if (stride == sizeof(t_word))
+        array_scanwords((t_word *)firstitem, 0, nitem, st);
+    else for (i = 0, itemp = firstitem; i < nitem; i++, itemp += stride)
+    {
+        t_float f = *(t_float *)itemp;
+        if (f < st->as_min)
+            st->as_min = f, st->as_imin = i;
+        if (f > st->as_max)
+            st->as_max = f, st->as_imax = i;
+        st->as_sum += f;
+        st->as_possum += (f > 0 ? f : 0);
+    }
+    *arrayp = a;
+    *firstitemp = firstitem;
     *nitemp = nitem;
     *stridep = stride;
     *arrayonsetp = arrayonset;
@@ -597,14 +650,14 @@ static void *array_sum_new(t_symbol *s, int argc, t_atom *argv)
 
 static void array_sum_bang(t_array_rangeop *x)
 {
-    char *itemp, *firstitem;
-    int stride, nitem, arrayonset, i;
-    double sum;
-    if (!array_rangeop_getrange(x, &firstitem, &nitem, &stride, &arrayonset))
-        return;
-    for (i = 0, sum = 0, itemp = firstitem; i < nitem; i++, itemp += stride)
-        sum += *(t_float *)itemp;
-    outlet_float(x->x_outlet, sum);
+    char *firstitem;
+    int stride, nitem, arrayonset;
+    t_arraystats st;
+    t_array *a;
+    if (!array_rangeop_getstats(x, &st, &a, &firstitem, &nitem, &stride,
+        &arrayonset))
+            return;
+    outlet_float(x->x_outlet, st.as_sum);
 }
 
 static void array_sum_float(t_array_rangeop *x, t_floatarg f)
@@ -631,8 +684,10 @@ static void array_get_bang(t_array_rangeop *x)
     char *itemp, *firstitem;
     int stride, nitem, arrayonset, i;
     t_atom *outv;
-    if (!array_rangeop_getrange(x, &firstitem, &nitem, &stride, &arrayonset))
-        return;
+    t_array *a;
+    if (!array_rangeop_getrange(x, &a, &firstitem, &nitem, &stride,
+        &arrayonset))
+            return;
     ATOMS_ALLOCA(outv, nitem);
     for (i = 0, itemp = firstitem; i < nitem; i++, itemp += stride)
         SETFLOAT(&outv[i],  *(t_float *)itemp);
@@ -663,13 +718,20 @@ static void array_set_list(t_array_rangeop *x, t_symbol *s,
 {
     char *itemp, *firstitem;
     int stride, nitem, arrayonset, i;
-    if (!array_rangeop_getrange(x, &firstitem, &nitem, &stride, &arrayonset))
-        return;
+    t_garray *y;
+    t_array *a;
+        /* a named array might share its points with others */
+    if (x->x_tc.tc_sym &&
+        (y = (t_garray *)pd_findbyclass(x->x_tc.tc_sym, garray_class)))
+            garray_unshare(y);
+    if (!array_rangeop_getrange(x, &a, &firstitem, &nitem, &stride,
+        &arrayonset))
+            return;
     if (nitem > argc)
         nitem = argc;
     for (i = 0, itemp = firstitem; i < nitem; i++, itemp += stride)
         *(t_float *)itemp = atom_getfloatarg(i, argc, argv);
-    array_client_senditup(&x->x_tc);
+    array_client_senditup(&x->x_tc, arrayonset, nitem);
 }
 
 /* -----  array quantile -- output quantile for input from 0 to 1 ------- */
@@ -690,12 +752,17 @@ static void array_quantile_float(t_array_rangeop *x, t_floatarg f)
     char *itemp, *firstitem;
     int stride, nitem, arrayonset, i;
     double sum;
-    if (!array_rangeop_getrange(x, &firstitem, &nitem, &stride, &arrayonset))
-        return;
-    for (i = 0, sum = 0, itemp = firstitem; i < nitem; i++, itemp += stride)
-        sum += (*(t_float *)itemp > 0? *(t_float *)itemp : 0);
-    sum *= f;
-    for (i = 0, itemp = firstitem; i < (nitem-1); i++, itemp += stride)
+    t_arraystats st;
+    t_array *a;
+    if (!array_rangeop_getstats(x, &st, &a, &firstitem, &nitem, &stride,
+        &arrayonset))
+            return;
+    sum = st.as_possum * f;
+        /* the first field, if its points are contiguous */
+    if (stride == sizeof(t_word) &&
+        firstitem == a->a_vec + arrayonset * sizeof(t_word))
+            i = array_quantile(a, arrayonset, nitem, sum);
+    else for (i = 0, itemp = firstitem; i < (nitem-1); i++, itemp += stride)
     {
         sum -= (*(t_float *)itemp > 0? *(t_float *)itemp : 0);
         if (sum < 0)
@@ -733,8 +800,9 @@ static void array_random_bang(t_array_random *x)
 {
     char *firstitem;
     int stride, nitem, arrayonset;
+    t_array *a;
 
-    if (!array_rangeop_getrange(&x->x_r, &firstitem, &nitem, &stride,
+    if (!array_rangeop_getrange(&x->x_r, &a, &firstitem, &nitem, &stride,
         &arrayonset))
             return;
     x->x_state = x->x_state * 472940017 + 832416023;
@@ -768,18 +836,23 @@ static void *array_max_new(t_symbol *s, int argc, t_atom *argv)
 
 static void array_max_bang(t_array_max *x)
 {
-    char *itemp, *firstitem;
-    int stride, nitem, arrayonset, i, besti;
-    t_float bestf;
-    if (!array_rangeop_getrange(&x->x_rangeop, &firstitem, &nitem, &stride,
-        &arrayonset))
+    char *firstitem;
+    int stride, nitem, arrayonset;
+    t_arraystats st;
+    t_array *a;
+    if (!array_rangeop_getstats(&x->x_rangeop, &st, &a, &firstitem, &nitem,
+        &stride, &arrayonset))
             return;
-    for (i = 0, besti = -1, bestf= -1e30, itemp = firstitem;
-        i < nitem; i++, itemp += stride)
-            if (*(t_float *)itemp > bestf)
-                bestf = *(t_float *)itemp, besti = i+arrayonset;
-    outlet_float(x->x_out2, besti);
-    outlet_float(x->x_out1, bestf);
+    if (st.as_imax >= 0)
+    {
+        outlet_float(x->x_out2, st.as_imax + arrayonset);
+        outlet_float(x->x_out1, st.as_max);
+    }
+    else
+    {
+        outlet_float(x->x_out2, -1);
+        outlet_float(x->x_out1, -1e30);
+    }
 }
 
 static void array_max_float(t_array_max *x, t_floatarg f)
@@ -809,18 +882,23 @@ static void *array_min_new(t_symbol *s, int argc, t_atom *argv)
 
 static void array_min_bang(t_array_min *x)
 {
-    char *itemp, *firstitem;
-    int stride, nitem, i, arrayonset, besti;
-    t_float bestf;
-    if (!array_rangeop_getrange(&x->x_rangeop, &firstitem, &nitem, &stride,
-        &arrayonset))
+    char *firstitem;
+    int stride, nitem, arrayonset;
+    t_arraystats st;
+    t_array *a;
+    if (!array_rangeop_getstats(&x->x_rangeop, &st, &a, &firstitem, &nitem,
+        &stride, &arrayonset))
             return;
-    for (i = 0, besti = -1, bestf= 1e30, itemp = firstitem;
-        i < nitem; i++, itemp += stride)
-            if (*(t_float *)itemp < bestf)
-                bestf = *(t_float *)itemp, besti = i+arrayonset;
-    outlet_float(x->x_out2, besti);
-    outlet_float(x->x_out1, bestf);
+    if (st.as_imin >= 0)
+    {
+        outlet_float(x->x_out2, st.as_imin + arrayonset);
+        outlet_float(x->x_out1, st.as_min);
+    }
+    else
+    {
+        outlet_float(x->x_out2, -1);
+        outlet_float(x->x_out1, 1e30);
+    }
 }
 
 static void array_min_float(t_array_min *x, t_floatarg f)
@@ -829,6 +907,406 @@ static void array_min_float(t_array_min *x, t_floatarg f)
     array_min_bang(x);
 }
 
+/* ---- array fft: complex FFT of a pair of arrays, in worker threads ---- */
+
+    /* The real and imaginary parts are copied out of the arrays and the
+    transform is computed in a thread of its own; a clock polls for
+    completion (as "soundfiler read -async" does), then the results are
+    swapped into the arrays and the outlet bangs.  Big transforms use the
+    "four-step" algorithm: with N = N1*N2, N2 FFTs of size N1 down the
+    columns, a twiddle multiply, and N1 FFTs of size N2 along the rows, each
+    step shared out among up to ARRAYFFT_MAXTHREADS threads.  Like fft~ and
+    ifft~, neither direction is normalized. */
+
+#define ARRAYFFT_POLL 5         /* msec between checks for completion */
+#define ARRAYFFT_MAXTHREADS 8
+#define ARRAYFFT_PARALLEL (1 << 16) /* smallest size to split up */
+#define ARRAYFFT_GATHER 16      /* columns gathered at once in step 1 */
+
+int garray_exchangewords(t_garray *x, t_word **vecp, int *np);
+
+struct _array_fft;
+
+typedef struct _fftjob
+{
+    struct _array_fft *j_owner; /* 0 once the object is gone */
+    int j_done;                 /* set by the thread when finished */
+    int j_inverse;
+    int j_n;                    /* size N = N1*N2 */
+    int j_n1;
+    int j_n2;
+    int j_nthreads;
+    t_symbol *j_arrays[2];      /* where the results go */
+    t_sample *j_in[2];          /* real and imaginary input, then scratch */
+    t_word *j_out[2];           /* real and imaginary output */
+    t_complexfft *j_fft1[ARRAYFFT_MAXTHREADS];  /* size N1 (or N) */
+    t_complexfft *j_fft2[ARRAYFFT_MAXTHREADS];  /* size N2 */
+} t_fftjob;
+
+    /* one thread's share of a step */
+typedef struct _fftpart
+{
+    t_fftjob *p_job;
+    int p_index;
+    int p_onset;
+    int p_count;
+    int p_step;
+} t_fftpart;
+
+static t_class *array_fft_class;
+
+typedef struct _array_fft
+{
+    t_object x_obj;
+    t_symbol *x_re;
+    t_symbol *x_im;
+    t_fftjob *x_job;
+    t_clock *x_clock;
+} t_array_fft;
+
+static pthread_mutex_t fftjob_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void fftjob_free(t_fftjob *j)
+{
+    int i;
+    for (i = 0; i < 2; i++)
+    {
+        if (j->j_in[i])
+            freebytes(j->j_in[i], j->j_n * sizeof(t_sample));
+        if (j->j_out[i])
+            freebytes(j->j_out[i], j->j_n * sizeof(t_word));
+    }
+    for (i = 0; i < ARRAYFFT_MAXTHREADS; i++)
+    {
+        if (j->j_fft1[i])
+            complexfft_free(j->j_fft1[i]);
+        if (j->j_fft2[i])
+            complexfft_free(j->j_fft2[i]);
+    }
+    freebytes(j, sizeof(*j));
+}
+
+    /* step 1: FFT columns n2 = onset ... onset+count-1, each the N1 points
+    x[N2*n1 + n2], and multiply by the twiddle factors exp(-+2pi i n2 k1/N),
+    leaving the results where they came from. */
+static void fftjob_columns(t_fftjob *j, t_complexfft *fft, int onset,
+    int count)
+{
+    int n1 = j->j_n1, n2 = j->j_n2, i, k, c, nc;
+    t_sample *re = j->j_in[0], *im = j->j_in[1];
+    t_sample *bre = (t_sample *)getbytes(ARRAYFFT_GATHER * n1 *
+        sizeof(t_sample));
+    t_sample *bim = (t_sample *)getbytes(ARRAYFFT_GATHER * n1 *
+        sizeof(t_sample));
+    double sign = (j->j_inverse ? 1 : -1);
+    for (i = onset; i < onset + count; i += nc)
+    {
+        nc = onset + count - i;
+        if (nc > ARRAYFFT_GATHER)
+            nc = ARRAYFFT_GATHER;
+            /* gather a few neighboring columns at once to read whole
+            cache lines */
+        for (k = 0; k < n1; k++)
+            for (c = 0; c < nc; c++)
+                bre[c*n1 + k] = re[k*n2 + i + c],
+                    bim[c*n1 + k] = im[k*n2 + i + c];
+        for (c = 0; c < nc; c++)
+        {
+            t_sample *cre = bre + c*n1, *cim = bim + c*n1;
+            double angle = sign * 2 * 3.14159265358979323846 * (i + c) /
+                j->j_n, wre = 1, wim = 0, dre = cos(angle), dim = sin(angle);
+            if (j->j_inverse)
+                complexfft_inverse(fft, cre, cim);
+            else complexfft_forward(fft, cre, cim);
+            for (k = 0; k < n1; k++)
+            {
+                double tre = cre[k] * wre - cim[k] * wim,
+                    tim = cre[k] * wim + cim[k] * wre, t;
+                cre[k] = tre;
+                cim[k] = tim;
+                t = wre * dre - wim * dim;
+                wim = wre * dim + wim * dre;
+                wre = t;
+            }
+        }
+        for (k = 0; k < n1; k++)
+            for (c = 0; c < nc; c++)
+                re[k*n2 + i + c] = bre[c*n1 + k],
+                    im[k*n2 + i + c] = bim[c*n1 + k];
+    }
+    freebytes(bre, ARRAYFFT_GATHER * n1 * sizeof(t_sample));
+    freebytes(bim, ARRAYFFT_GATHER * n1 * sizeof(t_sample));
+}
+
+    /* step 2: FFT rows k1 = onset ... onset+count-1, now contiguous, and
+    scatter them to the outputs at X[k1 + N1*k2]. */
+static void fftjob_rows(t_fftjob *j, t_complexfft *fft, int onset,
+    int count)
+{
+    int n1 = j->j_n1, n2 = j->j_n2, i, k;
+    for (i = onset; i < onset + count; i++)
+    {
+        t_sample *rre = j->j_in[0] + i*n2, *rim = j->j_in[1] + i*n2;
+        if (j->j_inverse)
+            complexfft_inverse(fft, rre, rim);
+        else complexfft_forward(fft, rre, rim);
+        for (k = 0; k < n2; k++)
+            j->j_out[0][i + n1*k].w_float = rre[k],
+                j->j_out[1][i + n1*k].w_float = rim[k];
+    }
+}
+
+static void *fftjob_part(void *z)
+{
+    t_fftpart *p = (t_fftpart *)z;
+    int affinityserial = -1;
+    if (p->p_index)
+        sys_bindthread(AFFINITY_DISK, &affinityserial);
+    if (p->p_step == 1)
+        fftjob_columns(p->p_job, p->p_job->j_fft1[p->p_index],
+            p->p_onset, p->p_count);
+    else fftjob_rows(p->p_job, p->p_job->j_fft2[p->p_index],
+            p->p_onset, p->p_count);
+    return (0);
+}
+
+    /* share one step's "total" columns or rows among the threads; the
+    calling thread takes the first range. */
+static void fftjob_step(t_fftjob *j, int step, int total)
+{
+    t_fftpart part[ARRAYFFT_MAXTHREADS];
+    pthread_t thread[ARRAYFFT_MAXTHREADS];
+    int started[ARRAYFFT_MAXTHREADS], i, onset,
+        per = (total + j->j_nthreads - 1) / j->j_nthreads;
+    for (i = 0, onset = 0; i < j->j_nthreads; i++, onset += per)
+    {
+        part[i].p_job = j;
+        part[i].p_index = i;
+        part[i].p_onset = (onset < total ? onset : total);
+        part[i].p_count = (onset + per < total ? onset + per : total) -
+            part[i].p_onset;
+        part[i].p_step = step;
+        started[i] = (i > 0 &&
+            !pthread_create(&thread[i], 0, fftjob_part, &part[i]));
+    }
+    for (i = 0; i < j->j_nthreads; i++)
+        if (!started[i])
+            fftjob_part(&part[i]);
+    for (i = 1; i < j->j_nthreads; i++)
+        if (started[i])
+            pthread_join(thread[i], 0);
+}
+
+static void *fftjob_main(void *z)
+{
+    t_fftjob *j = (t_fftjob *)z;
+    int i, orphaned, affinityserial = -1;
+    sys_bindthread(AFFINITY_DISK, &affinityserial);
+    if (!j->j_n2)
+    {
+        if (j->j_inverse)
+            complexfft_inverse(j->j_fft1[0], j->j_in[0], j->j_in[1]);
+        else complexfft_forward(j->j_fft1[0], j->j_in[0], j->j_in[1]);
+        for (i = 0; i < j->j_n; i++)
+            j->j_out[0][i].w_float = j->j_in[0][i],
+                j->j_out[1][i].w_float = j->j_in[1][i];
+    }
+    else
+    {
+        fftjob_step(j, 1, j->j_n2);
+        fftjob_step(j, 2, j->j_n1);
+    }
+    pthread_mutex_lock(&fftjob_mutex);
+    j->j_done = 1;
+    orphaned = !j->j_owner;
+    pthread_mutex_unlock(&fftjob_mutex);
+    if (orphaned)
+        fftjob_free(j);
+    return (0);
+}
+
+static int array_fft_getarray(t_array_fft *x, t_symbol *s, t_word **vec,
+    int *n)
+{
+    t_garray *g;
+    if (!s)
+        pd_error(x, "array fft: no array name set");
+    else if (!(g = (t_garray *)pd_findbyclass(s, garray_class)))
+        pd_error(x, "array fft: couldn't find named array '%s'", s->s_name);
+    else if (garray_getfloatwords_readonly(g, n, vec))
+        return (1);
+    return (0);
+}
+
+static void array_fft_start(t_array_fft *x, int inverse)
+{
+    t_fftjob *j;
+    t_word *vec[2];
+    int n, n2, i, k, logn, nthreads = 1, fail;
+    pthread_attr_t attr;
+    pthread_t thread;
+    if (x->x_job)
+    {
+        pd_error(x, "array fft: previous transform still running");
+        return;
+    }
+    if (!array_fft_getarray(x, x->x_re, &vec[0], &n) ||
+        !array_fft_getarray(x, x->x_im, &vec[1], &n2))
+            return;
+    if (n != n2)
+    {
+        pd_error(x, "array fft: %s and %s differ in size",
+            x->x_re->s_name, x->x_im->s_name);
+        return;
+    }
+    if (n < 2 || n != (1 << (logn = ilog2(n))))
+    {
+        pd_error(x, "array fft: size %d not a power of two", n);
+        return;
+    }
+    j = (t_fftjob *)getbytes(sizeof(*j));
+    j->j_owner = x;
+    j->j_inverse = inverse;
+    j->j_n = n;
+    j->j_arrays[0] = x->x_re;
+    j->j_arrays[1] = x->x_im;
+#ifdef _SC_NPROCESSORS_ONLN
+    {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = (ncpu > ARRAYFFT_MAXTHREADS ? ARRAYFFT_MAXTHREADS :
+            (ncpu < 1 ? 1 : (int)ncpu));
+    }
+#endif
+    if (n < ARRAYFFT_PARALLEL || nthreads < 2)
+    {
+        j->j_nthreads = 1;
+        if (!(j->j_fft1[0] = complexfft_new(n)))
+            goto fail;
+    }
+    else
+    {
+        j->j_nthreads = nthreads;
+        j->j_n1 = 1 << (logn / 2);
+        j->j_n2 = n / j->j_n1;
+        for (i = 0; i < nthreads; i++)
+            if (!(j->j_fft1[i] = complexfft_new(j->j_n1)) ||
+                !(j->j_fft2[i] = complexfft_new(j->j_n2)))
+                    goto fail;
+    }
+    for (i = 0; i < 2; i++)
+    {
+        if (!(j->j_in[i] = (t_sample *)getbytes(n * sizeof(t_sample))) ||
+            !(j->j_out[i] = (t_word *)getbytes(n * sizeof(t_word))))
+                goto fail;
+        for (k = 0; k < n; k++)
+            j->j_in[i][k] = vec[i][k].w_float;
+    }
+    x->x_job = j;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    fail = pthread_create(&thread, &attr, fftjob_main, j);
+    pthread_attr_destroy(&attr);
+    if (fail)
+    {
+        x->x_job = 0;
+        goto fail;
+    }
+    clock_delay(x->x_clock, ARRAYFFT_POLL);
+    return;
+fail:
+    pd_error(x, "array fft: couldn't start transform of size %d", n);
+    fftjob_free(j);
+}
+
+static void array_fft_forward(t_array_fft *x)
+{
+    array_fft_start(x, 0);
+}
+
+static void array_fft_inverse(t_array_fft *x)
+{
+    array_fft_start(x, 1);
+}
+
+static void array_fft_set(t_array_fft *x, t_symbol *re, t_symbol *im)
+{
+    x->x_re = re;
+    x->x_im = im;
+}
+
+    /* the transform is done: swap the results into the arrays */
+static void array_fft_poll(t_array_fft *x)
+{
+    t_fftjob *j = x->x_job;
+    int i, done;
+    pthread_mutex_lock(&fftjob_mutex);
+    done = j->j_done;
+    pthread_mutex_unlock(&fftjob_mutex);
+    if (!done)
+    {
+        clock_delay(x->x_clock, ARRAYFFT_POLL);
+        return;
+    }
+    x->x_job = 0;
+    for (i = 0; i < 2; i++)
+    {
+        t_garray *g = (t_garray *)pd_findbyclass(j->j_arrays[i],
+            garray_class);
+        int n = j->j_n;
+        if (!g)
+            pd_error(x, "array fft: %s: no such array",
+                j->j_arrays[i]->s_name);
+        else if (garray_exchangewords(g, &j->j_out[i], &n))
+        {
+                /* now holding the old contents, to be freed */
+            freebytes(j->j_out[i], n * sizeof(t_word));
+            j->j_out[i] = 0;
+            garray_redraw(g);
+        }
+    }
+    fftjob_free(j);
+    outlet_bang(x->x_obj.ob_outlet);
+}
+
+static void *array_fft_new(t_symbol *s, int argc, t_atom *argv)
+{
+    t_array_fft *x = (t_array_fft *)pd_new(array_fft_class);
+    x->x_re = x->x_im = 0;
+    x->x_job = 0;
+    if (argc && argv->a_type == A_SYMBOL)
+    {
+        x->x_re = argv->a_w.w_symbol;
+        argc--; argv++;
+    }
+    if (argc && argv->a_type == A_SYMBOL)
+    {
+        x->x_im = argv->a_w.w_symbol;
+        argc--; argv++;
+    }
+    if (argc)
+    {
+        post("warning: array fft ignoring extra argument: ");
+        postatom(argc, argv); endpost();
+    }
+    x->x_clock = clock_new(x, (t_method)array_fft_poll);
+    outlet_new(&x->x_obj, &s_bang);
+    return (x);
+}
+
+static void array_fft_free(t_array_fft *x)
+{
+    pthread_mutex_lock(&fftjob_mutex);
+    if (x->x_job)
+    {
+        if (x->x_job->j_done)
+            fftjob_free(x->x_job);
+        else x->x_job->j_owner = 0;
+        x->x_job = 0;
+    }
+    pthread_mutex_unlock(&fftjob_mutex);
+    clock_free(x->x_clock);
+}
+
 /* overall creator for "array" objects - dispatch to "array define" etc */
 static void *arrayobj_new(t_symbol *s, int argc, t_atom *argv)
 {
@@ -855,6 +1333,8 @@ static void *arrayobj_new(t_symbol *s, int argc, t_atom *argv)
             pd_this->pd_newest = array_max_new(s, argc-1, argv+1);
         else if (!strcmp(str, "min"))
             pd_this->pd_newest = array_min_new(s, argc-1, argv+1);
+        else if (!strcmp(str, "fft"))
+            pd_this->pd_newest = array_fft_new(s, argc-1, argv+1);
         else
         {
             pd_error(0, "array %s: unknown function", str);
@@ -943,4 +1423,16 @@ void x_array_setup(void)
     class_addfloat(array_min_class, array_min_float);
     class_addbang(array_min_class, array_min_bang);
     class_sethelpsymbol(array_min_class, gensym("array-object"));
+
+    array_fft_class = class_new(gensym("array fft"),
+        (t_newmethod)array_fft_new, (t_method)array_fft_free,
+            sizeof(t_array_fft), 0, A_GIMME, 0);
+    class_addbang(array_fft_class, array_fft_forward);
+    class_addmethod(array_fft_class, (t_method)array_fft_forward,
+        gensym("forward"), 0);
+    class_addmethod(array_fft_class, (t_method)array_fft_inverse,
+        gensym("inverse"), 0);
+    class_addmethod(array_fft_class, (t_method)array_fft_set,
+        gensym("set"), A_SYMBOL, A_SYMBOL, 0);
+    class_sethelpsymbol(array_fft_class, gensym("array-object"));
 }
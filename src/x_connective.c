@@ -351,6 +351,96 @@ static void receive_setup(void)
     class_sethelpsymbol(receive_class, gensym("send-receive"));
 }
 
+/* ------------- hash table for select and route arguments ------------- */
+
+/* With more than WORDHASH_MIN arguments, select and route look incoming
+floats or symbols up in a hash table (open addressing, at most half full)
+instead of comparing against each argument in turn.  Only the first of any
+duplicate arguments is entered so the same outlet wins as before. */
+
+#define WORDHASH_MIN 8
+
+typedef struct _wordhashslot
+{
+    t_word s_w;
+    int s_index;        /* argument number, or -1 if slot is empty */
+} t_wordhashslot;
+
+typedef struct _wordhash
+{
+    int h_size;         /* power of two, or zero if not hashing */
+    t_wordhashslot *h_vec;
+} t_wordhash;
+
+static unsigned int wordhash_key(t_atomtype type, t_word w)
+{
+    size_t k;
+    if (type == A_FLOAT)
+    {
+        union
+        {
+            t_float f;
+#if PD_FLOATSIZE == 32
+            uint32_t i;
+#else
+            uint64_t i;
+#endif
+        } u;
+        u.f = w.w_float;
+        if (!(u.i << 1))    /* -0 == 0 (tested on the bits since -ffast-math
+                            may assume there's no such thing as -0) */
+            u.i = 0;
+        k = (size_t)(u.i ^ (u.i >> 29));
+    }
+    else k = (size_t)w.w_symbol >> 3;
+    return ((unsigned int)(k * 2654435769u) ^ (unsigned int)(k >> 16));
+}
+
+static int wordhash_equal(t_atomtype type, t_word w1, t_word w2)
+{
+    return (type == A_FLOAT ? w1.w_float == w2.w_float :
+        w1.w_symbol == w2.w_symbol);
+}
+
+static void wordhash_init(t_wordhash *h, int n)
+{
+    int i;
+    h->h_size = 0;
+    h->h_vec = 0;
+    if (n <= WORDHASH_MIN)
+        return;
+    for (h->h_size = 16; h->h_size < 2 * n; h->h_size *= 2)
+        ;
+    h->h_vec = (t_wordhashslot *)getbytes(h->h_size * sizeof(*h->h_vec));
+    for (i = 0; i < h->h_size; i++)
+        h->h_vec[i].s_index = -1;
+}
+
+static void wordhash_free(t_wordhash *h)
+{
+    if (h->h_vec)
+        freebytes(h->h_vec, h->h_size * sizeof(*h->h_vec));
+}
+
+    /* find the argument number for a value, or -1 if absent.  If "add" is
+    nonzero and the value is absent, enter it as argument number "add-1". */
+static int wordhash_find(t_wordhash *h, t_atomtype type, t_word w, int add)
+{
+    int i = (int)(wordhash_key(type, w) & (h->h_size - 1));
+    while (h->h_vec[i].s_index >= 0)
+    {
+        if (wordhash_equal(type, h->h_vec[i].s_w, w))
+            return (h->h_vec[i].s_index);
+        i = (i + 1) & (h->h_size - 1);
+    }
+    if (add)
+    {
+        h->h_vec[i].s_w = w;
+        h->h_vec[i].s_index = add - 1;
+    }
+    return (-1);
+}
+
 /* -------------------------- select ------------------------------ */
 
 static t_class *sel1_class;
@@ -392,6 +482,7 @@ typedef struct _sel2
     t_int x_nelement;
     t_selectelement *x_vec;
     t_outlet *x_rejectout;
+    t_wordhash x_hash;
 } t_sel2;
 
 static void sel2_float(t_sel2 *x, t_float f)
@@ -400,7 +491,17 @@ static void sel2_float(t_sel2 *x, t_float f)
     int nelement;
     if (x->x_type == A_FLOAT)
     {
-        for (nelement = (int)x->x_nelement, e = x->x_vec; nelement--; e++)
+        if (x->x_hash.h_size)
+        {
+            t_word w;
+            w.w_float = f;
+            if ((nelement = wordhash_find(&x->x_hash, A_FLOAT, w, 0)) >= 0)
+            {
+                outlet_bang(x->x_vec[nelement].e_outlet);
+                return;
+            }
+        }
+        else for (nelement = (int)x->x_nelement, e = x->x_vec; nelement--; e++)
             if (e->e_w.w_float == f)
         {
             outlet_bang(e->e_outlet);
@@ -416,7 +517,17 @@ static void sel2_symbol(t_sel2 *x, t_symbol *s)
     int nelement;
     if (x->x_type == A_SYMBOL)
     {
-        for (nelement = (int)x->x_nelement, e = x->x_vec; nelement--; e++)
+        if (x->x_hash.h_size)
+        {
+            t_word w;
+            w.w_symbol = s;
+            if ((nelement = wordhash_find(&x->x_hash, A_SYMBOL, w, 0)) >= 0)
+            {
+                outlet_bang(x->x_vec[nelement].e_outlet);
+                return;
+            }
+        }
+        else for (nelement = (int)x->x_nelement, e = x->x_vec; nelement--; e++)
             if (e->e_w.w_symbol == s)
         {
             outlet_bang(e->e_outlet);
@@ -429,6 +540,7 @@ static void sel2_symbol(t_sel2 *x, t_symbol *s)
 static void sel2_free(t_sel2 *x)
 {
     freebytes(x->x_vec, x->x_nelement * sizeof(*x->x_vec));
+    wordhash_free(&x->x_hash);
 }
 
 static void *select_new(t_symbol *s, int argc, t_atom *argv)
@@ -472,6 +584,10 @@ static void *select_new(t_symbol *s, int argc, t_atom *argv)
                 e->e_w.w_float = atom_getfloatarg(n, argc, argv);
             else e->e_w.w_symbol = atom_getsymbolarg(n, argc, argv);
         }
+        wordhash_init(&x->x_hash, argc);
+        if (x->x_hash.h_size)
+            for (n = 0, e = x->x_vec; n < argc; n++, e++)
+                wordhash_find(&x->x_hash, x->x_type, e->e_w, n+1);
         x->x_rejectout = outlet_new(&x->x_obj, &s_float);
         return (x);
     }
@@ -511,23 +627,35 @@ typedef struct _route
     int x_nelement;
     t_routeelement *x_vec;
     t_outlet *x_rejectout;
+    t_wordhash x_hash;
 } t_route;
 
-static void route_anything(t_route *x, t_symbol *sel, int argc, t_atom *argv)
+    /* find the element for a float or symbol, or 0 if there's none */
+static t_routeelement *route_find(t_route *x, t_word w)
 {
     t_routeelement *e;
     int nelement;
-    if (x->x_type == A_SYMBOL)
+    if (x->x_hash.h_size)
+        return ((nelement = wordhash_find(&x->x_hash, x->x_type, w, 0)) >= 0 ?
+            x->x_vec + nelement : 0);
+    for (nelement = x->x_nelement, e = x->x_vec; nelement--; e++)
+        if (wordhash_equal(x->x_type, e->e_w, w))
+            return (e);
+    return (0);
+}
+
+static void route_anything(t_route *x, t_symbol *sel, int argc, t_atom *argv)
+{
+    t_routeelement *e;
+    t_word w;
+    w.w_symbol = sel;
+    if (x->x_type == A_SYMBOL && (e = route_find(x, w)))
     {
-        for (nelement = x->x_nelement, e = x->x_vec; nelement--; e++)
-            if (e->e_w.w_symbol == sel)
-        {
-            if (argc > 0 && argv[0].a_type == A_SYMBOL)
-                outlet_anything(e->e_outlet, argv[0].a_w.w_symbol,
-                    argc-1, argv+1);
-            else outlet_list(e->e_outlet, 0, argc, argv);
-            return;
-        }
+        if (argc > 0 && argv[0].a_type == A_SYMBOL)
+            outlet_anything(e->e_outlet, argv[0].a_w.w_symbol,
+                argc-1, argv+1);
+        else outlet_list(e->e_outlet, 0, argc, argv);
+        return;
     }
     outlet_anything(x->x_rejectout, sel, argc, argv);
 }
@@ -535,16 +663,14 @@ static void route_anything(t_route *x, t_symbol *sel, int argc, t_atom *argv)
 static void route_list(t_route *x, t_symbol *sel, int argc, t_atom *argv)
 {
     t_routeelement *e;
-    int nelement;
+    t_word w;
     if (x->x_type == A_FLOAT)
     {
-        t_float f;
         if (!argc) return;
         if (argv->a_type != A_FLOAT)
             goto rejected;
-        f = atom_getfloat(argv);
-        for (nelement = x->x_nelement, e = x->x_vec; nelement--; e++)
-            if (e->e_w.w_float == f)
+        w.w_float = atom_getfloat(argv);
+        if ((e = route_find(x, w)))
         {
             if (argc > 1 && argv[1].a_type == A_SYMBOL)
                 outlet_anything(e->e_outlet, argv[1].a_w.w_symbol,
@@ -557,60 +683,50 @@ static void route_list(t_route *x, t_symbol *sel, int argc, t_atom *argv)
     {
         if (argc > 1)       /* 2 or more args: treat as "list" */
         {
-            for (nelement = x->x_nelement, e = x->x_vec; nelement--; e++)
+            w.w_symbol = &s_list;
+            if ((e = route_find(x, w)))
             {
-                if (e->e_w.w_symbol == &s_list)
-                {
-                    if (argc > 0 && argv[0].a_type == A_SYMBOL)
-                        outlet_anything(e->e_outlet, argv[0].a_w.w_symbol,
-                            argc-1, argv+1);
-                    else outlet_list(e->e_outlet, 0, argc, argv);
-                    return;
-                }
+                if (argc > 0 && argv[0].a_type == A_SYMBOL)
+                    outlet_anything(e->e_outlet, argv[0].a_w.w_symbol,
+                        argc-1, argv+1);
+                else outlet_list(e->e_outlet, 0, argc, argv);
+                return;
             }
         }
         else if (argc == 0)         /* no args: treat as "bang" */
         {
-            for (nelement = x->x_nelement, e = x->x_vec; nelement--; e++)
+            w.w_symbol = &s_bang;
+            if ((e = route_find(x, w)))
             {
-                if (e->e_w.w_symbol == &s_bang)
-                {
-                    outlet_bang(e->e_outlet);
-                    return;
-                }
+                outlet_bang(e->e_outlet);
+                return;
             }
         }
         else if (argv[0].a_type == A_FLOAT)    /* one float arg */
         {
-            for (nelement = x->x_nelement, e = x->x_vec; nelement--; e++)
+            w.w_symbol = &s_float;
+            if ((e = route_find(x, w)))
             {
-                if (e->e_w.w_symbol == &s_float)
-                {
-                    outlet_float(e->e_outlet, argv[0].a_w.w_float);
-                    return;
-                }
+                outlet_float(e->e_outlet, argv[0].a_w.w_float);
+                return;
             }
         }
         else if (argv[0].a_type == A_POINTER)    /* one pointer arg */
         {
-            for (nelement = x->x_nelement, e = x->x_vec; nelement--; e++)
+            w.w_symbol = &s_pointer;
+            if ((e = route_find(x, w)))
             {
-                if (e->e_w.w_symbol == &s_pointer)
-                {
-                    outlet_pointer(e->e_outlet, argv[0].a_w.w_gpointer);
-                    return;
-                }
+                outlet_pointer(e->e_outlet, argv[0].a_w.w_gpointer);
+                return;
             }
         }
         else                                     /* one symbol arg */
         {
-            for (nelement = x->x_nelement, e = x->x_vec; nelement--; e++)
+            w.w_symbol = &s_symbol;
+            if ((e = route_find(x, w)))
             {
-                if (e->e_w.w_symbol == &s_symbol)
-                {
-                    outlet_symbol(e->e_outlet, argv[0].a_w.w_symbol);
-                    return;
-                }
+                outlet_symbol(e->e_outlet, argv[0].a_w.w_symbol);
+                return;
             }
         }
     }
@@ -622,6 +738,7 @@ static void route_list(t_route *x, t_symbol *sel, int argc, t_atom *argv)
 static void route_free(t_route *x)
 {
     freebytes(x->x_vec, x->x_nelement * sizeof(*x->x_vec));
+    wordhash_free(&x->x_hash);
 }
 
 static void *route_new(t_symbol *s, int argc, t_atom *argv)
@@ -646,6 +763,10 @@ static void *route_new(t_symbol *s, int argc, t_atom *argv)
             e->e_w.w_float = atom_getfloatarg(n, argc, argv);
         else e->e_w.w_symbol = atom_getsymbolarg(n, argc, argv);
     }
+    wordhash_init(&x->x_hash, argc);
+    if (x->x_hash.h_size)
+        for (n = 0, e = x->x_vec; n < argc; n++, e++)
+            wordhash_find(&x->x_hash, x->x_type, e->e_w, n+1);
     if (argc == 1)
     {
         if (argv->a_type == A_FLOAT)
@@ -59,20 +59,33 @@ static void *print_new(t_symbol *sel, int argc, t_atom *argv)
     return (x);
 }
 
+    /* with "-printlimit", each print object may only print so many lines
+    a second */
+static int print_allowed(t_print *x)
+{
+    return (sys_printallow(x, (*x->x_sym->s_name ? x->x_sym : gensym("print"))));
+}
+
 static void print_bang(t_print *x)
 {
+    if (!print_allowed(x))
+        return;
     print_startlogpost(x, "%s%sbang", x->x_sym->s_name, (*x->x_sym->s_name ? ": " : ""));
     endpost();
 }
 
 static void print_pointer(t_print *x, t_gpointer *gp)
 {
+    if (!print_allowed(x))
+        return;
     print_startlogpost(x, "%s%s(pointer)", x->x_sym->s_name, (*x->x_sym->s_name ? ": " : ""));
     endpost();
 }
 
 static void print_float(t_print *x, t_float f)
 {
+    if (!print_allowed(x))
+        return;
     print_startlogpost(x, "%s%s%g", x->x_sym->s_name, (*x->x_sym->s_name ? ": " : ""), f);
     endpost();
 }
@@ -80,6 +93,8 @@ static void print_float(t_print *x, t_float f)
 static void print_anything(t_print *x, t_symbol *s, int argc, t_atom *argv)
 {
     int i;
+    if (!print_allowed(x))
+        return;
     print_startlogpost(x, "%s%s%s", x->x_sym->s_name, (*x->x_sym->s_name ? ": " : ""),
         s->s_name);
     for (i = 0; i < argc; i++)
@@ -116,6 +131,8 @@ static void print_list(t_print *x, t_symbol *s, int argc, t_atom *argv)
     else if (argv->a_type == A_FLOAT)
     {
         int i;
+        if (!print_allowed(x))
+            return;
         if (*x->x_sym->s_name)
             print_startlogpost(x, "%s: ", x->x_sym->s_name);
         else
@@ -19,18 +19,27 @@ static t_class *libpdrec_class;
 typedef struct _libpdrec {
     t_object x_obj;
     t_symbol *x_sym;
+    void *x_context;
+    int x_hascontext; // created by libpd_bind_context()
 } t_libpdrec;
 
 static void libpdrecbang(t_libpdrec *x) {
-  if (libpd_banghook) (*libpd_banghook)(x->x_sym->s_name);
+  if (x->x_hascontext && libpd_contextbanghook)
+    (*libpd_contextbanghook)(x->x_context);
+  else if (libpd_banghook) (*libpd_banghook)(x->x_sym->s_name);
 }
 
 static void libpdrecfloat(t_libpdrec *x, t_float f) {
-  if (libpd_floathook) (*libpd_floathook)(x->x_sym->s_name, f);
+  if (x->x_hascontext && libpd_contextfloathook)
+    (*libpd_contextfloathook)(x->x_context, f);
+  else if (libpd_floathook) (*libpd_floathook)(x->x_sym->s_name, f);
 }
 
 static void libpdrecsymbol(t_libpdrec *x, t_symbol *s) {
-  if (libpd_symbolhook) (*libpd_symbolhook)(x->x_sym->s_name, s->s_name);
+  if (x->x_hascontext && libpd_contextsymbolhook)
+    (*libpd_contextsymbolhook)(x->x_context, s->s_name);
+  else if (libpd_symbolhook)
+    (*libpd_symbolhook)(x->x_sym->s_name, s->s_name);
 }
 
 static void libpdrecpointer(t_libpdrec *x, t_gpointer *gp) {
@@ -38,12 +47,16 @@ static void libpdrecpointer(t_libpdrec *x, t_gpointer *gp) {
 }
 
 static void libpdreclist(t_libpdrec *x, t_symbol *s, int argc, t_atom *argv) {
-  if (libpd_listhook) (*libpd_listhook)(x->x_sym->s_name, argc, argv);
+  if (x->x_hascontext && libpd_contextlisthook)
+    (*libpd_contextlisthook)(x->x_context, argc, argv);
+  else if (libpd_listhook) (*libpd_listhook)(x->x_sym->s_name, argc, argv);
 }
 
 static void libpdrecanything(t_libpdrec *x, t_symbol *s,
                 int argc, t_atom *argv) {
-  if (libpd_messagehook)
+  if (x->x_hascontext && libpd_contextmessagehook)
+    (*libpd_contextmessagehook)(x->x_context, s->s_name, argc, argv);
+  else if (libpd_messagehook)
     (*libpd_messagehook)(x->x_sym->s_name, s->s_name, argc, argv);
 }
 
@@ -55,6 +68,8 @@ static void *libpdreceive_donew(t_symbol *s) {
   t_libpdrec *x;
   x = (t_libpdrec *)pd_new(libpdrec_class);
   x->x_sym = s;
+  x->x_context = NULL;
+  x->x_hascontext = 0;
   pd_bind(&x->x_obj.ob_pd, s);
   return x;
 }
@@ -68,6 +83,17 @@ void *libpdreceive_new(t_symbol *s) {
   return x;
 }
 
+// likewise
+void *libpdreceive_new_context(t_symbol *s, void *context) {
+  t_libpdrec *x;
+  sys_lock();
+  x = (t_libpdrec *)libpdreceive_donew(s);
+  x->x_context = context;
+  x->x_hascontext = 1;
+  sys_unlock();
+  return x;
+}
+
 void libpdreceive_setup(void) {
   sys_lock();
   libpdrec_class = class_new(gensym("libpd_receive"),
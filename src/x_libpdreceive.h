@@ -23,4 +23,8 @@ void libpdreceive_setup(void);
 // create a new libpd source receiver with a given name symbol
 void *libpdreceive_new(t_symbol *);
 
+// create a new libpd source receiver which passes the given context pointer
+// to the context hooks
+void *libpdreceive_new_context(t_symbol *, void *context);
+
 #endif
@@ -51,22 +51,90 @@ typedef struct _listelem
     t_gpointer l_p;
 } t_listelem;
 
+    /* The items are kept somewhere inside an allocated block, which [list
+    store] lets grow geometrically with room at either end, so that building
+    a list one item at a time isn't quadratic.  Everyone else allocates
+    exactly what they need so l_mem == l_vec. */
 typedef struct _alist
 {
     t_pd l_pd;          /* object to point inlets to */
     int l_n;            /* number of items */
     int l_npointer;     /* number of pointers */
     t_listelem *l_vec;  /* pointer to items */
+    t_listelem *l_mem;  /* allocated block containing them */
+    int l_size;         /* allocated size of l_mem */
 } t_alist;
 
+    /* Scratch space for lists too big for alloca() and for temporary
+    copies of stored lists containing pointers.  Since messages are passed
+    depth first, everything taken from it is given back in the reverse
+    order, so it's just a stack that is reused from one message to the next.
+    If it fills up while in use we fall back on getbytes() and remember to
+    grow it the next time it's empty.  Anything bigger than LIST_MAXSCRATCH
+    bytes always goes to getbytes() so that one huge list doesn't keep the
+    memory tied up. */
+#define LIST_MAXSCRATCH (1 << 20)
+#define LIST_SCRATCHROUND(n) (((n) + 15) & ~(size_t)15)
+
+static PERTHREAD char *list_scratch;
+static PERTHREAD size_t list_scratchsize, list_scratchfill, list_scratchwant;
+
+static void *list_scratch_get(size_t nbytes)
+{
+    void *ret;
+    nbytes = LIST_SCRATCHROUND(nbytes);
+    if (nbytes > LIST_MAXSCRATCH)
+        return (getbytes(nbytes));
+    if (list_scratchfill + nbytes > list_scratchsize)
+    {
+        size_t newsize;
+        if (list_scratchfill)
+        {
+            if (list_scratchwant < list_scratchfill + nbytes)
+                list_scratchwant = list_scratchfill + nbytes;
+            return (getbytes(nbytes));
+        }
+        newsize = 2 * list_scratchsize;
+        if (newsize < nbytes)
+            newsize = nbytes;
+        if (newsize < list_scratchwant)
+            newsize = list_scratchwant;
+        if (newsize < 4096)
+            newsize = 4096;
+        if (list_scratch)
+            freebytes(list_scratch, list_scratchsize);
+        if (!(list_scratch = (char *)getbytes(newsize)))
+        {
+            list_scratchsize = 0;
+            return (0);
+        }
+        list_scratchsize = newsize;
+        list_scratchwant = 0;
+    }
+    ret = list_scratch + list_scratchfill;
+    list_scratchfill += nbytes;
+    return (ret);
+}
+
+static void list_scratch_release(void *p, size_t nbytes)
+{
+    nbytes = LIST_SCRATCHROUND(nbytes);
+    if ((char *)p >= list_scratch &&
+        (char *)p < list_scratch + list_scratchsize)
+            list_scratchfill = (char *)p - list_scratch;
+    else freebytes(p, nbytes);
+}
+
 #if HAVE_ALLOCA
 #define ATOMS_ALLOCA(x, n) ((x) = (t_atom *)((n) < LIST_NGETBYTE ?  \
-        alloca((n) * sizeof(t_atom)) : getbytes((n) * sizeof(t_atom))))
+        alloca((n) * sizeof(t_atom)) : list_scratch_get((n) * sizeof(t_atom))))
 #define ATOMS_FREEA(x, n) ( \
-    ((n) < LIST_NGETBYTE || (freebytes((x), (n) * sizeof(t_atom)), 0)))
+    ((n) < LIST_NGETBYTE || \
+        (list_scratch_release((x), (n) * sizeof(t_atom)), 0)))
 #else
-#define ATOMS_ALLOCA(x, n) ((x) = (t_atom *)getbytes((n) * sizeof(t_atom)))
-#define ATOMS_FREEA(x, n) (freebytes((x), (n) * sizeof(t_atom)))
+#define ATOMS_ALLOCA(x, n) \
+    ((x) = (t_atom *)list_scratch_get((n) * sizeof(t_atom)))
+#define ATOMS_FREEA(x, n) (list_scratch_release((x), (n) * sizeof(t_atom)))
 #endif
 
 static void atoms_copy(int argc, t_atom *from, t_atom *to)
@@ -83,8 +151,8 @@ t_class *alist_class;
 static void alist_init(t_alist *x)
 {
     x->l_pd = alist_class;
-    x->l_n = x->l_npointer = 0;
-    x->l_vec = 0;
+    x->l_n = x->l_npointer = x->l_size = 0;
+    x->l_vec = x->l_mem = 0;
 }
 
 static void alist_clear(t_alist *x)
@@ -95,8 +163,24 @@ static void alist_clear(t_alist *x)
         if (x->l_vec[i].l_a.a_type == A_POINTER)
             gpointer_unset(x->l_vec[i].l_a.a_w.w_gpointer);
     }
-    if (x->l_vec)
-        freebytes(x->l_vec, x->l_n * sizeof(*x->l_vec));
+    if (x->l_mem)
+        freebytes(x->l_mem, x->l_size * sizeof(*x->l_mem));
+    x->l_vec = x->l_mem = 0;
+    x->l_n = x->l_size = 0;
+}
+
+    /* get an exactly sized block for n items, after clearing the list */
+static int alist_alloc(t_alist *x, int n)
+{
+    if (!(x->l_vec = x->l_mem = (t_listelem *)getbytes(n * sizeof(*x->l_vec))))
+    {
+        x->l_n = x->l_size = 0;
+        pd_error(0, "list: out of memory");
+        return (0);
+    }
+    x->l_n = x->l_size = n;
+    x->l_npointer = 0;
+    return (1);
 }
 
 static void alist_copyin(t_alist *x, t_symbol *s, int argc, t_atom *argv,
@@ -119,14 +203,8 @@ static void alist_copyin(t_alist *x, t_symbol *s, int argc, t_atom *argv,
 static void alist_list(t_alist *x, t_symbol *s, int argc, t_atom *argv)
 {
     alist_clear(x);
-    if (!(x->l_vec = (t_listelem *)getbytes(argc * sizeof(*x->l_vec))))
-    {
-        x->l_n = 0;
-        pd_error(0, "list: out of memory");
+    if (!alist_alloc(x, argc))
         return;
-    }
-    x->l_n = argc;
-    x->l_npointer = 0;
     alist_copyin(x, s, argc, argv, 0);
 }
 
@@ -135,14 +213,8 @@ static void alist_anything(t_alist *x, t_symbol *s, int argc, t_atom *argv)
 {
     int i;
     alist_clear(x);
-    if (!(x->l_vec = (t_listelem *)getbytes((argc+1) * sizeof(*x->l_vec))))
-    {
-        x->l_n = 0;
-        pd_error(0, "list_alloc: out of memory");
+    if (!alist_alloc(x, argc+1))
         return;
-    }
-    x->l_n = argc+1;
-    x->l_npointer = 0;
     SETSYMBOL(&x->l_vec[0].l_a, s);
     for (i = 0; i < argc; i++)
     {
@@ -164,18 +236,23 @@ static void alist_toatoms(t_alist *x, t_atom *to, int onset, int count)
 }
 
 
+    /* make a temporary copy of part of a list (with its own references to
+    any pointers) in scratch space, to output while the original might get
+    changed.  It must be freed with alist_unclone() in last-in-first-out
+    order with anything else taken from the scratch space. */
 static void alist_clone(t_alist *x, t_alist *y, int onset, int count)
 {
     int i;
     y->l_pd = alist_class;
-    y->l_n = count;
     y->l_npointer = 0;
-    if (!(y->l_vec = (t_listelem *)getbytes(y->l_n * sizeof(*y->l_vec))))
+    if (!(y->l_vec = y->l_mem = (t_listelem *)list_scratch_get(
+        count * sizeof(*y->l_vec))))
     {
-        y->l_n = 0;
-        pd_error(0, "list_alloc: out of memory");
+        y->l_n = y->l_size = 0;
+        pd_error(0, "list: out of memory");
     }
-    else for (i = 0; i < count; i++)
+    else y->l_n = y->l_size = count;
+    for (i = 0; i < y->l_n; i++)
     {
         y->l_vec[i].l_a = x->l_vec[onset + i].l_a;
         if (y->l_vec[i].l_a.a_type == A_POINTER)
@@ -187,6 +264,16 @@ static void alist_clone(t_alist *x, t_alist *y, int onset, int count)
     }
 }
 
+static void alist_unclone(t_alist *y)
+{
+    int i;
+    for (i = 0; i < y->l_n; i++)
+        if (y->l_vec[i].l_a.a_type == A_POINTER)
+            gpointer_unset(y->l_vec[i].l_a.a_w.w_gpointer);
+    if (y->l_mem)
+        list_scratch_release(y->l_mem, y->l_size * sizeof(*y->l_mem));
+}
+
     /* function to restore gpointers after the list has moved in memory */
 static void alist_restore_gpointers(t_alist *x, int offset, int count)
 {
@@ -199,6 +286,59 @@ static void alist_restore_gpointers(t_alist *x, int offset, int count)
     }
 }
 
+    /* make room for "n" new items at "index", leaving the items before
+    it where they are with respect to l_vec and the ones after it shifted up
+    by n.  Items nearer the front are moved down into the free space before
+    the list and those nearer the end up into the space after it; if that
+    side is full we reallocate at double the size with the slack split
+    between the two ends, so that repeated appends and prepends both take
+    constant amortized time.  Returns 0 if out of memory. */
+static int alist_makeroom(t_alist *x, int index, int n)
+{
+    int head = x->l_vec - x->l_mem, tail = x->l_size - head - x->l_n;
+    if (index + index < x->l_n && head >= n)
+    {
+            /* move the items before index down */
+        memmove(x->l_vec - n, x->l_vec, index * sizeof(*x->l_vec));
+        x->l_vec -= n;
+        if (x->l_npointer)
+            alist_restore_gpointers(x, 0, index);
+    }
+    else if (index + index >= x->l_n && tail >= n)
+    {
+            /* move the items after index up */
+        memmove(x->l_vec + index + n, x->l_vec + index,
+            (x->l_n - index) * sizeof(*x->l_vec));
+        if (x->l_npointer)
+            alist_restore_gpointers(x, index + n, x->l_n - index);
+    }
+    else
+    {
+        int newsize = 2 * (x->l_n + n), slack, newhead;
+        t_listelem *newmem;
+        if (newsize < 16)
+            newsize = 16;
+        slack = newsize - (x->l_n + n);
+        newhead = slack/2;
+        if (!(newmem = (t_listelem *)getbytes(newsize * sizeof(*newmem))))
+            return (0);
+        memcpy(newmem + newhead, x->l_vec, index * sizeof(*x->l_vec));
+        memcpy(newmem + newhead + index + n, x->l_vec + index,
+            (x->l_n - index) * sizeof(*x->l_vec));
+        if (x->l_mem)
+            freebytes(x->l_mem, x->l_size * sizeof(*x->l_mem));
+        x->l_mem = newmem;
+        x->l_size = newsize;
+        x->l_vec = newmem + newhead;
+        if (x->l_npointer)
+        {
+            alist_restore_gpointers(x, 0, index);
+            alist_restore_gpointers(x, index + n, x->l_n - index);
+        }
+    }
+    return (1);
+}
+
 static void alist_setup(void)
 {
     alist_class = class_new(gensym("list inlet"),
@@ -232,6 +372,12 @@ static void list_append_list(t_list_append *x, t_symbol *s,
 {
     t_atom *outv;
     int outc = x->x_alist.l_n + argc;
+        /* nothing stored: pass the incoming list straight through */
+    if (!x->x_alist.l_n)
+    {
+        outlet_list(x->x_obj.ob_outlet, &s_list, argc, argv);
+        return;
+    }
     ATOMS_ALLOCA(outv, outc);
     atoms_copy(argc, argv, outv);
     if (x->x_alist.l_npointer)
@@ -240,7 +386,7 @@ static void list_append_list(t_list_append *x, t_symbol *s,
         alist_clone(&x->x_alist, &y, 0, x->x_alist.l_n);
         alist_toatoms(&y, outv+argc, 0, x->x_alist.l_n);
         outlet_list(x->x_obj.ob_outlet, &s_list, outc, outv);
-        alist_clear(&y);
+        alist_unclone(&y);
     }
     else
     {
@@ -264,7 +410,7 @@ static void list_append_anything(t_list_append *x, t_symbol *s,
         alist_clone(&x->x_alist, &y, 0, x->x_alist.l_n);
         alist_toatoms(&y, outv + 1 + argc, 0, x->x_alist.l_n);
         outlet_list(x->x_obj.ob_outlet, &s_list, outc, outv);
-        alist_clear(&y);
+        alist_unclone(&y);
     }
     else
     {
@@ -310,6 +456,12 @@ static void list_prepend_list(t_list_prepend *x, t_symbol *s,
 {
     t_atom *outv;
     int n, outc = x->x_alist.l_n + argc;
+        /* nothing stored: pass the incoming list straight through */
+    if (!x->x_alist.l_n)
+    {
+        outlet_list(x->x_obj.ob_outlet, &s_list, argc, argv);
+        return;
+    }
     ATOMS_ALLOCA(outv, outc);
     atoms_copy(argc, argv, outv + x->x_alist.l_n);
     if (x->x_alist.l_npointer)
@@ -318,7 +470,7 @@ static void list_prepend_list(t_list_prepend *x, t_symbol *s,
         alist_clone(&x->x_alist, &y, 0, x->x_alist.l_n);
         alist_toatoms(&y, outv, 0, x->x_alist.l_n);
         outlet_list(x->x_obj.ob_outlet, &s_list, outc, outv);
-        alist_clear(&y);
+        alist_unclone(&y);
     }
     else
     {
@@ -342,7 +494,7 @@ static void list_prepend_anything(t_list_prepend *x, t_symbol *s,
         alist_clone(&x->x_alist, &y, 0, x->x_alist.l_n);
         alist_toatoms(&y, outv, 0, x->x_alist.l_n);
         outlet_list(x->x_obj.ob_outlet, &s_list, outc, outv);
-        alist_clear(&y);
+        alist_unclone(&y);
     }
     else
     {
@@ -406,7 +558,7 @@ static void list_store_send(t_list_store *x, t_symbol *s)
         alist_clone(&x->x_alist, &y, 0, n);
         alist_toatoms(&y, vec, 0, n);
         pd_list(s->s_thing, gensym("list"), n, vec);
-        alist_clear(&y);
+        alist_unclone(&y);
     }
     else
     {
@@ -429,7 +581,7 @@ static void list_store_list(t_list_store *x, t_symbol *s,
         alist_clone(&x->x_alist, &y, 0, x->x_alist.l_n);
         alist_toatoms(&y, outv+argc, 0, x->x_alist.l_n);
         outlet_list(x->x_out1, &s_list, outc, outv);
-        alist_clear(&y);
+        alist_unclone(&y);
     }
     else
     {
@@ -442,27 +594,10 @@ static void list_store_list(t_list_store *x, t_symbol *s,
 static void list_store_doinsert(t_list_store *x, t_symbol *s,
     int argc, t_atom *argv, int index)
 {
-    t_listelem *oldptr = x->x_alist.l_vec;
-        /* try to allocate more memory */
-    if (!(x->x_alist.l_vec = (t_listelem *)resizebytes(x->x_alist.l_vec,
-        (x->x_alist.l_n) * sizeof(*x->x_alist.l_vec),
-        (x->x_alist.l_n + argc) * sizeof(*x->x_alist.l_vec))))
+    if (!alist_makeroom(&x->x_alist, index, argc))
     {
-        x->x_alist.l_n = 0;
         pd_error(0, "list: out of memory");
         return;
-    }
-        /* fix gpointers in case resizebytes() has moved the alist in memory */
-    if (x->x_alist.l_vec != oldptr && x->x_alist.l_npointer)
-        alist_restore_gpointers(&x->x_alist, 0, x->x_alist.l_n);
-        /* shift existing elements after 'index' to the right */
-    if (index < x->x_alist.l_n)
-    {
-        memmove(x->x_alist.l_vec + index + argc, x->x_alist.l_vec + index,
-            (x->x_alist.l_n - index) * sizeof(*x->x_alist.l_vec));
-            /* fix gpointers because of memmove() */
-        if (x->x_alist.l_npointer)
-            alist_restore_gpointers(&x->x_alist, index + argc, x->x_alist.l_n - index);
     }
         /* finally copy new elements */
     alist_copyin(&x->x_alist, s, argc, argv, index);
@@ -500,7 +635,6 @@ static void list_store_prepend(t_list_store *x, t_symbol *s,
 static void list_store_delete(t_list_store *x, t_floatarg f1, t_floatarg f2)
 {
     int i, max, index = (int)f1, n = (int)f2;
-    t_listelem *oldptr = x->x_alist.l_vec;
     if (index < 0 || index >= x->x_alist.l_n)
     {
         pd_error(x, "list_store_delete: index %d out of range", index);
@@ -525,27 +659,43 @@ static void list_store_delete(t_list_store *x, t_floatarg f1, t_floatarg f2)
             }
         }
     }
-        /* shift elements (after the deleted elements) to the left */
-    memmove(x->x_alist.l_vec + index, x->x_alist.l_vec + index + n,
-        (x->x_alist.l_n - index) * sizeof(*x->x_alist.l_vec));
-        /* shrink memory */
-    if (!(x->x_alist.l_vec = (t_listelem *)resizebytes(x->x_alist.l_vec,
-        (x->x_alist.l_n) * sizeof(*x->x_alist.l_vec),
-        (x->x_alist.l_n - n) * sizeof(*x->x_alist.l_vec))))
+        /* close the gap by moving whichever side is shorter */
+    if (index < x->x_alist.l_n - index - n)
     {
-        x->x_alist.l_n = 0;
-        pd_error(0, "list: out of memory");
-        return;
+        memmove(x->x_alist.l_vec + n, x->x_alist.l_vec,
+            index * sizeof(*x->x_alist.l_vec));
+        x->x_alist.l_vec += n;
+        if (x->x_alist.l_npointer)
+            alist_restore_gpointers(&x->x_alist, 0, index);
     }
-    if (x->x_alist.l_npointer)
+    else
     {
-            /* fix all gpointers in case resizebytes() has moved the alist in memory */
-        if (x->x_alist.l_vec != oldptr)
-            alist_restore_gpointers(&x->x_alist, 0, x->x_alist.l_n - n);
-        else /* only fix gpointers after index (because of of memmove()) */
-            alist_restore_gpointers(&x->x_alist, index, x->x_alist.l_n - index - n);
+        memmove(x->x_alist.l_vec + index, x->x_alist.l_vec + index + n,
+            (x->x_alist.l_n - index - n) * sizeof(*x->x_alist.l_vec));
+        if (x->x_alist.l_npointer)
+            alist_restore_gpointers(&x->x_alist, index,
+                x->x_alist.l_n - index - n);
     }
     x->x_alist.l_n -= n;
+        /* give memory back if the list has shrunk a lot */
+    if (x->x_alist.l_size > 64 && x->x_alist.l_n < x->x_alist.l_size / 4)
+    {
+        t_listelem *newmem;
+        int newsize = 2 * x->x_alist.l_n;
+        if (newsize < 16)
+            newsize = 16;
+        if ((newmem = (t_listelem *)getbytes(newsize * sizeof(*newmem))))
+        {
+            memcpy(newmem, x->x_alist.l_vec,
+                x->x_alist.l_n * sizeof(*newmem));
+            freebytes(x->x_alist.l_mem,
+                x->x_alist.l_size * sizeof(*x->x_alist.l_mem));
+            x->x_alist.l_vec = x->x_alist.l_mem = newmem;
+            x->x_alist.l_size = newsize;
+            if (x->x_alist.l_npointer)
+                alist_restore_gpointers(&x->x_alist, 0, x->x_alist.l_n);
+        }
+    }
 }
 
 static void list_store_get(t_list_store *x, float f1, float f2)
@@ -556,7 +706,7 @@ static void list_store_get(t_list_store *x, float f1, float f2)
         outc = 1; /* default */
     else if (outc < 0)
         outc = x->x_alist.l_n - onset; /* till the end of the list */
-    if (onset < 0 || (onset + outc > x->x_alist.l_n))
+    if (onset < 0 || outc < 0 || (onset + outc > x->x_alist.l_n))
     {
         outlet_bang(x->x_out2);
         return;
@@ -568,7 +718,7 @@ static void list_store_get(t_list_store *x, float f1, float f2)
         alist_clone(&x->x_alist, &y, onset, outc);
         alist_toatoms(&y, outv, 0, outc);
         outlet_list(x->x_out1, &s_list, outc, outv);
-        alist_clear(&y);
+        alist_unclone(&y);
     }
     else
     {
@@ -5,6 +5,7 @@
 /* network */
 
 #include "m_pd.h"
+#include "m_imp.h"
 #include "s_stuff.h"
 #include "s_net.h"
 
@@ -13,6 +14,10 @@
 #include <errno.h>
 #include <stdlib.h>
 
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+
 #ifdef _WIN32
 # include <malloc.h> /* MSVC or mingw on windows */
 #elif defined(__linux__) || defined(__APPLE__) || defined(HAVE_ALLOCA_H)
@@ -22,15 +27,18 @@
 /* print addrinfo lists for debugging */
 /* #define PRINT_ADDRINFO */
 
+    /* default limit on TCP output queued while the peer isn't reading */
+#define NETSEND_OUTMAX 1048576
+
 /* ----------------------------- helpers ------------------------- */
 
 void socketreceiver_free(t_socketreceiver *x);
 
 static void outlet_sockaddr(t_outlet *o, const struct sockaddr *sa)
 {
-    char addrstr[INET6_ADDRSTRLEN];
+    char addrstr[MAXPDSTRING];  /* room for a Unix-domain socket path */
     unsigned short port = sockaddr_get_port(sa);
-    if (sockaddr_get_addrstr(sa, addrstr, INET6_ADDRSTRLEN))
+    if (sockaddr_get_addrstr(sa, addrstr, MAXPDSTRING))
     {
         t_atom ap[2];
         SETSYMBOL(&ap[0], gensym(addrstr));
@@ -52,9 +60,28 @@ typedef struct _netsend
     int x_sockfd;
     int x_protocol;
     int x_bin;
+    int x_typed;        /* "-t": typed binary messages */
+    int x_osc;          /* "-o": OSC messages */
+    struct _nettyped *x_typedconn;  /* its state for our one socket */
+    t_float x_osclatency;           /* timetag outgoing OSC this far ahead */
+    struct _oscpending *x_pending;  /* incoming OSC waiting for timetags */
     t_socketreceiver *x_receiver;
     struct sockaddr_storage x_server;
     t_float x_timeout; /* TCP connect timeout in seconds */
+        /* TCP output waiting for the socket to become writable */
+    char *x_outbuf;
+    int x_outsize;      /* allocated size of x_outbuf */
+    int x_outhead;      /* end of pending output */
+    int x_outtail;      /* start of pending output */
+    int *x_outmsg;      /* remaining length of each pending message */
+    int x_outmsgsize;   /* allocated entries in x_outmsg */
+    int x_msghead;      /* end of pending messages in x_outmsg */
+    int x_msgtail;      /* oldest pending message */
+    int x_outlocked;    /* oldest message partly sent so can't be dropped */
+    int x_outmax;       /* high-water mark in bytes, 0 to block instead */
+    int x_outdrop;      /* on overflow, drop oldest (1) or disconnect (0) */
+    int x_outwaiting;   /* polling for writability; reported on outlet */
+    int x_outwarned;    /* already complained about dropping messages */
 } t_netsend;
 
 static t_class *netreceive_class;
@@ -67,10 +94,16 @@ typedef struct _netreceive
     int *x_connections;
     int x_old;
     t_socketreceiver **x_receivers;
+    struct _nettyped **x_typedconns;    /* per connection, or NULL */
+    int x_reuseport;                    /* share the port ("-r" flag) */
+    t_symbol *x_unixpath;               /* Unix-domain socket we made */
 } t_netreceive;
 
 static void netsend_disconnect(t_netsend *x);
+static void netsend_read(void *z, t_binbuf *b);
 static void netreceive_notify(t_netreceive *x, int fd);
+static int netsend_rawsend(t_netsend *x, int sockfd,
+    const char *buf, int length);
 
 /* ----------------------------- netsend ------------------------- */
 
@@ -79,7 +112,7 @@ static void *netsend_new(t_symbol *s, int argc, t_atom *argv)
     t_netsend *x = (t_netsend *)pd_new(netsend_class);
     outlet_new(&x->x_obj, &s_float);
     x->x_protocol = SOCK_STREAM;
-    x->x_bin = 0;
+    x->x_bin = x->x_typed = x->x_osc = 0;
     if (argc && argv->a_type == A_FLOAT)
     {
         x->x_protocol = (argv->a_w.w_float != 0 ? SOCK_DGRAM : SOCK_STREAM);
@@ -90,6 +123,10 @@ static void *netsend_new(t_symbol *s, int argc, t_atom *argv)
     {
         if (!strcmp(argv->a_w.w_symbol->s_name, "-b"))
             x->x_bin = 1;
+        else if (!strcmp(argv->a_w.w_symbol->s_name, "-t"))
+            x->x_typed = 1;
+        else if (!strcmp(argv->a_w.w_symbol->s_name, "-o"))
+            x->x_osc = 1;
         else if (!strcmp(argv->a_w.w_symbol->s_name, "-u"))
             x->x_protocol = SOCK_DGRAM;
         else
@@ -104,20 +141,84 @@ static void *netsend_new(t_symbol *s, int argc, t_atom *argv)
         pd_error(x, "netsend: extra arguments ignored:");
         postatom(argc, argv); endpost();
     }
+    if (x->x_bin + x->x_typed + x->x_osc > 1)
+    {
+        pd_error(x, "netsend: only one of '-b', '-t' and '-o' allowed");
+        x->x_typed = x->x_osc = 0;
+    }
     x->x_sockfd = -1;
+    x->x_typedconn = NULL;
     x->x_receiver = NULL;
     x->x_msgout = outlet_new(&x->x_obj, &s_anything);
     x->x_connectout = NULL;
     x->x_fromout = NULL;
     x->x_timeout = 10;
+    x->x_outmax = NETSEND_OUTMAX;
+    x->x_outdrop = 1;
     memset(&x->x_server, 0, sizeof(struct sockaddr_storage));
+    sys_inputsource(x, netsend_read, 1);
     return (x);
 }
 
+    /* output one incoming UDP packet as a list of bytes */
+static void netsend_outdatagram(t_netsend *x, t_datagram *d)
+{
+    int i;
+    t_atom *ap = (t_atom *)alloca(d->d_len * sizeof(t_atom));
+    if (x->x_fromout)
+        outlet_sockaddr(x->x_fromout, (const struct sockaddr *)d->d_from);
+        /* handle too large UDP packets */
+    if (d->d_truncated)
+        post("warning: incoming UDP packet truncated to %d bytes.",
+            NET_MAXPACKETSIZE-1);
+    for (i = 0; i < d->d_len; i++)
+        SETFLOAT(ap+i, d->d_buf[i]);
+    outlet_list(x->x_msgout, 0, d->d_len, ap);
+}
+
+static void netsend_readudp(t_netsend *x, int fd)
+{
+    t_datagram *d = 0;
+    int n, i, more, readbytes = 0;
+    while (1)
+    {
+        if ((n = sys_recvbatch(fd, &d, &more)) < 0)
+        {
+                /* socket_errno_udp() ignores some error codes */
+            if (!socket_errno_udp())
+                return;
+            sys_sockerror("recv (bin)");
+                /* never close UDP socket because we can't really notify it */
+            if (x->x_obj.ob_pd != netreceive_class)
+                netsend_disconnect(x);
+            return;
+        }
+        for (i = 0; i < n; i++)
+        {
+            if (d[i].d_len <= 0)
+            {
+                if (x->x_obj.ob_pd != netreceive_class)
+                {
+                    sys_recvbatchdone(d);
+                    netsend_disconnect(x);
+                    return;
+                }
+                continue;
+            }
+            netsend_outdatagram(x, &d[i]);
+            readbytes += d[i].d_len;
+        }
+        sys_recvbatchdone(d);
+            /* throttle */
+        if (readbytes >= NET_MAXPACKETSIZE || !more)
+            return;
+    }
+}
+
 static void netsend_readbin(t_netsend *x, int fd)
 {
     unsigned char *inbuf = sys_getrecvbuf(0);
-    int ret = 0, readbytes = 0, i;
+    int ret = 0, i;
     struct sockaddr_storage fromaddr = {0};
     socklen_t fromaddrlen = sizeof(struct sockaddr_storage);
     if (!x->x_msgout)
@@ -125,104 +226,1030 @@ static void netsend_readbin(t_netsend *x, int fd)
         bug("netsend_readbin");
         return;
     }
-    while (1)
+    if (x->x_protocol == SOCK_DGRAM)
     {
-        if (x->x_protocol == SOCK_DGRAM)
-            ret = (int)recvfrom(fd, inbuf, NET_MAXPACKETSIZE, 0,
-                (struct sockaddr *)&fromaddr, &fromaddrlen);
+        netsend_readudp(x, fd);
+        return;
+    }
+    ret = (int)recv(fd, inbuf, NET_MAXPACKETSIZE, 0);
+    if (ret <= 0)
+    {
+        if (ret < 0)
+            sys_sockerror("recv (bin)");
+        if (x->x_obj.ob_pd == netreceive_class)
+        {
+            sys_rmpollfn(fd);
+            sys_closesocket(fd);
+            netreceive_notify((t_netreceive *)x, fd);
+        }
+        else /* properly shutdown netsend */
+            netsend_disconnect(x);
+        return;
+    }
+    if (x->x_fromout &&
+        !getpeername(fd, (struct sockaddr *)&fromaddr, &fromaddrlen))
+    {
+        sockaddr_end_unixpath(&fromaddr, fromaddrlen);
+        outlet_sockaddr(x->x_fromout, (const struct sockaddr *)&fromaddr);
+    }
+    for (i = 0; i < ret; i++)
+        outlet_float(x->x_msgout, inbuf[i]);
+}
+
+    /* output received atoms as messages separated by commas and semis */
+static void netsend_outatoms(t_netsend *x, int natom, t_atom *at)
+{
+    int msg;
+    for (msg = 0; msg < natom;)
+    {
+        int emsg;
+        for (emsg = msg; emsg < natom && at[emsg].a_type != A_COMMA
+             && at[emsg].a_type != A_SEMI; emsg++)
+            ;
+        if (emsg > msg)
+        {
+            int i;
+            for (i = msg; i < emsg; i++)
+                if (at[i].a_type == A_DOLLAR || at[i].a_type == A_DOLLSYM)
+                {
+                    pd_error(x, "netreceive: got dollar sign in message");
+                    goto nodice;
+                }
+            if (at[msg].a_type == A_FLOAT)
+            {
+                if (emsg > msg + 1)
+                    outlet_list(x->x_msgout, 0, emsg-msg, at + msg);
+                else outlet_float(x->x_msgout, at[msg].a_w.w_float);
+            }
+            else if (at[msg].a_type == A_SYMBOL)
+                outlet_anything(x->x_msgout, at[msg].a_w.w_symbol,
+                    emsg-msg-1, at + msg + 1);
+        }
+    nodice:
+        msg = emsg + 1;
+    }
+}
+
+static void netsend_read(void *z, t_binbuf *b)
+{
+    netsend_outatoms((t_netsend *)z, binbuf_getnatom(b), binbuf_getvec(b));
+}
+
+/* ----------------------- typed binary messages ----------------------- */
+
+/* With "-t", netsend sends each message as a vector of typed atoms instead
+of FUDI text, so that long lists of numbers needn't be printed and parsed.
+A TCP connection starts with the two bytes NETTYPED_MAGIC, NETTYPED_VERSION
+from each side; netreceive looks at the first byte of each new connection
+to decide whether it's typed or text, and answers in kind.  After that each
+message is a 4-byte length followed by that many bytes of atoms, each a tag
+byte and its data, all big-endian:
+
+    'f' float32             'd' float64
+    'F' count(16) and that many float32s
+    's' id(16) length(16) chars: define symbol number "id" and use it
+    'S' id(16): a symbol defined earlier on this connection
+    'n' length(16) chars: a symbol that isn't remembered
+    ',' and ';'
+
+Each side of a connection numbers the symbols it sends separately.  Over UDP
+each datagram is the two magic bytes followed by one message's atoms, with
+no length and no 's' or 'S' since datagrams can go missing; netreceive
+only looks for them with its own "-t" flag. */
+
+#define NETTYPED_MAGIC 0xff     /* never appears in FUDI text */
+#define NETTYPED_VERSION 1
+#define NETTYPED_MAXSYM 65535   /* symbols remembered per connection */
+#define NETTYPED_MAXMSG (16 * 1024 * 1024)
+
+typedef struct _nettyped
+{
+    t_netsend *nt_owner;
+    int nt_udp;
+    int nt_osc;                 /* OSC instead of typed atoms */
+    int nt_gothello;            /* peer's magic bytes have arrived */
+    unsigned char *nt_inbuf;    /* incoming TCP bytes */
+    int nt_insize;
+    int nt_inhead;
+    t_symbol **nt_rxsym;        /* symbols the peer has defined */
+    int nt_nrxsym;
+    t_symbol **nt_txhash;       /* symbols we've defined, by address */
+    unsigned short *nt_txid;
+    int nt_txhashsize;
+    int nt_ntxsym;
+    unsigned char *nt_outbuf;   /* encoded outgoing message */
+    int nt_outsize;
+    t_atom *nt_vec;             /* decoded incoming message */
+    int nt_vecsize;
+    int nt_busy;                /* passing a message on; put off freeing */
+    int nt_freed;
+} t_nettyped;
+
+static const char nettyped_hello[2] = {(char)NETTYPED_MAGIC, NETTYPED_VERSION};
+
+static t_nettyped *nettyped_new(t_netsend *owner, int udp)
+{
+    t_nettyped *t = (t_nettyped *)getbytes(sizeof(*t));
+    t->nt_owner = owner;
+    t->nt_udp = udp;
+    t->nt_osc = t->nt_gothello = owner->x_osc;
+    return (t);
+}
+
+static void nettyped_free(t_nettyped *t)
+{
+    if (t->nt_busy)
+    {
+        t->nt_freed = 1;
+        return;
+    }
+    if (t->nt_inbuf)
+        freebytes(t->nt_inbuf, t->nt_insize);
+    if (t->nt_rxsym)
+        freebytes(t->nt_rxsym, t->nt_nrxsym * sizeof(t_symbol *));
+    if (t->nt_txhash)
+    {
+        freebytes(t->nt_txhash, t->nt_txhashsize * sizeof(t_symbol *));
+        freebytes(t->nt_txid, t->nt_txhashsize * sizeof(unsigned short));
+    }
+    if (t->nt_outbuf)
+        freebytes(t->nt_outbuf, t->nt_outsize);
+    if (t->nt_vec)
+        freebytes(t->nt_vec, t->nt_vecsize * sizeof(t_atom));
+    freebytes(t, sizeof(*t));
+}
+
+static unsigned int nettyped_get16(const unsigned char *p)
+{
+    return ((p[0] << 8) | p[1]);
+}
+
+static uint32_t nettyped_get32(const unsigned char *p)
+{
+    return (((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+        ((uint32_t)p[2] << 8) | p[3]);
+}
+
+static void nettyped_put16(unsigned char *p, unsigned int n)
+{
+    p[0] = n >> 8;
+    p[1] = n;
+}
+
+static void nettyped_put32(unsigned char *p, uint32_t n)
+{
+    p[0] = n >> 24;
+    p[1] = n >> 16;
+    p[2] = n >> 8;
+    p[3] = n;
+}
+
+static t_float nettyped_getfloat(const unsigned char *p)
+{
+    uint32_t u = nettyped_get32(p);
+    float f;
+    memcpy(&f, &u, 4);
+    return (f);
+}
+
+static void nettyped_putfloat(unsigned char *p, t_float f)
+{
+    float g = f;
+    uint32_t u;
+    memcpy(&u, &g, 4);
+    nettyped_put32(p, u);
+}
+
+static t_float nettyped_getdouble(const unsigned char *p)
+{
+    uint64_t u = ((uint64_t)nettyped_get32(p) << 32) | nettyped_get32(p + 4);
+    double d;
+    memcpy(&d, &u, 8);
+    return (d);
+}
+
+static void nettyped_putdouble(unsigned char *p, t_float f)
+{
+    double d = f;
+    uint64_t u;
+    memcpy(&u, &d, 8);
+    nettyped_put32(p, (uint32_t)(u >> 32));
+    nettyped_put32(p + 4, (uint32_t)u);
+}
+
+    /* does a float survive the trip through float32? */
+#define NETTYPED_ISFLOAT32(f) ((t_float)(float)(f) == (f) || (f) != (f))
+
+    /* find the number we gave a symbol, or -1 after assigning it one */
+static int nettyped_txsym(t_nettyped *t, t_symbol *s)
+{
+    unsigned int i, mask;
+    if (t->nt_ntxsym >= t->nt_txhashsize / 2)
+    {
+        t_symbol **oldhash = t->nt_txhash;
+        unsigned short *oldid = t->nt_txid;
+        int oldsize = t->nt_txhashsize, j;
+        if (t->nt_ntxsym >= NETTYPED_MAXSYM)
+            goto full;
+        t->nt_txhashsize = (oldsize ? 2 * oldsize : 64);
+        t->nt_txhash = (t_symbol **)getbytes(
+            t->nt_txhashsize * sizeof(t_symbol *));
+        t->nt_txid = (unsigned short *)getbytes(
+            t->nt_txhashsize * sizeof(unsigned short));
+        mask = t->nt_txhashsize - 1;
+        for (j = 0; j < oldsize; j++)
+            if (oldhash[j])
+        {
+            for (i = ((uintptr_t)oldhash[j] >> 3) & mask; t->nt_txhash[i];
+                i = (i + 1) & mask)
+                    ;
+            t->nt_txhash[i] = oldhash[j];
+            t->nt_txid[i] = oldid[j];
+        }
+        if (oldsize)
+        {
+            freebytes(oldhash, oldsize * sizeof(t_symbol *));
+            freebytes(oldid, oldsize * sizeof(unsigned short));
+        }
+    }
+full:
+    mask = t->nt_txhashsize - 1;
+    for (i = ((uintptr_t)s >> 3) & mask; t->nt_txhash[i]; i = (i + 1) & mask)
+        if (t->nt_txhash[i] == s)
+            return (t->nt_txid[i]);
+    if (t->nt_ntxsym >= NETTYPED_MAXSYM)
+        return (-2);
+    t->nt_txhash[i] = s;
+    t->nt_txid[i] = t->nt_ntxsym++;
+    return (-1);
+}
+
+    /* make sure there's room for n more bytes of output */
+static unsigned char *nettyped_room(t_nettyped *t, int used, int n)
+{
+    if (used + n > t->nt_outsize)
+    {
+        int newsize = (t->nt_outsize ? t->nt_outsize : 256);
+        while (newsize < used + n)
+            newsize *= 2;
+        t->nt_outbuf = (unsigned char *)resizebytes(t->nt_outbuf,
+            t->nt_outsize, newsize);
+        t->nt_outsize = newsize;
+    }
+    return (t->nt_outbuf + used);
+}
+
+    /* encode a message into nt_outbuf and return its length */
+static int nettyped_encode(t_nettyped *t, int argc, t_atom *argv)
+{
+    int i, n = (t->nt_udp ? 2 : 4);
+    unsigned char *bp = nettyped_room(t, 0, n);
+    if (t->nt_udp)
+        bp[0] = NETTYPED_MAGIC, bp[1] = NETTYPED_VERSION;
+    for (i = 0; i < argc; i++)
+    {
+        t_atom *a = argv + i;
+        if (a->a_type == A_FLOAT)
+        {
+            int nrun = 1;
+                /* pack runs of floats after a single tag */
+            while (i + nrun < argc && nrun < 65535 &&
+                a[nrun].a_type == A_FLOAT &&
+                NETTYPED_ISFLOAT32(a[nrun].a_w.w_float))
+                    nrun++;
+            if (!NETTYPED_ISFLOAT32(a->a_w.w_float))
+            {
+                bp = nettyped_room(t, n, 9);
+                bp[0] = 'd';
+                nettyped_putdouble(bp + 1, a->a_w.w_float);
+                n += 9;
+            }
+            else if (nrun == 1)
+            {
+                bp = nettyped_room(t, n, 5);
+                bp[0] = 'f';
+                nettyped_putfloat(bp + 1, a->a_w.w_float);
+                n += 5;
+            }
+            else
+            {
+                int j;
+                bp = nettyped_room(t, n, 3 + 4 * nrun);
+                bp[0] = 'F';
+                nettyped_put16(bp + 1, nrun);
+                for (j = 0, bp += 3; j < nrun; j++, bp += 4)
+                    nettyped_putfloat(bp, a[j].a_w.w_float);
+                n += 3 + 4 * nrun;
+                i += nrun - 1;
+            }
+        }
+        else if (a->a_type == A_SEMI || a->a_type == A_COMMA)
+        {
+            bp = nettyped_room(t, n, 1);
+            *bp = (a->a_type == A_SEMI ? ';' : ',');
+            n++;
+        }
         else
-            ret = (int)recv(fd, inbuf, NET_MAXPACKETSIZE, 0);
-        if (ret <= 0)
         {
-            if (ret < 0)
+            char buf[MAXPDSTRING];
+            const char *name;
+            int len, id = -2;
+            if (a->a_type == A_SYMBOL)
             {
-                /* socket_errno_udp() ignores some error codes */
-                if (x->x_protocol == SOCK_DGRAM && !socket_errno_udp())
-                    return;
-                sys_sockerror("recv (bin)");
+                name = a->a_w.w_symbol->s_name;
+                if (!t->nt_udp)
+                    id = nettyped_txsym(t, a->a_w.w_symbol);
+            }
+            else
+            {
+                atom_string(a, buf, MAXPDSTRING);
+                name = buf;
+            }
+            if (id >= 0)
+            {
+                bp = nettyped_room(t, n, 3);
+                bp[0] = 'S';
+                nettyped_put16(bp + 1, id);
+                n += 3;
+                continue;
+            }
+            if ((len = (int)strlen(name)) > 65535)
+                len = 65535;
+            if (id == -1)
+            {
+                bp = nettyped_room(t, n, 5 + len);
+                bp[0] = 's';
+                nettyped_put16(bp + 1, t->nt_ntxsym - 1);
+                nettyped_put16(bp + 3, len);
+                memcpy(bp + 5, name, len);
+                n += 5 + len;
+            }
+            else
+            {
+                bp = nettyped_room(t, n, 3 + len);
+                bp[0] = 'n';
+                nettyped_put16(bp + 1, len);
+                memcpy(bp + 3, name, len);
+                n += 3 + len;
+            }
+        }
+    }
+    if (!t->nt_udp)
+        nettyped_put32(t->nt_outbuf, n - 4);
+    return (n);
+}
+
+    /* decode one message into nt_vec; returns the number of atoms or
+    -1 if the message is garbled */
+static int nettyped_decode(t_nettyped *t, const unsigned char *bp, int n)
+{
+    const unsigned char *ep = bp + n;
+    int natom = 0;
+    while (bp < ep)
+    {
+        int tag = *bp++, count = 1, len, id;
+        t_atom *a;
+        if (tag == 'F')
+        {
+            if (ep - bp < 2)
+                return (-1);
+            count = nettyped_get16(bp);
+            if (ep - bp < 2 + 4 * count)
+                return (-1);
+        }
+        if (natom + count > t->nt_vecsize)
+        {
+            int newsize = (t->nt_vecsize ? t->nt_vecsize : 64);
+            while (newsize < natom + count)
+                newsize *= 2;
+            t->nt_vec = (t_atom *)resizebytes(t->nt_vec,
+                t->nt_vecsize * sizeof(t_atom), newsize * sizeof(t_atom));
+            t->nt_vecsize = newsize;
+        }
+        a = t->nt_vec + natom;
+        switch (tag)
+        {
+        case 'f':
+            if (ep - bp < 4)
+                return (-1);
+            SETFLOAT(a, nettyped_getfloat(bp));
+            bp += 4;
+            break;
+        case 'd':
+            if (ep - bp < 8)
+                return (-1);
+            SETFLOAT(a, nettyped_getdouble(bp));
+            bp += 8;
+            break;
+        case 'F':
+            for (bp += 2; count--; a++, natom++, bp += 4)
+                SETFLOAT(a, nettyped_getfloat(bp));
+            continue;
+        case ';':
+            SETSEMI(a);
+            break;
+        case ',':
+            SETCOMMA(a);
+            break;
+        case 'S':
+            if (ep - bp < 2 || (id = nettyped_get16(bp)) >= t->nt_nrxsym ||
+                !t->nt_rxsym[id])
+                    return (-1);
+            SETSYMBOL(a, t->nt_rxsym[id]);
+            bp += 2;
+            break;
+        case 's': case 'n':
+        {
+            char *buf;
+            if (tag == 's')
+            {
+                if (ep - bp < 2)
+                    return (-1);
+                id = nettyped_get16(bp);
+                bp += 2;
             }
-            if (x->x_obj.ob_pd == netreceive_class)
+            else id = -1;
+            if (ep - bp < 2 || ep - bp < 2 + (len = nettyped_get16(bp)))
+                return (-1);
+            buf = (char *)alloca(len + 1);
+            memcpy(buf, bp + 2, len);
+            buf[len] = 0;
+            SETSYMBOL(a, gensym(buf));
+            bp += 2 + len;
+            if (id >= 0)
             {
-                    /* never close UDP socket because we can't really notify it */
-                if (x->x_protocol != SOCK_DGRAM)
+                if (t->nt_udp)
+                    return (-1);
+                if (id >= t->nt_nrxsym)
                 {
-                    sys_rmpollfn(fd);
-                    sys_closesocket(fd);
-                    netreceive_notify((t_netreceive *)x, fd);
+                    t->nt_rxsym = (t_symbol **)resizebytes(t->nt_rxsym,
+                        t->nt_nrxsym * sizeof(t_symbol *),
+                            (id + 1) * sizeof(t_symbol *));
+                    memset(t->nt_rxsym + t->nt_nrxsym, 0,
+                        (id + 1 - t->nt_nrxsym) * sizeof(t_symbol *));
+                    t->nt_nrxsym = id + 1;
                 }
+                t->nt_rxsym[id] = a->a_w.w_symbol;
             }
-            else /* properly shutdown netsend */
-                netsend_disconnect(x);
-            return;
+            break;
         }
-        if (x->x_protocol == SOCK_DGRAM)
+        default:
+            return (-1);
+        }
+        natom++;
+    }
+    return (natom);
+}
+
+    /* pass a decoded message on, after the sender's address if wanted.
+    Returns nonzero if the state was freed meanwhile (because the message
+    disconnected us, say.) */
+static int nettyped_output(t_nettyped *t, const unsigned char *bp, int n,
+    const struct sockaddr *from)
+{
+    t_netsend *x = t->nt_owner;
+    int natom = nettyped_decode(t, bp, n);
+    if (natom < 0)
+    {
+        pd_error(x, "%s: dropped garbled message",
+            class_getname(pd_class(&x->x_obj.ob_pd)));
+        return (0);
+    }
+    t->nt_busy = 1;
+    outlet_setstacklim();
+    if (from && x->x_fromout)
+        outlet_sockaddr(x->x_fromout, from);
+    if (!t->nt_freed)
+        netsend_outatoms(x, natom, t->nt_vec);
+    t->nt_busy = 0;
+    if (t->nt_freed)
+    {
+        t->nt_freed = 0;
+        nettyped_free(t);
+        return (1);
+    }
+    return (0);
+}
+
+/* ------------------------- OSC messages ----------------------------- */
+
+/* With "-o", netsend and netreceive speak OSC directly instead of going
+through byte lists and [oscformat]/[oscparse].  Over TCP each packet is
+preceded by its size as in OSC 1.0.  Incoming messages come out as lists
+of address components and arguments, as from [oscparse].  Messages in a
+bundle with a timetag in the future are held back until then according to
+the system clock; netsend's "latency" message timetags outgoing messages
+that far ahead, wrapping each in a bundle. */
+
+typedef struct _oscpending
+{
+    t_clock *p_clock;
+    t_netsend *p_owner;
+    struct _oscpending *p_next;
+    int p_natom;
+    t_atom *p_vec;
+    int p_hasfrom;
+    struct sockaddr_storage p_from;
+} t_oscpending;
+
+#define OSC_ROUNDUP(n) (((n) + 3) & ~3)
+#define OSC_NTPOFFSET 2208988800.   /* seconds from 1900 to 1970 */
+
+    /* the system clock in seconds since 1900, as in OSC timetags */
+static double netosc_now(void)
+{
+#ifdef _WIN32
+    FILETIME ft;
+    ULARGE_INTEGER u;
+    GetSystemTimeAsFileTime(&ft);
+    u.LowPart = ft.dwLowDateTime;
+    u.HighPart = ft.dwHighDateTime;
+        /* 100-nanosecond ticks since 1601 */
+    return ((double)(u.QuadPart - 116444736000000000ULL) * 1e-7 +
+        OSC_NTPOFFSET);
+#else
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return (tv.tv_sec + 1e-6 * tv.tv_usec + OSC_NTPOFFSET);
+#endif
+}
+
+static void netosc_out(t_netsend *x, int natom, t_atom *vec,
+    const struct sockaddr *from)
+{
+    outlet_setstacklim();
+    if (from && x->x_fromout)
+        outlet_sockaddr(x->x_fromout, from);
+    outlet_list(x->x_msgout, 0, natom, vec);
+}
+
+static void netosc_tick(t_oscpending *p)
+{
+    t_oscpending **pp;
+    for (pp = &p->p_owner->x_pending; *pp != p; pp = &(*pp)->p_next)
+        ;
+    *pp = p->p_next;
+    netosc_out(p->p_owner, p->p_natom, p->p_vec,
+        (p->p_hasfrom ? (const struct sockaddr *)&p->p_from : 0));
+    clock_free(p->p_clock);
+    freebytes(p->p_vec, p->p_natom * sizeof(t_atom));
+    freebytes(p, sizeof(*p));
+}
+
+    /* drop messages still waiting for their timetags */
+static void netosc_cancel(t_netsend *x)
+{
+    while (x->x_pending)
+    {
+        t_oscpending *p = x->x_pending;
+        x->x_pending = p->p_next;
+        clock_free(p->p_clock);
+        freebytes(p->p_vec, p->p_natom * sizeof(t_atom));
+        freebytes(p, sizeof(*p));
+    }
+}
+
+    /* make sure nt_vec has room for n atoms */
+static t_atom *netosc_vec(t_nettyped *t, int n)
+{
+    if (n > t->nt_vecsize)
+    {
+        int newsize = (t->nt_vecsize ? t->nt_vecsize : 64);
+        while (newsize < n)
+            newsize *= 2;
+        t->nt_vec = (t_atom *)resizebytes(t->nt_vec,
+            t->nt_vecsize * sizeof(t_atom), newsize * sizeof(t_atom));
+        t->nt_vecsize = newsize;
+    }
+    return (t->nt_vec);
+}
+
+    /* find a null-terminated, padded string; returns the onset after it
+    or -1 if there isn't one */
+static int netosc_string(const unsigned char *bp, int onset, int n)
+{
+    const unsigned char *z = (onset < n ?
+        memchr(bp + onset, 0, n - onset) : 0);
+    return (z ? OSC_ROUNDUP((int)(z - bp) + 1) : -1);
+}
+
+static t_symbol *netosc_gensym(const unsigned char *s, int len)
+{
+    char buf[MAXPDSTRING];
+    if (len > MAXPDSTRING - 1)
+        len = MAXPDSTRING - 1;
+    memcpy(buf, s, len);
+    buf[len] = 0;
+    return (gensym(buf));
+}
+
+    /* parse an OSC packet straight from the socket buffer and output it,
+    now or when its timetag comes due ("when" is 0 for "immediately".)
+    Returns nonzero if the state was freed meanwhile. */
+static int netosc_parse(t_nettyped *t, const unsigned char *bp, int n,
+    const struct sockaddr *from, double when)
+{
+    t_netsend *x = t->nt_owner;
+    const char *name = class_getname(pd_class(&x->x_obj.ob_pd));
+    int i, k, natom = 0, tagonset, dataonset;
+    t_atom *vec;
+    double delay;
+    if (n >= 16 && !memcmp(bp, "#bundle", 8))
+    {
+        uint32_t sec = nettyped_get32(bp + 8), frac = nettyped_get32(bp + 12);
+        if (sec || frac != 1)
+            when = sec + frac * (1. / 4294967296.);
+        for (i = 16; i + 4 <= n; )
         {
-            t_atom *ap;
-            if (x->x_fromout)
-                outlet_sockaddr(x->x_fromout, (const struct sockaddr *)&fromaddr);
-                /* handle too large UDP packets */
-            if (ret > NET_MAXPACKETSIZE)
+            int size = (int)nettyped_get32(bp + i);
+            if (size <= 0 || (size & 3) || size > n - i - 4)
             {
-                post("warning: incoming UDP packet truncated from %d to %d bytes.",
-                    ret, NET_MAXPACKETSIZE);
-                ret = NET_MAXPACKETSIZE;
+                pd_error(x, "%s: bad OSC bundle element size", name);
+                return (0);
             }
-            ap = (t_atom *)alloca(ret * sizeof(t_atom));
-            for (i = 0; i < ret; i++)
-                SETFLOAT(ap+i, inbuf[i]);
-            outlet_list(x->x_msgout, 0, ret, ap);
-            readbytes += ret;
-            /* throttle */
-            if (readbytes >= NET_MAXPACKETSIZE)
-                return;
-            /* check for pending UDP packets */
-            if (socket_bytes_available(fd) <= 0)
-                return;
+            if (netosc_parse(t, bp + i + 4, size, from, when))
+                return (1);
+            i += size + 4;
         }
+        return (0);
+    }
+    if (!n || bp[0] != '/')
+    {
+        pd_error(x, "%s: not an OSC message (no leading slash)", name);
+        return (0);
+    }
+    if ((tagonset = netosc_string(bp, 0, n)) < 0)
+        goto tooshort;
+        /* worst case: every byte is an address component or argument */
+    vec = netosc_vec(t, n + 1);
+    for (i = 0; bp[i]; )
+    {
+        while (bp[i] == '/')
+            i++;
+        for (k = i; bp[k] && bp[k] != '/'; k++)
+            ;
+        if (k > i)
+        {
+            SETSYMBOL(vec + natom, netosc_gensym(bp + i, k - i));
+            natom++;
+        }
+        i = k;
+    }
+        /* the type tag string is optional in OSC 1.0 */
+    if (tagonset < n && bp[tagonset] == ',')
+    {
+        if ((dataonset = netosc_string(bp, tagonset, n)) < 0)
+            goto tooshort;
+        for (i = tagonset + 1, k = dataonset; bp[i]; i++)
+        {
+            union
+            {
+                float z_f;
+                uint32_t z_i;
+            } z;
+            union
+            {
+                double z_d;
+                uint64_t z_i;
+            } zz;
+            t_float f;
+            int size, end;
+            switch (bp[i])
+            {
+            case 'f':
+                if (k > n - 4)
+                    goto tooshort;
+                z.z_i = nettyped_get32(bp + k);
+                f = z.z_f;
+                if (PD_BADFLOAT(f))
+                    f = 0;
+                SETFLOAT(vec + natom, f);
+                natom++;
+                k += 4;
+                break;
+            case 'i': case 'c': case 'r': case 'm':
+                if (k > n - 4)
+                    goto tooshort;
+                SETFLOAT(vec + natom, (int32_t)nettyped_get32(bp + k));
+                natom++;
+                k += 4;
+                break;
+            case 'd': case 'h': case 't':
+                if (k > n - 8)
+                    goto tooshort;
+                zz.z_i = ((uint64_t)nettyped_get32(bp + k) << 32) |
+                    nettyped_get32(bp + k + 4);
+                if (bp[i] == 'd')
+                {
+                    f = zz.z_d;
+                    if (PD_BADFLOAT(f))
+                        f = 0;
+                }
+                else if (bp[i] == 'h')
+                    f = (int64_t)zz.z_i;
+                else f = (t_float)(zz.z_i * (1. / 4294967296.));
+                SETFLOAT(vec + natom, f);
+                natom++;
+                k += 8;
+                break;
+            case 's': case 'S':
+                if ((end = netosc_string(bp, k, n)) < 0)
+                    goto tooshort;
+                SETSYMBOL(vec + natom,
+                    netosc_gensym(bp + k, (int)strlen((char *)bp + k)));
+                natom++;
+                k = end;
+                break;
+            case 'b':
+                if (k > n - 4)
+                    goto tooshort;
+                size = (int)nettyped_get32(bp + k);
+                k += 4;
+                if (size < 0 || size > n - k)
+                    goto tooshort;
+                SETFLOAT(vec + natom, size);
+                natom++;
+                for (end = k + size; k < end; k++, natom++)
+                    SETFLOAT(vec + natom, bp[k]);
+                k = OSC_ROUNDUP(k);
+                break;
+            case 'T':
+                SETFLOAT(vec + natom, 1);
+                natom++;
+                break;
+            case 'F':
+                SETFLOAT(vec + natom, 0);
+                natom++;
+                break;
+            case 'N': case 'I': case '[': case ']':
+                break;
+            default:
+                pd_error(x, "%s: unknown OSC tag '%c' (%d)", name,
+                    bp[i], bp[i]);
+                goto done;
+            }
+        }
+    }
+done:
+    if (when != 0 && (delay = (when - netosc_now()) * 1000.) > 0)
+    {
+        t_oscpending *p = (t_oscpending *)getbytes(sizeof(*p));
+        p->p_clock = clock_new(p, (t_method)netosc_tick);
+        p->p_owner = x;
+        p->p_natom = natom;
+        p->p_vec = (t_atom *)copybytes(vec, natom * sizeof(t_atom));
+        if ((p->p_hasfrom = (from != 0)))
+            memcpy(&p->p_from, from, sockaddr_get_len(from));
+        p->p_next = x->x_pending;
+        x->x_pending = p;
+        clock_delay(p->p_clock, delay);
+        return (0);
+    }
+    t->nt_busy = 1;
+    netosc_out(x, natom, vec, from);
+    t->nt_busy = 0;
+    if (t->nt_freed)
+    {
+        t->nt_freed = 0;
+        nettyped_free(t);
+        return (1);
+    }
+    return (0);
+tooshort:
+    pd_error(x, "%s: OSC message ended prematurely", name);
+    return (0);
+}
+
+    /* put a padded OSC string in nt_outbuf at onset n */
+static int netosc_putstring(t_nettyped *t, int n, const char *s)
+{
+    int len = (int)strlen(s), size = OSC_ROUNDUP(len + 1);
+    unsigned char *bp = nettyped_room(t, n, size);
+    memcpy(bp, s, len);
+    memset(bp + len, 0, size - len);
+    return (n + size);
+}
+
+    /* encode "/address args..." as an OSC message in nt_outbuf, after a
+    size prefix for TCP and inside a bundle if there's a latency.  Returns
+    the length or 0 if there's no address. */
+static int netosc_encode(t_nettyped *t, int argc, t_atom *argv)
+{
+    t_netsend *x = t->nt_owner;
+    char buf[MAXPDSTRING], *tags;
+    int i, n = (t->nt_udp ? 0 : 4), msgonset;
+    if (!argc || argv->a_type != A_SYMBOL)
+    {
+        pd_error(x, "%s: OSC message needs an address",
+            class_getname(pd_class(&x->x_obj.ob_pd)));
+        return (0);
+    }
+    if (x->x_osclatency > 0)
+    {
+        double when = netosc_now() + x->x_osclatency * 0.001;
+        uint32_t sec = (uint32_t)when;
+        unsigned char *bp = nettyped_room(t, n, 20);
+        memcpy(bp, "#bundle", 8);
+        nettyped_put32(bp + 8, sec);
+        nettyped_put32(bp + 12, (uint32_t)((when - sec) * 4294967296.));
+        n += 20;
+    }
+    msgonset = n;
+    if (*argv->a_w.w_symbol->s_name == '/')
+        n = netosc_putstring(t, n, argv->a_w.w_symbol->s_name);
+    else
+    {
+        buf[0] = '/';
+        strncpy(buf + 1, argv->a_w.w_symbol->s_name, MAXPDSTRING - 2);
+        buf[MAXPDSTRING - 1] = 0;
+        n = netosc_putstring(t, n, buf);
+    }
+    argc--, argv++;
+    tags = (argc + 2 <= MAXPDSTRING ? buf : (char *)getbytes(argc + 2));
+    tags[0] = ',';
+    for (i = 0; i < argc; i++)
+        tags[i + 1] = (argv[i].a_type == A_FLOAT ? 'f' : 's');
+    tags[argc + 1] = 0;
+    n = netosc_putstring(t, n, tags);
+    if (tags != buf)
+        freebytes(tags, argc + 2);
+    for (i = 0; i < argc; i++)
+    {
+        if (argv[i].a_type == A_FLOAT)
+        {
+            nettyped_putfloat(nettyped_room(t, n, 4), argv[i].a_w.w_float);
+            n += 4;
+        }
+        else if (argv[i].a_type == A_SYMBOL)
+            n = netosc_putstring(t, n, argv[i].a_w.w_symbol->s_name);
         else
         {
-            if (x->x_fromout &&
-                !getpeername(fd, (struct sockaddr *)&fromaddr, &fromaddrlen))
-                    outlet_sockaddr(x->x_fromout, (const struct sockaddr *)&fromaddr);
-            for (i = 0; i < ret; i++)
-                outlet_float(x->x_msgout, inbuf[i]);
-            return;
+            atom_string(argv + i, buf, MAXPDSTRING);
+            n = netosc_putstring(t, n, buf);
         }
     }
+    if (x->x_osclatency > 0)
+        nettyped_put32(t->nt_outbuf + msgonset - 4, n - msgonset);
+    if (!t->nt_udp)
+        nettyped_put32(t->nt_outbuf, n - 4);
+    return (n);
 }
 
-static void netsend_read(void *z, t_binbuf *b)
+    /* lost the TCP connection (or gave up on it) */
+static void nettyped_close(t_nettyped *t, int fd)
 {
-    t_netsend *x = (t_netsend *)z;
-    int msg, natom = binbuf_getnatom(b);
-    t_atom *at = binbuf_getvec(b);
-    for (msg = 0; msg < natom;)
+    t_netsend *x = t->nt_owner;
+    if (x->x_obj.ob_pd == netreceive_class)
+    {
+        sys_rmpollfn(fd);
+        sys_closesocket(fd);
+        netreceive_notify((t_netreceive *)x, fd);
+    }
+    else netsend_disconnect(x);
+}
+
+    /* poll function for typed TCP connections */
+static void nettyped_read(t_nettyped *t, int fd)
+{
+    t_netsend *x = t->nt_owner;
+    int ret, onset = 0;
+    struct sockaddr_storage fromaddr = {0};
+    socklen_t fromaddrlen = sizeof(struct sockaddr_storage);
+    const struct sockaddr *from = 0;
+    if (t->nt_insize - t->nt_inhead < NET_MAXPACKETSIZE)
+    {
+        int newsize = (t->nt_insize ? t->nt_insize : NET_MAXPACKETSIZE);
+        while (newsize - t->nt_inhead < NET_MAXPACKETSIZE)
+            newsize *= 2;
+        t->nt_inbuf = (unsigned char *)resizebytes(t->nt_inbuf,
+            t->nt_insize, newsize);
+        t->nt_insize = newsize;
+    }
+    ret = (int)recv(fd, (char *)t->nt_inbuf + t->nt_inhead,
+        t->nt_insize - t->nt_inhead, 0);
+    if (ret <= 0)
+    {
+        if (ret < 0)
+            sys_sockerror("recv (typed)");
+        nettyped_close(t, fd);
+        return;
+    }
+    t->nt_inhead += ret;
+    if (!t->nt_gothello)
+    {
+        if (t->nt_inhead < 2)
+            return;
+        if (t->nt_inbuf[0] != NETTYPED_MAGIC ||
+            t->nt_inbuf[1] != NETTYPED_VERSION)
+        {
+            pd_error(x, "%s: peer doesn't speak typed messages",
+                class_getname(pd_class(&x->x_obj.ob_pd)));
+            nettyped_close(t, fd);
+            return;
+        }
+        t->nt_gothello = 1;
+        onset = 2;
+    }
+    if (x->x_fromout &&
+        !getpeername(fd, (struct sockaddr *)&fromaddr, &fromaddrlen))
+    {
+        sockaddr_end_unixpath(&fromaddr, fromaddrlen);
+        from = (const struct sockaddr *)&fromaddr;
+    }
+    while (t->nt_inhead - onset >= 4)
+    {
+        uint32_t n = nettyped_get32(t->nt_inbuf + onset);
+        if (n > NETTYPED_MAXMSG)
+        {
+            pd_error(x, "%s: typed message too long (%u bytes)",
+                class_getname(pd_class(&x->x_obj.ob_pd)), (unsigned)n);
+            nettyped_close(t, fd);
+            return;
+        }
+        if (t->nt_inhead - onset < 4 + (int)n)
+            break;
+        if (t->nt_osc ? netosc_parse(t, t->nt_inbuf + onset + 4, n, from, 0) :
+            nettyped_output(t, t->nt_inbuf + onset + 4, n, from))
+                return;
+        onset += 4 + n;
+    }
+    if (onset)
+    {
+        memmove(t->nt_inbuf, t->nt_inbuf + onset, t->nt_inhead - onset);
+        t->nt_inhead -= onset;
+    }
+}
+
+    /* poll function for a UDP netreceive with "-t", which takes typed
+    datagrams and text ones alike */
+static void nettyped_readudp(t_nettyped *t, int fd)
+{
+    t_netsend *x = t->nt_owner;
+    t_datagram *d = 0;
+    int n, i, more, readbytes = 0;
+    while (1)
     {
-        int emsg;
-        for (emsg = msg; emsg < natom && at[emsg].a_type != A_COMMA
-             && at[emsg].a_type != A_SEMI; emsg++)
-            ;
-        if (emsg > msg)
+        if ((n = sys_recvbatch(fd, &d, &more)) < 0)
         {
-            int i;
-            for (i = msg; i < emsg; i++)
-                if (at[i].a_type == A_DOLLAR || at[i].a_type == A_DOLLSYM)
+            if (socket_errno_udp())
+                sys_sockerror("recv (udp)");
+            return;
+        }
+        for (i = 0; i < n; i++)
+        {
+            unsigned char *buf = d[i].d_buf;
+            int len = d[i].d_len;
+            if (len <= 0)
+                continue;
+            readbytes += len;
+            if (d[i].d_truncated)
+                post("warning: incoming UDP packet truncated to %d bytes.",
+                    NET_MAXPACKETSIZE-1);
+            if (t->nt_osc)
+            {
+                if (netosc_parse(t, buf, len,
+                    (const struct sockaddr *)d[i].d_from, 0))
+                        break;
+            }
+            else if (len >= 2 && buf[0] == NETTYPED_MAGIC &&
+                buf[1] == NETTYPED_VERSION)
+            {
+                if (nettyped_output(t, buf + 2, len - 2,
+                    (const struct sockaddr *)d[i].d_from))
+                        break;
+            }
+            else if (buf[len-1] == '\n')
+            {
+                    /* FUDI text, as in socketreceiver_getudp() */
+                t_binbuf *b = binbuf_new();
+                char *semi;
+                buf[len] = 0;
+                if ((semi = strchr((char *)buf, ';')))
+                    *semi = 0;
+                binbuf_text(b, (char *)buf, strlen((char *)buf));
+                t->nt_busy = 1;
+                outlet_setstacklim();
+                if (x->x_fromout)
+                    outlet_sockaddr(x->x_fromout,
+                        (const struct sockaddr *)d[i].d_from);
+                if (!t->nt_freed)
+                    netsend_read(x, b);
+                t->nt_busy = 0;
+                binbuf_free(b);
+                if (t->nt_freed)
                 {
-                    pd_error(x, "netreceive: got dollar sign in message");
-                    goto nodice;
+                    t->nt_freed = 0;
+                    nettyped_free(t);
+                    break;
                 }
-            if (at[msg].a_type == A_FLOAT)
-            {
-                if (emsg > msg + 1)
-                    outlet_list(x->x_msgout, 0, emsg-msg, at + msg);
-                else outlet_float(x->x_msgout, at[msg].a_w.w_float);
             }
-            else if (at[msg].a_type == A_SYMBOL)
-                outlet_anything(x->x_msgout, at[msg].a_w.w_symbol,
-                    emsg-msg-1, at + msg + 1);
         }
-    nodice:
-        msg = emsg + 1;
+        sys_recvbatchdone(d);
+        if (i < n)  /* we were freed */
+            return;
+            /* throttle */
+        if (readbytes >= NET_MAXPACKETSIZE || !more)
+            return;
     }
 }
 
@@ -237,11 +1264,17 @@ static void netsend_notify(void *z, int fd)
         if (x->x_receiver)
             socketreceiver_free(x->x_receiver);
         x->x_receiver = NULL;
+        if (x->x_typedconn)
+            nettyped_free(x->x_typedconn);
+        x->x_typedconn = NULL;
         memset(&x->x_server, 0, sizeof(struct sockaddr_storage));
         outlet_float(x->x_obj.ob_outlet, 0);
     }
 }
 
+static void netsend_connected(t_netsend *x, int sockfd);
+static void netsend_connectunix(t_netsend *x, const char *path);
+
 static void netsend_connect(t_netsend *x, t_symbol *s, int argc, t_atom *argv)
 {
     int portno, sportno, sockfd, multicast = 0, status;
@@ -249,6 +1282,14 @@ static void netsend_connect(t_netsend *x, t_symbol *s, int argc, t_atom *argv)
     const char *hostname = NULL;
     char hostbuf[256];
 
+    if (argc == 1 && argv[0].a_type == A_SYMBOL &&
+        sockaddr_is_unixpath(argv[0].a_w.w_symbol->s_name))
+    {
+        if (x->x_sockfd >= 0)
+            pd_error(0, "netsend: already connected");
+        else netsend_connectunix(x, argv[0].a_w.w_symbol->s_name);
+        return;
+    }
     /* check argument types */
     if ((argc < 2) ||
         argv[0].a_type != A_SYMBOL ||
@@ -388,12 +1429,29 @@ static void netsend_connect(t_netsend *x, t_symbol *s, int argc, t_atom *argv)
         pd_error(x, "netsend: connect failed: %s (%d)", buf, err);
         return;
     }
+    netsend_connected(x, sockfd);
+    return;
+connect_fail:
+    freeaddrinfo(ailist);
+    if (sockfd > 0)
+        sys_closesocket(sockfd);
+}
 
+    /* finish connecting once we have a socket, whichever kind it is */
+static void netsend_connected(t_netsend *x, int sockfd)
+{
     x->x_sockfd = sockfd;
+    if (x->x_protocol == SOCK_STREAM)
+        socket_set_nonblocking(sockfd, (x->x_outmax > 0));
+    if (x->x_typed || x->x_osc)
+        x->x_typedconn = nettyped_new(x, x->x_protocol == SOCK_DGRAM);
     if (x->x_msgout) /* add polling function for return messages */
     {
         if (x->x_bin)
             sys_addpollfn(x->x_sockfd, (t_fdpollfn)netsend_readbin, x);
+        else if (x->x_typedconn && x->x_protocol == SOCK_STREAM)
+            sys_addpollfn(x->x_sockfd, (t_fdpollfn)nettyped_read,
+                x->x_typedconn);
         else
         {
             t_socketreceiver *y =
@@ -403,52 +1461,277 @@ static void netsend_connect(t_netsend *x, t_symbol *s, int argc, t_atom *argv)
             x->x_receiver = y;
         }
     }
+    if (x->x_typed && x->x_protocol == SOCK_STREAM &&
+        netsend_rawsend(x, sockfd, nettyped_hello, 2))
+    {
+        netsend_disconnect(x);
+        return;
+    }
     outlet_float(x->x_obj.ob_outlet, 1);
-    return;
-connect_fail:
-    freeaddrinfo(ailist);
-    if (sockfd > 0)
+}
+
+    /* "connect /some/path": a Unix-domain socket on this machine instead
+    of a host and port.  It skips the network stack altogether, which makes
+    it the cheaper way to talk to another local process. */
+static void netsend_connectunix(t_netsend *x, const char *path)
+{
+    struct sockaddr_storage ss;
+    int sockfd, len = sockaddr_set_unixpath(&ss, path);
+    if (len < 0)
+    {
+#ifdef NET_UNIXSOCKETS
+        pd_error(x, "netsend: %s: socket path too long", path);
+#else
+        pd_error(x, "netsend: Unix-domain sockets not supported");
+#endif
+        return;
+    }
+    if ((sockfd = socket(AF_UNIX, x->x_protocol, 0)) < 0)
+    {
+        sys_sockerror("socket");
+        return;
+    }
+    logpost(NULL, PD_VERBOSE, "connecting to %s", path);
+        /* datagrams are sent with sendto() like UDP, so only a stream
+        socket connects up front */
+    if (x->x_protocol == SOCK_STREAM &&
+        socket_connect(sockfd, (struct sockaddr *)&ss, len, x->x_timeout) < 0)
+    {
+        sys_sockerror("connecting stream socket");
         sys_closesocket(sockfd);
+        outlet_float(x->x_obj.ob_outlet, 0);
+        return;
+    }
+    memcpy(&x->x_server, &ss, len);
+    netsend_connected(x, sockfd);
+}
+
+    /* -------------- TCP output queued while the socket is full --------- */
+
+static int netsend_wouldblock(void)
+{
+    int err = socket_errno();
+#ifdef _WIN32
+    return (err == WSAEWOULDBLOCK);
+#else
+    return (err == EAGAIN || err == EWOULDBLOCK);
+#endif
+}
+
+static void netsend_writepoll(t_netsend *x, int fd);
+
+    /* start or stop waiting for the socket and report it on the outlet */
+static void netsend_setwaiting(t_netsend *x, int waiting)
+{
+    t_atom at;
+    if (waiting == x->x_outwaiting)
+        return;
+    if (waiting)
+        sys_addwritepollfn(x->x_sockfd, (t_fdpollfn)netsend_writepoll, x);
+    else
+    {
+        sys_rmwritepollfn(x->x_sockfd);
+        x->x_outwarned = 0;
+    }
+    x->x_outwaiting = waiting;
+    SETFLOAT(&at, waiting);
+    outlet_anything(x->x_obj.ob_outlet, gensym("backpressure"), 1, &at);
+}
+
+    /* throw away pending output, without telling anyone */
+static void netsend_outclear(t_netsend *x)
+{
+    if (x->x_outwaiting)
+        sys_rmwritepollfn(x->x_sockfd);
+    x->x_outwaiting = x->x_outwarned = x->x_outlocked = 0;
+    x->x_outhead = x->x_outtail = x->x_msghead = x->x_msgtail = 0;
+}
+
+    /* account for n bytes that have gone out */
+static void netsend_outsent(t_netsend *x, int n)
+{
+    x->x_outtail += n;
+    while (x->x_msgtail < x->x_msghead && n >= x->x_outmsg[x->x_msgtail])
+    {
+        n -= x->x_outmsg[x->x_msgtail++];
+        x->x_outlocked = 0;
+    }
+    if (n > 0)
+    {
+        x->x_outmsg[x->x_msgtail] -= n;
+        x->x_outlocked = 1;
+    }
+    if (x->x_outtail >= x->x_outhead)
+        x->x_outhead = x->x_outtail = x->x_msghead = x->x_msgtail =
+            x->x_outlocked = 0;
+}
+
+    /* drop the oldest whole messages until at least nbytes are freed or
+    there's nothing left to drop */
+static void netsend_outdrop(t_netsend *x, int nbytes)
+{
+    int i = x->x_msgtail + x->x_outlocked, j = i, ndrop = 0;
+    while (j < x->x_msghead && ndrop < nbytes)
+        ndrop += x->x_outmsg[j++];
+    if (j == i)
+        return;
+    if (!x->x_outwarned)
+    {
+        pd_error(x, "netsend: output buffer full; dropping old messages");
+        x->x_outwarned = 1;
+    }
+    if (!x->x_outlocked)
+    {
+        x->x_outtail += ndrop;
+        x->x_msgtail = j;
+    }
+    else
+    {
+            /* keep the partly sent message in front */
+        int onset = x->x_outtail + x->x_outmsg[x->x_msgtail];
+        memmove(x->x_outbuf + onset, x->x_outbuf + onset + ndrop,
+            x->x_outhead - (onset + ndrop));
+        x->x_outhead -= ndrop;
+        memmove(x->x_outmsg + i, x->x_outmsg + j,
+            (x->x_msghead - j) * sizeof(int));
+        x->x_msghead -= (j - i);
+    }
+}
+
+    /* add a message to the output queue.  Returns nonzero if we should
+    disconnect instead. */
+static int netsend_outappend(t_netsend *x, const char *buf, int length)
+{
+    int pending = x->x_outhead - x->x_outtail;
+    if (x->x_outmax > 0 && pending + length > x->x_outmax)
+    {
+        if (!x->x_outdrop)
+        {
+            pd_error(x, "netsend: output buffer overflow; disconnecting");
+            return (1);
+        }
+        netsend_outdrop(x, pending + length - x->x_outmax);
+        pending = x->x_outhead - x->x_outtail;
+    }
+    if (x->x_outhead + length > x->x_outsize)
+    {
+        if (x->x_outtail)
+        {
+            memmove(x->x_outbuf, x->x_outbuf + x->x_outtail, pending);
+            x->x_outhead = pending;
+            x->x_outtail = 0;
+        }
+        if (pending + length > x->x_outsize)
+        {
+            int newsize = (x->x_outsize ? x->x_outsize : MAXPDSTRING);
+            while (newsize < pending + length)
+                newsize *= 2;
+            x->x_outbuf = (char *)resizebytes(x->x_outbuf,
+                x->x_outsize, newsize);
+            x->x_outsize = newsize;
+        }
+    }
+    if (x->x_msghead == x->x_outmsgsize)
+    {
+        int nmsg = x->x_msghead - x->x_msgtail;
+        if (x->x_msgtail)
+        {
+            memmove(x->x_outmsg, x->x_outmsg + x->x_msgtail,
+                nmsg * sizeof(int));
+            x->x_msghead = nmsg;
+            x->x_msgtail = 0;
+        }
+        else
+        {
+            int newsize = (x->x_outmsgsize ? 2 * x->x_outmsgsize : 64);
+            x->x_outmsg = (int *)resizebytes(x->x_outmsg,
+                x->x_outmsgsize * sizeof(int), newsize * sizeof(int));
+            x->x_outmsgsize = newsize;
+        }
+    }
+    memcpy(x->x_outbuf + x->x_outhead, buf, length);
+    x->x_outhead += length;
+    x->x_outmsg[x->x_msghead++] = length;
+    return (0);
+}
+
+    /* send without blocking, queueing whatever the socket won't take */
+static int netsend_outsend(t_netsend *x, int sockfd,
+    const char *buf, int length)
+{
+    int sent = 0;
+    if (x->x_outhead == x->x_outtail)
+    {
+        if ((sent = (int)send(sockfd, buf, length, 0)) < 0)
+        {
+            if (!netsend_wouldblock())
+            {
+                sys_sockerror("send");
+                return (1);
+            }
+            sent = 0;
+        }
+        if (sent >= length)
+            return (0);
+    }
+    if (netsend_outappend(x, buf + sent, length - sent))
+        return (1);
+    if (sent)
+        x->x_outlocked = 1;
+    netsend_setwaiting(x, 1);
+    return (0);
+}
+
+static void netsend_writepoll(t_netsend *x, int fd)
+{
+    int res = (int)send(fd, x->x_outbuf + x->x_outtail,
+        x->x_outhead - x->x_outtail, 0);
+    if (res < 0)
+    {
+        if (!netsend_wouldblock())
+        {
+            sys_sockerror("send");
+            netsend_disconnect(x);
+        }
+        return;
+    }
+    netsend_outsent(x, res);
+    if (x->x_outhead == x->x_outtail)
+        netsend_setwaiting(x, 0);
 }
 
 static void netsend_disconnect(t_netsend *x)
 {
     if (x->x_sockfd >= 0)
     {
+        netsend_outclear(x);
         sys_rmpollfn(x->x_sockfd);
         sys_closesocket(x->x_sockfd);
         x->x_sockfd = -1;
         if (x->x_receiver)
             socketreceiver_free(x->x_receiver);
         x->x_receiver = NULL;
+        if (x->x_typedconn)
+            nettyped_free(x->x_typedconn);
+        x->x_typedconn = NULL;
         memset(&x->x_server, 0, sizeof(struct sockaddr_storage));
         outlet_float(x->x_obj.ob_outlet, 0);
     }
 }
 
-static int netsend_dosend(t_netsend *x, int sockfd, int argc, t_atom *argv)
+    /* send bytes, queueing them if the socket is full and we're allowed to */
+static int netsend_rawsend(t_netsend *x, int sockfd,
+    const char *buf, int length)
 {
-    char *buf, *bp;
-    int length, sent, fail = 0;
-    t_binbuf *b = 0;
-    if (x->x_bin)
-    {
-        int i;
-        buf = alloca(argc);
-        for (i = 0; i < argc; i++)
-            ((unsigned char *)buf)[i] = atom_getfloatarg(i, argc, argv);
-        length = argc;
-    }
-    else
-    {
-        t_atom at;
-        b = binbuf_new();
-        binbuf_add(b, argc, argv);
-        SETSEMI(&at);
-        binbuf_add(b, 1, &at);
-        binbuf_gettext(b, &buf, &length);
-    }
-    for (bp = buf, sent = 0; sent < length;)
+    const char *bp;
+    int sent, fail = 0;
+        /* in "-iothread" mode TCP output is written by the I/O thread */
+    if (x->x_protocol == SOCK_STREAM && !sys_iosend(sockfd, buf, length))
+        fail = 0;
+    else if (x->x_protocol == SOCK_STREAM &&
+        (x->x_outmax > 0 || x->x_outhead > x->x_outtail))
+            fail = netsend_outsend(x, sockfd, buf, length);
+    else for (bp = buf, sent = 0; sent < length;)
     {
         static double lastwarntime;
         static double pleasewarn;
@@ -458,8 +1741,8 @@ static int netsend_dosend(t_netsend *x, int sockfd, int argc, t_atom *argv)
         int res = 0;
         if (x->x_protocol == SOCK_DGRAM)
         {
-            socklen_t addrlen = (x->x_server.ss_family == AF_INET6 ?
-                sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+            socklen_t addrlen =
+                sockaddr_get_len((struct sockaddr *)&x->x_server);
             res = (int)sendto(sockfd, bp, length-sent, 0,
                 (struct sockaddr *)&x->x_server, addrlen);
         }
@@ -492,8 +1775,43 @@ static int netsend_dosend(t_netsend *x, int sockfd, int argc, t_atom *argv)
             bp += res;
         }
     }
-    done:
-    if (!x->x_bin)
+    return (fail);
+}
+
+    /* send a message as bytes ("-b"), typed atoms or OSC if "t" is the
+    connection's typed state, or else FUDI text */
+static int netsend_dosend(t_netsend *x, int sockfd, t_nettyped *t,
+    int argc, t_atom *argv)
+{
+    char *buf;
+    int length, fail;
+    t_binbuf *b = 0;
+    if (x->x_bin)
+    {
+        int i;
+        buf = alloca(argc);
+        for (i = 0; i < argc; i++)
+            ((unsigned char *)buf)[i] = atom_getfloatarg(i, argc, argv);
+        length = argc;
+    }
+    else if (t)
+    {
+        if (!(length = (t->nt_osc ? netosc_encode(t, argc, argv) :
+            nettyped_encode(t, argc, argv))))
+                return (0);
+        buf = (char *)t->nt_outbuf;
+    }
+    else
+    {
+        t_atom at;
+        b = binbuf_new();
+        binbuf_add(b, argc, argv);
+        SETSEMI(&at);
+        binbuf_add(b, 1, &at);
+        binbuf_gettext(b, &buf, &length);
+    }
+    fail = netsend_rawsend(x, sockfd, buf, length);
+    if (b)
     {
         t_freebytes(buf, length);
         binbuf_free(b);
@@ -505,7 +1823,7 @@ static void netsend_send(t_netsend *x, t_symbol *s, int argc, t_atom *argv)
 {
     if (x->x_sockfd >= 0)
     {
-        if (netsend_dosend(x, x->x_sockfd, argc, argv))
+        if (netsend_dosend(x, x->x_sockfd, x->x_typedconn, argc, argv))
             netsend_disconnect(x);
     }
 }
@@ -516,9 +1834,39 @@ static void netsend_timeout(t_netsend *x, t_float timeout)
         x->x_timeout = timeout * 0.001;
 }
 
+    /* set the high-water mark for queued TCP output, or 0 to block */
+static void netsend_buffer(t_netsend *x, t_floatarg f)
+{
+    x->x_outmax = (f > 0 ? f : 0);
+    if (x->x_sockfd >= 0 && x->x_protocol == SOCK_STREAM)
+        socket_set_nonblocking(x->x_sockfd, (x->x_outmax > 0));
+}
+
+static void netsend_overflow(t_netsend *x, t_symbol *s)
+{
+    if (s == gensym("drop"))
+        x->x_outdrop = 1;
+    else if (s == gensym("disconnect"))
+        x->x_outdrop = 0;
+    else pd_error(x, "netsend: overflow: %s: use 'drop' or 'disconnect'",
+        s->s_name);
+}
+
+    /* timetag outgoing OSC messages this many msec in the future */
+static void netsend_latency(t_netsend *x, t_floatarg f)
+{
+    x->x_osclatency = (f > 0 ? f : 0);
+}
+
 static void netsend_free(t_netsend *x)
 {
+    sys_inputsource(x, 0, 0);
     netsend_disconnect(x);
+    netosc_cancel(x);
+    if (x->x_outbuf)
+        freebytes(x->x_outbuf, x->x_outsize);
+    if (x->x_outmsg)
+        freebytes(x->x_outmsg, x->x_outmsgsize * sizeof(int));
 }
 
 static void netsend_setup(void)
@@ -535,6 +1883,12 @@ static void netsend_setup(void)
     class_addlist(netsend_class, (t_method)netsend_send);
     class_addmethod(netsend_class, (t_method)netsend_timeout,
         gensym("timeout"), A_DEFFLOAT, 0);
+    class_addmethod(netsend_class, (t_method)netsend_buffer,
+        gensym("buffer"), A_FLOAT, 0);
+    class_addmethod(netsend_class, (t_method)netsend_overflow,
+        gensym("overflow"), A_SYMBOL, 0);
+    class_addmethod(netsend_class, (t_method)netsend_latency,
+        gensym("latency"), A_FLOAT, 0);
 }
 
 /* ----------------------------- netreceive ------------------------- */
@@ -560,6 +1914,14 @@ static void netreceive_notify(t_netreceive *x, int fd)
             x->x_receivers = (t_socketreceiver **)t_resizebytes(x->x_receivers,
                 x->x_nconnections * sizeof(t_socketreceiver*),
                     (x->x_nconnections-1) * sizeof(t_socketreceiver*));
+
+            if (x->x_typedconns[i])
+                nettyped_free(x->x_typedconns[i]);
+            memmove(x->x_typedconns+i, x->x_typedconns+(i+1),
+                sizeof(t_nettyped*) * (x->x_nconnections - (i+1)));
+            x->x_typedconns = (t_nettyped **)t_resizebytes(x->x_typedconns,
+                x->x_nconnections * sizeof(t_nettyped*),
+                    (x->x_nconnections-1) * sizeof(t_nettyped*));
             x->x_nconnections--;
         }
     }
@@ -579,6 +1941,52 @@ static void netreceive_fromaddr(void *z, const void *fromaddr)
         outlet_sockaddr(x->x_ns.x_fromout, (const struct sockaddr *)fromaddr);
 }
 
+    /* the first read on a new TCP connection: see whether the peer is
+    sending typed messages or text, and hand it on accordingly */
+static void netreceive_sniff(t_netreceive *x, int fd)
+{
+    unsigned char c;
+    int i, ret = (int)recv(fd, (char *)&c, 1, MSG_PEEK);
+    if (ret <= 0)
+    {
+        if (ret < 0)
+            sys_sockerror("recv (tcp)");
+        sys_rmpollfn(fd);
+        sys_closesocket(fd);
+        netreceive_notify(x, fd);
+        return;
+    }
+    for (i = 0; i < x->x_nconnections; i++)
+        if (x->x_connections[i] == fd)
+            break;
+    if (i == x->x_nconnections)
+    {
+        bug("netreceive_sniff");
+        return;
+    }
+    sys_rmpollfn(fd);
+    if (c == NETTYPED_MAGIC)
+    {
+        t_nettyped *t = nettyped_new(&x->x_ns, 0);
+        x->x_typedconns[i] = t;
+        sys_addpollfn(fd, (t_fdpollfn)nettyped_read, t);
+        if (netsend_rawsend(&x->x_ns, fd, nettyped_hello, 2))
+            nettyped_close(t, fd);
+        else nettyped_read(t, fd);
+    }
+    else
+    {
+        t_socketreceiver *y = socketreceiver_new((void *)x,
+            (t_socketnotifier)netreceive_notify, netsend_read, 0);
+        if (x->x_ns.x_fromout)
+            socketreceiver_set_fromaddrfn(y,
+                (t_socketfromaddrfn)netreceive_fromaddr);
+        sys_addpollfn(fd, (t_fdpollfn)socketreceiver_read, y);
+        x->x_receivers[i] = y;
+        socketreceiver_read(y, fd);
+    }
+}
+
 static void netreceive_connectpoll(t_netreceive *x)
 {
     int fd = accept(x->x_ns.x_sockfd, 0, 0);
@@ -594,8 +2002,20 @@ static void netreceive_connectpoll(t_netreceive *x)
             x->x_nconnections * sizeof(t_socketreceiver*),
             nconnections * sizeof(t_socketreceiver*));
         x->x_receivers[x->x_nconnections] = NULL;
+        x->x_typedconns = (t_nettyped **)t_resizebytes(x->x_typedconns,
+            x->x_nconnections * sizeof(t_nettyped*),
+            nconnections * sizeof(t_nettyped*));
+        x->x_typedconns[x->x_nconnections] = NULL;
         if (x->x_ns.x_bin)
             sys_addpollfn(fd, (t_fdpollfn)netsend_readbin, x);
+        else if (x->x_ns.x_osc && x->x_ns.x_msgout)
+        {
+            t_nettyped *t = nettyped_new(&x->x_ns, 0);
+            x->x_typedconns[x->x_nconnections] = t;
+            sys_addpollfn(fd, (t_fdpollfn)nettyped_read, t);
+        }
+        else if (x->x_ns.x_msgout)
+            sys_addpollfn(fd, (t_fdpollfn)netreceive_sniff, x);
         else
         {
             t_socketreceiver *y = socketreceiver_new((void *)x,
@@ -623,11 +2043,15 @@ static void netreceive_closeall(t_netreceive *x)
             socketreceiver_free(x->x_receivers[i]);
             x->x_receivers[i] = NULL;
         }
+        if (x->x_typedconns[i])
+            nettyped_free(x->x_typedconns[i]);
     }
     x->x_connections = (int *)t_resizebytes(x->x_connections,
         x->x_nconnections * sizeof(int), 0);
     x->x_receivers = (t_socketreceiver**)t_resizebytes(x->x_receivers,
                 x->x_nconnections * sizeof(t_socketreceiver*), 0);
+    x->x_typedconns = (t_nettyped**)t_resizebytes(x->x_typedconns,
+                x->x_nconnections * sizeof(t_nettyped*), 0);
     x->x_nconnections = 0;
     if (x->x_ns.x_sockfd >= 0)
     {
@@ -635,27 +2059,69 @@ static void netreceive_closeall(t_netreceive *x)
         sys_closesocket(x->x_ns.x_sockfd);
     }
     x->x_ns.x_sockfd = -1;
+    if (x->x_unixpath)
+        socket_unlink_unix(x->x_unixpath->s_name);
+    x->x_unixpath = 0;
     if (x->x_ns.x_receiver)
         socketreceiver_free(x->x_ns.x_receiver);
     x->x_ns.x_receiver = NULL;
+    if (x->x_ns.x_typedconn)
+        nettyped_free(x->x_ns.x_typedconn);
+    x->x_ns.x_typedconn = NULL;
     if (x->x_ns.x_connectout)
         outlet_float(x->x_ns.x_connectout, x->x_nconnections);
 }
 
+static void netreceive_startlistening(t_netreceive *x, int sockfd);
+
+    /* "listen /some/path": a Unix-domain socket in the file system instead
+    of a port; see netsend_connectunix() */
+static void netreceive_listenunix(t_netreceive *x, t_symbol *path)
+{
+    int sockfd = socket_bind_unix(path->s_name, x->x_ns.x_protocol);
+    if (sockfd < 0)
+    {
+        int err = socket_errno();
+        char buf[MAXPDSTRING];
+        socket_strerror(err, buf, sizeof(buf));
+        pd_error(x, "netreceive: listen on %s failed: %s (%d)",
+            path->s_name, buf, err);
+        return;
+    }
+    logpost(NULL, PD_VERBOSE, "listening on %s", path->s_name);
+    x->x_unixpath = path;
+    netreceive_startlistening(x, sockfd);
+}
+
 static void netreceive_listen(t_netreceive *x, t_symbol *s, int argc, t_atom *argv)
 {
     int portno = 0, sockfd, status, protocol = x->x_ns.x_protocol, multicast = 0;
     struct addrinfo *ailist = NULL, *ai;
     const char *hostname = NULL; /* allowed or UDP multicast hostname */
+    char ifname[MAXPDSTRING];    /* interface to receive multicast on */
 
     netreceive_closeall(x);
 
+    *ifname = 0;
+    if (argc && argv->a_type == A_SYMBOL &&
+        sockaddr_is_unixpath(argv->a_w.w_symbol->s_name))
+    {
+        netreceive_listenunix(x, argv->a_w.w_symbol);
+        if (argc > 1)
+        {
+            pd_error(x, "netreceive: extra arguments ignored:");
+            postatom(argc-1, argv+1); endpost();
+        }
+        return;
+    }
     if (argc && argv->a_type == A_FLOAT)
         portno = argv->a_w.w_float, argc--, argv++;
     if (argc && argv->a_type == A_SYMBOL)
     {
         hostname = argv->a_w.w_symbol->s_name;
         argv++; argc--;
+        if (argc)
+            atom_string(argv, ifname, MAXPDSTRING), argc--, argv++;
     }
     if (argc)
     {
@@ -701,6 +2167,10 @@ static void netreceive_listen(t_netreceive *x, t_symbol *s, int argc, t_atom *ar
         if (socket_set_boolopt(sockfd, SOL_SOCKET, SO_REUSEADDR, 1) < 0)
             post("netreceive: setsockopt (SO_REUSEADDR) failed");
     #endif
+        /* let other sockets (in other Pds, say) bind the same port, and have
+           the kernel share out the incoming traffic */
+        if (x->x_reuseport && socket_set_reuseport(sockfd, 1) < 0)
+            post("netreceive: setsockopt (SO_REUSEPORT) failed");
     #if 0
         intarg = 0;
         if (socket_set_boolopt(sockfd, SOL_SOCKET, SO_RCVBUF, 0) < 0)
@@ -768,7 +2238,8 @@ static void netreceive_listen(t_netreceive *x, t_symbol *s, int argc, t_atom *ar
             }
         }
         /* join multicast group */
-        if (multicast && socket_join_multicast_group(sockfd, ai->ai_addr) < 0)
+        if (multicast && socket_set_multicast_membership(sockfd, ai->ai_addr,
+            ifname, 1) < 0)
         {
             int err = socket_errno();
             char buf[MAXPDSTRING];
@@ -777,6 +2248,9 @@ static void netreceive_listen(t_netreceive *x, t_symbol *s, int argc, t_atom *ar
                 "netreceive: joining multicast group %s failed: %s (%d)",
                 hostname, buf, err);
         }
+        else if (*ifname && !multicast)
+            pd_error(x, "netreceive: %s: not a multicast group; "
+                "interface ignored", hostname);
         /* this addr worked */
         if (hostname)
         {
@@ -802,12 +2276,27 @@ static void netreceive_listen(t_netreceive *x, t_symbol *s, int argc, t_atom *ar
             buf, err);
         return;
     }
+    netreceive_startlistening(x, sockfd);
+}
+
+    /* start reading datagrams from, or accepting connections on, a socket
+    that has just been bound */
+static void netreceive_startlistening(t_netreceive *x, int sockfd)
+{
+    int protocol = x->x_ns.x_protocol;
     x->x_ns.x_sockfd = sockfd;
 
     if (protocol == SOCK_DGRAM) /* datagram protocol */
     {
         if (x->x_ns.x_bin)
             sys_addpollfn(x->x_ns.x_sockfd, (t_fdpollfn)netsend_readbin, x);
+        else if ((x->x_ns.x_typed || x->x_ns.x_osc) && x->x_ns.x_msgout)
+        {
+            x->x_ns.x_typedconn = nettyped_new(&x->x_ns, 1);
+            sys_addpollfn(x->x_ns.x_sockfd, (t_fdpollfn)nettyped_readudp,
+                x->x_ns.x_typedconn);
+            x->x_ns.x_connectout = 0;
+        }
         else
         {
                 /* a UDP receiver doesn't get notifications! */
@@ -848,22 +2337,77 @@ static void netreceive_send(t_netreceive *x,
     }
     for (i = 0; i < x->x_nconnections; i++)
     {
-        if (netsend_dosend(&x->x_ns, x->x_connections[i], argc, argv))
+        if (netsend_dosend(&x->x_ns, x->x_connections[i],
+            x->x_typedconns[i], argc, argv))
             pd_error(x, "netreceive: send message failed");
                 /* should we now close the connection? */
     }
 }
 
+    /* join or leave another multicast group on the listening UDP socket,
+    optionally on a given interface */
+static void netreceive_membership(t_netreceive *x, t_symbol *s,
+    int argc, t_atom *argv)
+{
+    struct addrinfo *ailist = NULL, *ai;
+    t_symbol *group = atom_getsymbolarg(0, argc, argv);
+    char ifname[MAXPDSTRING];
+    int join = (s == gensym("join")), status, err = 0;
+    if (x->x_ns.x_protocol != SOCK_DGRAM || x->x_ns.x_sockfd < 0)
+    {
+        pd_error(x, "netreceive: '%s' needs a listening UDP socket",
+            s->s_name);
+        return;
+    }
+    *ifname = 0;
+    if (argc > 1)
+        atom_string(argv + 1, ifname, MAXPDSTRING);
+    if ((status = addrinfo_get_list(&ailist, group->s_name, 0, SOCK_DGRAM)))
+    {
+        pd_error(x, "netreceive: bad multicast group %s? %s (%d)",
+            group->s_name, gai_strerror(status), status);
+        return;
+    }
+    addrinfo_sort_list(&ailist, addrinfo_ipv4_first);
+    for (ai = ailist; ai; ai = ai->ai_next)
+    {
+        if (!sockaddr_is_multicast(ai->ai_addr))
+            continue;
+        if (socket_set_multicast_membership(x->x_ns.x_sockfd, ai->ai_addr,
+            ifname, join) >= 0)
+        {
+            logpost(x, PD_VERBOSE, "netreceive: %s %s",
+                (join ? "joined" : "left"), group->s_name);
+            freeaddrinfo(ailist);
+            return;
+        }
+        err = socket_errno();
+    }
+    freeaddrinfo(ailist);
+    if (err)
+    {
+        char buf[MAXPDSTRING];
+        socket_strerror(err, buf, sizeof(buf));
+        pd_error(x, "netreceive: %s %s failed: %s (%d)", s->s_name,
+            group->s_name, buf, err);
+    }
+    else pd_error(x, "netreceive: %s: not a multicast group", group->s_name);
+}
+
 static void *netreceive_new(t_symbol *s, int argc, t_atom *argv)
 {
     t_netreceive *x = (t_netreceive *)pd_new(netreceive_class);
     int from = 0;
     x->x_ns.x_protocol = SOCK_STREAM;
     x->x_old = 0;
-    x->x_ns.x_bin = 0;
+    x->x_ns.x_bin = x->x_ns.x_typed = x->x_ns.x_osc = 0;
+    x->x_ns.x_typedconn = NULL;
+    x->x_reuseport = 0;
+    x->x_unixpath = 0;
     x->x_nconnections = 0;
     x->x_connections = (int *)t_getbytes(0);
     x->x_receivers = (t_socketreceiver **)t_getbytes(0);
+    x->x_typedconns = (t_nettyped **)t_getbytes(0);
     x->x_ns.x_sockfd = -1;
     if (argc && argv->a_type == A_FLOAT)
     {
@@ -880,10 +2424,16 @@ static void *netreceive_new(t_symbol *s, int argc, t_atom *argv)
         {
             if (!strcmp(argv->a_w.w_symbol->s_name, "-b"))
                 x->x_ns.x_bin = 1;
+            else if (!strcmp(argv->a_w.w_symbol->s_name, "-t"))
+                x->x_ns.x_typed = 1;
+            else if (!strcmp(argv->a_w.w_symbol->s_name, "-o"))
+                x->x_ns.x_osc = 1;
             else if (!strcmp(argv->a_w.w_symbol->s_name, "-u"))
                 x->x_ns.x_protocol = SOCK_DGRAM;
             else if (!strcmp(argv->a_w.w_symbol->s_name, "-f"))
                 from = 1;
+            else if (!strcmp(argv->a_w.w_symbol->s_name, "-r"))
+                x->x_reuseport = 1;
             else
             {
                 pd_error(x, "netreceive: unknown flag ...");
@@ -892,6 +2442,11 @@ static void *netreceive_new(t_symbol *s, int argc, t_atom *argv)
             argc--; argv++;
         }
     }
+    if (x->x_ns.x_bin + x->x_ns.x_typed + x->x_ns.x_osc > 1)
+    {
+        pd_error(x, "netreceive: only one of '-b', '-t' and '-o' allowed");
+        x->x_ns.x_typed = x->x_ns.x_osc = 0;
+    }
     if (x->x_old)
     {
         /* old style, nonsecure version */
@@ -906,6 +2461,7 @@ static void *netreceive_new(t_symbol *s, int argc, t_atom *argv)
         x->x_ns.x_fromout = outlet_new(&x->x_ns.x_obj, &s_symbol);
     else
         x->x_ns.x_fromout = NULL;
+    sys_inputsource(x, (x->x_ns.x_msgout ? netsend_read : 0), 1);
         /* create a socket */
     netreceive_listen(x, 0, argc, argv); /* pass arguments */
 
@@ -914,7 +2470,9 @@ static void *netreceive_new(t_symbol *s, int argc, t_atom *argv)
 
 static void netreceive_free(t_netreceive *x)
 {
+    sys_inputsource(x, 0, 0);
     netreceive_closeall(x);
+    netosc_cancel(&x->x_ns);
 }
 
 static void netreceive_setup(void)
@@ -926,6 +2484,10 @@ static void netreceive_setup(void)
         gensym("listen"), A_GIMME, 0);
     class_addmethod(netreceive_class, (t_method)netreceive_send,
         gensym("send"), A_GIMME, 0);
+    class_addmethod(netreceive_class, (t_method)netreceive_membership,
+        gensym("join"), A_GIMME, 0);
+    class_addmethod(netreceive_class, (t_method)netreceive_membership,
+        gensym("leave"), A_GIMME, 0);
     class_addlist(netreceive_class, (t_method)netreceive_send);
 }
 
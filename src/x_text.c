@@ -6,6 +6,7 @@
 moment it also defines "text" but it may later be better to split this off. */
 
 #include "m_pd.h"
+#include "m_imp.h"
 #include "g_canvas.h"    /* just for glist_getfont, bother */
 #include <string.h>
 #include <stdio.h>
@@ -54,6 +55,7 @@ typedef struct _textbuf
     t_canvas *b_canvas;
     t_guiconnect *b_guiconnect;
     t_symbol *b_sym;
+    t_clock *b_packclock;       /* set if "compact" is on */
 } t_textbuf;
 
 static void textbuf_init(t_textbuf *x, t_symbol *sym)
@@ -61,6 +63,38 @@ static void textbuf_init(t_textbuf *x, t_symbol *sym)
     x->b_binbuf = binbuf_new();
     x->b_canvas = canvas_getcurrent();
     x->b_sym = sym;
+    x->b_packclock = 0;
+}
+
+    /* with "compact 1" a big text that nobody has read or changed for
+    a while is packed into about a third of the memory (see binbuf_pack()
+    in m_binbuf.c); the next access expands it again, at some cost, so
+    this is for large databases that sit unused between bursts of use. */
+#define TEXT_PACKMIN 4096       /* atoms - don't bother with smaller ones */
+#define TEXT_PACKPERIOD 5000    /* msec - pack after 1-2 of these unused */
+
+static void textbuf_packtick(t_textbuf *x)
+{
+    t_memowner owner;   /* charge the packed form to us, not to nobody */
+    mem_pushowner(&owner, x->b_canvas, pd_class(&x->b_ob.ob_pd));
+    binbuf_pack(x->b_binbuf, TEXT_PACKMIN);
+    mem_popowner(&owner);
+    clock_delay(x->b_packclock, TEXT_PACKPERIOD);
+}
+
+static void textbuf_compact(t_textbuf *x, t_floatarg f)
+{
+    if (f != 0 && !x->b_packclock)
+    {
+        x->b_packclock = clock_new(x, (t_method)textbuf_packtick);
+        clock_delay(x->b_packclock, TEXT_PACKPERIOD);
+    }
+    else if (f == 0 && x->b_packclock)
+    {
+        clock_free(x->b_packclock);
+        x->b_packclock = 0;
+        binbuf_getvec(x->b_binbuf);     /* expand it if it's packed */
+    }
 }
 
 static void textbuf_senditup(t_textbuf *x)
@@ -199,6 +233,8 @@ static void textbuf_write(t_textbuf *x, t_symbol *s, int argc, t_atom *argv)
 static void textbuf_free(t_textbuf *x)
 {
     t_pd *x2;
+    if (x->b_packclock)
+        clock_free(x->b_packclock);
     if (x->b_binbuf)
         binbuf_free(x->b_binbuf);
     if (x->b_guiconnect)
@@ -211,27 +247,11 @@ static void textbuf_free(t_textbuf *x)
         pd_unbind(x2, gensym("#A"));
 }
 
-    /* random helper function to find the nth line in a text buffer */
-static int text_nthline(int n, t_atom *vec, int line, int *startp, int *endp)
-{
-    int i, cnt = 0;
-    for (i = 0; i < n; i++)
-    {
-        if (cnt == line)
-        {
-            int j = i;
-            while (j < n && vec[j].a_type != A_SEMI &&
-                vec[j].a_type != A_COMMA)
-                    j++;
-            *startp = i;
-            *endp = j;
-            return (1);
-        }
-        else if (vec[i].a_type == A_SEMI || vec[i].a_type == A_COMMA)
-            cnt++;
-    }
-    return (0);
-}
+    /* find the nth line in a text buffer (m_binbuf.c keeps an index) */
+int binbuf_nthline(t_binbuf *x, int n, int *startp, int *endp);
+void binbuf_invalidatelines(t_binbuf *x);
+void binbuf_modified(t_binbuf *x);
+int binbuf_getserial(const t_binbuf *x);
 
 /* text_define object - text buffer, accessible by other accessor objects */
 
@@ -255,6 +275,7 @@ static void *text_define_new(t_symbol *s, int argc, t_atom *argv)
 {
     t_text_define *x = (t_text_define *)pd_new(text_define_class);
     t_symbol *asym = gensym("#A");
+    int compact = 0;
     x->x_keep = 0;
     x->x_bindsym = &s_;
     while (argc && argv->a_type == A_SYMBOL &&
@@ -262,6 +283,8 @@ static void *text_define_new(t_symbol *s, int argc, t_atom *argv)
     {
         if (!strcmp(argv->a_w.w_symbol->s_name, "-k"))
             x->x_keep = 1;
+        else if (!strcmp(argv->a_w.w_symbol->s_name, "-c"))
+            compact = 1;
         else
         {
             pd_error(x, "text define: unknown flag ...");
@@ -282,6 +305,7 @@ static void *text_define_new(t_symbol *s, int argc, t_atom *argv)
     }
     textbuf_init(&x->x_textbuf, *x->x_bindsym->s_name ? x->x_bindsym :
         gensym("text"));
+    textbuf_compact(&x->x_textbuf, compact);
         /* set up a scalar and a pointer to it that we can output */
     x->x_scalar = scalar_new(canvas_getcurrent(), gensym("pd-text"));
     binbuf_free(x->x_scalar->sc_vec[2].w_binbuf);
@@ -819,7 +843,7 @@ static void text_get_float(t_text_get *x, t_floatarg f)
     n = binbuf_getnatom(b);
     startfield = x->x_f1;
     nfield = x->x_f2;
-    if (text_nthline(n, vec, f, &start, &end))
+    if (binbuf_nthline(b, f, &start, &end))
     {
         int outc = end - start, k;
         t_atom *outv;
@@ -922,7 +946,7 @@ static void text_set_list(t_text_set *x,
         pd_error(x, "text set: line number (%d) < 0", lineno);
         return;
     }
-    if (text_nthline(n, vec, lineno, &start, &end))
+    if (binbuf_nthline(b, lineno, &start, &end))
     {
         if (fieldno < 0)
         {
@@ -975,8 +999,15 @@ static void text_set_list(t_text_set *x,
     {
         if (argv[i].a_type == A_POINTER)
             SETSYMBOL(&vec[start+i], gensym("(pointer)"));
-        else vec[start+i] = argv[i];
+        else
+        {
+            vec[start+i] = argv[i];
+                /* writing a separator in place changes the line structure */
+            if (argv[i].a_type == A_SEMI || argv[i].a_type == A_COMMA)
+                binbuf_invalidatelines(b);
+        }
     }
+    binbuf_modified(b);
     text_client_senditup(&x->x_tc);
 }
 
@@ -1033,7 +1064,7 @@ static void text_insert_list(t_text_insert *x,
         return;
     }
     nwas = binbuf_getnatom(b);
-    if (!text_nthline(nwas, binbuf_getvec(b), lineno, &start, &end))
+    if (!binbuf_nthline(b, lineno, &start, &end))
         start = nwas;
     (void)binbuf_resize(b, (n = nwas + argc + 1));
     vec = binbuf_getvec(b);
@@ -1084,7 +1115,7 @@ static void text_delete_float(t_text_delete *x, t_floatarg f)
     n = binbuf_getnatom(b);
     if (lineno < 0)
         binbuf_clear(b);
-    else if (text_nthline(n, vec, lineno, &start, &end))
+    else if (binbuf_nthline(b, lineno, &start, &end))
     {
         if (end < n)
             end++;
@@ -1152,7 +1183,7 @@ static void text_size_float(t_text_size *x, t_floatarg f)
        return;
     vec = binbuf_getvec(b);
     n = binbuf_getnatom(b);
-    if (text_nthline(n, vec, f, &start, &end))
+    if (binbuf_nthline(b, f, &start, &end))
         outlet_float(x->x_out1, end-start);
     else outlet_float(x->x_out1, -1);
 }
@@ -1238,6 +1269,19 @@ typedef struct _key
     int k_binop;
 } t_key;
 
+    /* entry in the index of lines by the first key's value */
+typedef struct _searchentry
+{
+    union
+    {
+        t_float se_f;
+        t_symbol *se_s;
+    } se_w;
+    int se_line;
+    int se_start;
+    int se_n;
+} t_searchentry;
+
 typedef struct _text_search
 {
     t_text_client x_tc;
@@ -1246,6 +1290,14 @@ typedef struct _text_search
     int x_onset;        /* first line to include in search */
     int x_range;        /* max number of lines to search */
     t_key *x_keyvec;
+    t_binbuf *x_indexbuf;   /* binbuf we last searched */
+    int x_serial;           /* its serial number at the time */
+    int x_indexed;          /* true if the index below is for it */
+    int x_nfloat;           /* lines whose first key is a float */
+    t_searchentry *x_floatvec;
+    int x_nsym;             /* lines whose first key is a symbol */
+    t_searchentry *x_symvec;
+    t_searchentry *x_candvec;   /* scratch space, x_nfloat + x_nsym + 1 */
 } t_text_search;
 
 static void *text_search_new(t_symbol *s, int argc, t_atom *argv)
@@ -1262,6 +1314,8 @@ static void *text_search_new(t_symbol *s, int argc, t_atom *argv)
     x->x_nkeys = nkey;
     x->x_onset = 0;
     x->x_range = 0x7fffffff;
+    x->x_indexbuf = 0;
+    x->x_indexed = x->x_nfloat = x->x_nsym = 0;
     x->x_keyvec = (t_key *)getbytes(nkey * sizeof(*x->x_keyvec));
     if (!argc)
         x->x_keyvec[0].k_field = 0, x->x_keyvec[0].k_binop = KB_EQ;
@@ -1301,11 +1355,370 @@ static void *text_search_new(t_symbol *s, int argc, t_atom *argv)
     return (x);
 }
 
+    /* does the line starting at "start", "n" atoms long, match the keys? */
+static int text_search_match(t_text_search *x, t_atom *vec, int start, int n,
+    int argc, t_atom *argv, int *failed)
+{
+    int j, field = x->x_keyvec[0].k_field, binop = x->x_keyvec[0].k_binop;
+    for (j = 0; j < argc; )
+    {
+        if (field >= n || vec[start+field].a_type != argv[j].a_type)
+            return (0);
+        if (argv[j].a_type == A_FLOAT)      /* arg is a float */
+        {
+            switch (binop)
+            {
+                case KB_EQ:
+                    if (vec[start+field].a_w.w_float !=
+                        argv[j].a_w.w_float)
+                            return (0);
+                break;
+                case KB_GT:
+                    if (vec[start+field].a_w.w_float <=
+                        argv[j].a_w.w_float)
+                            return (0);
+                break;
+                case KB_GE:
+                    if (vec[start+field].a_w.w_float <
+                        argv[j].a_w.w_float)
+                            return (0);
+                break;
+                case KB_LT:
+                    if (vec[start+field].a_w.w_float >=
+                        argv[j].a_w.w_float)
+                            return (0);
+                break;
+                case KB_LE:
+                    if (vec[start+field].a_w.w_float >
+                        argv[j].a_w.w_float)
+                            return (0);
+                break;
+                    /* the other possibility ('near') never fails */
+            }
+        }
+        else                                /* arg is a symbol */
+        {
+            if (binop != KB_EQ)
+            {
+                if (!*failed)
+                {
+                    pd_error(x,
+            "text search (%s): only exact matches allowed for symbols",
+                        argv[j].a_w.w_symbol->s_name);
+                    *failed = 1;
+                }
+                return (0);
+            }
+            if (vec[start+field].a_w.w_symbol != argv[j].a_w.w_symbol)
+                return (0);
+        }
+        if (++j >= x->x_nkeys)    /* if at last key just increment field */
+            field++;
+        else field = x->x_keyvec[j].k_field,    /* else next key */
+                binop = x->x_keyvec[j].k_binop;
+    }
+    return (1);
+}
+
+    /* given two matching lines, is the one at "start" better than the one
+    at "beststart"?  Ties go to the old one. */
+static int text_search_better(t_text_search *x, t_atom *vec, int start,
+    int n, int beststart, int argc, t_atom *argv)
+{
+    int j, field = x->x_keyvec[0].k_field, binop = x->x_keyvec[0].k_binop;
+    for (j = 0; j < argc; )
+    {
+        if (field >= n || vec[start+field].a_type != argv[j].a_type)
+            bug("text search 2");
+        if (argv[j].a_type == A_FLOAT)      /* arg is a float */
+        {
+            float thisv = vec[start+field].a_w.w_float,
+                bestv = (beststart >= 0 ?
+                    vec[beststart+field].a_w.w_float : -1e20);
+            switch (binop)
+            {
+                case KB_GT:
+                case KB_GE:
+                    if (thisv < bestv)
+                        return (1);
+                    else if (thisv > bestv)
+                        return (0);
+                break;
+                case KB_LT:
+                case KB_LE:
+                    if (thisv > bestv)
+                        return (1);
+                    else if (thisv < bestv)
+                        return (0);
+                break;
+                case KB_NEAR:
+                    if (thisv >= argv[j].a_w.w_float &&
+                        bestv >= argv[j].a_w.w_float)
+                    {
+                        if (thisv < bestv)
+                            return (1);
+                        else if (thisv > bestv)
+                            return (0);
+                    }
+                    else if (thisv <= argv[j].a_w.w_float &&
+                        bestv <= argv[j].a_w.w_float)
+                    {
+                        if (thisv > bestv)
+                            return (1);
+                        else if (thisv < bestv)
+                            return (0);
+                    }
+                    else
+                    {
+                        float d1 = thisv - argv[j].a_w.w_float,
+                            d2 = bestv - argv[j].a_w.w_float;
+                        if (d1 < 0)
+                            d1 = -d1;
+                        if (d2 < 0)
+                            d2 = -d2;
+
+                        if (d1 < d2)
+                            return (1);
+                        else if (d1 > d2)
+                            return (0);
+                    }
+                break;
+                    /* the other possibility ('=') never decides */
+            }
+        }
+        if (++j >= x->x_nkeys)    /* last key - increment field */
+            field++;
+        else field = x->x_keyvec[j].k_field,    /* else next key */
+                binop = x->x_keyvec[j].k_binop;
+    }
+    return (0);     /* a tie - keep the old one */
+}
+
+    /* Index of the lines by the value of the first key's field, so that
+    a search on a large text needn't look at every line.  It's made the
+    second time the text is searched without having changed in between,
+    so that texts that change as often as they're searched don't pay for
+    sorting.  Lines are sorted by value and then by line number. */
+
+static int searchentry_fcmp(const void *p1, const void *p2)
+{
+    const t_searchentry *e1 = (const t_searchentry *)p1,
+        *e2 = (const t_searchentry *)p2;
+    if (e1->se_w.se_f < e2->se_w.se_f)
+        return (-1);
+    else if (e1->se_w.se_f > e2->se_w.se_f)
+        return (1);
+    else return (e1->se_line - e2->se_line);
+}
+
+static int searchentry_scmp(const void *p1, const void *p2)
+{
+    const t_searchentry *e1 = (const t_searchentry *)p1,
+        *e2 = (const t_searchentry *)p2;
+    if (e1->se_w.se_s < e2->se_w.se_s)
+        return (-1);
+    else if (e1->se_w.se_s > e2->se_w.se_s)
+        return (1);
+    else return (e1->se_line - e2->se_line);
+}
+
+static int searchentry_linecmp(const void *p1, const void *p2)
+{
+    return (((const t_searchentry *)p1)->se_line -
+        ((const t_searchentry *)p2)->se_line);
+}
+
+static void text_search_freeindex(t_text_search *x)
+{
+    if (x->x_indexed)
+        freebytes(x->x_candvec,
+            (x->x_nfloat + x->x_nsym + 1) * sizeof(*x->x_candvec));
+    if (x->x_nfloat)
+        freebytes(x->x_floatvec, x->x_nfloat * sizeof(*x->x_floatvec));
+    if (x->x_nsym)
+        freebytes(x->x_symvec, x->x_nsym * sizeof(*x->x_symvec));
+    x->x_nfloat = x->x_nsym = 0;
+    x->x_indexed = 0;
+}
+
+static void text_search_makeindex(t_text_search *x, t_binbuf *b)
+{
+    t_atom *vec = binbuf_getvec(b);
+    int n = binbuf_getnatom(b), i, lineno, thisstart, nfloat = 0, nsym = 0,
+        field = x->x_keyvec[0].k_field, pass;
+    text_search_freeindex(x);
+        /* enumerate lines the same way text_search_list() does; first
+        count them, then fill in the entries */
+    for (pass = 0; pass < 2; pass++)
+    {
+        nfloat = nsym = 0;
+        for (i = lineno = thisstart = 0; i < n; i++)
+        {
+            if (vec[i].a_type == A_SEMI || vec[i].a_type == A_COMMA ||
+                i == n-1)
+            {
+                int thisn = i - thisstart;
+                t_searchentry *e = 0;
+                if (field < thisn && vec[thisstart+field].a_type == A_FLOAT)
+                {
+                    if (pass)
+                        (e = &x->x_floatvec[nfloat])->se_w.se_f =
+                            vec[thisstart+field].a_w.w_float;
+                    nfloat++;
+                }
+                else if (field < thisn &&
+                    vec[thisstart+field].a_type == A_SYMBOL)
+                {
+                    if (pass)
+                        (e = &x->x_symvec[nsym])->se_w.se_s =
+                            vec[thisstart+field].a_w.w_symbol;
+                    nsym++;
+                }
+                if (e)
+                    e->se_line = lineno, e->se_start = thisstart,
+                        e->se_n = thisn;
+                lineno++;
+                thisstart = i+1;
+            }
+        }
+        if (!pass)
+        {
+            if (nfloat)
+                x->x_floatvec = (t_searchentry *)getbytes(
+                    nfloat * sizeof(*x->x_floatvec));
+            if (nsym)
+                x->x_symvec = (t_searchentry *)getbytes(
+                    nsym * sizeof(*x->x_symvec));
+        }
+    }
+    x->x_nfloat = nfloat;
+    x->x_nsym = nsym;
+    x->x_candvec = (t_searchentry *)getbytes(
+        (nfloat + nsym + 1) * sizeof(*x->x_candvec));
+    qsort(x->x_floatvec, nfloat, sizeof(*x->x_floatvec), searchentry_fcmp);
+    qsort(x->x_symvec, nsym, sizeof(*x->x_symvec), searchentry_scmp);
+    x->x_indexed = 1;
+}
+
+    /* binary search: first entry for which the value, rounded to single
+    precision as text_search_better() does if "round" is set, is at least
+    (or, if "strict", more than) f */
+static int searchentry_lowerbound(t_searchentry *vec, int n, t_float f,
+    int strict, int round)
+{
+    int lo = 0, hi = n;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) >> 1;
+        t_float v = (round ? (float)vec[mid].se_w.se_f : vec[mid].se_w.se_f);
+        if (strict ? (v <= f) : (v < f))
+            lo = mid + 1;
+        else hi = mid;
+    }
+    return (lo);
+}
+
+    /* collect the matching lines from a run of index entries into the
+    candidate list */
+static int text_search_addmatches(t_text_search *x, t_atom *vec,
+    t_searchentry *from, int nfrom, t_searchentry *to, int nto,
+    int argc, t_atom *argv, int *failed)
+{
+    int i;
+    for (i = 0; i < nfrom; i++)
+        if (from[i].se_line >= x->x_onset &&
+            from[i].se_line - x->x_onset < x->x_range &&
+            text_search_match(x, vec, from[i].se_start, from[i].se_n,
+                argc, argv, failed))
+                    to[nto++] = from[i];
+    return (nto);
+}
+
+    /* the end of the run of entries starting at "i" (going up if "dir" is
+    1, down if -1) that have the same value in single precision */
+static int searchentry_run(t_searchentry *vec, int n, int i, int dir)
+{
+    float f = vec[i].se_w.se_f;
+    while (i >= 0 && i < n && (float)vec[i].se_w.se_f == f)
+        i += dir;
+    return (i);
+}
+
+    /* Use the index to find the lines that could possibly be the best
+    match, and put them in x_candvec.  Since the first key dominates the
+    comparison, the best line is among the matching ones whose first key's
+    value is closest to the goal: the run of equal values for "=", the
+    closest run above or below for ">" or "<", and the closest runs on both
+    sides for "near".  Runs are of values equal in single precision since
+    that's what text_search_better() compares.  Returns the number of
+    candidates. */
+static int text_search_candidates(t_text_search *x, t_atom *vec,
+    int argc, t_atom *argv, int *failed)
+{
+    int binop = x->x_keyvec[0].k_binop, ncand = 0, nwas, i, j, lo, hi,
+        nf = x->x_nfloat;
+    t_searchentry *fvec = x->x_floatvec, *cand = x->x_candvec;
+    t_float f = argv[0].a_w.w_float;
+
+    if (argv[0].a_type == A_SYMBOL)
+    {
+        t_symbol *sym = argv[0].a_w.w_symbol;
+        for (lo = 0, hi = x->x_nsym; lo < hi; )
+        {
+            int mid = (lo + hi) >> 1;
+            if (x->x_symvec[mid].se_w.se_s < sym)
+                lo = mid + 1;
+            else hi = mid;
+        }
+        for (hi = lo; hi < x->x_nsym && x->x_symvec[hi].se_w.se_s == sym;
+            hi++)
+                ;
+        return (text_search_addmatches(x, vec, x->x_symvec + lo, hi - lo,
+            cand, 0, argc, argv, failed));
+    }
+    if (binop == KB_EQ)
+    {
+        lo = searchentry_lowerbound(fvec, nf, f, 0, 0);
+        hi = searchentry_lowerbound(fvec, nf, f, 1, 0);
+        return (text_search_addmatches(x, vec, fvec + lo, hi - lo,
+            cand, 0, argc, argv, failed));
+    }
+    if (binop == KB_GT || binop == KB_GE || binop == KB_NEAR)
+    {
+            /* walk upward through runs until one of them matches */
+        i = (binop == KB_NEAR ? searchentry_lowerbound(fvec, nf, f, 0, 1) :
+            searchentry_lowerbound(fvec, nf, f, (binop == KB_GT), 0));
+        while (i < nf && !ncand)
+        {
+            j = searchentry_run(fvec, nf, i, 1);
+            ncand = text_search_addmatches(x, vec, fvec + i, j - i,
+                cand, ncand, argc, argv, failed);
+            i = j;
+        }
+    }
+    if (binop == KB_LT || binop == KB_LE || binop == KB_NEAR)
+    {
+            /* walk downward; for "near", values equal to the goal were
+            already seen above so start below them */
+        i = (binop == KB_NEAR ? searchentry_lowerbound(fvec, nf, f, 0, 1) :
+            searchentry_lowerbound(fvec, nf, f, (binop == KB_LE), 0)) - 1;
+        nwas = ncand;
+        while (i >= 0 && ncand == nwas)
+        {
+            j = searchentry_run(fvec, nf, i, -1);
+            ncand = text_search_addmatches(x, vec, fvec + j + 1, i - j,
+                cand, ncand, argc, argv, failed);
+            i = j;
+        }
+    }
+    return (ncand);
+}
+
 static void text_search_list(t_text_search *x,
     t_symbol *s, int argc, t_atom *argv)
 {
     t_binbuf *b = text_client_getbuf(&x->x_tc);
-    int i, n, lineno, bestline = -1, beststart=-1, bestn, thisstart,
+    int i, n, lineno, bestline = -1, beststart=-1, thisstart,
         nkeys = x->x_nkeys, failed = 0;
     t_atom *vec;
     if (!b)
@@ -1319,156 +1732,59 @@ static void text_search_list(t_text_search *x,
     n = binbuf_getnatom(b);
     if (nkeys < 1)
         bug("text_search");
+
+        /* decide whether to use (and perhaps make) the index.  Symbols with
+        anything but an exact match are left to the full search, which
+        reports the error. */
+    if (b != x->x_indexbuf || binbuf_getserial(b) != x->x_serial)
+    {
+        text_search_freeindex(x);
+        x->x_indexbuf = b;
+        x->x_serial = binbuf_getserial(b);
+    }
+    else if (!x->x_indexed)
+        text_search_makeindex(x, b);
+    if (x->x_indexed && argc > 0 &&
+        (argv[0].a_type == A_FLOAT || argv[0].a_type == A_SYMBOL))
+    {
+        int ncand, binop = x->x_keyvec[0].k_binop;
+        t_searchentry *cand = x->x_candvec;
+        for (i = 0; i < argc; i++)
+        {
+            if (i < nkeys)
+                binop = x->x_keyvec[i].k_binop;
+            if (argv[i].a_type == A_SYMBOL && binop != KB_EQ)
+                goto fullsearch;
+        }
+        ncand = text_search_candidates(x, vec, argc, argv, &failed);
+        qsort(cand, ncand, sizeof(*cand), searchentry_linecmp);
+        for (i = 0; i < ncand; i++)
+            if (bestline < 0 || text_search_better(x, vec, cand[i].se_start,
+                cand[i].se_n, beststart, argc, argv))
+                    bestline = cand[i].se_line, beststart = cand[i].se_start;
+        outlet_float(x->x_out1, bestline);
+        return;
+    }
+fullsearch:
     for (i = lineno = thisstart = 0; i < n; i++)
     {
         if (vec[i].a_type == A_SEMI || vec[i].a_type == A_COMMA || i == n-1)
         {
-            int thisn, j, field, binop;
+            int thisn = i - thisstart;
             if (lineno < x->x_onset)
                 goto nomatch;
             if (lineno >= x->x_onset + x->x_range)
                 break;
-            thisn = i - thisstart;
-            field = x->x_keyvec[0].k_field;
-            binop = x->x_keyvec[0].k_binop;
                 /* do we match? */
-            for (j = 0; j < argc; )
-            {
-                if (field >= thisn ||
-                    vec[thisstart+field].a_type != argv[j].a_type)
-                        goto nomatch;
-                if (argv[j].a_type == A_FLOAT)      /* arg is a float */
-                {
-                    switch (binop)
-                    {
-                        case KB_EQ:
-                            if (vec[thisstart+field].a_w.w_float !=
-                                argv[j].a_w.w_float)
-                                    goto nomatch;
-                        break;
-                        case KB_GT:
-                            if (vec[thisstart+field].a_w.w_float <=
-                                argv[j].a_w.w_float)
-                                    goto nomatch;
-                        break;
-                        case KB_GE:
-                            if (vec[thisstart+field].a_w.w_float <
-                                argv[j].a_w.w_float)
-                                    goto nomatch;
-                        break;
-                        case KB_LT:
-                            if (vec[thisstart+field].a_w.w_float >=
-                                argv[j].a_w.w_float)
-                                    goto nomatch;
-                        break;
-                        case KB_LE:
-                            if (vec[thisstart+field].a_w.w_float >
-                                argv[j].a_w.w_float)
-                                    goto nomatch;
-                        break;
-                            /* the other possibility ('near') never fails */
-                    }
-                }
-                else                                /* arg is a symbol */
-                {
-                    if (binop != KB_EQ)
-                    {
-                        if (!failed)
-                        {
-                            pd_error(x,
-                    "text search (%s): only exact matches allowed for symbols",
-                                argv[j].a_w.w_symbol->s_name);
-                            failed = 1;
-                        }
-                        goto nomatch;
-                    }
-                    if (vec[thisstart+field].a_w.w_symbol !=
-                        argv[j].a_w.w_symbol)
-                            goto nomatch;
-                }
-                if (++j >= nkeys)    /* if at last key just increment field */
-                    field++;
-                else field = x->x_keyvec[j].k_field,    /* else next key */
-                        binop = x->x_keyvec[j].k_binop;
-            }
+            if (!text_search_match(x, vec, thisstart, thisn,
+                argc, argv, &failed))
+                    goto nomatch;
                 /* the line matches.  Now, if there is a previous match, are
-                we better than it? */
-            if (bestline >= 0)
-            {
-                field = x->x_keyvec[0].k_field;
-                binop = x->x_keyvec[0].k_binop;
-                for (j = 0; j < argc; )
-                {
-                    if (field >= thisn
-                        || vec[thisstart+field].a_type != argv[j].a_type)
-                            bug("text search 2");
-                    if (argv[j].a_type == A_FLOAT)      /* arg is a float */
-                    {
-                        float thisv = vec[thisstart+field].a_w.w_float,
-                            bestv = (beststart >= 0 ?
-                                vec[beststart+field].a_w.w_float : -1e20);
-                        switch (binop)
-                        {
-                            case KB_GT:
-                            case KB_GE:
-                                if (thisv < bestv)
-                                    goto replace;
-                                else if (thisv > bestv)
-                                    goto nomatch;
-                            break;
-                            case KB_LT:
-                            case KB_LE:
-                                if (thisv > bestv)
-                                    goto replace;
-                                else if (thisv < bestv)
-                                    goto nomatch;
-                            break;
-                            case KB_NEAR:
-                                if (thisv >= argv[j].a_w.w_float &&
-                                    bestv >= argv[j].a_w.w_float)
-                                {
-                                    if (thisv < bestv)
-                                        goto replace;
-                                    else if (thisv > bestv)
-                                        goto nomatch;
-                                }
-                                else if (thisv <= argv[j].a_w.w_float &&
-                                    bestv <= argv[j].a_w.w_float)
-                                {
-                                    if (thisv > bestv)
-                                        goto replace;
-                                    else if (thisv < bestv)
-                                        goto nomatch;
-                                }
-                                else
-                                {
-                                    float d1 = thisv - argv[j].a_w.w_float,
-                                        d2 = bestv - argv[j].a_w.w_float;
-                                    if (d1 < 0)
-                                        d1 = -d1;
-                                    if (d2 < 0)
-                                        d2 = -d2;
-
-                                    if (d1 < d2)
-                                        goto replace;
-                                    else if (d1 > d2)
-                                        goto nomatch;
-                                }
-                            break;
-                                /* the other possibility ('=') never decides */
-                        }
-                    }
-                    if (++j >= nkeys)    /* last key - increment field */
-                        field++;
-                    else field = x->x_keyvec[j].k_field,    /* else next key */
-                            binop = x->x_keyvec[j].k_binop;
-                }
-                goto nomatch;   /* a tie - keep the old one */
-            replace:
-                bestline = lineno, beststart = thisstart, bestn = thisn;
-            }
-                /* no previous match so we're best */
-            else bestline = lineno, beststart = thisstart, bestn = thisn;
+                we better than it?  If there's no previous match we're
+                best. */
+            if (bestline < 0 || text_search_better(x, vec, thisstart, thisn,
+                beststart, argc, argv))
+                    bestline = lineno, beststart = thisstart;
         nomatch:
             lineno++;
             thisstart = i+1;
@@ -1484,9 +1800,27 @@ static void text_search_range(t_text_search *x, t_floatarg onset,
     x->x_range = (range >= 0x7fffffff ? 0x7ffffff : (range < 0 ? 0 : range));
 }
 
+static void text_search_free(t_text_search *x)
+{
+    text_search_freeindex(x);
+    freebytes(x->x_keyvec, x->x_nkeys * sizeof(*x->x_keyvec));
+    text_client_free(&x->x_tc);
+}
+
 /* ---------------- text_sequence object - sequencer ----------- */
 t_class *text_sequence_class;
 
+    /* a timeline of the waits in the sequence, made when first asked to
+    seek and remade if the text changes.  For each wait we keep the time
+    at which the lines following it come out and the state the sequencer
+    would be in just after it. */
+typedef struct _seqwait
+{
+    double sw_time;         /* time at the end of the wait */
+    int sw_onset;           /* onset of the next line to output */
+    int sw_eaten;           /* value of x_eaten after the wait */
+} t_seqwait;
+
 typedef struct _text_sequence
 {
     t_text_client x_tc;
@@ -1504,6 +1838,11 @@ typedef struct _text_sequence
     unsigned char x_eaten;  /* true if we've eaten leading numbers already */
     unsigned char x_loop;   /* true if we can send multiple lines */
     unsigned char x_auto;   /* set timer when we hit single-number time list */
+    t_binbuf *x_indexbuf;   /* binbuf the timeline below was made from */
+    int x_serial;           /* its serial number at the time */
+    int x_indexed;          /* true if x_waitvec is valid for it */
+    int x_nwait;            /* number of waits in x_waitvec */
+    t_seqwait *x_waitvec;   /* the waits in order, for seeking */
 } t_text_sequence;
 
 static void text_sequence_tick(t_text_sequence *x);
@@ -1522,6 +1861,8 @@ static void *text_sequence_new(t_symbol *s, int argc, t_atom *argv)
     x->x_eaten = 0;
     x->x_loop = 0;
     x->x_lastto = 0;
+    x->x_indexbuf = 0;
+    x->x_indexed = x->x_nwait = 0;
     x->x_clock = clock_new(x, (t_method)text_sequence_tick);
     while (argc && argv->a_type == A_SYMBOL &&
         *argv->a_w.w_symbol->s_name == '-')
@@ -1794,7 +2135,7 @@ static void text_sequence_line(t_text_sequence *x, t_floatarg f)
     x->x_lastto = 0;
     vec = binbuf_getvec(b);
     n = binbuf_getnatom(b);
-    if (!text_nthline(n, vec, f, &start, &end))
+    if (!binbuf_nthline(b, f, &start, &end))
     {
         pd_error(x, "text sequence: line number %d out of range", (int)f);
         x->x_onset = 0x7fffffff;
@@ -1803,6 +2144,135 @@ static void text_sequence_line(t_text_sequence *x, t_floatarg f)
     x->x_eaten = 0;
 }
 
+static void text_sequence_freeindex(t_text_sequence *x)
+{
+    if (x->x_nwait)
+        freebytes(x->x_waitvec, x->x_nwait * sizeof(*x->x_waitvec));
+    x->x_nwait = 0;
+    x->x_indexed = 0;
+}
+
+    /* walk the text the same way text_sequence_doit() does, without
+    output, noting each wait.  As in "auto" mode, only waits consisting of
+    a single number take time.  The first pass counts the waits and the
+    second fills them in. */
+static void text_sequence_makeindex(t_text_sequence *x, t_binbuf *b)
+{
+    t_atom *vec = binbuf_getvec(b);
+    int n = binbuf_getnatom(b), pass;
+    text_sequence_freeindex(x);
+    for (pass = 0; pass < 2; pass++)
+    {
+        int onset = 0, i, nwait = 0, eaten = 0, lastto = 0;
+        double time = 0;
+        while (onset < n)
+        {
+            if (!lastto && (
+                (vec[onset].a_type == A_FLOAT && x->x_waitargc && !eaten) ||
+                    (vec[onset].a_type == A_SYMBOL &&
+                        vec[onset].a_w.w_symbol == x->x_waitsym)))
+            {
+                int eatsemi = 1;
+                if (vec[onset].a_type == A_FLOAT)
+                {
+                    for (i = onset; i < n && i < onset + x->x_waitargc &&
+                        vec[i].a_type == A_FLOAT; i++)
+                            ;
+                    eatsemi = 0;
+                }
+                else
+                {
+                    for (i = onset; i < n && vec[i].a_type != A_SEMI &&
+                        vec[i].a_type != A_COMMA; i++)
+                            ;
+                    onset++;
+                }
+                eaten = 1;
+                if (i - onset == 1 && vec[onset].a_type == A_FLOAT &&
+                    vec[onset].a_w.w_float > 0)
+                        time += vec[onset].a_w.w_float;
+                onset = i + eatsemi;
+                if (pass)
+                {
+                    x->x_waitvec[nwait].sw_time = time;
+                    x->x_waitvec[nwait].sw_onset = onset;
+                    x->x_waitvec[nwait].sw_eaten = eaten;
+                }
+                nwait++;
+                lastto = 0;
+            }
+            else
+            {
+                int gotcomma;
+                for (i = onset; i < n && vec[i].a_type != A_SEMI &&
+                    vec[i].a_type != A_COMMA; i++)
+                        ;
+                eaten = 0;
+                gotcomma = (i < n && vec[i].a_type == A_COMMA);
+                    /* track whether the next line continues this one's
+                    destination, which suppresses waits */
+                if (x->x_mainout)
+                {
+                    if (!gotcomma)
+                        lastto = 0;
+                    else if (!lastto && i > onset &&
+                        (vec[onset].a_type == A_SYMBOL ||
+                            vec[onset].a_type == A_DOLLSYM))
+                                lastto = 1;
+                }
+                else if (i > onset)
+                    lastto = (gotcomma && (lastto ||
+                        vec[onset].a_type == A_SYMBOL ||
+                            vec[onset].a_type == A_DOLLSYM));
+                onset = i + 1;
+            }
+        }
+        if (!pass && nwait)
+            x->x_waitvec = (t_seqwait *)getbytes(nwait * sizeof(*x->x_waitvec));
+        x->x_nwait = nwait;
+    }
+    x->x_indexed = 1;
+}
+
+    /* move to the first line that would come out at or after the given
+    time in "auto" mode (ignoring tempo) */
+static void text_sequence_seek(t_text_sequence *x, t_floatarg f)
+{
+    t_binbuf *b = text_client_getbuf(&x->x_tc);
+    int lo = 0, hi;
+    if (!b)
+       return;
+    if (b != x->x_indexbuf || binbuf_getserial(b) != x->x_serial ||
+        !x->x_indexed)
+    {
+        x->x_indexbuf = b;
+        x->x_serial = binbuf_getserial(b);
+        text_sequence_makeindex(x, b);
+    }
+    x->x_lastto = 0;
+    if (f <= 0)
+    {
+        x->x_onset = (binbuf_getnatom(b) ? 0 : 0x7fffffff);
+        x->x_eaten = 0;
+        return;
+    }
+        /* binary search for the first wait that ends at or after f */
+    hi = x->x_nwait;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) >> 1;
+        if (x->x_waitvec[mid].sw_time < f)
+            lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo < x->x_nwait && x->x_waitvec[lo].sw_onset < binbuf_getnatom(b))
+    {
+        x->x_onset = x->x_waitvec[lo].sw_onset;
+        x->x_eaten = x->x_waitvec[lo].sw_eaten;
+    }
+    else x->x_onset = 0x7fffffff;
+}
+
 static void text_sequence_args(t_text_sequence *x, t_symbol *s,
     int argc, t_atom *argv)
 {
@@ -1825,6 +2295,7 @@ static void text_sequence_tempo(t_text_sequence *x,
 
 static void text_sequence_free(t_text_sequence *x)
 {
+    text_sequence_freeindex(x);
     t_freebytes(x->x_argv, sizeof(t_atom) * x->x_argc);
     clock_free(x->x_clock);
     text_client_free(&x->x_tc);
@@ -2199,7 +2670,6 @@ void text_template_init(void)
 
 void x_qlist_setup(void)
 {
-    text_template_init();
     text_define_class = class_new(gensym("text define"),
         (t_newmethod)text_define_new,
         (t_method)text_define_free, sizeof(t_text_define), 0, A_GIMME, 0);
@@ -2223,6 +2693,8 @@ void x_qlist_setup(void)
         gensym("send"), A_SYMBOL, 0);
     class_addmethod(text_define_class, (t_method)text_define_sort,
         gensym("sort"), A_GIMME, 0);
+    class_addmethod(text_define_class, (t_method)textbuf_compact,
+        gensym("compact"), A_FLOAT, 0);
     class_setsavefn(text_define_class, text_define_save);
     class_addbang(text_define_class, text_define_bang);
     class_sethelpsymbol(text_define_class, gensym("text-object"));
@@ -2273,7 +2745,7 @@ void x_qlist_setup(void)
     class_sethelpsymbol(text_fromlist_class, gensym("text-object"));
 
     text_search_class = class_new(gensym("text search"),
-        (t_newmethod)text_search_new, (t_method)text_client_free,
+        (t_newmethod)text_search_new, (t_method)text_search_free,
             sizeof(t_text_search), 0, A_GIMME, 0);
     class_addlist(text_search_class, text_search_list);
     class_addmethod(text_search_class, (t_method)text_search_range,
@@ -2287,6 +2759,8 @@ void x_qlist_setup(void)
         gensym("step"), 0);
     class_addmethod(text_sequence_class, (t_method)text_sequence_line,
         gensym("line"), A_FLOAT, 0);
+    class_addmethod(text_sequence_class, (t_method)text_sequence_seek,
+        gensym("seek"), A_FLOAT, 0);
     class_addmethod(text_sequence_class, (t_method)text_sequence_auto,
         gensym("auto"), 0);
     class_addmethod(text_sequence_class, (t_method)text_sequence_stop,
@@ -2324,6 +2798,8 @@ void x_qlist_setup(void)
         gensym("notify"), 0, 0);
     class_addmethod(qlist_class, (t_method)qlist_print, gensym("print"),
         A_DEFSYM, 0);
+    class_addmethod(qlist_class, (t_method)textbuf_compact,
+        gensym("compact"), A_FLOAT, 0);
     class_addmethod(qlist_class, (t_method)qlist_tempo,
         gensym("tempo"), A_FLOAT, 0);
     class_addbang(qlist_class, qlist_bang);
@@ -2354,6 +2830,8 @@ void x_qlist_setup(void)
         gensym("notify"), 0, 0);
     class_addmethod(textfile_class, (t_method)qlist_print, gensym("print"),
         A_DEFSYM, 0);
+    class_addmethod(textfile_class, (t_method)textbuf_compact,
+        gensym("compact"), A_FLOAT, 0);
     class_addbang(textfile_class, textfile_bang);
 }
 
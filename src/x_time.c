@@ -406,17 +406,27 @@ static void timer_setup(void)
 
 /* -------------------------- pipe -------------------------- */
 
+    /* Each message waiting in a pipe is kept in a "hang", which holds the
+    saved values and a copy of any pointers.  Pending hangs are kept in a
+    binary heap ordered by output time (ties going to the earlier message),
+    and a single clock is set for the earliest one.  Hangs that have been
+    output are kept on a free list and reused, so that a busy pipe doesn't
+    allocate anything once it has reached its maximum load. */
+
 static t_class *pipe_class;
 
 typedef struct _hang
 {
-    t_clock *h_clock;
-    struct _hang *h_next;
-    struct _pipe *h_owner;
+    struct _hang *h_next;       /* next in free list */
+    double h_settime;           /* logical time to output at */
+    double h_serial;            /* order of scheduling, for ties */
     t_gpointer *h_gp;
     union word h_vec[1];        /* not the actual number. */
 } t_hang;
 
+#define HANG_BEFORE(a, b) ((a)->h_settime < (b)->h_settime || \
+    ((a)->h_settime == (b)->h_settime && (a)->h_serial < (b)->h_serial))
+
 typedef struct pipeout
 {
     t_atom p_atom;
@@ -431,9 +441,16 @@ typedef struct _pipe
     t_float x_deltime;
     t_pipeout *x_vec;
     t_gpointer *x_gp;
-    t_hang *x_hang;
+    t_clock *x_clock;
+    t_hang **x_heap;            /* pending hangs, earliest first */
+    int x_nhang;                /* number of pending hangs */
+    int x_heapsize;             /* allocated size of x_heap */
+    t_hang *x_freelist;         /* hangs available for reuse */
+    double x_serial;            /* counts scheduled messages */
 } t_pipe;
 
+static void pipe_tick(t_pipe *x);
+
 static void *pipe_new(t_symbol *s, int argc, t_atom *argv)
 {
     t_pipe *x = (t_pipe *)pd_new(pipe_class);
@@ -509,39 +526,99 @@ static void *pipe_new(t_symbol *s, int argc, t_atom *argv)
         }
     }
     floatinlet_new(&x->x_obj, &x->x_deltime);
-    x->x_hang = 0;
+    x->x_clock = clock_new(x, (t_method)pipe_tick);
+    x->x_heap = 0;
+    x->x_nhang = x->x_heapsize = 0;
+    x->x_freelist = 0;
+    x->x_serial = 0;
     x->x_deltime = deltime;
     return (x);
 }
 
-static void hang_free(t_hang *h)
+static size_t hang_size(t_pipe *x)
+{
+    return (sizeof(t_hang) + (x->x_n - 1) * sizeof(union word) +
+        x->x_nptr * sizeof(t_gpointer));
+}
+
+    /* get a hang from the free list, or make a new one if there is none.
+    The pointer copies live in the same block, after the values. */
+static t_hang *hang_get(t_pipe *x)
+{
+    t_hang *h = x->x_freelist;
+    if (h)
+        x->x_freelist = h->h_next;
+    else
+    {
+        h = (t_hang *)getbytes(hang_size(x));
+        h->h_gp = (t_gpointer *)(h->h_vec + x->x_n);
+    }
+    return (h);
+}
+
+static void hang_release(t_pipe *x, t_hang *h)
 {
-    t_pipe *x = h->h_owner;
     t_gpointer *gp;
     int i;
     for (gp = h->h_gp, i = x->x_nptr; i--; gp++)
         gpointer_unset(gp);
-    freebytes(h->h_gp, x->x_nptr * sizeof(*h->h_gp));
-    clock_free(h->h_clock);
-    freebytes(h, sizeof(*h) + (x->x_n - 1) * sizeof(*h->h_vec));
+    h->h_next = x->x_freelist;
+    x->x_freelist = h;
 }
 
-static void hang_tick(t_hang *h)
+static void pipe_siftup(t_pipe *x, int i)
 {
-    t_pipe *x = h->h_owner;
-    t_hang *h2, *h3;
-    t_pipeout *p;
-    int i;
-    union word *w;
-    if (x->x_hang == h) x->x_hang = h->h_next;
-    else for (h2 = x->x_hang; (h3 = h2->h_next); h2 = h3)
+    t_hang **heap = x->x_heap, *h = heap[i];
+    while (i > 0)
     {
-        if (h3 == h)
-        {
-            h2->h_next = h3->h_next;
+        int parent = (i - 1) >> 1;
+        if (!HANG_BEFORE(h, heap[parent]))
             break;
-        }
+        heap[i] = heap[parent];
+        i = parent;
     }
+    heap[i] = h;
+}
+
+static void pipe_siftdown(t_pipe *x, int i)
+{
+    t_hang **heap = x->x_heap, *h = heap[i];
+    int n = x->x_nhang;
+    while (1)
+    {
+        int child = 2 * i + 1;
+        if (child >= n)
+            break;
+        if (child + 1 < n && HANG_BEFORE(heap[child+1], heap[child]))
+            child++;
+        if (!HANG_BEFORE(heap[child], h))
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = h;
+}
+
+    /* take the earliest hang out of the heap and reset the clock for the
+    next one.  The caller outputs it and then releases it. */
+static t_hang *pipe_pop(t_pipe *x)
+{
+    t_hang *h = x->x_heap[0];
+    if (--x->x_nhang)
+    {
+        x->x_heap[0] = x->x_heap[x->x_nhang];
+        pipe_siftdown(x, 0);
+        clock_set(x->x_clock, x->x_heap[0]->h_settime);
+    }
+    else clock_unset(x->x_clock);
+    return (h);
+}
+
+static void pipe_output(t_pipe *x, t_hang *h)
+{
+    t_pipeout *p;
+    int i;
+    union word *w;
     for (i = x->x_n, p = x->x_vec + (x->x_n - 1), w = h->h_vec + (x->x_n - 1);
         i--; p--, w--)
     {
@@ -557,19 +634,25 @@ static void hang_tick(t_hang *h)
         default: break;
         }
     }
-    hang_free(h);
+    hang_release(x, h);
+}
+
+    /* output one message per clock callback, so that messages due at the
+    same time stay interleaved with other clocks as they were set. */
+static void pipe_tick(t_pipe *x)
+{
+    if (x->x_nhang)
+        pipe_output(x, pipe_pop(x));
 }
 
 static void pipe_list(t_pipe *x, t_symbol *s, int ac, t_atom *av)
 {
-    t_hang *h = (t_hang *)
-        getbytes(sizeof(*h) + (x->x_n - 1) * sizeof(*h->h_vec));
+    t_hang *h = hang_get(x);
     t_gpointer *gp, *gp2;
     t_pipeout *p;
     int i, n = x->x_n;
     t_atom *ap;
     t_word *w;
-    h->h_gp = (t_gpointer *)getbytes(x->x_nptr * sizeof(t_gpointer));
     if (ac > n)
     {
         if (av[n].a_type == A_FLOAT)
@@ -608,34 +691,72 @@ static void pipe_list(t_pipe *x, t_symbol *s, int ac, t_atom *av)
         }
         else *w = p->p_atom.a_w;
     }
-    h->h_next = x->x_hang;
-    x->x_hang = h;
-    h->h_owner = x;
-    h->h_clock = clock_new(h, (t_method)hang_tick);
-    clock_delay(h->h_clock, (x->x_deltime >= 0 ? x->x_deltime : 0));
+    h->h_settime = clock_getsystimeafter(x->x_deltime >= 0 ? x->x_deltime : 0);
+    h->h_serial = x->x_serial++;
+    if (x->x_nhang == x->x_heapsize)
+    {
+        int newsize = (x->x_heapsize ? 2 * x->x_heapsize : 8);
+        if (x->x_heap)
+            x->x_heap = (t_hang **)resizebytes(x->x_heap,
+                x->x_heapsize * sizeof(t_hang *), newsize * sizeof(t_hang *));
+        else x->x_heap = (t_hang **)getbytes(newsize * sizeof(t_hang *));
+        x->x_heapsize = newsize;
+    }
+    x->x_heap[x->x_nhang++] = h;
+    pipe_siftup(x, x->x_nhang - 1);
+    if (x->x_heap[0] == h)
+        clock_set(x->x_clock, h->h_settime);
 }
 
+    /* output everything that's pending.  As before the heap was introduced,
+    the most recently scheduled message comes out first; this is a linear
+    search each time, but flushing is rare. */
 static void pipe_flush(t_pipe *x)
 {
-    while (x->x_hang) hang_tick(x->x_hang);
+    while (x->x_nhang)
+    {
+        int i, latest = 0;
+        t_hang *h;
+        for (i = 1; i < x->x_nhang; i++)
+            if (x->x_heap[i]->h_serial > x->x_heap[latest]->h_serial)
+                latest = i;
+        h = x->x_heap[latest];
+        if (latest < --x->x_nhang)
+        {
+            x->x_heap[latest] = x->x_heap[x->x_nhang];
+            if (latest > 0 && HANG_BEFORE(x->x_heap[latest],
+                x->x_heap[(latest - 1) >> 1]))
+                    pipe_siftup(x, latest);
+            else pipe_siftdown(x, latest);
+        }
+        if (x->x_nhang)
+            clock_set(x->x_clock, x->x_heap[0]->h_settime);
+        else clock_unset(x->x_clock);
+        pipe_output(x, h);
+    }
 }
 
 static void pipe_clear(t_pipe *x)
 {
-    t_hang *hang;
-    while ((hang = x->x_hang))
-    {
-        x->x_hang = hang->h_next;
-        hang_free(hang);
-    }
+    while (x->x_nhang)
+        hang_release(x, x->x_heap[--x->x_nhang]);
+    clock_unset(x->x_clock);
 }
 
 static void pipe_free(t_pipe *x)
 {
+    t_hang *h;
     pipe_clear(x);
+    while ((h = x->x_freelist))
+    {
+        x->x_freelist = h->h_next;
+        freebytes(h, hang_size(x));
+    }
+    if (x->x_heap)
+        freebytes(x->x_heap, x->x_heapsize * sizeof(t_hang *));
+    clock_free(x->x_clock);
     freebytes(x->x_vec, x->x_n * sizeof(*x->x_vec));
     freebytes(x->x_gp, x->x_nptr * sizeof(*x->x_gp));
-
 }
 
 static void pipe_setup(void)
@@ -106,6 +106,8 @@ struct ex_ex *eval_store(struct expr *expr, struct ex_ex *eptr,
                                                 struct ex_ex *optr, int i);
 struct ex_ex *eval_sigidx(struct expr *expr, struct ex_ex *eptr,
                                                 struct ex_ex *optr, int i);
+static void ex_sigidx(struct expr *expr, struct ex_ex *eptr,
+                struct ex_ex *argp, struct ex_ex *optr, int idx);
 static int cal_sigidx(struct ex_ex *optr,       /* The output value */
            int i, t_float rem_i,      /* integer and fractinal part of index */
            int idx,                  /* index of current fexpr~ processing */
@@ -1527,23 +1529,36 @@ eval_sigidx(struct expr *expr, struct ex_ex *eptr, struct ex_ex *optr, int idx)
 {
         struct ex_ex arg = { 0 };
         struct ex_ex *reteptr;
-        int i = 0;
-        t_float fi = 0,         /* index in float */
-              rem_i = 0;        /* remains of the float */
 
         arg.ex_type = 0;
         arg.ex_int = 0;
         reteptr = ex_eval(expr, eptr + 1, &arg, idx);
-        if (arg.ex_type == ET_FLT) {
-                fi = arg.ex_flt;                /* float index */
-                i = (int) arg.ex_flt;           /* integer index */
-                rem_i =  arg.ex_flt - i;        /* remains of integer */
-        } else if (arg.ex_type == ET_INT) {
-                fi = arg.ex_int;                /* float index */
-                i = (int) arg.ex_int;           /* integer index */
+        ex_sigidx(expr, eptr, &arg, optr, idx);
+        return (reteptr);
+}
+
+/*
+ * ex_sigidx -- look up $x?[] or $y?[] at the (already evaluated) index arg;
+ *              shared by eval_sigidx() and the compiled code in ex_run()
+ */
+static void
+ex_sigidx(struct expr *expr, struct ex_ex *eptr, struct ex_ex *argp,
+                                                struct ex_ex *optr, int idx)
+{
+        int i = 0;
+        t_float fi = 0,         /* index in float */
+              rem_i = 0;        /* remains of the float */
+
+        if (argp->ex_type == ET_FLT) {
+                fi = argp->ex_flt;              /* float index */
+                i = (int) argp->ex_flt;         /* integer index */
+                rem_i =  argp->ex_flt - i;      /* remains of integer */
+        } else if (argp->ex_type == ET_INT) {
+                fi = argp->ex_int;              /* float index */
+                i = (int) argp->ex_int;         /* integer index */
                 rem_i = 0;
         } else {
-                post("eval_sigidx: bad res type (%d)", arg.ex_type);
+                post("eval_sigidx: bad res type (%d)", argp->ex_type);
         }
         optr->ex_type = ET_FLT;
         /*
@@ -1595,7 +1610,7 @@ eval_sigidx(struct expr *expr, struct ex_ex *eptr, struct ex_ex *optr, int idx)
                         post("fexpr~: $y%d illegal: not that many exprs",
                                                                 eptr->ex_int);
                         optr->ex_flt = 0;
-                        return (reteptr);
+                        return;
                 }
                 if (cal_sigidx(optr, i, rem_i, idx, expr->exp_vsize,
                              expr->exp_tmpres[eptr->ex_int],
@@ -1613,7 +1628,834 @@ eval_sigidx(struct expr *expr, struct ex_ex *eptr, struct ex_ex *optr, int idx)
                 post("fexpr~:eval_sigidx: internal error - unknown vector (%d)",
                                                                 eptr->ex_type);
         }
-        return (reteptr);
+}
+
+/*
+ * The compiled form of expressions.  ex_eval() walks the tree of nodes
+ * for each message to expr, once per block for expr~ (allocating a
+ * temporary vector for every operator on the way) and once per sample
+ * and expression for fexpr~, switching on the node and operand types
+ * each time.  ex_compile() resolves all that once, when the object is
+ * created, into a flat list of instructions whose operands are kept in
+ * registers of fixed type, so that ex_run() only has to step through the
+ * list.  The arithmetic is that of ex_eval(), with the same casts and
+ * divide-by-zero rules, so the results don't change.  Expressions using
+ * tables, variables, symbols, stores or an "if" whose branches have
+ * different types are not compiled and ex_eval() is still used for them.
+ *
+ * While compiling, anything depending only on constants is computed
+ * right away ("pow(2, 1/12.)"), something computed twice ("$f1*$f1 +
+ * $f1*$f1") is only computed once, and pow() to a small integer power
+ * is done by multiplying.
+ */
+
+/* operand types of binary instructions, added to the opcode */
+#define EXT_II          0
+#define EXT_IF          1
+#define EXT_FI          2
+#define EXT_FF          3
+#define EXT_IV          4
+#define EXT_FV          5
+#define EXT_VI          6
+#define EXT_VF          7
+#define EXT_VV          8
+#define EXT_NBIN        9
+/* ... and of unary ones */
+#define EXT_I           0
+#define EXT_F           1
+#define EXT_V           2
+#define EXT_NUN         3
+
+#define EXI_II          0       /* integer inlet */
+#define EXI_FI          1       /* float inlet */
+#define EXI_VI          2       /* signal inlet for expr~ */
+#define EXI_XI0         3       /* $x?[0] */
+#define EXI_YOM1        4       /* $y?[-1] */
+#define EXI_SIGIDX      5       /* $x?[] or $y?[] with an index in i_a */
+#define EXI_MOVE        6
+#define EXI_JUMP        7       /* to i_args */
+#define EXI_JZI         8       /* to i_args if i_a (an int) is zero */
+#define EXI_JZF         9       /* ... or a float */
+#define EXI_IFV         10      /* "if" with a vector condition */
+#define EXI_CALL        11      /* any other function */
+#define EXI_POWI        12      /* pow() to a small constant integer power */
+#define EXI_UNARY       13      /* + EXT_NUN * (index in ex_unops) */
+#define EXI_BINARY      (EXI_UNARY + 3 * EXT_NUN) /* + EXT_NBIN * ex_binops */
+#define EXB_MOD         16      /* OP_MOD in ex_binops, followed by OP_DIV */
+
+static long ex_unops[] = {OP_NOT, OP_NEG, OP_UMINUS, 0};
+static long ex_binops[] = {OP_MUL, OP_ADD, OP_SUB, OP_LT, OP_LE, OP_GT,
+        OP_GE, OP_EQ, OP_NE, OP_SL, OP_SR, OP_AND, OP_XOR, OP_OR, OP_LAND,
+        OP_LOR, OP_MOD, OP_DIV, 0};
+
+static void ex_exec(struct expr *expr, struct ex_prog *p, int from, int to,
+                                                                int idx);
+
+/*
+ * ex_grow -- make room for element n of a growing array
+ *            return 1 if out of memory
+ */
+static int
+ex_grow(void **vecp, int *sizep, int n, size_t elsize)
+{
+        void *vec;
+        int size;
+
+        if (n < *sizep)
+                return (0);
+        size = 2 * *sizep + 16;
+        if (!(vec = fts_realloc(*vecp, size * elsize)))
+                return (1);
+        *vecp = vec;
+        *sizep = size;
+        return (0);
+}
+
+static int
+ex_newreg(struct ex_prog *p, int type)
+{
+        struct ex_reg *r;
+
+        if (ex_grow((void **)&p->p_reg, &p->p_regsize, p->p_nreg,
+                                                sizeof (struct ex_reg)))
+                return (-1);
+        r = &p->p_reg[p->p_nreg];
+        r->r_vec = 0;
+        r->r_int = 0;
+        r->r_type = type;
+        r->r_own = (type == ET_VEC);
+        r->r_const = 0;
+        return (p->p_nreg++);
+}
+
+static int
+ex_emit(struct ex_prog *p, int op, int dst, int a, int b, struct ex_ex *node)
+{
+        struct ex_inst *in;
+
+        if (ex_grow((void **)&p->p_inst, &p->p_instsize, p->p_ninst,
+                                                sizeof (struct ex_inst)))
+                return (-1);
+        in = &p->p_inst[p->p_ninst];
+        in->i_op = op;
+        in->i_dst = dst;
+        in->i_a = a;
+        in->i_b = b;
+        in->i_args = 0;
+        in->i_node = node;
+        in->i_cse = 0;
+        return (p->p_ninst++);
+}
+
+static int
+ex_addargs(struct ex_prog *p, int argc, int *regs)
+{
+        int i, onset = p->p_nargs;
+
+        for (i = 0; i < argc; i++) {
+                if (ex_grow((void **)&p->p_args, &p->p_argsize, p->p_nargs,
+                                                                sizeof (int)))
+                        return (-1);
+                p->p_args[p->p_nargs++] = regs[i];
+        }
+        return (onset);
+}
+
+/*
+ * ex_functype -- the type a function returns for arguments of given types
+ *                this only depends on the types (see FUNC_EVAL) so we find
+ *                out by calling it once on dummy arguments; vector
+ *                arguments always make a vector and "random" is left alone
+ *                as calling it has a side effect
+ */
+static int
+ex_functype(struct expr *expr, t_ex_func *f, struct ex_prog *p, int *regs)
+{
+        struct ex_ex args[MAX_ARGS], res;
+        int i, allint = 1;
+
+        for (i = 0; i < f->f_argc; i++) {
+                if (p->p_reg[regs[i]].r_type == ET_VEC)
+                        return (ET_VEC);
+                if (p->p_reg[regs[i]].r_type != ET_INT)
+                        allint = 0;
+        }
+        if (!strcmp(f->f_name, "random"))
+                return (allint ? ET_INT : ET_FLT);
+        for (i = 0; i < f->f_argc; i++) {
+                args[i].ex_type = p->p_reg[regs[i]].r_type;
+                if (args[i].ex_type == ET_INT)
+                        args[i].ex_int = 1;
+                else
+                        args[i].ex_flt = 1;
+        }
+        res.ex_type = 0;
+        res.ex_int = 0;
+        (*f->f_func)(expr, f->f_argc, args, &res);
+        if (res.ex_type == ET_VEC)
+                fts_free(res.ex_vec);
+        return (res.ex_type == ET_INT || res.ex_type == ET_FLT ?
+                                                        res.ex_type : 0);
+}
+
+/*
+ * ex_intern -- a constant just put in the last register d is
+ *              given the register of an equal one if there is one
+ */
+static int
+ex_intern(struct ex_prog *p, int d)
+{
+        struct ex_reg *r = &p->p_reg[d];
+        int i;
+
+        r->r_const = 1;
+        for (i = 0; i < d; i++)
+                if (p->p_reg[i].r_const && p->p_reg[i].r_type == r->r_type &&
+                    (r->r_type == ET_INT ? p->p_reg[i].r_int == r->r_int :
+                        !memcmp(&p->p_reg[i].r_flt, &r->r_flt, sizeof (t_float)))) {
+                        p->p_nreg--;
+                        return (i);
+                }
+        return (d);
+}
+
+#define EX_NOTINT       0x7fffffff
+
+/* ex_intval -- the value of a scalar register if it's an integer */
+static int
+ex_intval(struct ex_reg *r)
+{
+        if (r->r_type == ET_INT)
+                return (r->r_int == (int)r->r_int ? (int)r->r_int : EX_NOTINT);
+        if (r->r_type == ET_FLT && r->r_flt == (int)r->r_flt)
+                return ((int)r->r_flt);
+        return (EX_NOTINT);
+}
+
+/* are instructions x and y (which is pure) sure to give the same result */
+static int
+ex_samekey(struct ex_prog *p, struct ex_inst *x, struct ex_inst *y)
+{
+        int i, n;
+
+        if (x->i_op != y->i_op || x->i_a != y->i_a || x->i_b != y->i_b)
+                return (0);
+        switch (x->i_op) {
+        case EXI_II:
+        case EXI_FI:
+        case EXI_VI:
+        case EXI_XI0:
+        case EXI_YOM1:
+                return (x->i_node->ex_int == y->i_node->ex_int);
+        case EXI_SIGIDX:
+                return (x->i_node->ex_type == y->i_node->ex_type &&
+                        x->i_node->ex_int == y->i_node->ex_int);
+        case EXI_CALL:
+                if (x->i_node->ex_ptr != y->i_node->ex_ptr)
+                        return (0);
+                n = ((t_ex_func *)x->i_node->ex_ptr)->f_argc;
+                break;
+        case EXI_IFV:
+                n = 3;
+                break;
+        default:
+                return (1);
+        }
+        for (i = 0; i < n; i++)
+                if (p->p_args[x->i_args + i] != p->p_args[y->i_args + i])
+                        return (0);
+        return (1);
+}
+
+/* can instruction in be computed once and for all right away */
+static int
+ex_canfold(struct ex_prog *p, struct ex_inst *in)
+{
+        struct ex_reg *b = &p->p_reg[in->i_b];
+        int i;
+
+        if (p->p_reg[in->i_dst].r_type == ET_VEC)
+                return (0);
+        if (in->i_op == EXI_CALL) {
+                for (i = 0; i < ((t_ex_func *)in->i_node->ex_ptr)->f_argc; i++)
+                        if (!p->p_reg[p->p_args[in->i_args + i]].r_const)
+                                return (0);
+                return (1);
+        }
+        if (in->i_op < EXI_POWI || !p->p_reg[in->i_a].r_const)
+                return (0);
+        if (in->i_op >= EXI_UNARY && in->i_op < EXI_BINARY)
+                return (1);
+        if (!b->r_const)
+                return (0);
+        /* leave dividing by zero to run time so that it's reported as ever */
+        if (in->i_op >= EXI_BINARY + EXB_MOD * EXT_NBIN)
+                return ((b->r_type == ET_INT ? (int)b->r_int :
+                                                        (int)b->r_flt) != 0);
+        return (1);
+}
+
+/* ex_hide -- keep instructions from onset on from being shared later */
+static void
+ex_hide(struct ex_prog *p, int onset)
+{
+        for (; onset < p->p_ninst; onset++)
+                p->p_inst[onset].i_cse = 0;
+}
+
+/*
+ * ex_add -- add an instruction with a new result register (argument
+ *           registers in regs for functions) and return the register;
+ *           if the same thing was computed before that is used instead,
+ *           and if all the operands are constant it's done right away
+ */
+static int
+ex_add(struct expr *expr, struct ex_prog *p, int op, int type, int a, int b,
+                                struct ex_ex *node, int nargs, int *regs)
+{
+        int d, k, i;
+
+        if ((d = ex_newreg(p, type)) < 0 ||
+            (k = ex_emit(p, op, d, a, b, node)) < 0 ||
+            (nargs && (p->p_inst[k].i_args = ex_addargs(p, nargs, regs)) < 0))
+                return (-1);
+        /* "random" gives a different number each time */
+        if (op == EXI_CALL &&
+            !strcmp(((t_ex_func *)node->ex_ptr)->f_name, "random"))
+                return (d);
+        for (i = 0; i < k; i++)
+                if (p->p_inst[i].i_cse &&
+                    ex_samekey(p, &p->p_inst[i], &p->p_inst[k])) {
+                        p->p_ninst--;
+                        p->p_nargs -= nargs;
+                        p->p_nreg--;
+                        return (p->p_inst[i].i_dst);
+                }
+        if (ex_canfold(p, &p->p_inst[k])) {
+                ex_exec(expr, p, k, k + 1, 0);
+                p->p_ninst--;
+                p->p_nargs -= nargs;
+                return (ex_intern(p, d));
+        }
+        p->p_inst[k].i_cse = 1;
+        return (d);
+}
+
+/*
+ * ex_comp -- compile the subexpression starting at eptr, in the order
+ *            ex_eval() would evaluate it, putting its result register in
+ *            *regp; return the node after it, or exNULL if we can't
+ */
+static struct ex_ex *
+ex_comp(struct expr *expr, struct ex_prog *p, struct ex_ex *eptr, int *regp)
+{
+        struct ex_ex *node = eptr;
+        int a, b, c, d, i, k, op, jz, jump, start, type, regs[MAX_ARGS];
+        t_ex_func *f;
+
+        switch (eptr->ex_type) {
+        case ET_INT:
+        case ET_FLT:
+                /* constants just sit in their registers */
+                if ((d = ex_newreg(p, eptr->ex_type)) < 0)
+                        return (exNULL);
+                if (eptr->ex_type == ET_INT)
+                        p->p_reg[d].r_int = eptr->ex_int;
+                else
+                        p->p_reg[d].r_flt = eptr->ex_flt;
+                *regp = ex_intern(p, d);
+                return (++eptr);
+        case ET_II:
+        case ET_FI:
+                if (eptr->ex_int == -1 ||
+                    (d = ex_add(expr, p, eptr->ex_type == ET_II ? EXI_II :
+                        EXI_FI, eptr->ex_type == ET_II ? ET_INT : ET_FLT,
+                                                0, 0, eptr, 0, 0)) < 0)
+                        return (exNULL);
+                *regp = d;
+                return (++eptr);
+        case ET_VI:
+                if (!IS_EXPR_TILDE(expr) ||
+                    (d = ex_add(expr, p, EXI_VI, ET_VEC, 0, 0, eptr, 0, 0)) < 0)
+                        return (exNULL);
+                p->p_reg[d].r_own = 0;
+                *regp = d;
+                return (++eptr);
+        case ET_XI0:
+        case ET_YOM1:
+                if (!IS_FEXPR_TILDE(expr) ||
+                    (d = ex_add(expr, p, eptr->ex_type == ET_XI0 ? EXI_XI0 :
+                                EXI_YOM1, ET_FLT, 0, 0, eptr, 0, 0)) < 0)
+                        return (exNULL);
+                *regp = d;
+                return (++eptr);
+        case ET_XI:
+        case ET_YO:
+                if (!IS_FEXPR_TILDE(expr) ||
+                    !(eptr = ex_comp(expr, p, eptr + 1, &a)) ||
+                    p->p_reg[a].r_type == ET_VEC ||
+                    (d = ex_add(expr, p, EXI_SIGIDX, ET_FLT, a, 0, node,
+                                                                0, 0)) < 0)
+                        return (exNULL);
+                *regp = d;
+                return (eptr);
+        case ET_FUNC:
+                f = (t_ex_func *)(eptr++)->ex_ptr;
+                if (!f || !f->f_name || f->f_argc > MAX_ARGS)
+                        return (exNULL);
+                if (f->f_func != (void (*)) ex_if) {
+                        for (i = 0; i < f->f_argc; i++)
+                                if (!(eptr = ex_comp(expr, p, eptr, &regs[i])))
+                                        return (exNULL);
+                        if (!(type = ex_functype(expr, f, p, regs)))
+                                return (exNULL);
+                        /* small integer powers are done by multiplying */
+                        if (!strcmp(f->f_name, "pow") &&
+                            p->p_reg[regs[1]].r_const &&
+                            (k = ex_intval(&p->p_reg[regs[1]])) >= -2 &&
+                            k <= 4)
+                                d = ex_add(expr, p, EXI_POWI, type, regs[0],
+                                                regs[1], node, 0, 0);
+                        else d = ex_add(expr, p, EXI_CALL, type, 0, 0, node,
+                                                        f->f_argc, regs);
+                        if (d < 0)
+                                return (exNULL);
+                        *regp = d;
+                        return (eptr);
+                }
+                if (f->f_argc != 3 || !(eptr = ex_comp(expr, p, eptr, &c)))
+                        return (exNULL);
+                if (p->p_reg[c].r_type == ET_VEC) {
+                        /* a vector condition needs both branches */
+                        if (!(eptr = ex_comp(expr, p, eptr, &a)) ||
+                            !(eptr = ex_comp(expr, p, eptr, &b)))
+                                return (exNULL);
+                        regs[0] = c;
+                        regs[1] = a;
+                        regs[2] = b;
+                        if ((d = ex_add(expr, p, EXI_IFV, ET_VEC, 0, 0, node,
+                                                                3, regs)) < 0)
+                                return (exNULL);
+                        *regp = d;
+                        return (eptr);
+                }
+                if (p->p_reg[c].r_const) {
+                        /*
+                         * a constant condition: jump over the branch not
+                         * taken (which still has to be parsed), the other
+                         * one is the result whatever its type
+                         */
+                        k = (p->p_reg[c].r_type == ET_INT ?
+                                p->p_reg[c].r_int != 0 : p->p_reg[c].r_flt != 0);
+                        if (!k && (jump = ex_emit(p, EXI_JUMP, 0, 0, 0,
+                                                                node)) < 0)
+                                return (exNULL);
+                        start = p->p_ninst;
+                        if (!(eptr = ex_comp(expr, p, eptr, &a)))
+                                return (exNULL);
+                        if (!k) {
+                                ex_hide(p, start);
+                                p->p_inst[jump].i_args = p->p_ninst;
+                        } else if ((jump = ex_emit(p, EXI_JUMP, 0, 0, 0,
+                                                                node)) < 0)
+                                return (exNULL);
+                        start = p->p_ninst;
+                        if (!(eptr = ex_comp(expr, p, eptr, &b)))
+                                return (exNULL);
+                        if (k) {
+                                ex_hide(p, start);
+                                p->p_inst[jump].i_args = p->p_ninst;
+                        }
+                        *regp = (k ? a : b);
+                        return (eptr);
+                }
+                /*
+                 * otherwise jump over the branch not taken; what's
+                 * computed in either can't be shared with what follows
+                 */
+                if ((jz = ex_emit(p, p->p_reg[c].r_type == ET_INT ?
+                                        EXI_JZI : EXI_JZF, 0, c, 0, node)) < 0)
+                        return (exNULL);
+                start = p->p_ninst;
+                if (!(eptr = ex_comp(expr, p, eptr, &a)) ||
+                    (d = ex_newreg(p, p->p_reg[a].r_type)) < 0 ||
+                    ex_emit(p, EXI_MOVE, d, a, 0, node) < 0 ||
+                    (jump = ex_emit(p, EXI_JUMP, 0, 0, 0, node)) < 0)
+                        return (exNULL);
+                ex_hide(p, start);
+                p->p_inst[jz].i_args = start = p->p_ninst;
+                if (!(eptr = ex_comp(expr, p, eptr, &b)) ||
+                    p->p_reg[b].r_type != p->p_reg[a].r_type ||
+                    ex_emit(p, EXI_MOVE, d, b, 0, node) < 0)
+                        return (exNULL);
+                ex_hide(p, start);
+                p->p_inst[jump].i_args = p->p_ninst;
+                /* vectors are passed on by pointer */
+                p->p_reg[d].r_own = 0;
+                *regp = d;
+                return (eptr);
+        case ET_OP:
+                break;
+        default:
+                return (exNULL);
+        }
+        if (!eptr[1].ex_type || (!unary_op(eptr->ex_op) && !eptr[2].ex_type))
+                return (exNULL);
+        op = (eptr++)->ex_op;
+        if (unary_op(op)) {
+                for (k = 0; ex_unops[k] != op; k++)
+                        ;
+                if (!(eptr = ex_comp(expr, p, eptr, &a)))
+                        return (exNULL);
+                type = p->p_reg[a].r_type;
+                if ((d = ex_add(expr, p, EXI_UNARY + k * EXT_NUN +
+                    (type == ET_INT ? EXT_I : (type == ET_FLT ? EXT_F : EXT_V)),
+                                        type, a, 0, node, 0, 0)) < 0)
+                        return (exNULL);
+                *regp = d;
+                return (eptr);
+        }
+        for (k = 0; ex_binops[k] && ex_binops[k] != op; k++)
+                ;
+        if (!ex_binops[k] || !(eptr = ex_comp(expr, p, eptr, &a)) ||
+            !(eptr = ex_comp(expr, p, eptr, &b)))
+                return (exNULL);
+        switch (p->p_reg[a].r_type) {
+        case ET_INT:
+                op = (p->p_reg[b].r_type == ET_INT ? EXT_II :
+                        (p->p_reg[b].r_type == ET_FLT ? EXT_IF : EXT_IV));
+                break;
+        case ET_FLT:
+                op = (p->p_reg[b].r_type == ET_INT ? EXT_FI :
+                        (p->p_reg[b].r_type == ET_FLT ? EXT_FF : EXT_FV));
+                break;
+        default:
+                op = (p->p_reg[b].r_type == ET_INT ? EXT_VI :
+                        (p->p_reg[b].r_type == ET_FLT ? EXT_VF : EXT_VV));
+        }
+        type = (op == EXT_II ? ET_INT : (op < EXT_IV ? ET_FLT : ET_VEC));
+        if ((d = ex_add(expr, p, EXI_BINARY + k * EXT_NBIN + op, type, a, b,
+                                                        node, 0, 0)) < 0)
+                return (exNULL);
+        *regp = d;
+        return (eptr);
+}
+
+/*
+ * ex_progvsize -- (re)allocate the vector registers for a block size
+ *                 return 1 if out of memory
+ */
+int
+ex_progvsize(struct ex_prog *p, int vsize)
+{
+        int i;
+
+        if (vsize == p->p_vsize)
+                return (0);
+        for (i = 0; i < p->p_nreg; i++)
+                if (p->p_reg[i].r_own) {
+                        if (p->p_reg[i].r_vec)
+                                fts_free(p->p_reg[i].r_vec);
+                        if (!(p->p_reg[i].r_vec =
+                            (t_float *)fts_calloc(vsize, sizeof (t_float))))
+                                return (1);
+                }
+        p->p_vsize = vsize;
+        return (0);
+}
+
+void
+ex_freeprog(struct ex_prog *p)
+{
+        int i;
+
+        for (i = 0; i < p->p_nreg; i++)
+                if (p->p_reg[i].r_own && p->p_reg[i].r_vec)
+                        fts_free(p->p_reg[i].r_vec);
+        if (p->p_reg)
+                fts_free(p->p_reg);
+        if (p->p_inst)
+                fts_free(p->p_inst);
+        if (p->p_args)
+                fts_free(p->p_args);
+        fts_free(p);
+}
+
+/*
+ * ex_compile -- compile an expression of expr, expr~ or fexpr~
+ *               return 0 if it has to be left to ex_eval(); expr~ results
+ *               that aren't vectors are also left to it as they are only
+ *               computed once a block anyway
+ */
+struct ex_prog *
+ex_compile(struct expr *expr, struct ex_ex *eptr)
+{
+        struct ex_prog *p;
+
+        if (!eptr || !eptr->ex_type ||
+            !(p = (struct ex_prog *)fts_calloc(1, sizeof (struct ex_prog))))
+                return (0);
+        if (!ex_comp(expr, p, eptr, &p->p_res) ||
+            (IS_EXPR_TILDE(expr) && p->p_reg[p->p_res].r_type != ET_VEC) ||
+            ex_progvsize(p, expr->exp_vsize)) {
+                ex_freeprog(p);
+                return (0);
+        }
+        return (p);
+}
+
+#define EXI_EVAL(K, OPR)                                                \
+case EXI_BINARY + (K) * EXT_NBIN + EXT_II:                              \
+        d->r_int = DZC(a->r_int, OPR, b->r_int);                        \
+        break;                                                          \
+case EXI_BINARY + (K) * EXT_NBIN + EXT_IF:                              \
+        d->r_flt = DZC(((t_float)a->r_int), OPR, b->r_flt);             \
+        break;                                                          \
+case EXI_BINARY + (K) * EXT_NBIN + EXT_FI:                              \
+        d->r_flt = DZC(a->r_flt, OPR, b->r_int);                        \
+        break;                                                          \
+case EXI_BINARY + (K) * EXT_NBIN + EXT_FF:                              \
+        d->r_flt = DZC(a->r_flt, OPR, b->r_flt);                        \
+        break;                                                          \
+case EXI_BINARY + (K) * EXT_NBIN + EXT_IV:                              \
+        scalar = a->r_int;                                              \
+        goto ex_sv##K;                                                  \
+case EXI_BINARY + (K) * EXT_NBIN + EXT_FV:                              \
+        scalar = a->r_flt;                                              \
+ex_sv##K:                                                               \
+        rp = b->r_vec;                                                  \
+        op = d->r_vec;                                                  \
+        for (j = 0; j < n; j++)                                         \
+                op[j] = DZC(scalar, OPR, rp[j]);                        \
+        break;                                                          \
+case EXI_BINARY + (K) * EXT_NBIN + EXT_VI:                              \
+        scalar = b->r_int;                                              \
+        goto ex_vs##K;                                                  \
+case EXI_BINARY + (K) * EXT_NBIN + EXT_VF:                              \
+        scalar = b->r_flt;                                              \
+ex_vs##K:                                                               \
+        lp = a->r_vec;                                                  \
+        op = d->r_vec;                                                  \
+        for (j = 0; j < n; j++)                                         \
+                op[j] = DZC(lp[j], OPR, scalar);                        \
+        break;                                                          \
+case EXI_BINARY + (K) * EXT_NBIN + EXT_VV:                              \
+        lp = a->r_vec;                                                  \
+        rp = b->r_vec;                                                  \
+        op = d->r_vec;                                                  \
+        for (j = 0; j < n; j++)                                         \
+                op[j] = DZC(lp[j], OPR, rp[j]);                         \
+        break;
+
+#define EXI_EVAL_UNARY(K, OPR, TYPE)                                    \
+case EXI_UNARY + (K) * EXT_NUN + EXT_I:                                 \
+        d->r_int = OPR a->r_int;                                        \
+        break;                                                          \
+case EXI_UNARY + (K) * EXT_NUN + EXT_F:                                 \
+        d->r_flt = OPR (TYPE a->r_flt);                                 \
+        break;                                                          \
+case EXI_UNARY + (K) * EXT_NUN + EXT_V:                                 \
+        lp = a->r_vec;                                                  \
+        op = d->r_vec;                                                  \
+        for (j = 0; j < n; j++)                                         \
+                op[j] = OPR (TYPE lp[j]);                               \
+        break;
+
+static double
+ex_powi(double x, int n)
+{
+        switch (n) {
+        case -2:
+                return (1 / (x * x));
+        case -1:
+                return (1 / x);
+        case 0:
+                return (1);
+        case 1:
+                return (x);
+        case 2:
+                return (x * x);
+        case 3:
+                return (x * x * x);
+        default:
+                x *= x;
+                return (x * x);
+        }
+}
+
+/*
+ * ex_run -- run a compiled expression for sample idx (for fexpr~)
+ *           and return the register with the result
+ */
+struct ex_reg *
+ex_run(struct expr *expr, struct ex_prog *p, int idx)
+{
+        ex_exec(expr, p, 0, p->p_ninst, idx);
+        return (p->p_reg + p->p_res);
+}
+
+/* ex_exec -- run instructions from up to (but not including) to */
+static void
+ex_exec(struct expr *expr, struct ex_prog *p, int from, int to, int idx)
+{
+        struct ex_inst *in = p->p_inst + from, *end = p->p_inst + to;
+        struct ex_reg *reg = p->p_reg, *d, *a, *b;
+        struct ex_ex args[MAX_ARGS], res;
+        t_float scalar, leftvalue, rightvalue, *lp, *rp, *op, *cp;
+        int i, j, n = expr->exp_vsize, *argp;
+        t_ex_func *f;
+
+        while (in < end) {
+                d = reg + in->i_dst;
+                a = reg + in->i_a;
+                b = reg + in->i_b;
+                switch (in->i_op) {
+                case EXI_II:
+                        d->r_int = expr->exp_var[in->i_node->ex_int].ex_int;
+                        break;
+                case EXI_FI:
+                        d->r_flt = expr->exp_var[in->i_node->ex_int].ex_flt;
+                        break;
+                case EXI_VI:
+                        d->r_vec = expr->exp_var[in->i_node->ex_int].ex_vec;
+                        break;
+                case EXI_XI0:
+                        d->r_flt =
+                            expr->exp_var[in->i_node->ex_int].ex_vec[idx];
+                        break;
+                case EXI_YOM1:
+                        if (idx == 0)
+                                d->r_flt = expr->exp_p_res[in->i_node->ex_int]
+                                                                        [n - 1];
+                        else
+                                d->r_flt = expr->exp_tmpres[in->i_node->ex_int]
+                                                                        [idx-1];
+                        break;
+                case EXI_SIGIDX:
+                        args[0].ex_type = a->r_type;
+                        if (a->r_type == ET_INT)
+                                args[0].ex_int = a->r_int;
+                        else
+                                args[0].ex_flt = a->r_flt;
+                        ex_sigidx(expr, in->i_node, &args[0], &res, idx);
+                        d->r_flt = res.ex_flt;
+                        break;
+                case EXI_MOVE:
+                        d->r_cont = a->r_cont;
+                        break;
+                case EXI_JUMP:
+                        in = p->p_inst + in->i_args;
+                        continue;
+                case EXI_JZI:
+                        if (!a->r_int) {
+                                in = p->p_inst + in->i_args;
+                                continue;
+                        }
+                        break;
+                case EXI_JZF:
+                        if (!a->r_flt) {
+                                in = p->p_inst + in->i_args;
+                                continue;
+                        }
+                        break;
+                case EXI_IFV:
+                        argp = p->p_args + in->i_args;
+                        cp = reg[argp[0]].r_vec;
+                        a = reg + argp[1];
+                        b = reg + argp[2];
+                        lp = rp = 0;
+                        leftvalue = rightvalue = 0;
+                        if (a->r_type == ET_INT)
+                                leftvalue = a->r_int;
+                        else if (a->r_type == ET_FLT)
+                                leftvalue = a->r_flt;
+                        else
+                                lp = a->r_vec;
+                        if (b->r_type == ET_INT)
+                                rightvalue = b->r_int;
+                        else if (b->r_type == ET_FLT)
+                                rightvalue = b->r_flt;
+                        else
+                                rp = b->r_vec;
+                        op = d->r_vec;
+                        for (j = 0; j < n; j++)
+                                if (cp[j])
+                                        op[j] = (lp ? lp[j] : leftvalue);
+                                else
+                                        op[j] = (rp ? rp[j] : rightvalue);
+                        break;
+                case EXI_CALL:
+                        f = (t_ex_func *)in->i_node->ex_ptr;
+                        argp = p->p_args + in->i_args;
+                        for (i = 0; i < f->f_argc; i++) {
+                                a = reg + argp[i];
+                                args[i].ex_type = a->r_type;
+                                if (a->r_type == ET_INT)
+                                        args[i].ex_int = a->r_int;
+                                else if (a->r_type == ET_FLT)
+                                        args[i].ex_flt = a->r_flt;
+                                else
+                                        args[i].ex_vec = a->r_vec;
+                        }
+                        if (d->r_type == ET_VEC) {
+                                res.ex_type = ET_VEC;
+                                res.ex_vec = d->r_vec;
+                        } else {
+                                res.ex_type = 0;
+                                res.ex_int = 0;
+                        }
+                        (*f->f_func)(expr, f->f_argc, args, &res);
+                        if (d->r_type == ET_INT)
+                                d->r_int = res.ex_int;
+                        else if (d->r_type == ET_FLT)
+                                d->r_flt = res.ex_flt;
+                        break;
+                case EXI_POWI:
+                        j = (b->r_type == ET_INT ? b->r_int : (int)b->r_flt);
+                        if (a->r_type == ET_INT)
+                                d->r_flt = (t_float)ex_powi(a->r_int, j);
+                        else if (a->r_type == ET_FLT)
+                                d->r_flt = (t_float)ex_powi(a->r_flt, j);
+                        else {
+                                lp = a->r_vec;
+                                op = d->r_vec;
+                                for (i = 0; i < n; i++)
+                                        op[i] = (t_float)ex_powi(lp[i], j);
+                        }
+                        break;
+                EXI_EVAL_UNARY(0, !, +)
+                EXI_EVAL_UNARY(1, ~, (long))
+                EXI_EVAL_UNARY(2, -, +)
+#undef DZC
+#define DZC(ARG1,OPR,ARG2)      (ARG1 OPR ARG2)
+                EXI_EVAL(0, *)
+                EXI_EVAL(1, +)
+                EXI_EVAL(2, -)
+                EXI_EVAL(3, <)
+                EXI_EVAL(4, <=)
+                EXI_EVAL(5, >)
+                EXI_EVAL(6, >=)
+                EXI_EVAL(7, ==)
+                EXI_EVAL(8, !=)
+#undef DZC
+#define DZC(ARG1,OPR,ARG2)      (((int)ARG1) OPR ((int)ARG2))
+                EXI_EVAL(9, <<)
+                EXI_EVAL(10, >>)
+                EXI_EVAL(11, &)
+                EXI_EVAL(12, ^)
+                EXI_EVAL(13, |)
+                EXI_EVAL(14, &&)
+                EXI_EVAL(15, ||)
+#undef DZC
+#define DZC(ARG1,OPR,ARG2)      ((((int)ARG2)?(((int)ARG1) OPR ((int)ARG2)) \
+                                                        : (ex_dzdetect(expr),0)))
+                EXI_EVAL(16, %)
+#undef DZC
+#define DZC(ARG1,OPR,ARG2)      (((ARG2)?(ARG1 OPR ARG2):(ex_dzdetect(expr),0)))
+                EXI_EVAL(17, /)
+                }
+                in++;
+        }
 }
 
 /*
@@ -185,6 +185,23 @@ struct ex_ex {
 #define EE_NOTABLE      0x08    /* NO TABLE */
 #define EE_NOVAR        0x10    /* NO VARIABLE */
 
+#ifdef PD
+/*
+ * tables looked up by an expression, so that expr~ doesn't look them up
+ * by name for every sample; good until an array changes size or anything
+ * is bound or unbound
+ */
+#define EX_NTABCACHE    4
+struct ex_tabcache {
+        t_symbol *tc_sym;
+        t_garray *tc_garray;
+        t_word *tc_vec;                 /* read-only points */
+        int tc_size;
+        int tc_serial;                  /* garray_resizeserial() */
+        int tc_bindserial;              /* pd_bindserial() */
+};
+#endif
+
 typedef struct expr {
 #ifdef PD
         t_object exp_ob;
@@ -209,11 +226,55 @@ typedef struct expr {
         t_float *exp_p_var[MAX_VARS];
         t_float *exp_p_res[MAX_VARS];   /* the previous evaluation result */
         t_float *exp_tmpres[MAX_VARS];  /* temporty result for fexpr~ */
+        struct ex_prog *exp_prog[MAX_VARS]; /* compiled form, if any */
         int exp_vsize;                  /* the size of the signal vector */
         int exp_nivec;                  /* # of vector inlets */
         t_float exp_f;          /* control value to be transformed to signal */
+#ifdef PD
+        struct ex_tabcache exp_tabcache[EX_NTABCACHE];
+        int exp_tabnext;                /* cache entry to replace next */
+#endif
 } t_expr;
 
+/*
+ * the compiled form of an expression for expr~ and fexpr~ (see ex_compile()
+ * in x_vexp.c): a list of instructions in evaluation order whose operands
+ * and results are kept in registers each of a type fixed at compile time
+ */
+struct ex_reg {
+        union {
+                long v_int;
+                t_float v_flt;
+                t_float *v_vec;
+        } r_cont;
+#define r_int           r_cont.v_int
+#define r_flt           r_cont.v_flt
+#define r_vec           r_cont.v_vec
+        char r_type;            /* ET_INT, ET_FLT, or ET_VEC */
+        char r_own;             /* vector register with a buffer of its own */
+        char r_const;           /* value known at compile time */
+};
+
+struct ex_inst {
+        int i_op;               /* what to do (EXI_... in x_vexp.c) */
+        int i_dst;              /* result register */
+        int i_a, i_b;           /* operand registers */
+        int i_args;             /* onset in p_args, or a jump target */
+        struct ex_ex *i_node;   /* the node compiled, for inlet numbers etc. */
+        char i_cse;             /* result can be used again further on */
+};
+
+struct ex_prog {
+        struct ex_inst *p_inst;
+        int p_ninst, p_instsize;
+        struct ex_reg *p_reg;
+        int p_nreg, p_regsize;
+        int *p_args;            /* argument registers */
+        int p_nargs, p_argsize;
+        int p_res;              /* register holding the result */
+        int p_vsize;            /* size of the vector registers' buffers */
+};
+
 typedef struct ex_funcs {
         char *f_name;                                   /* function name */
         void (*f_func)(t_expr *, long, struct ex_ex *, struct ex_ex *);
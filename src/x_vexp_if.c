@@ -24,11 +24,18 @@
 #include <stdlib.h>
 
 #include "x_vexp.h"
+#ifdef PD
+#include "m_imp.h"
+#endif
 
 static char *exp_version = "0.57";
 
 extern struct ex_ex *ex_eval(struct expr *expr, struct ex_ex *eptr,
                                                 struct ex_ex *optr, int n);
+extern struct ex_prog *ex_compile(struct expr *expr, struct ex_ex *eptr);
+extern struct ex_reg *ex_run(struct expr *expr, struct ex_prog *p, int idx);
+extern int ex_progvsize(struct ex_prog *p, int vsize);
+extern void ex_freeprog(struct ex_prog *p);
 
 #ifdef PD
 static t_class *expr_class;
@@ -150,6 +157,9 @@ expr_ff(t_expr *x)
         for (i = 0 ; i < x->exp_nexpr; i++)
                 if (x->exp_stack[i])
                         fts_free(x->exp_stack[i]);
+        for (i = 0 ; i < x->exp_nexpr; i++)
+                if (x->exp_prog[i])
+                        ex_freeprog(x->exp_prog[i]);
 /*
  * SDY free all the allocated buffers here for expr~ and fexpr~
  * check to see if there are others
@@ -169,6 +179,7 @@ expr_ff(t_expr *x)
 static void
 expr_bang(t_expr *x)
 {
+        struct ex_reg *reg;
         int i;
 
 #ifdef EXPR_DEBUG
@@ -200,7 +211,14 @@ expr_bang(t_expr *x)
                 return;
 
         for (i = x->exp_nexpr - 1; i > -1 ; i--) {
-                if (!ex_eval(x, x->exp_stack[i], &x->exp_res[i], 0)) {
+                if (x->exp_prog[i]) {
+                        reg = ex_run(x, x->exp_prog[i], 0);
+                        x->exp_res[i].ex_type = reg->r_type;
+                        if (reg->r_type == ET_INT)
+                                x->exp_res[i].ex_int = reg->r_int;
+                        else
+                                x->exp_res[i].ex_flt = reg->r_flt;
+                } else if (!ex_eval(x, x->exp_stack[i], &x->exp_res[i], 0)) {
                         /*fprintf(stderr,"expr_bang(error evaluation)\n"); */
                 /*  SDY now that we have multiple ones, on error we should
                  * continue
@@ -285,6 +303,7 @@ Nexpr_new(t_symbol *s, int ac, t_atom *av)
         x->exp_error = 0;
         for (i = 0; i < MAX_VARS; i++) {
                 x->exp_stack[i] = (struct ex_ex *)0;
+                x->exp_prog[i] = (struct ex_prog *)0;
                 x->exp_outlet[i] = (t_outlet *)0;
                 x->exp_res[i].ex_type = 0;
                 x->exp_res[i].ex_int = 0;
@@ -390,6 +409,12 @@ SDY the following coredumps why?
         }
         for (i = 0; i < MAX_VARS; i++)
                 x->exp_p_var[i] = fts_calloc(x->exp_vsize, sizeof (t_float));
+        /*
+         * compile the expressions where we can, so that expr_bang() and
+         * the perform routine don't have to walk the tree every time
+         */
+        for (i = 0; i < x->exp_nexpr; i++)
+                x->exp_prog[i] = ex_compile(x, x->exp_stack[i]);
 
         return (x);
 }
@@ -400,6 +425,7 @@ expr_perform(t_int *w)
         int i, j;
         t_expr *x = (t_expr *)w[1];
         struct ex_ex res;
+        struct ex_reg *reg;
         int n;
 
         /* sanity check */
@@ -422,11 +448,22 @@ expr_perform(t_int *w)
                  * the data because, outputs could be the same buffer as
                  * inputs
                  */
-                if ( x->exp_nexpr == 1)
+                if ( x->exp_nexpr == 1 && x->exp_prog[0]) {
+                        reg = ex_run(x, x->exp_prog[0], 0);
+                        if (reg->r_vec != x->exp_res[0].ex_vec)
+                                memcpy(x->exp_res[0].ex_vec, reg->r_vec,
+                                        x->exp_vsize * sizeof(t_float));
+                } else if ( x->exp_nexpr == 1)
                         ex_eval(x, x->exp_stack[0], &x->exp_res[0], 0);
                 else {
                         res.ex_type = ET_VEC;
                         for (i = 0; i < x->exp_nexpr; i++) {
+                                if (x->exp_prog[i]) {
+                                        reg = ex_run(x, x->exp_prog[i], 0);
+                                        memcpy(x->exp_tmpres[i], reg->r_vec,
+                                                x->exp_vsize * sizeof(t_float));
+                                        continue;
+                                }
                                 res.ex_vec = x->exp_tmpres[i];
                                 ex_eval(x, x->exp_stack[i], &res, 0);
                         }
@@ -448,6 +485,14 @@ expr_perform(t_int *w)
          * we need to keep the output in  a different buffer
          */
         for (i = 0; i < x->exp_vsize; i++) for (j = 0; j < x->exp_nexpr; j++) {
+                if (x->exp_prog[j]) {
+                        reg = ex_run(x, x->exp_prog[j], i);
+                        if (reg->r_type == ET_INT)
+                                x->exp_tmpres[j][i] = (t_float) reg->r_int;
+                        else
+                                x->exp_tmpres[j][i] = reg->r_flt;
+                        continue;
+                }
                 res.ex_type = 0;
                 res.ex_int = 0;
                 ex_eval(x, x->exp_stack[j], &res, i);
@@ -487,6 +532,12 @@ expr_dsp(t_expr *x, t_signal **sp)
         x->exp_error = 0;               /* reset all errors */
         newsize = (x->exp_vsize !=  sp[0]->s_n);
         x->exp_vsize = sp[0]->s_n;      /* record the vector size */
+        for (i = 0; i < x->exp_nexpr; i++)
+                if (x->exp_prog[i] &&
+                    ex_progvsize(x->exp_prog[i], x->exp_vsize)) {
+                        ex_freeprog(x->exp_prog[i]);
+                        x->exp_prog[i] = 0;
+                }
         for (i = 0; i < x->exp_nexpr; i++) {
                 x->exp_res[i].ex_type = ET_VEC;
                 x->exp_res[i].ex_vec =  sp[x->exp_nivec + i]->s_vec;
@@ -864,6 +915,8 @@ int
 ex_getsym(char *p, fts_symbol_t *s)
 {
         *s = gensym(p);
+            /* kept in memory from malloc(), which -symgc can't see */
+        mess_keepsymbol(*s);
         return (0);
 }
 
@@ -875,6 +928,40 @@ ex_symname(fts_symbol_t s)
         return (fts_symbol_name(s));
 }
 
+#ifdef PD
+/*
+ * ex_gettable -- find a table by name, using the expression's cache
+ *                return the array and its read-only points, or 0
+ */
+static t_garray *
+ex_gettable(struct expr *expr, t_symbol *s, int *sizep, t_word **vecp)
+{
+        struct ex_tabcache *tc;
+        int i, serial = garray_resizeserial(), bindserial = pd_bindserial();
+        t_garray *garray;
+
+        for (i = 0, tc = expr->exp_tabcache; i < EX_NTABCACHE; i++, tc++)
+                if (tc->tc_sym == s && tc->tc_serial == serial &&
+                    tc->tc_bindserial == bindserial) {
+                        *sizep = tc->tc_size;
+                        *vecp = tc->tc_vec;
+                        return (tc->tc_garray);
+                }
+        if (!s || !(garray = (t_garray *)pd_findbyclass(s, garray_class)) ||
+            !garray_getfloatwords_readonly(garray, sizep, vecp))
+                return (0);
+        tc = &expr->exp_tabcache[expr->exp_tabnext];
+        expr->exp_tabnext = (expr->exp_tabnext + 1) % EX_NTABCACHE;
+        tc->tc_sym = s;
+        tc->tc_garray = garray;
+        tc->tc_vec = *vecp;
+        tc->tc_size = *sizep;
+        tc->tc_serial = serial;
+        tc->tc_bindserial = bindserial;
+        return (garray);
+}
+#endif
+
 /*
  * max_ex_tab -- evaluate this table access
  *               eptr is the name of the table and arg is the index we
@@ -897,8 +984,7 @@ max_ex_tab(struct expr *expr, fts_symbol_t s, struct ex_ex *arg,
         long indx;
         t_word *wvec;
 
-        if (!s || !(garray = (t_garray *)pd_findbyclass(s, garray_class)) ||
-            !garray_getfloatwords(garray, &size, &wvec))
+        if (!(garray = ex_gettable(expr, s, &size, &wvec)))
         {
                 optr->ex_type = ET_FLT;
                 optr->ex_flt = 0;
@@ -958,7 +1044,9 @@ max_ex_tab_store(struct expr *expr, t_symbol *s, struct ex_ex *arg,
         long indx;
         t_word *wvec;
 
-        if (!s || !(garray = (t_garray *)pd_findbyclass(s, garray_class)) ||
+            /* the cached points are read-only; getting them writably
+            copies them if they're shared with another array */
+        if (!(garray = ex_gettable(expr, s, &size, &wvec)) ||
                 !garray_getfloatwords(garray, &size, &wvec)) {
                 optr->ex_type = ET_FLT;
                 optr->ex_flt = 0;
@@ -1002,7 +1090,7 @@ max_ex_tab_store(struct expr *expr, t_symbol *s, struct ex_ex *arg,
                 optr->ex_flt = 0;
                 return (1);
         }
-                garray_redraw(garray);
+                garray_redrawrange(garray, indx, 1);
                 return(0);
 
 #else /* MSP */
@@ -1037,8 +1125,7 @@ max_ex_var(struct expr *expr, t_symbol *var, struct ex_ex *optr, int idx)
            * should be defined in the expr object in MSP
            */
 #define ISTABLE(sym, garray, size, vec)                               \
-if (!sym || !(garray = (t_garray *)pd_findbyclass(sym, garray_class)) || \
-                !garray_getfloatwords(garray, &size, &vec))  {          \
+if (!(garray = ex_gettable(e, sym, &size, &vec)))  {                    \
         optr->ex_type = ET_FLT;                                         \
         optr->ex_int = 0;                                               \
         pd_error(0, "no such table '%s'", sym?(sym->s_name):"(null)");                       \
@@ -17,6 +17,12 @@ t_libpd_symbolhook libpd_symbolhook = NULL;
 t_libpd_listhook libpd_listhook = NULL;
 t_libpd_messagehook libpd_messagehook = NULL;
 
+t_libpd_contextbanghook libpd_contextbanghook = NULL;
+t_libpd_contextfloathook libpd_contextfloathook = NULL;
+t_libpd_contextsymbolhook libpd_contextsymbolhook = NULL;
+t_libpd_contextlisthook libpd_contextlisthook = NULL;
+t_libpd_contextmessagehook libpd_contextmessagehook = NULL;
+
 t_libpd_noteonhook libpd_noteonhook = NULL;
 t_libpd_controlchangehook libpd_controlchangehook = NULL;
 t_libpd_programchangehook libpd_programchangehook = NULL;
@@ -24,6 +24,12 @@ extern t_libpd_symbolhook libpd_symbolhook;
 extern t_libpd_listhook libpd_listhook;
 extern t_libpd_messagehook libpd_messagehook;
 
+extern t_libpd_contextbanghook libpd_contextbanghook;
+extern t_libpd_contextfloathook libpd_contextfloathook;
+extern t_libpd_contextsymbolhook libpd_contextsymbolhook;
+extern t_libpd_contextlisthook libpd_contextlisthook;
+extern t_libpd_contextmessagehook libpd_contextmessagehook;
+
 extern t_libpd_noteonhook libpd_noteonhook;
 extern t_libpd_controlchangehook libpd_controlchangehook;
 extern t_libpd_programchangehook libpd_programchangehook;
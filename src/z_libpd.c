@@ -14,6 +14,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <limits.h>
+#include <pthread.h>
 #ifndef LIBPD_NO_NUMERIC
 # include <locale.h>
 #endif
@@ -22,7 +23,9 @@
 #include "z_hooks.h"
 #include "s_stuff.h"
 #include "m_imp.h"
+#include "g_canvas.h"
 #include "g_all_guis.h"
+#include "z_ringbuffer.h"
 
 #if PD_MINOR_VERSION < 46
 # define HAVE_SCHED_TICK_ARG
@@ -50,6 +53,8 @@ int sys_pollgui(void);
   void lrshift_tilde_setup(void);
   void pd_tilde_setup(void);
   void pique_setup(void);
+  void rev2_tilde_setup(void);
+  void rev3_tilde_setup(void);
   void sigmund_tilde_setup(void);
   void stdout_setup(void);
 #endif
@@ -64,6 +69,15 @@ static void *get_object(const char *s) {
   return x;
 }
 
+void libpd_set_lazyclasses(int lazy) {
+  sys_lazyclasses = lazy;
+}
+
+void libpd_set_lowmem(int lowmem) {
+  sys_lowmem = lowmem;
+  if (lowmem) sys_lazyclasses = 1;
+}
+
 // this is called instead of sys_main() to start things
 int libpd_init(void) {
   static int s_initialized = 0;
@@ -101,6 +115,8 @@ int libpd_init(void) {
   lrshift_tilde_setup();
   pd_tilde_setup();
   pique_setup();
+  rev2_tilde_setup();
+  rev3_tilde_setup();
   sigmund_tilde_setup();
   stdout_setup();
 #endif
@@ -171,6 +187,152 @@ int libpd_init_audio(int inChannels, int outChannels, int sampleRate) {
   return 0;
 }
 
+/* batched messages: libpd_submit_*() */
+
+// one lock-free queue per instance that asks for one; they're only added and
+// removed with the lock held, and read by the submitting thread without it
+typedef struct _submitqueue {
+  t_pdinstance *q_instance;
+  ring_buffer *q_ring;
+  char *q_temp; // the reader's copy, as big as the ring
+  int q_overflows;
+  struct _submitqueue *q_next;
+} t_submitqueue;
+
+// each message in the ring: this, then argc atoms
+typedef struct _submitparams {
+  enum {
+    SUBMIT_BANG, SUBMIT_FLOAT, SUBMIT_SYMBOL, SUBMIT_LIST, SUBMIT_MESSAGE
+  } p_type;
+  int p_argc;
+  t_symbol *p_recv;
+  t_symbol *p_sel;
+} t_submitparams;
+
+static t_submitqueue *submit_queues = NULL;
+
+static t_submitqueue *submit_getqueue(void) {
+  t_submitqueue *q;
+  for (q = submit_queues; q; q = q->q_next)
+    if (q->q_instance == pd_this) return q;
+  return NULL;
+}
+
+static int submit_write(int type, void *recv, void *sel,
+    int argc, t_atom *argv) {
+  t_submitqueue *q = submit_getqueue();
+  t_submitparams p;
+  int n = argc * (int)sizeof(t_atom);
+  if (!q || !recv) return -1;
+  if (rb_available_to_write(q->q_ring) < (int)sizeof(p) + n) {
+    q->q_overflows++;
+    return -1;
+  }
+  p.p_type = type;
+  p.p_argc = argc;
+  p.p_recv = (t_symbol *)recv;
+  p.p_sel = (t_symbol *)sel;
+  rb_write_to_buffer(q->q_ring, 2,
+    (const char *)&p, (int)sizeof(p), (const char *)argv, n);
+  return 0;
+}
+
+// send everything queued for the current instance; call with the lock held
+static void submit_drain(void) {
+  t_submitqueue *q = submit_getqueue();
+  char *buf, *end;
+  int available;
+  if (!q || !(available = rb_available_to_read(q->q_ring))) return;
+  rb_read_from_buffer(q->q_ring, q->q_temp, available);
+  for (buf = q->q_temp, end = buf + available; buf < end; ) {
+    t_submitparams *p = (t_submitparams *)buf;
+    t_atom *argv = (t_atom *)(buf + sizeof(*p));
+    t_pd *obj = p->p_recv->s_thing;
+    buf += sizeof(*p) + p->p_argc * sizeof(t_atom);
+    if (!obj) continue;
+    switch (p->p_type) {
+      case SUBMIT_BANG: pd_bang(obj); break;
+      case SUBMIT_FLOAT: pd_float(obj, argv->a_w.w_float); break;
+      case SUBMIT_SYMBOL: pd_symbol(obj, argv->a_w.w_symbol); break;
+      case SUBMIT_LIST: pd_list(obj, &s_list, p->p_argc, argv); break;
+      default: pd_typedmess(obj, p->p_sel, p->p_argc, argv); break;
+    }
+  }
+}
+
+#ifdef PDINSTANCE
+static void submit_free(t_pdinstance *x) {
+  t_submitqueue *q, **qp;
+  for (qp = &submit_queues; (q = *qp); qp = &q->q_next)
+    if (q->q_instance == x) {
+      *qp = q->q_next;
+      rb_free(q->q_ring);
+      free(q->q_temp);
+      free(q);
+      return;
+    }
+}
+#endif
+
+int libpd_submit_init(int size) {
+  t_submitqueue *q;
+  if (submit_getqueue()) return -1;
+  if (!(q = (t_submitqueue *)calloc(1, sizeof(*q)))) return -1;
+  if (!(q->q_ring = rb_create(size)) || !(q->q_temp = malloc(size))) {
+    if (q->q_ring) rb_free(q->q_ring);
+    free(q);
+    return -1;
+  }
+  q->q_instance = pd_this;
+  sys_lock();
+  q->q_next = submit_queues;
+  submit_queues = q;
+  sys_unlock();
+  return 0;
+}
+
+void *libpd_intern(const char *name) {
+  t_symbol *x;
+  sys_lock();
+  x = gensym(name);
+  sys_unlock();
+  return x;
+}
+
+void libpd_set_symbol_handle(t_atom *a, void *symbol) {
+  SETSYMBOL(a, (t_symbol *)symbol);
+}
+
+int libpd_submit_bang(void *recv) {
+  return submit_write(SUBMIT_BANG, recv, NULL, 0, NULL);
+}
+
+int libpd_submit_float(void *recv, float x) {
+  t_atom a;
+  SETFLOAT(&a, x);
+  return submit_write(SUBMIT_FLOAT, recv, NULL, 1, &a);
+}
+
+int libpd_submit_symbol(void *recv, void *symbol) {
+  t_atom a;
+  SETSYMBOL(&a, (t_symbol *)symbol);
+  return submit_write(SUBMIT_SYMBOL, recv, NULL, 1, &a);
+}
+
+int libpd_submit_list(void *recv, int argc, t_atom *argv) {
+  return submit_write(SUBMIT_LIST, recv, NULL, argc, argv);
+}
+
+int libpd_submit_message(void *recv, void *msg, int argc, t_atom *argv) {
+  if (!msg) return -1;
+  return submit_write(SUBMIT_MESSAGE, recv, msg, argc, argv);
+}
+
+int libpd_submit_overflows(void) {
+  t_submitqueue *q = submit_getqueue();
+  return (q ? rb_sync_fetch(&q->q_overflows) : 0);
+}
+
 static const t_sample sample_to_short = SHRT_MAX,
                       short_to_sample = 1.0 / (t_sample) SHRT_MAX;
 
@@ -178,6 +340,7 @@ static const t_sample sample_to_short = SHRT_MAX,
   int i, j, k; \
   t_sample *p0, *p1; \
   sys_lock(); \
+  submit_drain(); \
   sys_pollgui(); \
   for (i = 0; i < ticks; i++) { \
     for (j = 0, p0 = STUFF->st_soundin; j < DEFDACBLKSIZE; j++, p0++) { \
@@ -217,6 +380,7 @@ int libpd_process_double(const int ticks, const double *inBuffer, double *outBuf
   t_sample *p; \
   size_t i; \
   sys_lock(); \
+  submit_drain(); \
   sys_pollgui(); \
   for (p = STUFF->st_soundin, i = 0; i < n_in; i++) { \
     *p++ = *inBuffer++ _x; \
@@ -241,6 +405,368 @@ int libpd_process_raw_double(const double *inBuffer, double *outBuffer) {
   PROCESS_RAW(,)
 }
 
+// copy one tick's 64 samples; memcpy if the sample types agree
+#define COPYBLOCK(_to, _from) \
+  if (sizeof(*(_to)) == sizeof(*(_from))) \
+    memcpy((_to), (_from), DEFDACBLKSIZE * sizeof(*(_to))); \
+  else for (j = 0; j < DEFDACBLKSIZE; j++) (_to)[j] = (_from)[j];
+
+#define PROCESS_PLANAR \
+  size_t nframes = (size_t)ticks * DEFDACBLKSIZE; \
+  int i, j, k; \
+  sys_lock(); \
+  submit_drain(); \
+  sys_pollgui(); \
+  for (i = 0; i < ticks; i++) { \
+    for (k = 0; k < STUFF->st_inchannels; k++) { \
+      COPYBLOCK(STUFF->st_soundin + k * DEFDACBLKSIZE, \
+        inBuffer + k * nframes + i * DEFDACBLKSIZE) \
+    } \
+    memset(STUFF->st_soundout, 0, \
+        STUFF->st_outchannels*DEFDACBLKSIZE*sizeof(t_sample)); \
+    SCHED_TICK(pd_this->pd_systime + STUFF->st_time_per_dsp_tick); \
+    for (k = 0; k < STUFF->st_outchannels; k++) { \
+      COPYBLOCK(outBuffer + k * nframes + i * DEFDACBLKSIZE, \
+        STUFF->st_soundout + k * DEFDACBLKSIZE) \
+    } \
+  } \
+  sys_unlock(); \
+  return 0;
+
+int libpd_process_planar_float(const int ticks,
+    const float *inBuffer, float *outBuffer) {
+  PROCESS_PLANAR
+}
+
+int libpd_process_planar_double(const int ticks,
+    const double *inBuffer, double *outBuffer) {
+  PROCESS_PLANAR
+}
+
+/* processing any number of frames */
+
+// a tick's worth of input being collected, and of output from the previous
+// tick being handed out, per instance; like the submit queues, only added and
+// removed with the lock held
+typedef struct _framefifo {
+  t_pdinstance *f_instance;
+  int f_inchannels;
+  int f_outchannels;
+  int f_pos;            // frames into the current tick
+  t_sample *f_in;       // planar, DEFDACBLKSIZE per channel
+  t_sample *f_out;
+  struct _framefifo *f_next;
+} t_framefifo;
+
+static t_framefifo *frame_fifos = NULL;
+
+// get the current instance's FIFO for its channel counts; call with the lock
+static t_framefifo *frame_getfifo(void) {
+  t_framefifo *f;
+  int nin = STUFF->st_inchannels, nout = STUFF->st_outchannels;
+  for (f = frame_fifos; f; f = f->f_next)
+    if (f->f_instance == pd_this) break;
+  if (f && f->f_inchannels == nin && f->f_outchannels == nout)
+    return f;
+  if (!f) {
+    if (!(f = (t_framefifo *)calloc(1, sizeof(*f)))) return NULL;
+    f->f_instance = pd_this;
+    f->f_next = frame_fifos;
+    frame_fifos = f;
+  }
+  free(f->f_in);
+  free(f->f_out);
+  f->f_in = (t_sample *)calloc((nin ? nin : 1) * DEFDACBLKSIZE,
+    sizeof(t_sample));
+  f->f_out = (t_sample *)calloc((nout ? nout : 1) * DEFDACBLKSIZE,
+    sizeof(t_sample));
+  f->f_inchannels = nin;
+  f->f_outchannels = nout;
+  f->f_pos = 0;
+  if (!f->f_in || !f->f_out) {
+    f->f_inchannels = f->f_outchannels = -1; // try again next time
+    return NULL;
+  }
+  return f;
+}
+
+#ifdef PDINSTANCE
+static void frame_free(t_pdinstance *x) {
+  t_framefifo *f, **fp;
+  for (fp = &frame_fifos; (f = *fp); fp = &f->f_next)
+    if (f->f_instance == x) {
+      *fp = f->f_next;
+      free(f->f_in);
+      free(f->f_out);
+      free(f);
+      return;
+    }
+}
+#endif
+
+// hand the caller's frames to the FIFO a chunk at a time, running a tick
+// each time it fills; the caller's buffers hold samples of _type, with
+// channels _instride (_outstride) apart and frames _instep (_outstep) apart
+#define PROCESS_FRAMES(_type, _instride, _instep, _outstride, _outstep) \
+  t_framefifo *f; \
+  int done = 0, n, j, k; \
+  sys_lock(); \
+  submit_drain(); \
+  sys_pollgui(); \
+  if (!(f = frame_getfifo())) { \
+    sys_unlock(); \
+    return -1; \
+  } \
+  while (done < frames) { \
+    n = DEFDACBLKSIZE - f->f_pos; \
+    if (n > frames - done) n = frames - done; \
+    for (k = 0; k < f->f_inchannels; k++) { \
+      t_sample *fp = f->f_in + k * DEFDACBLKSIZE + f->f_pos; \
+      const _type *ip = inBuffer + k * (_instride) + done * (_instep); \
+      for (j = 0; j < n; j++, ip += (_instep)) fp[j] = *ip; \
+    } \
+    for (k = 0; k < f->f_outchannels; k++) { \
+      t_sample *fp = f->f_out + k * DEFDACBLKSIZE + f->f_pos; \
+      _type *op = outBuffer + k * (_outstride) + done * (_outstep); \
+      for (j = 0; j < n; j++, op += (_outstep)) *op = fp[j]; \
+    } \
+    done += n; \
+    if ((f->f_pos += n) == DEFDACBLKSIZE) { \
+      memcpy(STUFF->st_soundin, f->f_in, \
+        f->f_inchannels * DEFDACBLKSIZE * sizeof(t_sample)); \
+      memset(STUFF->st_soundout, 0, \
+        f->f_outchannels * DEFDACBLKSIZE * sizeof(t_sample)); \
+      SCHED_TICK(pd_this->pd_systime + STUFF->st_time_per_dsp_tick); \
+      memcpy(f->f_out, STUFF->st_soundout, \
+        f->f_outchannels * DEFDACBLKSIZE * sizeof(t_sample)); \
+      f->f_pos = 0; \
+    } \
+  } \
+  sys_unlock(); \
+  return 0;
+
+int libpd_process_frames_float(const int frames,
+    const float *inBuffer, float *outBuffer) {
+  PROCESS_FRAMES(float, 1, f->f_inchannels, 1, f->f_outchannels)
+}
+
+int libpd_process_frames_double(const int frames,
+    const double *inBuffer, double *outBuffer) {
+  PROCESS_FRAMES(double, 1, f->f_inchannels, 1, f->f_outchannels)
+}
+
+int libpd_process_frames_planar_float(const int frames,
+    const float *inBuffer, float *outBuffer) {
+  PROCESS_FRAMES(float, frames, 1, frames, 1)
+}
+
+int libpd_process_frames_planar_double(const int frames,
+    const double *inBuffer, double *outBuffer) {
+  PROCESS_FRAMES(double, frames, 1, frames, 1)
+}
+
+int libpd_frames_latency(void) {
+  return DEFDACBLKSIZE;
+}
+
+/* threaded engine */
+
+// a thread per instance running ticks between two slot queues of
+// interleaved ticks; the list is walked by hosts' audio threads, so it has a
+// mutex of its own rather than Pd's lock
+typedef struct _engine {
+  t_pdinstance *e_instance;
+  pthread_t e_thread;
+  slot_queue *e_in;
+  slot_queue *e_out;
+  int e_inchannels;     // channels per slot, fixed when started
+  int e_outchannels;
+  float *e_tick;        // the thread's copy of one tick (in or out)
+  int e_running;        // cleared to stop the thread
+  int e_waiting;        // the thread is (about to be) asleep
+  int e_xruns;
+  pthread_mutex_t e_mutex;
+  pthread_cond_t e_cond;
+  struct _engine *e_next;
+} t_engine;
+
+static t_engine *engines = NULL;
+static pthread_mutex_t engines_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static t_engine *engine_get(void) {
+  t_engine *e;
+  pthread_mutex_lock(&engines_mutex);
+  for (e = engines; e; e = e->e_next)
+    if (e->e_instance == pd_this) break;
+  pthread_mutex_unlock(&engines_mutex);
+  return e;
+}
+
+static int engine_slots(slot_queue *q) {
+  return q->n_slots - 1 - sq_available_to_read(q);
+}
+
+static void engine_wake(t_engine *e) {
+  if (rb_sync_fetch(&e->e_waiting)) {
+    pthread_mutex_lock(&e->e_mutex);
+    rb_sync_cas(&e->e_waiting, 1, 0);
+    pthread_cond_signal(&e->e_cond);
+    pthread_mutex_unlock(&e->e_mutex);
+  }
+}
+
+static void *engine_thread(void *z) {
+  t_engine *e = (t_engine *)z;
+  int j, k, nin, nout;
+#ifdef PDINSTANCE
+  pd_setinstance(e->e_instance);
+#endif
+  while (rb_sync_fetch(&e->e_running)) {
+    if (!sq_available_to_read(e->e_in) || !engine_slots(e->e_out)) {
+        // nothing to do: sleep until the host wakes us, checking again
+        // after saying so in case it just did something
+      pthread_mutex_lock(&e->e_mutex);
+      rb_sync_cas(&e->e_waiting, 0, 1);
+      if (rb_sync_fetch(&e->e_running) &&
+        (!sq_available_to_read(e->e_in) || !engine_slots(e->e_out))) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        if ((ts.tv_nsec += 10000000) >= 1000000000) {
+          ts.tv_sec++;
+          ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&e->e_cond, &e->e_mutex, &ts);
+      }
+      rb_sync_cas(&e->e_waiting, 1, 0);
+      pthread_mutex_unlock(&e->e_mutex);
+      continue;
+    }
+    sq_read(e->e_in, e->e_tick, 1);
+    sys_lock();
+    submit_drain();
+    sys_pollgui();
+      // libpd_init_audio() may have changed Pd's channel counts since the
+      // engine started; only copy what both sides have, and zero the rest
+    nin = (e->e_inchannels < STUFF->st_inchannels ?
+      e->e_inchannels : STUFF->st_inchannels);
+    nout = (e->e_outchannels < STUFF->st_outchannels ?
+      e->e_outchannels : STUFF->st_outchannels);
+    for (k = 0; k < nin; k++)
+      for (j = 0; j < DEFDACBLKSIZE; j++)
+        STUFF->st_soundin[k * DEFDACBLKSIZE + j] =
+          e->e_tick[j * e->e_inchannels + k];
+    memset(STUFF->st_soundin + nin * DEFDACBLKSIZE, 0,
+      (STUFF->st_inchannels - nin) * DEFDACBLKSIZE * sizeof(t_sample));
+    memset(STUFF->st_soundout, 0,
+      STUFF->st_outchannels * DEFDACBLKSIZE * sizeof(t_sample));
+    SCHED_TICK(pd_this->pd_systime + STUFF->st_time_per_dsp_tick);
+    for (k = 0; k < e->e_outchannels; k++)
+      for (j = 0; j < DEFDACBLKSIZE; j++)
+        e->e_tick[j * e->e_outchannels + k] = (k < nout ?
+          STUFF->st_soundout[k * DEFDACBLKSIZE + j] : 0);
+    sys_unlock();
+    sq_write(e->e_out, e->e_tick);
+  }
+  return NULL;
+}
+
+static void engine_free(t_engine *e) {
+  if (e->e_in) sq_free(e->e_in);
+  if (e->e_out) sq_free(e->e_out);
+  free(e->e_tick);
+  pthread_mutex_destroy(&e->e_mutex);
+  pthread_cond_destroy(&e->e_cond);
+  free(e);
+}
+
+int libpd_engine_start(int ahead) {
+  t_engine *e;
+  int nslots = 2, nin, nout, i;
+  float *silence;
+  if (ahead < 1) ahead = 1;
+  if (engine_get() || !(e = (t_engine *)calloc(1, sizeof(*e)))) return -1;
+  pthread_mutex_init(&e->e_mutex, NULL);
+  pthread_cond_init(&e->e_cond, NULL);
+  while (nslots < ahead + 2) nslots *= 2;
+  sys_lock();
+  nin = e->e_inchannels = STUFF->st_inchannels;
+  nout = e->e_outchannels = STUFF->st_outchannels;
+  sys_unlock();
+    // slots must have some size even with no channels
+  e->e_in = sq_create(nslots, (nin ? nin : 1) * DEFDACBLKSIZE * sizeof(float));
+  e->e_out = sq_create(nslots,
+    (nout ? nout : 1) * DEFDACBLKSIZE * sizeof(float));
+  e->e_tick = (float *)calloc(((nin > nout ? nin : nout) + 1) * DEFDACBLKSIZE,
+    sizeof(float));
+  if (!e->e_in || !e->e_out || !e->e_tick) {
+    engine_free(e);
+    return -1;
+  }
+    // the host's first ahead ticks of output are silence
+  silence = e->e_tick;
+  for (i = 0; i < ahead; i++) sq_write(e->e_out, silence);
+  e->e_instance = pd_this;
+  e->e_running = 1;
+  if (pthread_create(&e->e_thread, NULL, engine_thread, e)) {
+    engine_free(e);
+    return -1;
+  }
+  pthread_mutex_lock(&engines_mutex);
+  e->e_next = engines;
+  engines = e;
+  pthread_mutex_unlock(&engines_mutex);
+  return 0;
+}
+
+void libpd_engine_stop(void) {
+  t_engine *e = engine_get(), **ep;
+  if (!e) return;
+  rb_sync_cas(&e->e_running, 1, 0);
+  pthread_mutex_lock(&e->e_mutex);
+  pthread_cond_signal(&e->e_cond);
+  pthread_mutex_unlock(&e->e_mutex);
+  pthread_join(e->e_thread, NULL);
+  pthread_mutex_lock(&engines_mutex);
+  for (ep = &engines; *ep; ep = &(*ep)->e_next)
+    if (*ep == e) {
+      *ep = e->e_next;
+      break;
+    }
+  pthread_mutex_unlock(&engines_mutex);
+  engine_free(e);
+}
+
+int libpd_engine_process_float(const int ticks,
+    const float *inBuffer, float *outBuffer) {
+  t_engine *e = engine_get();
+  int nin, nout, i, missed = 0, dropped = 0;
+  float dummy[DEFDACBLKSIZE] = {0};
+  if (!e) return -1;
+  nin = e->e_inchannels * DEFDACBLKSIZE;
+  nout = e->e_outchannels * DEFDACBLKSIZE;
+    // without channels the slots still pace the engine, one per tick
+  for (i = 0; i < ticks; i++)
+    if (sq_write(e->e_in, (nin ? inBuffer + i * nin : dummy)) < 0)
+      dropped++;
+  engine_wake(e);
+  for (i = 0; i < ticks; i++) {
+    float *out = outBuffer + i * nout;
+    if (sq_read(e->e_out, (nout ? out : dummy), 1) < 1) {
+      memset(out, 0, nout * sizeof(float));
+      missed++;
+    }
+  }
+    // only this thread changes the count
+  if (dropped + missed)
+    rb_sync_cas(&e->e_xruns, e->e_xruns, e->e_xruns + dropped + missed);
+  return missed;
+}
+
+int libpd_engine_xruns(void) {
+  t_engine *e = engine_get();
+  return (e ? rb_sync_fetch(&e->e_xruns) : 0);
+}
+
 #define GETARRAY \
   t_garray *garray = (t_garray *) pd_findbyclass(gensym(name), garray_class); \
   if (!garray) {sys_unlock(); return -1;} \
@@ -262,27 +788,67 @@ int libpd_resize_array(const char *name, long size) {
   return 0;
 }
 
-#define MEMCPY(_x, _y) \
+// copy whole blocks if t_words are just floats (32-bit systems)
+#if PD_FLOATSIZE == 32
+#define WORDSAREFLOATS (sizeof(t_word) == sizeof(float))
+#else
+#define WORDSAREFLOATS 0
+#endif
+
+// reading leaves points that may be shared with other arrays alone
+static t_word *libpd_readonlywords(t_garray *garray) {
+  int n;
+  t_word *vec;
+  return garray_getfloatwords_readonly(garray, &n, &vec) ? vec : NULL;
+}
+
+#define MEMCPY(_getvec, _x, _y, _block) \
   GETARRAY \
-  if (n < 0 || offset < 0 || offset + n > garray_npoints(garray)) return -2; \
-  t_word *vec = ((t_word *) garray_vec(garray)) + offset; \
+  if (n < 0 || offset < 0 || offset + n > garray_npoints(garray)) { \
+    sys_unlock(); \
+    return -2; \
+  } \
+  t_word *vec = ((t_word *) _getvec(garray)) + offset; \
   int i; \
-  for (i = 0; i < n; i++) _x = _y;
+  if (WORDSAREFLOATS) _block; \
+  else for (i = 0; i < n; i++) _x = _y;
 
 int libpd_read_array(float *dest, const char *name, int offset, int n) {
   sys_lock();
-  MEMCPY(*dest++, (vec++)->w_float)
+  MEMCPY(libpd_readonlywords, *dest++, (vec++)->w_float,
+    memcpy(dest, vec, n * sizeof(float)))
   sys_unlock();
   return 0;
 }
 
 int libpd_write_array(const char *name, int offset, const float *src, int n) {
   sys_lock();
-  MEMCPY((vec++)->w_float, *src++)
+  MEMCPY(garray_vec, (vec++)->w_float, *src++,
+    memcpy(vec, src, n * sizeof(float)))
   sys_unlock();
   return 0;
 }
 
+t_float *libpd_array_view(const char *name, int *size, int *stride) {
+  t_garray *garray;
+  t_float *retval = NULL;
+  int n;
+  t_word *vec;
+  sys_lock();
+  garray = (t_garray *) pd_findbyclass(gensym(name), garray_class);
+  if (garray && garray_getfloatwords(garray, &n, &vec)) {
+    *size = n;
+    *stride = sizeof(t_word) / sizeof(t_float);
+    retval = &vec->w_float;
+  }
+  sys_unlock();
+  return retval;
+}
+
+int libpd_array_generation(void) {
+  return glist_valid;
+}
+
 int libpd_bang(const char *recv) {
   void *obj;
   sys_lock();
@@ -406,6 +972,14 @@ void *libpd_bind(const char *recv) {
   return libpdreceive_new(x);
 }
 
+void *libpd_bind_context(const char *recv, void *context) {
+  t_symbol *x;
+  sys_lock();
+  x = gensym(recv);
+  sys_unlock();
+  return libpdreceive_new_context(x, context);
+}
+
 void libpd_unbind(void *p) {
   sys_lock();
   pd_free((t_pd *)p);
@@ -444,6 +1018,26 @@ void libpd_set_messagehook(const t_libpd_messagehook hook) {
   libpd_messagehook = hook;
 }
 
+void libpd_set_contextbanghook(const t_libpd_contextbanghook hook) {
+  libpd_contextbanghook = hook;
+}
+
+void libpd_set_contextfloathook(const t_libpd_contextfloathook hook) {
+  libpd_contextfloathook = hook;
+}
+
+void libpd_set_contextsymbolhook(const t_libpd_contextsymbolhook hook) {
+  libpd_contextsymbolhook = hook;
+}
+
+void libpd_set_contextlisthook(const t_libpd_contextlisthook hook) {
+  libpd_contextlisthook = hook;
+}
+
+void libpd_set_contextmessagehook(const t_libpd_contextmessagehook hook) {
+  libpd_contextmessagehook = hook;
+}
+
 int libpd_is_float(t_atom *a) {
   return (a)->a_type == A_FLOAT;
 }
@@ -620,8 +1214,146 @@ void libpd_set_instance(t_pdinstance *p) {
 #endif
 }
 
+#ifdef PDINSTANCE
+// what libpd_clone_instance() takes from the source instance
+typedef struct _clonepatch {
+  t_binbuf *p_binbuf;
+  t_symbol *p_name, *p_dir;
+} t_clonepatch;
+
+typedef struct _clonearray {
+  t_symbol *a_name;
+  int a_n;
+  t_word *a_vec;
+} t_clonearray;
+
+// whether an instance has a toplevel patch of a name, looked up by string
+// since every instance has its own symbols
+static int clone_haspatch(t_pdinstance *x, t_symbol *name) {
+  t_canvas *gl;
+  for (gl = x->pd_canvaslist; gl; gl = gl->gl_next)
+    if (!strcmp(gl->gl_name->s_name, name->s_name))
+      return 1;
+  return 0;
+}
+
+static void clone_getarrays(t_glist *gl, t_clonearray **vec, int *n) {
+  t_gobj *y;
+  for (y = gl->gl_list; y; y = y->g_next) {
+    if (pd_class(&y->g_pd) == canvas_class)
+      clone_getarrays((t_glist *)y, vec, n);
+    else if (pd_class(&y->g_pd) == garray_class) {
+      t_clonearray *a;
+      t_word *w;
+      int size;
+      if (!garray_getfloatwords((t_garray *)y, &size, &w))
+        continue;
+      *vec = (t_clonearray *)resizebytes(*vec, *n * sizeof(**vec),
+        (*n + 1) * sizeof(**vec));
+      a = &(*vec)[(*n)++];
+      a->a_name = garray_getrealname((t_garray *)y);
+      a->a_n = size;
+      a->a_vec = (t_word *)getbytes(size * sizeof(t_word));
+      memcpy(a->a_vec, w, size * sizeof(t_word));
+    }
+  }
+}
+#endif
+
+t_pdinstance *libpd_clone_instance(t_pdinstance *from) {
+#ifdef PDINSTANCE
+  t_pdinstance *x = pdinstance_new();
+  t_clonepatch *patches;
+  t_clonearray *arrays = 0;
+  t_canvas *gl;
+  int npatches = 0, narrays = 0, i, inchans, outchans, srate, dspstate;
+
+  // take a snapshot of the source's patches and arrays as they are now,
+  // except for the ones every new instance starts with (the templates)
+  pd_setinstance(from);
+  sys_lock();
+  for (gl = pd_getcanvaslist(); gl; gl = gl->gl_next)
+    if (!clone_haspatch(x, gl->gl_name))
+      npatches++;
+  patches = (t_clonepatch *)getbytes(npatches * sizeof(*patches));
+  // the list is newest first; keep the order in which they were opened
+  for (gl = pd_getcanvaslist(), i = npatches; gl; gl = gl->gl_next) {
+    t_clonepatch *p;
+    if (clone_haspatch(x, gl->gl_name))
+      continue;
+    p = &patches[--i];
+    p->p_binbuf = binbuf_new();
+    mess1(&gl->gl_pd, gensym("saveto"), p->p_binbuf);
+    p->p_name = gl->gl_name;
+    p->p_dir = canvas_getdir(gl);
+    clone_getarrays(gl, &arrays, &narrays);
+  }
+  inchans = STUFF->st_inchannels;
+  outchans = STUFF->st_outchannels;
+  srate = STUFF->st_dacsr;
+  dspstate = pd_getdspstate();
+
+  // translate the symbols into the new instance, which nobody else can see
+  // yet, while the source's are safe to read
+  pd_setinstance(x);
+  for (i = 0; i < npatches; i++) {
+    binbuf_gensyms(patches[i].p_binbuf);
+    patches[i].p_name = gensym(patches[i].p_name->s_name);
+    patches[i].p_dir = gensym(patches[i].p_dir->s_name);
+  }
+  for (i = 0; i < narrays; i++)
+    arrays[i].a_name = gensym(arrays[i].a_name->s_name);
+  binbuf_copyfilecache(from);
+  pd_setinstance(from);
+  sys_unlock();
+
+  // rebuild the patches from the snapshot; abstractions come from the
+  // copied file cache without reading them again
+  pd_setinstance(x);
+  libpd_init_audio(inchans, outchans, srate);
+  sys_lock();
+  for (i = 0; i < npatches; i++) {
+    glob_evalpatch(patches[i].p_binbuf, patches[i].p_name, patches[i].p_dir);
+    binbuf_free(patches[i].p_binbuf);
+  }
+  freebytes(patches, npatches * sizeof(*patches));
+  for (i = 0; i < narrays; i++) {
+    t_garray *a = (t_garray *)pd_findbyclass(arrays[i].a_name, garray_class);
+    t_word *w;
+    int size;
+    if (a) {
+      if (garray_npoints(a) != arrays[i].a_n)
+        garray_resize_long(a, arrays[i].a_n);
+      if (garray_getfloatwords(a, &size, &w) && size == arrays[i].a_n) {
+        memcpy(w, arrays[i].a_vec, size * sizeof(t_word));
+        garray_redraw(a);
+      }
+    }
+    freebytes(arrays[i].a_vec, arrays[i].a_n * sizeof(t_word));
+  }
+  freebytes(arrays, narrays * sizeof(*arrays));
+  sys_unlock();
+  if (dspstate) {
+    libpd_start_message(1);
+    libpd_add_float(1.0f);
+    libpd_finish_message("pd", "dsp");
+  }
+  return x;
+#else
+  return 0;
+#endif
+}
+
 void libpd_free_instance(t_pdinstance *p) {
 #ifdef PDINSTANCE
+  t_pdinstance *cur = pd_this;
+  pd_setinstance(p);
+  libpd_engine_stop();
+  pd_setinstance(cur);
+  sys_lock();
+  submit_free(p);
+  frame_free(p);
+  sys_unlock();
   pdinstance_free(p);
 #endif
 }
@@ -656,6 +1388,25 @@ int libpd_get_verbose(void) {
   return sys_verbose;
 }
 
+void libpd_set_dspprofile(int on) {
+  sys_lock();
+  ugen_setprofile(on);
+  sys_unlock();
+}
+
+static void libpd_profilehook(void *data, const char *name, const char *owner,
+  double load, double usec) {
+  (*(t_libpd_profilehook)data)(name, owner, load, usec);
+}
+
+int libpd_get_dspprofile(const t_libpd_profilehook hook) {
+  int n;
+  sys_lock();
+  n = ugen_getprofile(libpd_profilehook, (void *)hook);
+  sys_unlock();
+  return n;
+}
+
 // dummy routines needed because we don't use s_file.c
 void glob_loadpreferences(t_pd *dummy, t_symbol *s) {}
 void glob_savepreferences(t_pd *dummy, t_symbol *s) {}
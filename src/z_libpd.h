@@ -27,6 +27,15 @@ extern "C"
 ///       by 0, set any custom handling after calling this function
 EXTERN int libpd_init(void);
 
+/// set up pd's built-in classes only when a patch first uses them: 0 or 1
+/// note: call this before libpd_init(), after which it has no effect
+EXTERN void libpd_set_lazyclasses(int lazy);
+
+/// trade speed for a small memory footprint: 0 or 1
+/// note: this implies libpd_set_lazyclasses(1), starts the symbol table small
+///       and does without method hash tables; call it before libpd_init()
+EXTERN void libpd_set_lowmem(int lowmem);
+
 /// clear the libpd search path for abstractions and externals
 /// note: this is called by libpd_init()
 EXTERN void libpd_clear_search_path(void);
@@ -106,6 +115,89 @@ EXTERN int libpd_process_raw_short(const short *inBuffer, short *outBuffer);
 /// returns 0 on success
 EXTERN int libpd_process_raw_double(const double *inBuffer, double *outBuffer);
 
+/// process non-interleaved float samples for several ticks at once
+/// each channel is a contiguous run of ticks * libpd_blocksize() samples, so
+/// buffer sizes are, as for libpd_process_float():
+///     size = ticks * libpd_blocksize() * (in/out)channels
+/// channel k of inBuffer starts at inBuffer + k * ticks * libpd_blocksize()
+/// the lock is taken and the message queue polled once for the whole call
+/// returns 0 on success
+EXTERN int libpd_process_planar_float(const int ticks,
+    const float *inBuffer, float *outBuffer);
+
+/// process non-interleaved double samples for several ticks at once
+/// see libpd_process_planar_float() for the buffer layout
+/// returns 0 on success
+EXTERN int libpd_process_planar_double(const int ticks,
+    const double *inBuffer, double *outBuffer);
+
+/// process any number of interleaved float frames, not just whole ticks
+/// an internal FIFO collects input until it has a tick's worth and hands out
+/// output from the tick before, keeping its place between calls, so buffer
+/// sizes are frames * (in/out)channels and the output is delayed by
+/// libpd_frames_latency() frames; don't mix this with the tick-based calls
+/// note: the FIFO is (re)allocated on the first call after the channel
+///       counts change
+/// returns 0 on success or -1 on failure
+EXTERN int libpd_process_frames_float(const int frames,
+    const float *inBuffer, float *outBuffer);
+
+/// process any number of interleaved double frames
+/// see libpd_process_frames_float()
+/// returns 0 on success or -1 on failure
+EXTERN int libpd_process_frames_double(const int frames,
+    const double *inBuffer, double *outBuffer);
+
+/// process any number of non-interleaved float frames: channel k of inBuffer
+/// starts at inBuffer + k * frames
+/// see libpd_process_frames_float()
+/// returns 0 on success or -1 on failure
+EXTERN int libpd_process_frames_planar_float(const int frames,
+    const float *inBuffer, float *outBuffer);
+
+/// process any number of non-interleaved double frames
+/// see libpd_process_frames_planar_float()
+/// returns 0 on success or -1 on failure
+EXTERN int libpd_process_frames_planar_double(const int frames,
+    const double *inBuffer, double *outBuffer);
+
+/// get the latency in frames that libpd_process_frames_*() adds, which is
+/// always one tick (libpd_blocksize())
+EXTERN int libpd_frames_latency(void);
+
+/* threaded engine */
+
+/// start a thread that runs the current instance's ticks on its own, up to
+/// ahead ticks ahead of the host; the host then exchanges audio with
+/// libpd_engine_process_float() without waiting for pd's computation, and
+/// the output is delayed by ahead ticks (at least 1)
+/// the channel counts are those from libpd_init_audio() when the engine
+/// starts; if it's called again meanwhile, channels pd no longer has are
+/// silent until the engine is restarted; messages can still
+/// be sent with libpd_float() etc. (which wait for the lock) or, better, with
+/// libpd_submit_*(), which the engine drains before each tick
+/// note: don't call the other libpd_process_*() functions for this instance
+///       while its engine is running
+/// returns 0 on success or -1 on failure (or if one is already running)
+EXTERN int libpd_engine_start(int ahead);
+
+/// stop the current instance's engine thread, waiting for it to finish
+EXTERN void libpd_engine_stop(void);
+
+/// hand ticks of interleaved float input to the engine and collect as many
+/// ticks of output, sizes as for libpd_process_float()
+/// never waits: output that isn't ready yet is filled with silence, and
+/// input that doesn't fit is dropped, both counted in libpd_engine_xruns()
+/// note: call from a single thread at a time
+/// returns the number of output ticks that weren't ready, or -1 if the
+///         engine isn't running
+EXTERN int libpd_engine_process_float(const int ticks,
+    const float *inBuffer, float *outBuffer);
+
+/// get the number of ticks missed (output not ready or input dropped) since
+/// the engine started
+EXTERN int libpd_engine_xruns(void);
+
 /* array access */
 
 /// get the size of an array by name
@@ -129,6 +221,20 @@ EXTERN int libpd_read_array(float *dest, const char *name, int offset, int n);
 EXTERN int libpd_write_array(const char *name, int offset,
 	const float *src, int n);
 
+/// get direct access to the values of a named array, without copying
+/// returns a pointer to the first value or NULL if the array is non-existent,
+/// and sets size to the number of values and stride to the distance from one
+/// value to the next, counted in t_floats (values are stored in t_words,
+/// which can be bigger than a t_float): value i is at pointer[i * stride]
+/// note: the pointer stays valid only while libpd_array_generation() returns
+///       the same value, and should only be used from the thread calling
+///       libpd_process_*() functions, or while they aren't being called
+EXTERN t_float *libpd_array_view(const char *name, int *size, int *stride);
+
+/// get a counter that changes whenever any array's storage is reallocated or
+/// freed, invalidating pointers from libpd_array_view()
+EXTERN int libpd_array_generation(void);
+
 /* sending messages to pd */
 
 /// send a bang to a destination receiver
@@ -207,6 +313,40 @@ EXTERN int libpd_list(const char *recv, int argc, t_atom *argv);
 EXTERN int libpd_message(const char *recv, const char *msg,
 	int argc, t_atom *argv);
 
+/* sending messages to pd in batches */
+
+/// set up a lock-free queue of messages to the current instance, of size
+/// bytes (a multiple of 256), which the libpd_submit_*() functions fill from
+/// one other thread without taking the lock; the queue is emptied into pd
+/// at the start of each libpd_process_*() call, in order, before any DSP
+/// note: call once per instance, before any libpd_submit_*() call
+/// returns 0 on success or -1 on failure
+EXTERN int libpd_submit_init(int size);
+
+/// get a handle for a receiver or symbol name to use with libpd_submit_*()
+/// this takes the lock, so get handles ahead of time; they stay valid for
+/// the life of the instance even when nothing is bound to the name
+EXTERN void *libpd_intern(const char *name);
+
+/// write a symbol from a libpd_intern() handle to the given atom without
+/// taking the lock
+EXTERN void libpd_set_symbol_handle(t_atom *a, void *symbol);
+
+/// queue a bang, float, symbol, list or typed message to a receiver handle
+/// symbols (and symbols in lists) must come from libpd_intern()
+/// messages to receivers that don't exist at processing time are dropped
+/// note: call from a single thread at a time
+/// returns 0 on success or -1 if the queue is full or not set up
+EXTERN int libpd_submit_bang(void *recv);
+EXTERN int libpd_submit_float(void *recv, float x);
+EXTERN int libpd_submit_symbol(void *recv, void *symbol);
+EXTERN int libpd_submit_list(void *recv, int argc, t_atom *argv);
+EXTERN int libpd_submit_message(void *recv, void *msg,
+    int argc, t_atom *argv);
+
+/// get the number of messages dropped because the queue was full
+EXTERN int libpd_submit_overflows(void);
+
 /* receiving messages from pd */
 
 /// subscribe to messages sent to a source receiver
@@ -297,6 +437,53 @@ EXTERN void libpd_set_listhook(const t_libpd_listhook hook);
 /// note: do not call this while DSP is running
 EXTERN void libpd_set_messagehook(const t_libpd_messagehook hook);
 
+/* receiving messages by context */
+
+/// subscribe to messages sent to a source receiver like libpd_bind(), but
+/// deliver them to the context hooks below with the given host pointer
+/// instead of the receiver name, so that the host doesn't have to look the
+/// name up; context can be an object of the host's or an integer handle
+/// cast to void *
+/// messages for which no context hook is set go to the named hooks above
+/// returns an opaque receiver pointer (for libpd_unbind()) or NULL on failure
+EXTERN void *libpd_bind_context(const char *recv, void *context);
+
+/// context bang receive hook signature, context is from libpd_bind_context()
+typedef void (*t_libpd_contextbanghook)(void *context);
+
+/// context float receive hook signature
+typedef void (*t_libpd_contextfloathook)(void *context, float x);
+
+/// context symbol receive hook signature
+typedef void (*t_libpd_contextsymbolhook)(void *context, const char *symbol);
+
+/// context list receive hook signature, see t_libpd_listhook
+typedef void (*t_libpd_contextlisthook)(void *context, int argc, t_atom *argv);
+
+/// context typed message hook signature, see t_libpd_messagehook
+typedef void (*t_libpd_contextmessagehook)(void *context, const char *msg,
+    int argc, t_atom *argv);
+
+/// set the context bang receiver hook, NULL by default
+/// note: do not call this while DSP is running
+EXTERN void libpd_set_contextbanghook(const t_libpd_contextbanghook hook);
+
+/// set the context float receiver hook, NULL by default
+/// note: do not call this while DSP is running
+EXTERN void libpd_set_contextfloathook(const t_libpd_contextfloathook hook);
+
+/// set the context symbol receiver hook, NULL by default
+/// note: do not call this while DSP is running
+EXTERN void libpd_set_contextsymbolhook(const t_libpd_contextsymbolhook hook);
+
+/// set the context list receiver hook, NULL by default
+/// note: do not call this while DSP is running
+EXTERN void libpd_set_contextlisthook(const t_libpd_contextlisthook hook);
+
+/// set the context message receiver hook, NULL by default
+/// note: do not call this while DSP is running
+EXTERN void libpd_set_contextmessagehook(const t_libpd_contextmessagehook hook);
+
 /// check if an atom is a float type: 0 or 1
 /// note: no NULL check is performed
 EXTERN int libpd_is_float(t_atom *a);
@@ -477,6 +664,14 @@ EXTERN int libpd_poll_gui(void);
 /// returns new instance or NULL when libpd is not compiled with PDINSTANCE
 EXTERN t_pdinstance *libpd_new_instance(void);
 
+/// create a new pd instance running the same patches as an existing one
+/// the patches are copied in memory as they would be saved, along with the
+/// contents of their arrays, the audio settings and the DSP state; files
+/// the source has cached, such as abstractions, aren't read again
+/// sets the current instance to the new one
+/// returns new instance or NULL when libpd is not compiled with PDINSTANCE
+EXTERN t_pdinstance *libpd_clone_instance(t_pdinstance *from);
+
 /// set the current pd instance
 /// subsequent libpd calls will affect this instance only
 /// does nothing when libpd is not compiled with PDINSTANCE
@@ -506,6 +701,24 @@ EXTERN void libpd_set_verbose(int verbose);
 /// get the verbose print state: 0 or 1
 EXTERN int libpd_get_verbose(void);
 
+/* DSP profiling */
+
+/// turn the per-object DSP profiler on (1) or off (0)
+/// turning it on resets the counts; the DSP chain is resorted at the next tick
+EXTERN void libpd_set_dspprofile(int on);
+
+/// profile report hook, called once per object, most expensive first:
+/// object's class name (or canvas name), name of containing subpatch, clone,
+/// or root canvas ("" if none), share of available CPU time (1 = 100%),
+/// and average time per DSP tick in microseconds
+/// note: subpatches, clones, and root canvases include everything in them
+typedef void (*t_libpd_profilehook)(const char *name, const char *owner,
+  double load, double usec);
+
+/// report the current profile through the given hook
+/// returns the number of objects reported or -1 if profiling is off
+EXTERN int libpd_get_dspprofile(const t_libpd_profilehook hook);
+
 #ifdef __cplusplus
 }
 #endif
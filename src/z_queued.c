@@ -12,9 +12,20 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 
 #include "z_ringbuffer.h"
 
+#ifdef _WIN32
+  #include <windows.h>
+#elif defined(__APPLE__)
+  #include <dispatch/dispatch.h>
+#else
+  #include <semaphore.h>
+  #include <time.h>
+  #include <errno.h>
+#endif
+
 t_libpd_printhook libpd_queued_printhook = NULL;
 t_libpd_banghook libpd_queued_banghook = NULL;
 t_libpd_floathook libpd_queued_floathook = NULL;
@@ -22,6 +33,12 @@ t_libpd_symbolhook libpd_queued_symbolhook = NULL;
 t_libpd_listhook libpd_queued_listhook = NULL;
 t_libpd_messagehook libpd_queued_messagehook = NULL;
 
+t_libpd_contextbanghook libpd_queued_contextbanghook = NULL;
+t_libpd_contextfloathook libpd_queued_contextfloathook = NULL;
+t_libpd_contextsymbolhook libpd_queued_contextsymbolhook = NULL;
+t_libpd_contextlisthook libpd_queued_contextlisthook = NULL;
+t_libpd_contextmessagehook libpd_queued_contextmessagehook = NULL;
+
 t_libpd_noteonhook libpd_queued_noteonhook = NULL;
 t_libpd_controlchangehook libpd_queued_controlchangehook = NULL;
 t_libpd_programchangehook libpd_queued_programchangehook = NULL;
@@ -34,11 +51,14 @@ typedef struct _pd_params {
   enum {
     LIBPD_PRINT, LIBPD_BANG, LIBPD_FLOAT,
     LIBPD_SYMBOL, LIBPD_LIST, LIBPD_MESSAGE,
+    LIBPD_CONTEXTBANG, LIBPD_CONTEXTFLOAT, LIBPD_CONTEXTSYMBOL,
+    LIBPD_CONTEXTLIST, LIBPD_CONTEXTMESSAGE,
   } type;
   const char *src;
   float x;
   const char *sym;
   int argc;
+  void *context; // for the context types, instead of src
 } pd_params;
 
 typedef struct _midi_params {
@@ -52,12 +72,109 @@ typedef struct _midi_params {
 } midi_params;
 
 #define BUFFER_SIZE 16384
+#define MIDI_QUEUE_SLOTS 1024 // must be a power of 2
+#define MIDI_BATCH 64 // number of MIDI messages dequeued at once
 #define S_PD_PARAMS sizeof(pd_params)
 #define S_MIDI_PARAMS sizeof(midi_params)
 #define S_ATOM sizeof(t_atom)
 
 static ring_buffer *pd_receive_buffer = NULL;
-static ring_buffer *midi_receive_buffer = NULL;
+static slot_queue *midi_receive_queue = NULL;
+
+// messages dropped because a queue was full; only written by the writer
+static int pd_overflows = 0;
+static int midi_overflows = 0;
+
+/* waking up a waiting receiver thread */
+
+// set by a receiver blocked in libpd_queued_wait(); the writer only makes a
+// system call (to post the semaphore) if this is set
+static int queued_waiting = 0;
+
+#ifdef _WIN32
+static HANDLE queued_sem = NULL;
+#elif defined(__APPLE__)
+static dispatch_semaphore_t queued_sem = NULL;
+#else
+static sem_t queued_sem;
+static int queued_sem_ok = 0;
+#endif
+
+static void queued_sem_init(void) {
+#ifdef _WIN32
+  if (!queued_sem) queued_sem = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+#elif defined(__APPLE__)
+  if (!queued_sem) queued_sem = dispatch_semaphore_create(0);
+#else
+  if (!queued_sem_ok) queued_sem_ok = (sem_init(&queued_sem, 0, 0) == 0);
+#endif
+}
+
+static void queued_sem_post(void) {
+#ifdef _WIN32
+  if (queued_sem) ReleaseSemaphore(queued_sem, 1, NULL);
+#elif defined(__APPLE__)
+  if (queued_sem) dispatch_semaphore_signal(queued_sem);
+#else
+  if (queued_sem_ok) sem_post(&queued_sem);
+#endif
+}
+
+// wait for a post or the timeout (msec, < 0 for none)
+static void queued_sem_wait(int msec) {
+#ifdef _WIN32
+  if (queued_sem)
+    WaitForSingleObject(queued_sem, msec < 0 ? INFINITE : (DWORD)msec);
+#elif defined(__APPLE__)
+  if (queued_sem)
+    dispatch_semaphore_wait(queued_sem, msec < 0 ? DISPATCH_TIME_FOREVER :
+      dispatch_time(DISPATCH_TIME_NOW, (int64_t)msec * 1000000));
+#else
+  if (!queued_sem_ok) return;
+  if (msec < 0) {
+    while (sem_wait(&queued_sem) < 0 && errno == EINTR)
+      ;
+  } else {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += msec / 1000;
+    ts.tv_nsec += (long)(msec % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000;
+    }
+    while (sem_timedwait(&queued_sem, &ts) < 0 && errno == EINTR)
+      ;
+  }
+#endif
+}
+
+// called by the writer after each message is queued
+static void queued_wakeup(void) {
+  if (rb_sync_fetch(&queued_waiting)) {
+    rb_sync_cas(&queued_waiting, 1, 0);
+    queued_sem_post();
+  }
+}
+
+static int queued_available(void) {
+  if (!pd_receive_buffer || !midi_receive_queue) return 0;
+  return rb_available_to_read(pd_receive_buffer) > 0 ||
+    sq_available_to_read(midi_receive_queue) > 0;
+}
+
+// write a pd message, counting it if there's no room
+#define PD_WRITE(_size, ...) \
+  if (rb_available_to_write(pd_receive_buffer) >= (int)(_size)) { \
+    rb_write_to_buffer(pd_receive_buffer, __VA_ARGS__); \
+    queued_wakeup(); \
+  } \
+  else pd_overflows++;
+
+// write a MIDI message, counting it if there's no room
+#define MIDI_WRITE(_p) \
+  if (sq_write(midi_receive_queue, &(_p)) == 0) queued_wakeup(); \
+  else midi_overflows++;
 
 static void receive_print(pd_params *p, char **buffer) {
   if (libpd_queued_printhook) {
@@ -98,6 +215,39 @@ static void receive_message(pd_params *p, char **buffer) {
   *buffer += p->argc * S_ATOM;
 }
 
+static void receive_contextbang(pd_params *p, char **buffer) {
+  if (libpd_queued_contextbanghook) {
+    libpd_queued_contextbanghook(p->context);
+  }
+}
+
+static void receive_contextfloat(pd_params *p, char **buffer) {
+  if (libpd_queued_contextfloathook) {
+    libpd_queued_contextfloathook(p->context, p->x);
+  }
+}
+
+static void receive_contextsymbol(pd_params *p, char **buffer) {
+  if (libpd_queued_contextsymbolhook) {
+    libpd_queued_contextsymbolhook(p->context, p->sym);
+  }
+}
+
+static void receive_contextlist(pd_params *p, char **buffer) {
+  if (libpd_queued_contextlisthook) {
+    libpd_queued_contextlisthook(p->context, p->argc, (t_atom *) *buffer);
+  }
+  *buffer += p->argc * S_ATOM;
+}
+
+static void receive_contextmessage(pd_params *p, char **buffer) {
+  if (libpd_queued_contextmessagehook) {
+    libpd_queued_contextmessagehook(p->context, p->sym,
+      p->argc, (t_atom *) *buffer);
+  }
+  *buffer += p->argc * S_ATOM;
+}
+
 #define LIBPD_WORD_ALIGN 8
 
 static void internal_printhook(const char *s) {
@@ -106,51 +256,69 @@ static void internal_printhook(const char *s) {
   int rest = len % LIBPD_WORD_ALIGN;
   if (rest) rest = LIBPD_WORD_ALIGN - rest;
   int total = len + rest;
-  if (rb_available_to_write(pd_receive_buffer) >= S_PD_PARAMS + total) {
-    pd_params p = {LIBPD_PRINT, NULL, 0.0f, NULL, total};
-    rb_write_to_buffer(pd_receive_buffer, 3,
-        (const char *)&p, S_PD_PARAMS, s, len, padding, rest);
-  }
+  pd_params p = {LIBPD_PRINT, NULL, 0.0f, NULL, total, NULL};
+  PD_WRITE(S_PD_PARAMS + total, 3,
+      (const char *)&p, S_PD_PARAMS, s, len, padding, rest)
 }
 
 static void internal_banghook(const char *src) {
-  if (rb_available_to_write(pd_receive_buffer) >= S_PD_PARAMS) {
-    pd_params p = {LIBPD_BANG, src, 0.0f, NULL, 0};
-    rb_write_to_buffer(pd_receive_buffer, 1, (const char *)&p, S_PD_PARAMS);
-  }
+  pd_params p = {LIBPD_BANG, src, 0.0f, NULL, 0, NULL};
+  PD_WRITE(S_PD_PARAMS, 1, (const char *)&p, S_PD_PARAMS)
 }
 
 static void internal_floathook(const char *src, float x) {
-  if (rb_available_to_write(pd_receive_buffer) >= S_PD_PARAMS) {
-    pd_params p = {LIBPD_FLOAT, src, x, NULL, 0};
-    rb_write_to_buffer(pd_receive_buffer, 1, (const char *)&p, S_PD_PARAMS);
-  }
+  pd_params p = {LIBPD_FLOAT, src, x, NULL, 0, NULL};
+  PD_WRITE(S_PD_PARAMS, 1, (const char *)&p, S_PD_PARAMS)
 }
 
 static void internal_symbolhook(const char *src, const char *sym) {
-  if (rb_available_to_write(pd_receive_buffer) >= S_PD_PARAMS) {
-    pd_params p = {LIBPD_SYMBOL, src, 0.0f, sym, 0};
-    rb_write_to_buffer(pd_receive_buffer, 1, (const char *)&p, S_PD_PARAMS);
-  }
+  pd_params p = {LIBPD_SYMBOL, src, 0.0f, sym, 0, NULL};
+  PD_WRITE(S_PD_PARAMS, 1, (const char *)&p, S_PD_PARAMS)
 }
 
 static void internal_listhook(const char *src, int argc, t_atom *argv) {
   int n = argc * S_ATOM;
-  if (rb_available_to_write(pd_receive_buffer) >= S_PD_PARAMS + n) {
-    pd_params p = {LIBPD_LIST, src, 0.0f, NULL, argc};
-    rb_write_to_buffer(pd_receive_buffer, 2,
-        (const char *)&p, S_PD_PARAMS, (const char *)argv, n);
-  }
+  pd_params p = {LIBPD_LIST, src, 0.0f, NULL, argc, NULL};
+  PD_WRITE(S_PD_PARAMS + n, 2,
+      (const char *)&p, S_PD_PARAMS, (const char *)argv, n)
 }
 
 static void internal_messagehook(const char *src, const char* sym,
     int argc, t_atom *argv) {
   int n = argc * S_ATOM;
-  if (rb_available_to_write(pd_receive_buffer) >= S_PD_PARAMS + n) {
-    pd_params p = {LIBPD_MESSAGE, src, 0.0f, sym, argc};
-    rb_write_to_buffer(pd_receive_buffer, 2,
-        (const char *)&p, S_PD_PARAMS, (const char *)argv, n);
-  }
+  pd_params p = {LIBPD_MESSAGE, src, 0.0f, sym, argc, NULL};
+  PD_WRITE(S_PD_PARAMS + n, 2,
+      (const char *)&p, S_PD_PARAMS, (const char *)argv, n)
+}
+
+static void internal_contextbanghook(void *context) {
+  pd_params p = {LIBPD_CONTEXTBANG, NULL, 0.0f, NULL, 0, context};
+  PD_WRITE(S_PD_PARAMS, 1, (const char *)&p, S_PD_PARAMS)
+}
+
+static void internal_contextfloathook(void *context, float x) {
+  pd_params p = {LIBPD_CONTEXTFLOAT, NULL, x, NULL, 0, context};
+  PD_WRITE(S_PD_PARAMS, 1, (const char *)&p, S_PD_PARAMS)
+}
+
+static void internal_contextsymbolhook(void *context, const char *sym) {
+  pd_params p = {LIBPD_CONTEXTSYMBOL, NULL, 0.0f, sym, 0, context};
+  PD_WRITE(S_PD_PARAMS, 1, (const char *)&p, S_PD_PARAMS)
+}
+
+static void internal_contextlisthook(void *context, int argc, t_atom *argv) {
+  int n = argc * S_ATOM;
+  pd_params p = {LIBPD_CONTEXTLIST, NULL, 0.0f, NULL, argc, context};
+  PD_WRITE(S_PD_PARAMS + n, 2,
+      (const char *)&p, S_PD_PARAMS, (const char *)argv, n)
+}
+
+static void internal_contextmessagehook(void *context, const char* sym,
+    int argc, t_atom *argv) {
+  int n = argc * S_ATOM;
+  pd_params p = {LIBPD_CONTEXTMESSAGE, NULL, 0.0f, sym, argc, context};
+  PD_WRITE(S_PD_PARAMS + n, 2,
+      (const char *)&p, S_PD_PARAMS, (const char *)argv, n)
 }
 
 static void receive_noteon(midi_params *p, char **buffer) {
@@ -196,52 +364,38 @@ static void receive_midibyte(midi_params *p, char **buffer) {
 }
 
 static void internal_noteonhook(int channel, int pitch, int velocity) {
-  if (rb_available_to_write(midi_receive_buffer) >= S_MIDI_PARAMS) {
-    midi_params p = {LIBPD_NOTEON, channel, pitch, velocity};
-    rb_write_to_buffer(midi_receive_buffer, 1, (const char *)&p, S_MIDI_PARAMS);
-  }
+  midi_params p = {LIBPD_NOTEON, channel, pitch, velocity};
+  MIDI_WRITE(p)
 }
 
 static void internal_controlchangehook(int channel, int controller, int value) {
-  if (rb_available_to_write(midi_receive_buffer) >= S_MIDI_PARAMS) {
-    midi_params p = {LIBPD_CONTROLCHANGE, channel, controller, value};
-    rb_write_to_buffer(midi_receive_buffer, 1, (const char *)&p, S_MIDI_PARAMS);
-  }
+  midi_params p = {LIBPD_CONTROLCHANGE, channel, controller, value};
+  MIDI_WRITE(p)
 }
 
 static void internal_programchangehook(int channel, int value) {
-  if (rb_available_to_write(midi_receive_buffer) >= S_MIDI_PARAMS) {
-    midi_params p = {LIBPD_PROGRAMCHANGE, channel, value, 0};
-    rb_write_to_buffer(midi_receive_buffer, 1, (const char *)&p, S_MIDI_PARAMS);
-  }
+  midi_params p = {LIBPD_PROGRAMCHANGE, channel, value, 0};
+  MIDI_WRITE(p)
 }
 
 static void internal_pitchbendhook(int channel, int value) {
-  if (rb_available_to_write(midi_receive_buffer) >= S_MIDI_PARAMS) {
-    midi_params p = {LIBPD_PITCHBEND, channel, value, 0};
-    rb_write_to_buffer(midi_receive_buffer, 1, (const char *)&p, S_MIDI_PARAMS);
-  }
+  midi_params p = {LIBPD_PITCHBEND, channel, value, 0};
+  MIDI_WRITE(p)
 }
 
 static void internal_aftertouchhook(int channel, int value) {
-  if (rb_available_to_write(midi_receive_buffer) >= S_MIDI_PARAMS) {
-    midi_params p = {LIBPD_AFTERTOUCH, channel, value, 0};
-    rb_write_to_buffer(midi_receive_buffer, 1, (const char *)&p, S_MIDI_PARAMS);
-  }
+  midi_params p = {LIBPD_AFTERTOUCH, channel, value, 0};
+  MIDI_WRITE(p)
 }
 
 static void internal_polyaftertouchhook(int channel, int pitch, int value) {
-  if (rb_available_to_write(midi_receive_buffer) >= S_MIDI_PARAMS) {
-    midi_params p = {LIBPD_POLYAFTERTOUCH, channel, pitch, value};
-    rb_write_to_buffer(midi_receive_buffer, 1, (const char *)&p, S_MIDI_PARAMS);
-  }
+  midi_params p = {LIBPD_POLYAFTERTOUCH, channel, pitch, value};
+  MIDI_WRITE(p)
 }
 
 static void internal_midibytehook(int port, int byte) {
-  if (rb_available_to_write(midi_receive_buffer) >= S_MIDI_PARAMS) {
-    midi_params p = {LIBPD_MIDIBYTE, port, byte, 0};
-    rb_write_to_buffer(midi_receive_buffer, 1, (const char *)&p, S_MIDI_PARAMS);
-  }
+  midi_params p = {LIBPD_MIDIBYTE, port, byte, 0};
+  MIDI_WRITE(p)
 }
 
 void libpd_set_queued_printhook(const t_libpd_printhook hook) {
@@ -268,6 +422,36 @@ void libpd_set_queued_messagehook(const t_libpd_messagehook hook) {
   libpd_queued_messagehook = hook;
 }
 
+// the context hooks are only queued while the host has set them, so that
+// messages for unset ones fall back to the named hooks as they do unqueued
+
+void libpd_set_queued_contextbanghook(const t_libpd_contextbanghook hook) {
+  libpd_queued_contextbanghook = hook;
+  libpd_set_contextbanghook(hook ? internal_contextbanghook : NULL);
+}
+
+void libpd_set_queued_contextfloathook(const t_libpd_contextfloathook hook) {
+  libpd_queued_contextfloathook = hook;
+  libpd_set_contextfloathook(hook ? internal_contextfloathook : NULL);
+}
+
+void libpd_set_queued_contextsymbolhook(
+    const t_libpd_contextsymbolhook hook) {
+  libpd_queued_contextsymbolhook = hook;
+  libpd_set_contextsymbolhook(hook ? internal_contextsymbolhook : NULL);
+}
+
+void libpd_set_queued_contextlisthook(const t_libpd_contextlisthook hook) {
+  libpd_queued_contextlisthook = hook;
+  libpd_set_contextlisthook(hook ? internal_contextlisthook : NULL);
+}
+
+void libpd_set_queued_contextmessagehook(
+    const t_libpd_contextmessagehook hook) {
+  libpd_queued_contextmessagehook = hook;
+  libpd_set_contextmessagehook(hook ? internal_contextmessagehook : NULL);
+}
+
 void libpd_set_queued_noteonhook(const t_libpd_noteonhook hook) {
   libpd_queued_noteonhook = hook;
 }
@@ -301,10 +485,11 @@ int libpd_queued_init() {
     pd_receive_buffer = rb_create(BUFFER_SIZE);
     if (!pd_receive_buffer) return -2;
   }
-  if (!midi_receive_buffer) {
-    midi_receive_buffer = rb_create(BUFFER_SIZE);
-    if (!midi_receive_buffer) return -2;
+  if (!midi_receive_queue) {
+    midi_receive_queue = sq_create(MIDI_QUEUE_SLOTS, S_MIDI_PARAMS);
+    if (!midi_receive_queue) return -2;
   }
+  queued_sem_init();
 
   libpd_set_printhook(internal_printhook);
   libpd_set_banghook(internal_banghook);
@@ -329,12 +514,26 @@ void libpd_queued_release() {
     rb_free(pd_receive_buffer);
     pd_receive_buffer = NULL;
   }
-  if (midi_receive_buffer) {
-    rb_free(midi_receive_buffer);
-    midi_receive_buffer = NULL;
+  if (midi_receive_queue) {
+    sq_free(midi_receive_queue);
+    midi_receive_queue = NULL;
   }
 }
 
+int libpd_queued_wait(int msec) {
+  if (queued_available()) return 1;
+  rb_sync_cas(&queued_waiting, 0, 1);
+    // check again in case a message came in before we set the flag
+  if (!queued_available()) queued_sem_wait(msec);
+  rb_sync_cas(&queued_waiting, 1, 0);
+  return queued_available();
+}
+
+void libpd_queued_get_overflows(int *pd, int *midi) {
+  if (pd) *pd = rb_sync_fetch(&pd_overflows);
+  if (midi) *midi = rb_sync_fetch(&midi_overflows);
+}
+
 void libpd_queued_receive_pd_messages() {
   size_t available = rb_available_to_read(pd_receive_buffer);
   if (!available) return;
@@ -370,6 +569,26 @@ void libpd_queued_receive_pd_messages() {
         receive_message(p, &buffer);
         break;
       }
+      case LIBPD_CONTEXTBANG: {
+        receive_contextbang(p, &buffer);
+        break;
+      }
+      case LIBPD_CONTEXTFLOAT: {
+        receive_contextfloat(p, &buffer);
+        break;
+      }
+      case LIBPD_CONTEXTSYMBOL: {
+        receive_contextsymbol(p, &buffer);
+        break;
+      }
+      case LIBPD_CONTEXTLIST: {
+        receive_contextlist(p, &buffer);
+        break;
+      }
+      case LIBPD_CONTEXTMESSAGE: {
+        receive_contextmessage(p, &buffer);
+        break;
+      }
       default:
         break;
     }
@@ -377,15 +596,13 @@ void libpd_queued_receive_pd_messages() {
 }
 
 void libpd_queued_receive_midi_messages() {
-  size_t available = rb_available_to_read(midi_receive_buffer);
-  if (!available) return;
-  static char temp_buffer[BUFFER_SIZE];
-  rb_read_from_buffer(midi_receive_buffer, temp_buffer, (int) available);
-  char *end = temp_buffer + available;
-  char *buffer = temp_buffer;
-  while (buffer < end) {
-    midi_params *p = (midi_params *)buffer;
-    buffer += S_MIDI_PARAMS;
+  midi_params batch[MIDI_BATCH];
+  int n, i;
+  if (!midi_receive_queue) return;
+  while ((n = sq_read(midi_receive_queue, batch, MIDI_BATCH)) > 0) {
+   for (i = 0; i < n; i++) {
+    midi_params *p = &batch[i];
+    char *buffer = NULL;
     switch (p->type) {
       case LIBPD_NOTEON: {
         receive_noteon(p, &buffer);
@@ -418,5 +635,6 @@ void libpd_queued_receive_midi_messages() {
       default:
         break;
     }
+   }
   }
 }
@@ -42,6 +42,31 @@ EXTERN void libpd_set_queued_listhook(const t_libpd_listhook hook);
 /// note: do not call this while DSP is running
 EXTERN void libpd_set_queued_messagehook(const t_libpd_messagehook hook);
 
+/// set the queued context bang receiver hook, NULL by default
+/// note: do not call this while DSP is running
+EXTERN void libpd_set_queued_contextbanghook(
+    const t_libpd_contextbanghook hook);
+
+/// set the queued context float receiver hook, NULL by default
+/// note: do not call this while DSP is running
+EXTERN void libpd_set_queued_contextfloathook(
+    const t_libpd_contextfloathook hook);
+
+/// set the queued context symbol receiver hook, NULL by default
+/// note: do not call this while DSP is running
+EXTERN void libpd_set_queued_contextsymbolhook(
+    const t_libpd_contextsymbolhook hook);
+
+/// set the queued context list receiver hook, NULL by default
+/// note: do not call this while DSP is running
+EXTERN void libpd_set_queued_contextlisthook(
+    const t_libpd_contextlisthook hook);
+
+/// set the queued context message receiver hook, NULL by default
+/// note: do not call this while DSP is running
+EXTERN void libpd_set_queued_contextmessagehook(
+    const t_libpd_contextmessagehook hook);
+
 /// set the queued MIDI note on hook, NULL by default
 /// note: do not call this while DSP is running
 EXTERN void libpd_set_queued_noteonhook(const t_libpd_noteonhook hook);
@@ -85,6 +110,16 @@ EXTERN void libpd_queued_receive_pd_messages();
 /// process and dispatch receive midi messages in MIDI message ringbuffer
 EXTERN void libpd_queued_receive_midi_messages();
 
+/// block the calling (receiver) thread until there are queued messages to
+/// dispatch or msec milliseconds have passed, msec < 0 waits indefinitely
+/// this lets a UI or network thread sleep instead of polling
+/// returns 1 if messages are available, 0 on timeout
+EXTERN int libpd_queued_wait(int msec);
+
+/// get the number of pd and MIDI messages dropped so far because the
+/// corresponding queue was full, either pointer may be NULL
+EXTERN void libpd_queued_get_overflows(int *pd, int *midi);
+
 #ifdef __cplusplus
 }
 #endif
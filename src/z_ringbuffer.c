@@ -29,7 +29,7 @@
     #include <windows.h>
     #define SYNC_FETCH(ptr) InterlockedOr(ptr, 0)
     #define SYNC_COMPARE_AND_SWAP(ptr, oldval, newval) \
-            InterlockedCompareExchange(ptr, oldval, newval)
+            InterlockedCompareExchange(ptr, newval, oldval)
   #else // gcc atomics
     #define SYNC_FETCH(ptr) __sync_fetch_and_or(ptr, 0)
     #define SYNC_COMPARE_AND_SWAP(ptr, oldval, newval) \
@@ -152,3 +152,70 @@ void rb_clear_buffer(ring_buffer *buffer) {
   SYNC_COMPARE_AND_SWAP(&(buffer->write_idx), buffer->write_idx, 0);
   }
 }
+
+slot_queue *sq_create(int n_slots, int slot_size) {
+  if (n_slots < 2 || (n_slots & (n_slots - 1)) || slot_size <= 0)
+    return NULL;
+  slot_queue *queue = malloc(sizeof(slot_queue));
+  if (!queue) return NULL;
+  queue->slots = calloc(n_slots, slot_size);
+  if (!queue->slots) {
+    free(queue);
+    return NULL;
+  }
+  queue->n_slots = n_slots;
+  queue->slot_size = slot_size;
+  queue->write_idx = 0;
+  queue->read_idx = 0;
+  return queue;
+}
+
+void sq_free(slot_queue *queue) {
+  free(queue->slots);
+  free(queue);
+}
+
+int sq_available_to_read(slot_queue *queue) {
+  if (queue) {
+    int read_idx = SYNC_FETCH(&(queue->read_idx));
+    int write_idx = SYNC_FETCH(&(queue->write_idx));
+    return (write_idx - read_idx) & (queue->n_slots - 1);
+  } else {
+    return 0;
+  }
+}
+
+int sq_write(slot_queue *queue, const void *slot) {
+  if (!queue) return -1;
+  int write_idx = queue->write_idx;  // no need for sync in writer thread
+  int next = (write_idx + 1) & (queue->n_slots - 1);
+  if (next == SYNC_FETCH(&(queue->read_idx))) return -1;  // full
+  memcpy(queue->slots + write_idx * queue->slot_size, slot, queue->slot_size);
+  SYNC_COMPARE_AND_SWAP(&(queue->write_idx), write_idx,
+      next);  // includes memory barrier
+  return 0;
+}
+
+int sq_read(slot_queue *queue, void *dest, int max) {
+  int available = sq_available_to_read(queue);  // also a memory barrier
+  if (available > max) available = max;
+  if (available <= 0) return 0;
+  int read_idx = queue->read_idx;  // no need for sync in reader thread
+  int first = queue->n_slots - read_idx;  // slots before wrap-around
+  if (first > available) first = available;
+  memcpy(dest, queue->slots + read_idx * queue->slot_size,
+    first * queue->slot_size);
+  memcpy((char *)dest + first * queue->slot_size, queue->slots,
+    (available - first) * queue->slot_size);
+  SYNC_COMPARE_AND_SWAP(&(queue->read_idx), read_idx,
+      (read_idx + available) & (queue->n_slots - 1));  // includes memory barrier
+  return available;
+}
+
+int rb_sync_fetch(int *ptr) {
+  return SYNC_FETCH(ptr);
+}
+
+void rb_sync_cas(int *ptr, int oldval, int newval) {
+  SYNC_COMPARE_AND_SWAP(ptr, oldval, newval);
+}
@@ -11,12 +11,17 @@
 #ifndef __Z_RING_BUFFER_H__
 #define __Z_RING_BUFFER_H__
 
+/// size of a cache line; indices written by different threads are kept this
+/// far apart so that the writer and reader don't slow each other down
+#define RB_CACHELINE 64
+
 /// simple lock-free ring buffer implementation for one writer thread
 /// and one consumer thread
 typedef struct ring_buffer {
     int size;
     char *buf_ptr;
     int write_idx;
+    char pad[RB_CACHELINE - sizeof(int)];
     int read_idx;
 } ring_buffer;
 
@@ -58,4 +63,45 @@ int rb_read_from_buffer(ring_buffer *buffer, char *dest, int len);
 /// this is safe to call from any thread
 void rb_clear_buffer(ring_buffer *buffer);
 
+/// lock-free queue of fixed-size slots for one writer thread and one
+/// consumer thread, for messages that all have the same size
+typedef struct slot_queue {
+    int write_idx;
+    char pad1[RB_CACHELINE - sizeof(int)];
+    int read_idx;
+    char pad2[RB_CACHELINE - sizeof(int)];
+    int n_slots;
+    int slot_size;
+    char *slots;
+} slot_queue;
+
+/// create a slot queue holding up to n_slots - 1 slots of slot_size bytes,
+/// n_slots must be a power of 2
+/// returns NULL on failure
+slot_queue *sq_create(int n_slots, int slot_size);
+
+/// free a slot queue
+void sq_free(slot_queue *queue);
+
+/// get the number of slots that can currently be read
+/// this is safe to call from any thread
+int sq_available_to_read(slot_queue *queue);
+
+/// copy one slot into the queue if there is room
+/// note: call this from a single writer thread only
+/// returns 0 on success or -1 if the queue is full
+int sq_write(slot_queue *queue, const void *slot);
+
+/// copy up to max slots from the queue into dest
+/// note: call this from a single reader thread only
+/// returns the number of slots read
+int sq_read(slot_queue *queue, void *dest, int max);
+
+/// atomically fetch an int shared between threads
+int rb_sync_fetch(int *ptr);
+
+/// atomically replace an int shared between threads if it equals oldval
+/// (includes a full memory barrier)
+void rb_sync_cas(int *ptr, int oldval, int newval);
+
 #endif
@@ -13,11 +13,15 @@ namespace eval ::pdtk_canvas:: {
     namespace export pdtk_canvas_popup
     namespace export pdtk_canvas_editmode
     namespace export pdtk_canvas_getscroll
+    namespace export pdtk_canvas_setextent
     namespace export pdtk_canvas_setparents
     namespace export pdtk_canvas_reflecttitle
     namespace export pdtk_canvas_menuclose
 }
 
+# the whole extent of canvases that pd only draws in part, by tkcanvas
+array set ::pdtk_canvas::extent {}
+
 # store the filename associated with this window,
 # so we can use it during menuclose
 array set ::pdtk_canvas::::window_fullname {}
@@ -120,8 +124,8 @@ proc pdtk_canvas_new {mytoplevel width height geometry editable} {
     set tkcanvas [tkcanvas_name $mytoplevel]
     canvas $tkcanvas -width $width -height $height \
         -highlightthickness 0 -scrollregion [list 0 0 $width $height] \
-        -xscrollcommand "$mytoplevel.xscroll set" \
-        -yscrollcommand "$mytoplevel.yscroll set" \
+        -xscrollcommand "::pdtk_canvas::scrolled $mytoplevel x" \
+        -yscrollcommand "::pdtk_canvas::scrolled $mytoplevel y" \
         -background white
     scrollbar $mytoplevel.xscroll -orient horizontal -command "$tkcanvas xview"
     scrollbar $mytoplevel.yscroll -orient vertical -command "$tkcanvas yview"
@@ -355,6 +359,20 @@ proc ::pdtk_canvas::pdtk_canvas_getscroll {tkcanvas} {
     set width [winfo width $tkcanvas]
 
     set bbox [$tkcanvas bbox all]
+    if {[info exists ::pdtk_canvas::extent($tkcanvas)]} {
+        set extent $::pdtk_canvas::extent($tkcanvas)
+        if {$bbox eq "" || [llength $bbox] != 4} {set bbox $extent}
+        foreach i {0 1} {
+            if {[lindex $extent $i] < [lindex $bbox $i]} {
+                lset bbox $i [lindex $extent $i]
+            }
+        }
+        foreach i {2 3} {
+            if {[lindex $extent $i] > [lindex $bbox $i]} {
+                lset bbox $i [lindex $extent $i]
+            }
+        }
+    }
     if {$bbox eq "" || [llength $bbox] != 4} {return}
     set xupperleft [lindex $bbox 0]
     set yupperleft [lindex $bbox 1]
@@ -384,6 +402,44 @@ proc ::pdtk_canvas::pdtk_canvas_getscroll {tkcanvas} {
     }
 }
 
+# pd leaves out objects that are far out of view in big patches, and tells
+# us how far they reach so we can scroll to them; with no extent given,
+# everything is drawn
+proc ::pdtk_canvas::pdtk_canvas_setextent {tkcanvas args} {
+    if {[llength $args] == 4} {
+        set ::pdtk_canvas::extent($tkcanvas) $args
+    } else {
+        array unset ::pdtk_canvas::extent $tkcanvas
+    }
+    pdtk_canvas_getscroll $tkcanvas
+    ::pdtk_canvas::scrolled [winfo toplevel $tkcanvas] {} {} {}
+}
+
+# the view changed: set the scrollbar, and if pd is still holding back
+# objects, tell it (once things are idle) which part is visible now
+proc ::pdtk_canvas::scrolled {mytoplevel axis first last} {
+    if {$axis ne ""} {
+        $mytoplevel.${axis}scroll set $first $last
+    }
+    set tkcanvas [tkcanvas_name $mytoplevel]
+    if {[info exists ::pdtk_canvas::extent($tkcanvas)] && \
+            ![info exists ::pdtk_canvas::viewpending($mytoplevel)]} {
+        set ::pdtk_canvas::viewpending($mytoplevel) 1
+        after idle [list ::pdtk_canvas::sendviewport $mytoplevel]
+    }
+}
+
+proc ::pdtk_canvas::sendviewport {mytoplevel} {
+    unset -nocomplain ::pdtk_canvas::viewpending($mytoplevel)
+    set tkcanvas [tkcanvas_name $mytoplevel]
+    if {![winfo exists $tkcanvas]} {return}
+    set x1 [expr {int([$tkcanvas canvasx 0])}]
+    set y1 [expr {int([$tkcanvas canvasy 0])}]
+    set x2 [expr {$x1 + [winfo width $tkcanvas]}]
+    set y2 [expr {$y1 + [winfo height $tkcanvas]}]
+    pdsend "$mytoplevel viewport $x1 $y1 $x2 $y2"
+}
+
 proc ::pdtk_canvas::scroll {tkcanvas axis amount} {
     if {$axis eq "x" && $::xscrollable($tkcanvas) == 1} {
         $tkcanvas xview scroll [expr {- ($amount)}] units